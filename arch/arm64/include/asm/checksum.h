@@ -46,6 +46,13 @@ static inline __sum16 ip_fast_csum(const void *iph, unsigned int ihl)
 }
 #define ip_fast_csum ip_fast_csum
 
+extern unsigned int do_csum(const unsigned char *buff, int len);
+#define do_csum do_csum
+
+extern __wsum csum_partial_copy_nocheck(const void *src, void *dst, int len,
+					__wsum sum);
+#define csum_partial_copy_nocheck csum_partial_copy_nocheck
+
 #include <asm-generic/checksum.h>
 
 #endif	/* __ASM_CHECKSUM_H */
@@ -0,0 +1,304 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * arch/arm64/kernel/probes/opt.c
+ *
+ * Kprobes jump optimization (optprobes) for ARM64
+ *
+ * An optimized kprobe replaces the probed instruction with a branch to a
+ * detour buffer, which saves the registers, calls the pre handlers, runs
+ * the probed instruction and branches back to the instruction following
+ * it, all without taking a debug exception.
+ */
+#include <linux/kprobes.h>
+#include <linux/kernel.h>
+#include <linux/bitops.h>
+#include <linux/list.h>
+#include <linux/sizes.h>
+#include <asm/cacheflush.h>
+#include <asm/insn.h>
+#include <asm/kprobes.h>
+#include <asm/ptrace.h>
+
+#define TMPL_OP_IDX		\
+	(optprobe_template_op_address - optprobe_template_entry)
+#define TMPL_CALL_IDX		\
+	(optprobe_template_call - optprobe_template_entry)
+#define TMPL_INSN_IDX		\
+	(optprobe_template_insn - optprobe_template_entry)
+#define TMPL_RET_IDX		\
+	(optprobe_template_ret - optprobe_template_entry)
+#define TMPL_END_IDX		\
+	(optprobe_template_end - optprobe_template_entry)
+
+/* Reserved in kernel text by kprobes_trampoline.S */
+extern char optinsn_slot[], optinsn_slot_end[];
+
+DEFINE_INSN_CACHE_OPS(arm64_optinsn);
+
+/*
+ * The insn cache allocates optinsn_slot page by page.  It is at most 16
+ * pages long, so a single word tracks the pages handed out.  Both hooks
+ * are called under the mutex of the cache.
+ */
+static unsigned long optinsn_pages_in_use;
+
+static void *__arm64_alloc_optinsn_page(void)
+{
+	unsigned long nr_pages = (optinsn_slot_end - optinsn_slot) / PAGE_SIZE;
+	unsigned long page;
+
+	page = find_first_zero_bit(&optinsn_pages_in_use, nr_pages);
+	if (page >= nr_pages)
+		return NULL;
+
+	__set_bit(page, &optinsn_pages_in_use);
+	return optinsn_slot + page * PAGE_SIZE;
+}
+
+static void __arm64_free_optinsn_page(void *page)
+{
+	__clear_bit(((char *)page - optinsn_slot) / PAGE_SIZE,
+		    &optinsn_pages_in_use);
+}
+
+struct kprobe_insn_cache kprobe_arm64_optinsn_slots = {
+	.mutex = __MUTEX_INITIALIZER(kprobe_arm64_optinsn_slots.mutex),
+	.pages = LIST_HEAD_INIT(kprobe_arm64_optinsn_slots.pages),
+	/* insn_size initialized later */
+	.alloc = __arm64_alloc_optinsn_page,
+	.free = __arm64_free_optinsn_page,
+	.nr_garbage = 0,
+};
+
+static bool in_branch_range(unsigned long pc, unsigned long addr)
+{
+	long offset = (long)addr - (long)pc;
+
+	return offset >= -SZ_128M && offset < SZ_128M;
+}
+
+/*
+ * The probed instruction is executed in the detour buffer, at another
+ * address than its own.  The PC-relative instructions (branches, ADR,
+ * ADRP, literal loads) are simulated rather than single-stepped out of
+ * line, and thus left without an instruction slot by arch_prepare_kprobe():
+ * these probes can't be optimized and keep using BRK.
+ */
+static bool can_optimize(struct kprobe *p)
+{
+	return p->ainsn.api.insn != NULL;
+}
+
+static void
+optimized_callback(struct optimized_kprobe *op, struct pt_regs *regs)
+{
+	struct kprobe_ctlblk *kcb = get_kprobe_ctlblk();
+	unsigned long flags;
+
+	/* This is possible if op is under delayed unoptimizing */
+	if (kprobe_disabled(&op->kp))
+		return;
+
+	local_irq_save(flags);
+
+	if (kprobe_running()) {
+		kprobes_inc_nmissed_count(&op->kp);
+	} else {
+		__this_cpu_write(current_kprobe, &op->kp);
+		regs->pc = (unsigned long)op->kp.addr;
+		regs->orig_x0 = ~0UL;
+		kcb->kprobe_status = KPROBE_HIT_ACTIVE;
+		opt_pre_handler(&op->kp, regs);
+		__this_cpu_write(current_kprobe, NULL);
+	}
+
+	local_irq_restore(flags);
+}
+NOKPROBE_SYMBOL(optimized_callback);
+
+void arch_remove_optimized_kprobe(struct optimized_kprobe *op)
+{
+	if (op->optinsn.insn) {
+		free_arm64_optinsn_slot(op->optinsn.insn, 1);
+		op->optinsn.insn = NULL;
+	}
+}
+
+/*
+ * Generate the instructions loading a 64-bit immediate value into x0, the
+ * first argument of optimized_callback(), and write them at 'addr'.
+ */
+static int patch_imm64_load_insns(unsigned long val, kprobe_opcode_t *addr)
+{
+	enum aarch64_insn_movewide_type type = AARCH64_INSN_MOVEWIDE_ZERO;
+	int shift, ret;
+	u32 insn;
+
+	/* movz x0, #(val & 0xffff); movk x0, #..., lsl #16/#32/#48 */
+	for (shift = 0; shift < 64; shift += 16) {
+		insn = aarch64_insn_gen_movewide(AARCH64_INSN_REG_0,
+						 (val >> shift) & 0xffff,
+						 shift,
+						 AARCH64_INSN_VARIANT_64BIT,
+						 type);
+		ret = aarch64_insn_write(addr++, insn);
+		if (ret)
+			return ret;
+		type = AARCH64_INSN_MOVEWIDE_KEEP;
+	}
+
+	return 0;
+}
+
+static int patch_branch_insn(kprobe_opcode_t *addr, unsigned long target,
+			     enum aarch64_insn_branch_type type)
+{
+	return aarch64_insn_write(addr,
+			aarch64_insn_gen_branch_imm((unsigned long)addr,
+						    target, type));
+}
+
+int arch_prepare_optimized_kprobe(struct optimized_kprobe *op, struct kprobe *p)
+{
+	unsigned long buff_addr, next = (unsigned long)p->addr +
+					sizeof(kprobe_opcode_t);
+	kprobe_opcode_t *buff;
+	u32 insn;
+	int i, ret;
+
+	kprobe_arm64_optinsn_slots.insn_size = MAX_OPTINSN_SIZE;
+
+	if (!can_optimize(p))
+		return -EILSEQ;
+
+	/* Allocate instruction slot for detour buffer */
+	buff = get_arm64_optinsn_slot();
+	if (!buff)
+		return -ENOMEM;
+	buff_addr = (unsigned long)buff;
+
+	/*
+	 * The probed address branches to the detour buffer, which branches
+	 * back to the next instruction: both need the buffer to be within
+	 * the 128MB range of the B instruction.  That is always the case in
+	 * kernel text, not necessarily in modules.
+	 */
+	if (!in_branch_range((unsigned long)p->addr, buff_addr) ||
+	    !in_branch_range(buff_addr + TMPL_RET_IDX * AARCH64_INSN_SIZE,
+			     next) ||
+	    !in_branch_range(buff_addr + TMPL_CALL_IDX * AARCH64_INSN_SIZE,
+			     (unsigned long)optimized_callback)) {
+		ret = -ERANGE;
+		goto error;
+	}
+
+	/* Setup template, the buffer is read-only kernel text */
+	for (i = 0; i < TMPL_END_IDX; i++) {
+		ret = aarch64_insn_read(optprobe_template_entry + i, &insn);
+		if (!ret)
+			ret = aarch64_insn_write(buff + i, insn);
+		if (ret)
+			goto error;
+	}
+
+	/*
+	 * Fixup the template with instructions to:
+	 * 1. load the address of the optimized_kprobe
+	 */
+	ret = patch_imm64_load_insns((unsigned long)op, buff + TMPL_OP_IDX);
+	if (ret)
+		goto error;
+
+	/* 2. call optimized_callback() */
+	ret = patch_branch_insn(buff + TMPL_CALL_IDX,
+				(unsigned long)optimized_callback,
+				AARCH64_INSN_BRANCH_LINK);
+	if (ret)
+		goto error;
+
+	/* 3. execute the probed instruction */
+	ret = aarch64_insn_write(buff + TMPL_INSN_IDX, p->opcode);
+	if (ret)
+		goto error;
+
+	/* 4. branch back from trampoline */
+	ret = patch_branch_insn(buff + TMPL_RET_IDX, next,
+				AARCH64_INSN_BRANCH_NOLINK);
+	if (ret)
+		goto error;
+
+	flush_icache_range(buff_addr, (unsigned long)&buff[TMPL_END_IDX]);
+
+	op->optinsn.insn = buff;
+	return 0;
+
+error:
+	free_arm64_optinsn_slot(buff, 0);
+	return ret;
+}
+
+int arch_prepared_optinsn(struct arch_optimized_insn *optinsn)
+{
+	return optinsn->insn != NULL;
+}
+
+/*
+ * On ARM64, optprobes always replace one instruction (4 bytes aligned
+ * and 4 bytes long).  It is impossible to encounter another kprobe in
+ * this address range, so always return 0.
+ */
+int arch_check_optimized_kprobe(struct optimized_kprobe *op)
+{
+	return 0;
+}
+
+void arch_optimize_kprobes(struct list_head *oplist)
+{
+	struct optimized_kprobe *op, *tmp;
+	void *addrs[1];
+	u32 insns[1];
+
+	list_for_each_entry_safe(op, tmp, oplist, list) {
+		WARN_ON(kprobe_disabled(&op->kp));
+
+		/*
+		 * Replacing the BRK with a B is safe without stopping the
+		 * machine, aarch64_insn_patch_text() only syncs the caches.
+		 */
+		addrs[0] = op->kp.addr;
+		insns[0] = aarch64_insn_gen_branch_imm(
+				(unsigned long)op->kp.addr,
+				(unsigned long)op->optinsn.insn,
+				AARCH64_INSN_BRANCH_NOLINK);
+		aarch64_insn_patch_text(addrs, insns, 1);
+
+		list_del_init(&op->list);
+	}
+}
+
+void arch_unoptimize_kprobe(struct optimized_kprobe *op)
+{
+	arch_arm_kprobe(&op->kp);
+}
+
+/*
+ * Recover original instructions and breakpoints from relative jumps.
+ * Caller must call with locking kprobe_mutex.
+ */
+void arch_unoptimize_kprobes(struct list_head *oplist,
+			     struct list_head *done_list)
+{
+	struct optimized_kprobe *op, *tmp;
+
+	list_for_each_entry_safe(op, tmp, oplist, list) {
+		arch_unoptimize_kprobe(op);
+		list_move(&op->list, done_list);
+	}
+}
+
+int arch_within_optimized_kprobe(struct optimized_kprobe *op,
+				 unsigned long addr)
+{
+	return ((unsigned long)op->kp.addr <= addr &&
+		(unsigned long)op->kp.addr + RELATIVEJUMP_SIZE > addr);
+}
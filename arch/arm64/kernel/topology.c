@@ -54,7 +54,7 @@ static int __init get_cpu_for_node(struct device_node *node)
 }
 
 static int __init parse_core(struct device_node *core, int physical_id,
-			     int core_id)
+			     int cluster_id, int core_id)
 {
 	char name[10];
 	bool leaf = true;
@@ -70,6 +70,7 @@ static int __init parse_core(struct device_node *core, int physical_id,
 			cpu = get_cpu_for_node(t);
 			if (cpu >= 0) {
 				cpu_topology[cpu].physical_id = physical_id;
+				cpu_topology[cpu].cluster_id = cluster_id;
 				cpu_topology[cpu].core_id = core_id;
 				cpu_topology[cpu].thread_id = i;
 			} else {
@@ -92,6 +93,7 @@ static int __init parse_core(struct device_node *core, int physical_id,
 		}
 
 		cpu_topology[cpu].physical_id = physical_id;
+		cpu_topology[cpu].cluster_id = cluster_id;
 		cpu_topology[cpu].core_id = core_id;
 	} else if (leaf) {
 		pr_err("%pOF: Can't get CPU for leaf core\n", core);
@@ -108,13 +110,15 @@ static int __init parse_cluster(struct device_node *cluster, int depth)
 	bool has_cores = false;
 	struct device_node *c;
 	static int physical_id __initdata;
-	int core_id = 0;
+	static int cluster_id __initdata;
+	static int core_id __initdata;
 	int i, ret;
 
 	/*
-	 * First check for child clusters; we currently ignore any
-	 * information about the nesting of clusters and present the
-	 * scheduler with a flat list of them.
+	 * First check for child clusters.  The clusters at the top of the
+	 * cpu-map are the packages; the leaf clusters nested in them are
+	 * presented to the scheduler as a flat list of clusters, which
+	 * usually share an L2.  A leaf package has no cluster.
 	 */
 	i = 0;
 	do {
@@ -146,7 +150,9 @@ static int __init parse_cluster(struct device_node *cluster, int depth)
 			}
 
 			if (leaf) {
-				ret = parse_core(c, physical_id, core_id++);
+				ret = parse_core(c, physical_id,
+						 depth > 1 ? cluster_id : -1,
+						 core_id++);
 			} else {
 				pr_err("%pOF: Non-leaf cluster with core %s\n",
 				       cluster, name);
@@ -163,8 +169,13 @@ static int __init parse_cluster(struct device_node *cluster, int depth)
 	if (leaf && !has_cores)
 		pr_warn("%pOF: empty cluster\n", cluster);
 
-	if (leaf)
+	if (leaf && depth > 1)
+		cluster_id++;
+
+	if (depth == 1) {
 		physical_id++;
+		core_id = 0;
+	}
 
 	return 0;
 }
@@ -221,6 +232,11 @@ const struct cpumask *cpu_coregroup_mask(int cpu)
 	return &cpu_topology[cpu].core_sibling;
 }
 
+const struct cpumask *cpu_clustergroup_mask(int cpu)
+{
+	return &cpu_topology[cpu].cluster_sibling;
+}
+
 static void update_siblings_masks(unsigned int cpuid)
 {
 	struct cpu_topology *cpu_topo, *cpuid_topo = &cpu_topology[cpuid];
@@ -237,12 +253,22 @@ static void update_siblings_masks(unsigned int cpuid)
 		if (cpu != cpuid)
 			cpumask_set_cpu(cpu, &cpuid_topo->core_sibling);
 
+		if (cpuid_topo->cluster_id != -1 &&
+		    cpuid_topo->cluster_id == cpu_topo->cluster_id) {
+			cpumask_set_cpu(cpuid, &cpu_topo->cluster_sibling);
+			cpumask_set_cpu(cpu, &cpuid_topo->cluster_sibling);
+		}
+
 		if (cpuid_topo->core_id != cpu_topo->core_id)
 			continue;
 
+		/* The threads of a core always share its cluster */
 		cpumask_set_cpu(cpuid, &cpu_topo->thread_sibling);
-		if (cpu != cpuid)
+		cpumask_set_cpu(cpuid, &cpu_topo->cluster_sibling);
+		if (cpu != cpuid) {
 			cpumask_set_cpu(cpu, &cpuid_topo->thread_sibling);
+			cpumask_set_cpu(cpu, &cpuid_topo->cluster_sibling);
+		}
 	}
 }
 
@@ -293,10 +319,13 @@ static void __init reset_cpu_topology(void)
 
 		cpu_topo->thread_id = -1;
 		cpu_topo->core_id = 0;
+		cpu_topo->cluster_id = -1;
 		cpu_topo->physical_id = -1;
 
 		cpumask_clear(&cpu_topo->core_sibling);
 		cpumask_set_cpu(cpu, &cpu_topo->core_sibling);
+		cpumask_clear(&cpu_topo->cluster_sibling);
+		cpumask_set_cpu(cpu, &cpu_topo->cluster_sibling);
 		cpumask_clear(&cpu_topo->thread_sibling);
 		cpumask_set_cpu(cpu, &cpu_topo->thread_sibling);
 	}
@@ -324,11 +353,15 @@ static int __init parse_acpi_topology(void)
 			cpu_topology[cpu].thread_id = topology_id;
 			topology_id = find_acpi_cpu_topology(cpu, 1);
 			cpu_topology[cpu].core_id   = topology_id;
+			topology_id = find_acpi_cpu_topology_cluster(cpu, 1);
+			cpu_topology[cpu].cluster_id = topology_id;
 			topology_id = find_acpi_cpu_topology_package(cpu);
 			cpu_topology[cpu].physical_id = topology_id;
 		} else {
 			cpu_topology[cpu].thread_id  = -1;
 			cpu_topology[cpu].core_id    = topology_id;
+			topology_id = find_acpi_cpu_topology_cluster(cpu, 0);
+			cpu_topology[cpu].cluster_id = topology_id;
 			topology_id = find_acpi_cpu_topology_package(cpu);
 			cpu_topology[cpu].physical_id = topology_id;
 		}
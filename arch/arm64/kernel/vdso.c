@@ -221,6 +221,7 @@ int arch_setup_additional_pages(struct linux_binprm *bprm,
 void update_vsyscall(struct timekeeper *tk)
 {
 	u32 use_syscall = !tk->tkr_mono.clock->archdata.vdso_direct;
+	struct timespec64 btm = ktime_to_timespec64(tk->offs_boot);
 
 	++vdso_data->tb_seq_count;
 	smp_wmb();
@@ -231,6 +232,9 @@ void update_vsyscall(struct timekeeper *tk)
 							tk->tkr_mono.shift;
 	vdso_data->wtm_clock_sec		= tk->wall_to_monotonic.tv_sec;
 	vdso_data->wtm_clock_nsec		= tk->wall_to_monotonic.tv_nsec;
+	vdso_data->btm_clock_sec		= btm.tv_sec;
+	vdso_data->btm_clock_nsec		= btm.tv_nsec;
+	vdso_data->tai_offset			= tk->tai_offset;
 
 	if (!use_syscall) {
 		/* tkr_mono.cycle_last == tkr_raw.cycle_last */
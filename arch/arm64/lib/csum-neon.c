@@ -0,0 +1,68 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * NEON loops of the arm64 IP checksums, see csum.c
+ *
+ * Called between kernel_neon_begin() and kernel_neon_end(), on a multiple
+ * of 64 bytes.  The 32-bit words are added pairwise into the 64-bit lanes
+ * of four accumulators, which cannot overflow for an int length.  The
+ * result is a 64-bit value with the one's complement sum of the data.
+ */
+
+#include <arm_neon.h>
+
+static inline unsigned long csum_neon_fold(uint64x2_t acc0, uint64x2_t acc1,
+					   uint64x2_t acc2, uint64x2_t acc3)
+{
+	unsigned long lo, sum;
+
+	acc0 = vaddq_u64(vaddq_u64(acc0, acc1), vaddq_u64(acc2, acc3));
+	lo = vgetq_lane_u64(acc0, 0);
+	sum = lo + vgetq_lane_u64(acc0, 1);
+	return sum + (sum < lo);
+}
+
+unsigned long csum_neon(const unsigned char *src, int len)
+{
+	uint64x2_t acc0 = vdupq_n_u64(0), acc1 = acc0, acc2 = acc0, acc3 = acc0;
+	const uint32_t *s = (const uint32_t *)src;
+
+	do {
+		acc0 = vpadalq_u32(acc0, vld1q_u32(s));
+		acc1 = vpadalq_u32(acc1, vld1q_u32(s + 4));
+		acc2 = vpadalq_u32(acc2, vld1q_u32(s + 8));
+		acc3 = vpadalq_u32(acc3, vld1q_u32(s + 12));
+		s += 16;
+		len -= 64;
+	} while (len);
+
+	return csum_neon_fold(acc0, acc1, acc2, acc3);
+}
+
+unsigned long csum_copy_neon(const unsigned char *src, unsigned char *dst,
+			     int len)
+{
+	uint64x2_t acc0 = vdupq_n_u64(0), acc1 = acc0, acc2 = acc0, acc3 = acc0;
+	const uint32_t *s = (const uint32_t *)src;
+	uint32_t *d = (uint32_t *)dst;
+	uint32x4_t d0, d1, d2, d3;
+
+	do {
+		d0 = vld1q_u32(s);
+		d1 = vld1q_u32(s + 4);
+		d2 = vld1q_u32(s + 8);
+		d3 = vld1q_u32(s + 12);
+		vst1q_u32(d, d0);
+		vst1q_u32(d + 4, d1);
+		vst1q_u32(d + 8, d2);
+		vst1q_u32(d + 12, d3);
+		acc0 = vpadalq_u32(acc0, d0);
+		acc1 = vpadalq_u32(acc1, d1);
+		acc2 = vpadalq_u32(acc2, d2);
+		acc3 = vpadalq_u32(acc3, d3);
+		s += 16;
+		d += 16;
+		len -= 64;
+	} while (len);
+
+	return csum_neon_fold(acc0, acc1, acc2, acc3);
+}
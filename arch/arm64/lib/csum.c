@@ -0,0 +1,147 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * IP checksums for arm64
+ *
+ * The data is summed as 64-bit words into 128-bit accumulators, whose
+ * upper halves count the carries: as 2^64 is 1 modulo 0xffff, the two
+ * halves are then added with an end-around carry, giving a value with the
+ * one's complement sum of the 16-bit words.  From CSUM_NEON_THRESHOLD
+ * bytes, the bulk of the data is summed with NEON if it may be used.
+ *
+ * do_csum() backs csum_partial() and ip_compute_csum() of lib/checksum.c,
+ * csum_partial_copy_nocheck() sums the data as it copies it.
+ */
+
+#include <linux/compiler.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/types.h>
+#include <asm/checksum.h>
+#include <asm/neon.h>
+#include <asm/simd.h>
+#include <asm/unaligned.h>
+
+#define CSUM_NEON_THRESHOLD	512
+
+/* csum-neon.c, on a multiple of 64 bytes */
+unsigned long csum_neon(const unsigned char *src, int len);
+unsigned long csum_copy_neon(const unsigned char *src, unsigned char *dst,
+			     int len);
+
+static inline u64 csum_add64(u64 sum, u64 x)
+{
+	sum += x;
+	return sum + (sum < x);
+}
+
+static inline u64 csum_fold128(__uint128_t acc)
+{
+	return csum_add64((u64)acc, (u64)(acc >> 64));
+}
+
+static inline u32 csum_from64to32(u64 sum)
+{
+	sum += (sum >> 32) | (sum << 32);
+	return sum >> 32;
+}
+
+static inline unsigned int csum_from64to16(u64 sum)
+{
+	u32 s = csum_from64to32(sum);
+
+	s += (s >> 16) | (s << 16);
+	return s >> 16;
+}
+
+/* Adds the @len bytes at @src to @sum, copying them to @dst if not NULL */
+static __always_inline u64 csum_words(const unsigned char *src,
+				      unsigned char *dst, int len, u64 sum)
+{
+	__uint128_t acc0 = sum, acc1 = 0;
+	u64 w0, w1, w2, w3;
+
+	while (len >= 32) {
+		w0 = get_unaligned((const u64 *)src);
+		w1 = get_unaligned((const u64 *)(src + 8));
+		w2 = get_unaligned((const u64 *)(src + 16));
+		w3 = get_unaligned((const u64 *)(src + 24));
+		if (dst) {
+			put_unaligned(w0, (u64 *)dst);
+			put_unaligned(w1, (u64 *)(dst + 8));
+			put_unaligned(w2, (u64 *)(dst + 16));
+			put_unaligned(w3, (u64 *)(dst + 24));
+			dst += 32;
+		}
+		acc0 += w0;
+		acc1 += w1;
+		acc0 += w2;
+		acc1 += w3;
+		src += 32;
+		len -= 32;
+	}
+	while (len >= 8) {
+		w0 = get_unaligned((const u64 *)src);
+		if (dst) {
+			put_unaligned(w0, (u64 *)dst);
+			dst += 8;
+		}
+		acc0 += w0;
+		src += 8;
+		len -= 8;
+	}
+	if (len) {
+		/* the tail keeps its place in the word, in either endian */
+		w0 = 0;
+		memcpy(&w0, src, len);
+		if (dst)
+			memcpy(dst, src, len);
+		acc1 += w0;
+	}
+
+	return csum_add64(csum_fold128(acc0), csum_fold128(acc1));
+}
+
+unsigned int do_csum(const unsigned char *buff, int len)
+{
+	u64 sum = 0;
+
+	if (len <= 0)
+		return 0;
+
+	if (IS_ENABLED(CONFIG_KERNEL_MODE_NEON) &&
+	    len >= CSUM_NEON_THRESHOLD && may_use_simd()) {
+		int n = len & ~63;
+
+		kernel_neon_begin();
+		sum = csum_neon(buff, n);
+		kernel_neon_end();
+		buff += n;
+		len -= n;
+	}
+
+	return csum_from64to16(csum_words(buff, NULL, len, sum));
+}
+
+__wsum csum_partial_copy_nocheck(const void *src, void *dst, int len,
+				 __wsum sum)
+{
+	u64 sum64 = (__force u32)sum;
+
+	if (len <= 0)
+		return sum;
+
+	if (IS_ENABLED(CONFIG_KERNEL_MODE_NEON) &&
+	    len >= CSUM_NEON_THRESHOLD && may_use_simd()) {
+		int n = len & ~63;
+
+		kernel_neon_begin();
+		sum64 = csum_add64(sum64, csum_copy_neon(src, dst, n));
+		kernel_neon_end();
+		src += n;
+		dst += n;
+		len -= n;
+	}
+
+	sum64 = csum_words(src, dst, len, sum64);
+	return (__force __wsum)csum_from64to32(sum64);
+}
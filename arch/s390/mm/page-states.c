@@ -257,6 +257,7 @@ int arch_test_page_nodat(struct page *page)
 void arch_set_page_states(int make_stable)
 {
 	unsigned long flags, order, t;
+	struct zone_shard *shard;
 	struct list_head *l;
 	struct page *page;
 	struct zone *zone;
@@ -266,16 +267,21 @@ void arch_set_page_states(int make_stable)
 	if (make_stable)
 		drain_local_pages(NULL);
 	for_each_populated_zone(zone) {
-		spin_lock_irqsave(&zone->lock, flags);
-		for_each_migratetype_order(order, t) {
-			list_for_each(l, &zone->free_area[order].free_list[t]) {
-				page = list_entry(l, struct page, lru);
-				if (make_stable)
-					set_page_stable_dat(page, 0);
-				else
-					set_page_unused(page, order);
+		zone_lock_all_shards(zone, flags);
+		for_each_zone_shard(zone, shard) {
+			for_each_migratetype_order(order, t) {
+				struct free_area *area;
+
+				area = &shard->free_area[order];
+				list_for_each(l, &area->free_list[t]) {
+					page = list_entry(l, struct page, lru);
+					if (make_stable)
+						set_page_stable_dat(page, 0);
+					else
+						set_page_unused(page, order);
+				}
 			}
 		}
-		spin_unlock_irqrestore(&zone->lock, flags);
+		zone_unlock_all_shards(zone, flags);
 	}
 }
@@ -28,6 +28,7 @@
 #include <crypto/cryptd.h>
 #include <crypto/ctr.h>
 #include <crypto/b128ops.h>
+#include <crypto/gf128mul.h>
 #include <crypto/xts.h>
 #include <asm/cpu_device_id.h>
 #include <asm/fpu/api.h>
@@ -38,6 +39,7 @@
 #include <crypto/internal/skcipher.h>
 #include <linux/workqueue.h>
 #include <linux/spinlock.h>
+#include <asm/unaligned.h>
 #ifdef CONFIG_X86_64
 #include <asm/crypto/glue_helper.h>
 #endif
@@ -58,12 +60,14 @@
 struct aesni_rfc4106_gcm_ctx {
 	u8 hash_subkey[16] AESNI_ALIGN_ATTR;
 	struct crypto_aes_ctx aes_key_expanded AESNI_ALIGN_ATTR;
+	u8 hash_powers[16 * 16];
 	u8 nonce[4];
 };
 
 struct generic_gcmaes_ctx {
 	u8 hash_subkey[16] AESNI_ALIGN_ATTR;
 	struct crypto_aes_ctx aes_key_expanded AESNI_ALIGN_ATTR;
+	u8 hash_powers[16 * 16];
 };
 
 struct aesni_xts_ctx {
@@ -258,6 +262,66 @@ static void aesni_gcm_dec_avx2(void *ctx, u8 *out,
 }
 #endif
 
+#ifdef CONFIG_AS_VAES
+/*
+ * The VAES and VPCLMULQDQ versions of GCM and XTS, in 256- and 512-bit
+ * vectors, for the whole blocks of each step of the scatterlist walks.
+ * h_powers holds H^16 .. H^1, as computed by aesni_gcm_vaes_init_powers().
+ */
+struct aesni_gcm_vaes_state {
+	u8 ctr[16];
+	u8 ghash[16];
+};
+
+struct aesni_vaes_funcs {
+	void (*gcm_ghash)(const u8 *h_powers, u8 *ghash, const u8 *src,
+			  unsigned int len);
+	void (*gcm_enc_update)(const struct crypto_aes_ctx *ctx,
+			       const u8 *h_powers,
+			       struct aesni_gcm_vaes_state *state,
+			       const u8 *src, u8 *dst, unsigned int len);
+	void (*gcm_dec_update)(const struct crypto_aes_ctx *ctx,
+			       const u8 *h_powers,
+			       struct aesni_gcm_vaes_state *state,
+			       const u8 *src, u8 *dst, unsigned int len);
+	void (*xts_enc)(const struct crypto_aes_ctx *ctx, const u8 *src,
+			u8 *dst, unsigned int len, u8 *tweak);
+	void (*xts_dec)(const struct crypto_aes_ctx *ctx, const u8 *src,
+			u8 *dst, unsigned int len, u8 *tweak);
+};
+
+#define AESNI_VAES_FUNCS(suffix)					\
+asmlinkage void aesni_gcm_ghash_vaes_##suffix(const u8 *h_powers,	\
+		u8 *ghash, const u8 *src, unsigned int len);		\
+asmlinkage void aesni_gcm_enc_update_vaes_##suffix(			\
+		const struct crypto_aes_ctx *ctx, const u8 *h_powers,	\
+		struct aesni_gcm_vaes_state *state, const u8 *src,	\
+		u8 *dst, unsigned int len);				\
+asmlinkage void aesni_gcm_dec_update_vaes_##suffix(			\
+		const struct crypto_aes_ctx *ctx, const u8 *h_powers,	\
+		struct aesni_gcm_vaes_state *state, const u8 *src,	\
+		u8 *dst, unsigned int len);				\
+asmlinkage void aesni_xts_enc_vaes_##suffix(				\
+		const struct crypto_aes_ctx *ctx, const u8 *src,	\
+		u8 *dst, unsigned int len, u8 *tweak);			\
+asmlinkage void aesni_xts_dec_vaes_##suffix(				\
+		const struct crypto_aes_ctx *ctx, const u8 *src,	\
+		u8 *dst, unsigned int len, u8 *tweak);			\
+									\
+static const struct aesni_vaes_funcs aesni_vaes_##suffix = {		\
+	.gcm_ghash	= aesni_gcm_ghash_vaes_##suffix,		\
+	.gcm_enc_update	= aesni_gcm_enc_update_vaes_##suffix,		\
+	.gcm_dec_update	= aesni_gcm_dec_update_vaes_##suffix,		\
+	.xts_enc	= aesni_xts_enc_vaes_##suffix,			\
+	.xts_dec	= aesni_xts_dec_vaes_##suffix,			\
+}
+
+AESNI_VAES_FUNCS(avx2);
+AESNI_VAES_FUNCS(avx512);
+
+static const struct aesni_vaes_funcs *aesni_vaes __read_mostly;
+#endif
+
 static void (*aesni_gcm_enc_tfm)(void *ctx, u8 *out,
 			const u8 *in, unsigned long plaintext_len, u8 *iv,
 			u8 *hash_subkey, const u8 *aad, unsigned long aad_len,
@@ -600,11 +664,44 @@ static const struct common_glue_ctx aesni_dec_xts = {
 	} }
 };
 
+#ifdef CONFIG_AS_VAES
+/* Each step of the walk is done in a single call, the tweak running on. */
+static int xts_crypt_vaes(struct skcipher_request *req, bool enc)
+{
+	struct crypto_skcipher *tfm = crypto_skcipher_reqtfm(req);
+	struct aesni_xts_ctx *ctx = crypto_skcipher_ctx(tfm);
+	struct skcipher_walk walk;
+	u8 tweak[AES_BLOCK_SIZE];
+	unsigned int nbytes;
+	int err;
+
+	err = skcipher_walk_virt(&walk, req, true);
+	if (!walk.nbytes)
+		return err;
+
+	kernel_fpu_begin();
+	aesni_enc(aes_ctx(ctx->raw_tweak_ctx), tweak, walk.iv);
+	while ((nbytes = walk.nbytes)) {
+		(enc ? aesni_vaes->xts_enc : aesni_vaes->xts_dec)(
+			aes_ctx(ctx->raw_crypt_ctx), walk.src.virt.addr,
+			walk.dst.virt.addr, nbytes & AES_BLOCK_MASK, tweak);
+		err = skcipher_walk_done(&walk, nbytes & (AES_BLOCK_SIZE - 1));
+	}
+	kernel_fpu_end();
+
+	return err;
+}
+#endif
+
 static int xts_encrypt(struct skcipher_request *req)
 {
 	struct crypto_skcipher *tfm = crypto_skcipher_reqtfm(req);
 	struct aesni_xts_ctx *ctx = crypto_skcipher_ctx(tfm);
 
+#ifdef CONFIG_AS_VAES
+	if (aesni_vaes)
+		return xts_crypt_vaes(req, true);
+#endif
 	return glue_xts_req_128bit(&aesni_enc_xts, req,
 				   XTS_TWEAK_CAST(aesni_xts_tweak),
 				   aes_ctx(ctx->raw_tweak_ctx),
@@ -616,6 +713,10 @@ static int xts_decrypt(struct skcipher_request *req)
 	struct crypto_skcipher *tfm = crypto_skcipher_reqtfm(req);
 	struct aesni_xts_ctx *ctx = crypto_skcipher_ctx(tfm);
 
+#ifdef CONFIG_AS_VAES
+	if (aesni_vaes)
+		return xts_crypt_vaes(req, false);
+#endif
 	return glue_xts_req_128bit(&aesni_dec_xts, req,
 				   XTS_TWEAK_CAST(aesni_xts_tweak),
 				   aes_ctx(ctx->raw_tweak_ctx),
@@ -645,8 +746,38 @@ static void rfc4106_exit(struct crypto_aead *aead)
 	cryptd_free_aead(*ctx);
 }
 
+#ifdef CONFIG_AS_VAES
+/*
+ * Stores H^16 .. H^1 for the VAES GHASH: byte-reflected, shifted left by
+ * one bit and reduced by the bit-reflected GHASH polynomial.
+ */
+static void aesni_gcm_vaes_init_powers(u8 *hash_powers, const u8 *hash_subkey)
+{
+	be128 h, hp;
+	int i;
+
+	memcpy(&h, hash_subkey, sizeof(h));
+	hp = h;
+	for (i = 15; i >= 0; i--) {
+		u64 hi = be64_to_cpu(hp.a), lo = be64_to_cpu(hp.b);
+		u64 carry = hi >> 63;
+
+		hi = (hi << 1) | (lo >> 63);
+		lo <<= 1;
+		if (carry) {
+			hi ^= 0xc200000000000000ULL;
+			lo ^= 1;
+		}
+		put_unaligned_le64(lo, &hash_powers[i * 16]);
+		put_unaligned_le64(hi, &hash_powers[i * 16 + 8]);
+		gf128mul_lle(&hp, &h);
+	}
+}
+#endif
+
 static int
-rfc4106_set_hash_subkey(u8 *hash_subkey, const u8 *key, unsigned int key_len)
+rfc4106_set_hash_subkey(u8 *hash_subkey, u8 *hash_powers, const u8 *key,
+			unsigned int key_len)
 {
 	struct crypto_cipher *tfm;
 	int ret;
@@ -664,6 +795,10 @@ rfc4106_set_hash_subkey(u8 *hash_subkey, const u8 *key, unsigned int key_len)
 	memset(hash_subkey, 0, RFC4106_HASH_SUBKEY_SIZE);
 
 	crypto_cipher_encrypt_one(tfm, hash_subkey, hash_subkey);
+#ifdef CONFIG_AS_VAES
+	if (aesni_vaes)
+		aesni_gcm_vaes_init_powers(hash_powers, hash_subkey);
+#endif
 
 out_free_cipher:
 	crypto_free_cipher(tfm);
@@ -686,7 +821,8 @@ static int common_rfc4106_set_key(struct crypto_aead *aead, const u8 *key,
 
 	return aes_set_key_common(crypto_aead_tfm(aead),
 				  &ctx->aes_key_expanded, key, key_len) ?:
-	       rfc4106_set_hash_subkey(ctx->hash_subkey, key, key_len);
+	       rfc4106_set_hash_subkey(ctx->hash_subkey, ctx->hash_powers,
+				       key, key_len);
 }
 
 static int rfc4106_set_key(struct crypto_aead *parent, const u8 *key,
@@ -743,8 +879,147 @@ static int generic_gcmaes_set_authsize(struct crypto_aead *tfm,
 	return 0;
 }
 
+#ifdef CONFIG_AS_VAES
+/* Hashes the @assoclen bytes of associated data at the start of req->src */
+static void gcmaes_vaes_hash_assoc(struct aead_request *req,
+				   unsigned int assoclen, const u8 *hash_powers,
+				   u8 *ghash)
+{
+	struct scatter_walk walk;
+	u8 buf[AES_BLOCK_SIZE];
+	unsigned int buflen = 0;
+
+	if (!assoclen)
+		return;
+
+	scatterwalk_start(&walk, req->src);
+	do {
+		unsigned int n = scatterwalk_clamp(&walk, assoclen);
+		unsigned int left, len;
+		u8 *mapped, *p;
+
+		if (!n) {
+			scatterwalk_start(&walk, sg_next(walk.sg));
+			n = scatterwalk_clamp(&walk, assoclen);
+		}
+		mapped = p = scatterwalk_map(&walk);
+		left = n;
+
+		if (buflen) {
+			len = min_t(unsigned int, left,
+				    AES_BLOCK_SIZE - buflen);
+			memcpy(buf + buflen, p, len);
+			buflen += len;
+			p += len;
+			left -= len;
+			if (buflen == AES_BLOCK_SIZE) {
+				aesni_vaes->gcm_ghash(hash_powers, ghash, buf,
+						      AES_BLOCK_SIZE);
+				buflen = 0;
+			}
+		}
+		if (left >= AES_BLOCK_SIZE) {
+			len = left & AES_BLOCK_MASK;
+			aesni_vaes->gcm_ghash(hash_powers, ghash, p, len);
+			p += len;
+			left -= len;
+		}
+		if (left) {
+			memcpy(buf, p, left);
+			buflen = left;
+		}
+
+		assoclen -= n;
+		scatterwalk_unmap(mapped);
+		scatterwalk_advance(&walk, n);
+		scatterwalk_done(&walk, 0, assoclen);
+	} while (assoclen);
+
+	if (buflen) {
+		memset(buf + buflen, 0, AES_BLOCK_SIZE - buflen);
+		aesni_vaes->gcm_ghash(hash_powers, ghash, buf, AES_BLOCK_SIZE);
+	}
+}
+
+/*
+ * GCM on the scatterlists as they are: the whole blocks of each step of the
+ * walk are en/decrypted and hashed in a single call, only a final partial
+ * block is left to C.
+ */
+static int gcmaes_crypt_vaes(struct aead_request *req, unsigned int assoclen,
+			     const u8 *hash_powers, u8 *iv,
+			     struct crypto_aes_ctx *aes_ctx, bool enc)
+{
+	struct crypto_aead *tfm = crypto_aead_reqtfm(req);
+	unsigned int auth_tag_len = crypto_aead_authsize(tfm);
+	unsigned int cryptlen = req->cryptlen - (enc ? 0 : auth_tag_len);
+	struct aesni_gcm_vaes_state state;
+	u8 tag[AES_BLOCK_SIZE], buf[AES_BLOCK_SIZE];
+	struct skcipher_walk walk;
+	__be64 lengths[2];
+	unsigned int nbytes;
+	int err;
+
+	if (enc)
+		err = skcipher_walk_aead_encrypt(&walk, req, true);
+	else
+		err = skcipher_walk_aead_decrypt(&walk, req, true);
+	if (err)
+		return err;
+
+	memcpy(state.ctr, iv, AES_BLOCK_SIZE);
+	crypto_inc(state.ctr, AES_BLOCK_SIZE);
+	memset(state.ghash, 0, sizeof(state.ghash));
+
+	kernel_fpu_begin();
+	gcmaes_vaes_hash_assoc(req, assoclen, hash_powers, state.ghash);
+
+	while ((nbytes = walk.nbytes) >= AES_BLOCK_SIZE) {
+		(enc ? aesni_vaes->gcm_enc_update : aesni_vaes->gcm_dec_update)(
+			aes_ctx, hash_powers, &state, walk.src.virt.addr,
+			walk.dst.virt.addr, nbytes & AES_BLOCK_MASK);
+		err = skcipher_walk_done(&walk, nbytes & (AES_BLOCK_SIZE - 1));
+	}
+	if (walk.nbytes) {
+		/* buf: the last ciphertext block, padded with zeroes */
+		memset(buf, 0, sizeof(buf));
+		memcpy(buf, walk.src.virt.addr, nbytes);
+		aesni_enc(aes_ctx, tag, state.ctr);
+		crypto_xor_cpy(walk.dst.virt.addr, buf, tag, nbytes);
+		if (enc)
+			memcpy(buf, walk.dst.virt.addr, nbytes);
+		aesni_vaes->gcm_ghash(hash_powers, state.ghash, buf,
+				      AES_BLOCK_SIZE);
+		err = skcipher_walk_done(&walk, 0);
+	}
+
+	lengths[0] = cpu_to_be64((u64)assoclen * 8);
+	lengths[1] = cpu_to_be64((u64)cryptlen * 8);
+	aesni_vaes->gcm_ghash(hash_powers, state.ghash, (u8 *)lengths,
+			      sizeof(lengths));
+	aesni_enc(aes_ctx, tag, iv);
+	kernel_fpu_end();
+
+	if (err)
+		return err;
+
+	crypto_xor(tag, state.ghash, AES_BLOCK_SIZE);
+	if (enc) {
+		scatterwalk_map_and_copy(tag, req->dst,
+					 req->assoclen + cryptlen,
+					 auth_tag_len, 1);
+		return 0;
+	}
+
+	scatterwalk_map_and_copy(buf, req->src, req->assoclen + cryptlen,
+				 auth_tag_len, 0);
+	return crypto_memneq(buf, tag, auth_tag_len) ? -EBADMSG : 0;
+}
+#endif
+
 static int gcmaes_encrypt(struct aead_request *req, unsigned int assoclen,
-			  u8 *hash_subkey, u8 *iv, void *aes_ctx)
+			  u8 *hash_subkey, u8 *hash_powers, u8 *iv,
+			  void *aes_ctx)
 {
 	u8 one_entry_in_sg = 0;
 	u8 *src, *dst, *assoc;
@@ -753,6 +1028,12 @@ static int gcmaes_encrypt(struct aead_request *req, unsigned int assoclen,
 	struct scatter_walk src_sg_walk;
 	struct scatter_walk dst_sg_walk = {};
 
+#ifdef CONFIG_AS_VAES
+	if (aesni_vaes)
+		return gcmaes_crypt_vaes(req, assoclen, hash_powers, iv,
+					 aes_ctx, true);
+#endif
+
 	if (sg_is_last(req->src) &&
 	    (!PageHighMem(sg_page(req->src)) ||
 	    req->src->offset + req->src->length <= PAGE_SIZE) &&
@@ -806,7 +1087,8 @@ static int gcmaes_encrypt(struct aead_request *req, unsigned int assoclen,
 }
 
 static int gcmaes_decrypt(struct aead_request *req, unsigned int assoclen,
-			  u8 *hash_subkey, u8 *iv, void *aes_ctx)
+			  u8 *hash_subkey, u8 *hash_powers, u8 *iv,
+			  void *aes_ctx)
 {
 	u8 one_entry_in_sg = 0;
 	u8 *src, *dst, *assoc;
@@ -818,6 +1100,12 @@ static int gcmaes_decrypt(struct aead_request *req, unsigned int assoclen,
 	struct scatter_walk dst_sg_walk = {};
 	int retval = 0;
 
+#ifdef CONFIG_AS_VAES
+	if (aesni_vaes)
+		return gcmaes_crypt_vaes(req, assoclen, hash_powers, iv,
+					 aes_ctx, false);
+#endif
+
 	tempCipherLen = (unsigned long)(req->cryptlen - auth_tag_len);
 
 	if (sg_is_last(req->src) &&
@@ -897,8 +1185,8 @@ static int helper_rfc4106_encrypt(struct aead_request *req)
 		*(iv+4+i) = req->iv[i];
 	*((__be32 *)(iv+12)) = counter;
 
-	return gcmaes_encrypt(req, req->assoclen - 8, ctx->hash_subkey, iv,
-			      aes_ctx);
+	return gcmaes_encrypt(req, req->assoclen - 8, ctx->hash_subkey,
+			      ctx->hash_powers, iv, aes_ctx);
 }
 
 static int helper_rfc4106_decrypt(struct aead_request *req)
@@ -924,8 +1212,8 @@ static int helper_rfc4106_decrypt(struct aead_request *req)
 		*(iv+4+i) = req->iv[i];
 	*((__be32 *)(iv+12)) = counter;
 
-	return gcmaes_decrypt(req, req->assoclen - 8, ctx->hash_subkey, iv,
-			      aes_ctx);
+	return gcmaes_decrypt(req, req->assoclen - 8, ctx->hash_subkey,
+			      ctx->hash_powers, iv, aes_ctx);
 }
 
 static int rfc4106_encrypt(struct aead_request *req)
@@ -1093,7 +1381,8 @@ static int generic_gcmaes_set_key(struct crypto_aead *aead, const u8 *key,
 
 	return aes_set_key_common(crypto_aead_tfm(aead),
 				  &ctx->aes_key_expanded, key, key_len) ?:
-	       rfc4106_set_hash_subkey(ctx->hash_subkey, key, key_len);
+	       rfc4106_set_hash_subkey(ctx->hash_subkey, ctx->hash_powers,
+				       key, key_len);
 }
 
 static int generic_gcmaes_encrypt(struct aead_request *req)
@@ -1107,23 +1396,23 @@ static int generic_gcmaes_encrypt(struct aead_request *req)
 	memcpy(iv, req->iv, 12);
 	*((__be32 *)(iv+12)) = counter;
 
-	return gcmaes_encrypt(req, req->assoclen, ctx->hash_subkey, iv,
-			      aes_ctx);
+	return gcmaes_encrypt(req, req->assoclen, ctx->hash_subkey,
+			      ctx->hash_powers, iv, aes_ctx);
 }
 
 static int generic_gcmaes_decrypt(struct aead_request *req)
 {
 	__be32 counter = cpu_to_be32(1);
 	struct crypto_aead *tfm = crypto_aead_reqtfm(req);
-	struct aesni_rfc4106_gcm_ctx *ctx = aesni_rfc4106_gcm_ctx_get(tfm);
+	struct generic_gcmaes_ctx *ctx = generic_gcmaes_ctx_get(tfm);
 	void *aes_ctx = &(ctx->aes_key_expanded);
 	u8 iv[16] __attribute__ ((__aligned__(AESNI_ALIGN)));
 
 	memcpy(iv, req->iv, 12);
 	*((__be32 *)(iv+12)) = counter;
 
-	return gcmaes_decrypt(req, req->assoclen, ctx->hash_subkey, iv,
-			      aes_ctx);
+	return gcmaes_decrypt(req, req->assoclen, ctx->hash_subkey,
+			      ctx->hash_powers, iv, aes_ctx);
 }
 
 static struct aead_alg aesni_aead_algs[] = { {
@@ -1133,6 +1422,7 @@ static struct aead_alg aesni_aead_algs[] = { {
 	.decrypt		= helper_rfc4106_decrypt,
 	.ivsize			= 8,
 	.maxauthsize		= 16,
+	.chunksize		= AES_BLOCK_SIZE,
 	.base = {
 		.cra_name		= "__gcm-aes-aesni",
 		.cra_driver_name	= "__driver-gcm-aes-aesni",
@@ -1167,6 +1457,7 @@ static struct aead_alg aesni_aead_algs[] = { {
 	.decrypt		= generic_gcmaes_decrypt,
 	.ivsize			= 12,
 	.maxauthsize		= 16,
+	.chunksize		= AES_BLOCK_SIZE,
 	.base = {
 		.cra_name		= "gcm(aes)",
 		.cra_driver_name	= "generic-gcm-aesni",
@@ -1214,6 +1505,23 @@ static int __init aesni_init(void)
 	if (!x86_match_cpu(aesni_cpu_id))
 		return -ENODEV;
 #ifdef CONFIG_X86_64
+#ifdef CONFIG_AS_VAES
+	if (boot_cpu_has(X86_FEATURE_VAES) &&
+	    boot_cpu_has(X86_FEATURE_VPCLMULQDQ)) {
+		if (boot_cpu_has(X86_FEATURE_AVX512F) &&
+		    boot_cpu_has(X86_FEATURE_AVX512BW) &&
+		    cpu_has_xfeatures(XFEATURE_MASK_SSE | XFEATURE_MASK_YMM |
+				      XFEATURE_MASK_AVX512, NULL)) {
+			pr_info("AVX-512 VAES version of gcm and xts engaged.\n");
+			aesni_vaes = &aesni_vaes_avx512;
+		} else if (boot_cpu_has(X86_FEATURE_AVX2) &&
+			   cpu_has_xfeatures(XFEATURE_MASK_SSE |
+					     XFEATURE_MASK_YMM, NULL)) {
+			pr_info("AVX2 VAES version of gcm and xts engaged.\n");
+			aesni_vaes = &aesni_vaes_avx2;
+		}
+	}
+#endif
 #ifdef CONFIG_AS_AVX2
 	if (boot_cpu_has(X86_FEATURE_AVX2)) {
 		pr_info("AVX2 version of gcm_enc/dec engaged.\n");
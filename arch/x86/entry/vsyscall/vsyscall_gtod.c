@@ -31,6 +31,7 @@ void update_vsyscall(struct timekeeper *tk)
 {
 	int vclock_mode = tk->tkr_mono.clock->archdata.vclock_mode;
 	struct vsyscall_gtod_data *vdata = &vsyscall_gtod_data;
+	struct timespec64 boot = ktime_to_timespec64(tk->offs_boot);
 
 	/* Mark the new vclock used. */
 	BUILD_BUG_ON(VCLOCK_MAX >= 32);
@@ -44,6 +45,8 @@ void update_vsyscall(struct timekeeper *tk)
 	vdata->mask		= tk->tkr_mono.mask;
 	vdata->mult		= tk->tkr_mono.mult;
 	vdata->shift		= tk->tkr_mono.shift;
+	/* tkr_mono.shift == tkr_raw.shift */
+	vdata->raw_mult		= tk->tkr_raw.mult;
 
 	vdata->wall_time_sec		= tk->xtime_sec;
 	vdata->wall_time_snsec		= tk->tkr_mono.xtime_nsec;
@@ -60,6 +63,23 @@ void update_vsyscall(struct timekeeper *tk)
 		vdata->monotonic_time_sec++;
 	}
 
+	vdata->monotonic_time_raw_sec	= tk->raw_sec;
+	vdata->monotonic_time_raw_snsec	= tk->tkr_raw.xtime_nsec;
+
+	vdata->boottime_sec		= vdata->monotonic_time_sec
+					+ boot.tv_sec;
+	vdata->boottime_snsec		= vdata->monotonic_time_snsec
+					+ ((u64)boot.tv_nsec
+						<< tk->tkr_mono.shift);
+	while (vdata->boottime_snsec >=
+					(((u64)NSEC_PER_SEC) << tk->tkr_mono.shift)) {
+		vdata->boottime_snsec -=
+					((u64)NSEC_PER_SEC) << tk->tkr_mono.shift;
+		vdata->boottime_sec++;
+	}
+
+	vdata->tai_time_sec		= tk->xtime_sec + tk->tai_offset;
+
 	vdata->wall_time_coarse_sec	= tk->xtime_sec;
 	vdata->wall_time_coarse_nsec	= (long)(tk->tkr_mono.xtime_nsec >>
 						 tk->tkr_mono.shift);
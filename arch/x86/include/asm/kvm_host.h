@@ -45,6 +45,13 @@
 
 #define KVM_HALT_POLL_NS_DEFAULT 200000
 
+/* the PML buffer of VMX, flushed to the dirty ring in one go */
+#define KVM_CPU_DIRTY_LOG_SIZE 512
+
+/* the tdp page faults can take the mmu_lock for read, see tdp_mmu.c */
+#define KVM_HAVE_MMU_RWLOCK
+#define KVM_TDP_MMU_RMAP_LOCKS 64
+
 #define KVM_IRQCHIP_NUM_PINS  KVM_IOAPIC_NUM_PINS
 
 /* x86-specific vcpu->requests bit members */
@@ -759,6 +766,12 @@ struct kvm_arch {
 	 */
 	struct list_head active_mmu_pages;
 	struct list_head zapped_obsolete_pages;
+	/*
+	 * Taken with the mmu_lock held for read: the first one for the
+	 * lists and counters of the shadow pages, the others for the rmaps.
+	 */
+	spinlock_t tdp_mmu_pages_lock;
+	spinlock_t tdp_mmu_rmap_locks[KVM_TDP_MMU_RMAP_LOCKS];
 	struct kvm_page_track_notifier_node mmu_sp_tracker;
 	struct kvm_page_track_notifier_head track_notifier_head;
 
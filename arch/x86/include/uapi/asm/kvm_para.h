@@ -25,6 +25,8 @@
 #define KVM_FEATURE_STEAL_TIME		5
 #define KVM_FEATURE_PV_EOI		6
 #define KVM_FEATURE_PV_UNHALT		7
+/* 8 is reserved, as on the hosts already assigning it */
+#define KVM_FEATURE_PV_TLB_FLUSH	9
 
 /* The last 8 bits are used to indicate how to interpret the flags field
  * in pvclock structure. If no bits are set, all flags are ignored.
@@ -51,6 +53,11 @@ struct kvm_steal_time {
 	__u32 pad[11];
 };
 
+/* kvm_steal_time->preempted */
+#define KVM_VCPU_PREEMPTED          (1 << 0)
+/* set by the guest while preempted, flushes the TLB before it runs */
+#define KVM_VCPU_FLUSH_TLB          (1 << 1)
+
 #define KVM_CLOCK_PAIRING_WALLCLOCK 0
 struct kvm_clock_pairing {
 	__s64 sec;
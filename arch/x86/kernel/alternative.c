@@ -654,6 +654,11 @@ void __init alternative_instructions(void)
 				(unsigned long)__smp_locks_end);
 #endif
 
+#ifdef CONFIG_NUMA_AWARE_SPINLOCKS
+	/* Pick the spinlock slow path before the call sites get patched */
+	cna_configure_spin_lock_slowpath();
+#endif
+
 	apply_paravirt(__parainstructions, __parainstructions_end);
 
 	restart_nmi();
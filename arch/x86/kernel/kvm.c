@@ -465,6 +465,40 @@ static void __init kvm_apf_trap_init(void)
 	update_intr_gate(X86_TRAP_PF, async_page_fault);
 }
 
+static DEFINE_PER_CPU(cpumask_var_t, __pv_tlb_mask);
+
+/*
+ * The preempted vcpus get KVM_VCPU_FLUSH_TLB set in their steal time area
+ * instead of an IPI: the host flushes their TLB before they run again, so
+ * the caller does not wait for them to be scheduled in.
+ */
+static void kvm_flush_tlb_others(const struct cpumask *cpumask,
+				 const struct flush_tlb_info *info)
+{
+	struct cpumask *flushmask = this_cpu_cpumask_var_ptr(__pv_tlb_mask);
+	struct kvm_steal_time *src;
+	u8 state;
+	int cpu;
+
+	cpumask_copy(flushmask, cpumask);
+	for_each_cpu(cpu, flushmask) {
+		src = &per_cpu(steal_time, cpu);
+		state = READ_ONCE(src->preempted);
+		if ((state & KVM_VCPU_PREEMPTED) &&
+		    try_cmpxchg(&src->preempted, &state,
+				state | KVM_VCPU_FLUSH_TLB))
+			__cpumask_clear_cpu(cpu, flushmask);
+	}
+
+	native_flush_tlb_others(flushmask, info);
+}
+
+static bool __init pv_tlb_flush_supported(void)
+{
+	return kvm_para_has_feature(KVM_FEATURE_PV_TLB_FLUSH) &&
+	       kvm_para_has_feature(KVM_FEATURE_STEAL_TIME);
+}
+
 void __init kvm_guest_init(void)
 {
 	int i;
@@ -484,6 +518,12 @@ void __init kvm_guest_init(void)
 		pv_time_ops.steal_clock = kvm_steal_clock;
 	}
 
+	/* before apply_paravirt() patches the flush_tlb_others() calls */
+	if (pv_tlb_flush_supported()) {
+		pv_mmu_ops.flush_tlb_others = kvm_flush_tlb_others;
+		pr_info("KVM setup pv remote TLB flush\n");
+	}
+
 	if (kvm_para_has_feature(KVM_FEATURE_PV_EOI))
 		apic_set_eoi_write(kvm_guest_apic_eoi_write);
 
@@ -551,6 +591,22 @@ const struct hypervisor_x86 x86_hyper_kvm __refconst = {
 };
 EXPORT_SYMBOL_GPL(x86_hyper_kvm);
 
+static __init int kvm_setup_pv_tlb_flush(void)
+{
+	int cpu;
+
+	if (!kvm_para_available() || !pv_tlb_flush_supported())
+		return 0;
+
+	for_each_possible_cpu(cpu) {
+		if (!zalloc_cpumask_var_node(per_cpu_ptr(&__pv_tlb_mask, cpu),
+					     GFP_KERNEL, cpu_to_node(cpu)))
+			return -ENOMEM;
+	}
+	return 0;
+}
+arch_initcall(kvm_setup_pv_tlb_flush);
+
 static __init int activate_jump_labels(void)
 {
 	if (has_steal_clock) {
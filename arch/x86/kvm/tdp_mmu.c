@@ -0,0 +1,194 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Concurrent page faults for two-dimensional paging
+ *
+ * With tdp_mmu=1, the EPT/NPT violations map the guest memory with the
+ * mmu_lock held for read, so that the vcpus faulting in fresh memory do
+ * not serialize on it.  The sptes are installed with cmpxchg64(), the
+ * rmaps and the lists of shadow pages are updated under finer spinlocks.
+ * Everything else, zapping and memslot updates included, still holds the
+ * mmu_lock for write and sees the page tables as if the faults had been
+ * serialized.  The page tables cannot be freed under the faults, they only
+ * are from kvm_mmu_commit_zap_page(), with the mmu_lock held for write.
+ *
+ * Only the mapping of non-present sptes is done concurrently.  The faults
+ * that must replace a present spte, split a large page, install a MMIO
+ * spte or write protect a page shadowed for a nested guest go on with the
+ * mmu_lock held for write.
+ */
+
+static bool __read_mostly tdp_mmu_enabled;
+module_param_named(tdp_mmu, tdp_mmu_enabled, bool, S_IRUGO);
+
+static void mmu_memory_cache_free(struct kvm_mmu_memory_cache *mc, void *obj)
+{
+	mc->objects[mc->nobjs++] = obj;
+}
+
+static spinlock_t *tdp_mmu_rmap_lock(struct kvm *kvm,
+				     struct kvm_rmap_head *rmap_head)
+{
+	return &kvm->arch.tdp_mmu_rmap_locks[hash_ptr(rmap_head,
+				ilog2(KVM_TDP_MMU_RMAP_LOCKS))];
+}
+
+static void tdp_mmu_rmap_add(struct kvm_vcpu *vcpu, u64 *sptep, gfn_t gfn)
+{
+	struct kvm_mmu_page *sp = page_header(__pa(sptep));
+	struct kvm_rmap_head *rmap_head;
+	spinlock_t *lock;
+
+	rmap_head = gfn_to_rmap(vcpu->kvm, gfn, sp);
+	lock = tdp_mmu_rmap_lock(vcpu->kvm, rmap_head);
+	spin_lock(lock);
+	pte_list_add(vcpu, sptep, rmap_head);
+	spin_unlock(lock);
+}
+
+/*
+ * Links a new page table at *@sptep, which was @old_spte.  Returns the
+ * value of the spte after the call, the new one unless another vcpu linked
+ * a page table first.
+ */
+static u64 tdp_mmu_link_page(struct kvm_vcpu *vcpu,
+			     struct kvm_shadow_walk_iterator *it, u64 old_spte)
+{
+	struct kvm *kvm = vcpu->kvm;
+	struct kvm_mmu_page *sp;
+	struct hlist_head *head;
+	u64 spte, cur;
+
+	sp = mmu_memory_cache_alloc(&vcpu->arch.mmu_page_header_cache);
+	sp->spt = mmu_memory_cache_alloc(&vcpu->arch.mmu_page_cache);
+	set_page_private(virt_to_page(sp->spt), (unsigned long)sp);
+	sp->gfn = (it->addr & PT64_LVL_ADDR_MASK(it->level)) >> PAGE_SHIFT;
+	sp->role = vcpu->arch.mmu.base_role;
+	sp->role.level = it->level - 1;
+	sp->role.direct = 1;
+	sp->role.cr4_pae = 0;
+	sp->role.access = ACC_ALL;
+	sp->mmu_valid_gen = kvm->arch.mmu_valid_gen;
+	clear_page(sp->spt);
+
+	spte = make_nonleaf_spte(sp);
+	cur = cmpxchg64(it->sptep, old_spte, spte);
+	if (cur != old_spte) {
+		mmu_memory_cache_free(&vcpu->arch.mmu_page_cache, sp->spt);
+		memset(sp, 0, sizeof(*sp));
+		mmu_memory_cache_free(&vcpu->arch.mmu_page_header_cache, sp);
+		return cur;
+	}
+
+	/* only the mmu_lock writers look at the parents of a direct page */
+	mmu_page_add_parent_pte(vcpu, sp, it->sptep);
+
+	head = &kvm->arch.mmu_page_hash[kvm_page_table_hashfn(sp->gfn)];
+	spin_lock(&kvm->arch.tdp_mmu_pages_lock);
+	/* FIFO, as in kvm_mmu_alloc_page() */
+	list_add(&sp->link, &kvm->arch.active_mmu_pages);
+	hlist_add_head(&sp->hash_link, head);
+	kvm_mod_used_mmu_pages(kvm, +1);
+	++kvm->stat.mmu_cache_miss;
+	spin_unlock(&kvm->arch.tdp_mmu_pages_lock);
+
+	trace_kvm_mmu_get_page(sp, true);
+	return spte;
+}
+
+/* As mmu_set_spte(), for a non-present @old_spte */
+static int tdp_mmu_set_spte(struct kvm_vcpu *vcpu, u64 *sptep, u64 old_spte,
+			    int write, int map_writable, int level, gfn_t gfn,
+			    kvm_pfn_t pfn, bool prefault)
+{
+	struct kvm *kvm = vcpu->kvm;
+	bool emulate = false;
+	u64 spte;
+
+	if (make_spte(vcpu, page_header(__pa(sptep)), old_spte, ACC_ALL,
+		      level, gfn, pfn, prefault, true, map_writable, &spte)) {
+		if (write)
+			emulate = true;
+		kvm_make_request(KVM_REQ_TLB_FLUSH, vcpu);
+	}
+
+	/* the guest retries the access if another vcpu mapped it first */
+	if (spte && cmpxchg64(sptep, old_spte, spte) == old_spte) {
+		tdp_mmu_rmap_add(vcpu, sptep, gfn);
+		if (is_large_pte(spte)) {
+			spin_lock(&kvm->arch.tdp_mmu_pages_lock);
+			++kvm->stat.lpages;
+			spin_unlock(&kvm->arch.tdp_mmu_pages_lock);
+		}
+		++vcpu->stat.pf_fixed;
+	}
+
+	kvm_release_pfn_clean(pfn);
+	return emulate;
+}
+
+static int tdp_mmu_map(struct kvm_vcpu *vcpu, int write, int map_writable,
+		       int level, gfn_t gfn, kvm_pfn_t pfn, bool prefault)
+{
+	struct kvm_shadow_walk_iterator iterator;
+	u64 spte;
+
+	for_each_shadow_entry_lockless(vcpu, (u64)gfn << PAGE_SHIFT,
+				       iterator, spte) {
+		if (iterator.level == level) {
+			if (is_shadow_present_pte(spte))
+				break;
+			return tdp_mmu_set_spte(vcpu, iterator.sptep, spte,
+						write, map_writable, level,
+						gfn, pfn, prefault);
+		}
+
+		if (!is_shadow_present_pte(spte))
+			spte = tdp_mmu_link_page(vcpu, &iterator, spte);
+		if (!is_shadow_present_pte(spte) || is_large_pte(spte))
+			break;
+	}
+	return -EAGAIN;
+}
+
+/*
+ * Called by tdp_page_fault() with the pfn of @gfn.  Returns -EAGAIN if the
+ * fault must be handled with the mmu_lock held for write, @gfn, @pfn and
+ * @level being updated for it.
+ */
+static int tdp_mmu_page_fault(struct kvm_vcpu *vcpu, int write,
+			      int map_writable, int *level, gfn_t *gfn,
+			      kvm_pfn_t *pfn, bool force_pt_level,
+			      bool prefault, unsigned long mmu_seq)
+{
+	struct kvm *kvm = vcpu->kvm;
+	int r = -EAGAIN;
+
+	if (!IS_ENABLED(CONFIG_X86_64) ||
+	    vcpu->arch.mmu.shadow_root_level < PT64_ROOT_4LEVEL ||
+	    is_noslot_pfn(*pfn))
+		return -EAGAIN;
+
+	read_lock(&kvm->mmu_lock);
+	if (mmu_notifier_retry(kvm, mmu_seq)) {
+		read_unlock(&kvm->mmu_lock);
+		kvm_release_pfn_clean(*pfn);
+		return 0;
+	}
+
+	/*
+	 * Zapping pages to make room, and finding the shadow pages of the
+	 * gfn for a nested guest, need the mmu_lock for write.
+	 */
+	if (kvm_mmu_available_pages(kvm) < KVM_MIN_FREE_MMU_PAGES ||
+	    kvm->arch.indirect_shadow_pages)
+		goto out_unlock;
+
+	if (likely(!force_pt_level))
+		transparent_hugepage_adjust(vcpu, gfn, pfn, level);
+	if (VALID_PAGE(vcpu->arch.mmu.root_hpa))
+		r = tdp_mmu_map(vcpu, write, map_writable, *level, *gfn, *pfn,
+				prefault);
+out_unlock:
+	read_unlock(&kvm->mmu_lock);
+	return r;
+}
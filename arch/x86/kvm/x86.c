@@ -100,6 +100,7 @@ static void update_cr8_intercept(struct kvm_vcpu *vcpu);
 static void process_nmi(struct kvm_vcpu *vcpu);
 static void enter_smm(struct kvm_vcpu *vcpu);
 static void __kvm_set_rflags(struct kvm_vcpu *vcpu, unsigned long rflags);
+static void kvm_vcpu_flush_tlb(struct kvm_vcpu *vcpu);
 
 struct kvm_x86_ops *kvm_x86_ops __read_mostly;
 EXPORT_SYMBOL_GPL(kvm_x86_ops);
@@ -2104,6 +2105,30 @@ static void kvmclock_reset(struct kvm_vcpu *vcpu)
 	vcpu->arch.pv_time_enabled = false;
 }
 
+/*
+ * Clears the preempted byte of the steal time area with a locked xchg: the
+ * guest may be setting KVM_VCPU_FLUSH_TLB in it.  Returns the old value.
+ */
+static u8 kvm_steal_time_clear_preempted(struct kvm_vcpu *vcpu)
+{
+	gpa_t gpa = vcpu->arch.st.stime.gpa +
+		    offsetof(struct kvm_steal_time, preempted);
+	struct page *page;
+	u8 *kaddr, old;
+
+	page = gfn_to_page(vcpu->kvm, gpa_to_gfn(gpa));
+	if (is_error_page(page))
+		return 0;
+
+	kaddr = kmap_atomic(page);
+	old = xchg(kaddr + offset_in_page(gpa), 0);
+	kunmap_atomic(kaddr);
+
+	kvm_release_page_dirty(page);
+	mark_page_dirty(vcpu->kvm, gpa_to_gfn(gpa));
+	return old;
+}
+
 static void record_steal_time(struct kvm_vcpu *vcpu)
 {
 	if (!(vcpu->arch.st.msr_val & KVM_MSR_ENABLED))
@@ -2113,6 +2138,13 @@ static void record_steal_time(struct kvm_vcpu *vcpu)
 		&vcpu->arch.st.steal, sizeof(struct kvm_steal_time))))
 		return;
 
+	/*
+	 * The guest only requests a flush while the vcpu is marked as
+	 * preempted, do it here instead of the IPI it did not send.
+	 */
+	if (vcpu->arch.st.steal.preempted &&
+	    (kvm_steal_time_clear_preempted(vcpu) & KVM_VCPU_FLUSH_TLB))
+		kvm_vcpu_flush_tlb(vcpu);
 	vcpu->arch.st.steal.preempted = 0;
 
 	if (vcpu->arch.st.steal.version & 1)
@@ -2884,7 +2916,7 @@ static void kvm_steal_time_set_preempted(struct kvm_vcpu *vcpu)
 	if (!(vcpu->arch.st.msr_val & KVM_MSR_ENABLED))
 		return;
 
-	vcpu->arch.st.steal.preempted = 1;
+	vcpu->arch.st.steal.preempted = KVM_VCPU_PREEMPTED;
 
 	kvm_write_guest_offset_cached(vcpu->kvm, &vcpu->arch.st.stime,
 			&vcpu->arch.st.steal.preempted,
@@ -5466,9 +5498,9 @@ static bool reexecute_instruction(struct kvm_vcpu *vcpu, gva_t cr2,
 	if (vcpu->arch.mmu.direct_map) {
 		unsigned int indirect_shadow_pages;
 
-		spin_lock(&vcpu->kvm->mmu_lock);
+		write_lock(&vcpu->kvm->mmu_lock);
 		indirect_shadow_pages = vcpu->kvm->arch.indirect_shadow_pages;
-		spin_unlock(&vcpu->kvm->mmu_lock);
+		write_unlock(&vcpu->kvm->mmu_lock);
 
 		if (indirect_shadow_pages)
 			kvm_mmu_unprotect_page(vcpu->kvm, gpa_to_gfn(gpa));
@@ -6777,6 +6809,14 @@ static int vcpu_enter_guest(struct kvm_vcpu *vcpu)
 
 	bool req_immediate_exit = false;
 
+	/* let userspace collect the ring before it overflows to the bitmap */
+	if (vcpu->kvm->dirty_ring_size &&
+	    kvm_dirty_ring_soft_full(&vcpu->dirty_ring)) {
+		vcpu->run->exit_reason = KVM_EXIT_DIRTY_RING_FULL;
+		r = 0;
+		goto out;
+	}
+
 	if (kvm_request_pending(vcpu)) {
 		if (kvm_check_request(KVM_REQ_MMU_RELOAD, vcpu))
 			kvm_mmu_unload(vcpu);
@@ -1365,6 +1365,20 @@ __do_page_fault(struct pt_regs *regs, unsigned long error_code,
 	if (error_code & PF_INSTR)
 		flags |= FAULT_FLAG_INSTRUCTION;
 
+	/*
+	 * Try to handle user space faults without mmap_sem first.  The
+	 * protection key faults need the vma pkey for the signal, leave
+	 * them to the regular path, as everything the speculative fault
+	 * cannot handle.
+	 */
+	if ((error_code & (PF_USER | PF_PK)) == PF_USER) {
+		fault = handle_speculative_fault(mm, address, flags);
+		if (fault != VM_FAULT_RETRY) {
+			major |= fault & VM_FAULT_MAJOR;
+			goto done;
+		}
+	}
+
 	/*
 	 * When running in the kernel we expect faults to occur only to
 	 * addresses in user space.  All other faults represent errors in
@@ -1484,6 +1498,7 @@ __do_page_fault(struct pt_regs *regs, unsigned long error_code,
 		return;
 	}
 
+done:
 	/*
 	 * Major/minor page fault accounting. If any of the events
 	 * returned VM_FAULT_MAJOR, we account it as a major fault.
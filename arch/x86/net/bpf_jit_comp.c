@@ -11,8 +11,10 @@
 #include <linux/netdevice.h>
 #include <linux/filter.h>
 #include <linux/if_vlan.h>
+#include <linux/memory.h>
 #include <asm/cacheflush.h>
 #include <asm/set_memory.h>
+#include <asm/text-patching.h>
 #include <linux/bpf.h>
 
 int bpf_jit_enable __read_mostly;
@@ -332,6 +334,106 @@ static void emit_bpf_tail_call(u8 **pprog)
 	*pprog = prog;
 }
 
+#define X86_PATCH_SIZE 5
+
+/* generate the following code for a constant index:
+ *   if (++tail_call_cnt > MAX_TAIL_CALL_CNT)
+ *     goto out;
+ *   goto prog->bpf_func + prologue_size;  <- a nop while the slot is empty
+ * out:
+ * The jump is patched by bpf_arch_text_poke() on every update of the slot,
+ * @ip is where the code of the instruction lands in the final image.
+ */
+static void emit_bpf_tail_call_direct(struct bpf_jit_poke_descriptor *poke,
+				      u8 **pprog, u8 *ip)
+{
+	u8 *prog = *pprog;
+	int label;
+	int cnt = 0;
+
+	/* if (tail_call_cnt > MAX_TAIL_CALL_CNT)
+	 *   goto out;
+	 */
+	EMIT2_off32(0x8B, 0x85, 36);              /* mov eax, dword ptr [rbp + 36] */
+	EMIT3(0x83, 0xF8, MAX_TAIL_CALL_CNT);     /* cmp eax, MAX_TAIL_CALL_CNT */
+#define OFFSET4 14
+	EMIT2(X86_JA, OFFSET4);                   /* ja out */
+	label = cnt;
+	EMIT3(0x83, 0xC0, 0x01);                  /* add eax, 1 */
+	EMIT2_off32(0x89, 0x85, 36);              /* mov dword ptr [rbp + 36], eax */
+
+	if (ip) {
+		poke->ip = ip + cnt;
+		poke->adj_off = PROLOGUE_SIZE;
+	}
+	memcpy(prog, ideal_nops[NOP_ATOMIC5], X86_PATCH_SIZE);
+	prog += X86_PATCH_SIZE;
+	cnt += X86_PATCH_SIZE;
+
+	/* out: */
+	BUILD_BUG_ON(cnt - label != OFFSET4);
+	*pprog = prog;
+}
+
+static void emit_patch(u8 *insn, void *ip, void *target)
+{
+	if (!target) {
+		memcpy(insn, ideal_nops[NOP_ATOMIC5], X86_PATCH_SIZE);
+		return;
+	}
+	insn[0] = 0xE9;                           /* jmp target */
+	*(s32 *)(insn + 1) = (u8 *)target - ((u8 *)ip + X86_PATCH_SIZE);
+}
+
+/* Move the direct jump at ip from old_addr to new_addr, NULL being a nop */
+int bpf_arch_text_poke(void *ip, void *old_addr, void *new_addr)
+{
+	u8 old_insn[X86_PATCH_SIZE], new_insn[X86_PATCH_SIZE];
+	int ret = -EBUSY;
+
+	emit_patch(old_insn, ip, old_addr);
+	emit_patch(new_insn, ip, new_addr);
+
+	mutex_lock(&text_mutex);
+	if (memcmp(ip, old_insn, X86_PATCH_SIZE))
+		goto out;
+	/* a CPU hitting the jump while it is patched falls through to out */
+	if (memcmp(ip, new_insn, X86_PATCH_SIZE))
+		text_poke_bp(ip, new_insn, X86_PATCH_SIZE,
+			     (u8 *)ip + X86_PATCH_SIZE);
+	ret = 0;
+out:
+	mutex_unlock(&text_mutex);
+	return ret;
+}
+
+/* Point the direct tail calls of a freshly JITed program at their slots */
+static void bpf_tail_call_direct_fixup(struct bpf_prog *prog)
+{
+	struct bpf_jit_poke_descriptor *poke;
+	struct bpf_prog *target;
+	struct bpf_array *array;
+	int i, ret;
+
+	for (i = 0; i < prog->aux->size_poke_tab; i++) {
+		poke = &prog->aux->poke_tab[i];
+		array = container_of(poke->tail_call.map, struct bpf_array,
+				     map);
+
+		mutex_lock(&array->poke_mutex);
+		/* an interpreted target fails bpf_check_tail_call() anyway */
+		target = array->ptrs[poke->tail_call.key];
+		if (target && target->jited) {
+			ret = bpf_arch_text_poke(poke->ip, NULL,
+						 (u8 *)target->bpf_func +
+						 poke->adj_off);
+			BUG_ON(ret < 0);
+		}
+		poke->ip_stable = true;
+		mutex_unlock(&array->poke_mutex);
+	}
+}
+
 
 static void emit_load_skb_data_hlen(u8 **pprog)
 {
@@ -882,7 +984,12 @@ xadd:			if (is_imm8(insn->off))
 			break;
 
 		case BPF_JMP | BPF_TAIL_CALL:
-			emit_bpf_tail_call(&prog);
+			if (imm32)
+				emit_bpf_tail_call_direct(
+					&bpf_prog->aux->poke_tab[imm32 - 1],
+					&prog, image ? image + proglen : NULL);
+			else
+				emit_bpf_tail_call(&prog);
 			break;
 
 			/* cond jump */
@@ -1193,6 +1300,7 @@ struct bpf_prog *bpf_int_jit_compile(struct bpf_prog *prog)
 		prog->bpf_func = (void *)image;
 		prog->jited = 1;
 		prog->jited_len = proglen;
+		bpf_tail_call_direct_fixup(prog);
 	} else {
 		prog = orig_prog;
 	}
@@ -28,6 +28,7 @@
 #include <linux/mempool.h>
 #include <linux/workqueue.h>
 #include <linux/cgroup.h>
+#include <linux/cpuhotplug.h>
 
 #include <trace/events/block.h>
 #include "blk.h"
@@ -38,6 +39,9 @@
  */
 #define BIO_INLINE_VECS		4
 
+/* Max number of free bios kept on each cpu by a %BIOSET_PERCPU_CACHE set */
+#define ALLOC_CACHE_MAX		256
+
 /*
  * if you change this list, also change bvec_alloc or things will
  * break badly! cannot be bigger than what you can fit into an
@@ -246,6 +250,61 @@ void bio_uninit(struct bio *bio)
 }
 EXPORT_SYMBOL(bio_uninit);
 
+/*
+ * Keep @bio, which has no separately allocated vecs, on the free list of
+ * this cpu.  Bios are freed from any context, hence irqs are disabled.
+ */
+static bool bio_cache_put(struct bio_set *bs, struct bio *bio)
+{
+	struct bio_alloc_cache *cache;
+	unsigned long flags;
+	bool ret = false;
+
+	local_irq_save(flags);
+	cache = this_cpu_ptr(bs->cache);
+	if (cache->nr < ALLOC_CACHE_MAX) {
+		bio_list_add_head(&cache->free_list, bio);
+		cache->nr++;
+		ret = true;
+	}
+	local_irq_restore(flags);
+
+	return ret;
+}
+
+static struct bio *bio_cache_get(struct bio_set *bs)
+{
+	struct bio_alloc_cache *cache;
+	unsigned long flags;
+	struct bio *bio;
+
+	local_irq_save(flags);
+	cache = this_cpu_ptr(bs->cache);
+	bio = bio_list_pop(&cache->free_list);
+	if (bio)
+		cache->nr--;
+	local_irq_restore(flags);
+
+	return bio;
+}
+
+static void bio_cache_drain(struct bio_set *bs, struct bio_alloc_cache *cache)
+{
+	struct bio *bio;
+
+	while ((bio = bio_list_pop(&cache->free_list)) != NULL)
+		mempool_free((void *)bio - bs->front_pad, bs->bio_pool);
+	cache->nr = 0;
+}
+
+static int bio_cpu_dead(unsigned int cpu, struct hlist_node *node)
+{
+	struct bio_set *bs = hlist_entry_safe(node, struct bio_set, cpuhp_dead);
+
+	bio_cache_drain(bs, per_cpu_ptr(bs->cache, cpu));
+	return 0;
+}
+
 static void bio_free(struct bio *bio)
 {
 	struct bio_set *bs = bio->bi_pool;
@@ -254,6 +313,9 @@ static void bio_free(struct bio *bio)
 	bio_uninit(bio);
 
 	if (bs) {
+		if (bs->cache && !BVEC_POOL_IDX(bio) && bio_cache_put(bs, bio))
+			return;
+
 		bvec_free(bs->bvec_pool, bio->bi_io_vec, BVEC_POOL_IDX(bio));
 
 		/*
@@ -456,6 +518,16 @@ struct bio *bio_alloc_bioset(gfp_t gfp_mask, unsigned int nr_iovecs,
 		/* should not use nobvec bioset for nr_iovecs > 0 */
 		if (WARN_ON_ONCE(!bs->bvec_pool && nr_iovecs > 0))
 			return NULL;
+
+		if (bs->cache && nr_iovecs <= BIO_INLINE_VECS) {
+			bio = bio_cache_get(bs);
+			if (bio) {
+				bio_init(bio, nr_iovecs ? bio->bi_inline_vecs :
+					 NULL, nr_iovecs);
+				bio->bi_pool = bs;
+				return bio;
+			}
+		}
 		/*
 		 * generic_make_request() converts recursion to iteration; this
 		 * means if we're running beneath it, any bios we allocate and
@@ -717,23 +789,9 @@ struct bio *bio_clone_bioset(struct bio *bio_src, gfp_t gfp_mask,
 }
 EXPORT_SYMBOL(bio_clone_bioset);
 
-/**
- *	bio_add_pc_page	-	attempt to add page to bio
- *	@q: the target queue
- *	@bio: destination bio
- *	@page: page to add
- *	@len: vec entry length
- *	@offset: vec entry offset
- *
- *	Attempt to add a page to the bio_vec maplist. This can fail for a
- *	number of reasons, such as the bio being full or target block device
- *	limitations. The target block device must allow bio's up to PAGE_SIZE,
- *	so it is always possible to add a single page to an empty bio.
- *
- *	This should only be used by REQ_PC bios.
- */
-int bio_add_pc_page(struct request_queue *q, struct bio *bio, struct page
-		    *page, unsigned int len, unsigned int offset)
+static int __bio_add_hw_page(struct request_queue *q, struct bio *bio,
+			     struct page *page, unsigned int len,
+			     unsigned int offset, unsigned int max_sectors)
 {
 	int retried_segments = 0;
 	struct bio_vec *bvec;
@@ -744,7 +802,7 @@ int bio_add_pc_page(struct request_queue *q, struct bio *bio, struct page
 	if (unlikely(bio_flagged(bio, BIO_CLONED)))
 		return 0;
 
-	if (((bio->bi_iter.bi_size + len) >> 9) > queue_max_hw_sectors(q))
+	if (((bio->bi_iter.bi_size + len) >> 9) > max_sectors)
 		return 0;
 
 	/*
@@ -815,8 +873,58 @@ int bio_add_pc_page(struct request_queue *q, struct bio *bio, struct page
 	blk_recount_segments(q, bio);
 	return 0;
 }
+
+/**
+ *	bio_add_pc_page	-	attempt to add page to bio
+ *	@q: the target queue
+ *	@bio: destination bio
+ *	@page: page to add
+ *	@len: vec entry length
+ *	@offset: vec entry offset
+ *
+ *	Attempt to add a page to the bio_vec maplist. This can fail for a
+ *	number of reasons, such as the bio being full or target block device
+ *	limitations. The target block device must allow bio's up to PAGE_SIZE,
+ *	so it is always possible to add a single page to an empty bio.
+ *
+ *	This should only be used by REQ_PC bios.
+ */
+int bio_add_pc_page(struct request_queue *q, struct bio *bio, struct page
+		    *page, unsigned int len, unsigned int offset)
+{
+	return __bio_add_hw_page(q, bio, page, len, offset,
+				 queue_max_hw_sectors(q));
+}
 EXPORT_SYMBOL(bio_add_pc_page);
 
+/**
+ *	bio_add_zone_append_page - attempt to add page to zone append bio
+ *	@bio: destination bio
+ *	@page: page to add
+ *	@len: vec entry length
+ *	@offset: vec entry offset
+ *
+ *	Attempt to add a page to the bio_vec maplist of a REQ_OP_ZONE_APPEND
+ *	bio, whose target device must already be set.  A zone append is never
+ *	split, so the bio is kept within the size and segment limits of the
+ *	queue.  Returns the number of bytes added, 0 if the page doesn't fit.
+ */
+int bio_add_zone_append_page(struct bio *bio, struct page *page,
+			     unsigned int len, unsigned int offset)
+{
+	struct request_queue *q = bio->bi_disk->queue;
+
+	if (WARN_ON_ONCE(bio_op(bio) != REQ_OP_ZONE_APPEND))
+		return 0;
+
+	if (WARN_ON_ONCE(!blk_queue_is_zoned(q)))
+		return 0;
+
+	return __bio_add_hw_page(q, bio, page, len, offset,
+				 queue_max_zone_append_sectors(q));
+}
+EXPORT_SYMBOL_GPL(bio_add_zone_append_page);
+
 /**
  *	bio_add_page	-	attempt to add page to bio
  *	@bio: destination bio
@@ -1849,6 +1957,7 @@ void bio_endio(struct bio *bio)
 	}
 
 	blk_throtl_bio_endio(bio);
+	blkcg_iolatency_done_bio(bio);
 	/* release cgroup info */
 	bio_uninit(bio);
 	if (bio->bi_end_io)
@@ -1937,6 +2046,16 @@ mempool_t *biovec_create_pool(int pool_entries)
 
 void bioset_free(struct bio_set *bs)
 {
+	if (bs->cache) {
+		int cpu;
+
+		cpuhp_state_remove_instance_nocalls(CPUHP_BIO_DEAD,
+						    &bs->cpuhp_dead);
+		for_each_possible_cpu(cpu)
+			bio_cache_drain(bs, per_cpu_ptr(bs->cache, cpu));
+		free_percpu(bs->cache);
+	}
+
 	if (bs->rescue_workqueue)
 		destroy_workqueue(bs->rescue_workqueue);
 
@@ -1957,8 +2076,8 @@ EXPORT_SYMBOL(bioset_free);
  * bioset_create  - Create a bio_set
  * @pool_size:	Number of bio and bio_vecs to cache in the mempool
  * @front_pad:	Number of bytes to allocate in front of the returned bio
- * @flags:	Flags to modify behavior, currently %BIOSET_NEED_BVECS
- *              and %BIOSET_NEED_RESCUER
+ * @flags:	Flags to modify behavior, currently %BIOSET_NEED_BVECS,
+ *              %BIOSET_NEED_RESCUER and %BIOSET_PERCPU_CACHE
  *
  * Description:
  *    Set up a bio_set to be used with @bio_alloc_bioset. Allows the caller
@@ -1971,6 +2090,8 @@ EXPORT_SYMBOL(bioset_free);
  *    for allocating iovecs.  This pool is not needed e.g. for bio_clone_fast().
  *    If %BIOSET_NEED_RESCUER is set, a workqueue is created which can be used to
  *    dispatch queued requests when the mempool runs out of space.
+ *    If %BIOSET_PERCPU_CACHE is set, the freed bios with inline vecs are kept
+ *    on a per-cpu list for the next allocations, bypassing the mempool.
  *
  */
 struct bio_set *bioset_create(unsigned int pool_size,
@@ -2006,6 +2127,14 @@ struct bio_set *bioset_create(unsigned int pool_size,
 			goto bad;
 	}
 
+	if (flags & BIOSET_PERCPU_CACHE) {
+		bs->cache = alloc_percpu(struct bio_alloc_cache);
+		if (!bs->cache)
+			goto bad;
+		cpuhp_state_add_instance_nocalls(CPUHP_BIO_DEAD,
+						 &bs->cpuhp_dead);
+	}
+
 	if (!(flags & BIOSET_NEED_RESCUER))
 		return bs;
 
@@ -2134,6 +2263,9 @@ static int __init init_bio(void)
 	bio_integrity_init();
 	biovec_init_slabs();
 
+	cpuhp_setup_state_multi(CPUHP_BIO_DEAD, "block/bio:dead", NULL,
+				bio_cpu_dead);
+
 	fs_bio_set = bioset_create(BIO_POOL_SIZE, 0, BIOSET_NEED_BVECS);
 	if (!fs_bio_set)
 		panic("bio: can't allocate bios\n");
@@ -950,13 +950,20 @@ static int blkcg_print_stat(struct seq_file *sf, void *v)
 
 	hlist_for_each_entry_rcu(blkg, &blkcg->blkg_list, blkcg_node) {
 		const char *dname;
+		char *buf;
 		struct blkg_rwstat rwstat;
 		u64 rbytes, wbytes, rios, wios;
+		size_t size = seq_get_buf(sf, &buf), off = 0;
+		bool has_stats = false;
+		int i;
 
 		dname = blkg_dev_name(blkg);
 		if (!dname)
 			continue;
 
+		/* the line is only committed if there is any stat to show */
+		off += scnprintf(buf+off, size-off, "%s", dname);
+
 		spin_lock_irq(blkg->q->queue_lock);
 
 		rwstat = blkg_rwstat_recursive_sum(blkg, NULL,
@@ -969,11 +976,39 @@ static int blkcg_print_stat(struct seq_file *sf, void *v)
 		rios = atomic64_read(&rwstat.aux_cnt[BLKG_RWSTAT_READ]);
 		wios = atomic64_read(&rwstat.aux_cnt[BLKG_RWSTAT_WRITE]);
 
+		if (rbytes || wbytes || rios || wios) {
+			has_stats = true;
+			off += scnprintf(buf+off, size-off,
+					 " rbytes=%llu wbytes=%llu rios=%llu wios=%llu",
+					 rbytes, wbytes, rios, wios);
+		}
+
+		/* the policies append their own statistics to the line */
+		for (i = 0; i < BLKCG_MAX_POLS; i++) {
+			struct blkcg_policy *pol = blkcg_policy[i];
+			size_t written;
+
+			if (!blkg->pd[i] || !pol || !pol->pd_stat_fn)
+				continue;
+
+			written = pol->pd_stat_fn(blkg->pd[i], buf+off,
+						  size-off);
+			if (written)
+				has_stats = true;
+			off += written;
+		}
+
 		spin_unlock_irq(blkg->q->queue_lock);
 
-		if (rbytes || wbytes || rios || wios)
-			seq_printf(sf, "%s rbytes=%llu wbytes=%llu rios=%llu wios=%llu\n",
-				   dname, rbytes, wbytes, rios, wios);
+		if (has_stats) {
+			if (off < size - 1) {
+				off += scnprintf(buf+off, size-off, "\n");
+				seq_commit(sf, off);
+			} else {
+				/* retry with a larger buffer */
+				seq_commit(sf, -1);
+			}
+		}
 	}
 
 	rcu_read_unlock();
@@ -1162,11 +1197,26 @@ int blkcg_init_queue(struct request_queue *q)
 	q->root_rl.blkg = blkg;
 
 	ret = blk_throtl_init(q);
+	if (ret)
+		goto err_destroy_all;
+
+	ret = blk_iolatency_init(q);
+	if (ret)
+		goto err_throtl_exit;
+
+	ret = blk_lat_hist_init(q);
 	if (ret) {
-		spin_lock_irq(q->queue_lock);
-		blkg_destroy_all(q);
-		spin_unlock_irq(q->queue_lock);
+		blk_iolatency_exit(q);
+		goto err_throtl_exit;
 	}
+	return 0;
+
+err_throtl_exit:
+	blk_throtl_exit(q);
+err_destroy_all:
+	spin_lock_irq(q->queue_lock);
+	blkg_destroy_all(q);
+	spin_unlock_irq(q->queue_lock);
 	return ret;
 }
 
@@ -1203,6 +1253,8 @@ void blkcg_exit_queue(struct request_queue *q)
 	spin_unlock_irq(q->queue_lock);
 
 	blk_throtl_exit(q);
+	blk_iolatency_exit(q);
+	blk_lat_hist_exit(q);
 }
 
 /*
@@ -199,9 +199,22 @@ static void req_bio_endio(struct request *rq, struct bio *bio,
 
 	bio_advance(bio, nbytes);
 
+	if (req_op(rq) == REQ_OP_ZONE_APPEND && !error) {
+		/*
+		 * The driver set the request position to where the data was
+		 * written, a partial completion can't report that location.
+		 */
+		if (bio->bi_iter.bi_size)
+			bio->bi_status = BLK_STS_IOERR;
+		else
+			bio->bi_iter.bi_sector = rq->__sector;
+	}
+
 	/* don't actually finish bio if it's part of flush sequence */
-	if (bio->bi_iter.bi_size == 0 && !(rq->rq_flags & RQF_FLUSH_SEQ))
+	if (bio->bi_iter.bi_size == 0 && !(rq->rq_flags & RQF_FLUSH_SEQ)) {
+		blk_lat_hist_bio_done(rq, bio);
 		bio_endio(bio);
+	}
 }
 
 void blk_dump_rq_flags(struct request *rq, char *msg)
@@ -1851,6 +1864,7 @@ static blk_qc_t blk_queue_bio(struct request_queue *q, struct bio *bio)
 	}
 
 get_rq:
+	blkcg_iolatency_throttle(q, bio, q->queue_lock);
 	wb_acct = wbt_wait(q->rq_wb, bio, q->queue_lock);
 
 	/*
@@ -2020,6 +2034,29 @@ static inline int bio_check_eod(struct bio *bio, unsigned int nr_sectors)
 	return 0;
 }
 
+/*
+ * A zone append must start at the beginning of a zone, whose write pointer
+ * position the device uses, and fit in a single request: splitting it could
+ * write the pieces in different zones.  The written location is returned in
+ * bi_sector, relative to the disk, so partitions are not supported.
+ */
+static inline blk_status_t blk_check_zone_append(struct request_queue *q,
+						 struct bio *bio)
+{
+	sector_t pos = bio->bi_iter.bi_sector;
+
+	if (!blk_queue_is_zoned(q) || !queue_max_zone_append_sectors(q) ||
+	    bio->bi_partno)
+		return BLK_STS_NOTSUPP;
+
+	if (pos & (blk_queue_zone_sectors(q) - 1) ||
+	    bio_sectors(bio) > queue_max_zone_append_sectors(q))
+		return BLK_STS_IOERR;
+
+	bio->bi_opf |= REQ_NOMERGE;
+	return BLK_STS_OK;
+}
+
 static noinline_for_stack bool
 generic_make_request_checks(struct bio *bio)
 {
@@ -2053,6 +2090,15 @@ generic_make_request_checks(struct bio *bio)
 	if (should_fail_request(&bio->bi_disk->part0, bio->bi_iter.bi_size))
 		goto end_io;
 
+	if (bio_op(bio) == REQ_OP_ZONE_APPEND) {
+		blk_status_t ret = blk_check_zone_append(q, bio);
+
+		if (ret != BLK_STS_OK) {
+			status = ret;
+			goto end_io;
+		}
+	}
+
 	if (blk_partition_remap(bio))
 		goto end_io;
 
@@ -3227,20 +3273,17 @@ int kblockd_schedule_delayed_work_on(int cpu, struct delayed_work *dwork,
 EXPORT_SYMBOL(kblockd_schedule_delayed_work_on);
 
 /**
- * blk_start_plug - initialize blk_plug and track it inside the task_struct
+ * blk_start_plug_nr_ios - initialize blk_plug and track it inside the task
  * @plug:	The &struct blk_plug that needs to be initialized
+ * @nr_ios:	Number of I/Os the caller expects to submit
  *
  * Description:
- *   Tracking blk_plug inside the task_struct will help with auto-flushing the
- *   pending I/O should the task end up blocking between blk_start_plug() and
- *   blk_finish_plug(). This is important from a performance perspective, but
- *   also ensures that we don't deadlock. For instance, if the task is blocking
- *   for a memory allocation, memory reclaim could end up wanting to free a
- *   page belonging to that request that is currently residing in our private
- *   plug. By flushing the pending I/O when the process goes to sleep, we avoid
- *   this kind of deadlock.
+ *   Like blk_start_plug(), but lets blk-mq allocate the requests of the
+ *   first @nr_ios I/Os (at most %BLK_MAX_REQUEST_COUNT) with a single tag
+ *   allocation.  The requests left unused are freed when the plug is
+ *   flushed.
  */
-void blk_start_plug(struct blk_plug *plug)
+void blk_start_plug_nr_ios(struct blk_plug *plug, unsigned short nr_ios)
 {
 	struct task_struct *tsk = current;
 
@@ -3253,12 +3296,34 @@ void blk_start_plug(struct blk_plug *plug)
 	INIT_LIST_HEAD(&plug->list);
 	INIT_LIST_HEAD(&plug->mq_list);
 	INIT_LIST_HEAD(&plug->cb_list);
+	INIT_LIST_HEAD(&plug->cached_rq);
+	plug->nr_ios = min_t(unsigned short, nr_ios, BLK_MAX_REQUEST_COUNT);
 	/*
 	 * Store ordering should not be needed here, since a potential
 	 * preempt will imply a full memory barrier
 	 */
 	tsk->plug = plug;
 }
+EXPORT_SYMBOL(blk_start_plug_nr_ios);
+
+/**
+ * blk_start_plug - initialize blk_plug and track it inside the task_struct
+ * @plug:	The &struct blk_plug that needs to be initialized
+ *
+ * Description:
+ *   Tracking blk_plug inside the task_struct will help with auto-flushing the
+ *   pending I/O should the task end up blocking between blk_start_plug() and
+ *   blk_finish_plug(). This is important from a performance perspective, but
+ *   also ensures that we don't deadlock. For instance, if the task is blocking
+ *   for a memory allocation, memory reclaim could end up wanting to free a
+ *   page belonging to that request that is currently residing in our private
+ *   plug. By flushing the pending I/O when the process goes to sleep, we avoid
+ *   this kind of deadlock.
+ */
+void blk_start_plug(struct blk_plug *plug)
+{
+	blk_start_plug_nr_ios(plug, 1);
+}
 EXPORT_SYMBOL(blk_start_plug);
 
 static int plug_rq_cmp(void *priv, struct list_head *a, struct list_head *b)
@@ -3346,6 +3411,14 @@ void blk_flush_plug_list(struct blk_plug *plug, bool from_schedule)
 	if (!list_empty(&plug->mq_list))
 		blk_mq_flush_plug_list(plug, from_schedule);
 
+	/*
+	 * Free the cached requests even when called from schedule: they
+	 * hold references on their queue, a blocked task must not hold up
+	 * its freezing.
+	 */
+	if (unlikely(!list_empty(&plug->cached_rq)))
+		blk_mq_free_plug_rqs(plug);
+
 	if (list_empty(&plug->list))
 		return;
 
@@ -0,0 +1,563 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Block rq-wait based latency protection for cgroups
+ *
+ * Each cgroup can be given a target completion latency for a device through
+ * io.latency.  The latencies of the bios of a group are averaged over a
+ * window, through percpu blk_rq_stat buckets as used by blk-stat.  When a
+ * group misses its target, its siblings with a looser target (or none) get
+ * the number of bios they may have in flight halved, with the rq_wait
+ * throttling of blk-wbt.  The siblings recover step by step once a window
+ * passes without any target being missed.
+ *
+ * The scaling decisions of the children of a group are published through a
+ * cookie in the parent: it is decremented on each miss and incremented on
+ * each recovery window.  The children compare it with the value they saw
+ * last when they issue IO, and adjust their own depth accordingly.
+ */
+
+#include <linux/kernel.h>
+#include <linux/blkdev.h>
+#include <linux/bio.h>
+#include <linux/slab.h>
+#include <linux/percpu.h>
+#include <linux/blk-cgroup.h>
+#include "blk-stat.h"
+#include "blk-wbt.h"
+#include "blk.h"
+
+#define DEFAULT_SCALE_COOKIE	1000000U
+
+/* window of latency sampling, in multiples of the strictest target */
+#define WINDOW_TARGET_MULT	16
+#define MIN_WINDOW_NSEC		(100ULL * NSEC_PER_MSEC)
+#define MAX_WINDOW_NSEC		(1ULL * NSEC_PER_SEC)
+
+static struct blkcg_policy blkcg_policy_iolatency;
+
+struct child_latency_info {
+	spinlock_t lock;
+
+	/* lowest target of the children, 0 if none has one */
+	u64 min_lat_nsec;
+
+	/* jiffies of the last scaling decision */
+	unsigned long last_scale_event;
+
+	atomic_t scale_cookie;
+};
+
+struct iolatency_grp {
+	struct blkg_policy_data pd;
+	struct blk_rq_stat __percpu *stats;
+	struct rq_wait rq_wait;
+	atomic64_t window_start;
+
+	/* scale_cookie of the parent seen last */
+	atomic_t scale_cookie;
+
+	u64 min_lat_nsec;
+	unsigned int max_depth;
+
+	/* statistics of the last window, for io.stat */
+	u64 lat_avg;
+	u64 nr_windows;
+	u64 nr_missed;
+
+	struct child_latency_info child_lat;
+};
+
+static inline struct iolatency_grp *pd_to_lat(struct blkg_policy_data *pd)
+{
+	return pd ? container_of(pd, struct iolatency_grp, pd) : NULL;
+}
+
+static inline struct iolatency_grp *blkg_to_lat(struct blkcg_gq *blkg)
+{
+	return pd_to_lat(blkg_to_pd(blkg, &blkcg_policy_iolatency));
+}
+
+static inline struct blkcg_gq *lat_to_blkg(struct iolatency_grp *iolat)
+{
+	return pd_to_blkg(&iolat->pd);
+}
+
+static inline struct iolatency_grp *lat_parent(struct iolatency_grp *iolat)
+{
+	struct blkcg_gq *parent = lat_to_blkg(iolat)->parent;
+
+	return parent ? blkg_to_lat(parent) : NULL;
+}
+
+/*
+ * A group is only tracked while itself or one of its siblings has a target,
+ * other groups pay no more than the blkg lookup.
+ */
+static bool iolatency_applies(struct iolatency_grp *iolat)
+{
+	struct iolatency_grp *parent = lat_parent(iolat);
+
+	return READ_ONCE(iolat->min_lat_nsec) ||
+		(parent && READ_ONCE(parent->child_lat.min_lat_nsec));
+}
+
+static u64 iolatency_window(struct iolatency_grp *iolat)
+{
+	struct iolatency_grp *parent = lat_parent(iolat);
+	u64 lat = READ_ONCE(iolat->min_lat_nsec);
+
+	if (parent)
+		lat = max(lat, READ_ONCE(parent->child_lat.min_lat_nsec));
+
+	return clamp_t(u64, lat * WINDOW_TARGET_MULT, MIN_WINDOW_NSEC,
+		       MAX_WINDOW_NSEC);
+}
+
+static void scale_change(struct iolatency_grp *iolat, bool up, bool unlimit)
+{
+	struct request_queue *q = lat_to_blkg(iolat)->q;
+	unsigned int qd = max(q->nr_requests, 1UL);
+	unsigned int scale = max(qd / 16, 1U);
+	unsigned int depth = READ_ONCE(iolat->max_depth);
+
+	if (up) {
+		if (depth == UINT_MAX)
+			return;
+		depth += scale;
+		if (unlimit || depth >= qd)
+			depth = UINT_MAX;
+		WRITE_ONCE(iolat->max_depth, depth);
+		wake_up_all(&iolat->rq_wait.wait);
+	} else {
+		if (depth == UINT_MAX)
+			depth = qd;
+		WRITE_ONCE(iolat->max_depth, max(depth >> 1, 1U));
+	}
+}
+
+/*
+ * Follow the scaling decisions made in the parent since we last issued IO.
+ * The group with the strictest target is never throttled for its own sake.
+ */
+static void check_scale_change(struct iolatency_grp *iolat)
+{
+	struct iolatency_grp *parent = lat_parent(iolat);
+	unsigned int cur_cookie, our_cookie;
+
+	if (!parent)
+		return;
+
+	cur_cookie = atomic_read(&parent->child_lat.scale_cookie);
+	our_cookie = atomic_read(&iolat->scale_cookie);
+	if (cur_cookie == our_cookie)
+		return;
+	if (atomic_cmpxchg(&iolat->scale_cookie, our_cookie, cur_cookie) !=
+	    our_cookie)
+		return;
+
+	if (cur_cookie < our_cookie) {
+		u64 target = READ_ONCE(iolat->min_lat_nsec);
+
+		if (target &&
+		    target <= READ_ONCE(parent->child_lat.min_lat_nsec))
+			return;
+		scale_change(iolat, false, false);
+	} else {
+		scale_change(iolat, true, cur_cookie >= DEFAULT_SCALE_COOKIE);
+	}
+}
+
+static inline bool iolatency_may_queue(struct iolatency_grp *iolat,
+				       wait_queue_entry_t *wait)
+{
+	struct rq_wait *rqw = &iolat->rq_wait;
+	unsigned int depth = READ_ONCE(iolat->max_depth);
+
+	if (depth == UINT_MAX) {
+		atomic_inc(&rqw->inflight);
+		return true;
+	}
+
+	/*
+	 * If the waitqueue is already active and we are not the next
+	 * in line to be woken up, wait for our turn.
+	 */
+	if (waitqueue_active(&rqw->wait) &&
+	    rqw->wait.head.next != &wait->entry)
+		return false;
+
+	return rq_wait_inc_below(rqw, depth);
+}
+
+static void __blkcg_iolatency_throttle(struct iolatency_grp *iolat,
+				       spinlock_t *lock)
+	__releases(lock)
+	__acquires(lock)
+{
+	struct rq_wait *rqw = &iolat->rq_wait;
+	DEFINE_WAIT(wait);
+
+	if (iolatency_may_queue(iolat, &wait))
+		return;
+
+	do {
+		prepare_to_wait_exclusive(&rqw->wait, &wait,
+					  TASK_UNINTERRUPTIBLE);
+
+		if (iolatency_may_queue(iolat, &wait))
+			break;
+
+		if (lock) {
+			spin_unlock_irq(lock);
+			io_schedule();
+			spin_lock_irq(lock);
+		} else
+			io_schedule();
+	} while (1);
+
+	finish_wait(&rqw->wait, &wait);
+}
+
+/**
+ * blkcg_iolatency_throttle - throttle a bio against the depth of its cgroup
+ * @q: the request queue of @bio
+ * @bio: the bio about to get a request
+ * @lock: queue lock held by the caller, if any
+ *
+ * May sleep, like wbt_wait(), until the cgroup of @bio is below its current
+ * depth.  @lock is then released and reacquired.  The bio is tracked until
+ * blkcg_iolatency_done_bio().
+ */
+void blkcg_iolatency_throttle(struct request_queue *q, struct bio *bio,
+			      spinlock_t *lock)
+{
+	struct iolatency_grp *iolat;
+	struct blkcg_gq *blkg;
+
+	if (bio->bi_lat_private)
+		return;
+
+	rcu_read_lock();
+	blkg = blkg_lookup(bio_blkcg(bio), q);
+	iolat = blkg_to_lat(blkg);
+	if (!iolat || !iolatency_applies(iolat) || !blkg_tryget(blkg)) {
+		rcu_read_unlock();
+		return;
+	}
+	rcu_read_unlock();
+
+	check_scale_change(iolat);
+	__blkcg_iolatency_throttle(iolat, lock);
+
+	bio->bi_lat_private = iolat;
+	bio->bi_lat_issue = ktime_get_ns();
+}
+
+static void iolatency_check_latencies(struct iolatency_grp *iolat, u64 window)
+{
+	struct iolatency_grp *parent = lat_parent(iolat);
+	struct child_latency_info *lat_info;
+	struct blk_rq_stat stat;
+	unsigned long flags;
+	u64 target;
+	int cpu;
+
+	blk_rq_stat_init(&stat);
+	for_each_online_cpu(cpu) {
+		struct blk_rq_stat *s = per_cpu_ptr(iolat->stats, cpu);
+
+		blk_rq_stat_sum(&stat, s);
+		blk_rq_stat_init(s);
+	}
+
+	if (!stat.nr_samples || !parent)
+		return;
+
+	iolat->lat_avg = stat.mean;
+	iolat->nr_windows++;
+
+	lat_info = &parent->child_lat;
+	target = READ_ONCE(iolat->min_lat_nsec);
+
+	spin_lock_irqsave(&lat_info->lock, flags);
+	if (target && stat.mean > target) {
+		iolat->nr_missed++;
+		/* only the strictest target gets its siblings throttled */
+		if (target <= lat_info->min_lat_nsec &&
+		    atomic_read(&lat_info->scale_cookie) > 0) {
+			atomic_dec(&lat_info->scale_cookie);
+			lat_info->last_scale_event = jiffies;
+		}
+	} else if (atomic_read(&lat_info->scale_cookie) <
+		   DEFAULT_SCALE_COOKIE &&
+		   time_after(jiffies, lat_info->last_scale_event +
+			      nsecs_to_jiffies(window))) {
+		/* a whole window without any miss: let the siblings recover */
+		atomic_inc(&lat_info->scale_cookie);
+		lat_info->last_scale_event = jiffies;
+	}
+	spin_unlock_irqrestore(&lat_info->lock, flags);
+}
+
+/**
+ * blkcg_iolatency_done_bio - account the completion of a bio
+ * @bio: the completed bio
+ *
+ * Called from bio_endio(), in any context.
+ */
+void blkcg_iolatency_done_bio(struct bio *bio)
+{
+	struct iolatency_grp *iolat = bio->bi_lat_private;
+	struct rq_wait *rqw;
+	struct blk_rq_stat *stat;
+	u64 now, window, window_start;
+	int inflight;
+
+	if (!iolat)
+		return;
+	bio->bi_lat_private = NULL;
+
+	now = ktime_get_ns();
+	stat = get_cpu_ptr(iolat->stats);
+	if (now > bio->bi_lat_issue)
+		blk_rq_stat_add(stat, now - bio->bi_lat_issue);
+	put_cpu_ptr(stat);
+
+	window = iolatency_window(iolat);
+	window_start = atomic64_read(&iolat->window_start);
+	if (now > window_start && now - window_start >= window &&
+	    atomic64_cmpxchg(&iolat->window_start, window_start, now) ==
+	    window_start)
+		iolatency_check_latencies(iolat, window);
+
+	rqw = &iolat->rq_wait;
+	inflight = atomic_dec_return(&rqw->inflight);
+	WARN_ON_ONCE(inflight < 0);
+	if (waitqueue_active(&rqw->wait) &&
+	    inflight < READ_ONCE(iolat->max_depth))
+		wake_up(&rqw->wait);
+
+	blkg_put(lat_to_blkg(iolat));
+}
+
+/*
+ * The lowest target of the children drives the scaling of their siblings.
+ * Called with the queue lock held, on any change of the children targets.
+ */
+static void iolatency_update_min_lat(struct blkcg_gq *parent_blkg)
+{
+	struct iolatency_grp *parent = blkg_to_lat(parent_blkg);
+	struct cgroup_subsys_state *pos_css;
+	struct blkcg_gq *blkg;
+	u64 min_lat = 0;
+
+	if (!parent)
+		return;
+
+	rcu_read_lock();
+	blkg_for_each_descendant_pre(blkg, pos_css, parent_blkg) {
+		struct iolatency_grp *iolat = blkg_to_lat(blkg);
+
+		if (blkg->parent != parent_blkg || !iolat ||
+		    !iolat->min_lat_nsec)
+			continue;
+		if (!min_lat || iolat->min_lat_nsec < min_lat)
+			min_lat = iolat->min_lat_nsec;
+	}
+	rcu_read_unlock();
+
+	spin_lock(&parent->child_lat.lock);
+	WRITE_ONCE(parent->child_lat.min_lat_nsec, min_lat);
+	/* with no target left, nobody needs to be throttled any longer */
+	if (!min_lat)
+		atomic_set(&parent->child_lat.scale_cookie,
+			   DEFAULT_SCALE_COOKIE);
+	spin_unlock(&parent->child_lat.lock);
+}
+
+static ssize_t iolatency_set_limit(struct kernfs_open_file *of, char *buf,
+				   size_t nbytes, loff_t off)
+{
+	struct blkcg *blkcg = css_to_blkcg(of_css(of));
+	struct blkg_conf_ctx ctx;
+	struct iolatency_grp *iolat;
+	u64 lat_val = 0;
+	int ret;
+
+	ret = blkg_conf_prep(blkcg, &blkcg_policy_iolatency, buf, &ctx);
+	if (ret)
+		return ret;
+
+	iolat = blkg_to_lat(ctx.blkg);
+
+	while (true) {
+		char tok[27];	/* target=18446744073709551616 */
+		char *p;
+		u64 val = 0;
+		int len;
+
+		if (sscanf(ctx.body, "%26s%n", tok, &len) != 1)
+			break;
+		if (tok[0] == '\0')
+			break;
+		ctx.body += len;
+
+		ret = -EINVAL;
+		p = tok;
+		strsep(&p, "=");
+		if (!p || (sscanf(p, "%llu", &val) != 1 && strcmp(p, "max")))
+			goto out_finish;
+
+		if (strcmp(tok, "target"))
+			goto out_finish;
+		lat_val = val;
+	}
+
+	ret = -ERANGE;
+	if (lat_val > U64_MAX / NSEC_PER_USEC)
+		goto out_finish;
+
+	WRITE_ONCE(iolat->min_lat_nsec, lat_val * NSEC_PER_USEC);
+	iolatency_update_min_lat(ctx.blkg->parent);
+	ret = 0;
+out_finish:
+	blkg_conf_finish(&ctx);
+	return ret ?: nbytes;
+}
+
+static u64 iolatency_prfill_limit(struct seq_file *sf,
+				  struct blkg_policy_data *pd, int off)
+{
+	struct iolatency_grp *iolat = pd_to_lat(pd);
+	const char *dname = blkg_dev_name(pd->blkg);
+
+	if (!dname || !iolat->min_lat_nsec)
+		return 0;
+	seq_printf(sf, "%s target=%llu\n",
+		   dname, div_u64(iolat->min_lat_nsec, NSEC_PER_USEC));
+	return 0;
+}
+
+static int iolatency_print_limit(struct seq_file *sf, void *v)
+{
+	blkcg_print_blkgs(sf, css_to_blkcg(seq_css(sf)),
+			  iolatency_prfill_limit,
+			  &blkcg_policy_iolatency, seq_cft(sf)->private, false);
+	return 0;
+}
+
+static size_t iolatency_pd_stat(struct blkg_policy_data *pd, char *buf,
+				size_t size)
+{
+	struct iolatency_grp *iolat = pd_to_lat(pd);
+	unsigned int depth = READ_ONCE(iolat->max_depth);
+
+	if (!iolatency_applies(iolat))
+		return 0;
+
+	if (depth == UINT_MAX)
+		return scnprintf(buf, size,
+				 " depth=max avg_lat=%llu win_missed=%llu win_total=%llu",
+				 div_u64(iolat->lat_avg, NSEC_PER_USEC),
+				 iolat->nr_missed, iolat->nr_windows);
+	return scnprintf(buf, size,
+			 " depth=%u avg_lat=%llu win_missed=%llu win_total=%llu",
+			 depth, div_u64(iolat->lat_avg, NSEC_PER_USEC),
+			 iolat->nr_missed, iolat->nr_windows);
+}
+
+static struct blkg_policy_data *iolatency_pd_alloc(gfp_t gfp, int node)
+{
+	struct iolatency_grp *iolat;
+
+	iolat = kzalloc_node(sizeof(*iolat), gfp, node);
+	if (!iolat)
+		return NULL;
+	iolat->stats = alloc_percpu_gfp(struct blk_rq_stat, gfp);
+	if (!iolat->stats) {
+		kfree(iolat);
+		return NULL;
+	}
+	return &iolat->pd;
+}
+
+static void iolatency_pd_init(struct blkg_policy_data *pd)
+{
+	struct iolatency_grp *iolat = pd_to_lat(pd);
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		blk_rq_stat_init(per_cpu_ptr(iolat->stats, cpu));
+
+	atomic_set(&iolat->rq_wait.inflight, 0);
+	init_waitqueue_head(&iolat->rq_wait.wait);
+	atomic64_set(&iolat->window_start, ktime_get_ns());
+	atomic_set(&iolat->scale_cookie, DEFAULT_SCALE_COOKIE);
+	iolat->max_depth = UINT_MAX;
+
+	spin_lock_init(&iolat->child_lat.lock);
+	iolat->child_lat.last_scale_event = jiffies;
+	atomic_set(&iolat->child_lat.scale_cookie, DEFAULT_SCALE_COOKIE);
+}
+
+static void iolatency_pd_offline(struct blkg_policy_data *pd)
+{
+	struct iolatency_grp *iolat = pd_to_lat(pd);
+	struct blkcg_gq *blkg = lat_to_blkg(iolat);
+
+	WRITE_ONCE(iolat->min_lat_nsec, 0);
+	iolatency_update_min_lat(blkg->parent);
+
+	WRITE_ONCE(iolat->max_depth, UINT_MAX);
+	wake_up_all(&iolat->rq_wait.wait);
+}
+
+static void iolatency_pd_free(struct blkg_policy_data *pd)
+{
+	struct iolatency_grp *iolat = pd_to_lat(pd);
+
+	free_percpu(iolat->stats);
+	kfree(iolat);
+}
+
+static struct cftype iolatency_files[] = {
+	{
+		.name = "latency",
+		.flags = CFTYPE_NOT_ON_ROOT,
+		.seq_show = iolatency_print_limit,
+		.write = iolatency_set_limit,
+	},
+	{ }	/* terminate */
+};
+
+static struct blkcg_policy blkcg_policy_iolatency = {
+	.dfl_cftypes		= iolatency_files,
+	.pd_alloc_fn		= iolatency_pd_alloc,
+	.pd_init_fn		= iolatency_pd_init,
+	.pd_offline_fn		= iolatency_pd_offline,
+	.pd_free_fn		= iolatency_pd_free,
+	.pd_stat_fn		= iolatency_pd_stat,
+};
+
+int blk_iolatency_init(struct request_queue *q)
+{
+	return blkcg_activate_policy(q, &blkcg_policy_iolatency);
+}
+
+void blk_iolatency_exit(struct request_queue *q)
+{
+	blkcg_deactivate_policy(q, &blkcg_policy_iolatency);
+}
+
+static int __init iolatency_init(void)
+{
+	return blkcg_policy_register(&blkcg_policy_iolatency);
+}
+
+static void __exit iolatency_exit(void)
+{
+	blkcg_policy_unregister(&blkcg_policy_iolatency);
+}
+
+module_init(iolatency_init);
+module_exit(iolatency_exit);
@@ -0,0 +1,329 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Per cgroup and per device IO latency histograms
+ *
+ * The histograms are enabled for a device by writing "MAJ:MIN on" to the
+ * latency_hist file of a cgroup, and freed again with "MAJ:MIN off".  Two
+ * latencies are recorded for each completed bio, split by reads, writes and
+ * discards:
+ *
+ * q2c: from the submission of the bio to its completion, including the time
+ *	spent throttled and queued
+ * d2c: from the issue to the driver of the request holding the bio to the
+ *	completion of the bio
+ *
+ * Only the bios completed through requests are accounted, bio based drivers
+ * have no histograms.
+ *
+ * The buckets are log-linear: the latencies under 4us get a bucket per us,
+ * and each power of two above is split in four buckets, up to about 30s.
+ * They are counted per cpu and only summed when the file is read, which
+ * shows the non-empty buckets as "<upper bound in us>:<count>".
+ */
+
+#include <linux/kernel.h>
+#include <linux/blkdev.h>
+#include <linux/bio.h>
+#include <linux/slab.h>
+#include <linux/percpu.h>
+#include <linux/blk-cgroup.h>
+#include "blk-stat.h"
+#include "blk.h"
+
+#define LAT_HIST_SUB_BITS	2
+#define LAT_HIST_SUB		(1 << LAT_HIST_SUB_BITS)
+#define LAT_HIST_GROUPS		24
+#define LAT_HIST_BUCKETS	(LAT_HIST_GROUPS * LAT_HIST_SUB)
+
+enum {
+	LAT_HIST_READ,
+	LAT_HIST_WRITE,
+	LAT_HIST_DISCARD,
+	LAT_HIST_NR_DIRS,
+};
+
+enum {
+	LAT_HIST_Q2C,
+	LAT_HIST_D2C,
+	LAT_HIST_NR_TYPES,
+};
+
+static const char *lat_hist_dir_names[LAT_HIST_NR_DIRS] = {
+	[LAT_HIST_READ]		= "read",
+	[LAT_HIST_WRITE]	= "write",
+	[LAT_HIST_DISCARD]	= "discard",
+};
+
+static const char *lat_hist_type_names[LAT_HIST_NR_TYPES] = {
+	[LAT_HIST_Q2C]		= "q2c",
+	[LAT_HIST_D2C]		= "d2c",
+};
+
+struct lat_hist {
+	u64 buckets[LAT_HIST_NR_TYPES][LAT_HIST_NR_DIRS][LAT_HIST_BUCKETS];
+};
+
+struct lat_hist_grp {
+	struct blkg_policy_data pd;
+
+	/* NULL unless enabled, freed after a RCU grace period */
+	struct lat_hist __percpu *hist;
+};
+
+static struct blkcg_policy blkcg_policy_lat_hist;
+
+static inline struct lat_hist_grp *pd_to_lhg(struct blkg_policy_data *pd)
+{
+	return pd ? container_of(pd, struct lat_hist_grp, pd) : NULL;
+}
+
+static inline struct lat_hist_grp *blkg_to_lhg(struct blkcg_gq *blkg)
+{
+	return pd_to_lhg(blkg_to_pd(blkg, &blkcg_policy_lat_hist));
+}
+
+static unsigned int lat_hist_bucket(u64 lat_ns)
+{
+	u64 us = div_u64(lat_ns, NSEC_PER_USEC);
+	unsigned int shift, idx;
+
+	if (us < LAT_HIST_SUB)
+		return us;
+
+	shift = fls64(us) - 1 - LAT_HIST_SUB_BITS;
+	idx = (shift + 1) * LAT_HIST_SUB +
+		((us >> shift) & (LAT_HIST_SUB - 1));
+	return min_t(unsigned int, idx, LAT_HIST_BUCKETS - 1);
+}
+
+/* upper bound of bucket @idx, in us */
+static u64 lat_hist_bucket_limit(unsigned int idx)
+{
+	unsigned int shift;
+
+	if (idx < LAT_HIST_SUB)
+		return idx + 1;
+
+	shift = idx / LAT_HIST_SUB - 1;
+	return (u64)(LAT_HIST_SUB + idx % LAT_HIST_SUB + 1) << shift;
+}
+
+static int lat_hist_dir(struct bio *bio)
+{
+	if (bio_op(bio) == REQ_OP_DISCARD)
+		return LAT_HIST_DISCARD;
+	return op_is_write(bio_op(bio)) ? LAT_HIST_WRITE : LAT_HIST_READ;
+}
+
+/**
+ * blk_lat_hist_bio_issue - start the q2c latency of a bio
+ * @blkg: the blkg @bio is issued by
+ * @bio: the submitted bio
+ *
+ * Called from blkcg_bio_issue_check(), under the RCU read lock.  A throttled
+ * bio keeps the time of its first submission.
+ */
+void blk_lat_hist_bio_issue(struct blkcg_gq *blkg, struct bio *bio)
+{
+	struct lat_hist_grp *lhg = blkg_to_lhg(blkg);
+
+	if (lhg && READ_ONCE(lhg->hist) && !bio->bi_submit_ns)
+		bio->bi_submit_ns = ktime_get_ns();
+}
+
+/**
+ * blk_lat_hist_bio_done - account the latencies of a completed bio
+ * @rq: the request @bio was part of
+ * @bio: the bio being completed
+ *
+ * Called from any context, before bio_endio().
+ */
+void blk_lat_hist_bio_done(struct request *rq, struct bio *bio)
+{
+	struct lat_hist_grp *lhg;
+	struct lat_hist __percpu *hist;
+	u64 now, issue;
+	int dir;
+
+	if (!bio->bi_submit_ns)
+		return;
+
+	rcu_read_lock();
+	lhg = blkg_to_lhg(blkg_lookup(bio_blkcg(bio), rq->q));
+	hist = lhg ? READ_ONCE(lhg->hist) : NULL;
+	if (!hist)
+		goto out;
+
+	now = ktime_get_ns();
+	dir = lat_hist_dir(bio);
+	if (now > bio->bi_submit_ns)
+		this_cpu_inc(hist->buckets[LAT_HIST_Q2C][dir]
+			     [lat_hist_bucket(now - bio->bi_submit_ns)]);
+
+	/* the issue time of the request is truncated by blk-stat */
+	issue = blk_stat_time(&rq->issue_stat);
+	now = __blk_stat_time(now);
+	if (issue && now > issue)
+		this_cpu_inc(hist->buckets[LAT_HIST_D2C][dir]
+			     [lat_hist_bucket(now - issue)]);
+out:
+	rcu_read_unlock();
+	bio->bi_submit_ns = 0;
+}
+
+static u64 lat_hist_prfill(struct seq_file *sf, struct blkg_policy_data *pd,
+			   int off)
+{
+	struct lat_hist __percpu *hist = pd_to_lhg(pd)->hist;
+	const char *dname = blkg_dev_name(pd->blkg);
+	int type, dir, idx, cpu;
+
+	if (!dname || !hist)
+		return 0;
+
+	for (type = 0; type < LAT_HIST_NR_TYPES; type++) {
+		for (dir = 0; dir < LAT_HIST_NR_DIRS; dir++) {
+			seq_printf(sf, "%s %s_%s", dname,
+				   lat_hist_dir_names[dir],
+				   lat_hist_type_names[type]);
+			for (idx = 0; idx < LAT_HIST_BUCKETS; idx++) {
+				u64 sum = 0;
+
+				for_each_possible_cpu(cpu)
+					sum += per_cpu_ptr(hist, cpu)->
+						buckets[type][dir][idx];
+				if (sum)
+					seq_printf(sf, " %llu:%llu",
+						   lat_hist_bucket_limit(idx),
+						   sum);
+			}
+			seq_putc(sf, '\n');
+		}
+	}
+	return 0;
+}
+
+static int lat_hist_print(struct seq_file *sf, void *v)
+{
+	blkcg_print_blkgs(sf, css_to_blkcg(seq_css(sf)), lat_hist_prfill,
+			  &blkcg_policy_lat_hist, 0, false);
+	return 0;
+}
+
+static ssize_t lat_hist_write(struct kernfs_open_file *of, char *buf,
+			      size_t nbytes, loff_t off)
+{
+	struct blkcg *blkcg = css_to_blkcg(of_css(of));
+	struct lat_hist __percpu *new, *old = NULL;
+	struct blkg_conf_ctx ctx;
+	struct lat_hist_grp *lhg;
+	char tok[4];
+	int ret;
+
+	/* preallocated, the queue_lock is held once the blkg is found */
+	new = alloc_percpu(struct lat_hist);
+	if (!new)
+		return -ENOMEM;
+
+	ret = blkg_conf_prep(blkcg, &blkcg_policy_lat_hist, buf, &ctx);
+	if (ret)
+		goto out_free;
+
+	lhg = blkg_to_lhg(ctx.blkg);
+
+	ret = -EINVAL;
+	if (sscanf(ctx.body, "%3s", tok) != 1)
+		goto out_finish;
+
+	if (!strcmp(tok, "on")) {
+		if (!lhg->hist) {
+			blk_stat_enable_accounting(ctx.blkg->q);
+			WRITE_ONCE(lhg->hist, new);
+			new = NULL;
+		}
+	} else if (!strcmp(tok, "off")) {
+		old = lhg->hist;
+		WRITE_ONCE(lhg->hist, NULL);
+	} else {
+		goto out_finish;
+	}
+	ret = 0;
+out_finish:
+	blkg_conf_finish(&ctx);
+	if (old) {
+		/* blk_lat_hist_bio_done() may still be using it */
+		synchronize_rcu();
+		free_percpu(old);
+	}
+out_free:
+	free_percpu(new);
+	return ret ?: nbytes;
+}
+
+static struct blkg_policy_data *lat_hist_pd_alloc(gfp_t gfp, int node)
+{
+	struct lat_hist_grp *lhg;
+
+	lhg = kzalloc_node(sizeof(*lhg), gfp, node);
+	if (!lhg)
+		return NULL;
+	return &lhg->pd;
+}
+
+static void lat_hist_pd_free(struct blkg_policy_data *pd)
+{
+	struct lat_hist_grp *lhg = pd_to_lhg(pd);
+
+	/* the blkg is released after a RCU grace period */
+	free_percpu(lhg->hist);
+	kfree(lhg);
+}
+
+static struct cftype lat_hist_files[] = {
+	{
+		.name = "latency_hist",
+		.flags = CFTYPE_NOT_ON_ROOT,
+		.seq_show = lat_hist_print,
+		.write = lat_hist_write,
+	},
+	{ }	/* terminate */
+};
+
+static struct cftype lat_hist_legacy_files[] = {
+	{
+		.name = "latency_hist",
+		.seq_show = lat_hist_print,
+		.write = lat_hist_write,
+	},
+	{ }	/* terminate */
+};
+
+static struct blkcg_policy blkcg_policy_lat_hist = {
+	.dfl_cftypes		= lat_hist_files,
+	.legacy_cftypes		= lat_hist_legacy_files,
+	.pd_alloc_fn		= lat_hist_pd_alloc,
+	.pd_free_fn		= lat_hist_pd_free,
+};
+
+int blk_lat_hist_init(struct request_queue *q)
+{
+	return blkcg_activate_policy(q, &blkcg_policy_lat_hist);
+}
+
+void blk_lat_hist_exit(struct request_queue *q)
+{
+	blkcg_deactivate_policy(q, &blkcg_policy_lat_hist);
+}
+
+static int __init lat_hist_init(void)
+{
+	return blkcg_policy_register(&blkcg_policy_lat_hist);
+}
+
+static void __exit lat_hist_exit(void)
+{
+	blkcg_policy_unregister(&blkcg_policy_lat_hist);
+}
+
+module_init(lat_hist_init);
+module_exit(lat_hist_exit);
@@ -181,6 +181,23 @@ static struct bio *blk_bio_segment_split(struct request_queue *q,
 	return do_split ? new : NULL;
 }
 
+/*
+ * A bio made of a single vec within a page, as most small direct IOs are,
+ * fits any queue limits: max_sectors, max_segment_size and the segment
+ * boundary are all at least one page, and there is no gap to check against
+ * the virt boundary.  Only the chunk boundary can still get in the way.
+ */
+static inline bool bio_may_exceed_limits(struct request_queue *q,
+					 struct bio *bio)
+{
+	struct bio_vec *bv = bio->bi_io_vec;
+
+	if (bio->bi_vcnt != 1 || bio_flagged(bio, BIO_CLONED) ||
+	    q->limits.chunk_sectors)
+		return true;
+	return bv->bv_offset + bv->bv_len > PAGE_SIZE;
+}
+
 void blk_queue_split(struct request_queue *q, struct bio **bio)
 {
 	struct bio *split, *res;
@@ -198,6 +215,11 @@ void blk_queue_split(struct request_queue *q, struct bio **bio)
 		split = blk_bio_write_same_split(q, *bio, q->bio_split, &nsegs);
 		break;
 	default:
+		if (!bio_may_exceed_limits(q, *bio)) {
+			split = NULL;
+			nsegs = 1;
+			break;
+		}
 		split = blk_bio_segment_split(q, *bio, q->bio_split, &nsegs);
 		break;
 	}
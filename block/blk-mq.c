@@ -39,6 +39,8 @@
 
 static void blk_mq_poll_stats_start(struct request_queue *q);
 static void blk_mq_poll_stats_fn(struct blk_stat_callback *cb);
+static void blk_mq_ra_stats_start(struct request_queue *q);
+static void blk_mq_ra_stats_fn(struct blk_stat_callback *cb);
 
 static int blk_mq_poll_stats_bkt(const struct request *rq)
 {
@@ -57,6 +59,24 @@ static int blk_mq_poll_stats_bkt(const struct request *rq)
 	return bucket;
 }
 
+/* Reads by size, from 4k to 512k and more */
+#define BLK_MQ_RA_STATS_BKTS	8
+
+static int blk_mq_ra_stats_bkt(const struct request *rq)
+{
+	unsigned int bytes = blk_rq_bytes(rq);
+	int bucket;
+
+	if (rq_data_dir(rq) != READ || !bytes)
+		return -1;
+
+	bucket = ilog2(bytes) - 12;
+	if (bucket < 0)
+		return -1;
+
+	return min(bucket, BLK_MQ_RA_STATS_BKTS - 1);
+}
+
 /*
  * Check if any of the ctx's have pending work in this hardware queue
  */
@@ -73,14 +93,18 @@ bool blk_mq_hctx_has_pending(struct blk_mq_hw_ctx *hctx)
 static void blk_mq_hctx_mark_pending(struct blk_mq_hw_ctx *hctx,
 				     struct blk_mq_ctx *ctx)
 {
-	if (!sbitmap_test_bit(&hctx->ctx_map, ctx->index_hw))
-		sbitmap_set_bit(&hctx->ctx_map, ctx->index_hw);
+	const int bit = ctx->index_hw[hctx->type];
+
+	if (!sbitmap_test_bit(&hctx->ctx_map, bit))
+		sbitmap_set_bit(&hctx->ctx_map, bit);
 }
 
 static void blk_mq_hctx_clear_pending(struct blk_mq_hw_ctx *hctx,
 				      struct blk_mq_ctx *ctx)
 {
-	sbitmap_clear_bit(&hctx->ctx_map, ctx->index_hw);
+	const int bit = ctx->index_hw[hctx->type];
+
+	sbitmap_clear_bit(&hctx->ctx_map, bit);
 }
 
 struct mq_inflight {
@@ -329,6 +353,43 @@ static struct request *blk_mq_rq_ctx_init(struct blk_mq_alloc_data *data,
 	return rq;
 }
 
+/*
+ * Allocate up to data->nr_tags requests with a single tag allocation.  The
+ * first one is returned, the others are queued on data->cached_rq for the
+ * following submissions of the plug.
+ */
+static struct request *
+__blk_mq_alloc_requests_batch(struct blk_mq_alloc_data *data, unsigned int op)
+{
+	struct request *rq, *first = NULL;
+	unsigned int tag_offset;
+	unsigned long tag_mask;
+	int i, nr = 0;
+
+	tag_mask = blk_mq_get_tags(data, data->nr_tags, &tag_offset);
+	if (unlikely(!tag_mask))
+		return NULL;
+
+	for (i = 0; tag_mask; i++) {
+		if (!(tag_mask & (1UL << i)))
+			continue;
+		tag_mask &= ~(1UL << i);
+		rq = blk_mq_rq_ctx_init(data, tag_offset + i, op);
+		rq->elv.icq = NULL;
+		if (!first)
+			first = rq;
+		else
+			list_add_tail(&rq->queuelist, data->cached_rq);
+		nr++;
+	}
+
+	/* the caller already holds a reference on the queue for the first */
+	percpu_ref_get_many(&data->q->q_usage_counter, nr - 1);
+	data->hctx->queued += nr;
+	data->nr_tags -= nr;
+	return first;
+}
+
 static struct request *blk_mq_get_request(struct request_queue *q,
 		struct bio *bio, unsigned int op,
 		struct blk_mq_alloc_data *data)
@@ -342,8 +403,9 @@ static struct request *blk_mq_get_request(struct request_queue *q,
 	data->q = q;
 	if (likely(!data->ctx))
 		data->ctx = local_ctx = blk_mq_get_ctx(q);
+	data->cmd_flags = op;
 	if (likely(!data->hctx))
-		data->hctx = blk_mq_map_queue(q, data->ctx->cpu);
+		data->hctx = blk_mq_map_queue(q, data->cmd_flags, data->ctx);
 	if (op & REQ_NOWAIT)
 		data->flags |= BLK_MQ_REQ_NOWAIT;
 
@@ -356,6 +418,10 @@ static struct request *blk_mq_get_request(struct request_queue *q,
 		 */
 		if (!op_is_flush(op) && e->type->ops.mq.limit_depth)
 			e->type->ops.mq.limit_depth(op, data);
+	} else if (data->nr_tags > 1) {
+		rq = __blk_mq_alloc_requests_batch(data, op);
+		if (rq)
+			return rq;
 	}
 
 	tag = blk_mq_get_tag(data);
@@ -460,7 +526,7 @@ void blk_mq_free_request(struct request *rq)
 	struct request_queue *q = rq->q;
 	struct elevator_queue *e = q->elevator;
 	struct blk_mq_ctx *ctx = rq->mq_ctx;
-	struct blk_mq_hw_ctx *hctx = blk_mq_map_queue(q, ctx->cpu);
+	struct blk_mq_hw_ctx *hctx = blk_mq_map_queue(q, rq->cmd_flags, ctx);
 	const int sched_tag = rq->internal_tag;
 
 	if (rq->rq_flags & RQF_ELVPRIV) {
@@ -489,6 +555,21 @@ void blk_mq_free_request(struct request *rq)
 }
 EXPORT_SYMBOL_GPL(blk_mq_free_request);
 
+/*
+ * Free the requests allocated in advance for a plug, but never used.
+ */
+void blk_mq_free_plug_rqs(struct blk_plug *plug)
+{
+	struct request *rq;
+
+	while (!list_empty(&plug->cached_rq)) {
+		rq = list_first_entry(&plug->cached_rq, struct request,
+				      queuelist);
+		list_del_init(&rq->queuelist);
+		blk_mq_free_request(rq);
+	}
+}
+
 inline void __blk_mq_end_request(struct request *rq, blk_status_t error)
 {
 	blk_account_io_done(rq);
@@ -512,6 +593,73 @@ void blk_mq_end_request(struct request *rq, blk_status_t error)
 }
 EXPORT_SYMBOL(blk_mq_end_request);
 
+#define TAG_COMP_BATCH		32
+
+static inline void blk_mq_flush_tag_batch(struct blk_mq_hw_ctx *hctx,
+					  int *tag_array, int nr_tags)
+{
+	struct request_queue *q = hctx->queue;
+
+	blk_mq_put_tags(hctx->tags, tag_array, nr_tags);
+	blk_mq_sched_restart(hctx);
+	percpu_ref_put_many(&q->q_usage_counter, nr_tags);
+}
+
+/**
+ * blk_mq_end_request_batch - end I/O on a batch of requests
+ * @iob:	the batch filled by blk_mq_add_to_batch()
+ *
+ * Description:
+ *	Ends all I/O successfully on the requests of @iob, and frees them.
+ *	The driver tags are given back to the tag map and the queue usage
+ *	counter dropped for up to TAG_COMP_BATCH requests at once, with a
+ *	single wakeup of the tag waiters.
+ **/
+void blk_mq_end_request_batch(struct io_comp_batch *iob)
+{
+	int tags[TAG_COMP_BATCH], nr_tags = 0;
+	struct blk_mq_hw_ctx *cur_hctx = NULL;
+	struct request *rq, *next;
+
+	list_for_each_entry_safe(rq, next, &iob->req_list, queuelist) {
+		struct request_queue *q = rq->q;
+		struct blk_mq_ctx *ctx = rq->mq_ctx;
+		struct blk_mq_hw_ctx *hctx;
+
+		list_del_init(&rq->queuelist);
+		if (blk_update_request(rq, BLK_STS_OK, blk_rq_bytes(rq)))
+			BUG();
+		blk_account_io_done(rq);
+
+		hctx = blk_mq_map_queue(q, rq->cmd_flags, ctx);
+		if (blk_mq_tag_is_reserved(hctx->tags, rq->tag)) {
+			blk_mq_free_request(rq);
+			continue;
+		}
+
+		ctx->rq_completed[rq_is_sync(rq)]++;
+		if (rq->rq_flags & RQF_MQ_INFLIGHT)
+			atomic_dec(&hctx->nr_active);
+
+		wbt_done(q->rq_wb, &rq->issue_stat);
+
+		clear_bit(REQ_ATOM_STARTED, &rq->atomic_flags);
+		clear_bit(REQ_ATOM_POLL_SLEPT, &rq->atomic_flags);
+
+		if (nr_tags == TAG_COMP_BATCH || cur_hctx != hctx) {
+			if (cur_hctx)
+				blk_mq_flush_tag_batch(cur_hctx, tags, nr_tags);
+			nr_tags = 0;
+			cur_hctx = hctx;
+		}
+		tags[nr_tags++] = rq->tag;
+	}
+
+	if (nr_tags)
+		blk_mq_flush_tag_batch(cur_hctx, tags, nr_tags);
+}
+EXPORT_SYMBOL_GPL(blk_mq_end_request_batch);
+
 static void __blk_mq_complete_request_remote(void *data)
 {
 	struct request *rq = data;
@@ -529,6 +677,7 @@ static void __blk_mq_complete_request(struct request *rq)
 		blk_mq_sched_completed_request(rq);
 	if (rq->rq_flags & RQF_STATS) {
 		blk_mq_poll_stats_start(rq->q);
+		blk_mq_ra_stats_start(rq->q);
 		blk_stat_add(rq);
 	}
 
@@ -571,6 +720,52 @@ void blk_mq_complete_request(struct request *rq)
 }
 EXPORT_SYMBOL(blk_mq_complete_request);
 
+/**
+ * blk_mq_add_to_batch - queue a request for a batched completion
+ * @rq:		the request being processed
+ * @iob:	the batch to add @rq to
+ * @error:	the status of @rq
+ * @complete:	the function ending the requests of @iob
+ *
+ * Description:
+ *	Instead of blk_mq_complete_request(), a driver reaping several
+ *	completions at once may queue the requests on @iob and call
+ *	@complete once done, which in turn finishes with
+ *	blk_mq_end_request_batch().  Only the requests which completed
+ *	without error, with no scheduler, end_io callback or bidi partner,
+ *	are eligible, and they are ended in the context of the caller.
+ *
+ * Return: false if @rq was not added, and must be completed as usual.
+ **/
+bool blk_mq_add_to_batch(struct request *rq, struct io_comp_batch *iob,
+			 blk_status_t error,
+			 void (*complete)(struct io_comp_batch *))
+{
+	if (error || rq->internal_tag != -1 || rq->end_io ||
+	    blk_bidi_rq(rq))
+		return false;
+
+	if (!iob->complete)
+		iob->complete = complete;
+	else if (iob->complete != complete)
+		return false;
+
+	if (unlikely(blk_should_fake_timeout(rq->q)))
+		return true;
+	if (blk_mark_rq_complete(rq))
+		return true;
+
+	if (rq->rq_flags & RQF_STATS) {
+		blk_mq_poll_stats_start(rq->q);
+		blk_mq_ra_stats_start(rq->q);
+		blk_stat_add(rq);
+	}
+
+	list_add_tail(&rq->queuelist, &iob->req_list);
+	return true;
+}
+EXPORT_SYMBOL_GPL(blk_mq_add_to_batch);
+
 int blk_mq_request_started(struct request *rq)
 {
 	return test_bit(REQ_ATOM_STARTED, &rq->atomic_flags);
@@ -857,10 +1052,11 @@ static bool flush_busy_ctx(struct sbitmap *sb, unsigned int bitnr, void *data)
 	struct flush_busy_ctx_data *flush_data = data;
 	struct blk_mq_hw_ctx *hctx = flush_data->hctx;
 	struct blk_mq_ctx *ctx = hctx->ctxs[bitnr];
+	enum hctx_type type = hctx->type;
 
 	sbitmap_clear_bit(sb, bitnr);
 	spin_lock(&ctx->lock);
-	list_splice_tail_init(&ctx->rq_list, flush_data->list);
+	list_splice_tail_init(&ctx->rq_lists[type], flush_data->list);
 	spin_unlock(&ctx->lock);
 	return true;
 }
@@ -893,8 +1089,9 @@ bool blk_mq_get_driver_tag(struct request *rq, struct blk_mq_hw_ctx **hctx,
 {
 	struct blk_mq_alloc_data data = {
 		.q = rq->q,
-		.hctx = blk_mq_map_queue(rq->q, rq->mq_ctx->cpu),
+		.hctx = blk_mq_map_queue(rq->q, rq->cmd_flags, rq->mq_ctx),
 		.flags = wait ? 0 : BLK_MQ_REQ_NOWAIT,
+		.cmd_flags = rq->cmd_flags,
 	};
 
 	might_sleep_if(wait);
@@ -948,7 +1145,7 @@ static void blk_mq_put_driver_tag(struct request *rq)
 	if (rq->tag == -1 || rq->internal_tag == -1)
 		return;
 
-	hctx = blk_mq_map_queue(rq->q, rq->mq_ctx->cpu);
+	hctx = blk_mq_map_queue(rq->q, rq->cmd_flags, rq->mq_ctx);
 	__blk_mq_put_driver_tag(hctx, rq);
 }
 
@@ -1379,15 +1576,16 @@ static inline void __blk_mq_insert_req_list(struct blk_mq_hw_ctx *hctx,
 					    bool at_head)
 {
 	struct blk_mq_ctx *ctx = rq->mq_ctx;
+	enum hctx_type type = hctx->type;
 
 	lockdep_assert_held(&ctx->lock);
 
 	trace_block_rq_insert(hctx->queue, rq);
 
 	if (at_head)
-		list_add(&rq->queuelist, &ctx->rq_list);
+		list_add(&rq->queuelist, &ctx->rq_lists[type]);
 	else
-		list_add_tail(&rq->queuelist, &ctx->rq_list);
+		list_add_tail(&rq->queuelist, &ctx->rq_lists[type]);
 }
 
 void __blk_mq_insert_request(struct blk_mq_hw_ctx *hctx, struct request *rq,
@@ -1408,7 +1606,8 @@ void __blk_mq_insert_request(struct blk_mq_hw_ctx *hctx, struct request *rq,
 void blk_mq_request_bypass_insert(struct request *rq)
 {
 	struct blk_mq_ctx *ctx = rq->mq_ctx;
-	struct blk_mq_hw_ctx *hctx = blk_mq_map_queue(rq->q, ctx->cpu);
+	struct blk_mq_hw_ctx *hctx = blk_mq_map_queue(rq->q, rq->cmd_flags,
+						      ctx);
 
 	spin_lock(&hctx->lock);
 	list_add_tail(&rq->queuelist, &hctx->dispatch);
@@ -1442,14 +1641,22 @@ static int plug_ctx_cmp(void *priv, struct list_head *a, struct list_head *b)
 {
 	struct request *rqa = container_of(a, struct request, queuelist);
 	struct request *rqb = container_of(b, struct request, queuelist);
+	struct blk_mq_hw_ctx *hctxa, *hctxb;
+
+	if (rqa->mq_ctx != rqb->mq_ctx)
+		return rqa->mq_ctx > rqb->mq_ctx;
 
-	return !(rqa->mq_ctx < rqb->mq_ctx ||
-		 (rqa->mq_ctx == rqb->mq_ctx &&
-		  blk_rq_pos(rqa) < blk_rq_pos(rqb)));
+	hctxa = blk_mq_map_queue(rqa->q, rqa->cmd_flags, rqa->mq_ctx);
+	hctxb = blk_mq_map_queue(rqb->q, rqb->cmd_flags, rqb->mq_ctx);
+	if (hctxa != hctxb)
+		return hctxa > hctxb;
+
+	return blk_rq_pos(rqa) >= blk_rq_pos(rqb);
 }
 
 void blk_mq_flush_plug_list(struct blk_plug *plug, bool from_schedule)
 {
+	struct blk_mq_hw_ctx *this_hctx, *hctx;
 	struct blk_mq_ctx *this_ctx;
 	struct request_queue *this_q;
 	struct request *rq;
@@ -1462,6 +1669,7 @@ void blk_mq_flush_plug_list(struct blk_plug *plug, bool from_schedule)
 	list_sort(NULL, &list, plug_ctx_cmp);
 
 	this_q = NULL;
+	this_hctx = NULL;
 	this_ctx = NULL;
 	depth = 0;
 
@@ -1469,15 +1677,19 @@ void blk_mq_flush_plug_list(struct blk_plug *plug, bool from_schedule)
 		rq = list_entry_rq(list.next);
 		list_del_init(&rq->queuelist);
 		BUG_ON(!rq->q);
-		if (rq->mq_ctx != this_ctx) {
+		/* the requests of a ctx may go to the hctxs of several maps */
+		hctx = blk_mq_map_queue(rq->q, rq->cmd_flags, rq->mq_ctx);
+		if (rq->mq_ctx != this_ctx || hctx != this_hctx) {
 			if (this_ctx) {
 				trace_block_unplug(this_q, depth, from_schedule);
-				blk_mq_sched_insert_requests(this_q, this_ctx,
+				blk_mq_sched_insert_requests(this_hctx,
+								this_ctx,
 								&ctx_list,
 								from_schedule);
 			}
 
 			this_ctx = rq->mq_ctx;
+			this_hctx = hctx;
 			this_q = rq->q;
 			depth = 0;
 		}
@@ -1492,7 +1704,7 @@ void blk_mq_flush_plug_list(struct blk_plug *plug, bool from_schedule)
 	 */
 	if (this_ctx) {
 		trace_block_unplug(this_q, depth, from_schedule);
-		blk_mq_sched_insert_requests(this_q, this_ctx, &ctx_list,
+		blk_mq_sched_insert_requests(this_hctx, this_ctx, &ctx_list,
 						from_schedule);
 	}
 }
@@ -1595,6 +1807,38 @@ static void blk_mq_try_issue_directly(struct blk_mq_hw_ctx *hctx,
 	}
 }
 
+/*
+ * Take the next request the plug allocated in advance, if it suits @bio: same
+ * queue, same hardware queue, and still on the CPU the request was set up for.
+ */
+static struct request *blk_mq_get_cached_request(struct request_queue *q,
+		struct blk_plug *plug, struct bio *bio,
+		struct blk_mq_alloc_data *data)
+{
+	struct request *rq;
+
+	if (!plug || list_empty(&plug->cached_rq))
+		return NULL;
+	rq = list_first_entry(&plug->cached_rq, struct request, queuelist);
+	if (rq->q != q)
+		return NULL;
+
+	data->ctx = blk_mq_get_ctx(q);
+	data->hctx = blk_mq_map_queue(q, bio->bi_opf, data->ctx);
+	if (rq->mq_ctx != data->ctx ||
+	    blk_mq_map_queue(q, rq->cmd_flags, rq->mq_ctx) != data->hctx) {
+		blk_mq_put_ctx(data->ctx);
+		data->ctx = NULL;
+		data->hctx = NULL;
+		return NULL;
+	}
+
+	list_del_init(&rq->queuelist);
+	rq->cmd_flags = bio->bi_opf;
+	rq->start_time = jiffies;
+	return rq;
+}
+
 static blk_qc_t blk_mq_make_request(struct request_queue *q, struct bio *bio)
 {
 	const int is_sync = op_is_sync(bio->bi_opf);
@@ -1621,11 +1865,23 @@ static blk_qc_t blk_mq_make_request(struct request_queue *q, struct bio *bio)
 	if (blk_mq_sched_bio_merge(q, bio))
 		return BLK_QC_T_NONE;
 
+	blkcg_iolatency_throttle(q, bio, NULL);
 	wb_acct = wbt_wait(q->rq_wb, bio, NULL);
 
 	trace_block_getrq(q, bio, bio->bi_opf);
 
-	rq = blk_mq_get_request(q, bio, bio->bi_opf, &data);
+	plug = current->plug;
+	rq = NULL;
+	if (!is_flush_fua)
+		rq = blk_mq_get_cached_request(q, plug, bio, &data);
+	if (!rq) {
+		if (plug && plug->nr_ios > 1 && !is_flush_fua) {
+			data.nr_tags = plug->nr_ios;
+			plug->nr_ios = 1;
+			data.cached_rq = &plug->cached_rq;
+		}
+		rq = blk_mq_get_request(q, bio, bio->bi_opf, &data);
+	}
 	if (unlikely(!rq)) {
 		__wbt_done(q->rq_wb, wb_acct);
 		if (bio->bi_opf & REQ_NOWAIT)
@@ -1637,7 +1893,6 @@ static blk_qc_t blk_mq_make_request(struct request_queue *q, struct bio *bio)
 
 	cookie = request_to_qc_t(data.hctx, rq);
 
-	plug = current->plug;
 	if (unlikely(is_flush_fua)) {
 		blk_mq_put_ctx(data.ctx);
 		blk_mq_bio_to_request(rq, bio);
@@ -1695,7 +1950,8 @@ static blk_qc_t blk_mq_make_request(struct request_queue *q, struct bio *bio)
 
 		if (same_queue_rq) {
 			data.hctx = blk_mq_map_queue(q,
-					same_queue_rq->mq_ctx->cpu);
+					same_queue_rq->cmd_flags,
+					same_queue_rq->mq_ctx);
 			blk_mq_try_issue_directly(data.hctx, same_queue_rq,
 					&cookie);
 		}
@@ -1765,7 +2021,7 @@ struct blk_mq_tags *blk_mq_alloc_rq_map(struct blk_mq_tag_set *set,
 	struct blk_mq_tags *tags;
 	int node;
 
-	node = blk_mq_hw_queue_to_node(set->mq_map, hctx_idx);
+	node = blk_mq_hw_queue_to_node(&set->map[HCTX_TYPE_DEFAULT], hctx_idx);
 	if (node == NUMA_NO_NODE)
 		node = set->numa_node;
 
@@ -1806,7 +2062,7 @@ int blk_mq_alloc_rqs(struct blk_mq_tag_set *set, struct blk_mq_tags *tags,
 	size_t rq_size, left;
 	int node;
 
-	node = blk_mq_hw_queue_to_node(set->mq_map, hctx_idx);
+	node = blk_mq_hw_queue_to_node(&set->map[HCTX_TYPE_DEFAULT], hctx_idx);
 	if (node == NUMA_NO_NODE)
 		node = set->numa_node;
 
@@ -1889,13 +2145,15 @@ static int blk_mq_hctx_notify_dead(unsigned int cpu, struct hlist_node *node)
 	struct blk_mq_hw_ctx *hctx;
 	struct blk_mq_ctx *ctx;
 	LIST_HEAD(tmp);
+	enum hctx_type type;
 
 	hctx = hlist_entry_safe(node, struct blk_mq_hw_ctx, cpuhp_dead);
 	ctx = __blk_mq_get_ctx(hctx->queue, cpu);
+	type = hctx->type;
 
 	spin_lock(&ctx->lock);
-	if (!list_empty(&ctx->rq_list)) {
-		list_splice_init(&ctx->rq_list, &tmp);
+	if (!list_empty(&ctx->rq_lists[type])) {
+		list_splice_init(&ctx->rq_lists[type], &tmp);
 		blk_mq_hctx_clear_pending(hctx, ctx);
 	}
 	spin_unlock(&ctx->lock);
@@ -2032,7 +2290,8 @@ static int blk_mq_init_hctx(struct request_queue *q,
 static void blk_mq_init_cpu_queues(struct request_queue *q,
 				   unsigned int nr_hw_queues)
 {
-	unsigned int i;
+	struct blk_mq_tag_set *set = q->tag_set;
+	unsigned int i, j;
 
 	for_each_possible_cpu(i) {
 		struct blk_mq_ctx *__ctx = per_cpu_ptr(q->queue_ctx, i);
@@ -2040,21 +2299,27 @@ static void blk_mq_init_cpu_queues(struct request_queue *q,
 
 		__ctx->cpu = i;
 		spin_lock_init(&__ctx->lock);
-		INIT_LIST_HEAD(&__ctx->rq_list);
+		for (j = 0; j < HCTX_MAX_TYPES; j++)
+			INIT_LIST_HEAD(&__ctx->rq_lists[j]);
 		__ctx->queue = q;
 
 		/* If the cpu isn't present, the cpu is mapped to first hctx */
 		if (!cpu_present(i))
 			continue;
 
-		hctx = blk_mq_map_queue(q, i);
-
 		/*
 		 * Set local node, IFF we have more than one hw queue. If
 		 * not, we remain on the home node of the device
 		 */
-		if (nr_hw_queues > 1 && hctx->numa_node == NUMA_NO_NODE)
-			hctx->numa_node = local_memory_node(cpu_to_node(i));
+		for (j = 0; j < set->nr_maps; j++) {
+			if (!set->map[j].nr_queues)
+				continue;
+			hctx = blk_mq_map_queue_type(q, j, i);
+			if (nr_hw_queues > 1 &&
+			    hctx->numa_node == NUMA_NO_NODE)
+				hctx->numa_node =
+					local_memory_node(cpu_to_node(i));
+		}
 	}
 }
 
@@ -2089,7 +2354,7 @@ static void blk_mq_free_map_and_requests(struct blk_mq_tag_set *set,
 
 static void blk_mq_map_swqueue(struct request_queue *q)
 {
-	unsigned int i, hctx_idx;
+	unsigned int i, j, hctx_idx;
 	struct blk_mq_hw_ctx *hctx;
 	struct blk_mq_ctx *ctx;
 	struct blk_mq_tag_set *set = q->tag_set;
@@ -2109,26 +2374,60 @@ static void blk_mq_map_swqueue(struct request_queue *q)
 	 *
 	 * If the cpu isn't present, the cpu is mapped to first hctx.
 	 */
-	for_each_present_cpu(i) {
-		hctx_idx = q->mq_map[i];
-		/* unmapped hw queue can be remapped after CPU topo changed */
-		if (!set->tags[hctx_idx] &&
-		    !__blk_mq_alloc_rq_map(set, hctx_idx)) {
+	for_each_possible_cpu(i) {
+		ctx = per_cpu_ptr(q->queue_ctx, i);
+
+		if (!cpu_present(i)) {
+			for (j = 0; j < HCTX_MAX_TYPES; j++)
+				ctx->hctxs[j] = blk_mq_map_queue_type(q,
+						HCTX_TYPE_DEFAULT, i);
+			continue;
+		}
+
+		for (j = 0; j < set->nr_maps; j++) {
+			if (!set->map[j].nr_queues) {
+				ctx->hctxs[j] = blk_mq_map_queue_type(q,
+						HCTX_TYPE_DEFAULT, i);
+				continue;
+			}
+
+			hctx_idx = set->map[j].mq_map[i];
 			/*
-			 * If tags initialization fail for some hctx,
-			 * that hctx won't be brought online.  In this
-			 * case, remap the current ctx to hctx[0] which
-			 * is guaranteed to always have tags allocated
+			 * unmapped hw queue can be remapped after CPU topo
+			 * changed
 			 */
-			q->mq_map[i] = 0;
-		}
+			if (!set->tags[hctx_idx] &&
+			    !__blk_mq_alloc_rq_map(set, hctx_idx)) {
+				/*
+				 * If tags initialization fail for some hctx,
+				 * that hctx won't be brought online.  In this
+				 * case, remap the current ctx to hctx[0] which
+				 * is guaranteed to always have tags allocated
+				 */
+				set->map[j].mq_map[i] = 0;
+			}
 
-		ctx = per_cpu_ptr(q->queue_ctx, i);
-		hctx = blk_mq_map_queue(q, i);
+			hctx = blk_mq_map_queue_type(q, j, i);
+			ctx->hctxs[j] = hctx;
+
+			/*
+			 * If the CPU is already set in the mask, then we've
+			 * mapped this one already. This can happen if
+			 * devices share queues across queue maps.
+			 */
+			if (cpumask_test_cpu(i, hctx->cpumask))
+				continue;
 
-		cpumask_set_cpu(i, hctx->cpumask);
-		ctx->index_hw = hctx->nr_ctx;
-		hctx->ctxs[hctx->nr_ctx++] = ctx;
+			cpumask_set_cpu(i, hctx->cpumask);
+			hctx->type = j;
+			ctx->index_hw[hctx->type] = hctx->nr_ctx;
+			hctx->ctxs[hctx->nr_ctx++] = ctx;
+		}
+
+		/* Types without a map of their own use the default one */
+		for (; j < HCTX_MAX_TYPES; j++)
+			ctx->hctxs[j] = blk_mq_map_queue_type(q,
+					HCTX_TYPE_DEFAULT, i);
 	}
 
 	mutex_unlock(&q->sysfs_lock);
@@ -2260,7 +2559,6 @@ void blk_mq_release(struct request_queue *q)
 		kobject_put(&hctx->kobj);
 	}
 
-	q->mq_map = NULL;
 
 	kfree(q->queue_hw_ctx);
 
@@ -2316,7 +2614,7 @@ static void blk_mq_realloc_hw_ctxs(struct blk_mq_tag_set *set,
 		if (hctxs[i])
 			continue;
 
-		node = blk_mq_hw_queue_to_node(q->mq_map, i);
+		node = blk_mq_hw_queue_to_node(&set->map[HCTX_TYPE_DEFAULT], i);
 		hctxs[i] = kzalloc_node(blk_mq_hw_ctx_size(set),
 					GFP_KERNEL, node);
 		if (!hctxs[i])
@@ -2369,6 +2667,12 @@ struct request_queue *blk_mq_init_allocated_queue(struct blk_mq_tag_set *set,
 	if (!q->poll_cb)
 		goto err_exit;
 
+	q->ra_cb = blk_stat_alloc_callback(blk_mq_ra_stats_fn,
+					   blk_mq_ra_stats_bkt,
+					   BLK_MQ_RA_STATS_BKTS, q);
+	if (!q->ra_cb)
+		goto err_exit;
+
 	q->queue_ctx = alloc_percpu(struct blk_mq_ctx);
 	if (!q->queue_ctx)
 		goto err_exit;
@@ -2381,8 +2685,6 @@ struct request_queue *blk_mq_init_allocated_queue(struct blk_mq_tag_set *set,
 	if (!q->queue_hw_ctx)
 		goto err_percpu;
 
-	q->mq_map = set->mq_map;
-
 	blk_mq_realloc_hw_ctxs(set, q);
 	if (!q->nr_hw_queues)
 		goto err_hctxs;
@@ -2524,10 +2826,11 @@ static int blk_mq_alloc_rq_maps(struct blk_mq_tag_set *set)
 
 static int blk_mq_update_queue_map(struct blk_mq_tag_set *set)
 {
-	if (set->ops->map_queues)
+	if (set->ops->map_queues && !is_kdump_kernel())
 		return set->ops->map_queues(set);
-	else
-		return blk_mq_map_queues(set);
+
+	BUG_ON(set->nr_maps > 1);
+	return blk_mq_map_queues(&set->map[HCTX_TYPE_DEFAULT]);
 }
 
 /*
@@ -2538,7 +2841,7 @@ static int blk_mq_update_queue_map(struct blk_mq_tag_set *set)
  */
 int blk_mq_alloc_tag_set(struct blk_mq_tag_set *set)
 {
-	int ret;
+	int i, ret;
 
 	BUILD_BUG_ON(BLK_MQ_MAX_DEPTH > 1 << BLK_MQ_UNIQUE_TAG_BITS);
 
@@ -2552,6 +2855,11 @@ int blk_mq_alloc_tag_set(struct blk_mq_tag_set *set)
 	if (!set->ops->queue_rq)
 		return -EINVAL;
 
+	if (!set->nr_maps)
+		set->nr_maps = 1;
+	else if (set->nr_maps > HCTX_MAX_TYPES)
+		return -EINVAL;
+
 	if (set->queue_depth > BLK_MQ_MAX_DEPTH) {
 		pr_info("blk-mq: reduced tag depth to %u\n",
 			BLK_MQ_MAX_DEPTH);
@@ -2565,6 +2873,7 @@ int blk_mq_alloc_tag_set(struct blk_mq_tag_set *set)
 	 */
 	if (is_kdump_kernel()) {
 		set->nr_hw_queues = 1;
+		set->nr_maps = 1;
 		set->queue_depth = min(64U, set->queue_depth);
 	}
 	/*
@@ -2579,10 +2888,14 @@ int blk_mq_alloc_tag_set(struct blk_mq_tag_set *set)
 		return -ENOMEM;
 
 	ret = -ENOMEM;
-	set->mq_map = kzalloc_node(sizeof(*set->mq_map) * nr_cpu_ids,
-			GFP_KERNEL, set->numa_node);
-	if (!set->mq_map)
-		goto out_free_tags;
+	for (i = 0; i < set->nr_maps; i++) {
+		set->map[i].mq_map = kzalloc_node(sizeof(unsigned int) *
+						  nr_cpu_ids, GFP_KERNEL,
+						  set->numa_node);
+		if (!set->map[i].mq_map)
+			goto out_free_mq_map;
+		set->map[i].nr_queues = set->nr_hw_queues;
+	}
 
 	ret = blk_mq_update_queue_map(set);
 	if (ret)
@@ -2598,9 +2911,10 @@ int blk_mq_alloc_tag_set(struct blk_mq_tag_set *set)
 	return 0;
 
 out_free_mq_map:
-	kfree(set->mq_map);
-	set->mq_map = NULL;
-out_free_tags:
+	for (i = 0; i < set->nr_maps; i++) {
+		kfree(set->map[i].mq_map);
+		set->map[i].mq_map = NULL;
+	}
 	kfree(set->tags);
 	set->tags = NULL;
 	return ret;
@@ -2609,13 +2923,15 @@ EXPORT_SYMBOL(blk_mq_alloc_tag_set);
 
 void blk_mq_free_tag_set(struct blk_mq_tag_set *set)
 {
-	int i;
+	int i, j;
 
 	for (i = 0; i < nr_cpu_ids; i++)
 		blk_mq_free_map_and_requests(set, i);
 
-	kfree(set->mq_map);
-	set->mq_map = NULL;
+	for (j = 0; j < set->nr_maps; j++) {
+		kfree(set->map[j].mq_map);
+		set->map[j].mq_map = NULL;
+	}
 
 	kfree(set->tags);
 	set->tags = NULL;
@@ -2677,6 +2993,8 @@ static void __blk_mq_update_nr_hw_queues(struct blk_mq_tag_set *set,
 		blk_mq_freeze_queue(q);
 
 	set->nr_hw_queues = nr_hw_queues;
+	if (set->nr_maps == 1)
+		set->map[HCTX_TYPE_DEFAULT].nr_queues = nr_hw_queues;
 	blk_mq_update_queue_map(set);
 	list_for_each_entry(q, &set->tag_list, tag_set_list) {
 		blk_mq_realloc_hw_ctxs(set, q);
@@ -2729,6 +3047,58 @@ static void blk_mq_poll_stats_fn(struct blk_stat_callback *cb)
 	}
 }
 
+/*
+ * The readahead window of the queue's bdi may grow past its ra_pages to what
+ * the device reads in BLK_MQ_RA_WINDOW_MSECS, estimated from the latency of
+ * the largest reads, so that fast devices do not lose their bandwidth to a
+ * window sized for disks.
+ */
+#define BLK_MQ_RA_WINDOW_MSECS	4
+#define BLK_MQ_RA_MIN_SAMPLES	8
+#define BLK_MQ_RA_MAX_PAGES	(16UL << (20 - PAGE_SHIFT))
+
+/* Only non-rotational devices are worth the cost of the statistics. */
+void blk_mq_ra_stats_enable(struct request_queue *q)
+{
+	if (!blk_queue_nonrot(q) ||
+	    test_and_set_bit(QUEUE_FLAG_RA_STATS, &q->queue_flags))
+		return;
+	blk_stat_add_callback(q, q->ra_cb);
+}
+
+static void blk_mq_ra_stats_start(struct request_queue *q)
+{
+	if (!test_bit(QUEUE_FLAG_RA_STATS, &q->queue_flags) ||
+	    blk_stat_is_active(q->ra_cb))
+		return;
+
+	blk_stat_activate_msecs(q->ra_cb, 100);
+}
+
+static void blk_mq_ra_stats_fn(struct blk_stat_callback *cb)
+{
+	struct request_queue *q = cb->data;
+	struct backing_dev_info *bdi = q->backing_dev_info;
+	unsigned long old = READ_ONCE(bdi->ra_bw_pages);
+	u64 bw, pages;
+	int bucket;
+
+	for (bucket = BLK_MQ_RA_STATS_BKTS - 1; bucket >= 0; bucket--) {
+		if (cb->stat[bucket].nr_samples >= BLK_MQ_RA_MIN_SAMPLES)
+			break;
+	}
+	if (bucket < 0 || !cb->stat[bucket].mean)
+		return;
+
+	/* bytes per second, from the smallest size of the bucket */
+	bw = div64_u64((4096ULL << bucket) * NSEC_PER_SEC,
+		       cb->stat[bucket].mean);
+	pages = (bw * BLK_MQ_RA_WINDOW_MSECS / MSEC_PER_SEC) >> PAGE_SHIFT;
+	pages = min_t(u64, pages, BLK_MQ_RA_MAX_PAGES);
+
+	WRITE_ONCE(bdi->ra_bw_pages, old ? (3 * old + pages) / 4 : pages);
+}
+
 static unsigned long blk_mq_poll_nsecs(struct request_queue *q,
 				       struct blk_mq_hw_ctx *hctx,
 				       struct request *rq)
@@ -100,6 +100,22 @@ enum tg_state_flags {
 
 #define rb_entry_tg(node)	rb_entry((node), struct throtl_grp, rb_node)
 
+/* Max bios dispatched from the tokens of a CPU before taking the lock */
+#define THROTL_TOKEN_BATCH	8
+
+/*
+ * Budget already charged to a group and its ancestors, which the bios
+ * issued on a CPU consume without taking the queue_lock.  The tokens are
+ * only valid during the slice they were charged in, and as long as the
+ * token_gen of the group is unchanged.
+ */
+struct throtl_tokens {
+	uint64_t bytes[2];
+	unsigned int ios[2];
+	unsigned int gen[2];
+	unsigned long expires[2];
+};
+
 enum {
 	LIMIT_LOW,
 	LIMIT_MAX,
@@ -179,6 +195,10 @@ struct throtl_grp {
 	unsigned int bio_cnt; /* total bios */
 	unsigned int bad_bio_cnt; /* bios exceeding latency threshold */
 	unsigned long bio_cnt_reset_time;
+
+	/* per-cpu fast path budget, invalidated by bumping token_gen */
+	struct throtl_tokens __percpu *tokens;
+	unsigned int token_gen;
 };
 
 /* We measure latency for request size from <= 4k to >= 1M */
@@ -491,6 +511,12 @@ static struct blkg_policy_data *throtl_pd_alloc(gfp_t gfp, int node)
 	if (!tg)
 		return NULL;
 
+	tg->tokens = alloc_percpu_gfp(struct throtl_tokens, gfp);
+	if (!tg->tokens) {
+		kfree(tg);
+		return NULL;
+	}
+
 	throtl_service_queue_init(&tg->service_queue);
 
 	for (rw = READ; rw <= WRITE; rw++) {
@@ -611,6 +637,7 @@ static void throtl_pd_free(struct blkg_policy_data *pd)
 	struct throtl_grp *tg = pd_to_tg(pd);
 
 	del_timer_sync(&tg->service_queue.pending_timer);
+	free_percpu(tg->tokens);
 	kfree(tg);
 }
 
@@ -1060,6 +1087,124 @@ static void throtl_charge_bio(struct throtl_grp *tg, struct bio *bio)
 		bio_set_flag(bio, BIO_THROTTLED);
 }
 
+/*
+ * The tokens skip the per-bio bookkeeping of the .low limit (upgrade and
+ * downgrade checks, idle time and latency tracking): only use them while
+ * the .max limits alone are in force.
+ */
+static bool throtl_tokens_allowed(struct throtl_data *td)
+{
+	if (READ_ONCE(td->limit_index) != LIMIT_MAX ||
+	    READ_ONCE(td->limit_valid[LIMIT_LOW]))
+		return false;
+#ifdef CONFIG_BLK_DEV_THROTTLING_LOW
+	if (READ_ONCE(td->track_bio_latency))
+		return false;
+#endif
+	return true;
+}
+
+/* Clamp @bytes and @ios to what @tg may still dispatch in its slice */
+static void tg_clamp_tokens(struct throtl_grp *tg, bool rw, uint64_t *bytes,
+			    unsigned int *ios)
+{
+	unsigned long jiffy_elapsed_rnd = jiffies - tg->slice_start[rw];
+	uint64_t tmp;
+
+	if (!jiffy_elapsed_rnd)
+		jiffy_elapsed_rnd = tg->td->throtl_slice;
+	jiffy_elapsed_rnd = roundup(jiffy_elapsed_rnd, tg->td->throtl_slice);
+
+	if (tg_bps_limit(tg, rw) != U64_MAX) {
+		tmp = tg_bps_limit(tg, rw) * jiffy_elapsed_rnd;
+		do_div(tmp, HZ);
+		tmp = tmp > tg->bytes_disp[rw] ? tmp - tg->bytes_disp[rw] : 0;
+		*bytes = min(*bytes, tmp);
+	}
+
+	if (tg_iops_limit(tg, rw) != UINT_MAX) {
+		tmp = (u64)tg_iops_limit(tg, rw) * jiffy_elapsed_rnd;
+		do_div(tmp, HZ);
+		tmp = tmp > tg->io_disp[rw] ? tmp - tg->io_disp[rw] : 0;
+		*ios = min_t(uint64_t, *ios, tmp);
+	}
+}
+
+/*
+ * @bio was dispatched directly by @tg and all its ancestors: charge a batch
+ * of bios like it in advance, for the next bios issued on this cpu to pass
+ * without the queue_lock.  Called with the queue_lock held.
+ */
+static void throtl_refill_tokens(struct throtl_grp *tg, struct bio *bio)
+{
+	bool rw = bio_data_dir(bio);
+	unsigned int bio_size = throtl_bio_data_size(bio);
+	uint64_t bytes = (uint64_t)bio_size * THROTL_TOKEN_BATCH;
+	unsigned int ios = THROTL_TOKEN_BATCH;
+	unsigned long expires = jiffies + tg->td->throtl_slice;
+	struct throtl_tokens *tokens;
+	struct throtl_grp *this_tg;
+
+	if (!bio_size || !throtl_tokens_allowed(tg->td))
+		return;
+
+	for (this_tg = tg; this_tg;
+	     this_tg = sq_to_tg(this_tg->service_queue.parent_sq)) {
+		if (tg_bps_limit(this_tg, rw) == U64_MAX &&
+		    tg_iops_limit(this_tg, rw) == UINT_MAX)
+			continue;
+		tg_clamp_tokens(this_tg, rw, &bytes, &ios);
+		if (time_before(this_tg->slice_end[rw], expires))
+			expires = this_tg->slice_end[rw];
+	}
+	if (bytes < bio_size || !ios || !time_before(jiffies, expires))
+		return;
+
+	for (this_tg = tg; this_tg;
+	     this_tg = sq_to_tg(this_tg->service_queue.parent_sq)) {
+		this_tg->bytes_disp[rw] += bytes;
+		this_tg->io_disp[rw] += ios;
+		this_tg->last_bytes_disp[rw] += bytes;
+		this_tg->last_io_disp[rw] += ios;
+	}
+
+	/* irqs are disabled by the queue_lock */
+	tokens = this_cpu_ptr(tg->tokens);
+	tokens->bytes[rw] = bytes;
+	tokens->ios[rw] = ios;
+	tokens->gen[rw] = tg->token_gen;
+	tokens->expires[rw] = expires;
+}
+
+/*
+ * Fast path of blk_throtl_bio(): dispatch @bio from the tokens of this cpu.
+ * No other per-bio state needs updating, the tokens were charged already.
+ */
+static bool throtl_consume_tokens(struct throtl_grp *tg, struct bio *bio)
+{
+	bool rw = bio_data_dir(bio);
+	unsigned int bio_size = throtl_bio_data_size(bio);
+	struct throtl_tokens *tokens;
+	unsigned long flags;
+	bool ret = false;
+
+	if (!throtl_tokens_allowed(tg->td))
+		return false;
+
+	local_irq_save(flags);
+	tokens = this_cpu_ptr(tg->tokens);
+	if (tokens->ios[rw] && tokens->bytes[rw] >= bio_size &&
+	    tokens->gen[rw] == READ_ONCE(tg->token_gen) &&
+	    time_before(jiffies, tokens->expires[rw])) {
+		tokens->ios[rw]--;
+		tokens->bytes[rw] -= bio_size;
+		ret = true;
+	}
+	local_irq_restore(flags);
+
+	return ret;
+}
+
 /**
  * throtl_add_bio_tg - add a bio to the specified throtl_grp
  * @bio: bio to add
@@ -1404,6 +1549,8 @@ static void tg_conf_updated(struct throtl_grp *tg, bool global)
 		struct throtl_grp *parent_tg;
 
 		tg_update_has_rules(this_tg);
+		/* the budget cached per cpu was charged with the old limits */
+		WRITE_ONCE(this_tg->token_gen, this_tg->token_gen + 1);
 		/* ignore root/second level */
 		if (!cgroup_subsys_on_dfl(io_cgrp_subsys) || !blkg->parent ||
 		    !blkg->parent->parent)
@@ -2124,6 +2271,7 @@ bool blk_throtl_bio(struct request_queue *q, struct blkcg_gq *blkg,
 {
 	struct throtl_qnode *qn = NULL;
 	struct throtl_grp *tg = blkg_to_tg(blkg ?: q->root_blkg);
+	struct throtl_grp *bio_tg = tg;
 	struct throtl_service_queue *sq;
 	bool rw = bio_data_dir(bio);
 	bool throttled = false;
@@ -2135,6 +2283,9 @@ bool blk_throtl_bio(struct request_queue *q, struct blkcg_gq *blkg,
 	if (bio_flagged(bio, BIO_THROTTLED) || !tg->has_rules[rw])
 		goto out;
 
+	if (throtl_consume_tokens(tg, bio))
+		goto out;
+
 	spin_lock_irq(q->queue_lock);
 
 	throtl_update_latency_buckets(td);
@@ -2191,8 +2342,10 @@ bool blk_throtl_bio(struct request_queue *q, struct blkcg_gq *blkg,
 		qn = &tg->qnode_on_parent[rw];
 		sq = sq->parent_sq;
 		tg = sq_to_tg(sq);
-		if (!tg)
+		if (!tg) {
+			throtl_refill_tokens(bio_tg, bio);
 			goto out_unlock;
+		}
 	}
 
 	/* out-of-limit, queue to @tg */
@@ -2209,6 +2362,9 @@ bool blk_throtl_bio(struct request_queue *q, struct blkcg_gq *blkg,
 	throtl_add_bio_tg(bio, qn, tg);
 	throttled = true;
 
+	/* the bios behind this one can't bypass it through the tokens */
+	WRITE_ONCE(bio_tg->token_gen, bio_tg->token_gen + 1);
+
 	/*
 	 * Update @tg's dispatch time and force schedule dispatch if @tg
 	 * was empty before @bio.  The forced scheduling isn't likely to
@@ -61,6 +61,29 @@ struct rq_wait {
 	atomic_t inflight;
 };
 
+/*
+ * Increment the inflight count of 'rq_wait', if it is below 'limit'. Returns
+ * true if we succeeded, false if it would go over 'limit'.
+ */
+static inline bool rq_wait_inc_below(struct rq_wait *rq_wait, int limit)
+{
+	atomic_t *v = &rq_wait->inflight;
+	int cur = atomic_read(v);
+
+	for (;;) {
+		int old;
+
+		if (cur >= limit)
+			return false;
+		old = atomic_cmpxchg(v, cur, cur + 1);
+		if (old == cur)
+			break;
+		cur = old;
+	}
+
+	return true;
+}
+
 struct rq_wb {
 	/*
 	 * Settings that govern how we throttle
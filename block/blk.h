@@ -45,7 +45,7 @@ static inline struct blk_flush_queue *blk_get_flush_queue(
 		struct request_queue *q, struct blk_mq_ctx *ctx)
 {
 	if (q->mq_ops)
-		return blk_mq_map_queue(q, ctx->cpu)->fq;
+		return blk_mq_map_queue(q, REQ_OP_FLUSH, ctx)->fq;
 	return q->fq;
 }
 
@@ -349,6 +349,32 @@ static inline void blk_throtl_bio_endio(struct bio *bio) { }
 static inline void blk_throtl_stat_add(struct request *rq, u64 time) { }
 #endif
 
+#ifdef CONFIG_BLK_CGROUP_IOLATENCY
+extern int blk_iolatency_init(struct request_queue *q);
+extern void blk_iolatency_exit(struct request_queue *q);
+extern void blkcg_iolatency_throttle(struct request_queue *q, struct bio *bio,
+				     spinlock_t *lock);
+extern void blkcg_iolatency_done_bio(struct bio *bio);
+#else
+static inline int blk_iolatency_init(struct request_queue *q) { return 0; }
+static inline void blk_iolatency_exit(struct request_queue *q) { }
+static inline void blkcg_iolatency_throttle(struct request_queue *q,
+					    struct bio *bio,
+					    spinlock_t *lock) { }
+static inline void blkcg_iolatency_done_bio(struct bio *bio) { }
+#endif
+
+#ifdef CONFIG_BLK_CGROUP_LAT_HIST
+extern int blk_lat_hist_init(struct request_queue *q);
+extern void blk_lat_hist_exit(struct request_queue *q);
+extern void blk_lat_hist_bio_done(struct request *rq, struct bio *bio);
+#else
+static inline int blk_lat_hist_init(struct request_queue *q) { return 0; }
+static inline void blk_lat_hist_exit(struct request_queue *q) { }
+static inline void blk_lat_hist_bio_done(struct request *rq,
+					 struct bio *bio) { }
+#endif
+
 #ifdef CONFIG_BOUNCE
 extern int init_emergency_isa_pool(void);
 extern void blk_queue_bounce(struct request_queue *q, struct bio **bio);
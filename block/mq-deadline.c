@@ -32,10 +32,14 @@ static const int writes_starved = 2;    /* max times reads can starve a write */
 static const int fifo_batch = 16;       /* # of sequential requests treated as one
 				     by the above parameters. For throughput. */
 
-struct deadline_data {
-	/*
-	 * run time data
-	 */
+/*
+ * With several hardware queues, each of them schedules its requests in a
+ * shard of its own, with its own lock.  A single shard is used otherwise,
+ * and for zoned block devices: the writes to a zone must reach the device in
+ * order, whatever CPU they were issued from.
+ */
+struct dd_shard {
+	spinlock_t lock;
 
 	/*
 	 * requests (deadline_rq s) are present on both sort_list and fifo_list
@@ -50,6 +54,13 @@ struct deadline_data {
 	unsigned int batching;		/* number of sequential requests made */
 	unsigned int starved;		/* times reads have starved writes */
 
+	unsigned int dispatched;	/* since the last cross-shard check */
+	unsigned int check_next;	/* next shard to check for expiry */
+
+	struct list_head dispatch;
+} ____cacheline_aligned_in_smp;
+
+struct deadline_data {
 	/*
 	 * settings that change how the i/o scheduler behaves
 	 */
@@ -58,14 +69,19 @@ struct deadline_data {
 	int writes_starved;
 	int front_merges;
 
-	spinlock_t lock;
-	struct list_head dispatch;
+	unsigned int nr_shards;
+	struct dd_shard shards[];
 };
 
+static inline struct dd_shard *dd_rq_shard(struct request *rq)
+{
+	return rq->elv.priv[0];
+}
+
 static inline struct rb_root *
-deadline_rb_root(struct deadline_data *dd, struct request *rq)
+deadline_rb_root(struct dd_shard *ds, struct request *rq)
 {
-	return &dd->sort_list[rq_data_dir(rq)];
+	return &ds->sort_list[rq_data_dir(rq)];
 }
 
 /*
@@ -83,22 +99,22 @@ deadline_latter_request(struct request *rq)
 }
 
 static void
-deadline_add_rq_rb(struct deadline_data *dd, struct request *rq)
+deadline_add_rq_rb(struct dd_shard *ds, struct request *rq)
 {
-	struct rb_root *root = deadline_rb_root(dd, rq);
+	struct rb_root *root = deadline_rb_root(ds, rq);
 
 	elv_rb_add(root, rq);
 }
 
 static inline void
-deadline_del_rq_rb(struct deadline_data *dd, struct request *rq)
+deadline_del_rq_rb(struct dd_shard *ds, struct request *rq)
 {
 	const int data_dir = rq_data_dir(rq);
 
-	if (dd->next_rq[data_dir] == rq)
-		dd->next_rq[data_dir] = deadline_latter_request(rq);
+	if (ds->next_rq[data_dir] == rq)
+		ds->next_rq[data_dir] = deadline_latter_request(rq);
 
-	elv_rb_del(deadline_rb_root(dd, rq), rq);
+	elv_rb_del(deadline_rb_root(ds, rq), rq);
 }
 
 /*
@@ -106,15 +122,13 @@ deadline_del_rq_rb(struct deadline_data *dd, struct request *rq)
  */
 static void deadline_remove_request(struct request_queue *q, struct request *rq)
 {
-	struct deadline_data *dd = q->elevator->elevator_data;
-
 	list_del_init(&rq->queuelist);
 
 	/*
 	 * We might not be on the rbtree, if we are doing an insert merge
 	 */
 	if (!RB_EMPTY_NODE(&rq->rb_node))
-		deadline_del_rq_rb(dd, rq);
+		deadline_del_rq_rb(dd_rq_shard(rq), rq);
 
 	elv_rqhash_del(q, rq);
 	if (q->last_merge == rq)
@@ -124,14 +138,14 @@ static void deadline_remove_request(struct request_queue *q, struct request *rq)
 static void dd_request_merged(struct request_queue *q, struct request *req,
 			      enum elv_merge type)
 {
-	struct deadline_data *dd = q->elevator->elevator_data;
+	struct dd_shard *ds = dd_rq_shard(req);
 
 	/*
 	 * if the merge was a front merge, we need to reposition request
 	 */
 	if (type == ELEVATOR_FRONT_MERGE) {
-		elv_rb_del(deadline_rb_root(dd, req), req);
-		deadline_add_rq_rb(dd, req);
+		elv_rb_del(deadline_rb_root(ds, req), req);
+		deadline_add_rq_rb(ds, req);
 	}
 }
 
@@ -160,13 +174,13 @@ static void dd_merged_requests(struct request_queue *q, struct request *req,
  * move an entry to dispatch queue
  */
 static void
-deadline_move_request(struct deadline_data *dd, struct request *rq)
+deadline_move_request(struct dd_shard *ds, struct request *rq)
 {
 	const int data_dir = rq_data_dir(rq);
 
-	dd->next_rq[READ] = NULL;
-	dd->next_rq[WRITE] = NULL;
-	dd->next_rq[data_dir] = deadline_latter_request(rq);
+	ds->next_rq[READ] = NULL;
+	ds->next_rq[WRITE] = NULL;
+	ds->next_rq[data_dir] = deadline_latter_request(rq);
 
 	/*
 	 * take it off the sort and fifo list
@@ -176,11 +190,11 @@ deadline_move_request(struct deadline_data *dd, struct request *rq)
 
 /*
  * deadline_check_fifo returns 0 if there are no expired requests on the fifo,
- * 1 otherwise. Requires !list_empty(&dd->fifo_list[data_dir])
+ * 1 otherwise. Requires !list_empty(&ds->fifo_list[data_dir])
  */
-static inline int deadline_check_fifo(struct deadline_data *dd, int ddir)
+static inline int deadline_check_fifo(struct dd_shard *ds, int ddir)
 {
-	struct request *rq = rq_entry_fifo(dd->fifo_list[ddir].next);
+	struct request *rq = rq_entry_fifo(ds->fifo_list[ddir].next);
 
 	/*
 	 * rq is expired!
@@ -195,31 +209,31 @@ static inline int deadline_check_fifo(struct deadline_data *dd, int ddir)
  * deadline_dispatch_requests selects the best request according to
  * read/write expire, fifo_batch, etc
  */
-static struct request *__dd_dispatch_request(struct blk_mq_hw_ctx *hctx)
+static struct request *__dd_dispatch_request(struct deadline_data *dd,
+					      struct dd_shard *ds)
 {
-	struct deadline_data *dd = hctx->queue->elevator->elevator_data;
 	struct request *rq;
 	bool reads, writes;
 	int data_dir;
 
-	if (!list_empty(&dd->dispatch)) {
-		rq = list_first_entry(&dd->dispatch, struct request, queuelist);
+	if (!list_empty(&ds->dispatch)) {
+		rq = list_first_entry(&ds->dispatch, struct request, queuelist);
 		list_del_init(&rq->queuelist);
 		goto done;
 	}
 
-	reads = !list_empty(&dd->fifo_list[READ]);
-	writes = !list_empty(&dd->fifo_list[WRITE]);
+	reads = !list_empty(&ds->fifo_list[READ]);
+	writes = !list_empty(&ds->fifo_list[WRITE]);
 
 	/*
 	 * batches are currently reads XOR writes
 	 */
-	if (dd->next_rq[WRITE])
-		rq = dd->next_rq[WRITE];
+	if (ds->next_rq[WRITE])
+		rq = ds->next_rq[WRITE];
 	else
-		rq = dd->next_rq[READ];
+		rq = ds->next_rq[READ];
 
-	if (rq && dd->batching < dd->fifo_batch)
+	if (rq && ds->batching < dd->fifo_batch)
 		/* we have a next request are still entitled to batch */
 		goto dispatch_request;
 
@@ -229,9 +243,9 @@ static struct request *__dd_dispatch_request(struct blk_mq_hw_ctx *hctx)
 	 */
 
 	if (reads) {
-		BUG_ON(RB_EMPTY_ROOT(&dd->sort_list[READ]));
+		BUG_ON(RB_EMPTY_ROOT(&ds->sort_list[READ]));
 
-		if (writes && (dd->starved++ >= dd->writes_starved))
+		if (writes && (ds->starved++ >= dd->writes_starved))
 			goto dispatch_writes;
 
 		data_dir = READ;
@@ -245,9 +259,9 @@ static struct request *__dd_dispatch_request(struct blk_mq_hw_ctx *hctx)
 
 	if (writes) {
 dispatch_writes:
-		BUG_ON(RB_EMPTY_ROOT(&dd->sort_list[WRITE]));
+		BUG_ON(RB_EMPTY_ROOT(&ds->sort_list[WRITE]));
 
-		dd->starved = 0;
+		ds->starved = 0;
 
 		data_dir = WRITE;
 
@@ -260,42 +274,82 @@ static struct request *__dd_dispatch_request(struct blk_mq_hw_ctx *hctx)
 	/*
 	 * we are not running a batch, find best request for selected data_dir
 	 */
-	if (deadline_check_fifo(dd, data_dir) || !dd->next_rq[data_dir]) {
+	if (deadline_check_fifo(ds, data_dir) || !ds->next_rq[data_dir]) {
 		/*
 		 * A deadline has expired, the last request was in the other
 		 * direction, or we have run out of higher-sectored requests.
 		 * Start again from the request with the earliest expiry time.
 		 */
-		rq = rq_entry_fifo(dd->fifo_list[data_dir].next);
+		rq = rq_entry_fifo(ds->fifo_list[data_dir].next);
 	} else {
 		/*
 		 * The last req was the same dir and we have a next request in
 		 * sort order. No expired requests so continue on from here.
 		 */
-		rq = dd->next_rq[data_dir];
+		rq = ds->next_rq[data_dir];
 	}
 
-	dd->batching = 0;
+	ds->batching = 0;
 
 dispatch_request:
 	/*
 	 * rq is the selected appropriate request.
 	 */
-	dd->batching++;
-	deadline_move_request(dd, rq);
+	ds->batching++;
+	deadline_move_request(ds, rq);
 done:
 	rq->rq_flags |= RQF_STARTED;
 	return rq;
 }
 
+/*
+ * The shards only look at their own requests.  Every fifo_batch dispatches,
+ * a shard peeks at the oldest request of another one, in turn, and kicks the
+ * hardware queue of that shard if its deadline has passed.  This bounds how
+ * long an expired request waits for a hardware queue that is not run.
+ */
+static void dd_check_other_shard(struct request_queue *q,
+				 struct deadline_data *dd, struct dd_shard *ds)
+{
+	struct dd_shard *other;
+	unsigned int i;
+	bool expired = false;
+	int data_dir;
+
+	if (++ds->dispatched < max(dd->fifo_batch, 1))
+		return;
+	ds->dispatched = 0;
+
+	i = ds->check_next;
+	if (++ds->check_next >= dd->nr_shards)
+		ds->check_next = 0;
+	other = &dd->shards[i];
+	if (other == ds || !spin_trylock(&other->lock))
+		return;
+	for (data_dir = READ; data_dir <= WRITE; data_dir++) {
+		if (!list_empty(&other->fifo_list[data_dir]) &&
+		    deadline_check_fifo(other, data_dir))
+			expired = true;
+	}
+	spin_unlock(&other->lock);
+
+	if (expired && i < q->nr_hw_queues)
+		blk_mq_run_hw_queue(q->queue_hw_ctx[i], true);
+}
+
 static struct request *dd_dispatch_request(struct blk_mq_hw_ctx *hctx)
 {
-	struct deadline_data *dd = hctx->queue->elevator->elevator_data;
+	struct request_queue *q = hctx->queue;
+	struct deadline_data *dd = q->elevator->elevator_data;
+	struct dd_shard *ds = hctx->sched_data;
 	struct request *rq;
 
-	spin_lock(&dd->lock);
-	rq = __dd_dispatch_request(hctx);
-	spin_unlock(&dd->lock);
+	spin_lock(&ds->lock);
+	rq = __dd_dispatch_request(dd, ds);
+	spin_unlock(&ds->lock);
+
+	if (rq && dd->nr_shards > 1)
+		dd_check_other_shard(q, dd, ds);
 
 	return rq;
 }
@@ -303,13 +357,26 @@ static struct request *dd_dispatch_request(struct blk_mq_hw_ctx *hctx)
 static void dd_exit_queue(struct elevator_queue *e)
 {
 	struct deadline_data *dd = e->elevator_data;
+	unsigned int i;
 
-	BUG_ON(!list_empty(&dd->fifo_list[READ]));
-	BUG_ON(!list_empty(&dd->fifo_list[WRITE]));
+	for (i = 0; i < dd->nr_shards; i++) {
+		BUG_ON(!list_empty(&dd->shards[i].fifo_list[READ]));
+		BUG_ON(!list_empty(&dd->shards[i].fifo_list[WRITE]));
+	}
 
 	kfree(dd);
 }
 
+static void dd_init_shard(struct dd_shard *ds)
+{
+	spin_lock_init(&ds->lock);
+	INIT_LIST_HEAD(&ds->fifo_list[READ]);
+	INIT_LIST_HEAD(&ds->fifo_list[WRITE]);
+	ds->sort_list[READ] = RB_ROOT;
+	ds->sort_list[WRITE] = RB_ROOT;
+	INIT_LIST_HEAD(&ds->dispatch);
+}
+
 /*
  * initialize elevator private data (deadline_data).
  */
@@ -317,34 +384,46 @@ static int dd_init_queue(struct request_queue *q, struct elevator_type *e)
 {
 	struct deadline_data *dd;
 	struct elevator_queue *eq;
+	unsigned int i, nr_shards;
 
 	eq = elevator_alloc(q, e);
 	if (!eq)
 		return -ENOMEM;
 
-	dd = kzalloc_node(sizeof(*dd), GFP_KERNEL, q->node);
+	nr_shards = q->nr_hw_queues;
+	if (blk_queue_is_zoned(q))
+		nr_shards = 1;
+
+	dd = kzalloc_node(sizeof(*dd) + nr_shards * sizeof(struct dd_shard),
+			  GFP_KERNEL, q->node);
 	if (!dd) {
 		kobject_put(&eq->kobj);
 		return -ENOMEM;
 	}
 	eq->elevator_data = dd;
 
-	INIT_LIST_HEAD(&dd->fifo_list[READ]);
-	INIT_LIST_HEAD(&dd->fifo_list[WRITE]);
-	dd->sort_list[READ] = RB_ROOT;
-	dd->sort_list[WRITE] = RB_ROOT;
+	dd->nr_shards = nr_shards;
+	for (i = 0; i < nr_shards; i++)
+		dd_init_shard(&dd->shards[i]);
 	dd->fifo_expire[READ] = read_expire;
 	dd->fifo_expire[WRITE] = write_expire;
 	dd->writes_starved = writes_starved;
 	dd->front_merges = 1;
 	dd->fifo_batch = fifo_batch;
-	spin_lock_init(&dd->lock);
-	INIT_LIST_HEAD(&dd->dispatch);
 
 	q->elevator = eq;
 	return 0;
 }
 
+static int dd_init_hctx(struct blk_mq_hw_ctx *hctx, unsigned int hctx_idx)
+{
+	struct deadline_data *dd = hctx->queue->elevator->elevator_data;
+
+	/* the hardware queues added later on share the existing shards */
+	hctx->sched_data = &dd->shards[hctx_idx % dd->nr_shards];
+	return 0;
+}
+
 static int dd_request_merge(struct request_queue *q, struct request **rq,
 			    struct bio *bio)
 {
@@ -352,10 +431,11 @@ static int dd_request_merge(struct request_queue *q, struct request **rq,
 	sector_t sector = bio_end_sector(bio);
 	struct request *__rq;
 
+	/* only called through blk_mq_sched_try_merge(), with a single shard */
 	if (!dd->front_merges)
 		return ELEVATOR_NO_MERGE;
 
-	__rq = elv_rb_find(&dd->sort_list[bio_data_dir(bio)], sector);
+	__rq = elv_rb_find(&dd->shards[0].sort_list[bio_data_dir(bio)], sector);
 	if (__rq) {
 		BUG_ON(sector != blk_rq_pos(__rq));
 
@@ -368,16 +448,65 @@ static int dd_request_merge(struct request_queue *q, struct request **rq,
 	return ELEVATOR_NO_MERGE;
 }
 
+/*
+ * The merge hash and last_merge hint of the elevator are per request queue,
+ * hence only usable with a single shard.  The shards rather look for a front
+ * merge in their sort list, and for a back merge amongst their latest
+ * requests.
+ */
+static bool dd_shard_bio_merge(struct request_queue *q,
+			       struct deadline_data *dd, struct dd_shard *ds,
+			       struct bio *bio)
+{
+	const int data_dir = bio_data_dir(bio);
+	struct request *rq;
+	int checked = 8;
+
+	if (dd->front_merges) {
+		rq = elv_rb_find(&ds->sort_list[data_dir], bio_end_sector(bio));
+		if (rq && elv_bio_merge_ok(rq, bio) &&
+		    blk_mq_sched_allow_merge(q, rq, bio) &&
+		    bio_attempt_front_merge(q, rq, bio)) {
+			dd_request_merged(q, rq, ELEVATOR_FRONT_MERGE);
+			return true;
+		}
+	}
+
+	list_for_each_entry_reverse(rq, &ds->fifo_list[data_dir], queuelist) {
+		if (!checked--)
+			break;
+
+		if (!blk_rq_merge_ok(rq, bio))
+			continue;
+
+		switch (blk_try_merge(rq, bio)) {
+		case ELEVATOR_BACK_MERGE:
+			return blk_mq_sched_allow_merge(q, rq, bio) &&
+				bio_attempt_back_merge(q, rq, bio);
+		case ELEVATOR_DISCARD_MERGE:
+			return bio_attempt_discard_merge(q, rq, bio);
+		default:
+			continue;
+		}
+	}
+
+	return false;
+}
+
 static bool dd_bio_merge(struct blk_mq_hw_ctx *hctx, struct bio *bio)
 {
 	struct request_queue *q = hctx->queue;
 	struct deadline_data *dd = q->elevator->elevator_data;
+	struct dd_shard *ds = hctx->sched_data;
 	struct request *free = NULL;
 	bool ret;
 
-	spin_lock(&dd->lock);
-	ret = blk_mq_sched_try_merge(q, bio, &free);
-	spin_unlock(&dd->lock);
+	spin_lock(&ds->lock);
+	if (dd->nr_shards == 1)
+		ret = blk_mq_sched_try_merge(q, bio, &free);
+	else
+		ret = dd_shard_bio_merge(q, dd, ds, bio);
+	spin_unlock(&ds->lock);
 
 	if (free)
 		blk_mq_free_request(free);
@@ -393,22 +522,24 @@ static void dd_insert_request(struct blk_mq_hw_ctx *hctx, struct request *rq,
 {
 	struct request_queue *q = hctx->queue;
 	struct deadline_data *dd = q->elevator->elevator_data;
+	struct dd_shard *ds = hctx->sched_data;
 	const int data_dir = rq_data_dir(rq);
 
-	if (blk_mq_sched_try_insert_merge(q, rq))
+	if (dd->nr_shards == 1 && blk_mq_sched_try_insert_merge(q, rq))
 		return;
 
 	blk_mq_sched_request_inserted(rq);
 
+	rq->elv.priv[0] = ds;
 	if (at_head || blk_rq_is_passthrough(rq)) {
 		if (at_head)
-			list_add(&rq->queuelist, &dd->dispatch);
+			list_add(&rq->queuelist, &ds->dispatch);
 		else
-			list_add_tail(&rq->queuelist, &dd->dispatch);
+			list_add_tail(&rq->queuelist, &ds->dispatch);
 	} else {
-		deadline_add_rq_rb(dd, rq);
+		deadline_add_rq_rb(ds, rq);
 
-		if (rq_mergeable(rq)) {
+		if (dd->nr_shards == 1 && rq_mergeable(rq)) {
 			elv_rqhash_add(q, rq);
 			if (!q->last_merge)
 				q->last_merge = rq;
@@ -418,17 +549,16 @@ static void dd_insert_request(struct blk_mq_hw_ctx *hctx, struct request *rq,
 		 * set expire time and add to fifo list
 		 */
 		rq->fifo_time = jiffies + dd->fifo_expire[data_dir];
-		list_add_tail(&rq->queuelist, &dd->fifo_list[data_dir]);
+		list_add_tail(&rq->queuelist, &ds->fifo_list[data_dir]);
 	}
 }
 
 static void dd_insert_requests(struct blk_mq_hw_ctx *hctx,
 			       struct list_head *list, bool at_head)
 {
-	struct request_queue *q = hctx->queue;
-	struct deadline_data *dd = q->elevator->elevator_data;
+	struct dd_shard *ds = hctx->sched_data;
 
-	spin_lock(&dd->lock);
+	spin_lock(&ds->lock);
 	while (!list_empty(list)) {
 		struct request *rq;
 
@@ -436,16 +566,16 @@ static void dd_insert_requests(struct blk_mq_hw_ctx *hctx,
 		list_del_init(&rq->queuelist);
 		dd_insert_request(hctx, rq, at_head);
 	}
-	spin_unlock(&dd->lock);
+	spin_unlock(&ds->lock);
 }
 
 static bool dd_has_work(struct blk_mq_hw_ctx *hctx)
 {
-	struct deadline_data *dd = hctx->queue->elevator->elevator_data;
+	struct dd_shard *ds = hctx->sched_data;
 
-	return !list_empty_careful(&dd->dispatch) ||
-		!list_empty_careful(&dd->fifo_list[0]) ||
-		!list_empty_careful(&dd->fifo_list[1]);
+	return !list_empty_careful(&ds->dispatch) ||
+		!list_empty_careful(&ds->fifo_list[0]) ||
+		!list_empty_careful(&ds->fifo_list[1]);
 }
 
 /*
@@ -521,31 +651,31 @@ static struct elv_fs_entry deadline_attrs[] = {
 #define DEADLINE_DEBUGFS_DDIR_ATTRS(ddir, name)				\
 static void *deadline_##name##_fifo_start(struct seq_file *m,		\
 					  loff_t *pos)			\
-	__acquires(&dd->lock)						\
+	__acquires(&ds->lock)						\
 {									\
-	struct request_queue *q = m->private;				\
-	struct deadline_data *dd = q->elevator->elevator_data;		\
+	struct blk_mq_hw_ctx *hctx = m->private;			\
+	struct dd_shard *ds = hctx->sched_data;				\
 									\
-	spin_lock(&dd->lock);						\
-	return seq_list_start(&dd->fifo_list[ddir], *pos);		\
+	spin_lock(&ds->lock);						\
+	return seq_list_start(&ds->fifo_list[ddir], *pos);		\
 }									\
 									\
 static void *deadline_##name##_fifo_next(struct seq_file *m, void *v,	\
 					 loff_t *pos)			\
 {									\
-	struct request_queue *q = m->private;				\
-	struct deadline_data *dd = q->elevator->elevator_data;		\
+	struct blk_mq_hw_ctx *hctx = m->private;			\
+	struct dd_shard *ds = hctx->sched_data;				\
 									\
-	return seq_list_next(v, &dd->fifo_list[ddir], pos);		\
+	return seq_list_next(v, &ds->fifo_list[ddir], pos);		\
 }									\
 									\
 static void deadline_##name##_fifo_stop(struct seq_file *m, void *v)	\
-	__releases(&dd->lock)						\
+	__releases(&ds->lock)						\
 {									\
-	struct request_queue *q = m->private;				\
-	struct deadline_data *dd = q->elevator->elevator_data;		\
+	struct blk_mq_hw_ctx *hctx = m->private;			\
+	struct dd_shard *ds = hctx->sched_data;				\
 									\
-	spin_unlock(&dd->lock);						\
+	spin_unlock(&ds->lock);						\
 }									\
 									\
 static const struct seq_operations deadline_##name##_fifo_seq_ops = {	\
@@ -558,9 +688,9 @@ static const struct seq_operations deadline_##name##_fifo_seq_ops = {	\
 static int deadline_##name##_next_rq_show(void *data,			\
 					  struct seq_file *m)		\
 {									\
-	struct request_queue *q = data;					\
-	struct deadline_data *dd = q->elevator->elevator_data;		\
-	struct request *rq = dd->next_rq[ddir];				\
+	struct blk_mq_hw_ctx *hctx = data;				\
+	struct dd_shard *ds = hctx->sched_data;				\
+	struct request *rq = ds->next_rq[ddir];				\
 									\
 	if (rq)								\
 		__blk_mq_debugfs_rq_show(m, rq);			\
@@ -572,47 +702,47 @@ DEADLINE_DEBUGFS_DDIR_ATTRS(WRITE, write)
 
 static int deadline_batching_show(void *data, struct seq_file *m)
 {
-	struct request_queue *q = data;
-	struct deadline_data *dd = q->elevator->elevator_data;
+	struct blk_mq_hw_ctx *hctx = data;
+	struct dd_shard *ds = hctx->sched_data;
 
-	seq_printf(m, "%u\n", dd->batching);
+	seq_printf(m, "%u\n", ds->batching);
 	return 0;
 }
 
 static int deadline_starved_show(void *data, struct seq_file *m)
 {
-	struct request_queue *q = data;
-	struct deadline_data *dd = q->elevator->elevator_data;
+	struct blk_mq_hw_ctx *hctx = data;
+	struct dd_shard *ds = hctx->sched_data;
 
-	seq_printf(m, "%u\n", dd->starved);
+	seq_printf(m, "%u\n", ds->starved);
 	return 0;
 }
 
 static void *deadline_dispatch_start(struct seq_file *m, loff_t *pos)
-	__acquires(&dd->lock)
+	__acquires(&ds->lock)
 {
-	struct request_queue *q = m->private;
-	struct deadline_data *dd = q->elevator->elevator_data;
+	struct blk_mq_hw_ctx *hctx = m->private;
+	struct dd_shard *ds = hctx->sched_data;
 
-	spin_lock(&dd->lock);
-	return seq_list_start(&dd->dispatch, *pos);
+	spin_lock(&ds->lock);
+	return seq_list_start(&ds->dispatch, *pos);
 }
 
 static void *deadline_dispatch_next(struct seq_file *m, void *v, loff_t *pos)
 {
-	struct request_queue *q = m->private;
-	struct deadline_data *dd = q->elevator->elevator_data;
+	struct blk_mq_hw_ctx *hctx = m->private;
+	struct dd_shard *ds = hctx->sched_data;
 
-	return seq_list_next(v, &dd->dispatch, pos);
+	return seq_list_next(v, &ds->dispatch, pos);
 }
 
 static void deadline_dispatch_stop(struct seq_file *m, void *v)
-	__releases(&dd->lock)
+	__releases(&ds->lock)
 {
-	struct request_queue *q = m->private;
-	struct deadline_data *dd = q->elevator->elevator_data;
+	struct blk_mq_hw_ctx *hctx = m->private;
+	struct dd_shard *ds = hctx->sched_data;
 
-	spin_unlock(&dd->lock);
+	spin_unlock(&ds->lock);
 }
 
 static const struct seq_operations deadline_dispatch_seq_ops = {
@@ -622,18 +752,18 @@ static const struct seq_operations deadline_dispatch_seq_ops = {
 	.show	= blk_mq_debugfs_rq_show,
 };
 
-#define DEADLINE_QUEUE_DDIR_ATTRS(name)						\
+#define DEADLINE_HCTX_DDIR_ATTRS(name)						\
 	{#name "_fifo_list", 0400, .seq_ops = &deadline_##name##_fifo_seq_ops},	\
 	{#name "_next_rq", 0400, deadline_##name##_next_rq_show}
-static const struct blk_mq_debugfs_attr deadline_queue_debugfs_attrs[] = {
-	DEADLINE_QUEUE_DDIR_ATTRS(read),
-	DEADLINE_QUEUE_DDIR_ATTRS(write),
+static const struct blk_mq_debugfs_attr deadline_hctx_debugfs_attrs[] = {
+	DEADLINE_HCTX_DDIR_ATTRS(read),
+	DEADLINE_HCTX_DDIR_ATTRS(write),
 	{"batching", 0400, deadline_batching_show},
 	{"starved", 0400, deadline_starved_show},
 	{"dispatch", 0400, .seq_ops = &deadline_dispatch_seq_ops},
 	{},
 };
-#undef DEADLINE_QUEUE_DDIR_ATTRS
+#undef DEADLINE_HCTX_DDIR_ATTRS
 #endif
 
 static struct elevator_type mq_deadline = {
@@ -649,11 +779,12 @@ static struct elevator_type mq_deadline = {
 		.has_work		= dd_has_work,
 		.init_sched		= dd_init_queue,
 		.exit_sched		= dd_exit_queue,
+		.init_hctx		= dd_init_hctx,
 	},
 
 	.uses_mq	= true,
 #ifdef CONFIG_BLK_DEBUG_FS
-	.queue_debugfs_attrs = deadline_queue_debugfs_attrs,
+	.hctx_debugfs_attrs = deadline_hctx_debugfs_attrs,
 #endif
 	.elevator_attrs = deadline_attrs,
 	.elevator_name = "mq-deadline",
@@ -568,3 +568,24 @@ int find_acpi_cpu_topology_package(unsigned int cpu)
 	return find_acpi_cpu_topology_tag(cpu, PPTT_ABORT_PACKAGE,
 					  ACPI_PPTT_PHYSICAL_PACKAGE);
 }
+
+/**
+ * find_acpi_cpu_topology_cluster() - Determine a unique cpu cluster value
+ * @cpu: Kernel logical cpu number
+ * @level: The topological level of the cores: 0, or 1 if they have threads
+ *
+ * Determine a topology unique cluster ID for the given cpu, the node which
+ * contains its core. This ID can then be used to group peers, which will
+ * have matching ids.
+ *
+ * The search does not go beyond a level with the PHYSICAL_PACKAGE flag set,
+ * so cores attached directly to their package report the package value.
+ *
+ * Return: -ENOENT if the PPTT doesn't exist, or the cpu cannot be found.
+ * Otherwise returns a value which represents the cluster for this cpu.
+ */
+int find_acpi_cpu_topology_cluster(unsigned int cpu, int level)
+{
+	return find_acpi_cpu_topology_tag(cpu, level + 1,
+					  ACPI_PPTT_PHYSICAL_PACKAGE);
+}
@@ -76,6 +76,7 @@
 #include <linux/miscdevice.h>
 #include <linux/falloc.h>
 #include <linux/uio.h>
+#include <linux/blk-cgroup.h>
 #include "loop.h"
 
 #include <linux/uaccess.h>
@@ -85,6 +86,19 @@ static DEFINE_MUTEX(loop_index_mutex);
 
 static int max_part;
 static int part_shift;
+static bool default_dio = true;
+
+#define LOOP_IDLE_WORKER_TIMEOUT (60 * HZ)
+
+struct loop_worker {
+	struct rb_node rb_node;
+	struct work_struct work;
+	struct list_head cmd_list;
+	struct list_head idle_list;
+	struct loop_device *lo;
+	struct cgroup_subsys_state *blkcg_css;
+	unsigned long last_ran_at;
+};
 
 static int transfer_xor(struct loop_device *lo, int cmd,
 			struct page *raw_page, unsigned raw_off,
@@ -592,7 +606,7 @@ static int do_req_filebacked(struct loop_device *lo, struct request *rq)
 static inline void loop_update_dio(struct loop_device *lo)
 {
 	__loop_update_dio(lo, io_is_direct(lo->lo_backing_file) |
-			lo->use_dio);
+			lo->want_dio);
 }
 
 static void loop_reread_partitions(struct loop_device *lo,
@@ -824,26 +838,39 @@ static void loop_config_discard(struct loop_device *lo)
 	queue_flag_set_unlocked(QUEUE_FLAG_DISCARD, q);
 }
 
+static void loop_rootcg_workfn(struct work_struct *work);
+static void loop_free_idle_workers(unsigned long data);
+
 static void loop_unprepare_queue(struct loop_device *lo)
 {
-	kthread_flush_worker(&lo->worker);
-	kthread_stop(lo->worker_task);
-}
+	struct loop_worker *pos, *worker;
 
-static int loop_kthread_worker_fn(void *worker_ptr)
-{
-	current->flags |= PF_LESS_THROTTLE;
-	return kthread_worker_fn(worker_ptr);
+	destroy_workqueue(lo->workqueue);
+	del_timer_sync(&lo->timer);
+
+	rbtree_postorder_for_each_entry_safe(worker, pos, &lo->worker_tree,
+					     rb_node) {
+		css_put(worker->blkcg_css);
+		kfree(worker);
+	}
+	lo->worker_tree = RB_ROOT;
+	INIT_LIST_HEAD(&lo->idle_worker_list);
 }
 
 static int loop_prepare_queue(struct loop_device *lo)
 {
-	kthread_init_worker(&lo->worker);
-	lo->worker_task = kthread_run(loop_kthread_worker_fn,
-			&lo->worker, "loop%d", lo->lo_number);
-	if (IS_ERR(lo->worker_task))
+	/* MIN_NICE workers, as the loop kthread used to be */
+	lo->workqueue = alloc_workqueue("loop%d", WQ_UNBOUND | WQ_HIGHPRI,
+					0, lo->lo_number);
+	if (!lo->workqueue)
 		return -ENOMEM;
-	set_user_nice(lo->worker_task, MIN_NICE);
+
+	spin_lock_init(&lo->lo_work_lock);
+	INIT_WORK(&lo->rootcg_work, loop_rootcg_workfn);
+	INIT_LIST_HEAD(&lo->rootcg_cmd_list);
+	INIT_LIST_HEAD(&lo->idle_worker_list);
+	lo->worker_tree = RB_ROOT;
+	setup_timer(&lo->timer, loop_free_idle_workers, (unsigned long)lo);
 	return 0;
 }
 
@@ -909,6 +936,7 @@ static int loop_set_fd(struct loop_device *lo, fmode_t mode,
 	set_device_ro(bdev, (lo_flags & LO_FLAGS_READ_ONLY) != 0);
 
 	lo->use_dio = false;
+	lo->want_dio = default_dio;
 	lo->lo_device = bdev;
 	lo->lo_flags = lo_flags;
 	lo->lo_backing_file = file;
@@ -1313,6 +1341,7 @@ static int loop_set_dio(struct loop_device *lo, unsigned long arg)
 	if (lo->lo_state != Lo_bound)
 		goto out;
 
+	lo->want_dio = !!arg;
 	__loop_update_dio(lo, !!arg);
 	if (lo->use_dio == !!arg)
 		return 0;
@@ -1623,6 +1652,8 @@ module_param(max_loop, int, S_IRUGO);
 MODULE_PARM_DESC(max_loop, "Maximum number of loop devices");
 module_param(max_part, int, S_IRUGO);
 MODULE_PARM_DESC(max_part, "Maximum number of partitions per loop device");
+module_param(default_dio, bool, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(default_dio, "Use direct I/O on backing files when possible");
 MODULE_LICENSE("GPL");
 MODULE_ALIAS_BLOCKDEV_MAJOR(LOOP_MAJOR);
 
@@ -1664,6 +1695,68 @@ int loop_unregister_transfer(int number)
 EXPORT_SYMBOL(loop_register_transfer);
 EXPORT_SYMBOL(loop_unregister_transfer);
 
+static void loop_workfn(struct work_struct *work);
+
+static void loop_set_timer(struct loop_device *lo)
+{
+	if (!timer_pending(&lo->timer))
+		mod_timer(&lo->timer, jiffies + LOOP_IDLE_WORKER_TIMEOUT);
+}
+
+static void loop_queue_work(struct loop_device *lo, struct loop_cmd *cmd)
+{
+	struct rb_node **node = &lo->worker_tree.rb_node, *parent = NULL;
+	struct loop_worker *cur_worker, *worker = NULL;
+	struct work_struct *work;
+	struct list_head *cmd_list;
+
+	spin_lock_irq(&lo->lo_work_lock);
+
+	if (!cmd->blkcg_css)
+		goto queue_work;
+
+	while (*node) {
+		parent = *node;
+		cur_worker = rb_entry(*node, struct loop_worker, rb_node);
+		if (cur_worker->blkcg_css == cmd->blkcg_css) {
+			worker = cur_worker;
+			goto queue_work;
+		}
+		if ((long)cur_worker->blkcg_css < (long)cmd->blkcg_css)
+			node = &(*node)->rb_left;
+		else
+			node = &(*node)->rb_right;
+	}
+
+	/* Fall back to the root cgroup work if no worker can be allocated */
+	worker = kzalloc(sizeof(*worker), GFP_NOWAIT | __GFP_NOWARN);
+	if (!worker)
+		goto queue_work;
+
+	worker->blkcg_css = cmd->blkcg_css;
+	css_get(worker->blkcg_css);
+	INIT_WORK(&worker->work, loop_workfn);
+	INIT_LIST_HEAD(&worker->cmd_list);
+	INIT_LIST_HEAD(&worker->idle_list);
+	worker->lo = lo;
+	rb_link_node(&worker->rb_node, parent, node);
+	rb_insert_color(&worker->rb_node, &lo->worker_tree);
+queue_work:
+	if (worker) {
+		/* the idle timer frees the workers on the idle list */
+		if (!list_empty(&worker->idle_list))
+			list_del_init(&worker->idle_list);
+		work = &worker->work;
+		cmd_list = &worker->cmd_list;
+	} else {
+		work = &lo->rootcg_work;
+		cmd_list = &lo->rootcg_cmd_list;
+	}
+	list_add_tail(&cmd->list_entry, cmd_list);
+	queue_work(lo->workqueue, work);
+	spin_unlock_irq(&lo->lo_work_lock);
+}
+
 static blk_status_t loop_queue_rq(struct blk_mq_hw_ctx *hctx,
 		const struct blk_mq_queue_data *bd)
 {
@@ -1686,7 +1779,14 @@ static blk_status_t loop_queue_rq(struct blk_mq_hw_ctx *hctx,
 		break;
 	}
 
-	kthread_queue_work(&lo->worker, &cmd->work);
+	/* the bios hold a reference on their css until completed */
+	cmd->blkcg_css = NULL;
+#ifdef CONFIG_BLK_CGROUP
+	if (cmd->rq->bio && cmd->rq->bio->bi_css &&
+	    cmd->rq->bio->bi_css != blkcg_root_css)
+		cmd->blkcg_css = cmd->rq->bio->bi_css;
+#endif
+	loop_queue_work(lo, cmd);
 
 	return BLK_STS_OK;
 }
@@ -1711,12 +1811,80 @@ static void loop_handle_cmd(struct loop_cmd *cmd)
 	}
 }
 
-static void loop_queue_work(struct kthread_work *work)
+static void loop_process_work(struct loop_worker *worker,
+			      struct list_head *cmd_list,
+			      struct loop_device *lo)
+{
+	unsigned int orig_flags = current->flags;
+	struct loop_cmd *cmd;
+
+	current->flags |= PF_LESS_THROTTLE;
+
+	spin_lock_irq(&lo->lo_work_lock);
+	while (!list_empty(cmd_list)) {
+		cmd = list_first_entry(cmd_list, struct loop_cmd, list_entry);
+		list_del(&cmd->list_entry);
+		spin_unlock_irq(&lo->lo_work_lock);
+
+		loop_handle_cmd(cmd);
+		cond_resched();
+
+		spin_lock_irq(&lo->lo_work_lock);
+	}
+
+	/*
+	 * Only a worker with no pending command, which won't run again
+	 * unless loop_queue_work() takes it off the idle list, may be freed.
+	 */
+	if (worker && !work_pending(&worker->work)) {
+		worker->last_ran_at = jiffies;
+		list_add_tail(&worker->idle_list, &lo->idle_worker_list);
+		loop_set_timer(lo);
+	}
+	spin_unlock_irq(&lo->lo_work_lock);
+
+	current_restore_flags(orig_flags, PF_LESS_THROTTLE);
+}
+
+static void loop_workfn(struct work_struct *work)
+{
+	struct loop_worker *worker =
+		container_of(work, struct loop_worker, work);
+	struct cgroup_subsys_state *css = worker->blkcg_css;
+
+	/* the worker may be freed once processed */
+	kthread_associate_blkcg(css);
+	loop_process_work(worker, &worker->cmd_list, worker->lo);
+	kthread_associate_blkcg(NULL);
+}
+
+static void loop_rootcg_workfn(struct work_struct *work)
 {
-	struct loop_cmd *cmd =
-		container_of(work, struct loop_cmd, work);
+	struct loop_device *lo =
+		container_of(work, struct loop_device, rootcg_work);
 
-	loop_handle_cmd(cmd);
+	loop_process_work(NULL, &lo->rootcg_cmd_list, lo);
+}
+
+static void loop_free_idle_workers(unsigned long data)
+{
+	struct loop_device *lo = (struct loop_device *)data;
+	struct loop_worker *pos, *worker;
+
+	spin_lock_irq(&lo->lo_work_lock);
+	list_for_each_entry_safe(worker, pos, &lo->idle_worker_list,
+				 idle_list) {
+		if (time_is_after_jiffies(worker->last_ran_at +
+					  LOOP_IDLE_WORKER_TIMEOUT))
+			break;
+		list_del(&worker->idle_list);
+		rb_erase(&worker->rb_node, &lo->worker_tree);
+		css_put(worker->blkcg_css);
+		kfree(worker);
+	}
+	if (!list_empty(&lo->idle_worker_list))
+		loop_set_timer(lo);
+	spin_unlock_irq(&lo->lo_work_lock);
 }
 
 static int loop_init_request(struct blk_mq_tag_set *set, struct request *rq,
@@ -1725,7 +1893,6 @@ static int loop_init_request(struct blk_mq_tag_set *set, struct request *rq,
 	struct loop_cmd *cmd = blk_mq_rq_to_pdu(rq);
 
 	cmd->rq = rq;
-	kthread_init_work(&cmd->work, loop_queue_work);
 
 	return 0;
 }
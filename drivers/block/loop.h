@@ -14,7 +14,9 @@
 #include <linux/blk-mq.h>
 #include <linux/spinlock.h>
 #include <linux/mutex.h>
-#include <linux/kthread.h>
+#include <linux/rbtree.h>
+#include <linux/timer.h>
+#include <linux/workqueue.h>
 #include <uapi/linux/loop.h>
 
 /* Possible states of device */
@@ -55,9 +57,22 @@ struct loop_device {
 	spinlock_t		lo_lock;
 	int			lo_state;
 	struct mutex		lo_ctl_mutex;
-	struct kthread_worker	worker;
-	struct task_struct	*worker_task;
 	bool			use_dio;
+	bool			want_dio;
+
+	/*
+	 * The commands are handled by a worker per blkcg, so that they are
+	 * issued concurrently and on behalf of the cgroup they come from.
+	 * The root cgroup, and the commands whose worker can't be allocated,
+	 * use the rootcg_work.  Idle workers are freed by the timer.
+	 */
+	struct workqueue_struct	*workqueue;
+	spinlock_t		lo_work_lock;
+	struct work_struct	rootcg_work;
+	struct list_head	rootcg_cmd_list;
+	struct list_head	idle_worker_list;
+	struct rb_root		worker_tree;
+	struct timer_list	timer;
 
 	struct request_queue	*lo_queue;
 	struct blk_mq_tag_set	tag_set;
@@ -65,7 +80,8 @@ struct loop_device {
 };
 
 struct loop_cmd {
-	struct kthread_work work;
+	struct list_head list_entry;
+	struct cgroup_subsys_state *blkcg_css;
 	struct request *rq;
 	bool use_aio; /* use AIO interface to handle I/O */
 	atomic_t ref; /* only for aio */
@@ -15,6 +15,8 @@
 #include <linux/lightnvm.h>
 #include <linux/configfs.h>
 #include <linux/badblocks.h>
+#include <linux/random.h>
+#include <linux/highmem.h>
 
 #define SECTOR_SHIFT		9
 #define PAGE_SECTORS_SHIFT	(PAGE_SHIFT - SECTOR_SHIFT)
@@ -32,6 +34,11 @@ static inline u64 mb_per_tick(int mbps)
 	return (1 << 20) / TICKS_PER_SEC * ((u64) mbps);
 }
 
+static inline u64 ios_per_tick(unsigned int iops)
+{
+	return DIV_ROUND_UP(iops, (unsigned int)TICKS_PER_SEC);
+}
+
 struct nullb_cmd {
 	struct list_head list;
 	struct llist_node ll_list;
@@ -87,6 +94,23 @@ struct nullb_page {
 #define NULLB_PAGE_LOCK (sizeof(unsigned long) * 8 - 1)
 #define NULLB_PAGE_FREE (sizeof(unsigned long) * 8 - 2)
 
+/*
+ * nullb_lat_table is the latency distribution of an operation type.
+ *
+ * @pct:	The percentiles, in hundredths of percent.  They are increasing
+ *		and the last one is always 10000.
+ * @nsec:	The latency at each percentile.
+ * The latencies between two points are interpolated linearly, the ones under
+ * the first percentile all get the latency of the first point.
+ */
+#define NULLB_LAT_POINTS	16
+
+struct nullb_lat_table {
+	unsigned int nr;
+	u32 pct[NULLB_LAT_POINTS];
+	u64 nsec[NULLB_LAT_POINTS];
+};
+
 struct nullb_device {
 	struct nullb *nullb;
 	struct config_item item;
@@ -95,6 +119,10 @@ struct nullb_device {
 	unsigned long flags; /* device flags */
 	unsigned int curr_cache;
 	struct badblocks badblocks;
+	struct blk_zone *zones; /* zones, if zoned */
+	unsigned int nr_zones;
+	sector_t zone_size_sects;
+	spinlock_t zone_lock; /* protects the zone conditions and wps */
 
 	unsigned long size; /* device size in MB */
 	unsigned long completion_nsec; /* time in ns to complete a request */
@@ -107,12 +135,21 @@ struct nullb_device {
 	unsigned int hw_queue_depth; /* queue depth */
 	unsigned int index; /* index of the disk, only valid with a disk */
 	unsigned int mbps; /* Bandwidth throttle cap (in MB/s) */
+	unsigned int write_mbps; /* Write bandwidth throttle cap (in MB/s) */
+	unsigned int iops; /* IOPS throttle cap */
+	unsigned int stall_interval_ms; /* period of the stalls */
+	unsigned int stall_ms; /* duration of a stall */
+	unsigned long zone_size; /* zone size in MB */
+	unsigned int zone_nr_conv; /* number of conventional zones */
+	struct nullb_lat_table latency_read; /* read latency distribution */
+	struct nullb_lat_table latency_write; /* write latency distribution */
 	bool use_lightnvm; /* register as a LightNVM device */
 	bool blocking; /* blocking blk-mq device */
 	bool use_per_node_hctx; /* use per-node allocation for hardware context */
 	bool power; /* power on/off the device */
 	bool memory_backed; /* if data is stored in memory */
 	bool discard; /* if support discard */
+	bool zoned; /* if device is host-managed zoned */
 };
 
 struct nullb {
@@ -126,6 +163,8 @@ struct nullb {
 	struct blk_mq_tag_set __tag_set;
 	unsigned int queue_depth;
 	atomic_long_t cur_bytes;
+	atomic_long_t cur_write_bytes;
+	atomic_long_t cur_ios;
 	struct hrtimer bw_timer;
 	unsigned long cache_flush_pos;
 	spinlock_t lock;
@@ -347,7 +386,128 @@ NULLB_DEVICE_ATTR(use_per_node_hctx, bool);
 NULLB_DEVICE_ATTR(memory_backed, bool);
 NULLB_DEVICE_ATTR(discard, bool);
 NULLB_DEVICE_ATTR(mbps, uint);
+NULLB_DEVICE_ATTR(write_mbps, uint);
+NULLB_DEVICE_ATTR(iops, uint);
+NULLB_DEVICE_ATTR(stall_interval_ms, uint);
+NULLB_DEVICE_ATTR(stall_ms, uint);
 NULLB_DEVICE_ATTR(cache_size, ulong);
+NULLB_DEVICE_ATTR(zoned, bool);
+NULLB_DEVICE_ATTR(zone_size, ulong);
+NULLB_DEVICE_ATTR(zone_nr_conv, uint);
+
+static ssize_t nullb_device_lat_attr_show(struct nullb_lat_table *t,
+	char *page)
+{
+	ssize_t len = 0;
+	unsigned int i;
+
+	for (i = 0; i < t->nr; i++)
+		len += snprintf(page + len, PAGE_SIZE - len, "%s%u.%02u:%llu",
+				i ? " " : "", t->pct[i] / 100, t->pct[i] % 100,
+				t->nsec[i]);
+	len += snprintf(page + len, PAGE_SIZE - len, "\n");
+	return len;
+}
+
+/* Parses a percentile with at most two decimals, in hundredths of percent */
+static int null_lat_parse_pct(char *s, u32 *pct)
+{
+	char *dot = strchr(s, '.');
+	unsigned int ip, fp = 0;
+	int ret;
+
+	if (dot) {
+		size_t n = strlen(dot + 1);
+
+		*dot = '\0';
+		if (n == 0 || n > 2)
+			return -EINVAL;
+		ret = kstrtouint(dot + 1, 10, &fp);
+		if (ret)
+			return ret;
+		if (n == 1)
+			fp *= 10;
+	}
+	ret = kstrtouint(s, 10, &ip);
+	if (ret)
+		return ret;
+	if (ip > 100 || (ip == 100 && fp))
+		return -EINVAL;
+
+	*pct = ip * 100 + fp;
+	return 0;
+}
+
+/*
+ * A latency table is written as "PCT:NSEC" points separated by spaces or
+ * commas, with increasing percentiles up to 100, e.g. "50:20000 99:80000
+ * 99.99:2000000 100:5000000".  An empty string removes the table.
+ */
+static ssize_t nullb_device_lat_attr_store(struct nullb_lat_table *t,
+	const char *page, size_t count)
+{
+	struct nullb_lat_table new = { };
+	char *orig, *buf, *tok;
+	ssize_t ret;
+
+	orig = kstrndup(page, count, GFP_KERNEL);
+	if (!orig)
+		return -ENOMEM;
+
+	buf = strstrip(orig);
+	while ((tok = strsep(&buf, " ,")) != NULL) {
+		unsigned int i = new.nr;
+		char *colon;
+
+		if (!*tok)
+			continue;
+		ret = -EINVAL;
+		colon = strchr(tok, ':');
+		if (i == NULLB_LAT_POINTS || !colon)
+			goto out;
+		*colon = '\0';
+		ret = null_lat_parse_pct(tok, &new.pct[i]);
+		if (ret)
+			goto out;
+		ret = kstrtoull(colon + 1, 0, &new.nsec[i]);
+		if (ret)
+			goto out;
+		ret = -EINVAL;
+		if (i && (new.pct[i] <= new.pct[i - 1] ||
+			  new.nsec[i] < new.nsec[i - 1]))
+			goto out;
+		new.nr++;
+	}
+	ret = -EINVAL;
+	if (new.nr && new.pct[new.nr - 1] != 10000)
+		goto out;
+
+	*t = new;
+	ret = count;
+out:
+	kfree(orig);
+	return ret;
+}
+
+#define NULLB_DEVICE_LAT_ATTR(NAME)						\
+static ssize_t									\
+nullb_device_##NAME##_show(struct config_item *item, char *page)		\
+{										\
+	return nullb_device_lat_attr_show(&to_nullb_device(item)->NAME, page);	\
+}										\
+static ssize_t									\
+nullb_device_##NAME##_store(struct config_item *item, const char *page,		\
+			    size_t count)					\
+{										\
+	if (test_bit(NULLB_DEV_FL_CONFIGURED, &to_nullb_device(item)->flags))	\
+		return -EBUSY;							\
+	return nullb_device_lat_attr_store(&to_nullb_device(item)->NAME,	\
+					   page, count);			\
+}										\
+CONFIGFS_ATTR(nullb_device_, NAME);
+
+NULLB_DEVICE_LAT_ATTR(latency_read);
+NULLB_DEVICE_LAT_ATTR(latency_write);
 
 static ssize_t nullb_device_power_show(struct config_item *item, char *page)
 {
@@ -460,6 +620,15 @@ static struct configfs_attribute *nullb_device_attrs[] = {
 	&nullb_device_attr_mbps,
 	&nullb_device_attr_cache_size,
 	&nullb_device_attr_badblocks,
+	&nullb_device_attr_write_mbps,
+	&nullb_device_attr_iops,
+	&nullb_device_attr_latency_read,
+	&nullb_device_attr_latency_write,
+	&nullb_device_attr_stall_interval_ms,
+	&nullb_device_attr_stall_ms,
+	&nullb_device_attr_zoned,
+	&nullb_device_attr_zone_size,
+	&nullb_device_attr_zone_nr_conv,
 	NULL,
 };
 
@@ -513,7 +682,7 @@ nullb_group_drop_item(struct config_group *group, struct config_item *item)
 
 static ssize_t memb_group_features_show(struct config_item *item, char *page)
 {
-	return snprintf(page, PAGE_SIZE, "memory_backed,discard,bandwidth,cache,badblocks\n");
+	return snprintf(page, PAGE_SIZE, "memory_backed,discard,bandwidth,cache,badblocks,iops,latency,stall,zoned\n");
 }
 
 CONFIGFS_ATTR_RO(memb_group_, features);
@@ -573,11 +742,14 @@ static struct nullb_device *null_alloc_dev(void)
 	dev->use_lightnvm = g_use_lightnvm;
 	dev->blocking = g_blocking;
 	dev->use_per_node_hctx = g_use_per_node_hctx;
+	dev->zone_size = 256;
+	spin_lock_init(&dev->zone_lock);
 	return dev;
 }
 
 static void null_free_dev(struct nullb_device *dev)
 {
+	kvfree(dev->zones);
 	kfree(dev);
 }
 
@@ -693,11 +865,84 @@ static enum hrtimer_restart null_cmd_timer_expired(struct hrtimer *timer)
 	return HRTIMER_NORESTART;
 }
 
+static inline int null_cmd_op(struct nullb_cmd *cmd)
+{
+	if (cmd->nq->dev->queue_mode == NULL_Q_BIO)
+		return bio_op(cmd->bio);
+	return req_op(cmd->rq);
+}
+
+static inline sector_t null_cmd_sector(struct nullb_cmd *cmd)
+{
+	if (cmd->nq->dev->queue_mode == NULL_Q_BIO)
+		return cmd->bio->bi_iter.bi_sector;
+	return blk_rq_pos(cmd->rq);
+}
+
+static inline unsigned int null_cmd_sectors(struct nullb_cmd *cmd)
+{
+	if (cmd->nq->dev->queue_mode == NULL_Q_BIO)
+		return bio_sectors(cmd->bio);
+	return blk_rq_sectors(cmd->rq);
+}
+
+static u64 null_lat_sample(const struct nullb_lat_table *t)
+{
+	u32 p = prandom_u32() % 10000;
+	unsigned int i = 0;
+	u64 lo, hi;
+
+	while (p >= t->pct[i])
+		i++;
+	if (i == 0)
+		return t->nsec[0];
+
+	lo = t->nsec[i - 1];
+	hi = t->nsec[i];
+	return lo + div_u64((hi - lo) * (p - t->pct[i - 1]),
+			    t->pct[i] - t->pct[i - 1]);
+}
+
+/*
+ * The device stalls for the last stall_ms of every stall_interval_ms, as a
+ * SSD busy with garbage collection: the commands arriving during a stall do
+ * not complete before its end.
+ */
+static u64 null_stall_nsec(struct nullb_device *dev)
+{
+	u64 period = (u64)dev->stall_interval_ms * NSEC_PER_MSEC;
+	u64 stall = (u64)dev->stall_ms * NSEC_PER_MSEC;
+	u64 phase;
+
+	if (!stall)
+		return 0;
+
+	div64_u64_rem(ktime_get_ns(), period, &phase);
+	if (phase < period - stall)
+		return 0;
+	return period - phase;
+}
+
 static void null_cmd_end_timer(struct nullb_cmd *cmd)
 {
-	ktime_t kt = cmd->nq->dev->completion_nsec;
+	struct nullb_device *dev = cmd->nq->dev;
+	const struct nullb_lat_table *t = NULL;
+	u64 nsec = dev->completion_nsec;
 
-	hrtimer_start(&cmd->timer, kt, HRTIMER_MODE_REL);
+	switch (null_cmd_op(cmd)) {
+	case REQ_OP_READ:
+		t = &dev->latency_read;
+		break;
+	case REQ_OP_WRITE:
+	case REQ_OP_ZONE_APPEND:
+		t = &dev->latency_write;
+		break;
+	}
+	if (t && t->nr)
+		nsec = null_lat_sample(t);
+	nsec += null_stall_nsec(dev);
+
+	hrtimer_start(&cmd->timer, ns_to_ktime(nsec), HRTIMER_MODE_REL);
 }
 
 static void null_softirq_done_fn(struct request *rq)
@@ -1196,6 +1441,203 @@ static void null_restart_queue_async(struct nullb *nullb)
 	}
 }
 
+static inline unsigned int null_zone_no(struct nullb_device *dev,
+	sector_t sector)
+{
+	return sector >> ilog2(dev->zone_size_sects);
+}
+
+static int null_zone_init(struct nullb_device *dev)
+{
+	sector_t sector = 0;
+	unsigned int i;
+
+	/* the zones are kept across power cycles, as the data */
+	if (dev->zones)
+		return 0;
+
+	dev->zone_size_sects = dev->zone_size << (20 - SECTOR_SHIFT);
+	dev->nr_zones = dev->size / dev->zone_size;
+	dev->zones = kvmalloc_array(dev->nr_zones, sizeof(struct blk_zone),
+				    GFP_KERNEL | __GFP_ZERO);
+	if (!dev->zones)
+		return -ENOMEM;
+
+	for (i = 0; i < dev->nr_zones; i++) {
+		struct blk_zone *zone = &dev->zones[i];
+
+		zone->start = sector;
+		zone->len = dev->zone_size_sects;
+		if (i < dev->zone_nr_conv) {
+			zone->wp = zone->start + zone->len;
+			zone->type = BLK_ZONE_TYPE_CONVENTIONAL;
+			zone->cond = BLK_ZONE_COND_NOT_WP;
+		} else {
+			zone->wp = zone->start;
+			zone->type = BLK_ZONE_TYPE_SEQWRITE_REQ;
+			zone->cond = BLK_ZONE_COND_EMPTY;
+		}
+		sector += dev->zone_size_sects;
+	}
+	return 0;
+}
+
+/*
+ * Fills the report header and as many zones as fit in the pages of @bio,
+ * starting with the zone holding its sector, which is what
+ * blkdev_report_zones() expects.
+ */
+static void null_zone_report(struct nullb_device *dev, struct bio *bio)
+{
+	unsigned int zno = null_zone_no(dev, bio->bi_iter.bi_sector);
+	struct blk_zone_report_hdr hdr = { };
+	struct bvec_iter iter;
+	struct bio_vec bvec;
+	bool first = true;
+	unsigned int nr;
+
+	if (bio->bi_iter.bi_size < sizeof(hdr))
+		return;
+	nr = min_t(unsigned int, dev->nr_zones - zno,
+		   (bio->bi_iter.bi_size - sizeof(hdr)) /
+		   sizeof(struct blk_zone));
+	hdr.nr_zones = nr;
+
+	spin_lock_irq(&dev->zone_lock);
+	bio_for_each_segment(bvec, bio, iter) {
+		void *addr = kmap_atomic(bvec.bv_page);
+		void *buf = addr + bvec.bv_offset;
+		unsigned int ofst = 0;
+
+		if (first) {
+			memcpy(buf, &hdr, sizeof(hdr));
+			ofst = sizeof(hdr);
+			first = false;
+		}
+		while (nr && ofst + sizeof(struct blk_zone) <= bvec.bv_len) {
+			memcpy(buf + ofst, &dev->zones[zno++],
+			       sizeof(struct blk_zone));
+			ofst += sizeof(struct blk_zone);
+			nr--;
+		}
+		kunmap_atomic(addr);
+		if (!nr)
+			break;
+	}
+	spin_unlock_irq(&dev->zone_lock);
+}
+
+static blk_status_t null_zone_reset(struct nullb_device *dev, sector_t sector)
+{
+	struct blk_zone *zone = &dev->zones[null_zone_no(dev, sector)];
+
+	if (zone->type == BLK_ZONE_TYPE_CONVENTIONAL)
+		return BLK_STS_IOERR;
+
+	spin_lock_irq(&dev->zone_lock);
+	zone->wp = zone->start;
+	zone->cond = BLK_ZONE_COND_EMPTY;
+	spin_unlock_irq(&dev->zone_lock);
+
+	/* the data of a reset zone is gone */
+	if (dev->memory_backed)
+		null_handle_discard(dev->nullb, zone->start,
+				    zone->len << SECTOR_SHIFT);
+	return BLK_STS_OK;
+}
+
+/*
+ * The writes to a sequential zone must start at its write pointer, the zone
+ * appends are moved to it: on completion their sector is the one written.
+ */
+static blk_status_t null_zone_write(struct nullb_cmd *cmd, bool append)
+{
+	struct nullb_device *dev = cmd->nq->dev;
+	sector_t sector = null_cmd_sector(cmd);
+	unsigned int nr_sectors = null_cmd_sectors(cmd);
+	struct blk_zone *zone = &dev->zones[null_zone_no(dev, sector)];
+	blk_status_t ret = BLK_STS_IOERR;
+
+	if (zone->type == BLK_ZONE_TYPE_CONVENTIONAL)
+		return append ? BLK_STS_IOERR : BLK_STS_OK;
+
+	spin_lock_irq(&dev->zone_lock);
+	if (zone->cond == BLK_ZONE_COND_FULL)
+		goto out;
+	if (append)
+		sector = zone->wp;
+	if (sector != zone->wp ||
+	    zone->wp + nr_sectors > zone->start + zone->len)
+		goto out;
+
+	zone->wp += nr_sectors;
+	if (zone->wp == zone->start + zone->len)
+		zone->cond = BLK_ZONE_COND_FULL;
+	else
+		zone->cond = BLK_ZONE_COND_IMP_OPEN;
+
+	if (append) {
+		if (dev->queue_mode == NULL_Q_BIO)
+			cmd->bio->bi_iter.bi_sector = sector;
+		else
+			cmd->rq->__sector = sector;
+	}
+	ret = BLK_STS_OK;
+out:
+	spin_unlock_irq(&dev->zone_lock);
+	return ret;
+}
+
+/* Sets @done for the zone commands, which need no data transfer after */
+static blk_status_t null_handle_zoned(struct nullb_cmd *cmd, bool *done)
+{
+	struct nullb_device *dev = cmd->nq->dev;
+
+	switch (null_cmd_op(cmd)) {
+	case REQ_OP_ZONE_REPORT:
+		*done = true;
+		null_zone_report(dev, dev->queue_mode == NULL_Q_BIO ?
+				 cmd->bio : cmd->rq->bio);
+		return BLK_STS_OK;
+	case REQ_OP_ZONE_RESET:
+		*done = true;
+		return null_zone_reset(dev, null_cmd_sector(cmd));
+	case REQ_OP_WRITE:
+		return null_zone_write(cmd, false);
+	case REQ_OP_ZONE_APPEND:
+		return null_zone_write(cmd, true);
+	default:
+		return BLK_STS_OK;
+	}
+}
+
+/* Charges @rq to the token buckets, returns false if one ran out */
+static bool null_throttle_charge(struct nullb *nullb, struct request *rq)
+{
+	struct nullb_device *dev = nullb->dev;
+
+	if (dev->mbps &&
+	    atomic_long_sub_return(blk_rq_bytes(rq), &nullb->cur_bytes) < 0)
+		return false;
+	if (dev->write_mbps && op_is_write(req_op(rq)) &&
+	    atomic_long_sub_return(blk_rq_bytes(rq),
+				   &nullb->cur_write_bytes) < 0)
+		return false;
+	if (dev->iops && atomic_long_dec_return(&nullb->cur_ios) < 0)
+		return false;
+	return true;
+}
+
+static bool null_throttle_has_budget(struct nullb *nullb)
+{
+	struct nullb_device *dev = nullb->dev;
+
+	return (!dev->mbps || atomic_long_read(&nullb->cur_bytes) > 0) &&
+	       (!dev->write_mbps ||
+		atomic_long_read(&nullb->cur_write_bytes) > 0) &&
+	       (!dev->iops || atomic_long_read(&nullb->cur_ios) > 0);
+}
+
 static blk_status_t null_handle_cmd(struct nullb_cmd *cmd)
 {
 	struct nullb_device *dev = cmd->nq->dev;
@@ -1208,11 +1650,10 @@ static blk_status_t null_handle_cmd(struct nullb_cmd *cmd)
 		if (!hrtimer_active(&nullb->bw_timer))
 			hrtimer_restart(&nullb->bw_timer);
 
-		if (atomic_long_sub_return(blk_rq_bytes(rq),
-				&nullb->cur_bytes) < 0) {
+		if (!null_throttle_charge(nullb, rq)) {
 			null_stop_queue(nullb);
 			/* race with timer */
-			if (atomic_long_read(&nullb->cur_bytes) > 0)
+			if (null_throttle_has_budget(nullb))
 				null_restart_queue_async(nullb);
 			if (dev->queue_mode == NULL_Q_RQ) {
 				struct request_queue *q = nullb->q;
@@ -1252,6 +1693,14 @@ static blk_status_t null_handle_cmd(struct nullb_cmd *cmd)
 		}
 	}
 
+	if (dev->zoned) {
+		bool done = false;
+
+		cmd->error = null_handle_zoned(cmd, &done);
+		if (cmd->error != BLK_STS_OK || done)
+			goto out;
+	}
+
 	if (dev->memory_backed) {
 		if (dev->queue_mode == NULL_Q_BIO) {
 			if (bio_op(cmd->bio) == REQ_OP_FLUSH)
@@ -1295,16 +1744,29 @@ static blk_status_t null_handle_cmd(struct nullb_cmd *cmd)
 	return BLK_STS_OK;
 }
 
+static void null_throttle_refill(struct nullb *nullb)
+{
+	struct nullb_device *dev = nullb->dev;
+
+	atomic_long_set(&nullb->cur_bytes, mb_per_tick(dev->mbps));
+	atomic_long_set(&nullb->cur_write_bytes, mb_per_tick(dev->write_mbps));
+	atomic_long_set(&nullb->cur_ios, ios_per_tick(dev->iops));
+}
+
 static enum hrtimer_restart nullb_bwtimer_fn(struct hrtimer *timer)
 {
 	struct nullb *nullb = container_of(timer, struct nullb, bw_timer);
 	ktime_t timer_interval = ktime_set(0, TIMER_INTERVAL);
-	unsigned int mbps = nullb->dev->mbps;
+	struct nullb_device *dev = nullb->dev;
 
-	if (atomic_long_read(&nullb->cur_bytes) == mb_per_tick(mbps))
+	/* idle for a tick */
+	if (atomic_long_read(&nullb->cur_bytes) == mb_per_tick(dev->mbps) &&
+	    atomic_long_read(&nullb->cur_write_bytes) ==
+			mb_per_tick(dev->write_mbps) &&
+	    atomic_long_read(&nullb->cur_ios) == ios_per_tick(dev->iops))
 		return HRTIMER_NORESTART;
 
-	atomic_long_set(&nullb->cur_bytes, mb_per_tick(mbps));
+	null_throttle_refill(nullb);
 	null_restart_queue_async(nullb);
 
 	hrtimer_forward_now(&nullb->bw_timer, timer_interval);
@@ -1318,7 +1780,7 @@ static void nullb_setup_bwtimer(struct nullb *nullb)
 
 	hrtimer_init(&nullb->bw_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
 	nullb->bw_timer.function = nullb_bwtimer_fn;
-	atomic_long_set(&nullb->cur_bytes, mb_per_tick(nullb->dev->mbps));
+	null_throttle_refill(nullb);
 	hrtimer_start(&nullb->bw_timer, timer_interval, HRTIMER_MODE_REL);
 }
 
@@ -1596,6 +2058,8 @@ static void null_del_dev(struct nullb *nullb)
 	if (test_bit(NULLB_DEV_FL_THROTTLED, &nullb->dev->flags)) {
 		hrtimer_cancel(&nullb->bw_timer);
 		atomic_long_set(&nullb->cur_bytes, LONG_MAX);
+		atomic_long_set(&nullb->cur_write_bytes, LONG_MAX);
+		atomic_long_set(&nullb->cur_ios, LONG_MAX);
 		null_restart_queue_async(nullb);
 	}
 
@@ -1791,9 +2255,25 @@ static void null_validate_conf(struct nullb_device *dev)
 	dev->cache_size = min_t(unsigned long, ULONG_MAX / 1024 / 1024,
 						dev->cache_size);
 	dev->mbps = min_t(unsigned int, 1024 * 40, dev->mbps);
+	dev->write_mbps = min_t(unsigned int, 1024 * 40, dev->write_mbps);
 	/* can not stop a queue */
-	if (dev->queue_mode == NULL_Q_BIO)
+	if (dev->queue_mode == NULL_Q_BIO) {
 		dev->mbps = 0;
+		dev->write_mbps = 0;
+		dev->iops = 0;
+	}
+
+	dev->stall_ms = min(dev->stall_ms, dev->stall_interval_ms);
+
+	if (dev->use_lightnvm)
+		dev->zoned = false;
+	if (dev->zoned) {
+		dev->zone_size = roundup_pow_of_two(max(dev->zone_size, 1UL));
+		dev->size = max(round_down(dev->size, dev->zone_size),
+				dev->zone_size);
+		dev->zone_nr_conv = min_t(unsigned int, dev->zone_nr_conv,
+					  dev->size / dev->zone_size - 1);
+	}
 }
 
 static int null_add_dev(struct nullb_device *dev)
@@ -1859,7 +2339,7 @@ static int null_add_dev(struct nullb_device *dev)
 			goto out_cleanup_blk_queue;
 	}
 
-	if (dev->mbps) {
+	if (dev->mbps || dev->write_mbps || dev->iops) {
 		set_bit(NULLB_DEV_FL_THROTTLED, &dev->flags);
 		nullb_setup_bwtimer(nullb);
 	}
@@ -1884,6 +2364,16 @@ static int null_add_dev(struct nullb_device *dev)
 
 	null_config_discard(nullb);
 
+	if (dev->zoned) {
+		rv = null_zone_init(dev);
+		if (rv)
+			goto out_cleanup_blk_queue;
+		nullb->q->limits.zoned = BLK_ZONED_HM;
+		blk_queue_chunk_sectors(nullb->q, dev->zone_size_sects);
+		blk_queue_max_zone_append_sectors(nullb->q,
+						  dev->zone_size_sects);
+	}
+
 	sprintf(nullb->disk_name, "nullb%d", nullb->index);
 
 	if (dev->use_lightnvm)
@@ -3341,6 +3341,26 @@ static int find_watcher(struct rbd_device *rbd_dev,
 	return ret;
 }
 
+/*
+ * The lock owner may have up to CEPH_OSD_MAX_CONNS connections per osd,
+ * each from its own address: @addr is the main one, fence all of them.
+ */
+static int rbd_blacklist_owner(struct ceph_client *client,
+			       struct ceph_entity_addr *addr)
+{
+	int ret, i;
+
+	for (i = 0; i < CEPH_OSD_MAX_CONNS; i++) {
+		struct ceph_entity_addr sibling = *addr;
+
+		ceph_addr_sibling(&sibling, i);
+		ret = ceph_monc_blacklist_add(&client->monc, &sibling);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
 /*
  * lock_rwsem must be held for write
  */
@@ -3374,8 +3394,7 @@ static int rbd_try_lock(struct rbd_device *rbd_dev)
 		rbd_warn(rbd_dev, "%s%llu seems dead, breaking lock",
 			 ENTITY_NAME(lockers[0].id.name));
 
-		ret = ceph_monc_blacklist_add(&client->monc,
-					      &lockers[0].info.addr);
+		ret = rbd_blacklist_owner(client, &lockers[0].info.addr);
 		if (ret) {
 			rbd_warn(rbd_dev, "blacklist of %s%llu failed: %d",
 				 ENTITY_NAME(lockers[0].id.name), ret);
@@ -0,0 +1,697 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Userspace block device driver over shared rings
+ *
+ * The requests of each hardware queue are handed to a userspace daemon
+ * through rings in memory shared with it, see include/uapi/linux/ublk.h.
+ * The data is copied once, between the request pages and the buffer of its
+ * tag in the queue area.
+ *
+ * A device outlives its daemon: when the daemon goes away the queues are
+ * quiesced and the requests it had not completed are requeued, to be sent
+ * again to the next daemon attaching.  They are failed if none attaches
+ * within the recovery timeout of the device.
+ */
+
+#include <linux/module.h>
+#include <linux/blkdev.h>
+#include <linux/blk-mq.h>
+#include <linux/genhd.h>
+#include <linux/miscdevice.h>
+#include <linux/highmem.h>
+#include <linux/vmalloc.h>
+#include <linux/slab.h>
+#include <linux/idr.h>
+#include <linux/mm.h>
+#include <linux/fs.h>
+#include <uapi/linux/ublk.h>
+
+#define UBLK_MINORS		16
+#define UBLK_MAX_QUEUE_DEPTH	4096
+#define UBLK_MAX_IO_BYTES	(1U << 20)
+
+/* ublk_cmd->flags */
+enum {
+	UBLK_CMD_INFLIGHT	= 0,	/* in the SQ, not completed yet */
+};
+
+struct ublk_cmd {
+	unsigned long flags;
+};
+
+struct ublk_device;
+
+struct ublk_queue {
+	struct ublk_device *ub;
+	unsigned int qid;
+	void *area;			/* vmalloc_user(), mapped by the daemon */
+	struct ublk_ring *ring;
+	struct ublk_sqe *sqes;
+	struct ublk_cqe *cqes;
+	void *data;
+	u32 mask;
+
+	spinlock_t sq_lock;		/* serializes the submissions */
+	u32 sq_tail;
+	wait_queue_head_t sq_wait;
+
+	struct mutex cq_mutex;		/* serializes the reaping */
+	u32 cq_head;
+};
+
+struct ublk_device {
+	struct ublk_dev_info info;
+	struct blk_mq_tag_set tag_set;
+	struct request_queue *q;
+	struct gendisk *disk;
+	struct ublk_queue *queues;
+
+	/* all protected by ublk_ctl_mutex */
+	struct file *daemon;
+	bool quiesced;
+	bool started;
+	struct delayed_work recover_work;
+
+	/* no daemon came back, fail the requests */
+	bool dead;
+};
+
+static int ublk_major;
+static DEFINE_IDR(ublk_index_idr);
+static DEFINE_MUTEX(ublk_ctl_mutex);
+
+static void *ublk_tag_buf(struct ublk_queue *uq, unsigned int tag)
+{
+	return uq->data + (size_t)tag * uq->ub->info.max_io_bytes;
+}
+
+static void ublk_copy_rq(struct request *rq, void *buf, bool to_buf)
+{
+	struct req_iterator iter;
+	struct bio_vec bvec;
+
+	rq_for_each_segment(bvec, rq, iter) {
+		void *addr = kmap_atomic(bvec.bv_page);
+
+		if (to_buf) {
+			flush_dcache_page(bvec.bv_page);
+			memcpy(buf, addr + bvec.bv_offset, bvec.bv_len);
+		} else {
+			memcpy(addr + bvec.bv_offset, buf, bvec.bv_len);
+			flush_dcache_page(bvec.bv_page);
+		}
+		kunmap_atomic(addr);
+		buf += bvec.bv_len;
+	}
+}
+
+static blk_status_t ublk_queue_rq(struct blk_mq_hw_ctx *hctx,
+				  const struct blk_mq_queue_data *bd)
+{
+	struct ublk_queue *uq = hctx->driver_data;
+	struct request *rq = bd->rq;
+	struct ublk_cmd *cmd = blk_mq_rq_to_pdu(rq);
+	struct ublk_sqe *sqe;
+	bool has_data = false;
+	u8 op;
+
+	if (READ_ONCE(uq->ub->dead))
+		return BLK_STS_IOERR;
+
+	switch (req_op(rq)) {
+	case REQ_OP_READ:
+		op = UBLK_OP_READ;
+		has_data = true;
+		break;
+	case REQ_OP_WRITE:
+		op = UBLK_OP_WRITE;
+		has_data = true;
+		break;
+	case REQ_OP_FLUSH:
+		op = UBLK_OP_FLUSH;
+		break;
+	case REQ_OP_DISCARD:
+		op = UBLK_OP_DISCARD;
+		break;
+	case REQ_OP_WRITE_ZEROES:
+		op = UBLK_OP_WRITE_ZEROES;
+		break;
+	default:
+		return BLK_STS_NOTSUPP;
+	}
+
+	blk_mq_start_request(rq);
+
+	if (op == UBLK_OP_WRITE)
+		ublk_copy_rq(rq, ublk_tag_buf(uq, rq->tag), true);
+
+	spin_lock(&uq->sq_lock);
+	sqe = &uq->sqes[uq->sq_tail & uq->mask];
+	sqe->op = op;
+	sqe->tag = rq->tag;
+	sqe->flags = (rq->cmd_flags & REQ_FUA) ? UBLK_IO_F_FUA : 0;
+	sqe->sector = blk_rq_pos(rq);
+	sqe->nr_sectors = blk_rq_sectors(rq);
+	sqe->buf_offset = has_data ?
+		ublk_tag_buf(uq, rq->tag) - uq->area : 0;
+	set_bit(UBLK_CMD_INFLIGHT, &cmd->flags);
+	uq->sq_tail++;
+	/* the daemon sees the entry before the tail */
+	smp_store_release(&uq->ring->sq_tail, uq->sq_tail);
+	spin_unlock(&uq->sq_lock);
+
+	wake_up(&uq->sq_wait);
+	return BLK_STS_OK;
+}
+
+static void ublk_complete(struct ublk_queue *uq, unsigned int tag, int result)
+{
+	struct ublk_device *ub = uq->ub;
+	struct ublk_cmd *cmd;
+	struct request *rq;
+
+	/* the daemon is not trusted, ignore the bogus completions */
+	if (tag >= ub->info.queue_depth)
+		return;
+	rq = blk_mq_tag_to_rq(ub->tag_set.tags[uq->qid], tag);
+	if (!rq)
+		return;
+	cmd = blk_mq_rq_to_pdu(rq);
+	if (!test_and_clear_bit(UBLK_CMD_INFLIGHT, &cmd->flags))
+		return;
+
+	if (result > 0)
+		result = -EIO;
+	if (!result && req_op(rq) == REQ_OP_READ)
+		ublk_copy_rq(rq, ublk_tag_buf(uq, tag), false);
+	blk_mq_end_request(rq, errno_to_blk_status(result));
+}
+
+static int ublk_reap_cq(struct ublk_queue *uq)
+{
+	u32 head = uq->cq_head;
+	u32 tail = smp_load_acquire(&uq->ring->cq_tail);
+
+	if (tail - head > uq->mask + 1)
+		return -EINVAL;
+
+	while (head != tail) {
+		struct ublk_cqe *cqe = &uq->cqes[head & uq->mask];
+
+		ublk_complete(uq, READ_ONCE(cqe->tag), READ_ONCE(cqe->result));
+		head++;
+	}
+	uq->cq_head = head;
+	smp_store_release(&uq->ring->cq_head, head);
+	return 0;
+}
+
+static u32 ublk_sq_pending(struct ublk_queue *uq)
+{
+	u32 pending = READ_ONCE(uq->sq_tail) - READ_ONCE(uq->ring->sq_head);
+
+	return min(pending, uq->mask + 1);
+}
+
+static long ublk_enter(struct ublk_device *ub, unsigned long qid)
+{
+	struct ublk_queue *uq;
+	u32 pending;
+	int ret;
+
+	if (qid >= ub->info.nr_hw_queues)
+		return -EINVAL;
+	uq = &ub->queues[qid];
+
+	mutex_lock(&uq->cq_mutex);
+	ret = ublk_reap_cq(uq);
+	mutex_unlock(&uq->cq_mutex);
+	if (ret)
+		return ret;
+
+	ret = wait_event_interruptible(uq->sq_wait,
+				       (pending = ublk_sq_pending(uq)) != 0);
+	if (ret)
+		return ret;
+	return pending;
+}
+
+static void ublk_requeue_inflight(struct request *rq, void *data,
+				  bool reserved)
+{
+	struct ublk_cmd *cmd = blk_mq_rq_to_pdu(rq);
+
+	if (test_and_clear_bit(UBLK_CMD_INFLIGHT, &cmd->flags))
+		blk_mq_requeue_request(rq, false);
+}
+
+static void ublk_reset_queue(struct ublk_queue *uq)
+{
+	struct ublk_ring *ring = uq->ring;
+
+	uq->sq_tail = 0;
+	uq->cq_head = 0;
+	ring->sq_head = 0;
+	ring->sq_tail = 0;
+	ring->cq_head = 0;
+	ring->cq_tail = 0;
+}
+
+static void ublk_unquiesce(struct ublk_device *ub)
+{
+	if (!ub->quiesced)
+		return;
+	ub->quiesced = false;
+	blk_mq_unquiesce_queue(ub->q);
+	blk_mq_kick_requeue_list(ub->q);
+}
+
+static void ublk_recover_work(struct work_struct *work)
+{
+	struct ublk_device *ub = container_of(to_delayed_work(work),
+					      struct ublk_device, recover_work);
+
+	mutex_lock(&ublk_ctl_mutex);
+	if (!ub->daemon) {
+		pr_warn("%s: no daemon, failing the requests\n",
+			ub->disk->disk_name);
+		WRITE_ONCE(ub->dead, true);
+		ublk_unquiesce(ub);
+	}
+	mutex_unlock(&ublk_ctl_mutex);
+}
+
+static int ublk_attach(struct ublk_device *ub, struct file *filp)
+{
+	unsigned int i;
+
+	lockdep_assert_held(&ublk_ctl_mutex);
+
+	if (ub->daemon)
+		return -EBUSY;
+
+	/* the work checks ub->daemon, no need to wait for it */
+	cancel_delayed_work(&ub->recover_work);
+
+	/* quiesced or dead: no request is in the rings */
+	for (i = 0; i < ub->info.nr_hw_queues; i++)
+		ublk_reset_queue(&ub->queues[i]);
+
+	ub->daemon = filp;
+	filp->private_data = ub;
+	WRITE_ONCE(ub->dead, false);
+	ublk_unquiesce(ub);
+	return 0;
+}
+
+static void ublk_detach(struct ublk_device *ub)
+{
+	lockdep_assert_held(&ublk_ctl_mutex);
+
+	blk_mq_quiesce_queue(ub->q);
+	ub->quiesced = true;
+	blk_mq_tagset_busy_iter(&ub->tag_set, ublk_requeue_inflight, ub);
+	ub->daemon = NULL;
+
+	if (ub->info.recovery_timeout)
+		schedule_delayed_work(&ub->recover_work,
+				      ub->info.recovery_timeout * HZ);
+}
+
+static int ublk_init_hctx(struct blk_mq_hw_ctx *hctx, void *data,
+			  unsigned int hctx_idx)
+{
+	struct ublk_device *ub = data;
+
+	hctx->driver_data = &ub->queues[hctx_idx];
+	return 0;
+}
+
+static enum blk_eh_timer_return ublk_timeout(struct request *rq,
+					     bool reserved)
+{
+	/* the daemon may be slow or gone, the recovery takes care of it */
+	return BLK_EH_RESET_TIMER;
+}
+
+static const struct blk_mq_ops ublk_mq_ops = {
+	.queue_rq	= ublk_queue_rq,
+	.init_hctx	= ublk_init_hctx,
+	.timeout	= ublk_timeout,
+};
+
+static const struct block_device_operations ublk_fops = {
+	.owner		= THIS_MODULE,
+};
+
+static int ublk_validate_info(struct ublk_dev_info *info)
+{
+	u64 map_size;
+	u32 entries;
+
+	if (!info->nr_hw_queues || info->nr_hw_queues > nr_cpu_ids ||
+	    !info->queue_depth || info->queue_depth > UBLK_MAX_QUEUE_DEPTH)
+		return -EINVAL;
+	if (info->block_size < 512 || info->block_size > PAGE_SIZE ||
+	    !is_power_of_2(info->block_size))
+		return -EINVAL;
+	if (!info->max_io_bytes || info->max_io_bytes > UBLK_MAX_IO_BYTES ||
+	    !PAGE_ALIGNED(info->max_io_bytes))
+		return -EINVAL;
+	if (!info->dev_sectors)
+		return -EINVAL;
+
+	entries = roundup_pow_of_two(info->queue_depth);
+	info->sq_offset = sizeof(struct ublk_ring);
+	info->cq_offset = info->sq_offset + entries * sizeof(struct ublk_sqe);
+	info->data_offset = PAGE_ALIGN(info->cq_offset +
+				       entries * sizeof(struct ublk_cqe));
+	map_size = info->data_offset +
+		(u64)info->queue_depth * info->max_io_bytes;
+	if (map_size > 1ULL << UBLK_QUEUE_OFFSET_SHIFT)
+		return -EINVAL;
+	info->queue_map_size = map_size;
+	return 0;
+}
+
+static int ublk_init_queues(struct ublk_device *ub)
+{
+	struct ublk_dev_info *info = &ub->info;
+	unsigned int i;
+
+	ub->queues = kcalloc(info->nr_hw_queues, sizeof(*ub->queues),
+			     GFP_KERNEL);
+	if (!ub->queues)
+		return -ENOMEM;
+
+	for (i = 0; i < info->nr_hw_queues; i++) {
+		struct ublk_queue *uq = &ub->queues[i];
+
+		uq->area = vmalloc_user(info->queue_map_size);
+		if (!uq->area)
+			return -ENOMEM;
+		uq->ub = ub;
+		uq->qid = i;
+		uq->ring = uq->area;
+		uq->sqes = uq->area + info->sq_offset;
+		uq->cqes = uq->area + info->cq_offset;
+		uq->data = uq->area + info->data_offset;
+		uq->mask = roundup_pow_of_two(info->queue_depth) - 1;
+		uq->ring->ring_entries = uq->mask + 1;
+		spin_lock_init(&uq->sq_lock);
+		init_waitqueue_head(&uq->sq_wait);
+		mutex_init(&uq->cq_mutex);
+	}
+	return 0;
+}
+
+static void ublk_free_queues(struct ublk_device *ub)
+{
+	unsigned int i;
+
+	if (!ub->queues)
+		return;
+	for (i = 0; i < ub->info.nr_hw_queues; i++)
+		vfree(ub->queues[i].area);
+	kfree(ub->queues);
+}
+
+static void ublk_config_queue(struct ublk_device *ub)
+{
+	struct request_queue *q = ub->q;
+	u64 flags = ub->info.flags;
+
+	blk_queue_logical_block_size(q, ub->info.block_size);
+	blk_queue_physical_block_size(q, ub->info.block_size);
+	blk_queue_io_min(q, ub->info.block_size);
+	blk_queue_max_hw_sectors(q, ub->info.max_io_bytes >> 9);
+	blk_queue_max_segments(q, USHRT_MAX);
+	blk_queue_max_segment_size(q, UINT_MAX);
+
+	if (flags & UBLK_F_DISCARD) {
+		q->limits.discard_granularity = ub->info.block_size;
+		blk_queue_max_discard_sectors(q, UINT_MAX >> 9);
+		blk_queue_max_write_zeroes_sectors(q, UINT_MAX >> 9);
+		queue_flag_set_unlocked(QUEUE_FLAG_DISCARD, q);
+	}
+	if (flags & UBLK_F_WRITE_CACHE)
+		blk_queue_write_cache(q, true, true);
+
+	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, q);
+	queue_flag_clear_unlocked(QUEUE_FLAG_ADD_RANDOM, q);
+}
+
+static void ublk_free_dev(struct ublk_device *ub)
+{
+	if (ub->q)
+		blk_cleanup_queue(ub->q);
+	if (ub->tag_set.tags)
+		blk_mq_free_tag_set(&ub->tag_set);
+	if (ub->disk)
+		put_disk(ub->disk);
+	ublk_free_queues(ub);
+	kfree(ub);
+}
+
+static int ublk_add_dev(struct ublk_dev_info __user *argp)
+{
+	struct ublk_device *ub;
+	struct gendisk *disk;
+	int id, ret;
+
+	ub = kzalloc(sizeof(*ub), GFP_KERNEL);
+	if (!ub)
+		return -ENOMEM;
+	INIT_DELAYED_WORK(&ub->recover_work, ublk_recover_work);
+
+	ret = -EFAULT;
+	if (copy_from_user(&ub->info, argp, sizeof(ub->info)))
+		goto out_free;
+	ret = ublk_validate_info(&ub->info);
+	if (ret)
+		goto out_free;
+
+	ret = ublk_init_queues(ub);
+	if (ret)
+		goto out_free;
+
+	ub->tag_set.ops = &ublk_mq_ops;
+	ub->tag_set.nr_hw_queues = ub->info.nr_hw_queues;
+	ub->tag_set.queue_depth = ub->info.queue_depth;
+	ub->tag_set.numa_node = NUMA_NO_NODE;
+	ub->tag_set.cmd_size = sizeof(struct ublk_cmd);
+	ub->tag_set.flags = BLK_MQ_F_SHOULD_MERGE;
+	ub->tag_set.driver_data = ub;
+	ret = blk_mq_alloc_tag_set(&ub->tag_set);
+	if (ret) {
+		ub->tag_set.tags = NULL;
+		goto out_free;
+	}
+
+	ub->q = blk_mq_init_queue(&ub->tag_set);
+	if (IS_ERR(ub->q)) {
+		ret = PTR_ERR(ub->q);
+		ub->q = NULL;
+		goto out_free;
+	}
+	ub->q->queuedata = ub;
+	ublk_config_queue(ub);
+
+	/* nothing is dispatched until a daemon attaches */
+	blk_mq_quiesce_queue(ub->q);
+	ub->quiesced = true;
+
+	ret = -ENOMEM;
+	disk = alloc_disk(UBLK_MINORS);
+	if (!disk)
+		goto out_free;
+	ub->disk = disk;
+
+	mutex_lock(&ublk_ctl_mutex);
+	if (ub->info.dev_id == UBLK_DEV_ID_ANY)
+		id = idr_alloc(&ublk_index_idr, ub, 0,
+			       (1 << MINORBITS) / UBLK_MINORS, GFP_KERNEL);
+	else
+		id = idr_alloc(&ublk_index_idr, ub, ub->info.dev_id,
+			       ub->info.dev_id + 1, GFP_KERNEL);
+	mutex_unlock(&ublk_ctl_mutex);
+	if (id < 0) {
+		ret = id == -ENOSPC ? -EEXIST : id;
+		goto out_free;
+	}
+	ub->info.dev_id = id;
+
+	disk->major = ublk_major;
+	disk->first_minor = id * UBLK_MINORS;
+	disk->fops = &ublk_fops;
+	disk->private_data = ub;
+	disk->queue = ub->q;
+	sprintf(disk->disk_name, "ublkb%d", id);
+	set_capacity(disk, ub->info.dev_sectors);
+	set_disk_ro(disk, !!(ub->info.flags & UBLK_F_READ_ONLY));
+
+	if (copy_to_user(argp, &ub->info, sizeof(ub->info))) {
+		mutex_lock(&ublk_ctl_mutex);
+		idr_remove(&ublk_index_idr, id);
+		mutex_unlock(&ublk_ctl_mutex);
+		ret = -EFAULT;
+		goto out_free;
+	}
+	return 0;
+
+out_free:
+	if (ub->q)
+		blk_mq_unquiesce_queue(ub->q);
+	ublk_free_dev(ub);
+	return ret;
+}
+
+static int ublk_del_dev(unsigned long id)
+{
+	struct ublk_device *ub;
+
+	mutex_lock(&ublk_ctl_mutex);
+	ub = idr_find(&ublk_index_idr, id);
+	if (!ub || ub->daemon) {
+		mutex_unlock(&ublk_ctl_mutex);
+		return ub ? -EBUSY : -ENODEV;
+	}
+	idr_remove(&ublk_index_idr, id);
+	mutex_unlock(&ublk_ctl_mutex);
+
+	/* may take ublk_ctl_mutex, it can't find the device anymore */
+	cancel_delayed_work_sync(&ub->recover_work);
+
+	/* fail the requeued requests, del_gendisk() waits for them */
+	mutex_lock(&ublk_ctl_mutex);
+	WRITE_ONCE(ub->dead, true);
+	ublk_unquiesce(ub);
+	mutex_unlock(&ublk_ctl_mutex);
+
+	if (ub->started)
+		del_gendisk(ub->disk);
+	ublk_free_dev(ub);
+	return 0;
+}
+
+static long ublk_ctl_ioctl(struct file *filp, unsigned int cmd,
+			   unsigned long arg)
+{
+	struct ublk_device *ub = filp->private_data;
+	int ret;
+
+	switch (cmd) {
+	case UBLK_IOC_ADD_DEV:
+		if (!capable(CAP_SYS_ADMIN))
+			return -EPERM;
+		return ublk_add_dev((struct ublk_dev_info __user *)arg);
+	case UBLK_IOC_DEL_DEV:
+		if (!capable(CAP_SYS_ADMIN))
+			return -EPERM;
+		return ublk_del_dev(arg);
+	case UBLK_IOC_ATTACH:
+		if (!capable(CAP_SYS_ADMIN))
+			return -EPERM;
+		mutex_lock(&ublk_ctl_mutex);
+		if (filp->private_data) {
+			ret = -EBUSY;
+		} else {
+			ub = idr_find(&ublk_index_idr, arg);
+			ret = ub ? ublk_attach(ub, filp) : -ENODEV;
+		}
+		mutex_unlock(&ublk_ctl_mutex);
+		return ret;
+	case UBLK_IOC_START:
+		if (!ub)
+			return -ENXIO;
+		mutex_lock(&ublk_ctl_mutex);
+		ret = ub->started ? -EBUSY : 0;
+		ub->started = true;
+		mutex_unlock(&ublk_ctl_mutex);
+		/* reads the partitions, the queues must be served meanwhile */
+		if (!ret)
+			add_disk(ub->disk);
+		return ret;
+	case UBLK_IOC_ENTER:
+		if (!ub)
+			return -ENXIO;
+		return ublk_enter(ub, arg);
+	}
+	return -ENOTTY;
+}
+
+static int ublk_ctl_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	struct ublk_device *ub = filp->private_data;
+	unsigned long shift = UBLK_QUEUE_OFFSET_SHIFT - PAGE_SHIFT;
+	unsigned long qid = vma->vm_pgoff >> shift;
+
+	if (!ub)
+		return -ENXIO;
+	if (qid >= ub->info.nr_hw_queues)
+		return -EINVAL;
+
+	return remap_vmalloc_range(vma, ub->queues[qid].area,
+				   vma->vm_pgoff & ((1UL << shift) - 1));
+}
+
+static int ublk_ctl_release(struct inode *inode, struct file *filp)
+{
+	struct ublk_device *ub = filp->private_data;
+
+	if (ub) {
+		mutex_lock(&ublk_ctl_mutex);
+		ublk_detach(ub);
+		mutex_unlock(&ublk_ctl_mutex);
+	}
+	return 0;
+}
+
+static const struct file_operations ublk_ctl_fops = {
+	.owner		= THIS_MODULE,
+	.open		= nonseekable_open,
+	.release	= ublk_ctl_release,
+	.unlocked_ioctl	= ublk_ctl_ioctl,
+	.compat_ioctl	= ublk_ctl_ioctl,
+	.mmap		= ublk_ctl_mmap,
+	.llseek		= noop_llseek,
+};
+
+static struct miscdevice ublk_misc = {
+	.minor		= MISC_DYNAMIC_MINOR,
+	.name		= "ublk-control",
+	.fops		= &ublk_ctl_fops,
+};
+
+static int __init ublk_init(void)
+{
+	int ret;
+
+	ublk_major = register_blkdev(0, "ublk");
+	if (ublk_major < 0)
+		return ublk_major;
+
+	ret = misc_register(&ublk_misc);
+	if (ret)
+		unregister_blkdev(ublk_major, "ublk");
+	return ret;
+}
+
+static void __exit ublk_exit(void)
+{
+	struct ublk_device *ub;
+	int id;
+
+	misc_deregister(&ublk_misc);
+
+	/* no daemon is attached, the module is held by their files */
+	idr_for_each_entry(&ublk_index_idr, ub, id)
+		ublk_del_dev(id);
+	idr_destroy(&ublk_index_idr);
+	unregister_blkdev(ublk_major, "ublk");
+}
+
+module_init(ublk_init);
+module_exit(ublk_exit);
+MODULE_DESCRIPTION("Userspace block device driver over shared rings");
+MODULE_LICENSE("GPL");
@@ -22,6 +22,10 @@
 static int major;
 static DEFINE_IDA(vd_index_ida);
 
+static unsigned int poll_queues;
+module_param(poll_queues, uint, 0644);
+MODULE_PARM_DESC(poll_queues, "Number of dedicated virtqueues for polled I/O");
+
 static struct workqueue_struct *virtblk_wq;
 
 struct virtio_blk_vq {
@@ -50,6 +54,8 @@ struct virtio_blk {
 
 	/* num of vqs */
 	int num_vqs;
+	/* vqs available to each queue map, the poll ones come last */
+	unsigned int io_queues[HCTX_MAX_TYPES];
 	struct virtio_blk_vq *vqs;
 };
 
@@ -186,9 +192,36 @@ static inline void virtblk_request_done(struct request *req)
 	blk_mq_end_request(req, virtblk_result(vbr));
 }
 
+static void virtblk_complete_batch(struct io_comp_batch *iob)
+{
+	struct request *req;
+
+	list_for_each_entry(req, &iob->req_list, queuelist) {
+		switch (req_op(req)) {
+		case REQ_OP_SCSI_IN:
+		case REQ_OP_SCSI_OUT:
+			virtblk_scsi_request_done(req);
+			break;
+		}
+	}
+
+	blk_mq_end_request_batch(iob);
+}
+
+static void virtblk_complete_req(struct virtblk_req *vbr,
+				 struct io_comp_batch *iob)
+{
+	struct request *req = blk_mq_rq_from_pdu(vbr);
+
+	if (!blk_mq_add_to_batch(req, iob, virtblk_result(vbr),
+				 virtblk_complete_batch))
+		blk_mq_complete_request(req);
+}
+
 static void virtblk_done(struct virtqueue *vq)
 {
 	struct virtio_blk *vblk = vq->vdev->priv;
+	DEFINE_IO_COMP_BATCH(iob);
 	bool req_done = false;
 	int qid = vq->index;
 	struct virtblk_req *vbr;
@@ -199,9 +232,7 @@ static void virtblk_done(struct virtqueue *vq)
 	do {
 		virtqueue_disable_cb(vq);
 		while ((vbr = virtqueue_get_buf(vblk->vqs[qid].vq, &len)) != NULL) {
-			struct request *req = blk_mq_rq_from_pdu(vbr);
-
-			blk_mq_complete_request(req);
+			virtblk_complete_req(vbr, &iob);
 			req_done = true;
 		}
 		if (unlikely(virtqueue_is_broken(vq)))
@@ -212,6 +243,10 @@ static void virtblk_done(struct virtqueue *vq)
 	if (req_done)
 		blk_mq_start_stopped_hw_queues(vblk->disk->queue, true);
 	spin_unlock_irqrestore(&vblk->vqs[qid].lock, flags);
+
+	/* end the requests outside of the lock, their end_io may submit */
+	if (iob.complete)
+		iob.complete(&iob);
 }
 
 static blk_status_t virtio_queue_rq(struct blk_mq_hw_ctx *hctx,
@@ -428,6 +463,7 @@ static int init_vq(struct virtio_blk *vblk)
 	const char **names;
 	struct virtqueue **vqs;
 	unsigned short num_vqs;
+	unsigned int num_poll_vqs;
 	struct virtio_device *vdev = vblk->vdev;
 	struct irq_affinity desc = { 0, };
 
@@ -437,6 +473,17 @@ static int init_vq(struct virtio_blk *vblk)
 	if (err)
 		num_vqs = 1;
 
+	/*
+	 * blk-mq uses at most one hardware queue per CPU, the poll queues
+	 * included.  Keep at least one interrupt driven queue.
+	 */
+	num_vqs = min_t(unsigned int, num_vqs, nr_cpu_ids);
+	num_poll_vqs = min_t(unsigned int, poll_queues, num_vqs - 1);
+
+	vblk->io_queues[HCTX_TYPE_DEFAULT] = num_vqs - num_poll_vqs;
+	vblk->io_queues[HCTX_TYPE_READ] = 0;
+	vblk->io_queues[HCTX_TYPE_POLL] = num_poll_vqs;
+
 	vblk->vqs = kmalloc_array(num_vqs, sizeof(*vblk->vqs), GFP_KERNEL);
 	if (!vblk->vqs)
 		return -ENOMEM;
@@ -449,12 +496,19 @@ static int init_vq(struct virtio_blk *vblk)
 		goto out;
 	}
 
-	for (i = 0; i < num_vqs; i++) {
+	for (i = 0; i < num_vqs - num_poll_vqs; i++) {
 		callbacks[i] = virtblk_done;
 		snprintf(vblk->vqs[i].name, VQ_NAME_LEN, "req.%d", i);
 		names[i] = vblk->vqs[i].name;
 	}
 
+	/* no callback, hence no interrupt: these are only ever polled */
+	for (; i < num_vqs; i++) {
+		callbacks[i] = NULL;
+		snprintf(vblk->vqs[i].name, VQ_NAME_LEN, "req_poll.%d", i);
+		names[i] = vblk->vqs[i].name;
+	}
+
 	/* Discover virtqueues and write information to configuration.  */
 	err = virtio_find_vqs(vdev, num_vqs, vqs, callbacks, names, &desc);
 	if (err)
@@ -589,8 +643,61 @@ static int virtblk_init_request(struct blk_mq_tag_set *set, struct request *rq,
 static int virtblk_map_queues(struct blk_mq_tag_set *set)
 {
 	struct virtio_blk *vblk = set->driver_data;
+	int i, qoff, ret;
+
+	for (i = 0, qoff = 0; i < set->nr_maps; i++) {
+		struct blk_mq_queue_map *map = &set->map[i];
+
+		map->nr_queues = vblk->io_queues[i];
+		map->queue_offset = qoff;
+		qoff += map->nr_queues;
+
+		if (map->nr_queues == 0)
+			continue;
+
+		/*
+		 * The poll queues have no interrupt, and thus no affinity:
+		 * spread them evenly over the CPUs.
+		 */
+		if (i == HCTX_TYPE_POLL)
+			ret = blk_mq_map_queues(map);
+		else
+			ret = blk_mq_virtio_map_queues(map, vblk->vdev, 0);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+static int virtblk_poll(struct blk_mq_hw_ctx *hctx, unsigned int tag)
+{
+	struct virtio_blk *vblk = hctx->queue->queuedata;
+	struct virtio_blk_vq *vq = &vblk->vqs[hctx->queue_num];
+	DEFINE_IO_COMP_BATCH(iob);
+	struct virtblk_req *vbr;
+	unsigned long flags;
+	unsigned int len;
+	bool req_done = false;
+	int found = 0;
+
+	spin_lock_irqsave(&vq->lock, flags);
+	while ((vbr = virtqueue_get_buf(vq->vq, &len)) != NULL) {
+		if (blk_mq_rq_from_pdu(vbr)->tag == tag)
+			found = 1;
+		virtblk_complete_req(vbr, &iob);
+		req_done = true;
+	}
+
+	/* In case queue is stopped waiting for more buffers. */
+	if (req_done)
+		blk_mq_start_stopped_hw_queues(vblk->disk->queue, true);
+	spin_unlock_irqrestore(&vq->lock, flags);
+
+	if (iob.complete)
+		iob.complete(&iob);
 
-	return blk_mq_virtio_map_queues(set, vblk->vdev, 0);
+	return found;
 }
 
 #ifdef CONFIG_VIRTIO_BLK_SCSI
@@ -610,6 +717,7 @@ static const struct blk_mq_ops virtio_mq_ops = {
 	.initialize_rq_fn = virtblk_initialize_rq,
 #endif
 	.map_queues	= virtblk_map_queues,
+	.poll		= virtblk_poll,
 };
 
 static unsigned int virtblk_queue_depth;
@@ -689,6 +797,9 @@ static int virtblk_probe(struct virtio_device *vdev)
 		sizeof(struct scatterlist) * sg_elems;
 	vblk->tag_set.driver_data = vblk;
 	vblk->tag_set.nr_hw_queues = vblk->num_vqs;
+	vblk->tag_set.nr_maps = 1;
+	if (vblk->io_queues[HCTX_TYPE_POLL])
+		vblk->tag_set.nr_maps = HCTX_MAX_TYPES;
 
 	err = blk_mq_alloc_tag_set(&vblk->tag_set);
 	if (err)
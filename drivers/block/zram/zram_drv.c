@@ -46,6 +46,8 @@ static const char *default_compressor = "lzo";
 static unsigned int num_devices = 1;
 
 static void zram_free_page(struct zram *zram, size_t index);
+static int zram_read_from_zspool(struct zram *zram, struct page *page,
+				 u32 index);
 
 static inline bool init_done(struct zram *zram)
 {
@@ -67,6 +69,16 @@ static void zram_set_handle(struct zram *zram, u32 index, unsigned long handle)
 	zram->table[index].handle = handle;
 }
 
+static void zram_slot_lock(struct zram *zram, u32 index)
+{
+	bit_spin_lock(ZRAM_ACCESS, &zram->table[index].value);
+}
+
+static void zram_slot_unlock(struct zram *zram, u32 index)
+{
+	bit_spin_unlock(ZRAM_ACCESS, &zram->table[index].value);
+}
+
 /* flag operations require table entry bit_spin_lock() being held */
 static int zram_test_flag(struct zram *zram, u32 index,
 			enum zram_pageflags flag)
@@ -110,6 +122,63 @@ static void zram_set_obj_size(struct zram *zram,
 	zram->table[index].value = (flags << ZRAM_FLAG_SHIFT) | size;
 }
 
+static bool zram_allocated(struct zram *zram, u32 index)
+{
+	return zram_get_handle(zram, index) ||
+		zram_test_flag(zram, index, ZRAM_SAME) ||
+		zram_test_flag(zram, index, ZRAM_WB);
+}
+
+/* update the per algorithm stats for the object of @index, by @sign */
+static void zram_account_obj(struct zram *zram, u32 index, int sign)
+{
+	int prio = ZRAM_PRIMARY_COMP;
+
+	if (zram_test_flag(zram, index, ZRAM_HUGE)) {
+		atomic64_add(sign, &zram->stats.huge_pages);
+		return;
+	}
+
+	if (zram_test_flag(zram, index, ZRAM_RECOMP))
+		prio = ZRAM_SECONDARY_COMP;
+	atomic64_add(sign, &zram->stats.comp_pages[prio]);
+	atomic64_add(sign * (s64)zram_get_obj_size(zram, index),
+		     &zram->stats.comp_size[prio]);
+}
+
+/* types of pages selected by writeback and recompress */
+#define ZRAM_PAGE_IDLE	BIT(0)
+#define ZRAM_PAGE_HUGE	BIT(1)
+
+static int zram_parse_page_type(const char *type)
+{
+	if (sysfs_streq(type, "idle"))
+		return ZRAM_PAGE_IDLE;
+	if (sysfs_streq(type, "huge"))
+		return ZRAM_PAGE_HUGE;
+	if (sysfs_streq(type, "huge_idle"))
+		return ZRAM_PAGE_IDLE | ZRAM_PAGE_HUGE;
+	return -EINVAL;
+}
+
+/*
+ * Whether the page of @index is in the zspool and of @type, with the slot
+ * lock held.
+ */
+static bool zram_page_match(struct zram *zram, u32 index, int type)
+{
+	if (!zram_get_handle(zram, index) ||
+	    zram_test_flag(zram, index, ZRAM_SAME) ||
+	    zram_test_flag(zram, index, ZRAM_WB) ||
+	    zram_test_flag(zram, index, ZRAM_UNDER_WB))
+		return false;
+	if ((type & ZRAM_PAGE_IDLE) && !zram_test_flag(zram, index, ZRAM_IDLE))
+		return false;
+	if ((type & ZRAM_PAGE_HUGE) && !zram_test_flag(zram, index, ZRAM_HUGE))
+		return false;
+	return true;
+}
+
 #if PAGE_SIZE != 4096
 static inline bool is_partial_io(struct bio_vec *bvec)
 {
@@ -261,6 +330,41 @@ static ssize_t mem_used_max_store(struct device *dev,
 	return len;
 }
 
+/*
+ * Writing "all" marks every stored page idle, an access to the page clears
+ * the mark again.  writeback and recompress can then select the pages which
+ * were not accessed since.
+ */
+static ssize_t idle_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	unsigned long nr_pages, index;
+
+	if (!sysfs_streq(buf, "all"))
+		return -EINVAL;
+
+	down_read(&zram->init_lock);
+	if (!init_done(zram)) {
+		up_read(&zram->init_lock);
+		return -EINVAL;
+	}
+
+	nr_pages = zram->disksize >> PAGE_SHIFT;
+	for (index = 0; index < nr_pages; index++) {
+		zram_slot_lock(zram, index);
+		if (zram_allocated(zram, index) &&
+		    !zram_test_flag(zram, index, ZRAM_WB) &&
+		    !zram_test_flag(zram, index, ZRAM_SAME))
+			zram_set_flag(zram, index, ZRAM_IDLE);
+		zram_slot_unlock(zram, index);
+		cond_resched();
+	}
+	up_read(&zram->init_lock);
+
+	return len;
+}
+
 #ifdef CONFIG_ZRAM_WRITEBACK
 static bool zram_wb_enabled(struct zram *zram)
 {
@@ -422,6 +526,7 @@ static unsigned long get_entry_bdev(struct zram *zram)
 
 	set_bit(entry, zram->bitmap);
 	spin_unlock(&zram->bitmap_lock);
+	atomic64_inc(&zram->stats.bd_count);
 
 	return entry;
 }
@@ -434,6 +539,7 @@ static void put_entry_bdev(struct zram *zram, unsigned long entry)
 	was_set = test_and_clear_bit(entry, zram->bitmap);
 	spin_unlock(&zram->bitmap_lock);
 	WARN_ON_ONCE(!was_set);
+	atomic64_dec(&zram->stats.bd_count);
 }
 
 void zram_page_end_io(struct bio *bio)
@@ -473,6 +579,7 @@ static int read_from_bdev_async(struct zram *zram, struct bio_vec *bvec,
 	}
 
 	submit_bio(bio);
+	atomic64_inc(&zram->stats.bd_reads);
 	return 1;
 }
 
@@ -569,6 +676,7 @@ static int write_to_bdev(struct zram *zram, struct bio_vec *bvec,
 	}
 
 	submit_bio(bio);
+	atomic64_inc(&zram->stats.bd_writes);
 	*pentry = entry;
 
 	return 0;
@@ -584,6 +692,202 @@ static void zram_wb_clear(struct zram *zram, u32 index)
 	put_entry_bdev(zram, entry);
 }
 
+/* pages written back at once by writeback_store() */
+#define ZRAM_WB_BATCH	32
+
+struct zram_wb_ctl;
+
+struct zram_wb_req {
+	struct zram_wb_ctl *ctl;
+	struct page *page;
+	u32 index;
+	unsigned long entry;
+	blk_status_t status;
+};
+
+struct zram_wb_ctl {
+	struct zram_wb_req reqs[ZRAM_WB_BATCH];
+	int nr;
+	atomic_t pending;
+	struct completion done;
+};
+
+static void zram_wb_end_io(struct bio *bio)
+{
+	struct zram_wb_req *req = bio->bi_private;
+	struct zram_wb_ctl *ctl = req->ctl;
+
+	req->status = bio->bi_status;
+	bio_put(bio);
+	if (atomic_dec_and_test(&ctl->pending))
+		complete(&ctl->done);
+}
+
+/*
+ * Submit the batch under a single plug, wait for it and move the pages
+ * which were not written to meanwhile to the backing device.
+ */
+static int zram_wb_flush(struct zram *zram, struct zram_wb_ctl *ctl)
+{
+	struct blk_plug plug;
+	int i, ret = 0;
+
+	if (!ctl->nr)
+		return 0;
+
+	reinit_completion(&ctl->done);
+	atomic_set(&ctl->pending, 1);
+	blk_start_plug(&plug);
+	for (i = 0; i < ctl->nr; i++) {
+		struct zram_wb_req *req = &ctl->reqs[i];
+		struct bio *bio = bio_alloc(GFP_NOIO, 1);
+
+		bio->bi_iter.bi_sector = req->entry * (PAGE_SIZE >> 9);
+		bio_set_dev(bio, zram->bdev);
+		bio_add_page(bio, req->page, PAGE_SIZE, 0);
+		bio->bi_opf = REQ_OP_WRITE | REQ_SYNC;
+		bio->bi_end_io = zram_wb_end_io;
+		bio->bi_private = req;
+		atomic_inc(&ctl->pending);
+		submit_bio(bio);
+	}
+	blk_finish_plug(&plug);
+	if (!atomic_dec_and_test(&ctl->pending))
+		wait_for_completion(&ctl->done);
+
+	for (i = 0; i < ctl->nr; i++) {
+		struct zram_wb_req *req = &ctl->reqs[i];
+
+		atomic64_inc(&zram->stats.bd_writes);
+		zram_slot_lock(zram, req->index);
+		/* freed or rewritten while under writeback */
+		if (req->status ||
+		    !zram_test_flag(zram, req->index, ZRAM_UNDER_WB)) {
+			zram_clear_flag(zram, req->index, ZRAM_UNDER_WB);
+			zram_slot_unlock(zram, req->index);
+			put_entry_bdev(zram, req->entry);
+			if (req->status)
+				ret = blk_status_to_errno(req->status);
+			continue;
+		}
+
+		zram_free_page(zram, req->index);
+		zram_set_flag(zram, req->index, ZRAM_WB);
+		zram_set_element(zram, req->index, req->entry);
+		zram_slot_unlock(zram, req->index);
+		atomic64_inc(&zram->stats.pages_stored);
+	}
+	ctl->nr = 0;
+
+	return ret;
+}
+
+/*
+ * Write the idle and/or huge pages of the zspool to the backing device, as
+ * selected by "idle", "huge" or "huge_idle".
+ */
+static ssize_t writeback_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	unsigned long nr_pages, index;
+	struct zram_wb_ctl *ctl;
+	int type, i, err, ret = 0;
+
+	type = zram_parse_page_type(buf);
+	if (type < 0)
+		return type;
+
+	ctl = kzalloc(sizeof(*ctl), GFP_KERNEL);
+	if (!ctl)
+		return -ENOMEM;
+	init_completion(&ctl->done);
+	for (i = 0; i < ZRAM_WB_BATCH; i++) {
+		ctl->reqs[i].ctl = ctl;
+		ctl->reqs[i].page = alloc_page(GFP_KERNEL);
+		if (!ctl->reqs[i].page) {
+			ret = -ENOMEM;
+			goto out_free;
+		}
+	}
+
+	down_read(&zram->init_lock);
+	if (!init_done(zram)) {
+		ret = -EINVAL;
+		goto out_unlock;
+	}
+
+	if (!zram_wb_enabled(zram)) {
+		ret = -ENODEV;
+		goto out_unlock;
+	}
+
+	nr_pages = zram->disksize >> PAGE_SHIFT;
+	for (index = 0; index < nr_pages; index++) {
+		struct zram_wb_req *req = &ctl->reqs[ctl->nr];
+
+		zram_slot_lock(zram, index);
+		if (!zram_page_match(zram, index, type)) {
+			zram_slot_unlock(zram, index);
+			continue;
+		}
+
+		err = zram_read_from_zspool(zram, req->page, index);
+		if (!err)
+			zram_set_flag(zram, index, ZRAM_UNDER_WB);
+		zram_slot_unlock(zram, index);
+		if (err)
+			continue;
+
+		req->entry = get_entry_bdev(zram);
+		if (!req->entry) {
+			zram_slot_lock(zram, index);
+			zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+			zram_slot_unlock(zram, index);
+			ret = -ENOSPC;
+			break;
+		}
+		req->index = index;
+
+		if (++ctl->nr == ZRAM_WB_BATCH) {
+			err = zram_wb_flush(zram, ctl);
+			if (err)
+				ret = err;
+		}
+		cond_resched();
+	}
+
+	err = zram_wb_flush(zram, ctl);
+	if (err)
+		ret = err;
+out_unlock:
+	up_read(&zram->init_lock);
+out_free:
+	for (i = 0; i < ZRAM_WB_BATCH; i++)
+		if (ctl->reqs[i].page)
+			__free_page(ctl->reqs[i].page);
+	kfree(ctl);
+
+	return ret ?: len;
+}
+
+static ssize_t bd_stat_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+	ssize_t ret;
+
+	down_read(&zram->init_lock);
+	ret = scnprintf(buf, PAGE_SIZE,
+			"%8llu %8llu %8llu\n",
+			(u64)atomic64_read(&zram->stats.bd_count),
+			(u64)atomic64_read(&zram->stats.bd_reads),
+			(u64)atomic64_read(&zram->stats.bd_writes));
+	up_read(&zram->init_lock);
+
+	return ret;
+}
+
 #else
 static bool zram_wb_enabled(struct zram *zram) { return false; }
 static inline void reset_bdev(struct zram *zram) {};
@@ -638,11 +942,9 @@ static ssize_t comp_algorithm_show(struct device *dev,
 	return sz;
 }
 
-static ssize_t comp_algorithm_store(struct device *dev,
-		struct device_attribute *attr, const char *buf, size_t len)
+static int zram_set_algorithm(struct zram *zram, char *dst, const char *buf)
 {
-	struct zram *zram = dev_to_zram(dev);
-	char compressor[ARRAY_SIZE(zram->compressor)];
+	char compressor[CRYPTO_MAX_ALG_NAME];
 	size_t sz;
 
 	strlcpy(compressor, buf, sizeof(compressor));
@@ -661,9 +963,197 @@ static ssize_t comp_algorithm_store(struct device *dev,
 		return -EBUSY;
 	}
 
-	strcpy(zram->compressor, compressor);
+	strcpy(dst, compressor);
 	up_write(&zram->init_lock);
-	return len;
+	return 0;
+}
+
+static ssize_t comp_algorithm_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	int ret;
+
+	ret = zram_set_algorithm(zram, zram->compressor, buf);
+	return ret ? ret : len;
+}
+
+static ssize_t recomp_algorithm_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	size_t sz;
+	struct zram *zram = dev_to_zram(dev);
+
+	down_read(&zram->init_lock);
+	sz = zcomp_available_show(zram->recomp_compressor, buf);
+	up_read(&zram->init_lock);
+
+	return sz;
+}
+
+/*
+ * The secondary algorithm is meant to be slower but stronger than the
+ * primary one: it is only used by recompress, on pages chosen by the admin.
+ */
+static ssize_t recomp_algorithm_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	int ret;
+
+	ret = zram_set_algorithm(zram, zram->recomp_compressor, buf);
+	return ret ? ret : len;
+}
+
+/*
+ * Re-encode the page of @index, whose slot lock is held, with the secondary
+ * algorithm.  The new object is kept only if it is smaller than the old one
+ * and than @threshold, if set: otherwise the page is not tried again.
+ */
+static int zram_recompress(struct zram *zram, u32 index, struct page *page,
+			   unsigned int threshold)
+{
+	unsigned int comp_len_old = zram_get_obj_size(zram, index);
+	unsigned int comp_len;
+	unsigned long handle;
+	struct zcomp_strm *zstrm;
+	void *src, *dst;
+	bool idle;
+	int ret;
+
+	ret = zram_read_from_zspool(zram, page, index);
+	if (ret)
+		return ret;
+
+	zstrm = zcomp_stream_get(zram->recomp);
+	src = kmap_atomic(page);
+	ret = zcomp_compress(zstrm, src, &comp_len);
+	kunmap_atomic(src);
+	if (ret) {
+		zcomp_stream_put(zram->recomp);
+		return ret;
+	}
+
+	if (comp_len >= comp_len_old || comp_len > max_zpage_size ||
+	    (threshold && comp_len >= threshold)) {
+		zcomp_stream_put(zram->recomp);
+		zram_set_flag(zram, index, ZRAM_INCOMPRESSIBLE);
+		return 0;
+	}
+
+	/* we hold the slot lock and can't sleep */
+	handle = zs_malloc(zram->mem_pool, comp_len,
+			__GFP_KSWAPD_RECLAIM |
+			__GFP_NOWARN |
+			__GFP_HIGHMEM |
+			__GFP_MOVABLE);
+	if (!handle) {
+		zcomp_stream_put(zram->recomp);
+		return -ENOMEM;
+	}
+
+	dst = zs_map_object(zram->mem_pool, handle, ZS_MM_WO);
+	memcpy(dst, zstrm->buffer, comp_len);
+	zcomp_stream_put(zram->recomp);
+	zs_unmap_object(zram->mem_pool, handle);
+
+	idle = zram_test_flag(zram, index, ZRAM_IDLE);
+	zram_free_page(zram, index);
+	zram_set_handle(zram, index, handle);
+	zram_set_obj_size(zram, index, comp_len);
+	zram_set_flag(zram, index, ZRAM_RECOMP);
+	if (idle)
+		zram_set_flag(zram, index, ZRAM_IDLE);
+	zram_account_obj(zram, index, 1);
+	atomic64_add(comp_len, &zram->stats.compr_data_size);
+	atomic64_inc(&zram->stats.pages_stored);
+
+	return 0;
+}
+
+/*
+ * Recompress the pages of the zspool with the secondary algorithm:
+ * "type=idle|huge|huge_idle" restricts it to the pages of that type and
+ * "threshold=BYTES" to the objects bigger than that, the new objects
+ * having to be smaller.
+ */
+static ssize_t recompress_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	unsigned int threshold = 0;
+	unsigned long nr_pages, index;
+	char *args, *param, *val, *p;
+	struct page *page;
+	int type = 0;
+	int ret = 0;
+
+	p = args = kstrdup(buf, GFP_KERNEL);
+	if (!args)
+		return -ENOMEM;
+
+	while ((param = strsep(&p, " \n")) != NULL) {
+		if (!*param)
+			continue;
+		val = strchr(param, '=');
+		if (!val) {
+			ret = -EINVAL;
+			break;
+		}
+		*val++ = 0;
+
+		if (!strcmp(param, "type")) {
+			type = zram_parse_page_type(val);
+			if (type < 0)
+				ret = type;
+		} else if (!strcmp(param, "threshold")) {
+			ret = kstrtouint(val, 10, &threshold);
+			if (!ret && threshold >= PAGE_SIZE)
+				ret = -EINVAL;
+		} else {
+			ret = -EINVAL;
+		}
+		if (ret)
+			break;
+	}
+	kfree(args);
+	if (ret)
+		return ret;
+
+	page = alloc_page(GFP_KERNEL);
+	if (!page)
+		return -ENOMEM;
+
+	down_read(&zram->init_lock);
+	if (!init_done(zram) || !zram->recomp) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	nr_pages = zram->disksize >> PAGE_SHIFT;
+	for (index = 0; index < nr_pages; index++) {
+		int err = 0;
+
+		zram_slot_lock(zram, index);
+		if (zram_page_match(zram, index, type) &&
+		    !zram_test_flag(zram, index, ZRAM_RECOMP) &&
+		    !zram_test_flag(zram, index, ZRAM_INCOMPRESSIBLE) &&
+		    zram_get_obj_size(zram, index) > threshold)
+			err = zram_recompress(zram, index, page, threshold);
+		zram_slot_unlock(zram, index);
+
+		/* out of memory is not worth going on with */
+		if (err == -ENOMEM) {
+			ret = err;
+			break;
+		}
+		cond_resched();
+	}
+out:
+	up_read(&zram->init_lock);
+	__free_page(page);
+
+	return ret ? ret : len;
 }
 
 static ssize_t compact_store(struct device *dev,
@@ -722,14 +1212,20 @@ static ssize_t mm_stat_show(struct device *dev,
 	max_used = atomic_long_read(&zram->stats.max_used_pages);
 
 	ret = scnprintf(buf, PAGE_SIZE,
-			"%8llu %8llu %8llu %8lu %8ld %8llu %8lu\n",
+			"%8llu %8llu %8llu %8lu %8ld %8llu %8lu"
+			" %8llu %8llu %8llu %8llu %8llu\n",
 			orig_size << PAGE_SHIFT,
 			(u64)atomic64_read(&zram->stats.compr_data_size),
 			mem_used << PAGE_SHIFT,
 			zram->limit_pages << PAGE_SHIFT,
 			max_used << PAGE_SHIFT,
 			(u64)atomic64_read(&zram->stats.same_pages),
-			pool_stats.pages_compacted);
+			pool_stats.pages_compacted,
+			(u64)atomic64_read(&zram->stats.huge_pages),
+			(u64)atomic64_read(&zram->stats.comp_pages[0]),
+			(u64)atomic64_read(&zram->stats.comp_size[0]),
+			(u64)atomic64_read(&zram->stats.comp_pages[1]),
+			(u64)atomic64_read(&zram->stats.comp_size[1]));
 	up_read(&zram->init_lock);
 
 	return ret;
@@ -756,16 +1252,6 @@ static DEVICE_ATTR_RO(io_stat);
 static DEVICE_ATTR_RO(mm_stat);
 static DEVICE_ATTR_RO(debug_stat);
 
-static void zram_slot_lock(struct zram *zram, u32 index)
-{
-	bit_spin_lock(ZRAM_ACCESS, &zram->table[index].value);
-}
-
-static void zram_slot_unlock(struct zram *zram, u32 index)
-{
-	bit_spin_unlock(ZRAM_ACCESS, &zram->table[index].value);
-}
-
 static void zram_meta_free(struct zram *zram, u64 disksize)
 {
 	size_t num_pages = disksize >> PAGE_SHIFT;
@@ -806,6 +1292,10 @@ static void zram_free_page(struct zram *zram, size_t index)
 {
 	unsigned long handle;
 
+	zram_clear_flag(zram, index, ZRAM_IDLE);
+	zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+	zram_clear_flag(zram, index, ZRAM_INCOMPRESSIBLE);
+
 	if (zram_wb_enabled(zram) && zram_test_flag(zram, index, ZRAM_WB)) {
 		zram_wb_clear(zram, index);
 		atomic64_dec(&zram->stats.pages_stored);
@@ -830,40 +1320,27 @@ static void zram_free_page(struct zram *zram, size_t index)
 
 	zs_free(zram->mem_pool, handle);
 
+	zram_account_obj(zram, index, -1);
 	atomic64_sub(zram_get_obj_size(zram, index),
 			&zram->stats.compr_data_size);
 	atomic64_dec(&zram->stats.pages_stored);
 
+	zram_clear_flag(zram, index, ZRAM_HUGE);
+	zram_clear_flag(zram, index, ZRAM_RECOMP);
 	zram_set_handle(zram, index, 0);
 	zram_set_obj_size(zram, index, 0);
 }
 
-static int __zram_bvec_read(struct zram *zram, struct page *page, u32 index,
-				struct bio *bio, bool partial_io)
+/* Decompress the page of @index, whose slot lock is held, to @page */
+static int zram_read_from_zspool(struct zram *zram, struct page *page,
+				 u32 index)
 {
 	int ret;
 	unsigned long handle;
 	unsigned int size;
+	struct zcomp *comp;
 	void *src, *dst;
 
-	if (zram_wb_enabled(zram)) {
-		zram_slot_lock(zram, index);
-		if (zram_test_flag(zram, index, ZRAM_WB)) {
-			struct bio_vec bvec;
-
-			zram_slot_unlock(zram, index);
-
-			bvec.bv_page = page;
-			bvec.bv_len = PAGE_SIZE;
-			bvec.bv_offset = 0;
-			return read_from_bdev(zram, &bvec,
-					zram_get_element(zram, index),
-					bio, partial_io);
-		}
-		zram_slot_unlock(zram, index);
-	}
-
-	zram_slot_lock(zram, index);
 	handle = zram_get_handle(zram, index);
 	if (!handle || zram_test_flag(zram, index, ZRAM_SAME)) {
 		unsigned long value;
@@ -873,7 +1350,6 @@ static int __zram_bvec_read(struct zram *zram, struct page *page, u32 index,
 		mem = kmap_atomic(page);
 		zram_fill_page(mem, PAGE_SIZE, value);
 		kunmap_atomic(mem);
-		zram_slot_unlock(zram, index);
 		return 0;
 	}
 
@@ -886,15 +1362,17 @@ static int __zram_bvec_read(struct zram *zram, struct page *page, u32 index,
 		kunmap_atomic(dst);
 		ret = 0;
 	} else {
-		struct zcomp_strm *zstrm = zcomp_stream_get(zram->comp);
+		struct zcomp_strm *zstrm;
 
+		comp = zram_test_flag(zram, index, ZRAM_RECOMP) ?
+			zram->recomp : zram->comp;
+		zstrm = zcomp_stream_get(comp);
 		dst = kmap_atomic(page);
 		ret = zcomp_decompress(zstrm, src, size, dst);
 		kunmap_atomic(dst);
-		zcomp_stream_put(zram->comp);
+		zcomp_stream_put(comp);
 	}
 	zs_unmap_object(zram->mem_pool, handle);
-	zram_slot_unlock(zram, index);
 
 	/* Should NEVER happen. Return bio error if it does. */
 	if (unlikely(ret))
@@ -903,6 +1381,36 @@ static int __zram_bvec_read(struct zram *zram, struct page *page, u32 index,
 	return ret;
 }
 
+static int __zram_bvec_read(struct zram *zram, struct page *page, u32 index,
+				struct bio *bio, bool partial_io)
+{
+	int ret;
+
+	if (zram_wb_enabled(zram)) {
+		zram_slot_lock(zram, index);
+		if (zram_test_flag(zram, index, ZRAM_WB)) {
+			struct bio_vec bvec;
+
+			zram_slot_unlock(zram, index);
+
+			bvec.bv_page = page;
+			bvec.bv_len = PAGE_SIZE;
+			bvec.bv_offset = 0;
+			return read_from_bdev(zram, &bvec,
+					zram_get_element(zram, index),
+					bio, partial_io);
+		}
+		zram_slot_unlock(zram, index);
+	}
+
+	zram_slot_lock(zram, index);
+	zram_clear_flag(zram, index, ZRAM_IDLE);
+	ret = zram_read_from_zspool(zram, page, index);
+	zram_slot_unlock(zram, index);
+
+	return ret;
+}
+
 static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
 				u32 index, int offset, struct bio *bio)
 {
@@ -1053,6 +1561,9 @@ static int __zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
 	}  else {
 		zram_set_handle(zram, index, handle);
 		zram_set_obj_size(zram, index, comp_len);
+		if (comp_len == PAGE_SIZE)
+			zram_set_flag(zram, index, ZRAM_HUGE);
+		zram_account_obj(zram, index, 1);
 	}
 	zram_slot_unlock(zram, index);
 
@@ -1310,7 +1821,7 @@ static int zram_rw_page(struct block_device *bdev, sector_t sector,
 
 static void zram_reset_device(struct zram *zram)
 {
-	struct zcomp *comp;
+	struct zcomp *comp, *recomp;
 	u64 disksize;
 
 	down_write(&zram->init_lock);
@@ -1323,6 +1834,8 @@ static void zram_reset_device(struct zram *zram)
 	}
 
 	comp = zram->comp;
+	recomp = zram->recomp;
+	zram->recomp = NULL;
 	disksize = zram->disksize;
 	zram->disksize = 0;
 
@@ -1334,6 +1847,8 @@ static void zram_reset_device(struct zram *zram)
 	zram_meta_free(zram, disksize);
 	memset(&zram->stats, 0, sizeof(zram->stats));
 	zcomp_destroy(comp);
+	if (recomp)
+		zcomp_destroy(recomp);
 	reset_bdev(zram);
 }
 
@@ -1370,6 +1885,17 @@ static ssize_t disksize_store(struct device *dev,
 		goto out_free_meta;
 	}
 
+	if (zram->recomp_compressor[0]) {
+		zram->recomp = zcomp_create(zram->recomp_compressor);
+		if (IS_ERR(zram->recomp)) {
+			pr_err("Cannot initialise %s compressing backend\n",
+					zram->recomp_compressor);
+			err = PTR_ERR(zram->recomp);
+			zram->recomp = NULL;
+			goto out_free_comp;
+		}
+	}
+
 	zram->comp = comp;
 	zram->disksize = disksize;
 	set_capacity(zram->disk, zram->disksize >> SECTOR_SHIFT);
@@ -1378,6 +1904,8 @@ static ssize_t disksize_store(struct device *dev,
 
 	return len;
 
+out_free_comp:
+	zcomp_destroy(comp);
 out_free_meta:
 	zram_meta_free(zram, disksize);
 out_unlock:
@@ -1460,8 +1988,13 @@ static DEVICE_ATTR_WO(mem_limit);
 static DEVICE_ATTR_WO(mem_used_max);
 static DEVICE_ATTR_RW(max_comp_streams);
 static DEVICE_ATTR_RW(comp_algorithm);
+static DEVICE_ATTR_RW(recomp_algorithm);
+static DEVICE_ATTR_WO(idle);
+static DEVICE_ATTR_WO(recompress);
 #ifdef CONFIG_ZRAM_WRITEBACK
 static DEVICE_ATTR_RW(backing_dev);
+static DEVICE_ATTR_WO(writeback);
+static DEVICE_ATTR_RO(bd_stat);
 #endif
 
 static struct attribute *zram_disk_attrs[] = {
@@ -1473,8 +2006,13 @@ static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_mem_used_max.attr,
 	&dev_attr_max_comp_streams.attr,
 	&dev_attr_comp_algorithm.attr,
+	&dev_attr_recomp_algorithm.attr,
+	&dev_attr_idle.attr,
+	&dev_attr_recompress.attr,
 #ifdef CONFIG_ZRAM_WRITEBACK
 	&dev_attr_backing_dev.attr,
+	&dev_attr_writeback.attr,
+	&dev_attr_bd_stat.attr,
 #endif
 	&dev_attr_io_stat.attr,
 	&dev_attr_mm_stat.attr,
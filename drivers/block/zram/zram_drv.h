@@ -64,10 +64,22 @@ enum zram_pageflags {
 	ZRAM_SAME = ZRAM_FLAG_SHIFT,
 	ZRAM_ACCESS,	/* page is now accessed */
 	ZRAM_WB,	/* page is stored on backing_device */
+	ZRAM_UNDER_WB,	/* page is being written to backing_device */
+	ZRAM_HUGE,	/* incompressible page, stored as is */
+	ZRAM_IDLE,	/* not accessed since the last "idle" mark */
+	ZRAM_RECOMP,	/* compressed with the secondary algorithm */
+	ZRAM_INCOMPRESSIBLE,	/* recompression did not save anything */
 
 	__NR_ZRAM_PAGEFLAGS,
 };
 
+/* Compression algorithms, pages are first stored with the primary one */
+enum zram_comp_prio {
+	ZRAM_PRIMARY_COMP,
+	ZRAM_SECONDARY_COMP,	/* used by recompress */
+	ZRAM_MAX_COMPS,
+};
+
 /*-- Data structures */
 
 /* Allocated for each disk page */
@@ -91,12 +103,23 @@ struct zram_stats {
 	atomic64_t pages_stored;	/* no. of pages currently stored */
 	atomic_long_t max_used_pages;	/* no. of maximum pages stored */
 	atomic64_t writestall;		/* no. of write slow paths */
+	atomic64_t huge_pages;		/* no. of huge pages */
+	/* no. of compressed pages and their size, per algorithm */
+	atomic64_t comp_pages[ZRAM_MAX_COMPS];
+	atomic64_t comp_size[ZRAM_MAX_COMPS];
+#ifdef CONFIG_ZRAM_WRITEBACK
+	atomic64_t bd_count;		/* no. of pages in backing device */
+	atomic64_t bd_reads;		/* no. of reads from backing device */
+	atomic64_t bd_writes;		/* no. of writes to backing device */
+#endif
 };
 
 struct zram {
 	struct zram_table_entry *table;
 	struct zs_pool *mem_pool;
 	struct zcomp *comp;
+	/* secondary algorithm, NULL unless recomp_algorithm is set */
+	struct zcomp *recomp;
 	struct gendisk *disk;
 	/* Prevent concurrent execution of device init */
 	struct rw_semaphore init_lock;
@@ -112,6 +135,7 @@ struct zram {
 	 */
 	u64 disksize;	/* bytes */
 	char compressor[CRYPTO_MAX_ALG_NAME];
+	char recomp_compressor[CRYPTO_MAX_ALG_NAME];
 	/*
 	 * zram is claimed so open request will be failed
 	 */
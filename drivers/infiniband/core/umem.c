@@ -38,6 +38,8 @@
 #include <linux/sched/mm.h>
 #include <linux/export.h>
 #include <linux/hugetlb.h>
+#include <linux/log2.h>
+#include <linux/sizes.h>
 #include <linux/slab.h>
 #include <rdma/ib_umem_odp.h>
 
@@ -47,20 +49,18 @@
 static void __ib_umem_release(struct ib_device *dev, struct ib_umem *umem, int dirty)
 {
 	struct scatterlist *sg;
-	struct page *page;
+	struct page_range range;
 	int i;
 
 	if (umem->nmap > 0)
 		ib_dma_unmap_sg(dev, umem->sg_head.sgl,
-				umem->npages,
+				umem->sg_nents,
 				DMA_BIDIRECTIONAL);
 
-	for_each_sg(umem->sg_head.sgl, sg, umem->npages, i) {
-
-		page = sg_page(sg);
-		if (!PageDirty(page) && umem->writable && dirty)
-			set_page_dirty_lock(page);
-		put_page(page);
+	for_each_sg(umem->sg_head.sgl, sg, umem->sg_nents, i) {
+		range.page = sg_page(sg);
+		range.nr_pages = sg->length >> PAGE_SHIFT;
+		put_user_page_range(&range, umem->writable && dirty);
 	}
 
 	sg_free_table(&umem->sg_head);
@@ -84,8 +84,8 @@ struct ib_umem *ib_umem_get(struct ib_ucontext *context, unsigned long addr,
 			    size_t size, int access, int dmasync)
 {
 	struct ib_umem *umem;
-	struct page **page_list;
-	struct vm_area_struct **vma_list;
+	struct page_range *range_list;
+	unsigned long nr_ranges;
 	unsigned long locked;
 	unsigned long lock_limit;
 	unsigned long cur_base;
@@ -93,7 +93,7 @@ struct ib_umem *ib_umem_get(struct ib_ucontext *context, unsigned long addr,
 	int ret;
 	int i;
 	unsigned long dma_attrs = 0;
-	struct scatterlist *sg, *sg_list_start;
+	struct scatterlist *sg = NULL;
 	int need_release = 0;
 	unsigned int gup_flags = FOLL_WRITE;
 
@@ -146,21 +146,13 @@ struct ib_umem *ib_umem_get(struct ib_ucontext *context, unsigned long addr,
 	/* We assume the memory is from hugetlb until proved otherwise */
 	umem->hugetlb   = 1;
 
-	page_list = (struct page **) __get_free_page(GFP_KERNEL);
-	if (!page_list) {
+	range_list = (struct page_range *) __get_free_page(GFP_KERNEL);
+	if (!range_list) {
 		put_pid(umem->pid);
 		kfree(umem);
 		return ERR_PTR(-ENOMEM);
 	}
 
-	/*
-	 * if we can't alloc the vma_list, it's not so bad;
-	 * just assume the memory is not hugetlb memory
-	 */
-	vma_list = (struct vm_area_struct **) __get_free_page(GFP_KERNEL);
-	if (!vma_list)
-		umem->hugetlb = 0;
-
 	npages = ib_umem_num_pages(umem);
 
 	down_write(&current->mm->mmap_sem);
@@ -188,14 +180,11 @@ struct ib_umem *ib_umem_get(struct ib_ucontext *context, unsigned long addr,
 		gup_flags |= FOLL_FORCE;
 
 	need_release = 1;
-	sg_list_start = umem->sg_head.sgl;
 
 	while (npages) {
-		ret = get_user_pages(cur_base,
-				     min_t(unsigned long, npages,
-					   PAGE_SIZE / sizeof (struct page *)),
-				     gup_flags, page_list, vma_list);
-
+		nr_ranges = PAGE_SIZE / sizeof(struct page_range);
+		ret = get_user_page_ranges(cur_base, npages, gup_flags,
+					   range_list, &nr_ranges);
 		if (ret < 0)
 			goto out;
 
@@ -203,20 +192,38 @@ struct ib_umem *ib_umem_get(struct ib_ucontext *context, unsigned long addr,
 		cur_base += ret * PAGE_SIZE;
 		npages   -= ret;
 
-		for_each_sg(sg_list_start, sg, ret, i) {
-			if (vma_list && !is_vm_hugetlb_page(vma_list[i]))
+		/*
+		 * One scatterlist entry per run of contiguous pages, so that
+		 * huge pages are mapped, and later released, in one piece.
+		 */
+		for (i = 0; i < nr_ranges; i++) {
+			struct page *page = range_list[i].page;
+			unsigned long len;
+
+			len = range_list[i].nr_pages << PAGE_SHIFT;
+
+			if (!PageHuge(page))
 				umem->hugetlb = 0;
 
-			sg_set_page(sg, page_list[i], PAGE_SIZE, 0);
-		}
+			while (len) {
+				unsigned int seg = min_t(unsigned long, len,
+							 SZ_2G);
+
+				sg = sg ? sg_next(sg) : umem->sg_head.sgl;
+				sg_set_page(sg, page, seg, 0);
+				umem->sg_nents++;
 
-		/* preparing for next loop */
-		sg_list_start = sg;
+				page = nth_page(page, seg >> PAGE_SHIFT);
+				len -= seg;
+			}
+		}
 	}
 
+	sg_mark_end(sg);
+
 	umem->nmap = ib_dma_map_sg_attrs(context->device,
 				  umem->sg_head.sgl,
-				  umem->npages,
+				  umem->sg_nents,
 				  DMA_BIDIRECTIONAL,
 				  dma_attrs);
 
@@ -237,9 +244,7 @@ struct ib_umem *ib_umem_get(struct ib_ucontext *context, unsigned long addr,
 		current->mm->pinned_vm = locked;
 
 	up_write(&current->mm->mmap_sem);
-	if (vma_list)
-		free_page((unsigned long) vma_list);
-	free_page((unsigned long) page_list);
+	free_page((unsigned long) range_list);
 
 	return ret < 0 ? ERR_PTR(ret) : umem;
 }
@@ -330,6 +335,45 @@ int ib_umem_page_count(struct ib_umem *umem)
 }
 EXPORT_SYMBOL(ib_umem_page_count);
 
+/**
+ * ib_umem_find_best_pgsz - find the largest page size mapping a umem
+ * @umem: umem struct
+ * @pgsz_bitmap: page sizes supported by the device
+ * @virt: IO virtual address the umem is mapped at by the device
+ *
+ * Returns the largest page size of @pgsz_bitmap with which the device
+ * can map the DMA-mapped umem at @virt, or 0 if there is none.  The IO
+ * virtual address and the DMA address must agree on the bits below the
+ * page size, and every scatterlist entry but the first and the last must
+ * start and end on a page boundary.
+ */
+unsigned long ib_umem_find_best_pgsz(struct ib_umem *umem,
+				     unsigned long pgsz_bitmap,
+				     unsigned long virt)
+{
+	unsigned long offset = ib_umem_offset(umem);
+	unsigned long va = virt;
+	unsigned long mask;
+	struct scatterlist *sg;
+	int i;
+
+	if (WARN_ON(umem->odp_data))
+		return 0;
+
+	mask = roundup_pow_of_two(umem->length);
+	for_each_sg(umem->sg_head.sgl, sg, umem->nmap, i) {
+		mask |= (sg_dma_address(sg) + offset) ^ va;
+		va += sg_dma_len(sg) - offset;
+		if (i != umem->nmap - 1)
+			mask |= va;
+		offset = 0;
+	}
+
+	pgsz_bitmap &= GENMASK(__ffs(mask), 0);
+	return pgsz_bitmap ? rounddown_pow_of_two(pgsz_bitmap) : 0;
+}
+EXPORT_SYMBOL(ib_umem_find_best_pgsz);
+
 /*
  * Copy from the given ib_umem's pages to the given buffer.
  *
@@ -619,6 +619,14 @@ static size_t ipmmu_unmap(struct iommu_domain *io_domain, unsigned long iova,
 	return domain->iop->unmap(domain->iop, iova, size);
 }
 
+static void ipmmu_iotlb_sync(struct iommu_domain *io_domain)
+{
+	struct ipmmu_vmsa_domain *domain = to_vmsa_domain(io_domain);
+
+	if (domain->iop)
+		io_pgtable_tlb_sync(io_pgtable_ops_to_pgtable(domain->iop));
+}
+
 static phys_addr_t ipmmu_iova_to_phys(struct iommu_domain *io_domain,
 				      dma_addr_t iova)
 {
@@ -757,6 +765,7 @@ static const struct iommu_ops ipmmu_ops = {
 	.map = ipmmu_map,
 	.unmap = ipmmu_unmap,
 	.map_sg = default_iommu_map_sg,
+	.iotlb_sync = ipmmu_iotlb_sync,
 	.iova_to_phys = ipmmu_iova_to_phys,
 	.add_device = ipmmu_add_device,
 	.remove_device = ipmmu_remove_device,
@@ -877,6 +886,7 @@ static const struct iommu_ops ipmmu_ops = {
 	.map = ipmmu_map,
 	.unmap = ipmmu_unmap,
 	.map_sg = default_iommu_map_sg,
+	.iotlb_sync = ipmmu_iotlb_sync,
 	.iova_to_phys = ipmmu_iova_to_phys,
 	.add_device = ipmmu_add_device_dma,
 	.remove_device = ipmmu_remove_device_dma,
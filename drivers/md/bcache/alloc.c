@@ -66,6 +66,7 @@
 
 #include <linux/blkdev.h>
 #include <linux/kthread.h>
+#include <linux/percpu.h>
 #include <linux/random.h>
 #include <trace/events/bcache.h>
 
@@ -497,7 +498,7 @@ int bch_bucket_alloc_set(struct cache_set *c, unsigned reserve,
 			 struct bkey *k, int n, bool wait)
 {
 	int ret;
-	mutex_lock(&c->bucket_lock);
+	bch_bucket_lock(c);
 	ret = __bch_bucket_alloc_set(c, reserve, k, n, wait);
 	mutex_unlock(&c->bucket_lock);
 	return ret;
@@ -512,6 +513,33 @@ struct open_bucket {
 	BKEY_PADDED(key);
 };
 
+/*
+ * Writers of a cpu only use the open buckets of that cpu, and get the buckets
+ * they open from the small stash of already allocated buckets of the cpu, which
+ * is refilled in batches: the sector allocator only takes bucket_lock once
+ * every ALLOC_CPU_BUCKETS buckets for the common RESERVE_NONE case.
+ *
+ * The stashed buckets are allocated as any other, they keep their pin until
+ * they're opened so neither gc nor the allocator can reuse them.
+ */
+#define ALLOC_CPU_BUCKETS	8
+
+struct bch_alloc_cpu {
+	spinlock_t		lock;
+	struct list_head	data_buckets;
+
+	unsigned		nr_free;
+	uint64_t		free[ALLOC_CPU_BUCKETS];
+
+	unsigned long		hits;
+	unsigned long		refills;
+};
+
+static unsigned alloc_cpu_open_buckets(void)
+{
+	return max_t(unsigned, 4, MAX_OPEN_BUCKETS / num_possible_cpus());
+}
+
 /*
  * We keep multiple buckets open for writes, and try to segregate different
  * write streams for better cache utilization: first we look for a bucket where
@@ -532,19 +560,20 @@ struct open_bucket {
  * should be a sane heuristic.
  */
 static struct open_bucket *pick_data_bucket(struct cache_set *c,
+					    struct bch_alloc_cpu *ac,
 					    const struct bkey *search,
 					    unsigned write_point,
 					    struct bkey *alloc)
 {
 	struct open_bucket *ret, *ret_task = NULL;
 
-	list_for_each_entry_reverse(ret, &c->data_buckets, list)
+	list_for_each_entry_reverse(ret, &ac->data_buckets, list)
 		if (!bkey_cmp(&ret->key, search))
 			goto found;
 		else if (ret->last_write_point == write_point)
 			ret_task = ret;
 
-	ret = ret_task ?: list_first_entry(&c->data_buckets,
+	ret = ret_task ?: list_first_entry(&ac->data_buckets,
 					   struct open_bucket, list);
 found:
 	if (!ret->sectors_free && KEY_PTRS(alloc)) {
@@ -559,6 +588,72 @@ static struct open_bucket *pick_data_bucket(struct cache_set *c,
 	return ret;
 }
 
+static void alloc_cpu_release(struct cache_set *c, uint64_t *ptrs,
+			      unsigned nr)
+{
+	BKEY_PADDED(key) k;
+
+	mutex_lock(&c->bucket_lock);
+	while (nr) {
+		bkey_init(&k.key);
+		k.key.ptr[0] = ptrs[--nr];
+		SET_KEY_PTRS(&k.key, 1);
+
+		bch_bucket_free(c, &k.key);
+		bkey_put(c, &k.key);
+	}
+	mutex_unlock(&c->bucket_lock);
+}
+
+/*
+ * Allocates a bucket for @k like bch_bucket_alloc_set(), and for RESERVE_NONE
+ * also allocates up to ALLOC_CPU_BUCKETS more buckets for @ac while holding
+ * bucket_lock. At most half of the free RESERVE_NONE buckets are stashed, so
+ * the other cpus and the allocations not going through here aren't starved.
+ */
+static int alloc_cpu_refill(struct cache_set *c, struct bch_alloc_cpu *ac,
+			    unsigned reserve, struct bkey *k, bool wait)
+{
+	BKEY_PADDED(key) tmp;
+	uint64_t ptrs[ALLOC_CPU_BUCKETS];
+	unsigned nr = 0, want = 0;
+
+	bch_bucket_lock(c);
+
+	if (__bch_bucket_alloc_set(c, reserve, k, 1, wait)) {
+		mutex_unlock(&c->bucket_lock);
+		return -1;
+	}
+
+	if (reserve == RESERVE_NONE) {
+		struct cache *ca = c->cache_by_alloc[0];
+
+		want = min_t(size_t, ALLOC_CPU_BUCKETS - READ_ONCE(ac->nr_free),
+			     fifo_used(&ca->free[RESERVE_NONE]) / 2);
+	}
+
+	while (nr < want &&
+	       !__bch_bucket_alloc_set(c, RESERVE_NONE, &tmp.key, 1, false))
+		ptrs[nr++] = tmp.key.ptr[0];
+
+	mutex_unlock(&c->bucket_lock);
+
+	if (!nr)
+		return 0;
+
+	spin_lock(&ac->lock);
+	while (nr && ac->nr_free < ALLOC_CPU_BUCKETS)
+		ac->free[ac->nr_free++] = ptrs[--nr];
+	ac->refills++;
+	spin_unlock(&ac->lock);
+
+	/* Raced with another refill of the same cpu */
+	if (nr)
+		alloc_cpu_release(c, ptrs, nr);
+
+	return 0;
+}
+
 /*
  * Allocates some space in the cache to write to, and k to point to the newly
  * allocated space, and updates KEY_SIZE(k) and KEY_OFFSET(k) (to point to the
@@ -572,40 +667,54 @@ static struct open_bucket *pick_data_bucket(struct cache_set *c,
 bool bch_alloc_sectors(struct cache_set *c, struct bkey *k, unsigned sectors,
 		       unsigned write_point, unsigned write_prio, bool wait)
 {
+	unsigned watermark = write_prio ? RESERVE_MOVINGGC : RESERVE_NONE;
+	struct bch_alloc_cpu *ac = raw_cpu_ptr(c->alloc_cpu);
 	struct open_bucket *b;
 	BKEY_PADDED(key) alloc;
 	unsigned i;
 
 	/*
 	 * We might have to allocate a new bucket, which we can't do with a
-	 * spinlock held. So if we have to allocate, we drop the lock, allocate
-	 * and then retry. KEY_PTRS() indicates whether alloc points to
-	 * allocated bucket(s).
+	 * spinlock held. So if we have to allocate and the stash of this cpu is
+	 * empty, we drop the lock, allocate and then retry. KEY_PTRS()
+	 * indicates whether alloc points to allocated bucket(s).
+	 *
+	 * We may be migrated to another cpu meanwhile, we then just keep
+	 * using the open buckets of the cpu we started on.
 	 */
 
 	bkey_init(&alloc.key);
-	spin_lock(&c->data_bucket_lock);
+	spin_lock(&ac->lock);
 
-	while (!(b = pick_data_bucket(c, k, write_point, &alloc.key))) {
-		unsigned watermark = write_prio
-			? RESERVE_MOVINGGC
-			: RESERVE_NONE;
+	while (!(b = pick_data_bucket(c, ac, k, write_point, &alloc.key))) {
+		if (watermark == RESERVE_NONE && ac->nr_free) {
+			alloc.key.ptr[0] = ac->free[--ac->nr_free];
+			SET_KEY_PTRS(&alloc.key, 1);
+			ac->hits++;
+			continue;
+		}
 
-		spin_unlock(&c->data_bucket_lock);
+		spin_unlock(&ac->lock);
 
-		if (bch_bucket_alloc_set(c, watermark, &alloc.key, 1, wait))
+		if (alloc_cpu_refill(c, ac, watermark, &alloc.key, wait))
 			return false;
 
-		spin_lock(&c->data_bucket_lock);
+		spin_lock(&ac->lock);
 	}
 
 	/*
 	 * If we had to allocate, we might race and not need to allocate the
 	 * second time we call find_data_bucket(). If we allocated a bucket but
-	 * didn't use it, drop the refcount bch_bucket_alloc_set() took:
+	 * didn't use it, stash it or drop the refcount bch_bucket_alloc_set()
+	 * took:
 	 */
-	if (KEY_PTRS(&alloc.key))
-		bkey_put(c, &alloc.key);
+	if (KEY_PTRS(&alloc.key)) {
+		if (watermark == RESERVE_NONE &&
+		    ac->nr_free < ALLOC_CPU_BUCKETS)
+			ac->free[ac->nr_free++] = alloc.key.ptr[0];
+		else
+			bkey_put(c, &alloc.key);
+	}
 
 	for (i = 0; i < KEY_PTRS(&b->key); i++)
 		EBUG_ON(ptr_stale(c, &b->key, i));
@@ -625,7 +734,7 @@ bool bch_alloc_sectors(struct cache_set *c, struct bkey *k, unsigned sectors,
 	 * Move b to the end of the lru, and keep track of what this bucket was
 	 * last used for:
 	 */
-	list_move_tail(&b->list, &c->data_buckets);
+	list_move_tail(&b->list, &ac->data_buckets);
 	bkey_copy_key(&b->key, k);
 	b->last_write_point = write_point;
 
@@ -650,36 +759,76 @@ bool bch_alloc_sectors(struct cache_set *c, struct bkey *k, unsigned sectors,
 		for (i = 0; i < KEY_PTRS(&b->key); i++)
 			atomic_inc(&PTR_BUCKET(c, &b->key, i)->pin);
 
-	spin_unlock(&c->data_bucket_lock);
+	spin_unlock(&ac->lock);
 	return true;
 }
 
+void bch_alloc_cpu_stats(struct cache_set *c, unsigned long *hits,
+			 unsigned long *refills)
+{
+	int cpu;
+
+	*hits = *refills = 0;
+
+	for_each_possible_cpu(cpu) {
+		struct bch_alloc_cpu *ac = per_cpu_ptr(c->alloc_cpu, cpu);
+
+		*hits		+= READ_ONCE(ac->hits);
+		*refills	+= READ_ONCE(ac->refills);
+	}
+}
+
 /* Init */
 
 void bch_open_buckets_free(struct cache_set *c)
 {
 	struct open_bucket *b;
+	int cpu;
+
+	if (!c->alloc_cpu)
+		return;
 
-	while (!list_empty(&c->data_buckets)) {
-		b = list_first_entry(&c->data_buckets,
-				     struct open_bucket, list);
-		list_del(&b->list);
-		kfree(b);
+	for_each_possible_cpu(cpu) {
+		struct bch_alloc_cpu *ac = per_cpu_ptr(c->alloc_cpu, cpu);
+
+		while (!list_empty(&ac->data_buckets)) {
+			b = list_first_entry(&ac->data_buckets,
+					     struct open_bucket, list);
+			list_del(&b->list);
+			kfree(b);
+		}
 	}
+
+	free_percpu(c->alloc_cpu);
+	c->alloc_cpu = NULL;
 }
 
 int bch_open_buckets_alloc(struct cache_set *c)
 {
-	int i;
+	unsigned i, nr = alloc_cpu_open_buckets();
+	int cpu;
 
-	spin_lock_init(&c->data_bucket_lock);
+	c->alloc_cpu = alloc_percpu(struct bch_alloc_cpu);
+	if (!c->alloc_cpu)
+		return -ENOMEM;
 
-	for (i = 0; i < MAX_OPEN_BUCKETS; i++) {
-		struct open_bucket *b = kzalloc(sizeof(*b), GFP_KERNEL);
-		if (!b)
-			return -ENOMEM;
+	for_each_possible_cpu(cpu) {
+		struct bch_alloc_cpu *ac = per_cpu_ptr(c->alloc_cpu, cpu);
+
+		spin_lock_init(&ac->lock);
+		INIT_LIST_HEAD(&ac->data_buckets);
+	}
 
-		list_add(&b->list, &c->data_buckets);
+	for_each_possible_cpu(cpu) {
+		struct bch_alloc_cpu *ac = per_cpu_ptr(c->alloc_cpu, cpu);
+
+		for (i = 0; i < nr; i++) {
+			struct open_bucket *b = kzalloc(sizeof(*b), GFP_KERNEL);
+			if (!b)
+				return -ENOMEM;
+
+			list_add(&b->list, &ac->data_buckets);
+		}
 	}
 
 	return 0;
@@ -625,9 +625,11 @@ struct cache_set {
 
 	struct bset_sort_state	sort;
 
-	/* List of buckets we're currently writing data to */
-	struct list_head	data_buckets;
-	spinlock_t		data_bucket_lock;
+	/*
+	 * Buckets we're currently writing data to, and a few allocated buckets
+	 * to open them from without taking bucket_lock, per cpu
+	 */
+	struct bch_alloc_cpu __percpu *alloc_cpu;
 
 	struct journal		journal;
 
@@ -647,6 +649,10 @@ struct cache_set {
 	atomic_long_t		writeback_keys_done;
 	atomic_long_t		writeback_keys_failed;
 
+	/* Times bucket_lock or a btree node write lock was found held */
+	atomic_long_t		bucket_lock_contended;
+	atomic_long_t		btree_lock_contended;
+
 	enum			{
 		ON_ERROR_UNREGISTER,
 		ON_ERROR_PANIC,
@@ -849,6 +855,14 @@ static inline void wake_up_allocators(struct cache_set *c)
 		wake_up_process(ca->alloc_thread);
 }
 
+static inline void bch_bucket_lock(struct cache_set *c)
+{
+	if (!mutex_trylock(&c->bucket_lock)) {
+		atomic_long_inc(&c->bucket_lock_contended);
+		mutex_lock(&c->bucket_lock);
+	}
+}
+
 /* Forward declarations */
 
 void bch_count_io_errors(struct cache *, blk_status_t, const char *);
@@ -920,6 +934,8 @@ int bch_btree_cache_alloc(struct cache_set *);
 void bch_moving_init_cache_set(struct cache_set *);
 int bch_open_buckets_alloc(struct cache_set *);
 void bch_open_buckets_free(struct cache_set *);
+void bch_alloc_cpu_stats(struct cache_set *, unsigned long *,
+			 unsigned long *);
 
 int bch_cache_allocator_start(struct cache *ca);
 
@@ -225,6 +225,10 @@ static inline void bch_btree_op_init(struct btree_op *op, int write_lock_level)
 
 static inline void rw_lock(bool w, struct btree *b, int level)
 {
+	/* racy, only exported as a statistic */
+	if (w && rwsem_is_locked(&b->lock))
+		atomic_long_inc(&b->c->btree_lock_contended);
+
 	w ? down_write_nested(&b->lock, level + 1)
 	  : down_read_nested(&b->lock, level + 1);
 	if (w)
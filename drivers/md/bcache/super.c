@@ -544,6 +544,18 @@ void bch_prio_write(struct cache *ca)
 		struct bucket_disk *d = p->data;
 		struct bucket_disk *end = d + prios_per_bucket(ca);
 
+		bucket = bch_bucket_alloc(ca, RESERVE_PRIO, true);
+		BUG_ON(bucket == -1);
+
+		/*
+		 * A gen or prio changing while we copy them without
+		 * bucket_lock is no different from one changing right after
+		 * copying them with the lock held, or while the previous prio
+		 * bucket is written: don't hold it while filling in the buckets
+		 * and checksumming.
+		 */
+		mutex_unlock(&ca->set->bucket_lock);
+
 		for (b = ca->buckets + i * prios_per_bucket(ca);
 		     b < ca->buckets + ca->sb.nbuckets && d < end;
 		     b++, d++) {
@@ -555,10 +567,6 @@ void bch_prio_write(struct cache *ca)
 		p->magic	= pset_magic(&ca->sb);
 		p->csum		= bch_crc64(&p->magic, bucket_bytes(ca) - 8);
 
-		bucket = bch_bucket_alloc(ca, RESERVE_PRIO, true);
-		BUG_ON(bucket == -1);
-
-		mutex_unlock(&ca->set->bucket_lock);
 		prio_io(ca, bucket, REQ_OP_WRITE, 0);
 		mutex_lock(&ca->set->bucket_lock);
 
@@ -1504,7 +1512,6 @@ struct cache_set *bch_cache_set_alloc(struct cache_sb *sb)
 	INIT_LIST_HEAD(&c->btree_cache);
 	INIT_LIST_HEAD(&c->btree_cache_freeable);
 	INIT_LIST_HEAD(&c->btree_cache_freed);
-	INIT_LIST_HEAD(&c->data_buckets);
 
 	c->search = mempool_create_slab_pool(32, bch_search_cache);
 	if (!c->search)
@@ -67,6 +67,10 @@ read_attribute(state);
 read_attribute(cache_read_races);
 read_attribute(writeback_keys_done);
 read_attribute(writeback_keys_failed);
+read_attribute(bucket_lock_contended);
+read_attribute(btree_lock_contended);
+read_attribute(alloc_cpu_hits);
+read_attribute(alloc_cpu_refills);
 read_attribute(io_errors);
 read_attribute(congested);
 rw_attribute(congested_read_threshold_us);
@@ -548,6 +552,20 @@ SHOW(__bch_cache_set)
 	sysfs_print(writeback_keys_failed,
 		    atomic_long_read(&c->writeback_keys_failed));
 
+	sysfs_print(bucket_lock_contended,
+		    atomic_long_read(&c->bucket_lock_contended));
+	sysfs_print(btree_lock_contended,
+		    atomic_long_read(&c->btree_lock_contended));
+
+	if (attr == &sysfs_alloc_cpu_hits ||
+	    attr == &sysfs_alloc_cpu_refills) {
+		unsigned long hits, refills;
+
+		bch_alloc_cpu_stats(c, &hits, &refills);
+		sysfs_print(alloc_cpu_hits,	hits);
+		sysfs_print(alloc_cpu_refills,	refills);
+	}
+
 	if (attr == &sysfs_errors)
 		return bch_snprint_string_list(buf, PAGE_SIZE, error_actions,
 					       c->on_error);
@@ -731,6 +749,10 @@ static struct attribute *bch_cache_set_internal_files[] = {
 	&sysfs_cache_read_races,
 	&sysfs_writeback_keys_done,
 	&sysfs_writeback_keys_failed,
+	&sysfs_bucket_lock_contended,
+	&sysfs_btree_lock_contended,
+	&sysfs_alloc_cpu_hits,
+	&sysfs_alloc_cpu_refills,
 
 	&sysfs_trigger_gc,
 	&sysfs_prune_cache,
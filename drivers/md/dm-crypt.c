@@ -20,6 +20,7 @@
 #include <linux/crypto.h>
 #include <linux/workqueue.h>
 #include <linux/kthread.h>
+#include <linux/interrupt.h>
 #include <linux/backing-dev.h>
 #include <linux/atomic.h>
 #include <linux/scatterlist.h>
@@ -55,7 +56,7 @@ struct convert_context {
 		struct skcipher_request *req;
 		struct aead_request *req_aead;
 	} r;
-
+	bool atomic;	/* converting from the bio completion, cannot sleep */
 };
 
 /*
@@ -67,6 +68,7 @@ struct dm_crypt_io {
 	u8 *integrity_metadata;
 	bool integrity_metadata_from_pool;
 	struct work_struct work;
+	struct tasklet_struct tasklet;
 
 	struct convert_context ctx;
 
@@ -125,7 +127,9 @@ struct iv_tcw_private {
  * and encrypts / decrypts at the same time.
  */
 enum flags { DM_CRYPT_SUSPENDED, DM_CRYPT_KEY_VALID,
-	     DM_CRYPT_SAME_CPU, DM_CRYPT_NO_OFFLOAD };
+	     DM_CRYPT_SAME_CPU, DM_CRYPT_NO_OFFLOAD,
+	     DM_CRYPT_NO_READ_WORKQUEUE, DM_CRYPT_NO_WRITE_WORKQUEUE,
+	     DM_CRYPT_ASYNC_CIPHER };
 
 enum cipher_flags {
 	CRYPT_MODE_INTEGRITY_AEAD,	/* Use authenticated mode for cihper */
@@ -1236,6 +1240,10 @@ static void crypt_alloc_req_skcipher(struct crypt_config *cc,
 {
 	unsigned key_index = ctx->cc_sector & (cc->tfms_count - 1);
 
+	/*
+	 * Only reached after an asynchronous request, an atomic conversion
+	 * always uses the request embedded in the per bio data.
+	 */
 	if (!ctx->r.req)
 		ctx->r.req = mempool_alloc(cc->req_pool, GFP_NOIO);
 
@@ -1246,7 +1254,8 @@ static void crypt_alloc_req_skcipher(struct crypt_config *cc,
 	 * requests if driver request queue is full.
 	 */
 	skcipher_request_set_callback(ctx->r.req,
-	    CRYPTO_TFM_REQ_MAY_BACKLOG | CRYPTO_TFM_REQ_MAY_SLEEP,
+	    CRYPTO_TFM_REQ_MAY_BACKLOG |
+	    (ctx->atomic ? 0 : CRYPTO_TFM_REQ_MAY_SLEEP),
 	    kcryptd_async_done, dmreq_of_req(cc, ctx->r.req));
 }
 
@@ -1263,7 +1272,8 @@ static void crypt_alloc_req_aead(struct crypt_config *cc,
 	 * requests if driver request queue is full.
 	 */
 	aead_request_set_callback(ctx->r.req_aead,
-	    CRYPTO_TFM_REQ_MAY_BACKLOG | CRYPTO_TFM_REQ_MAY_SLEEP,
+	    CRYPTO_TFM_REQ_MAY_BACKLOG |
+	    (ctx->atomic ? 0 : CRYPTO_TFM_REQ_MAY_SLEEP),
 	    kcryptd_async_done, dmreq_of_req(cc, ctx->r.req_aead));
 }
 
@@ -1349,7 +1359,8 @@ static blk_status_t crypt_convert(struct crypt_config *cc,
 			atomic_dec(&ctx->cc_pending);
 			ctx->cc_sector += sector_step;
 			tag_offset++;
-			cond_resched();
+			if (!ctx->atomic)
+				cond_resched();
 			continue;
 		/*
 		 * There was a data integrity error.
@@ -1458,6 +1469,7 @@ static void crypt_io_init(struct dm_crypt_io *io, struct crypt_config *cc,
 	io->sector = sector;
 	io->error = 0;
 	io->ctx.r.req = NULL;
+	io->ctx.atomic = false;
 	io->integrity_metadata = NULL;
 	io->integrity_metadata_from_pool = false;
 	atomic_set(&io->io_pending, 0);
@@ -1661,6 +1673,20 @@ static int dmcrypt_write(void *data)
 	return 0;
 }
 
+/*
+ * Whether @bio is converted in the context queueing it rather than by the
+ * crypt workqueue: reads from the completion of the clone, writes from the
+ * submitter, which then also issues the clone itself.
+ */
+static bool kcryptd_crypt_inline(struct crypt_config *cc, struct bio *bio)
+{
+	if (test_bit(DM_CRYPT_ASYNC_CIPHER, &cc->flags))
+		return false;
+	if (bio_data_dir(bio) == READ)
+		return test_bit(DM_CRYPT_NO_READ_WORKQUEUE, &cc->flags);
+	return test_bit(DM_CRYPT_NO_WRITE_WORKQUEUE, &cc->flags);
+}
+
 static void kcryptd_crypt_write_io_submit(struct dm_crypt_io *io, int async)
 {
 	struct bio *clone = io->ctx.bio_out;
@@ -1681,7 +1707,8 @@ static void kcryptd_crypt_write_io_submit(struct dm_crypt_io *io, int async)
 
 	clone->bi_iter.bi_sector = cc->start + io->sector;
 
-	if (likely(!async) && test_bit(DM_CRYPT_NO_OFFLOAD, &cc->flags)) {
+	if ((likely(!async) && test_bit(DM_CRYPT_NO_OFFLOAD, &cc->flags)) ||
+	    kcryptd_crypt_inline(cc, io->base_bio)) {
 		generic_make_request(clone);
 		return;
 	}
@@ -1819,10 +1846,34 @@ static void kcryptd_crypt(struct work_struct *work)
 		kcryptd_crypt_write_convert(io);
 }
 
+static void kcryptd_crypt_tasklet(unsigned long work)
+{
+	kcryptd_crypt((struct work_struct *)work);
+}
+
 static void kcryptd_queue_crypt(struct dm_crypt_io *io)
 {
 	struct crypt_config *cc = io->cc;
 
+	if (kcryptd_crypt_inline(cc, io->base_bio)) {
+		if (bio_data_dir(io->base_bio) == READ) {
+			/*
+			 * Decrypt from the completion of the clone, the
+			 * skcipher walk refuses to run in hard irq context.
+			 */
+			io->ctx.atomic = true;
+			if (in_irq()) {
+				tasklet_init(&io->tasklet,
+					     kcryptd_crypt_tasklet,
+					     (unsigned long)&io->work);
+				tasklet_schedule(&io->tasklet);
+				return;
+			}
+		}
+		kcryptd_crypt(&io->work);
+		return;
+	}
+
 	INIT_WORK(&io->work, kcryptd_crypt);
 	queue_work(cc->crypt_queue, &io->work);
 }
@@ -1866,7 +1917,8 @@ static void crypt_free_tfms(struct crypt_config *cc)
 		crypt_free_tfms_skcipher(cc);
 }
 
-static int crypt_alloc_tfms_skcipher(struct crypt_config *cc, char *ciphermode)
+static int crypt_alloc_tfms_skcipher(struct crypt_config *cc, char *ciphermode,
+				     u32 mask)
 {
 	unsigned i;
 	int err;
@@ -1877,7 +1929,8 @@ static int crypt_alloc_tfms_skcipher(struct crypt_config *cc, char *ciphermode)
 		return -ENOMEM;
 
 	for (i = 0; i < cc->tfms_count; i++) {
-		cc->cipher_tfm.tfms[i] = crypto_alloc_skcipher(ciphermode, 0, 0);
+		cc->cipher_tfm.tfms[i] = crypto_alloc_skcipher(ciphermode, 0,
+							       mask);
 		if (IS_ERR(cc->cipher_tfm.tfms[i])) {
 			err = PTR_ERR(cc->cipher_tfm.tfms[i]);
 			crypt_free_tfms(cc);
@@ -1888,7 +1941,8 @@ static int crypt_alloc_tfms_skcipher(struct crypt_config *cc, char *ciphermode)
 	return 0;
 }
 
-static int crypt_alloc_tfms_aead(struct crypt_config *cc, char *ciphermode)
+static int crypt_alloc_tfms_aead(struct crypt_config *cc, char *ciphermode,
+				 u32 mask)
 {
 	int err;
 
@@ -1896,7 +1950,7 @@ static int crypt_alloc_tfms_aead(struct crypt_config *cc, char *ciphermode)
 	if (!cc->cipher_tfm.tfms)
 		return -ENOMEM;
 
-	cc->cipher_tfm.tfms_aead[0] = crypto_alloc_aead(ciphermode, 0, 0);
+	cc->cipher_tfm.tfms_aead[0] = crypto_alloc_aead(ciphermode, 0, mask);
 	if (IS_ERR(cc->cipher_tfm.tfms_aead[0])) {
 		err = PTR_ERR(cc->cipher_tfm.tfms_aead[0]);
 		crypt_free_tfms(cc);
@@ -1906,12 +1960,32 @@ static int crypt_alloc_tfms_aead(struct crypt_config *cc, char *ciphermode)
 	return 0;
 }
 
-static int crypt_alloc_tfms(struct crypt_config *cc, char *ciphermode)
+static int __crypt_alloc_tfms(struct crypt_config *cc, char *ciphermode,
+			      u32 mask)
 {
 	if (crypt_integrity_aead(cc))
-		return crypt_alloc_tfms_aead(cc, ciphermode);
+		return crypt_alloc_tfms_aead(cc, ciphermode, mask);
 	else
-		return crypt_alloc_tfms_skcipher(cc, ciphermode);
+		return crypt_alloc_tfms_skcipher(cc, ciphermode, mask);
+}
+
+static int crypt_alloc_tfms(struct crypt_config *cc, char *ciphermode)
+{
+	if (!test_bit(DM_CRYPT_NO_READ_WORKQUEUE, &cc->flags) &&
+	    !test_bit(DM_CRYPT_NO_WRITE_WORKQUEUE, &cc->flags))
+		return __crypt_alloc_tfms(cc, ciphermode, 0);
+
+	/*
+	 * Converting without the workqueues needs a cipher that completes
+	 * synchronously, an asynchronous driver keeps the workqueues.
+	 */
+	if (!__crypt_alloc_tfms(cc, ciphermode, CRYPTO_ALG_ASYNC))
+		return 0;
+
+	DMWARN("No synchronous %s cipher, using the crypt workqueues",
+	       ciphermode);
+	set_bit(DM_CRYPT_ASYNC_CIPHER, &cc->flags);
+	return __crypt_alloc_tfms(cc, ciphermode, 0);
 }
 
 static unsigned crypt_subkey_size(struct crypt_config *cc)
@@ -2531,7 +2605,7 @@ static int crypt_ctr_optional(struct dm_target *ti, unsigned int argc, char **ar
 	struct crypt_config *cc = ti->private;
 	struct dm_arg_set as;
 	static const struct dm_arg _args[] = {
-		{0, 6, "Invalid number of feature args"},
+		{0, 8, "Invalid number of feature args"},
 	};
 	unsigned int opt_params, val;
 	const char *opt_string, *sval;
@@ -2561,6 +2635,10 @@ static int crypt_ctr_optional(struct dm_target *ti, unsigned int argc, char **ar
 
 		else if (!strcasecmp(opt_string, "submit_from_crypt_cpus"))
 			set_bit(DM_CRYPT_NO_OFFLOAD, &cc->flags);
+		else if (!strcasecmp(opt_string, "no_read_workqueue"))
+			set_bit(DM_CRYPT_NO_READ_WORKQUEUE, &cc->flags);
+		else if (!strcasecmp(opt_string, "no_write_workqueue"))
+			set_bit(DM_CRYPT_NO_WRITE_WORKQUEUE, &cc->flags);
 		else if (sscanf(opt_string, "integrity:%u:", &val) == 1) {
 			if (val == 0 || val > MAX_TAG_SIZE) {
 				ti->error = "Invalid integrity arguments";
@@ -2881,6 +2959,8 @@ static void crypt_status(struct dm_target *ti, status_type_t type,
 		num_feature_args += !!ti->num_discard_bios;
 		num_feature_args += test_bit(DM_CRYPT_SAME_CPU, &cc->flags);
 		num_feature_args += test_bit(DM_CRYPT_NO_OFFLOAD, &cc->flags);
+		num_feature_args += test_bit(DM_CRYPT_NO_READ_WORKQUEUE, &cc->flags);
+		num_feature_args += test_bit(DM_CRYPT_NO_WRITE_WORKQUEUE, &cc->flags);
 		num_feature_args += cc->sector_size != (1 << SECTOR_SHIFT);
 		num_feature_args += test_bit(CRYPT_IV_LARGE_SECTORS, &cc->cipher_flags);
 		if (cc->on_disk_tag_size)
@@ -2893,6 +2973,10 @@ static void crypt_status(struct dm_target *ti, status_type_t type,
 				DMEMIT(" same_cpu_crypt");
 			if (test_bit(DM_CRYPT_NO_OFFLOAD, &cc->flags))
 				DMEMIT(" submit_from_crypt_cpus");
+			if (test_bit(DM_CRYPT_NO_READ_WORKQUEUE, &cc->flags))
+				DMEMIT(" no_read_workqueue");
+			if (test_bit(DM_CRYPT_NO_WRITE_WORKQUEUE, &cc->flags))
+				DMEMIT(" no_write_workqueue");
 			if (cc->on_disk_tag_size)
 				DMEMIT(" integrity:%u:%s", cc->on_disk_tag_size, cc->cipher_auth);
 			if (cc->sector_size != (1 << SECTOR_SHIFT))
@@ -3007,7 +3091,7 @@ static void crypt_io_hints(struct dm_target *ti, struct queue_limits *limits)
 
 static struct target_type crypt_target = {
 	.name   = "crypt",
-	.version = {1, 18, 0},
+	.version = {1, 19, 0},
 	.module = THIS_MODULE,
 	.ctr    = crypt_ctr,
 	.dtr    = crypt_dtr,
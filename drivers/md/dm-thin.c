@@ -18,7 +18,6 @@
 #include <linux/init.h>
 #include <linux/module.h>
 #include <linux/slab.h>
-#include <linux/vmalloc.h>
 #include <linux/sort.h>
 #include <linux/rbtree.h>
 
@@ -218,7 +217,8 @@ typedef void (*process_bio_fn)(struct thin_c *tc, struct bio *bio);
 typedef void (*process_cell_fn)(struct thin_c *tc, struct dm_bio_prison_cell *cell);
 typedef void (*process_mapping_fn)(struct dm_thin_new_mapping *m);
 
-#define CELL_SORT_ARRAY_SIZE 8192
+/* one array per thin device, sorting the deferred cells in chunks */
+#define CELL_SORT_ARRAY_SIZE 1024
 
 struct pool {
 	struct list_head list;
@@ -241,7 +241,7 @@ struct pool {
 	struct dm_kcopyd_client *copier;
 
 	struct workqueue_struct *wq;
-	struct throttle throttle;
+	struct workqueue_struct *thin_wq;	/* runs the thin workers */
 	struct work_struct worker;
 	struct delayed_work waker;
 	struct delayed_work no_space_timeout;
@@ -259,7 +259,6 @@ struct pool {
 	struct dm_deferred_set *shared_read_ds;
 	struct dm_deferred_set *all_io_ds;
 
-	struct dm_thin_new_mapping *next_mapping;
 	mempool_t *mapping_pool;
 
 	process_bio_fn process_bio;
@@ -271,8 +270,6 @@ struct pool {
 	process_mapping_fn process_prepared_mapping;
 	process_mapping_fn process_prepared_discard;
 	process_mapping_fn process_prepared_discard_pt2;
-
-	struct dm_bio_prison_cell **cell_sort_array;
 };
 
 static enum pool_mode get_pool_mode(struct pool *pool);
@@ -314,6 +311,16 @@ struct thin_c {
 	struct bio_list retry_on_resume_list;
 	struct rb_root sort_bio_list; /* sorted list of deferred bios */
 
+	/*
+	 * The deferred cells and bios of each thin are processed by its own
+	 * worker, so that the thins of a pool are served in parallel.  The
+	 * pool worker keeps the prepared mappings and the commits.
+	 */
+	struct work_struct worker;
+	struct throttle throttle;
+	struct dm_thin_new_mapping *next_mapping;
+	struct dm_bio_prison_cell **cell_sort_array;
+
 	/*
 	 * Ensures the thin is not destroyed until the worker has finished
 	 * iterating the active_thins list.
@@ -399,6 +406,14 @@ static void wake_worker(struct pool *pool)
 	queue_work(pool->wq, &pool->worker);
 }
 
+/*
+ * wake_thin_worker() is used when bios or cells are deferred to a thin.
+ */
+static void wake_thin_worker(struct thin_c *tc)
+{
+	queue_work(tc->pool->thin_wq, &tc->worker);
+}
+
 /*----------------------------------------------------------------*/
 
 static int bio_detain(struct pool *pool, struct dm_cell_key *key, struct bio *bio,
@@ -732,12 +747,15 @@ static void issue(struct thin_c *tc, struct bio *bio)
 	}
 
 	/*
-	 * Batch together any bios that trigger commits and then issue a
-	 * single commit for them in process_deferred_bios().
+	 * Batch together any bios that trigger commits, from all the thins
+	 * of the pool, and then issue a single commit for them in
+	 * process_deferred_bios().
 	 */
 	spin_lock_irqsave(&pool->lock, flags);
 	bio_list_add(&pool->deferred_flush_bios, bio);
 	spin_unlock_irqrestore(&pool->lock, flags);
+
+	wake_worker(pool);
 }
 
 static void remap_to_origin_and_issue(struct thin_c *tc, struct bio *bio)
@@ -849,7 +867,7 @@ static void cell_defer_no_holder(struct thin_c *tc, struct dm_bio_prison_cell *c
 	cell_release_no_holder(pool, cell, &tc->deferred_bio_list);
 	spin_unlock_irqrestore(&tc->lock, flags);
 
-	wake_worker(pool);
+	wake_thin_worker(tc);
 }
 
 static void thin_defer_bio(struct thin_c *tc, struct bio *bio);
@@ -1186,27 +1204,27 @@ static void save_and_set_endio(struct bio *bio, bio_end_io_t **save,
 	bio->bi_end_io = fn;
 }
 
-static int ensure_next_mapping(struct pool *pool)
+static int ensure_next_mapping(struct thin_c *tc)
 {
-	if (pool->next_mapping)
+	if (tc->next_mapping)
 		return 0;
 
-	pool->next_mapping = mempool_alloc(pool->mapping_pool, GFP_ATOMIC);
+	tc->next_mapping = mempool_alloc(tc->pool->mapping_pool, GFP_ATOMIC);
 
-	return pool->next_mapping ? 0 : -ENOMEM;
+	return tc->next_mapping ? 0 : -ENOMEM;
 }
 
-static struct dm_thin_new_mapping *get_next_mapping(struct pool *pool)
+static struct dm_thin_new_mapping *get_next_mapping(struct thin_c *tc)
 {
-	struct dm_thin_new_mapping *m = pool->next_mapping;
+	struct dm_thin_new_mapping *m = tc->next_mapping;
 
-	BUG_ON(!pool->next_mapping);
+	BUG_ON(!tc->next_mapping);
 
 	memset(m, 0, sizeof(struct dm_thin_new_mapping));
 	INIT_LIST_HEAD(&m->list);
 	m->bio = NULL;
 
-	pool->next_mapping = NULL;
+	tc->next_mapping = NULL;
 
 	return m;
 }
@@ -1253,7 +1271,7 @@ static void schedule_copy(struct thin_c *tc, dm_block_t virt_block,
 {
 	int r;
 	struct pool *pool = tc->pool;
-	struct dm_thin_new_mapping *m = get_next_mapping(pool);
+	struct dm_thin_new_mapping *m = get_next_mapping(tc);
 
 	m->tc = tc;
 	m->virt_begin = virt_block;
@@ -1332,7 +1350,7 @@ static void schedule_zero(struct thin_c *tc, dm_block_t virt_block,
 			  struct bio *bio)
 {
 	struct pool *pool = tc->pool;
-	struct dm_thin_new_mapping *m = get_next_mapping(pool);
+	struct dm_thin_new_mapping *m = get_next_mapping(tc);
 
 	atomic_set(&m->prepare_actions, 1); /* no need to quiesce */
 	m->tc = tc;
@@ -1549,7 +1567,7 @@ static void process_discard_cell_no_passdown(struct thin_c *tc,
 					     struct dm_bio_prison_cell *virt_cell)
 {
 	struct pool *pool = tc->pool;
-	struct dm_thin_new_mapping *m = get_next_mapping(pool);
+	struct dm_thin_new_mapping *m = get_next_mapping(tc);
 
 	/*
 	 * We don't need to lock the data blocks, since there's no
@@ -1578,7 +1596,7 @@ static void break_up_discard_bio(struct thin_c *tc, dm_block_t begin, dm_block_t
 	dm_block_t virt_begin, virt_end, data_begin;
 
 	while (begin != end) {
-		r = ensure_next_mapping(pool);
+		r = ensure_next_mapping(tc);
 		if (r)
 			/* we did our best */
 			return;
@@ -1603,7 +1621,7 @@ static void break_up_discard_bio(struct thin_c *tc, dm_block_t begin, dm_block_t
 		 * IO may still be going to the destination block.  We must
 		 * quiesce before we can do the removal.
 		 */
-		m = get_next_mapping(pool);
+		m = get_next_mapping(tc);
 		m->tc = tc;
 		m->maybe_shared = maybe_shared;
 		m->virt_begin = virt_begin;
@@ -2096,7 +2114,7 @@ static void process_thin_deferred_bios(struct thin_c *tc)
 		 * this bio might require one, we pause until there are some
 		 * prepared mappings to process.
 		 */
-		if (ensure_next_mapping(pool)) {
+		if (ensure_next_mapping(tc)) {
 			spin_lock_irqsave(&tc->lock, flags);
 			bio_list_add(&tc->deferred_bio_list, bio);
 			bio_list_merge(&tc->deferred_bio_list, &bios);
@@ -2110,7 +2128,7 @@ static void process_thin_deferred_bios(struct thin_c *tc)
 			pool->process_bio(tc, bio);
 
 		if ((count++ & 127) == 0) {
-			throttle_work_update(&pool->throttle);
+			throttle_work_update(&tc->throttle);
 			dm_pool_issue_prefetches(pool->pmd);
 		}
 	}
@@ -2134,7 +2152,7 @@ static int cmp_cells(const void *lhs, const void *rhs)
 	return 0;
 }
 
-static unsigned sort_cells(struct pool *pool, struct list_head *cells)
+static unsigned sort_cells(struct thin_c *tc, struct list_head *cells)
 {
 	unsigned count = 0;
 	struct dm_bio_prison_cell *cell, *tmp;
@@ -2143,11 +2161,11 @@ static unsigned sort_cells(struct pool *pool, struct list_head *cells)
 		if (count >= CELL_SORT_ARRAY_SIZE)
 			break;
 
-		pool->cell_sort_array[count++] = cell;
+		tc->cell_sort_array[count++] = cell;
 		list_del(&cell->user_list);
 	}
 
-	sort(pool->cell_sort_array, count, sizeof(cell), cmp_cells, NULL);
+	sort(tc->cell_sort_array, count, sizeof(cell), cmp_cells, NULL);
 
 	return count;
 }
@@ -2170,10 +2188,10 @@ static void process_thin_deferred_cells(struct thin_c *tc)
 		return;
 
 	do {
-		count = sort_cells(tc->pool, &cells);
+		count = sort_cells(tc, &cells);
 
 		for (i = 0; i < count; i++) {
-			cell = pool->cell_sort_array[i];
+			cell = tc->cell_sort_array[i];
 			BUG_ON(!cell->holder);
 
 			/*
@@ -2181,9 +2199,9 @@ static void process_thin_deferred_cells(struct thin_c *tc)
 			 * this bio might require one, we pause until there are some
 			 * prepared mappings to process.
 			 */
-			if (ensure_next_mapping(pool)) {
+			if (ensure_next_mapping(tc)) {
 				for (j = i; j < count; j++)
-					list_add(&pool->cell_sort_array[j]->user_list, &cells);
+					list_add(&tc->cell_sort_array[j]->user_list, &cells);
 
 				spin_lock_irqsave(&tc->lock, flags);
 				list_splice(&cells, &tc->deferred_cells);
@@ -2238,6 +2256,25 @@ static struct thin_c *get_next_thin(struct pool *pool, struct thin_c *tc)
 	return NULL;
 }
 
+static bool thin_has_deferred_work(struct thin_c *tc)
+{
+	return !bio_list_empty(&tc->deferred_bio_list) ||
+		!list_empty_careful(&tc->deferred_cells);
+}
+
+static void do_thin_worker(struct work_struct *ws)
+{
+	struct thin_c *tc = container_of(ws, struct thin_c, worker);
+
+	throttle_work_start(&tc->throttle);
+	dm_pool_issue_prefetches(tc->pool->pmd);
+	throttle_work_update(&tc->throttle);
+	process_thin_deferred_cells(tc);
+	throttle_work_update(&tc->throttle);
+	process_thin_deferred_bios(tc);
+	throttle_work_complete(&tc->throttle);
+}
+
 static void process_deferred_bios(struct pool *pool)
 {
 	unsigned long flags;
@@ -2245,12 +2282,16 @@ static void process_deferred_bios(struct pool *pool)
 	struct bio_list bios;
 	struct thin_c *tc;
 
-	tc = get_first_thin(pool);
-	while (tc) {
-		process_thin_deferred_cells(tc);
-		process_thin_deferred_bios(tc);
-		tc = get_next_thin(pool, tc);
-	}
+	/*
+	 * Restart the thins that have work left, either because they ran
+	 * out of new_mapping structs or on pool_resume().  Processing the
+	 * prepared mappings has freed some.
+	 */
+	rcu_read_lock();
+	list_for_each_entry_rcu(tc, &pool->active_thins, list)
+		if (thin_has_deferred_work(tc))
+			wake_thin_worker(tc);
+	rcu_read_unlock();
 
 	/*
 	 * If there are any deferred flush bios, we must commit
@@ -2281,17 +2322,11 @@ static void do_worker(struct work_struct *ws)
 {
 	struct pool *pool = container_of(ws, struct pool, worker);
 
-	throttle_work_start(&pool->throttle);
 	dm_pool_issue_prefetches(pool->pmd);
-	throttle_work_update(&pool->throttle);
 	process_prepared(pool, &pool->prepared_mappings, &pool->process_prepared_mapping);
-	throttle_work_update(&pool->throttle);
 	process_prepared(pool, &pool->prepared_discards, &pool->process_prepared_discard);
-	throttle_work_update(&pool->throttle);
 	process_prepared(pool, &pool->prepared_discards_pt2, &pool->process_prepared_discard_pt2);
-	throttle_work_update(&pool->throttle);
 	process_deferred_bios(pool);
-	throttle_work_complete(&pool->throttle);
 }
 
 /*
@@ -2383,6 +2418,9 @@ static void noflush_work(struct thin_c *tc, void (*fn)(struct work_struct *))
 
 	w.tc = tc;
 	pool_work_wait(&w.pw, tc->pool, fn);
+
+	/* a thin worker may have been running without the new mode */
+	flush_work(&tc->worker);
 }
 
 /*----------------------------------------------------------------*/
@@ -2569,30 +2607,27 @@ static void thin_defer_bio(struct thin_c *tc, struct bio *bio)
 	bio_list_add(&tc->deferred_bio_list, bio);
 	spin_unlock_irqrestore(&tc->lock, flags);
 
-	wake_worker(pool);
+	wake_thin_worker(tc);
 }
 
 static void thin_defer_bio_with_throttle(struct thin_c *tc, struct bio *bio)
 {
-	struct pool *pool = tc->pool;
-
-	throttle_lock(&pool->throttle);
+	throttle_lock(&tc->throttle);
 	thin_defer_bio(tc, bio);
-	throttle_unlock(&pool->throttle);
+	throttle_unlock(&tc->throttle);
 }
 
 static void thin_defer_cell(struct thin_c *tc, struct dm_bio_prison_cell *cell)
 {
 	unsigned long flags;
-	struct pool *pool = tc->pool;
 
-	throttle_lock(&pool->throttle);
+	throttle_lock(&tc->throttle);
 	spin_lock_irqsave(&tc->lock, flags);
 	list_add_tail(&cell->user_list, &tc->deferred_cells);
 	spin_unlock_irqrestore(&tc->lock, flags);
-	throttle_unlock(&pool->throttle);
+	throttle_unlock(&tc->throttle);
 
-	wake_worker(pool);
+	wake_thin_worker(tc);
 }
 
 static void thin_hook_bio(struct thin_c *tc, struct bio *bio)
@@ -2819,18 +2854,17 @@ static void __pool_destroy(struct pool *pool)
 {
 	__pool_table_remove(pool);
 
-	vfree(pool->cell_sort_array);
 	if (dm_pool_metadata_close(pool->pmd) < 0)
 		DMWARN("%s: dm_pool_metadata_close() failed.", __func__);
 
 	dm_bio_prison_destroy(pool->prison);
 	dm_kcopyd_client_destroy(pool->copier);
 
+	if (pool->thin_wq)
+		destroy_workqueue(pool->thin_wq);
 	if (pool->wq)
 		destroy_workqueue(pool->wq);
 
-	if (pool->next_mapping)
-		mempool_free(pool->next_mapping, pool->mapping_pool);
 	mempool_destroy(pool->mapping_pool);
 	dm_deferred_set_destroy(pool->shared_read_ds);
 	dm_deferred_set_destroy(pool->all_io_ds);
@@ -2887,8 +2921,8 @@ static struct pool *pool_create(struct mapped_device *pool_md,
 	}
 
 	/*
-	 * Create singlethreaded workqueue that will service all devices
-	 * that use this metadata.
+	 * Create singlethreaded workqueue that will service the prepared
+	 * mappings and commits of all devices that use this metadata.
 	 */
 	pool->wq = alloc_ordered_workqueue("dm-" DM_MSG_PREFIX, WQ_MEM_RECLAIM);
 	if (!pool->wq) {
@@ -2897,7 +2931,18 @@ static struct pool *pool_create(struct mapped_device *pool_md,
 		goto bad_wq;
 	}
 
-	throttle_init(&pool->throttle);
+	/*
+	 * The deferred bios of the thins are processed in parallel, each
+	 * thin by a single work item at a time.
+	 */
+	pool->thin_wq = alloc_workqueue("dm-" DM_MSG_PREFIX "-dev",
+					WQ_MEM_RECLAIM | WQ_UNBOUND, 0);
+	if (!pool->thin_wq) {
+		*error = "Error creating pool's thin workqueue";
+		err_p = ERR_PTR(-ENOMEM);
+		goto bad_thin_wq;
+	}
+
 	INIT_WORK(&pool->worker, do_worker);
 	INIT_DELAYED_WORK(&pool->waker, do_waker);
 	INIT_DELAYED_WORK(&pool->no_space_timeout, do_no_space_timeout);
@@ -2925,7 +2970,6 @@ static struct pool *pool_create(struct mapped_device *pool_md,
 		goto bad_all_io_ds;
 	}
 
-	pool->next_mapping = NULL;
 	pool->mapping_pool = mempool_create_slab_pool(MAPPING_POOL_SIZE,
 						      _new_mapping_cache);
 	if (!pool->mapping_pool) {
@@ -2934,13 +2978,6 @@ static struct pool *pool_create(struct mapped_device *pool_md,
 		goto bad_mapping_pool;
 	}
 
-	pool->cell_sort_array = vmalloc(sizeof(*pool->cell_sort_array) * CELL_SORT_ARRAY_SIZE);
-	if (!pool->cell_sort_array) {
-		*error = "Error allocating cell sort array";
-		err_p = ERR_PTR(-ENOMEM);
-		goto bad_sort_array;
-	}
-
 	pool->ref_count = 1;
 	pool->last_commit_jiffies = jiffies;
 	pool->pool_md = pool_md;
@@ -2949,13 +2986,13 @@ static struct pool *pool_create(struct mapped_device *pool_md,
 
 	return pool;
 
-bad_sort_array:
-	mempool_destroy(pool->mapping_pool);
 bad_mapping_pool:
 	dm_deferred_set_destroy(pool->all_io_ds);
 bad_all_io_ds:
 	dm_deferred_set_destroy(pool->shared_read_ds);
 bad_shared_read_ds:
+	destroy_workqueue(pool->thin_wq);
+bad_thin_wq:
 	destroy_workqueue(pool->wq);
 bad_wq:
 	dm_kcopyd_client_destroy(pool->copier);
@@ -3532,7 +3569,10 @@ static void pool_postsuspend(struct dm_target *ti)
 
 	cancel_delayed_work_sync(&pool->waker);
 	cancel_delayed_work_sync(&pool->no_space_timeout);
+	/* the pool and thin workers wake each other */
+	flush_workqueue(pool->thin_wq);
 	flush_workqueue(pool->wq);
+	flush_workqueue(pool->thin_wq);
 	(void) commit(pool);
 }
 
@@ -4005,9 +4045,13 @@ static void thin_dtr(struct dm_target *ti)
 
 	thin_put(tc);
 	wait_for_completion(&tc->can_destroy);
+	flush_work(&tc->worker);
 
 	mutex_lock(&dm_thin_pool_table.mutex);
 
+	if (tc->next_mapping)
+		mempool_free(tc->next_mapping, tc->pool->mapping_pool);
+	kfree(tc->cell_sort_array);
 	__pool_dec(tc->pool);
 	dm_pool_close_thin_device(tc->td);
 	dm_put_device(ti, tc->pool_dev);
@@ -4058,6 +4102,17 @@ static int thin_ctr(struct dm_target *ti, unsigned argc, char **argv)
 	bio_list_init(&tc->deferred_bio_list);
 	bio_list_init(&tc->retry_on_resume_list);
 	tc->sort_bio_list = RB_ROOT;
+	INIT_WORK(&tc->worker, do_thin_worker);
+	throttle_init(&tc->throttle);
+
+	tc->cell_sort_array = kmalloc_array(CELL_SORT_ARRAY_SIZE,
+					    sizeof(*tc->cell_sort_array),
+					    GFP_KERNEL);
+	if (!tc->cell_sort_array) {
+		ti->error = "Error allocating cell sort array";
+		r = -ENOMEM;
+		goto bad_sort_array;
+	}
 
 	if (argc == 3) {
 		r = dm_get_device(ti, argv[2], FMODE_READ, &origin_dev);
@@ -4161,6 +4216,8 @@ static int thin_ctr(struct dm_target *ti, unsigned argc, char **argv)
 	if (tc->origin_dev)
 		dm_put_device(ti, tc->origin_dev);
 bad_origin_dev:
+	kfree(tc->cell_sort_array);
+bad_sort_array:
 	kfree(tc);
 out_unlock:
 	mutex_unlock(&dm_thin_pool_table.mutex);
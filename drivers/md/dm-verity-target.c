@@ -32,20 +32,19 @@
 #define DM_VERITY_OPT_LOGGING		"ignore_corruption"
 #define DM_VERITY_OPT_RESTART		"restart_on_corruption"
 #define DM_VERITY_OPT_IGN_ZEROES	"ignore_zero_blocks"
+#define DM_VERITY_OPT_HIGHPRI		"highpri_small_io"
 
-#define DM_VERITY_OPTS_MAX		(2 + DM_VERITY_OPTS_FEC)
+#define DM_VERITY_OPTS_MAX		(3 + DM_VERITY_OPTS_FEC)
+
+/* the lanes of the multi-buffer sha256 */
+#define DM_VERITY_MB_BLOCKS		8
+
+#define DM_VERITY_SMALL_IO_SIZE		32768
 
 static unsigned dm_verity_prefetch_cluster = DM_VERITY_DEFAULT_PREFETCH_SIZE;
 
 module_param_named(prefetch_cluster, dm_verity_prefetch_cluster, uint, S_IRUGO | S_IWUSR);
 
-struct dm_verity_prefetch_work {
-	struct work_struct work;
-	struct dm_verity *v;
-	sector_t block;
-	unsigned n_blocks;
-};
-
 /*
  * Auxiliary structure appended to each dm-bufio buffer. If the value
  * hash_verified is nonzero, hash of the block has been verified.
@@ -473,6 +472,192 @@ static int verity_bv_zero(struct dm_verity *v, struct dm_verity_io *io,
 	return 0;
 }
 
+/*
+ * Hash the data block at io->iter, salted, into digest.
+ */
+static int verity_hash_io_block(struct dm_verity *v, struct dm_verity_io *io,
+				struct ahash_request *req, u8 *digest,
+				struct verity_result *res)
+{
+	int r;
+
+	r = verity_hash_init(v, req, res);
+	if (unlikely(r < 0))
+		return r;
+
+	r = verity_for_io_block(v, io, &io->iter, res);
+	if (unlikely(r < 0))
+		return r;
+
+	return verity_hash_final(v, req, digest, res);
+}
+
+/*
+ * State of a data block in a hashing batch.  With an asynchronous hash, like
+ * the multi-buffer sha256, the hashes of a batch are all started before
+ * waiting for the first one, so that the implementation can process them
+ * in parallel.
+ */
+struct verity_mb_block {
+	struct verity_result res;
+	struct bvec_iter start;
+	int r;
+	bool is_zero;
+	struct ahash_request *req;
+	u8 *real_digest;
+	u8 *want_digest;
+	struct scatterlist *sg;
+};
+
+static struct verity_mb_block *verity_alloc_mb(struct dm_verity *v)
+{
+	size_t hdr = ALIGN(v->mb_blocks * sizeof(struct verity_mb_block),
+			   CRYPTO_MINALIGN);
+	struct verity_mb_block *blk;
+	u8 *p;
+	unsigned i;
+
+	blk = kmalloc(hdr + v->mb_blocks * v->mb_block_size, GFP_NOIO |
+		      __GFP_NORETRY | __GFP_NOMEMALLOC | __GFP_NOWARN);
+	if (!blk)
+		return NULL;
+
+	p = (u8 *)blk + hdr;
+	for (i = 0; i < v->mb_blocks; i++, p += v->mb_block_size) {
+		blk[i].req = (struct ahash_request *)p;
+		blk[i].real_digest = p + v->ahash_reqsize;
+		blk[i].want_digest = blk[i].real_digest + v->digest_size;
+		blk[i].sg = PTR_ALIGN((struct scatterlist *)
+				      (blk[i].want_digest + v->digest_size),
+				      __alignof__(struct scatterlist));
+	}
+
+	return blk;
+}
+
+/*
+ * Find the expected digest of a data block and start hashing it.
+ */
+static int verity_mb_start_block(struct dm_verity *v, struct dm_verity_io *io,
+				 sector_t block, struct verity_mb_block *blk)
+{
+	struct bio *bio = dm_bio_from_per_bio_data(io, v->ti->per_io_data_size);
+	unsigned todo = 1 << v->data_dev_block_bits;
+	unsigned nents = 0, len;
+	int r;
+
+	r = verity_hash_for_block(v, io, block, blk->want_digest,
+				  &blk->is_zero);
+	if (unlikely(r < 0))
+		return r;
+
+	blk->start = io->iter;
+	blk->r = 0;
+
+	/* If we expect a zero block, don't validate, just return zeros. */
+	if (blk->is_zero)
+		return verity_for_bv_block(v, io, &io->iter, verity_bv_zero);
+
+	len = todo + v->salt_size;
+	sg_init_table(blk->sg, v->mb_sg_nents);
+	if (v->salt_size && v->version >= 1)
+		sg_set_buf(&blk->sg[nents++], v->salt, v->salt_size);
+
+	do {
+		struct bio_vec bv = bio_iter_iovec(bio, io->iter);
+		unsigned bv_len = min(bv.bv_len, todo);
+
+		/* keep room for a trailing salt */
+		if (unlikely(nents + 1 >= v->mb_sg_nents)) {
+			io->iter = blk->start;
+			blk->r = verity_hash_io_block(v, io, blk->req,
+						      blk->real_digest,
+						      &blk->res);
+			return 0;
+		}
+
+		sg_set_page(&blk->sg[nents++], bv.bv_page, bv_len,
+			    bv.bv_offset);
+		bio_advance_iter(bio, &io->iter, bv_len);
+		todo -= bv_len;
+	} while (todo);
+
+	if (v->salt_size && !v->version)
+		sg_set_buf(&blk->sg[nents++], v->salt, v->salt_size);
+	sg_mark_end(&blk->sg[nents - 1]);
+
+	ahash_request_set_tfm(blk->req, v->tfm);
+	ahash_request_set_callback(blk->req, CRYPTO_TFM_REQ_MAY_SLEEP |
+				   CRYPTO_TFM_REQ_MAY_BACKLOG,
+				   verity_op_done, (void *)&blk->res);
+	init_completion(&blk->res.completion);
+	ahash_request_set_crypt(blk->req, blk->sg, blk->real_digest, len);
+
+	/* waited for, and checked, by verity_mb_wait_block() */
+	blk->r = crypto_ahash_digest(blk->req);
+	return 0;
+}
+
+static int verity_mb_wait_block(struct dm_verity *v, struct dm_verity_io *io,
+				sector_t block, struct verity_mb_block *blk,
+				bool check)
+{
+	int r;
+
+	if (blk->is_zero)
+		return 0;
+
+	r = verity_complete_op(&blk->res, blk->r);
+	if (unlikely(r < 0) || !check)
+		return r;
+
+	if (likely(memcmp(blk->real_digest, blk->want_digest,
+			  v->digest_size) == 0))
+		return 0;
+	else if (verity_fec_decode(v, io, DM_VERITY_BLOCK_TYPE_DATA,
+				   block, NULL, &blk->start) == 0)
+		return 0;
+	else if (verity_handle_err(v, DM_VERITY_BLOCK_TYPE_DATA, block))
+		return -EIO;
+
+	return 0;
+}
+
+/*
+ * Verify one "dm_verity_io" structure in batches of v->mb_blocks blocks.
+ */
+static int verity_verify_io_mb(struct dm_verity_io *io,
+			       struct verity_mb_block *blk)
+{
+	struct dm_verity *v = io->v;
+	unsigned b, i, n;
+	int r = 0;
+
+	for (b = 0; b < io->n_blocks && !r; b += n) {
+		n = min(io->n_blocks - b, v->mb_blocks);
+
+		for (i = 0; i < n; i++) {
+			r = verity_mb_start_block(v, io, io->block + b + i,
+						  &blk[i]);
+			if (unlikely(r < 0)) {
+				n = i;
+				break;
+			}
+		}
+
+		/* the requests of the batch must all be finished */
+		for (i = 0; i < n; i++) {
+			int wr = verity_mb_wait_block(v, io, io->block + b + i,
+						      &blk[i], !r);
+
+			if (!r)
+				r = wr;
+		}
+	}
+
+	return r;
+}
+
 /*
  * Verify one "dm_verity_io" structure.
  */
@@ -484,6 +669,18 @@ static int verity_verify_io(struct dm_verity_io *io)
 	unsigned b;
 	struct verity_result res;
 
+	if (v->mb_blocks && io->n_blocks > 1) {
+		struct verity_mb_block *blk = verity_alloc_mb(v);
+
+		/* on allocation failure, verify the blocks one by one */
+		if (blk) {
+			int r = verity_verify_io_mb(io, blk);
+
+			kfree(blk);
+			return r;
+		}
+	}
+
 	for (b = 0; b < io->n_blocks; b++) {
 		int r;
 		struct ahash_request *req = verity_io_hash_req(v, io);
@@ -507,17 +704,9 @@ static int verity_verify_io(struct dm_verity_io *io)
 			continue;
 		}
 
-		r = verity_hash_init(v, req, &res);
-		if (unlikely(r < 0))
-			return r;
-
 		start = io->iter;
-		r = verity_for_io_block(v, io, &io->iter, &res);
-		if (unlikely(r < 0))
-			return r;
-
-		r = verity_hash_final(v, req, verity_io_real_digest(v, io),
-					&res);
+		r = verity_hash_io_block(v, io, req,
+					 verity_io_real_digest(v, io), &res);
 		if (unlikely(r < 0))
 			return r;
 
@@ -568,26 +757,33 @@ static void verity_end_io(struct bio *bio)
 	}
 
 	INIT_WORK(&io->work, verity_work);
-	queue_work(io->v->verify_wq, &io->work);
+	if (io->v->highpri_wq &&
+	    io->n_blocks << io->v->data_dev_block_bits <=
+	    DM_VERITY_SMALL_IO_SIZE)
+		queue_work(io->v->highpri_wq, &io->work);
+	else
+		queue_work(io->v->verify_wq, &io->work);
 }
 
 /*
  * Prefetch buffers for the specified io.
  * The root buffer is not prefetched, it is assumed that it will be cached
  * all the time.
+ *
+ * This is called from the map function, so that the hash blocks of the
+ * whole bio are read along with the data rather than after a trip through
+ * the workqueue which may leave them to be read synchronously by
+ * verity_verify_io().  dm_bufio_prefetch() does not wait for buffers.
  */
-static void verity_prefetch_io(struct work_struct *work)
+static void verity_prefetch_io(struct dm_verity *v, struct dm_verity_io *io)
 {
-	struct dm_verity_prefetch_work *pw =
-		container_of(work, struct dm_verity_prefetch_work, work);
-	struct dm_verity *v = pw->v;
 	int i;
 
 	for (i = v->levels - 2; i >= 0; i--) {
 		sector_t hash_block_start;
 		sector_t hash_block_end;
-		verity_hash_at_level(v, pw->block, i, &hash_block_start, NULL);
-		verity_hash_at_level(v, pw->block + pw->n_blocks - 1, i, &hash_block_end, NULL);
+		verity_hash_at_level(v, io->block, i, &hash_block_start, NULL);
+		verity_hash_at_level(v, io->block + io->n_blocks - 1, i, &hash_block_end, NULL);
 		if (!i) {
 			unsigned cluster = ACCESS_ONCE(dm_verity_prefetch_cluster);
 
@@ -607,25 +803,6 @@ static void verity_prefetch_io(struct work_struct *work)
 		dm_bufio_prefetch(v->bufio, hash_block_start,
 				  hash_block_end - hash_block_start + 1);
 	}
-
-	kfree(pw);
-}
-
-static void verity_submit_prefetch(struct dm_verity *v, struct dm_verity_io *io)
-{
-	struct dm_verity_prefetch_work *pw;
-
-	pw = kmalloc(sizeof(struct dm_verity_prefetch_work),
-		GFP_NOIO | __GFP_NORETRY | __GFP_NOMEMALLOC | __GFP_NOWARN);
-
-	if (!pw)
-		return;
-
-	INIT_WORK(&pw->work, verity_prefetch_io);
-	pw->v = v;
-	pw->block = io->block;
-	pw->n_blocks = io->n_blocks;
-	queue_work(v->verify_wq, &pw->work);
 }
 
 /*
@@ -667,7 +844,7 @@ static int verity_map(struct dm_target *ti, struct bio *bio)
 
 	verity_fec_init_io(io);
 
-	verity_submit_prefetch(v, io);
+	verity_prefetch_io(v, io);
 
 	generic_make_request(bio);
 
@@ -714,6 +891,8 @@ static void verity_status(struct dm_target *ti, status_type_t type,
 			args += DM_VERITY_OPTS_FEC;
 		if (v->zero_digest)
 			args++;
+		if (v->highpri_wq)
+			args++;
 		if (!args)
 			return;
 		DMEMIT(" %u", args);
@@ -732,6 +911,8 @@ static void verity_status(struct dm_target *ti, status_type_t type,
 		}
 		if (v->zero_digest)
 			DMEMIT(" " DM_VERITY_OPT_IGN_ZEROES);
+		if (v->highpri_wq)
+			DMEMIT(" " DM_VERITY_OPT_HIGHPRI);
 		sz = verity_fec_status_table(v, sz, result, maxlen);
 		break;
 	}
@@ -778,6 +959,9 @@ static void verity_dtr(struct dm_target *ti)
 	if (v->verify_wq)
 		destroy_workqueue(v->verify_wq);
 
+	if (v->highpri_wq)
+		destroy_workqueue(v->highpri_wq);
+
 	if (v->bufio)
 		dm_bufio_client_destroy(v->bufio);
 
@@ -870,6 +1054,19 @@ static int verity_parse_opt_args(struct dm_arg_set *as, struct dm_verity *v)
 			}
 			continue;
 
+		} else if (!strcasecmp(arg_name, DM_VERITY_OPT_HIGHPRI)) {
+			if (v->highpri_wq)
+				continue;
+			/* bound, to verify on the cpu completing the bio */
+			v->highpri_wq = alloc_workqueue("kverityd_highpri",
+							WQ_HIGHPRI |
+							WQ_MEM_RECLAIM, 0);
+			if (!v->highpri_wq) {
+				ti->error = "Cannot allocate workqueue";
+				return -ENOMEM;
+			}
+			continue;
+
 		} else if (verity_is_fec_opt_arg(arg_name)) {
 			r = verity_fec_parse_opt_args(as, v, &argc, arg_name);
 			if (r)
@@ -1020,6 +1217,21 @@ static int verity_ctr(struct dm_target *ti, unsigned argc, char **argv)
 	v->ahash_reqsize = sizeof(struct ahash_request) +
 		crypto_ahash_reqsize(v->tfm);
 
+	/*
+	 * An asynchronous hash gets the data blocks of a bio in batches, a
+	 * scatterlist holding the salt and the bio_vecs of each block.
+	 */
+	if (crypto_ahash_tfm(v->tfm)->__crt_alg->cra_flags & CRYPTO_ALG_ASYNC) {
+		v->mb_blocks = DM_VERITY_MB_BLOCKS;
+		v->mb_sg_nents = 2 +
+			(1 << (v->data_dev_block_bits - SECTOR_SHIFT));
+		v->mb_block_size = ALIGN(v->ahash_reqsize + v->digest_size * 2,
+					 __alignof__(struct scatterlist));
+		v->mb_block_size = ALIGN(v->mb_block_size + v->mb_sg_nents *
+					 sizeof(struct scatterlist),
+					 CRYPTO_MINALIGN);
+	}
+
 	v->root_digest = kmalloc(v->digest_size, GFP_KERNEL);
 	if (!v->root_digest) {
 		ti->error = "Cannot allocate root digest";
@@ -1137,7 +1349,7 @@ static int verity_ctr(struct dm_target *ti, unsigned argc, char **argv)
 
 static struct target_type verity_target = {
 	.name		= "verity",
-	.version	= {1, 3, 0},
+	.version	= {1, 4, 0},
 	.module		= THIS_MODULE,
 	.ctr		= verity_ctr,
 	.dtr		= verity_dtr,
@@ -56,8 +56,12 @@ struct dm_verity {
 	int hash_failed;	/* set to 1 if hash of any block failed */
 	enum verity_mode mode;	/* mode for handling verification errors */
 	unsigned corrupted_errs;/* Number of errors for corrupted blocks */
+	unsigned mb_blocks;	/* data blocks hashed concurrently, or 0 */
+	unsigned mb_sg_nents;	/* scatterlist entries for a data block */
+	unsigned mb_block_size;	/* per block space of a hashing batch */
 
 	struct workqueue_struct *verify_wq;
+	struct workqueue_struct *highpri_wq;	/* for small ios, or NULL */
 
 	/* starting blocks for each tree level. 0 is the lowest level. */
 	sector_t hash_level_block[DM_VERITY_MAX_LEVELS];
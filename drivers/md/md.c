@@ -3308,6 +3308,15 @@ ppl_size_store(struct md_rdev *rdev, const char *buf, size_t len)
 static struct rdev_sysfs_entry rdev_ppl_size =
 __ATTR(ppl_size, S_IRUGO|S_IWUSR, ppl_size_show, ppl_size_store);
 
+static ssize_t
+read_latency_show(struct md_rdev *rdev, char *page)
+{
+	return sprintf(page, "%llu\n",
+		       div_u64(md_rdev_read_lat(rdev), NSEC_PER_USEC));
+}
+static struct rdev_sysfs_entry rdev_read_latency =
+__ATTR_RO(read_latency);
+
 static struct attribute *rdev_default_attrs[] = {
 	&rdev_state.attr,
 	&rdev_errors.attr,
@@ -3320,6 +3329,7 @@ static struct attribute *rdev_default_attrs[] = {
 	&rdev_unack_bad_blocks.attr,
 	&rdev_ppl_sector.attr,
 	&rdev_ppl_size.attr,
+	&rdev_read_latency.attr,
 	NULL,
 };
 static ssize_t
@@ -5091,6 +5101,32 @@ static struct md_sysfs_entry md_consistency_policy =
 __ATTR(consistency_policy, S_IRUGO | S_IWUSR, consistency_policy_show,
        consistency_policy_store);
 
+static const char * const read_policy_names[] = {
+	[MD_READ_POLICY_DISTANCE]	= "distance",
+	[MD_READ_POLICY_LATENCY]	= "latency",
+};
+
+static ssize_t
+read_policy_show(struct mddev *mddev, char *page)
+{
+	return sprintf(page, "%s\n",
+		       read_policy_names[READ_ONCE(mddev->read_policy)]);
+}
+
+static ssize_t
+read_policy_store(struct mddev *mddev, const char *buf, size_t len)
+{
+	int policy = sysfs_match_string(read_policy_names, buf);
+
+	if (policy < 0)
+		return policy;
+	WRITE_ONCE(mddev->read_policy, policy);
+	return len;
+}
+
+static struct md_sysfs_entry md_read_policy =
+__ATTR(read_policy, S_IRUGO | S_IWUSR, read_policy_show, read_policy_store);
+
 static struct attribute *md_default_attrs[] = {
 	&md_level.attr,
 	&md_layout.attr,
@@ -5125,6 +5161,7 @@ static struct attribute *md_redundancy_attrs[] = {
 	&md_suspend_hi.attr,
 	&md_bitmap.attr,
 	&md_degraded.attr,
+	&md_read_policy.attr,
 	NULL,
 };
 static struct attribute_group md_redundancy_group = {
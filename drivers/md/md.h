@@ -116,6 +116,10 @@ struct md_rdev {
 					   * for reporting to userspace and storing
 					   * in superblock.
 					   */
+	u64		read_lat;	/* EWMA of the read completion latency
+					 * in ns, for MD_READ_POLICY_LATENCY
+					 */
+	unsigned long	read_lat_stamp;	/* jiffies of its last sample */
 	struct work_struct del_work;	/* used for delayed sysfs removal */
 
 	struct kernfs_node *sysfs_state; /* handle for 'state'
@@ -348,6 +352,9 @@ struct mddev {
 
 	int				ok_start_degraded;
 
+	/* how raid1 and raid10 choose the member to read from */
+	int				read_policy;
+
 	unsigned long			recovery;
 	/* If a RAID personality determines that recovery (of a particular
 	 * device) will fail due to a read error on the source device, it
@@ -712,6 +719,56 @@ static inline void rdev_dec_pending(struct md_rdev *rdev, struct mddev *mddev)
 	}
 }
 
+/* values of mddev->read_policy */
+enum md_read_policy {
+	MD_READ_POLICY_DISTANCE,	/* head distance, pending on SSDs */
+	MD_READ_POLICY_LATENCY,		/* read latency times in flight */
+};
+
+/* weight of a new sample in rdev->read_lat, as a shift */
+#define MD_READ_LAT_SHIFT	3
+/* the estimate of a member without completions halves at this period */
+#define MD_READ_LAT_DECAY	(HZ / 10)
+/* a sequential stream stays on its member until it is this much worse */
+#define MD_READ_SEQ_SLACK	4
+
+/*
+ * Latency estimate of @rdev.  It decays while no read completes there, so
+ * that a member avoided during a slow phase (e.g. garbage collection) is
+ * tried again later.
+ */
+static inline u64 md_rdev_read_lat(struct md_rdev *rdev)
+{
+	unsigned long idle = jiffies - READ_ONCE(rdev->read_lat_stamp);
+	unsigned long shift = idle / MD_READ_LAT_DECAY;
+
+	return shift < 64 ? READ_ONCE(rdev->read_lat) >> shift : 0;
+}
+
+/* cost of sending one more read to @rdev, lowest is best */
+static inline u64 md_rdev_read_score(struct md_rdev *rdev)
+{
+	return (md_rdev_read_lat(rdev) + 1) *
+		(atomic_read(&rdev->nr_pending) + 1);
+}
+
+/* account a successful read issued at @start_ns, 0 when not tracked */
+static inline void md_rdev_read_done(struct md_rdev *rdev, u64 start_ns)
+{
+	u64 now, lat;
+
+	if (!start_ns)
+		return;
+	now = ktime_get_ns();
+	lat = md_rdev_read_lat(rdev);
+	if (now > start_ns)
+		lat = lat ? lat - (lat >> MD_READ_LAT_SHIFT) +
+			((now - start_ns) >> MD_READ_LAT_SHIFT) :
+			now - start_ns;
+	WRITE_ONCE(rdev->read_lat, lat);
+	WRITE_ONCE(rdev->read_lat_stamp, jiffies);
+}
+
 extern struct md_cluster_operations *md_cluster_ops;
 static inline int mddev_is_clustered(struct mddev *mddev)
 {
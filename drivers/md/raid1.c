@@ -338,9 +338,10 @@ static void raid1_end_read_request(struct bio *bio)
 	 */
 	update_head_pos(r1_bio->read_disk, r1_bio);
 
-	if (uptodate)
+	if (uptodate) {
 		set_bit(R1BIO_Uptodate, &r1_bio->state);
-	else if (test_bit(FailFast, &rdev->flags) &&
+		md_rdev_read_done(rdev, r1_bio->read_start);
+	} else if (test_bit(FailFast, &rdev->flags) &&
 		 test_bit(R1BIO_FailFast, &r1_bio->state))
 		/* This was a fail-fast read so we definitely
 		 * want to retry */
@@ -567,6 +568,9 @@ static int read_balance(struct r1conf *conf, struct r1bio *r1_bio, int *max_sect
 	struct md_rdev *rdev;
 	int choose_first;
 	int choose_next_idle;
+	bool latency;
+	int best_lat_disk, seq_disk;
+	u64 best_score, seq_score;
 
 	rcu_read_lock();
 	/*
@@ -584,6 +588,12 @@ static int read_balance(struct r1conf *conf, struct r1bio *r1_bio, int *max_sect
 	best_good_sectors = 0;
 	has_nonrot_disk = 0;
 	choose_next_idle = 0;
+	latency = READ_ONCE(conf->mddev->read_policy) ==
+		MD_READ_POLICY_LATENCY;
+	best_lat_disk = -1;
+	seq_disk = -1;
+	best_score = U64_MAX;
+	seq_score = U64_MAX;
 	clear_bit(R1BIO_FailFast, &r1_bio->state);
 
 	if ((conf->mddev->recovery_cp < this_sector + sectors) ||
@@ -673,6 +683,21 @@ static int read_balance(struct r1conf *conf, struct r1bio *r1_bio, int *max_sect
 			best_disk = disk;
 			break;
 		}
+
+		if (latency) {
+			u64 score = md_rdev_read_score(rdev);
+
+			if (conf->mirrors[disk].next_seq_sect == this_sector) {
+				seq_disk = disk;
+				seq_score = score;
+			}
+			if (score < best_score) {
+				best_score = score;
+				best_lat_disk = disk;
+			}
+			continue;
+		}
+
 		/* Don't change to another disk for sequential reads */
 		if (conf->mirrors[disk].next_seq_sect == this_sector
 		    || dist == 0) {
@@ -724,6 +749,15 @@ static int read_balance(struct r1conf *conf, struct r1bio *r1_bio, int *max_sect
 	 * disk is rotational, which might/might not be optimal for raids with
 	 * mixed ratation/non-rotational disks depending on workload.
 	 */
+	if (best_disk == -1 && best_lat_disk >= 0) {
+		/* keep a sequential stream, and its readahead, on its member */
+		if (seq_disk >= 0 &&
+		    seq_score / MD_READ_SEQ_SLACK <= best_score)
+			best_disk = seq_disk;
+		else
+			best_disk = best_lat_disk;
+	}
+
 	if (best_disk == -1) {
 		if (has_nonrot_disk || min_pending == 0)
 			best_disk = best_pending_disk;
@@ -742,6 +776,7 @@ static int read_balance(struct r1conf *conf, struct r1bio *r1_bio, int *max_sect
 			conf->mirrors[best_disk].seq_start = this_sector;
 
 		conf->mirrors[best_disk].next_seq_sect = this_sector + sectors;
+		r1_bio->read_start = latency ? ktime_get_ns() : 0;
 	}
 	rcu_read_unlock();
 	*max_sectors = sectors;
@@ -155,6 +155,7 @@ struct r1bio {
 	 * if the IO is in READ direction, then this is where we read
 	 */
 	int			read_disk;
+	u64			read_start; /* ns, for read_policy latency */
 
 	struct list_head	retry_list;
 
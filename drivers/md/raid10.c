@@ -406,6 +406,7 @@ static void raid10_end_read_request(struct bio *bio)
 		 * wait for the 'master' bio.
 		 */
 		set_bit(R10BIO_Uptodate, &r10_bio->state);
+		md_rdev_read_done(rdev, r10_bio->read_start);
 	} else {
 		/* If all other devices that store this block have
 		 * failed, we want to return the error upwards rather
@@ -745,6 +746,10 @@ static struct md_rdev *read_balance(struct r10conf *conf,
 	int do_balance;
 	int best_slot;
 	struct geom *geo = &conf->geo;
+	bool latency;
+	int seq_slot = -1;
+	struct md_rdev *seq_rdev = NULL;
+	u64 best_score = U64_MAX, seq_score = U64_MAX;
 
 	raid10_find_phys(conf, r10_bio);
 	rcu_read_lock();
@@ -754,6 +759,8 @@ static struct md_rdev *read_balance(struct r10conf *conf,
 	best_dist = MaxSector;
 	best_good_sectors = 0;
 	do_balance = 1;
+	latency = READ_ONCE(conf->mddev->read_policy) ==
+		MD_READ_POLICY_LATENCY;
 	clear_bit(R10BIO_FailFast, &r10_bio->state);
 	/*
 	 * Check if we can balance. We can balance on the whole
@@ -822,6 +829,25 @@ static struct md_rdev *read_balance(struct r10conf *conf,
 		if (best_slot >= 0)
 			/* At least 2 disks to choose from so failfast is OK */
 			set_bit(R10BIO_FailFast, &r10_bio->state);
+
+		if (latency) {
+			u64 score = md_rdev_read_score(rdev);
+
+			if (conf->mirrors[disk].next_seq_sect == dev_sector) {
+				seq_score = score;
+				seq_slot = slot;
+				seq_rdev = rdev;
+			}
+			/* best_dist only says a good slot was found */
+			if (score < best_score) {
+				best_score = score;
+				best_dist = 0;
+				best_slot = slot;
+				best_rdev = rdev;
+			}
+			continue;
+		}
+
 		/* This optimisation is debatable, and completely destroys
 		 * sequential read speed for 'far copies' arrays.  So only
 		 * keep it for 'near' arrays, and review those later.
@@ -844,11 +870,21 @@ static struct md_rdev *read_balance(struct r10conf *conf,
 	if (slot >= conf->copies) {
 		slot = best_slot;
 		rdev = best_rdev;
+		/* keep a sequential stream, and its readahead, on its member */
+		if (seq_slot >= 0 && seq_slot != slot &&
+		    seq_score / MD_READ_SEQ_SLACK <= best_score) {
+			slot = seq_slot;
+			rdev = seq_rdev;
+		}
 	}
 
 	if (slot >= 0) {
 		atomic_inc(&rdev->nr_pending);
 		r10_bio->read_slot = slot;
+		disk = r10_bio->devs[slot].devnum;
+		conf->mirrors[disk].next_seq_sect =
+			r10_bio->devs[slot].addr + best_good_sectors;
+		r10_bio->read_start = latency ? ktime_get_ns() : 0;
 	} else
 		rdev = NULL;
 	rcu_read_unlock();
@@ -5,6 +5,8 @@
 struct raid10_info {
 	struct md_rdev	*rdev, *replacement;
 	sector_t	head_position;
+	/* keeps sequential reads on one device, for read_policy latency */
+	sector_t	next_seq_sect;
 	int		recovery_disabled;	/* matches
 						 * mddev->recovery_disabled
 						 * when we shouldn't try
@@ -114,6 +116,7 @@ struct r10bio {
 	 * if the IO is in READ direction, then this is where we read
 	 */
 	int			read_slot;
+	u64			read_start; /* ns, for read_policy latency */
 
 	struct list_head	retry_list;
 	/*
@@ -427,7 +427,7 @@ static inline void remove_hash(struct stripe_head *sh)
 	pr_debug("remove_hash(), stripe %llu\n",
 		(unsigned long long)sh->sector);
 
-	hlist_del_init(&sh->hash);
+	hlist_del_init_rcu(&sh->hash);
 }
 
 static inline void insert_hash(struct r5conf *conf, struct stripe_head *sh)
@@ -437,7 +437,7 @@ static inline void insert_hash(struct r5conf *conf, struct stripe_head *sh)
 	pr_debug("insert_hash(), stripe %llu\n",
 		(unsigned long long)sh->sector);
 
-	hlist_add_head(&sh->hash, hp);
+	hlist_add_head_rcu(&sh->hash, hp);
 }
 
 /* find an idle stripe, make sure it is unhashed, and return it. */
@@ -552,6 +552,42 @@ static struct stripe_head *__find_stripe(struct r5conf *conf, sector_t sector,
 	return NULL;
 }
 
+/*
+ * Take a reference on the cached stripe of @sector without the hash lock,
+ * when the stripe is already active.  Stripes come from a
+ * SLAB_TYPESAFE_BY_RCU cache and an inactive one can be reused for another
+ * sector at any time, so it is checked again once its count is held.  A
+ * miss, including one caused by a stripe moving to another hash chain under
+ * us, only means taking the locked path.
+ */
+static struct stripe_head *find_get_active_stripe(struct r5conf *conf,
+						  sector_t sector,
+						  short generation)
+{
+	struct stripe_head *sh;
+
+	rcu_read_lock();
+	hlist_for_each_entry_rcu(sh, stripe_hash(conf, sector), hash) {
+		if (READ_ONCE(sh->sector) != sector ||
+		    READ_ONCE(sh->generation) != generation)
+			continue;
+		if (!atomic_inc_not_zero(&sh->count))
+			break;
+		rcu_read_unlock();
+
+		/* the count is held, the stripe can't be reused any more */
+		if (sh->sector != sector || sh->generation != generation ||
+		    hlist_unhashed(&sh->hash)) {
+			raid5_release_stripe(sh);
+			return NULL;
+		}
+		this_cpu_inc(conf->percpu->lockless_lookups);
+		return sh;
+	}
+	rcu_read_unlock();
+	return NULL;
+}
+
 /*
  * Need to check if array has failed when deciding whether to:
  *  - start an array
@@ -644,6 +680,18 @@ raid5_get_active_stripe(struct r5conf *conf, sector_t sector,
 
 	pr_debug("get_stripe, sector %llu\n", (unsigned long long)sector);
 
+	if (noquiesce || !READ_ONCE(conf->quiesce)) {
+		sh = find_get_active_stripe(conf, sector,
+					    conf->generation - previous);
+		/* raid5_quiesce() sets ->quiesce under all the hash locks */
+		if (sh && !noquiesce && READ_ONCE(conf->quiesce)) {
+			raid5_release_stripe(sh);
+			sh = NULL;
+		}
+		if (sh)
+			return sh;
+	}
+
 	spin_lock_irq(conf->hash_locks + hash);
 
 	do {
@@ -758,6 +806,10 @@ static void stripe_add_to_batch_list(struct r5conf *conf, struct stripe_head *sh
 		return;
 	head_sector = sh->sector - STRIPE_SECTORS;
 
+	head = find_get_active_stripe(conf, head_sector, conf->generation);
+	if (head)
+		goto got_head;
+
 	hash = stripe_hash_locks_hash(head_sector);
 	spin_lock_irq(conf->hash_locks + hash);
 	head = __find_stripe(conf, head_sector, conf->generation);
@@ -784,6 +836,7 @@ static void stripe_add_to_batch_list(struct r5conf *conf, struct stripe_head *sh
 	}
 	spin_unlock_irq(conf->hash_locks + hash);
 
+got_head:
 	if (!head)
 		return;
 	if (!stripe_can_batch(head))
@@ -832,7 +885,9 @@ static void stripe_add_to_batch_list(struct r5conf *conf, struct stripe_head *sh
 		spin_lock(&head->batch_lock);
 		list_add_tail(&sh->batch_list, &head->batch_list);
 		spin_unlock(&head->batch_lock);
+		this_cpu_inc(conf->percpu->batches);
 	}
+	this_cpu_inc(conf->percpu->batched_stripes);
 
 	if (test_and_clear_bit(STRIPE_PREREAD_ACTIVE, &sh->state))
 		if (atomic_dec_return(&conf->preread_active_stripes)
@@ -2205,9 +2260,10 @@ static int grow_stripes(struct r5conf *conf, int num)
 	sprintf(conf->cache_name[1], "%s-alt", conf->cache_name[0]);
 
 	conf->active_name = 0;
+	/* typesafe for find_get_active_stripe() */
 	sc = kmem_cache_create(conf->cache_name[conf->active_name],
 			       sizeof(struct stripe_head)+(devs-1)*sizeof(struct r5dev),
-			       0, 0, NULL);
+			       0, SLAB_TYPESAFE_BY_RCU, NULL);
 	if (!sc)
 		return 1;
 	conf->slab_cache = sc;
@@ -2328,7 +2384,7 @@ static int resize_stripes(struct r5conf *conf, int newsize)
 	/* Step 1 */
 	sc = kmem_cache_create(conf->cache_name[1-conf->active_name],
 			       sizeof(struct stripe_head)+(newsize-1)*sizeof(struct r5dev),
-			       0, 0, NULL);
+			       0, SLAB_TYPESAFE_BY_RCU, NULL);
 	if (!sc)
 		return -ENOMEM;
 
@@ -3855,6 +3911,18 @@ static int handle_stripe_dirtying(struct r5conf *conf,
 {
 	int rmw = 0, rcw = 0, i;
 	sector_t recovery_cp = conf->mddev->recovery_cp;
+	bool full = false;
+
+	/*
+	 * A full stripe write has nothing to read, whatever the rmw_level:
+	 * go straight to reconstruct-write.
+	 */
+	if (is_full_stripe_write(sh) && !s->injournal) {
+		full = true;
+		rmw = 1;
+		set_bit(STRIPE_HANDLE, &sh->state);
+		goto reconstruct;
+	}
 
 	/* Check whether resync is now happening or should start.
 	 * If yes, then the array is dirty (after unclean shutdown or
@@ -3999,6 +4067,7 @@ static int handle_stripe_dirtying(struct r5conf *conf,
 	    !test_bit(STRIPE_PREREAD_ACTIVE, &sh->state))
 		set_bit(STRIPE_DELAYED, &sh->state);
 
+reconstruct:
 	/* now if nothing is locked, and if we have enough data,
 	 * we can start a write request
 	 */
@@ -4011,8 +4080,11 @@ static int handle_stripe_dirtying(struct r5conf *conf,
 	 */
 	if ((s->req_compute || !test_bit(STRIPE_COMPUTE_RUN, &sh->state)) &&
 	    (s->locked == 0 && (rcw == 0 || rmw == 0) &&
-	     !test_bit(STRIPE_BIT_DELAY, &sh->state)))
+	     !test_bit(STRIPE_BIT_DELAY, &sh->state))) {
+		if (full)
+			this_cpu_inc(conf->percpu->full_stripe_writes);
 		schedule_reconstruction(sh, s, rcw == 0, 0);
+	}
 	return 0;
 }
 
@@ -5394,6 +5466,36 @@ struct raid5_plug_cb {
 	struct list_head	temp_inactive_list[NR_STRIPE_HASH_LOCKS];
 };
 
+static int cmp_stripe_sector(void *priv, struct list_head *a,
+			     struct list_head *b)
+{
+	const struct stripe_head *sha = list_entry(a, struct stripe_head, lru);
+	const struct stripe_head *shb = list_entry(b, struct stripe_head, lru);
+
+	if (sha->sector == shb->sector)
+		return 0;
+	return sha->sector > shb->sector ? 1 : -1;
+}
+
+/*
+ * Join the full stripe writes gathered by a plug to batches, in sector
+ * order, so that contiguous stripes get their parity computed together
+ * even when they did not become full in ascending order.
+ */
+static void batch_plugged_stripes(struct r5conf *conf, struct list_head *list)
+{
+	struct stripe_head *sh;
+
+	list_sort(NULL, list, cmp_stripe_sector);
+	list_for_each_entry(sh, list, lru) {
+		if (sh->batch_head || !stripe_can_batch(sh))
+			continue;
+		stripe_add_to_batch_list(conf, sh);
+		if (sh->batch_head)
+			this_cpu_inc(conf->percpu->unplug_batched);
+	}
+}
+
 static void raid5_unplug(struct blk_plug_cb *blk_cb, bool from_schedule)
 {
 	struct raid5_plug_cb *cb = container_of(
@@ -5405,6 +5507,8 @@ static void raid5_unplug(struct blk_plug_cb *blk_cb, bool from_schedule)
 	int hash;
 
 	if (cb->list.next && !list_empty(&cb->list)) {
+		/* the plug holds a reference on each of these stripes */
+		batch_plugged_stripes(conf, &cb->list);
 		spin_lock_irq(&conf->device_lock);
 		while (!list_empty(&cb->list)) {
 			sh = list_first_entry(&cb->list, struct stripe_head, lru);
@@ -6554,6 +6658,39 @@ stripe_cache_active_show(struct mddev *mddev, char *page)
 static struct md_sysfs_entry
 raid5_stripecache_active = __ATTR_RO(stripe_cache_active);
 
+static ssize_t
+stripe_batch_stats_show(struct mddev *mddev, char *page)
+{
+	u64 batches = 0, batched = 0, unplug = 0, full = 0, lockless = 0;
+	struct r5conf *conf;
+	int cpu, ret = 0;
+
+	spin_lock(&mddev->lock);
+	conf = mddev->private;
+	if (conf && conf->percpu) {
+		for_each_possible_cpu(cpu) {
+			struct raid5_percpu *percpu;
+
+			percpu = per_cpu_ptr(conf->percpu, cpu);
+			batches += percpu->batches;
+			batched += percpu->batched_stripes;
+			unplug += percpu->unplug_batched;
+			full += percpu->full_stripe_writes;
+			lockless += percpu->lockless_lookups;
+		}
+		ret = sprintf(page,
+			      "batches %llu\nbatched_stripes %llu\n"
+			      "unplug_batched %llu\nfull_stripe_writes %llu\n"
+			      "lockless_lookups %llu\n",
+			      batches, batched, unplug, full, lockless);
+	}
+	spin_unlock(&mddev->lock);
+	return ret;
+}
+
+static struct md_sysfs_entry
+raid5_stripe_batch_stats = __ATTR_RO(stripe_batch_stats);
+
 static ssize_t
 raid5_show_group_thread_cnt(struct mddev *mddev, char *page)
 {
@@ -6630,6 +6767,7 @@ raid5_group_thread_cnt = __ATTR(group_thread_cnt, S_IRUGO | S_IWUSR,
 static struct attribute *raid5_attrs[] =  {
 	&raid5_stripecache_size.attr,
 	&raid5_stripecache_active.attr,
+	&raid5_stripe_batch_stats.attr,
 	&raid5_preread_bypass_threshold.attr,
 	&raid5_group_thread_cnt.attr,
 	&raid5_skip_copy.attr,
@@ -629,6 +629,12 @@ struct r5conf {
 					      * lists and performing address
 					      * conversions
 					      */
+		/* stripe batching counters, see stripe_batch_stats */
+		u64		batches; /* batch lists started */
+		u64		batched_stripes; /* stripes added to a batch */
+		u64		unplug_batched; /* of which at unplug time */
+		u64		full_stripe_writes; /* rcw without rmw check */
+		u64		lockless_lookups; /* found without hash lock */
 	} __percpu *percpu;
 	int scribble_disks;
 	int scribble_sectors;
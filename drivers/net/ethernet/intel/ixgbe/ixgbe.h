@@ -54,6 +54,7 @@
 #endif
 
 #include <net/busy_poll.h>
+#include <net/xdp.h>
 
 /* common prefix used by pr_<> macros */
 #undef pr_fmt
@@ -237,8 +238,8 @@ struct ixgbe_tx_buffer {
 	unsigned long time_stamp;
 	union {
 		struct sk_buff *skb;
-		/* XDP uses address ptr on irq_clean */
-		void *data;
+		/* XDP uses frame ptr on irq_clean */
+		struct xdp_frame *xdpf;
 	};
 	unsigned int bytecount;
 	unsigned short gso_segs;
@@ -370,6 +371,7 @@ struct ixgbe_ring {
 		struct ixgbe_tx_queue_stats tx_stats;
 		struct ixgbe_rx_queue_stats rx_stats;
 	};
+	struct xdp_rxq_info xdp_rxq;
 } ____cacheline_internodealigned_in_smp;
 
 enum ixgbe_ring_f_enum {
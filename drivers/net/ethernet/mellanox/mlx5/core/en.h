@@ -46,6 +46,8 @@
 #include <linux/mlx5/transobj.h>
 #include <linux/rhashtable.h>
 #include <net/switchdev.h>
+#include <net/xdp.h>
+#include <net/page_pool.h>
 #include "wq.h"
 #include "mlx5_core.h"
 #include "en_stats.h"
@@ -294,6 +296,11 @@ enum {
 	MLX5E_RQ_STATE_AM,
 };
 
+enum {
+	MLX5E_RQ_FLAG_XDP_XMIT,		/* page handed over by XDP */
+	MLX5E_RQ_FLAG_XDP_REDIRECT,	/* xdp_do_flush_map() pending */
+};
+
 #define MLX5E_TEST_BIT(state, nr) (state & BIT(nr))
 
 struct mlx5e_cq {
@@ -397,7 +404,7 @@ struct mlx5e_xdpsq {
 
 	/* write@xmit, read@completion */
 	struct {
-		struct mlx5e_dma_info     *di;
+		struct mlx5e_xdp_info     *xdpi;
 		bool                       doorbell;
 	} db;
 
@@ -452,6 +459,12 @@ struct mlx5e_dma_info {
 	dma_addr_t	addr;
 };
 
+struct mlx5e_xdp_info {
+	struct xdp_frame      *xdpf;	/* ndo_xdp_xmit() frame, or NULL */
+	dma_addr_t             dma_addr;
+	struct mlx5e_dma_info  di;	/* XDP_TX: RX page owned by the SQ */
+};
+
 struct mlx5e_wqe_frag_info {
 	struct mlx5e_dma_info di;
 	u32 offset;
@@ -521,10 +534,7 @@ struct mlx5e_rq {
 		struct {
 			struct mlx5e_wqe_frag_info *frag_info;
 			u32 frag_sz;	/* max possible skb frag_sz */
-			union {
-				bool page_reuse;
-				bool xdp_xmit;
-			};
+			bool page_reuse;
 		} wqe;
 		struct {
 			struct mlx5e_mpw_info *info;
@@ -553,6 +563,7 @@ struct mlx5e_rq {
 	mlx5e_fp_dealloc_wqe   dealloc_wqe;
 
 	unsigned long          state;
+	unsigned long          flags;
 	int                    ix;
 
 	struct mlx5e_rx_am     am; /* Adaptive Moderation */
@@ -568,6 +579,10 @@ struct mlx5e_rq {
 	u32                    rqn;
 	struct mlx5_core_dev  *mdev;
 	struct mlx5_core_mkey  umr_mkey;
+
+	/* XDP read-mostly */
+	struct xdp_rxq_info    xdp_rxq;
+	struct page_pool      *page_pool;
 } ____cacheline_aligned_in_smp;
 
 struct mlx5e_channel {
@@ -575,6 +590,7 @@ struct mlx5e_channel {
 	struct mlx5e_rq            rq;
 	struct mlx5e_txqsq         sq[MLX5E_MAX_NUM_TC];
 	struct mlx5e_icosq         icosq;   /* internal control operations */
+	struct mlx5e_xdpsq         xdpsq;   /* XDP_REDIRECT, ndo_xdp_xmit */
 	bool                       xdp;
 	struct napi_struct         napi;
 	struct device             *pdev;
@@ -837,6 +853,8 @@ int mlx5e_poll_rx_cq(struct mlx5e_cq *cq, int budget);
 bool mlx5e_poll_xdpsq_cq(struct mlx5e_cq *cq);
 void mlx5e_free_txqsq_descs(struct mlx5e_txqsq *sq);
 void mlx5e_free_xdpsq_descs(struct mlx5e_xdpsq *sq);
+int mlx5e_xdp_xmit(struct net_device *dev, int n, struct xdp_frame **frames,
+		   u32 flags);
 
 void mlx5e_page_release(struct mlx5e_rq *rq, struct mlx5e_dma_info *dma_info,
 			bool recycle);
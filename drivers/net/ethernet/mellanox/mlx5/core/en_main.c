@@ -88,6 +88,10 @@ void mlx5e_set_rq_type_params(struct mlx5_core_dev *mdev,
 {
 	params->rq_wq_type = rq_type;
 	params->lro_wqe_sz = MLX5E_PARAMS_DEFAULT_LRO_WQE_SZ;
+	params->rq_headroom = params->xdp_prog ?
+		XDP_PACKET_HEADROOM : MLX5_RX_HEADROOM;
+	params->rq_headroom += NET_IP_ALIGN;
+
 	switch (params->rq_wq_type) {
 	case MLX5_WQ_TYPE_LINKED_LIST_STRIDING_RQ:
 		params->log_rq_size = is_kdump_kernel() ?
@@ -104,9 +108,6 @@ void mlx5e_set_rq_type_params(struct mlx5_core_dev *mdev,
 		params->log_rq_size = is_kdump_kernel() ?
 			MLX5E_PARAMS_MINIMUM_LOG_RQ_SIZE :
 			MLX5E_PARAMS_DEFAULT_LOG_RQ_SIZE;
-		params->rq_headroom = params->xdp_prog ?
-			XDP_PACKET_HEADROOM : MLX5_RX_HEADROOM;
-		params->rq_headroom += NET_IP_ALIGN;
 
 		/* Extra room needed for build_skb */
 		params->lro_wqe_sz -= params->rq_headroom +
@@ -123,12 +124,23 @@ void mlx5e_set_rq_type_params(struct mlx5_core_dev *mdev,
 static void mlx5e_set_rq_params(struct mlx5_core_dev *mdev, struct mlx5e_params *params)
 {
 	u8 rq_type = mlx5e_check_fragmented_striding_rq_cap(mdev) &&
-		    !params->xdp_prog && !MLX5_IPSEC_DEV(mdev) ?
+		    !MLX5_IPSEC_DEV(mdev) ?
 		    MLX5_WQ_TYPE_LINKED_LIST_STRIDING_RQ :
 		    MLX5_WQ_TYPE_LINKED_LIST;
 	mlx5e_set_rq_type_params(mdev, params, rq_type);
 }
 
+/* XDP on a striding RQ copies each packet into a page of its own, with
+ * the XDP headroom in front of it and the skb_shared_info behind it.
+ */
+static bool mlx5e_xdp_mpwqe_fits(struct mlx5e_priv *priv, int mtu)
+{
+	u32 frag_sz = MLX5_SKB_FRAG_SZ(XDP_PACKET_HEADROOM + NET_IP_ALIGN +
+				       MLX5E_SW2HW_MTU(priv, mtu));
+
+	return frag_sz <= PAGE_SIZE;
+}
+
 static void mlx5e_update_carrier(struct mlx5e_priv *priv)
 {
 	struct mlx5_core_dev *mdev = priv->mdev;
@@ -203,6 +215,7 @@ static void mlx5e_update_sw_counters(struct mlx5e_priv *priv)
 		s->rx_xdp_drop += rq_stats->xdp_drop;
 		s->rx_xdp_tx += rq_stats->xdp_tx;
 		s->rx_xdp_tx_full += rq_stats->xdp_tx_full;
+		s->rx_xdp_redirect += rq_stats->xdp_redirect;
 		s->rx_wqe_err   += rq_stats->wqe_err;
 		s->rx_mpwqe_filler += rq_stats->mpwqe_filler;
 		s->rx_buff_alloc_err += rq_stats->buff_alloc_err;
@@ -561,10 +574,11 @@ static int mlx5e_alloc_rq(struct mlx5e_channel *c,
 			  struct mlx5e_rq_param *rqp,
 			  struct mlx5e_rq *rq)
 {
+	struct page_pool_params pp_params = { 0 };
 	struct mlx5_core_dev *mdev = c->mdev;
 	void *rqc = rqp->rqc;
 	void *rqc_wq = MLX5_ADDR_OF(rqc, rqc, wq);
-	u32 byte_count;
+	u32 byte_count, pool_size;
 	int npages;
 	int wq_sz;
 	int err;
@@ -589,6 +603,12 @@ static int mlx5e_alloc_rq(struct mlx5e_channel *c,
 	rq->ix      = c->ix;
 	rq->mdev    = mdev;
 
+	err = xdp_rxq_info_reg(&rq->xdp_rxq, rq->netdev, rq->ix);
+	if (err < 0) {
+		mlx5_wq_destroy(&rq->wq_ctrl);
+		return err;
+	}
+
 	rq->xdp_prog = params->xdp_prog ? bpf_prog_inc(params->xdp_prog) : NULL;
 	if (IS_ERR(rq->xdp_prog)) {
 		err = PTR_ERR(rq->xdp_prog);
@@ -598,9 +618,11 @@ static int mlx5e_alloc_rq(struct mlx5e_channel *c,
 
 	rq->buff.map_dir = rq->xdp_prog ? DMA_BIDIRECTIONAL : DMA_FROM_DEVICE;
 	rq->buff.headroom = params->rq_headroom;
+	pool_size = wq_sz;
 
 	switch (rq->wq_type) {
 	case MLX5_WQ_TYPE_LINKED_LIST_STRIDING_RQ:
+		pool_size = wq_sz * MLX5_MPWRQ_PAGES_PER_WQE;
 
 		rq->post_wqes = mlx5e_post_rx_mpwqes;
 		rq->dealloc_wqe = mlx5e_dealloc_rx_mpwqe;
@@ -676,6 +698,32 @@ static int mlx5e_alloc_rq(struct mlx5e_channel *c,
 		rq->mkey_be = c->mkey_be;
 	}
 
+	/* Create a page_pool and register it with rxq */
+	pp_params.order     = rq->buff.page_order;
+	pp_params.flags     = 0; /* No-internal DMA mapping in page_pool */
+	pp_params.pool_size = pool_size;
+	pp_params.nid       = mlx5e_get_node(c->priv, c->ix);
+	pp_params.dev       = c->pdev;
+	pp_params.dma_dir   = rq->buff.map_dir;
+
+	/* page_pool can be used even when there is no rq->xdp_prog,
+	 * given page_pool does not handle DMA mapping there is no
+	 * required state to clear.  And page_pool gracefully handles
+	 * elevated refcnt, as done by the page_reuse and MPWQE stride
+	 * schemes.  The rx page_cache stays in front of it and keeps
+	 * pages DMA mapped, the pool only backs it up on a cache miss.
+	 */
+	rq->page_pool = page_pool_create(&pp_params);
+	if (IS_ERR(rq->page_pool)) {
+		err = PTR_ERR(rq->page_pool);
+		rq->page_pool = NULL;
+		goto err_free;
+	}
+	err = xdp_rxq_info_reg_mem_model(&rq->xdp_rxq,
+					 MEM_TYPE_PAGE_POOL, rq->page_pool);
+	if (err)
+		goto err_free;
+
 	for (i = 0; i < wq_sz; i++) {
 		struct mlx5e_rx_wqe *wqe = mlx5_wq_ll_get_wqe(&rq->wq, i);
 
@@ -696,12 +744,27 @@ static int mlx5e_alloc_rq(struct mlx5e_channel *c,
 
 	return 0;
 
+err_free:
+	switch (rq->wq_type) {
+	case MLX5_WQ_TYPE_LINKED_LIST_STRIDING_RQ:
+		mlx5e_rq_free_mpwqe_info(rq);
+		break;
+	default: /* MLX5_WQ_TYPE_LINKED_LIST */
+		kfree(rq->wqe.frag_info);
+		goto err_rq_wq_destroy;
+	}
+
 err_destroy_umr_mkey:
 	mlx5_core_destroy_mkey(mdev, &rq->umr_mkey);
 
 err_rq_wq_destroy:
 	if (rq->xdp_prog)
 		bpf_prog_put(rq->xdp_prog);
+	xdp_rxq_info_unreg(&rq->xdp_rxq);
+	if (rq->page_pool) {
+		page_pool_destroy(rq->page_pool);
+		rq->page_pool = NULL;
+	}
 	mlx5_wq_destroy(&rq->wq_ctrl);
 
 	return err;
@@ -729,6 +792,12 @@ static void mlx5e_free_rq(struct mlx5e_rq *rq)
 
 		mlx5e_page_release(rq, dma_info, false);
 	}
+
+	xdp_rxq_info_unreg(&rq->xdp_rxq);
+	if (rq->page_pool)
+		page_pool_destroy(rq->page_pool);
+	rq->page_pool = NULL;
+
 	mlx5_wq_destroy(&rq->wq_ctrl);
 }
 
@@ -975,16 +1044,16 @@ static void mlx5e_close_rq(struct mlx5e_rq *rq)
 
 static void mlx5e_free_xdpsq_db(struct mlx5e_xdpsq *sq)
 {
-	kfree(sq->db.di);
+	kfree(sq->db.xdpi);
 }
 
 static int mlx5e_alloc_xdpsq_db(struct mlx5e_xdpsq *sq, int numa)
 {
 	int wq_sz = mlx5_wq_cyc_get_size(&sq->wq);
 
-	sq->db.di = kzalloc_node(sizeof(*sq->db.di) * wq_sz,
-				     GFP_KERNEL, numa);
-	if (!sq->db.di) {
+	sq->db.xdpi = kzalloc_node(sizeof(*sq->db.xdpi) * wq_sz,
+				   GFP_KERNEL, numa);
+	if (!sq->db.xdpi) {
 		mlx5e_free_xdpsq_db(sq);
 		return -ENOMEM;
 	}
@@ -1800,6 +1869,11 @@ static int mlx5e_open_channel(struct mlx5e_priv *priv, int ix,
 	if (err)
 		goto err_close_rx_cq;
 
+	err = mlx5e_open_cq(c, params->tx_cq_moderation, &cparam->tx_cq,
+			    &c->xdpsq.cq);
+	if (err)
+		goto err_close_rx_xdpsq_cq;
+
 	napi_enable(&c->napi);
 
 	err = mlx5e_open_icosq(c, params, &cparam->icosq, &c->icosq);
@@ -1814,6 +1888,10 @@ static int mlx5e_open_channel(struct mlx5e_priv *priv, int ix,
 	if (err)
 		goto err_close_sqs;
 
+	err = mlx5e_open_xdpsq(c, params, &cparam->xdp_sq, &c->xdpsq);
+	if (err)
+		goto err_close_rx_xdp_sq;
+
 	err = mlx5e_open_rq(c, params, &cparam->rq, &c->rq);
 	if (err)
 		goto err_close_xdp_sq;
@@ -1822,6 +1900,9 @@ static int mlx5e_open_channel(struct mlx5e_priv *priv, int ix,
 
 	return 0;
 err_close_xdp_sq:
+	mlx5e_close_xdpsq(&c->xdpsq);
+
+err_close_rx_xdp_sq:
 	if (c->xdp)
 		mlx5e_close_xdpsq(&c->rq.xdpsq);
 
@@ -1833,6 +1914,9 @@ static int mlx5e_open_channel(struct mlx5e_priv *priv, int ix,
 
 err_disable_napi:
 	napi_disable(&c->napi);
+	mlx5e_close_cq(&c->xdpsq.cq);
+
+err_close_rx_xdpsq_cq:
 	if (c->xdp)
 		mlx5e_close_cq(&c->rq.xdpsq.cq);
 
@@ -1870,16 +1954,19 @@ static void mlx5e_deactivate_channel(struct mlx5e_channel *c)
 	mlx5e_deactivate_rq(&c->rq);
 	for (tc = 0; tc < c->num_tc; tc++)
 		mlx5e_deactivate_txqsq(&c->sq[tc]);
+	clear_bit(MLX5E_SQ_STATE_ENABLED, &c->xdpsq.state);
 }
 
 static void mlx5e_close_channel(struct mlx5e_channel *c)
 {
 	mlx5e_close_rq(&c->rq);
+	mlx5e_close_xdpsq(&c->xdpsq);
 	if (c->xdp)
 		mlx5e_close_xdpsq(&c->rq.xdpsq);
 	mlx5e_close_sqs(c);
 	mlx5e_close_icosq(&c->icosq);
 	napi_disable(&c->napi);
+	mlx5e_close_cq(&c->xdpsq.cq);
 	if (c->xdp)
 		mlx5e_close_cq(&c->rq.xdpsq.cq);
 	mlx5e_close_cq(&c->rq.cq);
@@ -2113,6 +2200,9 @@ static void mlx5e_deactivate_channels(struct mlx5e_channels *chs)
 
 	for (i = 0; i < chs->num; i++)
 		mlx5e_deactivate_channel(chs->c[i]);
+
+	/* sync with ndo_xdp_xmit() running from other devices' NAPI */
+	synchronize_rcu();
 }
 
 void mlx5e_close_channels(struct mlx5e_channels *chs)
@@ -3375,6 +3465,16 @@ static int mlx5e_change_mtu(struct net_device *netdev, int new_mtu)
 
 	mutex_lock(&priv->state_lock);
 
+	if (priv->channels.params.xdp_prog &&
+	    priv->channels.params.rq_wq_type ==
+	    MLX5_WQ_TYPE_LINKED_LIST_STRIDING_RQ &&
+	    !mlx5e_xdp_mpwqe_fits(priv, new_mtu)) {
+		netdev_err(netdev, "MTU %d is too big for XDP on striding RQ\n",
+			   new_mtu);
+		err = -EINVAL;
+		goto out;
+	}
+
 	reset = !priv->channels.params.lro_en &&
 		(priv->channels.params.rq_wq_type !=
 		 MLX5_WQ_TYPE_LINKED_LIST_STRIDING_RQ);
@@ -3677,8 +3777,16 @@ static int mlx5e_xdp_set(struct net_device *netdev, struct bpf_prog *prog)
 	if (old_prog)
 		bpf_prog_put(old_prog);
 
-	if (reset) /* change RQ type according to priv->xdp_prog */
-		mlx5e_set_rq_params(priv->mdev, &priv->channels.params);
+	if (reset) { /* change RQ type according to priv->xdp_prog */
+		struct mlx5e_params *params = &priv->channels.params;
+		u8 striding = MLX5_WQ_TYPE_LINKED_LIST_STRIDING_RQ;
+
+		mlx5e_set_rq_params(priv->mdev, params);
+		if (prog && params->rq_wq_type == striding &&
+		    !mlx5e_xdp_mpwqe_fits(priv, netdev->mtu))
+			mlx5e_set_rq_type_params(priv->mdev, params,
+						 MLX5_WQ_TYPE_LINKED_LIST);
+	}
 
 	if (was_opened && reset)
 		mlx5e_open_locked(netdev);
@@ -3779,6 +3887,7 @@ static const struct net_device_ops mlx5e_netdev_ops = {
 #endif
 	.ndo_tx_timeout          = mlx5e_tx_timeout,
 	.ndo_xdp		 = mlx5e_xdp,
+	.ndo_xdp_xmit		 = mlx5e_xdp_xmit,
 #ifdef CONFIG_NET_POLL_CONTROLLER
 	.ndo_poll_controller     = mlx5e_netpoll,
 #endif
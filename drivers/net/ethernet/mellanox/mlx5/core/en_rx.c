@@ -218,7 +218,7 @@ static inline int mlx5e_page_alloc_mapped(struct mlx5e_rq *rq,
 	if (mlx5e_rx_cache_get(rq, dma_info))
 		return 0;
 
-	dma_info->page = dev_alloc_pages(rq->buff.page_order);
+	dma_info->page = page_pool_dev_alloc_pages(rq->page_pool);
 	if (unlikely(!dma_info->page))
 		return -ENOMEM;
 
@@ -236,12 +236,18 @@ static inline int mlx5e_page_alloc_mapped(struct mlx5e_rq *rq,
 void mlx5e_page_release(struct mlx5e_rq *rq, struct mlx5e_dma_info *dma_info,
 			bool recycle)
 {
-	if (likely(recycle) && mlx5e_rx_cache_put(rq, dma_info))
-		return;
+	if (likely(recycle)) {
+		if (mlx5e_rx_cache_put(rq, dma_info))
+			return;
 
-	dma_unmap_page(rq->pdev, dma_info->addr, RQ_PAGE_SIZE(rq),
-		       rq->buff.map_dir);
-	put_page(dma_info->page);
+		dma_unmap_page(rq->pdev, dma_info->addr, RQ_PAGE_SIZE(rq),
+			       rq->buff.map_dir);
+		page_pool_recycle_direct(rq->page_pool, dma_info->page);
+	} else {
+		dma_unmap_page(rq->pdev, dma_info->addr, RQ_PAGE_SIZE(rq),
+			       rq->buff.map_dir);
+		put_page(dma_info->page);
+	}
 }
 
 static inline bool mlx5e_page_reuse(struct mlx5e_rq *rq,
@@ -713,11 +719,10 @@ static inline void mlx5e_xmit_xdp_doorbell(struct mlx5e_xdpsq *sq)
 	mlx5e_notify_hw(wq, sq->pc, sq->uar_map, &wqe->ctrl);
 }
 
-static inline bool mlx5e_xmit_xdp_frame(struct mlx5e_rq *rq,
-					struct mlx5e_dma_info *di,
-					const struct xdp_buff *xdp)
+static inline bool mlx5e_xmit_xdp_frame(struct mlx5e_xdpsq *sq,
+					struct mlx5e_xdp_info *xdpi,
+					void *data, unsigned int dma_len)
 {
-	struct mlx5e_xdpsq       *sq   = &rq->xdpsq;
 	struct mlx5_wq_cyc       *wq   = &sq->wq;
 	u16                       pi   = sq->pc & wq->sz_m1;
 	struct mlx5e_tx_wqe      *wqe  = mlx5_wq_cyc_get_wqe(wq, pi);
@@ -726,37 +731,26 @@ static inline bool mlx5e_xmit_xdp_frame(struct mlx5e_rq *rq,
 	struct mlx5_wqe_eth_seg  *eseg = &wqe->eth;
 	struct mlx5_wqe_data_seg *dseg;
 
-	ptrdiff_t data_offset = xdp->data - xdp->data_hard_start;
-	dma_addr_t dma_addr  = di->addr + data_offset;
-	unsigned int dma_len = xdp->data_end - xdp->data;
+	dma_addr_t dma_addr  = xdpi->dma_addr;
 
 	prefetchw(wqe);
 
-	if (unlikely(dma_len < MLX5E_XDP_MIN_INLINE ||
-		     MLX5E_SW2HW_MTU(rq->channel->priv, rq->netdev->mtu) < dma_len)) {
-		rq->stats.xdp_drop++;
-		return false;
-	}
-
 	if (unlikely(!mlx5e_wqc_has_room_for(wq, sq->cc, sq->pc, 1))) {
 		if (sq->db.doorbell) {
 			/* SQ is full, ring doorbell */
 			mlx5e_xmit_xdp_doorbell(sq);
 			sq->db.doorbell = false;
 		}
-		rq->stats.xdp_tx_full++;
 		return false;
 	}
 
-	dma_sync_single_for_device(sq->pdev, dma_addr, dma_len, PCI_DMA_TODEVICE);
-
 	cseg->fm_ce_se = 0;
 
 	dseg = (struct mlx5_wqe_data_seg *)eseg + 1;
 
 	/* copy the inline part if required */
 	if (sq->min_inline_mode != MLX5_INLINE_MODE_NONE) {
-		memcpy(eseg->inline_hdr.start, xdp->data, MLX5E_XDP_MIN_INLINE);
+		memcpy(eseg->inline_hdr.start, data, MLX5E_XDP_MIN_INLINE);
 		eseg->inline_hdr.sz = cpu_to_be16(MLX5E_XDP_MIN_INLINE);
 		dma_len  -= MLX5E_XDP_MIN_INLINE;
 		dma_addr += MLX5E_XDP_MIN_INLINE;
@@ -769,15 +763,53 @@ static inline bool mlx5e_xmit_xdp_frame(struct mlx5e_rq *rq,
 
 	cseg->opmod_idx_opcode = cpu_to_be32((sq->pc << 8) | MLX5_OPCODE_SEND);
 
-	/* move page to reference to sq responsibility,
-	 * and mark so it's not put back in page-cache.
-	 */
-	rq->wqe.xdp_xmit = true;
-	sq->db.di[pi] = *di;
+	sq->db.xdpi[pi] = *xdpi;
 	sq->pc++;
 
+	/* the doorbell is rung once per NAPI poll, or on XDP_XMIT_FLUSH */
 	sq->db.doorbell = true;
 
+	return true;
+}
+
+static inline bool mlx5e_xdp_frame_len_ok(struct mlx5e_priv *priv,
+					  struct net_device *netdev,
+					  unsigned int len)
+{
+	return len >= MLX5E_XDP_MIN_INLINE &&
+	       len <= MLX5E_SW2HW_MTU(priv, netdev->mtu);
+}
+
+static inline bool mlx5e_xmit_xdp_buff(struct mlx5e_rq *rq,
+				       struct mlx5e_dma_info *di,
+				       const struct xdp_buff *xdp)
+{
+	struct mlx5e_xdpsq *sq = &rq->xdpsq;
+	unsigned int dma_len = xdp->data_end - xdp->data;
+	struct mlx5e_xdp_info xdpi;
+
+	if (unlikely(!mlx5e_xdp_frame_len_ok(rq->channel->priv, rq->netdev,
+					     dma_len))) {
+		rq->stats.xdp_drop++;
+		return false;
+	}
+
+	xdpi.xdpf     = NULL;
+	xdpi.dma_addr = di->addr + (xdp->data - page_address(di->page));
+	xdpi.di       = *di;
+
+	dma_sync_single_for_device(sq->pdev, xdpi.dma_addr, dma_len,
+				   PCI_DMA_TODEVICE);
+
+	if (unlikely(!mlx5e_xmit_xdp_frame(sq, &xdpi, xdp->data, dma_len))) {
+		rq->stats.xdp_tx_full++;
+		return false;
+	}
+
+	/* move page to reference to sq responsibility,
+	 * and mark so it's not put back in page-cache.
+	 */
+	__set_bit(MLX5E_RQ_FLAG_XDP_XMIT, &rq->flags);
 	rq->stats.xdp_tx++;
 	return true;
 }
@@ -790,6 +822,7 @@ static inline int mlx5e_xdp_handle(struct mlx5e_rq *rq,
 	const struct bpf_prog *prog = READ_ONCE(rq->xdp_prog);
 	struct xdp_buff xdp;
 	u32 act;
+	int err;
 
 	if (!prog)
 		return false;
@@ -797,6 +830,7 @@ static inline int mlx5e_xdp_handle(struct mlx5e_rq *rq,
 	xdp.data = va + *rx_headroom;
 	xdp.data_end = xdp.data + *len;
 	xdp.data_hard_start = va;
+	xdp.rxq = &rq->xdp_rxq;
 
 	act = bpf_prog_run_xdp(prog, &xdp);
 	switch (act) {
@@ -805,9 +839,24 @@ static inline int mlx5e_xdp_handle(struct mlx5e_rq *rq,
 		*len = xdp.data_end - xdp.data;
 		return false;
 	case XDP_TX:
-		if (unlikely(!mlx5e_xmit_xdp_frame(rq, di, &xdp)))
+		if (unlikely(!mlx5e_xmit_xdp_buff(rq, di, &xdp)))
 			trace_xdp_exception(rq->netdev, prog, act);
 		return true;
+	case XDP_REDIRECT:
+		err = xdp_do_redirect(rq->netdev, &xdp, prog);
+		if (unlikely(err)) {
+			rq->stats.xdp_drop++;
+			return true;
+		}
+		/* the page now belongs to its page_pool memory model,
+		 * which expects it without our DMA mapping.
+		 */
+		dma_unmap_page(rq->pdev, di->addr, RQ_PAGE_SIZE(rq),
+			       rq->buff.map_dir);
+		__set_bit(MLX5E_RQ_FLAG_XDP_XMIT, &rq->flags);
+		__set_bit(MLX5E_RQ_FLAG_XDP_REDIRECT, &rq->flags);
+		rq->stats.xdp_redirect++;
+		return true;
 	default:
 		bpf_warn_invalid_xdp_action(act);
 	case XDP_ABORTED:
@@ -884,9 +933,8 @@ void mlx5e_handle_rx_cqe(struct mlx5e_rq *rq, struct mlx5_cqe64 *cqe)
 	skb = skb_from_cqe(rq, cqe, wi, cqe_bcnt);
 	if (!skb) {
 		/* probably for XDP */
-		if (rq->wqe.xdp_xmit) {
+		if (__test_and_clear_bit(MLX5E_RQ_FLAG_XDP_XMIT, &rq->flags)) {
 			wi->di.page = NULL;
-			rq->wqe.xdp_xmit = false;
 			/* do not return page to cache, it will be returned on XDP_TX completion */
 			goto wq_ll_pop;
 		}
@@ -926,9 +974,8 @@ void mlx5e_handle_rx_cqe_rep(struct mlx5e_rq *rq, struct mlx5_cqe64 *cqe)
 
 	skb = skb_from_cqe(rq, cqe, wi, cqe_bcnt);
 	if (!skb) {
-		if (rq->wqe.xdp_xmit) {
+		if (__test_and_clear_bit(MLX5E_RQ_FLAG_XDP_XMIT, &rq->flags)) {
 			wi->di.page = NULL;
-			rq->wqe.xdp_xmit = false;
 			/* do not return page to cache, it will be returned on XDP_TX completion */
 			goto wq_ll_pop;
 		}
@@ -989,6 +1036,85 @@ static inline void mlx5e_mpwqe_fill_rx_skb(struct mlx5e_rq *rq,
 	skb->len  += headlen;
 }
 
+static inline void mlx5e_copy_mpwqe_data(struct mlx5e_rq *rq,
+					 struct mlx5e_mpw_info *wi,
+					 u32 wqe_offset, void *data, u32 len)
+{
+	u32 page_idx = wqe_offset >> PAGE_SHIFT;
+	u32 offset   = wqe_offset & (PAGE_SIZE - 1);
+
+	while (len) {
+		struct mlx5e_dma_info *dma_info = &wi->umr.dma_info[page_idx];
+		u32 pg_len = min_t(u32, PAGE_SIZE - offset, len);
+
+		dma_sync_single_for_cpu(rq->pdev, dma_info->addr + offset,
+					pg_len, DMA_FROM_DEVICE);
+		memcpy(data, page_address(dma_info->page) + offset, pg_len);
+		data += pg_len;
+		len -= pg_len;
+		offset = 0;
+		page_idx++;
+	}
+}
+
+/* Strides are packed back to back, with no headroom in front of them,
+ * so for XDP the packet is copied into a page of its own first.  The
+ * strides stay with the MPWQE, and the page is handed on as is to
+ * XDP_TX, XDP_REDIRECT or build_skb().
+ */
+static struct sk_buff *
+mlx5e_skb_from_cqe_mpwrq_xdp(struct mlx5e_rq *rq, struct mlx5_cqe64 *cqe,
+			     struct mlx5e_mpw_info *wi, u32 cqe_bcnt)
+{
+	u16 stride_ix   = mpwrq_get_cqe_stride_index(cqe);
+	u32 wqe_offset  = stride_ix << rq->mpwqe.log_stride_sz;
+	u16 rx_headroom = rq->buff.headroom;
+	struct mlx5e_dma_info di;
+	struct sk_buff *skb;
+	u32 frag_size;
+	bool consumed;
+	void *va;
+
+	frag_size = MLX5_SKB_FRAG_SZ(rx_headroom + cqe_bcnt);
+	if (unlikely(frag_size > PAGE_SIZE)) {
+		rq->stats.xdp_drop++;
+		return NULL;
+	}
+
+	if (unlikely(mlx5e_page_alloc_mapped(rq, &di))) {
+		rq->stats.buff_alloc_err++;
+		return NULL;
+	}
+
+	va = page_address(di.page);
+	mlx5e_copy_mpwqe_data(rq, wi, wqe_offset, va + rx_headroom, cqe_bcnt);
+
+	rcu_read_lock();
+	consumed = mlx5e_xdp_handle(rq, &di, va, &rx_headroom, &cqe_bcnt);
+	rcu_read_unlock();
+	if (consumed) {
+		if (!__test_and_clear_bit(MLX5E_RQ_FLAG_XDP_XMIT, &rq->flags))
+			mlx5e_page_release(rq, &di, true);
+		return NULL;
+	}
+
+	skb = build_skb(va, frag_size);
+	if (unlikely(!skb)) {
+		rq->stats.buff_alloc_err++;
+		mlx5e_page_release(rq, &di, true);
+		return NULL;
+	}
+
+	/* the skb holds its own reference, the page goes back to the cache */
+	page_ref_inc(di.page);
+	mlx5e_page_release(rq, &di, true);
+
+	skb_reserve(skb, rx_headroom);
+	skb_put(skb, cqe_bcnt);
+
+	return skb;
+}
+
 void mlx5e_handle_rx_cqe_mpwrq(struct mlx5e_rq *rq, struct mlx5_cqe64 *cqe)
 {
 	u16 cstrides       = mpwrq_get_cqe_consumed_strides(cqe);
@@ -1010,18 +1136,25 @@ void mlx5e_handle_rx_cqe_mpwrq(struct mlx5e_rq *rq, struct mlx5_cqe64 *cqe)
 		goto mpwrq_cqe_out;
 	}
 
-	skb = napi_alloc_skb(rq->cq.napi,
-			     ALIGN(MLX5_MPWRQ_SMALL_PACKET_THRESHOLD,
-				   sizeof(long)));
-	if (unlikely(!skb)) {
-		rq->stats.buff_alloc_err++;
-		goto mpwrq_cqe_out;
-	}
-
-	prefetchw(skb->data);
 	cqe_bcnt = mpwrq_get_cqe_byte_cnt(cqe);
 
-	mlx5e_mpwqe_fill_rx_skb(rq, cqe, wi, cqe_bcnt, skb);
+	if (rq->xdp_prog) {
+		skb = mlx5e_skb_from_cqe_mpwrq_xdp(rq, cqe, wi, cqe_bcnt);
+		if (!skb)
+			goto mpwrq_cqe_out;
+	} else {
+		skb = napi_alloc_skb(rq->cq.napi,
+				     ALIGN(MLX5_MPWRQ_SMALL_PACKET_THRESHOLD,
+					   sizeof(long)));
+		if (unlikely(!skb)) {
+			rq->stats.buff_alloc_err++;
+			goto mpwrq_cqe_out;
+		}
+
+		prefetchw(skb->data);
+		mlx5e_mpwqe_fill_rx_skb(rq, cqe, wi, cqe_bcnt, skb);
+	}
+
 	mlx5e_complete_rx_cqe(rq, cqe, cqe_bcnt, skb);
 	napi_gro_receive(rq->cq.napi, skb);
 
@@ -1047,10 +1180,11 @@ int mlx5e_poll_rx_cq(struct mlx5e_cq *cq, int budget)
 		work_done += mlx5e_decompress_cqes_cont(rq, cq, 0, budget);
 
 	cqe = mlx5_cqwq_get_cqe(&cq->wq);
-	if (!cqe)
+	if (!cqe) {
+		if (unlikely(work_done))
+			goto out;
 		return 0;
-
-	xdpsq = &rq->xdpsq;
+	}
 
 	do {
 		if (mlx5_get_cqe_format(cqe) == MLX5_COMPRESSED) {
@@ -1065,11 +1199,16 @@ int mlx5e_poll_rx_cq(struct mlx5e_cq *cq, int budget)
 		rq->handle_rx_cqe(rq, cqe);
 	} while ((++work_done < budget) && (cqe = mlx5_cqwq_get_cqe(&cq->wq)));
 
+out:
+	xdpsq = &rq->xdpsq;
 	if (xdpsq->db.doorbell) {
 		mlx5e_xmit_xdp_doorbell(xdpsq);
 		xdpsq->db.doorbell = false;
 	}
 
+	if (__test_and_clear_bit(MLX5E_RQ_FLAG_XDP_REDIRECT, &rq->flags))
+		xdp_do_flush_map();
+
 	mlx5_cqwq_update_db_record(&cq->wq);
 
 	/* ensure cq space is freed before enabling more cqes */
@@ -1078,11 +1217,25 @@ int mlx5e_poll_rx_cq(struct mlx5e_cq *cq, int budget)
 	return work_done;
 }
 
+static inline void mlx5e_xdpi_release(struct mlx5e_xdpsq *sq,
+				      struct mlx5e_xdp_info *xdpi,
+				      bool recycle)
+{
+	if (xdpi->xdpf) {
+		dma_unmap_single(sq->pdev, xdpi->dma_addr, xdpi->xdpf->len,
+				 DMA_TO_DEVICE);
+		xdp_return_frame(xdpi->xdpf);
+		return;
+	}
+
+	/* Recycle RX page */
+	mlx5e_page_release(&sq->channel->rq, &xdpi->di, recycle);
+}
+
 bool mlx5e_poll_xdpsq_cq(struct mlx5e_cq *cq)
 {
 	struct mlx5e_xdpsq *sq;
 	struct mlx5_cqe64 *cqe;
-	struct mlx5e_rq *rq;
 	u16 sqcc;
 	int i;
 
@@ -1095,8 +1248,6 @@ bool mlx5e_poll_xdpsq_cq(struct mlx5e_cq *cq)
 	if (!cqe)
 		return false;
 
-	rq = container_of(sq, struct mlx5e_rq, xdpsq);
-
 	/* sq->cc must be updated only after mlx5_cqwq_update_db_record(),
 	 * otherwise a cq overrun may occur
 	 */
@@ -1112,17 +1263,14 @@ bool mlx5e_poll_xdpsq_cq(struct mlx5e_cq *cq)
 		wqe_counter = be16_to_cpu(cqe->wqe_counter);
 
 		do {
-			struct mlx5e_dma_info *di;
 			u16 ci;
 
 			last_wqe = (sqcc == wqe_counter);
 
 			ci = sqcc & sq->wq.sz_m1;
-			di = &sq->db.di[ci];
-
 			sqcc++;
-			/* Recycle RX page */
-			mlx5e_page_release(rq, di, true);
+
+			mlx5e_xdpi_release(sq, &sq->db.xdpi[ci], true);
 		} while (!last_wqe);
 	} while ((++i < MLX5E_TX_CQ_POLL_BUDGET) && (cqe = mlx5_cqwq_get_cqe(&cq->wq)));
 
@@ -1137,17 +1285,93 @@ bool mlx5e_poll_xdpsq_cq(struct mlx5e_cq *cq)
 
 void mlx5e_free_xdpsq_descs(struct mlx5e_xdpsq *sq)
 {
-	struct mlx5e_rq *rq = container_of(sq, struct mlx5e_rq, xdpsq);
-	struct mlx5e_dma_info *di;
 	u16 ci;
 
 	while (sq->cc != sq->pc) {
 		ci = sq->cc & sq->wq.sz_m1;
-		di = &sq->db.di[ci];
 		sq->cc++;
 
-		mlx5e_page_release(rq, di, false);
+		mlx5e_xdpi_release(sq, &sq->db.xdpi[ci], false);
+	}
+}
+
+/* Redirected frames go out on the XDP SQ of the channel of the current
+ * CPU, which only that CPU produces to, so no locking is needed.
+ */
+static struct mlx5e_xdpsq *mlx5e_xdp_redirect_sq(struct mlx5e_priv *priv)
+{
+	struct mlx5e_xdpsq *sq;
+	int sq_num;
+
+	if (unlikely(!test_bit(MLX5E_STATE_OPENED, &priv->state)))
+		return NULL;
+
+	sq_num = smp_processor_id();
+	if (unlikely(sq_num >= priv->channels.num))
+		return NULL;
+
+	sq = &priv->channels.c[sq_num]->xdpsq;
+	if (unlikely(!test_bit(MLX5E_SQ_STATE_ENABLED, &sq->state)))
+		return NULL;
+
+	return sq;
+}
+
+static bool mlx5e_xdp_xmit_one(struct mlx5e_priv *priv,
+			       struct mlx5e_xdpsq *sq,
+			       struct xdp_frame *xdpf)
+{
+	struct mlx5e_xdp_info xdpi;
+
+	if (unlikely(!mlx5e_xdp_frame_len_ok(priv, priv->netdev, xdpf->len)))
+		return false;
+
+	xdpi.xdpf = xdpf;
+	xdpi.dma_addr = dma_map_single(sq->pdev, xdpf->data, xdpf->len,
+				       DMA_TO_DEVICE);
+	if (unlikely(dma_mapping_error(sq->pdev, xdpi.dma_addr)))
+		return false;
+
+	if (unlikely(!mlx5e_xmit_xdp_frame(sq, &xdpi, xdpf->data,
+					   xdpf->len))) {
+		dma_unmap_single(sq->pdev, xdpi.dma_addr, xdpf->len,
+				 DMA_TO_DEVICE);
+		return false;
+	}
+
+	return true;
+}
+
+int mlx5e_xdp_xmit(struct net_device *dev, int n, struct xdp_frame **frames,
+		   u32 flags)
+{
+	struct mlx5e_priv *priv = netdev_priv(dev);
+	struct mlx5e_xdpsq *sq;
+	int drops = 0;
+	int i;
+
+	if (unlikely(flags & ~XDP_XMIT_FLAGS_MASK))
+		return -EINVAL;
+
+	sq = mlx5e_xdp_redirect_sq(priv);
+	if (unlikely(!sq))
+		return -ENXIO;
+
+	for (i = 0; i < n; i++) {
+		struct xdp_frame *xdpf = frames[i];
+
+		if (unlikely(!mlx5e_xdp_xmit_one(priv, sq, xdpf))) {
+			xdp_return_frame(xdpf);
+			drops++;
+		}
+	}
+
+	if ((flags & XDP_XMIT_FLUSH) && sq->db.doorbell) {
+		mlx5e_xmit_xdp_doorbell(sq);
+		sq->db.doorbell = false;
 	}
+
+	return n - drops;
 }
 
 #ifdef CONFIG_MLX5_CORE_IPOIB
@@ -1582,7 +1582,8 @@ nfp_net_tx_xdp_buf(struct nfp_net_dp *dp, struct nfp_net_rx_ring *rx_ring,
 	return true;
 }
 
-static int nfp_net_run_xdp(struct bpf_prog *prog, void *data, void *hard_start,
+static int nfp_net_run_xdp(struct bpf_prog *prog, struct xdp_rxq_info *rxq,
+			   void *data, void *hard_start,
 			   unsigned int *off, unsigned int *len)
 {
 	struct xdp_buff xdp;
@@ -1592,6 +1593,7 @@ static int nfp_net_run_xdp(struct bpf_prog *prog, void *data, void *hard_start,
 	xdp.data_hard_start = hard_start;
 	xdp.data = data + *off;
 	xdp.data_end = data + *off + *len;
+	xdp.rxq = rxq;
 
 	orig_data = xdp.data;
 	ret = bpf_prog_run_xdp(prog, &xdp);
@@ -1721,7 +1723,8 @@ static int nfp_net_rx(struct nfp_net_rx_ring *rx_ring, int budget)
 
 			hard_start = rxbuf->frag + NFP_NET_RX_BUF_HEADROOM;
 
-			act = nfp_net_run_xdp(xdp_prog, rxbuf->frag, hard_start,
+			act = nfp_net_run_xdp(xdp_prog, &rx_ring->xdp_rxq,
+					      rxbuf->frag, hard_start,
 					      &pkt_off, &pkt_len);
 			switch (act) {
 			case XDP_PASS:
@@ -2256,6 +2259,8 @@ static void nfp_net_rx_ring_free(struct nfp_net_rx_ring *rx_ring)
 	struct nfp_net_r_vector *r_vec = rx_ring->r_vec;
 	struct nfp_net_dp *dp = &r_vec->nfp_net->dp;
 
+	if (dp->netdev)
+		xdp_rxq_info_unreg(&rx_ring->xdp_rxq);
 	kfree(rx_ring->rxbufs);
 
 	if (rx_ring->rxds)
@@ -2279,7 +2284,14 @@ static void nfp_net_rx_ring_free(struct nfp_net_rx_ring *rx_ring)
 static int
 nfp_net_rx_ring_alloc(struct nfp_net_dp *dp, struct nfp_net_rx_ring *rx_ring)
 {
-	int sz;
+	int sz, err;
+
+	if (dp->netdev) {
+		err = xdp_rxq_info_reg(&rx_ring->xdp_rxq, dp->netdev,
+				       rx_ring->idx);
+		if (err < 0)
+			return err;
+	}
 
 	rx_ring->cnt = dp->rxd_cnt;
 	rx_ring->size = sizeof(*rx_ring->rxds) * rx_ring->cnt;
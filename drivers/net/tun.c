@@ -175,6 +175,7 @@ struct tun_file {
 	struct list_head next;
 	struct tun_struct *detached;
 	struct skb_array tx_array;
+	struct xdp_rxq_info xdp_rxq;
 };
 
 struct tun_flow_entry {
@@ -549,6 +550,7 @@ static void __tun_detach(struct tun_file *tfile, bool clean)
 				   tun->tfiles[tun->numqueues - 1]);
 		ntfile = rtnl_dereference(tun->tfiles[index]);
 		ntfile->queue_index = index;
+		ntfile->xdp_rxq.queue_index = index;
 
 		--tun->numqueues;
 		if (clean) {
@@ -575,8 +577,10 @@ static void __tun_detach(struct tun_file *tfile, bool clean)
 			    tun->dev->reg_state == NETREG_REGISTERED)
 				unregister_netdevice(tun->dev);
 		}
-		if (tun)
+		if (tun) {
 			skb_array_cleanup(&tfile->tx_array);
+			xdp_rxq_info_unreg(&tfile->xdp_rxq);
+		}
 		sock_put(&tfile->sk);
 	}
 }
@@ -615,11 +619,13 @@ static void tun_detach_all(struct net_device *dev)
 		tfile = rtnl_dereference(tun->tfiles[i]);
 		/* Drop read queue */
 		tun_queue_purge(tfile);
+		xdp_rxq_info_unreg(&tfile->xdp_rxq);
 		sock_put(&tfile->sk);
 	}
 	list_for_each_entry_safe(tfile, tmp, &tun->disabled, next) {
 		tun_enable_queue(tfile);
 		tun_queue_purge(tfile);
+		xdp_rxq_info_unreg(&tfile->xdp_rxq);
 		sock_put(&tfile->sk);
 	}
 	BUG_ON(tun->numdisabled != 0);
@@ -673,6 +679,22 @@ static int tun_attach(struct tun_struct *tun, struct file *file, bool skip_filte
 
 	tfile->queue_index = tun->numqueues;
 	tfile->socket.sk->sk_shutdown &= ~RCV_SHUTDOWN;
+
+	if (tfile->detached) {
+		/* Re-attach detached tfile, updating XDP queue_index */
+		WARN_ON(!xdp_rxq_info_is_reg(&tfile->xdp_rxq));
+
+		if (tfile->xdp_rxq.queue_index != tfile->queue_index)
+			tfile->xdp_rxq.queue_index = tfile->queue_index;
+	} else {
+		/* Setup XDP RX-queue info, for new tfile getting attached */
+		err = xdp_rxq_info_reg(&tfile->xdp_rxq,
+				       tun->dev, tfile->queue_index);
+		if (err < 0)
+			goto out;
+		err = 0;
+	}
+
 	rcu_assign_pointer(tfile->tun, tun);
 	rcu_assign_pointer(tun->tfiles[tun->numqueues], tfile);
 	tun->numqueues++;
@@ -1316,6 +1338,7 @@ static struct sk_buff *tun_build_skb(struct tun_struct *tun,
 		xdp.data_hard_start = buf;
 		xdp.data = buf + pad;
 		xdp.data_end = xdp.data + len;
+		xdp.rxq = &tfile->xdp_rxq;
 		orig_data = xdp.data;
 		act = bpf_prog_run_xdp(xdp_prog, &xdp);
 
@@ -1830,18 +1853,159 @@ static void tun_sock_write_space(struct sock *sk)
 	kill_fasync(&tfile->fasync, SIGIO, POLL_OUT);
 }
 
+/* Run XDP on, and build an skb for, one buffer of a TUN_MSG_PTR batch.
+ * Returns the number of bytes queued on @list, or 0 if the buffer was
+ * consumed otherwise.
+ */
+static int tun_xdp_one(struct tun_struct *tun, struct tun_file *tfile,
+		       struct xdp_buff *xdp, struct list_head *list,
+		       bool *flush)
+{
+	struct tun_xdp_hdr *hdr = xdp->data_hard_start;
+	/* XDP may move the head over the header, keep a copy */
+	struct virtio_net_hdr gso = hdr->gso;
+	int buflen = hdr->buflen;
+	struct bpf_prog *xdp_prog;
+	struct sk_buff *skb;
+	bool xdp_xmit = false;
+	int len;
+	u32 act;
+
+	xdp_prog = rcu_dereference(tun->xdp_prog);
+	if (xdp_prog && !gso.gso_type) {
+		xdp->rxq = &tfile->xdp_rxq;
+		act = bpf_prog_run_xdp(xdp_prog, xdp);
+
+		switch (act) {
+		case XDP_REDIRECT:
+			if (xdp_do_redirect(tun->dev, xdp, xdp_prog))
+				goto drop;
+			*flush = true;
+			return 0;
+		case XDP_TX:
+			xdp_xmit = true;
+			/* fall through */
+		case XDP_PASS:
+			break;
+		default:
+			bpf_warn_invalid_xdp_action(act);
+			/* fall through */
+		case XDP_ABORTED:
+			trace_xdp_exception(tun->dev, xdp_prog, act);
+			/* fall through */
+		case XDP_DROP:
+			goto drop;
+		}
+	}
+
+	skb = build_skb(xdp->data_hard_start, buflen);
+	if (!skb)
+		goto drop;
+
+	skb_reserve(skb, xdp->data - xdp->data_hard_start);
+	skb_put(skb, xdp->data_end - xdp->data);
+	len = skb->len;
+
+	if (xdp_xmit) {
+		skb->dev = tun->dev;
+		generic_xdp_tx(skb, xdp_prog);
+		return 0;
+	}
+
+	if (virtio_net_hdr_to_skb(skb, &gso, tun_is_little_endian(tun))) {
+		this_cpu_inc(tun->pcpu_stats->rx_frame_errors);
+		kfree_skb(skb);
+		return 0;
+	}
+
+	skb->protocol = eth_type_trans(skb, tun->dev);
+	skb_reset_network_header(skb);
+	skb_probe_transport_header(skb, 0);
+
+	/* GSO frames skipped native XDP above */
+	if (xdp_prog && do_xdp_generic(xdp_prog, skb) != XDP_PASS)
+		return 0;
+
+	tun_flow_update(tun, __skb_get_hash_symmetric(skb), tfile);
+	list_add_tail(&skb->list, list);
+	return len;
+
+drop:
+	this_cpu_inc(tun->pcpu_stats->rx_dropped);
+	put_page(virt_to_head_page(xdp->data_hard_start));
+	return 0;
+}
+
+/* Takes ownership of all @n buffers unless an error is returned */
+static int tun_xdp_batch(struct tun_struct *tun, struct tun_file *tfile,
+			 struct xdp_buff *xdp, int n)
+{
+	struct tun_pcpu_stats *stats;
+	unsigned int packets = 0;
+	u64 bytes = 0;
+	bool flush = false;
+	LIST_HEAD(list);
+	int i, len;
+
+	if (!(tun->dev->flags & IFF_UP))
+		return -EIO;
+
+	/* Buffers are plain ethernet frames, without packet information */
+	if ((tun->flags & (TUN_TYPE_MASK | IFF_NO_PI)) != (IFF_TAP | IFF_NO_PI))
+		return -EOPNOTSUPP;
+
+	local_bh_disable();
+	rcu_read_lock();
+
+	for (i = 0; i < n; i++) {
+		len = tun_xdp_one(tun, tfile, &xdp[i], &list, &flush);
+		if (len) {
+			packets++;
+			bytes += len;
+		}
+	}
+
+	if (flush)
+		xdp_do_flush_map();
+	netif_receive_skb_list(&list);
+
+	rcu_read_unlock();
+	local_bh_enable();
+
+	stats = get_cpu_ptr(tun->pcpu_stats);
+	u64_stats_update_begin(&stats->syncp);
+	stats->rx_packets += packets;
+	stats->rx_bytes += bytes;
+	u64_stats_update_end(&stats->syncp);
+	put_cpu_ptr(stats);
+
+	return 0;
+}
+
 static int tun_sendmsg(struct socket *sock, struct msghdr *m, size_t total_len)
 {
 	int ret;
 	struct tun_file *tfile = container_of(sock, struct tun_file, socket);
 	struct tun_struct *tun = __tun_get(tfile);
+	struct tun_msg_ctl *ctl = m->msg_control;
 
 	if (!tun)
 		return -EBADFD;
 
-	ret = tun_get_user(tun, tfile, m->msg_control, &m->msg_iter,
+	if (ctl && ctl->type == TUN_MSG_PTR) {
+		ret = tun_xdp_batch(tun, tfile, ctl->ptr, ctl->num);
+		goto out;
+	}
+
+	if (ctl && ctl->type != TUN_MSG_UBUF) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	ret = tun_get_user(tun, tfile, ctl ? ctl->ptr : NULL, &m->msg_iter,
 			   m->msg_flags & MSG_DONTWAIT,
 			   m->msg_flags & MSG_MORE);
+out:
 	tun_put(tun);
 	return ret;
 }
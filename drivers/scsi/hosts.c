@@ -23,6 +23,7 @@
 
 #include <linux/module.h>
 #include <linux/blkdev.h>
+#include <linux/blk-mq.h>
 #include <linux/kernel.h>
 #include <linux/slab.h>
 #include <linux/kthread.h>
@@ -34,6 +35,7 @@
 #include <linux/platform_device.h>
 #include <linux/pm_runtime.h>
 #include <linux/idr.h>
+#include <scsi/scsi_cmnd.h>
 #include <scsi/scsi_device.h>
 #include <scsi/scsi_host.h>
 #include <scsi/scsi_transport.h>
@@ -594,6 +596,33 @@ void scsi_host_put(struct Scsi_Host *shost)
 }
 EXPORT_SYMBOL(scsi_host_put);
 
+static void scsi_host_check_in_flight(struct request *rq, void *data,
+				      bool reserved)
+{
+	struct scsi_cmnd *cmd = blk_mq_rq_to_pdu(rq);
+	int *count = data;
+
+	if (test_bit(SCMD_STATE_INFLIGHT, &cmd->state))
+		(*count)++;
+}
+
+/**
+ * scsi_host_busy - Return the number of commands active on the host
+ * @shost:	Pointer to Scsi_Host.
+ **/
+int scsi_host_busy(struct Scsi_Host *shost)
+{
+	int count = 0;
+
+	if (!scsi_host_busy_by_tags(shost))
+		return atomic_read(&shost->host_busy);
+
+	blk_mq_tagset_busy_iter(&shost->tag_set, scsi_host_check_in_flight,
+				&count);
+	return count;
+}
+EXPORT_SYMBOL(scsi_host_busy);
+
 int scsi_init_hosts(void)
 {
 	return class_register(&shost_class);
@@ -180,7 +180,7 @@ static void __scsi_queue_insert(struct scsi_cmnd *cmd, int reason, int unbusy)
 	 * active on the host/device.
 	 */
 	if (unbusy)
-		scsi_device_unbusy(device);
+		scsi_device_unbusy(device, cmd);
 
 	/*
 	 * Requeue this command.  It will go before all other commands
@@ -318,13 +318,16 @@ static void scsi_init_cmd_errh(struct scsi_cmnd *cmd)
 		cmd->cmd_len = scsi_command_size(cmd->cmnd);
 }
 
-void scsi_device_unbusy(struct scsi_device *sdev)
+void scsi_device_unbusy(struct scsi_device *sdev, struct scsi_cmnd *cmd)
 {
 	struct Scsi_Host *shost = sdev->host;
 	struct scsi_target *starget = scsi_target(sdev);
 	unsigned long flags;
 
-	atomic_dec(&shost->host_busy);
+	if (scsi_host_busy_by_tags(shost))
+		clear_bit(SCMD_STATE_INFLIGHT, &cmd->state);
+	else
+		atomic_dec(&shost->host_busy);
 	if (starget->can_queue > 0)
 		atomic_dec(&starget->target_busy);
 
@@ -1490,12 +1493,24 @@ static inline int scsi_host_queue_ready(struct request_queue *q,
 				   struct Scsi_Host *shost,
 				   struct scsi_device *sdev)
 {
+	bool by_tags = scsi_host_busy_by_tags(shost);
 	unsigned int busy;
 
 	if (scsi_host_in_recovery(shost))
 		return 0;
 
-	busy = atomic_inc_return(&shost->host_busy) - 1;
+	/*
+	 * Counted from the tags, the busy count is only needed to unblock
+	 * the host, or if can_queue was lowered below the tag set depth.
+	 */
+	if (!by_tags)
+		busy = atomic_inc_return(&shost->host_busy) - 1;
+	else if (atomic_read(&shost->host_blocked) > 0 ||
+		 shost->can_queue < shost->tag_set.queue_depth)
+		busy = scsi_host_busy(shost);
+	else
+		busy = 0;
+
 	if (atomic_read(&shost->host_blocked) > 0) {
 		if (busy)
 			goto starved;
@@ -1532,7 +1547,8 @@ static inline int scsi_host_queue_ready(struct request_queue *q,
 		list_add_tail(&sdev->starved_entry, &shost->starved_list);
 	spin_unlock_irq(shost->host_lock);
 out_dec:
-	atomic_dec(&shost->host_busy);
+	if (!by_tags)
+		atomic_dec(&shost->host_busy);
 	return 0;
 }
 
@@ -1983,6 +1999,10 @@ static blk_status_t scsi_queue_rq(struct blk_mq_hw_ctx *hctx,
 	scsi_init_cmd_errh(cmd);
 	cmd->scsi_done = scsi_mq_done;
 
+	/* counted by scsi_host_busy() until scsi_device_unbusy() */
+	if (scsi_host_busy_by_tags(shost))
+		set_bit(SCMD_STATE_INFLIGHT, &cmd->state);
+
 	reason = scsi_dispatch_cmd(cmd);
 	if (reason) {
 		scsi_set_blocked(cmd, reason);
@@ -1993,7 +2013,10 @@ static blk_status_t scsi_queue_rq(struct blk_mq_hw_ctx *hctx,
 	return BLK_STS_OK;
 
 out_dec_host_busy:
-	atomic_dec(&shost->host_busy);
+	if (scsi_host_busy_by_tags(shost))
+		clear_bit(SCMD_STATE_INFLIGHT, &cmd->state);
+	else
+		atomic_dec(&shost->host_busy);
 out_dec_target_busy:
 	if (scsi_target(sdev)->can_queue > 0)
 		atomic_dec(&scsi_target(sdev)->target_busy);
@@ -2071,7 +2094,7 @@ static int scsi_map_queues(struct blk_mq_tag_set *set)
 
 	if (shost->hostt->map_queues)
 		return shost->hostt->map_queues(shost);
-	return blk_mq_map_queues(set);
+	return blk_mq_map_queues(&set->map[HCTX_TYPE_DEFAULT]);
 }
 
 static u64 scsi_calculate_bounce_limit(struct Scsi_Host *shost)
@@ -5,6 +5,7 @@
 #include <linux/device.h>
 #include <linux/async.h>
 #include <scsi/scsi_device.h>
+#include <scsi/scsi_host.h>
 
 struct request_queue;
 struct request;
@@ -80,11 +81,23 @@ int scsi_eh_get_sense(struct list_head *work_q,
 		      struct list_head *done_q);
 int scsi_noretry_cmd(struct scsi_cmnd *scmd);
 
+/*
+ * With a single hardware queue, blk-mq hands out no more than can_queue
+ * driver tags for the host: the commands active on it are then counted
+ * from the tags rather than with host_busy, which all the submitting and
+ * completing cpus would otherwise share.
+ */
+static inline bool scsi_host_busy_by_tags(struct Scsi_Host *shost)
+{
+	return shost_use_blk_mq(shost) && shost->tag_set.nr_hw_queues == 1;
+}
+
 /* scsi_lib.c */
 extern void scsi_add_cmd_to_list(struct scsi_cmnd *cmd);
 extern void scsi_del_cmd_from_list(struct scsi_cmnd *cmd);
 extern int scsi_maybe_unblock_host(struct scsi_device *sdev);
-extern void scsi_device_unbusy(struct scsi_device *sdev);
+extern void scsi_device_unbusy(struct scsi_device *sdev,
+			       struct scsi_cmnd *cmd);
 extern void scsi_queue_insert(struct scsi_cmnd *cmd, int reason);
 extern void scsi_io_completion(struct scsi_cmnd *, unsigned int);
 extern void scsi_run_host_queues(struct Scsi_Host *shost);
@@ -1018,6 +1018,13 @@ static int sd_setup_read_write_cmnd(struct scsi_cmnd *SCpnt)
 			return ret;
 	}
 
+	if (req_op(rq) == REQ_OP_ZONE_APPEND) {
+		/* Written at the write pointer, known under the zone lock */
+		ret = sd_zbc_prepare_zone_append(SCpnt, &block, this_count);
+		if (ret != BLKPREP_OK)
+			goto out;
+	}
+
 	ret = scsi_init_io(SCpnt);
 	if (ret != BLKPREP_OK)
 		goto out;
@@ -1271,6 +1278,7 @@ static int sd_init_command(struct scsi_cmnd *cmd)
 		return sd_setup_flush_cmnd(cmd);
 	case REQ_OP_READ:
 	case REQ_OP_WRITE:
+	case REQ_OP_ZONE_APPEND:
 		return sd_setup_read_write_cmnd(cmd);
 	case REQ_OP_ZONE_REPORT:
 		return sd_zbc_setup_report_cmnd(cmd);
@@ -78,6 +78,10 @@ struct scsi_disk {
 	unsigned int	zone_blocks;
 	unsigned int	zone_shift;
 	unsigned long	*zones_wlock;
+	u32		*zones_wp_ofst;
+	spinlock_t	zones_wp_ofst_lock;
+	struct work_struct zones_wp_ofst_work;
+	unsigned char	*zones_wp_ofst_buf;
 	unsigned int	zones_optimal_open;
 	unsigned int	zones_optimal_nonseq;
 	unsigned int	zones_max_open;
@@ -287,6 +291,8 @@ extern int sd_zbc_write_lock_zone(struct scsi_cmnd *cmd);
 extern void sd_zbc_write_unlock_zone(struct scsi_cmnd *cmd);
 extern int sd_zbc_setup_report_cmnd(struct scsi_cmnd *cmd);
 extern int sd_zbc_setup_reset_cmnd(struct scsi_cmnd *cmd);
+extern int sd_zbc_prepare_zone_append(struct scsi_cmnd *cmd, sector_t *sector,
+				      unsigned int nr_sectors);
 extern void sd_zbc_complete(struct scsi_cmnd *cmd, unsigned int good_bytes,
 			    struct scsi_sense_hdr *sshdr);
 
@@ -320,6 +326,13 @@ static inline int sd_zbc_setup_reset_cmnd(struct scsi_cmnd *cmd)
 	return BLKPREP_INVALID;
 }
 
+static inline int sd_zbc_prepare_zone_append(struct scsi_cmnd *cmd,
+					     sector_t *sector,
+					     unsigned int nr_sectors)
+{
+	return BLKPREP_INVALID;
+}
+
 static inline void sd_zbc_complete(struct scsi_cmnd *cmd,
 				   unsigned int good_bytes,
 				   struct scsi_sense_hdr *sshdr) {}
@@ -55,6 +55,16 @@ enum zbc_zone_cond {
 	ZBC_ZONE_COND_OFFLINE,
 };
 
+/*
+ * Zone append is emulated with regular writes at the write pointer of the
+ * zones, whose offsets from the zone start (in 512B sectors) are tracked
+ * here.  The offset of a zone is unknown until it is first needed and read
+ * back with a zone report, or after a failed write.
+ */
+#define SD_ZBC_INVALID_WP_OFST	(~0u)
+#define SD_ZBC_UPDATING_WP_OFST	(SD_ZBC_INVALID_WP_OFST - 1)
+#define SD_ZBC_NO_WP_OFST	(SD_ZBC_INVALID_WP_OFST - 2)
+
 /**
  * Convert a zone descriptor to a zone struct.
  */
@@ -231,6 +241,160 @@ static inline unsigned int sd_zbc_zone_no(struct scsi_disk *sdkp,
 	return sectors_to_logical(sdkp->device, sector) >> sdkp->zone_shift;
 }
 
+static u32 sd_zbc_zone_wp_ofst(struct blk_zone *zone)
+{
+	if (zone->type == ZBC_ZONE_TYPE_CONV)
+		return SD_ZBC_NO_WP_OFST;
+
+	switch (zone->cond) {
+	case ZBC_ZONE_COND_READONLY:
+	case ZBC_ZONE_COND_OFFLINE:
+		return SD_ZBC_NO_WP_OFST;
+	case ZBC_ZONE_COND_FULL:
+		return zone->len;
+	default:
+		return zone->wp - zone->start;
+	}
+}
+
+/*
+ * Read back the write pointer of the zones marked by
+ * sd_zbc_prepare_zone_append(), whose zone appends are deferred meanwhile.
+ */
+static void sd_zbc_update_wp_ofst_workfn(struct work_struct *work)
+{
+	struct scsi_disk *sdkp = container_of(work, struct scsi_disk,
+					      zones_wp_ofst_work);
+	struct blk_zone zone;
+	unsigned long flags;
+	unsigned int zno;
+	int ret;
+
+	spin_lock_irqsave(&sdkp->zones_wp_ofst_lock, flags);
+	for (zno = 0; zno < sdkp->nr_zones; zno++) {
+		if (sdkp->zones_wp_ofst[zno] != SD_ZBC_UPDATING_WP_OFST)
+			continue;
+		spin_unlock_irqrestore(&sdkp->zones_wp_ofst_lock, flags);
+
+		ret = sd_zbc_report_zones(sdkp, sdkp->zones_wp_ofst_buf,
+					  SD_BUF_SIZE,
+					  (sector_t)zno << sdkp->zone_shift);
+		if (!ret)
+			sd_zbc_parse_report(sdkp, sdkp->zones_wp_ofst_buf + 64,
+					    &zone);
+
+		spin_lock_irqsave(&sdkp->zones_wp_ofst_lock, flags);
+		/* A zone reset may have completed meanwhile */
+		if (sdkp->zones_wp_ofst[zno] == SD_ZBC_UPDATING_WP_OFST)
+			sdkp->zones_wp_ofst[zno] = ret ?
+				SD_ZBC_INVALID_WP_OFST :
+				sd_zbc_zone_wp_ofst(&zone);
+	}
+	spin_unlock_irqrestore(&sdkp->zones_wp_ofst_lock, flags);
+
+	scsi_device_put(sdkp->device);
+}
+
+/**
+ * sd_zbc_prepare_zone_append - Locate a zone append
+ * @cmd: the command setup
+ * @sector: the sector of the command, moved to the zone write pointer
+ * @nr_sectors: the size of the command
+ *
+ * Called with the zone write locked, so that the position of the write
+ * pointer can't change until the command completes.
+ */
+int sd_zbc_prepare_zone_append(struct scsi_cmnd *cmd, sector_t *sector,
+			       unsigned int nr_sectors)
+{
+	struct request *rq = cmd->request;
+	struct scsi_disk *sdkp = scsi_disk(rq->rq_disk);
+	unsigned int zno = sd_zbc_zone_no(sdkp, *sector);
+	int ret = BLKPREP_OK;
+	unsigned long flags;
+	u32 wp_ofst;
+
+	if (!sdkp->zones_wp_ofst)
+		return BLKPREP_KILL;
+
+	spin_lock_irqsave(&sdkp->zones_wp_ofst_lock, flags);
+	wp_ofst = sdkp->zones_wp_ofst[zno];
+	switch (wp_ofst) {
+	case SD_ZBC_INVALID_WP_OFST:
+		/* The update work needs the device until it is done */
+		if (scsi_device_get(sdkp->device)) {
+			ret = BLKPREP_KILL;
+			break;
+		}
+		sdkp->zones_wp_ofst[zno] = SD_ZBC_UPDATING_WP_OFST;
+		if (!schedule_work(&sdkp->zones_wp_ofst_work))
+			scsi_device_put(sdkp->device);
+		/* fall through */
+	case SD_ZBC_UPDATING_WP_OFST:
+		ret = BLKPREP_DEFER;
+		break;
+	case SD_ZBC_NO_WP_OFST:
+		/* Conventional, read-only or offline zone */
+		ret = BLKPREP_KILL;
+		break;
+	default:
+		if (wp_ofst + nr_sectors > sd_zbc_zone_sectors(sdkp)) {
+			/* Zone full */
+			ret = BLKPREP_KILL;
+			break;
+		}
+		*sector += wp_ofst;
+		break;
+	}
+	spin_unlock_irqrestore(&sdkp->zones_wp_ofst_lock, flags);
+
+	return ret;
+}
+
+/*
+ * Keep track of the write pointer of a zone written or reset, and return
+ * the location of a zone append in the position of its request.
+ */
+static void sd_zbc_update_wp_ofst(struct scsi_cmnd *cmd,
+				  unsigned int good_bytes)
+{
+	struct request *rq = cmd->request;
+	struct scsi_disk *sdkp = scsi_disk(rq->rq_disk);
+	unsigned int zno = sd_zbc_zone_no(sdkp, blk_rq_pos(rq));
+	sector_t zone_mask = sd_zbc_zone_sectors(sdkp) - 1;
+	unsigned long flags;
+	u32 *wp_ofst;
+
+	if (!sdkp->zones_wp_ofst)
+		return;
+
+	spin_lock_irqsave(&sdkp->zones_wp_ofst_lock, flags);
+	wp_ofst = &sdkp->zones_wp_ofst[zno];
+	switch (req_op(rq)) {
+	case REQ_OP_ZONE_RESET:
+		if (*wp_ofst != SD_ZBC_NO_WP_OFST)
+			*wp_ofst = cmd->result ? SD_ZBC_INVALID_WP_OFST : 0;
+		break;
+	case REQ_OP_ZONE_APPEND:
+		/* A partial zone append is failed by the block layer */
+		if (!cmd->result && good_bytes == blk_rq_bytes(rq) &&
+		    *wp_ofst < SD_ZBC_NO_WP_OFST)
+			rq->__sector += *wp_ofst;
+		/* fall through */
+	case REQ_OP_WRITE:
+	case REQ_OP_WRITE_ZEROES:
+	case REQ_OP_WRITE_SAME:
+		if (*wp_ofst >= SD_ZBC_NO_WP_OFST)
+			break;
+		if (cmd->result || (blk_rq_pos(rq) & zone_mask) != *wp_ofst)
+			*wp_ofst = SD_ZBC_INVALID_WP_OFST;
+		else
+			*wp_ofst += good_bytes >> 9;
+		break;
+	}
+	spin_unlock_irqrestore(&sdkp->zones_wp_ofst_lock, flags);
+}
+
 int sd_zbc_setup_reset_cmnd(struct scsi_cmnd *cmd)
 {
 	struct request *rq = cmd->request;
@@ -338,6 +502,7 @@ void sd_zbc_complete(struct scsi_cmnd *cmd,
 	case REQ_OP_WRITE:
 	case REQ_OP_WRITE_ZEROES:
 	case REQ_OP_WRITE_SAME:
+	case REQ_OP_ZONE_APPEND:
 
 		if (result &&
 		    sshdr->sense_key == ILLEGAL_REQUEST &&
@@ -354,9 +519,13 @@ void sd_zbc_complete(struct scsi_cmnd *cmd,
 
 		if (!result)
 			sd_zbc_report_zones_complete(cmd, good_bytes);
-		break;
+		return;
 
+	default:
+		return;
 	}
+
+	sd_zbc_update_wp_ofst(cmd, good_bytes);
 }
 
 /**
@@ -546,6 +715,29 @@ static int sd_zbc_setup(struct scsi_disk *sdkp)
 			return -ENOMEM;
 	}
 
+	if (!sdkp->zones_wp_ofst) {
+		sdkp->zones_wp_ofst_buf = kmalloc(SD_BUF_SIZE, GFP_KERNEL);
+		if (!sdkp->zones_wp_ofst_buf)
+			return -ENOMEM;
+		sdkp->zones_wp_ofst = kmalloc_array(sdkp->nr_zones,
+						    sizeof(u32), GFP_KERNEL);
+		if (!sdkp->zones_wp_ofst) {
+			kfree(sdkp->zones_wp_ofst_buf);
+			sdkp->zones_wp_ofst_buf = NULL;
+			return -ENOMEM;
+		}
+		spin_lock_init(&sdkp->zones_wp_ofst_lock);
+		INIT_WORK(&sdkp->zones_wp_ofst_work,
+			  sd_zbc_update_wp_ofst_workfn);
+	}
+
+	/* The write pointers are read back when zone appends need them */
+	spin_lock_irq(&sdkp->zones_wp_ofst_lock);
+	memset(sdkp->zones_wp_ofst, 0xff, sdkp->nr_zones * sizeof(u32));
+	spin_unlock_irq(&sdkp->zones_wp_ofst_lock);
+
+	blk_queue_max_zone_append_sectors(sdkp->disk->queue, UINT_MAX);
+
 	return 0;
 }
 
@@ -612,6 +804,14 @@ int sd_zbc_read_zones(struct scsi_disk *sdkp,
 
 void sd_zbc_remove(struct scsi_disk *sdkp)
 {
+	/* A pending update work holds a reference on the device */
+	if (sdkp->zones_wp_ofst &&
+	    cancel_work_sync(&sdkp->zones_wp_ofst_work))
+		scsi_device_put(sdkp->device);
+	kfree(sdkp->zones_wp_ofst);
+	sdkp->zones_wp_ofst = NULL;
+	kfree(sdkp->zones_wp_ofst_buf);
+	sdkp->zones_wp_ofst_buf = NULL;
 	kfree(sdkp->zones_wlock);
 	sdkp->zones_wlock = NULL;
 }
@@ -792,7 +792,8 @@ static int virtscsi_map_queues(struct Scsi_Host *shost)
 {
 	struct virtio_scsi *vscsi = shost_priv(shost);
 
-	return blk_mq_virtio_map_queues(&shost->tag_set, vscsi->vdev, 2);
+	return blk_mq_virtio_map_queues(&shost->tag_set.map[HCTX_TYPE_DEFAULT],
+					vscsi->vdev, 2);
 }
 
 /*
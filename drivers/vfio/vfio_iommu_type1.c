@@ -25,6 +25,7 @@
  */
 
 #include <linux/compat.h>
+#include <linux/completion.h>
 #include <linux/device.h>
 #include <linux/fs.h>
 #include <linux/iommu.h>
@@ -58,6 +59,11 @@ module_param_named(disable_hugepages,
 MODULE_PARM_DESC(disable_hugepages,
 		 "Disable VFIO IOMMU support for IOMMU hugepages.");
 
+static unsigned int map_threads = 8;
+module_param_named(map_threads, map_threads, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(map_threads,
+		 "Maximum number of threads pinning and mapping a DMA range.");
+
 struct vfio_iommu {
 	struct list_head	domain_list;
 	struct vfio_domain	*external_domain; /* domain for external user */
@@ -333,70 +339,90 @@ static int put_pfn(unsigned long pfn, int prot)
 	return 0;
 }
 
-static int vaddr_get_pfn(struct mm_struct *mm, unsigned long vaddr,
-			 int prot, unsigned long *pfn)
+/*
+ * Pins the pages of up to @npages consecutive pfns from @vaddr, the
+ * first one being returned in @pfn.  Huge pages are pinned whole at once.
+ * Returns the number of pfns pinned or -errno.
+ */
+static long vaddr_get_pfns(struct mm_struct *mm, unsigned long vaddr,
+			   long npages, int prot, unsigned long *pfn)
 {
-	struct page *page[1];
+	struct page_range range;
+	unsigned long nr_ranges = 1;
 	struct vm_area_struct *vma;
-	int ret;
-
-	if (mm == current->mm) {
-		ret = get_user_pages_fast(vaddr, 1, !!(prot & IOMMU_WRITE),
-					  page);
-	} else {
-		unsigned int flags = 0;
+	unsigned int flags = 0;
+	long ret;
 
-		if (prot & IOMMU_WRITE)
-			flags |= FOLL_WRITE;
+	if (prot & IOMMU_WRITE)
+		flags |= FOLL_WRITE;
 
-		down_read(&mm->mmap_sem);
-		ret = get_user_pages_remote(NULL, mm, vaddr, 1, flags, page,
-					    NULL, NULL);
-		up_read(&mm->mmap_sem);
-	}
+	down_read(&mm->mmap_sem);
 
-	if (ret == 1) {
-		*pfn = page_to_pfn(page[0]);
-		return 0;
+	if (mm == current->mm)
+		ret = get_user_page_ranges(vaddr, npages, flags,
+					   &range, &nr_ranges);
+	else
+		ret = get_user_page_ranges_remote(NULL, mm, vaddr, npages,
+						  flags, &range, &nr_ranges);
+	if (ret > 0) {
+		*pfn = page_to_pfn(range.page);
+		goto out;
 	}
 
-	down_read(&mm->mmap_sem);
-
 	vma = find_vma_intersection(mm, vaddr, vaddr + 1);
 
 	if (vma && vma->vm_flags & VM_PFNMAP) {
 		*pfn = ((vaddr - vma->vm_start) >> PAGE_SHIFT) + vma->vm_pgoff;
 		if (is_invalid_reserved_pfn(*pfn))
-			ret = 0;
+			ret = 1;
 	}
 
+out:
 	up_read(&mm->mmap_sem);
 	return ret;
 }
 
+static int vaddr_get_pfn(struct mm_struct *mm, unsigned long vaddr,
+			 int prot, unsigned long *pfn)
+{
+	long ret = vaddr_get_pfns(mm, vaddr, 1, prot, pfn);
+
+	return ret < 0 ? ret : 0;
+}
+
 /*
  * Attempt to pin pages.  We really don't want to track all the pfns and
  * the iommu can only map chunks of consecutive pfns anyway, so get the
  * first page and all consecutive pages with the same locking.
  */
-static long vfio_pin_pages_remote(struct vfio_dma *dma, unsigned long vaddr,
+static long vfio_pin_pages_remote(struct vfio_dma *dma,
+				  struct task_struct *task, unsigned long vaddr,
 				  long npage, unsigned long *pfn_base,
 				  bool lock_cap, unsigned long limit)
 {
+	struct mm_struct *mm = task->mm;
 	unsigned long pfn = 0;
-	long ret, pinned = 0, lock_acct = 0;
+	long ret, pinned = 0, lock_acct = 0, batch;
 	bool rsvd;
 	dma_addr_t iova = vaddr - dma->vaddr + dma->iova;
 
 	/* This code path is only user initiated */
-	if (!current->mm)
+	if (!mm)
 		return -ENODEV;
 
-	ret = vaddr_get_pfn(current->mm, vaddr, dma->prot, pfn_base);
-	if (ret)
-		return ret;
+	/*
+	 * The pfns following the first one are pinned ahead in batches, up
+	 * to the end of a huge page or of a physically contiguous run.
+	 */
+	batch = vaddr_get_pfns(mm, vaddr,
+			       disable_hugepages ? 1 : npage,
+			       dma->prot, pfn_base);
+	if (batch < 0)
+		return batch;
 
 	pinned++;
+	batch--;
+	pfn = *pfn_base;
 	rsvd = is_invalid_reserved_pfn(*pfn_base);
 
 	/*
@@ -404,8 +430,9 @@ static long vfio_pin_pages_remote(struct vfio_dma *dma, unsigned long vaddr,
 	 * pages are already counted against the user.
 	 */
 	if (!rsvd && !vfio_find_vpfn(dma, iova)) {
-		if (!lock_cap && current->mm->locked_vm + 1 > limit) {
-			put_pfn(*pfn_base, dma->prot);
+		if (!lock_cap && mm->locked_vm + 1 > limit) {
+			for (; batch >= 0; batch--)
+				put_pfn(pfn++, dma->prot);
 			pr_warn("%s: RLIMIT_MEMLOCK (%ld) exceeded\n", __func__,
 					limit << PAGE_SHIFT);
 			return -ENOMEM;
@@ -419,20 +446,29 @@ static long vfio_pin_pages_remote(struct vfio_dma *dma, unsigned long vaddr,
 	/* Lock all the consecutive pages from pfn_base */
 	for (vaddr += PAGE_SIZE, iova += PAGE_SIZE; pinned < npage;
 	     pinned++, vaddr += PAGE_SIZE, iova += PAGE_SIZE) {
-		ret = vaddr_get_pfn(current->mm, vaddr, dma->prot, &pfn);
-		if (ret)
-			break;
+		if (batch) {
+			pfn++;
+			batch--;
+		} else {
+			batch = vaddr_get_pfns(mm, vaddr,
+					       npage - pinned, dma->prot, &pfn);
+			if (batch < 0)
+				break;
+			batch--;
+		}
 
 		if (pfn != *pfn_base + pinned ||
 		    rsvd != is_invalid_reserved_pfn(pfn)) {
-			put_pfn(pfn, dma->prot);
+			for (; batch >= 0; batch--)
+				put_pfn(pfn++, dma->prot);
 			break;
 		}
 
 		if (!rsvd && !vfio_find_vpfn(dma, iova)) {
 			if (!lock_cap &&
-			    current->mm->locked_vm + lock_acct + 1 > limit) {
-				put_pfn(pfn, dma->prot);
+			    mm->locked_vm + lock_acct + 1 > limit) {
+				for (; batch >= 0; batch--)
+					put_pfn(pfn++, dma->prot);
 				pr_warn("%s: RLIMIT_MEMLOCK (%ld) exceeded\n",
 					__func__, limit << PAGE_SHIFT);
 				ret = -ENOMEM;
@@ -443,7 +479,8 @@ static long vfio_pin_pages_remote(struct vfio_dma *dma, unsigned long vaddr,
 	}
 
 out:
-	ret = vfio_lock_acct(current, lock_acct, &lock_cap);
+	/* rechecks the limit, the other map threads may have locked pages */
+	ret = vfio_lock_acct(task, lock_acct, &lock_cap);
 
 unpin_out:
 	if (ret) {
@@ -648,19 +685,18 @@ static int vfio_iommu_type1_unpin_pages(void *iommu_data,
 	return i > npage ? npage : (i > 0 ? i : -EINVAL);
 }
 
-static long vfio_unmap_unpin(struct vfio_iommu *iommu, struct vfio_dma *dma,
-			     bool do_accounting)
+/*
+ * Unmaps and unpins [@iova, @iova + @size) of @dma, returns the number of
+ * pages unpinned, still accounted as locked.
+ */
+static long vfio_unmap_unpin_range(struct vfio_iommu *iommu,
+				   struct vfio_dma *dma, dma_addr_t iova,
+				   size_t size)
 {
-	dma_addr_t iova = dma->iova, end = dma->iova + dma->size;
+	dma_addr_t end = iova + size;
 	struct vfio_domain *domain, *d;
 	long unlocked = 0;
 
-	if (!dma->size)
-		return 0;
-
-	if (!IS_IOMMU_CAP_DOMAIN_IN_CONTAINER(iommu))
-		return 0;
-
 	/*
 	 * We use the IOMMU to track the physical addresses, otherwise we'd
 	 * need a much more complicated tracking system.  Unfortunately that
@@ -672,7 +708,7 @@ static long vfio_unmap_unpin(struct vfio_iommu *iommu, struct vfio_dma *dma,
 				      struct vfio_domain, next);
 
 	list_for_each_entry_continue(d, &iommu->domain_list, next) {
-		iommu_unmap(d->domain, dma->iova, dma->size);
+		iommu_unmap(d->domain, iova, size);
 		cond_resched();
 	}
 
@@ -711,6 +747,22 @@ static long vfio_unmap_unpin(struct vfio_iommu *iommu, struct vfio_dma *dma,
 		cond_resched();
 	}
 
+	return unlocked;
+}
+
+static long vfio_unmap_unpin(struct vfio_iommu *iommu, struct vfio_dma *dma,
+			     bool do_accounting)
+{
+	long unlocked;
+
+	if (!dma->size)
+		return 0;
+
+	if (!IS_IOMMU_CAP_DOMAIN_IN_CONTAINER(iommu))
+		return 0;
+
+	unlocked = vfio_unmap_unpin_range(iommu, dma, dma->iova, dma->size);
+
 	dma->iommu_mapped = false;
 	if (do_accounting) {
 		vfio_lock_acct(dma->task, -unlocked, NULL);
@@ -917,47 +969,163 @@ static int vfio_iommu_map(struct vfio_iommu *iommu, dma_addr_t iova,
 	return ret;
 }
 
-static int vfio_pin_map_dma(struct vfio_iommu *iommu, struct vfio_dma *dma,
-			    size_t map_size)
+/*
+ * The large mappings are pinned and mapped by chunks of VFIO_MAP_CHUNK,
+ * taken in turn by the calling thread and up to map_threads - 1 workers.
+ */
+#define VFIO_MAP_CHUNK		(1UL << 30)
+
+struct vfio_map_ctx {
+	struct vfio_iommu	*iommu;
+	struct vfio_dma		*dma;
+	size_t			size;
+	bool			lock_cap;
+	unsigned long		limit;
+	unsigned long		nr_chunks;
+	atomic_long_t		next_chunk;
+	size_t			*mapped;	/* bytes mapped of each chunk */
+	int			ret;		/* first error */
+	atomic_t		pending;	/* workers running */
+	struct completion	done;
+};
+
+struct vfio_map_worker {
+	struct work_struct	work;
+	struct vfio_map_ctx	*ctx;
+};
+
+/*
+ * Pins and maps @size bytes at @offset in @dma, adding the bytes mapped to
+ * @mapped.  The pages are accounted to dma->task, which waits for us.
+ */
+static int vfio_pin_map_range(struct vfio_map_ctx *ctx, size_t offset,
+			      size_t size, size_t *mapped)
 {
-	dma_addr_t iova = dma->iova;
-	unsigned long vaddr = dma->vaddr;
-	size_t size = map_size;
+	struct vfio_dma *dma = ctx->dma;
+	dma_addr_t iova = dma->iova + offset;
+	unsigned long vaddr = dma->vaddr + offset;
+	unsigned long pfn;
 	long npage;
-	unsigned long pfn, limit = rlimit(RLIMIT_MEMLOCK) >> PAGE_SHIFT;
-	bool lock_cap = capable(CAP_IPC_LOCK);
-	int ret = 0;
+	int ret;
 
 	while (size) {
 		/* Pin a contiguous chunk of memory */
-		npage = vfio_pin_pages_remote(dma, vaddr + dma->size,
+		npage = vfio_pin_pages_remote(dma, dma->task, vaddr,
 					      size >> PAGE_SHIFT, &pfn,
-					      lock_cap, limit);
+					      ctx->lock_cap, ctx->limit);
 		if (npage <= 0) {
 			WARN_ON(!npage);
-			ret = (int)npage;
-			break;
+			return (int)npage;
 		}
 
 		/* Map it! */
-		ret = vfio_iommu_map(iommu, iova + dma->size, pfn, npage,
-				     dma->prot);
+		ret = vfio_iommu_map(ctx->iommu, iova, pfn, npage, dma->prot);
 		if (ret) {
-			vfio_unpin_pages_remote(dma, iova + dma->size, pfn,
-						npage, true);
-			break;
+			vfio_unpin_pages_remote(dma, iova, pfn, npage, true);
+			return ret;
 		}
 
 		size -= npage << PAGE_SHIFT;
-		dma->size += npage << PAGE_SHIFT;
+		iova += npage << PAGE_SHIFT;
+		vaddr += npage << PAGE_SHIFT;
+		*mapped += npage << PAGE_SHIFT;
 	}
+	return 0;
+}
+
+static void vfio_pin_map_chunks(struct vfio_map_ctx *ctx)
+{
+	unsigned long i;
+	size_t offset, len;
+	int ret;
 
-	dma->iommu_mapped = true;
+	while (!READ_ONCE(ctx->ret)) {
+		i = atomic_long_inc_return(&ctx->next_chunk) - 1;
+		if (i >= ctx->nr_chunks)
+			break;
 
-	if (ret)
+		offset = i * VFIO_MAP_CHUNK;
+		len = min_t(size_t, ctx->size - offset, VFIO_MAP_CHUNK);
+		ret = vfio_pin_map_range(ctx, offset, len, &ctx->mapped[i]);
+		if (ret)
+			cmpxchg(&ctx->ret, 0, ret);
+	}
+}
+
+static void vfio_pin_map_work(struct work_struct *work)
+{
+	struct vfio_map_worker *worker;
+	struct vfio_map_ctx *ctx;
+
+	worker = container_of(work, struct vfio_map_worker, work);
+	ctx = worker->ctx;
+	vfio_pin_map_chunks(ctx);
+	if (atomic_dec_and_test(&ctx->pending))
+		complete(&ctx->done);
+}
+
+static int vfio_pin_map_dma(struct vfio_iommu *iommu, struct vfio_dma *dma,
+			    size_t map_size)
+{
+	struct vfio_map_ctx ctx = {
+		.iommu		= iommu,
+		.dma		= dma,
+		.size		= map_size,
+		.lock_cap	= capable(CAP_IPC_LOCK),
+		.limit		= rlimit(RLIMIT_MEMLOCK) >> PAGE_SHIFT,
+		.nr_chunks	= DIV_ROUND_UP(map_size, VFIO_MAP_CHUNK),
+		.next_chunk	= ATOMIC_LONG_INIT(0),
+		.pending	= ATOMIC_INIT(0),
+	};
+	struct vfio_map_worker *workers = NULL;
+	unsigned int i, nr_workers;
+	long unlocked = 0;
+
+	ctx.mapped = kvzalloc(ctx.nr_chunks * sizeof(*ctx.mapped), GFP_KERNEL);
+	if (!ctx.mapped) {
 		vfio_remove_dma(iommu, dma);
+		return -ENOMEM;
+	}
+	init_completion(&ctx.done);
+
+	nr_workers = min3((unsigned long)READ_ONCE(map_threads),
+			  (unsigned long)num_online_cpus(), ctx.nr_chunks);
+	if (nr_workers > 1)
+		workers = kcalloc(nr_workers - 1, sizeof(*workers),
+				  GFP_KERNEL);
+	if (workers) {
+		atomic_set(&ctx.pending, nr_workers - 1);
+		for (i = 0; i < nr_workers - 1; i++) {
+			workers[i].ctx = &ctx;
+			INIT_WORK(&workers[i].work, vfio_pin_map_work);
+			queue_work(system_unbound_wq, &workers[i].work);
+		}
+	}
 
-	return ret;
+	vfio_pin_map_chunks(&ctx);
+
+	if (workers) {
+		wait_for_completion(&ctx.done);
+		kfree(workers);
+	}
+
+	if (ctx.ret) {
+		/* the chunks may be partially mapped, in any order */
+		for (i = 0; i < ctx.nr_chunks; i++) {
+			if (ctx.mapped[i])
+				unlocked += vfio_unmap_unpin_range(iommu, dma,
+						dma->iova + i * VFIO_MAP_CHUNK,
+						ctx.mapped[i]);
+		}
+		vfio_lock_acct(dma->task, -unlocked, NULL);
+		vfio_remove_dma(iommu, dma);
+	} else {
+		dma->size = map_size;
+		dma->iommu_mapped = true;
+	}
+
+	kvfree(ctx.mapped);
+	return ctx.ret;
 }
 
 static int vfio_dma_do_map(struct vfio_iommu *iommu,
@@ -1088,7 +1256,8 @@ static int vfio_iommu_replay(struct vfio_iommu *iommu,
 				size_t n = dma->iova + dma->size - iova;
 				long npage;
 
-				npage = vfio_pin_pages_remote(dma, vaddr,
+				npage = vfio_pin_pages_remote(dma, current,
+							      vaddr,
 							      n >> PAGE_SHIFT,
 							      &pfn, lock_cap,
 							      limit);
@@ -30,8 +30,10 @@
 #include <linux/if_vlan.h>
 #include <linux/skb_array.h>
 #include <linux/skbuff.h>
+#include <linux/bpf.h>
 
 #include <net/sock.h>
+#include <net/xdp.h>
 
 #include "vhost.h"
 
@@ -88,6 +90,9 @@ struct vhost_net_ubuf_ref {
 };
 
 #define VHOST_RX_BATCH 64
+/* Max number of copied TX buffers handed to tun in one sendmsg */
+#define VHOST_TX_BATCH 64
+#define VHOST_NET_RX_PAD (NET_IP_ALIGN + NET_SKB_PAD)
 struct vhost_net_buf {
 	struct sk_buff **queue;
 	int tail;
@@ -110,6 +115,11 @@ struct vhost_net_virtqueue {
 	struct vhost_net_ubuf_ref *ubufs;
 	struct skb_array *rx_array;
 	struct vhost_net_buf rxq;
+	/* TX buffers already copied, waiting to be passed to tun */
+	struct xdp_buff *xdp;
+	int batched_xdp;
+	/* Backend accepts TUN_MSG_PTR batches */
+	bool tx_batch;
 };
 
 struct vhost_net {
@@ -277,6 +287,8 @@ static void vhost_net_vq_reset(struct vhost_net *n)
 		n->vqs[i].ubufs = NULL;
 		n->vqs[i].vhost_hlen = 0;
 		n->vqs[i].sock_hlen = 0;
+		n->vqs[i].batched_xdp = 0;
+		n->vqs[i].tx_batch = false;
 		vhost_net_buf_init(&n->vqs[i].rxq);
 	}
 
@@ -440,6 +452,88 @@ static bool vhost_exceeds_maxpend(struct vhost_net *net)
 		== nvq->done_idx;
 }
 
+/* Copy one TX packet into a page fragment laid out the way tun's
+ * build_skb() path expects, and queue it on the pending batch.
+ * Returns -ENOSPC, with @from untouched, for packets that can't be
+ * batched.
+ */
+static int vhost_net_build_xdp(struct vhost_net_virtqueue *nvq,
+			       struct iov_iter *from)
+{
+	struct page_frag *alloc_frag = &current->task_frag;
+	struct xdp_buff *xdp = &nvq->xdp[nvq->batched_xdp];
+	size_t len = iov_iter_count(from);
+	int pad = SKB_DATA_ALIGN(VHOST_NET_RX_PAD + XDP_PACKET_HEADROOM +
+				 sizeof(struct tun_xdp_hdr));
+	int buflen = SKB_DATA_ALIGN(len + pad) +
+		     SKB_DATA_ALIGN(sizeof(struct skb_shared_info));
+	struct tun_xdp_hdr *hdr;
+	void *buf;
+
+	if (unlikely(len < nvq->sock_hlen + ETH_HLEN) || buflen > PAGE_SIZE)
+		return -ENOSPC;
+
+	alloc_frag->offset = ALIGN((u64)alloc_frag->offset, SMP_CACHE_BYTES);
+	if (unlikely(!skb_page_frag_refill(buflen, alloc_frag, GFP_KERNEL)))
+		return -ENOMEM;
+
+	buf = page_address(alloc_frag->page) + alloc_frag->offset;
+	hdr = buf;
+	memset(&hdr->gso, 0, sizeof(hdr->gso));
+	if (copy_page_from_iter(alloc_frag->page, alloc_frag->offset +
+				offsetof(struct tun_xdp_hdr, gso),
+				nvq->sock_hlen, from) != nvq->sock_hlen)
+		return -EFAULT;
+
+	len -= nvq->sock_hlen;
+	if (copy_page_from_iter(alloc_frag->page, alloc_frag->offset + pad,
+				len, from) != len)
+		return -EFAULT;
+
+	hdr->buflen = buflen;
+	xdp->data_hard_start = buf;
+	xdp->data = buf + pad;
+	xdp->data_end = xdp->data + len;
+
+	get_page(alloc_frag->page);
+	alloc_frag->offset += buflen;
+	++nvq->batched_xdp;
+	return 0;
+}
+
+/* Hand the pending batch to tun and signal the guest once for it. */
+static void vhost_tx_batch(struct vhost_net *net,
+			   struct vhost_net_virtqueue *nvq,
+			   struct socket *sock)
+{
+	struct xdp_buff *xdp = nvq->xdp;
+	struct tun_msg_ctl ctl = {
+		.type = TUN_MSG_PTR,
+		.num = nvq->batched_xdp,
+		.ptr = xdp,
+	};
+	struct msghdr msg = {
+		.msg_control = &ctl,
+		.msg_flags = MSG_DONTWAIT,
+	};
+	int i, err;
+
+	if (!nvq->batched_xdp)
+		return;
+
+	err = sock->ops->sendmsg(sock, &msg, 0);
+	if (unlikely(err < 0)) {
+		/* The descriptors were already used: drop the packets */
+		for (i = 0; i < nvq->batched_xdp; i++)
+			put_page(virt_to_head_page(xdp[i].data_hard_start));
+		if (err == -EOPNOTSUPP)
+			nvq->tx_batch = false;
+	}
+
+	vhost_signal(&net->dev, &nvq->vq);
+	nvq->batched_xdp = 0;
+}
+
 /* Expects to be always run from workqueue - which acts as
  * read-size critical section for our kind of RCU. */
 static void handle_tx(struct vhost_net *net)
@@ -460,6 +554,7 @@ static void handle_tx(struct vhost_net *net)
 	size_t hdr_size;
 	struct socket *sock;
 	struct vhost_net_ubuf_ref *uninitialized_var(ubufs);
+	struct tun_msg_ctl ctl;
 	bool zcopy, zcopy_used;
 
 	mutex_lock(&vq->mutex);
@@ -523,6 +618,28 @@ static void handle_tx(struct vhost_net *net)
 				      nvq->done_idx
 				   && vhost_net_tx_select_zcopy(net);
 
+		if (!zcopy_used && nvq->tx_batch) {
+			err = vhost_net_build_xdp(nvq, &msg.msg_iter);
+			if (!err) {
+				vhost_add_used(vq, head, 0);
+				if (nvq->batched_xdp == VHOST_TX_BATCH)
+					vhost_tx_batch(net, nvq, sock);
+				total_len += len;
+				vhost_net_tx_packet(net);
+				if (unlikely(total_len >= VHOST_NET_WEIGHT)) {
+					vhost_poll_queue(&vq->poll);
+					break;
+				}
+				continue;
+			} else if (unlikely(err != -ENOSPC)) {
+				vhost_discard_vq_desc(vq, 1);
+				break;
+			}
+		}
+
+		/* Keep packets in order behind anything still batched */
+		vhost_tx_batch(net, nvq, sock);
+
 		/* use msg_control to pass vhost zerocopy ubuf info to skb */
 		if (zcopy_used) {
 			struct ubuf_info *ubuf;
@@ -534,8 +651,10 @@ static void handle_tx(struct vhost_net *net)
 			ubuf->ctx = nvq->ubufs;
 			ubuf->desc = nvq->upend_idx;
 			refcount_set(&ubuf->refcnt, 1);
-			msg.msg_control = ubuf;
-			msg.msg_controllen = sizeof(ubuf);
+			ctl.type = TUN_MSG_UBUF;
+			ctl.ptr = ubuf;
+			msg.msg_control = &ctl;
+			msg.msg_controllen = sizeof(ctl);
 			ubufs = nvq->ubufs;
 			atomic_inc(&ubufs->refcount);
 			nvq->upend_idx = (nvq->upend_idx + 1) % UIO_MAXIOV;
@@ -577,6 +696,7 @@ static void handle_tx(struct vhost_net *net)
 			break;
 		}
 	}
+	vhost_tx_batch(net, nvq, sock);
 out:
 	mutex_unlock(&vq->mutex);
 }
@@ -901,6 +1021,7 @@ static int vhost_net_open(struct inode *inode, struct file *f)
 	struct vhost_dev *dev;
 	struct vhost_virtqueue **vqs;
 	struct sk_buff **queue;
+	struct xdp_buff *xdp;
 	int i;
 
 	n = kvmalloc(sizeof *n, GFP_KERNEL | __GFP_RETRY_MAYFAIL);
@@ -921,6 +1042,15 @@ static int vhost_net_open(struct inode *inode, struct file *f)
 	}
 	n->vqs[VHOST_NET_VQ_RX].rxq.queue = queue;
 
+	xdp = kmalloc_array(VHOST_TX_BATCH, sizeof(*xdp), GFP_KERNEL);
+	if (!xdp) {
+		kfree(queue);
+		kfree(vqs);
+		kvfree(n);
+		return -ENOMEM;
+	}
+	n->vqs[VHOST_NET_VQ_TX].xdp = xdp;
+
 	dev = &n->dev;
 	vqs[VHOST_NET_VQ_TX] = &n->vqs[VHOST_NET_VQ_TX].vq;
 	vqs[VHOST_NET_VQ_RX] = &n->vqs[VHOST_NET_VQ_RX].vq;
@@ -933,6 +1063,8 @@ static int vhost_net_open(struct inode *inode, struct file *f)
 		n->vqs[i].done_idx = 0;
 		n->vqs[i].vhost_hlen = 0;
 		n->vqs[i].sock_hlen = 0;
+		n->vqs[i].batched_xdp = 0;
+		n->vqs[i].tx_batch = false;
 		vhost_net_buf_init(&n->vqs[i].rxq);
 	}
 	vhost_dev_init(dev, vqs, VHOST_NET_VQ_MAX);
@@ -1012,6 +1144,7 @@ static int vhost_net_release(struct inode *inode, struct file *f)
 	 * since jobs can re-queue themselves. */
 	vhost_net_flush(n);
 	kfree(n->vqs[VHOST_NET_VQ_RX].rxq.queue);
+	kfree(n->vqs[VHOST_NET_VQ_TX].xdp);
 	kfree(n->dev.vqs);
 	kvfree(n);
 	return 0;
@@ -1069,6 +1202,19 @@ static struct skb_array *get_tap_skb_array(int fd)
 	return array;
 }
 
+static bool get_tun_tx_batch(int fd)
+{
+	struct file *file = fget(fd);
+	bool batch;
+
+	if (!file)
+		return false;
+	/* Only tun understands TUN_MSG_PTR */
+	batch = !IS_ERR(tun_get_socket(file));
+	fput(file);
+	return batch;
+}
+
 static struct socket *get_tap_socket(int fd)
 {
 	struct file *file = fget(fd);
@@ -1148,6 +1294,8 @@ static long vhost_net_set_backend(struct vhost_net *n, unsigned index, int fd)
 		vhost_net_buf_unproduce(nvq);
 		if (index == VHOST_NET_VQ_RX)
 			nvq->rx_array = get_tap_skb_array(fd);
+		else
+			nvq->tx_batch = get_tun_tx_batch(fd);
 		r = vhost_vq_init_access(vq);
 		if (r)
 			goto err_used;
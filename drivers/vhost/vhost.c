@@ -300,6 +300,318 @@ static void vhost_vq_meta_reset(struct vhost_dev *d)
 		__vhost_vq_meta_reset(d->vqs[i]);
 }
 
+#if VHOST_ARCH_CAN_ACCEL_UACCESS
+static void vhost_map_free(struct vhost_map *map, bool dirty)
+{
+	int i;
+
+	vunmap(map->base);
+	for (i = 0; i < map->npages; i++) {
+		/* May run under the page lock from the MMU notifier */
+		if (dirty)
+			set_page_dirty(map->pages[i]);
+		put_page(map->pages[i]);
+	}
+	kfree(map->pages);
+	kfree(map);
+}
+
+static bool vhost_map_overlap(const struct vhost_map *map,
+			      unsigned long start, unsigned long end)
+{
+	return map && start < map->uaddr + map->size && end > map->uaddr;
+}
+
+/* Drop the maps of @vq that intersect [start, end), all if @all. */
+static void vhost_vq_unmap(struct vhost_virtqueue *vq, unsigned long start,
+			   unsigned long end, bool all)
+{
+	struct vhost_map *maps[VHOST_NUM_ADDRS] = { NULL };
+	struct vhost_map *map;
+	bool found = false;
+	int i;
+
+	spin_lock(&vq->mmu_lock);
+	for (i = 0; i < VHOST_NUM_ADDRS; i++) {
+		map = rcu_dereference_protected(vq->maps[i],
+				lockdep_is_held(&vq->mmu_lock));
+		if (all ? map : vhost_map_overlap(map, start, end)) {
+			RCU_INIT_POINTER(vq->maps[i], NULL);
+			maps[i] = map;
+			found = true;
+		}
+	}
+	spin_unlock(&vq->mmu_lock);
+
+	if (!found)
+		return;
+
+	/* Wait for the worker to stop using the old kernel addresses */
+	synchronize_rcu();
+
+	for (i = 0; i < VHOST_NUM_ADDRS; i++)
+		if (maps[i])
+			vhost_map_free(maps[i], i == VHOST_ADDR_USED);
+}
+
+static void vhost_invalidate_range_start(struct mmu_notifier *mn,
+					 struct mm_struct *mm,
+					 unsigned long start,
+					 unsigned long end)
+{
+	struct vhost_dev *dev = container_of(mn, struct vhost_dev,
+					     mmu_notifier);
+	struct vhost_virtqueue *vq;
+	int i;
+
+	for (i = 0; i < dev->nvqs; i++) {
+		vq = dev->vqs[i];
+
+		/* Keep the worker from mapping again until range_end */
+		spin_lock(&vq->mmu_lock);
+		++vq->invalidate_count;
+		++vq->invalidate_seq;
+		spin_unlock(&vq->mmu_lock);
+
+		vhost_vq_unmap(vq, start, end, false);
+	}
+}
+
+static void vhost_invalidate_range_end(struct mmu_notifier *mn,
+				       struct mm_struct *mm,
+				       unsigned long start,
+				       unsigned long end)
+{
+	struct vhost_dev *dev = container_of(mn, struct vhost_dev,
+					     mmu_notifier);
+	struct vhost_virtqueue *vq;
+	int i;
+
+	for (i = 0; i < dev->nvqs; i++) {
+		vq = dev->vqs[i];
+		spin_lock(&vq->mmu_lock);
+		--vq->invalidate_count;
+		spin_unlock(&vq->mmu_lock);
+	}
+}
+
+static void vhost_mmu_release(struct mmu_notifier *mn, struct mm_struct *mm)
+{
+	struct vhost_dev *dev = container_of(mn, struct vhost_dev,
+					     mmu_notifier);
+	int i;
+
+	for (i = 0; i < dev->nvqs; i++)
+		vhost_vq_unmap(dev->vqs[i], 0, 0, true);
+}
+
+static const struct mmu_notifier_ops vhost_mmu_notifier_ops = {
+	.invalidate_range_start	= vhost_invalidate_range_start,
+	.invalidate_range_end	= vhost_invalidate_range_end,
+	.release		= vhost_mmu_release,
+};
+
+static void vhost_vq_map_one(struct vhost_virtqueue *vq, int type,
+			     unsigned long uaddr, size_t size)
+{
+	bool write = type == VHOST_ADDR_USED;
+	unsigned long old_uaddr = 0, seq;
+	struct vhost_map *map;
+	size_t old_size = 0;
+	int npages, pinned;
+	bool busy;
+
+	spin_lock(&vq->mmu_lock);
+	map = rcu_dereference_protected(vq->maps[type],
+					lockdep_is_held(&vq->mmu_lock));
+	if (map) {
+		old_uaddr = map->uaddr;
+		old_size = map->size;
+	}
+	seq = vq->invalidate_seq;
+	busy = vq->invalidate_count;
+	spin_unlock(&vq->mmu_lock);
+
+	if (map && old_uaddr == uaddr && old_size == size)
+		return;
+	/* The ring moved or was resized */
+	if (map)
+		vhost_vq_unmap(vq, old_uaddr, old_uaddr + old_size, false);
+	if (busy || !uaddr || !size)
+		return;
+
+	map = kzalloc(sizeof(*map), GFP_KERNEL);
+	if (!map)
+		return;
+
+	npages = ((uaddr + size - 1) >> PAGE_SHIFT) - (uaddr >> PAGE_SHIFT) + 1;
+	map->pages = kmalloc_array(npages, sizeof(*map->pages), GFP_KERNEL);
+	if (!map->pages)
+		goto err;
+
+	pinned = get_user_pages_fast(uaddr, npages, write, map->pages);
+	if (pinned > 0)
+		map->npages = pinned;
+	if (pinned != npages)
+		goto err;
+
+	map->base = vmap(map->pages, npages, VM_MAP, PAGE_KERNEL);
+	if (!map->base)
+		goto err;
+
+	map->uaddr = uaddr;
+	map->size = size;
+	map->addr = map->base + (uaddr & ~PAGE_MASK);
+
+	spin_lock(&vq->mmu_lock);
+	/* Don't publish pages the MMU notifier may already have revoked */
+	if (vq->invalidate_count || vq->invalidate_seq != seq) {
+		spin_unlock(&vq->mmu_lock);
+		goto err;
+	}
+	rcu_assign_pointer(vq->maps[type], map);
+	spin_unlock(&vq->mmu_lock);
+	return;
+
+err:
+	vhost_map_free(map, false);
+}
+
+/* Map the rings of @vq if possible, called by the worker with the vq
+ * mutex held. Failure is not an error: accesses go through uaccess.
+ */
+static void vhost_vq_map_prefetch(struct vhost_virtqueue *vq)
+{
+	size_t s = vhost_has_feature(vq, VIRTIO_RING_F_EVENT_IDX) ? 2 : 0;
+	unsigned int num = vq->num;
+
+	/* A packed ring is written back through uaccess, only reads of
+	 * its descriptors go through the mapping.
+	 */
+	vhost_vq_map_one(vq, VHOST_ADDR_DESC, (unsigned long)vq->desc,
+			 num * sizeof(*vq->desc));
+	if (vhost_vq_is_packed(vq)) {
+		vhost_vq_map_one(vq, VHOST_ADDR_AVAIL, (unsigned long)vq->avail,
+				 sizeof(struct vring_packed_desc_event));
+		vhost_vq_map_one(vq, VHOST_ADDR_USED, (unsigned long)vq->used,
+				 sizeof(struct vring_packed_desc_event));
+		return;
+	}
+
+	vhost_vq_map_one(vq, VHOST_ADDR_AVAIL, (unsigned long)vq->avail,
+			 sizeof(*vq->avail) +
+			 num * sizeof(*vq->avail->ring) + s);
+	vhost_vq_map_one(vq, VHOST_ADDR_USED, (unsigned long)vq->used,
+			 sizeof(*vq->used) +
+			 num * sizeof(*vq->used->ring) + s);
+}
+
+/* Kernel address of @ptr if the whole access is mapped. RCU held. */
+static inline void *vhost_map_kaddr(struct vhost_virtqueue *vq, int type,
+				    const void __user *ptr, size_t size)
+{
+	struct vhost_map *map = rcu_dereference(vq->maps[type]);
+	unsigned long uaddr = (unsigned long)ptr;
+
+	if (!map || uaddr < map->uaddr ||
+	    uaddr + size > map->uaddr + map->size)
+		return NULL;
+
+	return map->addr + (uaddr - map->uaddr);
+}
+
+static bool vhost_map_copy_to(struct vhost_virtqueue *vq, int type,
+			      void __user *to, const void *from,
+			      unsigned int size)
+{
+	void *kaddr;
+
+	rcu_read_lock();
+	kaddr = vhost_map_kaddr(vq, type, to, size);
+	if (kaddr)
+		memcpy(kaddr, from, size);
+	rcu_read_unlock();
+
+	return kaddr;
+}
+
+static bool vhost_map_copy_from(struct vhost_virtqueue *vq, int type,
+				void *to, const void __user *from,
+				unsigned int size)
+{
+	void *kaddr;
+
+	rcu_read_lock();
+	kaddr = vhost_map_kaddr(vq, type, from, size);
+	if (kaddr)
+		memcpy(to, kaddr, size);
+	rcu_read_unlock();
+
+	return kaddr;
+}
+
+static void vhost_vq_map_init(struct vhost_virtqueue *vq)
+{
+	int i;
+
+	spin_lock_init(&vq->mmu_lock);
+	vq->invalidate_count = 0;
+	vq->invalidate_seq = 0;
+	for (i = 0; i < VHOST_NUM_ADDRS; i++)
+		RCU_INIT_POINTER(vq->maps[i], NULL);
+}
+
+static int vhost_dev_mmu_register(struct vhost_dev *dev)
+{
+	if (!dev->mm)
+		return 0;
+	dev->mmu_notifier.ops = &vhost_mmu_notifier_ops;
+	return mmu_notifier_register(&dev->mmu_notifier, dev->mm);
+}
+
+static void vhost_dev_mmu_unregister(struct vhost_dev *dev)
+{
+	if (dev->mm)
+		mmu_notifier_unregister(&dev->mmu_notifier, dev->mm);
+}
+#else
+static void vhost_vq_unmap(struct vhost_virtqueue *vq, unsigned long start,
+			   unsigned long end, bool all)
+{
+}
+
+static void vhost_vq_map_prefetch(struct vhost_virtqueue *vq)
+{
+}
+
+static bool vhost_map_copy_to(struct vhost_virtqueue *vq, int type,
+			      void __user *to, const void *from,
+			      unsigned int size)
+{
+	return false;
+}
+
+static bool vhost_map_copy_from(struct vhost_virtqueue *vq, int type,
+				void *to, const void __user *from,
+				unsigned int size)
+{
+	return false;
+}
+
+static void vhost_vq_map_init(struct vhost_virtqueue *vq)
+{
+}
+
+static int vhost_dev_mmu_register(struct vhost_dev *dev)
+{
+	return 0;
+}
+
+static void vhost_dev_mmu_unregister(struct vhost_dev *dev)
+{
+}
+#endif /* VHOST_ARCH_CAN_ACCEL_UACCESS */
+
 static void vhost_vq_reset(struct vhost_dev *dev,
 			   struct vhost_virtqueue *vq)
 {
@@ -313,6 +625,7 @@ static void vhost_vq_reset(struct vhost_dev *dev,
 	vq->signalled_used = 0;
 	vq->signalled_used_valid = false;
 	vq->used_flags = 0;
+	vq->packed_fetched = 0;
 	vq->log_used = false;
 	vq->log_addr = -1ull;
 	vq->private_data = NULL;
@@ -330,6 +643,7 @@ static void vhost_vq_reset(struct vhost_dev *dev,
 	vq->umem = NULL;
 	vq->iotlb = NULL;
 	__vhost_vq_meta_reset(vq);
+	vhost_vq_unmap(vq, 0, 0, true);
 }
 
 static int vhost_worker(void *data)
@@ -379,6 +693,9 @@ static void vhost_vq_free_iovecs(struct vhost_virtqueue *vq)
 	vq->log = NULL;
 	kfree(vq->heads);
 	vq->heads = NULL;
+	kvfree(vq->packed_count);
+	vq->packed_count = NULL;
+	vq->packed_hist = NULL;
 }
 
 /* Helper to allocate iovec buffers for all vqs. */
@@ -439,8 +756,11 @@ void vhost_dev_init(struct vhost_dev *dev,
 		vq->log = NULL;
 		vq->indirect = NULL;
 		vq->heads = NULL;
+		vq->packed_count = NULL;
+		vq->packed_hist = NULL;
 		vq->dev = dev;
 		mutex_init(&vq->mutex);
+		vhost_vq_map_init(vq);
 		vhost_vq_reset(dev, vq);
 		if (vq->handle_kick)
 			vhost_poll_init(&vq->poll, vq->handle_kick,
@@ -503,6 +823,10 @@ long vhost_dev_set_owner(struct vhost_dev *dev)
 
 	/* No owner, become one */
 	dev->mm = get_task_mm(current);
+	err = vhost_dev_mmu_register(dev);
+	if (err)
+		goto err_mmu;
+
 	worker = kthread_create(vhost_worker, dev, "vhost-%d", current->pid);
 	if (IS_ERR(worker)) {
 		err = PTR_ERR(worker);
@@ -525,6 +849,8 @@ long vhost_dev_set_owner(struct vhost_dev *dev)
 	kthread_stop(worker);
 	dev->worker = NULL;
 err_worker:
+	vhost_dev_mmu_unregister(dev);
+err_mmu:
 	if (dev->mm)
 		mmput(dev->mm);
 	dev->mm = NULL;
@@ -648,8 +974,10 @@ void vhost_dev_cleanup(struct vhost_dev *dev, bool locked)
 		kthread_stop(dev->worker);
 		dev->worker = NULL;
 	}
-	if (dev->mm)
+	if (dev->mm) {
+		vhost_dev_mmu_unregister(dev);
 		mmput(dev->mm);
+	}
 	dev->mm = NULL;
 }
 EXPORT_SYMBOL_GPL(vhost_dev_cleanup);
@@ -746,8 +1074,11 @@ static int vhost_copy_to_user(struct vhost_virtqueue *vq, void __user *to,
 {
 	int ret;
 
-	if (!vq->iotlb)
+	if (!vq->iotlb) {
+		if (vhost_map_copy_to(vq, VHOST_ADDR_USED, to, from, size))
+			return 0;
 		return __copy_to_user(to, from, size);
+	}
 	else {
 		/* This function should be called after iotlb
 		 * prefetch, which means we're sure that all vq
@@ -781,8 +1112,11 @@ static int vhost_copy_from_user(struct vhost_virtqueue *vq, void *to,
 {
 	int ret;
 
-	if (!vq->iotlb)
+	if (!vq->iotlb) {
+		if (vhost_map_copy_from(vq, VHOST_ADDR_DESC, to, from, size))
+			return 0;
 		return __copy_from_user(to, from, size);
+	}
 	else {
 		/* This function should be called after iotlb
 		 * prefetch, which means we're sure that vq
@@ -863,7 +1197,12 @@ static inline void __user *__vhost_get_user(struct vhost_virtqueue *vq,
 ({ \
 	int ret = -EFAULT; \
 	if (!vq->iotlb) { \
-		ret = __put_user(x, ptr); \
+		__typeof__(*(ptr)) __v = (x); \
+		if (vhost_map_copy_to(vq, VHOST_ADDR_USED, ptr, &__v, \
+				      sizeof(__v))) \
+			ret = 0; \
+		else \
+			ret = __put_user(__v, ptr); \
 	} else { \
 		__typeof__(ptr) to = \
 			(__typeof__(ptr)) __vhost_get_user(vq, ptr,	\
@@ -880,7 +1219,13 @@ static inline void __user *__vhost_get_user(struct vhost_virtqueue *vq,
 ({ \
 	int ret; \
 	if (!vq->iotlb) { \
-		ret = __get_user(x, ptr); \
+		__typeof__(*(ptr)) __v; \
+		if (vhost_map_copy_from(vq, type, &__v, ptr, sizeof(__v))) { \
+			x = __v; \
+			ret = 0; \
+		} else { \
+			ret = __get_user(x, ptr); \
+		} \
 	} else { \
 		__typeof__(ptr) from = \
 			(__typeof__(ptr)) __vhost_get_user(vq, ptr, \
@@ -1144,6 +1489,22 @@ static int vhost_iotlb_miss(struct vhost_virtqueue *vq, u64 iova, int access)
 	return 0;
 }
 
+/* Packed rings keep free running indices with num a power of 2 no larger
+ * than 2^15, so the wrap counter is simply the inverse of bit log2(num).
+ * Userspace and the event suppression areas use offset + wrap counter.
+ */
+static inline u16 vhost_packed_off_wrap(struct vhost_virtqueue *vq, u16 idx)
+{
+	return (idx & (vq->num - 1)) |
+	       (!(idx & vq->num) << VRING_PACKED_EVENT_F_WRAP_CTR);
+}
+
+static inline u16 vhost_packed_idx(struct vhost_virtqueue *vq, u16 off_wrap)
+{
+	return (off_wrap & (vq->num - 1)) |
+	       (off_wrap & (1 << VRING_PACKED_EVENT_F_WRAP_CTR) ? 0 : vq->num);
+}
+
 static int vq_access_ok(struct vhost_virtqueue *vq, unsigned int num,
 			struct vring_desc __user *desc,
 			struct vring_avail __user *avail,
@@ -1152,6 +1513,15 @@ static int vq_access_ok(struct vhost_virtqueue *vq, unsigned int num,
 {
 	size_t s = vhost_has_feature(vq, VIRTIO_RING_F_EVENT_IDX) ? 2 : 0;
 
+	/* Packed: descriptor ring, driver and device event suppression */
+	if (vhost_vq_is_packed(vq))
+		return access_ok(VERIFY_WRITE, desc,
+				 num * sizeof(struct vring_packed_desc)) &&
+		       access_ok(VERIFY_READ, avail,
+				 sizeof(struct vring_packed_desc_event)) &&
+		       access_ok(VERIFY_WRITE, used,
+				 sizeof(struct vring_packed_desc_event));
+
 	return access_ok(VERIFY_READ, desc, num * sizeof *desc) &&
 	       access_ok(VERIFY_READ, avail,
 			 sizeof *avail + num * sizeof *avail->ring + s) &&
@@ -1211,8 +1581,24 @@ int vq_iotlb_prefetch(struct vhost_virtqueue *vq)
 	size_t s = vhost_has_feature(vq, VIRTIO_RING_F_EVENT_IDX) ? 2 : 0;
 	unsigned int num = vq->num;
 
-	if (!vq->iotlb)
+	if (!vq->iotlb) {
+		vhost_vq_map_prefetch(vq);
 		return 1;
+	}
+
+	if (vhost_vq_is_packed(vq))
+		return iotlb_access_ok(vq, VHOST_ACCESS_RW,
+				       (u64)(uintptr_t)vq->desc,
+				       num * sizeof(struct vring_packed_desc),
+				       VHOST_ADDR_DESC) &&
+		       iotlb_access_ok(vq, VHOST_ACCESS_RO,
+				       (u64)(uintptr_t)vq->avail,
+				       sizeof(struct vring_packed_desc_event),
+				       VHOST_ADDR_AVAIL) &&
+		       iotlb_access_ok(vq, VHOST_ACCESS_WO,
+				       (u64)(uintptr_t)vq->used,
+				       sizeof(struct vring_packed_desc_event),
+				       VHOST_ADDR_USED);
 
 	return iotlb_access_ok(vq, VHOST_ACCESS_RO, (u64)(uintptr_t)vq->desc,
 			       num * sizeof(*vq->desc), VHOST_ADDR_DESC) &&
@@ -1227,6 +1613,19 @@ int vq_iotlb_prefetch(struct vhost_virtqueue *vq)
 }
 EXPORT_SYMBOL_GPL(vq_iotlb_prefetch);
 
+/* Size of the device-written area covered by log_addr: the used ring, or
+ * the descriptor ring of a packed virtqueue.
+ */
+static size_t vhost_log_size(struct vhost_virtqueue *vq, unsigned int num)
+{
+	size_t s = vhost_has_feature(vq, VIRTIO_RING_F_EVENT_IDX) ? 2 : 0;
+
+	if (vhost_vq_is_packed(vq))
+		return num * sizeof(struct vring_packed_desc);
+
+	return sizeof *vq->used + num * sizeof *vq->used->ring + s;
+}
+
 /* Can we log writes? */
 /* Caller should have device mutex but not vq mutex */
 int vhost_log_access_ok(struct vhost_dev *dev)
@@ -1240,13 +1639,10 @@ EXPORT_SYMBOL_GPL(vhost_log_access_ok);
 static int vq_log_access_ok(struct vhost_virtqueue *vq,
 			    void __user *log_base)
 {
-	size_t s = vhost_has_feature(vq, VIRTIO_RING_F_EVENT_IDX) ? 2 : 0;
-
 	return vq_memory_access_ok(log_base, vq->umem,
 				   vhost_has_feature(vq, VHOST_F_LOG_ALL)) &&
 		(!vq->log_used || log_access_ok(log_base, vq->log_addr,
-					sizeof *vq->used +
-					vq->num * sizeof *vq->used->ring + s));
+						vhost_log_size(vq, vq->num)));
 }
 
 /* Can we start vq? */
@@ -1384,6 +1780,11 @@ long vhost_vring_ioctl(struct vhost_dev *d, int ioctl, void __user *argp)
 			r = -EINVAL;
 			break;
 		}
+		if (vq->num != s.num) {
+			kvfree(vq->packed_count);
+			vq->packed_count = NULL;
+			vq->packed_hist = NULL;
+		}
 		vq->num = s.num;
 		break;
 	case VHOST_SET_VRING_BASE:
@@ -1401,6 +1802,9 @@ long vhost_vring_ioctl(struct vhost_dev *d, int ioctl, void __user *argp)
 			r = -EINVAL;
 			break;
 		}
+		/* Packed: bit 15 holds the driver ring wrap counter */
+		if (vhost_vq_is_packed(vq))
+			s.num = vhost_packed_idx(vq, s.num);
 		vq->last_avail_idx = s.num;
 		/* Forget the cached index value. */
 		vq->avail_idx = vq->last_avail_idx;
@@ -1408,6 +1812,8 @@ long vhost_vring_ioctl(struct vhost_dev *d, int ioctl, void __user *argp)
 	case VHOST_GET_VRING_BASE:
 		s.index = idx;
 		s.num = vq->last_avail_idx;
+		if (vhost_vq_is_packed(vq))
+			s.num = vhost_packed_off_wrap(vq, s.num);
 		if (copy_to_user(argp, &s, sizeof s))
 			r = -EFAULT;
 		break;
@@ -1454,8 +1860,7 @@ long vhost_vring_ioctl(struct vhost_dev *d, int ioctl, void __user *argp)
 			/* Also validate log access for used ring if enabled. */
 			if ((a.flags & (0x1 << VHOST_VRING_F_LOG)) &&
 			    !log_access_ok(vq->log_base, a.log_guest_addr,
-					   sizeof *vq->used +
-					   vq->num * sizeof *vq->used->ring)) {
+					   vhost_log_size(vq, vq->num))) {
 				r = -EINVAL;
 				break;
 			}
@@ -1744,9 +2149,39 @@ int vhost_log_write(struct vhost_virtqueue *vq, struct vhost_log *log,
 }
 EXPORT_SYMBOL_GPL(vhost_log_write);
 
+/* Packed: tell the guest whether, and from where, we want kicks.  The
+ * device event area is not logged, vhost_vq_init_access() rewrites it.
+ */
+static int vhost_update_device_event(struct vhost_virtqueue *vq)
+{
+	struct vring_packed_desc_event __user *event = (void __user *)vq->used;
+	u16 flags = VRING_PACKED_EVENT_FLAG_DISABLE;
+	u16 idx = vq->last_avail_idx;
+
+	if (!(vq->used_flags & VRING_USED_F_NO_NOTIFY)) {
+		flags = VRING_PACKED_EVENT_FLAG_ENABLE;
+		if (vhost_has_feature(vq, VIRTIO_RING_F_EVENT_IDX)) {
+			u16 off_wrap = vhost_packed_off_wrap(vq, idx);
+
+			if (vhost_put_user(vq, cpu_to_le16(off_wrap),
+					   &event->off_wrap))
+				return -EFAULT;
+			/* Offset and wrap counter before the flags. */
+			smp_wmb();
+			flags = VRING_PACKED_EVENT_FLAG_DESC;
+		}
+	}
+	if (vhost_put_user(vq, cpu_to_le16(flags), &event->flags))
+		return -EFAULT;
+	return 0;
+}
+
 static int vhost_update_used_flags(struct vhost_virtqueue *vq)
 {
 	void __user *used;
+
+	if (vhost_vq_is_packed(vq))
+		return vhost_update_device_event(vq);
 	if (vhost_put_user(vq, cpu_to_vhost16(vq, vq->used_flags),
 			   &vq->used->flags) < 0)
 		return -EFAULT;
@@ -1784,6 +2219,22 @@ static int vhost_update_avail_event(struct vhost_virtqueue *vq, u16 avail_event)
 	return 0;
 }
 
+static int vhost_vq_init_access_packed(struct vhost_virtqueue *vq)
+{
+	if (!vq->packed_count) {
+		vq->packed_count = kvmalloc_array(2 * vq->num, sizeof(u16),
+						  GFP_KERNEL);
+		if (!vq->packed_count)
+			return -ENOMEM;
+		vq->packed_hist = vq->packed_count + vq->num;
+	}
+
+	vq->signalled_used_valid = false;
+	/* Whatever was fetched before was used: resume at the avail index */
+	vq->last_used_idx = vq->last_avail_idx;
+	return vhost_update_used_flags(vq);
+}
+
 int vhost_vq_init_access(struct vhost_virtqueue *vq)
 {
 	__virtio16 last_used_idx;
@@ -1795,6 +2246,13 @@ int vhost_vq_init_access(struct vhost_virtqueue *vq)
 
 	vhost_init_is_le(vq);
 
+	if (vhost_vq_is_packed(vq)) {
+		r = vhost_vq_init_access_packed(vq);
+		if (r)
+			goto err;
+		return 0;
+	}
+
 	r = vhost_update_used_flags(vq);
 	if (r)
 		goto err;
@@ -1984,6 +2442,219 @@ static int get_indirect(struct vhost_virtqueue *vq,
 	return 0;
 }
 
+static int vhost_packed_desc_flags(struct vhost_virtqueue *vq, u16 idx,
+				   u16 *flags)
+{
+	struct vring_packed_desc __user *ring = (void __user *)vq->desc;
+	__le16 f;
+
+	if (vhost_copy_from_user(vq, &f, &ring[idx & (vq->num - 1)].flags,
+				 sizeof(f)))
+		return -EFAULT;
+	*flags = le16_to_cpu(f);
+	return 0;
+}
+
+/* Available descriptors have AVAIL matching, and USED not matching, our
+ * driver ring wrap counter.
+ */
+static bool vhost_packed_desc_avail(struct vhost_virtqueue *vq, u16 flags,
+				    u16 idx)
+{
+	bool wrap = !(idx & vq->num);
+
+	return !!(flags & (1 << VRING_PACKED_DESC_F_AVAIL)) == wrap &&
+	       !!(flags & (1 << VRING_PACKED_DESC_F_USED)) != wrap;
+}
+
+/* Translate one packed descriptor and append it to the iovec. */
+static int vhost_packed_desc_to_iov(struct vhost_virtqueue *vq,
+				    struct vring_packed_desc *desc,
+				    struct iovec iov[], unsigned int iov_size,
+				    unsigned int *out_num, unsigned int *in_num,
+				    struct vhost_log *log,
+				    unsigned int *log_num)
+{
+	unsigned int iov_count = *in_num + *out_num;
+	int ret, access;
+
+	if (desc->flags & cpu_to_le16(VRING_DESC_F_WRITE))
+		access = VHOST_ACCESS_WO;
+	else
+		access = VHOST_ACCESS_RO;
+
+	ret = translate_desc(vq, le64_to_cpu(desc->addr),
+			     le32_to_cpu(desc->len), iov + iov_count,
+			     iov_size - iov_count, access);
+	if (unlikely(ret < 0)) {
+		if (ret != -EAGAIN)
+			vq_err(vq, "Translation failure %d in descriptor\n",
+			       ret);
+		return ret;
+	}
+	if (access == VHOST_ACCESS_WO) {
+		/* If this is an input descriptor, increment that count. */
+		*in_num += ret;
+		if (unlikely(log)) {
+			log[*log_num].addr = le64_to_cpu(desc->addr);
+			log[*log_num].len = le32_to_cpu(desc->len);
+			++*log_num;
+		}
+	} else {
+		/* If it's an output descriptor, they're all supposed
+		 * to come before any input descriptors. */
+		if (unlikely(*in_num)) {
+			vq_err(vq, "Descriptor has out after in\n");
+			return -EINVAL;
+		}
+		*out_num += ret;
+	}
+	return 0;
+}
+
+static int get_indirect_packed(struct vhost_virtqueue *vq,
+			       struct iovec iov[], unsigned int iov_size,
+			       unsigned int *out_num, unsigned int *in_num,
+			       struct vhost_log *log, unsigned int *log_num,
+			       struct vring_packed_desc *indirect)
+{
+	struct vring_packed_desc desc;
+	u32 len = le32_to_cpu(indirect->len);
+	unsigned int i, count;
+	struct iov_iter from;
+	int ret;
+
+	/* Sanity check */
+	if (unlikely(len % sizeof desc)) {
+		vq_err(vq, "Invalid length in indirect descriptor: "
+		       "len 0x%llx not multiple of 0x%zx\n",
+		       (unsigned long long)len,
+		       sizeof desc);
+		return -EINVAL;
+	}
+
+	ret = translate_desc(vq, le64_to_cpu(indirect->addr), len,
+			     vq->indirect, UIO_MAXIOV, VHOST_ACCESS_RO);
+	if (unlikely(ret < 0)) {
+		if (ret != -EAGAIN)
+			vq_err(vq, "Translation failure %d in indirect.\n",
+			       ret);
+		return ret;
+	}
+	iov_iter_init(&from, READ, vq->indirect, ret, len);
+
+	/* The table is walked in order, there is no next field. */
+	count = len / sizeof desc;
+	if (unlikely(count > USHRT_MAX + 1)) {
+		vq_err(vq, "Indirect buffer length too big: %d\n", len);
+		return -E2BIG;
+	}
+
+	for (i = 0; i < count; i++) {
+		if (unlikely(!copy_from_iter_full(&desc, sizeof(desc),
+						  &from))) {
+			vq_err(vq, "Failed indirect descriptor: idx %d\n", i);
+			return -EINVAL;
+		}
+		if (unlikely(desc.flags &
+			     cpu_to_le16(VRING_DESC_F_INDIRECT))) {
+			vq_err(vq, "Nested indirect descriptor: idx %d\n", i);
+			return -EINVAL;
+		}
+		ret = vhost_packed_desc_to_iov(vq, &desc, iov, iov_size,
+					       out_num, in_num, log, log_num);
+		if (unlikely(ret < 0))
+			return ret;
+	}
+	return 0;
+}
+
+static int vhost_get_vq_desc_packed(struct vhost_virtqueue *vq,
+				    struct iovec iov[], unsigned int iov_size,
+				    unsigned int *out_num, unsigned int *in_num,
+				    struct vhost_log *log,
+				    unsigned int *log_num)
+{
+	struct vring_packed_desc __user *ring = (void __user *)vq->desc;
+	struct vring_packed_desc desc;
+	u16 idx = vq->last_avail_idx;
+	unsigned int i, count = 0;
+	u16 flags, id;
+	int ret;
+
+	if (unlikely(vhost_packed_desc_flags(vq, idx, &flags))) {
+		vq_err(vq, "Failed to access descriptor flags at %p\n",
+		       &ring[idx & (vq->num - 1)]);
+		return -EFAULT;
+	}
+
+	/* If there's nothing new since last we looked, return invalid. */
+	if (!vhost_packed_desc_avail(vq, flags, idx))
+		return vq->num;
+
+	/* Only read the chain after its head has been exposed by guest. */
+	smp_rmb();
+
+	/* When we start there are none of either input nor output. */
+	*out_num = *in_num = 0;
+	if (unlikely(log))
+		*log_num = 0;
+
+	do {
+		i = idx & (vq->num - 1);
+		if (unlikely(++count > vq->num)) {
+			vq_err(vq, "Loop detected: last one at %u "
+			       "vq size %u\n", i, vq->num);
+			return -EINVAL;
+		}
+		ret = vhost_copy_from_user(vq, &desc, ring + i, sizeof desc);
+		if (unlikely(ret)) {
+			vq_err(vq, "Failed to get descriptor: idx %d addr %p\n",
+			       i, ring + i);
+			return -EFAULT;
+		}
+		if (desc.flags & cpu_to_le16(VRING_DESC_F_INDIRECT)) {
+			/* An indirect table is the whole buffer. */
+			if (unlikely(count > 1 ||
+				     desc.flags &
+				     cpu_to_le16(VRING_DESC_F_NEXT))) {
+				vq_err(vq, "Chained indirect descriptor "
+				       "at idx %d\n", i);
+				return -EINVAL;
+			}
+			ret = get_indirect_packed(vq, iov, iov_size,
+						  out_num, in_num,
+						  log, log_num, &desc);
+		} else {
+			ret = vhost_packed_desc_to_iov(vq, &desc, iov, iov_size,
+						       out_num, in_num,
+						       log, log_num);
+		}
+		if (unlikely(ret < 0))
+			return ret;
+		idx++;
+	} while (desc.flags & cpu_to_le16(VRING_DESC_F_NEXT));
+
+	/* The buffer id comes with the last descriptor. */
+	id = le16_to_cpu(desc.id);
+	if (unlikely(id >= vq->num)) {
+		vq_err(vq, "Guest says buffer id %u > %u is available",
+		       id, vq->num);
+		return -EINVAL;
+	}
+
+	vq->packed_count[id] = count;
+	vq->packed_hist[vq->packed_fetched++ & (vq->num - 1)] = count;
+
+	/* On success, move past the descriptors of this buffer. */
+	vq->last_avail_idx = idx;
+
+	/* Assume notifications from guest are disabled at this point,
+	 * if they aren't we would need to update the device event. */
+	BUG_ON(!(vq->used_flags & VRING_USED_F_NO_NOTIFY));
+	return id;
+}
+
 /* This looks in the virtqueue and for the first available buffer, and converts
  * it to an iovec for convenient access.  Since descriptors consist of some
  * number of output then some number of input descriptors, it's actually two
@@ -2004,6 +2675,10 @@ int vhost_get_vq_desc(struct vhost_virtqueue *vq,
 	__virtio16 ring_head;
 	int ret, access;
 
+	if (vhost_vq_is_packed(vq))
+		return vhost_get_vq_desc_packed(vq, iov, iov_size, out_num,
+						in_num, log, log_num);
+
 	/* Check it isn't doing very strange things with descriptor numbers. */
 	last_avail_idx = vq->last_avail_idx;
 
@@ -2138,6 +2813,14 @@ EXPORT_SYMBOL_GPL(vhost_get_vq_desc);
 /* Reverse the effect of vhost_get_vq_desc. Useful for error handling. */
 void vhost_discard_vq_desc(struct vhost_virtqueue *vq, int n)
 {
+	if (vhost_vq_is_packed(vq)) {
+		unsigned int mask = vq->num - 1;
+
+		while (n--)
+			vq->last_avail_idx -=
+				vq->packed_hist[--vq->packed_fetched & mask];
+		return;
+	}
 	vq->last_avail_idx -= n;
 }
 EXPORT_SYMBOL_GPL(vhost_discard_vq_desc);
@@ -2198,6 +2881,68 @@ static int __vhost_add_used_n(struct vhost_virtqueue *vq,
 	return 0;
 }
 
+/* Packed: write each used buffer over the head of its slot, flipping the
+ * flags last, and skip as many descriptors as it was made of.
+ */
+static int vhost_add_used_n_packed(struct vhost_virtqueue *vq,
+				   struct vring_used_elem *heads,
+				   unsigned count)
+{
+	struct vring_packed_desc __user *ring = (void __user *)vq->desc;
+	const size_t idlen = offsetof(struct vring_packed_desc, flags) -
+			     offsetof(struct vring_packed_desc, len);
+	struct vring_packed_desc used;
+	unsigned int i, start;
+	u16 old, new, id;
+
+	for (i = 0; i < count; i++) {
+		id = vhost32_to_cpu(vq, heads[i].id);
+		if (unlikely(id >= vq->num)) {
+			vq_err(vq, "Used buffer id %u > %u", id, vq->num);
+			return -EINVAL;
+		}
+
+		start = vq->last_used_idx & (vq->num - 1);
+		used.len = cpu_to_le32(vhost32_to_cpu(vq, heads[i].len));
+		used.id = cpu_to_le16(id);
+		used.flags = vq->last_used_idx & vq->num ? 0 :
+			     cpu_to_le16(1 << VRING_PACKED_DESC_F_AVAIL |
+					 1 << VRING_PACKED_DESC_F_USED);
+
+		if (vhost_copy_to_user(vq, &ring[start].len, &used.len,
+				       idlen)) {
+			vq_err(vq, "Failed to write used");
+			return -EFAULT;
+		}
+		/* Make sure id and len are seen before the flags. */
+		smp_wmb();
+		if (vhost_copy_to_user(vq, &ring[start].flags, &used.flags,
+				       sizeof(used.flags))) {
+			vq_err(vq, "Failed to write used flags");
+			return -EFAULT;
+		}
+		if (unlikely(vq->log_used)) {
+			/* Make sure data is seen before log. */
+			smp_wmb();
+			/* Log used descriptor write. */
+			log_write(vq->log_base,
+				  vq->log_addr + start * sizeof(*ring),
+				  sizeof(*ring));
+		}
+
+		old = vq->last_used_idx;
+		new = (vq->last_used_idx += vq->packed_count[id]);
+		/* See __vhost_add_used_n(). */
+		if (unlikely((u16)(new - vq->signalled_used) <
+			     (u16)(new - old)))
+			vq->signalled_used_valid = false;
+	}
+
+	if (unlikely(vq->log_used) && vq->log_ctx)
+		eventfd_signal(vq->log_ctx, 1);
+	return 0;
+}
+
 /* After we've used one of their buffers, we tell them about it.  We'll then
  * want to notify the guest, using eventfd. */
 int vhost_add_used_n(struct vhost_virtqueue *vq, struct vring_used_elem *heads,
@@ -2205,6 +2950,9 @@ int vhost_add_used_n(struct vhost_virtqueue *vq, struct vring_used_elem *heads,
 {
 	int start, n, r;
 
+	if (vhost_vq_is_packed(vq))
+		return vhost_add_used_n_packed(vq, heads, count);
+
 	start = vq->last_used_idx & (vq->num - 1);
 	n = vq->num - start;
 	if (n < count) {
@@ -2235,6 +2983,47 @@ int vhost_add_used_n(struct vhost_virtqueue *vq, struct vring_used_elem *heads,
 }
 EXPORT_SYMBOL_GPL(vhost_add_used_n);
 
+static bool vhost_notify_packed(struct vhost_dev *dev,
+				struct vhost_virtqueue *vq)
+{
+	struct vring_packed_desc_event __user *event = (void __user *)vq->avail;
+	__le16 flags, off_wrap;
+	u16 old, new, event_idx, mask;
+	bool v;
+
+	if (vhost_get_avail(vq, flags, &event->flags)) {
+		vq_err(vq, "Failed to get driver event flags");
+		return true;
+	}
+	if (flags == cpu_to_le16(VRING_PACKED_EVENT_FLAG_DISABLE))
+		return false;
+	if (flags != cpu_to_le16(VRING_PACKED_EVENT_FLAG_DESC) ||
+	    !vhost_has_feature(vq, VIRTIO_RING_F_EVENT_IDX))
+		return true;
+
+	old = vq->signalled_used;
+	v = vq->signalled_used_valid;
+	new = vq->signalled_used = vq->last_used_idx;
+	vq->signalled_used_valid = true;
+
+	if (unlikely(!v))
+		return true;
+
+	if (vhost_get_avail(vq, off_wrap, &event->off_wrap)) {
+		vq_err(vq, "Failed to get driver event off_wrap");
+		return true;
+	}
+
+	/* Put the event on the last lap of the ring at or before new. */
+	mask = 2 * vq->num - 1;
+	event_idx = vhost_packed_idx(vq, le16_to_cpu(off_wrap));
+	if (event_idx > (new & mask))
+		event_idx -= 2 * vq->num;
+	event_idx += new & ~mask;
+
+	return vring_need_event(event_idx, new, old);
+}
+
 static bool vhost_notify(struct vhost_dev *dev, struct vhost_virtqueue *vq)
 {
 	__u16 old, new;
@@ -2245,6 +3034,9 @@ static bool vhost_notify(struct vhost_dev *dev, struct vhost_virtqueue *vq)
 	 * interrupts. */
 	smp_mb();
 
+	if (vhost_vq_is_packed(vq))
+		return vhost_notify_packed(dev, vq);
+
 	if (vhost_has_feature(vq, VIRTIO_F_NOTIFY_ON_EMPTY) &&
 	    unlikely(vq->avail_idx == vq->last_avail_idx))
 		return true;
@@ -2305,8 +3097,16 @@ EXPORT_SYMBOL_GPL(vhost_add_used_and_signal_n);
 bool vhost_vq_avail_empty(struct vhost_dev *dev, struct vhost_virtqueue *vq)
 {
 	__virtio16 avail_idx;
+	u16 flags;
 	int r;
 
+	if (vhost_vq_is_packed(vq)) {
+		r = vhost_packed_desc_flags(vq, vq->last_avail_idx, &flags);
+		if (unlikely(r))
+			return false;
+		return !vhost_packed_desc_avail(vq, flags, vq->last_avail_idx);
+	}
+
 	if (vq->avail_idx != vq->last_avail_idx)
 		return false;
 
@@ -2319,6 +3119,29 @@ bool vhost_vq_avail_empty(struct vhost_dev *dev, struct vhost_virtqueue *vq)
 }
 EXPORT_SYMBOL_GPL(vhost_vq_avail_empty);
 
+static bool vhost_enable_notify_packed(struct vhost_virtqueue *vq)
+{
+	u16 flags;
+	int r;
+
+	r = vhost_update_device_event(vq);
+	if (r) {
+		vq_err(vq, "Failed to enable notification at %p: %d\n",
+		       vq->used, r);
+		return false;
+	}
+	/* They could have slipped one in as we were doing that: make
+	 * sure it's written, then check again. */
+	smp_mb();
+	r = vhost_packed_desc_flags(vq, vq->last_avail_idx, &flags);
+	if (r) {
+		vq_err(vq, "Failed to check avail descriptor: %d\n", r);
+		return false;
+	}
+
+	return vhost_packed_desc_avail(vq, flags, vq->last_avail_idx);
+}
+
 /* OK, now we need to know about added descriptors. */
 bool vhost_enable_notify(struct vhost_dev *dev, struct vhost_virtqueue *vq)
 {
@@ -2328,6 +3151,8 @@ bool vhost_enable_notify(struct vhost_dev *dev, struct vhost_virtqueue *vq)
 	if (!(vq->used_flags & VRING_USED_F_NO_NOTIFY))
 		return false;
 	vq->used_flags &= ~VRING_USED_F_NO_NOTIFY;
+	if (vhost_vq_is_packed(vq))
+		return vhost_enable_notify_packed(vq);
 	if (!vhost_has_feature(vq, VIRTIO_RING_F_EVENT_IDX)) {
 		r = vhost_update_used_flags(vq);
 		if (r) {
@@ -2365,7 +3190,8 @@ void vhost_disable_notify(struct vhost_dev *dev, struct vhost_virtqueue *vq)
 	if (vq->used_flags & VRING_USED_F_NO_NOTIFY)
 		return;
 	vq->used_flags |= VRING_USED_F_NO_NOTIFY;
-	if (!vhost_has_feature(vq, VIRTIO_RING_F_EVENT_IDX)) {
+	if (vhost_vq_is_packed(vq) ||
+	    !vhost_has_feature(vq, VIRTIO_RING_F_EVENT_IDX)) {
 		r = vhost_update_used_flags(vq);
 		if (r)
 			vq_err(vq, "Failed to enable notification at %p: %d\n",
@@ -12,6 +12,15 @@
 #include <linux/virtio_config.h>
 #include <linux/virtio_ring.h>
 #include <linux/atomic.h>
+#include <linux/mmu_notifier.h>
+#include <asm/cacheflush.h>
+
+#if defined(CONFIG_VHOST_ACCEL_UACCESS) && \
+	ARCH_IMPLEMENTS_FLUSH_DCACHE_PAGE == 0
+#define VHOST_ARCH_CAN_ACCEL_UACCESS 1
+#else
+#define VHOST_ARCH_CAN_ACCEL_UACCESS 0
+#endif
 
 struct vhost_work;
 typedef void (*vhost_work_fn_t)(struct vhost_work *work);
@@ -84,6 +93,16 @@ enum vhost_uaddr_type {
 	VHOST_NUM_ADDRS = 3,
 };
 
+/* Pinned, vmap'd kernel mapping of [uaddr, uaddr + size) */
+struct vhost_map {
+	unsigned long uaddr;
+	size_t size;
+	void *addr;
+	void *base;
+	int npages;
+	struct page **pages;
+};
+
 /* The virtqueue structure describes a queue attached to a device. */
 struct vhost_virtqueue {
 	struct vhost_dev *dev;
@@ -95,6 +114,14 @@ struct vhost_virtqueue {
 	struct vring_avail __user *avail;
 	struct vring_used __user *used;
 	const struct vhost_umem_node *meta_iotlb[VHOST_NUM_ADDRS];
+#if VHOST_ARCH_CAN_ACCEL_UACCESS
+	/* Read under RCU by the worker, cleared by the MMU notifier */
+	struct vhost_map __rcu *maps[VHOST_NUM_ADDRS];
+	/* Protects maps and the invalidate counters */
+	spinlock_t mmu_lock;
+	int invalidate_count;
+	unsigned long invalidate_seq;
+#endif
 	struct file *kick;
 	struct file *call;
 	struct file *error;
@@ -125,6 +152,15 @@ struct vhost_virtqueue {
 	/* Last used index value we have signalled on */
 	bool signalled_used_valid;
 
+	/* Packed ring: the indices above count descriptors, free running,
+	 * with the wrap counter derived from bit log2(num).  Descriptors
+	 * used per buffer id, and per buffer in the order they were fetched
+	 * so that vhost_discard_vq_desc() can rewind.
+	 */
+	u16 *packed_count;
+	u16 *packed_hist;
+	u16 packed_fetched;
+
 	/* Log writes to used structure. */
 	bool log_used;
 	u64 log_addr;
@@ -173,6 +209,9 @@ struct vhost_dev {
 	struct list_head read_list;
 	struct list_head pending_list;
 	wait_queue_head_t wait;
+#if VHOST_ARCH_CAN_ACCEL_UACCESS
+	struct mmu_notifier mmu_notifier;
+#endif
 };
 
 void vhost_dev_init(struct vhost_dev *, struct vhost_virtqueue **vqs, int nvqs);
@@ -237,7 +276,8 @@ enum {
 			 (1ULL << VIRTIO_RING_F_EVENT_IDX) |
 			 (1ULL << VHOST_F_LOG_ALL) |
 			 (1ULL << VIRTIO_F_ANY_LAYOUT) |
-			 (1ULL << VIRTIO_F_VERSION_1)
+			 (1ULL << VIRTIO_F_VERSION_1) |
+			 (1ULL << VIRTIO_F_RING_PACKED)
 };
 
 static inline bool vhost_has_feature(struct vhost_virtqueue *vq, int bit)
@@ -245,6 +285,11 @@ static inline bool vhost_has_feature(struct vhost_virtqueue *vq, int bit)
 	return vq->acked_features & (1ULL << bit);
 }
 
+static inline bool vhost_vq_is_packed(struct vhost_virtqueue *vq)
+{
+	return vhost_has_feature(vq, VIRTIO_F_RING_PACKED);
+}
+
 #ifdef CONFIG_VHOST_CROSS_ENDIAN_LEGACY
 static inline bool vhost_is_little_endian(struct vhost_virtqueue *vq)
 {
@@ -21,6 +21,7 @@
 #include <linux/uio.h>
 
 #include <linux/sched/signal.h>
+#include <linux/sched/mm.h>
 #include <linux/fs.h>
 #include <linux/file.h>
 #include <linux/mm.h>
@@ -31,6 +32,7 @@
 #include <linux/timer.h>
 #include <linux/aio.h>
 #include <linux/highmem.h>
+#include <linux/pagemap.h>
 #include <linux/workqueue.h>
 #include <linux/security.h>
 #include <linux/eventfd.h>
@@ -186,6 +188,25 @@ struct aio_kiocb {
 	 * this is the underlying eventfd context to deliver events to.
 	 */
 	struct eventfd_ctx	*ki_eventfd;
+
+	struct aio_read_async	*ki_async;	/* see aio_read_async() */
+};
+
+/*
+ * A buffered read waiting for pages: the wake function of ->wait queues
+ * ->work, which retries the read in ->mm.
+ */
+struct aio_read_async {
+	struct aio_kiocb	*req;
+	struct wait_page_queue	wait;
+	struct work_struct	work;
+	struct mm_struct	*mm;
+	/* the submitter and the wake function, the last one retries */
+	atomic_t		refs;
+	ssize_t			done;
+	struct iov_iter		iter;
+	struct iovec		*iovec;		/* to free */
+	struct iovec		inline_vecs[UIO_FASTIOV];
 };
 
 /*------ sysctl variables----*/
@@ -1049,6 +1070,11 @@ static void kiocb_free(struct aio_kiocb *req)
 		fput(req->common.ki_filp);
 	if (req->ki_eventfd != NULL)
 		eventfd_ctx_put(req->ki_eventfd);
+	if (req->ki_async) {
+		mmdrop(req->ki_async->mm);
+		kfree(req->ki_async->iovec);
+		kfree(req->ki_async);
+	}
 	kmem_cache_free(kiocb_cachep, req);
 }
 
@@ -1490,11 +1516,106 @@ static inline ssize_t aio_ret(struct kiocb *req, ssize_t ret)
 	}
 }
 
+static void aio_read_async_issue(struct aio_read_async *async)
+{
+	struct kiocb *req = &async->req->common;
+	ssize_t ret;
+
+	for (;;) {
+		atomic_set(&async->refs, 2);
+		ret = call_read_iter(req->ki_filp, req, &async->iter);
+		if (ret == -EIOCBQUEUED) {
+			/*
+			 * Waiting for a page: the read must have returned
+			 * before it is retried, as it updates ->ki_pos.
+			 */
+			if (!atomic_dec_and_test(&async->refs))
+				return;
+			continue;
+		}
+		if (ret == -EAGAIN && (req->ki_flags & IOCB_WAITQ)) {
+			/* no page to wait for, e.g. it has to be read in */
+			req->ki_flags &= ~(IOCB_NOWAIT | IOCB_WAITQ);
+			continue;
+		}
+		if (ret <= 0)
+			break;
+		async->done += ret;
+		if (!iov_iter_count(&async->iter))
+			break;
+	}
+
+	aio_ret(req, async->done ? async->done : ret);
+}
+
+static void aio_read_async_work(struct work_struct *work)
+{
+	struct aio_read_async *async =
+		container_of(work, struct aio_read_async, work);
+	struct mm_struct *mm = async->mm;
+
+	/* exit_aio() waits for the request, with the mm gone */
+	if (!mmget_not_zero(mm)) {
+		aio_complete(&async->req->common,
+			     async->done ? async->done : -EINTR, 0);
+		return;
+	}
+	use_mm(mm);
+	aio_read_async_issue(async);
+	unuse_mm(mm);
+	mmput(mm);
+}
+
+static int aio_read_async_wake(struct wait_queue_entry *wait, unsigned mode,
+			       int sync, void *key)
+{
+	struct wait_page_queue *wpq =
+		container_of(wait, struct wait_page_queue, wait);
+	struct aio_read_async *async =
+		container_of(wpq, struct aio_read_async, wait);
+
+	if (!wake_page_match(wpq, key))
+		return 0;
+
+	list_del_init(&wait->entry);
+	if (atomic_dec_and_test(&async->refs))
+		queue_work(system_unbound_wq, &async->work);
+	return 1;
+}
+
+/*
+ * Buffered reads of the files supporting it are not done synchronously in
+ * io_submit(): instead of sleeping on a page being read in, the read gets
+ * aio_read_async_wake() called when it is unlocked, and the read goes on
+ * from an unbound workqueue.  Only the reads that cannot wait this way,
+ * e.g. when readahead is disabled, block the submitter.
+ */
+static void aio_read_async(struct kiocb *req, struct aio_read_async *async,
+			   struct iov_iter *iter, struct iovec *iovec)
+{
+	struct aio_kiocb *areq = container_of(req, struct aio_kiocb, common);
+
+	async->req = areq;
+	async->iter = *iter;
+	async->iovec = iovec;
+	async->done = 0;
+	async->mm = current->mm;
+	mmgrab(async->mm);
+	init_waitqueue_func_entry(&async->wait.wait, aio_read_async_wake);
+	INIT_WORK(&async->work, aio_read_async_work);
+	areq->ki_async = async;
+
+	req->ki_flags |= IOCB_NOWAIT | IOCB_WAITQ;
+	req->ki_waitq = &async->wait;
+	aio_read_async_issue(async);
+}
+
 static ssize_t aio_read(struct kiocb *req, struct iocb *iocb, bool vectored,
 		bool compat)
 {
 	struct file *file = req->ki_filp;
 	struct iovec inline_vecs[UIO_FASTIOV], *iovec = inline_vecs;
+	struct aio_read_async *async = NULL;
 	struct iov_iter iter;
 	ssize_t ret;
 
@@ -1503,12 +1624,27 @@ static ssize_t aio_read(struct kiocb *req, struct iocb *iocb, bool vectored,
 	if (unlikely(!file->f_op->read_iter))
 		return -EINVAL;
 
+	/* the iovec is then used after io_submit() returns */
+	if ((file->f_mode & FMODE_BUF_RASYNC) &&
+	    !(req->ki_flags & (IOCB_DIRECT | IOCB_NOWAIT))) {
+		async = kmalloc(sizeof(*async), GFP_KERNEL);
+		if (async)
+			iovec = async->inline_vecs;
+	}
+
 	ret = aio_setup_rw(READ, iocb, &iovec, vectored, compat, &iter);
-	if (ret)
+	if (ret) {
+		kfree(async);
 		return ret;
+	}
 	ret = rw_verify_area(READ, file, &req->ki_pos, iov_iter_count(&iter));
+	if (!ret && async) {
+		aio_read_async(req, async, &iter, iovec);
+		return 0;
+	}
 	if (!ret)
 		ret = aio_ret(req, call_read_iter(file, req, &iter));
+	kfree(async);
 	kfree(iovec);
 	return ret;
 }
@@ -1669,7 +1805,7 @@ static long do_io_submit(aio_context_t ctx_id, long nr,
 		return -EINVAL;
 	}
 
-	blk_start_plug(&plug);
+	blk_start_plug_nr_ios(&plug, min_t(long, nr, BLK_MAX_REQUEST_COUNT));
 
 	/*
 	 * AKPM: should this return a partial result if some of the IOs were
@@ -337,21 +337,23 @@ static inline void btrfs_inode_resume_unlocked_dio(struct btrfs_inode *inode)
 }
 
 static inline void btrfs_print_data_csum_error(struct btrfs_inode *inode,
-		u64 logical_start, u32 csum, u32 csum_expected, int mirror_num)
+		u64 logical_start, const u8 *csum, const u8 *csum_expected,
+		int mirror_num)
 {
 	struct btrfs_root *root = inode->root;
+	u16 csum_size = btrfs_super_csum_size(root->fs_info->super_copy);
 
 	/* Output minus objectid, which is more meaningful */
 	if (root->objectid >= BTRFS_LAST_FREE_OBJECTID)
 		btrfs_warn_rl(root->fs_info,
-	"csum failed root %lld ino %lld off %llu csum 0x%08x expected csum 0x%08x mirror %d",
-			root->objectid, btrfs_ino(inode),
-			logical_start, csum, csum_expected, mirror_num);
+	"csum failed root %lld ino %lld off %llu csum 0x%*phN expected csum 0x%*phN mirror %d",
+			root->objectid, btrfs_ino(inode), logical_start,
+			csum_size, csum, csum_size, csum_expected, mirror_num);
 	else
 		btrfs_warn_rl(root->fs_info,
-	"csum failed root %llu ino %llu off %llu csum 0x%08x expected csum 0x%08x mirror %d",
-			root->objectid, btrfs_ino(inode),
-			logical_start, csum, csum_expected, mirror_num);
+	"csum failed root %llu ino %llu off %llu csum 0x%*phN expected csum 0x%*phN mirror %d",
+			root->objectid, btrfs_ino(inode), logical_start,
+			csum_size, csum, csum_size, csum_expected, mirror_num);
 }
 
 bool btrfs_page_exists_in_range(struct inode *inode, loff_t start, loff_t end);
@@ -1956,7 +1956,7 @@ static noinline int balance_level(struct btrfs_trans_handle *trans,
 		left = NULL;
 
 	if (left) {
-		btrfs_tree_lock(left);
+		__btrfs_tree_lock(left, BTRFS_NESTING_LEFT);
 		btrfs_set_lock_blocking(left);
 		wret = btrfs_cow_block(trans, root, left,
 				       parent, pslot - 1, &left);
@@ -1971,7 +1971,7 @@ static noinline int balance_level(struct btrfs_trans_handle *trans,
 		right = NULL;
 
 	if (right) {
-		btrfs_tree_lock(right);
+		__btrfs_tree_lock(right, BTRFS_NESTING_RIGHT);
 		btrfs_set_lock_blocking(right);
 		wret = btrfs_cow_block(trans, root, right,
 				       parent, pslot + 1, &right);
@@ -2131,7 +2131,7 @@ static noinline int push_nodes_for_insert(struct btrfs_trans_handle *trans,
 	if (left) {
 		u32 left_nr;
 
-		btrfs_tree_lock(left);
+		__btrfs_tree_lock(left, BTRFS_NESTING_LEFT);
 		btrfs_set_lock_blocking(left);
 
 		left_nr = btrfs_header_nritems(left);
@@ -2184,7 +2184,7 @@ static noinline int push_nodes_for_insert(struct btrfs_trans_handle *trans,
 	if (right) {
 		u32 right_nr;
 
-		btrfs_tree_lock(right);
+		__btrfs_tree_lock(right, BTRFS_NESTING_RIGHT);
 		btrfs_set_lock_blocking(right);
 
 		right_nr = btrfs_header_nritems(right);
@@ -2653,6 +2653,88 @@ int btrfs_find_item(struct btrfs_root *fs_root, struct btrfs_path *path,
 	return 0;
 }
 
+/*
+ * Read only search walking the nodes without locking them, which keeps the
+ * readers off the locks of the root and of the upper nodes.  Only the leaf
+ * is read locked, as btrfs_search_slot() leaves it.  A node is searched
+ * without lock if it wasn't write locked meanwhile, and the nodes found
+ * are current if the top one still is the root node: the writers lock the
+ * parent of a node to replace it.  The pointers to the children are
+ * checked against their generation, and the children must be up to date:
+ * -EAGAIN means to do a locked search.
+ */
+static int search_slot_lockless(struct btrfs_root *root,
+				const struct btrfs_key *key,
+				struct btrfs_path *p)
+{
+	struct btrfs_fs_info *fs_info = root->fs_info;
+	unsigned int seq[BTRFS_MAX_LEVEL];
+	struct extent_buffer *b;
+	int level, top_level, slot, ret;
+	u32 nritems;
+	u64 blocknr, gen;
+
+	b = btrfs_root_node(root);
+	seq[0] = btrfs_tree_lock_seq(b);
+	top_level = btrfs_header_level(b);
+	if ((seq[0] & 1) || top_level == 0 || top_level >= BTRFS_MAX_LEVEL) {
+		free_extent_buffer(b);
+		return -EAGAIN;
+	}
+	level = top_level;
+	p->nodes[level] = b;
+	seq[level] = seq[0];
+
+	while (level > 0) {
+		nritems = btrfs_header_nritems(b);
+		if (!nritems || nritems > BTRFS_NODEPTRS_PER_BLOCK(fs_info))
+			goto again;
+		ret = generic_bin_search(b, offsetof(struct btrfs_node, ptrs),
+					 sizeof(struct btrfs_key_ptr), key,
+					 nritems, &slot);
+		if (ret < 0)
+			goto again;
+		if (ret && slot > 0)
+			slot--;
+		blocknr = btrfs_node_blockptr(b, slot);
+		gen = btrfs_node_ptr_generation(b, slot);
+		if (btrfs_tree_lock_seq_retry(b, seq[level]))
+			goto again;
+		p->slots[level] = slot;
+
+		b = find_extent_buffer(fs_info, blocknr);
+		if (!b)
+			goto again;
+		p->nodes[--level] = b;
+		if (btrfs_buffer_uptodate(b, gen, 1) <= 0)
+			goto again;
+		if (level == 0) {
+			btrfs_tree_read_lock(b);
+			p->locks[0] = BTRFS_READ_LOCK;
+			break;
+		}
+		seq[level] = btrfs_tree_lock_seq(b);
+		if ((seq[level] & 1) || btrfs_header_level(b) != level)
+			goto again;
+	}
+
+	for (level = 1; level <= top_level; level++)
+		if (btrfs_tree_lock_seq_retry(p->nodes[level], seq[level]))
+			goto again;
+	if (READ_ONCE(root->node) != p->nodes[top_level] ||
+	    btrfs_header_level(b) != 0)
+		goto again;
+
+	ret = bin_search(b, key, 0, &slot);
+	if (ret < 0)
+		goto again;
+	p->slots[0] = slot;
+	return ret;
+again:
+	btrfs_release_path(p);
+	return -EAGAIN;
+}
+
 /*
  * look for key in the tree.  path is filled in with nodes along the way
  * if key is found, we return zero and you can find the item in the leaf
@@ -2689,6 +2771,13 @@ int btrfs_search_slot(struct btrfs_trans_handle *trans, struct btrfs_root *root,
 	WARN_ON(p->nodes[0] != NULL);
 	BUG_ON(!cow && ins_len);
 
+	if (!cow && !p->keep_locks && !lowest_level &&
+	    !p->search_commit_root && !p->skip_locking) {
+		ret = search_slot_lockless(root, key, p);
+		if (ret != -EAGAIN)
+			goto done;
+	}
+
 	if (ins_len < 0) {
 		lowest_unlock = 2;
 
@@ -3773,7 +3862,7 @@ static int push_leaf_right(struct btrfs_trans_handle *trans, struct btrfs_root
 	if (IS_ERR(right))
 		return 1;
 
-	btrfs_tree_lock(right);
+	__btrfs_tree_lock(right, BTRFS_NESTING_RIGHT);
 	btrfs_set_lock_blocking(right);
 
 	free_space = btrfs_leaf_free_space(fs_info, right);
@@ -4007,7 +4096,7 @@ static int push_leaf_left(struct btrfs_trans_handle *trans, struct btrfs_root
 	if (IS_ERR(left))
 		return 1;
 
-	btrfs_tree_lock(left);
+	__btrfs_tree_lock(left, BTRFS_NESTING_LEFT);
 	btrfs_set_lock_blocking(left);
 
 	free_space = btrfs_leaf_free_space(fs_info, left);
@@ -5809,7 +5898,8 @@ int btrfs_next_old_leaf(struct btrfs_root *root, struct btrfs_path *path,
 			}
 			if (!ret) {
 				btrfs_set_path_blocking(path);
-				btrfs_tree_read_lock(next);
+				__btrfs_tree_read_lock(next,
+						       BTRFS_NESTING_RIGHT);
 				btrfs_clear_path_blocking(path, next,
 							  BTRFS_READ_LOCK);
 			}
@@ -5846,7 +5936,8 @@ int btrfs_next_old_leaf(struct btrfs_root *root, struct btrfs_path *path,
 			ret = btrfs_try_tree_read_lock(next);
 			if (!ret) {
 				btrfs_set_path_blocking(path);
-				btrfs_tree_read_lock(next);
+				__btrfs_tree_read_lock(next,
+						       BTRFS_NESTING_RIGHT);
 				btrfs_clear_path_blocking(path, next,
 							  BTRFS_READ_LOCK);
 			}
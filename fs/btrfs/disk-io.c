@@ -264,14 +264,99 @@ static struct extent_map *btree_get_extent(struct btrfs_inode *inode,
 	return em;
 }
 
-u32 btrfs_csum_data(const char *data, u32 seed, size_t len)
+/*
+ * Set up the checksum algorithm of the filesystem, crc32c uses the shash of
+ * hash.c and xxhash64 is computed by lib/xxhash.c, the other ones need a
+ * crypto API driver.
+ */
+int btrfs_init_csum_hash(struct btrfs_fs_info *fs_info, u16 csum_type)
 {
-	return btrfs_crc32c(seed, data, len);
+	const char *driver = btrfs_csums[csum_type].driver;
+	struct crypto_shash *csum_shash;
+
+	fs_info->csum_type = csum_type;
+	if (!driver)
+		return 0;
+
+	csum_shash = crypto_alloc_shash(driver, 0, 0);
+	if (IS_ERR(csum_shash)) {
+		btrfs_err(fs_info, "error allocating %s hash for checksum",
+			  driver);
+		return PTR_ERR(csum_shash);
+	}
+	if (crypto_shash_descsize(csum_shash) > BTRFS_CSUM_DESC_SIZE) {
+		btrfs_err(fs_info, "%s hash context too large for checksum",
+			  crypto_shash_driver_name(csum_shash));
+		crypto_free_shash(csum_shash);
+		return -EINVAL;
+	}
+	fs_info->csum_shash = csum_shash;
+	btrfs_info(fs_info, "using %s (%s) checksum algorithm",
+		   btrfs_super_csum_name(csum_type),
+		   crypto_shash_driver_name(csum_shash));
+	return 0;
 }
 
-void btrfs_csum_final(u32 crc, u8 *result)
+void btrfs_csum_init(struct btrfs_fs_info *fs_info, struct btrfs_csum_ctx *ctx)
 {
-	put_unaligned_le32(~crc, result);
+	struct shash_desc *desc = (struct shash_desc *)ctx->desc;
+
+	ctx->type = fs_info->csum_type;
+	switch (ctx->type) {
+	case BTRFS_CSUM_TYPE_CRC32:
+		ctx->crc = ~(u32)0;
+		break;
+	case BTRFS_CSUM_TYPE_XXHASH:
+		xxh64_reset(&ctx->xxh, 0);
+		break;
+	default:
+		desc->tfm = fs_info->csum_shash;
+		desc->flags = 0;
+		crypto_shash_init(desc);
+		break;
+	}
+}
+
+void btrfs_csum_update(struct btrfs_csum_ctx *ctx, const void *data,
+		       size_t len)
+{
+	switch (ctx->type) {
+	case BTRFS_CSUM_TYPE_CRC32:
+		ctx->crc = btrfs_crc32c(ctx->crc, data, len);
+		break;
+	case BTRFS_CSUM_TYPE_XXHASH:
+		xxh64_update(&ctx->xxh, data, len);
+		break;
+	default:
+		crypto_shash_update((struct shash_desc *)ctx->desc, data, len);
+		break;
+	}
+}
+
+/* @result has room for the btrfs_super_csum_size() bytes of the checksum */
+void btrfs_csum_final(struct btrfs_csum_ctx *ctx, u8 *result)
+{
+	switch (ctx->type) {
+	case BTRFS_CSUM_TYPE_CRC32:
+		put_unaligned_le32(~ctx->crc, result);
+		break;
+	case BTRFS_CSUM_TYPE_XXHASH:
+		put_unaligned_le64(xxh64_digest(&ctx->xxh), result);
+		break;
+	default:
+		crypto_shash_final((struct shash_desc *)ctx->desc, result);
+		break;
+	}
+}
+
+void btrfs_csum_data(struct btrfs_fs_info *fs_info, const void *data,
+		     size_t len, u8 *result)
+{
+	struct btrfs_csum_ctx ctx;
+
+	btrfs_csum_init(fs_info, &ctx);
+	btrfs_csum_update(&ctx, data, len);
+	btrfs_csum_final(&ctx, result);
 }
 
 /*
@@ -283,7 +368,8 @@ static int csum_tree_block(struct btrfs_fs_info *fs_info,
 			   int verify)
 {
 	u16 csum_size = btrfs_super_csum_size(fs_info->super_copy);
-	char *result = NULL;
+	struct btrfs_csum_ctx ctx;
+	u8 result[BTRFS_CSUM_SIZE];
 	unsigned long len;
 	unsigned long cur_len;
 	unsigned long offset = BTRFS_CSUM_SIZE;
@@ -291,9 +377,8 @@ static int csum_tree_block(struct btrfs_fs_info *fs_info,
 	unsigned long map_start;
 	unsigned long map_len;
 	int err;
-	u32 crc = ~(u32)0;
-	unsigned long inline_result;
 
+	btrfs_csum_init(fs_info, &ctx);
 	len = buf->len - offset;
 	while (len > 0) {
 		err = map_private_extent_buffer(buf, offset, 32,
@@ -301,41 +386,27 @@ static int csum_tree_block(struct btrfs_fs_info *fs_info,
 		if (err)
 			return err;
 		cur_len = min(len, map_len - (offset - map_start));
-		crc = btrfs_csum_data(kaddr + offset - map_start,
-				      crc, cur_len);
+		btrfs_csum_update(&ctx, kaddr + offset - map_start, cur_len);
 		len -= cur_len;
 		offset += cur_len;
 	}
-	if (csum_size > sizeof(inline_result)) {
-		result = kzalloc(csum_size, GFP_NOFS);
-		if (!result)
-			return -ENOMEM;
-	} else {
-		result = (char *)&inline_result;
-	}
-
-	btrfs_csum_final(crc, result);
+	btrfs_csum_final(&ctx, result);
 
 	if (verify) {
 		if (memcmp_extent_buffer(buf, result, 0, csum_size)) {
-			u32 val;
-			u32 found = 0;
-			memcpy(&found, result, csum_size);
+			u8 val[BTRFS_CSUM_SIZE];
 
-			read_extent_buffer(buf, &val, 0, csum_size);
+			read_extent_buffer(buf, val, 0, csum_size);
 			btrfs_warn_rl(fs_info,
-				"%s checksum verify failed on %llu wanted %X found %X level %d",
+				"%s checksum verify failed on %llu wanted 0x%*phN found 0x%*phN level %d",
 				fs_info->sb->s_id, buf->start,
-				val, found, btrfs_header_level(buf));
-			if (result != (char *)&inline_result)
-				kfree(result);
+				csum_size, val, csum_size, result,
+				btrfs_header_level(buf));
 			return -EUCLEAN;
 		}
 	} else {
 		write_extent_buffer(buf, result, 0, csum_size);
 	}
-	if (result != (char *)&inline_result)
-		kfree(result);
 	return 0;
 }
 
@@ -404,34 +475,20 @@ static int btrfs_check_super_csum(struct btrfs_fs_info *fs_info,
 {
 	struct btrfs_super_block *disk_sb =
 		(struct btrfs_super_block *)raw_disk_sb;
-	u16 csum_type = btrfs_super_csum_type(disk_sb);
-	int ret = 0;
-
-	if (csum_type == BTRFS_CSUM_TYPE_CRC32) {
-		u32 crc = ~(u32)0;
-		const int csum_size = sizeof(crc);
-		char result[csum_size];
+	u8 result[BTRFS_CSUM_SIZE];
 
-		/*
-		 * The super_block structure does not span the whole
-		 * BTRFS_SUPER_INFO_SIZE range, we expect that the unused space
-		 * is filled with zeros and is included in the checksum.
-		 */
-		crc = btrfs_csum_data(raw_disk_sb + BTRFS_CSUM_SIZE,
-				crc, BTRFS_SUPER_INFO_SIZE - BTRFS_CSUM_SIZE);
-		btrfs_csum_final(crc, result);
-
-		if (memcmp(raw_disk_sb, result, csum_size))
-			ret = 1;
-	}
+	/*
+	 * The super_block structure does not span the whole
+	 * BTRFS_SUPER_INFO_SIZE range, we expect that the unused space
+	 * is filled with zeros and is included in the checksum.
+	 */
+	btrfs_csum_data(fs_info, raw_disk_sb + BTRFS_CSUM_SIZE,
+			BTRFS_SUPER_INFO_SIZE - BTRFS_CSUM_SIZE, result);
 
-	if (csum_type >= ARRAY_SIZE(btrfs_csum_sizes)) {
-		btrfs_err(fs_info, "unsupported checksum algorithm %u",
-				csum_type);
-		ret = 1;
-	}
+	if (memcmp(raw_disk_sb, result, btrfs_super_csum_size(disk_sb)))
+		return 1;
 
-	return ret;
+	return 0;
 }
 
 /*
@@ -2561,6 +2618,7 @@ int open_ctree(struct super_block *sb,
 	u32 stripesize;
 	u64 generation;
 	u64 features;
+	u16 csum_type;
 	struct btrfs_key location;
 	struct buffer_head *bh;
 	struct btrfs_super_block *disk_super;
@@ -2761,6 +2819,22 @@ int open_ctree(struct super_block *sb,
 	 * We want to check superblock checksum, the type is stored inside.
 	 * Pass the whole disk block of size BTRFS_SUPER_INFO_SIZE (4k).
 	 */
+	csum_type = btrfs_super_csum_type((struct btrfs_super_block *)bh->b_data);
+	if (csum_type >= ARRAY_SIZE(btrfs_csums)) {
+		btrfs_err(fs_info, "unsupported checksum algorithm %u",
+			  csum_type);
+		err = -EINVAL;
+		brelse(bh);
+		goto fail_alloc;
+	}
+
+	ret = btrfs_init_csum_hash(fs_info, csum_type);
+	if (ret) {
+		err = ret;
+		brelse(bh);
+		goto fail_alloc;
+	}
+
 	if (btrfs_check_super_csum(fs_info, bh->b_data)) {
 		btrfs_err(fs_info, "superblock checksum mismatch");
 		err = -EINVAL;
@@ -3389,7 +3463,6 @@ static int write_dev_supers(struct btrfs_device *device,
 	int i;
 	int ret;
 	int errors = 0;
-	u32 crc;
 	u64 bytenr;
 
 	if (max_mirrors == 0)
@@ -3403,10 +3476,10 @@ static int write_dev_supers(struct btrfs_device *device,
 
 		btrfs_set_super_bytenr(sb, bytenr);
 
-		crc = ~(u32)0;
-		crc = btrfs_csum_data((const char *)sb + BTRFS_CSUM_SIZE, crc,
-				      BTRFS_SUPER_INFO_SIZE - BTRFS_CSUM_SIZE);
-		btrfs_csum_final(crc, sb->csum);
+		btrfs_csum_data(device->fs_info,
+				(const char *)sb + BTRFS_CSUM_SIZE,
+				BTRFS_SUPER_INFO_SIZE - BTRFS_CSUM_SIZE,
+				sb->csum);
 
 		/* One reference for us, and we leave it for the caller */
 		bh = __getblk(device->bdev, bytenr / BTRFS_BDEV_BLOCKSIZE,
@@ -19,6 +19,9 @@
 #ifndef __DISKIO__
 #define __DISKIO__
 
+#include <linux/xxhash.h>
+#include <crypto/hash.h>
+
 #define BTRFS_SUPER_INFO_OFFSET SZ_64K
 #define BTRFS_SUPER_INFO_SIZE 4096
 
@@ -33,6 +36,23 @@
  */
 #define BTRFS_BDEV_BLOCKSIZE	(4096)
 
+/*
+ * Room for the descriptor context of the crypto API checksums, enough for
+ * the generic sha256 and blake2b.  Checked against the driver at mount.
+ */
+#define BTRFS_CSUM_DESC_SIZE	256
+
+/* A checksum being computed, see btrfs_csum_init() */
+struct btrfs_csum_ctx {
+	u16 type;
+	union {
+		u32 crc;
+		struct xxh64_state xxh;
+		char desc[sizeof(struct shash_desc) + BTRFS_CSUM_DESC_SIZE]
+			CRYPTO_MINALIGN_ATTR;
+	};
+};
+
 enum btrfs_wq_endio_type {
 	BTRFS_WQ_ENDIO_DATA = 0,
 	BTRFS_WQ_ENDIO_METADATA = 1,
@@ -124,8 +144,13 @@ void btrfs_mark_buffer_dirty(struct extent_buffer *buf);
 int btrfs_buffer_uptodate(struct extent_buffer *buf, u64 parent_transid,
 			  int atomic);
 int btrfs_read_buffer(struct extent_buffer *buf, u64 parent_transid);
-u32 btrfs_csum_data(const char *data, u32 seed, size_t len);
-void btrfs_csum_final(u32 crc, u8 *result);
+int btrfs_init_csum_hash(struct btrfs_fs_info *fs_info, u16 csum_type);
+void btrfs_csum_init(struct btrfs_fs_info *fs_info, struct btrfs_csum_ctx *ctx);
+void btrfs_csum_update(struct btrfs_csum_ctx *ctx, const void *data,
+		       size_t len);
+void btrfs_csum_final(struct btrfs_csum_ctx *ctx, u8 *result);
+void btrfs_csum_data(struct btrfs_fs_info *fs_info, const void *data,
+		     size_t len, u8 *result);
 blk_status_t btrfs_bio_wq_end_io(struct btrfs_fs_info *info, struct bio *bio,
 			enum btrfs_wq_endio_type metadata);
 blk_status_t btrfs_wq_submit_bio(struct btrfs_fs_info *fs_info, struct bio *bio,
@@ -8376,9 +8376,15 @@ btrfs_init_new_buffer(struct btrfs_trans_handle *trans, struct btrfs_root *root,
 	if (IS_ERR(buf))
 		return buf;
 
-	btrfs_set_header_generation(buf, trans->transid);
 	btrfs_set_buffer_lockdep_class(root->root_key.objectid, buf, level);
-	btrfs_tree_lock(buf);
+	/*
+	 * Only a stale lockless search may hold the lock of a new block: the
+	 * trylock keeps lockdep from nesting it in the locked buffers of the
+	 * same level, like the one being COWed.
+	 */
+	if (!btrfs_try_tree_write_lock(buf))
+		btrfs_tree_lock(buf);
+	btrfs_set_header_generation(buf, trans->transid);
 	clean_tree_block(fs_info, buf);
 	clear_bit(EXTENT_BUFFER_STALE, &buf->bflags);
 
@@ -2519,11 +2519,22 @@ static void end_bio_extent_readpage(struct bio *bio)
 	u64 len;
 	u64 extent_start = 0;
 	u64 extent_len = 0;
+	DECLARE_BITMAP(csum_failed, BIO_MAX_PAGES);
+	bool batched = false;
 	int mirror;
 	int ret;
 	int i;
 
 	ASSERT(!bio_flagged(bio, BIO_CLONED));
+
+	/* all the pages of the bio belong to the same inode */
+	tree = &BTRFS_I(bio->bi_io_vec[0].bv_page->mapping->host)->io_tree;
+	if (uptodate && tree->ops && tree->ops->readpage_bio_end_io_hook) {
+		bitmap_zero(csum_failed, bio->bi_vcnt);
+		tree->ops->readpage_bio_end_io_hook(io_bio, csum_failed);
+		batched = true;
+	}
+
 	bio_for_each_segment_all(bvec, bio, i) {
 		struct page *page = bvec->bv_page;
 		struct inode *inode = page->mapping->host;
@@ -2558,9 +2569,12 @@ static void end_bio_extent_readpage(struct bio *bio)
 
 		mirror = io_bio->mirror_num;
 		if (likely(uptodate && tree->ops)) {
-			ret = tree->ops->readpage_end_io_hook(io_bio, offset,
-							      page, start, end,
-							      mirror);
+			if (batched)
+				ret = test_bit(i, csum_failed) ? -EIO : 0;
+			else
+				ret = tree->ops->readpage_end_io_hook(io_bio,
+						offset, page, start, end,
+						mirror);
 			if (ret)
 				uptodate = 0;
 			else
@@ -4755,16 +4769,9 @@ __alloc_extent_buffer(struct btrfs_fs_info *fs_info, u64 start,
 	eb->len = len;
 	eb->fs_info = fs_info;
 	eb->bflags = 0;
-	rwlock_init(&eb->lock);
-	atomic_set(&eb->write_locks, 0);
-	atomic_set(&eb->read_locks, 0);
-	atomic_set(&eb->blocking_readers, 0);
-	atomic_set(&eb->blocking_writers, 0);
-	atomic_set(&eb->spinning_readers, 0);
-	atomic_set(&eb->spinning_writers, 0);
+	init_rwsem(&eb->lock);
+	seqcount_init(&eb->lock_seq);
 	eb->lock_nested = 0;
-	init_waitqueue_head(&eb->write_lock_wq);
-	init_waitqueue_head(&eb->read_lock_wq);
 
 	btrfs_leak_debug_add(&eb->leak_list, &buffers);
 
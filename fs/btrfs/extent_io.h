@@ -115,6 +115,9 @@ struct extent_io_ops {
 	/*
 	 * Optional hooks, called if the pointer is not NULL
 	 */
+	/* replaces readpage_end_io_hook for the pages of a whole read bio */
+	void (*readpage_bio_end_io_hook)(struct btrfs_io_bio *io_bio,
+					 unsigned long *failed);
 	int (*fill_delalloc)(void *private_data, struct page *locked_page,
 			     u64 start, u64 end, int *page_started,
 			     unsigned long *nr_written);
@@ -174,31 +177,18 @@ struct extent_buffer {
 	atomic_t io_pages;
 	int read_mirror;
 	struct rcu_head rcu_head;
+	/* pid of the write lock holder, 0 if not write locked */
 	pid_t lock_owner;
 
-	/* count of read lock holders on the extent buffer */
-	atomic_t write_locks;
-	atomic_t read_locks;
-	atomic_t blocking_writers;
-	atomic_t blocking_readers;
-	atomic_t spinning_readers;
-	atomic_t spinning_writers;
 	short lock_nested;
 	/* >= 0 if eb belongs to a log tree, -1 otherwise */
 	short log_index;
 
-	/* protects write locks */
-	rwlock_t lock;
+	/* the tree lock, see locking.c */
+	struct rw_semaphore lock;
 
-	/* readers use lock_wq while they wait for the write
-	 * lock holders to unlock
-	 */
-	wait_queue_head_t write_lock_wq;
-
-	/* writers use read_lock_wq while they wait for readers
-	 * to unlock
-	 */
-	wait_queue_head_t read_lock_wq;
+	/* odd while write locked, for the lockless searches */
+	seqcount_t lock_seq;
 	struct page *pages[INLINE_EXTENT_BUFFER_PAGES];
 #ifdef CONFIG_BTRFS_DEBUG
 	struct list_head leak_list;
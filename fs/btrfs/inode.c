@@ -3157,16 +3157,17 @@ static int __readpage_endio_check(struct inode *inode,
 				  int icsum, struct page *page,
 				  int pgoff, u64 start, size_t len)
 {
+	struct btrfs_fs_info *fs_info = btrfs_sb(inode->i_sb);
+	u16 csum_size = btrfs_super_csum_size(fs_info->super_copy);
 	char *kaddr;
-	u32 csum_expected;
-	u32 csum = ~(u32)0;
+	u8 *csum_expected;
+	u8 csum[BTRFS_CSUM_SIZE];
 
-	csum_expected = *(((u32 *)io_bio->csum) + icsum);
+	csum_expected = io_bio->csum + icsum * csum_size;
 
 	kaddr = kmap_atomic(page);
-	csum = btrfs_csum_data(kaddr + pgoff, csum,  len);
-	btrfs_csum_final(csum, (u8 *)&csum);
-	if (csum != csum_expected)
+	btrfs_csum_data(fs_info, kaddr + pgoff, len, csum);
+	if (memcmp(csum, csum_expected, csum_size))
 		goto zeroit;
 
 	kunmap_atomic(kaddr);
@@ -3181,38 +3182,80 @@ static int __readpage_endio_check(struct inode *inode,
 }
 
 /*
- * when reads are done, we need to check csums to verify the data is correct
- * if there's a match, we allow the bio to finish.  If not, the code in
- * extent_io.c will try to find good copies for us.
+ * Returns true if the range [start, end] of @page, just read, has a csum to
+ * verify.
  */
-static int btrfs_readpage_end_io_hook(struct btrfs_io_bio *io_bio,
-				      u64 phy_offset, struct page *page,
-				      u64 start, u64 end, int mirror)
+static bool readpage_csum_wanted(struct inode *inode, struct page *page,
+				 u64 start, u64 end)
 {
-	size_t offset = start - page_offset(page);
-	struct inode *inode = page->mapping->host;
 	struct extent_io_tree *io_tree = &BTRFS_I(inode)->io_tree;
 	struct btrfs_root *root = BTRFS_I(inode)->root;
 
 	if (PageChecked(page)) {
 		ClearPageChecked(page);
-		return 0;
+		return false;
 	}
 
 	if (BTRFS_I(inode)->flags & BTRFS_INODE_NODATASUM)
-		return 0;
+		return false;
 
 	if (root->root_key.objectid == BTRFS_DATA_RELOC_TREE_OBJECTID &&
 	    test_range_bit(io_tree, start, end, EXTENT_NODATASUM, 1, NULL)) {
 		clear_extent_bits(io_tree, start, end, EXTENT_NODATASUM);
-		return 0;
+		return false;
 	}
+	return true;
+}
+
+/*
+ * when reads are done, we need to check csums to verify the data is correct
+ * if there's a match, we allow the bio to finish.  If not, the code in
+ * extent_io.c will try to find good copies for us.
+ */
+static int btrfs_readpage_end_io_hook(struct btrfs_io_bio *io_bio,
+				      u64 phy_offset, struct page *page,
+				      u64 start, u64 end, int mirror)
+{
+	size_t offset = start - page_offset(page);
+	struct inode *inode = page->mapping->host;
+
+	if (!readpage_csum_wanted(inode, page, start, end))
+		return 0;
 
 	phy_offset >>= inode->i_sb->s_blocksize_bits;
 	return __readpage_endio_check(inode, io_bio, phy_offset, page, offset,
 				      start, (size_t)(end - start + 1));
 }
 
+/*
+ * Same as btrfs_readpage_end_io_hook(), for all the pages of @io_bio at once:
+ * the csums are verified in a single pass over the bio and the index of each
+ * page failing the check is set in @failed.
+ */
+static void btrfs_readpage_bio_end_io_hook(struct btrfs_io_bio *io_bio,
+					   unsigned long *failed)
+{
+	struct bio *bio = &io_bio->bio;
+	struct inode *inode = bio->bi_io_vec[0].bv_page->mapping->host;
+	unsigned int blocksize_bits = inode->i_sb->s_blocksize_bits;
+	struct bio_vec *bvec;
+	u64 phy_offset = 0;
+	int i;
+
+	bio_for_each_segment_all(bvec, bio, i) {
+		struct page *page = bvec->bv_page;
+		u64 start = page_offset(page);
+		u64 end = start + bvec->bv_offset + bvec->bv_len - 1;
+
+		if (readpage_csum_wanted(inode, page, start, end) &&
+		    __readpage_endio_check(inode, io_bio,
+					   phy_offset >> blocksize_bits, page,
+					   0, start, (size_t)(end - start + 1)))
+			set_bit(i, failed);
+		phy_offset += bvec->bv_len;
+	}
+}
+
 void btrfs_add_delayed_iput(struct inode *inode)
 {
 	struct btrfs_fs_info *fs_info = btrfs_sb(inode->i_sb);
@@ -8528,7 +8571,8 @@ static inline blk_status_t btrfs_lookup_and_bind_dio_csum(struct inode *inode,
 
 	file_offset -= dip->logical_offset;
 	file_offset >>= inode->i_sb->s_blocksize_bits;
-	io_bio->csum = (u8 *)(((u32 *)orig_io_bio->csum) + file_offset);
+	io_bio->csum = orig_io_bio->csum + file_offset *
+		       btrfs_super_csum_size(btrfs_sb(inode->i_sb)->super_copy);
 
 	return 0;
 }
@@ -10869,6 +10913,7 @@ static const struct extent_io_ops btrfs_extent_io_ops = {
 	.set_range_writeback = btrfs_set_range_writeback,
 
 	/* optional callbacks */
+	.readpage_bio_end_io_hook = btrfs_readpage_bio_end_io_hook,
 	.fill_delalloc = run_delalloc_range,
 	.writepage_end_io_hook = btrfs_writepage_end_io_hook,
 	.writepage_start_hook = btrfs_writepage_start_hook,
@@ -24,19 +24,75 @@
 #define BTRFS_WRITE_LOCK_BLOCKING 3
 #define BTRFS_READ_LOCK_BLOCKING 4
 
-void btrfs_tree_lock(struct extent_buffer *eb);
+/*
+ * lockdep subclasses of the buffers locked while another buffer of the same
+ * tree and level is: the lockdep class only depends on them.
+ */
+enum btrfs_lock_nesting {
+	BTRFS_NESTING_NORMAL,
+	BTRFS_NESTING_LEFT,	/* left sibling of a locked buffer */
+	BTRFS_NESTING_RIGHT,	/* right sibling of a locked buffer */
+};
+
+void __btrfs_tree_lock(struct extent_buffer *eb, enum btrfs_lock_nesting nest);
 void btrfs_tree_unlock(struct extent_buffer *eb);
 
-void btrfs_tree_read_lock(struct extent_buffer *eb);
+void __btrfs_tree_read_lock(struct extent_buffer *eb,
+			    enum btrfs_lock_nesting nest);
 void btrfs_tree_read_unlock(struct extent_buffer *eb);
-void btrfs_tree_read_unlock_blocking(struct extent_buffer *eb);
-void btrfs_set_lock_blocking_rw(struct extent_buffer *eb, int rw);
-void btrfs_clear_lock_blocking_rw(struct extent_buffer *eb, int rw);
 void btrfs_assert_tree_locked(struct extent_buffer *eb);
 int btrfs_try_tree_read_lock(struct extent_buffer *eb);
 int btrfs_try_tree_write_lock(struct extent_buffer *eb);
-int btrfs_tree_read_lock_atomic(struct extent_buffer *eb);
 
+static inline void btrfs_tree_lock(struct extent_buffer *eb)
+{
+	__btrfs_tree_lock(eb, BTRFS_NESTING_NORMAL);
+}
+
+static inline void btrfs_tree_read_lock(struct extent_buffer *eb)
+{
+	__btrfs_tree_read_lock(eb, BTRFS_NESTING_NORMAL);
+}
+
+/*
+ * The tree locks are rw_semaphores, a blocking holder is the same as a
+ * spinning one.  The blocking states are still tracked by the paths.
+ */
+static inline int btrfs_tree_read_lock_atomic(struct extent_buffer *eb)
+{
+	return btrfs_try_tree_read_lock(eb);
+}
+
+static inline void btrfs_tree_read_unlock_blocking(struct extent_buffer *eb)
+{
+	btrfs_tree_read_unlock(eb);
+}
+
+static inline void btrfs_set_lock_blocking_rw(struct extent_buffer *eb,
+					      int rw)
+{
+}
+
+static inline void btrfs_clear_lock_blocking_rw(struct extent_buffer *eb,
+						int rw)
+{
+}
+
+/*
+ * Lockless readers: the sequence is odd while @eb is write locked, and
+ * btrfs_tree_lock_seq_retry() tells if it was write locked since the
+ * sequence was read.
+ */
+static inline unsigned int btrfs_tree_lock_seq(struct extent_buffer *eb)
+{
+	return raw_read_seqcount(&eb->lock_seq);
+}
+
+static inline bool btrfs_tree_lock_seq_retry(struct extent_buffer *eb,
+					     unsigned int seq)
+{
+	return read_seqcount_retry(&eb->lock_seq, seq);
+}
 
 static inline void btrfs_tree_unlock_rw(struct extent_buffer *eb, int rw)
 {
@@ -133,6 +133,22 @@ struct dentry_stat_t dentry_stat = {
 static DEFINE_PER_CPU(long, nr_dentry);
 static DEFINE_PER_CPU(long, nr_dentry_unused);
 
+/*
+ * Negative dentries on the LRU lists, i.e. with DCACHE_LRU_LIST but not
+ * DCACHE_SHRINK_LIST set.  Lookups of missing names create them for free and
+ * only memory pressure gets rid of them, so past sysctl_negative_dentry_limit
+ * in total or sysctl_negative_dentry_sb_limit in a superblock the oldest ones
+ * are pruned by negative_prune_work.  These are percpu_counters rather than
+ * our own counters because d_lru_add() reads them each time.
+ */
+static struct percpu_counter nr_dentry_negative;
+static atomic_long_t nr_dentry_negative_pruned;
+unsigned long sysctl_negative_dentry_limit __read_mostly;
+unsigned long sysctl_negative_dentry_sb_limit __read_mostly;
+
+static void prune_negative_dentries(struct work_struct *work);
+static DECLARE_WORK(negative_prune_work, prune_negative_dentries);
+
 #if defined(CONFIG_SYSCTL) && defined(CONFIG_PROC_FS)
 
 /*
@@ -170,6 +186,10 @@ int proc_nr_dentry(struct ctl_table *table, int write, void __user *buffer,
 {
 	dentry_stat.nr_dentry = get_nr_dentry();
 	dentry_stat.nr_unused = get_nr_dentry_unused();
+	dentry_stat.nr_negative =
+		percpu_counter_sum_positive(&nr_dentry_negative);
+	dentry_stat.nr_negative_pruned =
+		atomic_long_read(&nr_dentry_negative_pruned);
 	return proc_doulongvec_minmax(table, write, buffer, lenp, ppos);
 }
 #endif
@@ -309,12 +329,52 @@ void release_dentry_name_snapshot(struct name_snapshot *name)
 }
 EXPORT_SYMBOL(release_dentry_name_snapshot);
 
+static inline bool d_lru_negative(const struct dentry *dentry)
+{
+	/* on the LRU list proper and of DCACHE_MISS_TYPE */
+	return (dentry->d_flags & (DCACHE_LRU_LIST | DCACHE_SHRINK_LIST |
+				   DCACHE_ENTRY_TYPE)) == DCACHE_LRU_LIST;
+}
+
+static bool negative_dentries_over_limit(struct super_block *sb)
+{
+	unsigned long limit;
+	s64 nr;
+
+	limit = READ_ONCE(sysctl_negative_dentry_sb_limit);
+	nr = percpu_counter_read_positive(&sb->s_dentry_negative);
+	if (limit && nr > limit)
+		return true;
+	limit = READ_ONCE(sysctl_negative_dentry_limit);
+	nr = percpu_counter_read_positive(&nr_dentry_negative);
+	return limit && nr > limit;
+}
+
+static void d_negative_inc(struct dentry *dentry)
+{
+	struct super_block *sb = dentry->d_sb;
+
+	percpu_counter_inc(&nr_dentry_negative);
+	percpu_counter_inc(&sb->s_dentry_negative);
+	if (unlikely(negative_dentries_over_limit(sb)))
+		schedule_work(&negative_prune_work);
+}
+
+static void d_negative_dec(struct dentry *dentry)
+{
+	percpu_counter_dec(&nr_dentry_negative);
+	percpu_counter_dec(&dentry->d_sb->s_dentry_negative);
+}
+
 static inline void __d_set_inode_and_type(struct dentry *dentry,
 					  struct inode *inode,
 					  unsigned type_flags)
 {
 	unsigned flags;
 
+	/* @inode is never NULL, an unused negative dentry turns positive */
+	if (d_lru_negative(dentry))
+		d_negative_dec(dentry);
 	dentry->d_inode = inode;
 	flags = READ_ONCE(dentry->d_flags);
 	flags &= ~(DCACHE_ENTRY_TYPE | DCACHE_FALLTHRU);
@@ -329,6 +389,8 @@ static inline void __d_clear_type_and_inode(struct dentry *dentry)
 	flags &= ~(DCACHE_ENTRY_TYPE | DCACHE_FALLTHRU);
 	WRITE_ONCE(dentry->d_flags, flags);
 	dentry->d_inode = NULL;
+	if (d_lru_negative(dentry))
+		d_negative_inc(dentry);
 }
 
 static void dentry_free(struct dentry *dentry)
@@ -384,7 +446,8 @@ static void dentry_unlink_inode(struct dentry * dentry)
  * on the shrink list (ie not on the superblock LRU list).
  *
  * The per-cpu "nr_dentry_unused" counters are updated with
- * the DCACHE_LRU_LIST bit.
+ * the DCACHE_LRU_LIST bit, the negative dentry counters when
+ * a negative dentry gets on or off the superblock LRU list.
  *
  * These helper functions make sure we always follow the
  * rules. d_lock must be held by the caller.
@@ -395,6 +458,8 @@ static void d_lru_add(struct dentry *dentry)
 	D_FLAG_VERIFY(dentry, 0);
 	dentry->d_flags |= DCACHE_LRU_LIST;
 	this_cpu_inc(nr_dentry_unused);
+	if (d_is_negative(dentry))
+		d_negative_inc(dentry);
 	WARN_ON_ONCE(!list_lru_add(&dentry->d_sb->s_dentry_lru, &dentry->d_lru));
 }
 
@@ -403,6 +468,8 @@ static void d_lru_del(struct dentry *dentry)
 	D_FLAG_VERIFY(dentry, DCACHE_LRU_LIST);
 	dentry->d_flags &= ~DCACHE_LRU_LIST;
 	this_cpu_dec(nr_dentry_unused);
+	if (d_is_negative(dentry))
+		d_negative_dec(dentry);
 	WARN_ON_ONCE(!list_lru_del(&dentry->d_sb->s_dentry_lru, &dentry->d_lru));
 }
 
@@ -433,6 +500,8 @@ static void d_lru_isolate(struct list_lru_one *lru, struct dentry *dentry)
 	D_FLAG_VERIFY(dentry, DCACHE_LRU_LIST);
 	dentry->d_flags &= ~DCACHE_LRU_LIST;
 	this_cpu_dec(nr_dentry_unused);
+	if (d_is_negative(dentry))
+		d_negative_dec(dentry);
 	list_lru_isolate(lru, &dentry->d_lru);
 }
 
@@ -441,6 +510,8 @@ static void d_lru_shrink_move(struct list_lru_one *lru, struct dentry *dentry,
 {
 	D_FLAG_VERIFY(dentry, DCACHE_LRU_LIST);
 	dentry->d_flags |= DCACHE_SHRINK_LIST;
+	if (d_is_negative(dentry))
+		d_negative_dec(dentry);
 	list_lru_isolate_move(lru, &dentry->d_lru, list);
 }
 
@@ -1174,6 +1245,88 @@ void shrink_dcache_sb(struct super_block *sb)
 }
 EXPORT_SYMBOL(shrink_dcache_sb);
 
+struct negative_prune {
+	struct list_head dispose;
+	long nr_to_prune;
+};
+
+static enum lru_status negative_lru_isolate(struct list_head *item,
+		struct list_lru_one *lru, spinlock_t *lru_lock, void *arg)
+{
+	struct negative_prune *np = arg;
+	struct dentry	*dentry = container_of(item, struct dentry, d_lru);
+
+	if (!np->nr_to_prune || !spin_trylock(&dentry->d_lock))
+		return LRU_SKIP;
+
+	/* the positive dentries get another pass, as if referenced */
+	if (!d_is_negative(dentry)) {
+		spin_unlock(&dentry->d_lock);
+		return LRU_ROTATE;
+	}
+
+	if (dentry->d_lockref.count) {
+		d_lru_isolate(lru, dentry);
+		spin_unlock(&dentry->d_lock);
+		return LRU_REMOVED;
+	}
+
+	/* the oldest go first, referenced or not */
+	d_lru_shrink_move(lru, dentry, &np->dispose);
+	np->nr_to_prune--;
+	spin_unlock(&dentry->d_lock);
+
+	return LRU_REMOVED;
+}
+
+struct negative_prune_ctl {
+	long total;
+	long excess;
+};
+
+static void prune_negative_sb(struct super_block *sb, void *arg)
+{
+	struct negative_prune_ctl *ctl = arg;
+	unsigned long limit = READ_ONCE(sysctl_negative_dentry_sb_limit);
+	long nr = percpu_counter_sum_positive(&sb->s_dentry_negative);
+	unsigned long nr_to_walk;
+	long excess = 0;
+
+	if (limit && nr > limit)
+		excess = nr - limit;
+	/* and a share of the global excess, as per the count of @sb */
+	if (ctl->excess && ctl->total)
+		excess = max(excess, mult_frac(ctl->excess, nr, ctl->total));
+
+	/* each dentry is walked at most once */
+	nr_to_walk = list_lru_count(&sb->s_dentry_lru);
+	while (excess > 0 && nr_to_walk) {
+		struct negative_prune np = { .nr_to_prune = excess };
+		unsigned long batch = min(nr_to_walk, 1024UL);
+
+		INIT_LIST_HEAD(&np.dispose);
+		list_lru_walk(&sb->s_dentry_lru, negative_lru_isolate, &np,
+			      batch);
+		nr_to_walk -= batch;
+		atomic_long_add(excess - np.nr_to_prune,
+				&nr_dentry_negative_pruned);
+		excess = np.nr_to_prune;
+		shrink_dentry_list(&np.dispose);
+		cond_resched();
+	}
+}
+
+static void prune_negative_dentries(struct work_struct *work)
+{
+	unsigned long limit = READ_ONCE(sysctl_negative_dentry_limit);
+	struct negative_prune_ctl ctl = { };
+
+	ctl.total = percpu_counter_sum_positive(&nr_dentry_negative);
+	if (limit && ctl.total > limit)
+		ctl.excess = ctl.total - limit;
+	iterate_supers(prune_negative_sb, &ctl);
+}
+
 /**
  * enum d_walk_ret - action to talke during tree walk
  * @D_WALK_CONTINUE:	contrinue walk
@@ -3598,6 +3751,9 @@ static void __init dcache_init_early(void)
 
 static void __init dcache_init(void)
 {
+	if (percpu_counter_init(&nr_dentry_negative, 0, GFP_KERNEL))
+		panic("Failed to allocate the negative dentry counter");
+
 	/*
 	 * A constructor could be added for stable state like the lists,
 	 * but it is probably not worth it because of the cache nature
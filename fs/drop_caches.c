@@ -9,6 +9,7 @@
 #include <linux/writeback.h>
 #include <linux/sysctl.h>
 #include <linux/gfp.h>
+#include <linux/dcache.h>
 #include "internal.h"
 
 /* A global variable is a bit ugly, but it keeps the code simple */
@@ -40,6 +41,26 @@ static void drop_pagecache_sb(struct super_block *sb, void *unused)
 	iput(toput_inode);
 }
 
+/*
+ * What the sysctl does, for @sb alone: bit 1 of @mode drops its clean page
+ * cache, bit 2 its unused dentries and inodes.  Called with s_umount held.
+ */
+void drop_caches_sb(struct super_block *sb, int mode)
+{
+	if (mode & 1)
+		drop_pagecache_sb(sb, NULL);
+	if (mode & 2) {
+		long freed;
+		int passes = 0;
+
+		shrink_dcache_sb(sb);
+		/* The first pass may just age the referenced inodes */
+		do {
+			freed = prune_icache_sb_all(sb);
+		} while (freed > 10 || !passes++);
+	}
+}
+
 int drop_caches_sysctl_handler(struct ctl_table *table, int write,
 	void __user *buffer, size_t *length, loff_t *ppos)
 {
@@ -42,6 +42,9 @@
 #include <linux/seq_file.h>
 #include <linux/compat.h>
 #include <linux/rculist.h>
+#include <linux/vmalloc.h>
+#include <linux/log2.h>
+#include <linux/sched/user.h>
 #include <net/busy_poll.h>
 
 /*
@@ -50,14 +53,18 @@
  *
  * 1) epmutex (mutex)
  * 2) ep->mtx (mutex)
- * 3) ep->lock (spinlock)
+ * 3) ep->lock (rwlock)
  *
  * The acquire order is the one listed above, from 1 to 3.
- * We need a spinlock (ep->lock) because we manipulate objects
+ * We need a rwlock (ep->lock) because we manipulate objects
  * from inside the poll callback, that might be triggered from
  * a wake_up() that in turn might be called from IRQ context.
  * So we can't sleep inside the poll callback and hence we need
- * a spinlock. During the event transfer loop (from kernel to
+ * a spinning lock.  The poll callback only takes it for reading
+ * and adds items to the ready lists locklessly, so that wakeups
+ * on many files do not serialize on it; everything else that
+ * touches the ready lists takes it for writing.  The "wq" wait
+ * queue is protected by its own lock.  During the event transfer loop (from kernel to
  * user space) we could end up sleeping due a copy_to_user(), so
  * we need a lock that will allow us to sleep. This lock is a
  * mutex (ep->mtx). It is acquired during the event transfer loop,
@@ -176,6 +183,9 @@ struct epitem {
 
 	/* The structure that describe the interested events and the source fd */
 	struct epoll_event event;
+
+	/* Item number in the user ring of an EPOLL_USERPOLL instance */
+	unsigned int bit;
 };
 
 /*
@@ -184,8 +194,11 @@ struct epitem {
  * interface.
  */
 struct eventpoll {
-	/* Protect the access to this structure */
-	spinlock_t lock;
+	/*
+	 * Protect the access to the ready lists: taken for reading by
+	 * ep_poll_callback() and for writing by everybody else.
+	 */
+	rwlock_t lock;
 
 	/*
 	 * This mutex is used to ensure that files are not removed
@@ -226,6 +239,22 @@ struct eventpoll {
 	int visited;
 	struct list_head visited_list_link;
 
+	/*
+	 * Ring shared with userspace for EPOLL_USERPOLL instances: header
+	 * and items followed by the index ring, in one vmalloc_user() area.
+	 * items_bm tracks the used items, zombie_bm the items of removed
+	 * files still queued in the index ring, which are reused once head
+	 * moves past their zombie_tail.  They are protected by "mtx".
+	 */
+	struct epoll_uheader *user_header;
+	u32 *user_index;
+	unsigned int user_index_mask;
+	size_t user_length;
+	unsigned int user_max_items;
+	unsigned long *items_bm;
+	unsigned long *zombie_bm;
+	u32 *zombie_tail;
+
 #ifdef CONFIG_NET_RX_BUSY_POLL
 	/* used to track busy poll napi_id */
 	unsigned int napi_id;
@@ -377,6 +406,25 @@ static void ep_nested_calls_init(struct nested_calls *ncalls)
 	spin_lock_init(&ncalls->lock);
 }
 
+static inline bool ep_is_userpoll(struct eventpoll *ep)
+{
+	return ep->user_header != NULL;
+}
+
+/*
+ * Number of entries queued in the user ring and not consumed yet.  head
+ * is written by userspace, so do not trust it beyond the ring size.
+ */
+static inline unsigned int ep_uring_pending(struct eventpoll *ep)
+{
+	struct epoll_uheader *header = ep->user_header;
+	unsigned int pending;
+
+	pending = READ_ONCE(header->tail) - READ_ONCE(header->head);
+
+	return min_t(unsigned int, pending, ep->user_index_mask + 1);
+}
+
 /**
  * ep_events_available - Checks if ready events might be available.
  *
@@ -387,7 +435,11 @@ static void ep_nested_calls_init(struct nested_calls *ncalls)
  */
 static inline int ep_events_available(struct eventpoll *ep)
 {
-	return !list_empty(&ep->rdllist) || ep->ovflist != EP_UNACTIVE_PTR;
+	if (ep_is_userpoll(ep))
+		return ep_uring_pending(ep) != 0;
+
+	return !list_empty_careful(&ep->rdllist) ||
+		READ_ONCE(ep->ovflist) != EP_UNACTIVE_PTR;
 }
 
 #ifdef CONFIG_NET_RX_BUSY_POLL
@@ -702,17 +754,17 @@ static int ep_scan_ready_list(struct eventpoll *ep,
 	 * because we want the "sproc" callback to be able to do it
 	 * in a lockless way.
 	 */
-	spin_lock_irqsave(&ep->lock, flags);
+	write_lock_irqsave(&ep->lock, flags);
 	list_splice_init(&ep->rdllist, &txlist);
-	ep->ovflist = NULL;
-	spin_unlock_irqrestore(&ep->lock, flags);
+	WRITE_ONCE(ep->ovflist, NULL);
+	write_unlock_irqrestore(&ep->lock, flags);
 
 	/*
 	 * Now call the callback function.
 	 */
 	error = (*sproc)(ep, &txlist, priv);
 
-	spin_lock_irqsave(&ep->lock, flags);
+	write_lock_irqsave(&ep->lock, flags);
 	/*
 	 * During the time we spent inside the "sproc" callback, some
 	 * other events might have been queued by the poll callback.
@@ -736,7 +788,7 @@ static int ep_scan_ready_list(struct eventpoll *ep,
 	 * releasing the lock, events will be queued in the normal way inside
 	 * ep->rdllist.
 	 */
-	ep->ovflist = EP_UNACTIVE_PTR;
+	WRITE_ONCE(ep->ovflist, EP_UNACTIVE_PTR);
 
 	/*
 	 * Quickly re-inject items left on "txlist".
@@ -748,13 +800,15 @@ static int ep_scan_ready_list(struct eventpoll *ep,
 		/*
 		 * Wake up (if active) both the eventpoll wait list and
 		 * the ->poll() wait list (delayed after we release the lock).
+		 * ep_poll() checks for events without ep->lock, so the
+		 * barrier in wq_has_sleeper() is needed here.
 		 */
-		if (waitqueue_active(&ep->wq))
-			wake_up_locked(&ep->wq);
+		if (wq_has_sleeper(&ep->wq))
+			wake_up(&ep->wq);
 		if (waitqueue_active(&ep->poll_wait))
 			pwake++;
 	}
-	spin_unlock_irqrestore(&ep->lock, flags);
+	write_unlock_irqrestore(&ep->lock, flags);
 
 	if (!ep_locked)
 		mutex_unlock(&ep->mtx);
@@ -766,6 +820,68 @@ static int ep_scan_ready_list(struct eventpoll *ep,
 	return error;
 }
 
+/* Frees the removed items whose index entry userspace has consumed */
+static void ep_reap_uitems(struct eventpoll *ep)
+{
+	u32 head = READ_ONCE(ep->user_header->head);
+	unsigned int bit;
+
+	for_each_set_bit(bit, ep->zombie_bm, ep->user_max_items) {
+		if ((s32)(head - ep->zombie_tail[bit]) >= 0) {
+			__clear_bit(bit, ep->zombie_bm);
+			__clear_bit(bit, ep->items_bm);
+		}
+	}
+}
+
+/*
+ * Assigns a user ring item to the new @epi.  Must be called with "mtx" held.
+ */
+static int ep_get_uitem(struct eventpoll *ep, struct epitem *epi)
+{
+	struct epoll_uitem *uitem;
+	unsigned int bit;
+
+	bit = find_first_zero_bit(ep->items_bm, ep->user_max_items);
+	if (bit >= ep->user_max_items) {
+		ep_reap_uitems(ep);
+		bit = find_first_zero_bit(ep->items_bm, ep->user_max_items);
+		if (bit >= ep->user_max_items)
+			return -ENOSPC;
+	}
+
+	__set_bit(bit, ep->items_bm);
+	epi->bit = bit;
+
+	uitem = &ep->user_header->items[bit];
+	WRITE_ONCE(uitem->ready_events, 0);
+	WRITE_ONCE(uitem->events, epi->event.events);
+	WRITE_ONCE(uitem->data, epi->event.data);
+
+	return 0;
+}
+
+/*
+ * Releases the user ring item of @epi.  Its poll callbacks are gone, but an
+ * index entry may still point to it: clear ready_events so that userspace
+ * skips that entry, and keep the item until userspace has moved past all
+ * the entries queued so far, so that an item never has more than one entry
+ * in the ring.  Must be called with "mtx" held.
+ */
+static void ep_put_uitem(struct eventpoll *ep, struct epitem *epi)
+{
+	struct epoll_uitem *uitem = &ep->user_header->items[epi->bit];
+
+	WRITE_ONCE(uitem->events, 0);
+	WRITE_ONCE(uitem->data, 0);
+	if (xchg(&uitem->ready_events, 0)) {
+		ep->zombie_tail[epi->bit] = READ_ONCE(ep->user_header->tail);
+		__set_bit(epi->bit, ep->zombie_bm);
+	} else {
+		__clear_bit(epi->bit, ep->items_bm);
+	}
+}
+
 static void epi_rcu_free(struct rcu_head *head)
 {
 	struct epitem *epi = container_of(head, struct epitem, rcu);
@@ -798,10 +914,13 @@ static int ep_remove(struct eventpoll *ep, struct epitem *epi)
 
 	rb_erase_cached(&epi->rbn, &ep->rbr);
 
-	spin_lock_irqsave(&ep->lock, flags);
+	write_lock_irqsave(&ep->lock, flags);
 	if (ep_is_linked(&epi->rdllink))
 		list_del_init(&epi->rdllink);
-	spin_unlock_irqrestore(&ep->lock, flags);
+	write_unlock_irqrestore(&ep->lock, flags);
+
+	if (ep_is_userpoll(ep))
+		ep_put_uitem(ep, epi);
 
 	wakeup_source_unregister(ep_wakeup_source(epi));
 	/*
@@ -818,6 +937,75 @@ static int ep_remove(struct eventpoll *ep, struct epitem *epi)
 	return 0;
 }
 
+/* Sets up the user ring of an EPOLL_USERPOLL instance for @max_items files */
+static int ep_alloc_uring(struct eventpoll *ep, unsigned int max_items)
+{
+	size_t header_length, index_length;
+	struct epoll_uheader *header;
+	unsigned long nr_pages, limit;
+
+	/* with one entry per item at most, the index ring cannot overflow */
+	header_length = PAGE_ALIGN(sizeof(*header) +
+				   max_items * sizeof(struct epoll_uitem));
+	index_length = PAGE_ALIGN(roundup_pow_of_two(max_items) * sizeof(u32));
+	nr_pages = (header_length + index_length) >> PAGE_SHIFT;
+
+	/* The ring is pinned kernel memory, charge it like mlock() would */
+	limit = rlimit(RLIMIT_MEMLOCK) >> PAGE_SHIFT;
+	if (atomic_long_add_return(nr_pages, &ep->user->locked_vm) > limit &&
+	    !capable(CAP_IPC_LOCK)) {
+		atomic_long_sub(nr_pages, &ep->user->locked_vm);
+		return -EPERM;
+	}
+
+	ep->items_bm = kcalloc(2 * BITS_TO_LONGS(max_items), sizeof(long),
+			       GFP_KERNEL);
+	if (!ep->items_bm)
+		goto uncharge;
+	ep->zombie_bm = ep->items_bm + BITS_TO_LONGS(max_items);
+
+	ep->zombie_tail = kvmalloc_array(max_items, sizeof(u32), GFP_KERNEL);
+	if (!ep->zombie_tail)
+		goto free_bm;
+
+	header = vmalloc_user(header_length + index_length);
+	if (!header)
+		goto free_tail;
+
+	header->magic = EPOLL_USERPOLL_HEADER_MAGIC;
+	header->header_length = header_length;
+	header->index_length = index_length;
+	header->max_items_nr = max_items;
+
+	ep->user_header = header;
+	ep->user_index = (void *)header + header_length;
+	ep->user_index_mask = index_length / sizeof(u32) - 1;
+	ep->user_length = header_length + index_length;
+	ep->user_max_items = max_items;
+
+	return 0;
+
+free_tail:
+	kvfree(ep->zombie_tail);
+free_bm:
+	kfree(ep->items_bm);
+	ep->items_bm = NULL;
+uncharge:
+	atomic_long_sub(nr_pages, &ep->user->locked_vm);
+	return -ENOMEM;
+}
+
+static void ep_free_uring(struct eventpoll *ep)
+{
+	if (!ep_is_userpoll(ep))
+		return;
+
+	atomic_long_sub(ep->user_length >> PAGE_SHIFT, &ep->user->locked_vm);
+	vfree(ep->user_header);
+	kvfree(ep->zombie_tail);
+	kfree(ep->items_bm);
+}
+
 static void ep_free(struct eventpoll *ep)
 {
 	struct rb_node *rbp;
@@ -865,6 +1053,7 @@ static void ep_free(struct eventpoll *ep)
 
 	mutex_unlock(&epmutex);
 	mutex_destroy(&ep->mtx);
+	ep_free_uring(ep);
 	free_uid(ep->user);
 	wakeup_source_unregister(ep->ws);
 	kfree(ep);
@@ -934,6 +1123,11 @@ static unsigned int ep_eventpoll_poll(struct file *file, poll_table *wait)
 	struct eventpoll *ep = file->private_data;
 	struct readyevents_arg arg;
 
+	if (ep_is_userpoll(ep)) {
+		poll_wait(file, &ep->poll_wait, wait);
+		return ep_events_available(ep) ? POLLIN | POLLRDNORM : 0;
+	}
+
 	/*
 	 * During ep_insert() we already hold the ep->mtx for the tfile.
 	 * Prevent re-aquisition.
@@ -980,6 +1174,20 @@ static void ep_show_fdinfo(struct seq_file *m, struct file *f)
 }
 #endif
 
+static int ep_eventpoll_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct eventpoll *ep = file->private_data;
+
+	if (!ep_is_userpoll(ep))
+		return -ENODEV;
+
+	if (vma->vm_pgoff ||
+	    vma->vm_end - vma->vm_start > ep->user_length)
+		return -EINVAL;
+
+	return remap_vmalloc_range(vma, ep->user_header, 0);
+}
+
 /* File callbacks that implement the eventpoll file behaviour */
 static const struct file_operations eventpoll_fops = {
 #ifdef CONFIG_PROC_FS
@@ -987,6 +1195,7 @@ static const struct file_operations eventpoll_fops = {
 #endif
 	.release	= ep_eventpoll_release,
 	.poll		= ep_eventpoll_poll,
+	.mmap		= ep_eventpoll_mmap,
 	.llseek		= noop_llseek,
 };
 
@@ -1023,7 +1232,7 @@ void eventpoll_release_file(struct file *file)
 	mutex_unlock(&epmutex);
 }
 
-static int ep_alloc(struct eventpoll **pep)
+static int ep_alloc(struct eventpoll **pep, int flags, unsigned int max_items)
 {
 	int error;
 	struct user_struct *user;
@@ -1035,7 +1244,7 @@ static int ep_alloc(struct eventpoll **pep)
 	if (unlikely(!ep))
 		goto free_uid;
 
-	spin_lock_init(&ep->lock);
+	rwlock_init(&ep->lock);
 	mutex_init(&ep->mtx);
 	init_waitqueue_head(&ep->wq);
 	init_waitqueue_head(&ep->poll_wait);
@@ -1044,10 +1253,18 @@ static int ep_alloc(struct eventpoll **pep)
 	ep->ovflist = EP_UNACTIVE_PTR;
 	ep->user = user;
 
+	if (flags & EPOLL_USERPOLL) {
+		error = ep_alloc_uring(ep, max_items);
+		if (error)
+			goto free_ep;
+	}
+
 	*pep = ep;
 
 	return 0;
 
+free_ep:
+	kfree(ep);
 free_uid:
 	free_uid(user);
 	return error;
@@ -1126,10 +1343,147 @@ struct file *get_epoll_tfile_raw_ptr(struct file *file, int tfd,
 }
 #endif /* CONFIG_CHECKPOINT_RESTORE */
 
+/*
+ * Publishes @pollflags of @epi in the user ring of an EPOLL_USERPOLL
+ * instance.  Called with ep->lock held, for reading from the poll callback,
+ * so it may run concurrently for many items and even for the same item.
+ * A zero @pollflags stands for "all the registered events", as some files
+ * do not report which events woke them up.
+ *
+ * Returns %true if the item was queued in the index ring, %false if it was
+ * still queued and not consumed by userspace yet.
+ */
+static bool ep_add_event_to_uring(struct epitem *epi, unsigned int pollflags)
+{
+	struct eventpoll *ep = epi->ep;
+	struct epoll_uitem *uitem = &ep->user_header->items[epi->bit];
+	unsigned int events, old, tail;
+
+	events = epi->event.events & ~EP_PRIVATE_BITS;
+	if (pollflags)
+		events &= pollflags;
+	if (!events)
+		return false;
+
+	do {
+		old = READ_ONCE(uitem->ready_events);
+		if ((old | events) == old)
+			break;
+	} while (cmpxchg(&uitem->ready_events, old, old | events) != old);
+
+	if (old)
+		return false;
+
+	/*
+	 * EPOLLONESHOT disables the item once it is reported, until the next
+	 * EPOLL_CTL_MOD.  Concurrent callbacks may race here, but they all
+	 * store the same value and only the first one got to queue the item.
+	 */
+	if (epi->event.events & EPOLLONESHOT)
+		WRITE_ONCE(epi->event.events,
+			   epi->event.events & EP_PRIVATE_BITS);
+
+	/*
+	 * Reserve the slot first, userspace waits for the entry to become
+	 * non-zero.  The ring is never overrun: it has a slot per item, each
+	 * item is queued at most once, userspace moves head before clearing
+	 * ready_events, and ep_put_uitem() keeps the items of removed files
+	 * until their entry is consumed.
+	 */
+	tail = atomic_fetch_inc((atomic_t *)&ep->user_header->tail);
+	WRITE_ONCE(ep->user_index[tail & ep->user_index_mask], epi->bit + 1);
+
+	return true;
+}
+
+/*
+ * Adds a new entry to the tail of the list in a lockless way, i.e.
+ * multiple CPUs are allowed to call this function concurrently.
+ *
+ * Beware: it is necessary to prevent any other modifications of the
+ *         existing list until all changes are completed, in other words
+ *         concurrent list_add_tail_lockless() calls should be protected
+ *         with a read lock, where write lock acts as a barrier which
+ *         makes sure all list_add_tail_lockless() calls are fully
+ *         completed.
+ *
+ *        Also an element can be locklessly added to the list only in one
+ *        direction i.e. either to the tail either to the head, otherwise
+ *        concurrent access will corrupt the list.
+ *
+ * Returns %false if element has been already added to the list, %true
+ * otherwise.
+ */
+static inline bool list_add_tail_lockless(struct list_head *new,
+					  struct list_head *head)
+{
+	struct list_head *prev;
+
+	/*
+	 * This is simple 'new->next = head' operation, but cmpxchg()
+	 * is used in order to detect that same element has been just
+	 * added to the list from another CPU: the winner observes
+	 * new->next == new.
+	 */
+	if (cmpxchg(&new->next, new, head) != new)
+		return false;
+
+	/*
+	 * Initially ->next of a new element must be updated with the head
+	 * (we are inserting to the tail) and only then pointers are atomically
+	 * exchanged.  XCHG guarantees memory ordering, thus ->next should be
+	 * updated before pointers are actually swapped and pointers are
+	 * swapped before prev->next is updated.
+	 */
+	prev = xchg(&head->prev, new);
+
+	/*
+	 * It is safe to modify prev->next and new->prev, because a new element
+	 * is added only to the tail and new->next is updated before XCHG.
+	 */
+	prev->next = new;
+	new->prev = prev;
+
+	return true;
+}
+
+/*
+ * Chains a new epi entry to the tail of the ep->ovflist in a lockless way,
+ * i.e. multiple CPUs are allowed to call this function concurrently.
+ *
+ * Returns %false if epi element has been already chained, %true otherwise.
+ */
+static inline bool chain_epi_lockless(struct epitem *epi)
+{
+	struct eventpoll *ep = epi->ep;
+
+	/* Check that the same epi has not been just chained from another CPU */
+	if (cmpxchg(&epi->next, EP_UNACTIVE_PTR, NULL) != EP_UNACTIVE_PTR)
+		return false;
+
+	/* Atomically exchange tail */
+	epi->next = xchg(&ep->ovflist, epi);
+
+	return true;
+}
+
 /*
  * This is the callback that is passed to the wait queue wakeup
  * mechanism. It is called by the stored file descriptors when they
  * have events to report.
+ *
+ * This callback takes a read lock in order not to contend with concurrent
+ * events from another file descriptor, thus all modifications to ->rdllist
+ * or ->ovflist are lockless.  Read lock is paired with the write lock from
+ * ep_scan_ready_list(), which stops all list modifications and guarantees
+ * that lists state is seen correctly.
+ *
+ * Another thing worth to mention is that ep_poll_callback() can be called
+ * concurrently for the same @epi from different CPUs if poll table was inited
+ * with several wait queues entries.  Plural wakeup from different CPUs of a
+ * single wait queue is serialized by wq.lock, but the case when multiple wait
+ * queues are used should be detected accordingly.  This is detected using
+ * cmpxchg() operation.
  */
 static int ep_poll_callback(wait_queue_entry_t *wait, unsigned mode, int sync, void *key)
 {
@@ -1139,7 +1493,7 @@ static int ep_poll_callback(wait_queue_entry_t *wait, unsigned mode, int sync, v
 	struct eventpoll *ep = epi->ep;
 	int ewake = 0;
 
-	spin_lock_irqsave(&ep->lock, flags);
+	read_lock_irqsave(&ep->lock, flags);
 
 	ep_set_busy_poll_napi_id(epi);
 
@@ -1161,16 +1515,21 @@ static int ep_poll_callback(wait_queue_entry_t *wait, unsigned mode, int sync, v
 	if (key && !((unsigned long) key & epi->event.events))
 		goto out_unlock;
 
+	if (ep_is_userpoll(ep)) {
+		/* Still queued, whoever queued it did the wakeup */
+		if (!ep_add_event_to_uring(epi, (unsigned long)key))
+			goto out_unlock;
+		goto wakeup;
+	}
+
 	/*
 	 * If we are transferring events to userspace, we can hold no locks
 	 * (because we're accessing user memory, and because of linux f_op->poll()
 	 * semantics). All the events that happen during that period of time are
 	 * chained in ep->ovflist and requeued later on.
 	 */
-	if (unlikely(ep->ovflist != EP_UNACTIVE_PTR)) {
-		if (epi->next == EP_UNACTIVE_PTR) {
-			epi->next = ep->ovflist;
-			ep->ovflist = epi;
+	if (unlikely(READ_ONCE(ep->ovflist) != EP_UNACTIVE_PTR)) {
+		if (epi->next == EP_UNACTIVE_PTR && chain_epi_lockless(epi)) {
 			if (epi->ws) {
 				/*
 				 * Activate ep->ws since epi->ws may get
@@ -1184,14 +1543,15 @@ static int ep_poll_callback(wait_queue_entry_t *wait, unsigned mode, int sync, v
 	}
 
 	/* If this file is already in the ready list we exit soon */
-	if (!ep_is_linked(&epi->rdllink)) {
-		list_add_tail(&epi->rdllink, &ep->rdllist);
+	if (!ep_is_linked(&epi->rdllink) &&
+	    list_add_tail_lockless(&epi->rdllink, &ep->rdllist))
 		ep_pm_stay_awake_rcu(epi);
-	}
 
+wakeup:
 	/*
 	 * Wake up ( if active ) both the eventpoll wait list and the ->poll()
-	 * wait list.
+	 * wait list.  The atomic ops used to queue @epi above order the
+	 * queueing against the lockless ep_events_available() in ep_poll().
 	 */
 	if (waitqueue_active(&ep->wq)) {
 		if ((epi->event.events & EPOLLEXCLUSIVE) &&
@@ -1210,13 +1570,13 @@ static int ep_poll_callback(wait_queue_entry_t *wait, unsigned mode, int sync, v
 				break;
 			}
 		}
-		wake_up_locked(&ep->wq);
+		wake_up(&ep->wq);
 	}
 	if (waitqueue_active(&ep->poll_wait))
 		pwake++;
 
 out_unlock:
-	spin_unlock_irqrestore(&ep->lock, flags);
+	read_unlock_irqrestore(&ep->lock, flags);
 
 	/* We have to call this outside the lock */
 	if (pwake)
@@ -1461,6 +1821,13 @@ static int ep_insert(struct eventpoll *ep, struct epoll_event *event,
 		RCU_INIT_POINTER(epi->ws, NULL);
 	}
 
+	/* The user item must be ready before the poll callback can hit */
+	if (ep_is_userpoll(ep)) {
+		error = ep_get_uitem(ep, epi);
+		if (error)
+			goto error_create_wakeup_source;
+	}
+
 	/* Initialize the poll table using the queue callback */
 	epq.epi = epi;
 	init_poll_funcptr(&epq.pt, ep_ptable_queue_proc);
@@ -1500,24 +1867,32 @@ static int ep_insert(struct eventpoll *ep, struct epoll_event *event,
 		goto error_remove_epi;
 
 	/* We have to drop the new item inside our item list to keep track of it */
-	spin_lock_irqsave(&ep->lock, flags);
+	write_lock_irqsave(&ep->lock, flags);
 
 	/* record NAPI ID of new item if present */
 	ep_set_busy_poll_napi_id(epi);
 
 	/* If the file is already "ready" we drop it inside the ready list */
-	if ((revents & event->events) && !ep_is_linked(&epi->rdllink)) {
+	if (ep_is_userpoll(ep)) {
+		if ((revents & event->events) &&
+		    ep_add_event_to_uring(epi, revents)) {
+			if (wq_has_sleeper(&ep->wq))
+				wake_up(&ep->wq);
+			if (waitqueue_active(&ep->poll_wait))
+				pwake++;
+		}
+	} else if ((revents & event->events) && !ep_is_linked(&epi->rdllink)) {
 		list_add_tail(&epi->rdllink, &ep->rdllist);
 		ep_pm_stay_awake(epi);
 
 		/* Notify waiting tasks that events are available */
-		if (waitqueue_active(&ep->wq))
-			wake_up_locked(&ep->wq);
+		if (wq_has_sleeper(&ep->wq))
+			wake_up(&ep->wq);
 		if (waitqueue_active(&ep->poll_wait))
 			pwake++;
 	}
 
-	spin_unlock_irqrestore(&ep->lock, flags);
+	write_unlock_irqrestore(&ep->lock, flags);
 
 	atomic_long_inc(&ep->user->epoll_watches);
 
@@ -1543,10 +1918,13 @@ static int ep_insert(struct eventpoll *ep, struct epoll_event *event,
 	 * list, since that is used/cleaned only inside a section bound by "mtx".
 	 * And ep_insert() is called with "mtx" held.
 	 */
-	spin_lock_irqsave(&ep->lock, flags);
+	write_lock_irqsave(&ep->lock, flags);
 	if (ep_is_linked(&epi->rdllink))
 		list_del_init(&epi->rdllink);
-	spin_unlock_irqrestore(&ep->lock, flags);
+	write_unlock_irqrestore(&ep->lock, flags);
+
+	if (ep_is_userpoll(ep))
+		ep_put_uitem(ep, epi);
 
 	wakeup_source_unregister(ep_wakeup_source(epi));
 
@@ -1575,6 +1953,12 @@ static int ep_modify(struct eventpoll *ep, struct epitem *epi, struct epoll_even
 	 */
 	epi->event.events = event->events; /* need barrier below */
 	epi->event.data = event->data; /* protected by mtx */
+	if (ep_is_userpoll(ep)) {
+		struct epoll_uitem *uitem = &ep->user_header->items[epi->bit];
+
+		WRITE_ONCE(uitem->events, event->events);
+		WRITE_ONCE(uitem->data, event->data);
+	}
 	if (epi->event.events & EPOLLWAKEUP) {
 		if (!ep_has_wakeup_source(epi))
 			ep_create_wakeup_source(epi);
@@ -1612,19 +1996,28 @@ static int ep_modify(struct eventpoll *ep, struct epitem *epi, struct epoll_even
 	 * If the item is "hot" and it is not registered inside the ready
 	 * list, push it inside.
 	 */
-	if (revents & event->events) {
-		spin_lock_irq(&ep->lock);
+	if ((revents & event->events) && ep_is_userpoll(ep)) {
+		write_lock_irq(&ep->lock);
+		if (ep_add_event_to_uring(epi, revents)) {
+			if (wq_has_sleeper(&ep->wq))
+				wake_up(&ep->wq);
+			if (waitqueue_active(&ep->poll_wait))
+				pwake++;
+		}
+		write_unlock_irq(&ep->lock);
+	} else if (revents & event->events) {
+		write_lock_irq(&ep->lock);
 		if (!ep_is_linked(&epi->rdllink)) {
 			list_add_tail(&epi->rdllink, &ep->rdllist);
 			ep_pm_stay_awake(epi);
 
 			/* Notify waiting tasks that events are available */
-			if (waitqueue_active(&ep->wq))
-				wake_up_locked(&ep->wq);
+			if (wq_has_sleeper(&ep->wq))
+				wake_up(&ep->wq);
 			if (waitqueue_active(&ep->poll_wait))
 				pwake++;
 		}
-		spin_unlock_irq(&ep->lock);
+		write_unlock_irq(&ep->lock);
 	}
 
 	/* We have to call this outside the lock */
@@ -1757,7 +2150,6 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 		   int maxevents, long timeout)
 {
 	int res = 0, eavail, timed_out = 0;
-	unsigned long flags;
 	u64 slack = 0;
 	wait_queue_entry_t wait;
 	ktime_t expires, *to = NULL;
@@ -1774,7 +2166,6 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 		 * caller specified a non blocking operation.
 		 */
 		timed_out = 1;
-		spin_lock_irqsave(&ep->lock, flags);
 		goto check_events;
 	}
 
@@ -1783,8 +2174,6 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 	if (!ep_events_available(ep))
 		ep_busy_loop(ep, timed_out);
 
-	spin_lock_irqsave(&ep->lock, flags);
-
 	if (!ep_events_available(ep)) {
 		/*
 		 * Busy poll timed out.  Drop NAPI ID for now, we can add
@@ -1797,9 +2186,14 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 		 * We don't have any available event to return to the caller.
 		 * We need to sleep here, and we will be wake up by
 		 * ep_poll_callback() when events will become available.
+		 * The ready lists are checked without ep->lock from here
+		 * on, the wait queue has its own lock and set_current_state()
+		 * orders the queueing against the checks below.
 		 */
 		init_waitqueue_entry(&wait, current);
+		spin_lock_irq(&ep->wq.lock);
 		__add_wait_queue_exclusive(&ep->wq, &wait);
+		spin_unlock_irq(&ep->wq.lock);
 
 		for (;;) {
 			/*
@@ -1825,21 +2219,26 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 				break;
 			}
 
-			spin_unlock_irqrestore(&ep->lock, flags);
 			if (!schedule_hrtimeout_range(to, slack, HRTIMER_MODE_ABS))
 				timed_out = 1;
-
-			spin_lock_irqsave(&ep->lock, flags);
 		}
 
-		__remove_wait_queue(&ep->wq, &wait);
 		__set_current_state(TASK_RUNNING);
+
+		spin_lock_irq(&ep->wq.lock);
+		__remove_wait_queue(&ep->wq, &wait);
+		spin_unlock_irq(&ep->wq.lock);
 	}
 check_events:
 	/* Is it worth to try to dig for events ? */
 	eavail = ep_events_available(ep);
 
-	spin_unlock_irqrestore(&ep->lock, flags);
+	/* Userspace harvests the ring itself, only report how much is there */
+	if (!res && eavail && ep_is_userpoll(ep)) {
+		if (!(res = ep_uring_pending(ep)) && !timed_out)
+			goto fetch_events;
+		return res;
+	}
 
 	/*
 	 * Try to transfer events to user space. In case we get 0 events and
@@ -1953,7 +2352,7 @@ static void clear_tfile_check_list(void)
 /*
  * Open an eventpoll file descriptor.
  */
-SYSCALL_DEFINE1(epoll_create1, int, flags)
+static int do_epoll_create(int flags, unsigned int max_items)
 {
 	int error, fd;
 	struct eventpoll *ep = NULL;
@@ -1962,12 +2361,15 @@ SYSCALL_DEFINE1(epoll_create1, int, flags)
 	/* Check the EPOLL_* constant for consistency.  */
 	BUILD_BUG_ON(EPOLL_CLOEXEC != O_CLOEXEC);
 
-	if (flags & ~EPOLL_CLOEXEC)
+	if (flags & ~(EPOLL_CLOEXEC | EPOLL_USERPOLL))
+		return -EINVAL;
+	if ((flags & EPOLL_USERPOLL) &&
+	    (!max_items || max_items > EPOLL_USERPOLL_MAX_ITEMS))
 		return -EINVAL;
 	/*
 	 * Create the internal data structure ("struct eventpoll").
 	 */
-	error = ep_alloc(&ep);
+	error = ep_alloc(&ep, flags, max_items);
 	if (error < 0)
 		return error;
 	/*
@@ -1996,12 +2398,22 @@ SYSCALL_DEFINE1(epoll_create1, int, flags)
 	return error;
 }
 
+SYSCALL_DEFINE1(epoll_create1, int, flags)
+{
+	return do_epoll_create(flags, EPOLL_USERPOLL_DEF_ITEMS);
+}
+
+SYSCALL_DEFINE2(epoll_create2, int, flags, unsigned int, max_items)
+{
+	return do_epoll_create(flags, max_items);
+}
+
 SYSCALL_DEFINE1(epoll_create, int, size)
 {
 	if (size <= 0)
 		return -EINVAL;
 
-	return sys_epoll_create1(0);
+	return do_epoll_create(0, 0);
 }
 
 /*
@@ -2072,6 +2484,14 @@ SYSCALL_DEFINE4(epoll_ctl, int, epfd, int, op, int, fd,
 	 */
 	ep = f.file->private_data;
 
+	/*
+	 * The user ring only reports transitions to ready, and the ring is
+	 * not visible to wakeup sources.
+	 */
+	if (ep_op_has_event(op) && ep_is_userpoll(ep) &&
+	    (!(epds.events & EPOLLET) || (epds.events & EPOLLWAKEUP)))
+		goto error_tgt_fput;
+
 	/*
 	 * When we insert an epoll file descriptor, inside another epoll file
 	 * descriptor, there is the change of creating closed loops, which are
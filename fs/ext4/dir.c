@@ -111,6 +111,7 @@ static int ext4_readdir(struct file *file, struct dir_context *ctx)
 	struct buffer_head *bh = NULL;
 	int dir_has_error = 0;
 	struct fscrypt_str fstr = FSTR_INIT(NULL, 0);
+	bool pardirops = IS_PARDIROPS(inode);
 
 	if (ext4_encrypted_inode(inode)) {
 		err = fscrypt_get_encryption_info(inode);
@@ -127,8 +128,12 @@ static int ext4_readdir(struct file *file, struct dir_context *ctx)
 		 * We don't set the inode dirty flag since it's not
 		 * critical that it get flushed back to the disk.
 		 */
+		if (pardirops)
+			down_write(&EXT4_I(inode)->i_dirops_sem);
 		ext4_clear_inode_flag(file_inode(file),
 				      EXT4_INODE_INDEX);
+		if (pardirops)
+			up_write(&EXT4_I(inode)->i_dirops_sem);
 	}
 
 	if (ext4_has_inline_data(inode)) {
@@ -145,6 +150,9 @@ static int ext4_readdir(struct file *file, struct dir_context *ctx)
 			return err;
 	}
 
+	/* The entries may be added and removed with i_rwsem shared */
+	if (pardirops)
+		down_read(&EXT4_I(inode)->i_dirops_sem);
 	offset = ctx->pos & (sb->s_blocksize - 1);
 
 	while (ctx->pos < inode->i_size) {
@@ -284,6 +292,8 @@ static int ext4_readdir(struct file *file, struct dir_context *ctx)
 done:
 	err = 0;
 errout:
+	if (pardirops)
+		up_read(&EXT4_I(inode)->i_dirops_sem);
 #ifdef CONFIG_EXT4_FS_ENCRYPTION
 	fscrypt_fname_free_buffer(&fstr);
 #endif
@@ -1019,6 +1019,13 @@ struct ext4_inode_info {
 	 * to occasionally drop it.
 	 */
 	struct rw_semaphore i_mmap_sem;
+	/*
+	 * i_dirops_sem is for directories running their creates and unlinks
+	 * with i_rwsem shared (S_PARDIROPS).  Those hold it for reading and
+	 * lock the htree leaf they change; whatever changes the index or the
+	 * size of the directory holds it for writing.
+	 */
+	struct rw_semaphore i_dirops_sem;
 	struct inode vfs_inode;
 	struct jbd2_inode *jinode;
 
@@ -1084,6 +1091,18 @@ struct ext4_inode_info {
 	tid_t i_sync_tid;
 	tid_t i_datasync_tid;
 
+	/*
+	 * Fast commits: the inode is on s_fc_q if it was changed in
+	 * transaction i_fc_tid, which mapped the i_fc_lblk_len blocks from
+	 * i_fc_lblk_start.  i_fc_dirty is set until the changes are in a
+	 * fast commit.  [s_fc_lock]
+	 */
+	struct list_head i_fc_list;
+	tid_t i_fc_tid;
+	ext4_lblk_t i_fc_lblk_start;
+	ext4_lblk_t i_fc_lblk_len;
+	bool i_fc_dirty;
+
 #ifdef CONFIG_QUOTA
 	struct dquot *i_dquot[MAXQUOTAS];
 #endif
@@ -1112,6 +1131,7 @@ struct ext4_inode_info {
  * Mount flags set via mount options or defaults
  */
 #define EXT4_MOUNT_NO_MBCACHE		0x00001 /* Do not use mbcache */
+#define EXT4_MOUNT_PDIROPS		0x00002	/* Parallel dir creates/unlinks */
 #define EXT4_MOUNT_GRPID		0x00004	/* Create files with directory's group */
 #define EXT4_MOUNT_DEBUG		0x00008	/* Some debugging messages */
 #define EXT4_MOUNT_ERRORS_CONT		0x00010	/* Continue on errors */
@@ -1147,6 +1167,8 @@ struct ext4_inode_info {
 #define EXT4_MOUNT_DIOREAD_NOLOCK	0x400000 /* Enable support for dio read nolocking */
 #define EXT4_MOUNT_JOURNAL_CHECKSUM	0x800000 /* Journal checksums */
 #define EXT4_MOUNT_JOURNAL_ASYNC_COMMIT	0x1000000 /* Journal Async Commit */
+#define EXT4_MOUNT_MB_OPTIMIZE_SCAN	0x2000000 /* Indexed group selection */
+#define EXT4_MOUNT_FAST_COMMIT		0x4000000 /* Fast commits for fsync */
 #define EXT4_MOUNT_DELALLOC		0x8000000 /* Delalloc support */
 #define EXT4_MOUNT_DATA_ERR_ABORT	0x10000000 /* Abort on file data write */
 #define EXT4_MOUNT_BLOCK_VALIDITY	0x20000000 /* Block validity checking */
@@ -1412,6 +1434,12 @@ struct ext4_sb_info {
 	struct journal_s *s_journal;
 	struct list_head s_orphan;
 	struct mutex s_orphan_lock;
+
+	/* Fast commits */
+	struct list_head s_fc_q;		/* inodes changed, i_fc_list */
+	spinlock_t s_fc_lock;
+	wait_queue_head_t s_fc_wait;		/* EXT4_STATE_FC_COMMITTING */
+	tid_t s_fc_ineligible_tid;		/* last tid needing a commit */
 	unsigned long s_ext4_flags;		/* Ext4 superblock flags */
 	unsigned long s_commit_interval;
 	u32 s_max_batch_time;
@@ -1444,6 +1472,12 @@ struct ext4_sb_info {
 	unsigned int s_mb_free_pending;
 	struct list_head s_freed_data_list;	/* List of blocks to be freed
 						   after commit completed */
+	/* groups by order of largest free extent, for mb_optimize_scan */
+	struct list_head *s_mb_largest_free_orders;
+	rwlock_t *s_mb_largest_free_orders_locks;
+	/* groups by order of average fragment size, for mb_optimize_scan */
+	struct list_head *s_mb_avg_fragment_size;
+	rwlock_t *s_mb_avg_fragment_size_locks;
 
 	/* tunables */
 	unsigned long s_stripe;
@@ -1568,6 +1602,7 @@ enum {
 	EXT4_STATE_MAY_INLINE_DATA,	/* may have in-inode data */
 	EXT4_STATE_EXT_PRECACHED,	/* extents have been precached */
 	EXT4_STATE_LUSTRE_EA_INODE,	/* Lustre-style ea_inode */
+	EXT4_STATE_FC_COMMITTING,	/* Fast commit ongoing for inode */
 };
 
 #define EXT4_INODE_BIT_FNS(name, field, offset)				\
@@ -2434,6 +2469,16 @@ extern int ext4_init_inode_table(struct super_block *sb,
 				 ext4_group_t group, int barrier);
 extern void ext4_end_bitmap_read(struct buffer_head *bh, int uptodate);
 
+/* fast_commit.c */
+extern void ext4_fc_init(struct super_block *sb);
+extern void ext4_fc_replay(struct super_block *sb);
+extern void ext4_fc_mark_ineligible(struct super_block *sb, handle_t *handle);
+extern void ext4_fc_track_inode(handle_t *handle, struct inode *inode);
+extern void ext4_fc_track_range(handle_t *handle, struct inode *inode,
+				ext4_lblk_t lblk, ext4_lblk_t len);
+extern void ext4_fc_del(struct inode *inode);
+extern int ext4_fc_commit(struct super_block *sb, tid_t commit_tid);
+
 /* mballoc.c */
 extern const struct file_operations ext4_seq_mb_groups_fops;
 extern long ext4_mb_stats;
@@ -2559,6 +2604,8 @@ extern int ext4_generic_delete_entry(handle_t *handle,
 				     int buf_size,
 				     int csum_size);
 extern bool ext4_empty_dir(struct inode *inode);
+extern void ext4_update_pardirops(struct inode *dir);
+extern void __init ext4_init_dirops(void);
 
 /* resize.c */
 extern int ext4_group_add(struct super_block *sb,
@@ -2890,7 +2937,12 @@ struct ext4_group_info {
 	ext4_grpblk_t	bb_free;	/* total free blocks */
 	ext4_grpblk_t	bb_fragments;	/* nr of freespace fragments */
 	ext4_grpblk_t	bb_largest_free_order;/* order of largest frag in BG */
+	ext4_grpblk_t	bb_avg_fragment_size_order;	/* order of average
+							   fragment in BG */
+	ext4_group_t	bb_group;	/* group number */
 	struct          list_head bb_prealloc_list;
+	struct		list_head bb_largest_free_order_node;
+	struct		list_head bb_avg_fragment_size_node;
 #ifdef DOUBLE_CHECK
 	void            *bb_bitmap;
 #endif
@@ -64,10 +64,23 @@ static int ext4_journal_check_start(struct super_block *sb)
 	return 0;
 }
 
+/*
+ * Only the changes of these handles can be fast committed, the transactions
+ * with other handles need a full commit.
+ */
+static void ext4_fc_check_handle(struct super_block *sb, handle_t *handle,
+				 int type)
+{
+	if (type != EXT4_HT_WRITE_PAGE && type != EXT4_HT_MAP_BLOCKS &&
+	    type != EXT4_HT_DIRTY_INODE)
+		ext4_fc_mark_ineligible(sb, handle);
+}
+
 handle_t *__ext4_journal_start_sb(struct super_block *sb, unsigned int line,
 				  int type, int blocks, int rsv_blocks)
 {
 	journal_t *journal;
+	handle_t *handle;
 	int err;
 
 	trace_ext4_journal_start(sb, blocks, rsv_blocks, _RET_IP_);
@@ -78,8 +91,11 @@ handle_t *__ext4_journal_start_sb(struct super_block *sb, unsigned int line,
 	journal = EXT4_SB(sb)->s_journal;
 	if (!journal)
 		return ext4_get_nojournal();
-	return jbd2__journal_start(journal, blocks, rsv_blocks, GFP_NOFS,
-				   type, line);
+	handle = jbd2__journal_start(journal, blocks, rsv_blocks, GFP_NOFS,
+				     type, line);
+	if (!IS_ERR(handle))
+		ext4_fc_check_handle(sb, handle, type);
+	return handle;
 }
 
 int __ext4_journal_stop(const char *where, unsigned int line, handle_t *handle)
@@ -130,6 +146,7 @@ handle_t *__ext4_journal_start_reserved(handle_t *handle, unsigned int line,
 	err = jbd2_journal_start_reserved(handle, type, line);
 	if (err < 0)
 		return ERR_PTR(err);
+	ext4_fc_check_handle(sb, handle, type);
 	return handle;
 }
 
@@ -4032,6 +4032,11 @@ ext4_ext_handle_unwritten_extents(handle_t *handle, struct inode *inode,
 	trace_ext4_ext_handle_unwritten_extents(inode, map, flags,
 						    allocated, newblock);
 
+	/* Fast commits only log the blocks newly mapped */
+	if (flags & (EXT4_GET_BLOCKS_CREATE | EXT4_GET_BLOCKS_CONVERT |
+		     EXT4_GET_BLOCKS_CONVERT_UNWRITTEN))
+		ext4_fc_mark_ineligible(inode->i_sb, handle);
+
 	/* get_block() before submit the IO, split the extent */
 	if (flags & EXT4_GET_BLOCKS_PRE_IO) {
 		ret = ext4_split_convert_extents(handle, inode, map, ppath,
@@ -0,0 +1,767 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * fs/ext4/fast_commit.c
+ *
+ * Fast commits: an fsync() logs the size, the times and the newly mapped
+ * blocks of the inodes changed in the running transaction, in a few blocks
+ * of the fast commit area of the journal, instead of waiting for the full
+ * commit of the transaction.  They are replayed at mount, after the
+ * recovery of the journal.
+ *
+ * Only the transactions whose handles are of the types doing these changes
+ * (writeback, block allocation, inode dirtying) can be fast committed, for
+ * regular files with extents.  Anything else, like the directory
+ * operations, truncates, extent conversions or attribute changes, makes the
+ * transaction ineligible: its fsyncs wait for the full commit as before.
+ */
+
+#include <linux/crc32.h>
+#include <linux/quotaops.h>
+#include <linux/writeback.h>
+#include "ext4.h"
+#include "ext4_jbd2.h"
+#include "ext4_extents.h"
+#include "fast_commit.h"
+
+static bool ext4_fc_active(struct super_block *sb)
+{
+	journal_t *journal = EXT4_SB(sb)->s_journal;
+
+	return test_opt(sb, FAST_COMMIT) && journal && journal->j_fc_wbuf;
+}
+
+static bool ext4_fc_inode_ok(struct inode *inode)
+{
+	return S_ISREG(inode->i_mode) &&
+	       ext4_test_inode_flag(inode, EXT4_INODE_EXTENTS) &&
+	       !ext4_has_inline_data(inode) &&
+	       !ext4_should_journal_data(inode);
+}
+
+/**
+ * ext4_fc_mark_ineligible() - Require a full commit
+ * @sb: the filesystem
+ * @handle: the handle doing changes that the fast commits don't log, or
+ *	NULL for the running transaction
+ */
+void ext4_fc_mark_ineligible(struct super_block *sb, handle_t *handle)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	journal_t *journal = sbi->s_journal;
+	tid_t tid;
+
+	if (!ext4_fc_active(sb))
+		return;
+
+	if (handle && ext4_handle_valid(handle)) {
+		tid = handle->h_transaction->t_tid;
+	} else {
+		read_lock(&journal->j_state_lock);
+		tid = journal->j_running_transaction ?
+			journal->j_running_transaction->t_tid :
+			journal->j_transaction_sequence;
+		read_unlock(&journal->j_state_lock);
+	}
+
+	spin_lock(&sbi->s_fc_lock);
+	if (tid_gt(tid, sbi->s_fc_ineligible_tid))
+		sbi->s_fc_ineligible_tid = tid;
+	spin_unlock(&sbi->s_fc_lock);
+}
+
+/* Queues the inode for the fast commits of transaction tid */
+static void ext4_fc_queue(struct ext4_sb_info *sbi, struct ext4_inode_info *ei,
+			  tid_t tid)
+{
+	assert_spin_locked(&sbi->s_fc_lock);
+
+	if (list_empty(&ei->i_fc_list)) {
+		list_add_tail(&ei->i_fc_list, &sbi->s_fc_q);
+		ei->i_fc_tid = tid;
+		ei->i_fc_lblk_len = 0;
+	} else if (ei->i_fc_tid != tid) {
+		/* The previous transaction is being committed */
+		ei->i_fc_tid = tid;
+		ei->i_fc_lblk_len = 0;
+	}
+	ei->i_fc_dirty = true;
+}
+
+/**
+ * ext4_fc_track_inode() - Track the changes to an inode
+ * @handle: the handle changing it
+ * @inode: the inode
+ *
+ * Called when the inode is dirtied, to log its size and times.
+ */
+void ext4_fc_track_inode(handle_t *handle, struct inode *inode)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
+
+	if (!ext4_fc_active(inode->i_sb) || !ext4_handle_valid(handle))
+		return;
+	if (!ext4_fc_inode_ok(inode)) {
+		ext4_fc_mark_ineligible(inode->i_sb, handle);
+		return;
+	}
+
+	spin_lock(&sbi->s_fc_lock);
+	ext4_fc_queue(sbi, EXT4_I(inode), handle->h_transaction->t_tid);
+	spin_unlock(&sbi->s_fc_lock);
+}
+
+/**
+ * ext4_fc_track_range() - Track the blocks mapped to an inode
+ * @handle: the handle mapping them
+ * @inode: the inode
+ * @lblk: the first logical block mapped
+ * @len: the number of blocks
+ */
+void ext4_fc_track_range(handle_t *handle, struct inode *inode,
+			 ext4_lblk_t lblk, ext4_lblk_t len)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	ext4_lblk_t end;
+
+	if (!ext4_fc_active(inode->i_sb) || !ext4_handle_valid(handle))
+		return;
+	if (!ext4_fc_inode_ok(inode)) {
+		ext4_fc_mark_ineligible(inode->i_sb, handle);
+		return;
+	}
+
+	spin_lock(&sbi->s_fc_lock);
+	ext4_fc_queue(sbi, ei, handle->h_transaction->t_tid);
+	if (!ei->i_fc_lblk_len) {
+		ei->i_fc_lblk_start = lblk;
+		ei->i_fc_lblk_len = len;
+	} else {
+		end = max(ei->i_fc_lblk_start + ei->i_fc_lblk_len, lblk + len);
+		ei->i_fc_lblk_start = min(ei->i_fc_lblk_start, lblk);
+		ei->i_fc_lblk_len = end - ei->i_fc_lblk_start;
+	}
+	spin_unlock(&sbi->s_fc_lock);
+}
+
+/**
+ * ext4_fc_del() - Stop tracking an inode
+ * @inode: the inode being evicted
+ *
+ * Waits for the fast commit logging it.
+ */
+void ext4_fc_del(struct inode *inode)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
+	struct ext4_inode_info *ei = EXT4_I(inode);
+
+	if (!test_opt(inode->i_sb, FAST_COMMIT))
+		return;
+
+	spin_lock(&sbi->s_fc_lock);
+	while (ext4_test_inode_state(inode, EXT4_STATE_FC_COMMITTING)) {
+		DEFINE_WAIT(wait);
+
+		prepare_to_wait(&sbi->s_fc_wait, &wait, TASK_UNINTERRUPTIBLE);
+		spin_unlock(&sbi->s_fc_lock);
+		schedule();
+		finish_wait(&sbi->s_fc_wait, &wait);
+		spin_lock(&sbi->s_fc_lock);
+	}
+	list_del_init(&ei->i_fc_list);
+	spin_unlock(&sbi->s_fc_lock);
+}
+
+/* Called by jbd2 at the end of the full commit of transaction tid */
+static void ext4_fc_cleanup(journal_t *journal, tid_t tid)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(journal->j_private);
+	struct ext4_inode_info *ei, *n;
+
+	spin_lock(&sbi->s_fc_lock);
+	list_for_each_entry_safe(ei, n, &sbi->s_fc_q, i_fc_list) {
+		if (tid_geq(tid, ei->i_fc_tid)) {
+			list_del_init(&ei->i_fc_list);
+			ei->i_fc_lblk_len = 0;
+			ei->i_fc_dirty = false;
+		}
+	}
+	spin_unlock(&sbi->s_fc_lock);
+}
+
+static struct ext4_fc_head *ext4_fc_block_head(struct buffer_head *bh)
+{
+	return (struct ext4_fc_head *)(bh->b_data + sizeof(journal_header_t));
+}
+
+static u32 ext4_fc_block_csum(struct super_block *sb, struct buffer_head *bh)
+{
+	struct ext4_fc_head *head = ext4_fc_block_head(bh);
+	u32 crc;
+
+	crc = crc32_le(~0, EXT4_SB(sb)->s_es->s_uuid,
+		       sizeof(EXT4_SB(sb)->s_es->s_uuid));
+	crc = crc32_le(crc, (u8 *)head, offsetof(struct ext4_fc_head, fh_crc));
+	return crc32_le(crc, bh->b_data + EXT4_FC_DATA_OFFSET,
+			sb->s_blocksize - EXT4_FC_DATA_OFFSET);
+}
+
+/* The block being filled by a fast commit */
+struct ext4_fc_writer {
+	journal_t *journal;
+	struct buffer_head *bh;
+	unsigned int off;
+	unsigned int nr;
+};
+
+static void ext4_fc_close_block(struct super_block *sb,
+				struct ext4_fc_writer *wr, bool tail)
+{
+	struct ext4_fc_head *head = ext4_fc_block_head(wr->bh);
+
+	head->fh_flags = cpu_to_le16(tail ? EXT4_FC_HEAD_TAIL : 0);
+	head->fh_nr = cpu_to_le16(wr->nr);
+	head->fh_crc = cpu_to_le32(ext4_fc_block_csum(sb, wr->bh));
+	wr->bh = NULL;
+}
+
+/* Returns the payload of a new record, in the fast commit blocks */
+static void *ext4_fc_reserve(struct super_block *sb, struct ext4_fc_writer *wr,
+			     u16 tag, u16 len)
+{
+	struct ext4_fc_tl *tl;
+	int ret;
+
+	if (wr->bh && wr->off + sizeof(*tl) + len > sb->s_blocksize)
+		ext4_fc_close_block(sb, wr, false);
+	if (!wr->bh) {
+		ret = jbd2_fc_get_buf(wr->journal, &wr->bh);
+		if (ret)
+			return ERR_PTR(ret);
+		wr->off = EXT4_FC_DATA_OFFSET;
+		wr->nr = 0;
+	}
+
+	tl = (struct ext4_fc_tl *)(wr->bh->b_data + wr->off);
+	tl->fc_tag = cpu_to_le16(tag);
+	tl->fc_len = cpu_to_le16(len);
+	wr->off += sizeof(*tl) + len;
+	wr->nr++;
+	return tl + 1;
+}
+
+/*
+ * Writes the data of the blocks mapped in the transaction, as the ordered
+ * mode does at commit time: the pages left to write are mapped already, so
+ * ->writepage() doesn't need a handle.
+ */
+static int ext4_fc_write_data(struct inode *inode, ext4_lblk_t lblk,
+			      ext4_lblk_t len)
+{
+	struct address_space *mapping = inode->i_mapping;
+	loff_t start = (loff_t)lblk << inode->i_blkbits;
+	loff_t end = ((loff_t)(lblk + len) << inode->i_blkbits) - 1;
+	struct writeback_control wbc = {
+		.sync_mode = WB_SYNC_ALL,
+		.nr_to_write = mapping->nrpages * 2,
+		.range_start = start,
+		.range_end = end,
+	};
+	int ret;
+
+	ret = generic_writepages(mapping, &wbc);
+	if (!ret)
+		ret = filemap_fdatawait_range(mapping, start, end);
+	return ret;
+}
+
+static int ext4_fc_write_inode(struct super_block *sb,
+			       struct ext4_fc_writer *wr, struct inode *inode)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct ext4_map_blocks map;
+	struct ext4_fc_range *fr;
+	struct ext4_fc_inode *fi;
+	ext4_lblk_t lblk, len;
+	int ret;
+
+	spin_lock(&sbi->s_fc_lock);
+	lblk = ei->i_fc_lblk_start;
+	len = ei->i_fc_lblk_len;
+	ei->i_fc_dirty = false;
+	spin_unlock(&sbi->s_fc_lock);
+
+	if (len) {
+		ret = ext4_fc_write_data(inode, lblk, len);
+		if (ret)
+			return ret;
+	}
+
+	/* The current mapping of the blocks mapped in the transaction */
+	while (len) {
+		map.m_lblk = lblk;
+		map.m_len = len;
+		map.m_flags = 0;
+		ret = ext4_map_blocks(NULL, inode, &map, 0);
+		if (ret < 0)
+			return ret;
+		if (!map.m_len)
+			break;
+		if (ret > 0) {
+			fr = ext4_fc_reserve(sb, wr, EXT4_FC_TAG_RANGE,
+					     sizeof(*fr));
+			if (IS_ERR(fr))
+				return PTR_ERR(fr);
+			fr->fc_ino = cpu_to_le32(inode->i_ino);
+			fr->fc_lblk = cpu_to_le32(map.m_lblk);
+			fr->fc_len = cpu_to_le32(map.m_len);
+			fr->fc_flags = cpu_to_le32(map.m_flags &
+						   EXT4_MAP_UNWRITTEN ?
+						   EXT4_FC_RANGE_UNWRITTEN : 0);
+			fr->fc_pblk = cpu_to_le64(map.m_pblk);
+		}
+		lblk += map.m_len;
+		len -= map.m_len;
+	}
+
+	fi = ext4_fc_reserve(sb, wr, EXT4_FC_TAG_INODE, sizeof(*fi));
+	if (IS_ERR(fi))
+		return PTR_ERR(fi);
+	fi->fc_ino = cpu_to_le32(inode->i_ino);
+	fi->fc_size = cpu_to_le64(ei->i_disksize);
+	fi->fc_atime = cpu_to_le64(inode->i_atime.tv_sec);
+	fi->fc_mtime = cpu_to_le64(inode->i_mtime.tv_sec);
+	fi->fc_ctime = cpu_to_le64(inode->i_ctime.tv_sec);
+	fi->fc_atime_nsec = cpu_to_le32(inode->i_atime.tv_nsec);
+	fi->fc_mtime_nsec = cpu_to_le32(inode->i_mtime.tv_nsec);
+	fi->fc_ctime_nsec = cpu_to_le32(inode->i_ctime.tv_nsec);
+	return 0;
+}
+
+/**
+ * ext4_fc_commit() - Fast commit a transaction
+ * @sb: the filesystem
+ * @commit_tid: the running transaction, to be made stable
+ *
+ * Logs the inodes changed in @commit_tid since the previous fast commit.
+ * Returns 0 once they are stable, with the cache of the device flushed,
+ * -EAGAIN if the caller must wait for the full commit of @commit_tid
+ * instead, or another error.
+ */
+int ext4_fc_commit(struct super_block *sb, tid_t commit_tid)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	journal_t *journal = sbi->s_journal;
+	struct ext4_fc_writer wr = { .journal = journal };
+	struct ext4_inode_info *ei;
+	bool ineligible;
+	int ret = 0, nr = 0;
+
+	if (!ext4_fc_active(sb))
+		return -EAGAIN;
+	if (jbd2_fc_begin_commit(journal, commit_tid))
+		return -EAGAIN;
+
+	/*
+	 * Without handles running the inodes are consistent, and none is
+	 * queued meanwhile.  The evictions wait for EXT4_STATE_FC_COMMITTING.
+	 */
+	jbd2_journal_lock_updates(journal);
+	spin_lock(&sbi->s_fc_lock);
+	ineligible = tid_geq(sbi->s_fc_ineligible_tid, commit_tid);
+	if (!ineligible)
+		list_for_each_entry(ei, &sbi->s_fc_q, i_fc_list)
+			ext4_set_inode_state(&ei->vfs_inode,
+					     EXT4_STATE_FC_COMMITTING);
+	spin_unlock(&sbi->s_fc_lock);
+	if (ineligible) {
+		jbd2_journal_unlock_updates(journal);
+		jbd2_fc_end_commit_fallback(journal);
+		return -EAGAIN;
+	}
+
+	list_for_each_entry(ei, &sbi->s_fc_q, i_fc_list) {
+		if (!ei->i_fc_dirty)
+			continue;
+		ret = ext4_fc_write_inode(sb, &wr, &ei->vfs_inode);
+		if (ret)
+			break;
+		nr++;
+	}
+	if (!ret && wr.bh)
+		ext4_fc_close_block(sb, &wr, true);
+	jbd2_journal_unlock_updates(journal);
+
+	if (!ret)
+		ret = jbd2_fc_write_bufs(journal);
+
+	spin_lock(&sbi->s_fc_lock);
+	list_for_each_entry(ei, &sbi->s_fc_q, i_fc_list) {
+		if (!ext4_test_inode_state(&ei->vfs_inode,
+					   EXT4_STATE_FC_COMMITTING))
+			continue;
+		ext4_clear_inode_state(&ei->vfs_inode,
+				       EXT4_STATE_FC_COMMITTING);
+		/* For the full commit, in case of a fallback */
+		if (ret)
+			ei->i_fc_dirty = true;
+	}
+	spin_unlock(&sbi->s_fc_lock);
+	wake_up_all(&sbi->s_fc_wait);
+
+	if (ret) {
+		jbd2_fc_end_commit_fallback(journal);
+		return -EAGAIN;
+	}
+	jbd2_fc_end_commit(journal);
+
+	/* Nothing new since the last fast commit, but the data */
+	if (!nr && (journal->j_flags & JBD2_BARRIER))
+		ret = blkdev_issue_flush(sb->s_bdev, GFP_KERNEL, NULL);
+	return ret;
+}
+
+/**
+ * ext4_fc_init() - Set up the fast commits
+ * @sb: the filesystem, mounted read-write with fast_commit
+ *
+ * The fast commit area is created in the journal the first time.  The fast
+ * commits are disabled if they can't be used.
+ */
+void ext4_fc_init(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	journal_t *journal = sbi->s_journal;
+	int err = 0;
+
+	if (!test_opt(sb, FAST_COMMIT) || sb_rdonly(sb) ||
+	    (journal && journal->j_fc_wbuf))
+		return;
+
+	if (!journal || ext4_has_feature_bigalloc(sb) ||
+	    test_opt(sb, DATA_FLAGS) == EXT4_MOUNT_JOURNAL_DATA) {
+		ext4_msg(sb, KERN_WARNING, "fast commits need a journal, "
+			 "no bigalloc and no data=journal, disabled");
+		clear_opt(sb, FAST_COMMIT);
+		return;
+	}
+
+	/* The fast commit area is taken out of an empty journal */
+	if (!jbd2_has_feature_fast_commit(journal))
+		err = jbd2_journal_flush(journal);
+	if (!err)
+		err = jbd2_fc_init(journal, JBD2_DEFAULT_FC_BLOCKS);
+	if (err) {
+		ext4_msg(sb, KERN_WARNING,
+			 "can't set up fast commits (%d), disabled", err);
+		clear_opt(sb, FAST_COMMIT);
+		return;
+	}
+
+	journal->j_fc_cleanup_callback = ext4_fc_cleanup;
+	/* The changes done before are not tracked */
+	sbi->s_fc_ineligible_tid = journal->j_transaction_sequence - 1;
+	ext4_fc_mark_ineligible(sb, NULL);
+}
+
+static struct inode *ext4_fc_iget(struct super_block *sb, unsigned long ino)
+{
+	struct inode *inode;
+
+	if (ino < EXT4_FIRST_INO(sb))
+		return NULL;
+	/* It may have been deleted since, by the journal */
+	inode = ext4_iget(sb, ino);
+	if (IS_ERR(inode))
+		return NULL;
+	if (!ext4_fc_inode_ok(inode)) {
+		iput(inode);
+		return NULL;
+	}
+	return inode;
+}
+
+static int ext4_fc_replay_inode(struct super_block *sb,
+				struct ext4_fc_inode *fi)
+{
+	struct inode *inode;
+	handle_t *handle;
+	int ret, err;
+
+	inode = ext4_fc_iget(sb, le32_to_cpu(fi->fc_ino));
+	if (!inode)
+		return 0;
+
+	handle = ext4_journal_start(inode, EXT4_HT_INODE, 1);
+	if (IS_ERR(handle)) {
+		iput(inode);
+		return PTR_ERR(handle);
+	}
+	inode->i_atime.tv_sec = le64_to_cpu(fi->fc_atime);
+	inode->i_mtime.tv_sec = le64_to_cpu(fi->fc_mtime);
+	inode->i_ctime.tv_sec = le64_to_cpu(fi->fc_ctime);
+	inode->i_atime.tv_nsec = le32_to_cpu(fi->fc_atime_nsec);
+	inode->i_mtime.tv_nsec = le32_to_cpu(fi->fc_mtime_nsec);
+	inode->i_ctime.tv_nsec = le32_to_cpu(fi->fc_ctime_nsec);
+	i_size_write(inode, le64_to_cpu(fi->fc_size));
+	EXT4_I(inode)->i_disksize = inode->i_size;
+	ret = ext4_mark_inode_dirty(handle, inode);
+	err = ext4_journal_stop(handle);
+	iput(inode);
+	return ret ? ret : err;
+}
+
+/* Allocates exactly the blocks [pblk, pblk + len) */
+static int ext4_fc_claim_blocks(handle_t *handle, struct inode *inode,
+				ext4_lblk_t lblk, ext4_fsblk_t pblk,
+				unsigned int len)
+{
+	struct ext4_allocation_request ar = {
+		.inode = inode,
+		.logical = lblk,
+		.goal = pblk,
+		.len = len,
+		.flags = EXT4_MB_HINT_DATA | EXT4_MB_HINT_GOAL_ONLY |
+			 EXT4_MB_HINT_TRY_GOAL | EXT4_MB_HINT_NOPREALLOC |
+			 EXT4_MB_USE_ROOT_BLOCKS,
+	};
+	ext4_fsblk_t block;
+	int err = 0;
+
+	block = ext4_mb_new_blocks(handle, &ar, &err);
+	if (err)
+		return err;
+	if (block != pblk || ar.len != len) {
+		ext4_free_blocks(handle, inode, NULL, block, ar.len, 0);
+		return -EBUSY;
+	}
+	return 0;
+}
+
+/*
+ * Maps the blocks [lblk, lblk + len) of the inode to pblk, up to the next
+ * mapped block.  Returns the number of blocks done, the blocks already
+ * mapped by the journal or by a previous record are skipped.
+ */
+static int ext4_fc_replay_extent(handle_t *handle, struct inode *inode,
+				 ext4_lblk_t lblk, ext4_fsblk_t pblk,
+				 unsigned int len, bool unwritten)
+{
+	struct ext4_ext_path *path;
+	struct ext4_extent *ex, newex;
+	ext4_lblk_t ee_block = 0, next;
+	unsigned int ee_len;
+	int ret;
+
+	down_write(&EXT4_I(inode)->i_data_sem);
+	path = ext4_find_extent(inode, lblk, NULL, 0);
+	if (IS_ERR(path)) {
+		up_write(&EXT4_I(inode)->i_data_sem);
+		return PTR_ERR(path);
+	}
+
+	ex = path[path->p_depth].p_ext;
+	if (ex) {
+		ee_block = le32_to_cpu(ex->ee_block);
+		ee_len = ext4_ext_get_actual_len(ex);
+		if (lblk >= ee_block && lblk < ee_block + ee_len) {
+			ret = min_t(unsigned int, len,
+				    ee_block + ee_len - lblk);
+			goto out;
+		}
+	}
+	if (ex && ee_block > lblk)
+		next = ee_block;
+	else
+		next = ext4_ext_next_allocated_block(path);
+	len = min_t(unsigned int, len, next - lblk);
+
+	ret = ext4_fc_claim_blocks(handle, inode, lblk, pblk, len);
+	if (ret) {
+		ext4_warning(inode->i_sb, "inode %lu: blocks %llu-%llu "
+			     "of a fast commit not free (%d), skipped",
+			     inode->i_ino, pblk, pblk + len - 1, ret);
+		ret = len;
+		goto out;
+	}
+
+	newex.ee_block = cpu_to_le32(lblk);
+	ext4_ext_store_pblock(&newex, pblk);
+	newex.ee_len = cpu_to_le16(len);
+	if (unwritten)
+		ext4_ext_mark_unwritten(&newex);
+	ret = ext4_ext_insert_extent(handle, inode, &path, &newex, 0);
+	if (ret) {
+		ext4_free_blocks(handle, inode, NULL, pblk, len, 0);
+		goto out;
+	}
+	ext4_es_remove_extent(inode, lblk, len);
+	ret = len;
+out:
+	ext4_ext_drop_refs(path);
+	kfree(path);
+	up_write(&EXT4_I(inode)->i_data_sem);
+	return ret;
+}
+
+static int ext4_fc_replay_range(struct super_block *sb,
+				struct ext4_fc_range *fr)
+{
+	ext4_lblk_t lblk = le32_to_cpu(fr->fc_lblk);
+	ext4_fsblk_t pblk = le64_to_cpu(fr->fc_pblk);
+	unsigned int len = le32_to_cpu(fr->fc_len);
+	bool unwritten = le32_to_cpu(fr->fc_flags) & EXT4_FC_RANGE_UNWRITTEN;
+	ext4_grpblk_t offset;
+	ext4_group_t group;
+	struct inode *inode;
+	handle_t *handle;
+	unsigned int n;
+	int ret = 0, err;
+
+	if (!len || len > EXT_MAX_BLOCKS - lblk ||
+	    !ext4_data_block_valid(EXT4_SB(sb), pblk, len))
+		return 0;
+	inode = ext4_fc_iget(sb, le32_to_cpu(fr->fc_ino));
+	if (!inode)
+		return 0;
+	dquot_initialize(inode);
+
+	while (len) {
+		/* An extent of a single group */
+		ext4_get_group_no_and_offset(sb, pblk, &group, &offset);
+		n = min_t(unsigned int, len,
+			  EXT4_BLOCKS_PER_GROUP(sb) - offset);
+		n = min_t(unsigned int, n, unwritten ? EXT_UNWRITTEN_MAX_LEN :
+						       EXT_INIT_MAX_LEN);
+
+		handle = ext4_journal_start(inode, EXT4_HT_MAP_BLOCKS,
+					    ext4_chunk_trans_blocks(inode, n));
+		if (IS_ERR(handle)) {
+			ret = PTR_ERR(handle);
+			break;
+		}
+		ret = ext4_fc_replay_extent(handle, inode, lblk, pblk, n,
+					    unwritten);
+		if (ret > 0)
+			ext4_mark_inode_dirty(handle, inode);
+		err = ext4_journal_stop(handle);
+		if (ret < 0)
+			break;
+		if (err) {
+			ret = err;
+			break;
+		}
+		lblk += ret;
+		pblk += ret;
+		len -= ret;
+	}
+	iput(inode);
+	return ret < 0 ? ret : 0;
+}
+
+/* Returns whether the block is intact, and in *tail if it ends a commit */
+static bool ext4_fc_block_valid(struct super_block *sb, struct buffer_head *bh,
+				bool *tail)
+{
+	struct ext4_fc_head *head = ext4_fc_block_head(bh);
+
+	if (le32_to_cpu(head->fh_crc) != ext4_fc_block_csum(sb, bh))
+		return false;
+	*tail = head->fh_flags & cpu_to_le16(EXT4_FC_HEAD_TAIL);
+	return true;
+}
+
+static int ext4_fc_replay_block(struct super_block *sb, struct buffer_head *bh,
+				int *nr)
+{
+	unsigned int i, len, off = EXT4_FC_DATA_OFFSET;
+	struct ext4_fc_head *head = ext4_fc_block_head(bh);
+	struct ext4_fc_tl *tl;
+	void *payload;
+	int ret = 0;
+
+	for (i = 0; i < le16_to_cpu(head->fh_nr) && !ret; i++) {
+		if (off + sizeof(*tl) > sb->s_blocksize)
+			break;
+		tl = (struct ext4_fc_tl *)(bh->b_data + off);
+		len = le16_to_cpu(tl->fc_len);
+		payload = tl + 1;
+		if (off + sizeof(*tl) + len > sb->s_blocksize)
+			break;
+
+		switch (le16_to_cpu(tl->fc_tag)) {
+		case EXT4_FC_TAG_INODE:
+			if (len >= sizeof(struct ext4_fc_inode))
+				ret = ext4_fc_replay_inode(sb, payload);
+			break;
+		case EXT4_FC_TAG_RANGE:
+			if (len >= sizeof(struct ext4_fc_range))
+				ret = ext4_fc_replay_range(sb, payload);
+			break;
+		}
+		off += sizeof(*tl) + len;
+		(*nr)++;
+	}
+	return ret;
+}
+
+/**
+ * ext4_fc_replay() - Replay the fast commits found by the journal recovery
+ * @sb: the filesystem being mounted
+ *
+ * The records are replayed in order, up to the last valid tail block, so
+ * the last one of each inode wins.  The replay is then flushed and the
+ * fast commits invalidated.
+ */
+void ext4_fc_replay(struct super_block *sb)
+{
+	journal_t *journal = EXT4_SB(sb)->s_journal;
+	unsigned int s_flags = sb->s_flags;
+	unsigned long off, nblks = 0;
+	struct buffer_head *bh;
+	int ret = 0, nr = 0;
+	bool valid, tail;
+
+	if (!journal || !journal->j_fc_replay_blocks)
+		return;
+	if (bdev_read_only(sb->s_bdev)) {
+		ext4_msg(sb, KERN_ERR, "write access unavailable, "
+			 "skipping fast commit replay");
+		return;
+	}
+
+	for (off = 0; (bh = jbd2_fc_read_block(journal, off)); off++) {
+		valid = ext4_fc_block_valid(sb, bh, &tail);
+		brelse(bh);
+		if (!valid)
+			break;
+		if (tail)
+			nblks = off + 1;
+	}
+
+	if (s_flags & MS_RDONLY) {
+		ext4_msg(sb, KERN_INFO, "fast commit replay on readonly fs");
+		sb->s_flags &= ~MS_RDONLY;
+	}
+	for (off = 0; off < nblks && !ret; off++) {
+		bh = jbd2_fc_read_block(journal, off);
+		if (!bh) {
+			ret = -EIO;
+			break;
+		}
+		ret = ext4_fc_replay_block(sb, bh, &nr);
+		brelse(bh);
+	}
+	if (!ret)
+		ret = jbd2_journal_flush(journal);
+	if (!ret)
+		ret = jbd2_fc_replay_done(journal);
+	sb->s_flags = s_flags; /* Restore MS_RDONLY status */
+
+	if (ret)
+		ext4_msg(sb, KERN_ERR, "fast commit replay failed (%d)", ret);
+	else if (nr)
+		ext4_msg(sb, KERN_INFO, "%d fast commit record%s replayed",
+			 nr, nr == 1 ? "" : "s");
+}
@@ -0,0 +1,67 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * fs/ext4/fast_commit.h
+ *
+ * On-disk format of the ext4 fast commits.
+ */
+
+#ifndef __FAST_COMMIT_H__
+#define __FAST_COMMIT_H__
+
+/*
+ * A fast commit block starts with the journal_header_t of jbd2 and a
+ * struct ext4_fc_head, followed by fh_nr records, each a struct ext4_fc_tl
+ * and fc_len bytes of payload, a multiple of 8.  fh_crc is the crc32 of the
+ * fs uuid and of the block, but for the journal_header_t and fh_crc.  The
+ * last block of a fast commit has EXT4_FC_HEAD_TAIL set.  All the fields
+ * are little endian.
+ */
+struct ext4_fc_head {
+	__le16 fh_flags;
+	__le16 fh_nr;
+	__le32 fh_crc;
+	__le32 fh_reserved;
+};
+
+#define EXT4_FC_HEAD_TAIL	0x0001
+
+/* Offset of the first record in a block */
+#define EXT4_FC_DATA_OFFSET	(sizeof(journal_header_t) + \
+				 sizeof(struct ext4_fc_head))
+
+struct ext4_fc_tl {
+	__le16 fc_tag;
+	__le16 fc_len;
+	__le32 fc_reserved;
+};
+
+/* Record tags */
+#define EXT4_FC_TAG_INODE	1	/* struct ext4_fc_inode */
+#define EXT4_FC_TAG_RANGE	2	/* struct ext4_fc_range */
+
+/* Size and times of an inode */
+struct ext4_fc_inode {
+	__le32 fc_ino;
+	__le32 fc_reserved;
+	__le64 fc_size;
+	__le64 fc_atime;
+	__le64 fc_mtime;
+	__le64 fc_ctime;
+	__le32 fc_atime_nsec;
+	__le32 fc_mtime_nsec;
+	__le32 fc_ctime_nsec;
+	__le32 fc_reserved2;
+};
+
+/* Blocks mapped to an inode */
+struct ext4_fc_range {
+	__le32 fc_ino;
+	__le32 fc_lblk;
+	__le32 fc_len;
+	__le32 fc_flags;
+	__le64 fc_pblk;
+};
+
+#define EXT4_FC_RANGE_UNWRITTEN	0x0001
+
+#endif /* __FAST_COMMIT_H__ */
@@ -434,7 +434,7 @@ static int ext4_file_open(struct inode * inode, struct file * filp)
 			return ret;
 	}
 
-	filp->f_mode |= FMODE_NOWAIT;
+	filp->f_mode |= FMODE_NOWAIT | FMODE_BUF_RASYNC;
 	return dquot_file_open(inode, filp);
 }
 
@@ -495,7 +495,8 @@ static int ext4_find_unwritten_pgoff(struct inode *inode,
 			 * there is a hole at this offset.
 			 */
 			if (whence == SEEK_HOLE && lastoff < endoff &&
-			    lastoff < page_offset(pvec.pages[i])) {
+			    lastoff < ((loff_t)page_to_pgoff(page) <<
+				       PAGE_SHIFT)) {
 				found = 1;
 				*offset = lastoff;
 				goto out;
@@ -704,6 +704,8 @@ int ext4_map_blocks(handle_t *handle, struct inode *inode,
 
 out_sem:
 	up_write((&EXT4_I(inode)->i_data_sem));
+	if (retval > 0 && map->m_flags & EXT4_MAP_NEW)
+		ext4_fc_track_range(handle, inode, map->m_lblk, map->m_len);
 	if (retval > 0 && map->m_flags & EXT4_MAP_MAPPED) {
 		ret = check_block_validity(inode, map);
 		if (ret != 0)
@@ -3901,6 +3903,16 @@ void ext4_set_aops(struct inode *inode)
 		inode->i_mapping->a_ops = &ext4_da_aops;
 	else
 		inode->i_mapping->a_ops = &ext4_aops;
+
+	/*
+	 * ext4_mpage_readpages() reads huge pages of extent mapped files;
+	 * encrypted and inline data files do not go through it.
+	 */
+	if (S_ISREG(inode->i_mode) && !IS_DAX(inode) &&
+	    ext4_test_inode_flag(inode, EXT4_INODE_EXTENTS) &&
+	    !ext4_encrypted_inode(inode) &&
+	    !ext4_has_feature_inline_data(inode->i_sb))
+		mapping_set_large_pages(inode->i_mapping);
 }
 
 static int __ext4_block_zero_page_range(handle_t *handle,
@@ -4853,6 +4865,7 @@ struct inode *ext4_iget(struct super_block *sb, unsigned long ino)
 	} else if (S_ISDIR(inode->i_mode)) {
 		inode->i_op = &ext4_dir_inode_operations;
 		inode->i_fop = &ext4_dir_operations;
+		ext4_update_pardirops(inode);
 	} else if (S_ISLNK(inode->i_mode)) {
 		if (ext4_encrypted_inode(inode)) {
 			inode->i_op = &ext4_encrypted_symlink_inode_operations;
@@ -5452,6 +5465,8 @@ int ext4_setattr(struct dentry *dentry, struct iattr *attr)
 	if (!error) {
 		setattr_copy(inode, attr);
 		mark_inode_dirty(inode);
+		/* Fast commits don't log the attributes */
+		ext4_fc_mark_ineligible(inode->i_sb, NULL);
 	}
 
 	/*
@@ -5830,6 +5845,7 @@ int ext4_mark_inode_dirty(handle_t *handle, struct inode *inode)
 		ext4_try_to_expand_extra_isize(inode, sbi->s_want_extra_isize,
 					       iloc, handle);
 
+	ext4_fc_track_inode(handle, inode);
 	return ext4_mark_iloc_dirty(handle, inode, &iloc);
 }
 
@@ -5857,7 +5873,7 @@ void ext4_dirty_inode(struct inode *inode, int flags)
 
 	if (flags == I_DIRTY_TIME)
 		return;
-	handle = ext4_journal_start(inode, EXT4_HT_INODE, 2);
+	handle = ext4_journal_start(inode, EXT4_HT_DIRTY_INODE, 2);
 	if (IS_ERR(handle))
 		goto out;
 
@@ -6022,6 +6038,18 @@ int ext4_page_mkwrite(struct vm_fault *vmf)
 	if (ret)
 		goto out_ret;
 
+	/*
+	 * Large pages are only ever read, the page is split for writing and
+	 * the fault retried on the small page.
+	 */
+	if (PageTransCompound(page)) {
+		lock_page(page);
+		split_huge_page(page);
+		unlock_page(page);
+		ret = VM_FAULT_NOPAGE;
+		goto out;
+	}
+
 	/* Delalloc case is easy... */
 	if (test_opt(inode->i_sb, DELALLOC) &&
 	    !ext4_should_journal_data(inode) &&
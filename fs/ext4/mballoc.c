@@ -697,22 +697,93 @@ static void ext4_mb_mark_free_simple(struct super_block *sb,
 
 /*
  * Cache the order of the largest free extent we have available in this block
- * group.
+ * group, and with mb_optimize_scan move the group to the list of that order.
+ * The groups without free blocks are on no list.
  */
 static void
 mb_set_largest_free_order(struct super_block *sb, struct ext4_group_info *grp)
 {
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	bool listed, want;
 	int i;
-	int bits;
-
-	grp->bb_largest_free_order = -1; /* uninit */
 
-	bits = sb->s_blocksize_bits + 1;
-	for (i = bits; i >= 0; i--) {
-		if (grp->bb_counters[i] > 0) {
-			grp->bb_largest_free_order = i;
+	for (i = MB_NUM_ORDERS(sb) - 1; i >= 0; i--)
+		if (grp->bb_counters[i] > 0)
 			break;
-		}
+
+	/* the node is only changed under the group lock, which we hold */
+	listed = !list_empty(&grp->bb_largest_free_order_node);
+	want = i >= 0 && grp->bb_free;
+	if (!test_opt(sb, MB_OPTIMIZE_SCAN) ||
+	    (i == grp->bb_largest_free_order && listed == want)) {
+		grp->bb_largest_free_order = i;
+		return;
+	}
+
+	if (listed) {
+		int old = grp->bb_largest_free_order;
+
+		write_lock(&sbi->s_mb_largest_free_orders_locks[old]);
+		list_del_init(&grp->bb_largest_free_order_node);
+		write_unlock(&sbi->s_mb_largest_free_orders_locks[old]);
+	}
+
+	grp->bb_largest_free_order = i;
+	if (want) {
+		write_lock(&sbi->s_mb_largest_free_orders_locks[i]);
+		list_add_tail(&grp->bb_largest_free_order_node,
+			      &sbi->s_mb_largest_free_orders[i]);
+		write_unlock(&sbi->s_mb_largest_free_orders_locks[i]);
+	}
+}
+
+/*
+ * The groups with an average fragment size of 2^(order+1) to 2^(order+2) - 1
+ * blocks are on the average fragment size list of that order.
+ */
+static int mb_avg_fragment_size_order(struct super_block *sb,
+				      ext4_grpblk_t len)
+{
+	int order = fls(len) - 2;
+
+	if (order < 0)
+		return 0;
+	return min(order, MB_NUM_ORDERS(sb) - 1);
+}
+
+/*
+ * With mb_optimize_scan, move the group to the list of the order of its
+ * average fragment size, or take it off the lists when it's full.
+ */
+static void
+mb_update_avg_fragment_size(struct super_block *sb, struct ext4_group_info *grp)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	int order = -1;
+
+	if (!test_opt(sb, MB_OPTIMIZE_SCAN))
+		return;
+
+	if (grp->bb_free && grp->bb_fragments)
+		order = mb_avg_fragment_size_order(sb,
+					grp->bb_free / grp->bb_fragments);
+	if (order == grp->bb_avg_fragment_size_order)
+		return;
+
+	if (grp->bb_avg_fragment_size_order >= 0) {
+		int old = grp->bb_avg_fragment_size_order;
+
+		write_lock(&sbi->s_mb_avg_fragment_size_locks[old]);
+		list_del_init(&grp->bb_avg_fragment_size_node);
+		write_unlock(&sbi->s_mb_avg_fragment_size_locks[old]);
+	}
+
+	grp->bb_avg_fragment_size_order = order;
+	if (order >= 0) {
+		write_lock(&sbi->s_mb_avg_fragment_size_locks[order]);
+		list_add_tail(&grp->bb_avg_fragment_size_node,
+			      &sbi->s_mb_avg_fragment_size[order]);
+		write_unlock(&sbi->s_mb_avg_fragment_size_locks[order]);
 	}
 }
 
@@ -765,6 +836,7 @@ void ext4_mb_generate_buddy(struct super_block *sb,
 		set_bit(EXT4_GROUP_INFO_BBITMAP_CORRUPT_BIT, &grp->bb_state);
 	}
 	mb_set_largest_free_order(sb, grp);
+	mb_update_avg_fragment_size(sb, grp);
 
 	clear_bit(EXT4_GROUP_INFO_NEED_INIT_BIT, &(grp->bb_state));
 
@@ -1502,6 +1574,7 @@ static void mb_free_blocks(struct inode *inode, struct ext4_buddy *e4b,
 
 done:
 	mb_set_largest_free_order(sb, e4b->bd_info);
+	mb_update_avg_fragment_size(sb, e4b->bd_info);
 	mb_check_buddy(e4b);
 }
 
@@ -1636,6 +1709,7 @@ static int mb_mark_used(struct ext4_buddy *e4b, struct ext4_free_extent *ex)
 		e4b->bd_info->bb_counters[ord]++;
 	}
 	mb_set_largest_free_order(e4b->bd_sb, e4b->bd_info);
+	mb_update_avg_fragment_size(e4b->bd_sb, e4b->bd_info);
 
 	ext4_set_bits(e4b->bd_bitmap, ex->fe_start, len0);
 	mb_check_buddy(e4b);
@@ -2106,11 +2180,106 @@ static int ext4_mb_good_group(struct ext4_allocation_context *ac,
 	return 0;
 }
 
+/*
+ * The groups whose buddy isn't loaded yet are skipped, ext4_mb_good_group()
+ * can't initialize them with a list lock held.
+ */
+static bool ext4_mb_listed_group_ok(struct ext4_allocation_context *ac,
+				    struct ext4_group_info *grp, int cr,
+				    ext4_group_t ngroups)
+{
+	return grp->bb_group < ngroups && !EXT4_MB_GRP_NEED_INIT(grp) &&
+		ext4_mb_good_group(ac, grp->bb_group, cr) > 0;
+}
+
+/*
+ * Picks the first group of the lists from order @order up which fits the
+ * request for criteria @cr.
+ */
+static struct ext4_group_info *
+ext4_mb_pick_from_lists(struct ext4_allocation_context *ac, int cr, int order,
+			ext4_group_t ngroups)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(ac->ac_sb);
+	struct list_head *lists;
+	rwlock_t *locks;
+	struct ext4_group_info *iter;
+	int i;
+
+	if (cr == 0) {
+		lists = sbi->s_mb_largest_free_orders;
+		locks = sbi->s_mb_largest_free_orders_locks;
+	} else {
+		lists = sbi->s_mb_avg_fragment_size;
+		locks = sbi->s_mb_avg_fragment_size_locks;
+	}
+
+	for (i = order; i < MB_NUM_ORDERS(ac->ac_sb); i++) {
+		if (list_empty(&lists[i]))
+			continue;
+
+		read_lock(&locks[i]);
+		if (cr == 0) {
+			list_for_each_entry(iter, &lists[i],
+					    bb_largest_free_order_node)
+				if (ext4_mb_listed_group_ok(ac, iter, cr,
+							    ngroups))
+					goto found;
+		} else {
+			list_for_each_entry(iter, &lists[i],
+					    bb_avg_fragment_size_node)
+				if (ext4_mb_listed_group_ok(ac, iter, cr,
+							    ngroups))
+					goto found;
+		}
+		read_unlock(&locks[i]);
+	}
+	return NULL;
+found:
+	read_unlock(&locks[i]);
+	return iter;
+}
+
+/*
+ * Selects the next group to scan after @group. Without mb_optimize_scan, or
+ * for cr 2 and 3, the groups are walked linearly. Otherwise cr 0 takes a group
+ * whose largest free extent is at least 2^ac_2order, and cr 1 one whose
+ * average fragment size is at least the goal length, from the lists kept up
+ * to date with the buddy data, and @new_cr is moved to the next criteria once
+ * no such group is left.
+ */
+static void ext4_mb_choose_next_group(struct ext4_allocation_context *ac,
+				      int *new_cr, ext4_group_t *group,
+				      ext4_group_t ngroups)
+{
+	struct ext4_group_info *grp = NULL;
+
+	if (test_opt(ac->ac_sb, MB_OPTIMIZE_SCAN) && *new_cr < 2) {
+		if (*new_cr == 0)
+			grp = ext4_mb_pick_from_lists(ac, 0, ac->ac_2order,
+						      ngroups);
+		else
+			grp = ext4_mb_pick_from_lists(ac, 1,
+					mb_avg_fragment_size_order(ac->ac_sb,
+						ac->ac_g_ex.fe_len),
+					ngroups);
+		if (grp)
+			*group = grp->bb_group;
+		else
+			*new_cr += 1;
+		return;
+	}
+
+	*group = *group + 1;
+	if (*group >= ngroups)
+		*group = 0;
+}
+
 static noinline_for_stack int
 ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 {
 	ext4_group_t ngroups, group, i;
-	int cr;
+	int cr, new_cr;
 	int err = 0, first_err = 0;
 	struct ext4_sb_info *sbi;
 	struct super_block *sb;
@@ -2179,9 +2348,14 @@ ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 		 */
 		group = ac->ac_g_ex.fe_group;
 
-		for (i = 0; i < ngroups; group++, i++) {
+		for (i = 0, new_cr = cr; i < ngroups; i++,
+		     ext4_mb_choose_next_group(ac, &new_cr, &group, ngroups)) {
 			int ret = 0;
 			cond_resched();
+			if (new_cr != cr) {
+				cr = new_cr;
+				goto repeat;
+			}
 			/*
 			 * Artificially restricted ngroups for non-extent
 			 * files makes group > ngroups possible on first loop.
@@ -2465,9 +2639,13 @@ int ext4_mb_add_groupinfo(struct super_block *sb, ext4_group_t group,
 	}
 
 	INIT_LIST_HEAD(&meta_group_info[i]->bb_prealloc_list);
+	INIT_LIST_HEAD(&meta_group_info[i]->bb_largest_free_order_node);
+	INIT_LIST_HEAD(&meta_group_info[i]->bb_avg_fragment_size_node);
 	init_rwsem(&meta_group_info[i]->alloc_sem);
 	meta_group_info[i]->bb_free_root = RB_ROOT;
 	meta_group_info[i]->bb_largest_free_order = -1;  /* uninit */
+	meta_group_info[i]->bb_avg_fragment_size_order = -1;
+	meta_group_info[i]->bb_group = group;
 
 #ifdef DOUBLE_CHECK
 	{
@@ -2617,6 +2795,30 @@ int ext4_mb_init(struct super_block *sb)
 		goto out;
 	}
 
+	sbi->s_mb_largest_free_orders =
+		kmalloc_array(MB_NUM_ORDERS(sb), sizeof(struct list_head),
+			      GFP_KERNEL);
+	sbi->s_mb_largest_free_orders_locks =
+		kmalloc_array(MB_NUM_ORDERS(sb), sizeof(rwlock_t), GFP_KERNEL);
+	sbi->s_mb_avg_fragment_size =
+		kmalloc_array(MB_NUM_ORDERS(sb), sizeof(struct list_head),
+			      GFP_KERNEL);
+	sbi->s_mb_avg_fragment_size_locks =
+		kmalloc_array(MB_NUM_ORDERS(sb), sizeof(rwlock_t), GFP_KERNEL);
+	if (!sbi->s_mb_largest_free_orders ||
+	    !sbi->s_mb_largest_free_orders_locks ||
+	    !sbi->s_mb_avg_fragment_size ||
+	    !sbi->s_mb_avg_fragment_size_locks) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	for (i = 0; i < MB_NUM_ORDERS(sb); i++) {
+		INIT_LIST_HEAD(&sbi->s_mb_largest_free_orders[i]);
+		rwlock_init(&sbi->s_mb_largest_free_orders_locks[i]);
+		INIT_LIST_HEAD(&sbi->s_mb_avg_fragment_size[i]);
+		rwlock_init(&sbi->s_mb_avg_fragment_size_locks[i]);
+	}
+
 	ret = ext4_groupinfo_create_slab(sb->s_blocksize);
 	if (ret < 0)
 		goto out;
@@ -2700,6 +2902,14 @@ int ext4_mb_init(struct super_block *sb)
 	free_percpu(sbi->s_locality_groups);
 	sbi->s_locality_groups = NULL;
 out:
+	kfree(sbi->s_mb_largest_free_orders);
+	sbi->s_mb_largest_free_orders = NULL;
+	kfree(sbi->s_mb_largest_free_orders_locks);
+	sbi->s_mb_largest_free_orders_locks = NULL;
+	kfree(sbi->s_mb_avg_fragment_size);
+	sbi->s_mb_avg_fragment_size = NULL;
+	kfree(sbi->s_mb_avg_fragment_size_locks);
+	sbi->s_mb_avg_fragment_size_locks = NULL;
 	kfree(sbi->s_mb_offsets);
 	sbi->s_mb_offsets = NULL;
 	kfree(sbi->s_mb_maxs);
@@ -2752,6 +2962,10 @@ int ext4_mb_release(struct super_block *sb)
 			kfree(sbi->s_group_info[i]);
 		kvfree(sbi->s_group_info);
 	}
+	kfree(sbi->s_mb_largest_free_orders);
+	kfree(sbi->s_mb_largest_free_orders_locks);
+	kfree(sbi->s_mb_avg_fragment_size);
+	kfree(sbi->s_mb_avg_fragment_size_locks);
 	kfree(sbi->s_mb_offsets);
 	kfree(sbi->s_mb_maxs);
 	iput(sbi->s_buddy_cache);
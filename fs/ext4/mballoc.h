@@ -77,6 +77,12 @@ do {									\
  */
 #define MB_DEFAULT_GROUP_PREALLOC	512
 
+/*
+ * Number of buddy orders, also the number of lists groups are sorted in by
+ * their largest free extent and average fragment size for mb_optimize_scan
+ */
+#define MB_NUM_ORDERS(sb)		((sb)->s_blocksize_bits + 2)
+
 
 struct ext4_free_data {
 	/* this links the free block information from sb_info */
@@ -34,6 +34,8 @@
 #include <linux/quotaops.h>
 #include <linux/buffer_head.h>
 #include <linux/bio.h>
+#include <linux/hash.h>
+#include <linux/sched/mm.h>
 #include "ext4.h"
 #include "ext4_jbd2.h"
 
@@ -270,11 +272,14 @@ static int ext4_htree_next_block(struct inode *dir, __u32 hash,
 				 struct dx_frame *frame,
 				 struct dx_frame *frames,
 				 __u32 *start_hash);
+struct ext4_dirop_lock;
 static struct buffer_head * ext4_dx_find_entry(struct inode *dir,
 		struct ext4_filename *fname,
-		struct ext4_dir_entry_2 **res_dir);
+		struct ext4_dir_entry_2 **res_dir,
+		struct ext4_dirop_lock *dl);
 static int ext4_dx_add_entry(handle_t *handle, struct ext4_filename *fname,
-			     struct inode *dir, struct inode *inode);
+			     struct inode *dir, struct inode *inode,
+			     struct ext4_dirop_lock *dl);
 
 /* checksumming functions */
 void initialize_dirent_tail(struct ext4_dir_entry_tail *t,
@@ -882,6 +887,132 @@ static void dx_release(struct dx_frame *frames)
 	}
 }
 
+/*
+ * Parallel directory operations
+ *
+ * The VFS only holds i_rwsem shared for the creates and unlinks in the
+ * directories with S_PARDIROPS, which are the htree directories of the
+ * filesystems mounted with pdirops.  The names are then serialized by the
+ * VFS, and the blocks of the directory by the locks below: i_dirops_sem is
+ * held for reading while a leaf block is searched or changed under its
+ * hashed leaf lock, and for writing to change the index or the size of the
+ * directory.  A task holds one leaf lock at most, so the leaf locks need
+ * no ordering.  The locks rank below the transaction start, so the
+ * allocations under them must not recurse into the filesystem.
+ */
+#define EXT4_DIROP_LEAF_BITS	10
+
+static struct rw_semaphore ext4_dirop_leaves[1 << EXT4_DIROP_LEAF_BITS];
+
+enum {
+	EXT4_DIROP_NONE,	/* i_rwsem is held exclusive */
+	EXT4_DIROP_READ,	/* i_dirops_sem (r), read leaf locks */
+	EXT4_DIROP_WRITE,	/* i_dirops_sem (r), write leaf locks */
+	EXT4_DIROP_EXCL,	/* i_dirops_sem (w) */
+};
+
+struct ext4_dirop_lock {
+	struct inode *dir;
+	struct rw_semaphore *leaf;	/* leaf lock held, if any */
+	int mode;
+	unsigned int nofs_flags;
+};
+
+void __init ext4_init_dirops(void)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(ext4_dirop_leaves); i++)
+		init_rwsem(&ext4_dirop_leaves[i]);
+}
+
+/*
+ * Called on the directories read in and on those which get an index: the
+ * flag is never cleared, the VFS locks the directory as it saw it.
+ */
+void ext4_update_pardirops(struct inode *dir)
+{
+	if (test_opt(dir->i_sb, PDIROPS) && is_dx(dir) && !IS_PARDIROPS(dir))
+		inode_set_flags(dir, S_PARDIROPS, S_PARDIROPS);
+}
+
+static void ext4_dirop_unlock_leaf(struct ext4_dirop_lock *dl)
+{
+	if (!dl->leaf)
+		return;
+	if (dl->mode == EXT4_DIROP_WRITE)
+		up_write(dl->leaf);
+	else
+		up_read(dl->leaf);
+	dl->leaf = NULL;
+}
+
+/* Lock the leaf @block, releasing the one held */
+static void ext4_dirop_lock_leaf(struct ext4_dirop_lock *dl,
+				 ext4_lblk_t block)
+{
+	if (!dl || (dl->mode != EXT4_DIROP_READ &&
+		    dl->mode != EXT4_DIROP_WRITE))
+		return;
+	ext4_dirop_unlock_leaf(dl);
+	dl->leaf = &ext4_dirop_leaves[hash_64(((u64)block << 32) ^
+					(unsigned long)dl->dir,
+					EXT4_DIROP_LEAF_BITS)];
+	if (dl->mode == EXT4_DIROP_WRITE)
+		down_write(dl->leaf);
+	else
+		down_read(dl->leaf);
+}
+
+static void ext4_dirop_unlock_dir(struct ext4_dirop_lock *dl)
+{
+	ext4_dirop_unlock_leaf(dl);
+	if (dl->mode == EXT4_DIROP_NONE)
+		return;
+	if (dl->mode == EXT4_DIROP_EXCL)
+		up_write(&EXT4_I(dl->dir)->i_dirops_sem);
+	else
+		up_read(&EXT4_I(dl->dir)->i_dirops_sem);
+	memalloc_nofs_restore(dl->nofs_flags);
+	dl->mode = EXT4_DIROP_NONE;
+}
+
+/*
+ * Take i_dirops_sem for writing: what was read under the shared lock must
+ * be looked up again.
+ */
+static void ext4_dirop_lock_excl(struct ext4_dirop_lock *dl)
+{
+	if (dl->mode != EXT4_DIROP_READ && dl->mode != EXT4_DIROP_WRITE)
+		return;
+	ext4_dirop_unlock_dir(dl);
+	dl->nofs_flags = memalloc_nofs_save();
+	down_write(&EXT4_I(dl->dir)->i_dirops_sem);
+	dl->mode = EXT4_DIROP_EXCL;
+}
+
+/*
+ * Lock @dir for a lookup, or for a change of its entries with @write.  Only
+ * the leaves of an index are changed in parallel, the other changes of an
+ * S_PARDIROPS directory get it exclusive.
+ */
+static void ext4_dirop_lock_dir(struct ext4_dirop_lock *dl,
+				struct inode *dir, bool write)
+{
+	dl->dir = dir;
+	dl->leaf = NULL;
+	dl->mode = EXT4_DIROP_NONE;
+	if (!IS_PARDIROPS(dir))
+		return;
+
+	dl->nofs_flags = memalloc_nofs_save();
+	down_read(&EXT4_I(dir)->i_dirops_sem);
+	dl->mode = write ? EXT4_DIROP_WRITE : EXT4_DIROP_READ;
+	/* the index is only cleared with i_dirops_sem held for writing */
+	if (write && !is_dx(dir))
+		ext4_dirop_lock_excl(dl);
+}
+
 /*
  * This function increments the frame pointer to search the next leaf
  * block, and reads in the necessary intervening nodes if the search
@@ -1066,6 +1197,7 @@ int ext4_htree_fill_tree(struct file *dir_file, __u32 start_hash,
 	struct dx_hash_info hinfo;
 	struct ext4_dir_entry_2 *de;
 	struct dx_frame frames[EXT4_HTREE_LEVEL], *frame;
+	struct ext4_dirop_lock dl;
 	struct inode *dir;
 	ext4_lblk_t block;
 	int count = 0;
@@ -1076,6 +1208,7 @@ int ext4_htree_fill_tree(struct file *dir_file, __u32 start_hash,
 	dxtrace(printk(KERN_DEBUG "In htree_fill_tree, start hash: %x:%x\n",
 		       start_hash, start_minor_hash));
 	dir = file_inode(dir_file);
+	ext4_dirop_lock_dir(&dl, dir, false);
 	if (!(ext4_test_inode_flag(dir, EXT4_INODE_INDEX))) {
 		hinfo.hash_version = EXT4_SB(dir->i_sb)->s_def_hash_version;
 		if (hinfo.hash_version <= DX_HASH_TEA)
@@ -1090,19 +1223,24 @@ int ext4_htree_fill_tree(struct file *dir_file, __u32 start_hash,
 							&has_inline_data);
 			if (has_inline_data) {
 				*next_hash = ~0;
+				ext4_dirop_unlock_dir(&dl);
 				return count;
 			}
 		}
+		ext4_dirop_lock_leaf(&dl, 0);
 		count = htree_dirblock_to_tree(dir_file, dir, 0, &hinfo,
 					       start_hash, start_minor_hash);
 		*next_hash = ~0;
+		ext4_dirop_unlock_dir(&dl);
 		return count;
 	}
 	hinfo.hash = start_hash;
 	hinfo.minor_hash = 0;
 	frame = dx_probe(NULL, dir, &hinfo, frames);
-	if (IS_ERR(frame))
+	if (IS_ERR(frame)) {
+		ext4_dirop_unlock_dir(&dl);
 		return PTR_ERR(frame);
+	}
 
 	/* Add '.' and '..' from the htree header */
 	if (!start_hash && !start_minor_hash) {
@@ -1134,6 +1272,7 @@ int ext4_htree_fill_tree(struct file *dir_file, __u32 start_hash,
 		}
 		cond_resched();
 		block = dx_get_block(frame->at);
+		ext4_dirop_lock_leaf(&dl, block);
 		ret = htree_dirblock_to_tree(dir_file, dir, block, &hinfo,
 					     start_hash, start_minor_hash);
 		if (ret < 0) {
@@ -1159,11 +1298,13 @@ int ext4_htree_fill_tree(struct file *dir_file, __u32 start_hash,
 			break;
 	}
 	dx_release(frames);
+	ext4_dirop_unlock_dir(&dl);
 	dxtrace(printk(KERN_DEBUG "Fill tree: returned %d entries, "
 		       "next hash: %x\n", count, *next_hash));
 	return count;
 errout:
 	dx_release(frames);
+	ext4_dirop_unlock_dir(&dl);
 	return (err);
 }
 
@@ -1325,7 +1466,7 @@ static int is_dx_internal_node(struct inode *dir, ext4_lblk_t block,
 }
 
 /*
- *	ext4_find_entry()
+ *	__ext4_find_entry()
  *
  * finds an entry in the specified directory with the wanted name. It
  * returns the cache buffer in which the entry was found, and the entry
@@ -1333,12 +1474,14 @@ static int is_dx_internal_node(struct inode *dir, ext4_lblk_t block,
  * entry - you'll have to do that yourself if you want to.
  *
  * The returned buffer_head has ->b_count elevated.  The caller is expected
- * to brelse() it when appropriate.
+ * to brelse() it when appropriate.  With @dl, the lock of the block found
+ * is held until the caller unlocks the directory.
  */
-static struct buffer_head * ext4_find_entry (struct inode *dir,
+static struct buffer_head *__ext4_find_entry(struct inode *dir,
 					const struct qstr *d_name,
 					struct ext4_dir_entry_2 **res_dir,
-					int *inlined)
+					int *inlined,
+					struct ext4_dirop_lock *dl)
 {
 	struct super_block *sb;
 	struct buffer_head *bh_use[NAMEI_RA_SIZE];
@@ -1387,7 +1530,7 @@ static struct buffer_head * ext4_find_entry (struct inode *dir,
 		goto restart;
 	}
 	if (is_dx(dir)) {
-		ret = ext4_dx_find_entry(dir, &fname, res_dir);
+		ret = ext4_dx_find_entry(dir, &fname, res_dir, dl);
 		/*
 		 * On success, or if the error was file not found,
 		 * return.  Otherwise, fall back to doing a search the
@@ -1424,6 +1567,7 @@ static struct buffer_head * ext4_find_entry (struct inode *dir,
 				goto cleanup_and_exit;
 			}
 		}
+		ext4_dirop_lock_leaf(dl, block);
 		if ((bh = bh_use[ra_ptr++]) == NULL)
 			goto next;
 		wait_on_buffer(bh);
@@ -1478,12 +1622,23 @@ static struct buffer_head * ext4_find_entry (struct inode *dir,
 	for (; ra_ptr < ra_max; ra_ptr++)
 		brelse(bh_use[ra_ptr]);
 	ext4_fname_free_filename(&fname);
+	if (dl && IS_ERR_OR_NULL(ret))
+		ext4_dirop_unlock_leaf(dl);
 	return ret;
 }
 
+static struct buffer_head *ext4_find_entry(struct inode *dir,
+					   const struct qstr *d_name,
+					   struct ext4_dir_entry_2 **res_dir,
+					   int *inlined)
+{
+	return __ext4_find_entry(dir, d_name, res_dir, inlined, NULL);
+}
+
 static struct buffer_head * ext4_dx_find_entry(struct inode *dir,
 			struct ext4_filename *fname,
-			struct ext4_dir_entry_2 **res_dir)
+			struct ext4_dir_entry_2 **res_dir,
+			struct ext4_dirop_lock *dl)
 {
 	struct super_block * sb = dir->i_sb;
 	struct dx_frame frames[EXT4_HTREE_LEVEL], *frame;
@@ -1499,6 +1654,7 @@ static struct buffer_head * ext4_dx_find_entry(struct inode *dir,
 		return (struct buffer_head *) frame;
 	do {
 		block = dx_get_block(frame->at);
+		ext4_dirop_lock_leaf(dl, block);
 		bh = ext4_read_dirblock(dir, block, DIRENT);
 		if (IS_ERR(bh))
 			goto errout;
@@ -1539,6 +1695,8 @@ static struct dentry *ext4_lookup(struct inode *dir, struct dentry *dentry, unsi
 	struct inode *inode;
 	struct ext4_dir_entry_2 *de;
 	struct buffer_head *bh;
+	struct ext4_dirop_lock dl;
+	__u32 ino = 0;
 
 	if (ext4_encrypted_inode(dir)) {
 		int res = fscrypt_get_encryption_info(dir);
@@ -1558,12 +1716,15 @@ static struct dentry *ext4_lookup(struct inode *dir, struct dentry *dentry, unsi
        if (dentry->d_name.len > EXT4_NAME_LEN)
 	       return ERR_PTR(-ENAMETOOLONG);
 
-	bh = ext4_find_entry(dir, &dentry->d_name, &de, NULL);
+	ext4_dirop_lock_dir(&dl, dir, false);
+	bh = __ext4_find_entry(dir, &dentry->d_name, &de, NULL, &dl);
+	if (!IS_ERR_OR_NULL(bh))
+		ino = le32_to_cpu(de->inode);
+	ext4_dirop_unlock_dir(&dl);
 	if (IS_ERR(bh))
 		return (struct dentry *) bh;
 	inode = NULL;
 	if (bh) {
-		__u32 ino = le32_to_cpu(de->inode);
 		brelse(bh);
 		if (!ext4_valid_inum(dir->i_sb, ino)) {
 			EXT4_ERROR_INODE(dir, "bad inode number: %u", ino);
@@ -1953,6 +2114,7 @@ static int make_indexed_dir(handle_t *handle, struct ext4_filename *fname,
 		return PTR_ERR(bh2);
 	}
 	ext4_set_inode_flag(dir, EXT4_INODE_INDEX);
+	ext4_update_pardirops(dir);
 	data1 = bh2->b_data;
 
 	memcpy (data1, de, len);
@@ -2040,6 +2202,7 @@ static int ext4_add_entry(handle_t *handle, struct dentry *dentry,
 	struct ext4_dir_entry_tail *t;
 	struct super_block *sb;
 	struct ext4_filename fname;
+	struct ext4_dirop_lock dl;
 	int	retval;
 	int	dx_fallback=0;
 	unsigned blocksize;
@@ -2058,6 +2221,7 @@ static int ext4_add_entry(handle_t *handle, struct dentry *dentry,
 	if (retval)
 		return retval;
 
+	ext4_dirop_lock_dir(&dl, dir, true);
 	if (ext4_has_inline_data(dir)) {
 		retval = ext4_try_add_inline_entry(handle, &fname, dir, inode);
 		if (retval < 0)
@@ -2069,7 +2233,13 @@ static int ext4_add_entry(handle_t *handle, struct dentry *dentry,
 	}
 
 	if (is_dx(dir)) {
-		retval = ext4_dx_add_entry(handle, &fname, dir, inode);
+		retval = ext4_dx_add_entry(handle, &fname, dir, inode, &dl);
+		if (retval == -EAGAIN) {
+			/* the leaf is full or the index is bad */
+			ext4_dirop_lock_excl(&dl);
+			retval = ext4_dx_add_entry(handle, &fname, dir, inode,
+						   &dl);
+		}
 		if (!retval || (retval != ERR_BAD_DX_DIR))
 			goto out;
 		ext4_clear_inode_flag(dir, EXT4_INODE_INDEX);
@@ -2115,6 +2285,7 @@ static int ext4_add_entry(handle_t *handle, struct dentry *dentry,
 
 	retval = add_dirent_to_buf(handle, &fname, dir, inode, de, bh);
 out:
+	ext4_dirop_unlock_dir(&dl);
 	ext4_fname_free_filename(&fname);
 	brelse(bh);
 	if (retval == 0)
@@ -2126,7 +2297,8 @@ static int ext4_add_entry(handle_t *handle, struct dentry *dentry,
  * Returns 0 for success, or a negative error value
  */
 static int ext4_dx_add_entry(handle_t *handle, struct ext4_filename *fname,
-			     struct inode *dir, struct inode *inode)
+			     struct inode *dir, struct inode *inode,
+			     struct ext4_dirop_lock *dl)
 {
 	struct dx_frame frames[EXT4_HTREE_LEVEL], *frame;
 	struct dx_entry *entries, *at;
@@ -2139,10 +2311,16 @@ static int ext4_dx_add_entry(handle_t *handle, struct ext4_filename *fname,
 again:
 	restart = 0;
 	frame = dx_probe(fname, dir, NULL, frames);
-	if (IS_ERR(frame))
-		return PTR_ERR(frame);
+	if (IS_ERR(frame)) {
+		err = PTR_ERR(frame);
+		/* the directory is only changed with i_dirops_sem exclusive */
+		if (err == ERR_BAD_DX_DIR && dl->mode == EXT4_DIROP_WRITE)
+			err = -EAGAIN;
+		return err;
+	}
 	entries = frame->entries;
 	at = frame->at;
+	ext4_dirop_lock_leaf(dl, dx_get_block(frame->at));
 	bh = ext4_read_dirblock(dir, dx_get_block(frame->at), DIRENT);
 	if (IS_ERR(bh)) {
 		err = PTR_ERR(bh);
@@ -2159,6 +2337,12 @@ static int ext4_dx_add_entry(handle_t *handle, struct ext4_filename *fname,
 	if (err != -ENOSPC)
 		goto cleanup;
 
+	/* Splitting the leaf changes the index */
+	if (dl->mode == EXT4_DIROP_WRITE) {
+		err = -EAGAIN;
+		goto cleanup;
+	}
+
 	err = 0;
 	/* Block full, should compress but for now just split */
 	dxtrace(printk(KERN_DEBUG "using %u of %u node entries\n",
@@ -2769,6 +2953,9 @@ int ext4_orphan_add(handle_t *handle, struct inode *inode)
 	if (!list_empty(&EXT4_I(inode)->i_orphan))
 		return 0;
 
+	/* The orphan list is not in the fast commits */
+	ext4_fc_mark_ineligible(sb, handle);
+
 	/*
 	 * Orphan handling is only valid for files with data blocks
 	 * being truncated, or files being unlinked. Note that we either
@@ -2991,7 +3178,8 @@ static int ext4_unlink(struct inode *dir, struct dentry *dentry)
 	struct inode *inode;
 	struct buffer_head *bh;
 	struct ext4_dir_entry_2 *de;
-	handle_t *handle = NULL;
+	struct ext4_dirop_lock dl;
+	handle_t *handle;
 
 	if (unlikely(ext4_forced_shutdown(EXT4_SB(dir->i_sb))))
 		return -EIO;
@@ -3006,10 +3194,21 @@ static int ext4_unlink(struct inode *dir, struct dentry *dentry)
 	if (retval)
 		return retval;
 
+	/* The directory locks rank below the transaction start */
+	handle = ext4_journal_start(dir, EXT4_HT_DIR,
+				    EXT4_DATA_TRANS_BLOCKS(dir->i_sb));
+	if (IS_ERR(handle)) {
+		retval = PTR_ERR(handle);
+		goto end_trace;
+	}
+
+	ext4_dirop_lock_dir(&dl, dir, true);
 	retval = -ENOENT;
-	bh = ext4_find_entry(dir, &dentry->d_name, &de, NULL);
-	if (IS_ERR(bh))
-		return PTR_ERR(bh);
+	bh = __ext4_find_entry(dir, &dentry->d_name, &de, NULL, &dl);
+	if (IS_ERR(bh)) {
+		retval = PTR_ERR(bh);
+		bh = NULL;
+	}
 	if (!bh)
 		goto end_unlink;
 
@@ -3019,14 +3218,6 @@ static int ext4_unlink(struct inode *dir, struct dentry *dentry)
 	if (le32_to_cpu(de->inode) != inode->i_ino)
 		goto end_unlink;
 
-	handle = ext4_journal_start(dir, EXT4_HT_DIR,
-				    EXT4_DATA_TRANS_BLOCKS(dir->i_sb));
-	if (IS_ERR(handle)) {
-		retval = PTR_ERR(handle);
-		handle = NULL;
-		goto end_unlink;
-	}
-
 	if (IS_DIRSYNC(dir))
 		ext4_handle_sync(handle);
 
@@ -3036,6 +3227,7 @@ static int ext4_unlink(struct inode *dir, struct dentry *dentry)
 		set_nlink(inode, 1);
 	}
 	retval = ext4_delete_entry(handle, dir, de, bh);
+	ext4_dirop_unlock_dir(&dl);
 	if (retval)
 		goto end_unlink;
 	dir->i_ctime = dir->i_mtime = current_time(dir);
@@ -3048,9 +3240,10 @@ static int ext4_unlink(struct inode *dir, struct dentry *dentry)
 	ext4_mark_inode_dirty(handle, inode);
 
 end_unlink:
+	ext4_dirop_unlock_dir(&dl);
 	brelse(bh);
-	if (handle)
-		ext4_journal_stop(handle);
+	ext4_journal_stop(handle);
+end_trace:
 	trace_ext4_unlink_exit(dentry, retval);
 	return retval;
 }
@@ -96,6 +96,104 @@ static void mpage_end_io(struct bio *bio)
 	bio_put(bio);
 }
 
+static void large_page_end_io(struct bio *bio)
+{
+	struct page *page = bio->bi_private;
+
+	if (!bio->bi_status && !PageError(page)) {
+		SetPageUptodate(page);
+	} else {
+		ClearPageUptodate(page);
+		SetPageError(page);
+	}
+	unlock_page(page);
+	bio_put(bio);
+}
+
+/*
+ * Opens a new bio for a huge page at @sector.  The bios of a page are
+ * chained, each to the next one, so that the last one to be submitted
+ * completes the page once all of them are done.
+ */
+static struct bio *large_page_bio(struct inode *inode, struct page *page,
+				  struct bio *prev, sector_t sector)
+{
+	struct bio *bio;
+
+	bio = bio_alloc(GFP_KERNEL, min_t(int, hpage_nr_pages(page),
+					  BIO_MAX_PAGES));
+	bio_set_dev(bio, inode->i_sb->s_bdev);
+	bio->bi_iter.bi_sector = sector;
+	bio->bi_end_io = large_page_end_io;
+	bio->bi_private = page;
+	bio_set_op_attrs(bio, REQ_OP_READ, 0);
+	if (prev) {
+		bio_chain(prev, bio);
+		submit_bio(prev);
+	}
+	return bio;
+}
+
+/*
+ * Reads a locked huge page, one bio per run of contiguous blocks.  Holes
+ * and the blocks past the end of the file are zeroed here.
+ */
+static void ext4_read_large_page(struct inode *inode, struct page *page)
+{
+	const unsigned blkbits = inode->i_blkbits;
+	const unsigned shift = PAGE_SHIFT - blkbits;
+	const unsigned nr_blocks = hpage_nr_pages(page) << shift;
+	sector_t first_block = (sector_t)page->index << shift;
+	sector_t last_block_in_file;
+	sector_t next_pblk = 0;
+	struct ext4_map_blocks map;
+	struct bio *bio = NULL;
+	unsigned block = 0;
+
+	last_block_in_file = (i_size_read(inode) + (1 << blkbits) - 1) >>
+			     blkbits;
+	while (block < nr_blocks) {
+		unsigned len = nr_blocks - block;
+
+		map.m_lblk = first_block + block;
+		map.m_len = len;
+		map.m_flags = 0;
+		if (map.m_lblk < last_block_in_file &&
+		    ext4_map_blocks(NULL, inode, &map, 0) < 0) {
+			SetPageError(page);
+			map.m_flags = 0;
+		}
+		if (map.m_lblk < last_block_in_file && map.m_len)
+			len = min(len, map.m_len);
+
+		for (; len; len--, block++) {
+			struct page *subpage = page + (block >> shift);
+			unsigned offset = (block << blkbits) & ~PAGE_MASK;
+
+			if (!(map.m_flags & EXT4_MAP_MAPPED)) {
+				zero_user(subpage, offset, 1 << blkbits);
+				continue;
+			}
+			if (!bio || map.m_pblk != next_pblk)
+				bio = large_page_bio(inode, page, bio,
+					map.m_pblk << (blkbits - 9));
+			while (bio_add_page(bio, subpage, 1 << blkbits,
+					    offset) < (1 << blkbits))
+				bio = large_page_bio(inode, page, bio,
+					map.m_pblk << (blkbits - 9));
+			next_pblk = ++map.m_pblk;
+		}
+	}
+
+	if (bio) {
+		submit_bio(bio);
+		return;
+	}
+	if (!PageError(page))
+		SetPageUptodate(page);
+	unlock_page(page);
+}
+
 int ext4_mpage_readpages(struct address_space *mapping,
 			 struct list_head *pages, struct page *page,
 			 unsigned nr_pages)
@@ -133,6 +231,17 @@ int ext4_mpage_readpages(struct address_space *mapping,
 			if (add_to_page_cache_lru(page, mapping, page->index,
 				  readahead_gfp_mask(mapping)))
 				goto next_page;
+		} else {
+			page = compound_head(page);
+		}
+
+		if (PageTransHuge(page)) {
+			if (bio) {
+				submit_bio(bio);
+				bio = NULL;
+			}
+			ext4_read_large_page(inode, page);
+			goto next_page;
 		}
 
 		if (page_has_buffers(page))
@@ -109,6 +109,10 @@ static struct inode *ext4_get_journal_inode(struct super_block *sb,
  * sb_start_write -> i_mutex -> EXT4_STATE_DIOREAD_LOCK (r) ->
  *   transaction start -> i_data_sem (rw)
  *
+ * directory create and unlink:
+ * sb_start_write -> i_mutex (r or w) -> transaction start ->
+ *   i_dirops_sem (rw) -> htree leaf lock (rw)
+ *
  * writepages:
  * transaction start -> page lock(s) -> i_data_sem (rw)
  */
@@ -990,6 +994,10 @@ static struct inode *ext4_alloc_inode(struct super_block *sb)
 	spin_lock_init(&ei->i_completed_io_lock);
 	ei->i_sync_tid = 0;
 	ei->i_datasync_tid = 0;
+	INIT_LIST_HEAD(&ei->i_fc_list);
+	ei->i_fc_tid = 0;
+	ei->i_fc_lblk_len = 0;
+	ei->i_fc_dirty = false;
 	atomic_set(&ei->i_unwritten, 0);
 	INIT_WORK(&ei->i_rsv_conversion_work, ext4_end_io_rsv_work);
 	return &ei->vfs_inode;
@@ -1031,6 +1039,7 @@ static void init_once(void *foo)
 	init_rwsem(&ei->xattr_sem);
 	init_rwsem(&ei->i_data_sem);
 	init_rwsem(&ei->i_mmap_sem);
+	init_rwsem(&ei->i_dirops_sem);
 	inode_init_once(&ei->vfs_inode);
 }
 
@@ -1058,6 +1067,7 @@ static void destroy_inodecache(void)
 
 void ext4_clear_inode(struct inode *inode)
 {
+	ext4_fc_del(inode);
 	invalidate_inode_buffers(inode);
 	clear_inode(inode);
 	dquot_drop(inode);
@@ -1348,6 +1358,8 @@ enum {
 	Opt_dioread_nolock, Opt_dioread_lock,
 	Opt_discard, Opt_nodiscard, Opt_init_itable, Opt_noinit_itable,
 	Opt_max_dir_size_kb, Opt_nojournal_checksum, Opt_nombcache,
+	Opt_mb_optimize_scan, Opt_nomb_optimize_scan, Opt_fast_commit,
+	Opt_pdirops, Opt_nopdirops,
 };
 
 static const match_table_t tokens = {
@@ -1432,6 +1444,11 @@ static const match_table_t tokens = {
 	{Opt_test_dummy_encryption, "test_dummy_encryption"},
 	{Opt_nombcache, "nombcache"},
 	{Opt_nombcache, "no_mbcache"},	/* for backward compatibility */
+	{Opt_mb_optimize_scan, "mb_optimize_scan"},
+	{Opt_nomb_optimize_scan, "nomb_optimize_scan"},
+	{Opt_fast_commit, "fast_commit"},
+	{Opt_pdirops, "pdirops"},
+	{Opt_nopdirops, "nopdirops"},
 	{Opt_removed, "check=none"},	/* mount option from ext2/3 */
 	{Opt_removed, "nocheck"},	/* mount option from ext2/3 */
 	{Opt_removed, "reservation"},	/* mount option from ext2/3 */
@@ -1640,6 +1657,11 @@ static const struct mount_opts {
 	{Opt_max_dir_size_kb, 0, MOPT_GTE0},
 	{Opt_test_dummy_encryption, 0, MOPT_GTE0},
 	{Opt_nombcache, EXT4_MOUNT_NO_MBCACHE, MOPT_SET},
+	{Opt_mb_optimize_scan, EXT4_MOUNT_MB_OPTIMIZE_SCAN, MOPT_SET},
+	{Opt_nomb_optimize_scan, EXT4_MOUNT_MB_OPTIMIZE_SCAN, MOPT_CLEAR},
+	{Opt_fast_commit, EXT4_MOUNT_FAST_COMMIT, MOPT_EXT4_ONLY | MOPT_SET},
+	{Opt_pdirops, EXT4_MOUNT_PDIROPS, MOPT_SET},
+	{Opt_nopdirops, EXT4_MOUNT_PDIROPS, MOPT_CLEAR},
 	{Opt_err, 0, 0}
 };
 
@@ -4009,6 +4031,9 @@ static int ext4_fill_super(struct super_block *sb, void *data, int silent)
 
 	INIT_LIST_HEAD(&sbi->s_orphan); /* unlinked but open files */
 	mutex_init(&sbi->s_orphan_lock);
+	INIT_LIST_HEAD(&sbi->s_fc_q);
+	spin_lock_init(&sbi->s_fc_lock);
+	init_waitqueue_head(&sbi->s_fc_wait);
 
 	sb->s_root = NULL;
 
@@ -4290,6 +4315,10 @@ static int ext4_fill_super(struct super_block *sb, void *data, int silent)
 	}
 #endif  /* CONFIG_QUOTA */
 
+	/* The fast commits are replayed before the orphans */
+	ext4_fc_replay(sb);
+	ext4_fc_init(sb);
+
 	EXT4_SB(sb)->s_mount_state |= EXT4_ORPHAN_FS;
 	ext4_orphan_cleanup(sb, es);
 	EXT4_SB(sb)->s_mount_state &= ~EXT4_ORPHAN_FS;
@@ -5034,6 +5063,28 @@ static int ext4_remount(struct super_block *sb, int *flags, char *data)
 		goto restore_opts;
 	}
 
+	if ((sbi->s_mount_opt ^ old_opts.s_mount_opt) &
+	    EXT4_MOUNT_MB_OPTIMIZE_SCAN) {
+		ext4_msg(sb, KERN_ERR,
+			 "can't change mb_optimize_scan during remount");
+		err = -EINVAL;
+		goto restore_opts;
+	}
+
+	if ((sbi->s_mount_opt ^ old_opts.s_mount_opt) & EXT4_MOUNT_PDIROPS) {
+		ext4_msg(sb, KERN_ERR, "can't change pdirops during remount");
+		err = -EINVAL;
+		goto restore_opts;
+	}
+
+	if ((sbi->s_mount_opt ^ old_opts.s_mount_opt) &
+	    EXT4_MOUNT_FAST_COMMIT) {
+		ext4_msg(sb, KERN_ERR,
+			 "can't change fast_commit during remount");
+		err = -EINVAL;
+		goto restore_opts;
+	}
+
 	if ((sbi->s_mount_opt ^ old_opts.s_mount_opt) & EXT4_MOUNT_DAX) {
 		ext4_msg(sb, KERN_WARNING, "warning: refusing change of "
 			"dax flag with busy inodes while remounting");
@@ -5144,6 +5195,8 @@ static int ext4_remount(struct super_block *sb, int *flags, char *data)
 					goto restore_opts;
 				}
 			enable_quota = 1;
+			/* Not set up by a read-only mount */
+			ext4_fc_init(sb);
 		}
 	}
 
@@ -5771,7 +5824,7 @@ static struct file_system_type ext4_fs_type = {
 	.name		= "ext4",
 	.mount		= ext4_mount,
 	.kill_sb	= kill_block_super,
-	.fs_flags	= FS_REQUIRES_DEV,
+	.fs_flags	= FS_REQUIRES_DEV | FS_PARALLEL_WRITEBACK,
 };
 MODULE_ALIAS_FS("ext4");
 
@@ -5791,6 +5844,7 @@ static int __init ext4_init_fs(void)
 
 	for (i = 0; i < EXT4_WQ_HASH_SZ; i++)
 		init_waitqueue_head(&ext4__ioend_wq[i]);
+	ext4_init_dirops();
 
 	err = ext4_init_es();
 	if (err)
@@ -1067,9 +1067,9 @@ struct f2fs_sb_info {
 	struct f2fs_mount_info mount_opt;	/* mount options */
 
 	/* for cleaning operations */
-	struct mutex gc_mutex;			/* mutex for GC */
-	struct f2fs_gc_kthread	*gc_thread;	/* GC thread */
-	unsigned int cur_victim_sec;		/* current victim section num */
+	struct rw_semaphore gc_lock;		/* shared by GC, excl. by CP */
+	struct f2fs_gc_kthread	*gc_thread;	/* GC threads */
+	unsigned int gc_threads;		/* # of background GC threads */
 
 	/* threshold for converting bg victims for fg */
 	u64 fggc_threshold;
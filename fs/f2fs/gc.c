@@ -29,6 +29,7 @@ static int gc_thread_func(void *data)
 	struct f2fs_gc_kthread *gc_th = sbi->gc_thread;
 	wait_queue_head_t *wq = &sbi->gc_thread->gc_wait_queue_head;
 	unsigned int wait_ms;
+	unsigned int fg_wait_seq = READ_ONCE(gc_th->fg_wait_seq);
 
 	wait_ms = gc_th->min_sleep_time;
 
@@ -36,8 +37,10 @@ static int gc_thread_func(void *data)
 	do {
 		wait_event_interruptible_timeout(*wq,
 				kthread_should_stop() || freezing(current) ||
-				gc_th->gc_wake,
+				gc_th->gc_wake ||
+				READ_ONCE(gc_th->fg_wait_seq) != fg_wait_seq,
 				msecs_to_jiffies(wait_ms));
+		fg_wait_seq = READ_ONCE(gc_th->fg_wait_seq);
 
 		/* give it a try one time */
 		if (gc_th->gc_wake)
@@ -65,7 +68,7 @@ static int gc_thread_func(void *data)
 
 		/*
 		 * [GC triggering condition]
-		 * 0. GC is not conducted currently.
+		 * 0. No checkpoint excludes GC currently.
 		 * 1. There are enough dirty segments.
 		 * 2. IO subsystem is idle by checking the # of writeback pages.
 		 * 3. IO subsystem is idle by checking the # of requests in
@@ -76,9 +79,13 @@ static int gc_thread_func(void *data)
 		 * invalidated soon after by user update or deletion.
 		 * So, I'd like to wait some time to collect dirty segments.
 		 */
-		if (!mutex_trylock(&sbi->gc_mutex))
+		if (!down_read_trylock(&sbi->gc_lock))
 			goto next;
 
+		/* writers are waiting for free sections, help them */
+		if (has_not_enough_free_secs(sbi, 0, 0))
+			goto do_gc;
+
 		if (gc_th->gc_urgent) {
 			wait_ms = gc_th->urgent_sleep_time;
 			goto do_gc;
@@ -86,7 +93,7 @@ static int gc_thread_func(void *data)
 
 		if (!is_idle(sbi)) {
 			increase_sleep_time(gc_th, &wait_ms);
-			mutex_unlock(&sbi->gc_mutex);
+			up_read(&sbi->gc_lock);
 			goto next;
 		}
 
@@ -117,6 +124,7 @@ int start_gc_thread(struct f2fs_sb_info *sbi)
 {
 	struct f2fs_gc_kthread *gc_th;
 	dev_t dev = sbi->sb->s_bdev->bd_dev;
+	struct task_struct *task;
 	int err = 0;
 
 	gc_th = f2fs_kmalloc(sbi, sizeof(struct f2fs_gc_kthread), GFP_KERNEL);
@@ -133,15 +141,26 @@ int start_gc_thread(struct f2fs_sb_info *sbi)
 	gc_th->gc_idle = 0;
 	gc_th->gc_urgent = 0;
 	gc_th->gc_wake= 0;
+	gc_th->fg_wait_seq = 0;
+	gc_th->nr_threads = 0;
 
 	sbi->gc_thread = gc_th;
 	init_waitqueue_head(&sbi->gc_thread->gc_wait_queue_head);
-	sbi->gc_thread->f2fs_gc_task = kthread_run(gc_thread_func, sbi,
-			"f2fs_gc-%u:%u", MAJOR(dev), MINOR(dev));
-	if (IS_ERR(gc_th->f2fs_gc_task)) {
-		err = PTR_ERR(gc_th->f2fs_gc_task);
-		kfree(gc_th);
-		sbi->gc_thread = NULL;
+	while (gc_th->nr_threads < sbi->gc_threads) {
+		if (gc_th->nr_threads)
+			task = kthread_run(gc_thread_func, sbi,
+					"f2fs_gc-%u:%u/%u", MAJOR(dev),
+					MINOR(dev), gc_th->nr_threads);
+		else
+			task = kthread_run(gc_thread_func, sbi,
+					"f2fs_gc-%u:%u", MAJOR(dev),
+					MINOR(dev));
+		if (IS_ERR(task)) {
+			err = PTR_ERR(task);
+			stop_gc_thread(sbi);
+			break;
+		}
+		gc_th->f2fs_gc_task[gc_th->nr_threads++] = task;
 	}
 out:
 	return err;
@@ -150,9 +169,12 @@ int start_gc_thread(struct f2fs_sb_info *sbi)
 void stop_gc_thread(struct f2fs_sb_info *sbi)
 {
 	struct f2fs_gc_kthread *gc_th = sbi->gc_thread;
+	unsigned int i;
+
 	if (!gc_th)
 		return;
-	kthread_stop(gc_th->f2fs_gc_task);
+	for (i = 0; i < gc_th->nr_threads; i++)
+		kthread_stop(gc_th->f2fs_gc_task[i]);
 	kfree(gc_th);
 	sbi->gc_thread = NULL;
 }
@@ -302,6 +324,54 @@ static unsigned int count_bits(const unsigned long *addr,
 	return sum;
 }
 
+/*
+ * Select the victim section of GC from the victim index, starting with the
+ * sections having the fewest valid blocks.
+ */
+static void get_victim_from_index(struct f2fs_sb_info *sbi,
+			struct victim_sel_policy *p, int gc_type)
+{
+	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
+	unsigned int nsearched = 0;
+	unsigned int bucket, secno, segno;
+	unsigned long cost;
+
+	for (bucket = 0; bucket < NR_VICTIM_BUCKETS; bucket++) {
+		/*
+		 * The greedy cost of a section is at least its number of valid
+		 * blocks, the next buckets don't have a cheaper one.
+		 */
+		if (p->gc_mode == GC_GREEDY && p->min_segno != NULL_SEGNO &&
+			victim_bucket_start(sbi, bucket) >= p->min_cost)
+			break;
+
+		for_each_set_bit(secno, dirty_i->victim_index[bucket],
+							MAIN_SECS(sbi)) {
+			segno = GET_SEG_FROM_SEC(sbi, secno);
+
+			/* skip the sections without dirty segments */
+			if (find_next_bit(p->dirty_segmap, segno + p->ofs_unit,
+						segno) >= segno + p->ofs_unit)
+				continue;
+			if (sec_usage_check(sbi, secno))
+				continue;
+			if (gc_type == BG_GC &&
+				test_bit(secno, dirty_i->victim_secmap))
+				continue;
+			if (gc_type == FG_GC && no_fggc_candidate(sbi, secno))
+				continue;
+
+			cost = get_gc_cost(sbi, segno, p);
+			if (p->min_cost > cost) {
+				p->min_segno = segno;
+				p->min_cost = cost;
+			}
+			if (++nsearched >= p->max_search)
+				return;
+		}
+	}
+}
+
 /*
  * This function is called from two paths.
  * One is garbage collection and the other is SSR segment selection.
@@ -329,10 +399,14 @@ static int get_victim_by_default(struct f2fs_sb_info *sbi,
 	p.min_cost = get_max_cost(sbi, &p);
 
 	if (*result != NULL_SEGNO) {
+		secno = GET_SEC_FROM_SEG(sbi, *result);
 		if (IS_DATASEG(get_seg_entry(sbi, *result)->type) &&
 			get_valid_blocks(sbi, *result, false) &&
-			!sec_usage_check(sbi, GET_SEC_FROM_SEG(sbi, *result)))
+			!sec_usage_check(sbi, secno)) {
 			p.min_segno = *result;
+			if (p.alloc_mode == LFS)
+				set_bit(secno, dirty_i->gc_secmap);
+		}
 		goto out;
 	}
 
@@ -346,6 +420,12 @@ static int get_victim_by_default(struct f2fs_sb_info *sbi,
 			goto got_it;
 	}
 
+	/* SSR looks for segments of a given type, which are not indexed */
+	if (p.alloc_mode == LFS) {
+		get_victim_from_index(sbi, &p, gc_type);
+		goto found;
+	}
+
 	while (1) {
 		unsigned long cost;
 		unsigned int segno;
@@ -398,19 +478,20 @@ static int get_victim_by_default(struct f2fs_sb_info *sbi,
 			break;
 		}
 	}
+found:
 	if (p.min_segno != NULL_SEGNO) {
 got_it:
+		secno = GET_SEC_FROM_SEG(sbi, p.min_segno);
 		if (p.alloc_mode == LFS) {
-			secno = GET_SEC_FROM_SEG(sbi, p.min_segno);
-			if (gc_type == FG_GC)
-				sbi->cur_victim_sec = secno;
-			else
+			/* keep other GC threads and SSR off the section */
+			set_bit(secno, dirty_i->gc_secmap);
+			if (gc_type == BG_GC)
 				set_bit(secno, dirty_i->victim_secmap);
 		}
 		*result = (p.min_segno / p.ofs_unit) * p.ofs_unit;
 
 		trace_f2fs_get_victim(sbi->sb, type, gc_type, &p,
-				sbi->cur_victim_sec,
+				p.alloc_mode == LFS ? secno : NULL_SECNO,
 				prefree_segments(sbi), free_segments(sbi));
 	}
 out:
@@ -1045,11 +1126,15 @@ int f2fs_gc(struct f2fs_sb_info *sbi, bool sync,
 		sec_freed++;
 	total_freed += seg_freed;
 
-	if (gc_type == FG_GC)
-		sbi->cur_victim_sec = NULL_SEGNO;
+	clear_bit(GET_SEC_FROM_SEG(sbi, segno), DIRTY_I(sbi)->gc_secmap);
 
 	if (!sync) {
-		if (has_not_enough_free_secs(sbi, sec_freed, 0)) {
+		/*
+		 * A writer goes on once it has freed a section, the GC threads
+		 * and the other writers keep cleaning in parallel.
+		 */
+		if (has_not_enough_free_secs(sbi, sec_freed, 0) &&
+					(background || !sec_freed)) {
 			segno = NULL_SEGNO;
 			goto gc_more;
 		}
@@ -1070,7 +1155,7 @@ int f2fs_gc(struct f2fs_sb_info *sbi, bool sync,
 				reserved_segments(sbi),
 				prefree_segments(sbi));
 
-	mutex_unlock(&sbi->gc_mutex);
+	up_read(&sbi->gc_lock);
 
 	put_gc_inode(&gc_list);
 
@@ -23,10 +23,17 @@
 /* Search max. number of dirty segments to select a victim segment */
 #define DEF_MAX_VICTIM_SEARCH 4096 /* covers 8GB */
 
+/* max. number of background GC threads, see gc_threads= */
+#define F2FS_MAX_GC_THREADS	8
+
 struct f2fs_gc_kthread {
-	struct task_struct *f2fs_gc_task;
+	struct task_struct *f2fs_gc_task[F2FS_MAX_GC_THREADS];
+	unsigned int nr_threads;
 	wait_queue_head_t gc_wait_queue_head;
 
+	/* bumped by writers waiting for free sections, see f2fs_balance_fs */
+	unsigned int fg_wait_seq;
+
 	/* for gc sleep time */
 	unsigned int urgent_sleep_time;
 	unsigned int min_sleep_time;
@@ -428,7 +428,14 @@ void f2fs_balance_fs(struct f2fs_sb_info *sbi, bool need)
 	 * dir/node pages without enough free segments.
 	 */
 	if (has_not_enough_free_secs(sbi, 0, 0)) {
-		mutex_lock(&sbi->gc_mutex);
+		struct f2fs_gc_kthread *gc_th = sbi->gc_thread;
+
+		/* have the GC threads clean other sections meanwhile */
+		if (gc_th) {
+			WRITE_ONCE(gc_th->fg_wait_seq, gc_th->fg_wait_seq + 1);
+			wake_up_interruptible_all(&gc_th->gc_wait_queue_head);
+		}
+		down_read(&sbi->gc_lock);
 		f2fs_gc(sbi, false, false, NULL_SEGNO);
 	}
 }
@@ -1627,6 +1634,24 @@ static void __set_sit_entry_type(struct f2fs_sb_info *sbi, int type,
 		__mark_sit_entry_dirty(sbi, segno);
 }
 
+/* Move the section of @segno to the bucket of its valid blocks */
+static void update_victim_index(struct f2fs_sb_info *sbi, unsigned int segno)
+{
+	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
+	unsigned int secno = GET_SEC_FROM_SEG(sbi, segno);
+	unsigned int old = dirty_i->sec_bucket[secno];
+	unsigned int new;
+
+	new = victim_bucket(sbi, get_valid_blocks(sbi, segno, true));
+	if (new == old)
+		return;
+	if (old < NR_VICTIM_BUCKETS)
+		clear_bit(secno, dirty_i->victim_index[old]);
+	if (new < NR_VICTIM_BUCKETS)
+		set_bit(secno, dirty_i->victim_index[new]);
+	dirty_i->sec_bucket[secno] = new;
+}
+
 static void update_sit_entry(struct f2fs_sb_info *sbi, block_t blkaddr, int del)
 {
 	struct seg_entry *se;
@@ -1714,6 +1739,8 @@ static void update_sit_entry(struct f2fs_sb_info *sbi, block_t blkaddr, int del)
 
 	if (sbi->segs_per_sec > 1)
 		get_sec_entry(sbi, segno)->valid_blocks += del;
+
+	update_victim_index(sbi, segno);
 }
 
 void refresh_sit_entry(struct f2fs_sb_info *sbi, block_t old, block_t new)
@@ -2234,9 +2261,9 @@ int f2fs_trim_fs(struct f2fs_sb_info *sbi, struct fstrim_range *range)
 				BATCHED_TRIM_SEGMENTS(sbi),
 				sbi->segs_per_sec) - 1, end_segno);
 
-		mutex_lock(&sbi->gc_mutex);
+		down_write(&sbi->gc_lock);
 		err = write_checkpoint(sbi, &cpc);
-		mutex_unlock(&sbi->gc_mutex);
+		up_write(&sbi->gc_lock);
 		if (err)
 			break;
 
@@ -3374,6 +3401,34 @@ static int init_victim_secmap(struct f2fs_sb_info *sbi)
 	dirty_i->victim_secmap = kvzalloc(bitmap_size, GFP_KERNEL);
 	if (!dirty_i->victim_secmap)
 		return -ENOMEM;
+	dirty_i->gc_secmap = kvzalloc(bitmap_size, GFP_KERNEL);
+	if (!dirty_i->gc_secmap)
+		return -ENOMEM;
+	return 0;
+}
+
+static int init_victim_index(struct f2fs_sb_info *sbi)
+{
+	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
+	unsigned int bitmap_size = f2fs_bitmap_size(MAIN_SECS(sbi));
+	unsigned int secno, bucket, i;
+
+	for (i = 0; i < NR_VICTIM_BUCKETS; i++) {
+		dirty_i->victim_index[i] = kvzalloc(bitmap_size, GFP_KERNEL);
+		if (!dirty_i->victim_index[i])
+			return -ENOMEM;
+	}
+	dirty_i->sec_bucket = kvzalloc(MAIN_SECS(sbi), GFP_KERNEL);
+	if (!dirty_i->sec_bucket)
+		return -ENOMEM;
+
+	for (secno = 0; secno < MAIN_SECS(sbi); secno++) {
+		bucket = victim_bucket(sbi, get_valid_blocks(sbi,
+					GET_SEG_FROM_SEC(sbi, secno), true));
+		if (bucket < NR_VICTIM_BUCKETS)
+			set_bit(secno, dirty_i->victim_index[bucket]);
+		dirty_i->sec_bucket[secno] = bucket;
+	}
 	return 0;
 }
 
@@ -3381,6 +3436,7 @@ static int build_dirty_segmap(struct f2fs_sb_info *sbi)
 {
 	struct dirty_seglist_info *dirty_i;
 	unsigned int bitmap_size, i;
+	int err;
 
 	/* allocate memory for dirty segments list information */
 	dirty_i = kzalloc(sizeof(struct dirty_seglist_info), GFP_KERNEL);
@@ -3399,7 +3455,10 @@ static int build_dirty_segmap(struct f2fs_sb_info *sbi)
 	}
 
 	init_dirty_segmap(sbi);
-	return init_victim_secmap(sbi);
+	err = init_victim_secmap(sbi);
+	if (err)
+		return err;
+	return init_victim_index(sbi);
 }
 
 /*
@@ -3511,7 +3570,13 @@ static void discard_dirty_segmap(struct f2fs_sb_info *sbi,
 static void destroy_victim_secmap(struct f2fs_sb_info *sbi)
 {
 	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
+	int i;
+
 	kvfree(dirty_i->victim_secmap);
+	kvfree(dirty_i->gc_secmap);
+	for (i = 0; i < NR_VICTIM_BUCKETS; i++)
+		kvfree(dirty_i->victim_index[i]);
+	kvfree(dirty_i->sec_bucket);
 }
 
 static void destroy_dirty_segmap(struct f2fs_sb_info *sbi)
@@ -266,12 +266,40 @@ enum dirty_type {
 	NR_DIRTY_TYPE
 };
 
+/*
+ * The sections with valid blocks are indexed in NR_VICTIM_BUCKETS bitmaps by
+ * their number of valid blocks, so that GC looks at the emptiest sections
+ * first instead of scanning all the dirty segments.
+ */
+#define NR_VICTIM_BUCKETS	16
+
+/* NR_VICTIM_BUCKETS for the sections out of the index */
+static inline unsigned int victim_bucket(struct f2fs_sb_info *sbi,
+						unsigned int valid_blocks)
+{
+	if (!valid_blocks)
+		return NR_VICTIM_BUCKETS;
+	return (valid_blocks - 1) * NR_VICTIM_BUCKETS / BLKS_PER_SEC(sbi);
+}
+
+/* lowest number of valid blocks of a section in @bucket */
+static inline unsigned int victim_bucket_start(struct f2fs_sb_info *sbi,
+						unsigned int bucket)
+{
+	return DIV_ROUND_UP(bucket * BLKS_PER_SEC(sbi), NR_VICTIM_BUCKETS) + 1;
+}
+
 struct dirty_seglist_info {
 	const struct victim_selection *v_ops;	/* victim selction operation */
 	unsigned long *dirty_segmap[NR_DIRTY_TYPE];
 	struct mutex seglist_lock;		/* lock for segment bitmaps */
 	int nr_dirty[NR_DIRTY_TYPE];		/* # of dirty segments */
 	unsigned long *victim_secmap;		/* background GC victims */
+	unsigned long *gc_secmap;		/* sections being cleaned */
+
+	/* sections by valid blocks, for the victim selection of GC */
+	unsigned long *victim_index[NR_VICTIM_BUCKETS];
+	unsigned char *sec_bucket;		/* bucket of each section */
 };
 
 /* victim selection function for cleaning and SSR */
@@ -739,7 +767,7 @@ static inline bool no_fggc_candidate(struct f2fs_sb_info *sbi,
 
 static inline bool sec_usage_check(struct f2fs_sb_info *sbi, unsigned int secno)
 {
-	if (IS_CURSEC(sbi, secno) || (sbi->cur_victim_sec == secno))
+	if (IS_CURSEC(sbi, secno) || test_bit(secno, DIRTY_I(sbi)->gc_secmap))
 		return true;
 	return false;
 }
@@ -23,6 +23,7 @@
 #include <linux/spinlock.h>
 #include <linux/rcupdate.h>
 #include <linux/workqueue.h>
+#include <linux/prctl.h>
 
 unsigned int sysctl_nr_open __read_mostly = 1024*1024;
 unsigned int sysctl_nr_open_min = BITS_PER_LONG;
@@ -230,28 +231,48 @@ static int expand_files(struct files_struct *files, unsigned int nr)
 	return expanded;
 }
 
+/*
+ * The fds of a table in the scalable mode are claimed in open_fds without
+ * file_lock, see alloc_fd_scalable(), so open_fds and close_on_exec are
+ * always updated with atomic bitops.  full_fds_bits is still only changed
+ * under file_lock: a bit found set there means a full word, as only the
+ * holders of file_lock clear the bits of open_fds.
+ */
 static inline void __set_close_on_exec(unsigned int fd, struct fdtable *fdt)
 {
-	__set_bit(fd, fdt->close_on_exec);
+	set_bit(fd, fdt->close_on_exec);
 }
 
 static inline void __clear_close_on_exec(unsigned int fd, struct fdtable *fdt)
 {
 	if (test_bit(fd, fdt->close_on_exec))
-		__clear_bit(fd, fdt->close_on_exec);
+		clear_bit(fd, fdt->close_on_exec);
 }
 
 static inline void __set_open_fd(unsigned int fd, struct fdtable *fdt)
 {
-	__set_bit(fd, fdt->open_fds);
+	set_bit(fd, fdt->open_fds);
+	fd /= BITS_PER_LONG;
+	if (!~READ_ONCE(fdt->open_fds[fd]))
+		__set_bit(fd, fdt->full_fds_bits);
+}
+
+/* As __set_open_fd(), failing if the fd was claimed by alloc_fd_scalable() */
+static inline bool __claim_open_fd(unsigned int fd, struct fdtable *fdt)
+{
+	if (test_and_set_bit(fd, fdt->open_fds))
+		return false;
 	fd /= BITS_PER_LONG;
-	if (!~fdt->open_fds[fd])
+	if (!~READ_ONCE(fdt->open_fds[fd]))
 		__set_bit(fd, fdt->full_fds_bits);
+	return true;
 }
 
 static inline void __clear_open_fd(unsigned int fd, struct fdtable *fdt)
 {
-	__clear_bit(fd, fdt->open_fds);
+	/* the new owner of the fd must find its slot cleared */
+	smp_mb__before_atomic();
+	clear_bit(fd, fdt->open_fds);
 	__clear_bit(fd / BITS_PER_LONG, fdt->full_fds_bits);
 }
 
@@ -290,6 +311,7 @@ struct files_struct *dup_fd(struct files_struct *oldf, int *errorp)
 
 	spin_lock_init(&newf->file_lock);
 	newf->resize_in_progress = false;
+	newf->fd_alloc_scalable = oldf->fd_alloc_scalable;
 	init_waitqueue_head(&newf->resize_wait);
 	newf->next_fd = 0;
 	new_fdt = &newf->fdtab;
@@ -344,6 +366,20 @@ struct files_struct *dup_fd(struct files_struct *oldf, int *errorp)
 		struct file *f = *old_fds++;
 		if (f) {
 			get_file(f);
+			/*
+			 * In the scalable mode, a sibling may have claimed
+			 * and installed it since the bitmaps were copied.
+			 */
+			if (oldf->fd_alloc_scalable) {
+				unsigned int fd = open_files - i;
+
+				smp_rmb();
+				__set_open_fd(fd, new_fdt);
+				if (close_on_exec(fd, old_fdt))
+					__set_close_on_exec(fd, new_fdt);
+				else
+					__clear_close_on_exec(fd, new_fdt);
+			}
 		} else {
 			/*
 			 * The fd may be claimed in the fd bitmap but not yet
@@ -478,20 +514,87 @@ static unsigned int find_next_fd(struct fdtable *fdt, unsigned int start)
 	return find_next_zero_bit(fdt->open_fds, maxfd, start);
 }
 
+/* the bits of open_fds searched first by each CPU in the scalable mode */
+#define FD_ALLOC_SLICE	(L1_CACHE_BYTES * BITS_PER_BYTE)
+
+static int claim_fd(struct fdtable *fdt, unsigned int fd, unsigned int max)
+{
+	while ((fd = find_next_zero_bit(fdt->open_fds, max, fd)) < max) {
+		if (!test_and_set_bit(fd, fdt->open_fds))
+			return fd;
+		fd++;
+	}
+	return -EMFILE;
+}
+
+/*
+ * Claim a free fd of the current table without file_lock, which is taken by
+ * __alloc_fd() when there is none, to expand the table.  Each CPU starts from
+ * its own slice of open_fds, so that the threads accepting or opening files
+ * concurrently don't bounce the same cachelines.  As with __fd_install(), the
+ * table can't be resized under us: expand_fdtable() waits for the sections
+ * which might have missed resize_in_progress.  next_fd is left alone, the
+ * fds below it stay in use.
+ */
+static int alloc_fd_scalable(struct files_struct *files,
+			     unsigned start, unsigned end, unsigned flags)
+{
+	struct fdtable *fdt;
+	unsigned int first, max, slice;
+	int fd = -EMFILE;
+
+	rcu_read_lock_sched();
+	if (unlikely(files->resize_in_progress))
+		goto out;
+	/* coupled with smp_wmb() in expand_fdtable() */
+	smp_rmb();
+	fdt = rcu_dereference_sched(files->fdt);
+
+	max = min(end, fdt->max_fds);
+	if (start >= max)
+		goto out;
+	slice = max_t(unsigned int, FD_ALLOC_SLICE,
+		      fdt->max_fds / num_possible_cpus());
+	slice = round_down(slice, BITS_PER_LONG);
+	first = (raw_smp_processor_id() * slice) % fdt->max_fds;
+	if (first < start || first >= max)
+		first = start;
+
+	fd = claim_fd(fdt, first, max);
+	if (fd < 0 && first > start)
+		fd = claim_fd(fdt, start, first);
+	if (fd < 0)
+		goto out;
+
+	if (flags & O_CLOEXEC)
+		__set_close_on_exec(fd, fdt);
+	else
+		__clear_close_on_exec(fd, fdt);
+out:
+	rcu_read_unlock_sched();
+	return fd;
+}
+
 /*
  * allocate a file descriptor, mark it busy.
  */
 int __alloc_fd(struct files_struct *files,
 	       unsigned start, unsigned end, unsigned flags)
 {
-	unsigned int fd;
+	unsigned int fd, from = start;
 	int error;
 	struct fdtable *fdt;
 
+	if (READ_ONCE(files->fd_alloc_scalable)) {
+		error = alloc_fd_scalable(files, start, end, flags);
+		if (error >= 0)
+			return error;
+	}
+
 	spin_lock(&files->file_lock);
 repeat:
 	fdt = files_fdtable(files);
-	fd = start;
+	fd = from;
 	if (fd < files->next_fd)
 		fd = files->next_fd;
 
@@ -517,10 +620,15 @@ int __alloc_fd(struct files_struct *files,
 	if (error)
 		goto repeat;
 
+	/* alloc_fd_scalable() claims the fds without file_lock */
+	if (!__claim_open_fd(fd, fdt)) {
+		from = fd + 1;
+		goto repeat;
+	}
+
 	if (start <= files->next_fd)
 		files->next_fd = fd + 1;
 
-	__set_open_fd(fd, fdt);
 	if (flags & O_CLOEXEC)
 		__set_close_on_exec(fd, fdt);
 	else
@@ -550,6 +658,25 @@ int get_unused_fd_flags(unsigned flags)
 }
 EXPORT_SYMBOL(get_unused_fd_flags);
 
+int fd_alloc_prctl(unsigned long op, unsigned long val)
+{
+	struct files_struct *files = current->files;
+
+	switch (op) {
+	case PR_FD_ALLOC_SET_SCALABLE:
+		if (val > 1)
+			return -EINVAL;
+		/* the allocations made either way are compatible */
+		WRITE_ONCE(files->fd_alloc_scalable, val);
+		return 0;
+	case PR_FD_ALLOC_GET_SCALABLE:
+		if (val)
+			return -EINVAL;
+		return files->fd_alloc_scalable;
+	}
+	return -EINVAL;
+}
+
 static void __put_unused_fd(struct files_struct *files, unsigned int fd)
 {
 	struct fdtable *fdt = files_fdtable(files);
@@ -649,6 +776,8 @@ void do_close_on_exec(struct files_struct *files)
 
 	/* exec unshares first */
 	spin_lock(&files->file_lock);
+	/* the new program may rely on getting the lowest fd */
+	files->fd_alloc_scalable = false;
 	for (i = 0; ; i++) {
 		unsigned long set;
 		unsigned fd = i * BITS_PER_LONG;
@@ -830,7 +959,8 @@ __releases(&files->file_lock)
 	 */
 	fdt = files_fdtable(files);
 	tofree = fdt->fd[fd];
-	if (!tofree && fd_is_open(fd, fdt))
+	/* claimed atomically, as alloc_fd_scalable() does */
+	if (!tofree && test_and_set_bit(fd, fdt->open_fds))
 		goto Ebusy;
 	get_file(file);
 	rcu_assign_pointer(fdt->fd[fd], file);
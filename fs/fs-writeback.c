@@ -1479,6 +1479,210 @@ static long writeback_chunk_size(struct bdi_writeback *wb,
 	return pages;
 }
 
+/*
+ * Background writeback of the inodes of a filesystem which sets
+ * FS_PARALLEL_WRITEBACK is spread over bdi->wb_workers workers.  An inode
+ * always goes to the worker its number hashes to, and I_SYNC keeps it from
+ * being written back by two of them at once, so the writeback of any one
+ * inode stays in order.
+ */
+#define WB_SHARD_INODES		16
+
+struct wb_shard {
+	struct work_struct work;
+	struct writeback_control wbc;
+	long write_chunk;
+	struct inode *inodes[WB_SHARD_INODES];
+	int nr_inodes;
+	long wrote;		/* pages and inodes, as writeback_sb_inodes() */
+	long nr_pages;		/* pages only */
+};
+
+static struct workqueue_struct *wb_shard_wq;
+
+static void wb_shard_write(struct wb_shard *shard)
+{
+	struct writeback_control *wbc = &shard->wbc;
+	int i;
+
+	for (i = 0; i < shard->nr_inodes; i++) {
+		struct inode *inode = shard->inodes[i];
+		struct bdi_writeback *tmp_wb;
+
+		spin_lock(&inode->i_lock);
+		wbc_attach_and_unlock_inode(wbc, inode);
+
+		wbc->nr_to_write = shard->write_chunk;
+		wbc->pages_skipped = 0;
+
+		/* I_SYNC was set when the inode was handed to us */
+		__writeback_single_inode(inode, wbc);
+
+		wbc_detach_inode(wbc);
+		shard->nr_pages += shard->write_chunk - wbc->nr_to_write;
+
+		if (need_resched()) {
+			blk_flush_plug(current);
+			cond_resched();
+		}
+
+		tmp_wb = inode_to_wb_and_lock_list(inode);
+		spin_lock(&inode->i_lock);
+		if (!(inode->i_state & I_DIRTY_ALL))
+			shard->wrote++;
+		requeue_inode(inode, tmp_wb, wbc);
+		inode_sync_complete(inode);
+		spin_unlock(&inode->i_lock);
+		spin_unlock(&tmp_wb->list_lock);
+	}
+	shard->wrote += shard->nr_pages;
+}
+
+static void wb_shard_workfn(struct work_struct *work)
+{
+	struct wb_shard *shard = container_of(work, struct wb_shard, work);
+	struct blk_plug plug;
+
+	current->flags |= PF_SWAPWRITE;
+	blk_start_plug(&plug);
+	wb_shard_write(shard);
+	blk_finish_plug(&plug);
+	current->flags &= ~PF_SWAPWRITE;
+}
+
+static unsigned int wb_nr_shards(struct super_block *sb,
+				 struct bdi_writeback *wb,
+				 struct wb_writeback_work *work)
+{
+	if (!wb_shard_wq || work->sync_mode == WB_SYNC_ALL ||
+	    !(sb->s_type->fs_flags & FS_PARALLEL_WRITEBACK))
+		return 1;
+	return READ_ONCE(wb->bdi->wb_workers);
+}
+
+/*
+ * writeback_sb_inodes() for @nr_shards workers: hand out batches of b_io
+ * inodes to the workers, write the first share here and wait for the others.
+ */
+static long writeback_sb_inodes_parallel(struct super_block *sb,
+					 struct bdi_writeback *wb,
+					 struct wb_writeback_work *work,
+					 struct wb_shard *shards,
+					 unsigned int nr_shards)
+{
+	unsigned long start_time = jiffies;
+	long wrote = 0;
+	int i;
+
+	for (i = 0; i < nr_shards; i++) {
+		INIT_WORK(&shards[i].work, wb_shard_workfn);
+		shards[i].wbc = (struct writeback_control) {
+			.sync_mode		= work->sync_mode,
+			.tagged_writepages	= work->tagged_writepages,
+			.for_kupdate		= work->for_kupdate,
+			.for_background		= work->for_background,
+			.for_sync		= work->for_sync,
+			.range_cyclic		= work->range_cyclic,
+			.range_start		= 0,
+			.range_end		= LLONG_MAX,
+		};
+	}
+
+	while (!list_empty(&wb->b_io)) {
+		long write_chunk = writeback_chunk_size(wb, work);
+		long budget = work->nr_pages;
+		bool full = false;
+		int nr = 0;
+
+		for (i = 0; i < nr_shards; i++) {
+			shards[i].write_chunk = write_chunk;
+			shards[i].nr_inodes = 0;
+			shards[i].wrote = 0;
+			shards[i].nr_pages = 0;
+		}
+
+		while (!list_empty(&wb->b_io) && !full && budget > 0) {
+			struct inode *inode = wb_inode(wb->b_io.prev);
+			struct wb_shard *shard;
+
+			if (inode->i_sb != sb) {
+				if (work->sb) {
+					redirty_tail(inode, wb);
+					continue;
+				}
+				break;
+			}
+
+			spin_lock(&inode->i_lock);
+			if (inode->i_state &
+			    (I_NEW | I_FREEING | I_WILL_FREE)) {
+				spin_unlock(&inode->i_lock);
+				redirty_tail(inode, wb);
+				continue;
+			}
+			if (inode->i_state & I_SYNC) {
+				spin_unlock(&inode->i_lock);
+				requeue_io(inode, wb);
+				trace_writeback_sb_inodes_requeue(inode);
+				continue;
+			}
+			inode->i_state |= I_SYNC;
+			spin_unlock(&inode->i_lock);
+
+			/*
+			 * Take the inode off b_io so that the scan can go on,
+			 * requeue_inode() files it where it belongs once it
+			 * has been written.
+			 */
+			requeue_io(inode, wb);
+
+			shard = &shards[inode->i_ino % nr_shards];
+			shard->inodes[shard->nr_inodes++] = inode;
+			full = shard->nr_inodes == WB_SHARD_INODES;
+			if (write_chunk != LONG_MAX)
+				budget -= write_chunk;
+			nr++;
+		}
+		if (!nr)
+			break;
+
+		spin_unlock(&wb->list_lock);
+		for (i = 1; i < nr_shards; i++)
+			if (shards[i].nr_inodes)
+				queue_work(wb_shard_wq, &shards[i].work);
+		wb_shard_write(&shards[0]);
+		for (i = 0; i < nr_shards; i++) {
+			if (i && shards[i].nr_inodes)
+				flush_work(&shards[i].work);
+			work->nr_pages -= shards[i].nr_pages;
+			wrote += shards[i].wrote;
+		}
+		spin_lock(&wb->list_lock);
+
+		if (wrote) {
+			if (time_is_before_jiffies(start_time + HZ / 10UL))
+				break;
+			if (work->nr_pages <= 0)
+				break;
+		}
+	}
+	return wrote;
+}
+
+static int __init wb_shard_init(void)
+{
+	/*
+	 * Not freezable: the shards are waited for by writeback work that
+	 * the freezer lets finish.
+	 */
+	wb_shard_wq = alloc_workqueue("writeback_shard",
+				      WQ_MEM_RECLAIM | WQ_UNBOUND, 0);
+	if (!wb_shard_wq)
+		return -ENOMEM;
+	return 0;
+}
+fs_initcall(wb_shard_init);
+
 /*
  * Write a portion of b_io inodes which belong to @sb.
  *
@@ -1503,9 +1707,25 @@ static long writeback_sb_inodes(struct super_block *sb,
 		.range_end		= LLONG_MAX,
 	};
 	unsigned long start_time = jiffies;
+	unsigned int nr_shards;
 	long write_chunk;
 	long wrote = 0;  /* count both pages and inodes */
 
+	nr_shards = wb_nr_shards(sb, wb, work);
+	if (nr_shards > 1) {
+		struct wb_shard *shards;
+
+		/* we hold wb->list_lock, fall back to one worker on failure */
+		shards = kcalloc(nr_shards, sizeof(*shards),
+				 GFP_NOWAIT | __GFP_NOWARN);
+		if (shards) {
+			wrote = writeback_sb_inodes_parallel(sb, wb, work,
+							     shards, nr_shards);
+			kfree(shards);
+			return wrote;
+		}
+	}
+
 	while (!list_empty(&wb->b_io)) {
 		struct inode *inode = wb_inode(wb->b_io.prev);
 		struct bdi_writeback *tmp_wb;
@@ -25,15 +25,18 @@
  * Inode locking rules:
  *
  * inode->i_lock protects:
- *   inode->i_state, inode->i_hash, __iget()
+ *   inode->i_state, __iget()
  * Inode LRU list locks protect:
  *   inode->i_sb->s_inode_lru, inode->i_lru
  * inode->i_sb->s_inode_list_lock protects:
  *   inode->i_sb->s_inodes, inode->i_sb_list
  * bdi->wb.list_lock protects:
  *   bdi->wb.b_{dirty,io,more_io,dirty_time}, inode->i_io_list
- * inode_hash_lock protects:
- *   inode_hashtable, inode->i_hash
+ * the bit lock of an inode_hashtable bucket protects:
+ *   the bucket, inode->i_hash and inode->i_hash_head of its inodes
+ *
+ * The buckets are walked under RCU by find_inode_fast(), which then checks
+ * the inode is still hashed under inode->i_lock.
  *
  * Lock ordering:
  *
@@ -44,18 +47,14 @@
  * bdi->wb.list_lock
  *   inode->i_lock
  *
- * inode_hash_lock
+ * inode_hashtable bucket lock
  *   inode->i_sb->s_inode_list_lock
  *   inode->i_lock
- *
- * iunique_lock
- *   inode_hash_lock
  */
 
 static unsigned int i_hash_mask __read_mostly;
 static unsigned int i_hash_shift __read_mostly;
-static struct hlist_head *inode_hashtable __read_mostly;
-static __cacheline_aligned_in_smp DEFINE_SPINLOCK(inode_hash_lock);
+static struct hlist_bl_head *inode_hashtable __read_mostly;
 
 /*
  * Empty aops. Can be used for the cases where the user does not
@@ -178,6 +177,9 @@ int inode_init_always(struct super_block *sb, struct inode *inode)
 	mapping->host = inode;
 	mapping->flags = 0;
 	atomic_set(&mapping->i_mmap_writable, 0);
+#ifdef CONFIG_READ_ONLY_THP_FOR_FS
+	atomic_set(&mapping->nr_thps, 0);
+#endif
 	mapping_set_gfp_mask(mapping, GFP_HIGHUSER_MOVABLE);
 	mapping->private_data = NULL;
 	mapping->writeback_index = 0;
@@ -365,7 +367,7 @@ EXPORT_SYMBOL(address_space_init_once);
 void inode_init_once(struct inode *inode)
 {
 	memset(inode, 0, sizeof(*inode));
-	INIT_HLIST_NODE(&inode->i_hash);
+	INIT_HLIST_BL_NODE(&inode->i_hash);
 	INIT_LIST_HEAD(&inode->i_devices);
 	INIT_LIST_HEAD(&inode->i_io_list);
 	INIT_LIST_HEAD(&inode->i_wb_list);
@@ -459,6 +461,19 @@ static unsigned long hash(struct super_block *sb, unsigned long hashval)
 	return tmp & i_hash_mask;
 }
 
+static inline struct hlist_bl_head *i_hash_head(struct super_block *sb,
+						unsigned long hashval)
+{
+	return inode_hashtable + hash(sb, hashval);
+}
+
+/* called with the lock of @b held */
+static void __inode_hash_add(struct inode *inode, struct hlist_bl_head *b)
+{
+	inode->i_hash_head = b;
+	hlist_bl_add_head_rcu(&inode->i_hash, b);
+}
+
 /**
  *	__insert_inode_hash - hash an inode
  *	@inode: unhashed inode
@@ -469,13 +484,13 @@ static unsigned long hash(struct super_block *sb, unsigned long hashval)
  */
 void __insert_inode_hash(struct inode *inode, unsigned long hashval)
 {
-	struct hlist_head *b = inode_hashtable + hash(inode->i_sb, hashval);
+	struct hlist_bl_head *b = i_hash_head(inode->i_sb, hashval);
 
-	spin_lock(&inode_hash_lock);
+	hlist_bl_lock(b);
 	spin_lock(&inode->i_lock);
-	hlist_add_head(&inode->i_hash, b);
+	__inode_hash_add(inode, b);
 	spin_unlock(&inode->i_lock);
-	spin_unlock(&inode_hash_lock);
+	hlist_bl_unlock(b);
 }
 EXPORT_SYMBOL(__insert_inode_hash);
 
@@ -487,11 +502,14 @@ EXPORT_SYMBOL(__insert_inode_hash);
  */
 void __remove_inode_hash(struct inode *inode)
 {
-	spin_lock(&inode_hash_lock);
+	struct hlist_bl_head *b = inode->i_hash_head;
+
+	hlist_bl_lock(b);
 	spin_lock(&inode->i_lock);
-	hlist_del_init(&inode->i_hash);
+	/* keeps ->next for the lockless walkers of the bucket */
+	hlist_bl_del_init_rcu(&inode->i_hash);
 	spin_unlock(&inode->i_lock);
-	spin_unlock(&inode_hash_lock);
+	hlist_bl_unlock(b);
 }
 EXPORT_SYMBOL(__remove_inode_hash);
 
@@ -777,26 +795,44 @@ long prune_icache_sb(struct super_block *sb, struct shrink_control *sc)
 	return freed;
 }
 
-static void __wait_on_freeing_inode(struct inode *inode);
 /*
- * Called with the inode lock held.
+ * Walk the whole inode LRU of @sb, rather than the share of a node and of a
+ * memcg that the superblock shrinker gets, for FIDROPCACHES.
+ */
+long prune_icache_sb_all(struct super_block *sb)
+{
+	LIST_HEAD(freeable);
+	long freed;
+
+	freed = list_lru_walk(&sb->s_inode_lru, inode_lru_isolate, &freeable,
+			      list_lru_count(&sb->s_inode_lru));
+	dispose_list(&freeable);
+	return freed;
+}
+
+static void __wait_on_freeing_inode(struct inode *inode,
+				    struct hlist_bl_head *head, bool locked);
+/*
+ * Called with the lock of @head held: @test gets the inodes of the bucket
+ * with their memory and hash stable.
  */
 static struct inode *find_inode(struct super_block *sb,
-				struct hlist_head *head,
+				struct hlist_bl_head *head,
 				int (*test)(struct inode *, void *),
 				void *data)
 {
+	struct hlist_bl_node *node;
 	struct inode *inode = NULL;
 
 repeat:
-	hlist_for_each_entry(inode, head, i_hash) {
+	hlist_bl_for_each_entry(inode, node, head, i_hash) {
 		if (inode->i_sb != sb)
 			continue;
 		if (!test(inode, data))
 			continue;
 		spin_lock(&inode->i_lock);
 		if (inode->i_state & (I_FREEING|I_WILL_FREE)) {
-			__wait_on_freeing_inode(inode);
+			__wait_on_freeing_inode(inode, head, true);
 			goto repeat;
 		}
 		__iget(inode);
@@ -808,22 +844,32 @@ static struct inode *find_inode(struct super_block *sb,
 
 /*
  * find_inode_fast is the fast path version of find_inode, see the comment at
- * iget_locked for details.
+ * iget_locked for details.  Called with the lock of @head held if @locked,
+ * else under rcu_read_lock(): the inodes are freed after a grace period, and
+ * the ones unhashed while the bucket is walked are skipped.  The lockless
+ * walk can miss an inode hashed meanwhile, so the lookups that go on with
+ * inserting a new inode redo it with @locked.
  */
 static struct inode *find_inode_fast(struct super_block *sb,
-				struct hlist_head *head, unsigned long ino)
+				struct hlist_bl_head *head, unsigned long ino,
+				bool locked)
 {
+	struct hlist_bl_node *node;
 	struct inode *inode = NULL;
 
 repeat:
-	hlist_for_each_entry(inode, head, i_hash) {
+	hlist_bl_for_each_entry_rcu(inode, node, head, i_hash) {
 		if (inode->i_ino != ino)
 			continue;
 		if (inode->i_sb != sb)
 			continue;
 		spin_lock(&inode->i_lock);
+		if (!locked && unlikely(inode_unhashed(inode))) {
+			spin_unlock(&inode->i_lock);
+			continue;
+		}
 		if (inode->i_state & (I_FREEING|I_WILL_FREE)) {
-			__wait_on_freeing_inode(inode);
+			__wait_on_freeing_inode(inode, head, locked);
 			goto repeat;
 		}
 		__iget(inode);
@@ -1015,19 +1061,19 @@ EXPORT_SYMBOL(unlock_two_nondirectories);
  * hashed, and with the I_NEW flag set. The file system gets to fill it in
  * before unlocking it via unlock_new_inode().
  *
- * Note both @test and @set are called with the inode_hash_lock held, so can't
- * sleep.
+ * Note both @test and @set are called with the lock of the hash bucket held,
+ * so can't sleep.
  */
 struct inode *iget5_locked(struct super_block *sb, unsigned long hashval,
 		int (*test)(struct inode *, void *),
 		int (*set)(struct inode *, void *), void *data)
 {
-	struct hlist_head *head = inode_hashtable + hash(sb, hashval);
+	struct hlist_bl_head *head = i_hash_head(sb, hashval);
 	struct inode *inode;
 again:
-	spin_lock(&inode_hash_lock);
+	hlist_bl_lock(head);
 	inode = find_inode(sb, head, test, data);
-	spin_unlock(&inode_hash_lock);
+	hlist_bl_unlock(head);
 
 	if (inode) {
 		wait_on_inode(inode);
@@ -1042,7 +1088,7 @@ struct inode *iget5_locked(struct super_block *sb, unsigned long hashval,
 	if (inode) {
 		struct inode *old;
 
-		spin_lock(&inode_hash_lock);
+		hlist_bl_lock(head);
 		/* We released the lock, so.. */
 		old = find_inode(sb, head, test, data);
 		if (!old) {
@@ -1051,10 +1097,10 @@ struct inode *iget5_locked(struct super_block *sb, unsigned long hashval,
 
 			spin_lock(&inode->i_lock);
 			inode->i_state = I_NEW;
-			hlist_add_head(&inode->i_hash, head);
+			__inode_hash_add(inode, head);
 			spin_unlock(&inode->i_lock);
 			inode_sb_list_add(inode);
-			spin_unlock(&inode_hash_lock);
+			hlist_bl_unlock(head);
 
 			/* Return the locked inode with I_NEW set, the
 			 * caller is responsible for filling in the contents
@@ -1067,7 +1113,7 @@ struct inode *iget5_locked(struct super_block *sb, unsigned long hashval,
 		 * us. Use the old inode instead of the one we just
 		 * allocated.
 		 */
-		spin_unlock(&inode_hash_lock);
+		hlist_bl_unlock(head);
 		destroy_inode(inode);
 		inode = old;
 		wait_on_inode(inode);
@@ -1079,7 +1125,7 @@ struct inode *iget5_locked(struct super_block *sb, unsigned long hashval,
 	return inode;
 
 set_failed:
-	spin_unlock(&inode_hash_lock);
+	hlist_bl_unlock(head);
 	destroy_inode(inode);
 	return NULL;
 }
@@ -1100,12 +1146,12 @@ EXPORT_SYMBOL(iget5_locked);
  */
 struct inode *iget_locked(struct super_block *sb, unsigned long ino)
 {
-	struct hlist_head *head = inode_hashtable + hash(sb, ino);
+	struct hlist_bl_head *head = i_hash_head(sb, ino);
 	struct inode *inode;
 again:
-	spin_lock(&inode_hash_lock);
-	inode = find_inode_fast(sb, head, ino);
-	spin_unlock(&inode_hash_lock);
+	rcu_read_lock();
+	inode = find_inode_fast(sb, head, ino, false);
+	rcu_read_unlock();
 	if (inode) {
 		wait_on_inode(inode);
 		if (unlikely(inode_unhashed(inode))) {
@@ -1119,17 +1165,17 @@ struct inode *iget_locked(struct super_block *sb, unsigned long ino)
 	if (inode) {
 		struct inode *old;
 
-		spin_lock(&inode_hash_lock);
-		/* We released the lock, so.. */
-		old = find_inode_fast(sb, head, ino);
+		hlist_bl_lock(head);
+		/* We did not hold the lock, so.. */
+		old = find_inode_fast(sb, head, ino, true);
 		if (!old) {
 			inode->i_ino = ino;
 			spin_lock(&inode->i_lock);
 			inode->i_state = I_NEW;
-			hlist_add_head(&inode->i_hash, head);
+			__inode_hash_add(inode, head);
 			spin_unlock(&inode->i_lock);
 			inode_sb_list_add(inode);
-			spin_unlock(&inode_hash_lock);
+			hlist_bl_unlock(head);
 
 			/* Return the locked inode with I_NEW set, the
 			 * caller is responsible for filling in the contents
@@ -1142,7 +1188,7 @@ struct inode *iget_locked(struct super_block *sb, unsigned long ino)
 		 * us. Use the old inode instead of the one we just
 		 * allocated.
 		 */
-		spin_unlock(&inode_hash_lock);
+		hlist_bl_unlock(head);
 		destroy_inode(inode);
 		inode = old;
 		wait_on_inode(inode);
@@ -1164,17 +1210,18 @@ EXPORT_SYMBOL(iget_locked);
  */
 static int test_inode_iunique(struct super_block *sb, unsigned long ino)
 {
-	struct hlist_head *b = inode_hashtable + hash(sb, ino);
+	struct hlist_bl_head *b = i_hash_head(sb, ino);
+	struct hlist_bl_node *node;
 	struct inode *inode;
 
-	spin_lock(&inode_hash_lock);
-	hlist_for_each_entry(inode, b, i_hash) {
+	rcu_read_lock();
+	hlist_bl_for_each_entry_rcu(inode, node, b, i_hash) {
 		if (inode->i_ino == ino && inode->i_sb == sb) {
-			spin_unlock(&inode_hash_lock);
+			rcu_read_unlock();
 			return 0;
 		}
 	}
-	spin_unlock(&inode_hash_lock);
+	rcu_read_unlock();
 
 	return 1;
 }
@@ -1249,17 +1296,18 @@ EXPORT_SYMBOL(igrab);
  * Note: I_NEW is not waited upon so you have to be very careful what you do
  * with the returned inode.  You probably should be using ilookup5() instead.
  *
- * Note2: @test is called with the inode_hash_lock held, so can't sleep.
+ * Note2: @test is called with the lock of the hash bucket held, so can't
+ * sleep.
  */
 struct inode *ilookup5_nowait(struct super_block *sb, unsigned long hashval,
 		int (*test)(struct inode *, void *), void *data)
 {
-	struct hlist_head *head = inode_hashtable + hash(sb, hashval);
+	struct hlist_bl_head *head = i_hash_head(sb, hashval);
 	struct inode *inode;
 
-	spin_lock(&inode_hash_lock);
+	hlist_bl_lock(head);
 	inode = find_inode(sb, head, test, data);
-	spin_unlock(&inode_hash_lock);
+	hlist_bl_unlock(head);
 
 	return inode;
 }
@@ -1280,7 +1328,7 @@ EXPORT_SYMBOL(ilookup5_nowait);
  * This is a generalized version of ilookup() for file systems where the
  * inode number is not sufficient for unique identification of an inode.
  *
- * Note: @test is called with the inode_hash_lock held, so can't sleep.
+ * Note: @test is called with the lock of the hash bucket held, so can't sleep.
  */
 struct inode *ilookup5(struct super_block *sb, unsigned long hashval,
 		int (*test)(struct inode *, void *), void *data)
@@ -1309,12 +1357,12 @@ EXPORT_SYMBOL(ilookup5);
  */
 struct inode *ilookup(struct super_block *sb, unsigned long ino)
 {
-	struct hlist_head *head = inode_hashtable + hash(sb, ino);
+	struct hlist_bl_head *head = i_hash_head(sb, ino);
 	struct inode *inode;
 again:
-	spin_lock(&inode_hash_lock);
-	inode = find_inode_fast(sb, head, ino);
-	spin_unlock(&inode_hash_lock);
+	rcu_read_lock();
+	inode = find_inode_fast(sb, head, ino, false);
+	rcu_read_unlock();
 
 	if (inode) {
 		wait_on_inode(inode);
@@ -1341,7 +1389,7 @@ EXPORT_SYMBOL(ilookup);
  * taking the i_lock spin_lock and checking i_state for an inode being
  * freed or being initialized, and incrementing the reference count
  * before returning 1.  It also must not sleep, since it is called with
- * the inode_hash_lock spinlock held.
+ * the lock of the hash bucket held.
  *
  * This is a even more generalized version of ilookup5() when the
  * function must never block --- find_inode() can block in
@@ -1356,12 +1404,13 @@ struct inode *find_inode_nowait(struct super_block *sb,
 					     void *),
 				void *data)
 {
-	struct hlist_head *head = inode_hashtable + hash(sb, hashval);
+	struct hlist_bl_head *head = i_hash_head(sb, hashval);
 	struct inode *inode, *ret_inode = NULL;
+	struct hlist_bl_node *node;
 	int mval;
 
-	spin_lock(&inode_hash_lock);
-	hlist_for_each_entry(inode, head, i_hash) {
+	hlist_bl_lock(head);
+	hlist_bl_for_each_entry(inode, node, head, i_hash) {
 		if (inode->i_sb != sb)
 			continue;
 		mval = match(inode, hashval, data);
@@ -1372,7 +1421,7 @@ struct inode *find_inode_nowait(struct super_block *sb,
 		goto out;
 	}
 out:
-	spin_unlock(&inode_hash_lock);
+	hlist_bl_unlock(head);
 	return ret_inode;
 }
 EXPORT_SYMBOL(find_inode_nowait);
@@ -1381,12 +1430,14 @@ int insert_inode_locked(struct inode *inode)
 {
 	struct super_block *sb = inode->i_sb;
 	ino_t ino = inode->i_ino;
-	struct hlist_head *head = inode_hashtable + hash(sb, ino);
+	struct hlist_bl_head *head = i_hash_head(sb, ino);
 
 	while (1) {
+		struct hlist_bl_node *node;
 		struct inode *old = NULL;
-		spin_lock(&inode_hash_lock);
-		hlist_for_each_entry(old, head, i_hash) {
+
+		hlist_bl_lock(head);
+		hlist_bl_for_each_entry(old, node, head, i_hash) {
 			if (old->i_ino != ino)
 				continue;
 			if (old->i_sb != sb)
@@ -1401,14 +1452,14 @@ int insert_inode_locked(struct inode *inode)
 		if (likely(!old)) {
 			spin_lock(&inode->i_lock);
 			inode->i_state |= I_NEW;
-			hlist_add_head(&inode->i_hash, head);
+			__inode_hash_add(inode, head);
 			spin_unlock(&inode->i_lock);
-			spin_unlock(&inode_hash_lock);
+			hlist_bl_unlock(head);
 			return 0;
 		}
 		__iget(old);
 		spin_unlock(&old->i_lock);
-		spin_unlock(&inode_hash_lock);
+		hlist_bl_unlock(head);
 		wait_on_inode(old);
 		if (unlikely(!inode_unhashed(old))) {
 			iput(old);
@@ -1423,13 +1474,14 @@ int insert_inode_locked4(struct inode *inode, unsigned long hashval,
 		int (*test)(struct inode *, void *), void *data)
 {
 	struct super_block *sb = inode->i_sb;
-	struct hlist_head *head = inode_hashtable + hash(sb, hashval);
+	struct hlist_bl_head *head = i_hash_head(sb, hashval);
 
 	while (1) {
+		struct hlist_bl_node *node;
 		struct inode *old = NULL;
 
-		spin_lock(&inode_hash_lock);
-		hlist_for_each_entry(old, head, i_hash) {
+		hlist_bl_lock(head);
+		hlist_bl_for_each_entry(old, node, head, i_hash) {
 			if (old->i_sb != sb)
 				continue;
 			if (!test(old, data))
@@ -1444,14 +1496,14 @@ int insert_inode_locked4(struct inode *inode, unsigned long hashval,
 		if (likely(!old)) {
 			spin_lock(&inode->i_lock);
 			inode->i_state |= I_NEW;
-			hlist_add_head(&inode->i_hash, head);
+			__inode_hash_add(inode, head);
 			spin_unlock(&inode->i_lock);
-			spin_unlock(&inode_hash_lock);
+			hlist_bl_unlock(head);
 			return 0;
 		}
 		__iget(old);
 		spin_unlock(&old->i_lock);
-		spin_unlock(&inode_hash_lock);
+		hlist_bl_unlock(head);
 		wait_on_inode(old);
 		if (unlikely(!inode_unhashed(old))) {
 			iput(old);
@@ -1901,17 +1953,24 @@ EXPORT_SYMBOL(inode_needs_sync);
  * wake_up_bit(&inode->i_state, __I_NEW) after removing from the hash list
  * will DTRT.
  */
-static void __wait_on_freeing_inode(struct inode *inode)
+static void __wait_on_freeing_inode(struct inode *inode,
+				    struct hlist_bl_head *head, bool locked)
 {
 	wait_queue_head_t *wq;
 	DEFINE_WAIT_BIT(wait, &inode->i_state, __I_NEW);
 	wq = bit_waitqueue(&inode->i_state, __I_NEW);
 	prepare_to_wait(wq, &wait.wq_entry, TASK_UNINTERRUPTIBLE);
 	spin_unlock(&inode->i_lock);
-	spin_unlock(&inode_hash_lock);
+	if (locked)
+		hlist_bl_unlock(head);
+	else
+		rcu_read_unlock();
 	schedule();
 	finish_wait(wq, &wait.wq_entry);
-	spin_lock(&inode_hash_lock);
+	if (locked)
+		hlist_bl_lock(head);
+	else
+		rcu_read_lock();
 }
 
 static __initdata unsigned long ihash_entries;
@@ -1937,7 +1996,7 @@ void __init inode_init_early(void)
 
 	inode_hashtable =
 		alloc_large_system_hash("Inode-cache",
-					sizeof(struct hlist_head),
+					sizeof(struct hlist_bl_head),
 					ihash_entries,
 					14,
 					HASH_EARLY | HASH_ZERO,
@@ -1963,7 +2022,7 @@ void __init inode_init(void)
 
 	inode_hashtable =
 		alloc_large_system_hash("Inode-cache",
-					sizeof(struct hlist_head),
+					sizeof(struct hlist_bl_head),
 					ihash_entries,
 					14,
 					HASH_ZERO,
@@ -114,10 +114,16 @@ extern int open_check_o_direct(struct file *f);
 extern int vfs_open(const struct path *, struct file *, const struct cred *);
 extern struct file *filp_clone_open(struct file *);
 
+/*
+ * drop_caches.c
+ */
+extern void drop_caches_sb(struct super_block *sb, int mode);
+
 /*
  * inode.c
  */
 extern long prune_icache_sb(struct super_block *sb, struct shrink_control *sc);
+extern long prune_icache_sb_all(struct super_block *sb);
 extern void inode_add_lru(struct inode *inode);
 extern int dentry_needs_remove_privs(struct dentry *dentry);
 
@@ -144,6 +150,11 @@ extern int d_set_mounted(struct dentry *dentry);
 extern long prune_dcache_sb(struct super_block *sb, struct shrink_control *sc);
 extern struct dentry *d_alloc_cursor(struct dentry *);
 
+/*
+ * stat.c
+ */
+extern int cp_statx(const struct kstat *stat, struct statx __user *buffer);
+
 /*
  * read_write.c
  */
@@ -575,6 +575,27 @@ static int ioctl_fsthaw(struct file *filp)
 	return thaw_super(sb);
 }
 
+static int ioctl_fsdropcaches(struct file *filp, int __user *argp)
+{
+	struct super_block *sb = file_inode(filp)->i_sb;
+	int mode;
+
+	if (!capable(CAP_SYS_ADMIN))
+		return -EPERM;
+
+	if (get_user(mode, argp))
+		return -EFAULT;
+
+	/* As the drop_caches sysctl: 1 page cache, 2 dentries and inodes */
+	if (mode < 1 || mode > 3)
+		return -EINVAL;
+
+	down_read(&sb->s_umount);
+	drop_caches_sb(sb, mode);
+	up_read(&sb->s_umount);
+	return 0;
+}
+
 static int ioctl_file_dedupe_range(struct file *file, void __user *arg)
 {
 	struct file_dedupe_range __user *argp = arg;
@@ -664,6 +685,10 @@ int do_vfs_ioctl(struct file *filp, unsigned int fd, unsigned int cmd,
 		error = ioctl_fsthaw(filp);
 		break;
 
+	case FIDROPCACHES:
+		error = ioctl_fsdropcaches(filp, argp);
+		break;
+
 	case FS_IOC_FIEMAP:
 		return ioctl_fiemap(filp, arg);
 
@@ -685,6 +685,8 @@ EXPORT_SYMBOL_GPL(iomap_seek_data);
 #define IOMAP_DIO_WRITE		(1 << 30)
 #define IOMAP_DIO_DIRTY		(1 << 31)
 
+static struct bio_set *iomap_dio_bio_set __read_mostly;
+
 struct iomap_dio {
 	struct kiocb		*iocb;
 	iomap_dio_end_io_t	*end_io;
@@ -827,7 +829,7 @@ iomap_dio_zero(struct iomap_dio *dio, struct iomap *iomap, loff_t pos,
 	struct page *page = ZERO_PAGE(0);
 	struct bio *bio;
 
-	bio = bio_alloc(GFP_KERNEL, 1);
+	bio = bio_alloc_bioset(GFP_KERNEL, 1, iomap_dio_bio_set);
 	bio_set_dev(bio, iomap->bdev);
 	bio->bi_iter.bi_sector =
 		iomap->blkno + ((pos - iomap->offset) >> 9);
@@ -906,7 +908,7 @@ iomap_dio_actor(struct inode *inode, loff_t pos, loff_t length,
 		if (dio->error)
 			return 0;
 
-		bio = bio_alloc(GFP_KERNEL, nr_pages);
+		bio = bio_alloc_bioset(GFP_KERNEL, nr_pages, iomap_dio_bio_set);
 		bio_set_dev(bio, iomap->bdev);
 		bio->bi_iter.bi_sector =
 			iomap->blkno + ((pos - iomap->offset) >> 9);
@@ -928,6 +930,8 @@ iomap_dio_actor(struct inode *inode, loff_t pos, loff_t length,
 			if (dio->flags & IOMAP_DIO_DIRTY)
 				bio_set_pages_dirty(bio);
 		}
+		if (dio->iocb->ki_flags & IOCB_HIPRI)
+			bio->bi_opf |= REQ_HIPRI;
 
 		dio->size += bio->bi_iter.bi_size;
 		pos += bio->bi_iter.bi_size;
@@ -1072,3 +1076,13 @@ iomap_dio_rw(struct kiocb *iocb, struct iov_iter *iter,
 	return ret;
 }
 EXPORT_SYMBOL_GPL(iomap_dio_rw);
+
+static int __init iomap_dio_init(void)
+{
+	iomap_dio_bio_set = bioset_create(4, 0,
+				BIOSET_NEED_BVECS | BIOSET_PERCPU_CACHE);
+	if (!iomap_dio_bio_set)
+		return -ENOMEM;
+	return 0;
+}
+fs_initcall(iomap_dio_init);
@@ -101,6 +101,14 @@ EXPORT_SYMBOL(jbd2_journal_init_jbd_inode);
 EXPORT_SYMBOL(jbd2_journal_release_jbd_inode);
 EXPORT_SYMBOL(jbd2_journal_begin_ordered_truncate);
 EXPORT_SYMBOL(jbd2_inode_cache);
+EXPORT_SYMBOL(jbd2_fc_init);
+EXPORT_SYMBOL(jbd2_fc_begin_commit);
+EXPORT_SYMBOL(jbd2_fc_get_buf);
+EXPORT_SYMBOL(jbd2_fc_write_bufs);
+EXPORT_SYMBOL(jbd2_fc_end_commit);
+EXPORT_SYMBOL(jbd2_fc_end_commit_fallback);
+EXPORT_SYMBOL(jbd2_fc_read_block);
+EXPORT_SYMBOL(jbd2_fc_replay_done);
 
 static void __journal_abort_soft (journal_t *journal, int errno);
 static int jbd2_journal_create_slab(size_t slab_size);
@@ -1132,6 +1140,7 @@ static journal_t *journal_init_common(struct block_device *bdev,
 	init_waitqueue_head(&journal->j_wait_commit);
 	init_waitqueue_head(&journal->j_wait_updates);
 	init_waitqueue_head(&journal->j_wait_reserved);
+	init_waitqueue_head(&journal->j_fc_wait);
 	mutex_init(&journal->j_barrier);
 	mutex_init(&journal->j_checkpoint_mutex);
 	spin_lock_init(&journal->j_revoke_lock);
@@ -1169,6 +1178,10 @@ static journal_t *journal_init_common(struct block_device *bdev,
 	if (!journal->j_wbuf)
 		goto err_cleanup;
 
+	journal->j_pcpu_handles = alloc_percpu(struct jbd2_pcpu_handles);
+	if (!journal->j_pcpu_handles)
+		goto err_cleanup;
+
 	bh = getblk_unmovable(journal->j_dev, start, journal->j_blocksize);
 	if (!bh) {
 		pr_err("%s: Cannot get buffer for journal superblock\n",
@@ -1181,6 +1194,7 @@ static journal_t *journal_init_common(struct block_device *bdev,
 	return journal;
 
 err_cleanup:
+	free_percpu(journal->j_pcpu_handles);
 	kfree(journal->j_wbuf);
 	jbd2_journal_destroy_revoke(journal);
 	kfree(journal);
@@ -1279,6 +1293,21 @@ static void journal_fail_superblock (journal_t *journal)
 	journal->j_sb_buffer = NULL;
 }
 
+/*
+ * The fast commit area takes the end of the journal, the log wraps before
+ * it.  Returns the block one beyond the last block of the log.
+ */
+static unsigned long journal_log_end(journal_t *journal)
+{
+	journal_superblock_t *sb = journal->j_superblock;
+
+	journal->j_fc_last = be32_to_cpu(sb->s_maxlen);
+	journal->j_fc_first = journal->j_fc_last;
+	if (jbd2_has_feature_fast_commit(journal))
+		journal->j_fc_first -= be32_to_cpu(sb->s_num_fc_blks);
+	return journal->j_fc_first;
+}
+
 /*
  * Given a journal_t structure, initialise the various fields for
  * startup of a new journaling session.  We use this both when creating
@@ -1292,7 +1321,7 @@ static int journal_reset(journal_t *journal)
 	unsigned long long first, last;
 
 	first = be32_to_cpu(sb->s_first);
-	last = be32_to_cpu(sb->s_maxlen);
+	last = journal_log_end(journal);
 	if (first + JBD2_MIN_JOURNAL_BLOCKS > last + 1) {
 		printk(KERN_ERR "JBD2: Journal too short (blocks %llu-%llu).\n",
 		       first, last);
@@ -1312,6 +1341,10 @@ static int journal_reset(journal_t *journal)
 	journal->j_commit_request = journal->j_commit_sequence;
 
 	journal->j_max_transaction_buffers = journal->j_maxlen / 4;
+	/* At most an eighth of a transaction sits in the per-cpu pools */
+	journal->j_pcpu_batch = min_t(int, JBD2_PCPU_BATCH_MAX,
+				      journal->j_max_transaction_buffers /
+				      (8 * num_possible_cpus()));
 
 	/*
 	 * As a special case, if the on-disk copy is already marked as needing
@@ -1544,6 +1577,15 @@ static int journal_get_superblock(journal_t *journal)
 		goto out;
 	}
 
+	if (jbd2_has_feature_fast_commit(journal) &&
+	    be32_to_cpu(sb->s_num_fc_blks) >=
+	    journal->j_maxlen - be32_to_cpu(sb->s_first)) {
+		printk(KERN_WARNING
+			"JBD2: Invalid fast commit area of journal: %u\n",
+			be32_to_cpu(sb->s_num_fc_blks));
+		goto out;
+	}
+
 	if (jbd2_has_feature_csum2(journal) &&
 	    jbd2_has_feature_csum3(journal)) {
 		/* Can't have checksum v2 and v3 at the same time! */
@@ -1616,7 +1658,7 @@ static int load_superblock(journal_t *journal)
 	journal->j_tail_sequence = be32_to_cpu(sb->s_sequence);
 	journal->j_tail = be32_to_cpu(sb->s_start);
 	journal->j_first = be32_to_cpu(sb->s_first);
-	journal->j_last = be32_to_cpu(sb->s_maxlen);
+	journal->j_last = journal_log_end(journal);
 	journal->j_errno = be32_to_cpu(sb->s_errno);
 
 	return 0;
@@ -1689,6 +1731,324 @@ int jbd2_journal_load(journal_t *journal)
 	return -EIO;
 }
 
+/**
+ * int jbd2_fc_init() - Set up the fast commits of a journal.
+ * @journal: Journal to act on.
+ * @nblks: Number of blocks of the fast commit area
+ *
+ * The fast commits are written in an area at the end of the journal, out
+ * of the log, with the blocks of the fast commits of the running
+ * transaction one after the other.  If the journal has no such area yet,
+ * its @nblks last blocks are taken for it, which needs the journal to be
+ * empty, as it is just after it is loaded.
+ */
+int jbd2_fc_init(journal_t *journal, unsigned int nblks)
+{
+	journal_superblock_t *sb = journal->j_superblock;
+	struct buffer_head **wbuf;
+	int ret;
+
+	if (journal->j_fc_wbuf)
+		return 0;
+	if (journal->j_format_version < 2)
+		return -EINVAL;
+
+	if (!jbd2_has_feature_fast_commit(journal)) {
+		if (!nblks || journal->j_last - journal->j_first <
+		    nblks + JBD2_MIN_JOURNAL_BLOCKS)
+			return -ENOSPC;
+
+		mutex_lock_io(&journal->j_checkpoint_mutex);
+		write_lock(&journal->j_state_lock);
+		if (journal->j_running_transaction ||
+		    journal->j_committing_transaction ||
+		    journal->j_free != journal->j_last - journal->j_first) {
+			write_unlock(&journal->j_state_lock);
+			mutex_unlock(&journal->j_checkpoint_mutex);
+			return -EBUSY;
+		}
+		journal->j_last -= nblks;
+		journal->j_free -= nblks;
+		journal->j_fc_first = journal->j_last;
+		journal->j_head = journal->j_tail = journal->j_first;
+		sb->s_num_fc_blks = cpu_to_be32(nblks);
+		jbd2_set_feature_fast_commit(journal);
+		write_unlock(&journal->j_state_lock);
+
+		/* The log restarts at j_first, before the new area */
+		if (sb->s_start)
+			ret = jbd2_journal_update_sb_log_tail(journal,
+						journal->j_tail_sequence,
+						journal->j_tail,
+						REQ_SYNC | REQ_FUA);
+		else
+			ret = jbd2_write_superblock(journal,
+						    REQ_SYNC | REQ_FUA);
+		mutex_unlock(&journal->j_checkpoint_mutex);
+		if (ret)
+			return ret;
+		printk(KERN_INFO "JBD2: %u blocks of %s for fast commits\n",
+		       nblks, journal->j_devname);
+	}
+
+	wbuf = kcalloc(journal->j_fc_last - journal->j_fc_first,
+		       sizeof(struct buffer_head *), GFP_KERNEL);
+	if (!wbuf)
+		return -ENOMEM;
+	journal->j_fc_wbuf = wbuf;
+	return 0;
+}
+
+/**
+ * int jbd2_fc_begin_commit() - Start a fast commit.
+ * @journal: Journal to act on.
+ * @tid: Transaction the fast commit is for
+ *
+ * Waits for the other fast commits and for the full commits.  Returns
+ * -EALREADY if @tid was committed meanwhile, or another error if @tid can't
+ * be fast committed, in which case the caller should wait for its full
+ * commit.
+ */
+int jbd2_fc_begin_commit(journal_t *journal, tid_t tid)
+{
+	if (!journal->j_fc_wbuf)
+		return -EINVAL;
+
+	write_lock(&journal->j_state_lock);
+	while (journal->j_flags &
+	       (JBD2_FAST_COMMIT_ONGOING | JBD2_FULL_COMMIT_ONGOING)) {
+		DEFINE_WAIT(wait);
+
+		prepare_to_wait(&journal->j_fc_wait, &wait,
+				TASK_UNINTERRUPTIBLE);
+		write_unlock(&journal->j_state_lock);
+		schedule();
+		write_lock(&journal->j_state_lock);
+		finish_wait(&journal->j_fc_wait, &wait);
+	}
+	if (tid_geq(journal->j_commit_sequence, tid)) {
+		write_unlock(&journal->j_state_lock);
+		return -EALREADY;
+	}
+	if (is_journal_aborted(journal) || !journal->j_running_transaction ||
+	    journal->j_running_transaction->t_tid != tid) {
+		write_unlock(&journal->j_state_lock);
+		return -EINVAL;
+	}
+	journal->j_flags |= JBD2_FAST_COMMIT_ONGOING;
+	journal->j_fc_tid = tid;
+	journal->j_fc_nbufs = 0;
+	write_unlock(&journal->j_state_lock);
+
+	/*
+	 * Like the commits do (the full commits wait for us), tell the
+	 * recovery to look at the journal again after a jbd2_journal_flush().
+	 */
+	if (journal->j_flags & JBD2_FLUSHED) {
+		mutex_lock_io(&journal->j_checkpoint_mutex);
+		jbd2_journal_update_sb_log_tail(journal,
+						journal->j_tail_sequence,
+						journal->j_tail,
+						REQ_SYNC | REQ_FUA);
+		mutex_unlock(&journal->j_checkpoint_mutex);
+	}
+	return 0;
+}
+
+/**
+ * int jbd2_fc_get_buf() - Get the next block of a fast commit.
+ * @journal: Journal to act on.
+ * @bh_out: Returns the buffer
+ *
+ * The buffer is zeroed but for its journal_header_t, which has block type
+ * JBD2_FC_BLOCK and the tid of the fast commit.  Returns -ENOSPC once the
+ * fast commit area is full.
+ */
+int jbd2_fc_get_buf(journal_t *journal, struct buffer_head **bh_out)
+{
+	unsigned long blocknr = journal->j_fc_first + journal->j_fc_off +
+				journal->j_fc_nbufs;
+	unsigned long long pblock;
+	struct buffer_head *bh;
+	journal_header_t *header;
+	int ret;
+
+	if (blocknr >= journal->j_fc_last)
+		return -ENOSPC;
+	ret = jbd2_journal_bmap(journal, blocknr, &pblock);
+	if (ret)
+		return ret;
+	bh = __getblk(journal->j_dev, pblock, journal->j_blocksize);
+	if (!bh)
+		return -ENOMEM;
+
+	lock_buffer(bh);
+	memset(bh->b_data, 0, journal->j_blocksize);
+	header = (journal_header_t *)bh->b_data;
+	header->h_magic = cpu_to_be32(JBD2_MAGIC_NUMBER);
+	header->h_blocktype = cpu_to_be32(JBD2_FC_BLOCK);
+	header->h_sequence = cpu_to_be32(journal->j_fc_tid);
+	set_buffer_uptodate(bh);
+	unlock_buffer(bh);
+
+	journal->j_fc_wbuf[journal->j_fc_nbufs++] = bh;
+	*bh_out = bh;
+	return 0;
+}
+
+static void jbd2_fc_submit_buf(struct buffer_head *bh, int write_flags)
+{
+	lock_buffer(bh);
+	clear_buffer_dirty(bh);
+	get_bh(bh);
+	bh->b_end_io = end_buffer_write_sync;
+	submit_bh(REQ_OP_WRITE, write_flags, bh);
+}
+
+static void jbd2_fc_release_bufs(journal_t *journal)
+{
+	int i;
+
+	for (i = 0; i < journal->j_fc_nbufs; i++) {
+		brelse(journal->j_fc_wbuf[i]);
+		journal->j_fc_wbuf[i] = NULL;
+	}
+}
+
+/**
+ * int jbd2_fc_write_bufs() - Write the blocks of a fast commit.
+ * @journal: Journal to act on.
+ *
+ * The data of the fast committed inodes must have been written.  The last
+ * block is written with a cache flush and FUA once the others are done, so
+ * that the fast commit is stable on return.
+ */
+int jbd2_fc_write_bufs(journal_t *journal)
+{
+	struct buffer_head *bh;
+	int last = journal->j_fc_nbufs - 1;
+	int write_flags = REQ_SYNC;
+	int i, ret = 0;
+
+	if (last < 0)
+		return 0;
+
+	for (i = 0; i < last; i++)
+		jbd2_fc_submit_buf(journal->j_fc_wbuf[i], REQ_SYNC);
+	for (i = 0; i < last; i++) {
+		wait_on_buffer(journal->j_fc_wbuf[i]);
+		if (!buffer_uptodate(journal->j_fc_wbuf[i]))
+			ret = -EIO;
+	}
+
+	if (!ret) {
+		if (journal->j_flags & JBD2_BARRIER) {
+			if (journal->j_fs_dev != journal->j_dev)
+				blkdev_issue_flush(journal->j_fs_dev,
+						   GFP_NOFS, NULL);
+			write_flags |= REQ_PREFLUSH | REQ_FUA;
+		}
+		bh = journal->j_fc_wbuf[last];
+		jbd2_fc_submit_buf(bh, write_flags);
+		wait_on_buffer(bh);
+		if (!buffer_uptodate(bh))
+			ret = -EIO;
+	}
+	if (ret)
+		jbd2_journal_abort(journal, ret);
+	return ret;
+}
+
+/**
+ * void jbd2_fc_end_commit() - End a fast commit.
+ * @journal: Journal to act on.
+ *
+ * Ends a successful fast commit, its blocks stay in the fast commit area
+ * until the full commit of its transaction.
+ */
+void jbd2_fc_end_commit(journal_t *journal)
+{
+	jbd2_fc_release_bufs(journal);
+
+	write_lock(&journal->j_state_lock);
+	journal->j_fc_off += journal->j_fc_nbufs;
+	journal->j_fc_nbufs = 0;
+	journal->j_flags &= ~JBD2_FAST_COMMIT_ONGOING;
+	write_unlock(&journal->j_state_lock);
+	wake_up(&journal->j_fc_wait);
+}
+
+/**
+ * void jbd2_fc_end_commit_fallback() - Give up a fast commit.
+ * @journal: Journal to act on.
+ *
+ * The blocks of the fast commit are dropped, the caller must wait for the
+ * full commit of the transaction instead.
+ */
+void jbd2_fc_end_commit_fallback(journal_t *journal)
+{
+	jbd2_fc_release_bufs(journal);
+
+	write_lock(&journal->j_state_lock);
+	journal->j_fc_nbufs = 0;
+	journal->j_flags &= ~JBD2_FAST_COMMIT_ONGOING;
+	write_unlock(&journal->j_state_lock);
+	wake_up(&journal->j_fc_wait);
+}
+
+/**
+ * struct buffer_head *jbd2_fc_read_block() - Read a fast commit block.
+ * @journal: Journal to act on.
+ * @off: Offset of the block in the fast commit area
+ *
+ * Returns NULL past the fast commit blocks found by the recovery, or on
+ * error.
+ */
+struct buffer_head *jbd2_fc_read_block(journal_t *journal, unsigned long off)
+{
+	unsigned long long pblock;
+
+	if (off >= journal->j_fc_replay_blocks)
+		return NULL;
+	if (jbd2_journal_bmap(journal, journal->j_fc_first + off, &pblock))
+		return NULL;
+	return __bread(journal->j_dev, pblock, journal->j_blocksize);
+}
+
+/**
+ * int jbd2_fc_replay_done() - Invalidate the replayed fast commits.
+ * @journal: Journal to act on.
+ *
+ * To be called once the fast commits found by the recovery are replayed
+ * and their effect is stable, typically after a jbd2_journal_flush().
+ */
+int jbd2_fc_replay_done(journal_t *journal)
+{
+	unsigned long long pblock;
+	struct buffer_head *bh;
+	int ret;
+
+	if (!journal->j_fc_replay_blocks)
+		return 0;
+	ret = jbd2_journal_bmap(journal, journal->j_fc_first, &pblock);
+	if (ret)
+		return ret;
+	bh = __getblk(journal->j_dev, pblock, journal->j_blocksize);
+	if (!bh)
+		return -ENOMEM;
+
+	lock_buffer(bh);
+	memset(bh->b_data, 0, journal->j_blocksize);
+	set_buffer_uptodate(bh);
+	unlock_buffer(bh);
+	mark_buffer_dirty(bh);
+	ret = sync_dirty_buffer(bh);
+	brelse(bh);
+	if (!ret)
+		journal->j_fc_replay_blocks = 0;
+	return ret;
+}
+
 /**
  * void jbd2_journal_destroy() - Release a journal_t structure.
  * @journal: Journal to act on.
@@ -1758,7 +2118,9 @@ int jbd2_journal_destroy(journal_t *journal)
 		jbd2_journal_destroy_revoke(journal);
 	if (journal->j_chksum_driver)
 		crypto_free_shash(journal->j_chksum_driver);
+	kfree(journal->j_fc_wbuf);
 	kfree(journal->j_wbuf);
+	free_percpu(journal->j_pcpu_handles);
 	kfree(journal);
 
 	return err;
@@ -41,6 +41,7 @@ struct recovery_info
 enum passtype {PASS_SCAN, PASS_REVOKE, PASS_REPLAY};
 static int do_one_pass(journal_t *journal,
 				struct recovery_info *info, enum passtype pass);
+static int fc_do_one_pass(journal_t *journal, tid_t tid, tid_t new_tid);
 static int scan_revoke_records(journal_t *, struct buffer_head *,
 				tid_t, struct recovery_info *);
 
@@ -283,6 +284,11 @@ int jbd2_journal_recover(journal_t *journal)
 	 * any existing commit records in the log. */
 	journal->j_transaction_sequence = ++info.end_transaction;
 
+	/* The fast commits are for the transaction that was running */
+	if (!err && jbd2_has_feature_fast_commit(journal))
+		err = fc_do_one_pass(journal, info.end_transaction - 1,
+				     info.end_transaction);
+
 	jbd2_journal_clear_revoke(journal);
 	err2 = sync_blockdev(journal->j_fs_dev);
 	if (!err)
@@ -812,6 +818,53 @@ static int do_one_pass(journal_t *journal,
 
 /* Scan a revoke record, marking all blocks mentioned as revoked. */
 
+/*
+ * Count the fast commit blocks of transaction tid, the one that was running
+ * at the crash, and stamp them with new_tid, at which the log restarts, so
+ * that they are still found if the client fs crashes while replaying them.
+ * The blocks already stamped by an interrupted recovery are counted too.
+ */
+static int fc_do_one_pass(journal_t *journal, tid_t tid, tid_t new_tid)
+{
+	unsigned long off, nblks = journal->j_fc_last - journal->j_fc_first;
+	journal_header_t *header;
+	struct buffer_head *bh;
+	tid_t sequence;
+	int err = 0;
+
+	for (off = 0; off < nblks; off++) {
+		err = jread(&bh, journal, journal->j_fc_first + off);
+		if (err)
+			break;
+		header = (journal_header_t *)bh->b_data;
+		sequence = be32_to_cpu(header->h_sequence);
+		if (header->h_magic != cpu_to_be32(JBD2_MAGIC_NUMBER) ||
+		    header->h_blocktype != cpu_to_be32(JBD2_FC_BLOCK) ||
+		    (sequence != tid && sequence != new_tid)) {
+			brelse(bh);
+			break;
+		}
+		if (sequence != new_tid) {
+			lock_buffer(bh);
+			header->h_sequence = cpu_to_be32(new_tid);
+			unlock_buffer(bh);
+			mark_buffer_dirty(bh);
+		}
+		brelse(bh);
+	}
+	if (err || !off)
+		return err;
+
+	jbd_debug(1, "JBD2: %lu fast commit blocks for transaction %u\n",
+		  off, tid);
+	journal->j_fc_replay_blocks = off;
+	err = sync_blockdev(journal->j_dev);
+	if (!err && journal->j_dev != journal->j_fs_dev &&
+	    (journal->j_flags & JBD2_BARRIER))
+		err = blkdev_issue_flush(journal->j_dev, GFP_KERNEL, NULL);
+	return err;
+}
+
 static int scan_revoke_records(journal_t *journal, struct buffer_head *bh,
 			       tid_t sequence, struct recovery_info *info)
 {
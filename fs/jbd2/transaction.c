@@ -43,7 +43,8 @@ int __init jbd2_journal_init_transaction_cache(void)
 	transaction_cache = kmem_cache_create("jbd2_transaction_s",
 					sizeof(transaction_t),
 					0,
-					SLAB_HWCACHE_ALIGN|SLAB_TEMPORARY,
+					SLAB_HWCACHE_ALIGN|SLAB_TEMPORARY|
+					SLAB_TYPESAFE_BY_RCU,
 					NULL);
 	if (transaction_cache)
 		return 0;
@@ -100,12 +101,14 @@ jbd2_get_transaction(journal_t *journal, transaction_t *transaction)
 	journal->j_commit_timer.expires = round_jiffies_up(transaction->t_expires);
 	add_timer(&journal->j_commit_timer);
 
-	J_ASSERT(journal->j_running_transaction == NULL);
-	journal->j_running_transaction = transaction;
 	transaction->t_max_wait = 0;
 	transaction->t_start = jiffies;
 	transaction->t_requested = 0;
 
+	J_ASSERT(journal->j_running_transaction == NULL);
+	/* Initialized for start_this_handle_fast() */
+	smp_store_release(&journal->j_running_transaction, transaction);
+
 	return transaction;
 }
 
@@ -171,6 +174,190 @@ static void sub_reserved_credits(journal_t *journal, int blocks)
 	wake_up(&journal->j_wait_reserved);
 }
 
+/*
+ * Lockless handle start.
+ *
+ * Most handles of the running transaction are started without j_state_lock
+ * and without writing a shared cacheline: they are counted in the per-cpu
+ * updates of j_pcpu_handles instead of t_updates, and take their credits
+ * from the pool of the cpu, credits already charged to t_outstanding_credits
+ * by the slow path of start_this_handle().  jbd2_journal_updates() sums the
+ * handles for the commit and the barriers, which wait for them on
+ * j_wait_updates, and jbd2_journal_drain_pcpu() gives the unused credits
+ * of the pools back to the locked transaction once its handles are done.
+ *
+ * A handle raises its per-cpu count before looking at t_state and
+ * j_barrier_count, which are set before the counts are summed, with full
+ * barriers in between: either the handle sees the transaction locked and
+ * backs off, or the sum sees the handle.  The transactions are
+ * SLAB_TYPESAFE_BY_RCU, j_running_transaction is looked at under
+ * rcu_read_lock() and checked again after.
+ */
+static void jbd2_pcpu_put_update(journal_t *journal)
+{
+	/* The changes of the handle are done before it is seen stopped */
+	smp_mb();
+	this_cpu_dec(journal->j_pcpu_handles->updates);
+	/* Pairs with the barrier of prepare_to_wait() in the waiters */
+	if (wq_has_sleeper(&journal->j_wait_updates))
+		wake_up(&journal->j_wait_updates);
+}
+
+static bool start_this_handle_fast(journal_t *journal, handle_t *handle,
+				   int blocks)
+{
+	struct jbd2_pcpu_handles *ph;
+	transaction_t *transaction;
+	bool joined = false;
+
+	rcu_read_lock();
+	preempt_disable();
+	ph = this_cpu_ptr(journal->j_pcpu_handles);
+	ph->updates++;
+	/* Pairs with the barrier of jbd2_journal_updates() */
+	smp_mb();
+	transaction = smp_load_acquire(&journal->j_running_transaction);
+	if (transaction && READ_ONCE(transaction->t_state) == T_RUNNING &&
+	    !READ_ONCE(journal->j_barrier_count) &&
+	    !is_journal_aborted(journal) && !READ_ONCE(journal->j_errno) &&
+	    ph->credits >= blocks) {
+		/* Not freed and reused for another transaction meanwhile */
+		smp_rmb();
+		joined = READ_ONCE(journal->j_running_transaction) ==
+			 transaction;
+	}
+	if (joined) {
+		ph->credits -= blocks;
+		ph->handles++;
+	}
+	preempt_enable();
+	rcu_read_unlock();
+
+	if (!joined) {
+		jbd2_pcpu_put_update(journal);
+		return false;
+	}
+
+	handle->h_transaction = transaction;
+	handle->h_requested_credits = blocks;
+	handle->h_start_jiffies = jiffies;
+	handle->h_pcpu = 1;
+	return true;
+}
+
+/*
+ * Charge a batch of credits for the pool of this cpu to the running
+ * transaction.  Called with j_state_lock held for reading, by a handle which
+ * joined the transaction.
+ */
+static void jbd2_pcpu_refill(journal_t *journal, transaction_t *transaction)
+{
+	int batch = journal->j_pcpu_batch;
+
+	if (!batch || this_cpu_read(journal->j_pcpu_handles->credits) >= batch)
+		return;
+
+	if (atomic_add_return(batch, &transaction->t_outstanding_credits) >
+	    journal->j_max_transaction_buffers) {
+		atomic_sub(batch, &transaction->t_outstanding_credits);
+		return;
+	}
+	this_cpu_add(journal->j_pcpu_handles->credits, batch);
+}
+
+/* Give the unused credits of a handle back to its transaction */
+static void return_handle_credits(journal_t *journal, handle_t *handle)
+{
+	transaction_t *transaction = handle->h_transaction;
+	struct jbd2_pcpu_handles *ph;
+	int excess;
+
+	if (!handle->h_pcpu) {
+		atomic_sub(handle->h_buffer_credits,
+			   &transaction->t_outstanding_credits);
+		return;
+	}
+
+	/* Into the pool, which stays below two batches */
+	preempt_disable();
+	ph = this_cpu_ptr(journal->j_pcpu_handles);
+	ph->credits += handle->h_buffer_credits;
+	excess = ph->credits - 2 * journal->j_pcpu_batch;
+	if (excess > 0) {
+		ph->credits -= excess;
+		atomic_sub(excess, &transaction->t_outstanding_credits);
+	}
+	preempt_enable();
+}
+
+/*
+ * Drop a handle from the updates of its transaction, which can then commit
+ * and disappear.  Returns true if the last handle counted in t_updates went.
+ */
+static bool put_handle_update(journal_t *journal, handle_t *handle)
+{
+	transaction_t *transaction = handle->h_transaction;
+
+	if (handle->h_pcpu) {
+		handle->h_pcpu = 0;
+		jbd2_pcpu_put_update(journal);
+		return false;
+	}
+
+	if (atomic_dec_and_test(&transaction->t_updates)) {
+		wake_up(&journal->j_wait_updates);
+		return true;
+	}
+	return false;
+}
+
+/**
+ * jbd2_journal_updates() - count the handles of a transaction
+ * @journal: the journal
+ * @transaction: its running or locked transaction
+ *
+ * Exact once no handle can join @transaction anymore, because it is locked
+ * or a barrier is set: the handles backing off of it may only make the
+ * count too high for a while, and they wake up j_wait_updates.
+ */
+int jbd2_journal_updates(journal_t *journal, transaction_t *transaction)
+{
+	int cpu, updates = 0;
+
+	/* Pairs with the barrier of start_this_handle_fast() */
+	smp_mb();
+	for_each_possible_cpu(cpu)
+		updates += READ_ONCE(per_cpu_ptr(journal->j_pcpu_handles,
+						 cpu)->updates);
+	return updates + atomic_read(&transaction->t_updates);
+}
+
+/**
+ * jbd2_journal_drain_pcpu() - take the per-cpu pools back
+ * @journal: the journal
+ * @transaction: its locked transaction, without handles
+ *
+ * Gives the unused credits of the pools back to @transaction, and adds the
+ * handles started without j_state_lock to its t_handle_count.
+ */
+void jbd2_journal_drain_pcpu(journal_t *journal, transaction_t *transaction)
+{
+	struct jbd2_pcpu_handles *ph;
+	int cpu, credits = 0, handles = 0;
+
+	/* Pairs with the barrier of jbd2_pcpu_put_update() */
+	smp_mb();
+	for_each_possible_cpu(cpu) {
+		ph = per_cpu_ptr(journal->j_pcpu_handles, cpu);
+		credits += ph->credits;
+		handles += ph->handles;
+		ph->credits = 0;
+		ph->handles = 0;
+	}
+	atomic_sub(credits, &transaction->t_outstanding_credits);
+	atomic_add(handles, &transaction->t_handle_count);
+}
+
 /*
  * Wait until we can add credits for handle to the running transaction.  Called
  * with j_state_lock held for reading. Returns 0 if handle joined the running
@@ -299,6 +486,10 @@ static int start_this_handle(journal_t *journal, handle_t *handle,
 		return -ENOSPC;
 	}
 
+	if (!handle->h_reserved && !rsv_blocks &&
+	    start_this_handle_fast(journal, handle, blocks))
+		goto joined;
+
 alloc_transaction:
 	if (!journal->j_running_transaction) {
 		/*
@@ -361,6 +552,8 @@ static int start_this_handle(journal_t *journal, handle_t *handle,
 		/* We may have dropped j_state_lock - restart in that case */
 		if (add_transaction_credits(journal, blocks, rsv_blocks))
 			goto repeat;
+		if (!rsv_blocks)
+			jbd2_pcpu_refill(journal, transaction);
 	} else {
 		/*
 		 * We have handle reserved so we are allowed to join T_LOCKED
@@ -385,6 +578,7 @@ static int start_this_handle(journal_t *journal, handle_t *handle,
 		  atomic_read(&transaction->t_outstanding_credits),
 		  jbd2_log_space_left(journal));
 	read_unlock(&journal->j_state_lock);
+joined:
 	current->journal_info = handle;
 
 	rwsem_acquire_read(&journal->j_trans_commit_map, 0, 0, _THIS_IP_);
@@ -654,20 +848,18 @@ int jbd2__journal_restart(handle_t *handle, int nblocks, gfp_t gfp_mask)
 	 * First unlink the handle from its current transaction, and start the
 	 * commit on that.
 	 */
-	J_ASSERT(atomic_read(&transaction->t_updates) > 0);
+	J_ASSERT(handle->h_pcpu || atomic_read(&transaction->t_updates) > 0);
 	J_ASSERT(journal_current_handle() == handle);
 
 	read_lock(&journal->j_state_lock);
 	spin_lock(&transaction->t_handle_lock);
-	atomic_sub(handle->h_buffer_credits,
-		   &transaction->t_outstanding_credits);
+	return_handle_credits(journal, handle);
 	if (handle->h_rsv_handle) {
 		sub_reserved_credits(journal,
 				     handle->h_rsv_handle->h_buffer_credits);
 	}
-	if (atomic_dec_and_test(&transaction->t_updates))
-		wake_up(&journal->j_wait_updates);
 	tid = transaction->t_tid;
+	put_handle_update(journal, handle);
 	spin_unlock(&transaction->t_handle_lock);
 	handle->h_transaction = NULL;
 	current->journal_info = NULL;
@@ -735,7 +927,7 @@ void jbd2_journal_lock_updates(journal_t *journal)
 		spin_lock(&transaction->t_handle_lock);
 		prepare_to_wait(&journal->j_wait_updates, &wait,
 				TASK_UNINTERRUPTIBLE);
-		if (!atomic_read(&transaction->t_updates)) {
+		if (!jbd2_journal_updates(journal, transaction)) {
 			spin_unlock(&transaction->t_handle_lock);
 			finish_wait(&journal->j_wait_updates, &wait);
 			break;
@@ -1646,7 +1838,8 @@ int jbd2_journal_stop(handle_t *handle)
 	if (is_handle_aborted(handle))
 		err = -EIO;
 	else
-		J_ASSERT(atomic_read(&transaction->t_updates) > 0);
+		J_ASSERT(handle->h_pcpu ||
+			 atomic_read(&transaction->t_updates) > 0);
 
 	if (--handle->h_ref > 0) {
 		jbd_debug(4, "h_ref %d -> %d\n", handle->h_ref + 1,
@@ -1722,8 +1915,7 @@ int jbd2_journal_stop(handle_t *handle)
 	if (handle->h_sync)
 		transaction->t_synchronous_commit = 1;
 	current->journal_info = NULL;
-	atomic_sub(handle->h_buffer_credits,
-		   &transaction->t_outstanding_credits);
+	return_handle_credits(journal, handle);
 
 	/*
 	 * If the handle is marked SYNC, we need to set another commit
@@ -1759,11 +1951,8 @@ int jbd2_journal_stop(handle_t *handle)
 	 * pointer again.
 	 */
 	tid = transaction->t_tid;
-	if (atomic_dec_and_test(&transaction->t_updates)) {
-		wake_up(&journal->j_wait_updates);
-		if (journal->j_barrier_count)
-			wake_up(&journal->j_wait_transaction_locked);
-	}
+	if (put_handle_update(journal, handle) && journal->j_barrier_count)
+		wake_up(&journal->j_wait_transaction_locked);
 
 	rwsem_release(&journal->j_trans_commit_map, 1, _THIS_IP_);
 
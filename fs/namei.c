@@ -1630,23 +1630,19 @@ static int lookup_fast(struct nameidata *nd,
 	return err;
 }
 
-/* Fast lookup failed, do it the slow way */
-static struct dentry *lookup_slow(const struct qstr *name,
-				  struct dentry *dir,
-				  unsigned int flags)
+/* The directory is locked, at least shared */
+static struct dentry *__lookup_slow(const struct qstr *name,
+				    struct dentry *dir,
+				    unsigned int flags)
 {
-	struct dentry *dentry = ERR_PTR(-ENOENT), *old;
+	struct dentry *dentry, *old;
 	struct inode *inode = dir->d_inode;
 	DECLARE_WAIT_QUEUE_HEAD_ONSTACK(wq);
 
-	inode_lock_shared(inode);
-	/* Don't go there if it's already dead */
-	if (unlikely(IS_DEADDIR(inode)))
-		goto out;
 again:
 	dentry = d_alloc_parallel(dir, name, &wq);
 	if (IS_ERR(dentry))
-		goto out;
+		return dentry;
 	if (unlikely(!d_in_lookup(dentry))) {
 		if (!(flags & LOOKUP_NO_REVAL)) {
 			int error = d_revalidate(dentry, flags);
@@ -1668,11 +1664,78 @@ static struct dentry *lookup_slow(const struct qstr *name,
 			dentry = old;
 		}
 	}
-out:
+	return dentry;
+}
+
+/* Fast lookup failed, do it the slow way */
+static struct dentry *lookup_slow(const struct qstr *name,
+				  struct dentry *dir,
+				  unsigned int flags)
+{
+	struct dentry *dentry = ERR_PTR(-ENOENT);
+	struct inode *inode = dir->d_inode;
+
+	inode_lock_shared(inode);
+	/* Don't go there if it's already dead */
+	if (likely(!IS_DEADDIR(inode)))
+		dentry = __lookup_slow(name, dir, flags);
 	inode_unlock_shared(inode);
 	return dentry;
 }
 
+/*
+ * Parallel directory operations: the creates and unlinks in the
+ * directories with S_PARDIROPS hold i_rwsem shared, the filesystem does
+ * its own locking.  The operations on a same name are serialized by a
+ * hashed lock on its dentry, which is looked up again if a concurrent
+ * unlink dropped it meanwhile.
+ */
+#define PARDIROP_LOCK_BITS	8
+
+static struct mutex pardirop_locks[1 << PARDIROP_LOCK_BITS];
+
+static struct mutex *pardirop_lock(struct dentry *dentry)
+{
+	return &pardirop_locks[hash_ptr(dentry, PARDIROP_LOCK_BITS)];
+}
+
+static struct dentry *lookup_pardirop(const struct qstr *name,
+				      struct dentry *dir,
+				      unsigned int flags)
+{
+	struct dentry *dentry;
+
+again:
+	dentry = lookup_dcache(name, dir, flags);
+	if (!dentry)
+		dentry = __lookup_slow(name, dir, flags);
+	if (IS_ERR(dentry))
+		return dentry;
+
+	mutex_lock(pardirop_lock(dentry));
+	if (unlikely(d_unhashed(dentry))) {
+		mutex_unlock(pardirop_lock(dentry));
+		dput(dentry);
+		goto again;
+	}
+	return dentry;
+}
+
+static void unlock_pardirop(struct dentry *dentry)
+{
+	mutex_unlock(pardirop_lock(dentry));
+}
+
+static int __init pardirop_init(void)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(pardirop_locks); i++)
+		mutex_init(&pardirop_locks[i]);
+	return 0;
+}
+core_initcall(pardirop_init);
+
 static inline int may_lookup(struct nameidata *nd)
 {
 	if (nd->flags & LOOKUP_RCU) {
@@ -3102,7 +3165,7 @@ static int atomic_open(struct nameidata *nd, struct dentry *dentry,
 static int lookup_open(struct nameidata *nd, struct path *path,
 			struct file *file,
 			const struct open_flags *op,
-			bool got_write, int *opened)
+			bool got_write, bool pardirop, int *opened)
 {
 	struct dentry *dir = nd->path.dentry;
 	struct inode *dir_inode = dir->d_inode;
@@ -3116,6 +3179,12 @@ static int lookup_open(struct nameidata *nd, struct path *path,
 		return -ENOENT;
 
 	*opened &= ~FILE_CREATED;
+	if (pardirop) {
+		dentry = lookup_pardirop(&nd->last, dir, nd->flags);
+		if (IS_ERR(dentry))
+			return PTR_ERR(dentry);
+		goto looked_up;
+	}
 	dentry = d_lookup(dir, &nd->last);
 	for (;;) {
 		if (!dentry) {
@@ -3135,6 +3204,7 @@ static int lookup_open(struct nameidata *nd, struct path *path,
 		dput(dentry);
 		dentry = NULL;
 	}
+looked_up:
 	if (dentry->d_inode) {
 		/* Cached positive dentry: will open in f_op->open */
 		goto out_no_open;
@@ -3217,11 +3287,15 @@ static int lookup_open(struct nameidata *nd, struct path *path,
 		goto out_dput;
 	}
 out_no_open:
+	if (pardirop)
+		unlock_pardirop(dentry);
 	path->dentry = dentry;
 	path->mnt = nd->path.mnt;
 	return 1;
 
 out_dput:
+	if (pardirop)
+		unlock_pardirop(dentry);
 	dput(dentry);
 	return error;
 }
@@ -3237,6 +3311,7 @@ static int do_last(struct nameidata *nd,
 	int open_flag = op->open_flag;
 	bool will_truncate = (open_flag & O_TRUNC) != 0;
 	bool got_write = false;
+	bool pardirop = false;
 	int acc_mode = op->acc_mode;
 	unsigned seq;
 	struct inode *inode;
@@ -3293,12 +3368,15 @@ static int do_last(struct nameidata *nd,
 		 * dropping this one anyway.
 		 */
 	}
-	if (open_flag & O_CREAT)
+	if ((open_flag & O_CREAT) && IS_PARDIROPS(dir->d_inode) &&
+	    !dir->d_inode->i_op->atomic_open)
+		pardirop = true;
+	if ((open_flag & O_CREAT) && !pardirop)
 		inode_lock(dir->d_inode);
 	else
 		inode_lock_shared(dir->d_inode);
-	error = lookup_open(nd, &path, file, op, got_write, opened);
-	if (open_flag & O_CREAT)
+	error = lookup_open(nd, &path, file, op, got_write, pardirop, opened);
+	if ((open_flag & O_CREAT) && !pardirop)
 		inode_unlock(dir->d_inode);
 	else
 		inode_unlock_shared(dir->d_inode);
@@ -4021,6 +4099,7 @@ static long do_unlinkat(int dfd, const char __user *pathname)
 	struct inode *inode = NULL;
 	struct inode *delegated_inode = NULL;
 	unsigned int lookup_flags = 0;
+	bool pardirop;
 retry:
 	name = filename_parentat(dfd, getname(pathname), lookup_flags,
 				&path, &last, &type);
@@ -4035,8 +4114,17 @@ static long do_unlinkat(int dfd, const char __user *pathname)
 	if (error)
 		goto exit1;
 retry_deleg:
-	inode_lock_nested(path.dentry->d_inode, I_MUTEX_PARENT);
-	dentry = __lookup_hash(&last, path.dentry, lookup_flags);
+	pardirop = IS_PARDIROPS(path.dentry->d_inode);
+	if (pardirop) {
+		inode_lock_shared_nested(path.dentry->d_inode, I_MUTEX_PARENT);
+		dentry = ERR_PTR(-ENOENT);
+		if (likely(!IS_DEADDIR(path.dentry->d_inode)))
+			dentry = lookup_pardirop(&last, path.dentry,
+						 lookup_flags);
+	} else {
+		inode_lock_nested(path.dentry->d_inode, I_MUTEX_PARENT);
+		dentry = __lookup_hash(&last, path.dentry, lookup_flags);
+	}
 	error = PTR_ERR(dentry);
 	if (!IS_ERR(dentry)) {
 		/* Why not before? Because we want correct error value */
@@ -4051,9 +4139,14 @@ static long do_unlinkat(int dfd, const char __user *pathname)
 			goto exit2;
 		error = vfs_unlink(path.dentry->d_inode, dentry, &delegated_inode);
 exit2:
+		if (pardirop)
+			unlock_pardirop(dentry);
 		dput(dentry);
 	}
-	inode_unlock(path.dentry->d_inode);
+	if (pardirop)
+		inode_unlock_shared(path.dentry->d_inode);
+	else
+		inode_unlock(path.dentry->d_inode);
 	if (inode)
 		iput(inode);	/* truncate the inode here */
 	inode = NULL;
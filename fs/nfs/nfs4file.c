@@ -136,6 +136,13 @@ static ssize_t nfs4_copy_file_range(struct file *file_in, loff_t pos_in,
 {
 	if (file_inode(file_in) == file_inode(file_out))
 		return -EINVAL;
+	/*
+	 * COPY is sent in the session of the destination, so it can only
+	 * copy between two exports of the same server.
+	 */
+	if (NFS_SERVER(file_inode(file_in))->nfs_client !=
+	    NFS_SERVER(file_inode(file_out))->nfs_client)
+		return -EXDEV;
 
 	return nfs42_proc_copy(file_in, pos_in, file_out, pos_out, count);
 }
@@ -35,6 +35,7 @@ enum {
 	NFSD_FO_UnlockFS,
 	NFSD_Threads,
 	NFSD_Pool_Threads,
+	NFSD_Pool_Auto,
 	NFSD_Pool_Stats,
 	NFSD_Reply_Cache_Stats,
 	NFSD_Versions,
@@ -62,6 +63,7 @@ static ssize_t write_unlock_ip(struct file *file, char *buf, size_t size);
 static ssize_t write_unlock_fs(struct file *file, char *buf, size_t size);
 static ssize_t write_threads(struct file *file, char *buf, size_t size);
 static ssize_t write_pool_threads(struct file *file, char *buf, size_t size);
+static ssize_t write_pool_auto(struct file *file, char *buf, size_t size);
 static ssize_t write_versions(struct file *file, char *buf, size_t size);
 static ssize_t write_ports(struct file *file, char *buf, size_t size);
 static ssize_t write_maxblksize(struct file *file, char *buf, size_t size);
@@ -79,6 +81,7 @@ static ssize_t (*write_op[])(struct file *, char *, size_t) = {
 	[NFSD_FO_UnlockFS] = write_unlock_fs,
 	[NFSD_Threads] = write_threads,
 	[NFSD_Pool_Threads] = write_pool_threads,
+	[NFSD_Pool_Auto] = write_pool_auto,
 	[NFSD_Versions] = write_versions,
 	[NFSD_Ports] = write_ports,
 	[NFSD_MaxBlkSize] = write_maxblksize,
@@ -536,6 +539,93 @@ static ssize_t write_pool_threads(struct file *file, char *buf, size_t size)
 	return rv;
 }
 
+/**
+ * write_pool_auto - Set or report the auto-sizing of the pools
+ *
+ * Input:
+ *			buf:		ignored
+ *			size:		zero
+ *
+ * OR
+ *
+ * Input:
+ * 			buf:		C string containing whitespace-
+ * 					separated "min:max" pairs giving
+ *					the bounds of the number of NFSD
+ *					threads of each pool, "0:0" to
+ *					keep its current number of threads
+ *			size:		non-zero length of C string in @buf
+ * Output:
+ *	On success:	passed-in buffer filled with '\n'-terminated C
+ *			string containing the "min:max" pair of each pool;
+ *			return code is the size in bytes of the string
+ *	On error:	return code is zero or a negative errno value
+ *
+ * An auto-sized pool starts a thread when a transport waits for one too
+ * long, and its idle threads exit after a while.  Writing to threads or
+ * pool_threads turns the auto-sizing off.
+ */
+static ssize_t write_pool_auto(struct file *file, char *buf, size_t size)
+{
+	char *mesg = buf;
+	char tok[32];
+	int i;
+	int rv;
+	int len;
+	int npools;
+	unsigned int *min, *max;
+	struct net *net = netns(file);
+
+	mutex_lock(&nfsd_mutex);
+	npools = nfsd_nrpools(net);
+	if (npools == 0) {
+		mutex_unlock(&nfsd_mutex);
+		strcpy(buf, "0:0\n");
+		return strlen(buf);
+	}
+
+	rv = -ENOMEM;
+	min = kcalloc(npools, sizeof(unsigned int), GFP_KERNEL);
+	max = kcalloc(npools, sizeof(unsigned int), GFP_KERNEL);
+	if (min == NULL || max == NULL)
+		goto out_free;
+
+	if (size > 0) {
+		for (i = 0; i < npools; i++) {
+			len = qword_get(&mesg, tok, sizeof(tok));
+			if (len == 0)
+				break;		/* fewer pairs than pools */
+			rv = -EINVAL;
+			if (len < 0 ||
+			    sscanf(tok, "%u:%u", &min[i], &max[i]) != 2)
+				goto out_free;	/* syntax error */
+		}
+		rv = nfsd_set_pool_range(i, min, max, net);
+		if (rv)
+			goto out_free;
+	}
+
+	rv = nfsd_get_pool_range(npools, min, max, net);
+	if (rv)
+		goto out_free;
+
+	mesg = buf;
+	size = SIMPLE_TRANSACTION_LIMIT;
+	for (i = 0; i < npools && size > 0; i++) {
+		snprintf(mesg, size, "%u:%u%c", min[i], max[i],
+			 (i == npools-1 ? '\n' : ' '));
+		len = strlen(mesg);
+		size -= len;
+		mesg += len;
+	}
+	rv = mesg - buf;
+out_free:
+	kfree(min);
+	kfree(max);
+	mutex_unlock(&nfsd_mutex);
+	return rv;
+}
+
 static ssize_t
 nfsd_print_version_support(char *buf, int remaining, const char *sep,
 		unsigned vers, int minor)
@@ -1157,6 +1247,7 @@ static int nfsd_fill_super(struct super_block * sb, void * data, int silent)
 		[NFSD_Fh] = {"filehandle", &transaction_ops, S_IWUSR|S_IRUSR},
 		[NFSD_Threads] = {"threads", &transaction_ops, S_IWUSR|S_IRUSR},
 		[NFSD_Pool_Threads] = {"pool_threads", &transaction_ops, S_IWUSR|S_IRUSR},
+		[NFSD_Pool_Auto] = {"pool_threads_auto", &transaction_ops, S_IWUSR|S_IRUSR},
 		[NFSD_Pool_Stats] = {"pool_stats", &pool_stats_operations, S_IRUGO},
 		[NFSD_Reply_Cache_Stats] = {"reply_cache_stats", &reply_cache_stats_operations, S_IRUGO},
 		[NFSD_Versions] = {"versions", &transaction_ops, S_IWUSR|S_IRUSR},
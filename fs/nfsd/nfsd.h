@@ -80,6 +80,10 @@ int		nfsd_nrthreads(struct net *);
 int		nfsd_nrpools(struct net *);
 int		nfsd_get_nrthreads(int n, int *, struct net *);
 int		nfsd_set_nrthreads(int n, int *, struct net *);
+int		nfsd_get_pool_range(int n, unsigned int *, unsigned int *,
+				    struct net *);
+int		nfsd_set_pool_range(int n, unsigned int *, unsigned int *,
+				    struct net *);
 int		nfsd_pool_stats_open(struct inode *, struct file *);
 int		nfsd_pool_stats_release(struct inode *, struct file *);
 
@@ -193,6 +193,13 @@ int nfsd_minorversion(u32 minorversion, enum vers_op change)
  */
 #define	NFSD_MAXSERVS		8192
 
+/*
+ * An auto-sized pool gets a new thread when a transport waits for one longer
+ * than NFSD_GROW_DELAY_MS, and a thread idle for NFSD_IDLE_TIMEOUT exits.
+ */
+#define	NFSD_GROW_DELAY_MS	10
+#define	NFSD_IDLE_TIMEOUT	(60 * HZ)
+
 int nfsd_nrthreads(struct net *net)
 {
 	int rv = 0;
@@ -476,12 +483,24 @@ static int nfsd_get_default_max_blksize(void)
 	return ret;
 }
 
+static void nfsd_grow_pool(struct svc_serv *serv, struct svc_pool *pool)
+{
+	/* svc_destroy() waits for this work with the nfsd_mutex held */
+	if (!mutex_trylock(&nfsd_mutex))
+		return;
+	if (pool->sp_nrthreads < pool->sp_max_threads &&
+	    serv->sv_nrthreads < NFSD_MAXSERVS)
+		svc_set_num_threads(serv, pool, pool->sp_nrthreads + 1);
+	mutex_unlock(&nfsd_mutex);
+}
+
 static const struct svc_serv_ops nfsd_thread_sv_ops = {
 	.svo_shutdown		= nfsd_last_thread,
 	.svo_function		= nfsd,
 	.svo_enqueue_xprt	= svc_xprt_do_enqueue,
 	.svo_setup		= svc_set_num_threads,
 	.svo_module		= THIS_MODULE,
+	.svo_grow_pool		= nfsd_grow_pool,
 };
 
 int nfsd_create_serv(struct net *net)
@@ -503,6 +522,8 @@ int nfsd_create_serv(struct net *net)
 		return -ENOMEM;
 
 	nn->nfsd_serv->sv_maxconn = nn->max_connections;
+	nn->nfsd_serv->sv_grow_delay = msecs_to_jiffies(NFSD_GROW_DELAY_MS);
+	nn->nfsd_serv->sv_idle_timeout = NFSD_IDLE_TIMEOUT;
 	error = svc_bind(nn->nfsd_serv, net);
 	if (error < 0) {
 		svc_destroy(nn->nfsd_serv);
@@ -556,6 +577,15 @@ void nfsd_destroy(struct net *net)
 		nn->nfsd_serv = NULL;
 }
 
+/* Setting a number of threads turns the auto-sizing of a pool off */
+static void nfsd_pool_fixed(struct svc_pool *pool)
+{
+	spin_lock_bh(&pool->sp_lock);
+	pool->sp_min_threads = 0;
+	pool->sp_max_threads = 0;
+	spin_unlock_bh(&pool->sp_lock);
+}
+
 int nfsd_set_nrthreads(int n, int *nthreads, struct net *net)
 {
 	int i = 0;
@@ -600,6 +630,7 @@ int nfsd_set_nrthreads(int n, int *nthreads, struct net *net)
 	/* apply the new numbers */
 	svc_get(nn->nfsd_serv);
 	for (i = 0; i < n; i++) {
+		nfsd_pool_fixed(&nn->nfsd_serv->sv_pools[i]);
 		err = nn->nfsd_serv->sv_ops->svo_setup(nn->nfsd_serv,
 				&nn->nfsd_serv->sv_pools[i], nthreads[i]);
 		if (err)
@@ -609,6 +640,75 @@ int nfsd_set_nrthreads(int n, int *nthreads, struct net *net)
 	return err;
 }
 
+int nfsd_get_pool_range(int n, unsigned int *min, unsigned int *max,
+			struct net *net)
+{
+	int i = 0;
+	struct nfsd_net *nn = net_generic(net, nfsd_net_id);
+
+	if (nn->nfsd_serv != NULL) {
+		for (i = 0; i < nn->nfsd_serv->sv_nrpools && i < n; i++) {
+			min[i] = nn->nfsd_serv->sv_pools[i].sp_min_threads;
+			max[i] = nn->nfsd_serv->sv_pools[i].sp_max_threads;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Let the first n pools size themselves between min[i] and max[i] threads,
+ * or switch them back to their current number of threads if max[i] is 0.
+ */
+int nfsd_set_pool_range(int n, unsigned int *min, unsigned int *max,
+			struct net *net)
+{
+	int i;
+	int err = 0;
+	struct nfsd_net *nn = net_generic(net, nfsd_net_id);
+
+	WARN_ON(!mutex_is_locked(&nfsd_mutex));
+
+	if (nn->nfsd_serv == NULL || n <= 0)
+		return 0;
+
+	if (n > nn->nfsd_serv->sv_nrpools)
+		n = nn->nfsd_serv->sv_nrpools;
+
+	for (i = 0; i < n; i++) {
+		if (!max[i]) {
+			min[i] = 0;
+			continue;
+		}
+		if (min[i] > max[i] || max[i] > NFSD_MAXSERVS)
+			return -EINVAL;
+		/* as for pool_threads, pool 0 always keeps a thread */
+		if (i == 0 && min[i] == 0)
+			min[i] = 1;
+	}
+
+	svc_get(nn->nfsd_serv);
+	for (i = 0; i < n; i++) {
+		struct svc_pool *pool = &nn->nfsd_serv->sv_pools[i];
+		unsigned int nrthreads;
+
+		spin_lock_bh(&pool->sp_lock);
+		pool->sp_min_threads = min[i];
+		pool->sp_max_threads = max[i];
+		nrthreads = pool->sp_nrthreads;
+		spin_unlock_bh(&pool->sp_lock);
+
+		if (!max[i] || (nrthreads >= min[i] && nrthreads <= max[i]))
+			continue;
+		err = nn->nfsd_serv->sv_ops->svo_setup(nn->nfsd_serv, pool,
+				clamp(nrthreads, min[i], max[i]));
+		if (err)
+			break;
+	}
+	nfsd_destroy(net);
+	return err;
+}
+
 /*
  * Adjust the number of threads and return the new number of threads.
  * This is also the function that starts the server if necessary, if
@@ -618,6 +718,7 @@ int
 nfsd_svc(int nrservs, struct net *net)
 {
 	int	error;
+	unsigned int i;
 	bool	nfsd_up_before;
 	struct nfsd_net *nn = net_generic(net, nfsd_net_id);
 
@@ -640,6 +741,8 @@ nfsd_svc(int nrservs, struct net *net)
 	error = nfsd_startup_net(nrservs, net);
 	if (error)
 		goto out_destroy;
+	for (i = 0; i < nn->nfsd_serv->sv_nrpools; i++)
+		nfsd_pool_fixed(&nn->nfsd_serv->sv_pools[i]);
 	error = nn->nfsd_serv->sv_ops->svo_setup(nn->nfsd_serv,
 			NULL, nrservs);
 	if (error)
@@ -660,6 +763,29 @@ nfsd_svc(int nrservs, struct net *net)
 }
 
 
+/*
+ * A thread of an auto-sized pool exits once it has been idle for
+ * sv_idle_timeout, unless its pool is down to its minimum.  Returns true
+ * with the nfsd_mutex held if the thread is to exit.
+ */
+static bool nfsd_retire_idle(struct svc_rqst *rqstp, unsigned long idle)
+{
+	struct svc_pool *pool = rqstp->rq_pool;
+
+	if (!READ_ONCE(pool->sp_max_threads) ||
+	    time_before(jiffies, idle + rqstp->rq_server->sv_idle_timeout))
+		return false;
+
+	mutex_lock(&nfsd_mutex);
+	if (pool->sp_max_threads &&
+	    pool->sp_nrthreads > max(pool->sp_min_threads, 1U)) {
+		atomic_long_inc(&pool->sp_stats.threads_retired);
+		return true;
+	}
+	mutex_unlock(&nfsd_mutex);
+	return false;
+}
+
 /*
  * This is the NFS server kernel thread
  */
@@ -670,6 +796,7 @@ nfsd(void *vrqstp)
 	struct svc_xprt *perm_sock = list_entry(rqstp->rq_server->sv_permsocks.next, typeof(struct svc_xprt), xpt_list);
 	struct net *net = perm_sock->xpt_net;
 	struct nfsd_net *nn = net_generic(net, nfsd_net_id);
+	unsigned long idle, timeout;
 	int err;
 
 	/* Lock module and set up kernel thread */
@@ -710,8 +837,13 @@ nfsd(void *vrqstp)
 		 * Find a socket with data available and call its
 		 * recvfrom routine.
 		 */
-		while ((err = svc_recv(rqstp, 60*60*HZ)) == -EAGAIN)
-			;
+		idle = jiffies;
+		timeout = READ_ONCE(rqstp->rq_pool->sp_max_threads) ?
+			rqstp->rq_server->sv_idle_timeout : 60*60*HZ;
+		while ((err = svc_recv(rqstp, timeout)) == -EAGAIN) {
+			if (nfsd_retire_idle(rqstp, idle))
+				goto retire;
+		}
 		if (err == -EINTR)
 			break;
 		validate_process_creds();
@@ -723,6 +855,7 @@ nfsd(void *vrqstp)
 	flush_signals(current);
 
 	mutex_lock(&nfsd_mutex);
+retire:
 	nfsdstats.th_cnt --;
 
 out:
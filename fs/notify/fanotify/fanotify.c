@@ -1,7 +1,9 @@
 // SPDX-License-Identifier: GPL-2.0
+#include <linux/exportfs.h>
 #include <linux/fanotify.h>
 #include <linux/fdtable.h>
 #include <linux/fsnotify_backend.h>
+#include <linux/hash.h>
 #include <linux/init.h>
 #include <linux/jiffies.h>
 #include <linux/kernel.h> /* UINT_MAX */
@@ -12,6 +14,7 @@
 #include <linux/wait.h>
 
 #include "fanotify.h"
+#include "../fsnotify.h"
 
 static bool should_merge(struct fsnotify_event *old_fsn,
 			 struct fsnotify_event *new_fsn)
@@ -29,12 +32,32 @@ static bool should_merge(struct fsnotify_event *old_fsn,
 	return false;
 }
 
-/* and the list better be locked by something too! */
-static int fanotify_merge(struct list_head *list, struct fsnotify_event *event)
+static struct hlist_head *fanotify_merge_bucket(
+					struct fsnotify_group *group,
+					struct fsnotify_event *fsn_event)
 {
-	struct fsnotify_event *test_event;
+	struct fanotify_event_info *event = FANOTIFY_E(fsn_event);
+	unsigned long key;
+
+	/* the fields compared by should_merge(), but for the mount */
+	key = (unsigned long)fsn_event->inode ^ (unsigned long)event->tgid ^
+	      (unsigned long)event->path.dentry;
+	return &group->fanotify_data.merge_hash[hash_long(key,
+						FANOTIFY_MERGE_HASH_BITS)];
+}
 
-	pr_debug("%s: list=%p event=%p\n", __func__, list, event);
+/*
+ * Called under notification_lock.  The queued events are hashed by the
+ * object they are about, so that a new event is only compared with the ones
+ * of its bucket, the last queued first, instead of walking the whole queue.
+ */
+static int fanotify_merge(struct fsnotify_group *group,
+			  struct fsnotify_event *event)
+{
+	struct fanotify_event_info *test_event;
+	struct hlist_head *bucket;
+
+	pr_debug("%s: group=%p event=%p\n", __func__, group, event);
 
 #ifdef CONFIG_FANOTIFY_ACCESS_PERMISSIONS
 	/*
@@ -46,13 +69,16 @@ static int fanotify_merge(struct list_head *list, struct fsnotify_event *event)
 		return 0;
 #endif
 
-	list_for_each_entry_reverse(test_event, list, list) {
-		if (should_merge(test_event, event)) {
-			test_event->mask |= event->mask;
+	bucket = fanotify_merge_bucket(group, event);
+	hlist_for_each_entry(test_event, bucket, merge_list) {
+		if (should_merge(&test_event->fse, event)) {
+			test_event->fse.mask |= event->mask;
 			return 1;
 		}
 	}
 
+	/* not merged, the event is queued right after we return */
+	hlist_add_head(&FANOTIFY_E(event)->merge_list, bucket);
 	return 0;
 }
 
@@ -98,14 +124,15 @@ static int fanotify_get_response(struct fsnotify_group *group,
 
 static bool fanotify_should_send_event(struct fsnotify_mark *inode_mark,
 				       struct fsnotify_mark *vfsmnt_mark,
+				       struct fsnotify_mark *sb_mark,
 				       u32 event_mask,
 				       const void *data, int data_type)
 {
 	__u32 marks_mask, marks_ignored_mask;
 	const struct path *path = data;
 
-	pr_debug("%s: inode_mark=%p vfsmnt_mark=%p mask=%x data=%p"
-		 " data_type=%d\n", __func__, inode_mark, vfsmnt_mark,
+	pr_debug("%s: inode_mark=%p vfsmnt_mark=%p sb_mark=%p mask=%x data=%p"
+		 " data_type=%d\n", __func__, inode_mark, vfsmnt_mark, sb_mark,
 		 event_mask, data, data_type);
 
 	/* if we don't have enough info to send an event to userspace say no */
@@ -133,8 +160,21 @@ static bool fanotify_should_send_event(struct fsnotify_mark *inode_mark,
 	} else if (vfsmnt_mark) {
 		marks_mask = vfsmnt_mark->mask;
 		marks_ignored_mask = vfsmnt_mark->ignored_mask;
-	} else {
+	} else if (!sb_mark) {
 		BUG();
+	} else {
+		marks_mask = 0;
+		marks_ignored_mask = 0;
+	}
+
+	/*
+	 * The ignored masks of the inode and mount marks apply to it too.  An
+	 * event on child is also sent for the child itself, where the sb mark
+	 * gets it.
+	 */
+	if (sb_mark && !(event_mask & FS_EVENT_ON_CHILD)) {
+		marks_mask |= sb_mark->mask;
+		marks_ignored_mask |= sb_mark->ignored_mask;
 	}
 
 	if (d_is_dir(path->dentry) &&
@@ -148,7 +188,31 @@ static bool fanotify_should_send_event(struct fsnotify_mark *inode_mark,
 	return false;
 }
 
-struct fanotify_event_info *fanotify_alloc_event(struct inode *inode, u32 mask,
+/* returns NULL if the filesystem cannot encode a handle for @inode */
+static struct file_handle *fanotify_encode_fh(struct inode *inode)
+{
+	struct file_handle *fh;
+	int dwords = MAX_HANDLE_SZ >> 2;
+	int type;
+
+	fh = kmalloc(sizeof(*fh) + MAX_HANDLE_SZ, GFP_KERNEL);
+	if (!fh)
+		return NULL;
+
+	type = exportfs_encode_inode_fh(inode, (struct fid *)fh->f_handle,
+					&dwords, NULL);
+	if (type <= 0 || type == FILEID_INVALID ||
+	    dwords > (MAX_HANDLE_SZ >> 2)) {
+		kfree(fh);
+		return NULL;
+	}
+	fh->handle_type = type;
+	fh->handle_bytes = dwords << 2;
+	return fh;
+}
+
+struct fanotify_event_info *fanotify_alloc_event(struct fsnotify_group *group,
+						 struct inode *inode, u32 mask,
 						 const struct path *path)
 {
 	struct fanotify_event_info *event;
@@ -171,10 +235,15 @@ struct fanotify_event_info *fanotify_alloc_event(struct inode *inode, u32 mask,
 		return NULL;
 init: __maybe_unused
 	fsnotify_init_event(&event->fse, inode, mask);
+	INIT_HLIST_NODE(&event->merge_list);
+	event->fh = NULL;
 	event->tgid = get_pid(task_tgid(current));
 	if (path) {
 		event->path = *path;
 		path_get(&event->path);
+		/* the object itself, not the parent an event on child is for */
+		if (group->fanotify_data.flags & FAN_REPORT_FID)
+			event->fh = fanotify_encode_fh(d_inode(path->dentry));
 	} else {
 		event->path.mnt = NULL;
 		event->path.dentry = NULL;
@@ -205,14 +274,15 @@ static int fanotify_handle_event(struct fsnotify_group *group,
 	BUILD_BUG_ON(FAN_ACCESS_PERM != FS_ACCESS_PERM);
 	BUILD_BUG_ON(FAN_ONDIR != FS_ISDIR);
 
-	if (!fanotify_should_send_event(inode_mark, fanotify_mark, mask, data,
+	if (!fanotify_should_send_event(inode_mark, fanotify_mark,
+					iter_info->sb_mark, mask, data,
 					data_type))
 		return 0;
 
 	pr_debug("%s: group=%p inode=%p mask=%x\n", __func__, group, inode,
 		 mask);
 
-	event = fanotify_alloc_event(inode, mask, data);
+	event = fanotify_alloc_event(group, inode, mask, data);
 	if (unlikely(!event))
 		return -ENOMEM;
 
@@ -244,6 +314,7 @@ static void fanotify_free_group_priv(struct fsnotify_group *group)
 	user = group->fanotify_data.user;
 	atomic_dec(&user->fanotify_listeners);
 	free_uid(user);
+	kfree(group->fanotify_data.merge_hash);
 }
 
 static void fanotify_free_event(struct fsnotify_event *fsn_event)
@@ -253,6 +324,7 @@ static void fanotify_free_event(struct fsnotify_event *fsn_event)
 	event = FANOTIFY_E(fsn_event);
 	path_put(&event->path);
 	put_pid(event->tgid);
+	kfree(event->fh);
 #ifdef CONFIG_FANOTIFY_ACCESS_PERMISSIONS
 	if (fsn_event->mask & FAN_ALL_PERM_EVENTS) {
 		kmem_cache_free(fanotify_perm_event_cachep,
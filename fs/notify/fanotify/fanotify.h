@@ -7,6 +7,13 @@ extern struct kmem_cache *fanotify_mark_cache;
 extern struct kmem_cache *fanotify_event_cachep;
 extern struct kmem_cache *fanotify_perm_event_cachep;
 
+/* buckets of fanotify_data.merge_hash */
+#define FANOTIFY_MERGE_HASH_BITS	8
+#define FANOTIFY_MERGE_HASH_SIZE	(1U << FANOTIFY_MERGE_HASH_BITS)
+
+/* the fanotify_init() flags kept in fanotify_data.flags */
+#define FANOTIFY_GROUP_FLAGS		FAN_REPORT_FID
+
 /*
  * Structure for normal fanotify events. It gets allocated in
  * fanotify_handle_event() and freed when the information is retrieved by
@@ -20,6 +27,10 @@ struct fanotify_event_info {
 	 */
 	struct path path;
 	struct pid *tgid;
+	/* in fanotify_data.merge_hash while queued [notification_lock] */
+	struct hlist_node merge_list;
+	/* handle of the object for FAN_REPORT_FID groups, may be NULL */
+	struct file_handle *fh;
 };
 
 #ifdef CONFIG_FANOTIFY_ACCESS_PERMISSIONS
@@ -48,5 +59,6 @@ static inline struct fanotify_event_info *FANOTIFY_E(struct fsnotify_event *fse)
 	return container_of(fse, struct fanotify_event_info, fse);
 }
 
-struct fanotify_event_info *fanotify_alloc_event(struct inode *inode, u32 mask,
+struct fanotify_event_info *fanotify_alloc_event(struct fsnotify_group *group,
+						 struct inode *inode, u32 mask,
 						 const struct path *path);
@@ -10,6 +10,7 @@
 #include <linux/namei.h>
 #include <linux/poll.h>
 #include <linux/security.h>
+#include <linux/statfs.h>
 #include <linux/syscalls.h>
 #include <linux/slab.h>
 #include <linux/types.h>
@@ -46,6 +47,33 @@ struct kmem_cache *fanotify_mark_cache __read_mostly;
 struct kmem_cache *fanotify_event_cachep __read_mostly;
 struct kmem_cache *fanotify_perm_event_cachep __read_mostly;
 
+/* the info records keep the next metadata aligned */
+static size_t fanotify_fid_info_len(struct file_handle *fh)
+{
+	return round_up(sizeof(struct fanotify_event_info_fid) + sizeof(*fh) +
+			fh->handle_bytes, sizeof(u64));
+}
+
+static size_t fanotify_event_len(struct fsnotify_event *fsn_event)
+{
+	struct fanotify_event_info *event = FANOTIFY_E(fsn_event);
+
+	if (!event->fh)
+		return FAN_EVENT_METADATA_LEN;
+	return FAN_EVENT_METADATA_LEN + fanotify_fid_info_len(event->fh);
+}
+
+/* dequeue the first event, which can no longer be merged with */
+static struct fsnotify_event *fanotify_remove_first_event(
+					struct fsnotify_group *group)
+{
+	struct fsnotify_event *fsn_event;
+
+	fsn_event = fsnotify_remove_first_event(group);
+	hlist_del_init(&FANOTIFY_E(fsn_event)->merge_list);
+	return fsn_event;
+}
+
 /*
  * Get an fsnotify notification event if one exists and is small
  * enough to fit in "count". Return an error pointer if the count
@@ -63,12 +91,12 @@ static struct fsnotify_event *get_one_event(struct fsnotify_group *group,
 	if (fsnotify_notify_queue_is_empty(group))
 		return NULL;
 
-	if (FAN_EVENT_METADATA_LEN > count)
+	if (fanotify_event_len(fsnotify_peek_first_event(group)) > count)
 		return ERR_PTR(-EINVAL);
 
 	/* held the notification_lock the whole time, so this is the
 	 * same event we peeked above */
-	return fsnotify_remove_first_event(group);
+	return fanotify_remove_first_event(group);
 }
 
 static int create_fd(struct fsnotify_group *group,
@@ -126,13 +154,14 @@ static int fill_event_metadata(struct fsnotify_group *group,
 
 	*file = NULL;
 	event = container_of(fsn_event, struct fanotify_event_info, fse);
-	metadata->event_len = FAN_EVENT_METADATA_LEN;
+	metadata->event_len = fanotify_event_len(fsn_event);
 	metadata->metadata_len = FAN_EVENT_METADATA_LEN;
 	metadata->vers = FANOTIFY_METADATA_VERSION;
 	metadata->reserved = 0;
 	metadata->mask = fsn_event->mask & FAN_ALL_OUTGOING_EVENTS;
 	metadata->pid = pid_vnr(event->tgid);
-	if (unlikely(fsn_event->mask & FAN_Q_OVERFLOW))
+	if (unlikely(fsn_event->mask & FAN_Q_OVERFLOW) ||
+	    (group->fanotify_data.flags & FAN_REPORT_FID))
 		metadata->fd = FAN_NOFD;
 	else {
 		metadata->fd = create_fd(group, event, file);
@@ -202,6 +231,30 @@ static int process_access_response(struct fsnotify_group *group,
 }
 #endif
 
+static int copy_fid_info_to_user(struct fanotify_event_info *event,
+				 char __user *buf)
+{
+	struct fanotify_event_info_fid info = { };
+	struct file_handle *fh = event->fh;
+	size_t fh_len = sizeof(*fh) + fh->handle_bytes;
+	size_t len = fanotify_fid_info_len(fh);
+	struct kstatfs st;
+
+	info.hdr.info_type = FAN_EVENT_INFO_TYPE_FID;
+	info.hdr.len = len;
+	/* with a zero fsid if the filesystem cannot tell it anymore */
+	if (!vfs_statfs(&event->path, &st))
+		info.fsid = st.f_fsid;
+
+	buf += FAN_EVENT_METADATA_LEN;
+	if (copy_to_user(buf, &info, sizeof(info)) ||
+	    copy_to_user(buf + sizeof(info), fh, fh_len) ||
+	    clear_user(buf + sizeof(info) + fh_len,
+		       len - sizeof(info) - fh_len))
+		return -EFAULT;
+	return 0;
+}
+
 static ssize_t copy_event_to_user(struct fsnotify_group *group,
 				  struct fsnotify_event *event,
 				  char __user *buf)
@@ -219,7 +272,11 @@ static ssize_t copy_event_to_user(struct fsnotify_group *group,
 	fd = fanotify_event_metadata.fd;
 	ret = -EFAULT;
 	if (copy_to_user(buf, &fanotify_event_metadata,
-			 fanotify_event_metadata.event_len))
+			 FAN_EVENT_METADATA_LEN))
+		goto out_close_fd;
+
+	if (FANOTIFY_E(event)->fh &&
+	    copy_fid_info_to_user(FANOTIFY_E(event), buf))
 		goto out_close_fd;
 
 #ifdef CONFIG_FANOTIFY_ACCESS_PERMISSIONS
@@ -399,7 +456,7 @@ static int fanotify_release(struct inode *ignored, struct file *file)
 	 * response is consumed and fanotify_get_response() returns.
 	 */
 	while (!fsnotify_notify_queue_is_empty(group)) {
-		fsn_event = fsnotify_remove_first_event(group);
+		fsn_event = fanotify_remove_first_event(group);
 		if (!(fsn_event->mask & FAN_ALL_PERM_EVENTS)) {
 			spin_unlock(&group->notification_lock);
 			fsnotify_destroy_event(group, fsn_event);
@@ -435,7 +492,7 @@ static long fanotify_ioctl(struct file *file, unsigned int cmd, unsigned long ar
 	case FIONREAD:
 		spin_lock(&group->notification_lock);
 		list_for_each_entry(fsn_event, &group->notification_list, list)
-			send_len += FAN_EVENT_METADATA_LEN;
+			send_len += fanotify_event_len(fsn_event);
 		spin_unlock(&group->notification_lock);
 		ret = put_user(send_len, (int __user *) p);
 		break;
@@ -560,6 +617,35 @@ static int fanotify_remove_vfsmount_mark(struct fsnotify_group *group,
 	return 0;
 }
 
+static int fanotify_remove_sb_mark(struct fsnotify_group *group,
+				   struct super_block *sb, __u32 mask,
+				   unsigned int flags)
+{
+	struct fsnotify_mark *fsn_mark = NULL;
+	__u32 removed;
+	int destroy_mark;
+
+	mutex_lock(&group->mark_mutex);
+	fsn_mark = fsnotify_find_mark(&sb->s_fsnotify_marks, group);
+	if (!fsn_mark) {
+		mutex_unlock(&group->mark_mutex);
+		return -ENOENT;
+	}
+
+	removed = fanotify_mark_remove_from_mask(fsn_mark, mask, flags,
+						 &destroy_mark);
+	if (removed & sb->s_fsnotify_mask)
+		fsnotify_recalc_mask(sb->s_fsnotify_marks);
+	if (destroy_mark)
+		fsnotify_detach_mark(fsn_mark);
+	mutex_unlock(&group->mark_mutex);
+	if (destroy_mark)
+		fsnotify_free_mark(fsn_mark);
+
+	fsnotify_put_mark(fsn_mark);
+	return 0;
+}
+
 static int fanotify_remove_inode_mark(struct fsnotify_group *group,
 				      struct inode *inode, __u32 mask,
 				      unsigned int flags)
@@ -622,7 +708,8 @@ static __u32 fanotify_mark_add_to_mask(struct fsnotify_mark *fsn_mark,
 
 static struct fsnotify_mark *fanotify_add_new_mark(struct fsnotify_group *group,
 						   struct inode *inode,
-						   struct vfsmount *mnt)
+						   struct vfsmount *mnt,
+						   struct super_block *sb)
 {
 	struct fsnotify_mark *mark;
 	int ret;
@@ -635,7 +722,10 @@ static struct fsnotify_mark *fanotify_add_new_mark(struct fsnotify_group *group,
 		return ERR_PTR(-ENOMEM);
 
 	fsnotify_init_mark(mark, group);
-	ret = fsnotify_add_mark_locked(mark, inode, mnt, 0);
+	if (sb)
+		ret = fsnotify_add_sb_mark_locked(mark, sb, 0);
+	else
+		ret = fsnotify_add_mark_locked(mark, inode, mnt, 0);
 	if (ret) {
 		fsnotify_put_mark(mark);
 		return ERR_PTR(ret);
@@ -656,7 +746,7 @@ static int fanotify_add_vfsmount_mark(struct fsnotify_group *group,
 	fsn_mark = fsnotify_find_mark(&real_mount(mnt)->mnt_fsnotify_marks,
 				      group);
 	if (!fsn_mark) {
-		fsn_mark = fanotify_add_new_mark(group, NULL, mnt);
+		fsn_mark = fanotify_add_new_mark(group, NULL, mnt, NULL);
 		if (IS_ERR(fsn_mark)) {
 			mutex_unlock(&group->mark_mutex);
 			return PTR_ERR(fsn_mark);
@@ -671,6 +761,31 @@ static int fanotify_add_vfsmount_mark(struct fsnotify_group *group,
 	return 0;
 }
 
+static int fanotify_add_sb_mark(struct fsnotify_group *group,
+				struct super_block *sb, __u32 mask,
+				unsigned int flags)
+{
+	struct fsnotify_mark *fsn_mark;
+	__u32 added;
+
+	mutex_lock(&group->mark_mutex);
+	fsn_mark = fsnotify_find_mark(&sb->s_fsnotify_marks, group);
+	if (!fsn_mark) {
+		fsn_mark = fanotify_add_new_mark(group, NULL, NULL, sb);
+		if (IS_ERR(fsn_mark)) {
+			mutex_unlock(&group->mark_mutex);
+			return PTR_ERR(fsn_mark);
+		}
+	}
+	added = fanotify_mark_add_to_mask(fsn_mark, mask, flags);
+	if (added & ~sb->s_fsnotify_mask)
+		fsnotify_recalc_mask(sb->s_fsnotify_marks);
+	mutex_unlock(&group->mark_mutex);
+
+	fsnotify_put_mark(fsn_mark);
+	return 0;
+}
+
 static int fanotify_add_inode_mark(struct fsnotify_group *group,
 				   struct inode *inode, __u32 mask,
 				   unsigned int flags)
@@ -693,7 +808,7 @@ static int fanotify_add_inode_mark(struct fsnotify_group *group,
 	mutex_lock(&group->mark_mutex);
 	fsn_mark = fsnotify_find_mark(&inode->i_fsnotify_marks, group);
 	if (!fsn_mark) {
-		fsn_mark = fanotify_add_new_mark(group, inode, NULL);
+		fsn_mark = fanotify_add_new_mark(group, inode, NULL, NULL);
 		if (IS_ERR(fsn_mark)) {
 			mutex_unlock(&group->mark_mutex);
 			return PTR_ERR(fsn_mark);
@@ -728,6 +843,11 @@ SYSCALL_DEFINE2(fanotify_init, unsigned int, flags, unsigned int, event_f_flags)
 	if (event_f_flags & ~FANOTIFY_INIT_ALL_EVENT_F_BITS)
 		return -EINVAL;
 
+	/* permission events need an fd to be answered */
+	if ((flags & FAN_REPORT_FID) &&
+	    (flags & FAN_ALL_CLASS_BITS) != FAN_CLASS_NOTIF)
+		return -EINVAL;
+
 	switch (event_f_flags & O_ACCMODE) {
 	case O_RDONLY:
 	case O_RDWR:
@@ -758,8 +878,17 @@ SYSCALL_DEFINE2(fanotify_init, unsigned int, flags, unsigned int, event_f_flags)
 
 	group->fanotify_data.user = user;
 	atomic_inc(&user->fanotify_listeners);
+	group->fanotify_data.flags = flags & FANOTIFY_GROUP_FLAGS;
+
+	group->fanotify_data.merge_hash = kcalloc(FANOTIFY_MERGE_HASH_SIZE,
+						  sizeof(struct hlist_head),
+						  GFP_KERNEL);
+	if (!group->fanotify_data.merge_hash) {
+		fd = -ENOMEM;
+		goto out_destroy_group;
+	}
 
-	oevent = fanotify_alloc_event(NULL, FS_Q_OVERFLOW, NULL);
+	oevent = fanotify_alloc_event(group, NULL, FS_Q_OVERFLOW, NULL);
 	if (unlikely(!oevent)) {
 		fd = -ENOMEM;
 		goto out_destroy_group;
@@ -823,6 +952,7 @@ SYSCALL_DEFINE5(fanotify_mark, int, fanotify_fd, unsigned int, flags,
 {
 	struct inode *inode = NULL;
 	struct vfsmount *mnt = NULL;
+	struct super_block *sb = NULL;
 	struct fsnotify_group *group;
 	struct fd f;
 	struct path path;
@@ -844,13 +974,17 @@ SYSCALL_DEFINE5(fanotify_mark, int, fanotify_fd, unsigned int, flags,
 			return -EINVAL;
 		break;
 	case FAN_MARK_FLUSH:
-		if (flags & ~(FAN_MARK_MOUNT | FAN_MARK_FLUSH))
+		if (flags & ~(FAN_MARK_MOUNT | FAN_MARK_FILESYSTEM |
+			      FAN_MARK_FLUSH))
 			return -EINVAL;
 		break;
 	default:
 		return -EINVAL;
 	}
 
+	if ((flags & FAN_MARK_MOUNT) && (flags & FAN_MARK_FILESYSTEM))
+		return -EINVAL;
+
 	if (mask & FAN_ONDIR) {
 		flags |= FAN_MARK_ONDIR;
 		mask &= ~FAN_ONDIR;
@@ -886,6 +1020,8 @@ SYSCALL_DEFINE5(fanotify_mark, int, fanotify_fd, unsigned int, flags,
 		ret = 0;
 		if (flags & FAN_MARK_MOUNT)
 			fsnotify_clear_vfsmount_marks_by_group(group);
+		else if (flags & FAN_MARK_FILESYSTEM)
+			fsnotify_clear_sb_marks_by_group(group);
 		else
 			fsnotify_clear_inode_marks_by_group(group);
 		goto fput_and_out;
@@ -895,23 +1031,38 @@ SYSCALL_DEFINE5(fanotify_mark, int, fanotify_fd, unsigned int, flags,
 	if (ret)
 		goto fput_and_out;
 
-	/* inode held in place by reference to path; group by fget on fd */
-	if (!(flags & FAN_MARK_MOUNT))
-		inode = path.dentry->d_inode;
-	else
+	/* the events could not be reported without a file handle */
+	ret = -EOPNOTSUPP;
+	if ((group->fanotify_data.flags & FAN_REPORT_FID) &&
+	    (flags & FAN_MARK_ADD) && !path.dentry->d_sb->s_export_op)
+		goto path_put_and_out;
+
+	/*
+	 * inode and sb held in place by reference to path; group by fget on
+	 * fd
+	 */
+	if (flags & FAN_MARK_MOUNT)
 		mnt = path.mnt;
+	else if (flags & FAN_MARK_FILESYSTEM)
+		sb = path.dentry->d_sb;
+	else
+		inode = path.dentry->d_inode;
 
 	/* create/update an inode mark */
 	switch (flags & (FAN_MARK_ADD | FAN_MARK_REMOVE)) {
 	case FAN_MARK_ADD:
 		if (flags & FAN_MARK_MOUNT)
 			ret = fanotify_add_vfsmount_mark(group, mnt, mask, flags);
+		else if (flags & FAN_MARK_FILESYSTEM)
+			ret = fanotify_add_sb_mark(group, sb, mask, flags);
 		else
 			ret = fanotify_add_inode_mark(group, inode, mask, flags);
 		break;
 	case FAN_MARK_REMOVE:
 		if (flags & FAN_MARK_MOUNT)
 			ret = fanotify_remove_vfsmount_mark(group, mnt, mask, flags);
+		else if (flags & FAN_MARK_FILESYSTEM)
+			ret = fanotify_remove_sb_mark(group, sb, mask, flags);
 		else
 			ret = fanotify_remove_inode_mark(group, inode, mask, flags);
 		break;
@@ -919,6 +1070,7 @@ SYSCALL_DEFINE5(fanotify_mark, int, fanotify_fd, unsigned int, flags,
 		ret = -EINVAL;
 	}
 
+path_put_and_out:
 	path_put(&path);
 fput_and_out:
 	fdput(f);
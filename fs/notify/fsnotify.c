@@ -98,6 +98,17 @@ void fsnotify_unmount_inodes(struct super_block *sb)
 		iput(iput_inode);
 }
 
+/**
+ * fsnotify_sb_delete - an sb is unmounting, destroy its filesystem marks
+ * @sb: superblock being unmounted.
+ *
+ * Called after fsnotify_unmount_inodes(), with no locks held.
+ */
+void fsnotify_sb_delete(struct super_block *sb)
+{
+	fsnotify_clear_marks_by_sb(sb);
+}
+
 /*
  * Given an inode, first check if we care what happens to our children.  Inotify
  * and dnotify both tell their parents about events.  If we care about any event
@@ -186,6 +197,7 @@ EXPORT_SYMBOL_GPL(__fsnotify_parent);
 static int send_to_group(struct inode *to_tell,
 			 struct fsnotify_mark *inode_mark,
 			 struct fsnotify_mark *vfsmount_mark,
+			 struct fsnotify_mark *sb_mark,
 			 __u32 mask, const void *data,
 			 int data_is, u32 cookie,
 			 const unsigned char *file_name,
@@ -194,8 +206,9 @@ static int send_to_group(struct inode *to_tell,
 	struct fsnotify_group *group = NULL;
 	__u32 inode_test_mask = 0;
 	__u32 vfsmount_test_mask = 0;
+	__u32 sb_test_mask = 0;
 
-	if (unlikely(!inode_mark && !vfsmount_mark)) {
+	if (unlikely(!inode_mark && !vfsmount_mark && !sb_mark)) {
 		BUG();
 		return 0;
 	}
@@ -208,6 +221,9 @@ static int send_to_group(struct inode *to_tell,
 		if (vfsmount_mark &&
 		    !(vfsmount_mark->flags & FSNOTIFY_MARK_FLAG_IGNORED_SURV_MODIFY))
 			vfsmount_mark->ignored_mask = 0;
+		if (sb_mark &&
+		    !(sb_mark->flags & FSNOTIFY_MARK_FLAG_IGNORED_SURV_MODIFY))
+			sb_mark->ignored_mask = 0;
 	}
 
 	/* does the inode mark tell us to do something? */
@@ -228,14 +244,26 @@ static int send_to_group(struct inode *to_tell,
 			vfsmount_test_mask &= ~inode_mark->ignored_mask;
 	}
 
+	/* and the sb_mark, unless the inode or the mount ignore the event? */
+	if (sb_mark) {
+		sb_test_mask = (mask & ~FS_EVENT_ON_CHILD);
+		group = sb_mark->group;
+		sb_test_mask &= sb_mark->mask;
+		sb_test_mask &= ~sb_mark->ignored_mask;
+		if (inode_mark)
+			sb_test_mask &= ~inode_mark->ignored_mask;
+		if (vfsmount_mark)
+			sb_test_mask &= ~vfsmount_mark->ignored_mask;
+	}
+
 	pr_debug("%s: group=%p to_tell=%p mask=%x inode_mark=%p"
 		 " inode_test_mask=%x vfsmount_mark=%p vfsmount_test_mask=%x"
-		 " data=%p data_is=%d cookie=%d\n",
+		 " sb_mark=%p sb_test_mask=%x data=%p data_is=%d cookie=%d\n",
 		 __func__, group, to_tell, mask, inode_mark,
-		 inode_test_mask, vfsmount_mark, vfsmount_test_mask, data,
-		 data_is, cookie);
+		 inode_test_mask, vfsmount_mark, vfsmount_test_mask, sb_mark,
+		 sb_test_mask, data, data_is, cookie);
 
-	if (!inode_test_mask && !vfsmount_test_mask)
+	if (!inode_test_mask && !vfsmount_test_mask && !sb_test_mask)
 		return 0;
 
 	return group->ops->handle_event(group, to_tell, inode_mark,
@@ -243,6 +271,25 @@ static int send_to_group(struct inode *to_tell,
 					file_name, cookie, iter_info);
 }
 
+static struct fsnotify_mark *fsnotify_next_mark(struct hlist_node *node)
+{
+	if (!node)
+		return NULL;
+	return hlist_entry(srcu_dereference(node, &fsnotify_mark_srcu),
+			   struct fsnotify_mark, obj_list);
+}
+
+static struct hlist_node *fsnotify_first_node(
+			struct fsnotify_mark_connector __rcu **connp)
+{
+	struct fsnotify_mark_connector *conn;
+
+	conn = srcu_dereference(*connp, &fsnotify_mark_srcu);
+	if (!conn)
+		return NULL;
+	return srcu_dereference(conn->list.first, &fsnotify_mark_srcu);
+}
+
 /*
  * This is the main call to fsnotify.  The VFS calls into hook specific functions
  * in linux/fsnotify.h.  Those functions then in turn call here.  Here will call
@@ -253,10 +300,11 @@ int fsnotify(struct inode *to_tell, __u32 mask, const void *data, int data_is,
 	     const unsigned char *file_name, u32 cookie)
 {
 	struct hlist_node *inode_node = NULL, *vfsmount_node = NULL;
-	struct fsnotify_mark *inode_mark = NULL, *vfsmount_mark = NULL;
-	struct fsnotify_group *inode_group, *vfsmount_group;
-	struct fsnotify_mark_connector *inode_conn, *vfsmount_conn;
+	struct hlist_node *sb_node = NULL;
+	struct fsnotify_mark *inode_mark, *vfsmount_mark, *sb_mark;
+	struct fsnotify_group *group;
 	struct fsnotify_iter_info iter_info;
+	struct super_block *sb = to_tell->i_sb;
 	struct mount *mnt;
 	int ret = 0;
 	/* global tests shouldn't care about events on child only the specific event */
@@ -274,96 +322,90 @@ int fsnotify(struct inode *to_tell, __u32 mask, const void *data, int data_is,
 	 * SRCU because we have no references to any objects and do not
 	 * need SRCU to keep them "alive".
 	 */
-	if (!to_tell->i_fsnotify_marks &&
+	if (!to_tell->i_fsnotify_marks && !sb->s_fsnotify_marks &&
 	    (!mnt || !mnt->mnt_fsnotify_marks))
 		return 0;
 	/*
 	 * if this is a modify event we may need to clear the ignored masks
-	 * otherwise return if neither the inode nor the vfsmount care about
-	 * this type of event.
+	 * otherwise return if neither the inode nor the vfsmount nor the sb
+	 * care about this type of event.
 	 */
 	if (!(mask & FS_MODIFY) &&
 	    !(test_mask & to_tell->i_fsnotify_mask) &&
+	    !(test_mask & sb->s_fsnotify_mask) &&
 	    !(mnt && test_mask & mnt->mnt_fsnotify_mask))
 		return 0;
 
 	iter_info.srcu_idx = srcu_read_lock(&fsnotify_mark_srcu);
 
-	if ((mask & FS_MODIFY) ||
-	    (test_mask & to_tell->i_fsnotify_mask)) {
-		inode_conn = srcu_dereference(to_tell->i_fsnotify_marks,
-					      &fsnotify_mark_srcu);
-		if (inode_conn)
-			inode_node = srcu_dereference(inode_conn->list.first,
-						      &fsnotify_mark_srcu);
-	}
-
+	/*
+	 * The inode marks are needed for their ignored masks as soon as any
+	 * mount or sb mark is walked.
+	 */
+	inode_node = fsnotify_first_node(&to_tell->i_fsnotify_marks);
 	if (mnt && ((mask & FS_MODIFY) ||
-		    (test_mask & mnt->mnt_fsnotify_mask))) {
-		inode_conn = srcu_dereference(to_tell->i_fsnotify_marks,
-					      &fsnotify_mark_srcu);
-		if (inode_conn)
-			inode_node = srcu_dereference(inode_conn->list.first,
-						      &fsnotify_mark_srcu);
-		vfsmount_conn = srcu_dereference(mnt->mnt_fsnotify_marks,
-					         &fsnotify_mark_srcu);
-		if (vfsmount_conn)
-			vfsmount_node = srcu_dereference(
-						vfsmount_conn->list.first,
-						&fsnotify_mark_srcu);
+		    (test_mask & mnt->mnt_fsnotify_mask)))
+		vfsmount_node = fsnotify_first_node(&mnt->mnt_fsnotify_marks);
+	if ((mask & FS_MODIFY) || (test_mask & sb->s_fsnotify_mask)) {
+		sb_node = fsnotify_first_node(&sb->s_fsnotify_marks);
+		/* and the mount ones too, as a mount mark may ignore it */
+		if (mnt && !vfsmount_node)
+			vfsmount_node = fsnotify_first_node(
+						&mnt->mnt_fsnotify_marks);
 	}
+	if (!vfsmount_node && !sb_node && !(mask & FS_MODIFY) &&
+	    !(test_mask & to_tell->i_fsnotify_mask))
+		inode_node = NULL;
 
 	/*
-	 * We need to merge inode & vfsmount mark lists so that inode mark
-	 * ignore masks are properly reflected for mount mark notifications.
-	 * That's why this traversal is so complicated...
+	 * We need to merge inode, vfsmount & sb mark lists so that inode and
+	 * vfsmount mark ignore masks are properly reflected for mount and sb
+	 * mark notifications.  The lists are sorted by group, so each round
+	 * handles the first group of the three lists, with the marks it has
+	 * in each of them.
 	 */
-	while (inode_node || vfsmount_node) {
-		inode_group = NULL;
-		inode_mark = NULL;
-		vfsmount_group = NULL;
-		vfsmount_mark = NULL;
-
-		if (inode_node) {
-			inode_mark = hlist_entry(srcu_dereference(inode_node, &fsnotify_mark_srcu),
-						 struct fsnotify_mark, obj_list);
-			inode_group = inode_mark->group;
-		}
-
-		if (vfsmount_node) {
-			vfsmount_mark = hlist_entry(srcu_dereference(vfsmount_node, &fsnotify_mark_srcu),
-						    struct fsnotify_mark, obj_list);
-			vfsmount_group = vfsmount_mark->group;
-		}
+	while (inode_node || vfsmount_node || sb_node) {
+		inode_mark = fsnotify_next_mark(inode_node);
+		vfsmount_mark = fsnotify_next_mark(vfsmount_node);
+		sb_mark = fsnotify_next_mark(sb_node);
 
-		if (inode_group && vfsmount_group) {
-			int cmp = fsnotify_compare_groups(inode_group,
-							  vfsmount_group);
-			if (cmp > 0) {
-				inode_group = NULL;
-				inode_mark = NULL;
-			} else if (cmp < 0) {
-				vfsmount_group = NULL;
-				vfsmount_mark = NULL;
-			}
-		}
+		group = NULL;
+		if (inode_mark)
+			group = inode_mark->group;
+		if (vfsmount_mark && (!group ||
+		    fsnotify_compare_groups(group, vfsmount_mark->group) > 0))
+			group = vfsmount_mark->group;
+		if (sb_mark && (!group ||
+		    fsnotify_compare_groups(group, sb_mark->group) > 0))
+			group = sb_mark->group;
+
+		if (inode_mark && inode_mark->group != group)
+			inode_mark = NULL;
+		if (vfsmount_mark && vfsmount_mark->group != group)
+			vfsmount_mark = NULL;
+		if (sb_mark && sb_mark->group != group)
+			sb_mark = NULL;
 
 		iter_info.inode_mark = inode_mark;
 		iter_info.vfsmount_mark = vfsmount_mark;
+		iter_info.sb_mark = sb_mark;
 
-		ret = send_to_group(to_tell, inode_mark, vfsmount_mark, mask,
-				    data, data_is, cookie, file_name,
-				    &iter_info);
+		ret = send_to_group(to_tell, inode_mark, vfsmount_mark,
+				    sb_mark, mask, data, data_is, cookie,
+				    file_name, &iter_info);
 
 		if (ret && (mask & ALL_FSNOTIFY_PERM_EVENTS))
 			goto out;
 
-		if (inode_group)
+		if (inode_mark)
 			inode_node = srcu_dereference(inode_node->next,
 						      &fsnotify_mark_srcu);
-		if (vfsmount_group)
+		if (vfsmount_mark)
 			vfsmount_node = srcu_dereference(vfsmount_node->next,
 							 &fsnotify_mark_srcu);
+		if (sb_mark)
+			sb_node = srcu_dereference(sb_node->next,
+						   &fsnotify_mark_srcu);
 	}
 	ret = 0;
 out:
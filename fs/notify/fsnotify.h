@@ -12,6 +12,7 @@
 struct fsnotify_iter_info {
 	struct fsnotify_mark *inode_mark;
 	struct fsnotify_mark *vfsmount_mark;
+	struct fsnotify_mark *sb_mark;
 	int srcu_idx;
 };
 
@@ -37,6 +38,11 @@ static inline void fsnotify_clear_marks_by_mount(struct vfsmount *mnt)
 {
 	fsnotify_destroy_marks(&real_mount(mnt)->mnt_fsnotify_marks);
 }
+/* run the list of all marks associated with sb and destroy them */
+static inline void fsnotify_clear_marks_by_sb(struct super_block *sb)
+{
+	fsnotify_destroy_marks(&sb->s_fsnotify_marks);
+}
 /* Wait until all marks queued for destruction are destroyed */
 extern void fsnotify_wait_marks_destroyed(void);
 
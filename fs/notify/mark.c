@@ -133,6 +133,8 @@ static void __fsnotify_recalc_mask(struct fsnotify_mark_connector *conn)
 		conn->inode->i_fsnotify_mask = new_mask;
 	else if (conn->flags & FSNOTIFY_OBJ_TYPE_VFSMOUNT)
 		real_mount(conn->mnt)->mnt_fsnotify_mask = new_mask;
+	else if (conn->flags & FSNOTIFY_OBJ_TYPE_SB)
+		conn->sb->s_fsnotify_mask = new_mask;
 }
 
 /*
@@ -188,6 +190,11 @@ static struct inode *fsnotify_detach_connector_from_object(
 		real_mount(conn->mnt)->mnt_fsnotify_mask = 0;
 		conn->mnt = NULL;
 		conn->flags &= ~FSNOTIFY_OBJ_TYPE_VFSMOUNT;
+	} else if (conn->flags & FSNOTIFY_OBJ_TYPE_SB) {
+		rcu_assign_pointer(conn->sb->s_fsnotify_marks, NULL);
+		conn->sb->s_fsnotify_mask = 0;
+		conn->sb = NULL;
+		conn->flags &= ~FSNOTIFY_OBJ_TYPE_SB;
 	}
 
 	return inode;
@@ -260,13 +267,16 @@ bool fsnotify_prepare_user_wait(struct fsnotify_iter_info *iter_info)
 {
 	struct fsnotify_group *group;
 
-	if (WARN_ON_ONCE(!iter_info->inode_mark && !iter_info->vfsmount_mark))
-		return false;
-
 	if (iter_info->inode_mark)
 		group = iter_info->inode_mark->group;
-	else
+	else if (iter_info->vfsmount_mark)
 		group = iter_info->vfsmount_mark->group;
+	else if (iter_info->sb_mark)
+		group = iter_info->sb_mark->group;
+	else {
+		WARN_ON_ONCE(1);
+		return false;
+	}
 
 	/*
 	 * Since acquisition of mark reference is an atomic op as well, we can
@@ -283,15 +293,22 @@ bool fsnotify_prepare_user_wait(struct fsnotify_iter_info *iter_info)
 		if (!fsnotify_get_mark_safe(iter_info->vfsmount_mark))
 			goto out_inode;
 	}
+	if (iter_info->sb_mark) {
+		if (!fsnotify_get_mark_safe(iter_info->sb_mark))
+			goto out_vfsmount;
+	}
 
 	/*
-	 * Now that both marks are pinned by refcount in the inode / vfsmount
-	 * lists, we can drop SRCU lock, and safely resume the list iteration
-	 * once userspace returns.
+	 * Now that all marks are pinned by refcount in the inode / vfsmount /
+	 * sb lists, we can drop SRCU lock, and safely resume the list
+	 * iteration once userspace returns.
 	 */
 	srcu_read_unlock(&fsnotify_mark_srcu, iter_info->srcu_idx);
 
 	return true;
+out_vfsmount:
+	if (iter_info->vfsmount_mark)
+		fsnotify_put_mark(iter_info->vfsmount_mark);
 out_inode:
 	if (iter_info->inode_mark)
 		fsnotify_put_mark(iter_info->inode_mark);
@@ -314,6 +331,10 @@ void fsnotify_finish_user_wait(struct fsnotify_iter_info *iter_info)
 		group = iter_info->vfsmount_mark->group;
 		fsnotify_put_mark(iter_info->vfsmount_mark);
 	}
+	if (iter_info->sb_mark) {
+		group = iter_info->sb_mark->group;
+		fsnotify_put_mark(iter_info->sb_mark);
+	}
 	/*
 	 * We abuse notification_waitq on group shutdown for waiting for all
 	 * marks pinned when waiting for userspace.
@@ -435,7 +456,8 @@ int fsnotify_compare_groups(struct fsnotify_group *a, struct fsnotify_group *b)
 static int fsnotify_attach_connector_to_object(
 				struct fsnotify_mark_connector __rcu **connp,
 				struct inode *inode,
-				struct vfsmount *mnt)
+				struct vfsmount *mnt,
+				struct super_block *sb)
 {
 	struct fsnotify_mark_connector *conn;
 
@@ -447,9 +469,12 @@ static int fsnotify_attach_connector_to_object(
 	if (inode) {
 		conn->flags = FSNOTIFY_OBJ_TYPE_INODE;
 		conn->inode = igrab(inode);
-	} else {
+	} else if (mnt) {
 		conn->flags = FSNOTIFY_OBJ_TYPE_VFSMOUNT;
 		conn->mnt = mnt;
+	} else {
+		conn->flags = FSNOTIFY_OBJ_TYPE_SB;
+		conn->sb = sb;
 	}
 	/*
 	 * cmpxchg() provides the barrier so that readers of *connp can see
@@ -482,8 +507,7 @@ static struct fsnotify_mark_connector *fsnotify_grab_connector(
 	if (!conn)
 		goto out;
 	spin_lock(&conn->lock);
-	if (!(conn->flags & (FSNOTIFY_OBJ_TYPE_INODE |
-			     FSNOTIFY_OBJ_TYPE_VFSMOUNT))) {
+	if (!(conn->flags & FSNOTIFY_OBJ_ALL_TYPES)) {
 		spin_unlock(&conn->lock);
 		srcu_read_unlock(&fsnotify_mark_srcu, idx);
 		return NULL;
@@ -501,7 +525,7 @@ static struct fsnotify_mark_connector *fsnotify_grab_connector(
  */
 static int fsnotify_add_mark_list(struct fsnotify_mark *mark,
 				  struct inode *inode, struct vfsmount *mnt,
-				  int allow_dups)
+				  struct super_block *sb, int allow_dups)
 {
 	struct fsnotify_mark *lmark, *last = NULL;
 	struct fsnotify_mark_connector *conn;
@@ -509,18 +533,21 @@ static int fsnotify_add_mark_list(struct fsnotify_mark *mark,
 	int cmp;
 	int err = 0;
 
-	if (WARN_ON(!inode && !mnt))
+	if (WARN_ON(!inode && !mnt && !sb))
 		return -EINVAL;
 	if (inode)
 		connp = &inode->i_fsnotify_marks;
-	else
+	else if (mnt)
 		connp = &real_mount(mnt)->mnt_fsnotify_marks;
+	else
+		connp = &sb->s_fsnotify_marks;
 restart:
 	spin_lock(&mark->lock);
 	conn = fsnotify_grab_connector(connp);
 	if (!conn) {
 		spin_unlock(&mark->lock);
-		err = fsnotify_attach_connector_to_object(connp, inode, mnt);
+		err = fsnotify_attach_connector_to_object(connp, inode, mnt,
+							  sb);
 		if (err)
 			return err;
 		goto restart;
@@ -566,14 +593,15 @@ static int fsnotify_add_mark_list(struct fsnotify_mark *mark,
  * These marks may be used for the fsnotify backend to determine which
  * event types should be delivered to which group.
  */
-int fsnotify_add_mark_locked(struct fsnotify_mark *mark, struct inode *inode,
-			     struct vfsmount *mnt, int allow_dups)
+static int __fsnotify_add_mark_locked(struct fsnotify_mark *mark,
+				      struct inode *inode,
+				      struct vfsmount *mnt,
+				      struct super_block *sb, int allow_dups)
 {
 	struct fsnotify_group *group = mark->group;
 	int ret = 0;
 
-	BUG_ON(inode && mnt);
-	BUG_ON(!inode && !mnt);
+	BUG_ON(!!inode + !!mnt + !!sb != 1);
 	BUG_ON(!mutex_is_locked(&group->mark_mutex));
 
 	/*
@@ -590,7 +618,7 @@ int fsnotify_add_mark_locked(struct fsnotify_mark *mark, struct inode *inode,
 	fsnotify_get_mark(mark); /* for g_list */
 	spin_unlock(&mark->lock);
 
-	ret = fsnotify_add_mark_list(mark, inode, mnt, allow_dups);
+	ret = fsnotify_add_mark_list(mark, inode, mnt, sb, allow_dups);
 	if (ret)
 		goto err;
 
@@ -608,6 +636,23 @@ int fsnotify_add_mark_locked(struct fsnotify_mark *mark, struct inode *inode,
 	return ret;
 }
 
+int fsnotify_add_mark_locked(struct fsnotify_mark *mark, struct inode *inode,
+			     struct vfsmount *mnt, int allow_dups)
+{
+	return __fsnotify_add_mark_locked(mark, inode, mnt, NULL, allow_dups);
+}
+
+/*
+ * The mark gets the events of all the inodes of @sb, whatever the mount they
+ * are accessed through.  It is destroyed by fsnotify_sb_delete() on unmount,
+ * so the caller must hold an active reference on @sb.
+ */
+int fsnotify_add_sb_mark_locked(struct fsnotify_mark *mark,
+				struct super_block *sb, int allow_dups)
+{
+	return __fsnotify_add_mark_locked(mark, NULL, NULL, sb, allow_dups);
+}
+
 int fsnotify_add_mark(struct fsnotify_mark *mark, struct inode *inode,
 		      struct vfsmount *mnt, int allow_dups)
 {
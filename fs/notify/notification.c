@@ -92,11 +92,13 @@ void fsnotify_destroy_event(struct fsnotify_group *group,
  * event off the queue to deal with.  The function returns 0 if the event was
  * added to the queue, 1 if the event was merged with some other queued event,
  * 2 if the event was not queued - either the queue of events has overflown
- * or the group is shutting down.
+ * or the group is shutting down.  @merge is called under notification_lock,
+ * also on an empty queue, and the event is queued right after it returns 0,
+ * so a backend may index the event there.
  */
 int fsnotify_add_event(struct fsnotify_group *group,
 		       struct fsnotify_event *event,
-		       int (*merge)(struct list_head *,
+		       int (*merge)(struct fsnotify_group *,
 				    struct fsnotify_event *))
 {
 	int ret = 0;
@@ -122,8 +124,8 @@ int fsnotify_add_event(struct fsnotify_group *group,
 		goto queue;
 	}
 
-	if (!list_empty(list) && merge) {
-		ret = merge(list, event);
+	if (merge) {
+		ret = merge(group, event);
 		if (ret) {
 			spin_unlock(&group->notification_lock);
 			return ret;
@@ -767,6 +767,19 @@ static int do_dentry_open(struct file *f,
 
 	file_ra_state_init(&f->f_ra, f->f_mapping->host->i_mapping);
 
+	/*
+	 * The huge pages khugepaged put in the page cache of a regular
+	 * file cannot be written to: drop the page cache before letting a
+	 * writer in.  Pairs with the barrier in collapse_file(), which
+	 * backs off if it sees the write access taken above.
+	 */
+	if (IS_ENABLED(CONFIG_READ_ONLY_THP_FOR_FS) &&
+	    (f->f_mode & FMODE_WRITE)) {
+		smp_mb();
+		if (filemap_nr_thps(inode->i_mapping))
+			truncate_pagecache(inode, 0);
+	}
+
 	return 0;
 
 cleanup_all:
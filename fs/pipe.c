@@ -129,16 +129,23 @@ static void anon_pipe_buf_release(struct pipe_inode_info *pipe,
 	struct page *page = buf->page;
 
 	/*
-	 * If nobody else uses this page, and we don't already have a
-	 * temporary page, let's keep track of it as a one-deep
-	 * allocation cache. (Otherwise just release our reference to it)
+	 * If nobody else uses this page, keep it in the pool of the pipe for
+	 * the next writes.  (Otherwise just release our reference to it)
+	 * With at most one ring of pooled pages, a streaming pipe stops
+	 * allocating once it has been full once.
 	 */
-	if (page_count(page) == 1 && !pipe->tmp_page)
-		pipe->tmp_page = page;
+	if (page_count(page) == 1 && pipe->nr_tmp_pages < pipe->buffers)
+		pipe->tmp_pages[pipe->nr_tmp_pages++] = page;
 	else
 		put_page(page);
 }
 
+static void pipe_free_tmp_pages(struct pipe_inode_info *pipe)
+{
+	while (pipe->nr_tmp_pages)
+		__free_page(pipe->tmp_pages[--pipe->nr_tmp_pages]);
+}
+
 static int anon_pipe_buf_steal(struct pipe_inode_info *pipe,
 			       struct pipe_buffer *buf)
 {
@@ -253,14 +260,13 @@ pipe_read(struct kiocb *iocb, struct iov_iter *to)
 	size_t total_len = iov_iter_count(to);
 	struct file *filp = iocb->ki_filp;
 	struct pipe_inode_info *pipe = filp->private_data;
-	int do_wakeup;
+	bool wake_writer = false;
 	ssize_t ret;
 
 	/* Null read succeeds. */
 	if (unlikely(total_len == 0))
 		return 0;
 
-	do_wakeup = 0;
 	ret = 0;
 	__pipe_lock(pipe);
 	for (;;) {
@@ -299,11 +305,13 @@ pipe_read(struct kiocb *iocb, struct iov_iter *to)
 			}
 
 			if (!buf->len) {
+				/* writers only sleep on a full pipe */
+				if (bufs == pipe->buffers)
+					wake_writer = true;
 				pipe_buf_release(pipe, buf);
 				curbuf = (curbuf + 1) & (pipe->buffers - 1);
 				pipe->curbuf = curbuf;
 				pipe->nrbufs = --bufs;
-				do_wakeup = 1;
 			}
 			total_len -= chars;
 			if (!total_len)
@@ -331,19 +339,21 @@ pipe_read(struct kiocb *iocb, struct iov_iter *to)
 				ret = -ERESTARTSYS;
 			break;
 		}
-		if (do_wakeup) {
+		if (wake_writer) {
 			wake_up_interruptible_sync_poll(&pipe->wait, POLLOUT | POLLWRNORM);
- 			kill_fasync(&pipe->fasync_writers, SIGIO, POLL_OUT);
+			wake_writer = false;
 		}
+		if (ret > 0)
+			kill_fasync(&pipe->fasync_writers, SIGIO, POLL_OUT);
 		pipe_wait(pipe);
 	}
 	__pipe_unlock(pipe);
 
 	/* Signal writers asynchronously that there is more room. */
-	if (do_wakeup) {
+	if (wake_writer)
 		wake_up_interruptible_sync_poll(&pipe->wait, POLLOUT | POLLWRNORM);
+	if (ret > 0)
 		kill_fasync(&pipe->fasync_writers, SIGIO, POLL_OUT);
-	}
 	if (ret > 0)
 		file_accessed(filp);
 	return ret;
@@ -360,7 +370,7 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 	struct file *filp = iocb->ki_filp;
 	struct pipe_inode_info *pipe = filp->private_data;
 	ssize_t ret = 0;
-	int do_wakeup = 0;
+	bool wake_reader = false;
 	size_t total_len = iov_iter_count(from);
 	ssize_t chars;
 
@@ -370,6 +380,13 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 
 	__pipe_lock(pipe);
 
+	/*
+	 * Readers only sleep on an empty pipe, but epoll users in edge
+	 * triggered mode expect an event for each write.
+	 */
+	if (!pipe->nrbufs || READ_ONCE(pipe->poll_usage))
+		wake_reader = true;
+
 	if (!pipe->readers) {
 		send_sig(SIGPIPE, current, 0);
 		ret = -EPIPE;
@@ -394,7 +411,6 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 				ret = -EFAULT;
 				goto out;
 			}
-			do_wakeup = 1;
 			buf->len += ret;
 			if (!iov_iter_count(from))
 				goto out;
@@ -414,23 +430,26 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 		if (bufs < pipe->buffers) {
 			int newbuf = (pipe->curbuf + bufs) & (pipe->buffers-1);
 			struct pipe_buffer *buf = pipe->bufs + newbuf;
-			struct page *page = pipe->tmp_page;
+			struct page *page;
 			int copied;
 
-			if (!page) {
+			/* the page stays in the pool until it is queued */
+			if (!pipe->nr_tmp_pages) {
 				page = alloc_page(GFP_HIGHUSER | __GFP_ACCOUNT);
 				if (unlikely(!page)) {
 					ret = ret ? : -ENOMEM;
 					break;
 				}
-				pipe->tmp_page = page;
+				pipe->tmp_pages[pipe->nr_tmp_pages++] = page;
 			}
+			page = pipe->tmp_pages[pipe->nr_tmp_pages - 1];
 			/* Always wake up, even if the copy fails. Otherwise
 			 * we lock up (O_NONBLOCK-)readers that sleep due to
 			 * syscall merging.
 			 * FIXME! Is this really true?
 			 */
-			do_wakeup = 1;
+			if (!bufs || READ_ONCE(pipe->poll_usage))
+				wake_reader = true;
 			copied = copy_page_from_iter(page, 0, PAGE_SIZE, from);
 			if (unlikely(copied < PAGE_SIZE && iov_iter_count(from))) {
 				if (!ret)
@@ -450,7 +469,7 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 				buf->flags = PIPE_BUF_FLAG_PACKET;
 			}
 			pipe->nrbufs = ++bufs;
-			pipe->tmp_page = NULL;
+			pipe->nr_tmp_pages--;
 
 			if (!iov_iter_count(from))
 				break;
@@ -467,21 +486,22 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 				ret = -ERESTARTSYS;
 			break;
 		}
-		if (do_wakeup) {
+		if (wake_reader) {
 			wake_up_interruptible_sync_poll(&pipe->wait, POLLIN | POLLRDNORM);
-			kill_fasync(&pipe->fasync_readers, SIGIO, POLL_IN);
-			do_wakeup = 0;
+			wake_reader = false;
 		}
+		if (ret > 0)
+			kill_fasync(&pipe->fasync_readers, SIGIO, POLL_IN);
 		pipe->waiting_writers++;
 		pipe_wait(pipe);
 		pipe->waiting_writers--;
 	}
 out:
 	__pipe_unlock(pipe);
-	if (do_wakeup) {
+	if (wake_reader)
 		wake_up_interruptible_sync_poll(&pipe->wait, POLLIN | POLLRDNORM);
+	if (ret > 0)
 		kill_fasync(&pipe->fasync_readers, SIGIO, POLL_IN);
-	}
 	if (ret > 0 && sb_start_write_trylock(file_inode(filp)->i_sb)) {
 		int err = file_update_time(filp);
 		if (err)
@@ -522,6 +542,9 @@ pipe_poll(struct file *filp, poll_table *wait)
 	struct pipe_inode_info *pipe = filp->private_data;
 	int nrbufs;
 
+	/* from now on, every write wakes the readers up */
+	WRITE_ONCE(pipe->poll_usage, true);
+
 	poll_wait(filp, &pipe->wait, wait);
 
 	/* Reading only -- no need for acquiring the semaphore.  */
@@ -644,8 +667,10 @@ struct pipe_inode_info *alloc_pipe_info(void)
 
 	pipe->bufs = kcalloc(pipe_bufs, sizeof(struct pipe_buffer),
 			     GFP_KERNEL_ACCOUNT);
+	pipe->tmp_pages = kcalloc(pipe_bufs, sizeof(struct page *),
+				  GFP_KERNEL_ACCOUNT);
 
-	if (pipe->bufs) {
+	if (pipe->bufs && pipe->tmp_pages) {
 		init_waitqueue_head(&pipe->wait);
 		pipe->r_counter = pipe->w_counter = 1;
 		pipe->buffers = pipe_bufs;
@@ -654,6 +679,8 @@ struct pipe_inode_info *alloc_pipe_info(void)
 		return pipe;
 	}
 
+	kfree(pipe->tmp_pages);
+	kfree(pipe->bufs);
 out_revert_acct:
 	(void) account_pipe_buffers(user, pipe_bufs, 0);
 	kfree(pipe);
@@ -673,8 +700,8 @@ void free_pipe_info(struct pipe_inode_info *pipe)
 		if (buf->ops)
 			pipe_buf_release(pipe, buf);
 	}
-	if (pipe->tmp_page)
-		__free_page(pipe->tmp_page);
+	pipe_free_tmp_pages(pipe);
+	kfree(pipe->tmp_pages);
 	kfree(pipe->bufs);
 	kfree(pipe);
 }
@@ -1035,6 +1062,7 @@ static inline unsigned int round_pipe_size(unsigned int size)
 static long pipe_set_size(struct pipe_inode_info *pipe, unsigned long arg)
 {
 	struct pipe_buffer *bufs;
+	struct page **tmp_pages;
 	unsigned int size, nr_pages;
 	unsigned long user_bufs;
 	long ret = 0;
@@ -1079,7 +1107,11 @@ static long pipe_set_size(struct pipe_inode_info *pipe, unsigned long arg)
 
 	bufs = kcalloc(nr_pages, sizeof(*bufs),
 		       GFP_KERNEL_ACCOUNT | __GFP_NOWARN);
-	if (unlikely(!bufs)) {
+	tmp_pages = kcalloc(nr_pages, sizeof(*tmp_pages),
+			    GFP_KERNEL_ACCOUNT | __GFP_NOWARN);
+	if (unlikely(!bufs || !tmp_pages)) {
+		kfree(tmp_pages);
+		kfree(bufs);
 		ret = -ENOMEM;
 		goto out_revert_acct;
 	}
@@ -1105,6 +1137,11 @@ static long pipe_set_size(struct pipe_inode_info *pipe, unsigned long arg)
 			memcpy(bufs + head, pipe->bufs, tail * sizeof(struct pipe_buffer));
 	}
 
+	/* the pool is sized to the ring, start it again */
+	pipe_free_tmp_pages(pipe);
+	kfree(pipe->tmp_pages);
+	pipe->tmp_pages = tmp_pages;
+
 	pipe->curbuf = 0;
 	kfree(pipe->bufs);
 	pipe->bufs = bufs;
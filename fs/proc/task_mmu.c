@@ -521,6 +521,22 @@ static int smaps_pte_hole(unsigned long addr, unsigned long end,
 }
 #endif
 
+static void smaps_account_swap(struct mem_size_stats *mss, swp_entry_t swpent)
+{
+	int mapcount;
+
+	mss->swap += PAGE_SIZE;
+	mapcount = swp_swapcount(swpent);
+	if (mapcount >= 2) {
+		u64 pss_delta = (u64)PAGE_SIZE << PSS_SHIFT;
+
+		do_div(pss_delta, mapcount);
+		mss->swap_pss += pss_delta;
+	} else {
+		mss->swap_pss += (u64)PAGE_SIZE << PSS_SHIFT;
+	}
+}
+
 static void smaps_pte_entry(pte_t *pte, unsigned long addr,
 		struct mm_walk *walk)
 {
@@ -533,20 +549,9 @@ static void smaps_pte_entry(pte_t *pte, unsigned long addr,
 	} else if (is_swap_pte(*pte)) {
 		swp_entry_t swpent = pte_to_swp_entry(*pte);
 
-		if (!non_swap_entry(swpent)) {
-			int mapcount;
-
-			mss->swap += PAGE_SIZE;
-			mapcount = swp_swapcount(swpent);
-			if (mapcount >= 2) {
-				u64 pss_delta = (u64)PAGE_SIZE << PSS_SHIFT;
-
-				do_div(pss_delta, mapcount);
-				mss->swap_pss += pss_delta;
-			} else {
-				mss->swap_pss += (u64)PAGE_SIZE << PSS_SHIFT;
-			}
-		} else if (is_migration_entry(swpent))
+		if (!non_swap_entry(swpent))
+			smaps_account_swap(mss, swpent);
+		else if (is_migration_entry(swpent))
 			page = migration_entry_to_page(swpent);
 		else if (is_device_private_entry(swpent))
 			page = device_private_entry_to_page(swpent);
@@ -609,8 +614,15 @@ static int smaps_pte_range(pmd_t *pmd, unsigned long addr, unsigned long end,
 
 	ptl = pmd_trans_huge_lock(pmd, vma);
 	if (ptl) {
-		if (pmd_present(*pmd))
+		if (pmd_present(*pmd)) {
 			smaps_pmd_entry(pmd, addr, walk);
+		} else if (is_pmd_swap_entry(*pmd)) {
+			swp_entry_t swpent = pmd_to_swp_entry(*pmd);
+			int i;
+
+			for (i = 0; i < HPAGE_PMD_NR; i++, swpent.val++)
+				smaps_account_swap(walk->private, swpent);
+		}
 		spin_unlock(ptl);
 		goto out;
 	}
@@ -994,7 +1006,7 @@ static inline void clear_soft_dirty_pmd(struct vm_area_struct *vma,
 		pmd = pmd_clear_soft_dirty(pmd);
 
 		set_pmd_at(vma->vm_mm, addr, pmdp, pmd);
-	} else if (is_migration_entry(pmd_to_swp_entry(pmd))) {
+	} else if (is_swap_pmd(pmd)) {
 		pmd = pmd_swp_clear_soft_dirty(pmd);
 		set_pmd_at(vma->vm_mm, addr, pmdp, pmd);
 	}
@@ -1153,8 +1165,10 @@ static ssize_t clear_refs_write(struct file *file, const char __user *buf,
 					goto out_mm;
 				}
 				for (vma = mm->mmap; vma; vma = vma->vm_next) {
+					vm_write_begin(vma);
 					vma->vm_flags &= ~VM_SOFTDIRTY;
 					vma_set_page_prot(vma);
+					vm_write_end(vma);
 				}
 				downgrade_write(&mm->mmap_sem);
 				break;
@@ -1333,8 +1347,8 @@ static int pagemap_pmd_range(pmd_t *pmdp, unsigned long addr, unsigned long end,
 			flags |= PM_SWAP;
 			if (pmd_swp_soft_dirty(pmd))
 				flags |= PM_SOFT_DIRTY;
-			VM_BUG_ON(!is_pmd_migration_entry(pmd));
-			page = migration_entry_to_page(entry);
+			if (is_pmd_migration_entry(pmd))
+				page = migration_entry_to_page(entry);
 		}
 #endif
 
@@ -1349,6 +1363,8 @@ static int pagemap_pmd_range(pmd_t *pmdp, unsigned long addr, unsigned long end,
 				break;
 			if (pm->show_pfn && (flags & PM_PRESENT))
 				frame++;
+			else if (flags & PM_SWAP)
+				frame += (1 << MAX_SWAPFILES_SHIFT);
 		}
 		spin_unlock(ptl);
 		return err;
@@ -1563,11 +1579,408 @@ static int pagemap_release(struct inode *inode, struct file *file)
 	return 0;
 }
 
+#define PM_SCAN_CATEGORIES	(PAGE_IS_PRESENT | PAGE_IS_SWAPPED |	\
+				 PAGE_IS_FILE | PAGE_IS_SOFT_DIRTY |	\
+				 PAGE_IS_HUGE)
+#define PM_SCAN_FLAGS		(PM_SCAN_CLEAR_SOFT_DIRTY)
+#define PM_SCAN_BUF_LEN		(PAGE_SIZE / sizeof(struct page_region))
+
+struct pagemap_scan_private {
+	struct pm_scan_arg arg;
+	unsigned long found_pages;
+	/* the last region of the buffer is the one being extended */
+	struct page_region *vec_buf;
+	unsigned long vec_buf_len, vec_buf_index;
+};
+
+static bool pagemap_scan_is_interesting(unsigned long categories,
+					struct pagemap_scan_private *p)
+{
+	categories ^= p->arg.category_inverted;
+	if ((categories & p->arg.category_mask) != p->arg.category_mask)
+		return false;
+	if (p->arg.category_anyof_mask &&
+	    !(categories & p->arg.category_anyof_mask))
+		return false;
+	return true;
+}
+
+/*
+ * Adds the pages of [addr, end) to the output, merged with the previous
+ * region when they follow it with the same categories.  Returns the end of
+ * the part added, which is short of @end when the buffer is full or when
+ * max_pages is reached: the walk then stops there.
+ */
+static unsigned long pagemap_scan_output(unsigned long categories,
+					 struct pagemap_scan_private *p,
+					 unsigned long addr, unsigned long end)
+{
+	struct page_region *cur = &p->vec_buf[p->vec_buf_index];
+
+	if (p->arg.max_pages) {
+		unsigned long left = p->arg.max_pages - p->found_pages;
+
+		if ((end - addr) >> PAGE_SHIFT > left)
+			end = addr + (left << PAGE_SHIFT);
+		if (end == addr)
+			return addr;
+	}
+
+	categories &= p->arg.return_mask;
+	if (cur->start != cur->end &&
+	    (cur->end != addr || cur->categories != categories)) {
+		if (p->vec_buf_index + 1 == p->vec_buf_len)
+			return addr;
+		cur = &p->vec_buf[++p->vec_buf_index];
+	}
+	if (cur->start == cur->end) {
+		cur->start = addr;
+		cur->categories = categories;
+	}
+	cur->end = end;
+
+	p->found_pages += (end - addr) >> PAGE_SHIFT;
+	return end;
+}
+
+/* Outputs [addr, end) if interesting, and returns -ENOSPC if it is not all */
+static int pagemap_scan_range(unsigned long categories,
+			      struct pagemap_scan_private *p,
+			      unsigned long addr, unsigned long end)
+{
+	unsigned long next;
+
+	if (!pagemap_scan_is_interesting(categories, p))
+		return 0;
+
+	next = pagemap_scan_output(categories, p, addr, end);
+	if (next != end) {
+		p->arg.walk_end = next;
+		return -ENOSPC;
+	}
+	return 0;
+}
+
+static unsigned long pagemap_page_category(struct vm_area_struct *vma,
+					   unsigned long addr, pte_t pte)
+{
+	unsigned long categories = 0;
+	struct page *page = NULL;
+
+	if (pte_present(pte)) {
+		categories |= PAGE_IS_PRESENT;
+		if (pte_soft_dirty(pte))
+			categories |= PAGE_IS_SOFT_DIRTY;
+		page = _vm_normal_page(vma, addr, pte, true);
+	} else if (is_swap_pte(pte)) {
+		swp_entry_t entry = pte_to_swp_entry(pte);
+
+		categories |= PAGE_IS_SWAPPED;
+		if (pte_swp_soft_dirty(pte))
+			categories |= PAGE_IS_SOFT_DIRTY;
+		if (is_migration_entry(entry))
+			page = migration_entry_to_page(entry);
+		if (is_device_private_entry(entry))
+			page = device_private_entry_to_page(entry);
+	}
+
+	if (page && !PageAnon(page))
+		categories |= PAGE_IS_FILE;
+	if (vma->vm_flags & VM_SOFTDIRTY)
+		categories |= PAGE_IS_SOFT_DIRTY;
+
+	return categories;
+}
+
+static int pagemap_scan_pmd_entry(pmd_t *pmd, unsigned long addr,
+				  unsigned long end, struct mm_walk *walk)
+{
+	struct pagemap_scan_private *p = walk->private;
+	struct vm_area_struct *vma = walk->vma;
+	bool clear = p->arg.flags & PM_SCAN_CLEAR_SOFT_DIRTY;
+	unsigned long flush_start = end, flush_end = 0;
+	spinlock_t *ptl;
+	pte_t *pte, *orig_pte;
+	int ret = 0;
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	ptl = pmd_trans_huge_lock(pmd, vma);
+	if (ptl) {
+		unsigned long categories = PAGE_IS_HUGE;
+		struct page *page = NULL;
+
+		if (pmd_present(*pmd)) {
+			categories |= PAGE_IS_PRESENT;
+			if (pmd_soft_dirty(*pmd))
+				categories |= PAGE_IS_SOFT_DIRTY;
+			page = pmd_page(*pmd);
+		} else if (is_swap_pmd(*pmd)) {
+			categories |= PAGE_IS_SWAPPED;
+			if (pmd_swp_soft_dirty(*pmd))
+				categories |= PAGE_IS_SOFT_DIRTY;
+		}
+		if (page && !PageAnon(page))
+			categories |= PAGE_IS_FILE;
+		if (vma->vm_flags & VM_SOFTDIRTY)
+			categories |= PAGE_IS_SOFT_DIRTY;
+
+		ret = pagemap_scan_range(categories, p, addr, end);
+		/*
+		 * The soft-dirty bit of a huge pmd is only cleared when all
+		 * of its pages were reported, the others are left dirty.
+		 */
+		if (!ret && clear && end - addr == HPAGE_PMD_SIZE &&
+		    pagemap_scan_is_interesting(categories, p))
+			clear_soft_dirty_pmd(vma, addr, pmd);
+		spin_unlock(ptl);
+		return ret;
+	}
+
+	if (pmd_trans_unstable(pmd))
+		return 0;
+#endif /* CONFIG_TRANSPARENT_HUGEPAGE */
+
+	orig_pte = pte = pte_offset_map_lock(walk->mm, pmd, addr, &ptl);
+	for (; addr < end; pte++, addr += PAGE_SIZE) {
+		unsigned long categories;
+
+		categories = pagemap_page_category(vma, addr, *pte);
+		if (!pagemap_scan_is_interesting(categories, p))
+			continue;
+
+		ret = pagemap_scan_range(categories, p, addr,
+					 addr + PAGE_SIZE);
+		if (ret)
+			break;
+		if (clear) {
+			clear_soft_dirty(vma, addr, pte);
+			flush_start = min(flush_start, addr);
+			flush_end = addr + PAGE_SIZE;
+		}
+	}
+	pte_unmap_unlock(orig_pte, ptl);
+
+	/* the ptes were write protected to catch the next writes */
+	if (flush_end)
+		flush_tlb_range(vma, flush_start, flush_end);
+
+	cond_resched();
+
+	return ret;
+}
+
+static int pagemap_scan_pte_hole(unsigned long addr, unsigned long end,
+				 struct mm_walk *walk)
+{
+	struct pagemap_scan_private *p = walk->private;
+	struct vm_area_struct *vma = walk->vma;
+	unsigned long categories = 0;
+
+	/* outside of any vma */
+	if (!vma)
+		return 0;
+
+	if (vma->vm_flags & VM_SOFTDIRTY)
+		categories |= PAGE_IS_SOFT_DIRTY;
+
+	return pagemap_scan_range(categories, p, addr, end);
+}
+
+#ifdef CONFIG_HUGETLB_PAGE
+static int pagemap_scan_hugetlb_entry(pte_t *ptep, unsigned long hmask,
+				      unsigned long addr, unsigned long end,
+				      struct mm_walk *walk)
+{
+	struct pagemap_scan_private *p = walk->private;
+	struct vm_area_struct *vma = walk->vma;
+	unsigned long categories = PAGE_IS_HUGE;
+	pte_t pte = huge_ptep_get(ptep);
+
+	if (pte_present(pte)) {
+		categories |= PAGE_IS_PRESENT;
+		if (!PageAnon(pte_page(pte)))
+			categories |= PAGE_IS_FILE;
+	}
+	if (vma->vm_flags & VM_SOFTDIRTY)
+		categories |= PAGE_IS_SOFT_DIRTY;
+
+	cond_resched();
+
+	return pagemap_scan_range(categories, p, addr, end);
+}
+#endif /* HUGETLB_PAGE */
+
+/* Copies the complete regions of the buffer to @vec */
+static int pagemap_scan_flush(struct pagemap_scan_private *p,
+			      struct page_region __user **vec, bool all)
+{
+	unsigned long n = p->vec_buf_index;
+	struct page_region *last = &p->vec_buf[n];
+
+	if (all && last->start != last->end)
+		n++;
+	if (!n)
+		return 0;
+
+	if (copy_to_user(*vec, p->vec_buf, n * sizeof(*p->vec_buf)))
+		return -EFAULT;
+	*vec += n;
+	p->arg.vec_len -= n;
+
+	/* the region being extended starts the buffer again */
+	if (n == p->vec_buf_index)
+		p->vec_buf[0] = *last;
+	else
+		memset(&p->vec_buf[0], 0, sizeof(*p->vec_buf));
+	p->vec_buf_index = 0;
+	p->vec_buf_len = min_t(unsigned long, PM_SCAN_BUF_LEN, p->arg.vec_len);
+	return n;
+}
+
+/*
+ * PAGEMAP_SCAN: /proc/pid/pagemap without one entry per page
+ *
+ * Walks [start, end) of the address space and fills @vec with the runs of
+ * pages whose categories are interesting, as told by the masks, which saves
+ * reading and filtering 8 bytes per page.  With PM_SCAN_CLEAR_SOFT_DIRTY
+ * the soft-dirty state of the reported pages is cleared in the same pass,
+ * as writing 4 to /proc/pid/clear_refs does for the whole address space.
+ * The VM_SOFTDIRTY state of a vma is left alone though: its pages keep on
+ * being reported soft-dirty until clear_refs is written.  Together with
+ * @max_pages, the scan can be done in increments starting at @walk_end.
+ */
+static long do_pagemap_scan(struct mm_struct *mm, unsigned long uarg)
+{
+	struct pm_scan_arg __user *uargp = (void __user *)uarg;
+	struct pagemap_scan_private p = {};
+	struct page_region __user *vec;
+	struct mm_walk scan_walk = {};
+	unsigned long start, end;
+	long ret, regions = 0;
+	bool clear;
+
+	if (copy_from_user(&p.arg, uargp, sizeof(p.arg)))
+		return -EFAULT;
+	if (p.arg.size != sizeof(p.arg))
+		return -EINVAL;
+	if (p.arg.flags & ~PM_SCAN_FLAGS)
+		return -EINVAL;
+	if ((p.arg.category_inverted | p.arg.category_mask |
+	     p.arg.category_anyof_mask | p.arg.return_mask) &
+	    ~PM_SCAN_CATEGORIES)
+		return -EINVAL;
+
+	start = p.arg.start;
+	end = p.arg.end;
+	if (start != p.arg.start || end != p.arg.end ||
+	    !PAGE_ALIGNED(start) || !PAGE_ALIGNED(end) || end < start)
+		return -EINVAL;
+
+	vec = (struct page_region __user *)(unsigned long)p.arg.vec;
+	if (p.arg.vec_len > ULONG_MAX / sizeof(*vec) ||
+	    !access_ok(VERIFY_WRITE, vec, p.arg.vec_len * sizeof(*vec)))
+		return -EFAULT;
+
+	clear = p.arg.flags & PM_SCAN_CLEAR_SOFT_DIRTY;
+	if (clear && !IS_ENABLED(CONFIG_MEM_SOFT_DIRTY))
+		return -EOPNOTSUPP;
+
+	p.arg.walk_end = start;
+	if (!p.arg.vec_len || start == end)
+		goto out;
+
+	p.vec_buf_len = min_t(unsigned long, PM_SCAN_BUF_LEN, p.arg.vec_len);
+	p.vec_buf = kcalloc(p.vec_buf_len, sizeof(*p.vec_buf), GFP_KERNEL);
+	if (!p.vec_buf)
+		return -ENOMEM;
+
+	ret = 0;
+	if (!mm || !mmget_not_zero(mm))
+		goto out_free;
+
+	scan_walk.pmd_entry = pagemap_scan_pmd_entry;
+	scan_walk.pte_hole = pagemap_scan_pte_hole;
+#ifdef CONFIG_HUGETLB_PAGE
+	scan_walk.hugetlb_entry = pagemap_scan_hugetlb_entry;
+#endif
+	scan_walk.mm = mm;
+	scan_walk.private = &p;
+
+	while (start < end) {
+		unsigned long next;
+
+		next = (start + PAGEMAP_WALK_SIZE) & PAGEMAP_WALK_MASK;
+		if (next < start || next > end)
+			next = end;
+
+		if (fatal_signal_pending(current)) {
+			ret = -EINTR;
+			break;
+		}
+
+		down_read(&mm->mmap_sem);
+		if (clear)
+			mmu_notifier_invalidate_range_start(mm, start, next);
+		p.arg.walk_end = next;
+		ret = walk_page_range(start, next, &scan_walk);
+		if (clear)
+			mmu_notifier_invalidate_range_end(mm, start, next);
+		up_read(&mm->mmap_sem);
+
+		if (ret)
+			break;
+
+		/* the last region may go on in the next chunk */
+		if (p.vec_buf_index) {
+			ret = pagemap_scan_flush(&p, &vec, false);
+			if (ret < 0)
+				break;
+			regions += ret;
+			ret = 0;
+		}
+		start = next;
+	}
+	mmput(mm);
+
+	if (ret == -ENOSPC)
+		ret = 0;
+	if (!ret) {
+		ret = pagemap_scan_flush(&p, &vec, true);
+		if (ret >= 0) {
+			regions += ret;
+			ret = 0;
+		}
+	}
+out_free:
+	kfree(p.vec_buf);
+	if (ret)
+		return ret;
+out:
+	if (put_user(p.arg.walk_end, &uargp->walk_end))
+		return -EFAULT;
+	return regions;
+}
+
+static long pagemap_ioctl(struct file *file, unsigned int cmd,
+			  unsigned long arg)
+{
+	struct mm_struct *mm = file->private_data;
+
+	switch (cmd) {
+	case PAGEMAP_SCAN:
+		return do_pagemap_scan(mm, arg);
+	default:
+		return -ENOTTY;
+	}
+}
+
 const struct file_operations proc_pagemap_operations = {
 	.llseek		= mem_lseek, /* borrow this */
 	.read		= pagemap_read,
 	.open		= pagemap_open,
 	.release	= pagemap_release,
+	.unlocked_ioctl	= pagemap_ioctl,
+	.compat_ioctl	= pagemap_ioctl,
 };
 #endif /* CONFIG_PROC_PAGE_MONITOR */
 
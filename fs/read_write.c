@@ -1569,10 +1569,6 @@ ssize_t vfs_copy_file_range(struct file *file_in, loff_t pos_in,
 	    (file_out->f_flags & O_APPEND))
 		return -EBADF;
 
-	/* this could be relaxed once a method supports cross-fs copies */
-	if (inode_in->i_sb != inode_out->i_sb)
-		return -EXDEV;
-
 	if (len == 0)
 		return 0;
 
@@ -1581,8 +1577,10 @@ ssize_t vfs_copy_file_range(struct file *file_in, loff_t pos_in,
 	/*
 	 * Try cloning first, this is supported by more file systems, and
 	 * more efficient if both clone and copy are supported (e.g. NFS).
+	 * Clones never cross a super block.
 	 */
-	if (file_in->f_op->clone_file_range) {
+	if (inode_in->i_sb == inode_out->i_sb &&
+	    file_in->f_op->clone_file_range) {
 		ret = file_in->f_op->clone_file_range(file_in, pos_in,
 				file_out, pos_out, len);
 		if (ret == 0) {
@@ -1591,13 +1589,26 @@ ssize_t vfs_copy_file_range(struct file *file_in, loff_t pos_in,
 		}
 	}
 
-	if (file_out->f_op->copy_file_range) {
+	/*
+	 * Across super blocks, the method is only tried between two files of
+	 * the same filesystem type, which can tell with -EXDEV that it cannot
+	 * copy between these two (e.g. NFS files of two different servers).
+	 */
+	if (file_out->f_op->copy_file_range &&
+	    (inode_in->i_sb == inode_out->i_sb ||
+	     file_out->f_op->copy_file_range ==
+	     file_in->f_op->copy_file_range)) {
 		ret = file_out->f_op->copy_file_range(file_in, pos_in, file_out,
 						      pos_out, len, flags);
-		if (ret != -EOPNOTSUPP)
+		if (ret != -EOPNOTSUPP && ret != -EXDEV)
 			goto done;
 	}
 
+	/*
+	 * Otherwise copy from page cache to page cache through the splice
+	 * pipe of the task.  A short copy is returned as it is, for the
+	 * caller to loop from where it stopped.
+	 */
 	ret = do_splice_direct(file_in, &pos_in, file_out, &pos_out,
 			len > MAX_RW_COUNT ? MAX_RW_COUNT : len, 0);
 
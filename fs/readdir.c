@@ -14,6 +14,7 @@
 #include <linux/stat.h>
 #include <linux/file.h>
 #include <linux/fs.h>
+#include <linux/namei.h>
 #include <linux/fsnotify.h>
 #include <linux/dirent.h>
 #include <linux/security.h>
@@ -23,6 +24,8 @@
 
 #include <linux/uaccess.h>
 
+#include "internal.h"
+
 int iterate_dir(struct file *file, struct dir_context *ctx)
 {
 	struct inode *inode = file_inode(file);
@@ -327,6 +330,184 @@ SYSCALL_DEFINE3(getdents64, unsigned int, fd,
 	return error;
 }
 
+/*
+ * getdents_statx() lists a directory as getdents64() does, with the statx of
+ * each entry as fstatat(fd, name, AT_SYMLINK_NOFOLLOW) would give.  The
+ * entries are listed first, under the lock of the directory, then looked up
+ * one by one, from the dcache if they are cached: a mount point gets the
+ * attributes of the directory below, as its d_ino is.
+ */
+struct getdents_statx_callback {
+	struct dir_context ctx;
+	struct linux_dirent_statx __user * current_dir;
+	struct linux_dirent_statx __user * previous;
+	int count;
+	int error;
+};
+
+static int filldir_statx(struct dir_context *ctx, const char *name, int namlen,
+			 loff_t offset, u64 ino, unsigned int d_type)
+{
+	struct linux_dirent_statx __user *dirent;
+	struct getdents_statx_callback *buf =
+		container_of(ctx, struct getdents_statx_callback, ctx);
+	int reclen = ALIGN(offsetof(struct linux_dirent_statx, d_name) +
+			   namlen + 1, sizeof(u64));
+
+	buf->error = -EINVAL;	/* only used if we fail.. */
+	if (reclen > buf->count)
+		return -EINVAL;
+	dirent = buf->previous;
+	if (dirent) {
+		if (signal_pending(current))
+			return -EINTR;
+		if (__put_user(offset, &dirent->d_off))
+			goto efault;
+	}
+	dirent = buf->current_dir;
+	if (__put_user(ino, &dirent->d_ino))
+		goto efault;
+	if (__put_user(0, &dirent->d_off))
+		goto efault;
+	if (__put_user(reclen, &dirent->d_reclen))
+		goto efault;
+	if (__put_user(namlen, &dirent->d_namlen))
+		goto efault;
+	if (__put_user(d_type, &dirent->d_type))
+		goto efault;
+	if (copy_to_user(dirent->d_name, name, namlen))
+		goto efault;
+	if (__put_user(0, dirent->d_name + namlen))
+		goto efault;
+	buf->previous = dirent;
+	dirent = (void __user *)dirent + reclen;
+	buf->current_dir = dirent;
+	buf->count -= reclen;
+	return 0;
+efault:
+	buf->error = -EFAULT;
+	return -EFAULT;
+}
+
+static struct dentry *getdents_statx_lookup(struct dentry *parent,
+					    const char *name, int namlen)
+{
+	if (name[0] == '.') {
+		if (namlen == 1)
+			return dget(parent);
+		if (namlen == 2 && name[1] == '.')
+			return dget_parent(parent);
+	}
+	return lookup_one_len_unlocked(name, parent, namlen);
+}
+
+/* fill d_stx and d_error of the @len bytes of entries at @dirent */
+static int getdents_statx_fill(struct file *file,
+			       struct linux_dirent_statx __user *dirent,
+			       int len, u32 mask, unsigned int flags)
+{
+	struct path path = { .mnt = file->f_path.mnt };
+	struct kstat stat;
+	char *name;
+	int error = 0;
+
+	name = __getname();
+	if (!name)
+		return -ENOMEM;
+
+	while (len > 0) {
+		unsigned short reclen, namlen;
+		int err;
+
+		if (__get_user(reclen, &dirent->d_reclen) ||
+		    __get_user(namlen, &dirent->d_namlen)) {
+			error = -EFAULT;
+			break;
+		}
+		/* the records are in user memory, they may have been changed */
+		if (namlen == 0 || namlen > NAME_MAX || reclen > len ||
+		    reclen < offsetof(struct linux_dirent_statx, d_name) +
+			     namlen + 1) {
+			error = -EINVAL;
+			break;
+		}
+		if (copy_from_user(name, dirent->d_name, namlen)) {
+			error = -EFAULT;
+			break;
+		}
+
+		path.dentry = getdents_statx_lookup(file->f_path.dentry,
+						    name, namlen);
+		if (IS_ERR(path.dentry)) {
+			err = PTR_ERR(path.dentry);
+		} else {
+			err = -ENOENT;
+			if (d_is_positive(path.dentry))
+				err = vfs_getattr(&path, &stat, mask, flags);
+			dput(path.dentry);
+		}
+		if (!err && cp_statx(&stat, &dirent->d_stx)) {
+			error = -EFAULT;
+			break;
+		}
+		if (__put_user(err, &dirent->d_error)) {
+			error = -EFAULT;
+			break;
+		}
+
+		dirent = (void __user *)dirent + reclen;
+		len -= reclen;
+		cond_resched();
+	}
+
+	__putname(name);
+	return error;
+}
+
+SYSCALL_DEFINE5(getdents_statx, unsigned int, fd,
+		struct linux_dirent_statx __user *, dirent, unsigned int, count,
+		unsigned int, mask, unsigned int, flags)
+{
+	struct fd f;
+	struct linux_dirent_statx __user * lastdirent;
+	struct getdents_statx_callback buf = {
+		.ctx.actor = filldir_statx,
+		.count = count,
+		.current_dir = dirent
+	};
+	int error;
+
+	if (mask & STATX__RESERVED)
+		return -EINVAL;
+	if ((flags & ~AT_STATX_SYNC_TYPE) ||
+	    (flags & AT_STATX_SYNC_TYPE) == AT_STATX_SYNC_TYPE)
+		return -EINVAL;
+	if (!access_ok(VERIFY_WRITE, dirent, count))
+		return -EFAULT;
+
+	f = fdget_pos(fd);
+	if (!f.file)
+		return -EBADF;
+
+	error = iterate_dir(f.file, &buf.ctx);
+	if (error >= 0)
+		error = buf.error;
+	lastdirent = buf.previous;
+	if (lastdirent) {
+		typeof(lastdirent->d_off) d_off = buf.ctx.pos;
+		if (__put_user(d_off, &lastdirent->d_off))
+			error = -EFAULT;
+		else
+			error = getdents_statx_fill(f.file, dirent,
+						    count - buf.count,
+						    mask, flags);
+		if (!error)
+			error = count - buf.count;
+	}
+	fdput_pos(f);
+	return error;
+}
+
 #ifdef CONFIG_COMPAT
 struct compat_old_linux_dirent {
 	compat_ulong_t	d_ino;
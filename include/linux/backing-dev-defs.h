@@ -44,6 +44,9 @@ enum wb_stat_item {
 
 #define WB_STAT_BATCH (8*(1+ilog2(nr_cpu_ids)))
 
+/* Upper bound of the writeback_workers bdi attribute */
+#define BDI_MAX_WB_WORKERS 16
+
 /*
  * For cgroup writeback, multiple wb's may map to the same blkcg.  Those
  * wb's can operate mostly independently but should share the congested
@@ -144,6 +147,7 @@ struct backing_dev_info {
 	struct list_head bdi_list;
 	unsigned long ra_pages;	/* max readahead in PAGE_SIZE units */
 	unsigned long io_pages;	/* max allowed IO size */
+	unsigned long ra_bw_pages; /* readahead the device can keep up with */
 	congested_fn *congested_fn; /* Function pointer if device is md/dm */
 	void *congested_data;	/* Pointer to aux data for congested func */
 
@@ -153,6 +157,7 @@ struct backing_dev_info {
 	unsigned int capabilities; /* Device capabilities */
 	unsigned int min_ratio;
 	unsigned int max_ratio, max_prop_frac;
+	unsigned int wb_workers; /* writeback workers per wb, see fs_flags */
 
 	/*
 	 * Sum of avg_write_bw of wbs with dirty inodes.  > 0 if there are
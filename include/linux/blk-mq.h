@@ -47,6 +47,7 @@ struct blk_mq_hw_ctx {
 
 	unsigned int		numa_node;
 	unsigned int		queue_num;
+	unsigned short		type;		/* HCTX_TYPE_* of the map */
 
 	atomic_t		nr_active;
 
@@ -66,10 +67,31 @@ struct blk_mq_hw_ctx {
 	struct srcu_struct	queue_rq_srcu[0];
 };
 
+/*
+ * A tag set may map the CPUs to its hardware queues several times, one map
+ * per type of I/O.  The hardware queues of the maps are disjoint ranges of
+ * the hardware queues of the set, given by queue_offset and nr_queues.  An
+ * empty map (nr_queues == 0) falls back to HCTX_TYPE_DEFAULT.
+ */
+enum hctx_type {
+	HCTX_TYPE_DEFAULT,	/* all I/O not otherwise accounted for */
+	HCTX_TYPE_READ,		/* just for READ I/O */
+	HCTX_TYPE_POLL,		/* polled I/O of any kind, REQ_HIPRI */
+
+	HCTX_MAX_TYPES,
+};
+
+struct blk_mq_queue_map {
+	unsigned int		*mq_map;	/* CPU to hardware queue */
+	unsigned int		nr_queues;
+	unsigned int		queue_offset;
+};
+
 struct blk_mq_tag_set {
-	unsigned int		*mq_map;
+	struct blk_mq_queue_map	map[HCTX_MAX_TYPES];
+	unsigned int		nr_maps;	/* nr entries in map[] */
 	const struct blk_mq_ops	*ops;
-	unsigned int		nr_hw_queues;
+	unsigned int		nr_hw_queues;	/* nr hw queues across maps */
 	unsigned int		queue_depth;	/* max hw supported */
 	unsigned int		reserved_tags;
 	unsigned int		cmd_size;	/* per-request extra data */
@@ -232,6 +254,25 @@ void blk_mq_start_request(struct request *rq);
 void blk_mq_end_request(struct request *rq, blk_status_t error);
 void __blk_mq_end_request(struct request *rq, blk_status_t error);
 
+/*
+ * Requests completed by a driver in one go, e.g. while reaping a completion
+ * queue, to be ended together by blk_mq_end_request_batch().
+ */
+struct io_comp_batch {
+	struct list_head req_list;
+	void (*complete)(struct io_comp_batch *);
+};
+
+#define DEFINE_IO_COMP_BATCH(name)					\
+	struct io_comp_batch name = {					\
+		.req_list = LIST_HEAD_INIT(name.req_list),		\
+	}
+
+bool blk_mq_add_to_batch(struct request *rq, struct io_comp_batch *iob,
+			 blk_status_t error,
+			 void (*complete)(struct io_comp_batch *));
+void blk_mq_end_request_batch(struct io_comp_batch *iob);
+
 void blk_mq_requeue_request(struct request *rq, bool kick_requeue_list);
 void blk_mq_add_to_requeue_list(struct request *rq, bool at_head,
 				bool kick_requeue_list);
@@ -263,7 +304,7 @@ int blk_mq_freeze_queue_wait_timeout(struct request_queue *q,
 int blk_mq_reinit_tagset(struct blk_mq_tag_set *set,
 			 int (reinit_request)(void *, struct request *));
 
-int blk_mq_map_queues(struct blk_mq_tag_set *set);
+int blk_mq_map_queues(struct blk_mq_queue_map *qmap);
 void blk_mq_update_nr_hw_queues(struct blk_mq_tag_set *set, int nr_hw_queues);
 
 void blk_mq_quiesce_queue_nowait(struct request_queue *q);
@@ -109,6 +109,7 @@ struct bpf_insn_aux_data {
 		enum bpf_reg_type ptr_type;	/* pointer type for load/store insns */
 		struct bpf_map *map_ptr;	/* pointer for call insn into lookup_elem */
 	};
+	u64 map_key_state; /* constant key for call insn into tail_call */
 	int ctx_field_size; /* the ctx field size for load insn, maybe 0 */
 	int converted_op_size; /* the valid value width after perceived conversion */
 };
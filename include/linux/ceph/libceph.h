@@ -51,6 +51,7 @@ struct ceph_options {
 	unsigned long osd_idle_ttl;		/* jiffies */
 	unsigned long osd_keepalive_timeout;	/* jiffies */
 	unsigned long osd_request_timeout;	/* jiffies */
+	int osd_conns;				/* connections per osd */
 
 	/*
 	 * any type that can't be simply compared or doesn't need need
@@ -72,6 +73,7 @@ struct ceph_options {
 #define CEPH_OSD_KEEPALIVE_DEFAULT	msecs_to_jiffies(5 * 1000)
 #define CEPH_OSD_IDLE_TTL_DEFAULT	msecs_to_jiffies(60 * 1000)
 #define CEPH_OSD_REQUEST_TIMEOUT_DEFAULT 0  /* no timeout */
+#define CEPH_OSD_CONNS_DEFAULT		1
 
 #define CEPH_MONC_HUNT_INTERVAL		msecs_to_jiffies(3 * 1000)
 #define CEPH_MONC_PING_INTERVAL		msecs_to_jiffies(10 * 1000)
@@ -136,7 +138,8 @@ struct ceph_client {
 #endif
 };
 
-#define from_msgr(ms)	container_of(ms, struct ceph_client, msgr)
+#define from_msgr(ms)	container_of((ms)->parent ?: (ms), \
+				     struct ceph_client, msgr)
 
 
 /*
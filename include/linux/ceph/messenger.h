@@ -67,6 +67,9 @@ struct ceph_messenger {
 	 */
 	u32 global_seq;
 	spinlock_t global_seq_lock;
+
+	/* the main messenger of the client, if a sibling */
+	struct ceph_messenger *parent;
 };
 
 enum ceph_msg_data_type {
@@ -193,6 +196,7 @@ struct ceph_connection {
 	struct ceph_entity_addr peer_addr_for_me;
 
 	unsigned long flags;
+	int work_cpu;		/* of con->work, or WORK_CPU_UNBOUND */
 	unsigned long state;
 	const char *error_msg;  /* error message, if any */
 
@@ -266,6 +270,9 @@ extern void ceph_msgr_flush(void);
 
 extern void ceph_messenger_init(struct ceph_messenger *msgr,
 				struct ceph_entity_addr *myaddr);
+extern void ceph_messenger_init_sibling(struct ceph_messenger *msgr,
+				       struct ceph_messenger *parent, int idx);
+extern void ceph_addr_sibling(struct ceph_entity_addr *addr, int idx);
 extern void ceph_messenger_fini(struct ceph_messenger *msgr);
 
 extern void ceph_con_init(struct ceph_connection *con, void *private,
@@ -28,6 +28,14 @@ typedef void (*ceph_osdc_callback_t)(struct ceph_osd_request *);
 
 #define CEPH_HOMELESS_OSD	-1
 
+#define CEPH_OSD_MAX_CONNS	8
+
+/* one of the connections of a session */
+struct ceph_osd_conn {
+	struct ceph_connection con;
+	struct ceph_auth_handshake auth;
+};
+
 /* a given osd we're communicating with */
 struct ceph_osd {
 	refcount_t o_ref;
@@ -35,13 +43,12 @@ struct ceph_osd {
 	int o_osd;
 	int o_incarnation;
 	struct rb_node o_node;
-	struct ceph_connection o_con;
+	struct ceph_osd_conn *o_conns;	/* osdc->num_conns, NULL if homeless */
 	struct rb_root o_requests;
 	struct rb_root o_linger_requests;
 	struct rb_root o_backoff_mappings;
 	struct rb_root o_backoffs_by_id;
 	struct list_head o_osd_lru;
-	struct ceph_auth_handshake o_auth;
 	unsigned long lru_ttl;
 	struct list_head o_keepalive_item;
 	struct mutex lock;
@@ -354,6 +361,14 @@ struct ceph_osd_client {
 	struct ceph_msgpool	msgpool_op_reply;
 
 	struct workqueue_struct	*notify_wq;
+
+	/*
+	 * Connections per osd session, the extra ones each have their own
+	 * messenger, that is their own address.
+	 */
+	int			num_conns;
+	struct ceph_messenger	conn_msgrs[CEPH_OSD_MAX_CONNS - 1];
+	atomic_t		conn_cpu_seq;
 };
 
 static inline bool ceph_osdmap_flag(struct ceph_osd_client *osdc, int flag)
@@ -19,6 +19,7 @@
 #include <linux/percpu-rwsem.h>
 #include <linux/workqueue.h>
 #include <linux/bpf-cgroup.h>
+#include <linux/psi_types.h>
 
 #ifdef CONFIG_CGROUPS
 
@@ -153,6 +154,12 @@ struct cgroup_subsys_state {
 	struct rcu_head rcu_head;
 	struct work_struct destroy_work;
 
+	/*
+	 * Entry in the cgroup's ->rstat_css_list if ->ss has a
+	 * ->css_rstat_flush() callback, protected by cgroup_rstat_lock.
+	 */
+	struct list_head rstat_css_node;
+
 	/*
 	 * PI: the parent css.	Placed here for cache proximity to following
 	 * fields of the containing structure.
@@ -255,6 +262,19 @@ struct css_set {
 	struct rcu_head rcu_head;
 };
 
+/*
+ * Per-cpu node of the tree of the cgroups whose statistics changed on a
+ * cpu since they were last flushed.  A cgroup is on the tree iff its
+ * ->updated_next is set and then all its ancestors are too.  The
+ * children of a cgroup on the tree are linked through their
+ * ->updated_next into its ->updated_children list, which is terminated
+ * by the cgroup itself rather than NULL.
+ */
+struct cgroup_rstat_cpu {
+	struct cgroup *updated_children;
+	struct cgroup *updated_next;
+};
+
 struct cgroup {
 	/* self css with NULL ->ss, points back to this cgroup */
 	struct cgroup_subsys_state self;
@@ -370,6 +390,17 @@ struct cgroup {
 	/* used to store eBPF programs */
 	struct cgroup_bpf bpf;
 
+	/* used to track pressure stalls */
+	struct psi_group psi;
+
+	/*
+	 * Statistics flushing, see kernel/cgroup/rstat.c.  ->rstat_cpu
+	 * tracks the per-cpu updated tree and ->rstat_css_list the csses
+	 * to flush when this cgroup is popped off it.
+	 */
+	struct cgroup_rstat_cpu __percpu *rstat_cpu;
+	struct list_head rstat_css_list;
+
 	/* ids of the ancestors at each level including self */
 	int ancestor_ids[];
 };
@@ -497,6 +528,9 @@ struct cftype {
 	ssize_t (*write)(struct kernfs_open_file *of,
 			 char *buf, size_t nbytes, loff_t off);
 
+	unsigned int (*poll)(struct kernfs_open_file *of,
+			     struct poll_table_struct *pt);
+
 #ifdef CONFIG_DEBUG_LOCK_ALLOC
 	struct lock_class_key	lockdep_key;
 #endif
@@ -513,6 +547,7 @@ struct cgroup_subsys {
 	void (*css_released)(struct cgroup_subsys_state *css);
 	void (*css_free)(struct cgroup_subsys_state *css);
 	void (*css_reset)(struct cgroup_subsys_state *css);
+	void (*css_rstat_flush)(struct cgroup_subsys_state *css, int cpu);
 
 	int (*can_attach)(struct cgroup_taskset *tset);
 	void (*cancel_attach)(struct cgroup_taskset *tset);
@@ -0,0 +1,95 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * DAMON: data access monitor
+ *
+ * A kdamond thread splits the address spaces of its target processes in
+ * regions and, every sampling interval, checks whether one page picked at
+ * random in each region was accessed.  At every aggregation interval the
+ * access counts of the regions are reported, the adjacent regions of
+ * similar counts are merged and the regions are split again at random, so
+ * that their number, and thus the monitoring overhead, stays between the
+ * bounds given by the user while the regions follow the access pattern.
+ */
+#ifndef _LINUX_DAMON_H
+#define _LINUX_DAMON_H
+
+#include <linux/ktime.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/pid.h>
+#include <linux/types.h>
+
+struct damon_addr_range {
+	unsigned long start;
+	unsigned long end;
+};
+
+/*
+ * A monitored region, [ar.start, ar.end), of the address space of a target.
+ * @nr_accesses counts the sampling intervals of the current aggregation
+ * interval in which the page at @sampling_addr was found accessed.
+ */
+struct damon_region {
+	struct damon_addr_range ar;
+	unsigned long sampling_addr;
+	unsigned int nr_accesses;
+	struct list_head list;
+};
+
+/* A monitored process and its regions, sorted by address */
+struct damon_task {
+	struct pid *pid;
+	struct list_head regions_list;
+	struct list_head list;
+};
+
+/*
+ * The intervals are in microseconds.  The regions of the targets are
+ * resynchronised with their mappings every @regions_update_interval.
+ *
+ * @sample_cb is called after the access checks of a sampling interval are
+ * prepared, and @aggregate_cb with the counts of the aggregation interval
+ * which ends, before they are reset.  Both are called by the kdamond thread,
+ * which is the only one to change the regions while it runs.
+ */
+struct damon_ctx {
+	unsigned long sample_interval;
+	unsigned long aggr_interval;
+	unsigned long regions_update_interval;
+	unsigned long min_nr_regions;
+	unsigned long max_nr_regions;
+
+	ktime_t last_aggregation;
+	ktime_t last_regions_update;
+
+	struct mutex kdamond_lock;
+	struct task_struct *kdamond;
+	bool kdamond_stop;
+
+	struct list_head tasks_list;
+
+	void *private;
+	void (*sample_cb)(struct damon_ctx *ctx);
+	void (*aggregate_cb)(struct damon_ctx *ctx);
+};
+
+#define damon_for_each_task(t, ctx) \
+	list_for_each_entry(t, &(ctx)->tasks_list, list)
+
+#define damon_for_each_region(r, t) \
+	list_for_each_entry(r, &(t)->regions_list, list)
+
+#ifdef CONFIG_DAMON
+
+struct damon_ctx *damon_new_ctx(void);
+void damon_destroy_ctx(struct damon_ctx *ctx);
+int damon_set_pids(struct damon_ctx *ctx, int *pids, unsigned int nr_pids);
+int damon_set_attrs(struct damon_ctx *ctx, unsigned long sample_int,
+		    unsigned long aggr_int, unsigned long regions_update_int,
+		    unsigned long min_nr_reg, unsigned long max_nr_reg);
+int damon_start(struct damon_ctx *ctx);
+int damon_stop(struct damon_ctx *ctx);
+
+#endif /* CONFIG_DAMON */
+
+#endif /* _LINUX_DAMON_H */
@@ -66,9 +66,12 @@ struct dentry_stat_t {
 	long nr_unused;
 	long age_limit;          /* age in seconds */
 	long want_pages;         /* pages requested by system */
-	long dummy[2];
+	long nr_negative;        /* negative dentries on the LRU lists */
+	long nr_negative_pruned; /* negative dentries pruned over the limits */
 };
 extern struct dentry_stat_t dentry_stat;
+extern unsigned long sysctl_negative_dentry_limit;
+extern unsigned long sysctl_negative_dentry_sb_limit;
 
 /*
  * Try to keep struct dentry aligned on 64 byte cachelines (this will
@@ -50,6 +50,7 @@ struct files_struct {
    */
 	atomic_t count;
 	bool resize_in_progress;
+	bool fd_alloc_scalable;		/* PR_FD_ALLOC_SET_SCALABLE */
 	wait_queue_head_t resize_wait;
 
 	struct fdtable __rcu *fdt;
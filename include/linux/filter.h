@@ -18,8 +18,10 @@
 #include <linux/capability.h>
 #include <linux/cryptohash.h>
 #include <linux/set_memory.h>
+#include <linux/scatterlist.h>
 
 #include <net/sch_generic.h>
+#include <net/xdp.h>
 
 #include <uapi/linux/filter.h>
 #include <uapi/linux/bpf.h>
@@ -28,6 +30,7 @@ struct sk_buff;
 struct sock;
 struct seccomp_data;
 struct bpf_prog_aux;
+struct sk_msg_buff;
 
 /* ArgX, context and stack frame pointer register positions. Note,
  * Arg1, Arg2, Arg3, etc are used as argument mappings of function
@@ -491,12 +494,6 @@ struct bpf_skb_data_end {
 	void *data_end;
 };
 
-struct xdp_buff {
-	void *data;
-	void *data_end;
-	void *data_hard_start;
-};
-
 /* compute the linear packet data range [data, data_end) which
  * will be accessed by cls_bpf, act_bpf and lwt programs
  */
@@ -697,6 +694,7 @@ int sk_attach_filter(struct sock_fprog *fprog, struct sock *sk);
 int sk_attach_bpf(u32 ufd, struct sock *sk);
 int sk_reuseport_attach_filter(struct sock_fprog *fprog, struct sock *sk);
 int sk_reuseport_attach_bpf(u32 ufd, struct sock *sk);
+void sk_reuseport_prog_free(struct bpf_prog *prog);
 int sk_detach_filter(struct sock *sk);
 int sk_get_filter(struct sock *sk, struct sock_filter __user *filter,
 		  unsigned int len);
@@ -719,8 +717,9 @@ struct bpf_prog *bpf_patch_insn_single(struct bpf_prog *prog, u32 off,
  * because we only track one map and force a flush when the map changes.
  * This does not appear to be a real limitation for existing software.
  */
+int xdp_ok_fwd_dev(const struct net_device *fwd, unsigned int pktlen);
 int xdp_do_generic_redirect(struct net_device *dev, struct sk_buff *skb,
-			    struct bpf_prog *prog);
+			    struct xdp_buff *xdp, struct bpf_prog *prog);
 int xdp_do_redirect(struct net_device *dev,
 		    struct xdp_buff *xdp,
 		    struct bpf_prog *prog);
@@ -730,6 +729,7 @@ void bpf_warn_invalid_xdp_action(u32 act);
 void bpf_warn_invalid_xdp_redirect(u32 ifindex);
 
 struct sock *do_sk_redirect_map(struct sk_buff *skb);
+struct sock *do_msg_redirect_map(struct sk_msg_buff *msg);
 
 #ifdef CONFIG_BPF_JIT
 extern int bpf_jit_enable;
@@ -969,4 +969,65 @@ struct bpf_sock_ops_kern {
 	};
 };
 
+/* Data of a sendmsg()/sendpage() on a sockmap socket as seen by a
+ * BPF_PROG_TYPE_SK_MSG program.  sg_data[0, sg_end) holds sg_size bytes.
+ * Entries with sg_copy set reference pages handed in by sendpage that
+ * must not be written to, the others are private pages charged to sk
+ * (if set).
+ */
+struct sk_msg_buff {
+	void *data;
+	void *data_end;
+	__u32 apply_bytes;
+	__u32 cork_bytes;
+	int sg_end;
+	__u32 sg_size;
+	struct scatterlist sg_data[MAX_SKB_FRAGS];
+	bool sg_copy[MAX_SKB_FRAGS];
+	struct bpf_map *map;
+	__u32 key;
+	__u32 flags;
+	struct sock *sk;
+	struct list_head list;
+};
+
+/* Only the first element is exposed to the program, and only if it is
+ * private; bpf_msg_pull_data() makes any other range available.
+ */
+static inline void sk_msg_compute_data_pointers(struct sk_msg_buff *msg)
+{
+	if (msg->sg_end && !msg->sg_copy[0]) {
+		msg->data = sg_virt(&msg->sg_data[0]);
+		msg->data_end = msg->data + msg->sg_data[0].length;
+	} else {
+		msg->data = NULL;
+		msg->data_end = NULL;
+	}
+}
+
+struct sk_reuseport_kern {
+	struct sk_buff *skb;
+	struct sock *sk;
+	struct sock *selected_sk;
+	void *data_end;
+	u32 hash;
+	u32 reuseport_id;
+};
+
+struct sock_reuseport;
+
+#ifdef CONFIG_INET
+struct sock *bpf_run_sk_reuseport(struct sock_reuseport *reuse, struct sock *sk,
+				  struct bpf_prog *prog, struct sk_buff *skb,
+				  u32 hash);
+#else
+static inline struct sock *
+bpf_run_sk_reuseport(struct sock_reuseport *reuse, struct sock *sk,
+		     struct bpf_prog *prog, struct sk_buff *skb,
+		     u32 hash)
+{
+	return NULL;
+}
+#endif
+
 #endif /* __LINUX_FILTER_H__ */
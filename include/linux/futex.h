@@ -3,6 +3,7 @@
 #define _LINUX_FUTEX_H
 
 #include <linux/ktime.h>
+#include <linux/mm_types.h>
 #include <uapi/linux/futex.h>
 
 struct inode;
@@ -60,10 +61,31 @@ extern void exit_robust_list(struct task_struct *curr);
 #else
 extern int futex_cmpxchg_enabled;
 #endif
+
+static inline void futex_mm_init(struct mm_struct *mm)
+{
+	mm->futex_hash = NULL;
+}
+
+extern void futex_mm_release(struct mm_struct *mm);
+extern int futex_hash_prctl(unsigned long arg2, unsigned long arg3);
 #else
 static inline void exit_robust_list(struct task_struct *curr)
 {
 }
+
+static inline void futex_mm_init(struct mm_struct *mm)
+{
+}
+
+static inline void futex_mm_release(struct mm_struct *mm)
+{
+}
+
+static inline int futex_hash_prctl(unsigned long arg2, unsigned long arg3)
+{
+	return -EINVAL;
+}
 #endif
 
 #ifdef CONFIG_FUTEX_PI
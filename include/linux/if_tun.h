@@ -16,6 +16,24 @@
 #define __IF_TUN_H
 
 #include <uapi/linux/if_tun.h>
+#include <uapi/linux/virtio_net.h>
+
+/* msg_control of a sendmsg() on a tun/tap socket is a struct tun_msg_ctl:
+ * TUN_MSG_UBUF carries a zerocopy ubuf_info, TUN_MSG_PTR an array of
+ * num xdp_buffs, each starting with a struct tun_xdp_hdr.
+ */
+#define TUN_MSG_UBUF 1
+#define TUN_MSG_PTR  2
+struct tun_msg_ctl {
+	unsigned short type;
+	unsigned short num;
+	void *ptr;
+};
+
+struct tun_xdp_hdr {
+	int buflen;
+	struct virtio_net_hdr gso;
+};
 
 #if defined(CONFIG_TUN) || defined(CONFIG_TUN_MODULE)
 struct socket *tun_get_socket(struct file *);
@@ -70,6 +70,8 @@ extern void *jbd2_alloc(size_t size, gfp_t flags);
 extern void jbd2_free(void *ptr, size_t size);
 
 #define JBD2_MIN_JOURNAL_BLOCKS 1024
+#define JBD2_DEFAULT_FC_BLOCKS 256	/* Size of the fast commit area */
+#define JBD2_PCPU_BATCH_MAX 256		/* Credits of a per-cpu pool refill */
 
 #ifdef __KERNEL__
 
@@ -126,6 +128,7 @@ typedef struct journal_s	journal_t;	/* Journal control structure */
 #define JBD2_SUPERBLOCK_V1	3
 #define JBD2_SUPERBLOCK_V2	4
 #define JBD2_REVOKE_BLOCK	5
+#define JBD2_FC_BLOCK		6
 
 /*
  * Standard header for all descriptor blocks:
@@ -265,7 +268,9 @@ typedef struct journal_superblock_s
 /* 0x0050 */
 	__u8	s_checksum_type;	/* checksum type */
 	__u8	s_padding2[3];
-	__u32	s_padding[42];
+/* 0x0054 */
+	__be32	s_num_fc_blks;		/* Nr of blocks of fast commit area */
+	__u32	s_padding[41];
 	__be32	s_checksum;		/* crc32c(superblock) */
 
 /* 0x0100 */
@@ -291,6 +296,7 @@ typedef struct journal_superblock_s
 #define JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT	0x00000004
 #define JBD2_FEATURE_INCOMPAT_CSUM_V2		0x00000008
 #define JBD2_FEATURE_INCOMPAT_CSUM_V3		0x00000010
+#define JBD2_FEATURE_INCOMPAT_FAST_COMMIT	0x00000020
 
 /* See "journal feature predicate functions" below */
 
@@ -301,7 +307,8 @@ typedef struct journal_superblock_s
 					JBD2_FEATURE_INCOMPAT_64BIT | \
 					JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT | \
 					JBD2_FEATURE_INCOMPAT_CSUM_V2 | \
-					JBD2_FEATURE_INCOMPAT_CSUM_V3)
+					JBD2_FEATURE_INCOMPAT_CSUM_V3 | \
+					JBD2_FEATURE_INCOMPAT_FAST_COMMIT)
 
 #ifdef __KERNEL__
 
@@ -443,6 +450,13 @@ struct jbd2_inode {
 
 struct jbd2_revoke_table_s;
 
+/* Per-cpu state of the running transaction, see start_this_handle_fast() */
+struct jbd2_pcpu_handles {
+	int	updates;	/* handles started minus handles stopped */
+	int	credits;	/* charged to t_outstanding_credits, unused */
+	int	handles;	/* handles started */
+};
+
 /**
  * struct handle_s - The handle_s type is the concrete type associated with
  *     handle_t.
@@ -453,6 +467,7 @@ struct jbd2_revoke_table_s;
  * @h_sync: flag for sync-on-close
  * @h_jdata: flag to force data journaling
  * @h_aborted: flag indicating fatal error on handle
+ * @h_pcpu: flag for a handle counted in the per-cpu updates of the journal
  **/
 
 /* Docbook can't yet cope with the bit fields, but will leave the documentation
@@ -486,6 +501,7 @@ struct jbd2_journal_handle
 	unsigned int	h_jdata:	1;	/* force data journaling */
 	unsigned int	h_reserved:	1;	/* handle with reserved credits */
 	unsigned int	h_aborted:	1;	/* fatal error on handle */
+	unsigned int	h_pcpu:		1;	/* in j_pcpu_handles */
 	unsigned int	h_type:		8;	/* for handle statistics */
 	unsigned int	h_line_no:	16;	/* for handle statistics */
 
@@ -647,7 +663,8 @@ struct transaction_s
 	struct transaction_chp_stats_s t_chp_stats;
 
 	/*
-	 * Number of outstanding updates running on this transaction
+	 * Number of outstanding updates running on this transaction, but
+	 * for the ones counted in j_pcpu_handles: see jbd2_journal_updates()
 	 * [t_handle_lock]
 	 */
 	atomic_t		t_updates;
@@ -897,6 +914,27 @@ struct journal_s
 	unsigned long		j_first;
 	unsigned long		j_last;
 
+	/*
+	 * Fast commit area: the blocks [j_fc_first, j_fc_last) at the end of
+	 * the journal, out of [j_first, j_last).  j_fc_off is the number of
+	 * blocks of the fast commits done for transaction j_fc_tid.
+	 * [j_state_lock]
+	 */
+	unsigned long		j_fc_first;
+	unsigned long		j_fc_last;
+	unsigned long		j_fc_off;
+	tid_t			j_fc_tid;
+
+	/* Buffers of the ongoing fast commit, written after the j_fc_off */
+	struct buffer_head	**j_fc_wbuf;
+	int			j_fc_nbufs;
+
+	/* Wait queue for fast and full commits to be done */
+	wait_queue_head_t	j_fc_wait;
+
+	/* Number of fast commit blocks found by the recovery */
+	unsigned long		j_fc_replay_blocks;
+
 	/*
 	 * Device, blocksize and starting block offset for the location where we
 	 * store the journal.
@@ -967,6 +1005,14 @@ struct journal_s
 	 */
 	int			j_max_transaction_buffers;
 
+	/*
+	 * Per-cpu handle counts and pools of credits of the running
+	 * transaction, for the handles started without j_state_lock, and
+	 * number of credits charged at once to refill a pool.
+	 */
+	struct jbd2_pcpu_handles __percpu *j_pcpu_handles;
+	int			j_pcpu_batch;
+
 	/*
 	 * What is the maximum transaction lifetime before we begin a commit?
 	 */
@@ -1013,6 +1059,12 @@ struct journal_s
 	void			(*j_commit_callback)(journal_t *,
 						     transaction_t *);
 
+	/*
+	 * Called at the end of the full commit of a transaction, once the
+	 * fast commits of that transaction are no longer needed
+	 */
+	void			(*j_fc_cleanup_callback)(journal_t *, tid_t);
+
 	/*
 	 * Journal statistics
 	 */
@@ -1116,6 +1168,7 @@ JBD2_FEATURE_INCOMPAT_FUNCS(64bit,		64BIT)
 JBD2_FEATURE_INCOMPAT_FUNCS(async_commit,	ASYNC_COMMIT)
 JBD2_FEATURE_INCOMPAT_FUNCS(csum2,		CSUM_V2)
 JBD2_FEATURE_INCOMPAT_FUNCS(csum3,		CSUM_V3)
+JBD2_FEATURE_INCOMPAT_FUNCS(fast_commit,	FAST_COMMIT)
 
 /*
  * Journal flag definitions
@@ -1130,6 +1183,10 @@ JBD2_FEATURE_INCOMPAT_FUNCS(csum3,		CSUM_V3)
 						 * data write error in ordered
 						 * mode */
 #define JBD2_REC_ERR	0x080	/* The errno in the sb has been recorded */
+#define JBD2_FAST_COMMIT_ONGOING	0x100	/* A fast commit is being
+						 * written */
+#define JBD2_FULL_COMMIT_ONGOING	0x200	/* A full commit is being
+						 * written */
 
 /*
  * Function declarations for the journaling transaction and buffer
@@ -1214,6 +1271,8 @@ extern void		__wait_on_journal (journal_t *);
 extern void jbd2_journal_destroy_transaction_cache(void);
 extern int  jbd2_journal_init_transaction_cache(void);
 extern void jbd2_journal_free_transaction(transaction_t *);
+extern int  jbd2_journal_updates(journal_t *, transaction_t *);
+extern void jbd2_journal_drain_pcpu(journal_t *, transaction_t *);
 
 /*
  * Journal locking.
@@ -1371,6 +1430,16 @@ int jbd2_complete_transaction(journal_t *journal, tid_t tid);
 int jbd2_log_do_checkpoint(journal_t *journal);
 int jbd2_trans_will_send_data_barrier(journal_t *journal, tid_t tid);
 
+/* Fast commits */
+int jbd2_fc_init(journal_t *journal, unsigned int nblks);
+int jbd2_fc_begin_commit(journal_t *journal, tid_t tid);
+int jbd2_fc_get_buf(journal_t *journal, struct buffer_head **bh_out);
+int jbd2_fc_write_bufs(journal_t *journal);
+void jbd2_fc_end_commit(journal_t *journal);
+void jbd2_fc_end_commit_fallback(journal_t *journal);
+struct buffer_head *jbd2_fc_read_block(journal_t *journal, unsigned long off);
+int jbd2_fc_replay_done(journal_t *journal);
+
 void __jbd2_log_wait_for_space(journal_t *journal);
 extern void __jbd2_journal_drop_transaction(journal_t *, transaction_t *);
 extern int jbd2_cleanup_journal_tail(journal_t *);
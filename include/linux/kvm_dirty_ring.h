@@ -0,0 +1,88 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef KVM_DIRTY_RING_H
+#define KVM_DIRTY_RING_H
+
+#include <linux/kvm.h>
+
+/*
+ * KVM dirty ring of a vcpu
+ *
+ * @dirty_index: free running counter of the gfns pushed
+ * @reset_index: free running counter of the gfns whose dirty tracking was
+ *		 enabled again by KVM_RESET_DIRTY_RINGS
+ * @size:	 number of entries of @dirty_gfns, a power of two
+ * @soft_limit:	 when the ring has this many entries in use, the vcpu exits
+ *		 to userspace with KVM_EXIT_DIRTY_RING_FULL
+ * @dirty_gfns:	 the entries, mapped by userspace
+ */
+struct kvm_dirty_ring {
+	u32 dirty_index;
+	u32 reset_index;
+	u32 size;
+	u32 soft_limit;
+	struct kvm_dirty_gfn *dirty_gfns;
+};
+
+/*
+ * Entries kept free past the soft limit: a vcpu can dirty a few pages
+ * before it checks the soft limit again, and the hardware dirty logs (e.g.
+ * the PML buffer of VMX) are flushed in batches of KVM_CPU_DIRTY_LOG_SIZE.
+ */
+#define KVM_DIRTY_RING_RSVD_ENTRIES	64
+#define KVM_DIRTY_RING_MAX_ENTRIES	65536
+
+#ifndef KVM_CPU_DIRTY_LOG_SIZE
+#define KVM_CPU_DIRTY_LOG_SIZE		0
+#endif
+
+static inline u32 kvm_dirty_ring_get_rsvd_entries(void)
+{
+	return KVM_DIRTY_RING_RSVD_ENTRIES + KVM_CPU_DIRTY_LOG_SIZE;
+}
+
+#ifdef CONFIG_HAVE_KVM_DIRTY_RING
+
+int kvm_dirty_ring_alloc(struct kvm_dirty_ring *ring, u32 size);
+void kvm_dirty_ring_free(struct kvm_dirty_ring *ring);
+int kvm_dirty_ring_reset(struct kvm *kvm, struct kvm_dirty_ring *ring);
+bool kvm_dirty_ring_push(struct kvm_dirty_ring *ring, u32 slot, u64 offset);
+struct page *kvm_dirty_ring_get_page(struct kvm_dirty_ring *ring, u32 offset);
+bool kvm_dirty_ring_soft_full(struct kvm_dirty_ring *ring);
+
+#else /* CONFIG_HAVE_KVM_DIRTY_RING */
+
+static inline int kvm_dirty_ring_alloc(struct kvm_dirty_ring *ring, u32 size)
+{
+	return 0;
+}
+
+static inline void kvm_dirty_ring_free(struct kvm_dirty_ring *ring)
+{
+}
+
+static inline int kvm_dirty_ring_reset(struct kvm *kvm,
+				       struct kvm_dirty_ring *ring)
+{
+	return 0;
+}
+
+static inline bool kvm_dirty_ring_push(struct kvm_dirty_ring *ring,
+				       u32 slot, u64 offset)
+{
+	return false;
+}
+
+static inline struct page *kvm_dirty_ring_get_page(struct kvm_dirty_ring *ring,
+						   u32 offset)
+{
+	return NULL;
+}
+
+static inline bool kvm_dirty_ring_soft_full(struct kvm_dirty_ring *ring)
+{
+	return false;
+}
+
+#endif /* CONFIG_HAVE_KVM_DIRTY_RING */
+
+#endif /* KVM_DIRTY_RING_H */
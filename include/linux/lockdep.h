@@ -139,6 +139,7 @@ struct lock_class_stats {
 	struct lock_time		write_waittime;
 	struct lock_time		read_holdtime;
 	struct lock_time		write_holdtime;
+	struct lock_time		handoff_waittime;
 	unsigned long			bounces[nr_bounce_types];
 };
 
@@ -605,6 +606,7 @@ static inline void lockdep_free_task(struct task_struct *task) {}
 
 extern void lock_contended(struct lockdep_map *lock, unsigned long ip);
 extern void lock_acquired(struct lockdep_map *lock, unsigned long ip);
+extern void lock_handoff(struct lockdep_map *lock, unsigned long ip);
 
 #define LOCK_CONTENDED(_lock, try, lock)			\
 do {								\
@@ -631,6 +633,7 @@ do {								\
 
 #define lock_contended(lockdep_map, ip) do {} while (0)
 #define lock_acquired(lockdep_map, ip) do {} while (0)
+#define lock_handoff(lockdep_map, ip) do {} while (0)
 
 #define LOCK_CONTENDED(_lock, try, lock) \
 	lock(_lock)
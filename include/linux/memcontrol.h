@@ -30,6 +30,7 @@
 #include <linux/vmstat.h>
 #include <linux/writeback.h>
 #include <linux/page-flags.h>
+#include <linux/zswap.h>
 
 struct mem_cgroup;
 struct page;
@@ -91,6 +92,28 @@ struct mem_cgroup_stat_cpu {
 	unsigned long events[MEMCG_NR_EVENTS];
 	unsigned long nr_page_events;
 	unsigned long targets[MEM_CGROUP_NTARGETS];
+
+	/* count and events as of the last stats flush */
+	long count_prev[MEMCG_NR_STAT];
+	unsigned long events_prev[MEMCG_NR_EVENTS];
+};
+
+/*
+ * Totals folded in from the percpu counters by the stats flush, which
+ * also passes the changes on to the parent through its pending deltas.
+ */
+struct memcg_vmstats {
+	/* this memcg and its descendants */
+	long state[MEMCG_NR_STAT];
+	unsigned long events[MEMCG_NR_EVENTS];
+
+	/* this memcg only */
+	long state_local[MEMCG_NR_STAT];
+	unsigned long events_local[MEMCG_NR_EVENTS];
+
+	/* flushed from the children, not yet added to the totals */
+	long state_pending[MEMCG_NR_STAT];
+	unsigned long events_pending[MEMCG_NR_EVENTS];
 };
 
 struct mem_cgroup_reclaim_iter {
@@ -103,6 +126,16 @@ struct lruvec_stat {
 	long count[NR_VM_NODE_STAT_ITEMS];
 };
 
+/*
+ * Bitmap of the memcg aware shrinkers that may have objects charged to a
+ * memcg on a node, indexed by shrinker id.
+ */
+struct memcg_shrinker_map {
+	struct rcu_head rcu;
+	unsigned int nr_bits;
+	unsigned long map[0];
+};
+
 /*
  * per-zone information in memory controller.
  */
@@ -113,6 +146,10 @@ struct mem_cgroup_per_node {
 
 	struct mem_cgroup_reclaim_iter	iter[DEF_PRIORITY + 1];
 
+#ifndef CONFIG_SLOB
+	struct memcg_shrinker_map __rcu	*shrinker_map;
+#endif
+
 	struct rb_node		tree_node;	/* RB tree node */
 	unsigned long		usage_in_excess;/* Set to the value by which */
 						/* the soft limit is exceeded*/
@@ -174,6 +211,13 @@ struct mem_cgroup {
 	struct page_counter kmem;
 	struct page_counter tcpmem;
 
+#ifdef CONFIG_ZSWAP
+	/* Compressed swap charged to this memcg, see mm/zswap.c */
+	struct page_counter zswap;
+	atomic_long_t zswap_bytes;
+	struct zswap_lru zswap_lru;
+#endif
+
 	/* Normal memory consumption range */
 	unsigned long low;
 	unsigned long high;
@@ -232,6 +276,9 @@ struct mem_cgroup {
 	 */
 	struct mem_cgroup_stat_cpu __percpu *stat;
 
+	/* Flushed totals, see mem_cgroup_flush_stats() */
+	struct memcg_vmstats vmstats;
+
 	unsigned long		socket_pressure;
 
 	/* Legacy tcp memory accounting */
@@ -272,11 +319,9 @@ static inline bool mem_cgroup_disabled(void)
 	return !cgroup_subsys_enabled(memory_cgrp_subsys);
 }
 
-static inline void mem_cgroup_event(struct mem_cgroup *memcg,
-				    enum memcg_event_item event)
+static inline bool mem_cgroup_is_root(struct mem_cgroup *memcg)
 {
-	this_cpu_inc(memcg->stat->events[event]);
-	cgroup_file_notify(&memcg->events_file);
+	return (memcg == root_mem_cgroup);
 }
 
 bool mem_cgroup_low(struct mem_cgroup *root, struct mem_cgroup *memcg);
@@ -504,20 +549,28 @@ static inline unsigned long memcg_page_state(struct mem_cgroup *memcg,
 	return val;
 }
 
+void memcg_rstat_updated(struct mem_cgroup *memcg, int val);
+
 /* idx can be of type enum memcg_stat_item or node_stat_item */
 static inline void __mod_memcg_state(struct mem_cgroup *memcg,
 				     int idx, int val)
 {
-	if (!mem_cgroup_disabled())
-		__this_cpu_add(memcg->stat->count[idx], val);
+	if (mem_cgroup_disabled())
+		return;
+
+	__this_cpu_add(memcg->stat->count[idx], val);
+	memcg_rstat_updated(memcg, val);
 }
 
 /* idx can be of type enum memcg_stat_item or node_stat_item */
 static inline void mod_memcg_state(struct mem_cgroup *memcg,
 				   int idx, int val)
 {
-	if (!mem_cgroup_disabled())
-		this_cpu_add(memcg->stat->count[idx], val);
+	unsigned long flags;
+
+	local_irq_save(flags);
+	__mod_memcg_state(memcg, idx, val);
+	local_irq_restore(flags);
 }
 
 /**
@@ -587,14 +640,11 @@ static inline void __mod_lruvec_state(struct lruvec *lruvec,
 static inline void mod_lruvec_state(struct lruvec *lruvec,
 				    enum node_stat_item idx, int val)
 {
-	struct mem_cgroup_per_node *pn;
+	unsigned long flags;
 
-	mod_node_page_state(lruvec_pgdat(lruvec), idx, val);
-	if (mem_cgroup_disabled())
-		return;
-	pn = container_of(lruvec, struct mem_cgroup_per_node, lruvec);
-	mod_memcg_state(pn->memcg, idx, val);
-	this_cpu_add(pn->lruvec_stat->count[idx], val);
+	local_irq_save(flags);
+	__mod_lruvec_state(lruvec, idx, val);
+	local_irq_restore(flags);
 }
 
 static inline void __mod_lruvec_page_state(struct page *page,
@@ -613,26 +663,36 @@ static inline void __mod_lruvec_page_state(struct page *page,
 static inline void mod_lruvec_page_state(struct page *page,
 					 enum node_stat_item idx, int val)
 {
-	struct mem_cgroup_per_node *pn;
+	unsigned long flags;
 
-	mod_node_page_state(page_pgdat(page), idx, val);
-	if (mem_cgroup_disabled() || !page->mem_cgroup)
-		return;
-	mod_memcg_state(page->mem_cgroup, idx, val);
-	pn = page->mem_cgroup->nodeinfo[page_to_nid(page)];
-	this_cpu_add(pn->lruvec_stat->count[idx], val);
+	local_irq_save(flags);
+	__mod_lruvec_page_state(page, idx, val);
+	local_irq_restore(flags);
 }
 
 unsigned long mem_cgroup_soft_limit_reclaim(pg_data_t *pgdat, int order,
 						gfp_t gfp_mask,
 						unsigned long *total_scanned);
 
+/* idx can be of type enum memcg_event_item or vm_event_item */
+static inline void __count_memcg_events(struct mem_cgroup *memcg,
+					int idx, unsigned long count)
+{
+	if (mem_cgroup_disabled())
+		return;
+
+	__this_cpu_add(memcg->stat->events[idx], count);
+	memcg_rstat_updated(memcg, count);
+}
+
 static inline void count_memcg_events(struct mem_cgroup *memcg,
-				      enum vm_event_item idx,
-				      unsigned long count)
+				      int idx, unsigned long count)
 {
-	if (!mem_cgroup_disabled())
-		this_cpu_add(memcg->stat->events[idx], count);
+	unsigned long flags;
+
+	local_irq_save(flags);
+	__count_memcg_events(memcg, idx, count);
+	local_irq_restore(flags);
 }
 
 /* idx can be of type enum memcg_stat_item or node_stat_item */
@@ -654,12 +714,20 @@ static inline void count_memcg_event_mm(struct mm_struct *mm,
 	rcu_read_lock();
 	memcg = mem_cgroup_from_task(rcu_dereference(mm->owner));
 	if (likely(memcg)) {
-		this_cpu_inc(memcg->stat->events[idx]);
+		count_memcg_events(memcg, idx, 1);
 		if (idx == OOM_KILL)
 			cgroup_file_notify(&memcg->events_file);
 	}
 	rcu_read_unlock();
 }
+
+static inline void mem_cgroup_event(struct mem_cgroup *memcg,
+				    enum memcg_event_item event)
+{
+	count_memcg_events(memcg, event, 1);
+	cgroup_file_notify(&memcg->events_file);
+}
+
 #ifdef CONFIG_TRANSPARENT_HUGEPAGE
 void mem_cgroup_split_huge_fixup(struct page *head);
 #endif
@@ -676,6 +744,11 @@ static inline bool mem_cgroup_disabled(void)
 	return true;
 }
 
+static inline bool mem_cgroup_is_root(struct mem_cgroup *memcg)
+{
+	return true;
+}
+
 static inline void mem_cgroup_event(struct mem_cgroup *memcg,
 				    enum memcg_event_item event)
 {
@@ -1133,6 +1206,9 @@ static inline int memcg_cache_id(struct mem_cgroup *memcg)
 	return memcg ? memcg->kmemcg_id : -1;
 }
 
+int memcg_expand_shrinker_maps(int new_id);
+void memcg_set_shrinker_bit(struct mem_cgroup *memcg, int nid,
+			    int shrinker_id);
 #else
 #define for_each_memcg_cache_index(_idx)	\
 	for (; NULL; )
@@ -1155,6 +1231,10 @@ static inline void memcg_put_cache_ids(void)
 {
 }
 
+static inline void memcg_set_shrinker_bit(struct mem_cgroup *memcg,
+					  int nid, int shrinker_id)
+{
+}
 #endif /* CONFIG_MEMCG && !CONFIG_SLOB */
 
 #endif /* _LINUX_MEMCONTROL_H */
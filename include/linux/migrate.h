@@ -26,6 +26,7 @@ enum migrate_reason {
 	MR_MEMPOLICY_MBIND,
 	MR_NUMA_MISPLACED,
 	MR_CMA,
+	MR_DEMOTION,
 	MR_TYPES
 };
 
@@ -68,6 +69,9 @@ extern int migrate_page(struct address_space *mapping,
 			enum migrate_mode mode);
 extern int migrate_pages(struct list_head *l, new_page_t new, free_page_t free,
 		unsigned long private, enum migrate_mode mode, int reason);
+extern int __migrate_pages(struct list_head *l, new_page_t new,
+		free_page_t free, unsigned long private, enum migrate_mode mode,
+		int reason, unsigned int *nr_succeeded);
 extern int isolate_movable_page(struct page *page, isolate_mode_t mode);
 extern void putback_movable_page(struct page *page);
 
@@ -88,6 +92,10 @@ static inline int migrate_pages(struct list_head *l, new_page_t new,
 		free_page_t free, unsigned long private, enum migrate_mode mode,
 		int reason)
 	{ return -ENOSYS; }
+static inline int __migrate_pages(struct list_head *l, new_page_t new,
+		free_page_t free, unsigned long private, enum migrate_mode mode,
+		int reason, unsigned int *nr_succeeded)
+	{ return -ENOSYS; }
 static inline int isolate_movable_page(struct page *page, isolate_mode_t mode)
 	{ return -EBUSY; }
 
@@ -124,6 +132,27 @@ static inline void __ClearPageMovable(struct page *page)
 }
 #endif
 
+/*
+ * The nodes with CPUs are the fast tier of memory.  Reclaim demotes their
+ * cold pages to memory-only nodes, slower persistent memory for instance,
+ * and NUMA balancing promotes back those which are accessed.
+ */
+static inline bool node_is_toptier(int node)
+{
+	return node_state(node, N_CPU);
+}
+
+#if defined(CONFIG_MIGRATION) && defined(CONFIG_NUMA)
+extern bool numa_demotion_enabled;
+extern int next_demotion_node(int node);
+#else
+#define numa_demotion_enabled	false
+static inline int next_demotion_node(int node)
+{
+	return NUMA_NO_NODE;
+}
+#endif
+
 #ifdef CONFIG_NUMA_BALANCING
 extern bool pmd_trans_migrating(pmd_t pmd);
 extern int migrate_misplaced_page(struct page *page,
@@ -292,6 +292,7 @@ extern pgprot_t protection_map[16];
 #define FAULT_FLAG_USER		0x40	/* The fault originated in userspace */
 #define FAULT_FLAG_REMOTE	0x80	/* faulting for non current tsk/mm */
 #define FAULT_FLAG_INSTRUCTION  0x100	/* The fault was during an instruction fetch */
+#define FAULT_FLAG_SPECULATIVE	0x200	/* Fault handled without mmap_sem */
 
 #define FAULT_FLAG_TRACE \
 	{ FAULT_FLAG_WRITE,		"WRITE" }, \
@@ -302,7 +303,8 @@ extern pgprot_t protection_map[16];
 	{ FAULT_FLAG_TRIED,		"TRIED" }, \
 	{ FAULT_FLAG_USER,		"USER" }, \
 	{ FAULT_FLAG_REMOTE,		"REMOTE" }, \
-	{ FAULT_FLAG_INSTRUCTION,	"INSTRUCTION" }
+	{ FAULT_FLAG_INSTRUCTION,	"INSTRUCTION" }, \
+	{ FAULT_FLAG_SPECULATIVE,	"SPECULATIVE" }
 
 /*
  * vm_fault is filled by the the pagefault handler and passed to the vma's
@@ -350,6 +352,12 @@ struct vm_fault {
 					 * page table to avoid allocation from
 					 * atomic context.
 					 */
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	unsigned int sequence;		/* vma->vm_sequence at fault start */
+	pmd_t orig_pmd;			/* Value of the PMD, the page table
+					 * walk is not protected by mmap_sem
+					 */
+#endif
 };
 
 /* page entry size for vm->huge_fault() */
@@ -745,11 +753,12 @@ int finish_mkwrite_fault(struct vm_fault *vmf);
  * sets it, so none of the operations on it need to be atomic.
  */
 
-/* Page flags: | [SECTION] | [NODE] | ZONE | [LAST_CPUPID] | ... | FLAGS | */
+/* Page flags: | [SECTION] | [NODE] | ZONE | [LRU_GEN] | [LAST_CPUPID] | ... | FLAGS | */
 #define SECTIONS_PGOFF		((sizeof(unsigned long)*8) - SECTIONS_WIDTH)
 #define NODES_PGOFF		(SECTIONS_PGOFF - NODES_WIDTH)
 #define ZONES_PGOFF		(NODES_PGOFF - ZONES_WIDTH)
-#define LAST_CPUPID_PGOFF	(ZONES_PGOFF - LAST_CPUPID_WIDTH)
+#define LRU_GEN_PGOFF		(ZONES_PGOFF - LRU_GEN_WIDTH)
+#define LAST_CPUPID_PGOFF	(LRU_GEN_PGOFF - LAST_CPUPID_WIDTH)
 
 /*
  * Define the bit shifts to access each section.  For non-existent
@@ -774,8 +783,9 @@ int finish_mkwrite_fault(struct vm_fault *vmf);
 
 #define ZONEID_PGSHIFT		(ZONEID_PGOFF * (ZONEID_SHIFT != 0))
 
-#if SECTIONS_WIDTH+NODES_WIDTH+ZONES_WIDTH > BITS_PER_LONG - NR_PAGEFLAGS
-#error SECTIONS_WIDTH+NODES_WIDTH+ZONES_WIDTH > BITS_PER_LONG - NR_PAGEFLAGS
+#if SECTIONS_WIDTH+NODES_WIDTH+ZONES_WIDTH+LRU_GEN_WIDTH > \
+	BITS_PER_LONG - NR_PAGEFLAGS
+#error SECTIONS_WIDTH+NODES_WIDTH+ZONES_WIDTH+LRU_GEN_WIDTH > BITS_PER_LONG - NR_PAGEFLAGS
 #endif
 
 #define ZONES_MASK		((1UL << ZONES_WIDTH) - 1)
@@ -783,6 +793,7 @@ int finish_mkwrite_fault(struct vm_fault *vmf);
 #define SECTIONS_MASK		((1UL << SECTIONS_WIDTH) - 1)
 #define LAST_CPUPID_MASK	((1UL << LAST_CPUPID_SHIFT) - 1)
 #define ZONEID_MASK		((1UL << ZONEID_SHIFT) - 1)
+#define LRU_GEN_MASK		(((1UL << LRU_GEN_WIDTH) - 1) << LRU_GEN_PGOFF)
 
 static inline enum zone_type page_zonenum(const struct page *page)
 {
@@ -1298,6 +1309,7 @@ int walk_page_vma(struct vm_area_struct *vma, struct mm_walk *walk);
 void free_pgd_range(struct mmu_gather *tlb, unsigned long addr,
 		unsigned long end, unsigned long floor, unsigned long ceiling);
 int copy_page_range(struct mm_struct *dst, struct mm_struct *src,
+			struct vm_area_struct *dst_vma,
 			struct vm_area_struct *vma);
 void unmap_mapping_range(struct address_space *mapping,
 		loff_t const holebegin, loff_t const holelen, int even_cows);
@@ -1328,6 +1340,17 @@ int invalidate_inode_page(struct page *page);
 #ifdef CONFIG_MMU
 extern int handle_mm_fault(struct vm_area_struct *vma, unsigned long address,
 		unsigned int flags);
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+extern int handle_speculative_fault(struct mm_struct *mm,
+				    unsigned long address, unsigned int flags);
+#else
+static inline int handle_speculative_fault(struct mm_struct *mm,
+					   unsigned long address,
+					   unsigned int flags)
+{
+	return VM_FAULT_RETRY;
+}
+#endif
 extern int fixup_user_fault(struct task_struct *tsk, struct mm_struct *mm,
 			    unsigned long address, unsigned int fault_flags,
 			    bool *unlocked);
@@ -1370,6 +1393,21 @@ long get_user_pages_unlocked(unsigned long start, unsigned long nr_pages,
 int get_user_pages_fast(unsigned long start, int nr_pages, int write,
 			struct page **pages);
 
+/* A run of pinned pages which are physically contiguous */
+struct page_range {
+	struct page *page;		/* first page of the run */
+	unsigned long nr_pages;
+};
+
+long get_user_page_ranges_remote(struct task_struct *tsk, struct mm_struct *mm,
+			    unsigned long start, unsigned long nr_pages,
+			    unsigned int gup_flags, struct page_range *ranges,
+			    unsigned long *nr_ranges);
+long get_user_page_ranges(unsigned long start, unsigned long nr_pages,
+			    unsigned int gup_flags, struct page_range *ranges,
+			    unsigned long *nr_ranges);
+void put_user_page_range(struct page_range *range, bool dirty);
+
 /* Container for pinned pfns / pages */
 struct frame_vector {
 	unsigned int nr_allocated;	/* Number of frames we have space for */
@@ -1436,6 +1474,47 @@ int clear_page_dirty_for_io(struct page *page);
 
 int get_cmdline(struct task_struct *task, char *buffer, int buflen);
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+static inline void vma_init_sequence(struct vm_area_struct *vma)
+{
+	seqcount_init(&vma->vm_sequence);
+	vma->vm_write_nest = 0;
+}
+
+/*
+ * vm_write_begin() and vm_write_end() bracket the changes of a vma that a
+ * speculative page fault must not miss, under mmap_sem held for writing.
+ * They nest, and only the outermost pair bumps the sequence count.
+ */
+static inline void vm_write_begin(struct vm_area_struct *vma)
+{
+	if (!vma->vm_write_nest++)
+		raw_write_seqcount_begin(&vma->vm_sequence);
+}
+
+static inline void vm_write_end(struct vm_area_struct *vma)
+{
+	if (!--vma->vm_write_nest)
+		raw_write_seqcount_end(&vma->vm_sequence);
+}
+
+extern struct vm_area_struct *get_vma(struct mm_struct *mm,
+				      unsigned long addr);
+extern void put_vma(struct vm_area_struct *vma);
+#else
+static inline void vma_init_sequence(struct vm_area_struct *vma)
+{
+}
+
+static inline void vm_write_begin(struct vm_area_struct *vma)
+{
+}
+
+static inline void vm_write_end(struct vm_area_struct *vma)
+{
+}
+#endif
+
 static inline bool vma_is_anonymous(struct vm_area_struct *vma)
 {
 	return !vma->vm_ops;
@@ -1457,9 +1536,17 @@ extern unsigned long move_page_tables(struct vm_area_struct *vma,
 		unsigned long old_addr, struct vm_area_struct *new_vma,
 		unsigned long new_addr, unsigned long len,
 		bool need_rmap_locks);
+
+/* Flags for change_protection() */
+#define MM_CP_DIRTY_ACCT	(1UL << 0)	/* make dirty pages writable */
+#define MM_CP_PROT_NUMA		(1UL << 1)	/* for NUMA hinting faults */
+#define MM_CP_UFFD_WP		(1UL << 2)	/* userfaultfd wrprotect */
+#define MM_CP_UFFD_WP_RESOLVE	(1UL << 3)	/* and its resolution */
+#define MM_CP_UFFD_WP_ALL	(MM_CP_UFFD_WP | MM_CP_UFFD_WP_RESOLVE)
+
 extern unsigned long change_protection(struct vm_area_struct *vma, unsigned long start,
 			      unsigned long end, pgprot_t newprot,
-			      int dirty_accountable, int prot_numa);
+			      unsigned long cp_flags);
 extern int mprotect_fixup(struct vm_area_struct *vma,
 			  struct vm_area_struct **pprev, unsigned long start,
 			  unsigned long end, unsigned long newflags);
@@ -2152,6 +2239,9 @@ do_mmap_pgoff(struct file *file, unsigned long addr,
 }
 
 #ifdef CONFIG_MMU
+/* Up to this many threads populate a range, see vm.populate_threads */
+#define MAX_POPULATE_THREADS	64
+extern int sysctl_populate_threads;
 extern int __mm_populate(unsigned long addr, unsigned long len,
 			 int ignore_errors);
 static inline void mm_populate(unsigned long addr, unsigned long len)
@@ -2456,6 +2546,7 @@ int drop_caches_sysctl_handler(struct ctl_table *, int,
 
 void drop_slab(void);
 void drop_slab_node(int nid);
+void drop_slab_mem_cgroup(struct mem_cgroup *root);
 
 #ifndef CONFIG_MMU
 #define randomize_va_space 0
@@ -2495,6 +2586,12 @@ void vmemmap_populate_print_last(void);
 #ifdef CONFIG_MEMORY_HOTPLUG
 void vmemmap_free(unsigned long start, unsigned long end);
 #endif
+#ifdef CONFIG_HUGETLB_PAGE_FREE_VMEMMAP
+int vmemmap_remap_free(unsigned long start, unsigned long end,
+		       unsigned long reuse);
+int vmemmap_remap_alloc(unsigned long start, unsigned long end,
+			unsigned long reuse, gfp_t gfp_mask);
+#endif
 void register_page_bootmem_memmap(unsigned long section_nr, struct page *map,
 				  unsigned long size);
 
@@ -44,9 +44,170 @@ static __always_inline void update_lru_size(struct lruvec *lruvec,
 #endif
 }
 
+#ifdef CONFIG_LRU_GEN
+
+static inline int lru_gen_from_seq(unsigned long seq)
+{
+	return seq % MAX_NR_GENS;
+}
+
+/* The generation of a page on a multi-gen LRU list, -1 otherwise */
+static inline int page_lru_gen(struct page *page)
+{
+	unsigned long flags = READ_ONCE(page->flags);
+
+	return ((flags & LRU_GEN_MASK) >> LRU_GEN_PGOFF) - 1;
+}
+
+static inline bool lru_gen_is_active(struct lruvec *lruvec, int gen)
+{
+	unsigned long max_seq = lruvec->lrugen.max_seq;
+
+	return gen == lru_gen_from_seq(max_seq) ||
+	       gen == lru_gen_from_seq(max_seq - 1);
+}
+
+/*
+ * Moves the page between generations of the lruvec, or onto (@old_gen
+ * is -1) or off (@new_gen is -1) them. The lru sizes follow, counting the
+ * two youngest generations as active.
+ */
+static inline void lru_gen_update_size(struct lruvec *lruvec,
+				       struct page *page,
+				       int old_gen, int new_gen)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int type = page_is_file_cache(page);
+	int zone = page_zonenum(page);
+	int delta = hpage_nr_pages(page);
+	enum lru_list lru = type * LRU_FILE;
+	bool old_active, new_active;
+
+	if (old_gen >= 0)
+		lrugen->nr_pages[old_gen][type][zone] -= delta;
+	if (new_gen >= 0)
+		lrugen->nr_pages[new_gen][type][zone] += delta;
+
+	old_active = old_gen >= 0 && lru_gen_is_active(lruvec, old_gen);
+	new_active = new_gen >= 0 && lru_gen_is_active(lruvec, new_gen);
+
+	if (old_gen >= 0 && (new_gen < 0 || old_active != new_active))
+		update_lru_size(lruvec, lru + old_active * LRU_ACTIVE, zone,
+				-delta);
+	if (new_gen >= 0 && (old_gen < 0 || old_active != new_active))
+		update_lru_size(lruvec, lru + new_active * LRU_ACTIVE, zone,
+				delta);
+}
+
+/*
+ * Sets the generation of the page, and moves PG_active into the page's
+ * generation: while on a multi-gen LRU list, PG_active is clear and the
+ * generation says whether the page counts as active. Pages taken off the
+ * lists to be freed have no references left and must not get PG_active
+ * back. page->flags is shared with atomic bit operations, hence the
+ * cmpxchg.
+ */
+static inline void lru_gen_set_page_gen(struct lruvec *lruvec,
+					struct page *page, int gen)
+{
+	unsigned long old_flags, new_flags;
+	int old_gen;
+
+	do {
+		old_flags = READ_ONCE(page->flags);
+		old_gen = ((old_flags & LRU_GEN_MASK) >> LRU_GEN_PGOFF) - 1;
+		new_flags = old_flags & ~(LRU_GEN_MASK | BIT(PG_active));
+		if (gen >= 0)
+			new_flags |= (gen + 1UL) << LRU_GEN_PGOFF;
+		else if (page_count(page) && old_gen >= 0 &&
+			 lru_gen_is_active(lruvec, old_gen))
+			new_flags |= BIT(PG_active);
+	} while (cmpxchg(&page->flags, old_flags, new_flags) != old_flags);
+}
+
+static inline bool lru_gen_add_page(struct lruvec *lruvec, struct page *page,
+				    bool tail)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int type = page_is_file_cache(page);
+	int zone = page_zonenum(page);
+	unsigned long seq;
+	int gen;
+
+	if (!lrugen->enabled || PageUnevictable(page))
+		return false;
+
+	/*
+	 * Active pages start in the youngest generation, the others in the
+	 * oldest one: at its head, or at its tail when the caller wants the
+	 * page to be reclaimed first.
+	 */
+	if (PageActive(page) && !tail)
+		seq = lrugen->max_seq;
+	else
+		seq = lrugen->min_seq[type];
+	gen = lru_gen_from_seq(seq);
+
+	lru_gen_set_page_gen(lruvec, page, gen);
+	lru_gen_update_size(lruvec, page, -1, gen);
+	if (tail)
+		list_add_tail(&page->lru, &lrugen->lists[gen][type][zone]);
+	else
+		list_add(&page->lru, &lrugen->lists[gen][type][zone]);
+
+	return true;
+}
+
+static inline bool lru_gen_del_page(struct lruvec *lruvec, struct page *page)
+{
+	int gen = page_lru_gen(page);
+
+	if (gen < 0)
+		return false;
+
+	list_del(&page->lru);
+	lru_gen_update_size(lruvec, page, gen, -1);
+	lru_gen_set_page_gen(lruvec, page, -1);
+
+	return true;
+}
+
+/* A tail page split off a huge page on a multi-gen LRU list joins it */
+static inline void lru_gen_split_page(struct page *head, struct page *tail)
+{
+	unsigned long old_flags, new_flags;
+
+	do {
+		old_flags = READ_ONCE(tail->flags);
+		new_flags = old_flags | (READ_ONCE(head->flags) & LRU_GEN_MASK);
+	} while (cmpxchg(&tail->flags, old_flags, new_flags) != old_flags);
+}
+
+#else /* !CONFIG_LRU_GEN */
+
+static inline bool lru_gen_add_page(struct lruvec *lruvec, struct page *page,
+				    bool tail)
+{
+	return false;
+}
+
+static inline bool lru_gen_del_page(struct lruvec *lruvec, struct page *page)
+{
+	return false;
+}
+
+static inline void lru_gen_split_page(struct page *head, struct page *tail)
+{
+}
+
+#endif /* CONFIG_LRU_GEN */
+
 static __always_inline void add_page_to_lru_list(struct page *page,
 				struct lruvec *lruvec, enum lru_list lru)
 {
+	if (lru_gen_add_page(lruvec, page, false))
+		return;
+
 	update_lru_size(lruvec, lru, page_zonenum(page), hpage_nr_pages(page));
 	list_add(&page->lru, &lruvec->lists[lru]);
 }
@@ -54,6 +215,9 @@ static __always_inline void add_page_to_lru_list(struct page *page,
 static __always_inline void add_page_to_lru_list_tail(struct page *page,
 				struct lruvec *lruvec, enum lru_list lru)
 {
+	if (lru_gen_add_page(lruvec, page, true))
+		return;
+
 	update_lru_size(lruvec, lru, page_zonenum(page), hpage_nr_pages(page));
 	list_add_tail(&page->lru, &lruvec->lists[lru]);
 }
@@ -61,6 +225,9 @@ static __always_inline void add_page_to_lru_list_tail(struct page *page,
 static __always_inline void del_page_from_lru_list(struct page *page,
 				struct lruvec *lruvec, enum lru_list lru)
 {
+	if (lru_gen_del_page(lruvec, page))
+		return;
+
 	list_del(&page->lru);
 	update_lru_size(lruvec, lru, page_zonenum(page), -hpage_nr_pages(page));
 }
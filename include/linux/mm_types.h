@@ -9,6 +9,7 @@
 #include <linux/spinlock.h>
 #include <linux/rbtree.h>
 #include <linux/rwsem.h>
+#include <linux/seqlock.h>
 #include <linux/completion.h>
 #include <linux/cpumask.h>
 #include <linux/uprobes.h>
@@ -345,6 +346,18 @@ struct vm_area_struct {
 	struct mempolicy *vm_policy;	/* NUMA policy for the VMA */
 #endif
 	struct vm_userfaultfd_ctx vm_userfaultfd_ctx;
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	/*
+	 * Speculative page faults look the vma up without mmap_sem: the
+	 * sequence count is bumped around changes of the fields they
+	 * depend on, and the reference count plus the RCU freeing keep
+	 * the vma around until they are done with it.
+	 */
+	seqcount_t vm_sequence;
+	unsigned int vm_write_nest;	/* vm_write_begin() nesting */
+	atomic_t vm_ref_count;
+	struct rcu_head vm_rcu;
+#endif
 } __randomize_layout;
 
 struct core_thread {
@@ -359,6 +372,7 @@ struct core_state {
 };
 
 struct kioctx_table;
+struct futex_hash;
 struct mm_struct {
 	struct vm_area_struct *mmap;		/* list of VMAs */
 	struct rb_root mm_rb;
@@ -453,6 +467,10 @@ struct mm_struct {
 	spinlock_t			ioctx_lock;
 	struct kioctx_table __rcu	*ioctx_table;
 #endif
+#ifdef CONFIG_FUTEX
+	/* hash of the FUTEX_PRIVATE_FLAG futexes, set on first use */
+	struct futex_hash		*futex_hash;
+#endif
 #ifdef CONFIG_MEMCG
 	/*
 	 * "owner" points to a task that is regarded as the canonical
@@ -509,6 +527,17 @@ struct mm_struct {
 #endif
 	struct work_struct async_put_work;
 
+#ifdef CONFIG_KSM
+	/* Pages of this mm merged by ksmd, and rmap_items it uses for it */
+	unsigned long ksm_merging_pages;
+	unsigned long ksm_rmap_items;
+#endif
+
+#ifdef CONFIG_LRU_GEN
+	/* On the list of mms the multi-gen LRU walks when aging */
+	struct list_head lru_gen_list;
+#endif
+
 #if IS_ENABLED(CONFIG_HMM)
 	/* HMM needs to track a few things per mm */
 	struct hmm *hmm;
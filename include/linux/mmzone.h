@@ -98,6 +98,27 @@ struct free_area {
 	unsigned long		nr_free;
 };
 
+/*
+ * The free lists of a zone may be split into shards with their own lock.
+ * Memory is striped across the shards in MAX_ORDER_NR_PAGES blocks, so
+ * a page and its buddies, and every page of a pageblock, always belong to
+ * the same shard, and the shard of a pfn does not change when the zone is
+ * resized.
+ */
+#ifdef CONFIG_ZONE_SHARDS_SHIFT
+#define MAX_ZONE_SHARDS		(1 << CONFIG_ZONE_SHARDS_SHIFT)
+#else
+#define MAX_ZONE_SHARDS		1
+#endif
+#define ZONE_SHARD_STRIPE_SHIFT	(MAX_ORDER - 1)
+
+struct zone_shard {
+	/* Protects free_area */
+	spinlock_t		lock;
+	/* free areas of different sizes */
+	struct free_area	free_area[MAX_ORDER];
+} ____cacheline_internodealigned_in_smp;
+
 struct pglist_data;
 
 /*
@@ -174,6 +195,8 @@ enum node_stat_item {
 	NR_SHMEM,		/* shmem pages (included tmpfs/GEM pages) */
 	NR_SHMEM_THPS,
 	NR_SHMEM_PMDMAPPED,
+	NR_FILE_THPS,
+	NR_FILE_PMDMAPPED,
 	NR_ANON_THPS,
 	NR_UNSTABLE_NFS,	/* NFS unstable pages */
 	NR_VMSCAN_WRITE,
@@ -232,6 +255,44 @@ struct zone_reclaim_stat {
 	unsigned long		recent_scanned[2];
 };
 
+#ifdef CONFIG_LRU_GEN
+/*
+ * The multi-gen LRU sorts the evictable pages of a lruvec into generations
+ * instead of the active and inactive lists. Aging scans the page tables of
+ * the processes using the lruvec and moves every page found accessed into
+ * the youngest generation, max_seq, before opening a new one; eviction
+ * works on the oldest generation, min_seq, separately for anon and file
+ * pages. At least MIN_NR_GENS and at most MAX_NR_GENS generations exist at
+ * any time, and the two youngest ones are reported as the active lists.
+ */
+#define MIN_NR_GENS		2U
+#define MAX_NR_GENS		4U
+
+#define ANON_AND_FILE		2
+
+enum {
+	LRU_GEN_ANON,
+	LRU_GEN_FILE,
+};
+
+struct lru_gen_struct {
+	/* the youngest generation, incremented by aging */
+	unsigned long max_seq;
+	/* the oldest generation of each type, incremented by eviction */
+	unsigned long min_seq[ANON_AND_FILE];
+	/* when each generation was created, in jiffies */
+	unsigned long timestamps[MAX_NR_GENS];
+	/* the lists, indexed by generation, type and zone */
+	struct list_head lists[MAX_NR_GENS][ANON_AND_FILE][MAX_NR_ZONES];
+	/* the number of pages on each of the lists above */
+	long nr_pages[MAX_NR_GENS][ANON_AND_FILE][MAX_NR_ZONES];
+	/* whether pages added to the lruvec go on the lists above */
+	bool enabled;
+	/* a task is walking page tables to age this lruvec */
+	bool aging;
+};
+#endif
+
 struct lruvec {
 	struct list_head		lists[NR_LRU_LISTS];
 	struct zone_reclaim_stat	reclaim_stat;
@@ -239,11 +300,34 @@ struct lruvec {
 	atomic_long_t			inactive_age;
 	/* Refaults at the time of last reclaim cycle */
 	unsigned long			refaults;
+#ifdef CONFIG_LRU_GEN
+	struct lru_gen_struct		lrugen;
+#endif
 #ifdef CONFIG_MEMCG
 	struct pglist_data *pgdat;
 #endif
 };
 
+struct mm_struct;
+
+#ifdef CONFIG_LRU_GEN
+void lru_gen_init_lruvec(struct lruvec *lruvec);
+void lru_gen_add_mm(struct mm_struct *mm);
+void lru_gen_del_mm(struct mm_struct *mm);
+#else
+static inline void lru_gen_init_lruvec(struct lruvec *lruvec)
+{
+}
+
+static inline void lru_gen_add_mm(struct mm_struct *mm)
+{
+}
+
+static inline void lru_gen_del_mm(struct mm_struct *mm)
+{
+}
+#endif
+
 /* Mask used at gathering information at once (see memcontrol.c) */
 #define LRU_ALL_FILE (BIT(LRU_INACTIVE_FILE) | BIT(LRU_ACTIVE_FILE))
 #define LRU_ALL_ANON (BIT(LRU_INACTIVE_ANON) | BIT(LRU_ACTIVE_ANON))
@@ -270,13 +354,28 @@ enum zone_watermarks {
 #define low_wmark_pages(z) (z->watermark[WMARK_LOW])
 #define high_wmark_pages(z) (z->watermark[WMARK_HIGH])
 
+/*
+ * The pcp-lists cache every order up to PAGE_ALLOC_COSTLY_ORDER, plus the
+ * THP order when transparent hugepages are enabled.
+ */
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+#define NR_PCP_THP 1
+#else
+#define NR_PCP_THP 0
+#endif
+#define NR_PCP_ORDERS	(PAGE_ALLOC_COSTLY_ORDER + 1 + NR_PCP_THP)
+#define NR_PCP_LISTS	(MIGRATE_PCPTYPES * NR_PCP_ORDERS)
+
 struct per_cpu_pages {
-	int count;		/* number of pages in the list */
+	int count;		/* number of base pages in the lists */
 	int high;		/* high watermark, emptying needed */
 	int batch;		/* chunk size for buddy add/remove */
 
-	/* Lists of pages, one per migrate type stored on the pcp-lists */
-	struct list_head lists[MIGRATE_PCPTYPES];
+	/* Number of pages, of any migrate type, on the lists of each order */
+	int order_count[NR_PCP_ORDERS];
+
+	/* Lists of pages, one per order and migrate type */
+	struct list_head lists[NR_PCP_LISTS];
 };
 
 struct per_cpu_pageset {
@@ -442,7 +541,8 @@ struct zone {
 	/*
 	 * Number of isolated pageblock. It is used to solve incorrect
 	 * freepage counting problem due to racy retrieving migratetype
-	 * of pageblock. Protected by zone->lock.
+	 * of pageblock. Updated under zone->lock and the lock of the shard
+	 * owning the pageblock.
 	 */
 	unsigned long		nr_isolate_pageblock;
 #endif
@@ -457,13 +557,18 @@ struct zone {
 	/* Write-intensive fields used from the page allocator */
 	ZONE_PADDING(_pad1_)
 
-	/* free areas of different sizes */
-	struct free_area	free_area[MAX_ORDER];
+	/* free lists, split into nr_shards independently locked shards */
+	struct zone_shard	shards[MAX_ZONE_SHARDS];
+	unsigned int		nr_shards;
 
 	/* zone flags, see below */
 	unsigned long		flags;
 
-	/* Primarily protects free_area */
+	/*
+	 * Protects the zone-wide free list state, such as the highatomic
+	 * reserve and the isolated pageblock count. Nests outside the shard
+	 * locks and must be held to take more than one of them.
+	 */
 	spinlock_t		lock;
 
 	/* Write-intensive fields used by compaction and vmstats. */
@@ -541,6 +646,53 @@ static inline bool zone_is_empty(struct zone *zone)
 	return zone->spanned_pages == 0;
 }
 
+static inline struct zone_shard *zone_shard(struct zone *zone,
+					    unsigned long pfn)
+{
+#if MAX_ZONE_SHARDS > 1
+	pfn >>= ZONE_SHARD_STRIPE_SHIFT;
+	return &zone->shards[pfn & (zone->nr_shards - 1)];
+#else
+	return &zone->shards[0];
+#endif
+}
+
+#define for_each_zone_shard(zone, shard)				\
+	for (shard = (zone)->shards;					\
+	     shard < (zone)->shards + (zone)->nr_shards; shard++)
+
+/* Number of free blocks of @order over all shards of @zone */
+static inline unsigned long zone_nr_free(struct zone *zone,
+					 unsigned int order)
+{
+	struct zone_shard *shard;
+	unsigned long nr_free = 0;
+
+	for_each_zone_shard(zone, shard)
+		nr_free += shard->free_area[order].nr_free;
+	return nr_free;
+}
+
+/* Take zone->lock and every shard lock, for walks over all free lists */
+#define zone_lock_all_shards(zone, flags)				\
+	do {								\
+		struct zone_shard *__shard;				\
+									\
+		spin_lock_irqsave(&(zone)->lock, flags);		\
+		for_each_zone_shard(zone, __shard)			\
+			spin_lock_nest_lock(&__shard->lock, &(zone)->lock); \
+	} while (0)
+
+static inline void zone_unlock_all_shards(struct zone *zone,
+					  unsigned long flags)
+{
+	struct zone_shard *shard;
+
+	for_each_zone_shard(zone, shard)
+		spin_unlock(&shard->lock);
+	spin_unlock_irqrestore(&zone->lock, flags);
+}
+
 /*
  * Return true if [start_pfn, start_pfn + nr_pages) range has a non-empty
  * intersection with the given zone
@@ -611,6 +763,23 @@ struct zonelist {
 extern struct page *mem_map;
 #endif
 
+/*
+ * Up to this many kswapd threads reclaim a node, see vm.kswapd_threads.
+ * The first one is woken by the allocator, and wakes the others to help
+ * it for as long as it has not balanced the node.
+ */
+#define MAX_KSWAPD_THREADS	16
+
+struct kswapd_thread {
+	struct task_struct *task;	/* Protected by
+					   mem_hotplug_begin/end() */
+	struct pglist_data *pgdat;
+	int id;
+	unsigned long nr_wakeups;	/* balance_pgdat() runs */
+	unsigned long nr_scanned;
+	unsigned long nr_reclaimed;
+};
+
 /*
  * On NUMA machines, each NUMA node would have a pg_data_t to describe
  * it's memory layout. On UMA machines there is a single pglist_data which
@@ -653,11 +822,16 @@ typedef struct pglist_data {
 	int node_id;
 	wait_queue_head_t kswapd_wait;
 	wait_queue_head_t pfmemalloc_wait;
-	struct task_struct *kswapd;	/* Protected by
-					   mem_hotplug_begin/end() */
+	struct kswapd_thread kswapd[MAX_KSWAPD_THREADS];
 	int kswapd_order;
 	enum zone_type kswapd_classzone_idx;
 
+	/* The request the first kswapd is balancing, for the others */
+	wait_queue_head_t kswapd_helper_wait;
+	unsigned long kswapd_seq;
+	int kswapd_run_order;
+	enum zone_type kswapd_run_classzone_idx;
+
 	int kswapd_failures;		/* Number of 'reclaimed == 0' runs */
 
 #ifdef CONFIG_COMPACTION
@@ -891,6 +1065,8 @@ int min_free_kbytes_sysctl_handler(struct ctl_table *, int,
 					void __user *, size_t *, loff_t *);
 int watermark_scale_factor_sysctl_handler(struct ctl_table *, int,
 					void __user *, size_t *, loff_t *);
+int kswapd_threads_sysctl_handler(struct ctl_table *, int,
+					void __user *, size_t *, loff_t *);
 extern int sysctl_lowmem_reserve_ratio[MAX_NR_ZONES-1];
 int lowmem_reserve_ratio_sysctl_handler(struct ctl_table *, int,
 					void __user *, size_t *, loff_t *);
@@ -164,6 +164,28 @@ struct padata_instance {
 #define	PADATA_INVALID	4
 };
 
+/**
+ * struct padata_mt_job - A job split into chunks and run by several threads.
+ *
+ * @thread_fn: Called for each chunk [start, end) of the job.
+ * @fn_arg: Argument passed to @thread_fn.
+ * @start: Start of the job, in job specific units.
+ * @size: Size of the job, in job specific units.
+ * @align: Chunk boundaries fall on multiples of this, except possibly
+ *         at the start and end of the job.
+ * @min_chunk: Smallest amount of work worth handing to one thread.
+ * @max_threads: Upper bound on the threads used, the caller included.
+ */
+struct padata_mt_job {
+	void (*thread_fn)(unsigned long start, unsigned long end, void *arg);
+	void			*fn_arg;
+	unsigned long		start;
+	unsigned long		size;
+	unsigned long		align;
+	unsigned long		min_chunk;
+	int			max_threads;
+};
+
 extern struct padata_instance *padata_alloc_possible(
 					struct workqueue_struct *wq);
 extern void padata_free(struct padata_instance *pinst);
@@ -178,4 +200,14 @@ extern int padata_register_cpumask_notifier(struct padata_instance *pinst,
 					    struct notifier_block *nblock);
 extern int padata_unregister_cpumask_notifier(struct padata_instance *pinst,
 					      struct notifier_block *nblock);
+
+#ifdef CONFIG_PADATA
+extern void __init padata_do_multithreaded(struct padata_mt_job *job);
+#else
+static inline void __init padata_do_multithreaded(struct padata_mt_job *job)
+{
+	if (job->size)
+		job->thread_fn(job->start, job->start + job->size, job->fn_arg);
+}
+#endif
 #endif
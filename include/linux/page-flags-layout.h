@@ -32,6 +32,17 @@
 
 #endif /* CONFIG_SPARSEMEM */
 
+/*
+ * The multi-gen LRU stores the generation of a page plus one, so that zero
+ * means the page is not on a multi-gen LRU list. MAX_NR_GENS is 4, which
+ * makes 3 bits enough.
+ */
+#ifdef CONFIG_LRU_GEN
+#define LRU_GEN_WIDTH		3
+#else
+#define LRU_GEN_WIDTH		0
+#endif
+
 /*
  * page->flags layout:
  *
@@ -41,11 +52,11 @@
  * The last is when there is insufficient space in page->flags and a separate
  * lookup is necessary.
  *
- * No sparsemem or sparsemem vmemmap: |       NODE     | ZONE |             ... | FLAGS |
- *      " plus space for last_cpupid: |       NODE     | ZONE | LAST_CPUPID ... | FLAGS |
- * classic sparse with space for node:| SECTION | NODE | ZONE |             ... | FLAGS |
- *      " plus space for last_cpupid: | SECTION | NODE | ZONE | LAST_CPUPID ... | FLAGS |
- * classic sparse no space for node:  | SECTION |     ZONE    | ... | FLAGS |
+ * No sparsemem or sparsemem vmemmap: |       NODE     | ZONE | [LRU_GEN] |             ... | FLAGS |
+ *      " plus space for last_cpupid: |       NODE     | ZONE | [LRU_GEN] | LAST_CPUPID ... | FLAGS |
+ * classic sparse with space for node:| SECTION | NODE | ZONE | [LRU_GEN] |             ... | FLAGS |
+ *      " plus space for last_cpupid: | SECTION | NODE | ZONE | [LRU_GEN] | LAST_CPUPID ... | FLAGS |
+ * classic sparse no space for node:  | SECTION |     ZONE    | [LRU_GEN] | ... | FLAGS |
  */
 #if defined(CONFIG_SPARSEMEM) && !defined(CONFIG_SPARSEMEM_VMEMMAP)
 #define SECTIONS_WIDTH		SECTIONS_SHIFT
@@ -55,7 +66,8 @@
 
 #define ZONES_WIDTH		ZONES_SHIFT
 
-#if SECTIONS_WIDTH+ZONES_WIDTH+NODES_SHIFT <= BITS_PER_LONG - NR_PAGEFLAGS
+#if SECTIONS_WIDTH+ZONES_WIDTH+LRU_GEN_WIDTH+NODES_SHIFT \
+	<= BITS_PER_LONG - NR_PAGEFLAGS
 #define NODES_WIDTH		NODES_SHIFT
 #else
 #ifdef CONFIG_SPARSEMEM_VMEMMAP
@@ -76,7 +88,8 @@
 #define LAST_CPUPID_SHIFT 0
 #endif
 
-#if SECTIONS_WIDTH+ZONES_WIDTH+NODES_SHIFT+LAST_CPUPID_SHIFT <= BITS_PER_LONG - NR_PAGEFLAGS
+#if SECTIONS_WIDTH+ZONES_WIDTH+LRU_GEN_WIDTH+NODES_SHIFT+LAST_CPUPID_SHIFT \
+	<= BITS_PER_LONG - NR_PAGEFLAGS
 #define LAST_CPUPID_WIDTH LAST_CPUPID_SHIFT
 #else
 #define LAST_CPUPID_WIDTH 0
@@ -27,6 +27,7 @@ enum mapping_flags {
 	AS_EXITING	= 4, 	/* final truncate in progress */
 	/* writeback related tags are not used */
 	AS_NO_WRITEBACK_TAGS = 5,
+	AS_LARGE_PAGES	= 6,	/* huge pages as multi-order entries */
 };
 
 /**
@@ -95,6 +96,52 @@ static inline int mapping_use_writeback_tags(struct address_space *mapping)
 	return !test_bit(AS_NO_WRITEBACK_TAGS, &mapping->flags);
 }
 
+/*
+ * A filesystem calls this on a new inode to let readahead put huge pages
+ * in its page cache.  Each of them takes a single multi-order entry of the
+ * radix tree.  They are split back into small pages before being written
+ * to, so its ->readpage and ->readpages are all that need to cope with
+ * them.
+ */
+static inline void mapping_set_large_pages(struct address_space *mapping)
+{
+	if (IS_ENABLED(CONFIG_TRANSPARENT_HUGE_PAGECACHE))
+		set_bit(AS_LARGE_PAGES, &mapping->flags);
+}
+
+static inline bool mapping_large_pages(struct address_space *mapping)
+{
+	return IS_ENABLED(CONFIG_TRANSPARENT_HUGE_PAGECACHE) &&
+		test_bit(AS_LARGE_PAGES, &mapping->flags);
+}
+
+static inline int filemap_nr_thps(struct address_space *mapping)
+{
+#ifdef CONFIG_READ_ONLY_THP_FOR_FS
+	return atomic_read(&mapping->nr_thps);
+#else
+	return 0;
+#endif
+}
+
+static inline void filemap_nr_thps_inc(struct address_space *mapping)
+{
+#ifdef CONFIG_READ_ONLY_THP_FOR_FS
+	atomic_inc(&mapping->nr_thps);
+#else
+	WARN_ON_ONCE(1);
+#endif
+}
+
+static inline void filemap_nr_thps_dec(struct address_space *mapping)
+{
+#ifdef CONFIG_READ_ONLY_THP_FOR_FS
+	atomic_dec(&mapping->nr_thps);
+#else
+	WARN_ON_ONCE(1);
+#endif
+}
+
 static inline gfp_t mapping_gfp_mask(struct address_space * mapping)
 {
 	return mapping->gfp_mask;
@@ -418,6 +465,20 @@ static inline pgoff_t page_to_index(struct page *page)
 	return pgoff;
 }
 
+/*
+ * The multi-order entry of a large page points to its head: return the
+ * subpage for @offset.  The other entries already point to the page at
+ * their index.
+ */
+static inline struct page *find_subpage(struct page *page, pgoff_t offset)
+{
+	if (!IS_ENABLED(CONFIG_TRANSPARENT_HUGE_PAGECACHE) ||
+	    !PageHead(page) || PageHuge(page))
+		return page;
+
+	return page + (offset & (HPAGE_PMD_NR - 1));
+}
+
 /*
  * Get the offset in PAGE_SIZE.
  * (TODO: hugepage should have ->index in PAGE_SIZE)
@@ -506,6 +567,34 @@ static inline int lock_page_or_retry(struct page *page, struct mm_struct *mm,
 	return trylock_page(page) || __lock_page_or_retry(page, mm, flags);
 }
 
+/* This has the same layout as wait_bit_key - see fs/cachefiles/rdwr.c */
+struct wait_page_key {
+	struct page *page;
+	int bit_nr;
+	int page_match;
+};
+
+struct wait_page_queue {
+	struct page *page;
+	int bit_nr;
+	wait_queue_entry_t wait;
+};
+
+/*
+ * For the wake function of a custom wait_page_queue: true if @key wakes up
+ * @wait_page, ie its bit of its page is clear.
+ */
+static inline bool wake_page_match(struct wait_page_queue *wait_page,
+				   struct wait_page_key *key)
+{
+	if (wait_page->page != key->page)
+		return false;
+	key->page_match = 1;
+
+	return wait_page->bit_nr == key->bit_nr &&
+	       !test_bit(key->bit_nr, &key->page->flags);
+}
+
 /*
  * This is exported only for wait_on_page_locked/wait_on_page_writeback, etc.,
  * and should not be used directly.
@@ -33,7 +33,9 @@ struct pipe_buffer {
  *	@nrbufs: the number of non-empty pipe buffers in this pipe
  *	@buffers: total number of buffers (should be a power of 2)
  *	@curbuf: the current pipe buffer entry
- *	@tmp_page: cached released page
+ *	@tmp_pages: released pages kept for the next writes, up to @buffers
+ *	@nr_tmp_pages: number of pages in @tmp_pages
+ *	@poll_usage: the pipe was polled, so readers are woken on every write
  *	@readers: number of current readers of this pipe
  *	@writers: number of current writers of this pipe
  *	@files: number of struct file referring this pipe (protected by ->i_lock)
@@ -55,7 +57,9 @@ struct pipe_inode_info {
 	unsigned int waiting_writers;
 	unsigned int r_counter;
 	unsigned int w_counter;
-	struct page *tmp_page;
+	struct page **tmp_pages;
+	unsigned int nr_tmp_pages;
+	bool poll_usage;
 	struct fasync_struct *fasync_readers;
 	struct fasync_struct *fasync_writers;
 	struct pipe_buffer *bufs;
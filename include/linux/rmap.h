@@ -222,6 +222,13 @@ static inline void page_vma_mapped_walk_done(struct page_vma_mapped_walk *pvmw)
 
 bool page_vma_mapped_walk(struct page_vma_mapped_walk *pvmw);
 
+/*
+ * Used by try_to_unmap() to replace the pmd mapping a THP in the swap cache
+ * with a swap entry for its whole cluster, in mm/huge_memory.c.
+ */
+bool set_pmd_swap_entry(struct page_vma_mapped_walk *pvmw, struct page *page,
+			enum ttu_flags flags);
+
 /*
  * Used by swapoff to help locate where page is expected in vma.
  */
@@ -344,6 +344,21 @@ void sbitmap_queue_resize(struct sbitmap_queue *sbq, unsigned int depth);
  */
 int __sbitmap_queue_get(struct sbitmap_queue *sbq);
 
+/**
+ * __sbitmap_queue_get_batch() - Try to allocate a batch of free bits from a
+ * &struct sbitmap_queue with preemption already disabled.
+ * @sbq: Bitmap queue to allocate from.
+ * @nr_tags: Number of bits wanted, at most BITS_PER_LONG - 1.
+ * @offset: Output parameter; bit number of the first bit of the mask.
+ *
+ * The bits are all taken from a single word of the bitmap, with one atomic
+ * operation.  Not supported on round-robin bitmaps.
+ *
+ * Return: Mask of the bits allocated relative to @offset, 0 if none could be.
+ */
+unsigned long __sbitmap_queue_get_batch(struct sbitmap_queue *sbq, int nr_tags,
+					unsigned int *offset);
+
 /**
  * __sbitmap_queue_get_shallow() - Try to allocate a free bit from a &struct
  * sbitmap_queue, limiting the depth used from each word, with preemption
@@ -410,6 +425,20 @@ static inline int sbitmap_queue_get_shallow(struct sbitmap_queue *sbq,
 void sbitmap_queue_clear(struct sbitmap_queue *sbq, unsigned int nr,
 			 unsigned int cpu);
 
+/**
+ * sbitmap_queue_clear_batch() - Free a batch of allocated bits and wake up
+ * waiters on a &struct sbitmap_queue.
+ * @sbq: Bitmap to free from.
+ * @offset: Offset to subtract from each entry of @tags.
+ * @tags: Bit numbers to free (plus @offset).
+ * @nr_tags: Number of entries in @tags.
+ *
+ * Consecutive bits of a same word are cleared with a single atomic operation,
+ * and the waiters are woken up once for the whole batch.
+ */
+void sbitmap_queue_clear_batch(struct sbitmap_queue *sbq, int offset,
+			       int *tags, int nr_tags);
+
 static inline int sbq_index_inc(int index)
 {
 	return (index + 1) & (SBQ_WAIT_QUEUES - 1);
@@ -38,7 +38,7 @@ static inline void wake_up_nohz_cpu(int cpu) { }
 #endif
 
 #ifdef CONFIG_NO_HZ_FULL
-extern u64 scheduler_tick_max_deferment(void);
+extern int sched_tick_offload_init(void);
 #endif
 
 #endif /* _LINUX_SCHED_NOHZ_H */
@@ -6,6 +6,14 @@
 #define MIN_NICE	-20
 #define NICE_WIDTH	(MAX_NICE - MIN_NICE + 1)
 
+/*
+ * Latency nice values [ -20 ... 0 ... 19 ] do not change the CPU share of a
+ * task, only how soon its wakeups preempt and how hard they look for an
+ * idle CPU: the lower, the more latency sensitive.
+ */
+#define MAX_LATENCY_NICE	19
+#define MIN_LATENCY_NICE	-20
+
 /*
  * Priority of a process goes from 0..MAX_PRIO-1, valid RT
  * priority is 0..MAX_RT_PRIO-1, and SCHED_NORMAL/SCHED_BATCH
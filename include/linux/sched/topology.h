@@ -26,6 +26,7 @@
 #define SD_PREFER_SIBLING	0x1000	/* Prefer to place tasks in a sibling domain */
 #define SD_OVERLAP		0x2000	/* sched_domains of this level overlap */
 #define SD_NUMA			0x4000	/* cross-node balancing */
+#define SD_CLUSTER		0x8000	/* Domain members share a cluster (L2) */
 
 /*
  * Increase resolution of cpu_capacity calculations
@@ -40,6 +41,15 @@ static inline int cpu_smt_flags(void)
 }
 #endif
 
+#ifdef CONFIG_SCHED_CLUSTER
+static inline int cpu_cluster_flags(void)
+{
+	return SD_CLUSTER | SD_SHARE_PKG_RESOURCES;
+}
+
+extern const struct cpumask *cpu_cluster_mask(int cpu);
+#endif
+
 #ifdef CONFIG_SCHED_MC
 static inline int cpu_core_flags(void)
 {
@@ -72,8 +82,24 @@ struct sched_domain_shared {
 	atomic_t	ref;
 	atomic_t	nr_busy_cpus;
 	int		has_idle_cores;
+
+	/*
+	 * The idle CPUs of the domain, followed by the CPUs of its idle
+	 * cores.  Variable length, like sched_domain::span.
+	 */
+	unsigned long	idle_cpus[0];
 };
 
+static inline struct cpumask *sds_idle_cpus(struct sched_domain_shared *sds)
+{
+	return to_cpumask(sds->idle_cpus);
+}
+
+static inline struct cpumask *sds_idle_cores(struct sched_domain_shared *sds)
+{
+	return to_cpumask((void *)sds->idle_cpus + cpumask_size());
+}
+
 struct sched_domain {
 	/* These fields must be setup */
 	struct sched_domain *parent;	/* top domain must be null terminated */
@@ -34,11 +34,14 @@ struct shrink_control {
 };
 
 #define SHRINK_STOP (~0UL)
+#define SHRINK_EMPTY (~0UL - 1)
 /*
  * A callback you can register to apply pressure to ageable caches.
  *
  * @count_objects should return the number of freeable items in the cache. If
- * there are no objects to free or the number of freeable items cannot be
+ * there are no objects to free, it should return SHRINK_EMPTY, which lets a
+ * memcg aware shrinker drop out of the shrinker map of the memcg until its
+ * list_lrus get objects again. If the number of freeable items cannot be
  * determined, it should return 0. No deadlock checks should be done during the
  * count callback - the shrinker relies on aggregating scan counts that couldn't
  * be executed due to potential deadlocks to be run at a later call when the
@@ -66,6 +69,10 @@ struct shrinker {
 
 	/* These are for internal use */
 	struct list_head list;
+#if defined(CONFIG_MEMCG) && !defined(CONFIG_SLOB)
+	/* ID in shrinker_idr, and bit in the memcg shrinker maps */
+	int id;
+#endif
 	/* objs pending delete, per node */
 	atomic_long_t *nr_deferred;
 };
@@ -75,6 +82,15 @@ struct shrinker {
 #define SHRINKER_NUMA_AWARE	(1 << 0)
 #define SHRINKER_MEMCG_AWARE	(1 << 1)
 
+/*
+ * A shrinker whose list_lrus must know its id before it can be registered,
+ * typically because they get objects first, is set up in steps: allocated
+ * with prealloc_shrinker(), then either registered with
+ * register_shrinker_prepared() or freed with free_prealloced_shrinker().
+ */
+extern int prealloc_shrinker(struct shrinker *);
+extern void register_shrinker_prepared(struct shrinker *);
+extern void free_prealloced_shrinker(struct shrinker *);
 extern int register_shrinker(struct shrinker *);
 extern void unregister_shrinker(struct shrinker *);
 #endif
@@ -36,6 +36,12 @@ enum stat_item {
 	CPU_PARTIAL_FREE,	/* Refill cpu partial on free */
 	CPU_PARTIAL_NODE,	/* Refill cpu partial from node partial */
 	CPU_PARTIAL_DRAIN,	/* Drain cpu partial to node partial */
+	ALLOC_PCS,		/* Allocation from the per cpu sheaves */
+	FREE_PCS,		/* Free to the per cpu sheaves */
+	SHEAF_REFILL,		/* Sheaf refilled from the slabs */
+	SHEAF_FLUSH,		/* Sheaf flushed back to the slabs */
+	BARN_GET,		/* Full sheaf taken from the node barn */
+	BARN_PUT,		/* Full sheaf put into the node barn */
 	NR_SLUB_STAT_ITEMS };
 
 struct kmem_cache_cpu {
@@ -90,6 +96,9 @@ struct kmem_cache {
 #ifdef CONFIG_SLUB_CPU_PARTIAL
 	int cpu_partial;	/* Number of per cpu partial objects to keep around */
 #endif
+	/* Per cpu object arrays, only with SLAB_SHEAVES */
+	struct slub_percpu_sheaves __percpu *cpu_sheaves;
+	unsigned int sheaf_capacity;	/* Objects per sheaf */
 	struct kmem_cache_order_objects oo;
 
 	/* Allocation and freeing of slabs */
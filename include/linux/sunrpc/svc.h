@@ -26,6 +26,8 @@ struct svc_pool_stats {
 	unsigned long	sockets_queued;
 	atomic_long_t	threads_woken;
 	atomic_long_t	threads_timedout;
+	atomic_long_t	threads_started;
+	atomic_long_t	threads_retired;
 };
 
 /*
@@ -45,8 +47,11 @@ struct svc_pool {
 	unsigned int		sp_nrthreads;	/* # of threads in pool */
 	struct list_head	sp_all_threads;	/* all server threads */
 	struct svc_pool_stats	sp_stats;	/* statistics on pool operation */
+	unsigned int		sp_min_threads;	/* bounds of an auto-sized */
+	unsigned int		sp_max_threads;	/* pool, 0 if sized by hand */
 #define	SP_TASK_PENDING		(0)		/* still work to do even if no
 						 * xprt is queued. */
+#define	SP_GROW_PENDING		(1)		/* a thread is being added */
 	unsigned long		sp_flags;
 } ____cacheline_aligned_in_smp;
 
@@ -67,6 +72,9 @@ struct svc_serv_ops {
 
 	/* optional module to count when adding threads (pooled svcs only) */
 	struct module	*svo_module;
+
+	/* optional: add a thread to an auto-sized pool, from a workqueue */
+	void		(*svo_grow_pool)(struct svc_serv *, struct svc_pool *);
 };
 
 /*
@@ -101,6 +109,12 @@ struct svc_serv {
 	unsigned int		sv_nrpools;	/* number of thread pools */
 	struct svc_pool *	sv_pools;	/* array of thread pools */
 	const struct svc_serv_ops *sv_ops;	/* server operations */
+
+	/* auto-sized pools grow beyond this queueing delay of an xprt */
+	unsigned long		sv_grow_delay;
+	/* and their threads idle for that long exit */
+	unsigned long		sv_idle_timeout;
+	struct work_struct	sv_grow_work;	/* calls svo_grow_pool */
 #if defined(CONFIG_SUNRPC_BACKCHANNEL)
 	struct list_head	sv_cb_list;	/* queue for callback requests
 						 * that arrive over the same
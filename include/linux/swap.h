@@ -296,6 +296,7 @@ struct vma_swap_readahead {
 /* linux/mm/workingset.c */
 void *workingset_eviction(struct address_space *mapping, struct page *page);
 bool workingset_refault(void *shadow);
+bool workingset_test_recent(void *shadow);
 void workingset_activation(struct page *page);
 void workingset_update_node(struct radix_tree_node *node, void *private);
 
@@ -323,6 +324,7 @@ extern void lru_add_drain_all(void);
 extern void lru_add_drain_all_cpuslocked(void);
 extern void rotate_reclaimable_page(struct page *page);
 extern void deactivate_file_page(struct page *page);
+extern void deactivate_page(struct page *page);
 extern void mark_page_lazyfree(struct page *page);
 extern void swap_setup(void);
 
@@ -341,6 +343,14 @@ extern unsigned long try_to_free_mem_cgroup_pages(struct mem_cgroup *memcg,
 						  unsigned long nr_pages,
 						  gfp_t gfp_mask,
 						  bool may_swap);
+extern unsigned long proactive_reclaim_mem_cgroup_pages(
+					struct mem_cgroup *memcg,
+					unsigned long nr_pages,
+					bool may_swap, bool anon_only,
+					int *swappiness);
+extern unsigned long drop_pagecache_mem_cgroup_pages(
+					struct mem_cgroup *memcg,
+					unsigned long nr_pages);
 extern unsigned long mem_cgroup_shrink_node(struct mem_cgroup *mem,
 						gfp_t gfp_mask, bool noswap,
 						pg_data_t *pgdat,
@@ -367,6 +377,7 @@ static inline int node_reclaim(struct pglist_data *pgdat, gfp_t mask,
 extern int page_evictable(struct page *page);
 extern void check_move_unevictable_pages(struct page **, int nr_pages);
 
+extern int kswapd_threads;
 extern int kswapd_run(int nid);
 extern void kswapd_stop(int nid);
 
@@ -606,11 +617,33 @@ static inline swp_entry_t get_swap_page(struct page *page)
 
 #ifdef CONFIG_THP_SWAP
 extern int split_swap_cluster(swp_entry_t entry);
+extern int swap_duplicate_huge(swp_entry_t entry);
+extern void swap_free_huge(swp_entry_t entry);
+extern void free_swap_and_cache_huge(swp_entry_t entry);
+extern int swapcache_prepare_huge(swp_entry_t entry);
 #else
 static inline int split_swap_cluster(swp_entry_t entry)
 {
 	return 0;
 }
+
+static inline int swap_duplicate_huge(swp_entry_t entry)
+{
+	return 0;
+}
+
+static inline void swap_free_huge(swp_entry_t entry)
+{
+}
+
+static inline void free_swap_and_cache_huge(swp_entry_t entry)
+{
+}
+
+static inline int swapcache_prepare_huge(swp_entry_t entry)
+{
+	return -EINVAL;
+}
 #endif
 
 #ifdef CONFIG_MEMCG
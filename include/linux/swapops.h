@@ -69,6 +69,8 @@ static inline swp_entry_t pte_to_swp_entry(pte_t pte)
 
 	if (pte_swp_soft_dirty(pte))
 		pte = pte_swp_clear_soft_dirty(pte);
+	if (pte_swp_uffd_wp(pte))
+		pte = pte_swp_clear_uffd_wp(pte);
 	arch_entry = __pte_to_swp_entry(pte);
 	return swp_entry(__swp_type(arch_entry), __swp_offset(arch_entry));
 }
@@ -301,6 +303,20 @@ static inline int is_pmd_migration_entry(pmd_t pmd)
 }
 #endif
 
+#ifdef CONFIG_THP_SWAP
+/* A THP swapped out whole, its swap cluster mapped by a single pmd */
+static inline int is_pmd_swap_entry(pmd_t pmd)
+{
+	return !pmd_none(pmd) && !pmd_present(pmd) &&
+		!is_migration_entry(pmd_to_swp_entry(pmd));
+}
+#else
+static inline int is_pmd_swap_entry(pmd_t pmd)
+{
+	return 0;
+}
+#endif
+
 #ifdef CONFIG_MEMORY_FAILURE
 
 extern atomic_long_t num_poisoned_pages __read_mostly;
@@ -11,10 +11,13 @@
 #ifndef _LINUX_SYSCALLS_H
 #define _LINUX_SYSCALLS_H
 
+struct cachestat;
+struct cachestat_range;
 struct epoll_event;
 struct iattr;
 struct inode;
 struct iocb;
+struct io_uring_params;
 struct io_event;
 struct iovec;
 struct itimerspec;
@@ -22,6 +25,7 @@ struct itimerval;
 struct kexec_segment;
 struct linux_dirent;
 struct linux_dirent64;
+struct linux_dirent_statx;
 struct list_head;
 struct mmap_arg_struct;
 struct msgbuf;
@@ -36,6 +40,7 @@ struct old_utsname;
 struct pollfd;
 struct rlimit;
 struct rlimit64;
+struct rseq;
 struct rusage;
 struct sched_param;
 struct sched_attr;
@@ -503,6 +508,10 @@ asmlinkage long sys_munlockall(void);
 asmlinkage long sys_madvise(unsigned long start, size_t len, int behavior);
 asmlinkage long sys_mincore(unsigned long start, size_t len,
 				unsigned char __user * vec);
+asmlinkage long sys_cachestat(unsigned int fd,
+			      struct cachestat_range __user *cstat_range,
+			      struct cachestat __user *cstat,
+			      unsigned int flags);
 
 asmlinkage long sys_pivot_root(const char __user *new_root,
 				const char __user *put_old);
@@ -543,6 +552,13 @@ asmlinkage long sys_io_submit(aio_context_t, long,
 				struct iocb __user * __user *);
 asmlinkage long sys_io_cancel(aio_context_t ctx_id, struct iocb __user *iocb,
 			      struct io_event __user *result);
+asmlinkage long sys_io_uring_setup(u32 entries,
+				struct io_uring_params __user *p);
+asmlinkage long sys_io_uring_enter(unsigned int fd, u32 to_submit,
+				u32 min_complete, u32 flags,
+				const sigset_t __user *sig, size_t sigsz);
+asmlinkage long sys_io_uring_register(unsigned int fd, unsigned int op,
+				void __user *arg, unsigned int nr_args);
 asmlinkage long sys_sendfile(int out_fd, int in_fd,
 			     off_t __user *offset, size_t count);
 asmlinkage long sys_sendfile64(int out_fd, int in_fd,
@@ -633,6 +649,10 @@ asmlinkage long sys_getdents(unsigned int fd,
 asmlinkage long sys_getdents64(unsigned int fd,
 				struct linux_dirent64 __user *dirent,
 				unsigned int count);
+asmlinkage long sys_getdents_statx(unsigned int fd,
+				struct linux_dirent_statx __user *dirent,
+				unsigned int count, unsigned int mask,
+				unsigned int flags);
 
 asmlinkage long sys_setsockopt(int fd, int level, int optname,
 				char __user *optval, int optlen);
@@ -668,6 +688,7 @@ asmlinkage long sys_select(int n, fd_set __user *inp, fd_set __user *outp,
 asmlinkage long sys_old_select(struct sel_arg_struct __user *arg);
 asmlinkage long sys_epoll_create(int size);
 asmlinkage long sys_epoll_create1(int flags);
+asmlinkage long sys_epoll_create2(int flags, unsigned int max_items);
 asmlinkage long sys_epoll_ctl(int epfd, int op, int fd,
 				struct epoll_event __user *event);
 asmlinkage long sys_epoll_wait(int epfd, struct epoll_event __user *events,
@@ -913,6 +934,10 @@ asmlinkage long sys_process_vm_writev(pid_t pid,
 				      const struct iovec __user *rvec,
 				      unsigned long riovcnt,
 				      unsigned long flags);
+asmlinkage long sys_process_madvise(pid_t pid,
+				    const struct iovec __user *vec,
+				    size_t vlen, int behavior,
+				    unsigned int flags);
 
 asmlinkage long sys_kcmp(pid_t pid1, pid_t pid2, int type,
 			 unsigned long idx1, unsigned long idx2);
@@ -938,6 +963,9 @@ asmlinkage long sys_pkey_mprotect(unsigned long start, size_t len,
 				  unsigned long prot, int pkey);
 asmlinkage long sys_pkey_alloc(unsigned long flags, unsigned long init_val);
 asmlinkage long sys_pkey_free(int pkey);
+
+asmlinkage long sys_rseq(struct rseq __user *rseq, uint32_t rseq_len,
+			 int flags, uint32_t sig);
 asmlinkage long sys_statx(int dfd, const char __user *path, unsigned flags,
 			  unsigned mask, struct statx __user *buffer);
 
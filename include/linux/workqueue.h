@@ -120,6 +120,22 @@ struct delayed_work {
 	int cpu;
 };
 
+/*
+ * Affinity scopes of unbound workqueues.  An unbound workqueue gets a
+ * separate pool_workqueue for each pod of its scope, a pod being a group
+ * of CPUs which share the given level of the topology.
+ */
+enum wq_affn_scope {
+	WQ_AFFN_DFL,			/* use system default */
+	WQ_AFFN_CPU,			/* one pod per CPU */
+	WQ_AFFN_SMT,			/* one pod per SMT core */
+	WQ_AFFN_CACHE,			/* one pod per last level cache */
+	WQ_AFFN_NUMA,			/* one pod per NUMA node */
+	WQ_AFFN_SYSTEM,			/* one pod across the whole system */
+
+	WQ_AFFN_NR_TYPES,
+};
+
 /**
  * struct workqueue_attrs - A struct for workqueue attributes.
  *
@@ -136,6 +152,33 @@ struct workqueue_attrs {
 	 */
 	cpumask_var_t cpumask;
 
+	/**
+	 * @__pod_cpumask: internal attribute used to create per-pod pools
+	 *
+	 * Internal use only.  The CPUs of the pod a pool serves.  Equal to
+	 * @cpumask for strict pools, a subset of it for lax ones, whose
+	 * workers are steered into the pod on wakeup but may be moved out by
+	 * the scheduler.
+	 */
+	cpumask_var_t __pod_cpumask;
+
+	/**
+	 * @affn_strict: affinity scope is strict
+	 *
+	 * If set, workers are confined to the CPUs of their pod.  Otherwise
+	 * they may run on any CPU of @cpumask.  Set by default.
+	 */
+	bool affn_strict;
+
+	/**
+	 * @affn_scope: unbound CPU affinity scope
+	 *
+	 * Like ``no_numa``, ``affn_scope`` isn't a property of a worker_pool.
+	 * It only selects the pods :c:func:`apply_workqueue_attrs` creates
+	 * pools for.
+	 */
+	enum wq_affn_scope affn_scope;
+
 	/**
 	 * @no_numa: disable NUMA affinity
 	 *
@@ -442,6 +485,7 @@ void free_workqueue_attrs(struct workqueue_attrs *attrs);
 int apply_workqueue_attrs(struct workqueue_struct *wq,
 			  const struct workqueue_attrs *attrs);
 int workqueue_set_unbound_cpumask(cpumask_var_t cpumask);
+int workqueue_unbound_exclude_cpumask(const struct cpumask *exclude_cpumask);
 
 extern bool queue_work_on(int cpu, struct workqueue_struct *wq,
 			struct work_struct *work);
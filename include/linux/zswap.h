@@ -0,0 +1,62 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _LINUX_ZSWAP_H
+#define _LINUX_ZSWAP_H
+
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/types.h>
+
+struct mem_cgroup;
+struct page;
+
+/* The compressed pages charged to a memcg, the oldest first */
+struct zswap_lru {
+	spinlock_t lock;
+	struct list_head list;
+};
+
+static inline void zswap_lru_init(struct zswap_lru *lru)
+{
+	spin_lock_init(&lru->lock);
+	INIT_LIST_HEAD(&lru->list);
+}
+
+#if defined(CONFIG_MEMCG) && defined(CONFIG_ZSWAP)
+struct mem_cgroup *mem_cgroup_zswap_get(struct page *page);
+void mem_cgroup_zswap_put(struct mem_cgroup *memcg);
+struct zswap_lru *mem_cgroup_zswap_lru(struct mem_cgroup *memcg);
+bool mem_cgroup_zswap_may_store(struct mem_cgroup *memcg);
+void mem_cgroup_charge_zswap(struct mem_cgroup *memcg, size_t size);
+void mem_cgroup_uncharge_zswap(struct mem_cgroup *memcg, size_t size);
+#else
+static inline struct mem_cgroup *mem_cgroup_zswap_get(struct page *page)
+{
+	return NULL;
+}
+
+static inline void mem_cgroup_zswap_put(struct mem_cgroup *memcg)
+{
+}
+
+static inline struct zswap_lru *mem_cgroup_zswap_lru(struct mem_cgroup *memcg)
+{
+	return NULL;
+}
+
+static inline bool mem_cgroup_zswap_may_store(struct mem_cgroup *memcg)
+{
+	return true;
+}
+
+static inline void mem_cgroup_charge_zswap(struct mem_cgroup *memcg,
+					   size_t size)
+{
+}
+
+static inline void mem_cgroup_uncharge_zswap(struct mem_cgroup *memcg,
+					     size_t size)
+{
+}
+#endif
+
+#endif /* _LINUX_ZSWAP_H */
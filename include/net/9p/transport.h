@@ -35,6 +35,8 @@
  * @name: the human-readable name of the transport
  * @maxsize: transport provided maximum packet size
  * @def: set if this transport should be considered the default
+ * @vmalloc_bufs: set if the message buffers need not be physically
+ *                contiguous, for a large msize
  * @create: member function to create a new connection on this transport
  * @close: member function to discard a connection on this transport
  * @request: member function to issue a request to the transport
@@ -54,6 +56,7 @@ struct p9_trans_module {
 	char *name;		/* name of transport */
 	int maxsize;		/* max message size of transport */
 	int def;		/* this transport should be default */
+	bool vmalloc_bufs;	/* message buffers may be vmalloc'd */
 	struct module *owner;
 	int (*create)(struct p9_client *, const char *, char *);
 	void (*close) (struct p9_client *);
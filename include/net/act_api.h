@@ -37,6 +37,9 @@ struct tc_action {
 	spinlock_t			tcfa_lock;
 	struct gnet_stats_basic_cpu __percpu *cpu_bstats;
 	struct gnet_stats_queue __percpu *cpu_qstats;
+	/* totals reported by the last TCA_FLAG_STATS_DELTA dump */
+	struct gnet_stats_basic_packed	tcfa_bstats_polled;
+	struct gnet_stats_queue		tcfa_qstats_polled;
 	struct tc_cookie	*act_cookie;
 	struct tcf_chain	*goto_chain;
 };
@@ -64,6 +67,25 @@ static inline void tcf_lastuse_update(struct tcf_t *tm)
 		tm->firstuse = now;
 }
 
+/* Stats helpers for actions created with per-CPU stats, so the counters
+ * need neither the action lock nor a shared cache line.
+ */
+static inline void tcf_action_update_bstats(struct tc_action *a,
+					    struct sk_buff *skb)
+{
+	bstats_cpu_update(this_cpu_ptr(a->cpu_bstats), skb);
+}
+
+static inline void tcf_action_inc_drop_qstats(struct tc_action *a)
+{
+	qstats_drop_inc(this_cpu_ptr(a->cpu_qstats));
+}
+
+static inline void tcf_action_inc_overlimit_qstats(struct tc_action *a)
+{
+	qstats_overlimit_inc(this_cpu_ptr(a->cpu_qstats));
+}
+
 static inline void tcf_tm_dump(struct tcf_t *dtm, const struct tcf_t *stm)
 {
 	dtm->install = jiffies_to_clock_t(jiffies - stm->install);
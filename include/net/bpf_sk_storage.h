@@ -0,0 +1,16 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _BPF_SK_STORAGE_H
+#define _BPF_SK_STORAGE_H
+
+struct sock;
+
+void bpf_sk_storage_free(struct sock *sk);
+
+extern const struct bpf_func_proto bpf_sk_storage_get_proto;
+extern const struct bpf_func_proto bpf_sk_storage_delete_proto;
+extern const struct bpf_func_proto bpf_skb_sk_storage_get_proto;
+extern const struct bpf_func_proto bpf_skb_sk_storage_delete_proto;
+extern const struct bpf_func_proto bpf_sock_ops_sk_storage_get_proto;
+extern const struct bpf_func_proto bpf_sock_ops_sk_storage_delete_proto;
+
+#endif /* _BPF_SK_STORAGE_H */
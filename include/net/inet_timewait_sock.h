@@ -77,6 +77,7 @@ struct inet_timewait_sock {
 				tw_pad		: 2,	/* 2 bits hole */
 				tw_tos		: 8;
 	kmemcheck_bitfield_end(flags);
+	u64			tw_state_stamp;	/* see sk_state_stamp */
 	struct timer_list	tw_timer;
 	struct inet_bind_bucket	*tw_tb;
 };
@@ -236,6 +236,9 @@ int fib_table_flush(struct net *net, struct fib_table *table);
 struct fib_table *fib_trie_unmerge(struct fib_table *main_tb);
 void fib_table_flush_external(struct fib_table *table);
 void fib_free_table(struct fib_table *tb);
+int fib_table_accel_enable(struct fib_table *tb);
+void fib_table_accel_disable(struct fib_table *tb);
+int fib_lookup_accel_update(struct net *net);
 
 #ifndef CONFIG_IP_MULTIPLE_TABLES
 
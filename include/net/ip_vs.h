@@ -53,8 +53,11 @@ static inline struct net *seq_file_single_net(struct seq_file *seq)
 #endif
 }
 
+struct ip_vs_conn_tab;
+struct netns_ipvs;
+
 /* Connections' size value needed by ip_vs_ctl.c */
-extern int ip_vs_conn_tab_size;
+unsigned int ip_vs_conn_tab_size(struct netns_ipvs *ipvs);
 
 struct ip_vs_iphdr {
 	int hdr_flags;	/* ipvs flags */
@@ -870,6 +873,9 @@ struct netns_ipvs {
 #endif
 	/* ip_vs_conn */
 	atomic_t		conn_count;      /* connection counter */
+	/* connection hash table */
+	struct ip_vs_conn_tab __rcu *conn_tab;
+	struct work_struct	conn_resize_work;
 
 	/* ip_vs_ctl */
 	struct ip_vs_stats		tot_stats;  /* Statistics & est. */
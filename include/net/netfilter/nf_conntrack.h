@@ -129,6 +129,12 @@ static inline struct net *nf_ct_net(const struct nf_conn *ct)
 	return read_pnet(&ct->ct_net);
 }
 
+/* Exact number of conntracks in @net, for reporting: sums up all CPUs */
+static inline unsigned int nf_conntrack_count(struct net *net)
+{
+	return percpu_counter_sum_positive(&net->ct.count);
+}
+
 /* Alter reply tuple (maybe alter helper). */
 void nf_conntrack_alter_reply(struct nf_conn *ct,
 			      const struct nf_conntrack_tuple *newreply);
@@ -276,6 +282,18 @@ static inline bool nf_ct_is_expired(const struct nf_conn *ct)
 	return (__s32)(ct->timeout - nfct_time_stamp) <= 0;
 }
 
+#define	DAY	(86400 * HZ)
+
+/* Set an arbitrary timeout large enough not to ever expire while the
+ * flow table owns the connection, this saves us a check for the
+ * IPS_OFFLOAD_BIT from the packet path via nf_ct_is_expired().
+ */
+static inline void nf_ct_offload_timeout(struct nf_conn *ct)
+{
+	if (nf_ct_expires(ct) < DAY / 2)
+		ct->timeout = nfct_time_stamp + DAY;
+}
+
 /* use after obtaining a reference count */
 static inline bool nf_ct_should_gc(const struct nf_conn *ct)
 {
@@ -286,30 +304,31 @@ static inline bool nf_ct_should_gc(const struct nf_conn *ct)
 struct kernel_param;
 
 int nf_conntrack_set_hashsize(const char *val, struct kernel_param *kp);
-int nf_conntrack_hash_resize(unsigned int hashsize);
+int nf_conntrack_hash_resize(struct net *net, unsigned int hashsize);
+unsigned int nf_conntrack_hash_size(struct net *net);
 
-extern struct hlist_nulls_head *nf_conntrack_hash;
+/* Per-netns conntrack hash table.
+ *
+ * While a resize is in progress, @future points to the table the entries
+ * are being moved to and buckets below @rehashed have already been moved.
+ * Lookups search this table first and then @future.  The nulls value that
+ * terminates bucket i is @nulls_base + i, so a lookup can tell that it
+ * ended up in a chain of another table.
+ */
+struct nf_conntrack_htable {
+	struct hlist_nulls_head		*hash;
+	unsigned int			size;
+	unsigned int			rehashed;
+	unsigned long			nulls_base;
+	struct nf_conntrack_htable __rcu *future;
+};
+
+/* table size of init_net, and upper bound of the automatic growth of
+ * the tables of other namespaces.
+ */
 extern unsigned int nf_conntrack_htable_size;
-extern seqcount_t nf_conntrack_generation;
 extern unsigned int nf_conntrack_max;
 
-/* must be called with rcu read lock held */
-static inline void
-nf_conntrack_get_ht(struct hlist_nulls_head **hash, unsigned int *hsize)
-{
-	struct hlist_nulls_head *hptr;
-	unsigned int sequence, hsz;
-
-	do {
-		sequence = read_seqcount_begin(&nf_conntrack_generation);
-		hsz = nf_conntrack_htable_size;
-		hptr = nf_conntrack_hash;
-	} while (read_seqcount_retry(&nf_conntrack_generation, sequence));
-
-	*hash = hptr;
-	*hsize = hsz;
-}
-
 struct nf_conn *nf_ct_tmpl_alloc(struct net *net,
 				 const struct nf_conntrack_zone *zone,
 				 gfp_t flags);
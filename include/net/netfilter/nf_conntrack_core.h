@@ -85,6 +85,16 @@ print_tuple(struct seq_file *s, const struct nf_conntrack_tuple *tuple,
 extern spinlock_t nf_conntrack_locks[CONNTRACK_LOCKS];
 void nf_conntrack_lock(spinlock_t *lock);
 
+/* Table sizes are powers of two and at least CONNTRACK_LOCKS, so a hash
+ * always maps to the same lock whatever the size of the table it is in.
+ */
+static inline spinlock_t *
+nf_conntrack_bucket_lock(const struct nf_conntrack_htable *tbl,
+			 unsigned int bucket)
+{
+	return &nf_conntrack_locks[bucket / (tbl->size / CONNTRACK_LOCKS)];
+}
+
 extern spinlock_t nf_conntrack_expect_lock;
 
 #endif /* _NF_CONNTRACK_CORE_H */
@@ -5,7 +5,9 @@
 #include <linux/list.h>
 #include <linux/list_nulls.h>
 #include <linux/atomic.h>
+#include <linux/percpu_counter.h>
 #include <linux/workqueue.h>
+#include <linux/mutex.h>
 #include <linux/netfilter/nf_conntrack_tcp.h>
 #ifdef CONFIG_NF_CT_PROTO_DCCP
 #include <linux/netfilter/nf_conntrack_dccp.h>
@@ -17,6 +19,7 @@
 
 struct ctl_table_header;
 struct nf_conntrack_ecache;
+struct nf_conntrack_htable;
 
 struct nf_proto_net {
 #ifdef CONFIG_SYSCTL
@@ -91,8 +94,18 @@ struct ct_pcpu {
 };
 
 struct netns_ct {
-	atomic_t		count;
+	struct percpu_counter	count;
 	unsigned int		expect_count;
+
+	struct nf_conntrack_htable __rcu *htable;
+	struct mutex		htable_mutex;	/* serializes resizes */
+	struct work_struct	htable_work;
+	bool			htable_user;	/* size was set by the user */
+
+	struct delayed_work	gc_dwork;
+	unsigned int		gc_last_bucket;
+	unsigned int		gc_next_run;
+	bool			gc_early_drop;
 #ifdef CONFIG_NF_CONNTRACK_EVENTS
 	struct delayed_work ecache_dwork;
 	bool ecache_dwork_pending;
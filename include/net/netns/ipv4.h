@@ -58,6 +58,7 @@ struct netns_ipv4 {
 #endif
 	struct hlist_head	*fib_table_hash;
 	bool			fib_offload_disabled;
+	int			sysctl_fib_lookup_accel;
 	struct sock		*fibnl;
 
 	struct sock  * __percpu	*icmp_sk;
@@ -126,6 +127,8 @@ struct netns_ipv4 {
 	int sysctl_tcp_sack;
 	int sysctl_tcp_window_scaling;
 	int sysctl_tcp_timestamps;
+	int sysctl_tcp_comp_sack_nr;
+	unsigned long sysctl_tcp_comp_sack_delay_ns;
 	struct inet_timewait_death_row tcp_death_row;
 	int sysctl_max_syn_backlog;
 
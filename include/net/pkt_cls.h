@@ -574,6 +574,28 @@ struct tc_cls_bpf_offload {
 	u32 gen_flags;
 };
 
+enum tc_htb_command {
+	TC_HTB_CREATE,		/* the root is created */
+	TC_HTB_DESTROY,		/* and destroyed */
+	TC_HTB_NODE_ADD,	/* a class is added under parent_classid */
+	TC_HTB_NODE_MODIFY,	/* rate or ceil of a class change */
+	TC_HTB_NODE_DEL,
+};
+
+/* Commands of a multi-queue HTB root offloaded with TCA_HTB_OFFLOAD. The
+ * driver enforces the rates; each leaf class owns TX queue qid, inner
+ * classes have a qid of -1.
+ */
+struct tc_htb_qopt_offload {
+	enum tc_htb_command command;
+	u32 handle;
+	u32 classid;
+	u32 parent_classid;	/* TC_H_ROOT for top level classes */
+	int qid;
+	u64 rate;		/* bytes per second */
+	u64 ceil;
+};
+
 
 /* This structure holds cookie structure that is passed from user
  * to the kernel for actions and classifiers
@@ -7,11 +7,15 @@
 #include <linux/types.h>
 #include <net/sock.h>
 
+extern spinlock_t reuseport_lock;
+
 struct sock_reuseport {
 	struct rcu_head		rcu;
 
 	u16			max_socks;	/* length of socks */
 	u16			num_socks;	/* elements in socks */
+	/* ID stays the same even after the size of socks[] grows. */
+	unsigned int		reuseport_id;
 	struct bpf_prog __rcu	*prog;		/* optional BPF sock selector */
 	struct sock		*socks[0];	/* array of sock pointers */
 };
@@ -26,4 +30,6 @@ extern struct sock *reuseport_select_sock(struct sock *sk,
 extern struct bpf_prog *reuseport_attach_prog(struct sock *sk,
 					      struct bpf_prog *prog);
 
+int reuseport_get_id(struct sock_reuseport *reuse);
+
 #endif  /* _SOCK_REUSEPORT_H */
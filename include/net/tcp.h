@@ -429,6 +429,8 @@ int compat_tcp_setsockopt(struct sock *sk, int level, int optname,
 			  char __user *optval, unsigned int optlen);
 void tcp_set_keepalive(struct sock *sk, int val);
 void tcp_syn_ack_timeout(const struct request_sock *req);
+int tcp_mmap(struct file *file, struct socket *sock,
+	     struct vm_area_struct *vma);
 int tcp_recvmsg(struct sock *sk, struct msghdr *msg, size_t len, int nonblock,
 		int flags, int *addr_len);
 void tcp_parse_options(const struct net *net, const struct sk_buff *skb,
@@ -579,6 +581,7 @@ void tcp_init_xmit_timers(struct sock *);
 static inline void tcp_clear_xmit_timers(struct sock *sk)
 {
 	hrtimer_cancel(&tcp_sk(sk)->pacing_timer);
+	hrtimer_cancel(&tcp_sk(sk)->compressed_ack_timer);
 	inet_csk_clear_xmit_timers(sk);
 }
 
@@ -717,9 +720,12 @@ void tcp_send_window_probe(struct sock *sk);
  */
 #define TCP_TS_HZ	1000
 
+/* CLOCK_MONOTONIC based, so that departure times stored in skb->tstamp
+ * can be compared with ktime_get_ns() by packet schedulers.
+ */
 static inline u64 tcp_clock_ns(void)
 {
-	return local_clock();
+	return ktime_get_ns();
 }
 
 static inline u64 tcp_clock_us(void)
@@ -740,13 +746,16 @@ static inline u32 tcp_time_stamp_raw(void)
 }
 
 
-/* Refresh 1us clock of a TCP socket,
+/* Refresh clocks of a TCP socket,
  * ensuring monotically increasing values.
  */
 static inline void tcp_mstamp_refresh(struct tcp_sock *tp)
 {
-	u64 val = tcp_clock_us();
+	u64 val = tcp_clock_ns();
 
+	if (val > tp->tcp_clock_cache)
+		tp->tcp_clock_cache = val;
+	val = div_u64(val, NSEC_PER_USEC);
 	if (val > tp->tcp_mstamp)
 		tp->tcp_mstamp = val;
 }
@@ -2031,6 +2040,7 @@ static inline void tcp_listendrop(const struct sock *sk)
 }
 
 enum hrtimer_restart tcp_pace_kick(struct hrtimer *timer);
+enum hrtimer_restart tcp_compressed_ack_kick(struct hrtimer *timer);
 
 /*
  * Interface for adding Upper Level Protocols over TCP
@@ -201,6 +201,10 @@ struct xfrm_state {
 	/* The functions for replay detection. */
 	const struct xfrm_replay *repl;
 
+	/* Output sequence numbers each CPU reserves at a time, 0 if off */
+	u32			seq_batch;
+	struct xfrm_state_pcpu __percpu *pcpu;
+
 	/* internal flag that only holds state for delayed aevent at the
 	 * moment
 	*/
@@ -280,6 +284,18 @@ struct km_event {
 	struct net *net;
 };
 
+/* Output sequence numbers a CPU reserved from its SA, and the use it
+ * has not charged to the SA lifetime yet.
+ */
+struct xfrm_state_pcpu {
+	u64			seq;
+	u32			left;
+	u32			packets;
+	u64			bytes;
+};
+
+#define XFRM_SEQ_BATCH_MAX	4096
+
 struct xfrm_replay {
 	void	(*advance)(struct xfrm_state *x, __be32 net_seq);
 	int	(*check)(struct xfrm_state *x,
@@ -1509,6 +1525,7 @@ struct xfrm_state *xfrm_stateonly_find(struct net *net, u32 mark,
 struct xfrm_state *xfrm_state_lookup_byspi(struct net *net, __be32 spi,
 					      unsigned short family);
 int xfrm_state_check_expire(struct xfrm_state *x);
+int xfrm_state_seq_batch_init(struct xfrm_state *x, u32 batch);
 void xfrm_state_insert(struct xfrm_state *x);
 int xfrm_state_add(struct xfrm_state *x);
 int xfrm_state_update(struct xfrm_state *x);
@@ -1563,6 +1580,7 @@ int xfrm_dev_state_flush(struct net *net, struct net_device *dev, bool task_vali
 void xfrm_sad_getinfo(struct net *net, struct xfrmk_sadinfo *si);
 void xfrm_spd_getinfo(struct net *net, struct xfrmk_spdinfo *si);
 u32 xfrm_replay_seqhi(struct xfrm_state *x, __be32 net_seq);
+u32 xfrm_replay_reserve(struct xfrm_state *x, u32 n, u64 *seq);
 int xfrm_init_replay(struct xfrm_state *x);
 int xfrm_state_mtu(struct xfrm_state *x, int mtu);
 int __xfrm_init_state(struct xfrm_state *x, bool init_replay, bool offload);
@@ -0,0 +1,99 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM readahead
+
+#if !defined(_TRACE_READAHEAD_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_READAHEAD_H
+
+#include <linux/fs.h>
+#include <linux/types.h>
+#include <linux/tracepoint.h>
+
+#ifndef _TRACE_READAHEAD_DEF
+#define _TRACE_READAHEAD_DEF
+/* The access pattern ondemand_readahead() read ahead for */
+enum ra_pattern {
+	RA_PATTERN_INITIAL,
+	RA_PATTERN_SEQUENTIAL,
+	RA_PATTERN_CONTEXT,
+	RA_PATTERN_MARKER,
+	RA_PATTERN_STREAM,
+	RA_PATTERN_STRIDE,
+	RA_PATTERN_REVERSE,
+	RA_PATTERN_RANDOM,
+};
+#endif
+
+#define show_ra_pattern(pattern)					\
+	__print_symbolic(pattern,					\
+		{ RA_PATTERN_INITIAL,		"initial" },		\
+		{ RA_PATTERN_SEQUENTIAL,	"sequential" },		\
+		{ RA_PATTERN_CONTEXT,		"context" },		\
+		{ RA_PATTERN_MARKER,		"marker" },		\
+		{ RA_PATTERN_STREAM,		"stream" },		\
+		{ RA_PATTERN_STRIDE,		"stride" },		\
+		{ RA_PATTERN_REVERSE,		"reverse" },		\
+		{ RA_PATTERN_RANDOM,		"random" })
+
+/*
+ * A readahead decision.  @async is set when the application reached pages
+ * it had read ahead, and clear on a cache miss, which gives the hit rate;
+ * @actual is the number of pages which were not cached yet and were read.
+ */
+TRACE_EVENT(readahead,
+
+	TP_PROTO(struct address_space *mapping, pgoff_t offset,
+		 unsigned long req_size, bool async, int pattern,
+		 struct file_ra_state *ra, unsigned int max_pages, int actual),
+
+	TP_ARGS(mapping, offset, req_size, async, pattern, ra, max_pages,
+		actual),
+
+	TP_STRUCT__entry(
+		__field(dev_t, s_dev)
+		__field(unsigned long, i_ino)
+		__field(pgoff_t, offset)
+		__field(unsigned long, req_size)
+		__field(bool, async)
+		__field(int, pattern)
+		__field(pgoff_t, start)
+		__field(unsigned int, size)
+		__field(unsigned int, async_size)
+		__field(long, stride)
+		__field(unsigned int, max_pages)
+		__field(int, actual)
+	),
+
+	TP_fast_assign(
+		if (mapping->host->i_sb)
+			__entry->s_dev = mapping->host->i_sb->s_dev;
+		else
+			__entry->s_dev = mapping->host->i_rdev;
+		__entry->i_ino = mapping->host->i_ino;
+		__entry->offset = offset;
+		__entry->req_size = req_size;
+		__entry->async = async;
+		__entry->pattern = pattern;
+		__entry->start = ra->start;
+		__entry->size = ra->size;
+		__entry->async_size = ra->async_size;
+		__entry->stride = ra->stride;
+		__entry->max_pages = max_pages;
+		__entry->actual = actual;
+	),
+
+	TP_printk("dev=%d:%d ino=%lx offset=%lu req_size=%lu %s pattern=%s "
+		  "start=%lu size=%u async_size=%u stride=%ld max_pages=%u "
+		  "actual=%d",
+		  MAJOR(__entry->s_dev), MINOR(__entry->s_dev), __entry->i_ino,
+		  __entry->offset, __entry->req_size,
+		  __entry->async ? "async" : "sync",
+		  show_ra_pattern(__entry->pattern),
+		  __entry->start, __entry->size, __entry->async_size,
+		  __entry->stride, __entry->max_pages, __entry->actual)
+);
+
+#endif /* _TRACE_READAHEAD_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
@@ -732,9 +732,26 @@ __SYSCALL(__NR_pkey_alloc,    sys_pkey_alloc)
 __SYSCALL(__NR_pkey_free,     sys_pkey_free)
 #define __NR_statx 291
 __SYSCALL(__NR_statx,     sys_statx)
+#define __NR_process_madvise 292
+__SC_COMP(__NR_process_madvise, sys_process_madvise, \
+          compat_sys_process_madvise)
+#define __NR_cachestat 293
+__SYSCALL(__NR_cachestat, sys_cachestat)
+#define __NR_rseq 294
+__SYSCALL(__NR_rseq, sys_rseq)
+#define __NR_io_uring_setup 295
+__SYSCALL(__NR_io_uring_setup, sys_io_uring_setup)
+#define __NR_io_uring_enter 296
+__SYSCALL(__NR_io_uring_enter, sys_io_uring_enter)
+#define __NR_io_uring_register 297
+__SYSCALL(__NR_io_uring_register, sys_io_uring_register)
+#define __NR_getdents_statx 298
+__SYSCALL(__NR_getdents_statx, sys_getdents_statx)
+#define __NR_epoll_create2 299
+__SYSCALL(__NR_epoll_create2, sys_epoll_create2)
 
 #undef __NR_syscalls
-#define __NR_syscalls 292
+#define __NR_syscalls 300
 
 /*
  * All syscalls below here should go away really,
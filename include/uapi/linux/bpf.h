@@ -93,6 +93,11 @@ enum bpf_cmd {
 	BPF_PROG_GET_FD_BY_ID,
 	BPF_MAP_GET_FD_BY_ID,
 	BPF_OBJ_GET_INFO_BY_FD,
+	BPF_TRACE_FUNC_OPEN,
+	BPF_MAP_LOOKUP_BATCH,
+	BPF_MAP_LOOKUP_AND_DELETE_BATCH,
+	BPF_MAP_UPDATE_BATCH,
+	BPF_MAP_DELETE_BATCH,
 };
 
 enum bpf_map_type {
@@ -112,6 +117,11 @@ enum bpf_map_type {
 	BPF_MAP_TYPE_HASH_OF_MAPS,
 	BPF_MAP_TYPE_DEVMAP,
 	BPF_MAP_TYPE_SOCKMAP,
+	BPF_MAP_TYPE_XSKMAP,
+	BPF_MAP_TYPE_CPUMAP,
+	BPF_MAP_TYPE_REUSEPORT_SOCKARRAY,
+	BPF_MAP_TYPE_RINGBUF,
+	BPF_MAP_TYPE_SK_STORAGE,
 };
 
 enum bpf_prog_type {
@@ -130,6 +140,10 @@ enum bpf_prog_type {
 	BPF_PROG_TYPE_LWT_XMIT,
 	BPF_PROG_TYPE_SOCK_OPS,
 	BPF_PROG_TYPE_SK_SKB,
+	BPF_PROG_TYPE_SK_REUSEPORT,
+	BPF_PROG_TYPE_SK_MSG,
+	BPF_PROG_TYPE_SCHED,
+	BPF_PROG_TYPE_TRACING,
 };
 
 enum bpf_attach_type {
@@ -139,6 +153,11 @@ enum bpf_attach_type {
 	BPF_CGROUP_SOCK_OPS,
 	BPF_SK_SKB_STREAM_PARSER,
 	BPF_SK_SKB_STREAM_VERDICT,
+	BPF_SK_MSG_VERDICT,
+	BPF_SCHED_SELECT_RQ,
+	BPF_SCHED_WAKEUP_PREEMPT,
+	BPF_TRACE_FENTRY,
+	BPF_TRACE_FEXIT,
 	__MAX_BPF_ATTACH_TYPE
 };
 
@@ -201,6 +220,23 @@ union bpf_attr {
 		__u64		flags;
 	};
 
+	struct { /* struct used by BPF_MAP_*_BATCH commands */
+		__aligned_u64	in_batch;	/* start batch,
+						 * NULL to start from beginning
+						 */
+		__aligned_u64	out_batch;	/* output: next start batch */
+		__aligned_u64	keys;
+		__aligned_u64	values;
+		__u32		count;		/* input/output:
+						 * input: # of key/value
+						 * elements
+						 * output: # of filled elements
+						 */
+		__u32		map_fd;
+		__u64		elem_flags;
+		__u64		flags;
+	} batch;
+
 	struct { /* anonymous struct used by BPF_PROG_LOAD command */
 		__u32		prog_type;	/* one of enum bpf_prog_type */
 		__u32		insn_cnt;
@@ -250,6 +286,12 @@ union bpf_attr {
 		__u32		info_len;
 		__aligned_u64	info;
 	} info;
+
+	struct { /* anonymous struct used by BPF_TRACE_FUNC_OPEN command */
+		__aligned_u64	func_name;	/* kernel function to trace */
+		__u32		prog_fd;
+		__u32		attach_type;	/* BPF_TRACE_FENTRY or FEXIT */
+	} trace_func;
 } __attribute__((aligned(8)));
 
 /* BPF helper function descriptions:
@@ -583,6 +625,98 @@ union bpf_attr {
  *	@map: pointer to sockmap to update
  *	@key: key to insert/update sock in map
  *	@flags: same flags as map update elem
+ *
+ * int bpf_sk_select_reuseport(reuse, map, key, flags)
+ *     Select a SO_REUSEPORT sk from a BPF_MAP_TYPE_REUSEPORT_SOCKARRAY
+ *     map.  It checks the selected sk is matching the incoming request
+ *     in the skb.
+ *     @reuse: pointer to sk_reuseport_md
+ *     @map: pointer to reuseport_sockarray
+ *     @key: key to lookup sock in map
+ *     @flags: reserved for future use
+ *     Return: 0 on success or negative error code
+ *
+ * int bpf_msg_redirect_map(msg, map, key, flags)
+ *     Redirect msg to a sock in map using key as a lookup key for the
+ *     sock in map.
+ *     @msg: pointer to sk_msg_md
+ *     @map: pointer to sockmap
+ *     @key: key to lookup sock in map
+ *     @flags: BPF_F_INGRESS queues the data for reading on the sock
+ *             found, otherwise it is sent out of that sock
+ *     Return: SK_PASS on success or SK_DROP on error
+ *
+ * int bpf_msg_apply_bytes(msg, bytes)
+ *     Apply the verdict of the program to the next 'bytes' of the
+ *     stream only.  The program runs again on the data after them.
+ *     @msg: pointer to sk_msg_md
+ *     @bytes: number of bytes, 0 applies the verdict to this msg
+ *     Return: 0
+ *
+ * int bpf_msg_cork_bytes(msg, bytes)
+ *     Hold back the data until at least 'bytes' are queued, then run
+ *     the program again on all of it.
+ *     @msg: pointer to sk_msg_md
+ *     @bytes: number of bytes to wait for
+ *     Return: 0
+ *
+ * int bpf_msg_pull_data(msg, start, end, flags)
+ *     Make bytes [start, end) of the msg linear and writable so that
+ *     data and data_end point at them.  This copies the range into a
+ *     private buffer if it spans several pages or belongs to a page
+ *     handed over by sendpage.
+ *     @msg: pointer to sk_msg_md
+ *     @start: offset of the first byte
+ *     @end: offset after the last byte
+ *     @flags: reserved for future use
+ *     Return: 0 on success or negative error code
+ *
+ * int bpf_msg_push_data(msg, start, len, flags)
+ *     Insert 'len' (at most PAGE_SIZE) zeroed bytes into the msg at
+ *     offset 'start', e.g. to make room for a header.  data and
+ *     data_end are reset to the start of the msg afterwards.
+ *     @msg: pointer to sk_msg_md
+ *     @start: offset to insert at
+ *     @len: number of bytes to insert
+ *     @flags: reserved for future use
+ *     Return: 0 on success or negative error code
+ *
+ * int bpf_ringbuf_output(map, data, size, flags)
+ *     Copy 'size' bytes from 'data' into a record of the ring buffer map,
+ *     shared by all CPUs.  User space is woken up when it caught up with
+ *     the producers, unless flags say otherwise.
+ *     @map: pointer to ringbuf map
+ *     @data: data to be copied
+ *     @size: size of data
+ *     @flags: BPF_RB_NO_WAKEUP or BPF_RB_FORCE_WAKEUP
+ *     Return: 0 on success, -EAGAIN if the ring buffer is full, or
+ *     negative error code
+ *
+ * u64 bpf_ringbuf_query(map, flags)
+ *     Query the state of the ring buffer map, e.g. to sample down when
+ *     the consumer falls behind.
+ *     @map: pointer to ringbuf map
+ *     @flags: BPF_RB_AVAIL_DATA, BPF_RB_RING_SIZE, BPF_RB_CONS_POS or
+ *             BPF_RB_PROD_POS
+ *     Return: the requested value, 0 for unknown flags
+ *
+ * void *bpf_sk_storage_get(map, ctx, value, flags)
+ *     Get the value of an sk_storage map for the socket of ctx: skb->sk
+ *     for programs working on skbs, the socket itself for sock_ops and
+ *     cgroup sock programs.  The value is created if it does not exist
+ *     yet and BPF_SK_STORAGE_GET_F_CREATE is set.
+ *     @map: pointer to sk_storage map
+ *     @ctx: context of the program
+ *     @value: initial value of a created element, or NULL for zeroes
+ *     @flags: 0 or BPF_SK_STORAGE_GET_F_CREATE
+ *     Return: pointer to the value or NULL, also if there is no (full)
+ *     socket or the element could not be created
+ *
+ * int bpf_sk_storage_delete(map, ctx)
+ *     Delete the value of an sk_storage map for the socket of ctx.
+ *     @map: pointer to sk_storage map
+ *     @ctx: context of the program
+ *     Return: 0 on success, -ENOENT if there is no such value
  */
 #define __BPF_FUNC_MAPPER(FN)		\
 	FN(unspec),			\
@@ -639,6 +773,16 @@ union bpf_attr {
 	FN(redirect_map),		\
 	FN(sk_redirect_map),		\
 	FN(sock_map_update),		\
+	FN(sk_select_reuseport),	\
+	FN(msg_redirect_map),		\
+	FN(msg_apply_bytes),		\
+	FN(msg_cork_bytes),		\
+	FN(msg_pull_data),		\
+	FN(msg_push_data),		\
+	FN(ringbuf_output),		\
+	FN(ringbuf_query),		\
+	FN(sk_storage_get),		\
+	FN(sk_storage_delete),		\
 
 /* integer value in 'imm' field of BPF_CALL instruction selects which helper
  * function eBPF program intends to call
@@ -666,7 +810,9 @@ enum bpf_func_id {
 #define BPF_F_MARK_MANGLED_0		(1ULL << 5)
 #define BPF_F_MARK_ENFORCE		(1ULL << 6)
 
-/* BPF_FUNC_clone_redirect and BPF_FUNC_redirect flags. */
+/* BPF_FUNC_clone_redirect, BPF_FUNC_redirect and BPF_FUNC_msg_redirect_map
+ * flags.
+ */
 #define BPF_F_INGRESS			(1ULL << 0)
 
 /* BPF_FUNC_skb_set_tunnel_key and BPF_FUNC_skb_get_tunnel_key flags. */
@@ -784,6 +930,9 @@ enum xdp_action {
 struct xdp_md {
 	__u32 data;
 	__u32 data_end;
+	/* Below access go through struct xdp_rxq_info */
+	__u32 ingress_ifindex; /* rxq->dev->ifindex */
+	__u32 rx_queue_index;  /* rxq->queue_index  */
 };
 
 enum sk_action {
@@ -791,6 +940,101 @@ enum sk_action {
 	SK_PASS,
 };
 
+/* user accessible metadata for SK_REUSEPORT_PROG */
+struct sk_reuseport_md {
+	/* Start of directly accessible data.  It begins from the
+	 * tcp/udp header.
+	 */
+	__u32 data;
+	__u32 data_end;		/* End of directly accessible data */
+	/* Total length of packet (starting from the tcp/udp header).
+	 * Note that the directly accessible bytes (data_end - data)
+	 * could be less than this "len".  Those bytes could be
+	 * indirectly read by the bpf_skb_load_bytes() helper.
+	 */
+	__u32 len;
+	/* Eth protocol in the mac header (network byte order). e.g.
+	 * ETH_P_IP(0x0800) and ETH_P_IPV6(0x86DD)
+	 */
+	__u32 eth_protocol;
+	__u32 ip_protocol;	/* IP protocol. e.g. IPPROTO_TCP, IPPROTO_UDP */
+	__u32 hash;		/* A hash of the packet 4 tuples */
+};
+
+/* user accessible metadata for SK_MSG packet hook, new fields must
+ * be added to the end of this structure
+ */
+struct sk_msg_md {
+	void *data;
+	void *data_end;
+};
+
+/* bpf_sched_md flags, how the task is being placed */
+#define BPF_SCHED_F_WAKE	(1U << 0)
+#define BPF_SCHED_F_FORK	(1U << 1)
+#define BPF_SCHED_F_EXEC	(1U << 2)
+#define BPF_SCHED_F_SYNC	(1U << 3)	/* the waker goes to sleep */
+
+/* BPF_PROG_TYPE_SCHED return codes.  BPF_SCHED_SELECT_RQ programs may also
+ * return a CPU, which is only used if the task is allowed to run there.
+ */
+#define BPF_SCHED_NO_PREF	(-1)
+#define BPF_SCHED_NO_PREEMPT	0
+#define BPF_SCHED_PREEMPT	1
+
+/* user accessible metadata for BPF_PROG_TYPE_SCHED programs, read only.
+ * The LLC fields describe the LLC of target_cpu.
+ */
+struct bpf_sched_md {
+	__u32 pid;
+	__u32 tgid;
+	__u64 cgroup_id;	/* of the task in the default hierarchy */
+	__u32 flags;		/* BPF_SCHED_F_* */
+	__u32 this_cpu;
+	__u32 prev_cpu;		/* the CPU the task last ran on */
+	__u32 target_cpu;	/* the CPU picked by the kernel, or the one
+				 * of curr_pid for BPF_SCHED_WAKEUP_PREEMPT
+				 */
+	__u32 llc_idle_cpus;	/* number of idle CPUs in the LLC */
+	__u32 llc_has_idle_cores;
+	__u32 curr_pid;		/* BPF_SCHED_WAKEUP_PREEMPT: the task running */
+};
+
+/* BPF_FUNC_ringbuf_output flags */
+#define BPF_RB_NO_WAKEUP		(1ULL << 0)
+#define BPF_RB_FORCE_WAKEUP		(1ULL << 1)
+
+/* BPF_FUNC_ringbuf_query flags */
+enum {
+	BPF_RB_AVAIL_DATA = 0,
+	BPF_RB_RING_SIZE = 1,
+	BPF_RB_CONS_POS = 2,
+	BPF_RB_PROD_POS = 3,
+};
+
+/* BPF ring buffer records start with an 8 byte header, whose first 32 bit
+ * word is the length of the data, along with these flags.  A record is
+ * BPF_RINGBUF_HDR_SZ plus its length rounded up to 8 bytes.
+ */
+#define BPF_RINGBUF_BUSY_BIT		(1U << 31)	/* not committed yet */
+#define BPF_RINGBUF_DISCARD_BIT		(1U << 30)	/* to be skipped */
+#define BPF_RINGBUF_HDR_SZ		8
+
+/* BPF_FUNC_sk_storage_get flags */
+#define BPF_SK_STORAGE_GET_F_CREATE	(1ULL << 0)
+
+/* user accessible metadata for BPF_PROG_TYPE_TRACING programs, read only.
+ * args[] holds the first BPF_TRACE_FUNC_MAX_ARGS integer or pointer
+ * arguments of the traced function, ret its return value for
+ * BPF_TRACE_FEXIT programs.
+ */
+#define BPF_TRACE_FUNC_MAX_ARGS	6
+
+struct bpf_trace_func_ctx {
+	__u64 args[BPF_TRACE_FUNC_MAX_ARGS];
+	__u64 ret;
+};
+
 #define BPF_TAG_SIZE	8
 
 struct bpf_prog_info {
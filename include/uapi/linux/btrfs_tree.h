@@ -301,6 +301,9 @@
 
 /* csum types */
 #define BTRFS_CSUM_TYPE_CRC32	0
+#define BTRFS_CSUM_TYPE_XXHASH	1
+#define BTRFS_CSUM_TYPE_SHA256	2
+#define BTRFS_CSUM_TYPE_BLAKE2	3
 
 /*
  * flags definitions for directory entry item type
@@ -19,8 +19,9 @@
 #include <linux/fcntl.h>
 #include <linux/types.h>
 
-/* Flags for epoll_create1.  */
+/* Flags for epoll_create1() and epoll_create2().  */
 #define EPOLL_CLOEXEC O_CLOEXEC
+#define EPOLL_USERPOLL 1
 
 /* Valid opcodes to issue to sys_epoll_ctl() */
 #define EPOLL_CTL_ADD 1
@@ -78,6 +79,62 @@ struct epoll_event {
 	__u64 data;
 } EPOLL_PACKED;
 
+/*
+ * An epoll instance created with EPOLL_USERPOLL publishes ready events in
+ * a ring that userspace mmap()s from the epoll fd, at offset 0 and with
+ * header_length + index_length bytes.  Every registered file owns one
+ * item in items[], and the index ring that starts header_length bytes
+ * into the mapping holds (item number + 1) for each item that became
+ * ready.  Only EPOLLET registrations are allowed, and EPOLLWAKEUP is not
+ * supported.
+ *
+ * epoll_create2() sizes items[] for its max_items argument, at most
+ * EPOLL_USERPOLL_MAX_ITEMS, and epoll_create1() for
+ * EPOLL_USERPOLL_DEF_ITEMS.  The index ring has at least an entry per
+ * item, which is therefore never overrun.  The
+ * item of a removed file stays reserved until head moves past the entries
+ * queued before its removal: EPOLL_CTL_ADD fails with ENOSPC while all
+ * the items are in use.
+ *
+ * The kernel ORs new events into ready_events and queues the item in the
+ * index ring only when ready_events was 0, so an item is in the ring at
+ * most once until userspace consumes it.  The kernel advances tail
+ * before it writes the index entry.  To consume entries, userspace does
+ * the following while head != tail:
+ *
+ *	idx = &index[head & (index_length / sizeof(__u32) - 1)];
+ *	while (!(nr = READ_ONCE(*idx)))		// being written
+ *		;
+ *	*idx = 0;
+ *	store_release(&header->head, ++head);
+ *	events = atomic_exchange(&items[nr - 1].ready_events, 0);
+ *
+ * Entries whose ready_events exchanges to 0 (e.g. for an item removed or
+ * replaced while it was queued) must be skipped.  When the ring is empty
+ * epoll_wait() sleeps until one is queued and returns the number of
+ * queued entries without writing to its events argument.
+ */
+#define EPOLL_USERPOLL_HEADER_MAGIC	0xeb01eb01
+#define EPOLL_USERPOLL_DEF_ITEMS	256
+#define EPOLL_USERPOLL_MAX_ITEMS	(1 << 14)
+
+struct epoll_uitem {
+	__u32 ready_events;	/* set by the kernel, cleared by userspace */
+	__u32 events;		/* registered event mask */
+	__u64 data;
+};
+
+struct epoll_uheader {
+	__u32 magic;		/* EPOLL_USERPOLL_HEADER_MAGIC */
+	__u32 header_length;	/* header and items, offset of the index */
+	__u32 index_length;	/* length of the index ring in bytes */
+	__u32 max_items_nr;
+	__u32 head;		/* updated by userspace */
+	__u32 tail;		/* updated by the kernel */
+	__u32 __pad[10];
+	struct epoll_uitem items[];
+};
+
 #ifdef CONFIG_PM_SLEEP
 static inline void ep_take_care_of_epollwakeup(struct epoll_event *epev)
 {
@@ -238,6 +238,7 @@ struct fsxattr {
 #define FIFREEZE	_IOWR('X', 119, int)	/* Freeze */
 #define FITHAW		_IOWR('X', 120, int)	/* Thaw */
 #define FITRIM		_IOWR('X', 121, struct fstrim_range)	/* Trim */
+#define FIDROPCACHES	_IOW('X', 122, int)	/* Drop caches */
 #define FICLONE		_IOW(0x94, 9, int)
 #define FICLONERANGE	_IOW(0x94, 13, struct file_clone_range)
 #define FIDEDUPERANGE	_IOWR(0x94, 54, struct file_dedupe_range)
@@ -380,4 +381,57 @@ typedef int __bitwise __kernel_rwf_t;
 /* mask of flags supported by the kernel */
 #define RWF_SUPPORTED	(RWF_HIPRI | RWF_DSYNC | RWF_SYNC | RWF_NOWAIT)
 
+/*
+ * /proc/pid/pagemap ioctl: reports the runs of pages of a range whose
+ * categories match the masks of struct pm_scan_arg.
+ */
+#define PAGEMAP_SCAN	_IOWR('f', 16, struct pm_scan_arg)
+
+/* Page categories, in the masks and in page_region.categories */
+#define PAGE_IS_PRESENT		(1 << 0)
+#define PAGE_IS_SWAPPED		(1 << 1)
+#define PAGE_IS_FILE		(1 << 2)
+#define PAGE_IS_SOFT_DIRTY	(1 << 3)	/* written since last cleared */
+#define PAGE_IS_HUGE		(1 << 4)	/* mapped by a huge page */
+
+/* The pages of [start, end) have all the categories of @categories */
+struct page_region {
+	__u64 start;
+	__u64 end;
+	__u64 categories;
+};
+
+/* Clears the soft-dirty state of the reported pages in the same walk */
+#define PM_SCAN_CLEAR_SOFT_DIRTY	(1 << 0)
+
+/*
+ * @size:		sizeof(struct pm_scan_arg)
+ * @flags:		PM_SCAN_* flags
+ * @start, @end:	page aligned range to scan
+ * @walk_end:		set to the address where the scan stopped, which is
+ *			short of @end when @vec is full or @max_pages reached
+ * @vec, @vec_len:	user array of struct page_region filled in
+ * @max_pages:		maximum number of pages to report, or 0
+ * @category_inverted:	categories whose state is inverted before matching
+ * @category_mask:	categories all of which a page must have
+ * @category_anyof_mask: categories one of which a page must have, if any
+ * @return_mask:	categories reported in page_region.categories
+ *
+ * The ioctl returns the number of regions filled in @vec.
+ */
+struct pm_scan_arg {
+	__u64 size;
+	__u64 flags;
+	__u64 start;
+	__u64 end;
+	__u64 walk_end;
+	__u64 vec;
+	__u64 vec_len;
+	__u64 max_pages;
+	__u64 category_inverted;
+	__u64 category_mask;
+	__u64 category_anyof_mask;
+	__u64 return_mask;
+};
+
 #endif /* _UAPI_LINUX_FS_H */
@@ -21,6 +21,7 @@
 #define FUTEX_WAKE_BITSET	10
 #define FUTEX_WAIT_REQUEUE_PI	11
 #define FUTEX_CMP_REQUEUE_PI	12
+#define FUTEX_WAIT_MULTIPLE	13
 
 #define FUTEX_PRIVATE_FLAG	128
 #define FUTEX_CLOCK_REALTIME	256
@@ -40,6 +41,25 @@
 					 FUTEX_PRIVATE_FLAG)
 #define FUTEX_CMP_REQUEUE_PI_PRIVATE	(FUTEX_CMP_REQUEUE_PI | \
 					 FUTEX_PRIVATE_FLAG)
+#define FUTEX_WAIT_MULTIPLE_PRIVATE	(FUTEX_WAIT_MULTIPLE | \
+					 FUTEX_PRIVATE_FLAG)
+
+/*
+ * FUTEX_WAIT_MULTIPLE takes an array of up to FUTEX_WAIT_MULTIPLE_MAX of
+ * these in uaddr and their number in val. It blocks until one of the
+ * futexes is woken with a matching bitset, and returns its index. The
+ * timeout is absolute, as for FUTEX_WAIT_BITSET.
+ *
+ * NOTE: this structure is part of the syscall ABI, and must not be
+ * changed.
+ */
+struct futex_wait_block {
+	__u64 uaddr;
+	__u32 val;
+	__u32 bitset;
+};
+
+#define FUTEX_WAIT_MULTIPLE_MAX	128
 
 /*
  * Support for robust futexes: the kernel cleans up held futexes at
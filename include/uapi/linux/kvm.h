@@ -235,6 +235,7 @@ struct kvm_hyperv_exit {
 #define KVM_EXIT_S390_STSI        25
 #define KVM_EXIT_IOAPIC_EOI       26
 #define KVM_EXIT_HYPERV           27
+#define KVM_EXIT_DIRTY_RING_FULL  28
 
 /* For KVM_EXIT_INTERNAL_ERROR */
 /* Emulate instruction failed. */
@@ -435,6 +436,26 @@ struct kvm_coalesced_mmio_ring {
 	((PAGE_SIZE - sizeof(struct kvm_coalesced_mmio_ring)) / \
 	 sizeof(struct kvm_coalesced_mmio))
 
+/*
+ * Entry of the dirty ring of a vcpu, mapped at KVM_DIRTY_LOG_PAGE_OFFSET of
+ * the vcpu fd once enabled with KVM_CAP_DIRTY_LOG_RING.  KVM sets
+ * KVM_DIRTY_GFN_F_DIRTY after writing slot and offset; userspace sets
+ * KVM_DIRTY_GFN_F_RESET once it has collected the gfn, and the entry is
+ * reused after KVM_RESET_DIRTY_RINGS.
+ */
+#define KVM_DIRTY_GFN_F_DIRTY		(1 << 0)
+#define KVM_DIRTY_GFN_F_RESET		(1 << 1)
+
+struct kvm_dirty_gfn {
+	__u32 flags;
+	__u32 slot;	/* as_id << 16 | slot id */
+	__u64 offset;	/* in pages, from the start of the slot */
+};
+
+#ifndef KVM_DIRTY_LOG_PAGE_OFFSET
+#define KVM_DIRTY_LOG_PAGE_OFFSET 0
+#endif
+
 /* for KVM_TRANSLATE */
 struct kvm_translation {
 	/* in */
@@ -931,6 +952,7 @@ struct kvm_ppc_resize_hpt {
 #define KVM_CAP_PPC_SMT_POSSIBLE 147
 #define KVM_CAP_HYPERV_SYNIC2 148
 #define KVM_CAP_HYPERV_VP_INDEX 149
+#define KVM_CAP_DIRTY_LOG_RING 150
 
 #ifdef KVM_CAP_IRQ_ROUTING
 
@@ -1357,6 +1379,8 @@ struct kvm_s390_ucas_mapping {
 /* Available with KVM_CAP_S390_CMMA_MIGRATION */
 #define KVM_S390_GET_CMMA_BITS      _IOWR(KVMIO, 0xb8, struct kvm_s390_cmma_log)
 #define KVM_S390_SET_CMMA_BITS      _IOW(KVMIO, 0xb9, struct kvm_s390_cmma_log)
+/* Available with KVM_CAP_DIRTY_LOG_RING */
+#define KVM_RESET_DIRTY_RINGS       _IO(KVMIO, 0xba)
 
 #define KVM_DEV_ASSIGN_ENABLE_IOMMU	(1 << 0)
 #define KVM_DEV_ASSIGN_PCI_2_3		(1 << 1)
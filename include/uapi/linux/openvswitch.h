@@ -74,6 +74,9 @@ enum ovs_datapath_cmd {
  * datapath.  Always present in notifications.
  * @OVS_DP_ATTR_MEGAFLOW_STATS: Statistics about mega flow masks usage for the
  * datapath. Always present in notifications.
+ * @OVS_DP_ATTR_MASKS_CACHE_SIZE: Number of entries in the per-CPU cache that
+ * maps a packet's hash to its likely megaflow mask.  Must be a power of two;
+ * zero disables the cache.  Always present in notifications.
  *
  * These attributes follow the &struct ovs_header within the Generic Netlink
  * payload for %OVS_DP_* commands.
@@ -86,6 +89,7 @@ enum ovs_datapath_attr {
 	OVS_DP_ATTR_MEGAFLOW_STATS,	/* struct ovs_dp_megaflow_stats */
 	OVS_DP_ATTR_USER_FEATURES,	/* OVS_DP_F_*  */
 	OVS_DP_ATTR_PAD,
+	OVS_DP_ATTR_MASKS_CACHE_SIZE,	/* u32 mask cache entries */
 	__OVS_DP_ATTR_MAX
 };
 
@@ -102,7 +106,7 @@ struct ovs_dp_megaflow_stats {
 	__u64 n_mask_hit;	 /* Number of masks used for flow lookups. */
 	__u32 n_masks;		 /* Number of masks for the datapath. */
 	__u32 pad0;		 /* Pad for future expension. */
-	__u64 pad1;		 /* Pad for future expension. */
+	__u64 n_cache_hit;	 /* Number of cache matches for lookups. */
 	__u64 pad2;		 /* Pad for future expension. */
 };
 
@@ -371,6 +371,8 @@ enum {
 	TCA_HTB_RATE64,
 	TCA_HTB_CEIL64,
 	TCA_HTB_PAD,
+	TCA_HTB_OFFLOAD,	/* mqhtb root: rates enforced by the device */
+	TCA_HTB_TXQ,		/* mqhtb leaf class: TX queue it is pinned to */
 	__TCA_HTB_MAX,
 };
 
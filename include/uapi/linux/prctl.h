@@ -198,4 +198,22 @@ struct prctl_mm_map {
 # define PR_CAP_AMBIENT_LOWER		3
 # define PR_CAP_AMBIENT_CLEAR_ALL	4
 
+/*
+ * Control the size of the hash table for the private futexes of the
+ * process. It can only be set before the first private futex operation.
+ * Zero slots means the futexes share the global hash table.
+ */
+#define PR_FUTEX_HASH			48
+# define PR_FUTEX_HASH_SET_SLOTS	1
+# define PR_FUTEX_HASH_GET_SLOTS	2
+
+/*
+ * Allocate the file descriptors of the process without the lock of its fd
+ * table, from a slice of the table per CPU.  The lowest free fd is then not
+ * always returned.  Reset on execve().
+ */
+#define PR_FD_ALLOC			49
+# define PR_FD_ALLOC_SET_SCALABLE	1
+# define PR_FD_ALLOC_GET_SCALABLE	2
+
 #endif /* _LINUX_PRCTL_H */
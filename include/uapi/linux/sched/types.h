@@ -9,6 +9,7 @@ struct sched_param {
 };
 
 #define SCHED_ATTR_SIZE_VER0	48	/* sizeof first published struct */
+#define SCHED_ATTR_SIZE_VER1	56	/* add: latency_nice */
 
 /*
  * Extended scheduling parameters data structure.
@@ -45,6 +46,8 @@ struct sched_param {
  *  @sched_deadline	representative of the task's deadline
  *  @sched_runtime	representative of the task's runtime
  *  @sched_period	representative of the task's period
+ *  @sched_latency_nice	task's latency nice value (SCHED_NORMAL/BATCH),
+ *			set with SCHED_FLAG_LATENCY_NICE
  *
  * Given this task model, there are a multiplicity of scheduling algorithms
  * and policies, that can be used to ensure all the tasks will make their
@@ -70,6 +73,9 @@ struct sched_attr {
 	__u64 sched_runtime;
 	__u64 sched_deadline;
 	__u64 sched_period;
+
+	/* SCHED_NORMAL, SCHED_BATCH */
+	__s32 sched_latency_nice;
 };
 
 #endif /* _UAPI_LINUX_SCHED_TYPES_H */
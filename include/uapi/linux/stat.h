@@ -127,6 +127,28 @@ struct statx {
 	/* 0x100 */
 };
 
+/*
+ * Directory entry as returned by getdents_statx(), d_reclen bytes long.
+ * d_error is 0 if d_stx holds the attributes of the entry, else the -errno
+ * its lookup failed with, e.g. -ENOENT if it was removed meanwhile.
+ */
+struct linux_dirent_statx {
+	/* 0x00 */
+	__u64	d_ino;		/* Inode number, as in getdents64() */
+	__s64	d_off;		/* Offset of the next entry */
+	/* 0x10 */
+	__u16	d_reclen;	/* Length of this record */
+	__u16	d_namlen;	/* Length of d_name, but for the NUL */
+	__u8	d_type;		/* DT_* type of the entry */
+	__u8	__spare0[3];
+	__s32	d_error;	/* 0 or -errno for d_stx */
+	__u32	__spare1;
+	/* 0x20 */
+	struct statx d_stx;	/* As by statx(AT_SYMLINK_NOFOLLOW) */
+	/* 0x120 */
+	char	d_name[0];	/* NUL terminated name */
+};
+
 /*
  * Flags to be stx_mask
  *
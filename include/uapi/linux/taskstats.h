@@ -34,7 +34,7 @@
  */
 
 
-#define TASKSTATS_VERSION	8
+#define TASKSTATS_VERSION	9
 #define TS_COMM_LEN		32	/* should be >= TASK_COMM_LEN
 					 * in linux/sched.h */
 
@@ -164,6 +164,16 @@ struct taskstats {
 	/* Delay waiting for memory reclaim */
 	__u64	freepages_count;
 	__u64	freepages_delay_total;
+	/* version 8 ends here */
+
+	/* Scheduler and memory fields of a single task, 0 for a tgid */
+	__u32	ac_tgid;		/* Thread group ID */
+	__u32	ac_cpu;			/* CPU last run on */
+	__u64	ac_start_time;		/* Start time [nsec since boot] */
+	__u64	sum_exec_runtime;	/* CPU time [nsec] */
+	__u64	nr_migrations;		/* Migrations between CPUs */
+	__u64	rss;			/* Current RSS, in KB */
+	__u64	vm_size;		/* Current VM size, in KB */
 };
 
 
@@ -201,6 +211,8 @@ enum {
 	TASKSTATS_CMD_ATTR_TGID,
 	TASKSTATS_CMD_ATTR_REGISTER_CPUMASK,
 	TASKSTATS_CMD_ATTR_DEREGISTER_CPUMASK,
+	TASKSTATS_CMD_ATTR_CGROUP_FD,	/* dump filter: fd of a cgroup2 dir */
+	TASKSTATS_CMD_ATTR_PIDNS_FD,	/* dump filter: fd of a pid ns */
 	__TASKSTATS_CMD_ATTR_MAX,
 };
 
@@ -0,0 +1,97 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+/*
+ * Userspace block device driver over shared rings
+ *
+ * A daemon creates a device through /dev/ublk-control, attaches to it and
+ * maps, for each hardware queue, an area holding a ring header, the
+ * submission (SQ) and completion (CQ) rings and a data buffer per tag.  The
+ * kernel writes a descriptor in the SQ for each request, with the data of
+ * the writes already copied in the buffer of its tag.  The daemon posts
+ * completions in the CQ, which are reaped in batches by UBLK_IOC_ENTER.
+ */
+#ifndef _UAPI_LINUX_UBLK_H
+#define _UAPI_LINUX_UBLK_H
+
+#include <linux/types.h>
+
+#define UBLK_IOC_MAGIC		0xe4
+
+/* create a device, dev_id is UBLK_DEV_ID_ANY or the id wanted */
+#define UBLK_IOC_ADD_DEV	_IOWR(UBLK_IOC_MAGIC, 0, struct ublk_dev_info)
+/* delete device arg, which must have no daemon attached */
+#define UBLK_IOC_DEL_DEV	_IO(UBLK_IOC_MAGIC, 1)
+/* attach the file to device arg, it then maps the queue areas */
+#define UBLK_IOC_ATTACH		_IO(UBLK_IOC_MAGIC, 2)
+/* register the disk of the attached device, once the queues are served */
+#define UBLK_IOC_START		_IO(UBLK_IOC_MAGIC, 3)
+/*
+ * Reap the completions of queue arg, then wait for submissions: returns the
+ * number of SQ entries not consumed yet.
+ */
+#define UBLK_IOC_ENTER		_IO(UBLK_IOC_MAGIC, 4)
+
+#define UBLK_DEV_ID_ANY		((__u32)-1)
+
+/* ublk_dev_info->flags */
+#define UBLK_F_DISCARD		(1ULL << 0)	/* discard and write zeroes */
+#define UBLK_F_WRITE_CACHE	(1ULL << 1)	/* flush and FUA */
+#define UBLK_F_READ_ONLY	(1ULL << 2)
+
+struct ublk_dev_info {
+	__u32	dev_id;
+	__u16	nr_hw_queues;
+	__u16	queue_depth;
+	__u32	block_size;
+	__u32	max_io_bytes;		/* multiple of the page size */
+	__u64	dev_sectors;
+	__u64	flags;
+	__u32	recovery_timeout;	/* in s, 0 to wait for ever */
+
+	/* filled by UBLK_IOC_ADD_DEV, offsets in the area of a queue */
+	__u32	sq_offset;
+	__u32	cq_offset;
+	__u32	data_offset;
+	__u32	queue_map_size;
+	__u32	reserved[7];
+};
+
+/* the area of queue q is mapped at q << UBLK_QUEUE_OFFSET_SHIFT */
+#define UBLK_QUEUE_OFFSET_SHIFT	28
+
+/* header of the area of a queue */
+struct ublk_ring {
+	__u32	sq_head;		/* advanced by the daemon */
+	__u32	sq_tail;		/* advanced by the kernel */
+	__u32	cq_head;		/* advanced by the kernel */
+	__u32	cq_tail;		/* advanced by the daemon */
+	__u32	ring_entries;		/* power of two, for SQ and CQ */
+	__u32	reserved[11];
+};
+
+/* ublk_sqe->op */
+#define UBLK_OP_READ		0
+#define UBLK_OP_WRITE		1
+#define UBLK_OP_FLUSH		2
+#define UBLK_OP_DISCARD		3
+#define UBLK_OP_WRITE_ZEROES	4
+
+/* ublk_sqe->flags */
+#define UBLK_IO_F_FUA		(1U << 0)
+
+struct ublk_sqe {
+	__u8	op;
+	__u8	reserved;
+	__u16	tag;
+	__u32	flags;
+	__u64	sector;
+	__u32	nr_sectors;
+	__u32	buf_offset;		/* of the data, in the queue area */
+};
+
+struct ublk_cqe {
+	__u16	tag;
+	__u16	reserved;
+	__s32	result;			/* 0 or -errno */
+};
+
+#endif /* _UAPI_LINUX_UBLK_H */
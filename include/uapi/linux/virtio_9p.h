@@ -33,6 +33,11 @@
 
 /* The mount point is specified in a config variable */
 #define VIRTIO_9P_MOUNT_TAG 0
+/*
+ * The device has several request queues, their number is the __u16 right
+ * after the tag_len bytes of tag in the config space
+ */
+#define VIRTIO_9P_F_MQ 1
 
 struct virtio_9p_config {
 	/* length of the tag name */
@@ -306,6 +306,7 @@ enum xfrm_attr_type_t {
 	XFRMA_PAD,
 	XFRMA_OFFLOAD_DEV,	/* struct xfrm_state_offload */
 	XFRMA_OUTPUT_MARK,	/* __u32 */
+	XFRMA_SEQ_BATCH,	/* __u32 */
 	__XFRMA_MAX
 
 #define XFRMA_MAX (__XFRMA_MAX - 1)
@@ -384,6 +385,7 @@ struct xfrm_usersa_info {
 };
 
 #define XFRM_SA_XFLAG_DONT_ENCAP_DSCP	1
+#define XFRM_SA_XFLAG_PCRYPT		2
 
 struct xfrm_usersa_id {
 	xfrm_address_t			daddr;
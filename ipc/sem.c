@@ -140,6 +140,12 @@ static int sysvipc_sem_proc_show(struct seq_file *s, void *it);
 #define SEMMSL_FAST	256 /* 512 bytes on stack */
 #define SEMOPM_FAST	64  /* ~ 372 bytes on stack */
 
+/*
+ * Complex operations on up to that many semaphores first try to run under
+ * the per-semaphore locks, which each need their own lockdep subclass.
+ */
+#define SEMOPM_FINE	MAX_LOCKDEP_SUBCLASSES
+
 /*
  * Switching from the mode suitable for simple ops
  * to the mode for complex ops is costly. Therefore:
@@ -157,6 +163,9 @@ static int sysvipc_sem_proc_show(struct seq_file *s, void *it);
  *
  * b) global or semaphore sem_lock() for read/write:
  *	sem_array.sems[i].pending_{const,alter}:
+ *	A complex operation that doesn't sleep may hold the semaphore locks
+ *	of all the semaphores it operates on instead, taken in index order
+ *	by sem_lock_multi().
  *
  * c) special:
  *	sem_undo_list.list_proc:
@@ -410,6 +419,67 @@ static inline void sem_unlock(struct sem_array *sma, int locknum)
 	}
 }
 
+/*
+ * Collect the distinct semaphores of @sops in index order into @semnums,
+ * which must have room for @nsops entries.  Returns their number.
+ */
+static int sem_sort_semnums(const struct sembuf *sops, int nsops,
+			    unsigned short *semnums)
+{
+	int i, j, nr = 0;
+
+	for (i = 0; i < nsops; i++) {
+		unsigned short num = sops[i].sem_num;
+
+		for (j = nr; j > 0 && semnums[j - 1] > num; j--)
+			;
+		if (j > 0 && semnums[j - 1] == num)
+			continue;
+
+		memmove(&semnums[j + 1], &semnums[j],
+			(nr - j) * sizeof(*semnums));
+		semnums[j] = num;
+		nr++;
+	}
+	return nr;
+}
+
+static void sem_unlock_multi(struct sem_array *sma,
+			     const unsigned short *semnums, int nr)
+{
+	while (nr--)
+		spin_unlock(&sma->sems[semnums[nr]].lock);
+}
+
+/*
+ * Lock the semaphores @semnums, sorted and without duplicates, for a
+ * complex operation.  Like the fast path of sem_lock(), this only
+ * succeeds if no complex operation is sleeping, so that all pending
+ * operations that may be affected are on the per-semaphore queues of
+ * @semnums.  Taking the locks in index order keeps concurrent callers
+ * from deadlocking, complexmode_enter() waits for them like for simple
+ * operations.
+ */
+static bool sem_lock_multi(struct sem_array *sma,
+			   const unsigned short *semnums, int nr)
+{
+	int i;
+
+	/* Same unlocked check as in sem_lock(), just an optimization. */
+	if (sma->use_global_lock)
+		return false;
+
+	for (i = 0; i < nr; i++)
+		spin_lock_nested(&sma->sems[semnums[i]].lock, i);
+
+	/* pairs with smp_store_release() */
+	if (!smp_load_acquire(&sma->use_global_lock))
+		return true;
+
+	sem_unlock_multi(sma, semnums, nr);
+	return false;
+}
+
 /*
  * sem_lock_(check_) routines are called in the paths where the rwsem
  * is not held.
@@ -1857,6 +1927,47 @@ static struct sem_undo *find_alloc_undo(struct ipc_namespace *ns, int semid)
 	return un;
 }
 
+/*
+ * Try to perform the complex operation @q under the locks of the
+ * semaphores it operates on, so that operations on unrelated semaphores
+ * of the array don't contend on the global lock.
+ *
+ * Returns 1 if the operation has to sleep or the array is in global lock
+ * mode: the caller then retries under the global lock, which is needed to
+ * queue @q.  Otherwise returns the result of the operation, the tasks to
+ * wake up are added to @wake_q.
+ */
+static int perform_complex_semop_fine(struct sem_array *sma,
+				      struct sem_queue *q,
+				      struct wake_q_head *wake_q)
+{
+	unsigned short semnums[SEMOPM_FINE];
+	int nr, error;
+
+	nr = sem_sort_semnums(q->sops, q->nsops, semnums);
+	if (!sem_lock_multi(sma, semnums, nr))
+		return 1;
+
+	/* see do_semtimedop() */
+	error = -EIDRM;
+	if (!ipc_valid_object(&sma->sem_perm))
+		goto out_unlock;
+	if (q->undo && q->undo->semid == -1)
+		goto out_unlock;
+
+	error = perform_atomic_semop(sma, q);
+	if (error == 0) {
+		if (q->alter)
+			do_smart_update(sma, q->sops, q->nsops, 1, wake_q);
+		else
+			set_semotime(sma, q->sops);
+	}
+
+out_unlock:
+	sem_unlock_multi(sma, semnums, nr);
+	return error;
+}
+
 static long do_semtimedop(int semid, struct sembuf __user *tsops,
 		unsigned nsops, const struct timespec64 *timeout)
 {
@@ -1957,6 +2068,24 @@ static long do_semtimedop(int semid, struct sembuf __user *tsops,
 		goto out_free;
 	}
 
+	queue.sops = sops;
+	queue.nsops = nsops;
+	queue.undo = un;
+	queue.pid = task_tgid_vnr(current);
+	queue.alter = alter;
+	queue.dupsop = dupsop;
+
+	if (nsops > 1 && nsops <= SEMOPM_FINE) {
+		DEFINE_WAKE_Q(wake_q);
+
+		error = perform_complex_semop_fine(sma, &queue, &wake_q);
+		if (error <= 0) {
+			rcu_read_unlock();
+			wake_up_q(&wake_q);
+			goto out_free;
+		}
+	}
+
 	error = -EIDRM;
 	locknum = sem_lock(sma, sops, nsops);
 	/*
@@ -1979,13 +2108,6 @@ static long do_semtimedop(int semid, struct sembuf __user *tsops,
 	if (un && un->semid == -1)
 		goto out_unlock_free;
 
-	queue.sops = sops;
-	queue.nsops = nsops;
-	queue.undo = un;
-	queue.pid = task_tgid_vnr(current);
-	queue.alter = alter;
-	queue.dupsop = dupsop;
-
 	error = perform_atomic_semop(sma, &queue);
 	if (error == 0) { /* non-blocking succesfull path */
 		DEFINE_WAKE_Q(wake_q);
@@ -299,6 +299,8 @@ const struct bpf_map_ops array_map_ops = {
 	.map_update_elem = array_map_update_elem,
 	.map_delete_elem = array_map_delete_elem,
 	.map_gen_lookup = array_map_gen_lookup,
+	.map_lookup_batch = generic_map_lookup_batch,
+	.map_update_batch = generic_map_update_batch,
 };
 
 const struct bpf_map_ops percpu_array_map_ops = {
@@ -308,6 +310,8 @@ const struct bpf_map_ops percpu_array_map_ops = {
 	.map_lookup_elem = percpu_array_map_lookup_elem,
 	.map_update_elem = array_map_update_elem,
 	.map_delete_elem = array_map_delete_elem,
+	.map_lookup_batch = generic_map_lookup_batch,
+	.map_update_batch = generic_map_update_batch,
 };
 
 static struct bpf_map *fd_array_map_alloc(union bpf_attr *attr)
@@ -376,7 +380,14 @@ int bpf_fd_array_map_update_elem(struct bpf_map *map, struct file *map_file,
 	if (IS_ERR(new_ptr))
 		return PTR_ERR(new_ptr);
 
-	old_ptr = xchg(array->ptrs + index, new_ptr);
+	if (map->ops->map_poke_run) {
+		mutex_lock(&array->poke_mutex);
+		old_ptr = xchg(array->ptrs + index, new_ptr);
+		map->ops->map_poke_run(map, index, old_ptr, new_ptr);
+		mutex_unlock(&array->poke_mutex);
+	} else {
+		old_ptr = xchg(array->ptrs + index, new_ptr);
+	}
 	if (old_ptr)
 		map->ops->map_fd_put_ptr(old_ptr);
 
@@ -392,7 +403,14 @@ static int fd_array_map_delete_elem(struct bpf_map *map, void *key)
 	if (index >= array->map.max_entries)
 		return -E2BIG;
 
-	old_ptr = xchg(array->ptrs + index, NULL);
+	if (map->ops->map_poke_run) {
+		mutex_lock(&array->poke_mutex);
+		old_ptr = xchg(array->ptrs + index, NULL);
+		map->ops->map_poke_run(map, index, old_ptr, NULL);
+		mutex_unlock(&array->poke_mutex);
+	} else {
+		old_ptr = xchg(array->ptrs + index, NULL);
+	}
 	if (old_ptr) {
 		map->ops->map_fd_put_ptr(old_ptr);
 		return 0;
@@ -438,15 +456,129 @@ void bpf_fd_array_map_clear(struct bpf_map *map)
 		fd_array_map_delete_elem(map, &i);
 }
 
+static struct bpf_map *prog_array_map_alloc(union bpf_attr *attr)
+{
+	struct bpf_array *array;
+	struct bpf_map *map;
+
+	map = fd_array_map_alloc(attr);
+	if (IS_ERR(map))
+		return map;
+
+	array = container_of(map, struct bpf_array, map);
+	INIT_LIST_HEAD(&array->poke_progs);
+	mutex_init(&array->poke_mutex);
+	return map;
+}
+
+static void prog_array_map_free(struct bpf_map *map)
+{
+	struct bpf_array *array = container_of(map, struct bpf_array, map);
+
+	/* every program holds a reference on the maps it tail calls into */
+	WARN_ON_ONCE(!list_empty(&array->poke_progs));
+	fd_array_map_free(map);
+}
+
+struct prog_poke_elem {
+	struct list_head list;
+	struct bpf_prog_aux *aux;
+};
+
+/* Called by the verifier for every program with direct tail calls into map */
+static int prog_array_map_poke_track(struct bpf_map *map,
+				     struct bpf_prog_aux *prog_aux)
+{
+	struct bpf_array *array = container_of(map, struct bpf_array, map);
+	struct prog_poke_elem *elem;
+	int ret = 0;
+
+	mutex_lock(&array->poke_mutex);
+	list_for_each_entry(elem, &array->poke_progs, list) {
+		if (elem->aux == prog_aux)
+			goto out;
+	}
+
+	elem = kmalloc(sizeof(*elem), GFP_KERNEL);
+	if (!elem) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	INIT_LIST_HEAD(&elem->list);
+	elem->aux = prog_aux;
+	list_add_tail(&elem->list, &array->poke_progs);
+out:
+	mutex_unlock(&array->poke_mutex);
+	return ret;
+}
+
+static void prog_array_map_poke_untrack(struct bpf_map *map,
+					struct bpf_prog_aux *prog_aux)
+{
+	struct bpf_array *array = container_of(map, struct bpf_array, map);
+	struct prog_poke_elem *elem, *tmp;
+
+	mutex_lock(&array->poke_mutex);
+	list_for_each_entry_safe(elem, tmp, &array->poke_progs, list) {
+		if (elem->aux == prog_aux) {
+			list_del_init(&elem->list);
+			kfree(elem);
+			break;
+		}
+	}
+	mutex_unlock(&array->poke_mutex);
+}
+
+/* Retarget the direct tail calls into slot key, under poke_mutex */
+static void prog_array_map_poke_run(struct bpf_map *map, u32 key,
+				    struct bpf_prog *old,
+				    struct bpf_prog *new)
+{
+	struct bpf_array *array = container_of(map, struct bpf_array, map);
+	struct bpf_jit_poke_descriptor *poke;
+	struct prog_poke_elem *elem;
+	struct bpf_prog_aux *aux;
+	u8 *old_addr, *new_addr;
+	int i, ret;
+
+	WARN_ON_ONCE(!mutex_is_locked(&array->poke_mutex));
+
+	list_for_each_entry(elem, &array->poke_progs, list) {
+		aux = elem->aux;
+		for (i = 0; i < aux->size_poke_tab; i++) {
+			poke = &aux->poke_tab[i];
+
+			/* The programs still being JITed find the slot in
+			 * its new state once they take poke_mutex.
+			 */
+			if (!poke->ip_stable ||
+			    poke->tail_call.map != map ||
+			    poke->tail_call.key != key)
+				continue;
+
+			old_addr = old ? (u8 *)old->bpf_func + poke->adj_off :
+					 NULL;
+			new_addr = new ? (u8 *)new->bpf_func + poke->adj_off :
+					 NULL;
+			ret = bpf_arch_text_poke(poke->ip, old_addr, new_addr);
+			BUG_ON(ret < 0);
+		}
+	}
+}
+
 const struct bpf_map_ops prog_array_map_ops = {
-	.map_alloc = fd_array_map_alloc,
-	.map_free = fd_array_map_free,
+	.map_alloc = prog_array_map_alloc,
+	.map_free = prog_array_map_free,
 	.map_get_next_key = array_map_get_next_key,
 	.map_lookup_elem = fd_array_map_lookup_elem,
 	.map_delete_elem = fd_array_map_delete_elem,
 	.map_fd_get_ptr = prog_fd_array_get_ptr,
 	.map_fd_put_ptr = prog_fd_array_put_ptr,
 	.map_fd_sys_lookup_elem = prog_fd_array_sys_lookup_elem,
+	.map_poke_track = prog_array_map_poke_track,
+	.map_poke_untrack = prog_array_map_poke_untrack,
+	.map_poke_run = prog_array_map_poke_run,
 };
 
 static struct bpf_event_entry *bpf_event_entry_gen(struct file *perf_file,
@@ -1381,11 +1381,40 @@ struct bpf_prog *bpf_prog_select_runtime(struct bpf_prog *fp, int *err)
 }
 EXPORT_SYMBOL_GPL(bpf_prog_select_runtime);
 
+/**
+ * bpf_jit_add_poke_descriptor - record a tail call to JIT as a direct jump
+ * @prog: program being verified
+ * @poke: tail call into a constant slot of a prog_array
+ *
+ * Returns the index of the descriptor in the poke_tab of @prog or a
+ * negative errno.
+ */
+int bpf_jit_add_poke_descriptor(struct bpf_prog *prog,
+				const struct bpf_jit_poke_descriptor *poke)
+{
+	struct bpf_jit_poke_descriptor *tab = prog->aux->poke_tab;
+	static const u32 poke_tab_max = 1024;
+	u32 slot = prog->aux->size_poke_tab;
+
+	if (slot >= poke_tab_max)
+		return -ENOSPC;
+
+	tab = krealloc(tab, (slot + 1) * sizeof(*poke), GFP_KERNEL);
+	if (!tab)
+		return -ENOMEM;
+
+	tab[slot] = *poke;
+	prog->aux->poke_tab = tab;
+	prog->aux->size_poke_tab = slot + 1;
+	return slot;
+}
+
 static void bpf_prog_free_deferred(struct work_struct *work)
 {
 	struct bpf_prog_aux *aux;
 
 	aux = container_of(work, struct bpf_prog_aux, work);
+	kfree(aux->poke_tab);
 	bpf_jit_free(aux->prog);
 }
 
@@ -1439,6 +1468,14 @@ const struct bpf_func_proto bpf_get_current_pid_tgid_proto __weak;
 const struct bpf_func_proto bpf_get_current_uid_gid_proto __weak;
 const struct bpf_func_proto bpf_get_current_comm_proto __weak;
 const struct bpf_func_proto bpf_sock_map_update_proto __weak;
+const struct bpf_func_proto bpf_ringbuf_output_proto __weak;
+const struct bpf_func_proto bpf_ringbuf_query_proto __weak;
+const struct bpf_func_proto bpf_sk_storage_get_proto __weak;
+const struct bpf_func_proto bpf_sk_storage_delete_proto __weak;
+const struct bpf_func_proto bpf_skb_sk_storage_get_proto __weak;
+const struct bpf_func_proto bpf_skb_sk_storage_delete_proto __weak;
+const struct bpf_func_proto bpf_sock_ops_sk_storage_get_proto __weak;
+const struct bpf_func_proto bpf_sock_ops_sk_storage_delete_proto __weak;
 
 const struct bpf_func_proto * __weak bpf_get_trace_printk_proto(void)
 {
@@ -1478,6 +1515,12 @@ void __weak bpf_jit_compile(struct bpf_prog *prog)
 {
 }
 
+/* Stub for JITs that do not JIT tail calls into patchable direct jumps */
+int __weak bpf_arch_text_poke(void *ip, void *old_addr, void *new_addr)
+{
+	return -ENOTSUPP;
+}
+
 bool __weak bpf_helper_changes_pkt_data(void *func)
 {
 	return false;
@@ -20,6 +20,12 @@
  * no BPF programs are attached the sock object may only be used for sock
  * redirect.
  *
+ * On the send side a msg program may be attached as well. It runs on the
+ * data of every sendmsg/sendpage call of the sock and may pass, drop or
+ * redirect it to the egress or ingress of another sock in the map. To
+ * this end socks in a map have their proto ops replaced, see
+ * bpf_tcp_init().
+ *
  * A sock object may be in multiple maps, but can only inherit a single
  * parse or verdict program. If adding a sock object to a map would result
  * in having multiple parsing programs the update will return an EBUSY error.
@@ -38,12 +44,15 @@
 #include <linux/skbuff.h>
 #include <linux/workqueue.h>
 #include <linux/list.h>
+#include <linux/uio.h>
 #include <net/strparser.h>
 #include <net/tcp.h>
+#include <net/inet_common.h>
 
 struct bpf_stab {
 	struct bpf_map map;
 	struct sock **sock_map;
+	struct bpf_prog *bpf_tx_msg;
 	struct bpf_prog *bpf_parse;
 	struct bpf_prog *bpf_verdict;
 };
@@ -59,8 +68,8 @@ struct smap_psock_map_entry {
 
 struct smap_psock {
 	struct rcu_head	rcu;
-	/* refcnt is used inside sk_callback_lock */
-	u32 refcnt;
+	/* refcnt is dropped to zero inside sk_callback_lock only */
+	refcount_t refcnt;
 
 	/* datapath variables */
 	struct sk_buff_head rxqueue;
@@ -71,7 +80,17 @@ struct smap_psock {
 	int save_off;
 	struct sk_buff *save_skb;
 
+	/* datapath variables for the msg program, under lock_sock */
+	struct sock *sk_redir;
+	bool redir_ingress;
+	int eval;
+	u32 apply_bytes;
+	u32 cork_bytes;
+	struct sk_msg_buff *cork;
+	struct list_head ingress;
+
 	struct strparser strp;
+	struct bpf_prog *bpf_tx_msg;
 	struct bpf_prog *bpf_parse;
 	struct bpf_prog *bpf_verdict;
 	struct list_head maps;
@@ -83,6 +102,8 @@ struct smap_psock {
 	struct work_struct tx_work;
 	struct work_struct gc_work;
 
+	struct proto *sk_proto;
+	void (*save_close)(struct sock *sk, long timeout);
 	void (*save_data_ready)(struct sock *sk);
 	void (*save_write_space)(struct sock *sk);
 	void (*save_state_change)(struct sock *sk);
@@ -105,6 +126,7 @@ enum __sk_action {
 	__SK_DROP = 0,
 	__SK_PASS,
 	__SK_REDIRECT,
+	__SK_NONE,
 };
 
 static int smap_verdict_func(struct smap_psock *psock, struct sk_buff *skb)
@@ -173,6 +195,717 @@ static void smap_report_sk_error(struct smap_psock *psock, int err)
 
 static void smap_release_sock(struct smap_psock *psock, struct sock *sock);
 
+/* Drop a reference taken by the data path with refcount_inc_not_zero() */
+static void smap_psock_put(struct smap_psock *psock, struct sock *sk)
+{
+	if (refcount_dec_not_one(&psock->refcnt))
+		return;
+
+	write_lock_bh(&sk->sk_callback_lock);
+	smap_release_sock(psock, sk);
+	write_unlock_bh(&sk->sk_callback_lock);
+}
+
+static struct smap_psock *smap_psock_get(struct sock *sk)
+{
+	struct smap_psock *psock;
+
+	rcu_read_lock();
+	psock = smap_psock_sk(sk);
+	if (psock && !refcount_inc_not_zero(&psock->refcnt))
+		psock = NULL;
+	rcu_read_unlock();
+
+	return psock;
+}
+
+/* Remove the first len bytes of m, len must not exceed sg_data[0]. */
+static void smap_msg_trim_front(struct sk_msg_buff *m, u32 len)
+{
+	struct scatterlist *sge = &m->sg_data[0];
+
+	if (!m->sg_copy[0] && m->sk)
+		sk_mem_uncharge(m->sk, len);
+	sge->offset += len;
+	sge->length -= len;
+	m->sg_size -= len;
+
+	if (sge->length)
+		return;
+
+	put_page(sg_page(sge));
+	m->sg_end--;
+	memmove(&m->sg_data[0], &m->sg_data[1],
+		m->sg_end * sizeof(struct scatterlist));
+	memmove(&m->sg_copy[0], &m->sg_copy[1], m->sg_end * sizeof(bool));
+}
+
+static void smap_msg_free_bytes(struct sk_msg_buff *m, u32 len)
+{
+	while (len && m->sg_end) {
+		u32 size = min_t(u32, len, m->sg_data[0].length);
+
+		smap_msg_trim_front(m, size);
+		len -= size;
+	}
+}
+
+static void smap_msg_free(struct sk_msg_buff *m)
+{
+	smap_msg_free_bytes(m, m->sg_size);
+}
+
+/* Move the first len bytes of from into the empty to. The bytes are no
+ * longer charged to any sock afterwards.
+ */
+static void smap_msg_split(struct sk_msg_buff *from, struct sk_msg_buff *to,
+			   u32 len)
+{
+	while (len && from->sg_end) {
+		struct scatterlist *sge = &from->sg_data[0];
+		u32 size = min_t(u32, len, sge->length);
+
+		get_page(sg_page(sge));
+		sg_set_page(&to->sg_data[to->sg_end], sg_page(sge),
+			    size, sge->offset);
+		to->sg_copy[to->sg_end++] = from->sg_copy[0];
+		to->sg_size += size;
+
+		smap_msg_trim_front(from, size);
+		len -= size;
+	}
+}
+
+static u32 smap_msg_private_bytes(const struct sk_msg_buff *m)
+{
+	u32 bytes = 0;
+	int i;
+
+	for (i = 0; i < m->sg_end; i++)
+		if (!m->sg_copy[i])
+			bytes += m->sg_data[i].length;
+	return bytes;
+}
+
+/* Copy up to len bytes from the iterator into page frags of sk appended
+ * to m. Returns -ENOSPC once m has no free scatterlist element left.
+ */
+static int smap_msg_fill(struct sock *sk, struct sk_msg_buff *m,
+			 struct iov_iter *from, int len, int *copied)
+{
+	struct page_frag *pfrag = sk_page_frag(sk);
+
+	while (len > 0) {
+		struct scatterlist *sge = NULL;
+		bool merge;
+		int use;
+
+		if (!sk_page_frag_refill(sk, pfrag))
+			return -ENOMEM;
+
+		use = min_t(int, len, pfrag->size - pfrag->offset);
+		if (!sk_wmem_schedule(sk, use))
+			return -ENOMEM;
+
+		if (m->sg_end)
+			sge = &m->sg_data[m->sg_end - 1];
+		merge = sge && !m->sg_copy[m->sg_end - 1] &&
+			sg_page(sge) == pfrag->page &&
+			sge->offset + sge->length == pfrag->offset;
+		if (!merge && m->sg_end == MAX_SKB_FRAGS)
+			return -ENOSPC;
+
+		if (!copy_from_iter_full(page_address(pfrag->page) +
+					 pfrag->offset, use, from))
+			return -EFAULT;
+
+		if (!merge) {
+			sge = &m->sg_data[m->sg_end];
+			sg_set_page(sge, pfrag->page, 0, pfrag->offset);
+			get_page(pfrag->page);
+			m->sg_copy[m->sg_end++] = false;
+		}
+
+		sk_mem_charge(sk, use);
+		m->sk = sk;
+		sge->length += use;
+		m->sg_size += use;
+		pfrag->offset += use;
+		*copied += use;
+		len -= use;
+	}
+
+	return 0;
+}
+
+/* Called with lock_sock(sk) held */
+static int bpf_tcp_push(struct sock *sk, struct sk_msg_buff *m, u32 send,
+			int flags)
+{
+	while (send && m->sg_end) {
+		struct scatterlist *sge = &m->sg_data[0];
+		u32 size = min_t(u32, send, sge->length);
+		int ret;
+
+		tcp_rate_check_app_limited(sk);
+		ret = do_tcp_sendpages(sk, sg_page(sge), sge->offset, size,
+				       size < send ?
+				       flags | MSG_SENDPAGE_NOTLAST : flags);
+		if (ret < 0)
+			return ret;
+
+		smap_msg_trim_front(m, ret);
+		send -= ret;
+	}
+
+	return 0;
+}
+
+static void smap_wake_ingress(struct sock *sk)
+{
+	struct socket_wq *wq;
+
+	rcu_read_lock();
+	wq = rcu_dereference(sk->sk_wq);
+	if (skwq_has_sleeper(wq))
+		wake_up_interruptible_sync_poll(&wq->wait, POLLIN |
+						POLLRDNORM | POLLRDBAND);
+	sk_wake_async(sk, SOCK_WAKE_WAITD, POLL_IN);
+	rcu_read_unlock();
+}
+
+/* Queue rm for reading on sk, which takes over its pages. */
+static int bpf_tcp_ingress(struct sock *sk, struct sk_msg_buff *rm)
+{
+	struct smap_psock *psock;
+	u32 charge;
+	int err = 0;
+
+	psock = smap_psock_get(sk);
+	if (unlikely(!psock))
+		return -EPIPE;
+
+	lock_sock(sk);
+	charge = smap_msg_private_bytes(rm);
+	if (unlikely(sock_flag(sk, SOCK_DEAD) ||
+		     sk->sk_shutdown & RCV_SHUTDOWN)) {
+		err = -EPIPE;
+	} else if (!sk_wmem_schedule(sk, charge)) {
+		err = -ENOMEM;
+	} else {
+		sk_mem_charge(sk, charge);
+		rm->sk = sk;
+		list_add_tail(&rm->list, &psock->ingress);
+		smap_wake_ingress(sk);
+	}
+	release_sock(sk);
+
+	smap_psock_put(psock, sk);
+	return err;
+}
+
+/* Called with lock_sock(sk) held, which is dropped while the data is
+ * handed to the redirect target.
+ */
+static int bpf_tcp_sendmsg_do_redirect(struct sock *sk,
+				       struct smap_psock *psock,
+				       struct sk_msg_buff *m, u32 send,
+				       int flags)
+{
+	struct sock *redir = psock->sk_redir;
+	bool ingress = psock->redir_ingress;
+	struct sk_msg_buff *rm;
+	int err;
+
+	rm = kzalloc(sizeof(*rm), __GFP_NOWARN | GFP_KERNEL);
+	if (unlikely(!rm)) {
+		smap_msg_free_bytes(m, send);
+		return -ENOMEM;
+	}
+	smap_msg_split(m, rm, send);
+
+	sock_hold(redir);
+	release_sock(sk);
+
+	if (ingress) {
+		err = bpf_tcp_ingress(redir, rm);
+	} else {
+		lock_sock(redir);
+		err = sock_flag(redir, SOCK_DEAD) ? -EPIPE :
+			bpf_tcp_push(redir, rm, rm->sg_size, flags);
+		release_sock(redir);
+	}
+
+	if (!ingress || err) {
+		smap_msg_free(rm);
+		kfree(rm);
+	}
+	sock_put(redir);
+
+	lock_sock(sk);
+	return err;
+}
+
+static void smap_reset_verdict(struct smap_psock *psock)
+{
+	psock->eval = __SK_NONE;
+	psock->apply_bytes = 0;
+	if (psock->sk_redir) {
+		sock_put(psock->sk_redir);
+		psock->sk_redir = NULL;
+	}
+}
+
+static int smap_do_tx_msg(struct sock *sk, struct smap_psock *psock,
+			  struct sk_msg_buff *md)
+{
+	struct bpf_prog *prog;
+	int rc;
+
+	preempt_disable();
+	rcu_read_lock();
+	prog = READ_ONCE(psock->bpf_tx_msg);
+	if (unlikely(!prog)) {
+		rc = __SK_PASS;
+		goto verdict;
+	}
+
+	sk_msg_compute_data_pointers(md);
+	md->map = NULL;
+	rc = (*prog->bpf_func)(md, prog->insnsi);
+
+	/* Moving return codes from UAPI namespace into internal namespace */
+	rc = rc == SK_PASS ? (md->map ? __SK_REDIRECT : __SK_PASS) : __SK_DROP;
+	if (rc == __SK_REDIRECT) {
+		if (psock->sk_redir)
+			sock_put(psock->sk_redir);
+		psock->sk_redir = do_msg_redirect_map(md);
+		if (!psock->sk_redir) {
+			rc = __SK_DROP;
+			goto verdict;
+		}
+		sock_hold(psock->sk_redir);
+		psock->redir_ingress = md->flags & BPF_F_INGRESS;
+	}
+verdict:
+	rcu_read_unlock();
+	preempt_enable();
+
+	return rc;
+}
+
+/* Run the msg program on m unless a previous verdict still applies, and
+ * act on it. Called with lock_sock(sk) held. Data the program wants to
+ * cork is moved to psock->cork, unless full says m can not grow.
+ */
+static int bpf_exec_tx_verdict(struct smap_psock *psock,
+			       struct sk_msg_buff *m, struct sock *sk,
+			       int *copied, int flags, bool full)
+{
+	int err = 0;
+
+	while (m->sg_size) {
+		u32 send;
+
+		if (psock->eval == __SK_NONE) {
+			psock->eval = smap_do_tx_msg(sk, psock, m);
+
+			if (m->cork_bytes > m->sg_size && !full) {
+				psock->cork_bytes = m->cork_bytes - m->sg_size;
+				m->cork_bytes = 0;
+				smap_reset_verdict(psock);
+				if (m != psock->cork) {
+					psock->cork = kmemdup(m, sizeof(*m),
+							      __GFP_NOWARN |
+							      GFP_KERNEL);
+					if (unlikely(!psock->cork))
+						return -ENOMEM;
+					m->sg_end = 0;
+					m->sg_size = 0;
+				}
+				return 0;
+			}
+			m->cork_bytes = 0;
+			psock->apply_bytes = m->apply_bytes;
+			m->apply_bytes = 0;
+		}
+
+		send = m->sg_size;
+		if (psock->apply_bytes && psock->apply_bytes < send)
+			send = psock->apply_bytes;
+
+		switch (psock->eval) {
+		case __SK_PASS:
+			err = bpf_tcp_push(sk, m, send, flags);
+			break;
+		case __SK_REDIRECT:
+			err = bpf_tcp_sendmsg_do_redirect(sk, psock, m, send,
+							  flags);
+			break;
+		case __SK_DROP:
+		default:
+			smap_msg_free_bytes(m, send);
+			*copied -= send;
+			err = -EACCES;
+			break;
+		}
+
+		if (psock->apply_bytes)
+			psock->apply_bytes -= send;
+		if (!psock->apply_bytes)
+			smap_reset_verdict(psock);
+		if (err)
+			break;
+	}
+
+	if (m == psock->cork && !m->sg_size) {
+		kfree(psock->cork);
+		psock->cork = NULL;
+	}
+	return err;
+}
+
+static bool smap_tx_msg_idle(const struct smap_psock *psock)
+{
+	return !READ_ONCE(psock->bpf_tx_msg) && !psock->cork &&
+	       psock->eval == __SK_NONE;
+}
+
+static int bpf_tcp_sendmsg(struct sock *sk, struct msghdr *msg, size_t size)
+{
+	int flags = msg->msg_flags;
+	struct sk_msg_buff md = {0};
+	struct smap_psock *psock;
+	int copied = 0, err = 0;
+	long timeo;
+
+	psock = smap_psock_get(sk);
+	if (unlikely(!psock))
+		return tcp_sendmsg(sk, msg, size);
+
+	lock_sock(sk);
+	if (smap_tx_msg_idle(psock)) {
+		err = tcp_sendmsg_locked(sk, msg, size);
+		goto out;
+	}
+
+	timeo = sock_sndtimeo(sk, msg->msg_flags & MSG_DONTWAIT);
+	while (msg_data_left(msg)) {
+		struct sk_msg_buff *m = psock->cork ? : &md;
+		int fill, added = 0;
+
+		if (sk->sk_err) {
+			err = -sk->sk_err;
+			goto out_err;
+		}
+
+		if (!sk_stream_memory_free(sk))
+			goto wait_for_sndbuf;
+
+		fill = smap_msg_fill(sk, m, &msg->msg_iter,
+				     msg_data_left(msg), &added);
+		copied += added;
+		if (fill && fill != -ENOSPC && fill != -ENOMEM) {
+			err = fill;
+			break;
+		}
+
+		if (psock->cork_bytes && fill != -ENOSPC) {
+			if (added < psock->cork_bytes) {
+				psock->cork_bytes -= added;
+				if (fill == -ENOMEM)
+					goto wait_for_memory;
+				continue;
+			}
+			psock->cork_bytes = 0;
+		}
+
+		err = bpf_exec_tx_verdict(psock, m, sk, &copied, flags,
+					  fill == -ENOSPC);
+		if (unlikely(err < 0))
+			goto out_err;
+		if (fill != -ENOMEM)
+			continue;
+		goto wait_for_memory;
+wait_for_sndbuf:
+		set_bit(SOCK_NOSPACE, &sk->sk_socket->flags);
+wait_for_memory:
+		err = sk_stream_wait_memory(sk, &timeo);
+		if (err)
+			goto out_err;
+	}
+out_err:
+	/* Whatever is left in md has been copied but not acted upon. */
+	copied -= md.sg_size;
+	smap_msg_free(&md);
+	if (err < 0)
+		err = sk_stream_error(sk, msg->msg_flags, err);
+	err = copied ? copied : err;
+out:
+	release_sock(sk);
+	smap_psock_put(psock, sk);
+	return err;
+}
+
+static int bpf_tcp_sendpage(struct sock *sk, struct page *page,
+			    int offset, size_t size, int flags)
+{
+	struct sk_msg_buff md = {0}, *m;
+	struct smap_psock *psock;
+	int err = 0, copied = 0;
+
+	psock = smap_psock_get(sk);
+	if (unlikely(!psock))
+		return tcp_sendpage(sk, page, offset, size, flags);
+
+	lock_sock(sk);
+	if (smap_tx_msg_idle(psock)) {
+		err = tcp_sendpage_locked(sk, page, offset, size, flags);
+		goto out;
+	}
+
+	m = psock->cork ? : &md;
+	if (m->sg_end == MAX_SKB_FRAGS) {
+		psock->cork_bytes = 0;
+		err = bpf_exec_tx_verdict(psock, m, sk, &copied, flags, true);
+		if (err)
+			goto out_err;
+		m = &md;
+	}
+
+	/* The page stays owned by the caller, the program does not get
+	 * to write to it without bpf_msg_pull_data() copying it first.
+	 */
+	get_page(page);
+	sg_set_page(&m->sg_data[m->sg_end], page, size, offset);
+	m->sg_copy[m->sg_end++] = true;
+	m->sg_size += size;
+
+	if (psock->cork_bytes) {
+		if (size < psock->cork_bytes) {
+			psock->cork_bytes -= size;
+			if (m == psock->cork)
+				goto out_err;
+			/* Start corking with this page */
+			psock->cork = kmemdup(m, sizeof(*m),
+					      __GFP_NOWARN | GFP_KERNEL);
+			if (psock->cork) {
+				md.sg_end = 0;
+				md.sg_size = 0;
+				goto out_err;
+			}
+		}
+		psock->cork_bytes = 0;
+	}
+
+	err = bpf_exec_tx_verdict(psock, m, sk, &copied, flags,
+				  m->sg_end == MAX_SKB_FRAGS);
+out_err:
+	smap_msg_free(&md);
+	err = err < 0 ? err : size;
+out:
+	release_sock(sk);
+	smap_psock_put(psock, sk);
+	return err;
+}
+
+/* Copy data redirected to the ingress of sk to the iterator. Called with
+ * lock_sock(sk) held.
+ */
+static int smap_ingress_copy(struct smap_psock *psock, struct iov_iter *to,
+			     size_t len, int flags)
+{
+	struct sk_msg_buff *md, *tmp;
+	int copied = 0;
+
+	list_for_each_entry_safe(md, tmp, &psock->ingress, list) {
+		int i = 0;
+
+		while (i < md->sg_end && copied < len) {
+			struct scatterlist *sge = &md->sg_data[i];
+			int copy = min_t(size_t, sge->length, len - copied);
+
+			copy = copy_page_to_iter(sg_page(sge), sge->offset,
+						 copy, to);
+			if (!copy)
+				return copied ? copied : -EFAULT;
+
+			copied += copy;
+			if (flags & MSG_PEEK)
+				i++;
+			else
+				smap_msg_trim_front(md, copy);
+		}
+
+		if (!md->sg_size) {
+			list_del(&md->list);
+			kfree(md);
+		}
+		if (copied == len)
+			break;
+	}
+
+	return copied;
+}
+
+static void bpf_wait_data(struct sock *sk, struct smap_psock *psock,
+			  long *timeo)
+{
+	DEFINE_WAIT_FUNC(wait, woken_wake_function);
+
+	add_wait_queue(sk_sleep(sk), &wait);
+	sk_set_bit(SOCKWQ_ASYNC_WAITDATA, sk);
+	sk_wait_event(sk, timeo,
+		      !list_empty(&psock->ingress) ||
+		      !skb_queue_empty(&sk->sk_receive_queue) ||
+		      sk->sk_err || (sk->sk_shutdown & RCV_SHUTDOWN),
+		      &wait);
+	sk_clear_bit(SOCKWQ_ASYNC_WAITDATA, sk);
+	remove_wait_queue(sk_sleep(sk), &wait);
+}
+
+static int bpf_tcp_recvmsg(struct sock *sk, struct msghdr *msg, size_t len,
+			   int nonblock, int flags, int *addr_len)
+{
+	struct smap_psock *psock;
+	int copied;
+	long timeo;
+
+	if (unlikely(flags & MSG_ERRQUEUE))
+		return inet_recv_error(sk, msg, len, addr_len);
+
+	psock = smap_psock_get(sk);
+	if (unlikely(!psock))
+		goto out_tcp;
+
+	/* Data that arrived through the stack is read first. */
+	if (!skb_queue_empty(&sk->sk_receive_queue))
+		goto out_put;
+
+	lock_sock(sk);
+	timeo = sock_rcvtimeo(sk, nonblock);
+bytes_ready:
+	copied = smap_ingress_copy(psock, &msg->msg_iter, len, flags);
+	if (!copied) {
+		if (sk->sk_err || (sk->sk_shutdown & RCV_SHUTDOWN) ||
+		    !timeo) {
+			nonblock |= !timeo;
+			release_sock(sk);
+			goto out_put;
+		}
+		if (signal_pending(current)) {
+			copied = sock_intr_errno(timeo);
+			goto out;
+		}
+
+		bpf_wait_data(sk, psock, &timeo);
+		if (!skb_queue_empty(&sk->sk_receive_queue)) {
+			release_sock(sk);
+			goto out_put;
+		}
+		goto bytes_ready;
+	}
+out:
+	release_sock(sk);
+	smap_psock_put(psock, sk);
+	return copied;
+out_put:
+	smap_psock_put(psock, sk);
+out_tcp:
+	return tcp_recvmsg(sk, msg, len, nonblock, flags, addr_len);
+}
+
+static bool bpf_tcp_stream_read(const struct sock *sk)
+{
+	struct smap_psock *psock;
+	bool empty = true;
+
+	rcu_read_lock();
+	psock = smap_psock_sk(sk);
+	if (likely(psock))
+		empty = list_empty(&psock->ingress);
+	rcu_read_unlock();
+
+	return !empty;
+}
+
+static void bpf_tcp_close(struct sock *sk, long timeout)
+{
+	void (*close_fun)(struct sock *sk, long timeout);
+	struct smap_psock_map_entry *e, *tmp;
+	struct smap_psock *psock;
+	struct sock *osk;
+
+	rcu_read_lock();
+	psock = smap_psock_sk(sk);
+	if (unlikely(!psock)) {
+		rcu_read_unlock();
+		tcp_close(sk, timeout);
+		return;
+	}
+
+	/* psock may be released below, keep what we need from it. The
+	 * sock itself is still referenced by the caller.
+	 */
+	close_fun = psock->save_close;
+
+	write_lock_bh(&sk->sk_callback_lock);
+	list_for_each_entry_safe(e, tmp, &psock->maps, list) {
+		osk = cmpxchg(e->entry, sk, NULL);
+		if (osk == sk) {
+			list_del(&e->list);
+			kfree(e);
+			smap_release_sock(psock, sk);
+		}
+	}
+	write_unlock_bh(&sk->sk_callback_lock);
+	rcu_read_unlock();
+
+	close_fun(sk, timeout);
+}
+
+enum {
+	SOCKMAP_IPV4,
+	SOCKMAP_IPV6,
+	SOCKMAP_NUM_PROTS,
+};
+
+static struct proto bpf_tcp_prots[SOCKMAP_NUM_PROTS];
+static struct proto *saved_tcp_prots[SOCKMAP_NUM_PROTS];
+static DEFINE_SPINLOCK(bpf_tcp_prots_lock);
+
+/* Replace the proto ops of sk with copies that divert sendmsg, sendpage,
+ * recvmsg and close through the psock. The original ones are restored
+ * when the last map reference to sk goes away. Called with
+ * sk_callback_lock held.
+ */
+static int bpf_tcp_init(struct sock *sk, struct smap_psock *psock)
+{
+	int i = sk->sk_family == AF_INET6 ? SOCKMAP_IPV6 : SOCKMAP_IPV4;
+	struct proto *prot = &bpf_tcp_prots[i];
+
+	/* The proto ops of a sock with an ULP, e.g. kTLS, are owned by it */
+	if (inet_csk(sk)->icsk_ulp_ops)
+		return -EBUSY;
+
+	spin_lock_bh(&bpf_tcp_prots_lock);
+	if (saved_tcp_prots[i] != sk->sk_prot) {
+		*prot = *sk->sk_prot;
+		prot->close = bpf_tcp_close;
+		prot->sendmsg = bpf_tcp_sendmsg;
+		prot->sendpage = bpf_tcp_sendpage;
+		prot->recvmsg = bpf_tcp_recvmsg;
+		prot->stream_memory_read = bpf_tcp_stream_read;
+		saved_tcp_prots[i] = sk->sk_prot;
+	}
+	spin_unlock_bh(&bpf_tcp_prots_lock);
+
+	psock->sk_proto = sk->sk_prot;
+	psock->save_close = sk->sk_prot->close;
+	WRITE_ONCE(sk->sk_prot, prot);
+	return 0;
+}
+
 /* Called with lock_sock(sk) held */
 static void smap_state_change(struct sock *sk)
 {
@@ -351,10 +1084,13 @@ static void smap_destroy_psock(struct rcu_head *rcu)
 
 static void smap_release_sock(struct smap_psock *psock, struct sock *sock)
 {
-	psock->refcnt--;
-	if (psock->refcnt)
+	if (!refcount_dec_and_test(&psock->refcnt))
 		return;
 
+	if (psock->sk_proto) {
+		WRITE_ONCE(sock->sk_prot, psock->sk_proto);
+		psock->sk_proto = NULL;
+	}
 	smap_stop_sock(psock, sock);
 	clear_bit(SMAP_TX_RUNNING, &psock->state);
 	rcu_assign_sk_user_data(sock, NULL);
@@ -410,6 +1146,16 @@ static int smap_init_sock(struct smap_psock *psock,
 	return strp_init(&psock->strp, sk, &cb);
 }
 
+static void smap_init_tx_msg(struct smap_psock *psock,
+			     struct bpf_prog *tx_msg)
+{
+	struct bpf_prog *orig_tx_msg;
+
+	orig_tx_msg = xchg(&psock->bpf_tx_msg, tx_msg);
+	if (orig_tx_msg)
+		bpf_prog_put(orig_tx_msg);
+}
+
 static void smap_init_progs(struct smap_psock *psock,
 			    struct bpf_stab *stab,
 			    struct bpf_prog *verdict,
@@ -448,6 +1194,7 @@ static void sock_map_remove_complete(struct bpf_stab *stab)
 static void smap_gc_work(struct work_struct *w)
 {
 	struct smap_psock_map_entry *e, *tmp;
+	struct sk_msg_buff *md, *mtmp;
 	struct smap_psock *psock;
 
 	psock = container_of(w, struct smap_psock, gc_work);
@@ -459,11 +1206,30 @@ static void smap_gc_work(struct work_struct *w)
 	cancel_work_sync(&psock->tx_work);
 	__skb_queue_purge(&psock->rxqueue);
 
+	/* Data queued by msg redirects or held back by a cork is charged
+	 * to the sock, release it under the sock lock.
+	 */
+	lock_sock(psock->sock);
+	list_for_each_entry_safe(md, mtmp, &psock->ingress, list) {
+		list_del(&md->list);
+		smap_msg_free(md);
+		kfree(md);
+	}
+	if (psock->cork) {
+		smap_msg_free(psock->cork);
+		kfree(psock->cork);
+	}
+	release_sock(psock->sock);
+	if (psock->sk_redir)
+		sock_put(psock->sk_redir);
+
 	/* At this point all strparser and xmit work must be complete */
 	if (psock->bpf_parse)
 		bpf_prog_put(psock->bpf_parse);
 	if (psock->bpf_verdict)
 		bpf_prog_put(psock->bpf_verdict);
+	if (psock->bpf_tx_msg)
+		bpf_prog_put(psock->bpf_tx_msg);
 
 	list_for_each_entry_safe(e, tmp, &psock->maps, list) {
 		list_del(&e->list);
@@ -490,7 +1256,9 @@ static struct smap_psock *smap_init_psock(struct sock *sock,
 	INIT_WORK(&psock->tx_work, smap_tx_work);
 	INIT_WORK(&psock->gc_work, smap_gc_work);
 	INIT_LIST_HEAD(&psock->maps);
-	psock->refcnt = 1;
+	INIT_LIST_HEAD(&psock->ingress);
+	psock->eval = __SK_NONE;
+	refcount_set(&psock->refcnt, 1);
 
 	rcu_assign_sk_user_data(sock, psock);
 	sock_hold(sock);
@@ -598,6 +1366,8 @@ static void sock_map_free(struct bpf_map *map)
 		bpf_prog_put(stab->bpf_verdict);
 	if (stab->bpf_parse)
 		bpf_prog_put(stab->bpf_parse);
+	if (stab->bpf_tx_msg)
+		bpf_prog_put(stab->bpf_tx_msg);
 
 	sock_map_remove_complete(stab);
 }
@@ -670,7 +1440,8 @@ static int sock_map_delete_elem(struct bpf_map *map, void *key)
  * operations as well as references in the data path are no longer in use.
  *
  * Psocks may exist in multiple maps, but only a single set of parse/verdict
- * programs may be inherited from the maps it belongs to. A reference count
+ * programs and a single msg program may be inherited from the maps it
+ * belongs to. A reference count
  * is kept with the total number of references to the psock from all maps. The
  * psock will not be released until this reaches zero. The psock and sock
  * user data data use the sk_callback_lock to protect critical data structures
@@ -692,7 +1463,7 @@ static int sock_map_ctx_update_elem(struct bpf_sock_ops_kern *skops,
 {
 	struct bpf_stab *stab = container_of(map, struct bpf_stab, map);
 	struct smap_psock_map_entry *e = NULL;
-	struct bpf_prog *verdict, *parse;
+	struct bpf_prog *verdict, *parse, *tx_msg;
 	struct sock *osock, *sock;
 	struct smap_psock *psock;
 	u32 i = *(u32 *)key;
@@ -718,6 +1489,7 @@ static int sock_map_ctx_update_elem(struct bpf_sock_ops_kern *skops,
 	 */
 	verdict = READ_ONCE(stab->bpf_verdict);
 	parse = READ_ONCE(stab->bpf_parse);
+	tx_msg = READ_ONCE(stab->bpf_tx_msg);
 
 	if (parse && verdict) {
 		/* bpf prog refcnt may be zero if a concurrent attach operation
@@ -736,6 +1508,17 @@ static int sock_map_ctx_update_elem(struct bpf_sock_ops_kern *skops,
 		}
 	}
 
+	if (tx_msg) {
+		tx_msg = bpf_prog_inc_not_zero(stab->bpf_tx_msg);
+		if (IS_ERR(tx_msg)) {
+			if (verdict)
+				bpf_prog_put(verdict);
+			if (parse)
+				bpf_prog_put(parse);
+			return PTR_ERR(tx_msg);
+		}
+	}
+
 	write_lock_bh(&sock->sk_callback_lock);
 	psock = smap_psock_sk(sock);
 
@@ -750,7 +1533,11 @@ static int sock_map_ctx_update_elem(struct bpf_sock_ops_kern *skops,
 			err = -EBUSY;
 			goto out_progs;
 		}
-		psock->refcnt++;
+		if (READ_ONCE(psock->bpf_tx_msg) && tx_msg) {
+			err = -EBUSY;
+			goto out_progs;
+		}
+		refcount_inc(&psock->refcnt);
 	} else {
 		psock = smap_init_psock(sock, stab);
 		if (IS_ERR(psock)) {
@@ -758,6 +1545,10 @@ static int sock_map_ctx_update_elem(struct bpf_sock_ops_kern *skops,
 			goto out_progs;
 		}
 
+		err = bpf_tcp_init(sock, psock);
+		if (err)
+			goto out_free;
+
 		set_bit(SMAP_TX_RUNNING, &psock->state);
 	}
 
@@ -778,6 +1569,8 @@ static int sock_map_ctx_update_elem(struct bpf_sock_ops_kern *skops,
 		smap_init_progs(psock, stab, verdict, parse);
 		smap_start_sock(psock, sock);
 	}
+	if (tx_msg)
+		smap_init_tx_msg(psock, tx_msg);
 
 	/* 4. Place psock in sockmap for use and stop any programs on
 	 * the old sock assuming its not the same sock we are replacing
@@ -806,6 +1599,8 @@ static int sock_map_ctx_update_elem(struct bpf_sock_ops_kern *skops,
 		bpf_prog_put(verdict);
 	if (parse)
 		bpf_prog_put(parse);
+	if (tx_msg)
+		bpf_prog_put(tx_msg);
 	write_unlock_bh(&sock->sk_callback_lock);
 	kfree(e);
 	return err;
@@ -820,6 +1615,9 @@ int sock_map_prog(struct bpf_map *map, struct bpf_prog *prog, u32 type)
 		return -EINVAL;
 
 	switch (type) {
+	case BPF_SK_MSG_VERDICT:
+		orig = xchg(&stab->bpf_tx_msg, prog);
+		break;
 	case BPF_SK_SKB_STREAM_PARSER:
 		orig = xchg(&stab->bpf_parse, prog);
 		break;
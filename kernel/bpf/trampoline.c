@@ -0,0 +1,298 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * fentry/fexit attachment of BPF_PROG_TYPE_TRACING programs
+ *
+ * All the programs attached to a kernel function share one trampoline,
+ * which owns an ftrace_ops filtered on the ftrace call site of that
+ * function only.  ftrace gives such an ops its own dynamic trampoline,
+ * so the call site ends up calling bpf_trampoline_func() directly, with
+ * no kprobe, int3 or ops list walk in between.
+ *
+ * BPF_TRACE_FENTRY programs run right there on the arguments found in the
+ * saved registers.  If BPF_TRACE_FEXIT programs are attached, the saved
+ * instruction pointer is also moved to bpf_trampoline_fexit, which calls
+ * the body of the function itself and runs bpf_trampoline_fexit_progs()
+ * on the arguments and the return value before returning to the caller.
+ * Unlike kretprobes, nothing is allocated per call: the state of the call
+ * lives in the frame of bpf_trampoline_fexit.
+ *
+ * The programs see the first BPF_TRACE_FUNC_MAX_ARGS arguments, passed in
+ * registers.  bpf_trampoline_fexit copies six words of stack arguments
+ * for the function body, which bounds the functions that fexit programs
+ * can trace to twelve arguments.
+ */
+
+#include <linux/bpf.h>
+#include <linux/ftrace.h>
+#include <linux/hash.h>
+#include <linux/anon_inodes.h>
+#include <linux/file.h>
+#include <linux/filter.h>
+#include <linux/module.h>
+#include <linux/rculist.h>
+#include <linux/slab.h>
+
+#define TRAMPOLINE_HASH_BITS	10
+#define TRAMPOLINE_TABLE_SIZE	(1 << TRAMPOLINE_HASH_BITS)
+
+enum {
+	BPF_TRAMP_FENTRY,
+	BPF_TRAMP_FEXIT,
+	BPF_TRAMP_MAX,
+};
+
+struct bpf_trampoline {
+	struct hlist_node hlist;
+	unsigned long ip;
+	struct module *mod;
+	struct ftrace_ops ops;
+	/* links of the attached programs, under trampoline_mutex */
+	struct list_head progs[BPF_TRAMP_MAX];
+	int nr_links;
+	struct rcu_head rcu;
+};
+
+struct bpf_tramp_link {
+	struct list_head node;
+	struct bpf_trampoline *tr;
+	struct bpf_prog *prog;
+	int kind;
+	struct rcu_head rcu;
+};
+
+/* Entered in place of the body of a function with fexit programs */
+extern void bpf_trampoline_fexit(void);
+
+static struct hlist_head trampoline_table[TRAMPOLINE_TABLE_SIZE];
+
+/* Serializes attaching and detaching the programs */
+static DEFINE_MUTEX(trampoline_mutex);
+
+static struct hlist_head *trampoline_bucket(unsigned long ip)
+{
+	return &trampoline_table[hash_long(ip, TRAMPOLINE_HASH_BITS)];
+}
+
+static struct bpf_trampoline *trampoline_lookup_rcu(unsigned long ip)
+{
+	struct bpf_trampoline *tr;
+
+	hlist_for_each_entry_rcu(tr, trampoline_bucket(ip), hlist)
+		if (tr->ip == ip)
+			return tr;
+	return NULL;
+}
+
+static void notrace run_tramp_progs(struct list_head *progs,
+				    struct bpf_trace_func_ctx *ctx)
+{
+	struct bpf_tramp_link *link;
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(link, progs, node)
+		BPF_PROG_RUN(link->prog, ctx);
+	rcu_read_unlock();
+}
+
+static void notrace bpf_trampoline_func(unsigned long ip,
+					unsigned long parent_ip,
+					struct ftrace_ops *ops,
+					struct pt_regs *regs)
+{
+	struct bpf_trampoline *tr = container_of(ops, struct bpf_trampoline,
+						 ops);
+	struct bpf_trace_func_ctx ctx;
+
+	if (in_nmi())
+		return;
+
+	preempt_disable_notrace();
+
+	/*
+	 * As in trace_call_bpf(), a function hit from a BPF program is not
+	 * traced, neither on entry nor on return.
+	 */
+	if (unlikely(__this_cpu_inc_return(bpf_prog_active) != 1))
+		goto out;
+
+	if (!list_empty(&tr->progs[BPF_TRAMP_FENTRY])) {
+		ctx.args[0] = regs->di;
+		ctx.args[1] = regs->si;
+		ctx.args[2] = regs->dx;
+		ctx.args[3] = regs->cx;
+		ctx.args[4] = regs->r8;
+		ctx.args[5] = regs->r9;
+		ctx.ret = 0;
+		run_tramp_progs(&tr->progs[BPF_TRAMP_FENTRY], &ctx);
+	}
+
+	/*
+	 * regs->ip is the body of the function, right after the call site.
+	 * %r10 is not used to pass arguments, hand the body over in it.
+	 */
+	if (!list_empty(&tr->progs[BPF_TRAMP_FEXIT])) {
+		regs->r10 = regs->ip;
+		regs->ip = (unsigned long)bpf_trampoline_fexit;
+	}
+out:
+	__this_cpu_dec(bpf_prog_active);
+	preempt_enable_notrace();
+}
+
+/*
+ * Called by bpf_trampoline_fexit once the body returned.  The function
+ * may have slept, so its trampoline is looked up again by address: the
+ * programs attached to it by now run, none if it is gone.
+ */
+asmlinkage void notrace
+bpf_trampoline_fexit_progs(struct bpf_trace_func_ctx *ctx, unsigned long body)
+{
+	struct bpf_trampoline *tr;
+
+	preempt_disable_notrace();
+	if (likely(__this_cpu_inc_return(bpf_prog_active) == 1)) {
+		rcu_read_lock();
+		tr = trampoline_lookup_rcu(body - MCOUNT_INSN_SIZE);
+		if (tr)
+			run_tramp_progs(&tr->progs[BPF_TRAMP_FEXIT], ctx);
+		rcu_read_unlock();
+	}
+	__this_cpu_dec(bpf_prog_active);
+	preempt_enable_notrace();
+}
+
+static struct bpf_trampoline *trampoline_get(unsigned long ip)
+{
+	struct bpf_trampoline *tr;
+	struct module *mod;
+	int i, err;
+
+	hlist_for_each_entry(tr, trampoline_bucket(ip), hlist)
+		if (tr->ip == ip)
+			return tr;
+
+	if (ftrace_location(ip) != ip)
+		return ERR_PTR(-EINVAL);
+
+	preempt_disable();
+	mod = __module_text_address(ip);
+	if (mod && !try_module_get(mod))
+		mod = ERR_PTR(-ENOENT);
+	preempt_enable();
+	if (IS_ERR(mod))
+		return ERR_CAST(mod);
+
+	tr = kzalloc(sizeof(*tr), GFP_KERNEL);
+	if (!tr) {
+		err = -ENOMEM;
+		goto out_put;
+	}
+
+	tr->ip = ip;
+	tr->mod = mod;
+	for (i = 0; i < BPF_TRAMP_MAX; i++)
+		INIT_LIST_HEAD(&tr->progs[i]);
+	tr->ops.func = bpf_trampoline_func;
+	tr->ops.flags = FTRACE_OPS_FL_SAVE_REGS | FTRACE_OPS_FL_IPMODIFY;
+
+	err = ftrace_set_filter_ip(&tr->ops, ip, 0, 0);
+	if (err)
+		goto out_free;
+	err = register_ftrace_function(&tr->ops);
+	if (err)
+		goto out_filter;
+
+	hlist_add_head_rcu(&tr->hlist, trampoline_bucket(ip));
+	return tr;
+
+out_filter:
+	ftrace_free_filter(&tr->ops);
+out_free:
+	kfree(tr);
+out_put:
+	module_put(mod);
+	return ERR_PTR(err);
+}
+
+static void trampoline_put(struct bpf_trampoline *tr)
+{
+	if (--tr->nr_links)
+		return;
+
+	/* No bpf_trampoline_func() runs past this, but fexit calls may */
+	unregister_ftrace_function(&tr->ops);
+	ftrace_free_filter(&tr->ops);
+	hlist_del_rcu(&tr->hlist);
+	module_put(tr->mod);
+	kfree_rcu(tr, rcu);
+}
+
+static int bpf_tramp_link_release(struct inode *inode, struct file *filp)
+{
+	struct bpf_tramp_link *link = filp->private_data;
+
+	mutex_lock(&trampoline_mutex);
+	list_del_rcu(&link->node);
+	trampoline_put(link->tr);
+	mutex_unlock(&trampoline_mutex);
+
+	bpf_prog_put(link->prog);
+	kfree_rcu(link, rcu);
+	return 0;
+}
+
+static const struct file_operations bpf_tramp_link_fops = {
+	.release	= bpf_tramp_link_release,
+};
+
+/**
+ * bpf_trampoline_open - attach a program to a kernel function
+ * @ip: address of the function
+ * @prog: BPF_PROG_TYPE_TRACING program, whose reference is taken over
+ * @type: BPF_TRACE_FENTRY or BPF_TRACE_FEXIT
+ *
+ * The program stays attached until the returned file descriptor is
+ * closed.  Returns the file descriptor or a negative errno, in which case
+ * the reference of @prog is left to the caller.
+ */
+int bpf_trampoline_open(unsigned long ip, struct bpf_prog *prog, u32 type)
+{
+	struct bpf_tramp_link *link;
+	struct bpf_trampoline *tr;
+	int fd;
+
+#ifndef CC_USING_FENTRY
+	/* mcount is called once the frame is set up, too late for fexit */
+	return -EOPNOTSUPP;
+#endif
+
+	link = kzalloc(sizeof(*link), GFP_USER);
+	if (!link)
+		return -ENOMEM;
+	link->prog = prog;
+	link->kind = type == BPF_TRACE_FEXIT ? BPF_TRAMP_FEXIT :
+					       BPF_TRAMP_FENTRY;
+
+	mutex_lock(&trampoline_mutex);
+	tr = trampoline_get(ip);
+	if (IS_ERR(tr)) {
+		mutex_unlock(&trampoline_mutex);
+		kfree(link);
+		return PTR_ERR(tr);
+	}
+	tr->nr_links++;
+	link->tr = tr;
+	list_add_tail_rcu(&link->node, &tr->progs[link->kind]);
+
+	fd = anon_inode_getfd("bpf-trampoline", &bpf_tramp_link_fops, link,
+			      O_RDWR | O_CLOEXEC);
+	if (fd < 0) {
+		list_del_rcu(&link->node);
+		trampoline_put(tr);
+		mutex_unlock(&trampoline_mutex);
+		kfree_rcu(link, rcu);
+		return fd;
+	}
+	mutex_unlock(&trampoline_mutex);
+	return fd;
+}
@@ -144,6 +144,8 @@ struct bpf_verifier_stack_elem {
 #define BPF_COMPLEXITY_LIMIT_STACK	1024
 
 #define BPF_MAP_PTR_POISON ((void *)0xeB9F + POISON_POINTER_DELTA)
+#define BPF_MAP_KEY_POISON	(1ULL << 63)
+#define BPF_MAP_KEY_SEEN	(1ULL << 62)
 
 struct bpf_call_arg_meta {
 	struct bpf_map *map_ptr;
@@ -877,7 +879,10 @@ static bool may_access_direct_pkt_data(struct bpf_verifier_env *env,
 	switch (env->prog->type) {
 	case BPF_PROG_TYPE_LWT_IN:
 	case BPF_PROG_TYPE_LWT_OUT:
-		/* dst_input() and dst_output() can't write for now */
+	case BPF_PROG_TYPE_SK_REUSEPORT:
+		/* dst_input() and dst_output() can't write for now, and
+		 * the reuseport selection must not alter the request.
+		 */
 		if (t == BPF_WRITE)
 			return false;
 		/* fallthrough */
@@ -886,6 +891,7 @@ static bool may_access_direct_pkt_data(struct bpf_verifier_env *env,
 	case BPF_PROG_TYPE_XDP:
 	case BPF_PROG_TYPE_LWT_XMIT:
 	case BPF_PROG_TYPE_SK_SKB:
+	case BPF_PROG_TYPE_SK_MSG:
 		if (meta)
 			return meta->pkt_access;
 
@@ -1357,9 +1363,13 @@ static int check_func_arg(struct bpf_verifier_env *env, u32 regno,
 	}
 
 	if (arg_type == ARG_PTR_TO_MAP_KEY ||
-	    arg_type == ARG_PTR_TO_MAP_VALUE) {
+	    arg_type == ARG_PTR_TO_MAP_VALUE ||
+	    arg_type == ARG_PTR_TO_MAP_VALUE_OR_NULL) {
 		expected_type = PTR_TO_STACK;
-		if (type != PTR_TO_PACKET && type != expected_type)
+		if (arg_type == ARG_PTR_TO_MAP_VALUE_OR_NULL &&
+		    register_is_null(*reg))
+			/* nothing to check below */;
+		else if (type != PTR_TO_PACKET && type != expected_type)
 			goto err_type;
 	} else if (arg_type == ARG_CONST_SIZE ||
 		   arg_type == ARG_CONST_SIZE_OR_ZERO) {
@@ -1416,7 +1426,9 @@ static int check_func_arg(struct bpf_verifier_env *env, u32 regno,
 			err = check_stack_boundary(env, regno,
 						   meta->map_ptr->key_size,
 						   false, NULL);
-	} else if (arg_type == ARG_PTR_TO_MAP_VALUE) {
+	} else if (arg_type == ARG_PTR_TO_MAP_VALUE ||
+		   (arg_type == ARG_PTR_TO_MAP_VALUE_OR_NULL &&
+		    !register_is_null(*reg))) {
 		/* bpf_map_xxx(..., map_ptr, ..., value) call:
 		 * check [value, value + map->value_size) validity
 		 */
@@ -1522,6 +1534,14 @@ static int check_map_func_compatibility(struct bpf_map *map, int func_id)
 		if (func_id != BPF_FUNC_redirect_map)
 			goto error;
 		break;
+	case BPF_MAP_TYPE_CPUMAP:
+		if (func_id != BPF_FUNC_redirect_map)
+			goto error;
+		break;
+	case BPF_MAP_TYPE_XSKMAP:
+		if (func_id != BPF_FUNC_redirect_map)
+			goto error;
+		break;
 	case BPF_MAP_TYPE_ARRAY_OF_MAPS:
 	case BPF_MAP_TYPE_HASH_OF_MAPS:
 		if (func_id != BPF_FUNC_map_lookup_elem)
@@ -1530,7 +1550,22 @@ static int check_map_func_compatibility(struct bpf_map *map, int func_id)
 	case BPF_MAP_TYPE_SOCKMAP:
 		if (func_id != BPF_FUNC_sk_redirect_map &&
 		    func_id != BPF_FUNC_sock_map_update &&
-		    func_id != BPF_FUNC_map_delete_elem)
+		    func_id != BPF_FUNC_map_delete_elem &&
+		    func_id != BPF_FUNC_msg_redirect_map)
+			goto error;
+		break;
+	case BPF_MAP_TYPE_REUSEPORT_SOCKARRAY:
+		if (func_id != BPF_FUNC_sk_select_reuseport)
+			goto error;
+		break;
+	case BPF_MAP_TYPE_RINGBUF:
+		if (func_id != BPF_FUNC_ringbuf_output &&
+		    func_id != BPF_FUNC_ringbuf_query)
+			goto error;
+		break;
+	case BPF_MAP_TYPE_SK_STORAGE:
+		if (func_id != BPF_FUNC_sk_storage_get &&
+		    func_id != BPF_FUNC_sk_storage_delete)
 			goto error;
 		break;
 	default:
@@ -1558,10 +1593,13 @@ static int check_map_func_compatibility(struct bpf_map *map, int func_id)
 			goto error;
 		break;
 	case BPF_FUNC_redirect_map:
-		if (map->map_type != BPF_MAP_TYPE_DEVMAP)
+		if (map->map_type != BPF_MAP_TYPE_DEVMAP &&
+		    map->map_type != BPF_MAP_TYPE_CPUMAP &&
+		    map->map_type != BPF_MAP_TYPE_XSKMAP)
 			goto error;
 		break;
 	case BPF_FUNC_sk_redirect_map:
+	case BPF_FUNC_msg_redirect_map:
 		if (map->map_type != BPF_MAP_TYPE_SOCKMAP)
 			goto error;
 		break;
@@ -1569,6 +1607,20 @@ static int check_map_func_compatibility(struct bpf_map *map, int func_id)
 		if (map->map_type != BPF_MAP_TYPE_SOCKMAP)
 			goto error;
 		break;
+	case BPF_FUNC_sk_select_reuseport:
+		if (map->map_type != BPF_MAP_TYPE_REUSEPORT_SOCKARRAY)
+			goto error;
+		break;
+	case BPF_FUNC_ringbuf_output:
+	case BPF_FUNC_ringbuf_query:
+		if (map->map_type != BPF_MAP_TYPE_RINGBUF)
+			goto error;
+		break;
+	case BPF_FUNC_sk_storage_get:
+	case BPF_FUNC_sk_storage_delete:
+		if (map->map_type != BPF_MAP_TYPE_SK_STORAGE)
+			goto error;
+		break;
 	default:
 		break;
 	}
@@ -1623,6 +1675,39 @@ static void clear_all_pkt_pointers(struct bpf_verifier_env *env)
 	}
 }
 
+/* Remember the prog_array and the index of a tail call, so that it can be
+ * JITed as a direct jump if they are the same on all paths.
+ */
+static void record_tail_call(struct bpf_verifier_env *env,
+			     struct bpf_call_arg_meta *meta, int insn_idx)
+{
+	struct bpf_insn_aux_data *aux = &env->insn_aux_data[insn_idx];
+	struct bpf_reg_state *reg = &env->cur_state.regs[BPF_REG_3];
+	struct bpf_map *map = meta->map_ptr;
+	u64 state;
+
+	if (!aux->map_ptr)
+		aux->map_ptr = map;
+	else if (aux->map_ptr != map)
+		aux->map_ptr = BPF_MAP_PTR_POISON;
+
+	if (aux->map_key_state & BPF_MAP_KEY_POISON)
+		return;
+
+	if (!map || reg->type != SCALAR_VALUE ||
+	    !tnum_is_const(reg->var_off) ||
+	    reg->var_off.value >= map->max_entries) {
+		aux->map_key_state = BPF_MAP_KEY_POISON;
+		return;
+	}
+
+	state = BPF_MAP_KEY_SEEN | reg->var_off.value;
+	if (!aux->map_key_state)
+		aux->map_key_state = state;
+	else if (aux->map_key_state != state)
+		aux->map_key_state = BPF_MAP_KEY_POISON;
+}
+
 static int check_call(struct bpf_verifier_env *env, int func_id, int insn_idx)
 {
 	struct bpf_verifier_state *state = &env->cur_state;
@@ -1693,6 +1778,9 @@ static int check_call(struct bpf_verifier_env *env, int func_id, int insn_idx)
 			return err;
 	}
 
+	if (func_id == BPF_FUNC_tail_call)
+		record_tail_call(env, &meta, insn_idx);
+
 	/* reset caller saved regs */
 	for (i = 0; i < CALLER_SAVED_REGS; i++) {
 		mark_reg_not_init(regs, caller_saved[i]);
@@ -4187,8 +4275,9 @@ static int fixup_bpf_calls(struct bpf_verifier_env *env)
 	const int insn_cnt = prog->len;
 	struct bpf_insn insn_buf[16];
 	struct bpf_prog *new_prog;
+	struct bpf_insn_aux_data *aux;
 	struct bpf_map *map_ptr;
-	int i, cnt, delta = 0;
+	int i, cnt, ret, delta = 0;
 
 	for (i = 0; i < insn_cnt; i++, insn++) {
 		if (insn->code != (BPF_JMP | BPF_CALL))
@@ -4214,6 +4303,30 @@ static int fixup_bpf_calls(struct bpf_verifier_env *env)
 			 */
 			insn->imm = 0;
 			insn->code = BPF_JMP | BPF_TAIL_CALL;
+
+			/* a constant slot of one prog_array is JITed as a
+			 * direct jump, imm is then 1 + its poke descriptor
+			 */
+			aux = &env->insn_aux_data[i + delta];
+			map_ptr = aux->map_ptr;
+			if (ebpf_jit_enabled() && map_ptr &&
+			    map_ptr != BPF_MAP_PTR_POISON &&
+			    !(aux->map_key_state & BPF_MAP_KEY_POISON)) {
+				struct bpf_jit_poke_descriptor desc = {
+					.tail_call.map = map_ptr,
+					.tail_call.key = aux->map_key_state,
+				};
+
+				ret = bpf_jit_add_poke_descriptor(prog, &desc);
+				if (ret < 0)
+					return ret;
+				insn->imm = ret + 1;
+
+				ret = map_ptr->ops->map_poke_track(map_ptr,
+								   prog->aux);
+				if (ret < 0)
+					return ret;
+			}
 			continue;
 		}
 
@@ -200,6 +200,15 @@ int cgroup_show_path(struct seq_file *sf, struct kernfs_node *kf_node,
 
 int cgroup_task_count(const struct cgroup *cgrp);
 
+/*
+ * rstat.c
+ */
+void cgroup_rstat_boot(void);
+int cgroup_rstat_init(struct cgroup *cgrp);
+void cgroup_rstat_exit(struct cgroup *cgrp);
+void cgroup_rstat_css_link(struct cgroup_subsys_state *css);
+void cgroup_rstat_css_unlink(struct cgroup_subsys_state *css);
+
 /*
  * namespace.c
  */
@@ -109,6 +109,24 @@ struct cpuset {
 	cpumask_var_t effective_cpus;
 	nodemask_t effective_mems;
 
+	/*
+	 * CPUs handed to child partition roots.  They are taken out of
+	 * effective_cpus, so tasks of this cpuset no longer run there.
+	 * Only used on the default hierarchy.
+	 */
+	cpumask_var_t subparts_cpus;
+	int nr_subparts_cpus;
+
+	/* PRS_* below, written by the cpuset.cpus.partition file */
+	int partition_root_state;
+
+	/*
+	 * A partition root none of whose CPUs is online borrows the
+	 * effective_cpus of its parent and is invalid until it has CPUs
+	 * again.  It gets no sched domain meanwhile.
+	 */
+	bool partition_invalid;
+
 	/*
 	 * This is old Memory Nodes tasks took on.
 	 *
@@ -165,6 +183,16 @@ static inline bool task_has_mempolicy(struct task_struct *task)
 #endif
 
 
+/*
+ * Partition root states.  A partition root owns its CPUs exclusively and
+ * gets a sched domain of its own; an isolated one gets none, so its CPUs
+ * are not load balanced.  The parent of a partition root must be one too,
+ * top_cpuset always is.
+ */
+#define PRS_MEMBER	0
+#define PRS_ROOT	1
+#define PRS_ISOLATED	2
+
 /* bits in struct cpuset flags field */
 typedef enum {
 	CS_ONLINE,
@@ -218,9 +246,20 @@ static inline int is_spread_slab(const struct cpuset *cs)
 	return test_bit(CS_SPREAD_SLAB, &cs->flags);
 }
 
+static inline bool is_partition_root(const struct cpuset *cs)
+{
+	return cs->partition_root_state != PRS_MEMBER;
+}
+
+static inline bool is_valid_partition_root(const struct cpuset *cs)
+{
+	return is_partition_root(cs) && !cs->partition_invalid;
+}
+
 static struct cpuset top_cpuset = {
 	.flags = ((1 << CS_ONLINE) | (1 << CS_CPU_EXCLUSIVE) |
 		  (1 << CS_MEM_EXCLUSIVE)),
+	.partition_root_state = PRS_ROOT,
 };
 
 /**
@@ -292,6 +331,12 @@ static DEFINE_SPINLOCK(callback_lock);
 
 static struct workqueue_struct *cpuset_migrate_mm_wq;
 
+/* CPUs of the isolated partitions, kept off unbound workqueues */
+static cpumask_var_t isolated_cpus;
+
+/* Scratch mask of the partition code, protected by cpuset_mutex */
+static cpumask_var_t partition_tmp_cpus;
+
 /*
  * CPU / memory hotplug is handled asynchronously.
  */
@@ -594,6 +639,82 @@ static inline int nr_cpusets(void)
 	return static_key_count(&cpusets_enabled_key.key) + 1;
 }
 
+/*
+ * generate_partition_domains()
+ *
+ * On the default hierarchy the sched domains follow the partition roots:
+ * each one which load balances gets a domain spanning its effective CPUs.
+ * Partition roots own disjoint sets of CPUs, so unlike on the legacy
+ * hierarchy there is nothing to merge.  The CPUs of isolated partitions
+ * are in no domain, which attaches them to the NULL domain.
+ *
+ * Must be called with cpuset_mutex held.
+ */
+static int generate_partition_domains(cpumask_var_t **domains,
+				      struct sched_domain_attr **attributes)
+{
+	struct cpuset *cp;
+	struct cgroup_subsys_state *pos_css;
+	cpumask_var_t *doms = NULL;
+	cpumask_var_t non_isolated_cpus;
+	int ndoms = 0, nslot = 0;
+
+	if (!alloc_cpumask_var(&non_isolated_cpus, GFP_KERNEL))
+		goto done;
+	cpumask_andnot(non_isolated_cpus, cpu_possible_mask, cpu_isolated_map);
+
+	rcu_read_lock();
+	cpuset_for_each_descendant_pre(cp, pos_css, &top_cpuset) {
+		if (!is_partition_root(cp)) {
+			pos_css = css_rightmost_descendant(pos_css);
+			continue;
+		}
+		/* it overlaps its parent, its children are invalid too */
+		if (cp->partition_invalid)
+			continue;
+		if (is_sched_load_balance(cp) &&
+		    cpumask_intersects(cp->effective_cpus, non_isolated_cpus))
+			ndoms++;
+	}
+	rcu_read_unlock();
+
+	doms = alloc_sched_domains(ndoms);
+	if (!doms)
+		goto done;
+
+	rcu_read_lock();
+	cpuset_for_each_descendant_pre(cp, pos_css, &top_cpuset) {
+		if (!is_partition_root(cp)) {
+			pos_css = css_rightmost_descendant(pos_css);
+			continue;
+		}
+		if (cp->partition_invalid || !is_sched_load_balance(cp) ||
+		    !cpumask_intersects(cp->effective_cpus, non_isolated_cpus))
+			continue;
+		if (WARN_ON_ONCE(nslot == ndoms))
+			break;
+		cpumask_and(doms[nslot++], cp->effective_cpus,
+			    non_isolated_cpus);
+	}
+	rcu_read_unlock();
+	ndoms = nslot;
+
+done:
+	free_cpumask_var(non_isolated_cpus);
+
+	/*
+	 * Fallback to the default domain if kmalloc() failed.
+	 * See comments in partition_sched_domains().
+	 */
+	if (doms == NULL)
+		ndoms = 1;
+
+	/* relax_domain_level is a legacy hierarchy knob */
+	*domains    = doms;
+	*attributes = NULL;
+	return ndoms;
+}
+
 /*
  * generate_sched_domains()
  *
@@ -662,6 +783,9 @@ static int generate_sched_domains(cpumask_var_t **domains,
 	int nslot;		/* next empty doms[] struct cpumask slot */
 	struct cgroup_subsys_state *pos_css;
 
+	if (cgroup_subsys_on_dfl(cpuset_cgrp_subsys))
+		return generate_partition_domains(domains, attributes);
+
 	doms = NULL;
 	dattr = NULL;
 	csa = NULL;
@@ -841,9 +965,35 @@ static void rebuild_sched_domains_locked(void)
 	 * We have raced with CPU hotplug. Don't do anything to avoid
 	 * passing doms with offlined cpu to partition_sched_domains().
 	 * Anyways, hotplug work item will rebuild sched domains.
+	 *
+	 * The CPUs of partition roots are not in top_cpuset.effective_cpus,
+	 * so with partitions only check that no CPU in use went offline.
 	 */
-	if (!cpumask_equal(top_cpuset.effective_cpus, cpu_active_mask))
+	if (!top_cpuset.nr_subparts_cpus &&
+	    !cpumask_equal(top_cpuset.effective_cpus, cpu_active_mask))
 		goto out;
+	if (top_cpuset.nr_subparts_cpus) {
+		struct cgroup_subsys_state *pos_css;
+		struct cpuset *cs;
+		bool stale = false;
+
+		rcu_read_lock();
+		cpuset_for_each_descendant_pre(cs, pos_css, &top_cpuset) {
+			if (!is_partition_root(cs)) {
+				pos_css = css_rightmost_descendant(pos_css);
+				continue;
+			}
+			if (is_valid_partition_root(cs) &&
+			    !cpumask_subset(cs->effective_cpus,
+					    cpu_active_mask)) {
+				stale = true;
+				break;
+			}
+		}
+		rcu_read_unlock();
+		if (stale)
+			goto out;
+	}
 
 	/* Generate domain masks and attrs */
 	ndoms = generate_sched_domains(&doms, &attr);
@@ -880,11 +1030,56 @@ static void update_tasks_cpumask(struct cpuset *cs)
 	struct task_struct *task;
 
 	css_task_iter_start(&cs->css, 0, &it);
-	while ((task = css_task_iter_next(&it)))
+	while ((task = css_task_iter_next(&it))) {
+		/*
+		 * top_cpuset only changes when partitions are created or
+		 * resized, which must not unbind per-cpu kthreads.
+		 */
+		if (cs == &top_cpuset && (task->flags & PF_NO_SETAFFINITY))
+			continue;
 		set_cpus_allowed_ptr(task, cs->effective_cpus);
+	}
 	css_task_iter_end(&it);
 }
 
+/*
+ * compute_effective_cpumask - the CPUs @cs may use from @parent
+ *
+ * The CPUs @parent handed to its partition roots are not in its
+ * effective_cpus, but a partition root child still takes its own from
+ * there.  A member child can't, since partition roots are cpu exclusive.
+ * The CPUs @cs hands to its own partition roots are then taken out.
+ *
+ * A partition root left without CPUs is marked invalid, as it then
+ * overlaps its parent.
+ */
+static void compute_effective_cpumask(struct cpumask *new_cpus,
+				      struct cpuset *cs, struct cpuset *parent)
+{
+	if (!parent) {
+		cpumask_copy(new_cpus, cpu_active_mask);
+	} else if (parent->nr_subparts_cpus) {
+		cpumask_or(new_cpus, parent->effective_cpus,
+			   parent->subparts_cpus);
+		cpumask_and(new_cpus, new_cpus, cs->cpus_allowed);
+		cpumask_and(new_cpus, new_cpus, cpu_active_mask);
+	} else {
+		cpumask_and(new_cpus, cs->cpus_allowed, parent->effective_cpus);
+	}
+
+	/*
+	 * If it becomes empty, inherit the effective mask of the parent,
+	 * which is guaranteed to have some CPUs.
+	 */
+	if (is_partition_root(cs))
+		cs->partition_invalid = parent && cpumask_empty(new_cpus);
+	if (parent && is_in_v2_mode() && cpumask_empty(new_cpus))
+		cpumask_copy(new_cpus, parent->effective_cpus);
+
+	if (cs->nr_subparts_cpus)
+		cpumask_andnot(new_cpus, new_cpus, cs->subparts_cpus);
+}
+
 /*
  * update_cpumasks_hier - Update effective cpumasks and tasks in the subtree
  * @cs: the cpuset to consider
@@ -905,16 +1100,7 @@ static void update_cpumasks_hier(struct cpuset *cs, struct cpumask *new_cpus)
 
 	rcu_read_lock();
 	cpuset_for_each_descendant_pre(cp, pos_css, cs) {
-		struct cpuset *parent = parent_cs(cp);
-
-		cpumask_and(new_cpus, cp->cpus_allowed, parent->effective_cpus);
-
-		/*
-		 * If it becomes empty, inherit the effective mask of the
-		 * parent, which is guaranteed to have some CPUs.
-		 */
-		if (is_in_v2_mode() && cpumask_empty(new_cpus))
-			cpumask_copy(new_cpus, parent->effective_cpus);
+		compute_effective_cpumask(new_cpus, cp, parent_cs(cp));
 
 		/* Skip the whole subtree if the cpumask remains the same. */
 		if (cpumask_equal(new_cpus, cp->effective_cpus)) {
@@ -940,7 +1126,7 @@ static void update_cpumasks_hier(struct cpuset *cs, struct cpumask *new_cpus)
 		 * we need to rebuild sched domains.
 		 */
 		if (!cpumask_empty(cp->cpus_allowed) &&
-		    is_sched_load_balance(cp))
+		    (is_sched_load_balance(cp) || is_partition_root(cp)))
 			need_rebuild_sched_domains = true;
 
 		rcu_read_lock();
@@ -952,6 +1138,88 @@ static void update_cpumasks_hier(struct cpuset *cs, struct cpumask *new_cpus)
 		rebuild_sched_domains_locked();
 }
 
+/*
+ * validate_partition - can @cs be a partition root owning @new_cpus?
+ *
+ * The CPUs must be available in the parent, either still unused in its
+ * effective_cpus or already owned by @cs, and the parent must keep at
+ * least one CPU for its own tasks.
+ */
+static int validate_partition(struct cpuset *cs, struct cpumask *new_cpus)
+{
+	struct cpuset *parent = parent_cs(cs);
+	struct cpumask *avail = partition_tmp_cpus;
+
+	if (!parent || !is_partition_root(parent) || cpumask_empty(new_cpus))
+		return -EINVAL;
+
+	cpumask_copy(avail, parent->effective_cpus);
+	if (is_partition_root(cs))
+		cpumask_or(avail, avail, cs->cpus_allowed);
+	if (!cpumask_subset(new_cpus, avail))
+		return -EINVAL;
+
+	cpumask_andnot(avail, parent->effective_cpus, new_cpus);
+	if (cpumask_empty(avail))
+		return -EINVAL;
+
+	return 0;
+}
+
+/*
+ * update_parent_subparts - hand @new_cpus from the parent over to @cs
+ *
+ * The CPUs @cs owned so far are given back first; a NULL @new_cpus just
+ * gives them back.  The caller then updates the effective cpumasks from
+ * the parent down.
+ */
+static void update_parent_subparts(struct cpuset *cs, struct cpumask *new_cpus)
+{
+	struct cpuset *parent = parent_cs(cs);
+
+	spin_lock_irq(&callback_lock);
+	cpumask_andnot(parent->subparts_cpus, parent->subparts_cpus,
+		       cs->cpus_allowed);
+	if (new_cpus)
+		cpumask_or(parent->subparts_cpus, parent->subparts_cpus,
+			   new_cpus);
+	parent->nr_subparts_cpus = cpumask_weight(parent->subparts_cpus);
+	spin_unlock_irq(&callback_lock);
+}
+
+/*
+ * update_isolated_cpus - keep unbound workqueues off isolated partitions
+ *
+ * Unbound kworkers would otherwise keep being scheduled on the CPUs that
+ * isolated partitions took out of load balancing.
+ */
+static void update_isolated_cpus(void)
+{
+	struct cpumask *new_isolated = partition_tmp_cpus;
+	struct cgroup_subsys_state *pos_css;
+	struct cpuset *cp;
+
+	cpumask_clear(new_isolated);
+	rcu_read_lock();
+	cpuset_for_each_descendant_pre(cp, pos_css, &top_cpuset) {
+		if (!is_partition_root(cp)) {
+			pos_css = css_rightmost_descendant(pos_css);
+			continue;
+		}
+		if (cp->partition_root_state != PRS_ISOLATED)
+			continue;
+		cpumask_or(new_isolated, new_isolated, cp->cpus_allowed);
+		cpumask_andnot(new_isolated, new_isolated, cp->subparts_cpus);
+	}
+	rcu_read_unlock();
+
+	if (cpumask_equal(new_isolated, isolated_cpus))
+		return;
+
+	cpumask_copy(isolated_cpus, new_isolated);
+	WARN_ON_ONCE(workqueue_unbound_exclude_cpumask(isolated_cpus) < 0);
+}
+
 /**
  * update_cpumask - update the cpus_allowed mask of a cpuset and all tasks in it
  * @cs: the cpuset to consider
@@ -993,12 +1261,26 @@ static int update_cpumask(struct cpuset *cs, struct cpuset *trialcs,
 	if (retval < 0)
 		return retval;
 
+	/* A partition root is resized by trading CPUs with its parent */
+	if (is_partition_root(cs)) {
+		retval = validate_partition(cs, trialcs->cpus_allowed);
+		if (retval < 0)
+			return retval;
+		update_parent_subparts(cs, trialcs->cpus_allowed);
+	}
+
 	spin_lock_irq(&callback_lock);
 	cpumask_copy(cs->cpus_allowed, trialcs->cpus_allowed);
 	spin_unlock_irq(&callback_lock);
 
 	/* use trialcs->cpus_allowed as a temp variable */
-	update_cpumasks_hier(cs, trialcs->cpus_allowed);
+	if (is_partition_root(cs)) {
+		update_cpumasks_hier(parent_cs(cs), trialcs->cpus_allowed);
+		update_isolated_cpus();
+		rebuild_sched_domains_locked();
+	} else {
+		update_cpumasks_hier(cs, trialcs->cpus_allowed);
+	}
 	return 0;
 }
 
@@ -1356,6 +1638,62 @@ static int update_flag(cpuset_flagbits_t bit, struct cpuset *cs,
 	return err;
 }
 
+/**
+ * update_prstate - change the partition root state of a cpuset
+ * @cs: the cpuset to consider
+ * @new_prs: PRS_MEMBER, PRS_ROOT or PRS_ISOLATED
+ *
+ * A new partition root takes its cpus_allowed away from its parent and
+ * becomes cpu exclusive.  A partition root can only become a member again
+ * once none of its children is a partition root.
+ *
+ * Called with cpuset_mutex held.
+ */
+static int update_prstate(struct cpuset *cs, int new_prs)
+{
+	int old_prs = cs->partition_root_state;
+	struct cpuset *parent = parent_cs(cs);
+	int err;
+
+	if (old_prs == new_prs)
+		return 0;
+
+	if (old_prs == PRS_MEMBER) {
+		err = validate_partition(cs, cs->cpus_allowed);
+		if (err)
+			return err;
+		/* Siblings must not overlap with us */
+		err = update_flag(CS_CPU_EXCLUSIVE, cs, 1);
+		if (err)
+			return err;
+		update_parent_subparts(cs, cs->cpus_allowed);
+	} else if (new_prs == PRS_MEMBER) {
+		if (cs->nr_subparts_cpus)
+			return -EBUSY;
+		update_parent_subparts(cs, NULL);
+	}
+
+	spin_lock_irq(&callback_lock);
+	if (new_prs == PRS_MEMBER)
+		clear_bit(CS_CPU_EXCLUSIVE, &cs->flags);
+	if (new_prs == PRS_ISOLATED)
+		clear_bit(CS_SCHED_LOAD_BALANCE, &cs->flags);
+	else
+		set_bit(CS_SCHED_LOAD_BALANCE, &cs->flags);
+	cs->partition_root_state = new_prs;
+	if (new_prs == PRS_MEMBER)
+		cs->partition_invalid = false;
+	spin_unlock_irq(&callback_lock);
+
+	/* The CPUs moved between @parent and @cs */
+	if (old_prs == PRS_MEMBER || new_prs == PRS_MEMBER)
+		update_cpumasks_hier(parent, partition_tmp_cpus);
+
+	update_isolated_cpus();
+	rebuild_sched_domains_locked();
+	return 0;
+}
+
 /*
  * Frequency meter - How fast is some event occurring?
  *
@@ -1606,6 +1944,7 @@ typedef enum {
 	FILE_MEMORY_PRESSURE,
 	FILE_SPREAD_PAGE,
 	FILE_SPREAD_SLAB,
+	FILE_PARTITION_ROOT,
 } cpuset_filetype_t;
 
 static int cpuset_write_u64(struct cgroup_subsys_state *css, struct cftype *cft,
@@ -1828,6 +2167,56 @@ static s64 cpuset_read_s64(struct cgroup_subsys_state *css, struct cftype *cft)
 	return 0;
 }
 
+static int sched_partition_show(struct seq_file *seq, void *v)
+{
+	struct cpuset *cs = css_cs(seq_css(seq));
+
+	switch (cs->partition_root_state) {
+	case PRS_ROOT:
+		seq_puts(seq, "root");
+		break;
+	case PRS_ISOLATED:
+		seq_puts(seq, "isolated");
+		break;
+	default:
+		seq_puts(seq, "member");
+		break;
+	}
+	seq_puts(seq, cs->partition_invalid ? " invalid\n" : "\n");
+
+	return 0;
+}
+
+static ssize_t sched_partition_write(struct kernfs_open_file *of, char *buf,
+				     size_t nbytes, loff_t off)
+{
+	struct cpuset *cs = css_cs(of_css(of));
+	int val;
+	int retval = -ENODEV;
+
+	buf = strstrip(buf);
+
+	if (!strcmp(buf, "root"))
+		val = PRS_ROOT;
+	else if (!strcmp(buf, "isolated"))
+		val = PRS_ISOLATED;
+	else if (!strcmp(buf, "member"))
+		val = PRS_MEMBER;
+	else
+		return -EINVAL;
+
+	css_get(&cs->css);
+	mutex_lock(&cpuset_mutex);
+	if (!is_cpuset_online(cs))
+		goto out_unlock;
+
+	retval = update_prstate(cs, val);
+out_unlock:
+	mutex_unlock(&cpuset_mutex);
+	css_put(&cs->css);
+	return retval ?: nbytes;
+}
+
 
 /*
  * for the common functions, 'private' gives the type of file
@@ -1935,6 +2324,51 @@ static struct cftype files[] = {
 	{ }	/* terminate */
 };
 
+/*
+ * This is currently a minimal set for the default hierarchy.
+ */
+static struct cftype dfl_files[] = {
+	{
+		.name = "cpus",
+		.seq_show = cpuset_common_seq_show,
+		.write = cpuset_write_resmask,
+		.max_write_len = (100U + 6 * NR_CPUS),
+		.private = FILE_CPULIST,
+		.flags = CFTYPE_NOT_ON_ROOT,
+	},
+
+	{
+		.name = "mems",
+		.seq_show = cpuset_common_seq_show,
+		.write = cpuset_write_resmask,
+		.max_write_len = (100U + 6 * MAX_NUMNODES),
+		.private = FILE_MEMLIST,
+		.flags = CFTYPE_NOT_ON_ROOT,
+	},
+
+	{
+		.name = "cpus.effective",
+		.seq_show = cpuset_common_seq_show,
+		.private = FILE_EFFECTIVE_CPULIST,
+	},
+
+	{
+		.name = "mems.effective",
+		.seq_show = cpuset_common_seq_show,
+		.private = FILE_EFFECTIVE_MEMLIST,
+	},
+
+	{
+		.name = "cpus.partition",
+		.seq_show = sched_partition_show,
+		.write = sched_partition_write,
+		.private = FILE_PARTITION_ROOT,
+		.flags = CFTYPE_NOT_ON_ROOT,
+	},
+
+	{ }	/* terminate */
+};
+
 /*
  *	cpuset_css_alloc - allocate a cpuset css
  *	cgrp:	control group that the new cpuset will be part of
@@ -1955,6 +2389,8 @@ cpuset_css_alloc(struct cgroup_subsys_state *parent_css)
 		goto free_cs;
 	if (!alloc_cpumask_var(&cs->effective_cpus, GFP_KERNEL))
 		goto free_cpus;
+	if (!zalloc_cpumask_var(&cs->subparts_cpus, GFP_KERNEL))
+		goto free_effective;
 
 	set_bit(CS_SCHED_LOAD_BALANCE, &cs->flags);
 	cpumask_clear(cs->cpus_allowed);
@@ -1966,6 +2402,8 @@ cpuset_css_alloc(struct cgroup_subsys_state *parent_css)
 
 	return &cs->css;
 
+free_effective:
+	free_cpumask_var(cs->effective_cpus);
 free_cpus:
 	free_cpumask_var(cs->cpus_allowed);
 free_cs:
@@ -2048,6 +2486,10 @@ static void cpuset_css_offline(struct cgroup_subsys_state *css)
 
 	mutex_lock(&cpuset_mutex);
 
+	/* Give the CPUs of a partition root back to its parent */
+	if (is_partition_root(cs))
+		update_prstate(cs, PRS_MEMBER);
+
 	if (is_sched_load_balance(cs))
 		update_flag(CS_SCHED_LOAD_BALANCE, cs, 0);
 
@@ -2061,6 +2503,7 @@ static void cpuset_css_free(struct cgroup_subsys_state *css)
 {
 	struct cpuset *cs = css_cs(css);
 
+	free_cpumask_var(cs->subparts_cpus);
 	free_cpumask_var(cs->effective_cpus);
 	free_cpumask_var(cs->cpus_allowed);
 	kfree(cs);
@@ -2110,6 +2553,7 @@ struct cgroup_subsys cpuset_cgrp_subsys = {
 	.bind		= cpuset_bind,
 	.fork		= cpuset_fork,
 	.legacy_cftypes	= files,
+	.dfl_cftypes	= dfl_files,
 	.early_init	= true,
 };
 
@@ -2125,6 +2569,9 @@ int __init cpuset_init(void)
 
 	BUG_ON(!alloc_cpumask_var(&top_cpuset.cpus_allowed, GFP_KERNEL));
 	BUG_ON(!alloc_cpumask_var(&top_cpuset.effective_cpus, GFP_KERNEL));
+	BUG_ON(!zalloc_cpumask_var(&top_cpuset.subparts_cpus, GFP_KERNEL));
+	BUG_ON(!zalloc_cpumask_var(&isolated_cpus, GFP_KERNEL));
+	BUG_ON(!alloc_cpumask_var(&partition_tmp_cpus, GFP_KERNEL));
 
 	cpumask_setall(top_cpuset.cpus_allowed);
 	nodes_setall(top_cpuset.mems_allowed);
@@ -2259,7 +2706,7 @@ static void cpuset_hotplug_update_tasks(struct cpuset *cs)
 		goto retry;
 	}
 
-	cpumask_and(&new_cpus, cs->cpus_allowed, parent_cs(cs)->effective_cpus);
+	compute_effective_cpumask(&new_cpus, cs, parent_cs(cs));
 	nodes_and(new_mems, cs->mems_allowed, parent_cs(cs)->effective_mems);
 
 	cpus_updated = !cpumask_equal(&new_cpus, cs->effective_cpus);
@@ -2314,6 +2761,15 @@ static void cpuset_hotplug_workfn(struct work_struct *work)
 	cpus_updated = !cpumask_equal(top_cpuset.effective_cpus, &new_cpus);
 	mems_updated = !nodes_equal(top_cpuset.effective_mems, new_mems);
 
+	/*
+	 * The CPUs handed to partition roots are not in top_cpuset's
+	 * effective_cpus, and any of them may have come or gone.
+	 */
+	if (top_cpuset.nr_subparts_cpus) {
+		cpumask_andnot(&new_cpus, &new_cpus, top_cpuset.subparts_cpus);
+		cpus_updated = true;
+	}
+
 	/* synchronize cpus_allowed to cpu_active_mask */
 	if (cpus_updated) {
 		spin_lock_irq(&callback_lock);
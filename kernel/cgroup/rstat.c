@@ -0,0 +1,254 @@
+/*
+ * Scalable hierarchical statistics for cgroups.
+ *
+ * Controllers keep their counters per cpu and call cgroup_rstat_updated()
+ * when they change one.  That puts the cgroup and its ancestors on a per
+ * cpu tree of updated cgroups, so that cgroup_rstat_flush() only visits
+ * the cgroups which changed since the last flush, children before their
+ * parents, and lets each controller fold the per cpu deltas of a cgroup
+ * into its totals and pass them on to its parent.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include "cgroup-internal.h"
+
+#include <linux/percpu.h>
+#include <linux/sched.h>
+#include <linux/spinlock.h>
+
+/*
+ * cgroup_rstat_lock serializes the flushers and protects the
+ * ->rstat_css_list of all cgroups.  The per cpu locks protect the
+ * updated trees and are nested inside it.
+ */
+static DEFINE_SPINLOCK(cgroup_rstat_lock);
+static DEFINE_PER_CPU(raw_spinlock_t, cgroup_rstat_cpu_lock);
+
+static struct cgroup_rstat_cpu *cgroup_rstat_cpu(struct cgroup *cgrp, int cpu)
+{
+	return per_cpu_ptr(cgrp->rstat_cpu, cpu);
+}
+
+/**
+ * cgroup_rstat_updated - note that a cgroup's statistics changed on a cpu
+ * @cgrp: target cgroup
+ * @cpu: cpu on which the statistics changed
+ *
+ * Puts @cgrp on @cpu's updated tree, so that the next cgroup_rstat_flush()
+ * of @cgrp or of one of its ancestors picks up the change.  This is
+ * cheap when @cgrp is already on the tree, which is the common case, and
+ * may be called from any context.
+ */
+void cgroup_rstat_updated(struct cgroup *cgrp, int cpu)
+{
+	raw_spinlock_t *cpu_lock = per_cpu_ptr(&cgroup_rstat_cpu_lock, cpu);
+	unsigned long flags;
+
+	/*
+	 * Speculative already-on-the-tree test.  A racing flush may have
+	 * just taken @cgrp off, in which case the change is picked up by
+	 * the flush after the next update.
+	 */
+	if (READ_ONCE(cgroup_rstat_cpu(cgrp, cpu)->updated_next))
+		return;
+
+	raw_spin_lock_irqsave(cpu_lock, flags);
+
+	/* put @cgrp and all its ancestors which are not yet on the tree */
+	while (true) {
+		struct cgroup_rstat_cpu *rstatc = cgroup_rstat_cpu(cgrp, cpu);
+		struct cgroup *parent = cgroup_parent(cgrp);
+		struct cgroup_rstat_cpu *prstatc;
+
+		/* additions and removals are both bottom-up */
+		if (rstatc->updated_next)
+			break;
+
+		/* the root has nowhere to be linked, mark it instead */
+		if (!parent) {
+			rstatc->updated_next = cgrp;
+			break;
+		}
+
+		prstatc = cgroup_rstat_cpu(parent, cpu);
+		rstatc->updated_next = prstatc->updated_children;
+		prstatc->updated_children = cgrp;
+
+		cgrp = parent;
+	}
+
+	raw_spin_unlock_irqrestore(cpu_lock, flags);
+}
+
+/*
+ * Returns the next cgroup of the subtree of @root to flush on @cpu after
+ * @pos, NULL starting the walk, and takes it off the updated tree.  The
+ * walk is in post order: a cgroup comes after all its updated children,
+ * and @root comes last.
+ */
+static struct cgroup *cgroup_rstat_cpu_pop_updated(struct cgroup *pos,
+						   struct cgroup *root, int cpu)
+{
+	struct cgroup_rstat_cpu *rstatc;
+	struct cgroup *parent;
+
+	if (pos == root)
+		return NULL;
+
+	/* walk down from whatever node is left to its first leaf */
+	pos = pos ? cgroup_parent(pos) : root;
+	while (true) {
+		rstatc = cgroup_rstat_cpu(pos, cpu);
+		if (rstatc->updated_children == pos)
+			break;
+		pos = rstatc->updated_children;
+	}
+
+	/*
+	 * Unlink @pos from its parent's list, which is singly linked.  The
+	 * walk removes the first child of its parent except for @root,
+	 * which may be anywhere on the list.
+	 */
+	parent = cgroup_parent(pos);
+	if (parent && rstatc->updated_next) {
+		struct cgroup **nextp;
+
+		nextp = &cgroup_rstat_cpu(parent, cpu)->updated_children;
+		while (*nextp != pos) {
+			WARN_ON_ONCE(*nextp == parent);
+			nextp = &cgroup_rstat_cpu(*nextp, cpu)->updated_next;
+		}
+
+		*nextp = rstatc->updated_next;
+		rstatc->updated_next = NULL;
+	}
+
+	return pos;
+}
+
+static void cgroup_rstat_flush_locked(struct cgroup *cgrp, bool may_sleep)
+{
+	int cpu;
+
+	lockdep_assert_held(&cgroup_rstat_lock);
+
+	for_each_possible_cpu(cpu) {
+		raw_spinlock_t *cpu_lock = per_cpu_ptr(&cgroup_rstat_cpu_lock,
+						       cpu);
+		struct cgroup *pos = NULL;
+
+		raw_spin_lock(cpu_lock);
+		while ((pos = cgroup_rstat_cpu_pop_updated(pos, cgrp, cpu))) {
+			struct cgroup_subsys_state *css;
+
+			list_for_each_entry(css, &pos->rstat_css_list,
+					    rstat_css_node)
+				css->ss->css_rstat_flush(css, cpu);
+		}
+		raw_spin_unlock(cpu_lock);
+
+		/* the walk holds off the other flushers, let them in */
+		if (may_sleep && (need_resched() ||
+				  spin_needbreak(&cgroup_rstat_lock))) {
+			spin_unlock_irq(&cgroup_rstat_lock);
+			if (!cond_resched())
+				cpu_relax();
+			spin_lock_irq(&cgroup_rstat_lock);
+		}
+	}
+}
+
+/**
+ * cgroup_rstat_flush - flush the statistics of a cgroup subtree
+ * @cgrp: target cgroup
+ *
+ * Calls ->css_rstat_flush() for every css of @cgrp and of its descendants
+ * which were updated since they were last flushed, on every cpu they were
+ * updated on, children first.  Once this returns the totals of all the
+ * controllers are up to date for @cgrp's subtree.  This is the single
+ * flush point for all the controllers using rstat, and may sleep.
+ */
+void cgroup_rstat_flush(struct cgroup *cgrp)
+{
+	might_sleep();
+
+	spin_lock_irq(&cgroup_rstat_lock);
+	cgroup_rstat_flush_locked(cgrp, true);
+	spin_unlock_irq(&cgroup_rstat_lock);
+}
+
+/* Makes @css flushed with its cgroup, if its controller has statistics */
+void cgroup_rstat_css_link(struct cgroup_subsys_state *css)
+{
+	if (!css->ss->css_rstat_flush)
+		return;
+
+	spin_lock_irq(&cgroup_rstat_lock);
+	list_add(&css->rstat_css_node, &css->cgroup->rstat_css_list);
+	spin_unlock_irq(&cgroup_rstat_lock);
+}
+
+/*
+ * Called before @css is freed.  The last changes of @css are flushed
+ * first: that passes them on to the parent, which is then put on the
+ * updated tree so that they are not left behind until its next update.
+ */
+void cgroup_rstat_css_unlink(struct cgroup_subsys_state *css)
+{
+	struct cgroup *cgrp = css->cgroup;
+	struct cgroup *parent = cgroup_parent(cgrp);
+
+	if (list_empty(&css->rstat_css_node))
+		return;
+
+	spin_lock_irq(&cgroup_rstat_lock);
+	cgroup_rstat_flush_locked(cgrp, false);
+	list_del_init(&css->rstat_css_node);
+	spin_unlock_irq(&cgroup_rstat_lock);
+
+	if (parent)
+		cgroup_rstat_updated(parent, raw_smp_processor_id());
+}
+
+int cgroup_rstat_init(struct cgroup *cgrp)
+{
+	int cpu;
+
+	cgrp->rstat_cpu = alloc_percpu(struct cgroup_rstat_cpu);
+	if (!cgrp->rstat_cpu)
+		return -ENOMEM;
+
+	/* an empty ->updated_children list is terminated by the cgroup */
+	for_each_possible_cpu(cpu)
+		cgroup_rstat_cpu(cgrp, cpu)->updated_children = cgrp;
+
+	return 0;
+}
+
+void cgroup_rstat_exit(struct cgroup *cgrp)
+{
+	int cpu;
+
+	cgroup_rstat_flush(cgrp);
+
+	for_each_possible_cpu(cpu) {
+		struct cgroup_rstat_cpu *rstatc = cgroup_rstat_cpu(cgrp, cpu);
+
+		if (WARN_ON_ONCE(rstatc->updated_children != cgrp) ||
+		    WARN_ON_ONCE(cgroup_parent(cgrp) && rstatc->updated_next))
+			return;
+	}
+
+	free_percpu(cgrp->rstat_cpu);
+	cgrp->rstat_cpu = NULL;
+}
+
+void __init cgroup_rstat_boot(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		raw_spin_lock_init(per_cpu_ptr(&cgroup_rstat_cpu_lock, cpu));
+}
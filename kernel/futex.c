@@ -61,12 +61,14 @@
 #include <linux/nsproxy.h>
 #include <linux/ptrace.h>
 #include <linux/sched/rt.h>
+#include <linux/sched/signal.h>
 #include <linux/sched/wake_q.h>
 #include <linux/sched/mm.h>
 #include <linux/hugetlb.h>
 #include <linux/freezer.h>
 #include <linux/bootmem.h>
 #include <linux/fault-inject.h>
+#include <linux/prctl.h>
 
 #include <asm/futex.h>
 
@@ -270,13 +272,42 @@ struct futex_hash_bucket {
  * (after initialization only in hash_futex()), so ensure that they
  * reside in the same cacheline.
  */
-static struct {
+struct futex_hash {
 	struct futex_hash_bucket *queues;
 	unsigned long            hashsize;
-} __futex_data __read_mostly __aligned(2*sizeof(long));
+};
+
+static struct futex_hash __futex_data __read_mostly __aligned(2*sizeof(long));
 #define futex_queues   (__futex_data.queues)
 #define futex_hashsize (__futex_data.hashsize)
 
+/*
+ * The FUTEX_PRIVATE_FLAG futexes of a process can be hashed into a table
+ * of its own, so that unrelated processes don't contend on the same hash
+ * bucket locks and the buckets sit on the node of the process rather than
+ * being spread over all of them.
+ *
+ * Where the private futexes of an mm are hashed is decided once, on its
+ * first private futex operation or by PR_FUTEX_HASH_SET_SLOTS, and never
+ * changes afterwards: mm->futex_hash then points either to a private hash
+ * or to the global one. The private tables are only created by default
+ * with futex_private_hash=1, sized from the number of threads.
+ */
+struct futex_private_hash {
+	struct futex_hash		hash;
+	struct futex_hash_bucket	queues[];
+};
+
+#define FUTEX_PRIVATE_HASH_MIN	16
+
+static bool futex_private_hash_auto __read_mostly;
+
+static int __init setup_futex_private_hash(char *str)
+{
+	return !strtobool(str, &futex_private_hash_auto);
+}
+__setup("futex_private_hash=", setup_futex_private_hash);
+
 
 /*
  * Fault injections for futexes.
@@ -392,10 +423,120 @@ static inline int hb_waiters_pending(struct futex_hash_bucket *hb)
  */
 static struct futex_hash_bucket *hash_futex(union futex_key *key)
 {
+	struct futex_hash *fh = &__futex_data;
 	u32 hash = jhash2((u32*)&key->both.word,
 			  (sizeof(key->both.word)+sizeof(key->both.ptr))/4,
 			  key->both.offset);
-	return &futex_queues[hash & (futex_hashsize - 1)];
+
+	/* get_futex_key() made sure the hash of private keys is set up */
+	if (!(key->both.offset & (FUT_OFF_INODE | FUT_OFF_MMSHARED)))
+		fh = READ_ONCE(key->private.mm->futex_hash);
+
+	return &fh->queues[hash & (fh->hashsize - 1)];
+}
+
+static void futex_hash_init_buckets(struct futex_hash *fh)
+{
+	unsigned long i;
+
+	for (i = 0; i < fh->hashsize; i++) {
+		atomic_set(&fh->queues[i].waiters, 0);
+		plist_head_init(&fh->queues[i].chain);
+		spin_lock_init(&fh->queues[i].lock);
+	}
+}
+
+static struct futex_hash *futex_private_hash_alloc(unsigned long slots)
+{
+	struct futex_private_hash *fph;
+
+	fph = kvzalloc_node(sizeof(*fph) + slots * sizeof(fph->queues[0]),
+			    GFP_KERNEL, numa_node_id());
+	if (!fph)
+		return NULL;
+
+	fph->hash.queues = fph->queues;
+	fph->hash.hashsize = slots;
+	futex_hash_init_buckets(&fph->hash);
+
+	return &fph->hash;
+}
+
+static void futex_hash_free(struct futex_hash *fh)
+{
+	if (fh && fh != &__futex_data)
+		kvfree(container_of(fh, struct futex_private_hash, hash));
+}
+
+/*
+ * Make @fh the hash of the private futexes of @mm, unless that was
+ * already decided.
+ */
+static int futex_hash_install(struct mm_struct *mm, struct futex_hash *fh)
+{
+	if (!cmpxchg(&mm->futex_hash, NULL, fh))
+		return 0;
+
+	futex_hash_free(fh);
+	return -EBUSY;
+}
+
+static noinline void futex_private_hash_setup(struct mm_struct *mm)
+{
+	struct futex_hash *fh = NULL;
+	unsigned long slots;
+
+	if (futex_private_hash_auto) {
+		slots = roundup_pow_of_two(4 * get_nr_threads(current));
+		slots = clamp_t(unsigned long, slots, FUTEX_PRIVATE_HASH_MIN,
+				futex_hashsize);
+		fh = futex_private_hash_alloc(slots);
+	}
+	if (!fh)
+		fh = &__futex_data;
+
+	futex_hash_install(mm, fh);
+}
+
+/*
+ * Called once the last user of @mm is gone, so no futex can be queued in
+ * its private hash anymore.
+ */
+void futex_mm_release(struct mm_struct *mm)
+{
+	futex_hash_free(mm->futex_hash);
+	mm->futex_hash = NULL;
+}
+
+int futex_hash_prctl(unsigned long arg2, unsigned long arg3)
+{
+	struct mm_struct *mm = current->mm;
+	struct futex_hash *fh;
+
+	switch (arg2) {
+	case PR_FUTEX_HASH_SET_SLOTS:
+		if (!arg3) {
+			fh = &__futex_data;
+		} else {
+			if (!is_power_of_2(arg3) || arg3 > futex_hashsize)
+				return -EINVAL;
+			if (READ_ONCE(mm->futex_hash))
+				return -EBUSY;
+			fh = futex_private_hash_alloc(arg3);
+			if (!fh)
+				return -ENOMEM;
+		}
+		return futex_hash_install(mm, fh);
+
+	case PR_FUTEX_HASH_GET_SLOTS:
+		fh = READ_ONCE(mm->futex_hash);
+		if (!fh || fh == &__futex_data)
+			return 0;
+		return fh->hashsize;
+
+	default:
+		return -EINVAL;
+	}
 }
 
 
@@ -527,6 +668,8 @@ get_futex_key(u32 __user *uaddr, int fshared, union futex_key *key, int rw)
 	 *        but access_ok() should be faster than find_vma()
 	 */
 	if (!fshared) {
+		if (unlikely(!READ_ONCE(mm->futex_hash)))
+			futex_private_hash_setup(mm);
 		key->private.mm = mm;
 		key->private.address = address;
 		get_futex_key_refs(key);  /* implies smp_mb(); (B) */
@@ -2646,6 +2789,210 @@ static int futex_wait(u32 __user *uaddr, unsigned int flags, u32 val,
 	return ret;
 }
 
+struct futex_vector {
+	struct futex_q q;
+	struct futex_wait_block w;
+};
+
+/**
+ * futex_unqueue_multiple() - Remove several futex_q from their hash buckets
+ * @vs:		the futexes to unqueue
+ * @count:	the number of futexes in @vs
+ *
+ * Return:
+ *  - >=0 - the index of the first futex that was already woken
+ *  -  -1 - if none of the futexes was woken
+ */
+static int futex_unqueue_multiple(struct futex_vector *vs, int count)
+{
+	int ret = -1, i;
+
+	for (i = 0; i < count; i++) {
+		/* unqueue_me() drops q.key ref */
+		if (!unqueue_me(&vs[i].q) && ret < 0)
+			ret = i;
+	}
+
+	return ret;
+}
+
+/**
+ * futex_wait_multiple_setup() - Prepare to wait on several futexes
+ * @vs:		the futexes to wait on
+ * @count:	the number of futexes in @vs
+ * @flags:	futex flags (FLAGS_SHARED, etc.)
+ * @woken:	storage for the index of a futex already woken
+ *
+ * Queue a futex_q on each of the futexes, in as many hash buckets. As for
+ * futex_wait_setup(), each futex value is checked with its hash bucket
+ * locked, but the task state is set before the first one gets queued so
+ * that a wakeup on any of them is not lost before we sleep.
+ *
+ * Return:
+ *  -  0 - all the futexes are queued, the task state is TASK_INTERRUPTIBLE;
+ *  -  1 - a futex was woken while queueing the others, its index is in
+ *	   @woken and none of the futexes is queued anymore;
+ *  - <0 - -EFAULT or -EWOULDBLOCK, nothing is queued
+ */
+static int futex_wait_multiple_setup(struct futex_vector *vs, int count,
+				     unsigned int flags, int *woken)
+{
+	struct futex_hash_bucket *hb;
+	u32 __user *uaddr;
+	int ret, i, j;
+	u32 uval;
+
+retry:
+	for (i = 0; i < count; i++) {
+		uaddr = u64_to_user_ptr(vs[i].w.uaddr);
+		ret = get_futex_key(uaddr, flags & FLAGS_SHARED, &vs[i].q.key,
+				    VERIFY_READ);
+		if (unlikely(ret)) {
+			for (j = 0; j < i; j++)
+				put_futex_key(&vs[j].q.key);
+			return ret;
+		}
+	}
+
+	set_current_state(TASK_INTERRUPTIBLE);
+
+	for (i = 0; i < count; i++) {
+		uaddr = u64_to_user_ptr(vs[i].w.uaddr);
+		hb = queue_lock(&vs[i].q);
+
+		ret = get_futex_value_locked(&uval, uaddr);
+		if (!ret && uval == vs[i].w.val) {
+			queue_me(&vs[i].q, hb);
+			continue;
+		}
+
+		queue_unlock(hb);
+		__set_current_state(TASK_RUNNING);
+
+		*woken = futex_unqueue_multiple(vs, i);
+		for (j = i; j < count; j++)
+			put_futex_key(&vs[j].q.key);
+		if (*woken >= 0)
+			return 1;
+
+		if (!ret)
+			return -EWOULDBLOCK;
+
+		if (get_user(uval, uaddr))
+			return -EFAULT;
+		goto retry;
+	}
+
+	return 0;
+}
+
+static bool futex_any_woken(struct futex_vector *vs, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (plist_node_empty(&vs[i].q.list))
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * futex_wait_multiple() - Wait until one of several futexes is woken
+ * @ublocks:	the userspace array of futex_wait_block
+ * @flags:	futex flags (FLAGS_SHARED, etc.)
+ * @count:	the number of entries in @ublocks
+ * @abs_time:	absolute timeout, or NULL for none
+ *
+ * Return: the index of the woken futex, or a negative error code
+ */
+static int futex_wait_multiple(u32 __user *ublocks, unsigned int flags,
+			       u32 count, ktime_t *abs_time)
+{
+	struct futex_wait_block __user *ub = (void __user *)ublocks;
+	struct hrtimer_sleeper timeout, *to = NULL;
+	struct futex_vector *vs;
+	int ret, woken, i;
+
+	if (!count || count > FUTEX_WAIT_MULTIPLE_MAX)
+		return -EINVAL;
+
+	vs = kcalloc(count, sizeof(*vs), GFP_KERNEL);
+	if (!vs)
+		return -ENOMEM;
+
+	for (i = 0; i < count; i++) {
+		if (copy_from_user(&vs[i].w, &ub[i], sizeof(vs[i].w))) {
+			ret = -EFAULT;
+			goto out_free;
+		}
+		if (!vs[i].w.bitset) {
+			ret = -EINVAL;
+			goto out_free;
+		}
+		vs[i].q = futex_q_init;
+		vs[i].q.bitset = vs[i].w.bitset;
+	}
+
+	if (abs_time) {
+		to = &timeout;
+
+		hrtimer_init_on_stack(&to->timer, (flags & FLAGS_CLOCKRT) ?
+				      CLOCK_REALTIME : CLOCK_MONOTONIC,
+				      HRTIMER_MODE_ABS);
+		hrtimer_init_sleeper(to, current);
+		hrtimer_set_expires_range_ns(&to->timer, *abs_time,
+					     current->timer_slack_ns);
+	}
+
+	while (true) {
+		ret = futex_wait_multiple_setup(vs, count, flags, &woken);
+		if (ret) {
+			if (ret > 0)
+				ret = woken;
+			break;
+		}
+
+		if (to)
+			hrtimer_start_expires(&to->timer, HRTIMER_MODE_ABS);
+
+		/*
+		 * Skip the call to schedule() if one of the futexes has
+		 * already been woken, or if the timer has already expired.
+		 */
+		if (!futex_any_woken(vs, count) && (!to || to->task))
+			freezable_schedule();
+		__set_current_state(TASK_RUNNING);
+
+		ret = futex_unqueue_multiple(vs, count);
+		if (ret >= 0)
+			break;
+
+		ret = -ETIMEDOUT;
+		if (to && !to->task)
+			break;
+
+		/*
+		 * The timeout is absolute, so the syscall can simply be
+		 * restarted with the same arguments.
+		 */
+		ret = -ERESTARTSYS;
+		if (signal_pending(current))
+			break;
+
+		/* A spurious wakeup, wait again. */
+	}
+
+	if (to) {
+		hrtimer_cancel(&to->timer);
+		destroy_hrtimer_on_stack(&to->timer);
+	}
+out_free:
+	kfree(vs);
+	return ret;
+}
+
 
 static long futex_wait_restart(struct restart_block *restart)
 {
@@ -3470,7 +3817,7 @@ long do_futex(u32 __user *uaddr, int op, u32 val, ktime_t *timeout,
 	if (op & FUTEX_CLOCK_REALTIME) {
 		flags |= FLAGS_CLOCKRT;
 		if (cmd != FUTEX_WAIT && cmd != FUTEX_WAIT_BITSET && \
-		    cmd != FUTEX_WAIT_REQUEUE_PI)
+		    cmd != FUTEX_WAIT_REQUEUE_PI && cmd != FUTEX_WAIT_MULTIPLE)
 			return -ENOSYS;
 	}
 
@@ -3511,6 +3858,8 @@ long do_futex(u32 __user *uaddr, int op, u32 val, ktime_t *timeout,
 					     uaddr2);
 	case FUTEX_CMP_REQUEUE_PI:
 		return futex_requeue(uaddr, flags, uaddr2, val, val2, &val3, 1);
+	case FUTEX_WAIT_MULTIPLE:
+		return futex_wait_multiple(uaddr, flags, val, timeout);
 	}
 	return -ENOSYS;
 }
@@ -3527,7 +3876,8 @@ SYSCALL_DEFINE6(futex, u32 __user *, uaddr, int, op, u32, val,
 
 	if (utime && (cmd == FUTEX_WAIT || cmd == FUTEX_LOCK_PI ||
 		      cmd == FUTEX_WAIT_BITSET ||
-		      cmd == FUTEX_WAIT_REQUEUE_PI)) {
+		      cmd == FUTEX_WAIT_REQUEUE_PI ||
+		      cmd == FUTEX_WAIT_MULTIPLE)) {
 		if (unlikely(should_fail_futex(!(op & FUTEX_PRIVATE_FLAG))))
 			return -EFAULT;
 		if (copy_from_user(&ts, utime, sizeof(ts)) != 0)
@@ -3574,7 +3924,6 @@ static void __init futex_detect_cmpxchg(void)
 static int __init futex_init(void)
 {
 	unsigned int futex_shift;
-	unsigned long i;
 
 #if CONFIG_BASE_SMALL
 	futex_hashsize = 16;
@@ -3590,12 +3939,7 @@ static int __init futex_init(void)
 	futex_hashsize = 1UL << futex_shift;
 
 	futex_detect_cmpxchg();
-
-	for (i = 0; i < futex_hashsize; i++) {
-		atomic_set(&futex_queues[i].waiters, 0);
-		plist_head_init(&futex_queues[i].chain);
-		spin_lock_init(&futex_queues[i].lock);
-	}
+	futex_hash_init_buckets(&__futex_data);
 
 	return 0;
 }
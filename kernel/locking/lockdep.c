@@ -229,6 +229,8 @@ struct lock_class_stats lock_stats(struct lock_class *class)
 		lock_time_add(&pcs->read_holdtime, &stats.read_holdtime);
 		lock_time_add(&pcs->write_holdtime, &stats.write_holdtime);
 
+		lock_time_add(&pcs->handoff_waittime, &stats.handoff_waittime);
+
 		for (i = 0; i < ARRAY_SIZE(stats.bounces); i++)
 			stats.bounces[i] += pcs->bounces[i];
 	}
@@ -4214,6 +4216,38 @@ __lock_acquired(struct lockdep_map *lock, unsigned long ip)
 	lock->ip = ip;
 }
 
+/*
+ * The lock was handed off to the waiter after it asked for it, account the
+ * time it waited since it contended on the lock.
+ */
+static void
+__lock_handoff(struct lockdep_map *lock, unsigned long ip)
+{
+	struct task_struct *curr = current;
+	struct held_lock *hlock;
+	struct lock_class_stats *stats;
+	unsigned int depth;
+	int i;
+
+	depth = curr->lockdep_depth;
+	if (DEBUG_LOCKS_WARN_ON(!depth))
+		return;
+
+	hlock = find_held_lock(curr, lock, depth, &i);
+	if (!hlock) {
+		print_lock_contention_bug(curr, lock, ip);
+		return;
+	}
+
+	if (hlock->instance != lock || !hlock->waittime_stamp)
+		return;
+
+	stats = get_lock_stats(hlock_class(hlock));
+	lock_time_inc(&stats->handoff_waittime,
+		      lockstat_clock() - hlock->waittime_stamp);
+	put_lock_stats(stats);
+}
+
 void lock_contended(struct lockdep_map *lock, unsigned long ip)
 {
 	unsigned long flags;
@@ -4252,6 +4286,25 @@ void lock_acquired(struct lockdep_map *lock, unsigned long ip)
 	raw_local_irq_restore(flags);
 }
 EXPORT_SYMBOL_GPL(lock_acquired);
+
+void lock_handoff(struct lockdep_map *lock, unsigned long ip)
+{
+	unsigned long flags;
+
+	if (unlikely(!lock_stat))
+		return;
+
+	if (unlikely(current->lockdep_recursion))
+		return;
+
+	raw_local_irq_save(flags);
+	check_flags(flags);
+	current->lockdep_recursion = 1;
+	__lock_handoff(lock, ip);
+	current->lockdep_recursion = 0;
+	raw_local_irq_restore(flags);
+}
+EXPORT_SYMBOL_GPL(lock_handoff);
 #endif
 
 /*
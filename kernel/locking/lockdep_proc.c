@@ -500,6 +500,13 @@ static void seq_stats(struct seq_file *m, struct lock_stat_data *data)
 		seq_puts(m, "\n");
 	}
 
+	if (stats->handoff_waittime.nr) {
+		seq_printf(m, "%38s-H:", name);
+		seq_printf(m, "%14s ", "");
+		seq_lock_time(m, &stats->handoff_waittime);
+		seq_puts(m, "\n");
+	}
+
 	if (stats->read_waittime.nr + stats->write_waittime.nr == 0)
 		return;
 
@@ -545,7 +552,7 @@ static void seq_stats(struct seq_file *m, struct lock_stat_data *data)
 
 static void seq_header(struct seq_file *m)
 {
-	seq_puts(m, "lock_stat version 0.4\n");
+	seq_puts(m, "lock_stat version 0.5\n");
 
 	if (unlikely(!debug_locks))
 		seq_printf(m, "*WARNING* lock debugging disabled!! - possibly due to a lockdep warning\n");
@@ -228,6 +228,65 @@ static struct lock_torture_ops spin_lock_irq_ops = {
 	.name		= "spin_lock_irq"
 };
 
+#ifdef CONFIG_NUMA_AWARE_SPINLOCKS
+/*
+ * Drive the native and the NUMA-aware queued spinlock slow paths directly,
+ * whichever one was selected at boot, so that they can be compared.
+ */
+static struct qspinlock torture_qspinlock = __ARCH_SPIN_LOCK_UNLOCKED;
+
+static void torture_qspin_lock(void (*slowpath)(struct qspinlock *lock,
+						u32 val))
+{
+	u32 val;
+
+	preempt_disable();
+	val = atomic_cmpxchg_acquire(&torture_qspinlock.val, 0, _Q_LOCKED_VAL);
+	if (val)
+		slowpath(&torture_qspinlock, val);
+}
+
+static int torture_qspin_native_write_lock(void)
+{
+	torture_qspin_lock(native_queued_spin_lock_slowpath);
+	return 0;
+}
+
+static int torture_qspin_cna_write_lock(void)
+{
+	torture_qspin_lock(__cna_queued_spin_lock_slowpath);
+	return 0;
+}
+
+static void torture_qspin_write_unlock(void)
+{
+	native_queued_spin_unlock(&torture_qspinlock);
+	preempt_enable();
+}
+
+static struct lock_torture_ops qspin_native_ops = {
+	.writelock	= torture_qspin_native_write_lock,
+	.write_delay	= torture_spin_lock_write_delay,
+	.task_boost     = torture_boost_dummy,
+	.writeunlock	= torture_qspin_write_unlock,
+	.readlock       = NULL,
+	.read_delay     = NULL,
+	.readunlock     = NULL,
+	.name		= "qspin_native"
+};
+
+static struct lock_torture_ops qspin_cna_ops = {
+	.writelock	= torture_qspin_cna_write_lock,
+	.write_delay	= torture_spin_lock_write_delay,
+	.task_boost     = torture_boost_dummy,
+	.writeunlock	= torture_qspin_write_unlock,
+	.readlock       = NULL,
+	.read_delay     = NULL,
+	.readunlock     = NULL,
+	.name		= "qspin_cna"
+};
+#endif
+
 static DEFINE_RWLOCK(torture_rwlock);
 
 static int torture_rwlock_write_lock(void) __acquires(torture_rwlock)
@@ -869,6 +928,9 @@ static int __init lock_torture_init(void)
 	static struct lock_torture_ops *torture_ops[] = {
 		&lock_busted_ops,
 		&spin_lock_ops, &spin_lock_irq_ops,
+#ifdef CONFIG_NUMA_AWARE_SPINLOCKS
+		&qspin_native_ops, &qspin_cna_ops,
+#endif
 		&rw_lock_ops, &rw_lock_irq_ops,
 		&mutex_lock_ops,
 		&ww_mutex_lock_ops,
@@ -33,14 +33,19 @@ do {									\
 } while (0)
 #endif
 
-#ifndef arch_mcs_spin_unlock_contended
+#ifndef arch_mcs_lock_handoff
 /*
  * smp_store_release() provides a memory barrier to ensure all
  * operations in the critical section has been completed before
- * unlocking.
+ * unlocking.  A value other than 1 passes state on to the next waiter.
  */
+#define arch_mcs_lock_handoff(l, val)					\
+	smp_store_release((l), (val))
+#endif
+
+#ifndef arch_mcs_spin_unlock_contended
 #define arch_mcs_spin_unlock_contended(l)				\
-	smp_store_release((l), 1)
+	arch_mcs_lock_handoff((l), 1)
 #endif
 
 /*
@@ -9,6 +9,9 @@
  *
  * Optimistic spinning by Tim Chen <tim.c.chen@intel.com>
  * and Davidlohr Bueso <davidlohr@hp.com>. Based on mutexes.
+ *
+ * Reader optimistic spinning and writer lock handoff, so that spinning
+ * readers cannot starve the writers queued behind them.
  */
 #include <linux/rwsem.h>
 #include <linux/init.h>
@@ -17,6 +20,7 @@
 #include <linux/sched/rt.h>
 #include <linux/sched/wake_q.h>
 #include <linux/sched/debug.h>
+#include <linux/sched/clock.h>
 #include <linux/osq_lock.h>
 
 #include "rwsem.h"
@@ -88,6 +92,7 @@ void __init_rwsem(struct rw_semaphore *sem, const char *name,
 	INIT_LIST_HEAD(&sem->wait_list);
 #ifdef CONFIG_RWSEM_SPIN_ON_OWNER
 	sem->owner = NULL;
+	sem->handoff = false;
 	osq_lock_init(&sem->osq);
 #endif
 }
@@ -105,6 +110,15 @@ struct rwsem_waiter {
 	enum rwsem_waiter_type type;
 };
 
+/*
+ * Time a writer may wait at the head of the queue before it asks for
+ * the lock to be handed off to it, and time a reader may spin on a
+ * reader-owned rwsem, which gives no indication of whether its owners
+ * are still running.
+ */
+#define RWSEM_WAIT_TIMEOUT	DIV_ROUND_UP(HZ, 250)
+#define RWSEM_RSPIN_THRESHOLD	(20 * NSEC_PER_USEC)
+
 enum rwsem_wake_type {
 	RWSEM_WAKE_ANY,		/* Wake whatever's at head of wait list */
 	RWSEM_WAKE_READERS,	/* Wake readers only */
@@ -219,6 +233,9 @@ static void __rwsem_mark_wake(struct rw_semaphore *sem,
 		atomic_long_add(adjustment, &sem->count);
 }
 
+static bool rwsem_can_spin_on_owner(struct rw_semaphore *sem, bool wlock);
+static bool rwsem_optimistic_spin(struct rw_semaphore *sem, bool wlock);
+
 /*
  * Wait for the read lock to be granted
  */
@@ -227,13 +244,27 @@ __rwsem_down_read_failed_common(struct rw_semaphore *sem, int state)
 {
 	long count, adjustment = -RWSEM_ACTIVE_READ_BIAS;
 	struct rwsem_waiter waiter;
+	bool first;
 	DEFINE_WAKE_Q(wake_q);
 
+	/*
+	 * Stop active locking and spin for the lock while its owner is
+	 * running. If no active lockers are left, the queued waiters are
+	 * woken up below when we fail to take the lock ourselves.
+	 */
+	if (rwsem_can_spin_on_owner(sem, false)) {
+		atomic_long_add(-RWSEM_ACTIVE_READ_BIAS, &sem->count);
+		adjustment = 0;
+		if (rwsem_optimistic_spin(sem, false))
+			return sem;
+	}
+
 	waiter.task = current;
 	waiter.type = RWSEM_WAITING_FOR_READ;
 
 	raw_spin_lock_irq(&sem->wait_lock);
-	if (list_empty(&sem->wait_list))
+	first = list_empty(&sem->wait_list);
+	if (first)
 		adjustment += RWSEM_WAITING_BIAS;
 	list_add_tail(&waiter.list, &sem->wait_list);
 
@@ -247,8 +278,7 @@ __rwsem_down_read_failed_common(struct rw_semaphore *sem, int state)
 	 * wake our own waiter to join the existing active readers !
 	 */
 	if (count == RWSEM_WAITING_BIAS ||
-	    (count > RWSEM_WAITING_BIAS &&
-	     adjustment != -RWSEM_ACTIVE_READ_BIAS))
+	    (count > RWSEM_WAITING_BIAS && first))
 		__rwsem_mark_wake(sem, RWSEM_WAKE_ANY, &wake_q);
 
 	raw_spin_unlock_irq(&sem->wait_lock);
@@ -299,7 +329,8 @@ EXPORT_SYMBOL(rwsem_down_read_failed_killable);
  * race conditions between checking the rwsem wait list and setting the
  * sem->count accordingly.
  */
-static inline bool rwsem_try_write_lock(long count, struct rw_semaphore *sem)
+static inline bool rwsem_try_write_lock(long count, struct rw_semaphore *sem,
+					bool handoff)
 {
 	/*
 	 * Avoid trying to acquire write lock if count isn't RWSEM_WAITING_BIAS.
@@ -307,6 +338,10 @@ static inline bool rwsem_try_write_lock(long count, struct rw_semaphore *sem)
 	if (count != RWSEM_WAITING_BIAS)
 		return false;
 
+	/* Leave the lock to the writer which asked for it to be handed off. */
+	if (!handoff && rwsem_handoff_pending(sem))
+		return false;
+
 	/*
 	 * Acquire the lock by trying to set it to ACTIVE_WRITE_BIAS. If there
 	 * are other tasks on the wait list, we need to add on WAITING_BIAS.
@@ -318,6 +353,8 @@ static inline bool rwsem_try_write_lock(long count, struct rw_semaphore *sem)
 	if (atomic_long_cmpxchg_acquire(&sem->count, RWSEM_WAITING_BIAS, count)
 							== RWSEM_WAITING_BIAS) {
 		rwsem_set_owner(sem);
+		if (handoff)
+			rwsem_clear_handoff(sem);
 		return true;
 	}
 
@@ -333,7 +370,8 @@ static inline bool rwsem_try_write_lock_unqueued(struct rw_semaphore *sem)
 	long old, count = atomic_long_read(&sem->count);
 
 	while (true) {
-		if (!(count == 0 || count == RWSEM_WAITING_BIAS))
+		if (!(count == 0 || count == RWSEM_WAITING_BIAS) ||
+		    rwsem_handoff_pending(sem))
 			return false;
 
 		old = atomic_long_cmpxchg_acquire(&sem->count, count,
@@ -347,21 +385,47 @@ static inline bool rwsem_try_write_lock_unqueued(struct rw_semaphore *sem)
 	}
 }
 
-static inline bool rwsem_can_spin_on_owner(struct rw_semaphore *sem)
+/*
+ * Try to acquire read lock before the reader has been put on wait queue.
+ * The count cannot tell active readers with waiters apart from an active
+ * writer without waiters, so readers only join the lock when there are
+ * no other waiters, or when there are no active lockers at all.
+ */
+static inline bool rwsem_try_read_lock_unqueued(struct rw_semaphore *sem)
+{
+	long old, count = atomic_long_read(&sem->count);
+
+	while (true) {
+		if (!(count >= 0 || count == RWSEM_WAITING_BIAS) ||
+		    rwsem_handoff_pending(sem))
+			return false;
+
+		old = atomic_long_cmpxchg_acquire(&sem->count, count,
+				      count + RWSEM_ACTIVE_READ_BIAS);
+		if (old == count) {
+			rwsem_set_reader_owned(sem);
+			return true;
+		}
+
+		count = old;
+	}
+}
+
+static bool rwsem_can_spin_on_owner(struct rw_semaphore *sem, bool wlock)
 {
 	struct task_struct *owner;
 	bool ret = true;
 
-	if (need_resched())
+	if (need_resched() || rwsem_handoff_pending(sem))
 		return false;
 
 	rcu_read_lock();
 	owner = READ_ONCE(sem->owner);
 	if (!rwsem_owner_is_writer(owner)) {
 		/*
-		 * Don't spin if the rwsem is readers owned.
+		 * Only readers spin if the rwsem is readers owned.
 		 */
-		ret = !rwsem_owner_is_reader(owner);
+		ret = !wlock || !rwsem_owner_is_reader(owner);
 		goto done;
 	}
 
@@ -378,7 +442,7 @@ static inline bool rwsem_can_spin_on_owner(struct rw_semaphore *sem)
 /*
  * Return true only if we can still spin on the owner field of the rwsem.
  */
-static noinline bool rwsem_spin_on_owner(struct rw_semaphore *sem)
+static noinline bool rwsem_spin_on_owner(struct rw_semaphore *sem, bool wlock)
 {
 	struct task_struct *owner = READ_ONCE(sem->owner);
 
@@ -411,19 +475,21 @@ static noinline bool rwsem_spin_on_owner(struct rw_semaphore *sem)
 out:
 	/*
 	 * If there is a new owner or the owner is not set, we continue
-	 * spinning.
+	 * spinning. Readers also keep spinning on a reader-owned rwsem,
+	 * for a bounded time.
 	 */
-	return !rwsem_owner_is_reader(READ_ONCE(sem->owner));
+	return !wlock || !rwsem_owner_is_reader(READ_ONCE(sem->owner));
 }
 
-static bool rwsem_optimistic_spin(struct rw_semaphore *sem)
+static bool rwsem_optimistic_spin(struct rw_semaphore *sem, bool wlock)
 {
 	bool taken = false;
+	u64 rspin_end = 0;
 
 	preempt_disable();
 
 	/* sem->wait_lock should not be held when doing optimistic spinning */
-	if (!rwsem_can_spin_on_owner(sem))
+	if (!rwsem_can_spin_on_owner(sem, wlock))
 		goto done;
 
 	if (!osq_lock(&sem->osq))
@@ -434,17 +500,32 @@ static bool rwsem_optimistic_spin(struct rw_semaphore *sem)
 	 * lock whenever the owner changes. Spinning will be stopped when:
 	 *  1) the owning writer isn't running; or
 	 *  2) readers own the lock as we can't determine if they are
-	 *     actively running or not.
+	 *     actively running or not, unless we are a reader that has
+	 *     spun for less than RWSEM_RSPIN_THRESHOLD; or
+	 *  3) a waiting writer asked for the lock to be handed off.
 	 */
-	while (rwsem_spin_on_owner(sem)) {
+	while (rwsem_spin_on_owner(sem, wlock)) {
 		/*
 		 * Try to acquire the lock
 		 */
-		if (rwsem_try_write_lock_unqueued(sem)) {
+		if (wlock ? rwsem_try_write_lock_unqueued(sem) :
+			    rwsem_try_read_lock_unqueued(sem)) {
 			taken = true;
 			break;
 		}
 
+		if (rwsem_handoff_pending(sem))
+			break;
+
+		if (!wlock && rwsem_owner_is_reader(READ_ONCE(sem->owner))) {
+			u64 now = local_clock();
+
+			if (!rspin_end)
+				rspin_end = now + RWSEM_RSPIN_THRESHOLD;
+			else if (need_resched() || now > rspin_end)
+				break;
+		}
+
 		/*
 		 * When there's no owner, we might have preempted between the
 		 * owner acquiring the lock and setting the owner field. If
@@ -477,7 +558,12 @@ static inline bool rwsem_has_spinner(struct rw_semaphore *sem)
 }
 
 #else
-static bool rwsem_optimistic_spin(struct rw_semaphore *sem)
+static bool rwsem_can_spin_on_owner(struct rw_semaphore *sem, bool wlock)
+{
+	return false;
+}
+
+static bool rwsem_optimistic_spin(struct rw_semaphore *sem, bool wlock)
 {
 	return false;
 }
@@ -496,6 +582,8 @@ __rwsem_down_write_failed_common(struct rw_semaphore *sem, int state)
 {
 	long count;
 	bool waiting = true; /* any queued threads before us */
+	bool handoff = false;
+	unsigned long timeout;
 	struct rwsem_waiter waiter;
 	struct rw_semaphore *ret = sem;
 	DEFINE_WAKE_Q(wake_q);
@@ -504,7 +592,7 @@ __rwsem_down_write_failed_common(struct rw_semaphore *sem, int state)
 	count = atomic_long_sub_return(RWSEM_ACTIVE_WRITE_BIAS, &sem->count);
 
 	/* do optimistic spinning and steal lock if possible */
-	if (rwsem_optimistic_spin(sem))
+	if (rwsem_optimistic_spin(sem, true))
 		return sem;
 
 	/*
@@ -513,6 +601,7 @@ __rwsem_down_write_failed_common(struct rw_semaphore *sem, int state)
 	 */
 	waiter.task = current;
 	waiter.type = RWSEM_WAITING_FOR_WRITE;
+	timeout = jiffies + RWSEM_WAIT_TIMEOUT;
 
 	raw_spin_lock_irq(&sem->wait_lock);
 
@@ -546,6 +635,16 @@ __rwsem_down_write_failed_common(struct rw_semaphore *sem, int state)
 			 * Reinitialize wake_q after use.
 			 */
 			wake_q_init(&wake_q);
+		} else if (count == RWSEM_WAITING_BIAS &&
+			   rwsem_handoff_pending(sem)) {
+			/*
+			 * We may have been spinning while the lock was freed
+			 * for the writer asking for a handoff, so that the
+			 * unlocker left its wakeup to us.
+			 */
+			__rwsem_mark_wake(sem, RWSEM_WAKE_ANY, &wake_q);
+			wake_up_q(&wake_q);
+			wake_q_init(&wake_q);
 		}
 
 	} else
@@ -554,8 +653,18 @@ __rwsem_down_write_failed_common(struct rw_semaphore *sem, int state)
 	/* wait until we successfully acquire the lock */
 	set_current_state(state);
 	while (true) {
-		if (rwsem_try_write_lock(count, sem))
+		if (rwsem_try_write_lock(count, sem, handoff))
 			break;
+
+		/*
+		 * Once we have waited at the head of the queue for long
+		 * enough, ask for the lock to be handed off to us so that
+		 * spinners and other writers can no longer steal it.
+		 */
+		if (!handoff && time_after(jiffies, timeout) &&
+		    list_first_entry(&sem->wait_list, struct rwsem_waiter,
+				     list) == &waiter)
+			handoff = rwsem_set_handoff(sem);
 		raw_spin_unlock_irq(&sem->wait_lock);
 
 		/* Block until there are no active lockers. */
@@ -573,11 +682,16 @@ __rwsem_down_write_failed_common(struct rw_semaphore *sem, int state)
 	list_del(&waiter.list);
 	raw_spin_unlock_irq(&sem->wait_lock);
 
+	if (handoff)
+		lock_handoff(&sem->dep_map, _RET_IP_);
+
 	return ret;
 
 out_nolock:
 	__set_current_state(TASK_RUNNING);
 	raw_spin_lock_irq(&sem->wait_lock);
+	if (handoff)
+		rwsem_clear_handoff(sem);
 	list_del(&waiter.list);
 	if (list_empty(&sem->wait_list))
 		atomic_long_add(-RWSEM_WAITING_BIAS, &sem->count);
@@ -660,7 +774,7 @@ struct rw_semaphore *rwsem_wake(struct rw_semaphore *sem)
 	 * rwsem_has_spinner() is true, it will guarantee at least one
 	 * trylock attempt on the rwsem later on.
 	 */
-	if (rwsem_has_spinner(sem)) {
+	if (rwsem_has_spinner(sem) && !rwsem_handoff_pending(sem)) {
 		/*
 		 * The smp_rmb() here is to make sure that the spinner
 		 * state is consulted before reading the wait_lock.
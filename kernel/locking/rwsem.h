@@ -54,6 +54,29 @@ static inline bool rwsem_owner_is_reader(struct task_struct *owner)
 {
 	return owner == RWSEM_READER_OWNED;
 }
+
+/*
+ * A writer that waited at the head of the queue for longer than
+ * RWSEM_WAIT_TIMEOUT sets the handoff flag. Spinners and queued
+ * writers then leave the lock alone so it is handed to that writer
+ * the next time it is released. The flag is only set and cleared by
+ * that writer, with the wait_lock held.
+ */
+static inline bool rwsem_handoff_pending(struct rw_semaphore *sem)
+{
+	return READ_ONCE(sem->handoff);
+}
+
+static inline bool rwsem_set_handoff(struct rw_semaphore *sem)
+{
+	WRITE_ONCE(sem->handoff, true);
+	return true;
+}
+
+static inline void rwsem_clear_handoff(struct rw_semaphore *sem)
+{
+	WRITE_ONCE(sem->handoff, false);
+}
 #else
 static inline void rwsem_set_owner(struct rw_semaphore *sem)
 {
@@ -66,4 +89,22 @@ static inline void rwsem_clear_owner(struct rw_semaphore *sem)
 static inline void rwsem_set_reader_owned(struct rw_semaphore *sem)
 {
 }
+
+/*
+ * Without optimistic spinning only queued writers can take the lock
+ * from the head of the queue, which is not worth a handoff.
+ */
+static inline bool rwsem_handoff_pending(struct rw_semaphore *sem)
+{
+	return false;
+}
+
+static inline bool rwsem_set_handoff(struct rw_semaphore *sem)
+{
+	return false;
+}
+
+static inline void rwsem_clear_handoff(struct rw_semaphore *sem)
+{
+}
 #endif
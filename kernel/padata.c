@@ -21,6 +21,7 @@
  */
 
 #include <linux/export.h>
+#include <linux/completion.h>
 #include <linux/cpumask.h>
 #include <linux/err.h>
 #include <linux/cpu.h>
@@ -1022,6 +1023,120 @@ void padata_free(struct padata_instance *pinst)
 }
 EXPORT_SYMBOL(padata_free);
 
+struct padata_mt_job_state {
+	spinlock_t		lock;
+	struct completion	completion;
+	struct padata_mt_job	*job;
+	int			nworks;
+	int			nworks_fini;
+	unsigned long		chunk_size;
+};
+
+struct padata_mt_work {
+	struct work_struct		work;
+	struct padata_mt_job_state	*ps;
+};
+
+/* Keep taking chunks off the job until none is left */
+static void __init padata_mt_run(struct padata_mt_job_state *ps)
+{
+	struct padata_mt_job *job = ps->job;
+	bool done;
+
+	spin_lock(&ps->lock);
+	while (job->size > 0) {
+		unsigned long start, size;
+
+		start = job->start;
+		/* End on a chunk boundary while enough work remains */
+		size = roundup(start + 1, ps->chunk_size) - start;
+		size = min(size, job->size);
+
+		job->start += size;
+		job->size -= size;
+
+		spin_unlock(&ps->lock);
+		job->thread_fn(start, start + size, job->fn_arg);
+		spin_lock(&ps->lock);
+	}
+	done = ++ps->nworks_fini == ps->nworks;
+	spin_unlock(&ps->lock);
+
+	if (done)
+		complete(&ps->completion);
+}
+
+static void __init padata_mt_helper(struct work_struct *work)
+{
+	struct padata_mt_work *pw = container_of(work, struct padata_mt_work,
+						 work);
+
+	padata_mt_run(pw->ps);
+}
+
+/**
+ * padata_do_multithreaded - run a job on several threads at once
+ *
+ * @job: Description of the job.
+ *
+ * The job is cut into chunks that the calling thread and up to
+ * @job->max_threads - 1 unbound workqueue workers pick up until it is
+ * done. Workers are queued from the calling cpu, so a caller bound to a
+ * node gets helpers on that node. Returns once the whole job has run.
+ * Only meant for boot time work, where the waiting is acceptable.
+ */
+void __init padata_do_multithreaded(struct padata_mt_job *job)
+{
+	/* In case threads finish at different times */
+	static const unsigned long load_balance_factor = 4;
+	struct padata_mt_job_state ps;
+	struct padata_mt_work *works;
+	unsigned long nworks, i;
+
+	if (!job->size)
+		return;
+
+	/* At least one thread, even when size < min_chunk */
+	nworks = max(job->size / max(job->min_chunk, 1UL), 1UL);
+	nworks = min_t(unsigned long, nworks, max(job->max_threads, 1));
+
+	works = NULL;
+	if (nworks > 1)
+		works = kcalloc(nworks - 1, sizeof(*works), GFP_KERNEL);
+	if (!works) {
+		job->thread_fn(job->start, job->start + job->size,
+			       job->fn_arg);
+		return;
+	}
+
+	spin_lock_init(&ps.lock);
+	init_completion(&ps.completion);
+	ps.job = job;
+	ps.nworks = nworks;
+	ps.nworks_fini = 0;
+
+	/*
+	 * Split large jobs into more chunks than threads so that one slow
+	 * thread does not hold up the others, but never below the caller's
+	 * minimum chunk size, and keep the caller's alignment.
+	 */
+	ps.chunk_size = job->size / (nworks * load_balance_factor);
+	ps.chunk_size = max(ps.chunk_size, job->min_chunk);
+	ps.chunk_size = roundup(ps.chunk_size, max(job->align, 1UL));
+
+	for (i = 0; i < nworks - 1; i++) {
+		works[i].ps = &ps;
+		INIT_WORK(&works[i].work, padata_mt_helper);
+		queue_work(system_unbound_wq, &works[i].work);
+	}
+
+	/* The caller does its share instead of sleeping */
+	padata_mt_run(&ps);
+	wait_for_completion(&ps.completion);
+
+	kfree(works);
+}
+
 #ifdef CONFIG_HOTPLUG_CPU
 
 static __init int padata_driver_init(void)
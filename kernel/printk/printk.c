@@ -42,6 +42,8 @@
 #include <linux/rculist.h>
 #include <linux/poll.h>
 #include <linux/irq_work.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
 #include <linux/utsname.h>
 #include <linux/ctype.h>
 #include <linux/uio.h>
@@ -1589,6 +1591,72 @@ static inline void printk_delay(void)
 	}
 }
 
+/*
+ * Once printk_kthread runs, printk() only stores the message and wakes the
+ * thread up to print it: a task logging in a loop no longer ends up writing
+ * everybody's messages to a slow console with interrupts disabled.  Printing
+ * stays synchronous in emergencies, with an oops or a panic in progress or
+ * the system going down, when the thread may never get to run again, and
+ * with printk.synchronous=1.
+ */
+static struct task_struct *printk_kthread __read_mostly;
+
+static bool __read_mostly printk_synchronous;
+module_param_named(synchronous, printk_synchronous, bool, S_IRUGO | S_IWUSR);
+
+/* Whether current leaves the printing to the consoles to printk_kthread */
+static bool printk_offload(void)
+{
+	if (!printk_kthread || current == printk_kthread || printk_synchronous)
+		return false;
+
+	return !oops_in_progress && system_state == SYSTEM_RUNNING &&
+	       atomic_read(&panic_cpu) == PANIC_CPU_INVALID;
+}
+
+static bool console_output_pending(void)
+{
+	unsigned long flags;
+	bool pending;
+
+	logbuf_lock_irqsave(flags);
+	pending = console_seq != log_next_seq;
+	logbuf_unlock_irqrestore(flags);
+
+	return pending;
+}
+
+static int printk_kthread_func(void *data)
+{
+	/* Not to spin on the pending output while the consoles are suspended */
+	set_freezable();
+
+	for (;;) {
+		/* Woken up by wake_up_klogd() */
+		wait_event_freezable(log_wait, console_output_pending());
+
+		console_lock();
+		console_unlock();
+	}
+
+	return 0;
+}
+
+static int __init printk_kthread_init(void)
+{
+	struct task_struct *thread;
+
+	thread = kthread_run(printk_kthread_func, NULL, "printk");
+	if (IS_ERR(thread)) {
+		pr_err("printk: failed to start the printing thread\n");
+		return PTR_ERR(thread);
+	}
+
+	printk_kthread = thread;
+	return 0;
+}
+late_initcall(printk_kthread_init);
+
 /*
  * Continuation lines are buffered, and not committed to the record buffer
  * until the line is complete, or a race forces it. The line fragments
@@ -1751,9 +1819,12 @@ asmlinkage int vprintk_emit(int facility, int level,
 		/*
 		 * Try to acquire and then immediately release the console
 		 * semaphore.  The release will print out buffers and wake up
-		 * /dev/kmsg and syslog() users.
+		 * /dev/kmsg and syslog() users, and printk_kthread when it is
+		 * the one printing.
 		 */
-		if (console_trylock())
+		if (printk_offload())
+			wake_up_klogd();
+		else if (console_trylock())
 			console_unlock();
 	}
 
@@ -1860,6 +1931,7 @@ static void call_console_drivers(const char *ext_text, size_t ext_len,
 static size_t msg_print_text(const struct printk_log *msg,
 			     bool syslog, char *buf, size_t size) { return 0; }
 static bool suppress_message_printing(int level) { return false; }
+static bool printk_offload(void) { return false; }
 
 #endif /* CONFIG_PRINTK */
 
@@ -2131,6 +2203,8 @@ static inline int can_use_console(void)
  * the output prior to releasing the lock.
  *
  * If there is output waiting, we wake /dev/kmsg and syslog() users.
+ * Unless in an emergency, the output is left to printk_kthread once it
+ * runs, and only the printing thread is woken up.
  *
  * console_unlock(); may be called from any context.
  */
@@ -2148,6 +2222,13 @@ void console_unlock(void)
 		return;
 	}
 
+	if (printk_offload()) {
+		console_locked = 0;
+		up_console_sem();
+		wake_up_klogd();
+		return;
+	}
+
 	/*
 	 * Console drivers are called with interrupts disabled, so
 	 * @console_may_schedule should be cleared before; however, we may
@@ -58,6 +58,8 @@
 #include <linux/trace_events.h>
 #include <linux/suspend.h>
 #include <linux/ftrace.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
 
 #include "tree.h"
 #include "rcu.h"
@@ -3142,19 +3144,199 @@ void call_rcu_bh(struct rcu_head *head, rcu_callback_t func)
 EXPORT_SYMBOL_GPL(call_rcu_bh);
 
 /*
- * Queue an RCU callback for lazy invocation after a grace period.
- * This will likely be later named something like "call_rcu_lazy()",
- * but this change will require some way of tagging the lazy RCU
- * callbacks in the list of pending callbacks. Until then, this
- * function may only be called from __kfree_rcu().
+ * Objects passed to kfree_rcu() are not queued as callbacks one by one,
+ * which would mean walking millions of cache-cold rcu_heads after a large
+ * flush. Their pointers are rather stashed into per-CPU page-sized arrays,
+ * which are handed to a single RCU callback every KFREE_DRAIN_JIFFIES and
+ * released with kfree_bulk() after the grace period. When no page can be
+ * allocated for the pointers, the rcu_heads are chained instead.
+ */
+#define KFREE_DRAIN_JIFFIES	(HZ / 50)
+
+struct kfree_rcu_bulk_data {
+	unsigned long nr_records;
+	struct kfree_rcu_bulk_data *next;
+	void *records[];
+};
+
+#define KFREE_BULK_MAX_ENTR \
+	((PAGE_SIZE - sizeof(struct kfree_rcu_bulk_data)) / sizeof(void *))
+
+/**
+ * struct kfree_rcu_cpu - batch up kfree_rcu() requests for RCU grace period
+ * @lock: Synchronize access to this structure
+ * @bhead: Pointer arrays being filled
+ * @head: Chained rcu_heads, when no pointer array could be allocated
+ * @bhead_free: Pointer arrays waiting for a grace period, then freed
+ * @head_free: Chained rcu_heads waiting for a grace period, then freed
+ * @bcached: A spare page kept for the next pointer array
+ * @rcu: Callback running once the batch in @bhead_free/@head_free is safe
+ * @free_work: Frees that batch outside of softirq context
+ * @monitor_work: Hands the pending batch to RCU every KFREE_DRAIN_JIFFIES
+ * @monitor_todo: @monitor_work is scheduled
+ */
+struct kfree_rcu_cpu {
+	spinlock_t lock;
+	struct kfree_rcu_bulk_data *bhead;
+	struct rcu_head *head;
+	struct kfree_rcu_bulk_data *bhead_free;
+	struct rcu_head *head_free;
+	struct kfree_rcu_bulk_data *bcached;
+	struct rcu_head rcu;
+	struct work_struct free_work;
+	struct delayed_work monitor_work;
+	bool monitor_todo;
+};
+
+static DEFINE_PER_CPU(struct kfree_rcu_cpu, krc);
+
+static void kfree_rcu_free_work(struct work_struct *work)
+{
+	struct kfree_rcu_cpu *krcp = container_of(work, struct kfree_rcu_cpu,
+						  free_work);
+	struct kfree_rcu_bulk_data *bhead, *bnext;
+	struct rcu_head *head, *next;
+	unsigned long flags;
+
+	spin_lock_irqsave(&krcp->lock, flags);
+	bhead = krcp->bhead_free;
+	head = krcp->head_free;
+	krcp->bhead_free = NULL;
+	krcp->head_free = NULL;
+	spin_unlock_irqrestore(&krcp->lock, flags);
+
+	for (; bhead; bhead = bnext) {
+		bnext = bhead->next;
+
+		rcu_lock_acquire(&rcu_callback_map);
+		kfree_bulk(bhead->nr_records, bhead->records);
+		rcu_lock_release(&rcu_callback_map);
+
+		if (cmpxchg(&krcp->bcached, NULL, bhead))
+			free_page((unsigned long)bhead);
+		cond_resched_rcu_qs();
+	}
+
+	for (; head; head = next) {
+		next = head->next;
+		debug_rcu_head_unqueue(head);
+		__rcu_reclaim(rcu_state_p->name, head);
+		cond_resched_rcu_qs();
+	}
+}
+
+static void kfree_rcu_gp_done(struct rcu_head *rcu)
+{
+	struct kfree_rcu_cpu *krcp = container_of(rcu, struct kfree_rcu_cpu,
+						  rcu);
+
+	queue_work(system_wq, &krcp->free_work);
+}
+
+/*
+ * Hand the pending batch to RCU, unless the previous one has not been
+ * freed yet, in which case try again later.
+ */
+static void kfree_rcu_monitor(struct work_struct *work)
+{
+	struct kfree_rcu_cpu *krcp = container_of(work, struct kfree_rcu_cpu,
+						  monitor_work.work);
+	unsigned long flags;
+
+	spin_lock_irqsave(&krcp->lock, flags);
+	if (krcp->bhead_free || krcp->head_free) {
+		schedule_delayed_work(&krcp->monitor_work, KFREE_DRAIN_JIFFIES);
+		spin_unlock_irqrestore(&krcp->lock, flags);
+		return;
+	}
+
+	krcp->bhead_free = krcp->bhead;
+	krcp->head_free = krcp->head;
+	krcp->bhead = NULL;
+	krcp->head = NULL;
+	krcp->monitor_todo = false;
+	spin_unlock_irqrestore(&krcp->lock, flags);
+
+	__call_rcu(&krcp->rcu, kfree_rcu_gp_done, rcu_state_p, -1, 0);
+}
+
+static bool kfree_rcu_bulk_add(struct kfree_rcu_cpu *krcp, void *ptr)
+{
+	struct kfree_rcu_bulk_data *bnode = krcp->bhead;
+
+	if (!bnode || bnode->nr_records == KFREE_BULK_MAX_ENTR) {
+		bnode = xchg(&krcp->bcached, NULL);
+		if (!bnode)
+			bnode = (void *)__get_free_page(GFP_NOWAIT |
+							__GFP_NOWARN);
+		if (!bnode)
+			return false;
+
+		bnode->nr_records = 0;
+		bnode->next = krcp->bhead;
+		krcp->bhead = bnode;
+	}
+
+	bnode->records[bnode->nr_records++] = ptr;
+	return true;
+}
+
+/*
+ * Queue a kfree_rcu() request. This function may only be called from
+ * __kfree_rcu(), @func is then the offset of @head in the object to free.
  */
 void kfree_call_rcu(struct rcu_head *head,
 		    rcu_callback_t func)
 {
-	__call_rcu(head, func, rcu_state_p, -1, 1);
+	struct kfree_rcu_cpu *krcp;
+	unsigned long flags;
+
+	/* The monitor work can't be scheduled early during boot. */
+	if (rcu_scheduler_active != RCU_SCHEDULER_RUNNING) {
+		__call_rcu(head, func, rcu_state_p, -1, 1);
+		return;
+	}
+
+	local_irq_save(flags);
+	krcp = this_cpu_ptr(&krc);
+	spin_lock(&krcp->lock);
+
+	if (!kfree_rcu_bulk_add(krcp, (void *)head - (unsigned long)func)) {
+		if (debug_rcu_head_queue(head)) {
+			/* Probable double kfree_rcu(), so leak the object. */
+			WARN_ONCE(1, "kfree_call_rcu(): Double-freed call. rcu_head %p\n",
+				  head);
+			goto unlock;
+		}
+		head->func = func;
+		head->next = krcp->head;
+		krcp->head = head;
+	}
+
+	if (!krcp->monitor_todo) {
+		krcp->monitor_todo = true;
+		schedule_delayed_work(&krcp->monitor_work, KFREE_DRAIN_JIFFIES);
+	}
+
+unlock:
+	spin_unlock(&krcp->lock);
+	local_irq_restore(flags);
 }
 EXPORT_SYMBOL_GPL(kfree_call_rcu);
 
+static void __init kfree_rcu_batch_init(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct kfree_rcu_cpu *krcp = per_cpu_ptr(&krc, cpu);
+
+		spin_lock_init(&krcp->lock);
+		INIT_WORK(&krcp->free_work, kfree_rcu_free_work);
+		INIT_DELAYED_WORK(&krcp->monitor_work, kfree_rcu_monitor);
+	}
+}
+
 /*
  * Because a context switch is a grace period for RCU-sched and RCU-bh,
  * any blocking grace-period wait automatically implies a grace period
@@ -4182,6 +4364,7 @@ void __init rcu_init(void)
 
 	rcu_early_boot_tests();
 
+	kfree_rcu_batch_init();
 	rcu_bootup_announce();
 	rcu_init_geometry();
 	rcu_init_one(&rcu_bh_state);
@@ -0,0 +1,200 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * BPF_PROG_TYPE_SCHED: task placement and wakeup preemption hints
+ *
+ * One program per attach type may be attached, system wide.  Its verdict
+ * is only a hint: a CPU returned by a BPF_SCHED_SELECT_RQ program is used
+ * if the task is allowed to run there, anything else leaves the decision
+ * to the kernel.  A static key per attach type keeps the hooks out of the
+ * fast paths while no program is attached.
+ */
+#include <linux/bpf.h>
+#include <linux/cgroup.h>
+#include <linux/filter.h>
+#include <linux/mutex.h>
+
+#include "sched.h"
+
+DEFINE_STATIC_KEY_FALSE(sched_bpf_select_rq_key);
+DEFINE_STATIC_KEY_FALSE(sched_bpf_wakeup_preempt_key);
+
+static struct bpf_prog __rcu *sched_bpf_select_rq_prog;
+static struct bpf_prog __rcu *sched_bpf_wakeup_preempt_prog;
+static DEFINE_MUTEX(sched_bpf_mutex);
+
+static void sched_bpf_init_md(struct bpf_sched_md *md, struct task_struct *p,
+			      int target_cpu)
+{
+#ifdef CONFIG_SMP
+	struct sched_domain_shared *sds;
+#endif
+
+	md->pid = task_pid_nr(p);
+	md->tgid = task_tgid_nr(p);
+#ifdef CONFIG_CGROUPS
+	md->cgroup_id = task_dfl_cgroup(p)->kn->id.id;
+#endif
+	md->this_cpu = smp_processor_id();
+	md->prev_cpu = task_cpu(p);
+	md->target_cpu = target_cpu;
+
+#ifdef CONFIG_SMP
+	sds = rcu_dereference(per_cpu(sd_llc_shared, target_cpu));
+	if (sds) {
+		md->llc_idle_cpus = cpumask_weight(sds_idle_cpus(sds));
+		md->llc_has_idle_cores = READ_ONCE(sds->has_idle_cores);
+	}
+#endif
+}
+
+#ifdef CONFIG_SMP
+int __sched_bpf_select_rq(struct task_struct *p, int prev_cpu, int new_cpu,
+			  int sd_flag, int wake_flags)
+{
+	struct bpf_sched_md md = {};
+	struct bpf_prog *prog;
+	int cpu = BPF_SCHED_NO_PREF;
+
+	rcu_read_lock();
+	prog = rcu_dereference(sched_bpf_select_rq_prog);
+	if (prog) {
+		sched_bpf_init_md(&md, p, new_cpu);
+		md.prev_cpu = prev_cpu;
+		if (sd_flag & SD_BALANCE_WAKE)
+			md.flags |= BPF_SCHED_F_WAKE;
+		if (sd_flag & SD_BALANCE_FORK)
+			md.flags |= BPF_SCHED_F_FORK;
+		if (sd_flag & SD_BALANCE_EXEC)
+			md.flags |= BPF_SCHED_F_EXEC;
+		if (wake_flags & WF_SYNC)
+			md.flags |= BPF_SCHED_F_SYNC;
+
+		cpu = BPF_PROG_RUN(prog, &md);
+	}
+	rcu_read_unlock();
+
+	if (cpu < 0 || cpu >= nr_cpu_ids ||
+	    !cpumask_test_cpu(cpu, &p->cpus_allowed) || !cpu_active(cpu))
+		return new_cpu;
+
+	return cpu;
+}
+#endif
+
+int __sched_bpf_wakeup_preempt(struct rq *rq, struct task_struct *p,
+			       int wake_flags)
+{
+	struct bpf_sched_md md = {};
+	struct bpf_prog *prog;
+	int ret = BPF_SCHED_NO_PREF;
+
+	rcu_read_lock();
+	prog = rcu_dereference(sched_bpf_wakeup_preempt_prog);
+	if (prog) {
+		sched_bpf_init_md(&md, p, cpu_of(rq));
+		md.flags = BPF_SCHED_F_WAKE;
+		if (wake_flags & WF_SYNC)
+			md.flags |= BPF_SCHED_F_SYNC;
+		if (wake_flags & WF_FORK)
+			md.flags |= BPF_SCHED_F_FORK;
+		md.curr_pid = task_pid_nr(rq->curr);
+
+		ret = BPF_PROG_RUN(prog, &md);
+	}
+	rcu_read_unlock();
+
+	return ret;
+}
+
+/* Attach @prog for @type, or detach the current program if @prog is NULL */
+int sched_bpf_prog(struct bpf_prog *prog, u32 type)
+{
+	struct static_key_false *key;
+	struct bpf_prog __rcu **slot;
+	struct bpf_prog *old;
+
+	if (!capable(CAP_SYS_ADMIN))
+		return -EPERM;
+
+	switch (type) {
+	case BPF_SCHED_SELECT_RQ:
+		slot = &sched_bpf_select_rq_prog;
+		key = &sched_bpf_select_rq_key;
+		break;
+	case BPF_SCHED_WAKEUP_PREEMPT:
+		slot = &sched_bpf_wakeup_preempt_prog;
+		key = &sched_bpf_wakeup_preempt_key;
+		break;
+	default:
+		return -EOPNOTSUPP;
+	}
+
+	mutex_lock(&sched_bpf_mutex);
+	old = rcu_dereference_protected(*slot,
+					lockdep_is_held(&sched_bpf_mutex));
+	if (!prog && !old) {
+		mutex_unlock(&sched_bpf_mutex);
+		return -ENOENT;
+	}
+
+	rcu_assign_pointer(*slot, prog);
+	if (prog && !old)
+		static_branch_enable(key);
+	else if (!prog)
+		static_branch_disable(key);
+	mutex_unlock(&sched_bpf_mutex);
+
+	if (old) {
+		synchronize_rcu();
+		bpf_prog_put(old);
+	}
+
+	return 0;
+}
+
+static const struct bpf_func_proto *sched_func_proto(enum bpf_func_id func_id)
+{
+	switch (func_id) {
+	case BPF_FUNC_map_lookup_elem:
+		return &bpf_map_lookup_elem_proto;
+	case BPF_FUNC_map_update_elem:
+		return &bpf_map_update_elem_proto;
+	case BPF_FUNC_map_delete_elem:
+		return &bpf_map_delete_elem_proto;
+	case BPF_FUNC_get_prandom_u32:
+		return &bpf_get_prandom_u32_proto;
+	case BPF_FUNC_get_smp_processor_id:
+		return &bpf_get_smp_processor_id_proto;
+	case BPF_FUNC_get_numa_node_id:
+		return &bpf_get_numa_node_id_proto;
+	case BPF_FUNC_ktime_get_ns:
+		return &bpf_ktime_get_ns_proto;
+	case BPF_FUNC_trace_printk:
+		return bpf_get_trace_printk_proto();
+	default:
+		return NULL;
+	}
+}
+
+static bool sched_is_valid_access(int off, int size, enum bpf_access_type type,
+				  struct bpf_insn_access_aux *info)
+{
+	if (type != BPF_READ)
+		return false;
+	if (off < 0 || off + size > sizeof(struct bpf_sched_md))
+		return false;
+	if (off % size != 0)
+		return false;
+
+	switch (off) {
+	case bpf_ctx_range(struct bpf_sched_md, cgroup_id):
+		return size == sizeof(__u64);
+	default:
+		return size == sizeof(__u32);
+	}
+}
+
+const struct bpf_verifier_ops sched_prog_ops = {
+	.get_func_proto		= sched_func_proto,
+	.is_valid_access	= sched_is_valid_access,
+};
@@ -299,11 +299,16 @@ static inline struct cfs_rq *group_cfs_rq(struct sched_entity *grp)
 	return grp->my_q;
 }
 
-static inline void list_add_leaf_cfs_rq(struct cfs_rq *cfs_rq)
+/*
+ * Returns whether the branch of @cfs_rq is connected to the tree, that is
+ * whether the parents still to be added, if any, are already on the list.
+ */
+static inline bool list_add_leaf_cfs_rq(struct cfs_rq *cfs_rq)
 {
+	struct rq *rq = rq_of(cfs_rq);
+	int cpu = cpu_of(rq);
+
 	if (!cfs_rq->on_list) {
-		struct rq *rq = rq_of(cfs_rq);
-		int cpu = cpu_of(rq);
 		/*
 		 * Ensure we either appear before our parent (if already
 		 * enqueued) or force our parent to appear after us when it is
@@ -329,6 +334,8 @@ static inline void list_add_leaf_cfs_rq(struct cfs_rq *cfs_rq)
 			 * list.
 			 */
 			rq->tmp_alone_branch = &rq->leaf_cfs_rq_list;
+			cfs_rq->on_list = 1;
+			return true;
 		} else if (!cfs_rq->tg->parent) {
 			/*
 			 * cfs rq without parent should be put
@@ -341,6 +348,8 @@ static inline void list_add_leaf_cfs_rq(struct cfs_rq *cfs_rq)
 			 * tmp_alone_branch to the beginning of the list.
 			 */
 			rq->tmp_alone_branch = &rq->leaf_cfs_rq_list;
+			cfs_rq->on_list = 1;
+			return true;
 		} else {
 			/*
 			 * The parent has not already been added so we want to
@@ -358,7 +367,10 @@ static inline void list_add_leaf_cfs_rq(struct cfs_rq *cfs_rq)
 		}
 
 		cfs_rq->on_list = 1;
+		return false;
 	}
+
+	return rq->tmp_alone_branch == &rq->leaf_cfs_rq_list;
 }
 
 static inline void list_del_leaf_cfs_rq(struct cfs_rq *cfs_rq)
@@ -457,8 +469,9 @@ static inline struct cfs_rq *group_cfs_rq(struct sched_entity *grp)
 	return NULL;
 }
 
-static inline void list_add_leaf_cfs_rq(struct cfs_rq *cfs_rq)
+static inline bool list_add_leaf_cfs_rq(struct cfs_rq *cfs_rq)
 {
+	return true;
 }
 
 static inline void list_del_leaf_cfs_rq(struct cfs_rq *cfs_rq)
@@ -1377,6 +1390,14 @@ bool should_numa_migrate_memory(struct task_struct *p, struct page * page,
 
 	this_cpupid = cpu_pid_to_cpupid(dst_cpu, current->pid);
 
+	/*
+	 * With memory tiering, a page of a slow node is promoted to the
+	 * fast one of the CPU which accesses it.
+	 */
+	if ((sysctl_numa_balancing_mode & NUMA_BALANCING_MEMORY_TIERING) &&
+	    !node_is_toptier(src_nid) && node_is_toptier(dst_nid))
+		return true;
+
 	/*
 	 * Multi-stage node selection is used in conjunction with a periodic
 	 * migration fault to build a temporal task<->page relation. By using
@@ -4071,6 +4092,8 @@ static inline u64 sched_cfs_bandwidth_slice(void)
 
 /*
  * Replenish runtime according to assigned quota and update expiration time.
+ * The runtime left unused is kept for the next periods, up to the burst, so
+ * that a group far below its quota on average may exceed it for a while.
  * We use sched_clock_cpu directly instead of rq->clock to avoid adding
  * additional synchronization around rq->lock.
  *
@@ -4078,13 +4101,24 @@ static inline u64 sched_cfs_bandwidth_slice(void)
  */
 void __refill_cfs_bandwidth_runtime(struct cfs_bandwidth *cfs_b)
 {
+	s64 overrun;
 	u64 now;
 
 	if (cfs_b->quota == RUNTIME_INF)
 		return;
 
 	now = sched_clock_cpu(smp_processor_id());
-	cfs_b->runtime = cfs_b->quota;
+	cfs_b->runtime += cfs_b->quota;
+
+	/* more than the quota was used in the period which ends */
+	overrun = cfs_b->runtime_snap - cfs_b->runtime;
+	if (overrun > 0) {
+		cfs_b->burst_time += overrun;
+		cfs_b->nr_burst++;
+	}
+
+	cfs_b->runtime = min(cfs_b->runtime, cfs_b->quota + cfs_b->burst);
+	cfs_b->runtime_snap = cfs_b->runtime;
 	cfs_b->runtime_expires = now + ktime_to_ns(cfs_b->period);
 }
 
@@ -4358,6 +4392,70 @@ void unthrottle_cfs_rq(struct cfs_rq *cfs_rq)
 		resched_curr(rq);
 }
 
+#ifdef CONFIG_SMP
+static void __cfsb_csd_unthrottle(void *arg)
+{
+	struct cfs_rq *cfs_rq, *tmp;
+	struct rq *rq = arg;
+	struct rq_flags rf;
+
+	rq_lock(rq, &rf);
+	list_for_each_entry_safe(cfs_rq, tmp, &rq->cfsb_csd_list,
+				 throttled_csd_list) {
+		list_del_init(&cfs_rq->throttled_csd_list);
+
+		if (cfs_rq_throttled(cfs_rq))
+			unthrottle_cfs_rq(cfs_rq);
+	}
+	rq_unlock(rq, &rf);
+}
+
+/*
+ * Leave the unthrottle of a remote cfs_rq to its CPU, which handles all the
+ * cfs_rqs queued for it in one interrupt.  Returns whether the interrupt has
+ * to be sent, once rq->lock is dropped.
+ */
+static bool unthrottle_cfs_rq_async(struct cfs_rq *cfs_rq)
+{
+	struct rq *rq = rq_of(cfs_rq);
+	bool first;
+
+	if (rq == this_rq() || !cpu_online(cpu_of(rq))) {
+		unthrottle_cfs_rq(cfs_rq);
+		return false;
+	}
+
+	first = list_empty(&rq->cfsb_csd_list);
+	list_add_tail(&cfs_rq->throttled_csd_list, &rq->cfsb_csd_list);
+
+	return first;
+}
+
+void init_cfsb_csd(struct rq *rq)
+{
+	rq->cfsb_csd.flags = 0;
+	rq->cfsb_csd.func = __cfsb_csd_unthrottle;
+	rq->cfsb_csd.info = rq;
+	INIT_LIST_HEAD(&rq->cfsb_csd_list);
+}
+#else
+static bool unthrottle_cfs_rq_async(struct cfs_rq *cfs_rq)
+{
+	unthrottle_cfs_rq(cfs_rq);
+	return false;
+}
+
+void init_cfsb_csd(struct rq *rq)
+{
+	INIT_LIST_HEAD(&rq->cfsb_csd_list);
+}
+#endif
+
+/*
+ * Each throttled cfs_rq gets its deficit back plus a bandwidth slice, as it
+ * would have asked for on its own, so that it does not come back to the
+ * global pool right after being unthrottled.
+ */
 static u64 distribute_cfs_runtime(struct cfs_bandwidth *cfs_b,
 		u64 remaining, u64 expires)
 {
@@ -4370,12 +4468,18 @@ static u64 distribute_cfs_runtime(struct cfs_bandwidth *cfs_b,
 				throttled_list) {
 		struct rq *rq = rq_of(cfs_rq);
 		struct rq_flags rf;
+		bool kick = false;
 
 		rq_lock(rq, &rf);
 		if (!cfs_rq_throttled(cfs_rq))
 			goto next;
 
+		/* already given its runtime, waiting to be unthrottled */
+		if (!list_empty(&cfs_rq->throttled_csd_list))
+			goto next;
+
 		runtime = -cfs_rq->runtime_remaining + 1;
+		runtime += sched_cfs_bandwidth_slice();
 		if (runtime > remaining)
 			runtime = remaining;
 		remaining -= runtime;
@@ -4385,11 +4489,15 @@ static u64 distribute_cfs_runtime(struct cfs_bandwidth *cfs_b,
 
 		/* we check whether we're throttled above */
 		if (cfs_rq->runtime_remaining > 0)
-			unthrottle_cfs_rq(cfs_rq);
+			kick = unthrottle_cfs_rq_async(cfs_rq);
 
 next:
 		rq_unlock(rq, &rf);
 
+		if (kick)
+			smp_call_function_single_async(cpu_of(rq),
+						       &rq->cfsb_csd);
+
 		if (!remaining)
 			break;
 	}
@@ -4454,6 +4562,10 @@ static int do_sched_cfs_period_timer(struct cfs_bandwidth *cfs_b, int overrun)
 		throttled = !list_empty(&cfs_b->throttled_cfs_rq);
 
 		cfs_b->runtime -= min(runtime, cfs_b->runtime);
+
+		/* the ones left are being unthrottled by their CPUs */
+		if (!runtime)
+			break;
 	}
 
 	/*
@@ -4694,6 +4806,7 @@ static void init_cfs_rq_runtime(struct cfs_rq *cfs_rq)
 {
 	cfs_rq->runtime_enabled = 0;
 	INIT_LIST_HEAD(&cfs_rq->throttled_list);
+	INIT_LIST_HEAD(&cfs_rq->throttled_csd_list);
 }
 
 void start_cfs_bandwidth(struct cfs_bandwidth *cfs_b)
@@ -4709,12 +4822,33 @@ void start_cfs_bandwidth(struct cfs_bandwidth *cfs_b)
 
 static void destroy_cfs_bandwidth(struct cfs_bandwidth *cfs_b)
 {
+	int __maybe_unused i;
+
 	/* init_cfs_bandwidth() was not called */
 	if (!cfs_b->throttled_cfs_rq.next)
 		return;
 
 	hrtimer_cancel(&cfs_b->period_timer);
 	hrtimer_cancel(&cfs_b->slack_timer);
+
+#ifdef CONFIG_SMP
+	/*
+	 * With the timers stopped, no cfs_rq of the group can be queued any
+	 * more, but some may still wait for a remote CPU to unthrottle them:
+	 * do it here, they are about to be freed.
+	 */
+	for_each_possible_cpu(i) {
+		struct rq *rq = cpu_rq(i);
+		unsigned long flags;
+
+		if (list_empty(&rq->cfsb_csd_list))
+			continue;
+
+		local_irq_save(flags);
+		__cfsb_csd_unthrottle(rq);
+		local_irq_restore(flags);
+	}
+#endif
 }
 
 /*
@@ -4746,10 +4880,16 @@ static void __maybe_unused update_runtime_enabled(struct rq *rq)
 /* cpu offline callback */
 static void __maybe_unused unthrottle_offline_cfs_rqs(struct rq *rq)
 {
+	struct cfs_rq *cfs_rq, *tmp;
 	struct task_group *tg;
 
 	lockdep_assert_held(&rq->lock);
 
+	/* all of them are unthrottled below */
+	list_for_each_entry_safe(cfs_rq, tmp, &rq->cfsb_csd_list,
+				 throttled_csd_list)
+		list_del_init(&cfs_rq->throttled_csd_list);
+
 	rcu_read_lock();
 	list_for_each_entry_rcu(tg, &task_groups, list) {
 		struct cfs_rq *cfs_rq = tg->cfs_rq[cpu_of(rq)];
@@ -4803,6 +4943,7 @@ static inline int throttled_lb_pair(struct task_group *tg,
 }
 
 void init_cfs_bandwidth(struct cfs_bandwidth *cfs_b) {}
+void init_cfsb_csd(struct rq *rq) {}
 
 #ifdef CONFIG_FAIR_GROUP_SCHED
 static void init_cfs_rq_runtime(struct cfs_rq *cfs_rq) {}
@@ -4922,6 +5063,20 @@ enqueue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 	if (!se)
 		add_nr_running(rq, 1);
 
+	/*
+	 * The loops above stop at a throttled cfs_rq, which may leave the
+	 * branch of the task disconnected from the leaf list: add the
+	 * parents it still misses.
+	 */
+	if (cfs_bandwidth_used()) {
+		for_each_sched_entity(se) {
+			cfs_rq = cfs_rq_of(se);
+
+			if (list_add_leaf_cfs_rq(cfs_rq))
+				break;
+		}
+	}
+
 	hrtick_update(rq);
 }
 
@@ -5630,6 +5785,44 @@ find_idlest_cpu(struct sched_group *group, struct task_struct *p, int this_cpu)
 	return shallowest_idle_cpu != -1 ? shallowest_idle_cpu : least_loaded_cpu;
 }
 
+/*
+ * The idle CPUs of an LLC, and the CPUs of its idle cores, are tracked in
+ * sd_llc_shared as CPUs enter and leave idle, so that the wakeup scans only
+ * visit them.  A bit is only written when it changes, and the tick clears
+ * those of busy CPUs left set, when the domains were built or by a race
+ * between siblings.
+ */
+void update_idle_cpumask(struct rq *rq, bool idle)
+{
+	struct sched_domain_shared *sds;
+	int cpu = cpu_of(rq);
+
+	rcu_read_lock();
+	sds = rcu_dereference(per_cpu(sd_llc_shared, cpu));
+	if (!sds)
+		goto unlock;
+
+	if (idle) {
+		if (!cpumask_test_cpu(cpu, sds_idle_cpus(sds)))
+			cpumask_set_cpu(cpu, sds_idle_cpus(sds));
+		goto unlock;
+	}
+
+	if (cpumask_test_cpu(cpu, sds_idle_cpus(sds)))
+		cpumask_clear_cpu(cpu, sds_idle_cpus(sds));
+#ifdef CONFIG_SCHED_SMT
+	if (static_branch_likely(&sched_smt_present) &&
+	    cpumask_test_cpu(cpu, sds_idle_cores(sds))) {
+		int sibling;
+
+		for_each_cpu(sibling, cpu_smt_mask(cpu))
+			cpumask_clear_cpu(sibling, sds_idle_cores(sds));
+	}
+#endif
+unlock:
+	rcu_read_unlock();
+}
+
 #ifdef CONFIG_SCHED_SMT
 
 static inline void set_idle_cores(int cpu, int val)
@@ -5654,18 +5847,20 @@ static inline bool test_idle_cores(int cpu, bool def)
 
 /*
  * Scans the local SMT mask to see if the entire core is idle, and records this
- * information in sd_llc_shared->has_idle_cores.
+ * information in sd_llc_shared->has_idle_cores and in its mask of idle cores.
  *
  * Since SMT siblings share all cache levels, inspecting this limited remote
  * state should be fairly cheap.
  */
 void __update_idle_core(struct rq *rq)
 {
+	struct sched_domain_shared *sds;
 	int core = cpu_of(rq);
 	int cpu;
 
 	rcu_read_lock();
-	if (test_idle_cores(core, true))
+	sds = rcu_dereference(per_cpu(sd_llc_shared, core));
+	if (!sds)
 		goto unlock;
 
 	for_each_cpu(cpu, cpu_smt_mask(core)) {
@@ -5676,7 +5871,12 @@ void __update_idle_core(struct rq *rq)
 			goto unlock;
 	}
 
-	set_idle_cores(core, 1);
+	if (!cpumask_test_cpu(core, sds_idle_cores(sds))) {
+		for_each_cpu(cpu, cpu_smt_mask(core))
+			cpumask_set_cpu(cpu, sds_idle_cores(sds));
+	}
+	if (!READ_ONCE(sds->has_idle_cores))
+		WRITE_ONCE(sds->has_idle_cores, 1);
 unlock:
 	rcu_read_unlock();
 }
@@ -5698,10 +5898,14 @@ static int select_idle_core(struct task_struct *p, struct sched_domain *sd, int
 		return -1;
 
 	cpumask_and(cpus, sched_domain_span(sd), &p->cpus_allowed);
+	if (sd->shared)
+		cpumask_and(cpus, cpus, sds_idle_cores(sd->shared));
 
+	schedstat_inc(this_rq()->sis_search);
 	for_each_cpu_wrap(core, cpus, target) {
 		bool idle = true;
 
+		schedstat_inc(this_rq()->sis_scanned);
 		for_each_cpu(cpu, cpu_smt_mask(core)) {
 			cpumask_clear_cpu(cpu, cpus);
 			if (!idle_cpu(cpu))
@@ -5711,6 +5915,7 @@ static int select_idle_core(struct task_struct *p, struct sched_domain *sd, int
 		if (idle)
 			return core;
 	}
+	schedstat_inc(this_rq()->sis_failed);
 
 	/*
 	 * Failed to find an idle core; stop looking for one.
@@ -5755,12 +5960,13 @@ static inline int select_idle_smt(struct task_struct *p, struct sched_domain *sd
 #endif /* CONFIG_SCHED_SMT */
 
 /*
- * Scan the LLC domain for idle CPUs; this is dynamically regulated by
+ * Scan the idle CPUs of the LLC domain; this is dynamically regulated by
  * comparing the average scan cost (tracked in sd->avg_scan_cost) against the
  * average idle time for this rq (as found in rq->avg_idle).
  */
 static int select_idle_cpu(struct task_struct *p, struct sched_domain *sd, int target)
 {
+	struct cpumask *cpus = this_cpu_cpumask_var_ptr(select_idle_mask);
 	struct sched_domain *this_sd;
 	u64 avg_cost, avg_idle;
 	u64 time, cost;
@@ -5787,18 +5993,34 @@ static int select_idle_cpu(struct task_struct *p, struct sched_domain *sd, int t
 			nr = div_u64(span_avg, avg_cost);
 		else
 			nr = 4;
+
+		/*
+		 * Latency sensitive tasks look further for an idle CPU,
+		 * the others give up sooner.
+		 */
+		nr = div_u64((u64)nr * (-MIN_LATENCY_NICE - p->se.latency_nice),
+			     -MIN_LATENCY_NICE);
+		nr = max(nr, 2);
 	}
 
 	time = local_clock();
 
-	for_each_cpu_wrap(cpu, sched_domain_span(sd), target) {
-		if (!--nr)
+	cpumask_and(cpus, sched_domain_span(sd), &p->cpus_allowed);
+	if (sd->shared)
+		cpumask_and(cpus, cpus, sds_idle_cpus(sd->shared));
+
+	schedstat_inc(this_rq()->sis_search);
+	for_each_cpu_wrap(cpu, cpus, target) {
+		if (!--nr) {
+			schedstat_inc(this_rq()->sis_failed);
 			return -1;
-		if (!cpumask_test_cpu(cpu, &p->cpus_allowed))
-			continue;
+		}
+		schedstat_inc(this_rq()->sis_scanned);
 		if (idle_cpu(cpu))
 			break;
 	}
+	if (cpu >= nr_cpumask_bits)
+		schedstat_inc(this_rq()->sis_failed);
 
 	time = local_clock() - time;
 	cost = this_sd->avg_scan_cost;
@@ -5808,8 +6030,42 @@ static int select_idle_cpu(struct task_struct *p, struct sched_domain *sd, int t
 	return cpu;
 }
 
+#ifdef CONFIG_SCHED_CLUSTER
+/*
+ * Scan the cluster (shared L2) of target for an idle CPU.  A cluster only
+ * has a handful of CPUs, so this is not rate limited like select_idle_cpu().
+ */
+static int select_idle_cluster(struct task_struct *p, int target)
+{
+	struct sched_domain *sd;
+	int cpu;
+
+	sd = rcu_dereference(per_cpu(sd_cluster, target));
+	if (!sd)
+		return -1;
+
+	for_each_cpu_wrap(cpu, sched_domain_span(sd), target) {
+		if (!cpumask_test_cpu(cpu, &p->cpus_allowed))
+			continue;
+		if (idle_cpu(cpu))
+			return cpu;
+	}
+
+	return -1;
+}
+
+#else /* CONFIG_SCHED_CLUSTER */
+
+static inline int select_idle_cluster(struct task_struct *p, int target)
+{
+	return -1;
+}
+
+#endif /* CONFIG_SCHED_CLUSTER */
+
 /*
- * Try and locate an idle core/thread in the LLC cache domain.
+ * Try and locate an idle core/thread in the cluster, then in the LLC cache
+ * domain.
  */
 static int select_idle_sibling(struct task_struct *p, int prev, int target)
 {
@@ -5829,6 +6085,10 @@ static int select_idle_sibling(struct task_struct *p, int prev, int target)
 	if (!sd)
 		return target;
 
+	i = select_idle_cluster(p, target);
+	if ((unsigned)i < nr_cpumask_bits)
+		return i;
+
 	i = select_idle_core(p, sd, target);
 	if ((unsigned)i < nr_cpumask_bits)
 		return i;
@@ -6021,6 +6281,8 @@ select_task_rq_fair(struct task_struct *p, int prev_cpu, int sd_flag, int wake_f
 		}
 		/* while loop will break here if sd == NULL */
 	}
+	new_cpu = sched_bpf_select_rq(p, prev_cpu, new_cpu, sd_flag,
+				      wake_flags);
 	rcu_read_unlock();
 
 	return new_cpu;
@@ -6085,6 +6347,15 @@ static unsigned long
 wakeup_gran(struct sched_entity *curr, struct sched_entity *se)
 {
 	unsigned long gran = sysctl_sched_wakeup_granularity;
+	int latency_nice = se->latency_nice - curr->latency_nice;
+
+	/*
+	 * A waking entity more latency sensitive than curr preempts it
+	 * sooner, down to no granularity at all for the largest difference;
+	 * a less sensitive one waits up to twice as long.
+	 */
+	latency_nice = clamp(latency_nice, MIN_LATENCY_NICE, MAX_LATENCY_NICE);
+	gran = gran * (latency_nice - MIN_LATENCY_NICE) / -MIN_LATENCY_NICE;
 
 	/*
 	 * Since its curr running now, convert the gran from real-time
@@ -6214,6 +6485,17 @@ static void check_preempt_wakeup(struct rq *rq, struct task_struct *p, int wake_
 	if (unlikely(p->policy != SCHED_NORMAL) || !sched_feat(WAKEUP_PREEMPTION))
 		return;
 
+	switch (sched_bpf_wakeup_preempt(rq, p, wake_flags)) {
+	case BPF_SCHED_PREEMPT:
+		find_matching_se(&se, &pse);
+		update_curr(cfs_rq_of(se));
+		if (!next_buddy_marked)
+			set_next_buddy(pse);
+		goto preempt;
+	case BPF_SCHED_NO_PREEMPT:
+		return;
+	}
+
 	find_matching_se(&se, &pse);
 	update_curr(cfs_rq_of(se));
 	BUG_ON(!pse);
@@ -6965,9 +7247,33 @@ static inline bool cfs_rq_is_decayed(struct cfs_rq *cfs_rq)
 	if (cfs_rq->runnable_load_sum)
 		return false;
 
+	if (atomic_long_read(&cfs_rq->removed_load_avg) ||
+	    atomic_long_read(&cfs_rq->removed_util_avg))
+		return false;
+
 	return true;
 }
 
+/*
+ * The children of a cfs_rq are just before it on the leaf list: a cfs_rq is
+ * left there as long as one of them is, so that the list stays ordered
+ * bottom up once they are re-added.
+ */
+static inline bool child_cfs_rq_on_list(struct cfs_rq *cfs_rq)
+{
+	struct rq *rq = rq_of(cfs_rq);
+	struct cfs_rq *prev_cfs_rq;
+	struct list_head *prev;
+
+	prev = cfs_rq->leaf_cfs_rq_list.prev;
+	if (prev == &rq->leaf_cfs_rq_list)
+		return false;
+
+	prev_cfs_rq = container_of(prev, struct cfs_rq, leaf_cfs_rq_list);
+
+	return prev_cfs_rq->tg->parent == cfs_rq->tg;
+}
+
 static void update_blocked_averages(int cpu)
 {
 	struct rq *rq = cpu_rq(cpu);
@@ -7000,9 +7306,10 @@ static void update_blocked_averages(int cpu)
 		 * There can be a lot of idle CPU cgroups.  Don't let fully
 		 * decayed cfs_rqs linger on the list.
 		 */
-		if (cfs_rq_is_decayed(cfs_rq))
+		if (cfs_rq_is_decayed(cfs_rq) && !child_cfs_rq_on_list(cfs_rq))
 			list_del_leaf_cfs_rq(cfs_rq);
 	}
+	rq->last_blocked_load_update_tick = jiffies;
 	rq_unlock_irqrestore(rq, &rf);
 }
 
@@ -7062,6 +7369,7 @@ static inline void update_blocked_averages(int cpu)
 	rq_lock_irqsave(rq, &rf);
 	update_rq_clock(rq);
 	update_cfs_rq_load_avg(cfs_rq_clock_task(cfs_rq), cfs_rq);
+	rq->last_blocked_load_update_tick = jiffies;
 	rq_unlock_irqrestore(rq, &rf);
 }
 
@@ -8416,7 +8724,12 @@ static int idle_balance(struct rq *this_rq, struct rq_flags *rf)
 
 	raw_spin_unlock(&this_rq->lock);
 
-	update_blocked_averages(this_cpu);
+	/*
+	 * The blocked load only decays at the rate of the PELT periods: it
+	 * is enough to update it once a tick, however often we go idle.
+	 */
+	if (time_after(jiffies, this_rq->last_blocked_load_update_tick))
+		update_blocked_averages(this_cpu);
 	rcu_read_lock();
 	for_each_domain(this_cpu, sd) {
 		int continue_balancing = 1;
@@ -9442,6 +9755,7 @@ void init_tg_cfs_entry(struct task_group *tg, struct cfs_rq *cfs_rq,
 	se->my_q = cfs_rq;
 	/* guarantee group entities always have weight */
 	update_load_set(&se->load, NICE_0_LOAD);
+	se->latency_nice = tg->latency_nice;
 	se->parent = parent;
 }
 
@@ -9483,6 +9797,26 @@ int sched_group_set_shares(struct task_group *tg, unsigned long shares)
 	mutex_unlock(&shares_mutex);
 	return 0;
 }
+
+int sched_group_set_latency_nice(struct task_group *tg, long latency_nice)
+{
+	int i;
+
+	/* The root cgroup has no entity to give it to */
+	if (!tg->se[0])
+		return -EINVAL;
+
+	if (latency_nice < MIN_LATENCY_NICE || latency_nice > MAX_LATENCY_NICE)
+		return -EINVAL;
+
+	mutex_lock(&shares_mutex);
+	tg->latency_nice = latency_nice;
+	for_each_possible_cpu(i)
+		WRITE_ONCE(tg->se[i]->latency_nice, latency_nice);
+	mutex_unlock(&shares_mutex);
+
+	return 0;
+}
 #else /* CONFIG_FAIR_GROUP_SCHED */
 
 void free_fair_sched_group(struct task_group *tg) { }
@@ -28,6 +28,7 @@ static struct task_struct *
 pick_next_task_idle(struct rq *rq, struct task_struct *prev, struct rq_flags *rf)
 {
 	put_prev_task(rq, prev);
+	update_idle_cpumask(rq, true);
 	update_idle_core(rq);
 	schedstat_inc(rq->sched_goidle);
 	return rq->idle;
@@ -48,7 +49,7 @@ dequeue_task_idle(struct rq *rq, struct task_struct *p, int flags)
 
 static void put_prev_task_idle(struct rq *rq, struct task_struct *prev)
 {
-	rq_last_tick_reset(rq);
+	update_idle_cpumask(rq, false);
 }
 
 static void task_tick_idle(struct rq *rq, struct task_struct *curr, int queued)
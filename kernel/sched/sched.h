@@ -22,9 +22,11 @@
 #include <linux/sched/init.h>
 
 #include <linux/u64_stats_sync.h>
+#include <uapi/linux/bpf.h>
 #include <linux/kernel_stat.h>
 #include <linux/binfmts.h>
 #include <linux/mutex.h>
+#include <linux/psi.h>
 #include <linux/spinlock.h>
 #include <linux/stop_machine.h>
 #include <linux/irq_work.h>
@@ -280,6 +282,9 @@ struct cfs_bandwidth {
 	u64 quota, runtime;
 	s64 hierarchical_quota;
 	u64 runtime_expires;
+	/* unused quota carried over to the next periods, at most @burst */
+	u64 burst;
+	u64 runtime_snap;
 
 	int idle, period_active;
 	struct hrtimer period_timer, slack_timer;
@@ -288,6 +293,8 @@ struct cfs_bandwidth {
 	/* statistics */
 	int nr_periods, nr_throttled;
 	u64 throttled_time;
+	int nr_burst;
+	u64 burst_time;
 #endif
 };
 
@@ -301,6 +308,7 @@ struct task_group {
 	/* runqueue "owned" by this group on each cpu */
 	struct cfs_rq **cfs_rq;
 	unsigned long shares;
+	int latency_nice;
 
 #ifdef	CONFIG_SMP
 	/*
@@ -374,6 +382,7 @@ extern void init_tg_cfs_entry(struct task_group *tg, struct cfs_rq *cfs_rq,
 			struct sched_entity *se, int cpu,
 			struct sched_entity *parent);
 extern void init_cfs_bandwidth(struct cfs_bandwidth *cfs_b);
+extern void init_cfsb_csd(struct rq *rq);
 
 extern void __refill_cfs_bandwidth_runtime(struct cfs_bandwidth *cfs_b);
 extern void start_cfs_bandwidth(struct cfs_bandwidth *cfs_b);
@@ -400,6 +409,8 @@ extern void sched_move_task(struct task_struct *tsk);
 
 #ifdef CONFIG_FAIR_GROUP_SCHED
 extern int sched_group_set_shares(struct task_group *tg, unsigned long shares);
+extern int sched_group_set_latency_nice(struct task_group *tg,
+					long latency_nice);
 
 #ifdef CONFIG_SMP
 extern void set_task_rq_fair(struct sched_entity *se,
@@ -492,6 +503,8 @@ struct cfs_rq {
 	u64 throttled_clock_task_time;
 	int throttled, throttle_count;
 	struct list_head throttled_list;
+	/* on rq->cfsb_csd_list, waiting for the rq to unthrottle it */
+	struct list_head throttled_csd_list;
 #endif /* CONFIG_CFS_BANDWIDTH */
 #endif /* CONFIG_FAIR_GROUP_SCHED */
 };
@@ -685,9 +698,6 @@ struct rq {
 #endif /* CONFIG_SMP */
 	unsigned long nohz_flags;
 #endif /* CONFIG_NO_HZ_COMMON */
-#ifdef CONFIG_NO_HZ_FULL
-	unsigned long last_sched_tick;
-#endif
 	/* capture load from *all* tasks on this cpu: */
 	struct load_weight load;
 	unsigned long nr_load_updates;
@@ -748,6 +758,9 @@ struct rq {
 
 	/* This is used to determine avg_idle's max value */
 	u64 max_idle_balance_cost;
+
+	/* jiffies of the last update_blocked_averages() */
+	unsigned long last_blocked_load_update_tick;
 #endif
 
 #ifdef CONFIG_IRQ_TIME_ACCOUNTING
@@ -764,6 +777,12 @@ struct rq {
 	unsigned long calc_load_update;
 	long calc_load_active;
 
+#ifdef CONFIG_CFS_BANDWIDTH
+	/* cfs_rqs given runtime by a remote CPU, unthrottled in a batch */
+	call_single_data_t cfsb_csd;
+	struct list_head cfsb_csd_list;
+#endif
+
 #ifdef CONFIG_SCHED_HRTICK
 #ifdef CONFIG_SMP
 	int hrtick_csd_pending;
@@ -788,6 +807,11 @@ struct rq {
 	/* try_to_wake_up() stats */
 	unsigned int ttwu_count;
 	unsigned int ttwu_local;
+
+	/* select_idle_sibling() scans of the LLC */
+	unsigned int sis_search;
+	unsigned int sis_scanned;
+	unsigned int sis_failed;
 #endif
 
 #ifdef CONFIG_SMP
@@ -826,6 +850,12 @@ static inline void update_idle_core(struct rq *rq)
 static inline void update_idle_core(struct rq *rq) { }
 #endif
 
+#ifdef CONFIG_SMP
+extern void update_idle_cpumask(struct rq *rq, bool idle);
+#else
+static inline void update_idle_cpumask(struct rq *rq, bool idle) { }
+#endif
+
 DECLARE_PER_CPU_SHARED_ALIGNED(struct rq, runqueues);
 
 #define cpu_rq(cpu)		(&per_cpu(runqueues, (cpu)))
@@ -1053,6 +1083,7 @@ DECLARE_PER_CPU(struct sched_domain *, sd_llc);
 DECLARE_PER_CPU(int, sd_llc_size);
 DECLARE_PER_CPU(int, sd_llc_id);
 DECLARE_PER_CPU(struct sched_domain_shared *, sd_llc_shared);
+DECLARE_PER_CPU(struct sched_domain *, sd_cluster);
 DECLARE_PER_CPU(struct sched_domain *, sd_numa);
 DECLARE_PER_CPU(struct sched_domain *, sd_asym);
 
@@ -1138,7 +1169,6 @@ static inline void sched_ttwu_pending(void) { }
 
 #endif /* CONFIG_SMP */
 
-#include "stats.h"
 #include "autogroup.h"
 
 #ifdef CONFIG_CGROUP_SCHED
@@ -1343,6 +1373,47 @@ static inline void finish_lock_switch(struct rq *rq, struct task_struct *prev)
 #define WF_FORK		0x02		/* child wakeup after fork */
 #define WF_MIGRATED	0x4		/* internal use, task got migrated */
 
+#ifdef CONFIG_BPF_SYSCALL
+DECLARE_STATIC_KEY_FALSE(sched_bpf_select_rq_key);
+DECLARE_STATIC_KEY_FALSE(sched_bpf_wakeup_preempt_key);
+
+extern int __sched_bpf_select_rq(struct task_struct *p, int prev_cpu,
+				 int new_cpu, int sd_flag, int wake_flags);
+extern int __sched_bpf_wakeup_preempt(struct rq *rq, struct task_struct *p,
+				      int wake_flags);
+
+/* The CPU a BPF program prefers for @p, @new_cpu if none */
+static inline int sched_bpf_select_rq(struct task_struct *p, int prev_cpu,
+				      int new_cpu, int sd_flag, int wake_flags)
+{
+	if (static_branch_unlikely(&sched_bpf_select_rq_key))
+		return __sched_bpf_select_rq(p, prev_cpu, new_cpu, sd_flag,
+					     wake_flags);
+	return new_cpu;
+}
+
+/* Whether @p should preempt rq->curr, BPF_SCHED_NO_PREF to let CFS decide */
+static inline int sched_bpf_wakeup_preempt(struct rq *rq, struct task_struct *p,
+					   int wake_flags)
+{
+	if (static_branch_unlikely(&sched_bpf_wakeup_preempt_key))
+		return __sched_bpf_wakeup_preempt(rq, p, wake_flags);
+	return BPF_SCHED_NO_PREF;
+}
+#else
+static inline int sched_bpf_select_rq(struct task_struct *p, int prev_cpu,
+				      int new_cpu, int sd_flag, int wake_flags)
+{
+	return new_cpu;
+}
+
+static inline int sched_bpf_wakeup_preempt(struct rq *rq, struct task_struct *p,
+					   int wake_flags)
+{
+	return BPF_SCHED_NO_PREF;
+}
+#endif
+
 /*
  * To aid in avoiding the subversion of "niceness" due to uneven distribution
  * of tasks with abnormal "nice" values across CPUs the contribution that
@@ -1602,13 +1673,6 @@ static inline void sub_nr_running(struct rq *rq, unsigned count)
 	sched_update_tick_dependency(rq);
 }
 
-static inline void rq_last_tick_reset(struct rq *rq)
-{
-#ifdef CONFIG_NO_HZ_FULL
-	rq->last_sched_tick = jiffies;
-#endif
-}
-
 extern void update_rq_clock(struct rq *rq);
 
 extern void activate_task(struct rq *rq, struct task_struct *p, int flags);
@@ -1764,6 +1828,20 @@ rq_unlock(struct rq *rq, struct rq_flags *rf)
 	raw_spin_unlock(&rq->lock);
 }
 
+static inline struct rq *
+this_rq_lock_irq(struct rq_flags *rf)
+	__acquires(rq->lock)
+{
+	struct rq *rq;
+
+	local_irq_disable();
+	rq = this_rq();
+	rq_lock(rq, rf);
+	return rq;
+}
+
+#include "stats.h"
+
 #ifdef CONFIG_SMP
 #ifdef CONFIG_PREEMPT
 
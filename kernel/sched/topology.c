@@ -4,6 +4,7 @@
  */
 #include <linux/sched.h>
 #include <linux/mutex.h>
+#include <linux/cpuset.h>
 
 #include "sched.h"
 
@@ -384,6 +385,7 @@ DEFINE_PER_CPU(struct sched_domain *, sd_llc);
 DEFINE_PER_CPU(int, sd_llc_size);
 DEFINE_PER_CPU(int, sd_llc_id);
 DEFINE_PER_CPU(struct sched_domain_shared *, sd_llc_shared);
+DEFINE_PER_CPU(struct sched_domain *, sd_cluster);
 DEFINE_PER_CPU(struct sched_domain *, sd_numa);
 DEFINE_PER_CPU(struct sched_domain *, sd_asym);
 
@@ -406,6 +408,9 @@ static void update_top_cache_domain(int cpu)
 	per_cpu(sd_llc_id, cpu) = id;
 	rcu_assign_pointer(per_cpu(sd_llc_shared, cpu), sds);
 
+	sd = lowest_flag_domain(cpu, SD_CLUSTER);
+	rcu_assign_pointer(per_cpu(sd_cluster, cpu), sd);
+
 	sd = lowest_flag_domain(cpu, SD_NUMA);
 	rcu_assign_pointer(per_cpu(sd_numa, cpu), sd);
 
@@ -1059,6 +1064,7 @@ static int sched_domains_curr_level;
  *
  *   SD_SHARE_CPUCAPACITY   - describes SMT topologies
  *   SD_SHARE_PKG_RESOURCES - describes shared caches
+ *   SD_CLUSTER             - describes CPUs sharing an L2 within the LLC
  *   SD_NUMA                - describes NUMA topologies
  *   SD_SHARE_POWERDOMAIN   - describes shared power domain
  *   SD_ASYM_CPUCAPACITY    - describes mixed capacity topologies
@@ -1072,6 +1078,7 @@ static int sched_domains_curr_level;
 	(SD_SHARE_CPUCAPACITY |		\
 	 SD_SHARE_PKG_RESOURCES |	\
 	 SD_NUMA |			\
+	 SD_CLUSTER |			\
 	 SD_ASYM_PACKING |		\
 	 SD_ASYM_CPUCAPACITY |		\
 	 SD_SHARE_POWERDOMAIN)
@@ -1191,6 +1198,9 @@ sd_init(struct sched_domain_topology_level *tl,
 		sd->shared = *per_cpu_ptr(sdd->sds, sd_id);
 		atomic_inc(&sd->shared->ref);
 		atomic_set(&sd->shared->nr_busy_cpus, sd_weight);
+		/* until the tick clears the busy ones */
+		cpumask_copy(sds_idle_cpus(sd->shared), sched_domain_span(sd));
+		cpumask_copy(sds_idle_cores(sd->shared), sched_domain_span(sd));
 	}
 
 	sd->private = sdd;
@@ -1198,6 +1208,83 @@ sd_init(struct sched_domain_topology_level *tl,
 	return sd;
 }
 
+#ifdef CONFIG_SCHED_CLUSTER
+/*
+ * kernel.sched_cluster, or sched_cluster= on the command line, turns the
+ * cluster level off.  The level is then given the span of its child and
+ * degenerates when the domains are built.
+ */
+unsigned int __read_mostly sysctl_sched_cluster = 1;
+static bool sched_cluster_changed;
+static DEFINE_MUTEX(sched_cluster_mutex);
+
+static int __init sched_cluster_setup(char *str)
+{
+	unsigned int val;
+
+	if (kstrtouint(str, 0, &val))
+		return 0;
+	sysctl_sched_cluster = !!val;
+
+	return 1;
+}
+__setup("sched_cluster=", sched_cluster_setup);
+
+int sched_cluster_handler(struct ctl_table *table, int write,
+			  void __user *buffer, size_t *lenp, loff_t *ppos)
+{
+	unsigned int old;
+	int ret;
+
+	mutex_lock(&sched_cluster_mutex);
+	old = sysctl_sched_cluster;
+	ret = proc_douintvec_minmax(table, write, buffer, lenp, ppos);
+	if (!ret && write && old != sysctl_sched_cluster) {
+		/* The domain spans are unchanged, force a full rebuild */
+		sched_cluster_changed = true;
+		rebuild_sched_domains();
+	}
+	mutex_unlock(&sched_cluster_mutex);
+
+	return ret;
+}
+
+/* Called with sched_domains_mutex held */
+static int sched_cluster_update(void)
+{
+	int ret = sched_cluster_changed;
+
+	sched_cluster_changed = false;
+	return ret;
+}
+
+const struct cpumask *cpu_cluster_mask(int cpu)
+{
+	const struct cpumask *mask = cpu_clustergroup_mask(cpu);
+
+	if (!READ_ONCE(sysctl_sched_cluster))
+		goto degenerate;
+#ifdef CONFIG_SCHED_MC
+	/* A cluster spanning the whole LLC would only shadow MC */
+	if (cpumask_subset(cpu_coregroup_mask(cpu), mask))
+		goto degenerate;
+#endif
+	return mask;
+
+degenerate:
+#ifdef CONFIG_SCHED_SMT
+	return cpu_smt_mask(cpu);
+#else
+	return cpumask_of(cpu);
+#endif
+}
+#else
+static inline int sched_cluster_update(void)
+{
+	return 0;
+}
+#endif
+
 /*
  * Topology list, bottom-up.
  */
@@ -1205,6 +1292,9 @@ static struct sched_domain_topology_level default_topology[] = {
 #ifdef CONFIG_SCHED_SMT
 	{ cpu_smt_mask, cpu_smt_flags, SD_INIT_NAME(SMT) },
 #endif
+#ifdef CONFIG_SCHED_CLUSTER
+	{ cpu_cluster_mask, cpu_cluster_flags, SD_INIT_NAME(CLS) },
+#endif
 #ifdef CONFIG_SCHED_MC
 	{ cpu_coregroup_mask, cpu_core_flags, SD_INIT_NAME(MC) },
 #endif
@@ -1524,7 +1614,8 @@ static int __sdt_alloc(const struct cpumask *cpu_map)
 
 			*per_cpu_ptr(sdd->sd, j) = sd;
 
-			sds = kzalloc_node(sizeof(struct sched_domain_shared),
+			sds = kzalloc_node(sizeof(struct sched_domain_shared) +
+					2 * cpumask_size(),
 					GFP_KERNEL, cpu_to_node(j));
 			if (!sds)
 				return -ENOMEM;
@@ -1849,7 +1940,7 @@ void partition_sched_domains(int ndoms_new, cpumask_var_t doms_new[],
 	unregister_sched_domain_sysctl();
 
 	/* Let the architecture update CPU core mappings: */
-	new_topology = arch_update_cpu_topology();
+	new_topology = arch_update_cpu_topology() | sched_cluster_update();
 
 	if (!doms_new) {
 		WARN_ON_ONCE(dattr_new);
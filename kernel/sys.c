@@ -37,6 +37,7 @@
 #include <linux/ptrace.h>
 #include <linux/fs_struct.h>
 #include <linux/file.h>
+#include <linux/futex.h>
 #include <linux/mount.h>
 #include <linux/gfp.h>
 #include <linux/syscore_ops.h>
@@ -2386,6 +2387,16 @@ SYSCALL_DEFINE5(prctl, int, option, unsigned long, arg2, unsigned long, arg3,
 	case PR_GET_FP_MODE:
 		error = GET_FP_MODE(me);
 		break;
+	case PR_FUTEX_HASH:
+		if (arg4 || arg5)
+			return -EINVAL;
+		error = futex_hash_prctl(arg2, arg3);
+		break;
+	case PR_FD_ALLOC:
+		if (arg4 || arg5)
+			return -EINVAL;
+		error = fd_alloc_prctl(arg2, arg3);
+		break;
 	default:
 		error = -EINVAL;
 		break;
@@ -28,6 +28,8 @@
 #include <linux/fs.h>
 #include <linux/file.h>
 #include <linux/pid_namespace.h>
+#include <linux/proc_ns.h>
+#include <linux/user_namespace.h>
 #include <net/genetlink.h>
 #include <linux/atomic.h>
 #include <linux/sched/cputime.h>
@@ -48,7 +50,9 @@ static const struct nla_policy taskstats_cmd_get_policy[TASKSTATS_CMD_ATTR_MAX+1
 	[TASKSTATS_CMD_ATTR_PID]  = { .type = NLA_U32 },
 	[TASKSTATS_CMD_ATTR_TGID] = { .type = NLA_U32 },
 	[TASKSTATS_CMD_ATTR_REGISTER_CPUMASK] = { .type = NLA_STRING },
-	[TASKSTATS_CMD_ATTR_DEREGISTER_CPUMASK] = { .type = NLA_STRING },};
+	[TASKSTATS_CMD_ATTR_DEREGISTER_CPUMASK] = { .type = NLA_STRING },
+	[TASKSTATS_CMD_ATTR_CGROUP_FD] = { .type = NLA_U32 },
+	[TASKSTATS_CMD_ATTR_PIDNS_FD] = { .type = NLA_U32 },};
 
 /*
  * We have to use TASKSTATS_CMD_ATTR_MAX here, it is the maxattr in the family.
@@ -565,6 +569,179 @@ static int taskstats_user_cmd(struct sk_buff *skb, struct genl_info *info)
 		return -EINVAL;
 }
 
+/*
+ * TASKSTATS_CMD_GET with NLM_F_DUMP sends a TASKSTATS_TYPE_AGGR_PID message
+ * for each task of the pid namespace of the caller, optionally only the ones
+ * under the cgroup2 directory TASKSTATS_CMD_ATTR_CGROUP_FD, or the ones seen
+ * in the pid namespace TASKSTATS_CMD_ATTR_PIDNS_FD.  The tasks are walked
+ * under RCU, and cb->args[] hold where to resume and what to filter on.
+ */
+enum {
+	DUMP_ARG_TGID,		/* thread group to resume at */
+	DUMP_ARG_THREAD,	/* threads of it already sent */
+	DUMP_ARG_PID_NS,	/* pid and user namespaces of the caller */
+	DUMP_ARG_USER_NS,
+	DUMP_ARG_CGROUP,	/* filters, or NULL */
+	DUMP_ARG_FILTER_NS,
+};
+
+static int taskstats_dump_done(struct netlink_callback *cb)
+{
+	struct pid_namespace *filter_ns = (void *)cb->args[DUMP_ARG_FILTER_NS];
+	struct cgroup *cgrp = (void *)cb->args[DUMP_ARG_CGROUP];
+
+	if (filter_ns)
+		put_pid_ns(filter_ns);
+	if (cgrp)
+		cgroup_put(cgrp);
+	put_user_ns((void *)cb->args[DUMP_ARG_USER_NS]);
+	put_pid_ns((void *)cb->args[DUMP_ARG_PID_NS]);
+	return 0;
+}
+
+static struct pid_namespace *get_pid_ns_from_fd(int fd)
+{
+	struct pid_namespace *pid_ns;
+	struct ns_common *ns;
+	struct file *file;
+
+	file = proc_ns_fget(fd);
+	if (IS_ERR(file))
+		return ERR_CAST(file);
+
+	ns = get_proc_ns(file_inode(file));
+	if (ns->ops == &pidns_operations) {
+		pid_ns = container_of(ns, struct pid_namespace, ns);
+		get_pid_ns(pid_ns);
+	} else {
+		pid_ns = ERR_PTR(-EINVAL);
+	}
+	fput(file);
+	return pid_ns;
+}
+
+static int taskstats_dump_start(struct netlink_callback *cb)
+{
+	struct nlattr *attrs[TASKSTATS_CMD_ATTR_MAX + 1];
+	struct pid_namespace *filter_ns;
+	struct cgroup *cgrp;
+	int rc;
+
+	rc = genlmsg_parse(cb->nlh, &family, attrs, TASKSTATS_CMD_ATTR_MAX,
+			   taskstats_cmd_get_policy, NULL);
+	if (rc < 0)
+		return rc;
+
+	/* the dump may go on from another task reading the socket */
+	cb->args[DUMP_ARG_PID_NS] =
+		(long)get_pid_ns(task_active_pid_ns(current));
+	cb->args[DUMP_ARG_USER_NS] = (long)get_user_ns(current_user_ns());
+
+	if (attrs[TASKSTATS_CMD_ATTR_CGROUP_FD]) {
+		cgrp = cgroup_get_from_fd(
+			nla_get_u32(attrs[TASKSTATS_CMD_ATTR_CGROUP_FD]));
+		if (IS_ERR(cgrp)) {
+			rc = PTR_ERR(cgrp);
+			goto err;
+		}
+		cb->args[DUMP_ARG_CGROUP] = (long)cgrp;
+	}
+
+	if (attrs[TASKSTATS_CMD_ATTR_PIDNS_FD]) {
+		filter_ns = get_pid_ns_from_fd(
+			nla_get_u32(attrs[TASKSTATS_CMD_ATTR_PIDNS_FD]));
+		if (IS_ERR(filter_ns)) {
+			rc = PTR_ERR(filter_ns);
+			goto err;
+		}
+		cb->args[DUMP_ARG_FILTER_NS] = (long)filter_ns;
+	}
+	return 0;
+err:
+	/* ->done is not called when ->start fails */
+	taskstats_dump_done(cb);
+	return rc;
+}
+
+static bool taskstats_dump_filter(struct netlink_callback *cb,
+				  struct task_struct *tsk)
+{
+	struct pid_namespace *filter_ns = (void *)cb->args[DUMP_ARG_FILTER_NS];
+	struct cgroup *cgrp = (void *)cb->args[DUMP_ARG_CGROUP];
+
+	if (cgrp && !task_under_cgroup_hierarchy(tsk, cgrp))
+		return false;
+	if (filter_ns && !task_pid_nr_ns(tsk, filter_ns))
+		return false;
+	return true;
+}
+
+/* false when @skb is full */
+static bool taskstats_dump_task(struct sk_buff *skb,
+				struct netlink_callback *cb,
+				struct task_struct *tsk)
+{
+	struct pid_namespace *pid_ns = (void *)cb->args[DUMP_ARG_PID_NS];
+	struct taskstats *stats;
+	void *reply;
+
+	reply = genlmsg_put(skb, NETLINK_CB(cb->skb).portid,
+			    cb->nlh->nlmsg_seq, &family, NLM_F_MULTI,
+			    TASKSTATS_CMD_NEW);
+	if (!reply)
+		return false;
+
+	stats = mk_reply(skb, TASKSTATS_TYPE_PID, task_pid_nr_ns(tsk, pid_ns));
+	if (!stats) {
+		genlmsg_cancel(skb, reply);
+		return false;
+	}
+	fill_stats((void *)cb->args[DUMP_ARG_USER_NS], pid_ns, tsk, stats);
+	genlmsg_end(skb, reply);
+	return true;
+}
+
+static int taskstats_user_dump(struct sk_buff *skb,
+			       struct netlink_callback *cb)
+{
+	struct pid_namespace *pid_ns = (void *)cb->args[DUMP_ARG_PID_NS];
+	struct task_struct *leader, *tsk;
+	unsigned long nr;
+	struct pid *pid;
+	pid_t tgid;
+
+	rcu_read_lock();
+	for (;; cb->args[DUMP_ARG_TGID]++, cb->args[DUMP_ARG_THREAD] = 0) {
+		pid = find_ge_pid(cb->args[DUMP_ARG_TGID], pid_ns);
+		if (!pid)
+			break;
+		tgid = pid_nr_ns(pid, pid_ns);
+		if (tgid != cb->args[DUMP_ARG_TGID]) {
+			/* the thread group we were in is gone */
+			cb->args[DUMP_ARG_TGID] = tgid;
+			cb->args[DUMP_ARG_THREAD] = 0;
+		}
+
+		/* see next_tgid() in fs/proc/base.c */
+		leader = pid_task(pid, PIDTYPE_PID);
+		if (!leader || !has_group_leader_pid(leader))
+			continue;
+
+		nr = 0;
+		for_each_thread(leader, tsk) {
+			if (nr++ < cb->args[DUMP_ARG_THREAD])
+				continue;
+			if (taskstats_dump_filter(cb, tsk) &&
+			    !taskstats_dump_task(skb, cb, tsk))
+				goto out;
+			cb->args[DUMP_ARG_THREAD] = nr;
+		}
+	}
+out:
+	rcu_read_unlock();
+	return skb->len;
+}
+
 static struct taskstats *taskstats_tgid_alloc(struct task_struct *tsk)
 {
 	struct signal_struct *sig = tsk->signal;
@@ -654,6 +831,9 @@ static const struct genl_ops taskstats_ops[] = {
 	{
 		.cmd		= TASKSTATS_CMD_GET,
 		.doit		= taskstats_user_cmd,
+		.start		= taskstats_dump_start,
+		.dumpit		= taskstats_user_dump,
+		.done		= taskstats_dump_done,
 		.policy		= taskstats_cmd_get_policy,
 		.flags		= GENL_ADMIN_PERM,
 	},
@@ -483,6 +483,9 @@ void __init tick_nohz_init(void)
 	 * as timekeeping, unbound timers, workqueues, ...
 	 */
 	WARN_ON_ONCE(cpumask_empty(housekeeping_mask));
+
+	/* Housekeeping runs the scheduler tick of busy nohz_full CPUs */
+	sched_tick_offload_init();
 }
 #endif
 
@@ -510,6 +513,13 @@ int tick_nohz_tick_stopped(void)
 	return __this_cpu_read(tick_cpu_sched.tick_stopped);
 }
 
+int tick_nohz_tick_stopped_cpu(int cpu)
+{
+	struct tick_sched *ts = per_cpu_ptr(&tick_cpu_sched, cpu);
+
+	return ts->tick_stopped;
+}
+
 /**
  * tick_nohz_update_jiffies - update jiffies when idle was interrupted
  *
@@ -750,12 +760,6 @@ static ktime_t tick_nohz_stop_sched_tick(struct tick_sched *ts,
 		delta = KTIME_MAX;
 	}
 
-#ifdef CONFIG_NO_HZ_FULL
-	/* Limit the tick delta to the maximum scheduler deferment */
-	if (!ts->inidle)
-		delta = min(delta, scheduler_tick_max_deferment());
-#endif
-
 	/* Calculate the next expiry time */
 	if (delta < (KTIME_MAX - basemono))
 		expires = basemono + delta;
@@ -52,6 +52,7 @@
 #include <asm/io.h>
 
 #include "tick-internal.h"
+#include "timer_migration.h"
 
 #define CREATE_TRACE_POINTS
 #include <trace/events/timer.h>
@@ -179,18 +180,23 @@ EXPORT_SYMBOL(jiffies_64);
 #define WHEEL_TIMEOUT_MAX	(WHEEL_TIMEOUT_CUTOFF - LVL_GRAN(LVL_DEPTH - 1))
 
 /*
- * The resulting wheel size. If NOHZ is configured we allocate two
- * wheels so we have a separate storage for the deferrable timers.
+ * The resulting wheel size. If NOHZ is configured we allocate three
+ * wheels: pinned timers stay in the standard one, timers which are not
+ * pinned go to the global one, which the timer migration hierarchy
+ * expires while the CPU is idle, and deferrable timers have a separate
+ * storage.
  */
 #define WHEEL_SIZE	(LVL_SIZE * LVL_DEPTH)
 
 #ifdef CONFIG_NO_HZ_COMMON
-# define NR_BASES	2
+# define NR_BASES	3
 # define BASE_STD	0
-# define BASE_DEF	1
+# define BASE_GLOBAL	1
+# define BASE_DEF	2
 #else
 # define NR_BASES	1
 # define BASE_STD	0
+# define BASE_GLOBAL	0
 # define BASE_DEF	0
 #endif
 
@@ -204,6 +210,7 @@ struct timer_base {
 	bool			nohz_active;
 	bool			is_idle;
 	bool			must_forward_clk;
+	bool			expiring;
 	DECLARE_BITMAP(pending_map, WHEEL_SIZE);
 	struct hlist_head	vectors[WHEEL_SIZE];
 } ____cacheline_aligned;
@@ -224,11 +231,13 @@ void timers_update_migration(bool update_nohz)
 
 	for_each_possible_cpu(cpu) {
 		per_cpu(timer_bases[BASE_STD].migration_enabled, cpu) = on;
+		per_cpu(timer_bases[BASE_GLOBAL].migration_enabled, cpu) = on;
 		per_cpu(timer_bases[BASE_DEF].migration_enabled, cpu) = on;
 		per_cpu(hrtimer_bases.migration_enabled, cpu) = on;
 		if (!update_nohz)
 			continue;
 		per_cpu(timer_bases[BASE_STD].nohz_active, cpu) = true;
+		per_cpu(timer_bases[BASE_GLOBAL].nohz_active, cpu) = true;
 		per_cpu(timer_bases[BASE_DEF].nohz_active, cpu) = true;
 		per_cpu(hrtimer_bases.nohz_active, cpu) = true;
 	}
@@ -555,6 +564,14 @@ trigger_dyntick_cpu(struct timer_base *base, struct timer_list *timer)
 	if (!base->is_idle)
 		return;
 
+	/*
+	 * The global base of an idle CPU is only queued to remotely by a
+	 * migrator re-arming a timer it expires on behalf of the CPU. The
+	 * migrator updates the hierarchy afterwards, no need to wake the CPU.
+	 */
+	if (base == per_cpu_ptr(&timer_bases[BASE_GLOBAL], base->cpu))
+		return;
+
 	/* Check whether this is the new first expiring timer: */
 	if (time_after_eq(timer->expires, base->next_expiry))
 		return;
@@ -815,11 +832,14 @@ static inline struct timer_base *get_timer_cpu_base(u32 tflags, u32 cpu)
 
 	/*
 	 * If the timer is deferrable and nohz is active then we need to use
-	 * the deferrable base.
+	 * the deferrable base. Timers which are not pinned go to the global
+	 * base.
 	 */
 	if (IS_ENABLED(CONFIG_NO_HZ_COMMON) && base->nohz_active &&
 	    (tflags & TIMER_DEFERRABLE))
 		base = per_cpu_ptr(&timer_bases[BASE_DEF], cpu);
+	else if (!(tflags & TIMER_PINNED))
+		base = per_cpu_ptr(&timer_bases[BASE_GLOBAL], cpu);
 	return base;
 }
 
@@ -829,11 +849,14 @@ static inline struct timer_base *get_timer_this_cpu_base(u32 tflags)
 
 	/*
 	 * If the timer is deferrable and nohz is active then we need to use
-	 * the deferrable base.
+	 * the deferrable base. Timers which are not pinned go to the global
+	 * base.
 	 */
 	if (IS_ENABLED(CONFIG_NO_HZ_COMMON) && base->nohz_active &&
 	    (tflags & TIMER_DEFERRABLE))
 		base = this_cpu_ptr(&timer_bases[BASE_DEF]);
+	else if (!(tflags & TIMER_PINNED))
+		base = this_cpu_ptr(&timer_bases[BASE_GLOBAL]);
 	return base;
 }
 
@@ -843,18 +866,6 @@ static inline struct timer_base *get_timer_base(u32 tflags)
 }
 
 #ifdef CONFIG_NO_HZ_COMMON
-static inline struct timer_base *
-get_target_base(struct timer_base *base, unsigned tflags)
-{
-#ifdef CONFIG_SMP
-	if ((tflags & TIMER_PINNED) || !base->migration_enabled)
-		return get_timer_this_cpu_base(tflags);
-	return get_timer_cpu_base(tflags, get_nohz_timer_target());
-#else
-	return get_timer_this_cpu_base(tflags);
-#endif
-}
-
 static inline void forward_timer_base(struct timer_base *base)
 {
 	unsigned long jnow;
@@ -882,12 +893,6 @@ static inline void forward_timer_base(struct timer_base *base)
 		base->clk = base->next_expiry;
 }
 #else
-static inline struct timer_base *
-get_target_base(struct timer_base *base, unsigned tflags)
-{
-	return get_timer_this_cpu_base(tflags);
-}
-
 static inline void forward_timer_base(struct timer_base *base) { }
 #endif
 
@@ -986,7 +991,12 @@ __mod_timer(struct timer_list *timer, unsigned long expires, bool pending_only)
 
 	debug_activate(timer, expires);
 
-	new_base = get_target_base(base, timer->flags);
+	/*
+	 * Timers are always queued on the local CPU. Instead of pushing
+	 * them to a busy CPU here, the timer migration hierarchy pulls the
+	 * global ones when the CPU goes idle.
+	 */
+	new_base = get_timer_this_cpu_base(timer->flags);
 
 	if (base != new_base) {
 		/*
@@ -1107,7 +1117,11 @@ void add_timer_on(struct timer_list *timer, int cpu)
 
 	BUG_ON(timer_pending(timer) || !timer->function);
 
-	new_base = get_timer_cpu_base(timer->flags, cpu);
+	/*
+	 * A timer queued on a given CPU must not be expired by the timer
+	 * migration hierarchy somewhere else: it is pinned from now on.
+	 */
+	new_base = get_timer_cpu_base(timer->flags | TIMER_PINNED, cpu);
 
 	/*
 	 * If @timer was on a different CPU, it should be migrated with the
@@ -1116,7 +1130,7 @@ void add_timer_on(struct timer_list *timer, int cpu)
 	 */
 	base = lock_timer_base(timer, &flags);
 	if (base != new_base) {
-		timer->flags |= TIMER_MIGRATING;
+		timer->flags |= TIMER_MIGRATING | TIMER_PINNED;
 
 		raw_spin_unlock(&base->lock);
 		base = new_base;
@@ -1473,23 +1487,28 @@ static u64 cmp_next_hrtimer_event(u64 basem, u64 expires)
  * Returns the tick aligned clock monotonic time of the next pending
  * timer or KTIME_MAX if no timer is pending.
  */
-u64 get_next_timer_interrupt(unsigned long basej, u64 basem)
+/*
+ * Convert a timer wheel expiry to jiffies64, as used by the timer
+ * migration hierarchy.
+ */
+static u64 timer_expiry64(unsigned long expiry)
 {
-	struct timer_base *base = this_cpu_ptr(&timer_bases[BASE_STD]);
-	u64 expires = KTIME_MAX;
-	unsigned long nextevt;
-	bool is_max_delta;
+	u64 now = get_jiffies_64();
 
-	/*
-	 * Pretend that there is no timer pending if the cpu is offline.
-	 * Possible pending timers will be migrated later to an active cpu.
-	 */
-	if (cpu_is_offline(smp_processor_id()))
-		return expires;
+	return now + (long)(expiry - (unsigned long)now);
+}
 
-	raw_spin_lock(&base->lock);
-	nextevt = __next_timer_interrupt(base);
-	is_max_delta = (nextevt == base->clk + NEXT_TIMER_MAX_DELTA);
+/*
+ * Fetch the first expiring timer of @base and forward its clock. Caller
+ * must hold base->lock.
+ */
+static unsigned long fetch_next_timer_interrupt(struct timer_base *base,
+						unsigned long basej,
+						bool *is_max_delta)
+{
+	unsigned long nextevt = __next_timer_interrupt(base);
+
+	*is_max_delta = (nextevt == base->clk + NEXT_TIMER_MAX_DELTA);
 	base->next_expiry = nextevt;
 	/*
 	 * We have a fresh next event. Check whether we can forward the
@@ -1502,10 +1521,66 @@ u64 get_next_timer_interrupt(unsigned long basej, u64 basem)
 		else if (time_after(nextevt, base->clk))
 			base->clk = nextevt;
 	}
+	return nextevt;
+}
+
+u64 get_next_timer_interrupt(unsigned long basej, u64 basem)
+{
+	struct timer_base *base = this_cpu_ptr(&timer_bases[BASE_STD]);
+	struct timer_base *base_global = base + BASE_GLOBAL;
+	unsigned long nextevt, nextevt_global;
+	bool is_max_delta, global_max_delta;
+	u64 expires = KTIME_MAX, global, tmigr_next;
+
+	/*
+	 * Pretend that there is no timer pending if the cpu is offline.
+	 * Possible pending timers will be migrated later to an active cpu.
+	 */
+	if (cpu_is_offline(smp_processor_id()))
+		return expires;
+
+	raw_spin_lock(&base->lock);
+	raw_spin_lock_nested(&base_global->lock, SINGLE_DEPTH_NESTING);
+	nextevt = fetch_next_timer_interrupt(base, basej, &is_max_delta);
+	nextevt_global = fetch_next_timer_interrupt(base_global, basej,
+						    &global_max_delta);
+	/* The timer migration locks nest outside of the base locks */
+	raw_spin_unlock(&base_global->lock);
+	raw_spin_unlock(&base->lock);
+
+	/*
+	 * An idle CPU hands its global timers to the timer migration
+	 * hierarchy, which only leaves it the wakeup for the whole
+	 * hierarchy if it is the last active CPU. A busy nohz_full CPU, or
+	 * one with migration disabled, still wakes up for its own timers.
+	 */
+	if (!global_max_delta && time_before_eq(nextevt_global, basej)) {
+		nextevt = nextevt_global;
+		is_max_delta = false;
+	} else if (is_idle_task(current)) {
+		global = global_max_delta ? TMIGR_NONE :
+			 timer_expiry64(nextevt_global);
+		tmigr_next = tmigr_cpu_deactivate(global);
+		if (!base->migration_enabled)
+			tmigr_next = min(tmigr_next, global);
+		if (tmigr_next != TMIGR_NONE &&
+		    (is_max_delta ||
+		     time_before((unsigned long)tmigr_next, nextevt))) {
+			nextevt = (unsigned long)tmigr_next;
+			is_max_delta = false;
+		}
+	} else if (!global_max_delta &&
+		   (is_max_delta || time_before(nextevt_global, nextevt))) {
+		nextevt = nextevt_global;
+		is_max_delta = false;
+	}
 
+	raw_spin_lock(&base->lock);
+	raw_spin_lock_nested(&base_global->lock, SINGLE_DEPTH_NESTING);
 	if (time_before_eq(nextevt, basej)) {
 		expires = basem;
 		base->is_idle = false;
+		base_global->is_idle = false;
 	} else {
 		if (!is_max_delta)
 			expires = basem + (u64)(nextevt - basej) * TICK_NSEC;
@@ -1513,14 +1588,18 @@ u64 get_next_timer_interrupt(unsigned long basej, u64 basem)
 		 * If we expect to sleep more than a tick, mark the base idle.
 		 * Also the tick is stopped so any added timer must forward
 		 * the base clk itself to keep granularity small. This idle
-		 * logic is only maintained for the BASE_STD base, deferrable
-		 * timers may still see large granularity skew (by design).
+		 * logic is only maintained for the BASE_STD and BASE_GLOBAL
+		 * bases, deferrable timers may still see large granularity
+		 * skew (by design).
 		 */
 		if ((expires - basem) > TICK_NSEC) {
 			base->must_forward_clk = true;
 			base->is_idle = true;
+			base_global->must_forward_clk = true;
+			base_global->is_idle = true;
 		}
 	}
+	raw_spin_unlock(&base_global->lock);
 	raw_spin_unlock(&base->lock);
 
 	return cmp_next_hrtimer_event(basem, expires);
@@ -1542,6 +1621,10 @@ void timer_clear_idle(void)
 	 * the lock in the exit from idle path.
 	 */
 	base->is_idle = false;
+	this_cpu_ptr(&timer_bases[BASE_GLOBAL])->is_idle = false;
+
+	/* Take the global timers back from the timer migration hierarchy */
+	tmigr_cpu_activate();
 }
 
 static int collect_expired_timers(struct timer_base *base,
@@ -1611,6 +1694,17 @@ static inline void __run_timers(struct timer_base *base)
 
 	raw_spin_lock_irq(&base->lock);
 
+	/*
+	 * The global base of a CPU which just left idle may still be
+	 * expired by a migrator. Only one CPU expires a base at a time,
+	 * the other one catches up on the next tick.
+	 */
+	if (base->expiring) {
+		raw_spin_unlock_irq(&base->lock);
+		return;
+	}
+	base->expiring = true;
+
 	while (time_after_eq(jiffies, base->clk)) {
 
 		levels = collect_expired_timers(base, heads);
@@ -1620,9 +1714,40 @@ static inline void __run_timers(struct timer_base *base)
 			expire_timers(base, heads + levels);
 	}
 	base->running_timer = NULL;
+	base->expiring = false;
 	raw_spin_unlock_irq(&base->lock);
 }
 
+#ifdef CONFIG_TIMER_MIGRATION
+/*
+ * Expire the global timers of the idle @cpu on its behalf, called by the
+ * migrator of its group.
+ */
+void timer_expire_remote(unsigned int cpu)
+{
+	__run_timers(per_cpu_ptr(&timer_bases[BASE_GLOBAL], cpu));
+}
+
+/*
+ * First expiry of the global base of @cpu in jiffies64, or TMIGR_NONE.
+ * Called with interrupts disabled.
+ */
+u64 timer_next_global_expiry(unsigned int cpu)
+{
+	struct timer_base *base = per_cpu_ptr(&timer_bases[BASE_GLOBAL], cpu);
+	unsigned long nextevt;
+	bool is_max_delta;
+
+	raw_spin_lock(&base->lock);
+	nextevt = __next_timer_interrupt(base);
+	is_max_delta = (nextevt == base->clk + NEXT_TIMER_MAX_DELTA);
+	base->next_expiry = nextevt;
+	raw_spin_unlock(&base->lock);
+
+	return is_max_delta ? TMIGR_NONE : timer_expiry64(nextevt);
+}
+#endif
+
 /*
  * This function runs timers and the timer-tq in bottom half context.
  */
@@ -1634,7 +1759,7 @@ static __latent_entropy void run_timer_softirq(struct softirq_action *h)
 	 * must_forward_clk must be cleared before running timers so that any
 	 * timer functions that call mod_timer will not try to forward the
 	 * base. idle trcking / clock forwarding logic is only used with
-	 * BASE_STD timers.
+	 * BASE_STD and BASE_GLOBAL timers.
 	 *
 	 * The deferrable base does not do idle tracking at all, so we do
 	 * not forward it. This can result in very large variations in
@@ -1644,8 +1769,18 @@ static __latent_entropy void run_timer_softirq(struct softirq_action *h)
 	base->must_forward_clk = false;
 
 	__run_timers(base);
-	if (IS_ENABLED(CONFIG_NO_HZ_COMMON) && base->nohz_active)
-		__run_timers(this_cpu_ptr(&timer_bases[BASE_DEF]));
+	if (IS_ENABLED(CONFIG_NO_HZ_COMMON)) {
+		struct timer_base *base_global;
+
+		base_global = this_cpu_ptr(&timer_bases[BASE_GLOBAL]);
+		base_global->must_forward_clk = false;
+		__run_timers(base_global);
+		if (base->nohz_active)
+			__run_timers(this_cpu_ptr(&timer_bases[BASE_DEF]));
+	}
+
+	/* Expire the global timers of the idle CPUs we are migrator for */
+	tmigr_handle_remote();
 }
 
 /*
@@ -1658,11 +1793,16 @@ void run_local_timers(void)
 	hrtimer_run_queues();
 	/* Raise the softirq only if required. */
 	if (time_before(jiffies, base->clk)) {
-		if (!IS_ENABLED(CONFIG_NO_HZ_COMMON) || !base->nohz_active)
+		if (!IS_ENABLED(CONFIG_NO_HZ_COMMON))
 			return;
-		/* CPU is awake, so check the deferrable base. */
-		base++;
-		if (time_before(jiffies, base->clk))
+		/*
+		 * CPU is awake, so check the global base, the deferrable
+		 * base and the timers of the idle CPUs it is migrator for.
+		 */
+		if (time_before(jiffies, base[BASE_GLOBAL].clk) &&
+		    (!base->nohz_active ||
+		     time_before(jiffies, base[BASE_DEF].clk)) &&
+		    !tmigr_requires_handle_remote())
 			return;
 	}
 	raise_softirq(TIMER_SOFTIRQ);
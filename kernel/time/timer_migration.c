@@ -0,0 +1,472 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Timer migration hierarchy
+ *
+ * Timers which are not pinned are queued in the global base of the CPU
+ * which arms them.  A CPU going idle does not wake up for them: it hands
+ * the first expiry of its global base to its group instead, and one
+ * active CPU of the group, the migrator, expires the global timers of the
+ * idle members from its timer softirq.  When the last CPU of a group goes
+ * idle, the group hands its first expiry to its parent, and so on up to
+ * the root.  When the whole hierarchy is idle, the last CPU to go idle
+ * keeps the first expiry of the hierarchy as its own wakeup.
+ *
+ * A group has up to TMIGR_CHILDREN_PER_GROUP children.  The lowest level
+ * packs CPUs of the same node, the levels above pack the groups of a node
+ * until a single group covers it, and the top levels pack the node groups
+ * up to the root.
+ */
+#include <linux/cpuhotplug.h>
+#include <linux/cpumask.h>
+#include <linux/init.h>
+#include <linux/jiffies.h>
+#include <linux/lockdep.h>
+#include <linux/percpu.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/tick.h>
+#include <linux/topology.h>
+#include <linux/sched/nohz.h>
+
+#include "timer_migration.h"
+
+static DEFINE_PER_CPU(struct tmigr_cpu, tmigr_cpu);
+
+/*
+ * Recompute the first expiry of the idle children of @group.  Caller holds
+ * group->lock.
+ */
+static u64 tmigr_group_update_next(struct tmigr_group *group)
+{
+	unsigned long idle = ~group->active & (BIT(group->num_children) - 1);
+	u64 next = TMIGR_NONE;
+	unsigned int i;
+
+	for_each_set_bit(i, &idle, group->num_children)
+		next = min(next, group->child_expiry[i]);
+	WRITE_ONCE(group->next_expiry, next);
+
+	return next;
+}
+
+/*
+ * Mark the child @childmask of @group active.  The parent only needs to
+ * know when the group was idle so far.
+ */
+static void tmigr_active_up(struct tmigr_group *group, u8 childmask)
+{
+	struct tmigr_group *parent;
+	bool was_active;
+
+	raw_spin_lock(&group->lock);
+	for (;;) {
+		was_active = group->active;
+		group->active |= childmask;
+		if (!group->migrator)
+			WRITE_ONCE(group->migrator, childmask);
+		tmigr_group_update_next(group);
+
+		parent = group->parent;
+		if (was_active || !parent)
+			break;
+		raw_spin_lock_nested(&parent->lock, parent->level);
+		raw_spin_unlock(&group->lock);
+		childmask = group->childmask;
+		group = parent;
+	}
+	raw_spin_unlock(&group->lock);
+}
+
+/*
+ * Mark the child @childmask of @group idle with @expiry as its first
+ * expiry.  Returns TMIGR_NONE when an active CPU takes care of the expiry,
+ * and the first expiry of the hierarchy when it became completely idle.
+ */
+static u64 tmigr_inactive_up(struct tmigr_group *group, u8 childmask,
+			     u64 expiry)
+{
+	struct tmigr_group *parent;
+
+	raw_spin_lock(&group->lock);
+	for (;;) {
+		group->active &= ~childmask;
+		group->child_expiry[__ffs(childmask)] = expiry;
+		if (group->migrator == childmask)
+			WRITE_ONCE(group->migrator, group->active ?
+				   BIT(__ffs(group->active)) : 0);
+		expiry = tmigr_group_update_next(group);
+
+		if (group->active) {
+			expiry = TMIGR_NONE;
+			break;
+		}
+		parent = group->parent;
+		if (!parent)
+			break;
+		raw_spin_lock_nested(&parent->lock, parent->level);
+		raw_spin_unlock(&group->lock);
+		childmask = group->childmask;
+		group = parent;
+	}
+	raw_spin_unlock(&group->lock);
+
+	return expiry;
+}
+
+/*
+ * Update the first expiry of the idle child @childmask of @group, up to
+ * the first active group whose migrator takes care of it.
+ */
+static void tmigr_update_events(struct tmigr_group *group, u8 childmask,
+				u64 expiry)
+{
+	struct tmigr_group *parent;
+
+	raw_spin_lock(&group->lock);
+	for (;;) {
+		/* The child woke up in the meantime */
+		if (group->active & childmask)
+			break;
+		group->child_expiry[__ffs(childmask)] = expiry;
+		expiry = tmigr_group_update_next(group);
+
+		parent = group->parent;
+		if (group->active || !parent)
+			break;
+		raw_spin_lock_nested(&parent->lock, parent->level);
+		raw_spin_unlock(&group->lock);
+		childmask = group->childmask;
+		group = parent;
+	}
+	raw_spin_unlock(&group->lock);
+}
+
+/**
+ * tmigr_cpu_deactivate - hand the global timers of this CPU to the hierarchy
+ * @nextexp:	first expiry of the global base of this CPU, in jiffies64
+ *
+ * Called with interrupts disabled when the CPU goes idle.  Returns the
+ * expiry this CPU still has to wake up for: TMIGR_NONE if an active CPU
+ * takes care of it, the first expiry of the hierarchy if this CPU was the
+ * last active one, or @nextexp if this CPU is not part of the hierarchy.
+ */
+u64 tmigr_cpu_deactivate(u64 nextexp)
+{
+	struct tmigr_cpu *tmc = this_cpu_ptr(&tmigr_cpu);
+	u64 ret;
+
+	if (!tmc->online)
+		return nextexp;
+
+	raw_spin_lock(&tmc->lock);
+	/*
+	 * An interrupt on the idle CPU may have queued new timers: go through
+	 * activation, so that this CPU takes up the whole hierarchy again if
+	 * it is the last idle one.
+	 */
+	if (tmc->idle)
+		tmigr_active_up(tmc->group, tmc->childmask);
+	WRITE_ONCE(tmc->idle, true);
+	ret = tmigr_inactive_up(tmc->group, tmc->childmask, nextexp);
+	raw_spin_unlock(&tmc->lock);
+
+	return ret;
+}
+
+/**
+ * tmigr_cpu_activate - take the global timers of this CPU back
+ *
+ * Called with interrupts disabled when the CPU leaves idle.
+ */
+void tmigr_cpu_activate(void)
+{
+	struct tmigr_cpu *tmc = this_cpu_ptr(&tmigr_cpu);
+
+	if (!tmc->online || !tmc->idle)
+		return;
+
+	raw_spin_lock(&tmc->lock);
+	WRITE_ONCE(tmc->idle, false);
+	tmigr_active_up(tmc->group, tmc->childmask);
+	raw_spin_unlock(&tmc->lock);
+}
+
+/**
+ * tmigr_requires_handle_remote - check for due timers of idle CPUs
+ *
+ * Called from the tick.  Returns true when one of the groups this CPU is
+ * the migrator of has expired global timers.
+ */
+bool tmigr_requires_handle_remote(void)
+{
+	struct tmigr_cpu *tmc = this_cpu_ptr(&tmigr_cpu);
+	struct tmigr_group *group = tmc->group;
+	u8 childmask = tmc->childmask;
+	u64 now;
+
+	if (!tmc->online || tmc->idle)
+		return false;
+
+	now = get_jiffies_64();
+	for (; group; group = group->parent) {
+		if (READ_ONCE(group->migrator) != childmask)
+			break;
+		if (READ_ONCE(group->next_expiry) <= now)
+			return true;
+		childmask = group->childmask;
+	}
+	return false;
+}
+
+static void tmigr_handle_remote_cpu(unsigned int cpu)
+{
+	struct tmigr_cpu *tmc = per_cpu_ptr(&tmigr_cpu, cpu);
+
+	if (!READ_ONCE(tmc->idle))
+		return;
+
+	timer_expire_remote(cpu);
+
+	/*
+	 * The callbacks may have re-armed timers in the global base of the
+	 * idle CPU: hand its new first expiry to the hierarchy, unless the
+	 * CPU woke up in the meantime and takes care of it itself.
+	 */
+	raw_spin_lock_irq(&tmc->lock);
+	if (tmc->idle)
+		tmigr_update_events(tmc->group, tmc->childmask,
+				    timer_next_global_expiry(cpu));
+	raw_spin_unlock_irq(&tmc->lock);
+}
+
+/*
+ * Expire the global timers of the idle children of @group which are due.
+ * An idle child group is idle as a whole, so nobody but us looks after it.
+ */
+static void tmigr_handle_group(struct tmigr_group *group, u64 now)
+{
+	unsigned long idle;
+	unsigned int i;
+
+	idle = ~READ_ONCE(group->active) & (BIT(group->num_children) - 1);
+	for_each_set_bit(i, &idle, group->num_children) {
+		if (READ_ONCE(group->child_expiry[i]) > now)
+			continue;
+		if (!group->level)
+			tmigr_handle_remote_cpu(group->cpus[i]);
+		else
+			tmigr_handle_group(group->groups[i], now);
+	}
+}
+
+/**
+ * tmigr_handle_remote - expire the global timers of idle CPUs
+ *
+ * Called from the timer softirq.  Walks up the groups this CPU is the
+ * migrator of.
+ */
+void tmigr_handle_remote(void)
+{
+	struct tmigr_cpu *tmc = this_cpu_ptr(&tmigr_cpu);
+	struct tmigr_group *group = tmc->group;
+	u8 childmask = tmc->childmask;
+	u64 now;
+
+	if (!tmc->online || tmc->idle)
+		return;
+
+	now = get_jiffies_64();
+	for (; group; group = group->parent) {
+		if (READ_ONCE(group->migrator) != childmask)
+			break;
+		if (READ_ONCE(group->next_expiry) <= now) {
+			tmigr_handle_group(group, now);
+			/* Drop the expiries of children which woke up */
+			raw_spin_lock_irq(&group->lock);
+			tmigr_group_update_next(group);
+			raw_spin_unlock_irq(&group->lock);
+		}
+		childmask = group->childmask;
+	}
+}
+
+static int tmigr_cpu_online(unsigned int cpu)
+{
+	struct tmigr_cpu *tmc = per_cpu_ptr(&tmigr_cpu, cpu);
+
+	/* A CPU running without the tick cannot expire remote timers */
+	if (tick_nohz_full_cpu(cpu))
+		return 0;
+
+	raw_spin_lock_irq(&tmc->lock);
+	tmc->online = true;
+	WRITE_ONCE(tmc->idle, false);
+	tmigr_active_up(tmc->group, tmc->childmask);
+	raw_spin_unlock_irq(&tmc->lock);
+
+	return 0;
+}
+
+static int tmigr_cpu_offline(unsigned int cpu)
+{
+	struct tmigr_cpu *tmc = per_cpu_ptr(&tmigr_cpu, cpu);
+	unsigned int target;
+	u64 next;
+
+	raw_spin_lock_irq(&tmc->lock);
+	if (!tmc->online) {
+		raw_spin_unlock_irq(&tmc->lock);
+		return 0;
+	}
+	/* timers_dead_cpu() moves the global timers of the CPU */
+	tmc->online = false;
+	WRITE_ONCE(tmc->idle, false);
+	next = tmigr_inactive_up(tmc->group, tmc->childmask, TMIGR_NONE);
+	raw_spin_unlock_irq(&tmc->lock);
+
+	/*
+	 * If this was the last active CPU, nobody looks after the timers of
+	 * the idle ones.  Kick one of them, it takes over when it goes idle
+	 * again.
+	 */
+	if (next != TMIGR_NONE) {
+		target = cpumask_any_but(cpu_online_mask, cpu);
+		if (target < nr_cpu_ids)
+			wake_up_nohz_cpu(target);
+	}
+	return 0;
+}
+
+static struct tmigr_group * __init tmigr_group_alloc(unsigned int level,
+						     int node)
+{
+	struct tmigr_group *group;
+	unsigned int i;
+
+	group = kzalloc_node(sizeof(*group), GFP_KERNEL, node);
+	if (!group)
+		return NULL;
+
+	raw_spin_lock_init(&group->lock);
+	group->level = level;
+	group->numa_node = node;
+	group->next_expiry = TMIGR_NONE;
+	for (i = 0; i < TMIGR_CHILDREN_PER_GROUP; i++)
+		group->child_expiry[i] = TMIGR_NONE;
+
+	return group;
+}
+
+/* Pack the possible CPUs of each node into lowest level groups */
+static int __init tmigr_build_cpu_groups(struct tmigr_group **groups)
+{
+	struct tmigr_group *group;
+	struct tmigr_cpu *tmc;
+	unsigned int cpu;
+	int node, nr = 0;
+
+	for_each_node(node) {
+		group = NULL;
+		for_each_possible_cpu(cpu) {
+			if (cpu_to_node(cpu) != node)
+				continue;
+			if (!group ||
+			    group->num_children == TMIGR_CHILDREN_PER_GROUP) {
+				group = tmigr_group_alloc(0, node);
+				if (!group)
+					return -ENOMEM;
+				groups[nr++] = group;
+			}
+			tmc = per_cpu_ptr(&tmigr_cpu, cpu);
+			tmc->group = group;
+			tmc->childmask = BIT(group->num_children);
+			group->cpus[group->num_children++] = cpu;
+		}
+	}
+	return nr;
+}
+
+/*
+ * Pack the @nr groups of one level into parents, in place.  Groups are
+ * sorted by node; as long as a node has several groups they are packed
+ * per node, and a node which is already covered by a single group waits
+ * for the others.  Returns the number of parents.
+ */
+static int __init tmigr_build_level(struct tmigr_group **groups, int nr)
+{
+	struct tmigr_group *parent = NULL, *child;
+	int i, prev_node = NUMA_NO_NODE, out = 0;
+	bool per_node = false;
+
+	for (i = 1; i < nr; i++) {
+		if (groups[i]->numa_node == groups[i - 1]->numa_node)
+			per_node = true;
+	}
+
+	for (i = 0; i < nr; i++) {
+		child = groups[i];
+
+		if (per_node && (!i || child->numa_node != prev_node) &&
+		    (i == nr - 1 ||
+		     groups[i + 1]->numa_node != child->numa_node)) {
+			prev_node = child->numa_node;
+			groups[out++] = child;
+			continue;
+		}
+		prev_node = child->numa_node;
+
+		if (!parent ||
+		    parent->num_children == TMIGR_CHILDREN_PER_GROUP ||
+		    (per_node && parent->numa_node != child->numa_node)) {
+			parent = tmigr_group_alloc(child->level + 1, per_node ?
+						   child->numa_node :
+						   NUMA_NO_NODE);
+			if (!parent)
+				return -ENOMEM;
+			groups[out++] = parent;
+		}
+		child->parent = parent;
+		child->childmask = BIT(parent->num_children);
+		parent->groups[parent->num_children++] = child;
+		parent->level = max(parent->level, child->level + 1);
+	}
+	return out;
+}
+
+static int __init tmigr_init(void)
+{
+	struct tmigr_group **groups;
+	unsigned int cpu;
+	int nr, ret;
+
+	for_each_possible_cpu(cpu)
+		raw_spin_lock_init(&per_cpu_ptr(&tmigr_cpu, cpu)->lock);
+
+	groups = kcalloc(nr_cpu_ids, sizeof(*groups), GFP_KERNEL);
+	if (!groups)
+		return -ENOMEM;
+
+	nr = tmigr_build_cpu_groups(groups);
+	while (nr > 1)
+		nr = tmigr_build_level(groups, nr);
+	if (nr < 0) {
+		ret = nr;
+		goto out;
+	}
+
+	/* The group locks nest by level */
+	if (groups[0]->level >= MAX_LOCKDEP_SUBCLASSES) {
+		pr_warn("timer migration: hierarchy too deep, disabled\n");
+		ret = -E2BIG;
+		goto out;
+	}
+
+	ret = cpuhp_setup_state(CPUHP_AP_ONLINE_DYN, "timers/migration:online",
+				tmigr_cpu_online, tmigr_cpu_offline);
+	if (ret > 0)
+		ret = 0;
+out:
+	kfree(groups);
+	return ret;
+}
+core_initcall(tmigr_init);
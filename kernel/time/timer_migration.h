@@ -0,0 +1,82 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _KERNEL_TIME_MIGRATION_H
+#define _KERNEL_TIME_MIGRATION_H
+
+/* No global timer pending, expiry values are in jiffies64 */
+#define TMIGR_NONE			U64_MAX
+
+#define TMIGR_CHILDREN_PER_GROUP	8
+
+/**
+ * struct tmigr_group - group of the timer migration hierarchy
+ * @lock:		Protects the state of the group.  The lock of a child
+ *			nests outside the lock of its parent.
+ * @parent:		Parent group, NULL for the root
+ * @level:		Height of the group; lowest level groups hold CPUs
+ * @numa_node:		Node of all children, NUMA_NO_NODE across nodes
+ * @num_children:	Number of children of the group
+ * @childmask:		Bit of the group in the masks of @parent
+ * @active:		Mask of the children which are not idle
+ * @migrator:		Bit of the active child which expires the global
+ *			timers of the idle children, 0 if the group is idle
+ * @next_expiry:	First expiry of the idle children
+ * @child_expiry:	First expiry handed over by each idle child
+ * @cpus:		Child CPUs of a lowest level group
+ * @groups:		Child groups of a higher level group
+ */
+struct tmigr_group {
+	raw_spinlock_t		lock;
+	struct tmigr_group	*parent;
+	unsigned int		level;
+	int			numa_node;
+	unsigned int		num_children;
+	u8			childmask;
+	u8			active;
+	u8			migrator;
+	u64			next_expiry;
+	u64			child_expiry[TMIGR_CHILDREN_PER_GROUP];
+	union {
+		unsigned int		cpus[TMIGR_CHILDREN_PER_GROUP];
+		struct tmigr_group	*groups[TMIGR_CHILDREN_PER_GROUP];
+	};
+};
+
+/**
+ * struct tmigr_cpu - per CPU state of the timer migration hierarchy
+ * @lock:	Serializes idle transitions against remote expiry
+ * @online:	The CPU takes part in the hierarchy
+ * @idle:	The CPU handed the first expiry of its global base to @group
+ * @childmask:	Bit of the CPU in the masks of @group
+ * @group:	Lowest level group of the CPU
+ */
+struct tmigr_cpu {
+	raw_spinlock_t		lock;
+	bool			online;
+	bool			idle;
+	u8			childmask;
+	struct tmigr_group	*group;
+};
+
+#ifdef CONFIG_TIMER_MIGRATION
+extern u64 tmigr_cpu_deactivate(u64 nextexp);
+extern void tmigr_cpu_activate(void);
+extern bool tmigr_requires_handle_remote(void);
+extern void tmigr_handle_remote(void);
+
+/* Provided by the timer wheel */
+extern void timer_expire_remote(unsigned int cpu);
+extern u64 timer_next_global_expiry(unsigned int cpu);
+#else
+static inline u64 tmigr_cpu_deactivate(u64 nextexp)
+{
+	return nextexp;
+}
+static inline void tmigr_cpu_activate(void) { }
+static inline bool tmigr_requires_handle_remote(void)
+{
+	return false;
+}
+static inline void tmigr_handle_remote(void) { }
+#endif
+
+#endif
@@ -1851,6 +1851,7 @@ void blk_fill_rwbs(char *rwbs, unsigned int op, int bytes)
 	switch (op & REQ_OP_MASK) {
 	case REQ_OP_WRITE:
 	case REQ_OP_WRITE_SAME:
+	case REQ_OP_ZONE_APPEND:
 		rwbs[i++] = 'W';
 		break;
 	case REQ_OP_DISCARD:
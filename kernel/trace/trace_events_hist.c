@@ -32,6 +32,8 @@ struct hist_field {
 	struct ftrace_event_field	*field;
 	unsigned long			flags;
 	hist_field_fn_t			fn;
+	hist_field_fn_t			val_fn;
+	u64				buckets;
 	unsigned int			size;
 	unsigned int			offset;
 };
@@ -76,6 +78,13 @@ static u64 hist_field_log2(struct hist_field *hist_field, void *event)
 	return (u64) ilog2(roundup_pow_of_two(val));
 }
 
+static u64 hist_field_bucket(struct hist_field *hist_field, void *event)
+{
+	u64 val = hist_field->val_fn(hist_field, event);
+
+	return div64_u64(val, hist_field->buckets) * hist_field->buckets;
+}
+
 #define DEFINE_HIST_FIELD_FN(type)					\
 static u64 hist_field_##type(struct hist_field *hist_field, void *event)\
 {									\
@@ -120,6 +129,7 @@ enum hist_field_flags {
 	HIST_FIELD_FL_SYSCALL		= 128,
 	HIST_FIELD_FL_STACKTRACE	= 256,
 	HIST_FIELD_FL_LOG2		= 512,
+	HIST_FIELD_FL_BUCKET		= 1024,
 };
 
 struct hist_trigger_attrs {
@@ -130,6 +140,7 @@ struct hist_trigger_attrs {
 	bool		pause;
 	bool		cont;
 	bool		clear;
+	bool		percpu;
 	unsigned int	map_bits;
 };
 
@@ -247,6 +258,8 @@ static struct hist_trigger_attrs *parse_hist_trigger_attrs(char *trigger_str)
 			attrs->cont = true;
 		else if (strcmp(str, "clear") == 0)
 			attrs->clear = true;
+		else if (strcmp(str, "percpu") == 0)
+			attrs->percpu = true;
 		else if (strncmp(str, "size=", strlen("size=")) == 0) {
 			int map_bits = parse_map_size(str);
 
@@ -375,6 +388,17 @@ static struct hist_field *create_hist_field(struct ftrace_event_field *field,
 	if (WARN_ON_ONCE(!field))
 		goto out;
 
+	if (flags & HIST_FIELD_FL_BUCKET) {
+		hist_field->fn = hist_field_bucket;
+		hist_field->val_fn = select_value_fn(field->size,
+						     field->is_signed);
+		if (!hist_field->val_fn) {
+			destroy_hist_field(hist_field);
+			return NULL;
+		}
+		goto out;
+	}
+
 	if (is_string_field(field)) {
 		flags |= HIST_FIELD_FL_STRING;
 
@@ -514,6 +538,7 @@ static int create_key_field(struct hist_trigger_data *hist_data,
 	struct ftrace_event_field *field = NULL;
 	unsigned long flags = 0;
 	unsigned int key_size;
+	u64 buckets = 0;
 	int ret = 0;
 
 	if (WARN_ON(key_idx >= TRACING_MAP_FIELDS_MAX))
@@ -541,7 +566,16 @@ static int create_key_field(struct hist_trigger_data *hist_data,
 				flags |= HIST_FIELD_FL_SYSCALL;
 			else if (strcmp(field_str, "log2") == 0)
 				flags |= HIST_FIELD_FL_LOG2;
-			else {
+			else if (strncmp(field_str, "buckets=",
+					 strlen("buckets=")) == 0) {
+				ret = kstrtoull(field_str + strlen("buckets="),
+						0, &buckets);
+				if (ret || !buckets) {
+					ret = -EINVAL;
+					goto out;
+				}
+				flags |= HIST_FIELD_FL_BUCKET;
+			} else {
 				ret = -EINVAL;
 				goto out;
 			}
@@ -553,9 +587,13 @@ static int create_key_field(struct hist_trigger_data *hist_data,
 			goto out;
 		}
 
-		if (is_string_field(field))
+		if (is_string_field(field)) {
+			if (flags & HIST_FIELD_FL_BUCKET) {
+				ret = -EINVAL;
+				goto out;
+			}
 			key_size = MAX_FILTER_STR_VAL;
-		else
+		} else
 			key_size = field->size;
 	}
 
@@ -565,6 +603,8 @@ static int create_key_field(struct hist_trigger_data *hist_data,
 		goto out;
 	}
 
+	hist_data->fields[key_idx]->buckets = buckets;
+
 	key_size = ALIGN(key_size, sizeof(u64));
 	hist_data->fields[key_idx]->size = key_size;
 	hist_data->fields[key_idx]->offset = key_offset;
@@ -817,6 +857,9 @@ create_hist_data(unsigned int map_bits,
 		goto free;
 	}
 
+	if (attrs->percpu)
+		tracing_map_set_percpu(hist_data->map);
+
 	ret = create_tracing_map_fields(hist_data);
 	if (ret)
 		goto free;
@@ -1002,6 +1045,10 @@ hist_trigger_entry_print(struct seq_file *m,
 		} else if (key_field->flags & HIST_FIELD_FL_LOG2) {
 			seq_printf(m, "%s: ~ 2^%-2llu", key_field->field->name,
 				   *(u64 *)(key + key_field->offset));
+		} else if (key_field->flags & HIST_FIELD_FL_BUCKET) {
+			uval = *(u64 *)(key + key_field->offset);
+			seq_printf(m, "%s: ~ %llu-%llu", key_field->field->name,
+				   uval, uval + key_field->buckets - 1);
 		} else if (key_field->flags & HIST_FIELD_FL_STRING) {
 			seq_printf(m, "%s: %-50s", key_field->field->name,
 				   (char *)(key + key_field->offset));
@@ -1079,8 +1126,8 @@ static void hist_trigger_show(struct seq_file *m,
 	}
 
 	seq_printf(m, "\nTotals:\n    Hits: %llu\n    Entries: %u\n    Dropped: %llu\n",
-		   (u64)atomic64_read(&hist_data->map->hits),
-		   n_entries, (u64)atomic64_read(&hist_data->map->drops));
+		   tracing_map_read_hits(hist_data->map),
+		   n_entries, tracing_map_read_drops(hist_data->map));
 }
 
 static int hist_show(struct seq_file *m, void *v)
@@ -1148,6 +1195,8 @@ static void hist_field_print(struct seq_file *m, struct hist_field *hist_field)
 
 		if (flags_str)
 			seq_printf(m, ".%s", flags_str);
+		else if (hist_field->flags & HIST_FIELD_FL_BUCKET)
+			seq_printf(m, ".buckets=%llu", hist_field->buckets);
 	}
 }
 
@@ -1216,6 +1265,9 @@ static int event_hist_trigger_print(struct seq_file *m,
 
 	seq_printf(m, ":size=%u", (1 << hist_data->map->map_bits));
 
+	if (hist_data->attrs->percpu)
+		seq_puts(m, ":percpu");
+
 	if (data->filter_str)
 		seq_printf(m, " if %s", data->filter_str);
 
@@ -1381,6 +1433,8 @@ static bool hist_trigger_match(struct event_trigger_data *data,
 			return false;
 		if (key_field->offset != key_field_test->offset)
 			return false;
+		if (key_field->buckets != key_field_test->buckets)
+			return false;
 	}
 
 	for (i = 0; i < hist_data->n_sort_keys; i++) {
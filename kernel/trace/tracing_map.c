@@ -24,6 +24,7 @@
 #include <linux/jhash.h>
 #include <linux/slab.h>
 #include <linux/sort.h>
+#include <linux/percpu.h>
 
 #include "tracing_map.h"
 #include "trace.h"
@@ -42,11 +43,16 @@
  *
  * Add n to sum i associated with the specified tracing_map_elt
  * instance.  The index i is the index returned by the call to
- * tracing_map_add_sum_field() when the tracing map was set up.
+ * tracing_map_add_sum_field() when the tracing map was set up.  If
+ * the map is a per-cpu map, n is added to the current cpu's copy of
+ * the sum.
  */
 void tracing_map_update_sum(struct tracing_map_elt *elt, unsigned int i, u64 n)
 {
-	atomic64_add(n, &elt->fields[i].sum);
+	if (elt->cpu_sums)
+		this_cpu_add(elt->cpu_sums->sums[i], n);
+	else
+		atomic64_add(n, &elt->fields[i].sum);
 }
 
 /**
@@ -57,13 +63,57 @@ void tracing_map_update_sum(struct tracing_map_elt *elt, unsigned int i, u64 n)
  * Retrieve the value of the sum i associated with the specified
  * tracing_map_elt instance.  The index i is the index returned by the
  * call to tracing_map_add_sum_field() when the tracing map was set
- * up.
+ * up.  If the map is a per-cpu map, the copies of the sum of all cpus
+ * are added together.
  *
  * Return: The sum associated with field i for elt.
  */
 u64 tracing_map_read_sum(struct tracing_map_elt *elt, unsigned int i)
 {
-	return (u64)atomic64_read(&elt->fields[i].sum);
+	u64 sum = (u64)atomic64_read(&elt->fields[i].sum);
+	int cpu;
+
+	if (elt->cpu_sums)
+		for_each_possible_cpu(cpu)
+			sum += per_cpu_ptr(elt->cpu_sums, cpu)->sums[i];
+
+	return sum;
+}
+
+/**
+ * tracing_map_read_hits - Return the number of hits of a tracing_map
+ * @map: The tracing_map
+ *
+ * Return: The number of times an element was inserted or retrieved.
+ */
+u64 tracing_map_read_hits(struct tracing_map *map)
+{
+	u64 hits = (u64)atomic64_read(&map->hits);
+	int cpu;
+
+	if (map->cpu_stats)
+		for_each_possible_cpu(cpu)
+			hits += per_cpu_ptr(map->cpu_stats, cpu)->hits;
+
+	return hits;
+}
+
+/**
+ * tracing_map_read_drops - Return the number of drops of a tracing_map
+ * @map: The tracing_map
+ *
+ * Return: The number of times an element insertion failed.
+ */
+u64 tracing_map_read_drops(struct tracing_map *map)
+{
+	u64 drops = (u64)atomic64_read(&map->drops);
+	int cpu;
+
+	if (map->cpu_stats)
+		for_each_possible_cpu(cpu)
+			drops += per_cpu_ptr(map->cpu_stats, cpu)->drops;
+
+	return drops;
 }
 
 int tracing_map_cmp_string(void *val_a, void *val_b)
@@ -275,11 +325,17 @@ struct tracing_map_array *tracing_map_array_alloc(unsigned int n_elts,
 static void tracing_map_elt_clear(struct tracing_map_elt *elt)
 {
 	unsigned i;
+	int cpu;
 
 	for (i = 0; i < elt->map->n_fields; i++)
 		if (elt->fields[i].cmp_fn == tracing_map_cmp_atomic64)
 			atomic64_set(&elt->fields[i].sum, 0);
 
+	if (elt->cpu_sums)
+		for_each_possible_cpu(cpu)
+			memset(per_cpu_ptr(elt->cpu_sums, cpu), 0,
+			       sizeof(struct tracing_map_cpu_sums));
+
 	if (elt->map->ops && elt->map->ops->elt_clear)
 		elt->map->ops->elt_clear(elt);
 }
@@ -305,12 +361,14 @@ static void tracing_map_elt_free(struct tracing_map_elt *elt)
 
 	if (elt->map->ops && elt->map->ops->elt_free)
 		elt->map->ops->elt_free(elt);
+	free_percpu(elt->cpu_sums);
 	kfree(elt->fields);
 	kfree(elt->key);
 	kfree(elt);
 }
 
-static struct tracing_map_elt *tracing_map_elt_alloc(struct tracing_map *map)
+static struct tracing_map_elt *tracing_map_elt_alloc(struct tracing_map *map,
+						     bool percpu)
 {
 	struct tracing_map_elt *elt;
 	int err = 0;
@@ -333,6 +391,14 @@ static struct tracing_map_elt *tracing_map_elt_alloc(struct tracing_map *map)
 		goto free;
 	}
 
+	if (percpu) {
+		elt->cpu_sums = alloc_percpu(struct tracing_map_cpu_sums);
+		if (!elt->cpu_sums) {
+			err = -ENOMEM;
+			goto free;
+		}
+	}
+
 	tracing_map_elt_init_fields(elt);
 
 	if (map->ops && map->ops->elt_alloc) {
@@ -388,7 +454,8 @@ static int tracing_map_alloc_elts(struct tracing_map *map)
 		return -ENOMEM;
 
 	for (i = 0; i < map->max_elts; i++) {
-		*(TRACING_MAP_ELT(map->elts, i)) = tracing_map_elt_alloc(map);
+		*(TRACING_MAP_ELT(map->elts, i)) =
+			tracing_map_elt_alloc(map, map->percpu);
 		if (IS_ERR(*(TRACING_MAP_ELT(map->elts, i)))) {
 			*(TRACING_MAP_ELT(map->elts, i)) = NULL;
 			tracing_map_free_elts(map);
@@ -410,6 +477,22 @@ static inline bool keys_match(void *key, void *test_key, unsigned key_size)
 	return match;
 }
 
+static inline void tracing_map_inc_hits(struct tracing_map *map)
+{
+	if (map->cpu_stats)
+		this_cpu_inc(map->cpu_stats->hits);
+	else
+		atomic64_inc(&map->hits);
+}
+
+static inline void tracing_map_inc_drops(struct tracing_map *map)
+{
+	if (map->cpu_stats)
+		this_cpu_inc(map->cpu_stats->drops);
+	else
+		atomic64_inc(&map->drops);
+}
+
 static inline struct tracing_map_elt *
 __tracing_map_insert(struct tracing_map *map, void *key, bool lookup_only)
 {
@@ -428,7 +511,7 @@ __tracing_map_insert(struct tracing_map *map, void *key, bool lookup_only)
 
 		if (test_key && test_key == key_hash && entry->val &&
 		    keys_match(key, entry->val->key, map->key_size)) {
-			atomic64_inc(&map->hits);
+			tracing_map_inc_hits(map);
 			return entry->val;
 		}
 
@@ -441,14 +524,14 @@ __tracing_map_insert(struct tracing_map *map, void *key, bool lookup_only)
 
 				elt = get_free_elt(map);
 				if (!elt) {
-					atomic64_inc(&map->drops);
+					tracing_map_inc_drops(map);
 					entry->key = 0;
 					break;
 				}
 
 				memcpy(elt->key, key, map->key_size);
 				entry->val = elt;
-				atomic64_inc(&map->hits);
+				tracing_map_inc_hits(map);
 
 				return entry->val;
 			}
@@ -542,6 +625,7 @@ void tracing_map_destroy(struct tracing_map *map)
 	tracing_map_free_elts(map);
 
 	tracing_map_array_free(map->map);
+	free_percpu(map->cpu_stats);
 	kfree(map);
 }
 
@@ -559,11 +643,17 @@ void tracing_map_destroy(struct tracing_map *map)
 void tracing_map_clear(struct tracing_map *map)
 {
 	unsigned int i;
+	int cpu;
 
 	atomic_set(&map->next_elt, -1);
 	atomic64_set(&map->hits, 0);
 	atomic64_set(&map->drops, 0);
 
+	if (map->cpu_stats)
+		for_each_possible_cpu(cpu)
+			memset(per_cpu_ptr(map->cpu_stats, cpu), 0,
+			       sizeof(struct tracing_map_cpu_stats));
+
 	tracing_map_array_clear(map->map);
 
 	for (i = 0; i < map->max_elts; i++)
@@ -668,6 +758,21 @@ struct tracing_map *tracing_map_create(unsigned int map_bits,
 	goto out;
 }
 
+/**
+ * tracing_map_set_percpu - Keep the sums and counters of a map per cpu
+ * @map: The tracing_map, not initialized yet
+ *
+ * Makes tracing_map_init() allocate per-cpu copies of the sums of
+ * each tracing_map_elt and of the 'hits' and 'drops' counters of the
+ * map.  Updates then only touch the current cpu's copy, at the cost
+ * of a pool of tracing_map_elts num_possible_cpus() times larger for
+ * the sums, and of folding the copies together on read.
+ */
+void tracing_map_set_percpu(struct tracing_map *map)
+{
+	map->percpu = true;
+}
+
 /**
  * tracing_map_init - Allocate and clear a map's tracing_map_elts
  * @map: The tracing_map to initialize
@@ -694,6 +799,12 @@ int tracing_map_init(struct tracing_map *map)
 	if (map->n_fields < 2)
 		return -EINVAL; /* need at least 1 key and 1 val */
 
+	if (map->percpu) {
+		map->cpu_stats = alloc_percpu(struct tracing_map_cpu_stats);
+		if (!map->cpu_stats)
+			return -ENOMEM;
+	}
+
 	err = tracing_map_alloc_elts(map);
 	if (err)
 		return err;
@@ -820,25 +931,45 @@ static struct tracing_map_elt *copy_elt(struct tracing_map_elt *elt)
 	struct tracing_map_elt *dup_elt;
 	unsigned int i;
 
-	dup_elt = tracing_map_elt_alloc(elt->map);
+	dup_elt = tracing_map_elt_alloc(elt->map, false);
 	if (IS_ERR(dup_elt))
 		return NULL;
 
 	if (elt->map->ops && elt->map->ops->elt_copy)
 		elt->map->ops->elt_copy(dup_elt, elt);
 
-	dup_elt->private_data = elt->private_data;
 	memcpy(dup_elt->key, elt->key, elt->map->key_size);
 
 	for (i = 0; i < elt->map->n_fields; i++) {
 		atomic64_set(&dup_elt->fields[i].sum,
-			     atomic64_read(&elt->fields[i].sum));
+			     tracing_map_read_sum(elt, i));
 		dup_elt->fields[i].cmp_fn = elt->fields[i].cmp_fn;
 	}
 
 	return dup_elt;
 }
 
+/*
+ * The sums of a per-cpu map are compared in place by the sort, fold
+ * them into copies of the elements first.
+ */
+static int fold_percpu_sums(struct tracing_map_sort_entry **sort_entries,
+			    int n_entries)
+{
+	struct tracing_map_elt *elt;
+	int i;
+
+	for (i = 0; i < n_entries; i++) {
+		elt = copy_elt(sort_entries[i]->elt);
+		if (!elt)
+			return -ENOMEM;
+		sort_entries[i]->elt = elt;
+		sort_entries[i]->elt_copied = true;
+	}
+
+	return 0;
+}
+
 static int merge_dup(struct tracing_map_sort_entry **sort_entries,
 		     unsigned int target, unsigned int dup)
 {
@@ -846,7 +977,7 @@ static int merge_dup(struct tracing_map_sort_entry **sort_entries,
 	bool first_dup = (target - dup) == 1;
 	int i;
 
-	if (first_dup) {
+	if (first_dup && !sort_entries[target]->elt_copied) {
 		elt = sort_entries[target]->elt;
 		target_elt = copy_elt(elt);
 		if (!target_elt)
@@ -859,7 +990,7 @@ static int merge_dup(struct tracing_map_sort_entry **sort_entries,
 	elt = sort_entries[dup]->elt;
 
 	for (i = 0; i < elt->map->n_fields; i++)
-		atomic64_add(atomic64_read(&elt->fields[i].sum),
+		atomic64_add(tracing_map_read_sum(elt, i),
 			     &target_elt->fields[i].sum);
 
 	sort_entries[dup]->dup = true;
@@ -1028,6 +1159,12 @@ int tracing_map_sort_entries(struct tracing_map *map,
 		goto free;
 	}
 
+	if (map->percpu) {
+		ret = fold_percpu_sums(entries, n_entries);
+		if (ret < 0)
+			goto free;
+	}
+
 	if (n_entries == 1) {
 		*sort_entries = entries;
 		return 1;
@@ -124,6 +124,17 @@ typedef int (*tracing_map_cmp_fn_t) (void *val_a, void *val_b);
  * user, tracing_map_sort_entry objects contain a number of additional
  * fields which are used for caching and internal purposes and can
  * safely be ignored.
+ *
+ * Finally, a map can be switched to per-cpu mode with
+ * tracing_map_set_percpu() before calling tracing_map_init().  The
+ * table of tracing_map_entries and the pool of tracing_map_elts stay
+ * shared, but the sums of each tracing_map_elt and the 'hits' and
+ * 'drops' counters of the map are then kept in per-cpu counters
+ * (the cpu_sums field of struct tracing_map_elt and the cpu_stats
+ * field of struct tracing_map), so that CPUs hitting the same
+ * elements don't bounce their cache lines.  They are only folded
+ * together on read, by tracing_map_read_sum() and
+ * tracing_map_sort_entries().
 */
 
 struct tracing_map_field {
@@ -134,9 +145,14 @@ struct tracing_map_field {
 	};
 };
 
+struct tracing_map_cpu_sums {
+	u64				sums[TRACING_MAP_FIELDS_MAX];
+};
+
 struct tracing_map_elt {
 	struct tracing_map		*map;
 	struct tracing_map_field	*fields;
+	struct tracing_map_cpu_sums __percpu *cpu_sums;
 	void				*key;
 	void				*private_data;
 };
@@ -177,6 +193,11 @@ struct tracing_map_array {
 #define TRACING_MAP_ELT(array, idx)					\
 	((struct tracing_map_elt **)TRACING_MAP_ARRAY_ELT(array, idx))
 
+struct tracing_map_cpu_stats {
+	u64				hits;
+	u64				drops;
+};
+
 struct tracing_map {
 	unsigned int			key_size;
 	unsigned int			map_bits;
@@ -194,6 +215,8 @@ struct tracing_map {
 	struct tracing_map_sort_key	sort_key;
 	atomic64_t			hits;
 	atomic64_t			drops;
+	bool				percpu;
+	struct tracing_map_cpu_stats __percpu *cpu_stats;
 };
 
 /**
@@ -245,6 +268,7 @@ tracing_map_create(unsigned int map_bits,
 		   unsigned int key_size,
 		   const struct tracing_map_ops *ops,
 		   void *private_data);
+extern void tracing_map_set_percpu(struct tracing_map *map);
 extern int tracing_map_init(struct tracing_map *map);
 
 extern int tracing_map_add_sum_field(struct tracing_map *map);
@@ -268,6 +292,8 @@ extern int tracing_map_cmp_none(void *val_a, void *val_b);
 extern void tracing_map_update_sum(struct tracing_map_elt *elt,
 				   unsigned int i, u64 n);
 extern u64 tracing_map_read_sum(struct tracing_map_elt *elt, unsigned int i);
+extern u64 tracing_map_read_hits(struct tracing_map *map);
+extern u64 tracing_map_read_drops(struct tracing_map *map);
 extern void tracing_map_set_field_descr(struct tracing_map *map,
 					unsigned int i,
 					unsigned int key_offset,
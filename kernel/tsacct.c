@@ -20,6 +20,7 @@
 #include <linux/sched/signal.h>
 #include <linux/sched/mm.h>
 #include <linux/sched/cputime.h>
+#include <linux/sched/task.h>
 #include <linux/tsacct_kern.h>
 #include <linux/acct.h>
 #include <linux/jiffies.h>
@@ -60,6 +61,11 @@ void bacct_add_tsk(struct user_namespace *user_ns,
 	stats->ac_nice	 = task_nice(tsk);
 	stats->ac_sched	 = tsk->policy;
 	stats->ac_pid	 = task_pid_nr_ns(tsk, pid_ns);
+	stats->ac_tgid	 = task_tgid_nr_ns(tsk, pid_ns);
+	stats->ac_cpu	 = task_cpu(tsk);
+	stats->ac_start_time = tsk->start_time;
+	stats->sum_exec_runtime = tsk->se.sum_exec_runtime;
+	stats->nr_migrations = tsk->se.nr_migrations;
 	rcu_read_lock();
 	tcred = __task_cred(tsk);
 	stats->ac_uid	 = from_kuid_munged(user_ns, tcred->uid);
@@ -100,13 +106,20 @@ void xacct_add_tsk(struct taskstats *stats, struct task_struct *p)
 	do_div(stats->coremem, 1000 * KB);
 	stats->virtmem = p->acct_vm_mem1 * PAGE_SIZE;
 	do_div(stats->virtmem, 1000 * KB);
-	mm = get_task_mm(p);
-	if (mm) {
+	/*
+	 * task_lock() rather than get_task_mm() keeps the mm alive: the
+	 * mmput() could sleep, and taskstats dumps run under RCU.
+	 */
+	task_lock(p);
+	mm = p->mm;
+	if (mm && !(p->flags & PF_KTHREAD)) {
 		/* adjust to KB unit */
 		stats->hiwater_rss   = get_mm_hiwater_rss(mm) * PAGE_SIZE / KB;
 		stats->hiwater_vm    = get_mm_hiwater_vm(mm)  * PAGE_SIZE / KB;
-		mmput(mm);
+		stats->rss	     = get_mm_rss(mm) * PAGE_SIZE / KB;
+		stats->vm_size	     = mm->total_vm * PAGE_SIZE / KB;
 	}
+	task_unlock(p);
 	stats->read_char	= p->ioac.rchar & KB_MASK;
 	stats->write_char	= p->ioac.wchar & KB_MASK;
 	stats->read_syscalls	= p->ioac.syscr & KB_MASK;
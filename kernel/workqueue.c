@@ -27,6 +27,7 @@
 #include <linux/export.h>
 #include <linux/kernel.h>
 #include <linux/sched.h>
+#include <linux/sched/topology.h>
 #include <linux/init.h>
 #include <linux/signal.h>
 #include <linux/completion.h>
@@ -275,13 +276,34 @@ struct workqueue_struct {
 	/* hot fields used during command issue, aligned to cacheline */
 	unsigned int		flags ____cacheline_aligned; /* WQ: WQ_* flags */
 	struct pool_workqueue __percpu *cpu_pwqs; /* I: per-cpu pwqs */
-	struct pool_workqueue __rcu *numa_pwq_tbl[]; /* PWR: unbound pwqs indexed by node */
+	struct pool_workqueue __rcu *pod_pwq_tbl[]; /* PWR: unbound pwqs indexed by pod */
 };
 
 static struct kmem_cache *pwq_cache;
 
-static cpumask_var_t *wq_numa_possible_cpumask;
-					/* possible CPUs of each node */
+/*
+ * Each affinity scope splits the possible CPUs into pods.  Unbound
+ * workqueues get a pwq for each pod of their scope.  Only the CPU and
+ * SYSTEM types are available from early boot, see wq_pod_init().
+ */
+struct wq_pod_type {
+	int			nr_pods;	/* number of pods */
+	cpumask_var_t		*pod_cpus;	/* pod -> possible cpus */
+	int			*pod_node;	/* pod -> node */
+	int			*cpu_pod;	/* cpu -> pod */
+};
+
+static struct wq_pod_type wq_pod_types[WQ_AFFN_NR_TYPES];
+static enum wq_affn_scope wq_affn_dfl = WQ_AFFN_NUMA;
+
+static const char * const wq_affn_names[WQ_AFFN_NR_TYPES] = {
+	[WQ_AFFN_DFL]		= "default",
+	[WQ_AFFN_CPU]		= "cpu",
+	[WQ_AFFN_SMT]		= "smt",
+	[WQ_AFFN_CACHE]		= "cache",
+	[WQ_AFFN_NUMA]		= "numa",
+	[WQ_AFFN_SYSTEM]	= "system",
+};
 
 static bool wq_disable_numa;
 module_param_named(disable_numa, wq_disable_numa, bool, 0444);
@@ -290,12 +312,47 @@ module_param_named(disable_numa, wq_disable_numa, bool, 0444);
 static bool wq_power_efficient = IS_ENABLED(CONFIG_WQ_POWER_EFFICIENT_DEFAULT);
 module_param_named(power_efficient, wq_power_efficient, bool, 0444);
 
-static bool wq_online;			/* can kworkers be created yet? */
+static int parse_affn_scope(const char *val)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(wq_affn_names); i++) {
+		if (sysfs_streq(val, wq_affn_names[i]))
+			return i;
+	}
+	return -EINVAL;
+}
+
+static int wq_affn_dfl_set(const char *val, const struct kernel_param *kp)
+{
+	int affn = parse_affn_scope(val);
+
+	if (affn < 0)
+		return affn;
+	if (affn == WQ_AFFN_DFL)
+		return -EINVAL;
+
+	wq_affn_dfl = affn;
+	return 0;
+}
+
+static int wq_affn_dfl_get(char *buffer, const struct kernel_param *kp)
+{
+	return scnprintf(buffer, PAGE_SIZE, "%s", wq_affn_names[wq_affn_dfl]);
+}
+
+static const struct kernel_param_ops wq_affn_dfl_ops = {
+	.set	= wq_affn_dfl_set,
+	.get	= wq_affn_dfl_get,
+};
+
+/* affinity scope of workqueues which don't pick one, can't change at runtime */
+module_param_cb(default_affinity_scope, &wq_affn_dfl_ops, NULL, 0444);
 
-static bool wq_numa_enabled;		/* unbound NUMA affinity enabled */
+static bool wq_online;			/* can kworkers be created yet? */
 
-/* buf for wq_update_unbound_numa_attrs(), protected by CPU hotplug exclusion */
-static struct workqueue_attrs *wq_update_unbound_numa_attrs_buf;
+/* buf for wq_update_pod(), protected by CPU hotplug exclusion */
+static struct workqueue_attrs *wq_update_pod_attrs_buf;
 
 static DEFINE_MUTEX(wq_pool_mutex);	/* protects pools and workqueues list */
 static DEFINE_SPINLOCK(wq_mayday_lock);	/* protects wq->maydays list */
@@ -307,6 +364,12 @@ static bool workqueue_freezing;		/* PL: have wqs started freezing? */
 /* PL: allowable cpus for unbound wqs and work items */
 static cpumask_var_t wq_unbound_cpumask;
 
+/* PL: unbound cpumask requested through sysfs */
+static cpumask_var_t wq_requested_unbound_cpumask;
+
+/* PL: cpus excluded from wq_unbound_cpumask, e.g. isolated partitions */
+static cpumask_var_t wq_isolated_cpumask;
+
 /* CPU where unbound work was last round robin scheduled from this CPU */
 static DEFINE_PER_CPU(int, wq_rr_cpu_last);
 
@@ -547,32 +610,59 @@ static int worker_pool_assign_id(struct worker_pool *pool)
 }
 
 /**
- * unbound_pwq_by_node - return the unbound pool_workqueue for the given node
+ * wqattrs_pod_type - return the pod type of the affinity scope of a wq_attrs
+ * @attrs: the wq_attrs of interest
+ *
+ * ->no_numa selects the SYSTEM scope.  Scopes whose pods aren't known yet
+ * and NUMA when disabled fall back to SYSTEM too.
+ *
+ * Return: The pod type unbound pwqs of @attrs are distributed over.
+ */
+static const struct wq_pod_type *
+wqattrs_pod_type(const struct workqueue_attrs *attrs)
+{
+	enum wq_affn_scope scope;
+	struct wq_pod_type *pt;
+
+	if (attrs->no_numa)
+		scope = WQ_AFFN_SYSTEM;
+	else if (attrs->affn_scope == WQ_AFFN_DFL)
+		scope = wq_affn_dfl;
+	else
+		scope = attrs->affn_scope;
+
+	pt = &wq_pod_types[scope];
+
+	/* pairs with smp_store_release() in init_pod_type() */
+	if (!smp_load_acquire(&pt->nr_pods))
+		pt = &wq_pod_types[WQ_AFFN_SYSTEM];
+	return pt;
+}
+
+/**
+ * unbound_pwq - return the unbound pool_workqueue for the given cpu
  * @wq: the target workqueue
- * @node: the node ID
+ * @cpu: the CPU ID
  *
  * This must be called with any of wq_pool_mutex, wq->mutex or sched RCU
  * read locked.
  * If the pwq needs to be used beyond the locking in effect, the caller is
  * responsible for guaranteeing that the pwq stays online.
  *
- * Return: The unbound pool_workqueue for @node.
+ * Return: The unbound pool_workqueue of the pod of @cpu, @wq->dfl_pwq if
+ * the pod doesn't have one.
  */
-static struct pool_workqueue *unbound_pwq_by_node(struct workqueue_struct *wq,
-						  int node)
+static struct pool_workqueue *unbound_pwq(struct workqueue_struct *wq,
+					  int cpu)
 {
-	assert_rcu_or_wq_mutex_or_pool_mutex(wq);
+	const struct wq_pod_type *pt;
+	struct pool_workqueue *pwq;
 
-	/*
-	 * XXX: @node can be NUMA_NO_NODE if CPU goes offline while a
-	 * delayed item is pending.  The plan is to keep CPU -> NODE
-	 * mapping valid and stable across CPU on/offlines.  Once that
-	 * happens, this workaround can be removed.
-	 */
-	if (unlikely(node == NUMA_NO_NODE))
-		return wq->dfl_pwq;
+	assert_rcu_or_wq_mutex_or_pool_mutex(wq);
 
-	return rcu_dereference_raw(wq->numa_pwq_tbl[node]);
+	pt = wqattrs_pod_type(wq->unbound_attrs);
+	pwq = rcu_dereference_raw(wq->pod_pwq_tbl[pt->cpu_pod[cpu]]);
+	return pwq ?: wq->dfl_pwq;
 }
 
 static unsigned int work_color_to_flags(int color)
@@ -834,9 +924,29 @@ static struct worker *first_idle_worker(struct worker_pool *pool)
 static void wake_up_worker(struct worker_pool *pool)
 {
 	struct worker *worker = first_idle_worker(pool);
+	struct task_struct *p;
+
+	if (unlikely(!worker))
+		return;
+
+	p = worker->task;
+#ifdef CONFIG_SMP
+	/*
+	 * Workers of a lax pool may run anywhere in the workqueue's cpumask.
+	 * Steer the wakeup into the pod so that work items stay close to
+	 * their issuers, the scheduler can still move the worker out if the
+	 * pod is saturated.
+	 */
+	if (!pool->attrs->affn_strict &&
+	    !cpumask_test_cpu(p->wake_cpu, pool->attrs->__pod_cpumask)) {
+		int cpu = cpumask_any_and(pool->attrs->__pod_cpumask,
+					  cpu_online_mask);
 
-	if (likely(worker))
-		wake_up_process(worker->task);
+		if (cpu < nr_cpu_ids)
+			p->wake_cpu = cpu;
+	}
+#endif
+	wake_up_process(p);
 }
 
 /**
@@ -910,6 +1020,27 @@ struct task_struct *wq_worker_sleeping(struct task_struct *task)
 	return to_wakeup ? to_wakeup->task : NULL;
 }
 
+/**
+ * wq_worker_last_func - retrieve worker's last work function
+ * @task: Task to retrieve last work function of.
+ *
+ * Determine the last function a worker executed. This is called from
+ * the scheduler to get a worker's last known identity.
+ *
+ * CONTEXT:
+ * spin_lock_irq(rq->lock)
+ *
+ * Return:
+ * The last work function %current executed as a worker, NULL if it
+ * hasn't executed any work yet.
+ */
+work_func_t wq_worker_last_func(struct task_struct *task)
+{
+	struct worker *worker = kthread_data(task);
+
+	return worker->last_func;
+}
+
 /**
  * worker_set_flags - set worker flags and adjust nr_running accordingly
  * @worker: self
@@ -1392,7 +1523,7 @@ static void __queue_work(int cpu, struct workqueue_struct *wq,
 	if (!(wq->flags & WQ_UNBOUND))
 		pwq = per_cpu_ptr(wq->cpu_pwqs, cpu);
 	else
-		pwq = unbound_pwq_by_node(wq, cpu_to_node(cpu));
+		pwq = unbound_pwq(wq, cpu);
 
 	/*
 	 * If @work was previously on a different pool, it might still be
@@ -1422,7 +1553,7 @@ static void __queue_work(int cpu, struct workqueue_struct *wq,
 	 * pwq is determined and locked.  For unbound pools, we could have
 	 * raced with pwq release and it could already be dead.  If its
 	 * refcnt is zero, repeat pwq selection.  Note that pwqs never die
-	 * without another pwq replacing it in the numa_pwq_tbl or while
+	 * without another pwq replacing it in the pod_pwq_tbl or while
 	 * work items are executing on it, so the retrying is guaranteed to
 	 * make forward-progress.
 	 */
@@ -2147,6 +2278,7 @@ __acquires(&pool->lock)
 	/* we're done with it, release */
 	hash_del(&worker->hentry);
 	worker->current_work = NULL;
+	worker->last_func = worker->current_func;
 	worker->current_func = NULL;
 	worker->current_pwq = NULL;
 	worker->desc_valid = false;
@@ -3149,6 +3281,7 @@ void free_workqueue_attrs(struct workqueue_attrs *attrs)
 {
 	if (attrs) {
 		free_cpumask_var(attrs->cpumask);
+		free_cpumask_var(attrs->__pod_cpumask);
 		kfree(attrs);
 	}
 }
@@ -3171,8 +3304,12 @@ struct workqueue_attrs *alloc_workqueue_attrs(gfp_t gfp_mask)
 		goto fail;
 	if (!alloc_cpumask_var(&attrs->cpumask, gfp_mask))
 		goto fail;
+	if (!alloc_cpumask_var(&attrs->__pod_cpumask, gfp_mask))
+		goto fail;
 
 	cpumask_copy(attrs->cpumask, cpu_possible_mask);
+	cpumask_copy(attrs->__pod_cpumask, cpu_possible_mask);
+	attrs->affn_strict = true;
 	return attrs;
 fail:
 	free_workqueue_attrs(attrs);
@@ -3184,11 +3321,15 @@ static void copy_workqueue_attrs(struct workqueue_attrs *to,
 {
 	to->nice = from->nice;
 	cpumask_copy(to->cpumask, from->cpumask);
+	cpumask_copy(to->__pod_cpumask, from->__pod_cpumask);
+	to->affn_strict = from->affn_strict;
 	/*
 	 * Unlike hash and equality test, this function doesn't ignore
-	 * ->no_numa as it is used for both pool and wq attrs.  Instead,
-	 * get_unbound_pool() explicitly clears ->no_numa after copying.
+	 * ->no_numa and ->affn_scope as it is used for both pool and wq
+	 * attrs.  Instead, get_unbound_pool() explicitly clears them after
+	 * copying.
 	 */
+	to->affn_scope = from->affn_scope;
 	to->no_numa = from->no_numa;
 }
 
@@ -3200,6 +3341,9 @@ static u32 wqattrs_hash(const struct workqueue_attrs *attrs)
 	hash = jhash_1word(attrs->nice, hash);
 	hash = jhash(cpumask_bits(attrs->cpumask),
 		     BITS_TO_LONGS(nr_cpumask_bits) * sizeof(long), hash);
+	hash = jhash(cpumask_bits(attrs->__pod_cpumask),
+		     BITS_TO_LONGS(nr_cpumask_bits) * sizeof(long), hash);
+	hash = jhash_1word(attrs->affn_strict, hash);
 	return hash;
 }
 
@@ -3211,6 +3355,10 @@ static bool wqattrs_equal(const struct workqueue_attrs *a,
 		return false;
 	if (!cpumask_equal(a->cpumask, b->cpumask))
 		return false;
+	if (!cpumask_equal(a->__pod_cpumask, b->__pod_cpumask))
+		return false;
+	if (a->affn_strict != b->affn_strict)
+		return false;
 	return true;
 }
 
@@ -3358,8 +3506,9 @@ static void put_unbound_pool(struct worker_pool *pool)
 static struct worker_pool *get_unbound_pool(const struct workqueue_attrs *attrs)
 {
 	u32 hash = wqattrs_hash(attrs);
+	const struct wq_pod_type *pt = &wq_pod_types[WQ_AFFN_NUMA];
 	struct worker_pool *pool;
-	int node;
+	int pod;
 	int target_node = NUMA_NO_NODE;
 
 	lockdep_assert_held(&wq_pool_mutex);
@@ -3372,14 +3521,11 @@ static struct worker_pool *get_unbound_pool(const struct workqueue_attrs *attrs)
 		}
 	}
 
-	/* if cpumask is contained inside a NUMA node, we belong to that node */
-	if (wq_numa_enabled) {
-		for_each_node(node) {
-			if (cpumask_subset(attrs->cpumask,
-					   wq_numa_possible_cpumask[node])) {
-				target_node = node;
-				break;
-			}
+	/* if the pod is contained inside a NUMA node, we belong to that node */
+	for (pod = 0; pod < pt->nr_pods; pod++) {
+		if (cpumask_subset(attrs->__pod_cpumask, pt->pod_cpus[pod])) {
+			target_node = pt->pod_node[pod];
+			break;
 		}
 	}
 
@@ -3393,9 +3539,10 @@ static struct worker_pool *get_unbound_pool(const struct workqueue_attrs *attrs)
 	pool->node = target_node;
 
 	/*
-	 * no_numa isn't a worker_pool attribute, always clear it.  See
-	 * 'struct workqueue_attrs' comments for detail.
+	 * no_numa and affn_scope aren't worker_pool attributes, always
+	 * clear them.  See 'struct workqueue_attrs' comments for detail.
 	 */
+	pool->attrs->affn_scope = WQ_AFFN_DFL;
 	pool->attrs->no_numa = false;
 
 	if (worker_pool_assign_id(pool) < 0)
@@ -3566,61 +3713,60 @@ static struct pool_workqueue *alloc_unbound_pwq(struct workqueue_struct *wq,
 }
 
 /**
- * wq_calc_node_cpumask - calculate a wq_attrs' cpumask for the specified node
+ * wq_calc_pod_cpumask - calculate a wq_attrs' cpumasks for a pod
  * @attrs: the wq_attrs of the default pwq of the target workqueue
- * @node: the target NUMA node
+ * @pt: the pod type of the affinity scope of the target workqueue
+ * @pod: the target pod
  * @cpu_going_down: if >= 0, the CPU to consider as offline
- * @cpumask: outarg, the resulting cpumask
+ * @pod_attrs: outarg, the attrs of the pwq to use for @pod
  *
- * Calculate the cpumask a workqueue with @attrs should use on @node.  If
+ * Calculate the attrs a workqueue with @attrs should use on @pod.  If
  * @cpu_going_down is >= 0, that cpu is considered offline during
- * calculation.  The result is stored in @cpumask.
+ * calculation.
  *
- * If NUMA affinity is not enabled, @attrs->cpumask is always used.  If
- * enabled and @node has online CPUs requested by @attrs, the returned
- * cpumask is the intersection of the possible CPUs of @node and
+ * If @pod has online CPUs requested by @attrs, @pod_attrs->__pod_cpumask
+ * is the intersection of the possible CPUs of @pod and @attrs->cpumask.
+ * A strict @attrs confines the workers to those CPUs, a lax one keeps
  * @attrs->cpumask.
  *
- * The caller is responsible for ensuring that the cpumask of @node stays
+ * The caller is responsible for ensuring that the pods of @pt stay
  * stable.
  *
- * Return: %true if the resulting @cpumask is different from @attrs->cpumask,
- * %false if equal.
+ * Return: %true if @pod needs a pwq of its own, %false if the default pwq
+ * should be used.
  */
-static bool wq_calc_node_cpumask(const struct workqueue_attrs *attrs, int node,
-				 int cpu_going_down, cpumask_t *cpumask)
+static bool wq_calc_pod_cpumask(const struct workqueue_attrs *attrs,
+				const struct wq_pod_type *pt, int pod,
+				int cpu_going_down,
+				struct workqueue_attrs *pod_attrs)
 {
-	if (!wq_numa_enabled || attrs->no_numa)
-		goto use_dfl;
-
-	/* does @node have any online CPUs @attrs wants? */
-	cpumask_and(cpumask, cpumask_of_node(node), attrs->cpumask);
-	if (cpu_going_down >= 0)
-		cpumask_clear_cpu(cpu_going_down, cpumask);
+	struct cpumask *pod_cpumask = pod_attrs->__pod_cpumask;
 
-	if (cpumask_empty(cpumask))
-		goto use_dfl;
+	copy_workqueue_attrs(pod_attrs, attrs);
 
-	/* yeap, return possible CPUs in @node that @attrs wants */
-	cpumask_and(cpumask, attrs->cpumask, wq_numa_possible_cpumask[node]);
+	/* does @pod have any online CPUs @attrs wants? */
+	cpumask_and(pod_cpumask, pt->pod_cpus[pod], attrs->cpumask);
+	cpumask_and(pod_cpumask, pod_cpumask, cpu_online_mask);
+	if (cpu_going_down >= 0)
+		cpumask_clear_cpu(cpu_going_down, pod_cpumask);
 
-	if (cpumask_empty(cpumask)) {
-		pr_warn_once("WARNING: workqueue cpumask: online intersect > "
-				"possible intersect\n");
+	if (cpumask_empty(pod_cpumask))
 		return false;
-	}
 
-	return !cpumask_equal(cpumask, attrs->cpumask);
+	/* yeap, return possible CPUs in @pod that @attrs wants */
+	cpumask_and(pod_cpumask, attrs->cpumask, pt->pod_cpus[pod]);
+	if (cpumask_equal(pod_cpumask, attrs->cpumask))
+		return false;
 
-use_dfl:
-	cpumask_copy(cpumask, attrs->cpumask);
-	return false;
+	if (attrs->affn_strict)
+		cpumask_copy(pod_attrs->cpumask, pod_cpumask);
+	return true;
 }
 
-/* install @pwq into @wq's numa_pwq_tbl[] for @node and return the old pwq */
-static struct pool_workqueue *numa_pwq_tbl_install(struct workqueue_struct *wq,
-						   int node,
-						   struct pool_workqueue *pwq)
+/* install @pwq into @wq's pod_pwq_tbl[] for @pod and return the old pwq */
+static struct pool_workqueue *pod_pwq_tbl_install(struct workqueue_struct *wq,
+						  int pod,
+						  struct pool_workqueue *pwq)
 {
 	struct pool_workqueue *old_pwq;
 
@@ -3628,10 +3774,11 @@ static struct pool_workqueue *numa_pwq_tbl_install(struct workqueue_struct *wq,
 	lockdep_assert_held(&wq->mutex);
 
 	/* link_pwq() can handle duplicate calls */
-	link_pwq(pwq);
+	if (pwq)
+		link_pwq(pwq);
 
-	old_pwq = rcu_access_pointer(wq->numa_pwq_tbl[node]);
-	rcu_assign_pointer(wq->numa_pwq_tbl[node], pwq);
+	old_pwq = rcu_access_pointer(wq->pod_pwq_tbl[pod]);
+	rcu_assign_pointer(wq->pod_pwq_tbl[pod], pwq);
 	return old_pwq;
 }
 
@@ -3648,10 +3795,10 @@ struct apply_wqattrs_ctx {
 static void apply_wqattrs_cleanup(struct apply_wqattrs_ctx *ctx)
 {
 	if (ctx) {
-		int node;
+		int pod;
 
-		for_each_node(node)
-			put_pwq_unlocked(ctx->pwq_tbl[node]);
+		for (pod = 0; pod < nr_cpu_ids; pod++)
+			put_pwq_unlocked(ctx->pwq_tbl[pod]);
 		put_pwq_unlocked(ctx->dfl_pwq);
 
 		free_workqueue_attrs(ctx->attrs);
@@ -3665,13 +3812,14 @@ static struct apply_wqattrs_ctx *
 apply_wqattrs_prepare(struct workqueue_struct *wq,
 		      const struct workqueue_attrs *attrs)
 {
+	const struct wq_pod_type *pt;
 	struct apply_wqattrs_ctx *ctx;
 	struct workqueue_attrs *new_attrs, *tmp_attrs;
-	int node;
+	int pod;
 
 	lockdep_assert_held(&wq_pool_mutex);
 
-	ctx = kzalloc(sizeof(*ctx) + nr_node_ids * sizeof(ctx->pwq_tbl[0]),
+	ctx = kzalloc(sizeof(*ctx) + nr_cpu_ids * sizeof(ctx->pwq_tbl[0]),
 		      GFP_KERNEL);
 
 	new_attrs = alloc_workqueue_attrs(GFP_KERNEL);
@@ -3688,13 +3836,7 @@ apply_wqattrs_prepare(struct workqueue_struct *wq,
 	cpumask_and(new_attrs->cpumask, new_attrs->cpumask, wq_unbound_cpumask);
 	if (unlikely(cpumask_empty(new_attrs->cpumask)))
 		cpumask_copy(new_attrs->cpumask, wq_unbound_cpumask);
-
-	/*
-	 * We may create multiple pwqs with differing cpumasks.  Make a
-	 * copy of @new_attrs which will be modified and used to obtain
-	 * pools.
-	 */
-	copy_workqueue_attrs(tmp_attrs, new_attrs);
+	cpumask_copy(new_attrs->__pod_cpumask, new_attrs->cpumask);
 
 	/*
 	 * If something goes wrong during CPU up/down, we'll fall back to
@@ -3705,14 +3847,20 @@ apply_wqattrs_prepare(struct workqueue_struct *wq,
 	if (!ctx->dfl_pwq)
 		goto out_free;
 
-	for_each_node(node) {
-		if (wq_calc_node_cpumask(new_attrs, node, -1, tmp_attrs->cpumask)) {
-			ctx->pwq_tbl[node] = alloc_unbound_pwq(wq, tmp_attrs);
-			if (!ctx->pwq_tbl[node])
+	/*
+	 * We may create multiple pwqs with differing cpumasks, one for
+	 * each pod of the affinity scope.  @tmp_attrs is used to obtain
+	 * their pools.
+	 */
+	pt = wqattrs_pod_type(new_attrs);
+	for (pod = 0; pod < pt->nr_pods; pod++) {
+		if (wq_calc_pod_cpumask(new_attrs, pt, pod, -1, tmp_attrs)) {
+			ctx->pwq_tbl[pod] = alloc_unbound_pwq(wq, tmp_attrs);
+			if (!ctx->pwq_tbl[pod])
 				goto out_free;
 		} else {
 			ctx->dfl_pwq->refcnt++;
-			ctx->pwq_tbl[node] = ctx->dfl_pwq;
+			ctx->pwq_tbl[pod] = ctx->dfl_pwq;
 		}
 	}
 
@@ -3735,17 +3883,20 @@ apply_wqattrs_prepare(struct workqueue_struct *wq,
 /* set attrs and install prepared pwqs, @ctx points to old pwqs on return */
 static void apply_wqattrs_commit(struct apply_wqattrs_ctx *ctx)
 {
-	int node;
+	int pod;
 
 	/* all pwqs have been created successfully, let's install'em */
 	mutex_lock(&ctx->wq->mutex);
 
 	copy_workqueue_attrs(ctx->wq->unbound_attrs, ctx->attrs);
 
-	/* save the previous pwq and install the new one */
-	for_each_node(node)
-		ctx->pwq_tbl[node] = numa_pwq_tbl_install(ctx->wq, node,
-							  ctx->pwq_tbl[node]);
+	/*
+	 * Save the previous pwqs and install the new ones.  The scope may
+	 * have changed, clear the slots beyond its pods too.
+	 */
+	for (pod = 0; pod < nr_cpu_ids; pod++)
+		ctx->pwq_tbl[pod] = pod_pwq_tbl_install(ctx->wq, pod,
+							ctx->pwq_tbl[pod]);
 
 	/* @dfl_pwq might not have been used, ensure it's linked */
 	link_pwq(ctx->dfl_pwq);
@@ -3800,10 +3951,10 @@ static int apply_workqueue_attrs_locked(struct workqueue_struct *wq,
  * @wq: the target workqueue
  * @attrs: the workqueue_attrs to apply, allocated with alloc_workqueue_attrs()
  *
- * Apply @attrs to an unbound workqueue @wq.  Unless disabled, on NUMA
- * machines, this function maps a separate pwq to each NUMA node with
- * possibles CPUs in @attrs->cpumask so that work items are affine to the
- * NUMA node it was issued on.  Older pwqs are released as in-flight work
+ * Apply @attrs to an unbound workqueue @wq.  This function maps a separate
+ * pwq to each pod of the affinity scope of @attrs with possible CPUs in
+ * @attrs->cpumask so that work items are affine to the pod they were
+ * issued on.  Older pwqs are released as in-flight work
  * items finish.  Note that a work item which repeatedly requeues itself
  * back-to-back will stay on its current pwq.
  *
@@ -3824,40 +3975,43 @@ int apply_workqueue_attrs(struct workqueue_struct *wq,
 }
 
 /**
- * wq_update_unbound_numa - update NUMA affinity of a wq for CPU hot[un]plug
+ * wq_update_pod - update the pod affinity of a wq for CPU hot[un]plug
  * @wq: the target workqueue
  * @cpu: the CPU coming up or going down
  * @online: whether @cpu is coming up or going down
  *
  * This function is to be called from %CPU_DOWN_PREPARE, %CPU_ONLINE and
- * %CPU_DOWN_FAILED.  @cpu is being hot[un]plugged, update NUMA affinity of
- * @wq accordingly.
+ * %CPU_DOWN_FAILED.  @cpu is being hot[un]plugged, update the pwq of the
+ * pod of @cpu accordingly.
  *
- * If NUMA affinity can't be adjusted due to memory allocation failure, it
- * falls back to @wq->dfl_pwq which may not be optimal but is always
+ * If the pod affinity can't be adjusted due to memory allocation failure,
+ * it falls back to @wq->dfl_pwq which may not be optimal but is always
  * correct.
  *
- * Note that when the last allowed CPU of a NUMA node goes offline for a
- * workqueue with a cpumask spanning multiple nodes, the workers which were
+ * Note that when the last allowed CPU of a pod goes offline for a
+ * workqueue with a cpumask spanning multiple pods, the workers which were
  * already executing the work items for the workqueue will lose their CPU
  * affinity and may execute on any CPU.  This is similar to how per-cpu
  * workqueues behave on CPU_DOWN.  If a workqueue user wants strict
  * affinity, it's the user's responsibility to flush the work item from
  * CPU_DOWN_PREPARE.
  */
-static void wq_update_unbound_numa(struct workqueue_struct *wq, int cpu,
-				   bool online)
+static void wq_update_pod(struct workqueue_struct *wq, int cpu, bool online)
 {
-	int node = cpu_to_node(cpu);
+	const struct wq_pod_type *pt;
+	int pod;
 	int cpu_off = online ? -1 : cpu;
 	struct pool_workqueue *old_pwq = NULL, *pwq;
 	struct workqueue_attrs *target_attrs;
-	cpumask_t *cpumask;
 
 	lockdep_assert_held(&wq_pool_mutex);
 
-	if (!wq_numa_enabled || !(wq->flags & WQ_UNBOUND) ||
-	    wq->unbound_attrs->no_numa)
+	if (!(wq->flags & WQ_UNBOUND))
+		return;
+
+	/* a single pod always uses the default pwq */
+	pt = wqattrs_pod_type(wq->unbound_attrs);
+	if (pt->nr_pods <= 1)
 		return;
 
 	/*
@@ -3865,36 +4019,32 @@ static void wq_update_unbound_numa(struct workqueue_struct *wq, int cpu,
 	 * Let's use a preallocated one.  The following buf is protected by
 	 * CPU hotplug exclusion.
 	 */
-	target_attrs = wq_update_unbound_numa_attrs_buf;
-	cpumask = target_attrs->cpumask;
-
-	copy_workqueue_attrs(target_attrs, wq->unbound_attrs);
-	pwq = unbound_pwq_by_node(wq, node);
+	target_attrs = wq_update_pod_attrs_buf;
+	pod = pt->cpu_pod[cpu];
+	pwq = unbound_pwq(wq, cpu);
 
 	/*
-	 * Let's determine what needs to be done.  If the target cpumask is
-	 * different from the default pwq's, we need to compare it to @pwq's
-	 * and create a new one if they don't match.  If the target cpumask
-	 * equals the default pwq's, the default pwq should be used.
+	 * Let's determine what needs to be done.  If the pod needs a pwq of
+	 * its own, compare the target attrs to @pwq's and create a new one
+	 * if they don't match.  Otherwise, the default pwq should be used.
 	 */
-	if (wq_calc_node_cpumask(wq->dfl_pwq->pool->attrs, node, cpu_off, cpumask)) {
-		if (cpumask_equal(cpumask, pwq->pool->attrs->cpumask))
-			return;
-	} else {
+	if (!wq_calc_pod_cpumask(wq->dfl_pwq->pool->attrs, pt, pod, cpu_off,
+				 target_attrs))
 		goto use_dfl_pwq;
-	}
+	if (wqattrs_equal(target_attrs, pwq->pool->attrs))
+		return;
 
 	/* create a new pwq */
 	pwq = alloc_unbound_pwq(wq, target_attrs);
 	if (!pwq) {
-		pr_warn("workqueue: allocation failed while updating NUMA affinity of \"%s\"\n",
+		pr_warn("workqueue: allocation failed while updating pod affinity of \"%s\"\n",
 			wq->name);
 		goto use_dfl_pwq;
 	}
 
 	/* Install the new pwq. */
 	mutex_lock(&wq->mutex);
-	old_pwq = numa_pwq_tbl_install(wq, node, pwq);
+	old_pwq = pod_pwq_tbl_install(wq, pod, pwq);
 	goto out_unlock;
 
 use_dfl_pwq:
@@ -3902,7 +4052,7 @@ static void wq_update_unbound_numa(struct workqueue_struct *wq, int cpu,
 	spin_lock_irq(&wq->dfl_pwq->pool->lock);
 	get_pwq(wq->dfl_pwq);
 	spin_unlock_irq(&wq->dfl_pwq->pool->lock);
-	old_pwq = numa_pwq_tbl_install(wq, node, wq->dfl_pwq);
+	old_pwq = pod_pwq_tbl_install(wq, pod, wq->dfl_pwq);
 out_unlock:
 	mutex_unlock(&wq->mutex);
 	put_pwq_unlocked(old_pwq);
@@ -3982,7 +4132,7 @@ struct workqueue_struct *__alloc_workqueue_key(const char *fmt,
 
 	/* allocate wq and format name */
 	if (flags & WQ_UNBOUND)
-		tbl_size = nr_node_ids * sizeof(wq->numa_pwq_tbl[0]);
+		tbl_size = nr_cpu_ids * sizeof(wq->pod_pwq_tbl[0]);
 
 	wq = kzalloc(sizeof(*wq) + tbl_size, GFP_KERNEL);
 	if (!wq)
@@ -4081,7 +4231,7 @@ EXPORT_SYMBOL_GPL(__alloc_workqueue_key);
 void destroy_workqueue(struct workqueue_struct *wq)
 {
 	struct pool_workqueue *pwq;
-	int node;
+	int pod;
 
 	/* drain it before proceeding with destruction */
 	drain_workqueue(wq);
@@ -4131,12 +4281,12 @@ void destroy_workqueue(struct workqueue_struct *wq)
 	} else {
 		/*
 		 * We're the sole accessor of @wq at this point.  Directly
-		 * access numa_pwq_tbl[] and dfl_pwq to put the base refs.
+		 * access pod_pwq_tbl[] and dfl_pwq to put the base refs.
 		 * @wq will be freed when the last pwq is released.
 		 */
-		for_each_node(node) {
-			pwq = rcu_access_pointer(wq->numa_pwq_tbl[node]);
-			RCU_INIT_POINTER(wq->numa_pwq_tbl[node], NULL);
+		for (pod = 0; pod < nr_cpu_ids; pod++) {
+			pwq = rcu_access_pointer(wq->pod_pwq_tbl[pod]);
+			RCU_INIT_POINTER(wq->pod_pwq_tbl[pod], NULL);
 			put_pwq_unlocked(pwq);
 		}
 
@@ -4229,7 +4379,7 @@ bool workqueue_congested(int cpu, struct workqueue_struct *wq)
 	if (!(wq->flags & WQ_UNBOUND))
 		pwq = per_cpu_ptr(wq->cpu_pwqs, cpu);
 	else
-		pwq = unbound_pwq_by_node(wq, cpu_to_node(cpu));
+		pwq = unbound_pwq(wq, cpu);
 
 	ret = !list_empty(&pwq->delayed_works);
 	rcu_read_unlock_sched();
@@ -4715,9 +4865,9 @@ int workqueue_online_cpu(unsigned int cpu)
 		mutex_unlock(&pool->attach_mutex);
 	}
 
-	/* update NUMA affinity of unbound workqueues */
+	/* update pod affinity of unbound workqueues */
 	list_for_each_entry(wq, &workqueues, list)
-		wq_update_unbound_numa(wq, cpu, true);
+		wq_update_pod(wq, cpu, true);
 
 	mutex_unlock(&wq_pool_mutex);
 	return 0;
@@ -4732,10 +4882,10 @@ int workqueue_offline_cpu(unsigned int cpu)
 	INIT_WORK_ONSTACK(&unbind_work, wq_unbind_fn);
 	queue_work_on(cpu, system_highpri_wq, &unbind_work);
 
-	/* update NUMA affinity of unbound workqueues */
+	/* update pod affinity of unbound workqueues */
 	mutex_lock(&wq_pool_mutex);
 	list_for_each_entry(wq, &workqueues, list)
-		wq_update_unbound_numa(wq, cpu, false);
+		wq_update_pod(wq, cpu, false);
 	mutex_unlock(&wq_pool_mutex);
 
 	/* wait for per-cpu unbinding to finish */
@@ -4953,6 +5103,36 @@ static int workqueue_apply_unbound_cpumask(void)
 	return ret;
 }
 
+/*
+ * Apply @requested minus wq_isolated_cpumask as the low-level unbound
+ * cpumask.  Called with wq_pool_mutex held.
+ */
+static int workqueue_update_unbound_cpumask(const struct cpumask *requested)
+{
+	cpumask_var_t saved_cpumask;
+	int ret;
+
+	lockdep_assert_held(&wq_pool_mutex);
+
+	if (!zalloc_cpumask_var(&saved_cpumask, GFP_KERNEL))
+		return -ENOMEM;
+
+	/* save the old wq_unbound_cpumask. */
+	cpumask_copy(saved_cpumask, wq_unbound_cpumask);
+
+	/* update wq_unbound_cpumask at first and apply it to wqs. */
+	if (!cpumask_andnot(wq_unbound_cpumask, requested, wq_isolated_cpumask))
+		cpumask_copy(wq_unbound_cpumask, requested);
+	ret = workqueue_apply_unbound_cpumask();
+
+	/* restore the wq_unbound_cpumask when failed. */
+	if (ret < 0)
+		cpumask_copy(wq_unbound_cpumask, saved_cpumask);
+
+	free_cpumask_var(saved_cpumask);
+	return ret;
+}
+
 /**
  *  workqueue_set_unbound_cpumask - Set the low-level unbound cpumask
  *  @cpumask: the cpumask to set
@@ -4968,30 +5148,39 @@ static int workqueue_apply_unbound_cpumask(void)
 int workqueue_set_unbound_cpumask(cpumask_var_t cpumask)
 {
 	int ret = -EINVAL;
-	cpumask_var_t saved_cpumask;
-
-	if (!zalloc_cpumask_var(&saved_cpumask, GFP_KERNEL))
-		return -ENOMEM;
 
 	cpumask_and(cpumask, cpumask, cpu_possible_mask);
 	if (!cpumask_empty(cpumask)) {
 		apply_wqattrs_lock();
+		ret = workqueue_update_unbound_cpumask(cpumask);
+		if (!ret)
+			cpumask_copy(wq_requested_unbound_cpumask, cpumask);
+		apply_wqattrs_unlock();
+	}
 
-		/* save the old wq_unbound_cpumask. */
-		cpumask_copy(saved_cpumask, wq_unbound_cpumask);
-
-		/* update wq_unbound_cpumask at first and apply it to wqs. */
-		cpumask_copy(wq_unbound_cpumask, cpumask);
-		ret = workqueue_apply_unbound_cpumask();
+	return ret;
+}
 
-		/* restore the wq_unbound_cpumask when failed. */
-		if (ret < 0)
-			cpumask_copy(wq_unbound_cpumask, saved_cpumask);
+/**
+ *  workqueue_unbound_exclude_cpumask - Keep unbound workqueues off some CPUs
+ *  @exclude_cpumask: the cpus to exclude
+ *
+ *  Used by cpuset to move unbound work away from the CPUs of isolated
+ *  partitions.  The requested unbound cpumask minus @exclude_cpumask
+ *  becomes the low-level unbound cpumask; if that leaves no CPU, the
+ *  requested cpumask is used as is.
+ *
+ *  Return:	0 on success, -errno as workqueue_set_unbound_cpumask().
+ */
+int workqueue_unbound_exclude_cpumask(const struct cpumask *exclude_cpumask)
+{
+	int ret;
 
-		apply_wqattrs_unlock();
-	}
+	apply_wqattrs_lock();
+	cpumask_copy(wq_isolated_cpumask, exclude_cpumask);
+	ret = workqueue_update_unbound_cpumask(wq_requested_unbound_cpumask);
+	apply_wqattrs_unlock();
 
-	free_cpumask_var(saved_cpumask);
 	return ret;
 }
 
@@ -5066,13 +5255,13 @@ static ssize_t wq_pool_ids_show(struct device *dev,
 {
 	struct workqueue_struct *wq = dev_to_wq(dev);
 	const char *delim = "";
-	int node, written = 0;
+	int cpu, written = 0;
 
 	rcu_read_lock_sched();
-	for_each_node(node) {
+	for_each_possible_cpu(cpu) {
 		written += scnprintf(buf + written, PAGE_SIZE - written,
-				     "%s%d:%d", delim, node,
-				     unbound_pwq_by_node(wq, node)->pool->id);
+				     "%s%d:%d", delim, cpu,
+				     unbound_pwq(wq, cpu)->pool->id);
 		delim = " ";
 	}
 	written += scnprintf(buf + written, PAGE_SIZE - written, "\n");
@@ -5210,11 +5399,101 @@ static ssize_t wq_numa_store(struct device *dev, struct device_attribute *attr,
 	return ret ?: count;
 }
 
+static ssize_t wq_affn_scope_show(struct device *dev,
+				  struct device_attribute *attr, char *buf)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	enum wq_affn_scope scope;
+	int written;
+
+	mutex_lock(&wq->mutex);
+	scope = wq->unbound_attrs->affn_scope;
+	if (scope == WQ_AFFN_DFL)
+		written = scnprintf(buf, PAGE_SIZE, "%s (%s)\n",
+				    wq_affn_names[WQ_AFFN_DFL],
+				    wq_affn_names[wq_affn_dfl]);
+	else
+		written = scnprintf(buf, PAGE_SIZE, "%s\n",
+				    wq_affn_names[scope]);
+	mutex_unlock(&wq->mutex);
+
+	return written;
+}
+
+static ssize_t wq_affn_scope_store(struct device *dev,
+				   struct device_attribute *attr,
+				   const char *buf, size_t count)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	struct workqueue_attrs *attrs;
+	int affn, ret = -ENOMEM;
+
+	affn = parse_affn_scope(buf);
+	if (affn < 0)
+		return affn;
+
+	apply_wqattrs_lock();
+
+	attrs = wq_sysfs_prep_attrs(wq);
+	if (!attrs)
+		goto out_unlock;
+
+	attrs->affn_scope = affn;
+	ret = apply_workqueue_attrs_locked(wq, attrs);
+
+out_unlock:
+	apply_wqattrs_unlock();
+	free_workqueue_attrs(attrs);
+	return ret ?: count;
+}
+
+static ssize_t wq_affn_strict_show(struct device *dev,
+				   struct device_attribute *attr, char *buf)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	int written;
+
+	mutex_lock(&wq->mutex);
+	written = scnprintf(buf, PAGE_SIZE, "%d\n",
+			    wq->unbound_attrs->affn_strict);
+	mutex_unlock(&wq->mutex);
+
+	return written;
+}
+
+static ssize_t wq_affn_strict_store(struct device *dev,
+				    struct device_attribute *attr,
+				    const char *buf, size_t count)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	struct workqueue_attrs *attrs;
+	int v, ret = -ENOMEM;
+
+	apply_wqattrs_lock();
+
+	attrs = wq_sysfs_prep_attrs(wq);
+	if (!attrs)
+		goto out_unlock;
+
+	ret = -EINVAL;
+	if (sscanf(buf, "%d", &v) == 1) {
+		attrs->affn_strict = !!v;
+		ret = apply_workqueue_attrs_locked(wq, attrs);
+	}
+
+out_unlock:
+	apply_wqattrs_unlock();
+	free_workqueue_attrs(attrs);
+	return ret ?: count;
+}
+
 static struct device_attribute wq_sysfs_unbound_attrs[] = {
 	__ATTR(pool_ids, 0444, wq_pool_ids_show, NULL),
 	__ATTR(nice, 0644, wq_nice_show, wq_nice_store),
 	__ATTR(cpumask, 0644, wq_cpumask_show, wq_cpumask_store),
 	__ATTR(numa, 0644, wq_numa_show, wq_numa_store),
+	__ATTR(affinity_scope, 0644, wq_affn_scope_show, wq_affn_scope_store),
+	__ATTR(affinity_strict, 0644, wq_affn_strict_show, wq_affn_strict_store),
 	__ATTR_NULL,
 };
 
@@ -5512,10 +5791,78 @@ static inline void wq_watchdog_init(void) { }
 
 #endif	/* CONFIG_WQ_WATCHDOG */
 
+static void __init init_pod_type(struct wq_pod_type *pt,
+				 bool (*cpus_share_pod)(int, int))
+{
+	int cur, pre, cpu, pod;
+	int nr_pods = 0;
+	cpumask_var_t *pod_cpus;
+	int *pod_node, *cpu_pod;
+
+	/* a CPU shares the pod of the first preceding CPU it shares with */
+	cpu_pod = kcalloc(nr_cpu_ids, sizeof(cpu_pod[0]), GFP_KERNEL);
+	BUG_ON(!cpu_pod);
+
+	for_each_possible_cpu(cur) {
+		for_each_possible_cpu(pre) {
+			if (pre >= cur) {
+				cpu_pod[cur] = nr_pods++;
+				break;
+			}
+			if (cpus_share_pod(cur, pre)) {
+				cpu_pod[cur] = cpu_pod[pre];
+				break;
+			}
+		}
+	}
+
+	pod_cpus = kcalloc(nr_pods, sizeof(pod_cpus[0]), GFP_KERNEL);
+	pod_node = kcalloc(nr_pods, sizeof(pod_node[0]), GFP_KERNEL);
+	BUG_ON(!pod_cpus || !pod_node);
+
+	for (pod = 0; pod < nr_pods; pod++)
+		BUG_ON(!zalloc_cpumask_var(&pod_cpus[pod], GFP_KERNEL));
+
+	for_each_possible_cpu(cpu) {
+		cpumask_set_cpu(cpu, pod_cpus[cpu_pod[cpu]]);
+		pod_node[cpu_pod[cpu]] = cpu_to_node(cpu);
+	}
+
+	pt->pod_cpus = pod_cpus;
+	pt->pod_node = pod_node;
+	pt->cpu_pod = cpu_pod;
+
+	/* pairs with smp_load_acquire() in wqattrs_pod_type() */
+	smp_store_release(&pt->nr_pods, nr_pods);
+}
+
+static bool __init cpus_dont_share(int cpu0, int cpu1)
+{
+	return false;
+}
+
+static bool __init cpus_share_smt(int cpu0, int cpu1)
+{
+#ifdef CONFIG_SCHED_SMT
+	return cpumask_test_cpu(cpu0, topology_sibling_cpumask(cpu1));
+#else
+	return false;
+#endif
+}
+
+static bool __init cpus_share_numa(int cpu0, int cpu1)
+{
+	return cpu_to_node(cpu0) == cpu_to_node(cpu1);
+}
+
+static bool __init cpus_share_system(int cpu0, int cpu1)
+{
+	return true;
+}
+
 static void __init wq_numa_init(void)
 {
-	cpumask_var_t *tbl;
-	int node, cpu;
+	int cpu;
 
 	if (num_possible_nodes() <= 1)
 		return;
@@ -5525,33 +5872,19 @@ static void __init wq_numa_init(void)
 		return;
 	}
 
-	wq_update_unbound_numa_attrs_buf = alloc_workqueue_attrs(GFP_KERNEL);
-	BUG_ON(!wq_update_unbound_numa_attrs_buf);
-
 	/*
-	 * We want masks of possible CPUs of each node which isn't readily
-	 * available.  Build one from cpu_to_node() which should have been
-	 * fully initialized by now.
+	 * The NUMA pods are built from cpu_to_node() which should have
+	 * been fully initialized by now.
 	 */
-	tbl = kzalloc(nr_node_ids * sizeof(tbl[0]), GFP_KERNEL);
-	BUG_ON(!tbl);
-
-	for_each_node(node)
-		BUG_ON(!zalloc_cpumask_var_node(&tbl[node], GFP_KERNEL,
-				node_online(node) ? node : NUMA_NO_NODE));
-
 	for_each_possible_cpu(cpu) {
-		node = cpu_to_node(cpu);
-		if (WARN_ON(node == NUMA_NO_NODE)) {
+		if (WARN_ON(cpu_to_node(cpu) == NUMA_NO_NODE)) {
 			pr_warn("workqueue: NUMA node mapping not available for cpu%d, disabling NUMA support\n", cpu);
 			/* happens iff arch is bonkers, let's just proceed */
 			return;
 		}
-		cpumask_set_cpu(cpu, tbl[node]);
 	}
 
-	wq_numa_possible_cpumask = tbl;
-	wq_numa_enabled = true;
+	init_pod_type(&wq_pod_types[WQ_AFFN_NUMA], cpus_share_numa);
 }
 
 /**
@@ -5573,9 +5906,19 @@ int __init workqueue_init_early(void)
 
 	BUG_ON(!alloc_cpumask_var(&wq_unbound_cpumask, GFP_KERNEL));
 	cpumask_copy(wq_unbound_cpumask, cpu_possible_mask);
+	BUG_ON(!alloc_cpumask_var(&wq_requested_unbound_cpumask, GFP_KERNEL));
+	cpumask_copy(wq_requested_unbound_cpumask, cpu_possible_mask);
+	BUG_ON(!zalloc_cpumask_var(&wq_isolated_cpumask, GFP_KERNEL));
 
 	pwq_cache = KMEM_CACHE(pool_workqueue, SLAB_PANIC);
 
+	wq_update_pod_attrs_buf = alloc_workqueue_attrs(GFP_KERNEL);
+	BUG_ON(!wq_update_pod_attrs_buf);
+
+	/* the other pod types need the topology, see wq_pod_init() */
+	init_pod_type(&wq_pod_types[WQ_AFFN_CPU], cpus_dont_share);
+	init_pod_type(&wq_pod_types[WQ_AFFN_SYSTEM], cpus_share_system);
+
 	/* initialize CPU pools */
 	for_each_possible_cpu(cpu) {
 		struct worker_pool *pool;
@@ -5585,6 +5928,7 @@ int __init workqueue_init_early(void)
 			BUG_ON(init_worker_pool(pool));
 			pool->cpu = cpu;
 			cpumask_copy(pool->attrs->cpumask, cpumask_of(cpu));
+			cpumask_copy(pool->attrs->__pod_cpumask, cpumask_of(cpu));
 			pool->attrs->nice = std_nice[i++];
 			pool->node = cpu_to_node(cpu);
 
@@ -5606,7 +5950,7 @@ int __init workqueue_init_early(void)
 		/*
 		 * An ordered wq should have only one pwq as ordering is
 		 * guaranteed by max_active which is enforced by pwqs.
-		 * Turn off NUMA so that dfl_pwq is used for all nodes.
+		 * Turn off NUMA so that dfl_pwq is used for all pods.
 		 */
 		BUG_ON(!(attrs = alloc_workqueue_attrs(GFP_KERNEL)));
 		attrs->nice = std_nice[i];
@@ -5667,7 +6011,7 @@ int __init workqueue_init(void)
 	}
 
 	list_for_each_entry(wq, &workqueues, list)
-		wq_update_unbound_numa(wq, smp_processor_id(), true);
+		wq_update_pod(wq, smp_processor_id(), true);
 
 	mutex_unlock(&wq_pool_mutex);
 
@@ -5687,3 +6031,28 @@ int __init workqueue_init(void)
 
 	return 0;
 }
+
+/*
+ * The SMT and cache topology is known only once the secondary CPUs are up
+ * and the sched domains have been built.  Build the remaining pod types
+ * then and move the existing workqueues over to their pods.
+ */
+static int __init wq_pod_init(void)
+{
+	struct workqueue_struct *wq;
+	int cpu;
+
+	apply_wqattrs_lock();
+
+	init_pod_type(&wq_pod_types[WQ_AFFN_SMT], cpus_share_smt);
+	init_pod_type(&wq_pod_types[WQ_AFFN_CACHE], cpus_share_cache);
+
+	list_for_each_entry(wq, &workqueues, list) {
+		for_each_online_cpu(cpu)
+			wq_update_pod(wq, cpu, true);
+	}
+
+	apply_wqattrs_unlock();
+	return 0;
+}
+core_initcall(wq_pod_init);
@@ -403,6 +403,63 @@ int __sbitmap_queue_get_shallow(struct sbitmap_queue *sbq,
 }
 EXPORT_SYMBOL_GPL(__sbitmap_queue_get_shallow);
 
+unsigned long __sbitmap_queue_get_batch(struct sbitmap_queue *sbq, int nr_tags,
+					unsigned int *offset)
+{
+	struct sbitmap *sb = &sbq->sb;
+	unsigned int hint, depth;
+	unsigned long index, nr;
+	int i;
+
+	if (unlikely(sbq->round_robin))
+		return 0;
+
+	depth = READ_ONCE(sb->depth);
+	hint = this_cpu_read(*sbq->alloc_hint);
+	if (unlikely(hint >= depth))
+		hint = 0;
+
+	index = SB_NR_TO_INDEX(sb, hint);
+
+	for (i = 0; i < sb->map_nr; i++) {
+		struct sbitmap_word *map = &sb->map[index];
+		unsigned long map_depth = READ_ONCE(map->depth);
+		atomic_long_t *ptr = (atomic_long_t *)&map->word;
+		unsigned long get_mask, val, ret;
+
+		nr = find_first_zero_bit(&map->word, map_depth);
+		if (nr + nr_tags <= map_depth) {
+			get_mask = ((1UL << nr_tags) - 1) << nr;
+			val = READ_ONCE(map->word);
+			for (;;) {
+				ret = atomic_long_cmpxchg(ptr, val,
+							  get_mask | val);
+				if (ret == val)
+					break;
+				val = ret;
+			}
+
+			/* keep the bits nobody else grabbed in between */
+			get_mask = (get_mask & ~ret) >> nr;
+			if (get_mask) {
+				*offset = nr + (index << sb->shift);
+				hint = *offset + nr_tags;
+				if (hint >= depth - 1)
+					hint = 0;
+				this_cpu_write(*sbq->alloc_hint, hint);
+				return get_mask;
+			}
+		}
+
+		/* Jump to next index. */
+		if (++index >= sb->map_nr)
+			index = 0;
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(__sbitmap_queue_get_batch);
+
 static struct sbq_wait_state *sbq_wake_ptr(struct sbitmap_queue *sbq)
 {
 	int i, wake_index;
@@ -425,7 +482,7 @@ static struct sbq_wait_state *sbq_wake_ptr(struct sbitmap_queue *sbq)
 	return NULL;
 }
 
-static void sbq_wake_up(struct sbitmap_queue *sbq)
+static void sbq_wake_up(struct sbitmap_queue *sbq, int nr)
 {
 	struct sbq_wait_state *ws;
 	unsigned int wake_batch;
@@ -444,7 +501,7 @@ static void sbq_wake_up(struct sbitmap_queue *sbq)
 	if (!ws)
 		return;
 
-	wait_cnt = atomic_dec_return(&ws->wait_cnt);
+	wait_cnt = atomic_sub_return(nr, &ws->wait_cnt);
 	if (wait_cnt <= 0) {
 		wake_batch = READ_ONCE(sbq->wake_batch);
 		/*
@@ -470,12 +527,47 @@ void sbitmap_queue_clear(struct sbitmap_queue *sbq, unsigned int nr,
 			 unsigned int cpu)
 {
 	sbitmap_clear_bit(&sbq->sb, nr);
-	sbq_wake_up(sbq);
+	sbq_wake_up(sbq, 1);
 	if (likely(!sbq->round_robin && nr < sbq->sb.depth))
 		*per_cpu_ptr(sbq->alloc_hint, cpu) = nr;
 }
 EXPORT_SYMBOL_GPL(sbitmap_queue_clear);
 
+void sbitmap_queue_clear_batch(struct sbitmap_queue *sbq, int offset,
+			       int *tags, int nr_tags)
+{
+	struct sbitmap *sb = &sbq->sb;
+	unsigned long *addr = NULL;
+	unsigned long mask = 0;
+	int i, nr;
+
+	smp_mb__before_atomic();
+	for (i = 0; i < nr_tags; i++) {
+		const int tag = tags[i] - offset;
+		unsigned long *this_addr;
+
+		this_addr = &sb->map[SB_NR_TO_INDEX(sb, tag)].word;
+		if (!addr) {
+			addr = this_addr;
+		} else if (addr != this_addr) {
+			atomic_long_andnot(mask, (atomic_long_t *)addr);
+			mask = 0;
+			addr = this_addr;
+		}
+		mask |= 1UL << SB_NR_TO_BIT(sb, tag);
+	}
+
+	if (mask)
+		atomic_long_andnot(mask, (atomic_long_t *)addr);
+
+	sbq_wake_up(sbq, nr_tags);
+
+	nr = tags[nr_tags - 1] - offset;
+	if (likely(!sbq->round_robin && nr < sbq->sb.depth))
+		this_cpu_write(*sbq->alloc_hint, nr);
+}
+EXPORT_SYMBOL_GPL(sbitmap_queue_clear_batch);
+
 void sbitmap_queue_wake_all(struct sbitmap_queue *sbq)
 {
 	int i, wake_index;
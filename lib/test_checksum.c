@@ -0,0 +1,171 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Checks the IP checksum routines of the architecture against a plain C
+ * sum of the 16-bit words, the way lib/checksum.c computes it, for lengths
+ * and alignments covering the heads, tails and unrolled loops of the
+ * optimized versions.  Each case is run once as is and once with the
+ * interrupts disabled, which keeps the versions using SIMD registers on
+ * their scalar code.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/init.h>
+#include <linux/irqflags.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/random.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <net/checksum.h>
+
+#define TEST_CSUM_SIZE	(64 * 1024)
+#define TEST_CSUM_ALIGN	16
+#define TEST_CSUM_GUARD	0x5a
+
+static u8 *src, *dst;
+static unsigned int tests, failures;
+
+/* The one's complement sum of @len bytes at @p and @sum, modulo 0xffff */
+static u16 ref_csum(const u8 *p, int len, u32 sum)
+{
+	u64 s = sum;
+	u16 w;
+	int i;
+
+	for (i = 0; i + 1 < len; i += 2) {
+		memcpy(&w, p + i, 2);
+		s += w;
+	}
+	if (len & 1) {
+		w = 0;
+		memcpy(&w, p + len - 1, 1);
+		s += w;
+	}
+	while (s >> 16)
+		s = (s & 0xffff) + (s >> 16);
+	return s % 0xffff;
+}
+
+static u16 norm_sum16(__sum16 csum)
+{
+	return (u16)~(__force u16)csum % 0xffff;
+}
+
+static u16 norm_csum(__wsum csum)
+{
+	return norm_sum16(csum_fold(csum));
+}
+
+static void check(bool ok, const char *func, int off, int len, bool irqs_off)
+{
+	tests++;
+	if (ok)
+		return;
+	if (failures++ < 10)
+		pr_err("%s() failed: offset %d, length %d%s\n", func, off, len,
+		       irqs_off ? ", irqs off" : "");
+}
+
+static void test_csum(int off, int len, bool irqs_off)
+{
+	int doff = (off + 3) % TEST_CSUM_ALIGN + 1;
+	u32 sum = prandom_u32();
+	u16 ref = ref_csum(src + off, len, sum);
+	__wsum csum, copy_csum;
+	unsigned long flags;
+	__sum16 ip_csum;
+	bool copied;
+
+	dst[doff - 1] = TEST_CSUM_GUARD;
+	dst[doff + len] = TEST_CSUM_GUARD;
+
+	if (irqs_off)
+		local_irq_save(flags);
+	csum = csum_partial(src + off, len, (__force __wsum)sum);
+	copy_csum = csum_partial_copy_nocheck(src + off, dst + doff, len,
+					      (__force __wsum)sum);
+	ip_csum = ip_compute_csum(src + off, len);
+	if (irqs_off)
+		local_irq_restore(flags);
+
+	copied = !memcmp(dst + doff, src + off, len) &&
+		 dst[doff - 1] == TEST_CSUM_GUARD &&
+		 dst[doff + len] == TEST_CSUM_GUARD;
+
+	check(norm_csum(csum) == ref, "csum_partial", off, len, irqs_off);
+	check(norm_csum(copy_csum) == ref && copied,
+	      "csum_partial_copy_nocheck", off, len, irqs_off);
+	check(norm_sum16(ip_csum) == ref_csum(src + off, len, 0),
+	      "ip_compute_csum", off, len, irqs_off);
+}
+
+static void test_ip_fast_csum(int off, unsigned int ihl)
+{
+	__sum16 ip_csum = ip_fast_csum(src + off, ihl);
+
+	check(norm_sum16(ip_csum) == ref_csum(src + off, ihl * 4, 0),
+	      "ip_fast_csum", off, ihl * 4, false);
+}
+
+static void test_lengths(void)
+{
+	int off, len, i;
+
+	for (off = 0; off < TEST_CSUM_ALIGN; off++) {
+		for (len = 0; len <= 1100; len++) {
+			test_csum(off, len, false);
+			test_csum(off, len, true);
+		}
+	}
+	for (i = 0; i < 256; i++) {
+		off = prandom_u32_max(TEST_CSUM_ALIGN);
+		len = prandom_u32_max(TEST_CSUM_SIZE - TEST_CSUM_ALIGN);
+		test_csum(off, len, false);
+		test_csum(off, len, true);
+	}
+}
+
+static int __init test_checksum_init(void)
+{
+	unsigned int ihl;
+	int off;
+
+	src = kmalloc(TEST_CSUM_SIZE, GFP_KERNEL);
+	dst = kmalloc(TEST_CSUM_SIZE + 2 * TEST_CSUM_ALIGN, GFP_KERNEL);
+	if (!src || !dst) {
+		kfree(src);
+		kfree(dst);
+		return -ENOMEM;
+	}
+
+	prandom_bytes(src, TEST_CSUM_SIZE);
+	test_lengths();
+	for (off = 0; off < TEST_CSUM_ALIGN; off += 4)
+		for (ihl = 5; ihl <= 15; ihl++)
+			test_ip_fast_csum(off, ihl);
+
+	/* all ones, for the carries */
+	memset(src, 0xff, TEST_CSUM_SIZE);
+	test_lengths();
+
+	kfree(src);
+	kfree(dst);
+
+	if (failures) {
+		pr_err("%u of %u tests failed\n", failures, tests);
+		return -EINVAL;
+	}
+	pr_info("all %u tests passed\n", tests);
+	return 0;
+}
+
+static void __exit test_checksum_exit(void)
+{
+}
+
+module_init(test_checksum_init);
+module_exit(test_checksum_exit);
+
+MODULE_DESCRIPTION("IP checksum routines test");
+MODULE_LICENSE("GPL");
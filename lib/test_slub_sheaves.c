@@ -0,0 +1,201 @@
+/*
+ * Microbenchmark for the SLUB per cpu sheaves: compares a cache created
+ * with SLAB_SHEAVES against one created without, on local alloc/free
+ * pairs, on batches of objects held at once, and on objects freed by
+ * another cpu than the one that allocated them.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/cpumask.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
+
+static unsigned int object_size = 256;
+module_param(object_size, uint, 0);
+MODULE_PARM_DESC(object_size, "Size of the test objects (default: 256)");
+
+static unsigned int loops = 1000000;
+module_param(loops, uint, 0);
+MODULE_PARM_DESC(loops, "Objects allocated and freed per test (default: 1000000)");
+
+static unsigned int batch = 512;
+module_param(batch, uint, 0);
+MODULE_PARM_DESC(batch, "Objects held at once by the batch tests (default: 512)");
+
+struct bench {
+	const char *name;
+	unsigned long flags;
+	int remote_cpu;
+	struct kmem_cache *s;
+	void **objs;
+};
+
+struct remote_free {
+	struct work_struct work;
+	struct bench *b;
+	u64 ns;
+};
+
+static int alloc_batch(struct bench *b)
+{
+	unsigned int i;
+
+	for (i = 0; i < batch; i++) {
+		b->objs[i] = kmem_cache_alloc(b->s, GFP_KERNEL);
+		if (!b->objs[i]) {
+			while (i--)
+				kmem_cache_free(b->s, b->objs[i]);
+			return -ENOMEM;
+		}
+	}
+	return 0;
+}
+
+static void free_batch(struct bench *b)
+{
+	unsigned int i;
+
+	for (i = 0; i < batch; i++)
+		kmem_cache_free(b->s, b->objs[i]);
+}
+
+static int bench_pairs(struct bench *b, u64 *ns)
+{
+	u64 start = ktime_get_ns();
+	unsigned int i;
+
+	for (i = 0; i < loops; i++) {
+		void *p = kmem_cache_alloc(b->s, GFP_KERNEL);
+
+		if (!p)
+			return -ENOMEM;
+		kmem_cache_free(b->s, p);
+	}
+	*ns = ktime_get_ns() - start;
+	return 0;
+}
+
+static int bench_batch(struct bench *b, u64 *ns)
+{
+	unsigned int i, rounds = loops / batch;
+	u64 start = ktime_get_ns();
+
+	for (i = 0; i < rounds; i++) {
+		if (alloc_batch(b))
+			return -ENOMEM;
+		free_batch(b);
+		cond_resched();
+	}
+	*ns = ktime_get_ns() - start;
+	return 0;
+}
+
+static void remote_free_fn(struct work_struct *work)
+{
+	struct remote_free *rf = container_of(work, struct remote_free, work);
+	u64 start = ktime_get_ns();
+
+	free_batch(rf->b);
+	rf->ns += ktime_get_ns() - start;
+}
+
+static int bench_remote(struct bench *b, u64 *alloc_ns, u64 *free_ns)
+{
+	unsigned int i, rounds = loops / batch;
+	struct remote_free rf = { .b = b };
+	int ret = 0;
+
+	*alloc_ns = 0;
+	INIT_WORK_ONSTACK(&rf.work, remote_free_fn);
+	for (i = 0; i < rounds; i++) {
+		u64 start = ktime_get_ns();
+
+		ret = alloc_batch(b);
+		if (ret)
+			break;
+		*alloc_ns += ktime_get_ns() - start;
+
+		queue_work_on(b->remote_cpu, system_wq, &rf.work);
+		flush_work(&rf.work);
+	}
+	destroy_work_on_stack(&rf.work);
+	*free_ns = rf.ns;
+	return ret;
+}
+
+/* Runs bound to one cpu, through work_on_cpu() */
+static long run_bench(void *arg)
+{
+	struct bench *b = arg;
+	u64 pairs, batched, remote_alloc = 0, remote_free = 0;
+	unsigned int nr = loops / batch * batch;
+	int ret;
+
+	ret = bench_pairs(b, &pairs);
+	if (!ret)
+		ret = bench_batch(b, &batched);
+	if (!ret && b->remote_cpu < nr_cpu_ids)
+		ret = bench_remote(b, &remote_alloc, &remote_free);
+	if (ret)
+		return ret;
+
+	pr_info("%-12s pair %llu ns, batch %llu ns, remote alloc %llu ns free %llu ns per object\n",
+		b->name, div_u64(pairs, loops), div_u64(batched, nr),
+		div_u64(remote_alloc, nr), div_u64(remote_free, nr));
+	return 0;
+}
+
+static int __init test_slub_sheaves_init(void)
+{
+	struct bench benches[] = {
+		{ .name = "no sheaves",	.flags = 0 },
+		{ .name = "sheaves",	.flags = SLAB_SHEAVES },
+	};
+	int cpu, i, ret = 0;
+
+	if (!object_size || !batch || loops < batch)
+		return -EINVAL;
+
+	get_online_cpus();
+	cpu = cpumask_first(cpu_online_mask);
+
+	for (i = 0; i < ARRAY_SIZE(benches) && !ret; i++) {
+		struct bench *b = &benches[i];
+
+		b->remote_cpu = cpumask_next(cpu, cpu_online_mask);
+		b->objs = vmalloc(batch * sizeof(void *));
+		b->s = kmem_cache_create("test_slub_sheaves", object_size, 0,
+					 b->flags, NULL);
+		if (!b->objs || !b->s) {
+			ret = -ENOMEM;
+		} else {
+			ret = work_on_cpu(cpu, run_bench, b);
+			if (!ret && b->flags && !b->s->sheaf_capacity)
+				pr_info("sheaves are not available for this cache\n");
+		}
+		if (b->s)
+			kmem_cache_destroy(b->s);
+		vfree(b->objs);
+	}
+	put_online_cpus();
+
+	if (ret)
+		return ret;
+	/* The results are in the log: fail the load so it can be rerun */
+	return -EAGAIN;
+}
+
+module_init(test_slub_sheaves_init);
+MODULE_LICENSE("GPL");
@@ -417,7 +417,10 @@ static unsigned long isolate_freepages_block(struct compact_control *cc,
 	bool locked = false;
 	unsigned long blockpfn = *start_pfn;
 	unsigned int order;
+	spinlock_t *lock;
 
+	/* The range never crosses a pageblock, hence a shard */
+	lock = &zone_shard(cc->zone, blockpfn)->lock;
 	cursor = pfn_to_page(blockpfn);
 
 	/* Isolate free pages. */
@@ -431,8 +434,7 @@ static unsigned long isolate_freepages_block(struct compact_control *cc,
 		 * pending or async compaction detects need_resched()
 		 */
 		if (!(blockpfn % SWAP_CLUSTER_MAX)
-		    && compact_unlock_should_abort(&cc->zone->lock, flags,
-								&locked, cc))
+		    && compact_unlock_should_abort(lock, flags, &locked, cc))
 			break;
 
 		nr_scanned++;
@@ -471,15 +473,13 @@ static unsigned long isolate_freepages_block(struct compact_control *cc,
 		 */
 		if (!locked) {
 			/*
-			 * The zone lock must be held to isolate freepages.
-			 * Unfortunately this is a very coarse lock and can be
-			 * heavily contended if there are parallel allocations
-			 * or parallel compactions. For async compaction do not
-			 * spin on the lock and we acquire the lock as late as
-			 * possible.
+			 * The shard lock must be held to isolate freepages.
+			 * This can still be heavily contended if there are
+			 * parallel allocations or parallel compactions. For
+			 * async compaction do not spin on the lock and we
+			 * acquire the lock as late as possible.
 			 */
-			locked = compact_trylock_irqsave(&cc->zone->lock,
-								&flags, cc);
+			locked = compact_trylock_irqsave(lock, &flags, cc);
 			if (!locked)
 				break;
 
@@ -517,7 +517,7 @@ static unsigned long isolate_freepages_block(struct compact_control *cc,
 	}
 
 	if (locked)
-		spin_unlock_irqrestore(&cc->zone->lock, flags);
+		spin_unlock_irqrestore(lock, flags);
 
 	/*
 	 * There is a tiny chance that we have read bogus compound_order(),
@@ -1286,9 +1286,89 @@ static inline bool is_via_compact_memory(int order)
 	return order == -1;
 }
 
+/*
+ * The order proactive compaction works for: that of the huge pages, the
+ * largest allocations which are common.
+ */
+#if defined CONFIG_TRANSPARENT_HUGEPAGE
+#define COMPACTION_HPAGE_ORDER	HPAGE_PMD_ORDER
+#elif defined CONFIG_HUGETLB_PAGE
+#define COMPACTION_HPAGE_ORDER	HUGETLB_PAGE_ORDER
+#else
+#define COMPACTION_HPAGE_ORDER	(PMD_SHIFT - PAGE_SHIFT)
+#endif
+
+/*
+ * Proactive compaction keeps the fragmentation score of the nodes between
+ * two watermarks derived from it: 0 disables it, 100 is the most
+ * aggressive.
+ */
+unsigned int __read_mostly sysctl_compaction_proactiveness = 20;
+
+/* The first kswapd thread runs whenever the node is being balanced */
+static bool kswapd_is_running(pg_data_t *pgdat)
+{
+	struct task_struct *kswapd = pgdat->kswapd[0].task;
+
+	return kswapd && (kswapd->state == TASK_RUNNING);
+}
+
+/*
+ * The fragmentation score of a zone is the percentage of its free memory
+ * which is not in blocks of COMPACTION_HPAGE_ORDER or larger.
+ */
+static unsigned int fragmentation_score_zone(struct zone *zone)
+{
+	return extfrag_for_order(zone, COMPACTION_HPAGE_ORDER);
+}
+
+/*
+ * The score of a node is the average score of its zones weighted by their
+ * size, so that a small, fragmented DMA zone does not trigger compaction
+ * of the whole node.
+ */
+static unsigned int fragmentation_score_node(pg_data_t *pgdat)
+{
+	unsigned long score = 0;
+	int zoneid;
+
+	for (zoneid = 0; zoneid < MAX_NR_ZONES; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+
+		if (!populated_zone(zone))
+			continue;
+		score += zone->present_pages * fragmentation_score_zone(zone);
+	}
+
+	return div64_ul(score, pgdat->node_present_pages + 1);
+}
+
+/*
+ * Proactive compaction starts above the high watermark and stops below the
+ * low one.
+ */
+static unsigned int fragmentation_score_wmark(bool low)
+{
+	unsigned int wmark_low;
+
+	/* a score of 5 or less is as good as it gets, don't go below */
+	wmark_low = max(100U - sysctl_compaction_proactiveness, 5U);
+	return low ? wmark_low : min(wmark_low + 10, 100U);
+}
+
+static bool should_proactive_compact_node(pg_data_t *pgdat)
+{
+	if (!sysctl_compaction_proactiveness || kswapd_is_running(pgdat))
+		return false;
+
+	return fragmentation_score_node(pgdat) >
+	       fragmentation_score_wmark(false);
+}
+
 static enum compact_result __compact_finished(struct zone *zone,
 						struct compact_control *cc)
 {
+	struct zone_shard *shard;
 	unsigned int order;
 	const int migratetype = cc->migratetype;
 
@@ -1315,6 +1395,17 @@ static enum compact_result __compact_finished(struct zone *zone,
 			return COMPACT_PARTIAL_SKIPPED;
 	}
 
+	if (cc->proactive_compaction) {
+		/* leave the memory to reclaim when it runs short */
+		if (kswapd_is_running(zone->zone_pgdat))
+			return COMPACT_PARTIAL_SKIPPED;
+
+		if (fragmentation_score_zone(zone) >
+		    fragmentation_score_wmark(true))
+			return COMPACT_CONTINUE;
+		return COMPACT_SUCCESS;
+	}
+
 	if (is_via_compact_memory(cc->order))
 		return COMPACT_CONTINUE;
 
@@ -1329,48 +1420,51 @@ static enum compact_result __compact_finished(struct zone *zone,
 			return COMPACT_CONTINUE;
 	}
 
-	/* Direct compactor: Is a suitable page free? */
+	/* Direct compactor: Is a suitable page free in any shard? */
 	for (order = cc->order; order < MAX_ORDER; order++) {
-		struct free_area *area = &zone->free_area[order];
-		bool can_steal;
+		for_each_zone_shard(zone, shard) {
+			struct free_area *area = &shard->free_area[order];
+			bool can_steal;
 
-		/* Job done if page is free of the right migratetype */
-		if (!list_empty(&area->free_list[migratetype]))
-			return COMPACT_SUCCESS;
+			/* Job done if page is free of the right migratetype */
+			if (!list_empty(&area->free_list[migratetype]))
+				return COMPACT_SUCCESS;
 
 #ifdef CONFIG_CMA
-		/* MIGRATE_MOVABLE can fallback on MIGRATE_CMA */
-		if (migratetype == MIGRATE_MOVABLE &&
-			!list_empty(&area->free_list[MIGRATE_CMA]))
-			return COMPACT_SUCCESS;
+			/* MIGRATE_MOVABLE can fallback on MIGRATE_CMA */
+			if (migratetype == MIGRATE_MOVABLE &&
+				!list_empty(&area->free_list[MIGRATE_CMA]))
+				return COMPACT_SUCCESS;
 #endif
-		/*
-		 * Job done if allocation would steal freepages from
-		 * other migratetype buddy lists.
-		 */
-		if (find_suitable_fallback(area, order, migratetype,
+			/*
+			 * Job done if allocation would steal freepages from
+			 * other migratetype buddy lists.
+			 */
+			if (find_suitable_fallback(area, order, migratetype,
 						true, &can_steal) != -1) {
 
-			/* movable pages are OK in any pageblock */
-			if (migratetype == MIGRATE_MOVABLE)
-				return COMPACT_SUCCESS;
+				/* movable pages are OK in any pageblock */
+				if (migratetype == MIGRATE_MOVABLE)
+					return COMPACT_SUCCESS;
 
-			/*
-			 * We are stealing for a non-movable allocation. Make
-			 * sure we finish compacting the current pageblock
-			 * first so it is as free as possible and we won't
-			 * have to steal another one soon. This only applies
-			 * to sync compaction, as async compaction operates
-			 * on pageblocks of the same migratetype.
-			 */
-			if (cc->mode == MIGRATE_ASYNC ||
-					IS_ALIGNED(cc->migrate_pfn,
-							pageblock_nr_pages)) {
-				return COMPACT_SUCCESS;
-			}
+				/*
+				 * We are stealing for a non-movable
+				 * allocation. Make sure we finish compacting
+				 * the current pageblock first so it is as free
+				 * as possible and we won't have to steal
+				 * another one soon. This only applies to sync
+				 * compaction, as async compaction operates on
+				 * pageblocks of the same migratetype.
+				 */
+				if (cc->mode == MIGRATE_ASYNC ||
+				    IS_ALIGNED(cc->migrate_pfn,
+					       pageblock_nr_pages)) {
+					return COMPACT_SUCCESS;
+				}
 
-			cc->finishing_block = true;
-			return COMPACT_CONTINUE;
+				cc->finishing_block = true;
+				return COMPACT_CONTINUE;
+			}
 		}
 	}
 
@@ -1889,6 +1983,60 @@ void compaction_unregister_node(struct node *node)
 }
 #endif /* CONFIG_SYSFS && CONFIG_NUMA */
 
+/*
+ * kcompactd checks the fragmentation score of its node this often, and
+ * spends at most a tenth of the time since its last proactive run
+ * compacting proactively.
+ */
+#define HPAGE_FRAG_CHECK_INTERVAL_MSEC	(500)
+#define PROACTIVE_CPU_BUDGET_RATIO	(10)
+
+/*
+ * Compacts the zones of @pgdat until their fragmentation score is back
+ * below the low watermark, when no allocation asked for it.
+ */
+static void proactive_compact_node(pg_data_t *pgdat)
+{
+	int zoneid;
+	struct zone *zone;
+	struct compact_control cc = {
+		.order = -1,
+		.mode = MIGRATE_SYNC_LIGHT,
+		.ignore_skip_hint = true,
+		.whole_zone = true,
+		.gfp_mask = GFP_KERNEL,
+		.proactive_compaction = true,
+	};
+
+	count_compact_event(KCOMPACTD_PROACTIVE);
+
+	for (zoneid = 0; zoneid < MAX_NR_ZONES; zoneid++) {
+		zone = &pgdat->node_zones[zoneid];
+		if (!populated_zone(zone))
+			continue;
+
+		cc.nr_freepages = 0;
+		cc.nr_migratepages = 0;
+		cc.total_migrate_scanned = 0;
+		cc.total_free_scanned = 0;
+		cc.zone = zone;
+		INIT_LIST_HEAD(&cc.freepages);
+		INIT_LIST_HEAD(&cc.migratepages);
+
+		if (kthread_should_stop())
+			return;
+		compact_zone(zone, &cc);
+
+		count_compact_events(KCOMPACTD_MIGRATE_SCANNED,
+				     cc.total_migrate_scanned);
+		count_compact_events(KCOMPACTD_FREE_SCANNED,
+				     cc.total_free_scanned);
+
+		VM_BUG_ON(!list_empty(&cc.freepages));
+		VM_BUG_ON(!list_empty(&cc.migratepages));
+	}
+}
+
 static inline bool kcompactd_work_requested(pg_data_t *pgdat)
 {
 	return pgdat->kcompactd_max_order > 0 || kthread_should_stop();
@@ -2026,6 +2174,8 @@ static int kcompactd(void *p)
 {
 	pg_data_t *pgdat = (pg_data_t*)p;
 	struct task_struct *tsk = current;
+	unsigned long proactive_next = jiffies;
+	unsigned int proactive_defer = 0;
 
 	const struct cpumask *cpumask = cpumask_of_node(pgdat->node_id);
 
@@ -2038,11 +2188,34 @@ static int kcompactd(void *p)
 	pgdat->kcompactd_classzone_idx = pgdat->nr_zones - 1;
 
 	while (!kthread_should_stop()) {
+		long timeout = msecs_to_jiffies(HPAGE_FRAG_CHECK_INTERVAL_MSEC);
+		unsigned long start, score;
+
 		trace_mm_compaction_kcompactd_sleep(pgdat->node_id);
-		wait_event_freezable(pgdat->kcompactd_wait,
-				kcompactd_work_requested(pgdat));
+		if (wait_event_freezable_timeout(pgdat->kcompactd_wait,
+				kcompactd_work_requested(pgdat), timeout)) {
+			kcompactd_do_work(pgdat);
+			continue;
+		}
+
+		/* the check interval passed with no request, look ahead */
+		if (proactive_defer) {
+			proactive_defer--;
+			continue;
+		}
+		if (time_before(jiffies, proactive_next) ||
+		    !should_proactive_compact_node(pgdat))
+			continue;
+
+		start = jiffies;
+		score = fragmentation_score_node(pgdat);
+		proactive_compact_node(pgdat);
+		proactive_next = jiffies +
+			(jiffies - start) * (PROACTIVE_CPU_BUDGET_RATIO - 1);
 
-		kcompactd_do_work(pgdat);
+		/* back off for a while if compaction did not help */
+		if (fragmentation_score_node(pgdat) >= score)
+			proactive_defer = 1 << COMPACT_MAX_DEFER_SHIFT;
 	}
 
 	return 0;
@@ -0,0 +1,894 @@
+/*
+ * Data access monitor
+ *
+ * Samples how often the regions of the address spaces of chosen processes
+ * are accessed, with the idle page flag of one page per region, and adapts
+ * the regions to the access pattern.  See include/linux/damon.h.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define pr_fmt(fmt) "damon: " fmt
+
+#include <linux/damon.h>
+#include <linux/debugfs.h>
+#include <linux/delay.h>
+#include <linux/kthread.h>
+#include <linux/mm.h>
+#include <linux/page_idle.h>
+#include <linux/random.h>
+#include <linux/sched/mm.h>
+#include <linux/sched/task.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/uaccess.h>
+
+#define CREATE_TRACE_POINTS
+#include <trace/events/damon.h>
+
+/* The regions are at least a page, and page aligned */
+#define MIN_REGION	PAGE_SIZE
+
+static unsigned long sz_range(struct damon_addr_range *ar)
+{
+	return ar->end - ar->start;
+}
+
+static struct damon_region *damon_new_region(unsigned long start,
+					     unsigned long end)
+{
+	struct damon_region *r;
+
+	r = kmalloc(sizeof(*r), GFP_KERNEL);
+	if (!r)
+		return NULL;
+
+	r->ar.start = start;
+	r->ar.end = end;
+	r->sampling_addr = start;
+	r->nr_accesses = 0;
+	INIT_LIST_HEAD(&r->list);
+	return r;
+}
+
+static void damon_destroy_region(struct damon_region *r)
+{
+	list_del(&r->list);
+	kfree(r);
+}
+
+static void damon_destroy_regions(struct damon_task *t)
+{
+	struct damon_region *r, *next;
+
+	list_for_each_entry_safe(r, next, &t->regions_list, list)
+		damon_destroy_region(r);
+}
+
+static unsigned int damon_nr_regions(struct damon_task *t)
+{
+	struct damon_region *r;
+	unsigned int nr = 0;
+
+	damon_for_each_region(r, t)
+		nr++;
+	return nr;
+}
+
+/* Inserts @new in the regions of @t, which it does not overlap */
+static void damon_insert_region(struct damon_task *t, struct damon_region *new)
+{
+	struct damon_region *r;
+
+	damon_for_each_region(r, t) {
+		if (r->ar.start >= new->ar.end) {
+			list_add_tail(&new->list, &r->list);
+			return;
+		}
+	}
+	list_add_tail(&new->list, &t->regions_list);
+}
+
+/* Splits @r at @addr, the upper part going right after it in the list */
+static int damon_split_region_at(struct damon_region *r, unsigned long addr)
+{
+	struct damon_region *new;
+
+	new = damon_new_region(addr, r->ar.end);
+	if (!new)
+		return -ENOMEM;
+
+	new->nr_accesses = r->nr_accesses;
+	r->ar.end = addr;
+	list_add(&new->list, &r->list);
+	return 0;
+}
+
+static void damon_split_region_evenly(struct damon_region *r,
+				      unsigned int nr_pieces)
+{
+	unsigned long sz_piece;
+
+	sz_piece = ALIGN_DOWN(sz_range(&r->ar) / nr_pieces, MIN_REGION);
+	if (!sz_piece)
+		return;
+
+	while (--nr_pieces && sz_range(&r->ar) > sz_piece) {
+		if (damon_split_region_at(r, r->ar.start + sz_piece))
+			return;
+		r = list_next_entry(r, list);
+	}
+}
+
+static struct mm_struct *damon_get_mm(struct damon_task *t)
+{
+	struct task_struct *task;
+	struct mm_struct *mm;
+
+	task = get_pid_task(t->pid, PIDTYPE_PID);
+	if (!task)
+		return NULL;
+
+	mm = get_task_mm(task);
+	put_task_struct(task);
+	return mm;
+}
+
+/*
+ * Most of an address space is in the gap between the heap and the mmap
+ * area and in the gap between the mmap area and the stack, which are never
+ * accessed.  The regions are kept within the three ranges of mappings which
+ * these two biggest gaps leave.
+ */
+static int damon_three_regions_of(struct damon_task *t,
+				  struct damon_addr_range regions[3])
+{
+	struct damon_addr_range gap, first_gap = {0}, second_gap = {0};
+	struct vm_area_struct *vma, *prev = NULL;
+	struct mm_struct *mm;
+	unsigned long start = 0;
+
+	mm = damon_get_mm(t);
+	if (!mm)
+		return -ESRCH;
+
+	down_read(&mm->mmap_sem);
+	for (vma = mm->mmap; vma; prev = vma, vma = vma->vm_next) {
+		if (!prev) {
+			start = vma->vm_start;
+			continue;
+		}
+		gap.start = prev->vm_end;
+		gap.end = vma->vm_start;
+		if (sz_range(&gap) > sz_range(&second_gap)) {
+			swap(gap, second_gap);
+			if (sz_range(&second_gap) > sz_range(&first_gap))
+				swap(second_gap, first_gap);
+		}
+	}
+	up_read(&mm->mmap_sem);
+
+	if (!sz_range(&second_gap)) {
+		mmput(mm);
+		return -EINVAL;
+	}
+
+	if (first_gap.start > second_gap.start)
+		swap(first_gap, second_gap);
+
+	regions[0].start = start;
+	regions[0].end = first_gap.start;
+	regions[1].start = first_gap.end;
+	regions[1].end = second_gap.start;
+	regions[2].start = second_gap.end;
+	regions[2].end = prev->vm_end;
+	mmput(mm);
+	return 0;
+}
+
+static void kdamond_init_regions(struct damon_ctx *ctx)
+{
+	struct damon_addr_range regions[3];
+	struct damon_region *r;
+	struct damon_task *t;
+	int i;
+
+	damon_for_each_task(t, ctx) {
+		if (damon_three_regions_of(t, regions))
+			continue;
+
+		for (i = 0; i < 3; i++) {
+			r = damon_new_region(regions[i].start, regions[i].end);
+			if (!r)
+				break;
+			list_add_tail(&r->list, &t->regions_list);
+			damon_split_region_evenly(r,
+					DIV_ROUND_UP(ctx->min_nr_regions, 3));
+		}
+	}
+}
+
+static bool damon_intersect(struct damon_region *r, struct damon_addr_range *ar)
+{
+	return r->ar.start < ar->end && ar->start < r->ar.end;
+}
+
+/*
+ * Fits the regions of @t to the three ranges: the regions out of them go,
+ * the first and last regions of a range are stretched up to its ends, and
+ * a range which no region overlaps gets a new one.
+ */
+static void damon_apply_three_regions(struct damon_task *t,
+				      struct damon_addr_range regions[3])
+{
+	struct damon_region *r, *next;
+	int i;
+
+	list_for_each_entry_safe(r, next, &t->regions_list, list) {
+		for (i = 0; i < 3; i++) {
+			if (damon_intersect(r, &regions[i]))
+				break;
+		}
+		if (i == 3)
+			damon_destroy_region(r);
+	}
+
+	for (i = 0; i < 3; i++) {
+		struct damon_region *first = NULL, *last = NULL;
+
+		damon_for_each_region(r, t) {
+			if (damon_intersect(r, &regions[i])) {
+				if (!first)
+					first = r;
+				last = r;
+			}
+			if (r->ar.start >= regions[i].end)
+				break;
+		}
+
+		if (first) {
+			first->ar.start = regions[i].start;
+			last->ar.end = regions[i].end;
+			continue;
+		}
+
+		r = damon_new_region(regions[i].start, regions[i].end);
+		if (r)
+			damon_insert_region(t, r);
+	}
+}
+
+static void kdamond_update_regions(struct damon_ctx *ctx)
+{
+	struct damon_addr_range regions[3];
+	struct damon_task *t;
+
+	damon_for_each_task(t, ctx) {
+		if (!damon_three_regions_of(t, regions))
+			damon_apply_three_regions(t, regions);
+	}
+}
+
+/*
+ * Returns the page mapped at @addr in @mm, with a reference, if it is a
+ * user page the idle flag can be tracked for.
+ */
+static struct page *damon_get_page(struct mm_struct *mm, unsigned long addr)
+{
+	struct vm_area_struct *vma;
+	struct page *page = NULL;
+
+	down_read(&mm->mmap_sem);
+	vma = find_vma(mm, addr);
+	if (vma && vma->vm_start <= addr)
+		page = follow_page(vma, addr, FOLL_GET);
+	up_read(&mm->mmap_sem);
+
+	if (IS_ERR_OR_NULL(page))
+		return NULL;
+
+	/* the reference of a subpage is the head's */
+	page = compound_head(page);
+	if (!PageLRU(page)) {
+		put_page(page);
+		return NULL;
+	}
+	return page;
+}
+
+static void damon_mkold(struct mm_struct *mm, unsigned long addr)
+{
+	struct page *page = damon_get_page(mm, addr);
+
+	if (!page)
+		return;
+
+	page_idle_clear_pte_refs(page);
+	set_page_idle(page);
+	put_page(page);
+}
+
+static bool damon_young(struct mm_struct *mm, unsigned long addr)
+{
+	struct page *page = damon_get_page(mm, addr);
+	bool young;
+
+	if (!page)
+		return false;
+
+	page_idle_clear_pte_refs(page);
+	young = !page_is_idle(page);
+	put_page(page);
+	return young;
+}
+
+/* Returns a random page aligned address of @r */
+static unsigned long damon_rand_addr(struct damon_region *r)
+{
+	unsigned long nr_pages = sz_range(&r->ar) >> PAGE_SHIFT;
+
+	return r->ar.start + ((unsigned long)prandom_u32_max(nr_pages) <<
+			      PAGE_SHIFT);
+}
+
+static void kdamond_prepare_access_checks(struct damon_ctx *ctx)
+{
+	struct damon_region *r;
+	struct damon_task *t;
+	struct mm_struct *mm;
+
+	damon_for_each_task(t, ctx) {
+		mm = damon_get_mm(t);
+		if (!mm)
+			continue;
+		damon_for_each_region(r, t) {
+			r->sampling_addr = damon_rand_addr(r);
+			damon_mkold(mm, r->sampling_addr);
+		}
+		mmput(mm);
+	}
+}
+
+/* Returns the highest access count of the regions */
+static unsigned int kdamond_check_accesses(struct damon_ctx *ctx)
+{
+	unsigned int max_nr_accesses = 0;
+	struct damon_region *r;
+	struct damon_task *t;
+	struct mm_struct *mm;
+
+	damon_for_each_task(t, ctx) {
+		mm = damon_get_mm(t);
+		if (!mm)
+			continue;
+		damon_for_each_region(r, t) {
+			if (damon_young(mm, r->sampling_addr))
+				r->nr_accesses++;
+			max_nr_accesses = max(r->nr_accesses, max_nr_accesses);
+		}
+		mmput(mm);
+	}
+	return max_nr_accesses;
+}
+
+/* @l takes @r over, with the access count averaged over both */
+static void damon_merge_two_regions(struct damon_region *l,
+				    struct damon_region *r)
+{
+	unsigned long l_pages = sz_range(&l->ar) >> PAGE_SHIFT;
+	unsigned long r_pages = sz_range(&r->ar) >> PAGE_SHIFT;
+
+	l->nr_accesses = (l->nr_accesses * l_pages +
+			  r->nr_accesses * r_pages) / (l_pages + r_pages);
+	l->ar.end = r->ar.end;
+	damon_destroy_region(r);
+}
+
+/* Merges the adjacent regions whose access counts differ by @thres at most */
+static void kdamond_merge_regions(struct damon_ctx *ctx, unsigned int thres)
+{
+	struct damon_region *r, *prev, *next;
+	struct damon_task *t;
+
+	damon_for_each_task(t, ctx) {
+		prev = NULL;
+		list_for_each_entry_safe(r, next, &t->regions_list, list) {
+			if (prev && prev->ar.end == r->ar.start &&
+			    abs((int)prev->nr_accesses -
+				(int)r->nr_accesses) <= thres) {
+				damon_merge_two_regions(prev, r);
+				continue;
+			}
+			prev = r;
+		}
+	}
+}
+
+/*
+ * Splits each region in two at random, unless that would make too many of
+ * them, so that a region of uneven accesses is found out by the next merge.
+ */
+static void kdamond_split_regions(struct damon_ctx *ctx)
+{
+	struct damon_region *r, *next;
+	struct damon_task *t;
+	unsigned long nr_regions = 0;
+
+	damon_for_each_task(t, ctx)
+		nr_regions += damon_nr_regions(t);
+	if (nr_regions > ctx->max_nr_regions / 2)
+		return;
+
+	damon_for_each_task(t, ctx) {
+		list_for_each_entry_safe(r, next, &t->regions_list, list) {
+			unsigned long sz_left;
+
+			sz_left = ALIGN_DOWN(sz_range(&r->ar) / 10 *
+					     (prandom_u32_max(9) + 1),
+					     MIN_REGION);
+			if (!sz_left || sz_left >= sz_range(&r->ar))
+				continue;
+			if (damon_split_region_at(r, r->ar.start + sz_left))
+				return;
+		}
+	}
+}
+
+static void kdamond_reset_aggregated(struct damon_ctx *ctx)
+{
+	struct damon_region *r;
+	struct damon_task *t;
+
+	damon_for_each_task(t, ctx) {
+		unsigned int nr = damon_nr_regions(t);
+
+		damon_for_each_region(r, t) {
+			trace_damon_aggregated(t, r, nr);
+			r->nr_accesses = 0;
+		}
+	}
+}
+
+/* Returns whether @interval passed since @last, @last moving on if so */
+static bool damon_check_interval(ktime_t *last, unsigned long interval)
+{
+	ktime_t now = ktime_get();
+
+	if (ktime_us_delta(now, *last) < interval)
+		return false;
+	*last = now;
+	return true;
+}
+
+/* Stops when asked to, or once all the targets are gone */
+static bool kdamond_need_stop(struct damon_ctx *ctx)
+{
+	struct task_struct *task;
+	struct damon_task *t;
+
+	if (READ_ONCE(ctx->kdamond_stop))
+		return true;
+
+	damon_for_each_task(t, ctx) {
+		task = get_pid_task(t->pid, PIDTYPE_PID);
+		if (task) {
+			put_task_struct(task);
+			return false;
+		}
+	}
+	return true;
+}
+
+static int kdamond_fn(void *data)
+{
+	struct damon_ctx *ctx = data;
+	unsigned int max_nr_accesses;
+	struct damon_task *t;
+
+	kdamond_init_regions(ctx);
+	ctx->last_aggregation = ctx->last_regions_update = ktime_get();
+
+	while (!kdamond_need_stop(ctx)) {
+		kdamond_prepare_access_checks(ctx);
+		if (ctx->sample_cb)
+			ctx->sample_cb(ctx);
+
+		usleep_range(ctx->sample_interval, ctx->sample_interval + 1);
+
+		max_nr_accesses = kdamond_check_accesses(ctx);
+		if (damon_check_interval(&ctx->last_aggregation,
+					 ctx->aggr_interval)) {
+			kdamond_merge_regions(ctx, max_nr_accesses / 10);
+			if (ctx->aggregate_cb)
+				ctx->aggregate_cb(ctx);
+			kdamond_reset_aggregated(ctx);
+			kdamond_split_regions(ctx);
+		}
+
+		if (damon_check_interval(&ctx->last_regions_update,
+					 ctx->regions_update_interval))
+			kdamond_update_regions(ctx);
+	}
+
+	damon_for_each_task(t, ctx)
+		damon_destroy_regions(t);
+
+	mutex_lock(&ctx->kdamond_lock);
+	ctx->kdamond = NULL;
+	mutex_unlock(&ctx->kdamond_lock);
+	return 0;
+}
+
+/**
+ * damon_start - start monitoring the targets of a context
+ * @ctx: the context
+ *
+ * Returns -EBUSY if the kdamond thread of @ctx already runs.
+ */
+int damon_start(struct damon_ctx *ctx)
+{
+	int err = -EBUSY;
+
+	mutex_lock(&ctx->kdamond_lock);
+	if (!ctx->kdamond) {
+		ctx->kdamond_stop = false;
+		ctx->kdamond = kthread_run(kdamond_fn, ctx, "kdamond");
+		err = PTR_ERR_OR_ZERO(ctx->kdamond);
+		if (err)
+			ctx->kdamond = NULL;
+	}
+	mutex_unlock(&ctx->kdamond_lock);
+
+	return err;
+}
+
+/**
+ * damon_stop - ask the kdamond thread of a context to stop
+ * @ctx: the context
+ *
+ * The thread stops at the end of its current sampling interval.  Returns
+ * -EPERM if it does not run.
+ */
+int damon_stop(struct damon_ctx *ctx)
+{
+	int err = -EPERM;
+
+	mutex_lock(&ctx->kdamond_lock);
+	if (ctx->kdamond) {
+		WRITE_ONCE(ctx->kdamond_stop, true);
+		err = 0;
+	}
+	mutex_unlock(&ctx->kdamond_lock);
+
+	return err;
+}
+
+static void damon_destroy_tasks(struct damon_ctx *ctx)
+{
+	struct damon_task *t, *next;
+
+	list_for_each_entry_safe(t, next, &ctx->tasks_list, list) {
+		damon_destroy_regions(t);
+		put_pid(t->pid);
+		list_del(&t->list);
+		kfree(t);
+	}
+}
+
+/**
+ * damon_set_pids - set the processes to monitor
+ * @ctx: the context, which must not be running
+ * @pids: the pids, in the pid namespace of the caller
+ * @nr_pids: the number of pids
+ *
+ * Replaces the targets of @ctx.  On an error, no target is left.
+ */
+int damon_set_pids(struct damon_ctx *ctx, int *pids, unsigned int nr_pids)
+{
+	struct damon_task *t;
+	unsigned int i;
+	int err = 0;
+
+	mutex_lock(&ctx->kdamond_lock);
+	if (ctx->kdamond) {
+		err = -EBUSY;
+		goto out;
+	}
+
+	damon_destroy_tasks(ctx);
+	for (i = 0; i < nr_pids; i++) {
+		t = kmalloc(sizeof(*t), GFP_KERNEL);
+		if (!t) {
+			err = -ENOMEM;
+			break;
+		}
+		t->pid = find_get_pid(pids[i]);
+		if (!t->pid) {
+			kfree(t);
+			err = -ESRCH;
+			break;
+		}
+		INIT_LIST_HEAD(&t->regions_list);
+		list_add_tail(&t->list, &ctx->tasks_list);
+	}
+	if (err)
+		damon_destroy_tasks(ctx);
+out:
+	mutex_unlock(&ctx->kdamond_lock);
+	return err;
+}
+
+/**
+ * damon_set_attrs - set the monitoring attributes of a context
+ * @ctx: the context, which must not be running
+ * @sample_int: the sampling interval, in microseconds
+ * @aggr_int: the aggregation interval, in microseconds
+ * @regions_update_int: the interval between updates of the regions to the
+ *			mappings of the targets, in microseconds
+ * @min_nr_reg: the minimum number of regions of a target
+ * @max_nr_reg: the maximum number of regions of all the targets
+ */
+int damon_set_attrs(struct damon_ctx *ctx, unsigned long sample_int,
+		    unsigned long aggr_int, unsigned long regions_update_int,
+		    unsigned long min_nr_reg, unsigned long max_nr_reg)
+{
+	int err = 0;
+
+	if (!sample_int || aggr_int < sample_int || min_nr_reg < 3 ||
+	    max_nr_reg < min_nr_reg)
+		return -EINVAL;
+
+	mutex_lock(&ctx->kdamond_lock);
+	if (ctx->kdamond) {
+		err = -EBUSY;
+	} else {
+		ctx->sample_interval = sample_int;
+		ctx->aggr_interval = aggr_int;
+		ctx->regions_update_interval = regions_update_int;
+		ctx->min_nr_regions = min_nr_reg;
+		ctx->max_nr_regions = max_nr_reg;
+	}
+	mutex_unlock(&ctx->kdamond_lock);
+
+	return err;
+}
+
+/**
+ * damon_new_ctx - allocate a monitoring context
+ *
+ * The context samples every 5ms, aggregates every 100ms and updates its
+ * regions every second, with 10 to 1000 regions.
+ */
+struct damon_ctx *damon_new_ctx(void)
+{
+	struct damon_ctx *ctx;
+
+	ctx = kzalloc(sizeof(*ctx), GFP_KERNEL);
+	if (!ctx)
+		return NULL;
+
+	ctx->sample_interval = 5 * USEC_PER_MSEC;
+	ctx->aggr_interval = 100 * USEC_PER_MSEC;
+	ctx->regions_update_interval = USEC_PER_SEC;
+	ctx->min_nr_regions = 10;
+	ctx->max_nr_regions = 1000;
+	mutex_init(&ctx->kdamond_lock);
+	INIT_LIST_HEAD(&ctx->tasks_list);
+	return ctx;
+}
+
+/**
+ * damon_destroy_ctx - free a monitoring context
+ * @ctx: the context, whose kdamond thread must have exited
+ */
+void damon_destroy_ctx(struct damon_ctx *ctx)
+{
+	if (WARN_ON_ONCE(ctx->kdamond))
+		return;
+
+	damon_destroy_tasks(ctx);
+	kfree(ctx);
+}
+
+#ifdef CONFIG_DEBUG_FS
+
+/*
+ * debugfs interface, in the damon directory:
+ *
+ * attrs	the sampling, aggregation and regions update intervals in
+ *		microseconds, then the minimum and maximum numbers of regions
+ * pids		the pids of the processes to monitor
+ * monitor_on	"on" or "off"
+ *
+ * attrs and pids can only be written while the monitor is off.
+ */
+static struct damon_ctx *damon_dbgfs_ctx;
+
+static char *user_input_str(const char __user *buf, size_t count, loff_t *ppos)
+{
+	if (*ppos)
+		return ERR_PTR(-EINVAL);
+	return memdup_user_nul(buf, count);
+}
+
+static ssize_t damon_attrs_read(struct file *file, char __user *buf,
+				size_t count, loff_t *ppos)
+{
+	struct damon_ctx *ctx = damon_dbgfs_ctx;
+	char kbuf[128];
+	int len;
+
+	mutex_lock(&ctx->kdamond_lock);
+	len = scnprintf(kbuf, sizeof(kbuf), "%lu %lu %lu %lu %lu\n",
+			ctx->sample_interval, ctx->aggr_interval,
+			ctx->regions_update_interval, ctx->min_nr_regions,
+			ctx->max_nr_regions);
+	mutex_unlock(&ctx->kdamond_lock);
+
+	return simple_read_from_buffer(buf, count, ppos, kbuf, len);
+}
+
+static ssize_t damon_attrs_write(struct file *file, const char __user *buf,
+				 size_t count, loff_t *ppos)
+{
+	unsigned long s, a, r, minr, maxr;
+	char *kbuf;
+	int err;
+
+	kbuf = user_input_str(buf, count, ppos);
+	if (IS_ERR(kbuf))
+		return PTR_ERR(kbuf);
+
+	if (sscanf(kbuf, "%lu %lu %lu %lu %lu", &s, &a, &r, &minr, &maxr) != 5)
+		err = -EINVAL;
+	else
+		err = damon_set_attrs(damon_dbgfs_ctx, s, a, r, minr, maxr);
+	kfree(kbuf);
+
+	return err ? err : count;
+}
+
+static ssize_t damon_pids_read(struct file *file, char __user *buf,
+			       size_t count, loff_t *ppos)
+{
+	struct damon_ctx *ctx = damon_dbgfs_ctx;
+	struct damon_task *t;
+	size_t size = 2;
+	ssize_t len = 0;
+	char *kbuf;
+
+	mutex_lock(&ctx->kdamond_lock);
+	damon_for_each_task(t, ctx)
+		size += 12;
+	kbuf = kmalloc(size, GFP_KERNEL);
+	if (!kbuf) {
+		mutex_unlock(&ctx->kdamond_lock);
+		return -ENOMEM;
+	}
+	damon_for_each_task(t, ctx)
+		len += scnprintf(kbuf + len, size - len, "%d ",
+				 pid_vnr(t->pid));
+	mutex_unlock(&ctx->kdamond_lock);
+
+	if (len)
+		len--;
+	len += scnprintf(kbuf + len, size - len, "\n");
+	len = simple_read_from_buffer(buf, count, ppos, kbuf, len);
+	kfree(kbuf);
+	return len;
+}
+
+static ssize_t damon_pids_write(struct file *file, const char __user *buf,
+				size_t count, loff_t *ppos)
+{
+	unsigned int nr_pids = 0;
+	int pos = 0, parsed;
+	char *kbuf;
+	int *pids;
+	int err;
+
+	kbuf = user_input_str(buf, count, ppos);
+	if (IS_ERR(kbuf))
+		return PTR_ERR(kbuf);
+
+	/* a pid takes a digit and a separator at least */
+	pids = kmalloc_array(count / 2 + 1, sizeof(*pids), GFP_KERNEL);
+	if (!pids) {
+		kfree(kbuf);
+		return -ENOMEM;
+	}
+	while (sscanf(kbuf + pos, "%d%n", &pids[nr_pids], &parsed) == 1) {
+		nr_pids++;
+		pos += parsed;
+	}
+
+	err = damon_set_pids(damon_dbgfs_ctx, pids, nr_pids);
+	kfree(pids);
+	kfree(kbuf);
+
+	return err ? err : count;
+}
+
+static ssize_t damon_monitor_on_read(struct file *file, char __user *buf,
+				     size_t count, loff_t *ppos)
+{
+	struct damon_ctx *ctx = damon_dbgfs_ctx;
+	bool on;
+
+	mutex_lock(&ctx->kdamond_lock);
+	on = ctx->kdamond;
+	mutex_unlock(&ctx->kdamond_lock);
+
+	return simple_read_from_buffer(buf, count, ppos, on ? "on\n" : "off\n",
+				       on ? 3 : 4);
+}
+
+static ssize_t damon_monitor_on_write(struct file *file,
+				      const char __user *buf,
+				      size_t count, loff_t *ppos)
+{
+	char *kbuf;
+	int err;
+
+	kbuf = user_input_str(buf, count, ppos);
+	if (IS_ERR(kbuf))
+		return PTR_ERR(kbuf);
+
+	if (sysfs_streq(kbuf, "on"))
+		err = damon_start(damon_dbgfs_ctx);
+	else if (sysfs_streq(kbuf, "off"))
+		err = damon_stop(damon_dbgfs_ctx);
+	else
+		err = -EINVAL;
+	kfree(kbuf);
+
+	return err ? err : count;
+}
+
+static const struct file_operations damon_attrs_fops = {
+	.owner = THIS_MODULE,
+	.read = damon_attrs_read,
+	.write = damon_attrs_write,
+};
+
+static const struct file_operations damon_pids_fops = {
+	.owner = THIS_MODULE,
+	.read = damon_pids_read,
+	.write = damon_pids_write,
+};
+
+static const struct file_operations damon_monitor_on_fops = {
+	.owner = THIS_MODULE,
+	.read = damon_monitor_on_read,
+	.write = damon_monitor_on_write,
+};
+
+static int __init damon_debugfs_init(void)
+{
+	struct dentry *root;
+
+	damon_dbgfs_ctx = damon_new_ctx();
+	if (!damon_dbgfs_ctx)
+		return -ENOMEM;
+
+	root = debugfs_create_dir("damon", NULL);
+	if (!root ||
+	    !debugfs_create_file("attrs", 0600, root, NULL,
+				 &damon_attrs_fops) ||
+	    !debugfs_create_file("pids", 0600, root, NULL,
+				 &damon_pids_fops) ||
+	    !debugfs_create_file("monitor_on", 0600, root, NULL,
+				 &damon_monitor_on_fops)) {
+		pr_warn("failed to create the debugfs files\n");
+		debugfs_remove_recursive(root);
+		damon_destroy_ctx(damon_dbgfs_ctx);
+		damon_dbgfs_ctx = NULL;
+		return -ENOMEM;
+	}
+	return 0;
+}
+late_initcall(damon_debugfs_init);
+
+#endif /* CONFIG_DEBUG_FS */
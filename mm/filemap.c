@@ -36,6 +36,7 @@
 #include <linux/memcontrol.h>
 #include <linux/cleancache.h>
 #include <linux/rmap.h>
+#include <linux/psi.h>
 #include "internal.h"
 
 #define CREATE_TRACE_POINTS
@@ -118,6 +119,18 @@ static int page_cache_tree_insert(struct address_space *mapping,
 	void **slot;
 	int error;
 
+	/*
+	 * A large page takes one multi-order entry.  It only goes where
+	 * there is nothing at all, not even shadow entries.
+	 */
+	if (PageTransHuge(page) && mapping_large_pages(mapping)) {
+		error = __radix_tree_insert(&mapping->page_tree, page->index,
+					    compound_order(page), page);
+		if (!error)
+			mapping->nrpages += hpage_nr_pages(page);
+		return error;
+	}
+
 	error = __radix_tree_create(&mapping->page_tree, page->index, 0,
 				    &node, &slot);
 	if (error)
@@ -151,6 +164,12 @@ static void page_cache_tree_delete(struct address_space *mapping,
 	VM_BUG_ON_PAGE(PageTail(page), page);
 	VM_BUG_ON_PAGE(nr != 1 && shadow, page);
 
+	if (nr != 1 && mapping_large_pages(mapping)) {
+		radix_tree_delete_item(&mapping->page_tree, page->index, page);
+		mapping->nrpages -= nr;
+		return;
+	}
+
 	for (i = 0; i < nr; i++) {
 		struct radix_tree_node *node;
 		void **slot;
@@ -238,8 +257,10 @@ void __delete_from_page_cache(struct page *page, void *shadow)
 		__mod_node_page_state(page_pgdat(page), NR_SHMEM, -nr);
 		if (PageTransHuge(page))
 			__dec_node_page_state(page, NR_SHMEM_THPS);
-	} else {
-		VM_BUG_ON_PAGE(PageTransHuge(page), page);
+	} else if (PageTransHuge(page)) {
+		__dec_node_page_state(page, NR_FILE_THPS);
+		if (!mapping_large_pages(mapping))
+			filemap_nr_thps_dec(mapping);
 	}
 
 	/*
@@ -731,15 +752,18 @@ static int __add_to_page_cache_locked(struct page *page,
 				      void **shadowp)
 {
 	int huge = PageHuge(page);
+	bool compound = !huge && PageTransHuge(page);
+	int nr = huge ? 1 : hpage_nr_pages(page);
 	struct mem_cgroup *memcg;
 	int error;
 
 	VM_BUG_ON_PAGE(!PageLocked(page), page);
 	VM_BUG_ON_PAGE(PageSwapBacked(page), page);
+	VM_BUG_ON_PAGE(compound && !mapping_large_pages(mapping), page);
 
 	if (!huge) {
 		error = mem_cgroup_try_charge(page, current->mm,
-					      gfp_mask, &memcg, false);
+					      gfp_mask, &memcg, compound);
 		if (error)
 			return error;
 	}
@@ -747,11 +771,12 @@ static int __add_to_page_cache_locked(struct page *page,
 	error = radix_tree_maybe_preload(gfp_mask & ~__GFP_HIGHMEM);
 	if (error) {
 		if (!huge)
-			mem_cgroup_cancel_charge(page, memcg, false);
+			mem_cgroup_cancel_charge(page, memcg, compound);
 		return error;
 	}
 
-	get_page(page);
+	/* Like shmem, a huge page holds a reference for each subpage */
+	page_ref_add(page, nr);
 	page->mapping = mapping;
 	page->index = offset;
 
@@ -763,10 +788,12 @@ static int __add_to_page_cache_locked(struct page *page,
 
 	/* hugetlb pages do not participate in page cache accounting. */
 	if (!huge)
-		__inc_node_page_state(page, NR_FILE_PAGES);
+		__mod_node_page_state(page_pgdat(page), NR_FILE_PAGES, nr);
+	if (compound)
+		__inc_node_page_state(page, NR_FILE_THPS);
 	spin_unlock_irq(&mapping->tree_lock);
 	if (!huge)
-		mem_cgroup_commit_charge(page, memcg, false, false);
+		mem_cgroup_commit_charge(page, memcg, false, compound);
 	trace_mm_filemap_add_to_page_cache(page);
 	return 0;
 err_insert:
@@ -774,8 +801,8 @@ static int __add_to_page_cache_locked(struct page *page,
 	/* Leave page->index set: truncation relies upon it */
 	spin_unlock_irq(&mapping->tree_lock);
 	if (!huge)
-		mem_cgroup_cancel_charge(page, memcg, false);
-	put_page(page);
+		mem_cgroup_cancel_charge(page, memcg, compound);
+	page_ref_sub(page, nr);
 	return error;
 }
 
@@ -820,6 +847,7 @@ int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 		if (!(gfp_mask & __GFP_WRITE) &&
 		    shadow && workingset_refault(shadow)) {
 			SetPageActive(page);
+			SetPageWorkingset(page);
 			workingset_activation(page);
 		} else
 			ClearPageActive(page);
@@ -879,19 +907,6 @@ void __init pagecache_init(void)
 	page_writeback_init();
 }
 
-/* This has the same layout as wait_bit_key - see fs/cachefiles/rdwr.c */
-struct wait_page_key {
-	struct page *page;
-	int bit_nr;
-	int page_match;
-};
-
-struct wait_page_queue {
-	struct page *page;
-	int bit_nr;
-	wait_queue_entry_t wait;
-};
-
 static int wake_page_function(wait_queue_entry_t *wait, unsigned mode, int sync, void *arg)
 {
 	struct wait_page_key *key = arg;
@@ -978,8 +993,20 @@ static inline int wait_on_page_bit_common(wait_queue_head_t *q,
 {
 	struct wait_page_queue wait_page;
 	wait_queue_entry_t *wait = &wait_page.wait;
+	bool thrashing = false;
+	unsigned long pflags;
 	int ret = 0;
 
+	/*
+	 * Waiting for the read of a page that was recently evicted from
+	 * the working set is a stall due to lack of memory.
+	 */
+	if (bit_nr == PG_locked &&
+	    !PageUptodate(page) && PageWorkingset(page)) {
+		psi_memstall_enter(&pflags);
+		thrashing = true;
+	}
+
 	init_wait(wait);
 	wait->flags = lock ? WQ_FLAG_EXCLUSIVE : 0;
 	wait->func = wake_page_function;
@@ -1018,6 +1045,9 @@ static inline int wait_on_page_bit_common(wait_queue_head_t *q,
 
 	finish_wait(q, wait);
 
+	if (thrashing)
+		psi_memstall_leave(&pflags);
+
 	/*
 	 * A signal could leave PageWaiters set. Clearing it here if
 	 * !waitqueue_active would be possible (by open-coding finish_wait),
@@ -1183,6 +1213,54 @@ int __lock_page_killable(struct page *__page)
 }
 EXPORT_SYMBOL_GPL(__lock_page_killable);
 
+/*
+ * Queue @wait on @page, unless it is unlocked (or, with @lock, locked by us)
+ * by then: returns 0, or -EIOCBQUEUED if wait->wait.func is to be called
+ * once the page is unlocked.
+ */
+static int __wait_on_page_locked_async(struct page *page,
+				       struct wait_page_queue *wait, bool lock)
+{
+	wait_queue_head_t *q = page_waitqueue(page);
+	int ret;
+
+	wait->page = page;
+	wait->bit_nr = PG_locked;
+
+	spin_lock_irq(&q->lock);
+	__add_wait_queue_entry_tail(q, &wait->wait);
+	SetPageWaiters(page);
+	if (lock)
+		ret = !trylock_page(page);
+	else
+		ret = PageLocked(page);
+	/*
+	 * Still on the queue under its lock, so the wake function cannot have
+	 * been called yet and is not going to be.
+	 */
+	if (!ret)
+		__remove_wait_queue(q, &wait->wait);
+	else
+		ret = -EIOCBQUEUED;
+	spin_unlock_irq(&q->lock);
+	return ret;
+}
+
+static int wait_on_page_locked_async(struct page *page,
+				     struct wait_page_queue *wait)
+{
+	if (!PageLocked(page))
+		return 0;
+	return __wait_on_page_locked_async(compound_head(page), wait, false);
+}
+
+static int lock_page_async(struct page *page, struct wait_page_queue *wait)
+{
+	if (trylock_page(page))
+		return 0;
+	return __wait_on_page_locked_async(compound_head(page), wait, true);
+}
+
 /*
  * Return values:
  * 1 - page is locked; mmap_sem is still held.
@@ -1364,6 +1442,7 @@ struct page *find_get_entry(struct address_space *mapping, pgoff_t offset)
 			put_page(head);
 			goto repeat;
 		}
+		page = find_subpage(page, offset);
 	}
 out:
 	rcu_read_unlock();
@@ -1456,12 +1535,35 @@ struct page *pagecache_get_page(struct address_space *mapping, pgoff_t offset,
 		}
 
 		/* Has the page been truncated? */
-		if (unlikely(page->mapping != mapping)) {
+		if (unlikely(compound_head(page)->mapping != mapping)) {
 			unlock_page(page);
 			put_page(page);
 			goto repeat;
 		}
-		VM_BUG_ON_PAGE(page->index != offset, page);
+		VM_BUG_ON_PAGE(page_to_pgoff(page) != offset, page);
+	}
+
+	/*
+	 * Whoever may create the page means to write to it, or to attach
+	 * buffers: a large page is split for them first.
+	 */
+	if ((fgp_flags & (FGP_CREAT | FGP_WRITE)) &&
+	    PageTransCompound(page) && mapping_large_pages(mapping)) {
+		bool locked = fgp_flags & FGP_LOCK;
+		int err;
+
+		if (!locked)
+			lock_page(page);
+		err = split_huge_page(page);
+		if (!locked)
+			unlock_page(page);
+		if (err) {
+			if (locked)
+				unlock_page(page);
+			put_page(page);
+			cond_resched();
+			goto repeat;
+		}
 	}
 
 	if (page && (fgp_flags & FGP_ACCESSED))
@@ -1500,6 +1602,31 @@ struct page *pagecache_get_page(struct address_space *mapping, pgoff_t offset,
 }
 EXPORT_SYMBOL(pagecache_get_page);
 
+/*
+ * The radix tree walks find a large page once, at the start of its
+ * multi-order entry: hand out its subpages from @start to @end, as if
+ * they had entries of their own.  Each of them gets a reference, the
+ * first one the reference that the caller took on the page.  Returns
+ * the number of subpages, at most @nr.
+ */
+static unsigned int page_cache_subpages(struct page *head, pgoff_t start,
+		pgoff_t end, unsigned int nr, struct page **pages,
+		pgoff_t *indices)
+{
+	pgoff_t index = max(start, head->index);
+	unsigned int i;
+
+	end = min(end, head->index + HPAGE_PMD_NR - 1);
+	nr = min_t(pgoff_t, nr, end - index + 1);
+	for (i = 0; i < nr; i++) {
+		pages[i] = head + (index + i - head->index);
+		if (indices)
+			indices[i] = index + i;
+	}
+	page_ref_add(head, nr - 1);
+	return nr;
+}
+
 /**
  * find_get_entries - gang pagecache lookup
  * @mapping:	The address_space to search
@@ -1569,6 +1696,15 @@ unsigned find_get_entries(struct address_space *mapping,
 			put_page(head);
 			goto repeat;
 		}
+
+		if (mapping_large_pages(mapping) && PageTransHuge(page)) {
+			ret += page_cache_subpages(page, start, -1,
+					nr_entries - ret, entries + ret,
+					indices + ret);
+			if (ret == nr_entries)
+				break;
+			continue;
+		}
 export:
 		indices[ret] = iter.index;
 		entries[ret] = page;
@@ -1651,6 +1787,16 @@ unsigned find_get_pages_range(struct address_space *mapping, pgoff_t *start,
 			goto repeat;
 		}
 
+		if (mapping_large_pages(mapping) && PageTransHuge(page)) {
+			ret += page_cache_subpages(page, *start, end,
+					nr_pages - ret, pages + ret, NULL);
+			if (ret == nr_pages) {
+				*start = page_to_index(pages[ret - 1]) + 1;
+				goto out;
+			}
+			continue;
+		}
+
 		pages[ret] = page;
 		if (++ret == nr_pages) {
 			*start = pages[ret - 1]->index + 1;
@@ -1744,6 +1890,14 @@ unsigned find_get_pages_contig(struct address_space *mapping, pgoff_t index,
 			break;
 		}
 
+		if (mapping_large_pages(mapping) && PageTransHuge(page)) {
+			ret += page_cache_subpages(page, index, -1,
+					nr_pages - ret, pages + ret, NULL);
+			if (ret == nr_pages)
+				break;
+			continue;
+		}
+
 		pages[ret] = page;
 		if (++ret == nr_pages)
 			break;
@@ -1963,7 +2117,7 @@ static ssize_t generic_file_buffered_read(struct kiocb *iocb,
 
 	for (;;) {
 		struct page *page;
-		pgoff_t end_index;
+		pgoff_t end_index, last;
 		loff_t isize;
 		unsigned long nr, ret;
 
@@ -1976,14 +2130,18 @@ static ssize_t generic_file_buffered_read(struct kiocb *iocb,
 
 		page = find_get_page(mapping, index);
 		if (!page) {
-			if (iocb->ki_flags & IOCB_NOWAIT)
+			if ((iocb->ki_flags & (IOCB_NOWAIT | IOCB_WAITQ)) ==
+			    IOCB_NOWAIT)
 				goto would_block;
 			page_cache_sync_readahead(mapping,
 					ra, filp,
 					index, last_index - index);
 			page = find_get_page(mapping, index);
-			if (unlikely(page == NULL))
+			if (unlikely(page == NULL)) {
+				if (iocb->ki_flags & IOCB_NOWAIT)
+					goto would_block;
 				goto no_cached_page;
+			}
 		}
 		if (PageReadahead(page)) {
 			page_cache_async_readahead(mapping,
@@ -1991,7 +2149,8 @@ static ssize_t generic_file_buffered_read(struct kiocb *iocb,
 					index, last_index - index);
 		}
 		if (!PageUptodate(page)) {
-			if (iocb->ki_flags & IOCB_NOWAIT) {
+			if ((iocb->ki_flags & (IOCB_NOWAIT | IOCB_WAITQ)) ==
+			    IOCB_NOWAIT) {
 				put_page(page);
 				goto would_block;
 			}
@@ -2000,8 +2159,20 @@ static ssize_t generic_file_buffered_read(struct kiocb *iocb,
 			 * See comment in do_read_cache_page on why
 			 * wait_on_page_locked is used to avoid unnecessarily
 			 * serialisations and why it's safe.
+			 *
+			 * With IOCB_WAITQ, what was copied is returned first,
+			 * the caller then retries with nothing written.
 			 */
-			error = wait_on_page_locked_killable(page);
+			if (iocb->ki_flags & IOCB_WAITQ) {
+				if (written) {
+					put_page(page);
+					goto out;
+				}
+				error = wait_on_page_locked_async(page,
+							iocb->ki_waitq);
+			} else {
+				error = wait_on_page_locked_killable(page);
+			}
 			if (unlikely(error))
 				goto readpage_error;
 			if (PageUptodate(page))
@@ -2016,7 +2187,7 @@ static ssize_t generic_file_buffered_read(struct kiocb *iocb,
 			if (!trylock_page(page))
 				goto page_not_up_to_date;
 			/* Did it get truncated before we got the lock? */
-			if (!page->mapping)
+			if (!compound_head(page)->mapping)
 				goto page_not_up_to_date_locked;
 			if (!mapping->a_ops->is_partially_uptodate(page,
 							offset, iter->count))
@@ -2040,14 +2211,27 @@ static ssize_t generic_file_buffered_read(struct kiocb *iocb,
 			goto out;
 		}
 
-		/* nr is the maximum number of bytes to copy from this page */
-		nr = PAGE_SIZE;
-		if (index == end_index) {
+		/*
+		 * nr is the maximum number of bytes to copy from this page.
+		 * The rest of a large page goes at once, when it is in the
+		 * kernel mapping and needs no flush_dcache_page(), and not
+		 * into a pipe, whose buffers take one page at most.
+		 */
+		last = index;
+		if (PageTransCompound(page) && !PageHighMem(page) &&
+		    !mapping_writably_mapped(mapping) &&
+		    !(iter->type & ITER_PIPE))
+			last = compound_head(page)->index + HPAGE_PMD_NR - 1;
+		if (last >= end_index) {
+			last = end_index;
 			nr = ((isize - 1) & ~PAGE_MASK) + 1;
-			if (nr <= offset) {
-				put_page(page);
-				goto out;
-			}
+		} else {
+			nr = PAGE_SIZE;
+		}
+		nr += (last - index) << PAGE_SHIFT;
+		if (nr <= offset) {
+			put_page(page);
+			goto out;
 		}
 		nr = nr - offset;
 
@@ -2089,13 +2273,16 @@ static ssize_t generic_file_buffered_read(struct kiocb *iocb,
 
 page_not_up_to_date:
 		/* Get exclusive access to the page ... */
-		error = lock_page_killable(page);
+		if (iocb->ki_flags & IOCB_WAITQ)
+			error = lock_page_async(page, iocb->ki_waitq);
+		else
+			error = lock_page_killable(page);
 		if (unlikely(error))
 			goto readpage_error;
 
 page_not_up_to_date_locked:
 		/* Did it get truncated before we got the lock? */
-		if (!page->mapping) {
+		if (!compound_head(page)->mapping) {
 			unlock_page(page);
 			put_page(page);
 			continue;
@@ -2108,6 +2295,11 @@ static ssize_t generic_file_buffered_read(struct kiocb *iocb,
 		}
 
 readpage:
+		if (iocb->ki_flags & IOCB_NOWAIT) {
+			unlock_page(page);
+			put_page(page);
+			goto would_block;
+		}
 		/*
 		 * A previous I/O error may have been due to temporary
 		 * failures, eg. multipath errors.
@@ -2131,7 +2323,7 @@ static ssize_t generic_file_buffered_read(struct kiocb *iocb,
 			if (unlikely(error))
 				goto readpage_error;
 			if (!PageUptodate(page)) {
-				if (page->mapping == NULL) {
+				if (compound_head(page)->mapping == NULL) {
 					/*
 					 * invalidate_mapping_pages got it
 					 */
@@ -2422,7 +2614,7 @@ int filemap_fault(struct vm_fault *vmf)
 	}
 
 	/* Did it get truncated? */
-	if (unlikely(page->mapping != mapping)) {
+	if (unlikely(compound_head(page)->mapping != mapping)) {
 		unlock_page(page);
 		put_page(page);
 		goto retry_find;
@@ -2507,6 +2699,7 @@ void filemap_map_pages(struct vm_fault *vmf,
 	struct file *file = vmf->vma->vm_file;
 	struct address_space *mapping = file->f_mapping;
 	pgoff_t last_pgoff = start_pgoff;
+	pgoff_t index, last;
 	unsigned long max_idx;
 	struct page *head, *page;
 
@@ -2550,22 +2743,39 @@ void filemap_map_pages(struct vm_fault *vmf,
 		if (!trylock_page(page))
 			goto skip;
 
-		if (page->mapping != mapping || !PageUptodate(page))
+		/* the tail pages of a huge page have no ->mapping or ->index */
+		if (compound_head(page)->mapping != mapping ||
+		    !PageUptodate(page))
 			goto unlock;
 
 		max_idx = DIV_ROUND_UP(i_size_read(mapping->host), PAGE_SIZE);
-		if (page->index >= max_idx)
+		if (iter.index >= max_idx)
 			goto unlock;
 
 		if (file->f_ra.mmap_miss > 0)
 			file->f_ra.mmap_miss--;
 
-		vmf->address += (iter.index - last_pgoff) << PAGE_SHIFT;
-		if (vmf->pte)
-			vmf->pte += iter.index - last_pgoff;
-		last_pgoff = iter.index;
-		if (alloc_set_pte(vmf, NULL, page))
-			goto unlock;
+		/* The subpages of a large page in the range, one at a time */
+		index = iter.index;
+		last = iter.index;
+		if (mapping_large_pages(mapping) && PageTransHuge(page)) {
+			index = max(start_pgoff, iter.index);
+			last = min3(end_pgoff, max_idx - 1,
+				    iter.index + HPAGE_PMD_NR - 1);
+			page_ref_add(head, last - index);
+		}
+		for (; index <= last; index++) {
+			vmf->address += (index - last_pgoff) << PAGE_SHIFT;
+			if (vmf->pte)
+				vmf->pte += index - last_pgoff;
+			last_pgoff = index;
+			if (alloc_set_pte(vmf, NULL, find_subpage(page, index)))
+				put_page(head);
+			else if (pmd_trans_huge(*vmf->pmd))
+				break;
+		}
+		if (index < last)
+			page_ref_sub(head, last - index);
 		unlock_page(page);
 		goto next;
 unlock:
@@ -13,6 +13,10 @@
 #include <linux/sched/signal.h>
 #include <linux/rwsem.h>
 #include <linux/hugetlb.h>
+#include <linux/kthread.h>
+#include <linux/cpuset.h>
+#include <linux/cgroup.h>
+#include <linux/userfaultfd_k.h>
 
 #include <asm/mmu_context.h>
 #include <asm/pgtable.h>
@@ -236,7 +240,9 @@ static struct page *follow_pmd_mask(struct vm_area_struct *vma,
 	}
 retry:
 	if (!pmd_present(*pmd)) {
-		if (likely(!(flags & FOLL_MIGRATION)))
+		/* a pmd swap entry is faulted in by the caller */
+		if (likely(!(flags & FOLL_MIGRATION)) ||
+		    is_pmd_swap_entry(*pmd))
 			return no_page_table(vma, flags);
 		VM_BUG_ON(thp_migration_supported() &&
 				  !is_pmd_migration_entry(*pmd));
@@ -261,7 +267,8 @@ static struct page *follow_pmd_mask(struct vm_area_struct *vma,
 	ptl = pmd_lock(mm, pmd);
 	if (unlikely(!pmd_present(*pmd))) {
 		spin_unlock(ptl);
-		if (likely(!(flags & FOLL_MIGRATION)))
+		if (likely(!(flags & FOLL_MIGRATION)) ||
+		    is_pmd_swap_entry(*pmd))
 			return no_page_table(vma, flags);
 		pmd_migration_entry_wait(mm, pmd);
 		goto retry_locked;
@@ -1095,6 +1102,182 @@ long get_user_pages(unsigned long start, unsigned long nr_pages,
 }
 EXPORT_SYMBOL(get_user_pages);
 
+/*
+ * @page was just pinned at @address.  If it is part of a huge page which is
+ * mapped whole by the same page table entry, pins the next subpages of that
+ * mapping, up to @max of them, with a single reference count update, and
+ * returns how many were pinned that way.
+ */
+static unsigned long gup_huge_extent(struct vm_area_struct *vma,
+		unsigned long address, struct page *page, unsigned long max,
+		unsigned int gup_flags)
+{
+	struct page *head = compound_head(page);
+	unsigned long subpage = page_to_pfn(page) - page_to_pfn(head);
+	unsigned long nr = 0;
+
+	if (!max || !PageCompound(page))
+		return 0;
+
+	if (is_vm_hugetlb_page(vma)) {
+		/* hugetlb pages are only ever mapped whole */
+		nr = (1UL << compound_order(head)) - subpage - 1;
+	} else {
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+		struct mm_struct *mm = vma->vm_mm;
+		spinlock_t *ptl;
+		pgd_t *pgd;
+		p4d_t *p4d;
+		pud_t *pud;
+		pmd_t *pmd;
+
+		pgd = pgd_offset(mm, address);
+		if (!pgd_present(*pgd))
+			return 0;
+		p4d = p4d_offset(pgd, address);
+		if (!p4d_present(*p4d))
+			return 0;
+		pud = pud_offset(p4d, address);
+		if (!pud_present(*pud) || pud_huge(*pud))
+			return 0;
+		pmd = pmd_offset(pud, address);
+
+		ptl = pmd_lock(mm, pmd);
+		if (pmd_trans_huge(*pmd) && pmd_page(*pmd) == head &&
+		    (!(gup_flags & FOLL_WRITE) || pmd_write(*pmd)))
+			nr = HPAGE_PMD_NR - subpage - 1;
+		spin_unlock(ptl);
+#endif
+	}
+
+	nr = min(nr, max);
+	if (nr)
+		page_ref_add(head, nr);
+	return nr;
+}
+
+static long __get_user_page_ranges(struct task_struct *tsk,
+		struct mm_struct *mm, unsigned long start,
+		unsigned long nr_pages, unsigned int gup_flags,
+		struct page_range *ranges, unsigned long *nr_ranges)
+{
+	unsigned long max_ranges = *nr_ranges;
+	struct page_range *range = NULL;
+	long pinned = 0;
+
+	*nr_ranges = 0;
+	if (!max_ranges)
+		return 0;
+
+	while (nr_pages) {
+		struct vm_area_struct *vma;
+		struct page_range run;
+		long ret;
+
+		ret = __get_user_pages(tsk, mm, start, 1, gup_flags | FOLL_GET,
+				       &run.page, &vma, NULL);
+		if (ret <= 0)
+			return pinned ? pinned : ret;
+
+		run.nr_pages = 1 + gup_huge_extent(vma, start, run.page,
+						   nr_pages - 1, gup_flags);
+
+		if (range && page_to_pfn(run.page) ==
+			     page_to_pfn(range->page) + range->nr_pages) {
+			range->nr_pages += run.nr_pages;
+		} else if (*nr_ranges < max_ranges) {
+			range = &ranges[(*nr_ranges)++];
+			*range = run;
+		} else {
+			put_user_page_range(&run, false);
+			break;
+		}
+
+		pinned += run.nr_pages;
+		start += run.nr_pages << PAGE_SHIFT;
+		nr_pages -= run.nr_pages;
+	}
+
+	return pinned;
+}
+
+/**
+ * get_user_page_ranges_remote() - pin user pages as physically contiguous runs
+ * @tsk:	the task_struct to use for page fault accounting, or
+ *		NULL if faults are not to be recorded.
+ * @mm:		mm_struct of target mm
+ * @start:	starting user address
+ * @nr_pages:	number of pages from start to pin
+ * @gup_flags:	flags modifying lookup behaviour
+ * @ranges:	array receiving the runs of pinned pages
+ * @nr_ranges:	size of @ranges on entry, number of runs filled on return
+ *
+ * This is get_user_pages_remote() for callers which map the pages as
+ * ranges, such as scatterlists for DMA: the pinned pages are returned as
+ * runs of physically contiguous pages, and the transparent huge pages and
+ * hugetlb pages found are pinned whole with a single page table walk and a
+ * single reference count update, rather than one 4k page at a time.
+ *
+ * Returns the number of pages pinned, which may be fewer than requested
+ * when @ranges runs out, or -errno if none was.  The runs are released with
+ * put_user_page_range().  mmap_sem must be held, as for get_user_pages().
+ */
+long get_user_page_ranges_remote(struct task_struct *tsk, struct mm_struct *mm,
+		unsigned long start, unsigned long nr_pages,
+		unsigned int gup_flags, struct page_range *ranges,
+		unsigned long *nr_ranges)
+{
+	return __get_user_page_ranges(tsk, mm, start, nr_pages,
+				      gup_flags | FOLL_TOUCH | FOLL_REMOTE,
+				      ranges, nr_ranges);
+}
+EXPORT_SYMBOL(get_user_page_ranges_remote);
+
+/*
+ * This is the same as get_user_page_ranges_remote() for the current task
+ * and mm.
+ */
+long get_user_page_ranges(unsigned long start, unsigned long nr_pages,
+		unsigned int gup_flags, struct page_range *ranges,
+		unsigned long *nr_ranges)
+{
+	return __get_user_page_ranges(current, current->mm, start, nr_pages,
+				      gup_flags | FOLL_TOUCH, ranges,
+				      nr_ranges);
+}
+EXPORT_SYMBOL(get_user_page_ranges);
+
+/**
+ * put_user_page_range() - release a run of pages pinned by get_user_page_ranges
+ * @range:	the run of pages
+ * @dirty:	whether the pages were written to
+ *
+ * Drops the references of the pages of a compound page together.
+ */
+void put_user_page_range(struct page_range *range, bool dirty)
+{
+	unsigned long pfn = page_to_pfn(range->page);
+	unsigned long end = pfn + range->nr_pages;
+
+	while (pfn < end) {
+		struct page *page = pfn_to_page(pfn);
+		struct page *head = compound_head(page);
+		unsigned long nr = 1;
+
+		if (PageCompound(page))
+			nr = min(end, page_to_pfn(head) +
+				      (1UL << compound_order(head))) - pfn;
+
+		if (dirty && !PageDirty(head))
+			set_page_dirty_lock(head);
+		if (nr > 1)
+			page_ref_sub(head, nr - 1);
+		put_page(head);
+		pfn += nr;
+	}
+}
+EXPORT_SYMBOL(put_user_page_range);
+
 /**
  * populate_vma_page_range() -  populate a range of pages in the vma.
  * @vma:   target vma
@@ -1153,25 +1336,14 @@ long populate_vma_page_range(struct vm_area_struct *vma,
 				NULL, NULL, nonblocking);
 }
 
-/*
- * __mm_populate - populate and/or mlock pages within a range of address space.
- *
- * This is used to implement mlock() and the MAP_POPULATE / MAP_LOCKED mmap
- * flags. VMAs must be already marked with the desired vm_flags, and
- * mmap_sem must not be held.
- */
-int __mm_populate(unsigned long start, unsigned long len, int ignore_errors)
+static int populate_range(struct mm_struct *mm, unsigned long start,
+			  unsigned long end, int ignore_errors)
 {
-	struct mm_struct *mm = current->mm;
-	unsigned long end, nstart, nend;
+	unsigned long nstart, nend;
 	struct vm_area_struct *vma = NULL;
 	int locked = 0;
 	long ret = 0;
 
-	VM_BUG_ON(start & ~PAGE_MASK);
-	VM_BUG_ON(len != PAGE_ALIGN(len));
-	end = start + len;
-
 	for (nstart = start; nstart < end; nstart = nend) {
 		/*
 		 * We want to fault in pages for [nstart; end) address range.
@@ -1215,6 +1387,196 @@ int __mm_populate(unsigned long start, unsigned long len, int ignore_errors)
 	return ret;	/* 0 or negative error code */
 }
 
+/*
+ * Large ranges are populated in chunks by up to vm.populate_threads threads,
+ * spread over the nodes the caller allocates from, so that their pages, and
+ * the zeroing of their huge pages in particular, are shared by many CPUs.
+ * A chunk covers whole huge pages, each of which is zeroed by one thread.
+ *
+ * The threads join the cgroups of the caller and only run on the CPUs it
+ * may run on, so that they allocate and are charged as the caller would.
+ * They fault in a chunk by steps, stopping once the caller is killed.
+ */
+int sysctl_populate_threads __read_mostly = 1;
+
+#define POPULATE_CHUNK		(64UL << 20)
+#define POPULATE_STEP		(8UL << 20)
+
+struct populate_ctl {
+	struct mm_struct *mm;
+	struct task_struct *task;	/* which populates */
+	unsigned long start, end;
+	unsigned long base, chunk;	/* chunks are aligned on base */
+	int ignore_errors;
+	atomic_long_t next;		/* index of the next chunk */
+	atomic_t nr_running;
+	struct completion done;
+	int ret;
+};
+
+static int populate_workfn(void *arg)
+{
+	struct populate_ctl *ctl = arg;
+
+	while (!READ_ONCE(ctl->ret)) {
+		unsigned long idx = atomic_long_inc_return(&ctl->next) - 1;
+		unsigned long start = ctl->base + idx * ctl->chunk;
+		unsigned long end = min(start + ctl->chunk, ctl->end);
+		int ret = 0;
+
+		if (start >= ctl->end)
+			break;
+		for (start = max(start, ctl->start); start < end;
+		     start += POPULATE_STEP) {
+			if (fatal_signal_pending(ctl->task)) {
+				ret = -EINTR;
+				break;
+			}
+			ret = populate_range(ctl->mm, start,
+					     min(start + POPULATE_STEP, end),
+					     ctl->ignore_errors);
+			if (ret)
+				break;
+		}
+		if (ret)
+			cmpxchg(&ctl->ret, 0, ret);
+	}
+	if (atomic_dec_and_test(&ctl->nr_running))
+		complete(&ctl->done);
+	return 0;
+}
+
+/* Returns the chunk size for the range, or 0 if threads cannot populate it */
+static unsigned long populate_chunk(struct mm_struct *mm, unsigned long start,
+				    unsigned long end)
+{
+	unsigned long chunk = POPULATE_CHUNK;
+	struct vm_area_struct *vma;
+
+	down_read(&mm->mmap_sem);
+	for (vma = find_vma(mm, start); vma && vma->vm_start < end;
+	     vma = vma->vm_next) {
+		/* the userfaults of other threads would not be retried */
+		if (userfaultfd_missing(vma)) {
+			chunk = 0;
+			break;
+		}
+		chunk = max(chunk, vma_kernel_pagesize(vma));
+	}
+	up_read(&mm->mmap_sem);
+	return chunk;
+}
+
+/* Returns a thread to populate from node nid as current would, or NULL */
+static struct task_struct *populate_thread(struct populate_ctl *ctl, int nid,
+					   struct cpumask *cpumask)
+{
+	struct task_struct *t;
+
+	t = kthread_create_on_node(populate_workfn, ctl, nid, "kpopulate/%d",
+				   nid);
+	if (IS_ERR(t))
+		return NULL;
+	/* charged to the memcg, and allocating from the cpuset, of current */
+	if (cgroup_attach_task_all(current, t)) {
+		kthread_stop(t);
+		return NULL;
+	}
+	if (!cpumask_and(cpumask, cpumask_of_node(nid), &current->cpus_allowed))
+		cpumask_copy(cpumask, &current->cpus_allowed);
+	if (set_cpus_allowed_ptr(t, cpumask)) {
+		kthread_stop(t);
+		return NULL;
+	}
+	return t;
+}
+
+static int populate_parallel(struct mm_struct *mm, unsigned long start,
+			     unsigned long end, int ignore_errors)
+{
+	struct populate_ctl ctl = {
+		.mm = mm,
+		.task = current,
+		.start = start,
+		.end = end,
+		.ignore_errors = ignore_errors,
+		.next = ATOMIC_LONG_INIT(0),
+	};
+	unsigned long nr_chunks;
+	cpumask_var_t cpumask;
+	nodemask_t nodes;
+	int nr_threads, nid, i;
+
+	ctl.chunk = populate_chunk(mm, start, end);
+	if (!ctl.chunk)
+		return populate_range(mm, start, end, ignore_errors);
+	ctl.base = round_down(start, ctl.chunk);
+	nr_chunks = DIV_ROUND_UP(end - ctl.base, ctl.chunk);
+	nr_threads = min_t(unsigned long, READ_ONCE(sysctl_populate_threads),
+			   nr_chunks);
+	if (nr_threads < 2 || !alloc_cpumask_var(&cpumask, GFP_KERNEL))
+		return populate_range(mm, start, end, ignore_errors);
+
+	/* the threads allocate locally, on the nodes of the caller */
+	nodes_and(nodes, cpuset_current_mems_allowed, node_states[N_MEMORY]);
+	if (nodes_empty(nodes))
+		nodes = node_states[N_MEMORY];
+	nid = numa_node_id();
+
+	init_completion(&ctl.done);
+	atomic_set(&ctl.nr_running, nr_threads);
+	/* the caller is the last thread */
+	for (i = 1; i < nr_threads; i++) {
+		struct task_struct *t;
+
+		nid = next_node_in(nid, nodes);
+		t = populate_thread(&ctl, nid, cpumask);
+		if (!t) {
+			atomic_dec(&ctl.nr_running);
+			continue;
+		}
+		wake_up_process(t);
+	}
+	free_cpumask_var(cpumask);
+	populate_workfn(&ctl);
+	wait_for_completion(&ctl.done);
+	return ctl.ret;
+}
+
+static bool populate_may_parallel(unsigned long len)
+{
+	if (READ_ONCE(sysctl_populate_threads) < 2)
+		return false;
+	if (len < 2 * POPULATE_CHUNK)
+		return false;
+#ifdef CONFIG_NUMA
+	/* the threads would not allocate with the caller's policy */
+	if (current->mempolicy)
+		return false;
+#endif
+	return true;
+}
+
+/*
+ * __mm_populate - populate and/or mlock pages within a range of address space.
+ *
+ * This is used to implement mlock() and the MAP_POPULATE / MAP_LOCKED mmap
+ * flags. VMAs must be already marked with the desired vm_flags, and
+ * mmap_sem must not be held.
+ */
+int __mm_populate(unsigned long start, unsigned long len, int ignore_errors)
+{
+	struct mm_struct *mm = current->mm;
+
+	VM_BUG_ON(start & ~PAGE_MASK);
+	VM_BUG_ON(len != PAGE_ALIGN(len));
+
+	if (populate_may_parallel(len))
+		return populate_parallel(mm, start, start + len,
+					 ignore_errors);
+	return populate_range(mm, start, start + len, ignore_errors);
+}
+
 /**
  * get_dump_page() - pin user page in memory while writing it to core dump
  * @addr: user address
@@ -33,6 +33,7 @@
 #include <linux/page_idle.h>
 #include <linux/shmem_fs.h>
 #include <linux/oom.h>
+#include <linux/sched/sysctl.h>
 
 #include <asm/tlb.h>
 #include <asm/pgalloc.h>
@@ -904,6 +905,44 @@ struct page *follow_devmap_pmd(struct vm_area_struct *vma, unsigned long addr,
 	return page;
 }
 
+#ifdef CONFIG_THP_SWAP
+/* Replaces a pmd swap entry with the ptes of the entries of its cluster */
+static void __split_huge_swap_pmd(struct vm_area_struct *vma,
+		unsigned long haddr, pmd_t *pmd)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	swp_entry_t entry = pmd_to_swp_entry(*pmd);
+	bool soft_dirty = pmd_swp_soft_dirty(*pmd);
+	pgtable_t pgtable;
+	pmd_t _pmd;
+	unsigned long addr;
+	int i;
+
+	pgtable = pgtable_trans_huge_withdraw(mm, pmd);
+	pmd_populate(mm, &_pmd, pgtable);
+
+	for (i = 0, addr = haddr; i < HPAGE_PMD_NR;
+	     i++, addr += PAGE_SIZE, entry.val++) {
+		pte_t swp_pte, *pte;
+
+		swp_pte = swp_entry_to_pte(entry);
+		if (soft_dirty)
+			swp_pte = pte_swp_mksoft_dirty(swp_pte);
+		pte = pte_offset_map(&_pmd, addr);
+		VM_BUG_ON(!pte_none(*pte));
+		set_pte_at(mm, addr, pte, swp_pte);
+		pte_unmap(pte);
+	}
+	smp_wmb(); /* make pte visible before pmd */
+	pmd_populate(mm, pmd, pgtable);
+}
+#else
+static inline void __split_huge_swap_pmd(struct vm_area_struct *vma,
+		unsigned long haddr, pmd_t *pmd)
+{
+}
+#endif
+
 int copy_huge_pmd(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 		  pmd_t *dst_pmd, pmd_t *src_pmd, unsigned long addr,
 		  struct vm_area_struct *vma)
@@ -933,6 +972,28 @@ int copy_huge_pmd(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 	if (unlikely(is_swap_pmd(pmd))) {
 		swp_entry_t entry = pmd_to_swp_entry(pmd);
 
+		if (is_pmd_swap_entry(pmd)) {
+			if (swap_duplicate_huge(entry) < 0) {
+				/* copy_pte_range() may sleep for them */
+				__split_huge_swap_pmd(vma, addr, src_pmd);
+				pte_free(dst_mm, pgtable);
+				goto out_unlock;
+			}
+			if (unlikely(list_empty(&dst_mm->mmlist))) {
+				spin_lock(&mmlist_lock);
+				if (list_empty(&dst_mm->mmlist))
+					list_add(&dst_mm->mmlist,
+						 &src_mm->mmlist);
+				spin_unlock(&mmlist_lock);
+			}
+			add_mm_counter(dst_mm, MM_SWAPENTS, HPAGE_PMD_NR);
+			atomic_long_inc(&dst_mm->nr_ptes);
+			pgtable_trans_huge_deposit(dst_mm, dst_pmd, pgtable);
+			set_pmd_at(dst_mm, addr, dst_pmd, pmd);
+			ret = 0;
+			goto out_unlock;
+		}
+
 		VM_BUG_ON(!is_pmd_migration_entry(pmd));
 		if (is_write_migration_entry(entry)) {
 			make_migration_entry_read(&entry);
@@ -1623,7 +1684,8 @@ bool madvise_free_huge_pmd(struct mmu_gather *tlb, struct vm_area_struct *vma,
 
 	if (unlikely(!pmd_present(orig_pmd))) {
 		VM_BUG_ON(thp_migration_supported() &&
-				  !is_pmd_migration_entry(orig_pmd));
+				  !is_pmd_migration_entry(orig_pmd) &&
+				  !is_pmd_swap_entry(orig_pmd));
 		goto out;
 	}
 
@@ -1711,6 +1773,11 @@ int zap_huge_pmd(struct mmu_gather *tlb, struct vm_area_struct *vma,
 		zap_deposited_table(tlb->mm, pmd);
 		spin_unlock(ptl);
 		tlb_remove_page_size(tlb, pmd_page(orig_pmd), HPAGE_PMD_SIZE);
+	} else if (is_pmd_swap_entry(orig_pmd)) {
+		zap_deposited_table(tlb->mm, pmd);
+		add_mm_counter(tlb->mm, MM_SWAPENTS, -HPAGE_PMD_NR);
+		spin_unlock(ptl);
+		free_swap_and_cache_huge(pmd_to_swp_entry(orig_pmd));
 	} else {
 		struct page *page = NULL;
 		int flush_needed = 1;
@@ -1764,7 +1831,7 @@ static inline int pmd_move_must_withdraw(spinlock_t *new_pmd_ptl,
 static pmd_t move_soft_dirty_pmd(pmd_t pmd)
 {
 #ifdef CONFIG_MEM_SOFT_DIRTY
-	if (unlikely(is_pmd_migration_entry(pmd)))
+	if (unlikely(is_swap_pmd(pmd)))
 		pmd = pmd_swp_mksoft_dirty(pmd);
 	else if (pmd_present(pmd))
 		pmd = pmd_mksoft_dirty(pmd);
@@ -1854,7 +1921,8 @@ int change_huge_pmd(struct vm_area_struct *vma, pmd_t *pmd,
 	if (is_swap_pmd(*pmd)) {
 		swp_entry_t entry = pmd_to_swp_entry(*pmd);
 
-		VM_BUG_ON(!is_pmd_migration_entry(*pmd));
+		VM_BUG_ON(!is_pmd_migration_entry(*pmd) &&
+			  !is_pmd_swap_entry(*pmd));
 		if (is_write_migration_entry(entry)) {
 			pmd_t newpmd;
 			/*
@@ -1882,6 +1950,12 @@ int change_huge_pmd(struct vm_area_struct *vma, pmd_t *pmd,
 	if (prot_numa && pmd_protnone(*pmd))
 		goto unlock;
 
+	/* as change_pte_range() with memory tiering alone */
+	if (prot_numa &&
+	    !(sysctl_numa_balancing_mode & NUMA_BALANCING_NORMAL) &&
+	    node_is_toptier(page_to_nid(pmd_page(*pmd))))
+		goto unlock;
+
 	/*
 	 * In case prot_numa, we are under down_read(mmap_sem). It's critical
 	 * to not clear pmd intermittently to avoid race with MADV_DONTNEED
@@ -2062,11 +2136,14 @@ static void __split_huge_pmd_locked(struct vm_area_struct *vma, pmd_t *pmd,
 	VM_BUG_ON(haddr & ~HPAGE_PMD_MASK);
 	VM_BUG_ON_VMA(vma->vm_start > haddr, vma);
 	VM_BUG_ON_VMA(vma->vm_end < haddr + HPAGE_PMD_SIZE, vma);
-	VM_BUG_ON(!is_pmd_migration_entry(*pmd) && !pmd_trans_huge(*pmd)
+	VM_BUG_ON(!is_swap_pmd(*pmd) && !pmd_trans_huge(*pmd)
 				&& !pmd_devmap(*pmd));
 
 	count_vm_event(THP_SPLIT_PMD);
 
+	if (is_pmd_swap_entry(*pmd))
+		return __split_huge_swap_pmd(vma, haddr, pmd);
+
 	if (!vma_is_anonymous(vma)) {
 		_pmd = pmdp_huge_clear_flush_notify(vma, haddr, pmd);
 		/*
@@ -2215,7 +2292,7 @@ void __split_huge_pmd(struct vm_area_struct *vma, pmd_t *pmd,
 		page = pmd_page(*pmd);
 		if (PageMlocked(page))
 			clear_page_mlock(page);
-	} else if (!(pmd_devmap(*pmd) || is_pmd_migration_entry(*pmd)))
+	} else if (!(pmd_devmap(*pmd) || is_swap_pmd(*pmd)))
 		goto out;
 	__split_huge_pmd_locked(vma, pmd, haddr, freeze);
 out:
@@ -2536,6 +2613,26 @@ bool can_split_huge_page(struct page *page, int *pextra_pins)
 	return total_mapcount(page) == page_count(page) - extra_pins - 1;
 }
 
+/*
+ * Replaces the multi-order page cache entry of @head with one entry for
+ * each subpage, from the nodes preloaded by the caller.
+ */
+static void split_page_cache_entry(struct address_space *mapping,
+				   struct page *head)
+{
+	struct radix_tree_iter iter;
+	void **slot;
+
+	BUG_ON(radix_tree_split(&mapping->page_tree, head->index, 0));
+	radix_tree_for_each_slot(slot, &mapping->page_tree, &iter,
+				 head->index) {
+		if (iter.index >= head->index + HPAGE_PMD_NR)
+			break;
+		radix_tree_iter_replace(&mapping->page_tree, &iter, slot,
+					head + (iter.index - head->index));
+	}
+}
+
 /*
  * This function splits huge page into normal pages. @page can point to any
  * subpage of huge page to split. Split doesn't change the position of @page.
@@ -2562,7 +2659,7 @@ int split_huge_page_to_list(struct page *page, struct list_head *list)
 	struct anon_vma *anon_vma = NULL;
 	struct address_space *mapping = NULL;
 	int count, mapcount, extra_pins, ret;
-	bool mlocked;
+	bool mlocked, large = false;
 	unsigned long flags;
 
 	VM_BUG_ON_PAGE(is_huge_zero_page(page), page);
@@ -2618,6 +2715,16 @@ int split_huge_page_to_list(struct page *page, struct list_head *list)
 	if (mlocked)
 		lru_add_drain();
 
+	/* A multi-order page cache entry takes new nodes to be split */
+	if (mapping && mapping_large_pages(mapping)) {
+		if (radix_tree_split_preload(HPAGE_PMD_ORDER, 0, GFP_NOFS)) {
+			unfreeze_page(head);
+			ret = -ENOMEM;
+			goto out_unlock;
+		}
+		large = true;
+	}
+
 	/* prevent PageLRU to go away from under us, and freeze lru stats */
 	spin_lock_irqsave(zone_lru_lock(page_zone(head)), flags);
 
@@ -2645,9 +2752,18 @@ int split_huge_page_to_list(struct page *page, struct list_head *list)
 			pgdata->split_queue_len--;
 			list_del(page_deferred_list(head));
 		}
-		if (mapping)
+		if (mapping && PageSwapBacked(head)) {
 			__dec_node_page_state(page, NR_SHMEM_THPS);
+		} else if (mapping) {
+			__dec_node_page_state(page, NR_FILE_THPS);
+			if (!large)
+				filemap_nr_thps_dec(mapping);
+		}
 		spin_unlock(&pgdata->split_queue_lock);
+		if (large) {
+			split_page_cache_entry(mapping, head);
+			radix_tree_preload_end();
+		}
 		__split_huge_page(page, list, flags);
 		if (PageSwapCache(head)) {
 			swp_entry_t entry = { .val = page_private(head) };
@@ -2668,6 +2784,8 @@ int split_huge_page_to_list(struct page *page, struct list_head *list)
 fail:		if (mapping)
 			spin_unlock(&mapping->tree_lock);
 		spin_unlock_irqrestore(zone_lru_lock(page_zone(head)), flags);
+		if (large)
+			radix_tree_preload_end();
 		unfreeze_page(head);
 		ret = -EBUSY;
 	}
@@ -2896,3 +3014,198 @@ void remove_migration_pmd(struct page_vma_mapped_walk *pvmw, struct page *new)
 	update_mmu_cache_pmd(vma, address, pvmw->pmd);
 }
 #endif
+
+#ifdef CONFIG_THP_SWAP
+/*
+ * Replaces the pmd mapping a THP in the swap cache with a swap entry for the
+ * cluster it was allocated, so that it can be read back whole.
+ */
+bool set_pmd_swap_entry(struct page_vma_mapped_walk *pvmw, struct page *page,
+			enum ttu_flags flags)
+{
+	struct vm_area_struct *vma = pvmw->vma;
+	struct mm_struct *mm = vma->vm_mm;
+	unsigned long address = pvmw->address;
+	swp_entry_t entry = { .val = page_private(page) };
+	pmd_t pmdval, pmdswp;
+
+	VM_BUG_ON_PAGE(!PageAnon(page) || !PageSwapCache(page), page);
+
+	if (!(flags & TTU_IGNORE_ACCESS) &&
+	    pmdp_clear_flush_young_notify(vma, address, pvmw->pmd))
+		return false;
+
+	if (swap_duplicate_huge(entry) < 0)
+		return false;
+
+	flush_cache_range(vma, address, address + HPAGE_PMD_SIZE);
+	pmdval = pmdp_huge_clear_flush(vma, address, pvmw->pmd);
+	if (pmd_dirty(pmdval))
+		set_page_dirty(page);
+	update_hiwater_rss(mm);
+
+	if (list_empty(&mm->mmlist)) {
+		spin_lock(&mmlist_lock);
+		if (list_empty(&mm->mmlist))
+			list_add(&mm->mmlist, &init_mm.mmlist);
+		spin_unlock(&mmlist_lock);
+	}
+	add_mm_counter(mm, MM_ANONPAGES, -HPAGE_PMD_NR);
+	add_mm_counter(mm, MM_SWAPENTS, HPAGE_PMD_NR);
+	pmdswp = swp_entry_to_pmd(entry);
+	if (pmd_soft_dirty(pmdval))
+		pmdswp = pmd_swp_mksoft_dirty(pmdswp);
+	/* the deposited page table stays for a later split */
+	set_pmd_at(mm, address, pvmw->pmd, pmdswp);
+
+	page_remove_rmap(page, true);
+	put_page(page);
+	mmu_notifier_invalidate_range(mm, address, address + HPAGE_PMD_SIZE);
+	return true;
+}
+
+/*
+ * Allocates a THP for the cluster of @entry and reads it in a single bio.
+ * Returns NULL when the cluster is not whole any more or the allocation
+ * fails, the caller then falls back to small pages.
+ */
+static struct page *thp_swapin(struct vm_fault *vmf, swp_entry_t entry)
+{
+	struct vm_area_struct *vma = vmf->vma;
+	unsigned long haddr = vmf->address & HPAGE_PMD_MASK;
+	struct page *page;
+
+	if (!transparent_hugepage_enabled(vma))
+		return NULL;
+
+	page = alloc_hugepage_vma(alloc_hugepage_direct_gfpmask(vma), vma,
+				  haddr, HPAGE_PMD_ORDER);
+	if (!page)
+		return NULL;
+	prep_transhuge_page(page);
+
+	if (swapcache_prepare_huge(entry)) {
+		put_page(page);
+		return NULL;
+	}
+
+	__SetPageLocked(page);
+	__SetPageSwapBacked(page);
+	if (add_to_swap_cache(page, entry, GFP_KERNEL)) {
+		put_swap_page(page, entry);
+		__ClearPageLocked(page);
+		put_page(page);
+		return NULL;
+	}
+
+	lru_cache_add_anon(page);
+	swap_readpage(page, false);
+	return page;
+}
+
+/*
+ * Faults in a THP swapped out whole, from the swap cache or from the swap
+ * device.  When that is not possible the pmd swap entry is split into pte
+ * swap entries, so that the fault is retried on small pages.
+ */
+int do_huge_pmd_swap_page(struct vm_fault *vmf, pmd_t orig_pmd)
+{
+	struct vm_area_struct *vma = vmf->vma;
+	struct mm_struct *mm = vma->vm_mm;
+	unsigned long haddr = vmf->address & HPAGE_PMD_MASK;
+	swp_entry_t entry = pmd_to_swp_entry(orig_pmd);
+	struct mem_cgroup *memcg;
+	struct page *page;
+	int exclusive = 0;
+	int ret = 0;
+	pmd_t pmd;
+
+	page = lookup_swap_cache(entry, NULL, vmf->address);
+	if (!page) {
+		page = thp_swapin(vmf, entry);
+		if (page) {
+			/* Had to read the page from swap area: Major fault */
+			ret = VM_FAULT_MAJOR;
+			count_vm_event(PGMAJFAULT);
+			count_memcg_event_mm(mm, PGMAJFAULT);
+		}
+	}
+	if (!page || !PageTransHuge(page))
+		goto fallback;
+
+	if (!lock_page_or_retry(page, mm, vmf->flags)) {
+		put_page(page);
+		return ret | VM_FAULT_RETRY;
+	}
+
+	/* split or taken out of the swap cache while unlocked: retry */
+	if (unlikely(!PageSwapCache(page) || page_private(page) != entry.val ||
+		     !PageTransHuge(page)))
+		goto out_page;
+
+	if (mem_cgroup_try_charge(page, mm, GFP_KERNEL, &memcg, true)) {
+		unlock_page(page);
+		goto fallback;
+	}
+
+	vmf->ptl = pmd_lock(mm, vmf->pmd);
+	if (unlikely(!pmd_same(*vmf->pmd, orig_pmd)))
+		goto out_nomap;
+
+	if (unlikely(!PageUptodate(page))) {
+		ret = VM_FAULT_SIGBUS;
+		goto out_nomap;
+	}
+
+	/* the same order of operations as in do_swap_page() */
+	add_mm_counter(mm, MM_ANONPAGES, HPAGE_PMD_NR);
+	add_mm_counter(mm, MM_SWAPENTS, -HPAGE_PMD_NR);
+	pmd = mk_huge_pmd(page, vma->vm_page_prot);
+	if ((vmf->flags & FAULT_FLAG_WRITE) && reuse_swap_page(page, NULL)) {
+		pmd = maybe_pmd_mkwrite(pmd_mkdirty(pmd), vma);
+		vmf->flags &= ~FAULT_FLAG_WRITE;
+		ret |= VM_FAULT_WRITE;
+		exclusive = RMAP_EXCLUSIVE;
+	}
+	if (pmd_swp_soft_dirty(orig_pmd))
+		pmd = pmd_mksoft_dirty(pmd);
+	do_page_add_anon_rmap(page, vma, haddr, exclusive | RMAP_COMPOUND);
+	mem_cgroup_commit_charge(page, memcg, true, true);
+	activate_page(page);
+	set_pmd_at(mm, haddr, vmf->pmd, pmd);
+	update_mmu_cache_pmd(vma, vmf->address, vmf->pmd);
+
+	swap_free_huge(entry);
+	if (mem_cgroup_swap_full(page) ||
+	    (vma->vm_flags & VM_LOCKED) || PageMlocked(page))
+		try_to_free_swap(page);
+	spin_unlock(vmf->ptl);
+	unlock_page(page);
+	count_vm_event(THP_SWPIN);
+
+	if (vmf->flags & FAULT_FLAG_WRITE) {
+		ret |= do_huge_pmd_wp_page(vmf, pmd);
+		if (ret & VM_FAULT_ERROR)
+			ret &= VM_FAULT_ERROR;
+	}
+	return ret;
+
+out_nomap:
+	mem_cgroup_cancel_charge(page, memcg, true);
+	spin_unlock(vmf->ptl);
+out_page:
+	unlock_page(page);
+	put_page(page);
+	return ret;
+
+fallback:
+	if (page)
+		put_page(page);
+	vmf->ptl = pmd_lock(mm, vmf->pmd);
+	if (pmd_same(*vmf->pmd, orig_pmd))
+		__split_huge_swap_pmd(vma, haddr, vmf->pmd);
+	spin_unlock(vmf->ptl);
+	count_vm_event(THP_SWPIN_FALLBACK);
+	return ret;
+}
+#endif /* CONFIG_THP_SWAP */
@@ -34,7 +34,10 @@
 #include <linux/hugetlb_cgroup.h>
 #include <linux/node.h>
 #include <linux/userfaultfd_k.h>
+#include <linux/llist.h>
+#include <linux/kthread.h>
 #include "internal.h"
+#include "hugetlb_vmemmap.h"
 
 int hugepages_treat_as_movable;
 
@@ -1188,15 +1191,10 @@ static inline int alloc_fresh_gigantic_page(struct hstate *h,
 					nodemask_t *nodes_allowed) { return 0; }
 #endif
 
-static void update_and_free_page(struct hstate *h, struct page *page)
+static void __update_and_free_page(struct hstate *h, struct page *page)
 {
 	int i;
 
-	if (hstate_is_gigantic(h) && !gigantic_page_supported())
-		return;
-
-	h->nr_huge_pages--;
-	h->nr_huge_pages_node[page_to_nid(page)]--;
 	for (i = 0; i < pages_per_huge_page(h); i++) {
 		page[i].flags &= ~(1 << PG_locked | 1 << PG_error |
 				1 << PG_referenced | 1 << PG_dirty |
@@ -1214,6 +1212,68 @@ static void update_and_free_page(struct hstate *h, struct page *page)
 	}
 }
 
+/*
+ * Huge pages whose vmemmap was freed need it back before they go to the
+ * buddy allocator, which can sleep: update_and_free_page() is called under
+ * hugetlb_lock, so that is done for them here.
+ */
+static LLIST_HEAD(hpage_freelist);
+
+static void free_hpage_workfn(struct work_struct *work)
+{
+	struct llist_node *node = llist_del_all(&hpage_freelist);
+
+	while (node) {
+		struct page *page;
+		struct hstate *h;
+		int nid;
+
+		page = container_of((struct address_space **)node,
+				    struct page, mapping);
+		node = node->next;
+		page->mapping = NULL;
+		/* not PageHuge() any more, see update_and_free_page() */
+		h = size_to_hstate(PAGE_SIZE << compound_order(page));
+
+		if (hugetlb_vmemmap_alloc(h, page)) {
+			/* Keep it in the pool as a surplus page */
+			nid = page_to_nid(page);
+			spin_lock(&hugetlb_lock);
+			h->nr_huge_pages++;
+			h->nr_huge_pages_node[nid]++;
+			h->surplus_huge_pages++;
+			h->surplus_huge_pages_node[nid]++;
+			set_compound_page_dtor(page, HUGETLB_PAGE_DTOR);
+			INIT_LIST_HEAD(&page->lru);
+			enqueue_huge_page(h, page);
+			spin_unlock(&hugetlb_lock);
+		} else {
+			__update_and_free_page(h, page);
+		}
+		cond_resched();
+	}
+}
+static DECLARE_WORK(free_hpage_work, free_hpage_workfn);
+
+static void update_and_free_page(struct hstate *h, struct page *page)
+{
+	if (hstate_is_gigantic(h) && !gigantic_page_supported())
+		return;
+
+	h->nr_huge_pages--;
+	h->nr_huge_pages_node[page_to_nid(page)]--;
+
+	if (hugetlb_vmemmap_optimized(page)) {
+		/* no longer PageHuge(), dissolve_free_huge_page() skips it */
+		set_compound_page_dtor(page, NULL_COMPOUND_DTOR);
+		if (llist_add((struct llist_node *)&page->mapping,
+			      &hpage_freelist))
+			schedule_work(&free_hpage_work);
+		return;
+	}
+	__update_and_free_page(h, page);
+}
+
 struct hstate *size_to_hstate(unsigned long size)
 {
 	struct hstate *h;
@@ -1299,6 +1359,7 @@ void free_huge_page(struct page *page)
 
 static void prep_new_huge_page(struct hstate *h, struct page *page, int nid)
 {
+	hugetlb_vmemmap_free(h, page);
 	INIT_LIST_HEAD(&page->lru);
 	set_compound_page_dtor(page, HUGETLB_PAGE_DTOR);
 	spin_lock(&hugetlb_lock);
@@ -1469,6 +1530,7 @@ int dissolve_free_huge_page(struct page *page)
 	int rc = 0;
 
 	spin_lock(&hugetlb_lock);
+retry:
 	if (PageHuge(page) && !page_count(page)) {
 		struct page *head = compound_head(page);
 		struct hstate *h = page_hstate(head);
@@ -1477,6 +1539,31 @@ int dissolve_free_huge_page(struct page *page)
 			rc = -EBUSY;
 			goto out;
 		}
+		/*
+		 * The struct pages of the tail pages have to be given back
+		 * their vmemmap before any of them is written.  That sleeps,
+		 * so take the page out of the pool meanwhile, out of reach of
+		 * allocations and of other dissolvers, and look at it again
+		 * afterwards.
+		 */
+		if (hugetlb_vmemmap_optimized(head)) {
+			list_del(&head->lru);
+			h->free_huge_pages--;
+			h->free_huge_pages_node[nid]--;
+			set_compound_page_dtor(head, NULL_COMPOUND_DTOR);
+			spin_unlock(&hugetlb_lock);
+
+			rc = hugetlb_vmemmap_alloc(h, head);
+
+			spin_lock(&hugetlb_lock);
+			set_compound_page_dtor(head, HUGETLB_PAGE_DTOR);
+			INIT_LIST_HEAD(&head->lru);
+			enqueue_huge_page(h, head);
+			if (rc)
+				goto out;
+			goto retry;
+		}
+
 		/*
 		 * Move PageHWPoison flag from head page to the raw error page,
 		 * which makes any subpages rather than the error page reusable.
@@ -2130,21 +2217,79 @@ static void __init prep_compound_huge_page(struct page *page,
 		prep_compound_page(page, order);
 }
 
-/* Put bootmem huge pages into the standard lists after mem_map is up */
-static void __init gather_bootmem_prealloc(void)
+/*
+ * Preparing the huge pages of the boot pool, and allocating them when they
+ * do not need bootmem, is done by one thread per node, for the memory of
+ * that node.
+ */
+struct hugetlb_node_work {
+	struct hstate *h;
+	int nid;
+	unsigned long nr_pages;		/* to allocate, then allocated */
+	struct list_head boot_pages;	/* to gather */
+	void (*fn)(struct hugetlb_node_work *work);
+	struct completion done;
+};
+
+static int __init hugetlb_node_workfn(void *arg)
 {
-	struct huge_bootmem_page *m;
+	struct hugetlb_node_work *work = arg;
+
+	work->fn(work);
+	complete(&work->done);
+	return 0;
+}
+
+/* Run the works, indexed by node, which have a function and wait for them */
+static void __init hugetlb_run_node_works(struct hugetlb_node_work *works)
+{
+	int nid;
+
+	for_each_node(nid) {
+		struct hugetlb_node_work *work = &works[nid];
+		const struct cpumask *cpumask = cpumask_of_node(nid);
+		struct task_struct *t;
+
+		if (!work->fn)
+			continue;
+
+		init_completion(&work->done);
+		t = kthread_create_on_node(hugetlb_node_workfn, work, nid,
+					   "hugetlb_init/%d", nid);
+		if (IS_ERR(t)) {
+			hugetlb_node_workfn(work);
+			continue;
+		}
+		if (!cpumask_empty(cpumask))
+			set_cpus_allowed_ptr(t, cpumask);
+		wake_up_process(t);
+	}
 
-	list_for_each_entry(m, &huge_boot_pages, list) {
+	for_each_node(nid)
+		if (works[nid].fn)
+			wait_for_completion(&works[nid].done);
+}
+
+static struct page * __init huge_bootmem_page_page(struct huge_bootmem_page *m)
+{
+#ifdef CONFIG_HIGHMEM
+	return pfn_to_page(m->phys >> PAGE_SHIFT);
+#else
+	return virt_to_page(m);
+#endif
+}
+
+static void __init gather_bootmem_node(struct hugetlb_node_work *work)
+{
+	struct huge_bootmem_page *m, *next;
+
+	list_for_each_entry_safe(m, next, &work->boot_pages, list) {
 		struct hstate *h = m->hstate;
-		struct page *page;
+		struct page *page = huge_bootmem_page_page(m);
 
 #ifdef CONFIG_HIGHMEM
-		page = pfn_to_page(m->phys >> PAGE_SHIFT);
 		memblock_free_late(__pa(m),
 				   sizeof(struct huge_bootmem_page));
-#else
-		page = virt_to_page(m);
 #endif
 		WARN_ON(page_count(page) != 1);
 		prep_compound_huge_page(page, h->order);
@@ -2161,11 +2306,90 @@ static void __init gather_bootmem_prealloc(void)
 	}
 }
 
+/* Put bootmem huge pages into the standard lists after mem_map is up */
+static void __init gather_bootmem_prealloc(void)
+{
+	struct huge_bootmem_page *m, *next;
+	struct hugetlb_node_work *works;
+	int nid;
+
+	works = kcalloc(nr_node_ids, sizeof(*works), GFP_KERNEL);
+	if (!works) {
+		struct hugetlb_node_work work;
+
+		INIT_LIST_HEAD(&work.boot_pages);
+		list_splice_init(&huge_boot_pages, &work.boot_pages);
+		gather_bootmem_node(&work);
+		return;
+	}
+
+	for_each_node(nid)
+		INIT_LIST_HEAD(&works[nid].boot_pages);
+	list_for_each_entry_safe(m, next, &huge_boot_pages, list) {
+		nid = page_to_nid(huge_bootmem_page_page(m));
+		list_move_tail(&m->list, &works[nid].boot_pages);
+		works[nid].fn = gather_bootmem_node;
+	}
+	hugetlb_run_node_works(works);
+	kfree(works);
+}
+
+static void __init hugetlb_alloc_node_pages(struct hugetlb_node_work *work)
+{
+	unsigned long i;
+
+	for (i = 0; i < work->nr_pages; i++) {
+		if (!alloc_fresh_huge_page_node(work->h, work->nid)) {
+			count_vm_event(HTLB_BUDDY_PGALLOC_FAIL);
+			break;
+		}
+		count_vm_event(HTLB_BUDDY_PGALLOC);
+		cond_resched();
+	}
+	work->nr_pages = i;
+}
+
+/*
+ * Allocate the boot pool of @h evenly from the nodes with memory, in
+ * parallel.  Returns the number of huge pages allocated.
+ */
+static unsigned long __init hugetlb_alloc_pages_on_nodes(struct hstate *h)
+{
+	unsigned int nr_nodes = num_node_state(N_MEMORY);
+	struct hugetlb_node_work *works;
+	unsigned long allocated = 0;
+	int nid, i = 0;
+
+	if (nr_nodes < 2 || hstate_is_gigantic(h))
+		return 0;
+
+	works = kcalloc(nr_node_ids, sizeof(*works), GFP_KERNEL);
+	if (!works)
+		return 0;
+
+	for_each_node_state(nid, N_MEMORY) {
+		works[nid].h = h;
+		works[nid].nid = nid;
+		works[nid].nr_pages = h->max_huge_pages / nr_nodes +
+				      (i++ < h->max_huge_pages % nr_nodes);
+		works[nid].fn = hugetlb_alloc_node_pages;
+	}
+	hugetlb_run_node_works(works);
+
+	for_each_node_state(nid, N_MEMORY)
+		allocated += works[nid].nr_pages;
+	kfree(works);
+
+	return allocated;
+}
+
 static void __init hugetlb_hstate_alloc_pages(struct hstate *h)
 {
 	unsigned long i;
 
-	for (i = 0; i < h->max_huge_pages; ++i) {
+	/* What the nodes could not allocate is taken from any node */
+	i = hugetlb_alloc_pages_on_nodes(h);
+	for (; i < h->max_huge_pages; ++i) {
 		if (hstate_is_gigantic(h)) {
 			if (!alloc_bootmem_huge_page(h))
 				break;
@@ -2834,6 +3058,7 @@ void __init hugetlb_add_hstate(unsigned int order)
 	h->next_nid_to_free = first_memory_node;
 	snprintf(h->name, HSTATE_NAME_LEN, "hugepages-%lukB",
 					huge_page_size(h)/1024);
+	hugetlb_vmemmap_init(h);
 
 	parsed_hstate = h;
 }
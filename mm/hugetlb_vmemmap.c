@@ -0,0 +1,114 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Freeing of the vmemmap pages associated with each HugeTLB page
+ *
+ * A HugeTLB page of 1GB has 16MB of struct pages, 4096 vmemmap pages, and
+ * all of them past the first two only describe tail pages, which are
+ * identical.  While the page belongs to the HugeTLB pool, the vmemmap pages
+ * but the first two are freed and their virtual range is mapped, read-only,
+ * to the second one.  Page flags of the tail pages are never written while
+ * the page is in the pool, the ones changed on hwpoison are the head's.
+ *
+ * Before the HugeTLB page goes back to the buddy allocator, its vmemmap is
+ * allocated again, which can fail: the page then stays a surplus page.
+ *
+ * This is disabled by default and enabled with hugetlb_free_vmemmap=on.
+ */
+#define pr_fmt(fmt)	"HugeTLB: " fmt
+
+#include <linux/mm.h>
+#include <linux/log2.h>
+#include "hugetlb_vmemmap.h"
+
+/* The first two vmemmap pages of a HugeTLB page are kept */
+#define RESERVE_VMEMMAP_NR	2U
+#define RESERVE_VMEMMAP_SIZE	(RESERVE_VMEMMAP_NR << PAGE_SHIFT)
+
+#define GFP_VMEMMAP_PAGE	(GFP_KERNEL | __GFP_NORETRY | __GFP_THISNODE)
+
+static bool hugetlb_free_vmemmap_enabled __read_mostly;
+
+static int __init early_hugetlb_free_vmemmap_param(char *buf)
+{
+	if (!buf)
+		return -EINVAL;
+
+	if (!strcmp(buf, "on"))
+		hugetlb_free_vmemmap_enabled = true;
+	else if (!strcmp(buf, "off"))
+		hugetlb_free_vmemmap_enabled = false;
+	else
+		return -EINVAL;
+
+	return 0;
+}
+early_param("hugetlb_free_vmemmap", early_hugetlb_free_vmemmap_param);
+
+static unsigned long vmemmap_range(struct hstate *h, struct page *head,
+				   unsigned long *end, unsigned long *reuse)
+{
+	unsigned long start = (unsigned long)head + RESERVE_VMEMMAP_SIZE;
+
+	*end = start + ((unsigned long)h->nr_free_vmemmap_pages << PAGE_SHIFT);
+	*reuse = start - PAGE_SIZE;
+	return start;
+}
+
+/*
+ * Free the vmemmap pages of the tail pages of @head, which was just
+ * allocated and is not used yet.
+ */
+void hugetlb_vmemmap_free(struct hstate *h, struct page *head)
+{
+	unsigned long start, end, reuse;
+
+	if (!h->nr_free_vmemmap_pages)
+		return;
+
+	start = vmemmap_range(h, head, &end, &reuse);
+	if (!vmemmap_remap_free(start, end, reuse))
+		SetPagePrivate(&head[2]);
+}
+
+/*
+ * Allocate back the vmemmap pages of the tail pages of @head before it is
+ * freed.  Returns -ENOMEM if they could not be allocated.
+ */
+int hugetlb_vmemmap_alloc(struct hstate *h, struct page *head)
+{
+	unsigned long start, end, reuse;
+	int ret;
+
+	if (!hugetlb_vmemmap_optimized(head))
+		return 0;
+
+	start = vmemmap_range(h, head, &end, &reuse);
+	ret = vmemmap_remap_alloc(start, end, reuse, GFP_VMEMMAP_PAGE);
+	if (!ret)
+		ClearPagePrivate(&head[2]);
+	return ret;
+}
+
+void __init hugetlb_vmemmap_init(struct hstate *h)
+{
+	unsigned int nr_pages = pages_per_huge_page(h);
+	unsigned int vmemmap_pages;
+
+	h->nr_free_vmemmap_pages = 0;
+	if (!hugetlb_free_vmemmap_enabled)
+		return;
+
+	/* The struct pages of the tail pages must line up on each page */
+	if (!is_power_of_2(sizeof(struct page))) {
+		pr_warn_once("cannot free vmemmap pages because the struct page size is not power of 2\n");
+		hugetlb_free_vmemmap_enabled = false;
+		return;
+	}
+
+	vmemmap_pages = (nr_pages * sizeof(struct page)) >> PAGE_SHIFT;
+	if (vmemmap_pages > RESERVE_VMEMMAP_NR)
+		h->nr_free_vmemmap_pages = vmemmap_pages - RESERVE_VMEMMAP_NR;
+
+	pr_info("can free %u vmemmap pages for %s\n",
+		h->nr_free_vmemmap_pages, h->name);
+}
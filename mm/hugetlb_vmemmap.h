@@ -0,0 +1,41 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Freeing of the vmemmap pages associated with each HugeTLB page
+ */
+#ifndef _LINUX_HUGETLB_VMEMMAP_H
+#define _LINUX_HUGETLB_VMEMMAP_H
+#include <linux/hugetlb.h>
+
+#ifdef CONFIG_HUGETLB_PAGE_FREE_VMEMMAP
+void __init hugetlb_vmemmap_init(struct hstate *h);
+void hugetlb_vmemmap_free(struct hstate *h, struct page *head);
+int hugetlb_vmemmap_alloc(struct hstate *h, struct page *head);
+
+/*
+ * Whether the vmemmap of the tail pages of @head is freed.  Kept in the
+ * third struct page, which is in the first vmemmap page and stays writable.
+ */
+static inline bool hugetlb_vmemmap_optimized(struct page *head)
+{
+	return PagePrivate(&head[2]);
+}
+#else
+static inline void hugetlb_vmemmap_init(struct hstate *h)
+{
+}
+
+static inline void hugetlb_vmemmap_free(struct hstate *h, struct page *head)
+{
+}
+
+static inline int hugetlb_vmemmap_alloc(struct hstate *h, struct page *head)
+{
+	return 0;
+}
+
+static inline bool hugetlb_vmemmap_optimized(struct page *head)
+{
+	return false;
+}
+#endif /* CONFIG_HUGETLB_PAGE_FREE_VMEMMAP */
+#endif /* _LINUX_HUGETLB_VMEMMAP_H */
@@ -29,6 +29,7 @@ enum scan_result {
 	SCAN_PMD_NULL,
 	SCAN_EXCEED_NONE_PTE,
 	SCAN_PTE_NON_PRESENT,
+	SCAN_PTE_UFFD_WP,
 	SCAN_PAGE_RO,
 	SCAN_LACK_REFERENCED_PAGE,
 	SCAN_PAGE_NULL,
@@ -48,6 +49,7 @@ enum scan_result {
 	SCAN_CGROUP_CHARGE_FAIL,
 	SCAN_EXCEED_SWAP_PTE,
 	SCAN_TRUNCATED,
+	SCAN_PAGE_HAS_PRIVATE,
 };
 
 #define CREATE_TRACE_POINTS
@@ -430,18 +432,53 @@ int __khugepaged_enter(struct mm_struct *mm)
 	return 0;
 }
 
+static bool hugepage_vma_check(struct vm_area_struct *vma,
+			       unsigned long vm_flags)
+{
+	if ((!(vm_flags & VM_HUGEPAGE) && !khugepaged_always()) ||
+	    (vm_flags & VM_NOHUGEPAGE) ||
+	    test_bit(MMF_DISABLE_THP, &vma->vm_mm->flags))
+		return false;
+	if (shmem_file(vma->vm_file)) {
+		if (!IS_ENABLED(CONFIG_TRANSPARENT_HUGE_PAGECACHE))
+			return false;
+		return IS_ALIGNED((vma->vm_start >> PAGE_SHIFT) - vma->vm_pgoff,
+				HPAGE_PMD_NR);
+	}
+	/*
+	 * VM_DENYWRITE keeps the writers away from a regular file as long
+	 * as it is mapped, see collapse_file() and do_dentry_open() for
+	 * the rest.  Readahead puts huge pages in the mappings that take
+	 * large pages by itself.
+	 */
+	if (IS_ENABLED(CONFIG_READ_ONLY_THP_FOR_FS) && vma->vm_file &&
+	    (vm_flags & VM_DENYWRITE)) {
+		if (!S_ISREG(file_inode(vma->vm_file)->i_mode) ||
+		    mapping_large_pages(vma->vm_file->f_mapping) ||
+		    (vm_flags & VM_NO_KHUGEPAGED))
+			return false;
+		return IS_ALIGNED((vma->vm_start >> PAGE_SHIFT) - vma->vm_pgoff,
+				HPAGE_PMD_NR);
+	}
+	if (!vma->anon_vma || vma->vm_ops)
+		return false;
+	if (is_vma_temporary_stack(vma))
+		return false;
+	return !(vm_flags & VM_NO_KHUGEPAGED);
+}
+
 int khugepaged_enter_vma_merge(struct vm_area_struct *vma,
 			       unsigned long vm_flags)
 {
 	unsigned long hstart, hend;
-	if (!vma->anon_vma)
+
+	if (vma_is_anonymous(vma) && !vma->anon_vma)
 		/*
 		 * Not yet faulted in so we will register later in the
 		 * page fault if needed.
 		 */
 		return 0;
-	if (vma->vm_ops || (vm_flags & VM_NO_KHUGEPAGED))
-		/* khugepaged not yet working on file or special mappings */
+	if (!hugepage_vma_check(vma, vm_flags))
 		return 0;
 	hstart = (vma->vm_start + ~HPAGE_PMD_MASK) & HPAGE_PMD_MASK;
 	hend = vma->vm_end & HPAGE_PMD_MASK;
@@ -814,25 +851,6 @@ khugepaged_alloc_page(struct page **hpage, gfp_t gfp, int node)
 }
 #endif
 
-static bool hugepage_vma_check(struct vm_area_struct *vma)
-{
-	if ((!(vma->vm_flags & VM_HUGEPAGE) && !khugepaged_always()) ||
-	    (vma->vm_flags & VM_NOHUGEPAGE) ||
-	    test_bit(MMF_DISABLE_THP, &vma->vm_mm->flags))
-		return false;
-	if (shmem_file(vma->vm_file)) {
-		if (!IS_ENABLED(CONFIG_TRANSPARENT_HUGE_PAGECACHE))
-			return false;
-		return IS_ALIGNED((vma->vm_start >> PAGE_SHIFT) - vma->vm_pgoff,
-				HPAGE_PMD_NR);
-	}
-	if (!vma->anon_vma || vma->vm_ops)
-		return false;
-	if (is_vma_temporary_stack(vma))
-		return false;
-	return !(vma->vm_flags & VM_NO_KHUGEPAGED);
-}
-
 /*
  * If mmap_sem temporarily dropped, revalidate vma
  * before taking mmap_sem.
@@ -857,7 +875,10 @@ static int hugepage_vma_revalidate(struct mm_struct *mm, unsigned long address,
 	hend = vma->vm_end & HPAGE_PMD_MASK;
 	if (address < hstart || address + HPAGE_PMD_SIZE > hend)
 		return SCAN_ADDRESS_RANGE;
-	if (!hugepage_vma_check(vma))
+	if (!hugepage_vma_check(vma, vma->vm_flags))
+		return SCAN_VMA_CHECK;
+	/* The collapse of the page cache goes through collapse_file() */
+	if (!vma->anon_vma || vma->vm_ops)
 		return SCAN_VMA_CHECK;
 	return 0;
 }
@@ -1006,6 +1027,8 @@ static void collapse_huge_page(struct mm_struct *mm,
 	if (mm_find_pmd(mm, address) != pmd)
 		goto out;
 
+	/* Keep the speculative page faults off the collapsed pmd */
+	vm_write_begin(vma);
 	anon_vma_lock_write(vma->anon_vma);
 
 	pte = pte_offset_map(pmd, address);
@@ -1041,6 +1064,7 @@ static void collapse_huge_page(struct mm_struct *mm,
 		pmd_populate(mm, pmd, pmd_pgtable(_pmd));
 		spin_unlock(pmd_ptl);
 		anon_vma_unlock_write(vma->anon_vma);
+		vm_write_end(vma);
 		result = SCAN_FAIL;
 		goto out;
 	}
@@ -1075,6 +1099,7 @@ static void collapse_huge_page(struct mm_struct *mm,
 	set_pmd_at(mm, address, pmd, _pmd);
 	update_mmu_cache_pmd(vma, address, pmd);
 	spin_unlock(pmd_ptl);
+	vm_write_end(vma);
 
 	*hpage = NULL;
 
@@ -1118,6 +1143,14 @@ static int khugepaged_scan_pmd(struct mm_struct *mm,
 	     _pte++, _address += PAGE_SIZE) {
 		pte_t pteval = *_pte;
 		if (is_swap_pte(pteval)) {
+			/*
+			 * A huge pmd cannot keep the userfaultfd write
+			 * protection of the ptes it would replace.
+			 */
+			if (pte_swp_uffd_wp(pteval)) {
+				result = SCAN_PTE_UFFD_WP;
+				goto out_unmap;
+			}
 			if (++unmapped <= khugepaged_max_ptes_swap) {
 				continue;
 			} else {
@@ -1138,6 +1171,10 @@ static int khugepaged_scan_pmd(struct mm_struct *mm,
 			result = SCAN_PTE_NON_PRESENT;
 			goto out_unmap;
 		}
+		if (pte_uffd_wp(pteval)) {
+			result = SCAN_PTE_UFFD_WP;
+			goto out_unmap;
+		}
 		if (pte_write(pteval))
 			writable = true;
 
@@ -1278,13 +1315,15 @@ static void retract_page_tables(struct address_space *mapping, pgoff_t pgoff)
 }
 
 /**
- * collapse_shmem - collapse small tmpfs/shmem pages into huge one.
+ * collapse_file - collapse small tmpfs/shmem or file pages into huge one.
  *
  * Basic scheme is simple, details are more complex:
  *  - allocate and freeze a new huge page;
  *  - scan over radix tree replacing old pages the new one
  *    + swap in pages if necessary;
  *    + fill in gaps;
+ *    + a regular file has no gaps: it is read in, clean and without
+ *      buffers, before its pages are replaced;
  *    + keep old pages around in case if rollback is required;
  *  - if replacing succeed:
  *    + copy data over;
@@ -1295,10 +1334,10 @@ static void retract_page_tables(struct address_space *mapping, pgoff_t pgoff)
  *    + restore gaps in the radix-tree;
  *    + free huge page;
  */
-static void collapse_shmem(struct mm_struct *mm,
-		struct address_space *mapping, pgoff_t start,
-		struct page **hpage, int node)
+static void collapse_file(struct mm_struct *mm, struct file *file,
+		pgoff_t start, struct page **hpage, int node)
 {
+	struct address_space *mapping = file->f_mapping;
 	gfp_t gfp;
 	struct page *page, *new_page, *tmp;
 	struct mem_cgroup *memcg;
@@ -1307,7 +1346,9 @@ static void collapse_shmem(struct mm_struct *mm,
 	struct radix_tree_iter iter;
 	void **slot;
 	int nr_none = 0, result = SCAN_SUCCEED;
+	bool is_shmem = shmem_file(file);
 
+	VM_BUG_ON(!IS_ENABLED(CONFIG_READ_ONLY_THP_FOR_FS) && !is_shmem);
 	VM_BUG_ON(start & (HPAGE_PMD_NR - 1));
 
 	/* Only allocate from the target node */
@@ -1326,7 +1367,8 @@ static void collapse_shmem(struct mm_struct *mm,
 
 	new_page->index = start;
 	new_page->mapping = mapping;
-	__SetPageSwapBacked(new_page);
+	if (is_shmem)
+		__SetPageSwapBacked(new_page);
 	__SetPageLocked(new_page);
 	BUG_ON(!page_ref_freeze(new_page, 1));
 
@@ -1338,6 +1380,14 @@ static void collapse_shmem(struct mm_struct *mm,
 	 * unfreeze it.
 	 */
 
+	/*
+	 * Holes of a regular file cannot be filled under the tree_lock: read
+	 * the range in first.  Pages still under read are locked and fail the
+	 * collapse below, which is retried on a later scan.
+	 */
+	if (!is_shmem)
+		force_page_cache_readahead(mapping, file, start, HPAGE_PMD_NR);
+
 	index = start;
 	spin_lock_irq(&mapping->tree_lock);
 	radix_tree_for_each_slot(slot, &mapping->page_tree, &iter, start) {
@@ -1346,8 +1396,9 @@ static void collapse_shmem(struct mm_struct *mm,
 		/*
 		 * Handle holes in the radix tree: charge it from shmem and
 		 * insert relevant subpage of new_page into the radix-tree.
+		 * A regular file is left alone if the readahead missed some.
 		 */
-		if (n && !shmem_charge(mapping->host, n)) {
+		if (n && (!is_shmem || !shmem_charge(mapping->host, n))) {
 			result = SCAN_FAIL;
 			break;
 		}
@@ -1363,7 +1414,20 @@ static void collapse_shmem(struct mm_struct *mm,
 
 		page = radix_tree_deref_slot_protected(slot,
 				&mapping->tree_lock);
-		if (radix_tree_exceptional_entry(page) || !PageUptodate(page)) {
+		if (!is_shmem) {
+			/* Shadow entries are holes, skip dirty pages */
+			if (radix_tree_exceptional_entry(page) ||
+			    PageDirty(page) || PageWriteback(page)) {
+				result = SCAN_FAIL;
+				break;
+			} else if (trylock_page(page)) {
+				get_page(page);
+			} else {
+				result = SCAN_PAGE_LOCK;
+				break;
+			}
+		} else if (radix_tree_exceptional_entry(page) ||
+			   !PageUptodate(page)) {
 			spin_unlock_irq(&mapping->tree_lock);
 			/* swap in or instantiate fallocated page */
 			if (shmem_getpage(mapping->host, index, &page,
@@ -1384,15 +1448,26 @@ static void collapse_shmem(struct mm_struct *mm,
 		 * without racing with truncate.
 		 */
 		VM_BUG_ON_PAGE(!PageLocked(page), page);
-		VM_BUG_ON_PAGE(!PageUptodate(page), page);
 		VM_BUG_ON_PAGE(PageTransCompound(page), page);
 
 		if (page_mapping(page) != mapping) {
 			result = SCAN_TRUNCATED;
 			goto out_unlock;
 		}
+		/* A regular file page may have failed to be read */
+		if (!PageUptodate(page)) {
+			result = SCAN_FAIL;
+			goto out_unlock;
+		}
 		spin_unlock_irq(&mapping->tree_lock);
 
+		/* Buffers would point into the small page */
+		if (page_has_private(page) &&
+		    !try_to_release_page(page, GFP_KERNEL)) {
+			result = SCAN_PAGE_HAS_PRIVATE;
+			goto out_isolate_failed;
+		}
+
 		if (isolate_lru_page(page)) {
 			result = SCAN_DEL_PAGE_LRU;
 			goto out_isolate_failed;
@@ -1454,7 +1529,7 @@ static void collapse_shmem(struct mm_struct *mm,
 	if (result == SCAN_SUCCEED && index < end) {
 		int n = end - index;
 
-		if (!shmem_charge(mapping->host, n)) {
+		if (!is_shmem || !shmem_charge(mapping->host, n)) {
 			result = SCAN_FAIL;
 			goto tree_locked;
 		}
@@ -1466,6 +1541,20 @@ static void collapse_shmem(struct mm_struct *mm,
 		nr_none += n;
 	}
 
+	/*
+	 * The huge page of a regular file must not be written to.  Pairs with
+	 * the barrier in do_dentry_open(): either the opener for write sees
+	 * nr_thps and drops the page cache, or we see its i_writecount.
+	 */
+	if (result == SCAN_SUCCEED && !is_shmem) {
+		filemap_nr_thps_inc(mapping);
+		smp_mb();
+		if (atomic_read(&mapping->host->i_writecount) > 0) {
+			filemap_nr_thps_dec(mapping);
+			result = SCAN_FAIL;
+		}
+	}
+
 tree_locked:
 	spin_unlock_irq(&mapping->tree_lock);
 tree_unlocked:
@@ -1491,7 +1580,10 @@ static void collapse_shmem(struct mm_struct *mm,
 		}
 
 		local_irq_save(flags);
-		__inc_node_page_state(new_page, NR_SHMEM_THPS);
+		if (is_shmem)
+			__inc_node_page_state(new_page, NR_SHMEM_THPS);
+		else
+			__inc_node_page_state(new_page, NR_FILE_THPS);
 		if (nr_none) {
 			__mod_node_page_state(zone->zone_pgdat, NR_FILE_PAGES, nr_none);
 			__mod_node_page_state(zone->zone_pgdat, NR_SHMEM, nr_none);
@@ -1505,17 +1597,22 @@ static void collapse_shmem(struct mm_struct *mm,
 		retract_page_tables(mapping, start);
 
 		/* Everything is ready, let's unfreeze the new_page */
-		set_page_dirty(new_page);
+		if (is_shmem)
+			set_page_dirty(new_page);
 		SetPageUptodate(new_page);
 		page_ref_unfreeze(new_page, HPAGE_PMD_NR);
 		mem_cgroup_commit_charge(new_page, memcg, false, true);
-		lru_cache_add_anon(new_page);
+		if (is_shmem)
+			lru_cache_add_anon(new_page);
+		else
+			lru_cache_add_file(new_page);
 		unlock_page(new_page);
 
 		*hpage = NULL;
 	} else {
 		/* Something went wrong: rollback changes to the radix-tree */
-		shmem_uncharge(mapping->host, nr_none);
+		if (is_shmem)
+			shmem_uncharge(mapping->host, nr_none);
 		spin_lock_irq(&mapping->tree_lock);
 		radix_tree_for_each_slot(slot, &mapping->page_tree, &iter,
 				start) {
@@ -1560,10 +1657,10 @@ static void collapse_shmem(struct mm_struct *mm,
 	/* TODO: tracepoints */
 }
 
-static void khugepaged_scan_shmem(struct mm_struct *mm,
-		struct address_space *mapping,
+static void khugepaged_scan_file(struct mm_struct *mm, struct file *file,
 		pgoff_t start, struct page **hpage)
 {
+	struct address_space *mapping = file->f_mapping;
 	struct page *page = NULL;
 	struct radix_tree_iter iter;
 	void **slot;
@@ -1586,6 +1683,9 @@ static void khugepaged_scan_shmem(struct mm_struct *mm,
 		}
 
 		if (radix_tree_exception(page)) {
+			/* Shadow entries of a regular file are holes */
+			if (!shmem_file(file))
+				continue;
 			if (++swap > khugepaged_max_ptes_swap) {
 				result = SCAN_EXCEED_SWAP_PTE;
 				break;
@@ -1610,7 +1710,8 @@ static void khugepaged_scan_shmem(struct mm_struct *mm,
 			break;
 		}
 
-		if (page_count(page) != 1 + page_mapcount(page)) {
+		if (page_count(page) !=
+		    1 + page_mapcount(page) + page_has_private(page)) {
 			result = SCAN_PAGE_COUNT;
 			break;
 		}
@@ -1635,15 +1736,14 @@ static void khugepaged_scan_shmem(struct mm_struct *mm,
 			result = SCAN_EXCEED_NONE_PTE;
 		} else {
 			node = khugepaged_find_target_node();
-			collapse_shmem(mm, mapping, start, hpage, node);
+			collapse_file(mm, file, start, hpage, node);
 		}
 	}
 
 	/* TODO: tracepoints */
 }
 #else
-static void khugepaged_scan_shmem(struct mm_struct *mm,
-		struct address_space *mapping,
+static void khugepaged_scan_file(struct mm_struct *mm, struct file *file,
 		pgoff_t start, struct page **hpage)
 {
 	BUILD_BUG();
@@ -1689,7 +1789,7 @@ static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
 			progress++;
 			break;
 		}
-		if (!hugepage_vma_check(vma)) {
+		if (!hugepage_vma_check(vma, vma->vm_flags)) {
 skip:
 			progress++;
 			continue;
@@ -1713,17 +1813,17 @@ static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
 			VM_BUG_ON(khugepaged_scan.address < hstart ||
 				  khugepaged_scan.address + HPAGE_PMD_SIZE >
 				  hend);
-			if (shmem_file(vma->vm_file)) {
+			if (IS_ENABLED(CONFIG_SHMEM) && vma->vm_file) {
 				struct file *file;
 				pgoff_t pgoff = linear_page_index(vma,
 						khugepaged_scan.address);
-				if (!shmem_huge_enabled(vma))
+				if (shmem_file(vma->vm_file) &&
+				    !shmem_huge_enabled(vma))
 					goto skip;
 				file = get_file(vma->vm_file);
 				up_read(&mm->mmap_sem);
 				ret = 1;
-				khugepaged_scan_shmem(mm, file->f_mapping,
-						pgoff, hpage);
+				khugepaged_scan_file(mm, file, pgoff, hpage);
 				fput(file);
 			} else {
 				ret = khugepaged_scan_pmd(mm, vma,
@@ -65,6 +65,7 @@
 #include <linux/lockdep.h>
 #include <linux/file.h>
 #include <linux/tracehook.h>
+#include <linux/srcu.h>
 #include "internal.h"
 #include <net/sock.h>
 #include <net/ip.h>
@@ -246,11 +247,6 @@ struct cgroup_subsys_state *vmpressure_to_css(struct vmpressure *vmpr)
 	return &container_of(vmpr, struct mem_cgroup, vmpressure)->css;
 }
 
-static inline bool mem_cgroup_is_root(struct mem_cgroup *memcg)
-{
-	return (memcg == root_mem_cgroup);
-}
-
 #ifndef CONFIG_SLOB
 /*
  * This will be the memcg's index in each cache's ->memcg_params.memcg_caches.
@@ -577,6 +573,143 @@ static unsigned long memcg_sum_events(struct mem_cgroup *memcg,
 	return val;
 }
 
+/*
+ * The statistics readers see the totals of the last flush through
+ * cgroup_rstat_flush(), and only flush when enough has changed since:
+ * each cpu adds a unit to memcg_stats_flush_threshold per
+ * MEMCG_STATS_BATCH changes, and a flush is due once every cpu may have
+ * added one.  The periodic flush bounds the age of the totals.
+ */
+#define MEMCG_STATS_BATCH		64U
+#define MEMCG_STATS_FLUSH_PERIOD	(2UL * HZ)
+
+static DEFINE_PER_CPU(unsigned int, memcg_stats_updates);
+static atomic_t memcg_stats_flush_threshold = ATOMIC_INIT(0);
+
+static void memcg_stats_flush_fn(struct work_struct *work);
+static DECLARE_DEFERRABLE_WORK(memcg_stats_flush_work, memcg_stats_flush_fn);
+
+/* Called with preemption disabled after a percpu counter changed by @val */
+void memcg_rstat_updated(struct mem_cgroup *memcg, int val)
+{
+	unsigned int x;
+
+	cgroup_rstat_updated(memcg->css.cgroup, smp_processor_id());
+
+	x = __this_cpu_add_return(memcg_stats_updates, abs(val));
+	if (x > MEMCG_STATS_BATCH) {
+		atomic_add(x / MEMCG_STATS_BATCH, &memcg_stats_flush_threshold);
+		__this_cpu_write(memcg_stats_updates, 0);
+	}
+}
+EXPORT_SYMBOL(memcg_rstat_updated);
+
+static void __mem_cgroup_flush_stats(void)
+{
+	atomic_set(&memcg_stats_flush_threshold, 0);
+	cgroup_rstat_flush(root_mem_cgroup->css.cgroup);
+}
+
+static void mem_cgroup_flush_stats(void)
+{
+	if (atomic_read(&memcg_stats_flush_threshold) > num_online_cpus())
+		__mem_cgroup_flush_stats();
+}
+
+static void memcg_stats_flush_fn(struct work_struct *work)
+{
+	__mem_cgroup_flush_stats();
+	queue_delayed_work(system_unbound_wq, &memcg_stats_flush_work,
+			   MEMCG_STATS_FLUSH_PERIOD);
+}
+
+static void mem_cgroup_css_rstat_flush(struct cgroup_subsys_state *css,
+				       int cpu)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_css(css);
+	struct mem_cgroup *parent = parent_mem_cgroup(memcg);
+	struct memcg_vmstats *vmstats = &memcg->vmstats;
+	struct mem_cgroup_stat_cpu *statc;
+	long delta, v;
+	int i;
+
+	/* the root sees the whole tree, even without use_hierarchy */
+	if (!parent && !mem_cgroup_is_root(memcg))
+		parent = root_mem_cgroup;
+
+	statc = per_cpu_ptr(memcg->stat, cpu);
+
+	for (i = 0; i < MEMCG_NR_STAT; i++) {
+		/*
+		 * The pending deltas of the children are not per cpu: the
+		 * first cpu this memcg is flushed for picks them all up.
+		 */
+		delta = vmstats->state_pending[i];
+		if (delta)
+			vmstats->state_pending[i] = 0;
+
+		v = READ_ONCE(statc->count[i]);
+		if (v != statc->count_prev[i]) {
+			vmstats->state_local[i] += v - statc->count_prev[i];
+			delta += v - statc->count_prev[i];
+			statc->count_prev[i] = v;
+		}
+
+		if (!delta)
+			continue;
+
+		vmstats->state[i] += delta;
+		if (parent)
+			parent->vmstats.state_pending[i] += delta;
+	}
+
+	for (i = 0; i < MEMCG_NR_EVENTS; i++) {
+		delta = vmstats->events_pending[i];
+		if (delta)
+			vmstats->events_pending[i] = 0;
+
+		v = READ_ONCE(statc->events[i]);
+		if (v != statc->events_prev[i]) {
+			vmstats->events_local[i] += v - statc->events_prev[i];
+			delta += v - statc->events_prev[i];
+			statc->events_prev[i] = v;
+		}
+
+		if (!delta)
+			continue;
+
+		vmstats->events[i] += delta;
+		if (parent)
+			parent->vmstats.events_pending[i] += delta;
+	}
+}
+
+/* idx can be of type enum memcg_stat_item or node_stat_item */
+static unsigned long memcg_tree_state(struct mem_cgroup *memcg, int idx)
+{
+	long x = READ_ONCE(memcg->vmstats.state[idx]);
+
+	return x < 0 ? 0 : x;
+}
+
+static unsigned long memcg_local_state(struct mem_cgroup *memcg, int idx)
+{
+	long x = READ_ONCE(memcg->vmstats.state_local[idx]);
+
+	return x < 0 ? 0 : x;
+}
+
+/* idx can be of type enum memcg_event_item or vm_event_item */
+static unsigned long memcg_tree_events(struct mem_cgroup *memcg, int idx)
+{
+	return READ_ONCE(memcg->vmstats.events[idx]);
+}
+
+static unsigned long memcg_local_events(struct mem_cgroup *memcg, int idx)
+{
+	return READ_ONCE(memcg->vmstats.events_local[idx]);
+}
+
 static void mem_cgroup_charge_statistics(struct mem_cgroup *memcg,
 					 struct page *page,
 					 bool compound, int nr_pages)
@@ -586,23 +719,23 @@ static void mem_cgroup_charge_statistics(struct mem_cgroup *memcg,
 	 * counted as CACHE even if it's on ANON LRU.
 	 */
 	if (PageAnon(page))
-		__this_cpu_add(memcg->stat->count[MEMCG_RSS], nr_pages);
+		__mod_memcg_state(memcg, MEMCG_RSS, nr_pages);
 	else {
-		__this_cpu_add(memcg->stat->count[MEMCG_CACHE], nr_pages);
+		__mod_memcg_state(memcg, MEMCG_CACHE, nr_pages);
 		if (PageSwapBacked(page))
-			__this_cpu_add(memcg->stat->count[NR_SHMEM], nr_pages);
+			__mod_memcg_state(memcg, NR_SHMEM, nr_pages);
 	}
 
 	if (compound) {
 		VM_BUG_ON_PAGE(!PageTransHuge(page), page);
-		__this_cpu_add(memcg->stat->count[MEMCG_RSS_HUGE], nr_pages);
+		__mod_memcg_state(memcg, MEMCG_RSS_HUGE, nr_pages);
 	}
 
 	/* pagein of a big page is an event. So, ignore page size */
 	if (nr_pages > 0)
-		__this_cpu_inc(memcg->stat->events[PGPGIN]);
+		__count_memcg_events(memcg, PGPGIN, 1);
 	else {
-		__this_cpu_inc(memcg->stat->events[PGPGOUT]);
+		__count_memcg_events(memcg, PGPGOUT, 1);
 		nr_pages = -nr_pages; /* for event */
 	}
 
@@ -906,6 +1039,173 @@ static void invalidate_reclaim_iterators(struct mem_cgroup *dead_memcg)
 	     iter != NULL;				\
 	     iter = mem_cgroup_iter(NULL, iter, NULL))
 
+#ifndef CONFIG_SLOB
+/*
+ * The shrinker maps of the memcgs below the root are all sized for
+ * memcg_shrinker_map_size shrinker ids, and are replaced by bigger copies
+ * when a shrinker gets an id past that. Readers and memcg_set_shrinker_bit()
+ * run under shrinker_srcu; the maps replaced are freed after it.
+ */
+static int memcg_shrinker_map_size;
+static DEFINE_MUTEX(memcg_shrinker_map_mutex);
+
+static struct memcg_shrinker_map *memcg_alloc_shrinker_map(int nr_bits)
+{
+	struct memcg_shrinker_map *map;
+
+	map = kvzalloc(sizeof(*map) + BITS_TO_LONGS(nr_bits) * sizeof(long),
+		       GFP_KERNEL);
+	if (map)
+		map->nr_bits = nr_bits;
+	return map;
+}
+
+static void memcg_free_shrinker_map_rcu(struct rcu_head *head)
+{
+	kvfree(container_of(head, struct memcg_shrinker_map, rcu));
+}
+
+static void memcg_free_shrinker_maps(struct mem_cgroup *memcg)
+{
+	int nid;
+
+	if (mem_cgroup_is_root(memcg))
+		return;
+
+	for_each_node(nid) {
+		struct mem_cgroup_per_node *pn = memcg->nodeinfo[nid];
+
+		kvfree(rcu_dereference_protected(pn->shrinker_map, true));
+		RCU_INIT_POINTER(pn->shrinker_map, NULL);
+	}
+}
+
+static int memcg_alloc_shrinker_maps(struct mem_cgroup *memcg)
+{
+	int nid, ret = 0;
+
+	if (mem_cgroup_is_root(memcg))
+		return 0;
+
+	mutex_lock(&memcg_shrinker_map_mutex);
+	for_each_node(nid) {
+		struct memcg_shrinker_map *map;
+
+		map = memcg_alloc_shrinker_map(memcg_shrinker_map_size);
+		if (!map) {
+			memcg_free_shrinker_maps(memcg);
+			ret = -ENOMEM;
+			break;
+		}
+		rcu_assign_pointer(memcg->nodeinfo[nid]->shrinker_map, map);
+	}
+	mutex_unlock(&memcg_shrinker_map_mutex);
+
+	return ret;
+}
+
+static int memcg_expand_one_shrinker_map(struct mem_cgroup *memcg,
+					 int nr_bits)
+{
+	int nid, i;
+
+	for_each_node(nid) {
+		struct mem_cgroup_per_node *pn = memcg->nodeinfo[nid];
+		struct memcg_shrinker_map *old, *new;
+
+		old = rcu_dereference_protected(pn->shrinker_map,
+				lockdep_is_held(&memcg_shrinker_map_mutex));
+		/* Not online yet: it will allocate maps of the new size */
+		if (!old)
+			return 0;
+
+		new = memcg_alloc_shrinker_map(nr_bits);
+		if (!new)
+			return -ENOMEM;
+
+		/*
+		 * Publish the new map before copying the old bits: a bit set
+		 * in the old map after the copy is set again in the new one
+		 * by memcg_set_shrinker_bit(), which rechecks the map.
+		 */
+		rcu_assign_pointer(pn->shrinker_map, new);
+		smp_mb();
+		for_each_set_bit(i, old->map, old->nr_bits)
+			set_bit(i, new->map);
+
+		call_srcu(&shrinker_srcu, &old->rcu,
+			  memcg_free_shrinker_map_rcu);
+	}
+	return 0;
+}
+
+int memcg_expand_shrinker_maps(int new_id)
+{
+	int nr_bits = round_up(new_id + 1, BITS_PER_LONG);
+	struct mem_cgroup *memcg;
+	int ret = 0;
+
+	mutex_lock(&memcg_shrinker_map_mutex);
+	if (nr_bits <= memcg_shrinker_map_size)
+		goto unlock;
+
+	for_each_mem_cgroup(memcg) {
+		if (mem_cgroup_is_root(memcg))
+			continue;
+		ret = memcg_expand_one_shrinker_map(memcg, nr_bits);
+		if (ret) {
+			mem_cgroup_iter_break(NULL, memcg);
+			goto unlock;
+		}
+	}
+	memcg_shrinker_map_size = nr_bits;
+unlock:
+	mutex_unlock(&memcg_shrinker_map_mutex);
+	return ret;
+}
+
+/*
+ * Called when @memcg gets its first objects in a list_lru of the shrinker
+ * with @shrinker_id on @nid. The root memcg has no map: reclaim of the root
+ * calls all the memcg aware shrinkers.
+ */
+void memcg_set_shrinker_bit(struct mem_cgroup *memcg, int nid,
+			    int shrinker_id)
+{
+	struct memcg_shrinker_map *map, *cur;
+	int idx;
+
+	if (shrinker_id < 0 || !memcg || mem_cgroup_is_root(memcg))
+		return;
+
+	idx = srcu_read_lock(&shrinker_srcu);
+	cur = srcu_dereference(memcg->nodeinfo[nid]->shrinker_map,
+			       &shrinker_srcu);
+	do {
+		map = cur;
+		if (!map || shrinker_id >= map->nr_bits)
+			break;
+		/* Pairs with the barrier in shrink_slab_memcg() */
+		smp_mb__before_atomic();
+		set_bit(shrinker_id, map->map);
+		/* Pairs with the barrier in memcg_expand_one_shrinker_map() */
+		smp_mb__after_atomic();
+		cur = srcu_dereference(memcg->nodeinfo[nid]->shrinker_map,
+				       &shrinker_srcu);
+	} while (cur != map);
+	srcu_read_unlock(&shrinker_srcu, idx);
+}
+#else
+static int memcg_alloc_shrinker_maps(struct mem_cgroup *memcg)
+{
+	return 0;
+}
+
+static void memcg_free_shrinker_maps(struct mem_cgroup *memcg)
+{
+}
+#endif /* !CONFIG_SLOB */
+
 /**
  * mem_cgroup_scan_tasks - iterate over tasks of a memory cgroup hierarchy
  * @memcg: hierarchy root
@@ -2415,8 +2715,7 @@ void mem_cgroup_split_huge_fixup(struct page *head)
 	for (i = 1; i < HPAGE_PMD_NR; i++)
 		head[i].mem_cgroup = head->mem_cgroup;
 
-	__this_cpu_sub(head->mem_cgroup->stat->count[MEMCG_RSS_HUGE],
-		       HPAGE_PMD_NR);
+	__mod_memcg_state(head->mem_cgroup, MEMCG_RSS_HUGE, -HPAGE_PMD_NR);
 }
 #endif /* CONFIG_TRANSPARENT_HUGEPAGE */
 
@@ -2424,7 +2723,7 @@ void mem_cgroup_split_huge_fixup(struct page *head)
 static void mem_cgroup_swap_statistics(struct mem_cgroup *memcg,
 				       int nr_entries)
 {
-	this_cpu_add(memcg->stat->count[MEMCG_SWAP], nr_entries);
+	mod_memcg_state(memcg, MEMCG_SWAP, nr_entries);
 }
 
 /**
@@ -2713,6 +3012,46 @@ static ssize_t mem_cgroup_force_empty_write(struct kernfs_open_file *of,
 	return mem_cgroup_force_empty(memcg) ?: nbytes;
 }
 
+/*
+ * Drops the clean and unmapped page cache (1), the slab objects (2) or both
+ * (3) charged to the cgroup and its descendants, as vm.drop_caches does for
+ * the whole system.
+ */
+static ssize_t mem_cgroup_drop_caches_write(struct kernfs_open_file *of,
+					    char *buf, size_t nbytes,
+					    loff_t off)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_css(of_css(of));
+	unsigned int nr_retries = MEM_CGROUP_RECLAIM_RETRIES;
+	unsigned int mode;
+	int err;
+
+	err = kstrtouint(strstrip(buf), 10, &mode);
+	if (err)
+		return err;
+	if (!mode || mode > 3)
+		return -EINVAL;
+
+	if (mode & 1) {
+		unsigned long cache;
+
+		lru_add_drain_all();
+		while (nr_retries &&
+		       (cache = memcg_tree_state(memcg, MEMCG_CACHE))) {
+			if (signal_pending(current))
+				return -EINTR;
+
+			/* Dirty and mapped pages stay: give up at some point */
+			if (!drop_pagecache_mem_cgroup_pages(memcg, cache))
+				nr_retries--;
+		}
+	}
+	if (mode & 2)
+		drop_slab_mem_cgroup(memcg);
+
+	return nbytes;
+}
+
 static u64 mem_cgroup_hierarchy_read(struct cgroup_subsys_state *css,
 				     struct cftype *cft)
 {
@@ -2751,43 +3090,33 @@ static int mem_cgroup_hierarchy_write(struct cgroup_subsys_state *css,
 
 static void tree_stat(struct mem_cgroup *memcg, unsigned long *stat)
 {
-	struct mem_cgroup *iter;
 	int i;
 
-	memset(stat, 0, sizeof(*stat) * MEMCG_NR_STAT);
-
-	for_each_mem_cgroup_tree(iter, memcg) {
-		for (i = 0; i < MEMCG_NR_STAT; i++)
-			stat[i] += memcg_page_state(iter, i);
-	}
+	for (i = 0; i < MEMCG_NR_STAT; i++)
+		stat[i] = memcg_tree_state(memcg, i);
 }
 
 static void tree_events(struct mem_cgroup *memcg, unsigned long *events)
 {
-	struct mem_cgroup *iter;
 	int i;
 
-	memset(events, 0, sizeof(*events) * MEMCG_NR_EVENTS);
-
-	for_each_mem_cgroup_tree(iter, memcg) {
-		for (i = 0; i < MEMCG_NR_EVENTS; i++)
-			events[i] += memcg_sum_events(iter, i);
-	}
+	for (i = 0; i < MEMCG_NR_EVENTS; i++)
+		events[i] = memcg_tree_events(memcg, i);
 }
 
 static unsigned long mem_cgroup_usage(struct mem_cgroup *memcg, bool swap)
 {
 	unsigned long val = 0;
 
+	/*
+	 * The root is not charged, it reports the totals as of the last
+	 * stats flush: this may be called with interrupts disabled.
+	 */
 	if (mem_cgroup_is_root(memcg)) {
-		struct mem_cgroup *iter;
-
-		for_each_mem_cgroup_tree(iter, memcg) {
-			val += memcg_page_state(iter, MEMCG_CACHE);
-			val += memcg_page_state(iter, MEMCG_RSS);
-			if (swap)
-				val += memcg_page_state(iter, MEMCG_SWAP);
-		}
+		val += memcg_tree_state(memcg, MEMCG_CACHE);
+		val += memcg_tree_state(memcg, MEMCG_RSS);
+		if (swap)
+			val += memcg_tree_state(memcg, MEMCG_SWAP);
 	} else {
 		if (!swap)
 			val = page_counter_read(&memcg->memory);
@@ -2920,7 +3249,7 @@ static void memcg_offline_kmem(struct mem_cgroup *memcg)
 	}
 	rcu_read_unlock();
 
-	memcg_drain_all_list_lrus(kmemcg_id, parent->kmemcg_id);
+	memcg_drain_all_list_lrus(kmemcg_id, parent);
 
 	memcg_free_cache_id(kmemcg_id);
 }
@@ -3186,17 +3515,19 @@ static int memcg_stat_show(struct seq_file *m, void *v)
 	BUILD_BUG_ON(ARRAY_SIZE(memcg1_stat_names) != ARRAY_SIZE(memcg1_stats));
 	BUILD_BUG_ON(ARRAY_SIZE(mem_cgroup_lru_names) != NR_LRU_LISTS);
 
+	mem_cgroup_flush_stats();
+
 	for (i = 0; i < ARRAY_SIZE(memcg1_stats); i++) {
 		if (memcg1_stats[i] == MEMCG_SWAP && !do_memsw_account())
 			continue;
 		seq_printf(m, "%s %lu\n", memcg1_stat_names[i],
-			   memcg_page_state(memcg, memcg1_stats[i]) *
+			   memcg_local_state(memcg, memcg1_stats[i]) *
 			   PAGE_SIZE);
 	}
 
 	for (i = 0; i < ARRAY_SIZE(memcg1_events); i++)
 		seq_printf(m, "%s %lu\n", memcg1_event_names[i],
-			   memcg_sum_events(memcg, memcg1_events[i]));
+			   memcg_local_events(memcg, memcg1_events[i]));
 
 	for (i = 0; i < NR_LRU_LISTS; i++)
 		seq_printf(m, "%s %lu\n", mem_cgroup_lru_names[i],
@@ -3215,23 +3546,16 @@ static int memcg_stat_show(struct seq_file *m, void *v)
 			   (u64)memsw * PAGE_SIZE);
 
 	for (i = 0; i < ARRAY_SIZE(memcg1_stats); i++) {
-		unsigned long long val = 0;
-
 		if (memcg1_stats[i] == MEMCG_SWAP && !do_memsw_account())
 			continue;
-		for_each_mem_cgroup_tree(mi, memcg)
-			val += memcg_page_state(mi, memcg1_stats[i]) *
-			PAGE_SIZE;
-		seq_printf(m, "total_%s %llu\n", memcg1_stat_names[i], val);
+		seq_printf(m, "total_%s %llu\n", memcg1_stat_names[i],
+			   (u64)memcg_tree_state(memcg, memcg1_stats[i]) *
+			   PAGE_SIZE);
 	}
 
-	for (i = 0; i < ARRAY_SIZE(memcg1_events); i++) {
-		unsigned long long val = 0;
-
-		for_each_mem_cgroup_tree(mi, memcg)
-			val += memcg_sum_events(mi, memcg1_events[i]);
-		seq_printf(m, "total_%s %llu\n", memcg1_event_names[i], val);
-	}
+	for (i = 0; i < ARRAY_SIZE(memcg1_events); i++)
+		seq_printf(m, "total_%s %llu\n", memcg1_event_names[i],
+			   (u64)memcg_tree_events(memcg, memcg1_events[i]));
 
 	for (i = 0; i < NR_LRU_LISTS; i++) {
 		unsigned long long val = 0;
@@ -3991,6 +4315,10 @@ static struct cftype mem_cgroup_legacy_files[] = {
 		.name = "force_empty",
 		.write = mem_cgroup_force_empty_write,
 	},
+	{
+		.name = "drop_caches",
+		.write = mem_cgroup_drop_caches_write,
+	},
 	{
 		.name = "use_hierarchy",
 		.write_u64 = mem_cgroup_hierarchy_write,
@@ -4251,6 +4579,9 @@ static struct mem_cgroup *mem_cgroup_alloc(void)
 #endif
 #ifdef CONFIG_CGROUP_WRITEBACK
 	INIT_LIST_HEAD(&memcg->cgwb_list);
+#endif
+#ifdef CONFIG_ZSWAP
+	zswap_lru_init(&memcg->zswap_lru);
 #endif
 	idr_replace(&mem_cgroup_idr, memcg, memcg->id.id);
 	return memcg;
@@ -4285,12 +4616,18 @@ mem_cgroup_css_alloc(struct cgroup_subsys_state *parent_css)
 		page_counter_init(&memcg->memsw, &parent->memsw);
 		page_counter_init(&memcg->kmem, &parent->kmem);
 		page_counter_init(&memcg->tcpmem, &parent->tcpmem);
+#ifdef CONFIG_ZSWAP
+		page_counter_init(&memcg->zswap, &parent->zswap);
+#endif
 	} else {
 		page_counter_init(&memcg->memory, NULL);
 		page_counter_init(&memcg->swap, NULL);
 		page_counter_init(&memcg->memsw, NULL);
 		page_counter_init(&memcg->kmem, NULL);
 		page_counter_init(&memcg->tcpmem, NULL);
+#ifdef CONFIG_ZSWAP
+		page_counter_init(&memcg->zswap, NULL);
+#endif
 		/*
 		 * Deeper hierachy with use_hierarchy == false doesn't make
 		 * much sense so let cgroup subsystem know about this
@@ -4323,9 +4660,20 @@ static int mem_cgroup_css_online(struct cgroup_subsys_state *css)
 {
 	struct mem_cgroup *memcg = mem_cgroup_from_css(css);
 
+	/*
+	 * The shrinker maps are allocated here: memcg_expand_shrinker_maps()
+	 * skips the memcgs that do not have them yet.
+	 */
+	if (memcg_alloc_shrinker_maps(memcg))
+		return -ENOMEM;
+
 	/* Online state pins memcg ID, memcg ID pins CSS */
 	atomic_set(&memcg->id.ref, 1);
 	css_get(css);
+
+	if (unlikely(mem_cgroup_is_root(memcg)))
+		queue_delayed_work(system_unbound_wq, &memcg_stats_flush_work,
+				   MEMCG_STATS_FLUSH_PERIOD);
 	return 0;
 }
 
@@ -4375,6 +4723,7 @@ static void mem_cgroup_css_free(struct cgroup_subsys_state *css)
 	cancel_work_sync(&memcg->high_work);
 	mem_cgroup_remove_from_trees(memcg);
 	memcg_free_kmem(memcg);
+	memcg_free_shrinker_maps(memcg);
 	mem_cgroup_free(memcg);
 }
 
@@ -4400,6 +4749,9 @@ static void mem_cgroup_css_reset(struct cgroup_subsys_state *css)
 	page_counter_limit(&memcg->memsw, PAGE_COUNTER_MAX);
 	page_counter_limit(&memcg->kmem, PAGE_COUNTER_MAX);
 	page_counter_limit(&memcg->tcpmem, PAGE_COUNTER_MAX);
+#ifdef CONFIG_ZSWAP
+	page_counter_limit(&memcg->zswap, PAGE_COUNTER_MAX);
+#endif
 	memcg->low = 0;
 	memcg->high = PAGE_COUNTER_MAX;
 	memcg->soft_limit = PAGE_COUNTER_MAX;
@@ -4584,8 +4936,8 @@ static int mem_cgroup_move_account(struct page *page,
 	spin_lock_irqsave(&from->move_lock, flags);
 
 	if (!anon && page_mapped(page)) {
-		__this_cpu_sub(from->stat->count[NR_FILE_MAPPED], nr_pages);
-		__this_cpu_add(to->stat->count[NR_FILE_MAPPED], nr_pages);
+		__mod_memcg_state(from, NR_FILE_MAPPED, -nr_pages);
+		__mod_memcg_state(to, NR_FILE_MAPPED, nr_pages);
 	}
 
 	/*
@@ -4597,16 +4949,14 @@ static int mem_cgroup_move_account(struct page *page,
 		struct address_space *mapping = page_mapping(page);
 
 		if (mapping_cap_account_dirty(mapping)) {
-			__this_cpu_sub(from->stat->count[NR_FILE_DIRTY],
-				       nr_pages);
-			__this_cpu_add(to->stat->count[NR_FILE_DIRTY],
-				       nr_pages);
+			__mod_memcg_state(from, NR_FILE_DIRTY, -nr_pages);
+			__mod_memcg_state(to, NR_FILE_DIRTY, nr_pages);
 		}
 	}
 
 	if (PageWriteback(page)) {
-		__this_cpu_sub(from->stat->count[NR_WRITEBACK], nr_pages);
-		__this_cpu_add(to->stat->count[NR_WRITEBACK], nr_pages);
+		__mod_memcg_state(from, NR_WRITEBACK, -nr_pages);
+		__mod_memcg_state(to, NR_WRITEBACK, nr_pages);
 	}
 
 	/*
@@ -4719,7 +5069,8 @@ static enum mc_target_type get_mctgt_type_thp(struct vm_area_struct *vma,
 
 	if (unlikely(is_swap_pmd(pmd))) {
 		VM_BUG_ON(thp_migration_supported() &&
-				  !is_pmd_migration_entry(pmd));
+				  !is_pmd_migration_entry(pmd) &&
+				  !is_pmd_swap_entry(pmd));
 		return ret;
 	}
 	page = pmd_page(pmd);
@@ -5299,6 +5650,7 @@ static int memory_stat_show(struct seq_file *m, void *v)
 	 * Current memory state:
 	 */
 
+	mem_cgroup_flush_stats();
 	tree_stat(memcg, stat);
 	tree_events(memcg, events);
 
@@ -5363,6 +5715,71 @@ static int memory_stat_show(struct seq_file *m, void *v)
 	return 0;
 }
 
+/*
+ * Reclaims the given amount from the cgroup without touching its limits.
+ * Optional "swappiness=<0-100>" and "type=anon|file" hints follow the
+ * amount.  Fails with -EAGAIN when reclaim stops making progress.
+ */
+static ssize_t memory_reclaim_write(struct kernfs_open_file *of, char *buf,
+				    size_t nbytes, loff_t off)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_css(of_css(of));
+	unsigned int nr_retries = MEM_CGROUP_RECLAIM_RETRIES;
+	unsigned long nr_to_reclaim, nr_reclaimed = 0;
+	bool may_swap = true, anon_only = false;
+	int swappiness, *swappinessp = NULL;
+	char *opt;
+	int err;
+
+	buf = strstrip(buf);
+	opt = strsep(&buf, " ");
+	if (!*opt)
+		return -EINVAL;
+	err = page_counter_memparse(opt, "", &nr_to_reclaim);
+	if (err)
+		return err;
+
+	while ((opt = strsep(&buf, " "))) {
+		if (!*opt)
+			continue;
+		if (!strncmp(opt, "swappiness=", 11)) {
+			if (kstrtoint(opt + 11, 10, &swappiness) ||
+			    swappiness < 0 || swappiness > 100)
+				return -EINVAL;
+			swappinessp = &swappiness;
+		} else if (!strcmp(opt, "type=anon")) {
+			anon_only = true;
+		} else if (!strcmp(opt, "type=file")) {
+			may_swap = false;
+		} else {
+			return -EINVAL;
+		}
+	}
+	if (anon_only && (!may_swap || (swappinessp && !swappiness)))
+		return -EINVAL;
+
+	while (nr_reclaimed < nr_to_reclaim) {
+		unsigned long reclaimed;
+
+		if (signal_pending(current))
+			return -EINTR;
+
+		/* Last try, get the pages in the per cpu pagevecs on the LRU */
+		if (!nr_retries)
+			lru_add_drain_all();
+
+		reclaimed = proactive_reclaim_mem_cgroup_pages(memcg,
+					nr_to_reclaim - nr_reclaimed,
+					may_swap, anon_only, swappinessp);
+		if (!reclaimed && !nr_retries--)
+			return -EAGAIN;
+
+		nr_reclaimed += reclaimed;
+	}
+
+	return nbytes;
+}
+
 static struct cftype memory_files[] = {
 	{
 		.name = "current",
@@ -5398,6 +5815,14 @@ static struct cftype memory_files[] = {
 		.flags = CFTYPE_NOT_ON_ROOT,
 		.seq_show = memory_stat_show,
 	},
+	{
+		.name = "reclaim",
+		.write = memory_reclaim_write,
+	},
+	{
+		.name = "drop_caches",
+		.write = mem_cgroup_drop_caches_write,
+	},
 	{ }	/* terminate */
 };
 
@@ -5408,6 +5833,7 @@ struct cgroup_subsys memory_cgrp_subsys = {
 	.css_released = mem_cgroup_css_released,
 	.css_free = mem_cgroup_css_free,
 	.css_reset = mem_cgroup_css_reset,
+	.css_rstat_flush = mem_cgroup_css_rstat_flush,
 	.can_attach = mem_cgroup_can_attach,
 	.cancel_attach = mem_cgroup_cancel_attach,
 	.post_attach = mem_cgroup_move_task,
@@ -5642,11 +6068,11 @@ static void uncharge_batch(const struct uncharge_gather *ug)
 	}
 
 	local_irq_save(flags);
-	__this_cpu_sub(ug->memcg->stat->count[MEMCG_RSS], ug->nr_anon);
-	__this_cpu_sub(ug->memcg->stat->count[MEMCG_CACHE], ug->nr_file);
-	__this_cpu_sub(ug->memcg->stat->count[MEMCG_RSS_HUGE], ug->nr_huge);
-	__this_cpu_sub(ug->memcg->stat->count[NR_SHMEM], ug->nr_shmem);
-	__this_cpu_add(ug->memcg->stat->events[PGPGOUT], ug->pgpgout);
+	__mod_memcg_state(ug->memcg, MEMCG_RSS, -ug->nr_anon);
+	__mod_memcg_state(ug->memcg, MEMCG_CACHE, -ug->nr_file);
+	__mod_memcg_state(ug->memcg, MEMCG_RSS_HUGE, -ug->nr_huge);
+	__mod_memcg_state(ug->memcg, NR_SHMEM, -ug->nr_shmem);
+	__count_memcg_events(ug->memcg, PGPGOUT, ug->pgpgout);
 	__this_cpu_add(ug->memcg->stat->nr_page_events, nr_pages);
 	memcg_check_events(ug->memcg, ug->dummy_page);
 	local_irq_restore(flags);
@@ -5874,7 +6300,7 @@ bool mem_cgroup_charge_skmem(struct mem_cgroup *memcg, unsigned int nr_pages)
 	if (in_softirq())
 		gfp_mask = GFP_NOWAIT;
 
-	this_cpu_add(memcg->stat->count[MEMCG_SOCK], nr_pages);
+	mod_memcg_state(memcg, MEMCG_SOCK, nr_pages);
 
 	if (try_charge(memcg, gfp_mask, nr_pages) == 0)
 		return true;
@@ -5895,7 +6321,7 @@ void mem_cgroup_uncharge_skmem(struct mem_cgroup *memcg, unsigned int nr_pages)
 		return;
 	}
 
-	this_cpu_sub(memcg->stat->count[MEMCG_SOCK], nr_pages);
+	mod_memcg_state(memcg, MEMCG_SOCK, -nr_pages);
 
 	refill_stock(memcg, nr_pages);
 }
@@ -5962,6 +6388,95 @@ static int __init mem_cgroup_init(void)
 }
 subsys_initcall(mem_cgroup_init);
 
+#ifdef CONFIG_ZSWAP
+/*
+ * zswap charges the compressed copy of a page to the memcg of the page, by
+ * the byte.  The memory counters of the memcg are charged for the pages its
+ * compressed bytes round up to, and so is its zswap counter, which
+ * memory.zswap.max limits.
+ */
+
+/**
+ * mem_cgroup_zswap_get - get the memcg to charge the compressed @page to
+ * @page: the page being swapped out
+ *
+ * Returns the memcg with a reference, or NULL for the root memcg, which is
+ * not charged.
+ */
+struct mem_cgroup *mem_cgroup_zswap_get(struct page *page)
+{
+	struct mem_cgroup *memcg;
+
+	if (mem_cgroup_disabled())
+		return NULL;
+
+	rcu_read_lock();
+	memcg = page->mem_cgroup;
+	if (memcg && (mem_cgroup_is_root(memcg) || !css_tryget(&memcg->css)))
+		memcg = NULL;
+	rcu_read_unlock();
+
+	return memcg;
+}
+
+void mem_cgroup_zswap_put(struct mem_cgroup *memcg)
+{
+	if (memcg)
+		css_put(&memcg->css);
+}
+
+struct zswap_lru *mem_cgroup_zswap_lru(struct mem_cgroup *memcg)
+{
+	return &memcg->zswap_lru;
+}
+
+/* Whether @memcg and its ancestors are all below their memory.zswap.max */
+bool mem_cgroup_zswap_may_store(struct mem_cgroup *memcg)
+{
+	for (; memcg && memcg != root_mem_cgroup;
+	     memcg = parent_mem_cgroup(memcg))
+		if (page_counter_read(&memcg->zswap) >=
+		    READ_ONCE(memcg->zswap.limit))
+			return false;
+	return true;
+}
+
+static void mem_cgroup_zswap_counters(struct mem_cgroup *memcg, long nr_pages)
+{
+	if (nr_pages > 0) {
+		page_counter_charge(&memcg->zswap, nr_pages);
+		page_counter_charge(&memcg->memory, nr_pages);
+		if (do_memsw_account())
+			page_counter_charge(&memcg->memsw, nr_pages);
+	} else if (nr_pages < 0) {
+		page_counter_uncharge(&memcg->zswap, -nr_pages);
+		page_counter_uncharge(&memcg->memory, -nr_pages);
+		if (do_memsw_account())
+			page_counter_uncharge(&memcg->memsw, -nr_pages);
+	}
+}
+
+/*
+ * The byte count is atomic, so the page deltas of concurrent charges and
+ * uncharges always add up to the pages of the final count.
+ */
+void mem_cgroup_charge_zswap(struct mem_cgroup *memcg, size_t size)
+{
+	long bytes = atomic_long_add_return(size, &memcg->zswap_bytes);
+
+	mem_cgroup_zswap_counters(memcg, DIV_ROUND_UP(bytes, PAGE_SIZE) -
+				  DIV_ROUND_UP(bytes - size, PAGE_SIZE));
+}
+
+void mem_cgroup_uncharge_zswap(struct mem_cgroup *memcg, size_t size)
+{
+	long bytes = atomic_long_sub_return(size, &memcg->zswap_bytes);
+
+	mem_cgroup_zswap_counters(memcg, DIV_ROUND_UP(bytes, PAGE_SIZE) -
+				  DIV_ROUND_UP(bytes + size, PAGE_SIZE));
+}
+#endif /* CONFIG_ZSWAP */
+
 #ifdef CONFIG_MEMCG_SWAP
 static struct mem_cgroup *mem_cgroup_id_get_online(struct mem_cgroup *memcg)
 {
@@ -6213,6 +6728,49 @@ static ssize_t swap_max_write(struct kernfs_open_file *of,
 	return nbytes;
 }
 
+#ifdef CONFIG_ZSWAP
+static u64 zswap_current_read(struct cgroup_subsys_state *css,
+			      struct cftype *cft)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_css(css);
+
+	return (u64)page_counter_read(&memcg->zswap) * PAGE_SIZE;
+}
+
+static int zswap_max_show(struct seq_file *m, void *v)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_css(seq_css(m));
+	unsigned long max = READ_ONCE(memcg->zswap.limit);
+
+	if (max == PAGE_COUNTER_MAX)
+		seq_puts(m, "max\n");
+	else
+		seq_printf(m, "%llu\n", (u64)max * PAGE_SIZE);
+
+	return 0;
+}
+
+/*
+ * The compressed pages already stored above a lowered limit stay until
+ * the memcg next stores, which writes its oldest ones back to swap.
+ */
+static ssize_t zswap_max_write(struct kernfs_open_file *of,
+			       char *buf, size_t nbytes, loff_t off)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_css(of_css(of));
+	unsigned long max;
+	int err;
+
+	buf = strstrip(buf);
+	err = page_counter_memparse(buf, "max", &max);
+	if (err)
+		return err;
+
+	xchg(&memcg->zswap.limit, max);
+	return nbytes;
+}
+#endif
+
 static struct cftype swap_files[] = {
 	{
 		.name = "swap.current",
@@ -6225,6 +6783,19 @@ static struct cftype swap_files[] = {
 		.seq_show = swap_max_show,
 		.write = swap_max_write,
 	},
+#ifdef CONFIG_ZSWAP
+	{
+		.name = "zswap.current",
+		.flags = CFTYPE_NOT_ON_ROOT,
+		.read_u64 = zswap_current_read,
+	},
+	{
+		.name = "zswap.max",
+		.flags = CFTYPE_NOT_ON_ROOT,
+		.seq_show = zswap_max_show,
+		.write = zswap_max_write,
+	},
+#endif
 	{ }	/* terminate */
 };
 
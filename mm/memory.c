@@ -64,6 +64,7 @@
 #include <linux/elf.h>
 #include <linux/gfp.h>
 #include <linux/migrate.h>
+#include <linux/mempolicy.h>
 #include <linux/string.h>
 #include <linux/dma-debug.h>
 #include <linux/debugfs.h>
@@ -939,8 +940,8 @@ struct page *vm_normal_page_pmd(struct vm_area_struct *vma, unsigned long addr,
 
 static inline unsigned long
 copy_one_pte(struct mm_struct *dst_mm, struct mm_struct *src_mm,
-		pte_t *dst_pte, pte_t *src_pte, struct vm_area_struct *vma,
-		unsigned long addr, int *rss)
+		pte_t *dst_pte, pte_t *src_pte, struct vm_area_struct *dst_vma,
+		struct vm_area_struct *vma, unsigned long addr, int *rss)
 {
 	unsigned long vm_flags = vma->vm_flags;
 	pte_t pte = *src_pte;
@@ -978,6 +979,8 @@ copy_one_pte(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 				pte = swp_entry_to_pte(entry);
 				if (pte_swp_soft_dirty(*src_pte))
 					pte = pte_swp_mksoft_dirty(pte);
+				if (pte_swp_uffd_wp(*src_pte))
+					pte = pte_swp_mkuffd_wp(pte);
 				set_pte_at(src_mm, addr, src_pte, pte);
 			}
 		} else if (is_device_private_entry(entry)) {
@@ -1010,6 +1013,9 @@ copy_one_pte(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 				set_pte_at(src_mm, addr, src_pte, pte);
 			}
 		}
+		/* the child is not write protected without an uffd context */
+		if (pte_swp_uffd_wp(pte) && !(dst_vma->vm_flags & VM_UFFD_WP))
+			pte = pte_swp_clear_uffd_wp(pte);
 		goto out_set_pte;
 	}
 
@@ -1030,6 +1036,9 @@ copy_one_pte(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 		pte = pte_mkclean(pte);
 	pte = pte_mkold(pte);
 
+	if (!(dst_vma->vm_flags & VM_UFFD_WP))
+		pte = pte_clear_uffd_wp(pte);
+
 	page = vm_normal_page(vma, addr, pte);
 	if (page) {
 		get_page(page);
@@ -1056,7 +1065,8 @@ copy_one_pte(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 }
 
 static int copy_pte_range(struct mm_struct *dst_mm, struct mm_struct *src_mm,
-		   pmd_t *dst_pmd, pmd_t *src_pmd, struct vm_area_struct *vma,
+		   pmd_t *dst_pmd, pmd_t *src_pmd,
+		   struct vm_area_struct *dst_vma, struct vm_area_struct *vma,
 		   unsigned long addr, unsigned long end)
 {
 	pte_t *orig_src_pte, *orig_dst_pte;
@@ -1095,7 +1105,7 @@ static int copy_pte_range(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 			continue;
 		}
 		entry.val = copy_one_pte(dst_mm, src_mm, dst_pte, src_pte,
-							vma, addr, rss);
+					 dst_vma, vma, addr, rss);
 		if (entry.val)
 			break;
 		progress += 8;
@@ -1119,7 +1129,8 @@ static int copy_pte_range(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 }
 
 static inline int copy_pmd_range(struct mm_struct *dst_mm, struct mm_struct *src_mm,
-		pud_t *dst_pud, pud_t *src_pud, struct vm_area_struct *vma,
+		pud_t *dst_pud, pud_t *src_pud,
+		struct vm_area_struct *dst_vma, struct vm_area_struct *vma,
 		unsigned long addr, unsigned long end)
 {
 	pmd_t *src_pmd, *dst_pmd;
@@ -1146,14 +1157,15 @@ static inline int copy_pmd_range(struct mm_struct *dst_mm, struct mm_struct *src
 		if (pmd_none_or_clear_bad(src_pmd))
 			continue;
 		if (copy_pte_range(dst_mm, src_mm, dst_pmd, src_pmd,
-						vma, addr, next))
+						dst_vma, vma, addr, next))
 			return -ENOMEM;
 	} while (dst_pmd++, src_pmd++, addr = next, addr != end);
 	return 0;
 }
 
 static inline int copy_pud_range(struct mm_struct *dst_mm, struct mm_struct *src_mm,
-		p4d_t *dst_p4d, p4d_t *src_p4d, struct vm_area_struct *vma,
+		p4d_t *dst_p4d, p4d_t *src_p4d,
+		struct vm_area_struct *dst_vma, struct vm_area_struct *vma,
 		unsigned long addr, unsigned long end)
 {
 	pud_t *src_pud, *dst_pud;
@@ -1180,14 +1192,15 @@ static inline int copy_pud_range(struct mm_struct *dst_mm, struct mm_struct *src
 		if (pud_none_or_clear_bad(src_pud))
 			continue;
 		if (copy_pmd_range(dst_mm, src_mm, dst_pud, src_pud,
-						vma, addr, next))
+						dst_vma, vma, addr, next))
 			return -ENOMEM;
 	} while (dst_pud++, src_pud++, addr = next, addr != end);
 	return 0;
 }
 
 static inline int copy_p4d_range(struct mm_struct *dst_mm, struct mm_struct *src_mm,
-		pgd_t *dst_pgd, pgd_t *src_pgd, struct vm_area_struct *vma,
+		pgd_t *dst_pgd, pgd_t *src_pgd,
+		struct vm_area_struct *dst_vma, struct vm_area_struct *vma,
 		unsigned long addr, unsigned long end)
 {
 	p4d_t *src_p4d, *dst_p4d;
@@ -1202,14 +1215,14 @@ static inline int copy_p4d_range(struct mm_struct *dst_mm, struct mm_struct *src
 		if (p4d_none_or_clear_bad(src_p4d))
 			continue;
 		if (copy_pud_range(dst_mm, src_mm, dst_p4d, src_p4d,
-						vma, addr, next))
+						dst_vma, vma, addr, next))
 			return -ENOMEM;
 	} while (dst_p4d++, src_p4d++, addr = next, addr != end);
 	return 0;
 }
 
 int copy_page_range(struct mm_struct *dst_mm, struct mm_struct *src_mm,
-		struct vm_area_struct *vma)
+		struct vm_area_struct *dst_vma, struct vm_area_struct *vma)
 {
 	pgd_t *src_pgd, *dst_pgd;
 	unsigned long next;
@@ -1264,7 +1277,7 @@ int copy_page_range(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 		if (pgd_none_or_clear_bad(src_pgd))
 			continue;
 		if (unlikely(copy_p4d_range(dst_mm, src_mm, dst_pgd, src_pgd,
-					    vma, addr, next))) {
+					    dst_vma, vma, addr, next))) {
 			ret = -ENOMEM;
 			break;
 		}
@@ -1603,20 +1616,18 @@ void zap_page_range(struct vm_area_struct *vma, unsigned long start,
 	tlb_gather_mmu(&tlb, mm, start, end);
 	update_hiwater_rss(mm);
 	mmu_notifier_invalidate_range_start(mm, start, end);
-	for ( ; vma && vma->vm_start < end; vma = vma->vm_next) {
+	for ( ; vma && vma->vm_start < end; vma = vma->vm_next)
 		unmap_single_vma(&tlb, vma, start, end, NULL);
 
-		/*
-		 * zap_page_range does not specify whether mmap_sem should be
-		 * held for read or write. That allows parallel zap_page_range
-		 * operations to unmap a PTE and defer a flush meaning that
-		 * this call observes pte_none and fails to flush the TLB.
-		 * Rather than adding a complex API, ensure that no stale
-		 * TLB entries exist when this call returns.
-		 */
-		flush_tlb_range(vma, start, end);
-	}
-
+	/*
+	 * zap_page_range does not specify whether mmap_sem should be held
+	 * for read or write.  That allows parallel zap_page_range
+	 * operations to unmap a PTE and defer a flush, meaning that this
+	 * call observes pte_none and fails to flush the TLB.
+	 * tlb_finish_mmu() detects such concurrent batching and then
+	 * flushes the whole range, so the VMAs are covered by a single
+	 * shootdown instead of one per VMA.
+	 */
 	mmu_notifier_invalidate_range_end(mm, start, end);
 	tlb_finish_mmu(&tlb, start, end);
 }
@@ -2402,6 +2413,106 @@ static void fault_dirty_shared_page(struct vm_area_struct *vma,
 		file_update_time(vma->vm_file);
 }
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * Tells whether the vma, or the pmd the speculative page fault found,
+ * changed since the fault started.  Called with interrupts disabled, which
+ * holds off the TLB flush which precedes the freeing of the page table.
+ */
+static bool vma_has_changed(struct vm_fault *vmf)
+{
+	if (RB_EMPTY_NODE(&vmf->vma->vm_rb))
+		return true;
+	if (read_seqcount_retry(&vmf->vma->vm_sequence, vmf->sequence))
+		return true;
+	return pmd_val(READ_ONCE(*vmf->pmd)) != pmd_val(vmf->orig_pmd);
+}
+
+/*
+ * Take the page table lock, and for a speculative page fault check that
+ * the vma is still the one the fault started with.  The lock is only
+ * tried: the unmapper may be waiting for the TLB flush IPI with it held.
+ */
+static bool pte_spinlock(struct vm_fault *vmf)
+{
+	bool ret = false;
+
+	if (!(vmf->flags & FAULT_FLAG_SPECULATIVE)) {
+		vmf->ptl = pte_lockptr(vmf->vma->vm_mm, vmf->pmd);
+		spin_lock(vmf->ptl);
+		return true;
+	}
+
+	local_irq_disable();
+	if (vma_has_changed(vmf))
+		goto out;
+
+	vmf->ptl = pte_lockptr(vmf->vma->vm_mm, &vmf->orig_pmd);
+	if (unlikely(!spin_trylock(vmf->ptl)))
+		goto out;
+
+	if (vma_has_changed(vmf)) {
+		spin_unlock(vmf->ptl);
+		goto out;
+	}
+	ret = true;
+out:
+	local_irq_enable();
+	return ret;
+}
+
+/* Same as pte_spinlock(), mapping vmf->pte as well */
+static bool pte_map_lock(struct vm_fault *vmf)
+{
+	bool ret = false;
+	spinlock_t *ptl;
+	pte_t *pte;
+
+	if (!(vmf->flags & FAULT_FLAG_SPECULATIVE)) {
+		vmf->pte = pte_offset_map_lock(vmf->vma->vm_mm, vmf->pmd,
+					       vmf->address, &vmf->ptl);
+		return true;
+	}
+
+	local_irq_disable();
+	if (vma_has_changed(vmf))
+		goto out;
+
+	ptl = pte_lockptr(vmf->vma->vm_mm, &vmf->orig_pmd);
+	pte = pte_offset_map(&vmf->orig_pmd, vmf->address);
+	if (unlikely(!spin_trylock(ptl))) {
+		pte_unmap(pte);
+		goto out;
+	}
+
+	if (vma_has_changed(vmf)) {
+		pte_unmap_unlock(pte, ptl);
+		goto out;
+	}
+
+	vmf->pte = pte;
+	vmf->ptl = ptl;
+	ret = true;
+out:
+	local_irq_enable();
+	return ret;
+}
+#else
+static inline bool pte_spinlock(struct vm_fault *vmf)
+{
+	vmf->ptl = pte_lockptr(vmf->vma->vm_mm, vmf->pmd);
+	spin_lock(vmf->ptl);
+	return true;
+}
+
+static inline bool pte_map_lock(struct vm_fault *vmf)
+{
+	vmf->pte = pte_offset_map_lock(vmf->vma->vm_mm, vmf->pmd,
+				       vmf->address, &vmf->ptl);
+	return true;
+}
+#endif
+
 /*
  * Handle write page faults for pages that can be reused in the current vma
  *
@@ -2486,7 +2597,14 @@ static int wp_page_copy(struct vm_fault *vmf)
 	/*
 	 * Re-check the pte - we dropped the lock
 	 */
-	vmf->pte = pte_offset_map_lock(mm, vmf->pmd, vmf->address, &vmf->ptl);
+	if (!pte_map_lock(vmf)) {
+		mmu_notifier_invalidate_range_end(mm, mmun_start, mmun_end);
+		mem_cgroup_cancel_charge(new_page, memcg, false);
+		put_page(new_page);
+		if (old_page)
+			put_page(old_page);
+		return VM_FAULT_RETRY;
+	}
 	if (likely(pte_same(*vmf->pte, vmf->orig_pte))) {
 		if (old_page) {
 			if (!PageAnon(old_page)) {
@@ -2587,7 +2705,7 @@ static int wp_page_copy(struct vm_fault *vmf)
  * shared mapping due to PTE being read-only once the mapped page is prepared.
  * It handles locking of PTE and modifying it. The function returns
  * VM_FAULT_WRITE on success, 0 when PTE got changed before we acquired PTE
- * lock.
+ * lock, and VM_FAULT_RETRY when a speculative fault found the vma changed.
  *
  * The function expects the page to be locked or other protection against
  * concurrent faults / writeback (such as DAX radix tree locks).
@@ -2595,8 +2713,8 @@ static int wp_page_copy(struct vm_fault *vmf)
 int finish_mkwrite_fault(struct vm_fault *vmf)
 {
 	WARN_ON_ONCE(!(vmf->vma->vm_flags & VM_SHARED));
-	vmf->pte = pte_offset_map_lock(vmf->vma->vm_mm, vmf->pmd, vmf->address,
-				       &vmf->ptl);
+	if (!pte_map_lock(vmf))
+		return VM_FAULT_RETRY;
 	/*
 	 * We might have raced with another page fault while we released the
 	 * pte_offset_map_lock.
@@ -2649,7 +2767,8 @@ static int wp_page_shared(struct vm_fault *vmf)
 			return tmp;
 		}
 		tmp = finish_mkwrite_fault(vmf);
-		if (unlikely(tmp & (VM_FAULT_ERROR | VM_FAULT_NOPAGE))) {
+		if (unlikely(tmp & (VM_FAULT_ERROR | VM_FAULT_NOPAGE |
+				    VM_FAULT_RETRY))) {
 			unlock_page(vmf->page);
 			put_page(vmf->page);
 			return tmp;
@@ -2687,6 +2806,11 @@ static int do_wp_page(struct vm_fault *vmf)
 {
 	struct vm_area_struct *vma = vmf->vma;
 
+	if (userfaultfd_pte_wp(vma, *vmf->pte)) {
+		pte_unmap_unlock(vmf->pte, vmf->ptl);
+		return handle_userfault(vmf, VM_UFFD_WP);
+	}
+
 	vmf->page = vm_normal_page(vma, vmf->address, vmf->orig_pte);
 	if (!vmf->page) {
 		/*
@@ -2714,8 +2838,11 @@ static int do_wp_page(struct vm_fault *vmf)
 			get_page(vmf->page);
 			pte_unmap_unlock(vmf->pte, vmf->ptl);
 			lock_page(vmf->page);
-			vmf->pte = pte_offset_map_lock(vma->vm_mm, vmf->pmd,
-					vmf->address, &vmf->ptl);
+			if (!pte_map_lock(vmf)) {
+				unlock_page(vmf->page);
+				put_page(vmf->page);
+				return VM_FAULT_RETRY;
+			}
 			if (!pte_same(*vmf->pte, vmf->orig_pte)) {
 				unlock_page(vmf->page);
 				pte_unmap_unlock(vmf->pte, vmf->ptl);
@@ -2977,7 +3104,9 @@ int do_swap_page(struct vm_fault *vmf)
 	inc_mm_counter_fast(vma->vm_mm, MM_ANONPAGES);
 	dec_mm_counter_fast(vma->vm_mm, MM_SWAPENTS);
 	pte = mk_pte(page, vma->vm_page_prot);
-	if ((vmf->flags & FAULT_FLAG_WRITE) && reuse_swap_page(page, NULL)) {
+	/* a write to a userfaultfd protected page goes to do_wp_page() */
+	if ((vmf->flags & FAULT_FLAG_WRITE) &&
+	    !pte_swp_uffd_wp(vmf->orig_pte) && reuse_swap_page(page, NULL)) {
 		pte = maybe_mkwrite(pte_mkdirty(pte), vma);
 		vmf->flags &= ~FAULT_FLAG_WRITE;
 		ret |= VM_FAULT_WRITE;
@@ -2986,6 +3115,8 @@ int do_swap_page(struct vm_fault *vmf)
 	flush_icache_page(vma, page);
 	if (pte_swp_soft_dirty(vmf->orig_pte))
 		pte = pte_mksoft_dirty(pte);
+	if (pte_swp_uffd_wp(vmf->orig_pte))
+		pte = pte_mkuffd_wp(pte);
 	set_pte_at(vma->vm_mm, vmf->address, vmf->pte, pte);
 	vmf->orig_pte = pte;
 	if (page == swapcache) {
@@ -3069,21 +3200,26 @@ static int do_anonymous_page(struct vm_fault *vmf)
 	 * parallel threads are excluded by other means.
 	 *
 	 * Here we only have down_read(mmap_sem).
+	 *
+	 * A speculative fault only gets here with a page table in place,
+	 * which pte_map_lock() checks is still there.
 	 */
-	if (pte_alloc(vma->vm_mm, vmf->pmd, vmf->address))
-		return VM_FAULT_OOM;
+	if (!(vmf->flags & FAULT_FLAG_SPECULATIVE)) {
+		if (pte_alloc(vma->vm_mm, vmf->pmd, vmf->address))
+			return VM_FAULT_OOM;
 
-	/* See the comment in pte_alloc_one_map() */
-	if (unlikely(pmd_trans_unstable(vmf->pmd)))
-		return 0;
+		/* See the comment in pte_alloc_one_map() */
+		if (unlikely(pmd_trans_unstable(vmf->pmd)))
+			return 0;
+	}
 
 	/* Use the zero-page for reads */
 	if (!(vmf->flags & FAULT_FLAG_WRITE) &&
 			!mm_forbids_zeropage(vma->vm_mm)) {
 		entry = pte_mkspecial(pfn_pte(my_zero_pfn(vmf->address),
 						vma->vm_page_prot));
-		vmf->pte = pte_offset_map_lock(vma->vm_mm, vmf->pmd,
-				vmf->address, &vmf->ptl);
+		if (!pte_map_lock(vmf))
+			return VM_FAULT_RETRY;
 		if (!pte_none(*vmf->pte))
 			goto unlock;
 		ret = check_stable_address_space(vma->vm_mm);
@@ -3118,8 +3254,11 @@ static int do_anonymous_page(struct vm_fault *vmf)
 	if (vma->vm_flags & VM_WRITE)
 		entry = pte_mkwrite(pte_mkdirty(entry));
 
-	vmf->pte = pte_offset_map_lock(vma->vm_mm, vmf->pmd, vmf->address,
-			&vmf->ptl);
+	if (!pte_map_lock(vmf)) {
+		mem_cgroup_cancel_charge(page, memcg, false);
+		put_page(page);
+		return VM_FAULT_RETRY;
+	}
 	if (!pte_none(*vmf->pte))
 		goto release;
 
@@ -3203,6 +3342,10 @@ static int pte_alloc_one_map(struct vm_fault *vmf)
 {
 	struct vm_area_struct *vma = vmf->vma;
 
+	/* The speculative fault walk found a page table */
+	if (vmf->flags & FAULT_FLAG_SPECULATIVE)
+		return pte_map_lock(vmf) ? 0 : VM_FAULT_RETRY;
+
 	if (!pmd_none(*vmf->pmd))
 		goto map_pte;
 	if (vmf->prealloc_pte) {
@@ -3360,7 +3503,8 @@ int alloc_set_pte(struct vm_fault *vmf, struct mem_cgroup *memcg,
 	pte_t entry;
 	int ret;
 
-	if (pmd_none(*vmf->pmd) && PageTransCompound(page) &&
+	if (!(vmf->flags & FAULT_FLAG_SPECULATIVE) &&
+			pmd_none(*vmf->pmd) && PageTransCompound(page) &&
 			IS_ENABLED(CONFIG_TRANSPARENT_HUGE_PAGECACHE)) {
 		/* THP on COW? */
 		VM_BUG_ON_PAGE(memcg, page);
@@ -3569,9 +3713,11 @@ static int do_read_fault(struct vm_fault *vmf)
 	/*
 	 * Let's call ->map_pages() first and use ->fault() as fallback
 	 * if page by the offset is not ready to be mapped (cold cache or
-	 * something).
+	 * something).  The fault around wants the page table allocated, which
+	 * a speculative fault leaves to the classic path.
 	 */
-	if (vma->vm_ops->map_pages && fault_around_bytes >> PAGE_SHIFT > 1) {
+	if (vma->vm_ops->map_pages && fault_around_bytes >> PAGE_SHIFT > 1 &&
+	    !(vmf->flags & FAULT_FLAG_SPECULATIVE)) {
 		ret = do_fault_around(vmf);
 		if (ret)
 			return ret;
@@ -3867,7 +4013,9 @@ static int handle_pte_fault(struct vm_fault *vmf)
 {
 	pte_t entry;
 
-	if (unlikely(pmd_none(*vmf->pmd))) {
+	if (vmf->flags & FAULT_FLAG_SPECULATIVE) {
+		/* handle_speculative_fault() walked the page table already */
+	} else if (unlikely(pmd_none(*vmf->pmd))) {
 		/*
 		 * Leave __pte_alloc() until later: because vm_ops->fault may
 		 * want to allocate huge page, and if we expose page table
@@ -3910,14 +4058,23 @@ static int handle_pte_fault(struct vm_fault *vmf)
 			return do_fault(vmf);
 	}
 
+	/* Swap ins and NUMA hinting faults are left to the classic path */
+	if ((vmf->flags & FAULT_FLAG_SPECULATIVE) &&
+	    (!pte_present(vmf->orig_pte) || pte_protnone(vmf->orig_pte))) {
+		pte_unmap(vmf->pte);
+		return VM_FAULT_RETRY;
+	}
+
 	if (!pte_present(vmf->orig_pte))
 		return do_swap_page(vmf);
 
 	if (pte_protnone(vmf->orig_pte) && vma_is_accessible(vmf->vma))
 		return do_numa_page(vmf);
 
-	vmf->ptl = pte_lockptr(vmf->vma->vm_mm, vmf->pmd);
-	spin_lock(vmf->ptl);
+	if (!pte_spinlock(vmf)) {
+		pte_unmap(vmf->pte);
+		return VM_FAULT_RETRY;
+	}
 	entry = vmf->orig_pte;
 	if (unlikely(!pte_same(*vmf->pte, entry)))
 		goto unlock;
@@ -4010,6 +4167,8 @@ static int __handle_mm_fault(struct vm_area_struct *vma, unsigned long address,
 
 		barrier();
 		if (unlikely(is_swap_pmd(orig_pmd))) {
+			if (is_pmd_swap_entry(orig_pmd))
+				return do_huge_pmd_swap_page(&vmf, orig_pmd);
 			VM_BUG_ON(thp_migration_supported() &&
 					  !is_pmd_migration_entry(orig_pmd));
 			if (is_pmd_migration_entry(orig_pmd))
@@ -4086,6 +4245,158 @@ int handle_mm_fault(struct vm_area_struct *vma, unsigned long address,
 }
 EXPORT_SYMBOL_GPL(handle_mm_fault);
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * The speculative path handles anonymous faults and the faults on files
+ * mapped through filemap_fault(), whose pages come from the page cache
+ * without any vma state: the rest needs mmap_sem.
+ */
+static bool vma_can_speculate(struct vm_area_struct *vma, unsigned int flags)
+{
+	if (is_vm_hugetlb_page(vma) ||
+	    (vma->vm_flags & (VM_PFNMAP | VM_MIXEDMAP | VM_IO)))
+		return false;
+	if (userfaultfd_armed(vma) || vma_policy(vma))
+		return false;
+
+	if (vma_is_anonymous(vma)) {
+		/* anon_vma_prepare() would need mmap_sem */
+		if (!vma->anon_vma)
+			return false;
+	} else {
+		if (vma->vm_ops->fault != filemap_fault)
+			return false;
+		if ((flags & FAULT_FLAG_WRITE) &&
+		    !(vma->vm_flags & VM_SHARED) && !vma->anon_vma)
+			return false;
+	}
+
+	if (flags & FAULT_FLAG_WRITE) {
+		if (!(vma->vm_flags & VM_WRITE))
+			return false;
+	} else if (flags & FAULT_FLAG_INSTRUCTION) {
+		if (!(vma->vm_flags & VM_EXEC))
+			return false;
+	} else if (!(vma->vm_flags & (VM_READ | VM_EXEC | VM_WRITE))) {
+		return false;
+	}
+
+	return arch_vma_access_permitted(vma, flags & FAULT_FLAG_WRITE,
+					 flags & FAULT_FLAG_INSTRUCTION,
+					 flags & FAULT_FLAG_REMOTE);
+}
+
+/**
+ * handle_speculative_fault - handle a user page fault without mmap_sem
+ * @mm: mm of the faulting task
+ * @address: faulting address
+ * @flags: FAULT_FLAG_xxx flags
+ *
+ * Looks the vma up under RCU and handles the pte level fault, checking
+ * under the page table lock that the vma did not change meanwhile.  The
+ * access checks are done on the way, but anything unusual, like a fault
+ * outside of any vma, is left to the caller.
+ *
+ * Returns VM_FAULT_RETRY when the fault must be handled again under
+ * mmap_sem, which is the case for all the errors too.
+ */
+int handle_speculative_fault(struct mm_struct *mm, unsigned long address,
+			     unsigned int flags)
+{
+	struct vm_fault vmf = {
+		.address = address & PAGE_MASK,
+	};
+	struct vm_area_struct *vma;
+	pgd_t *pgd, pgdval;
+	p4d_t *p4d, p4dval;
+	pud_t pudval;
+	unsigned int seq;
+	int ret;
+
+	/* The fault must not drop a mmap_sem it does not hold */
+	flags &= ~(FAULT_FLAG_ALLOW_RETRY | FAULT_FLAG_KILLABLE);
+	flags |= FAULT_FLAG_SPECULATIVE;
+
+	__set_current_state(TASK_RUNNING);
+	check_sync_rss_stat(current);
+
+	vma = get_vma(mm, address);
+	if (!vma)
+		goto out_abort;
+
+	seq = raw_read_seqcount(&vma->vm_sequence);
+	if (seq & 1)
+		goto out_put;
+	/* Matches the barrier in write_seqcount_end() */
+	smp_rmb();
+
+	if (!vma_can_speculate(vma, flags))
+		goto out_put;
+
+	vmf.vma = vma;
+	vmf.flags = flags;
+	vmf.sequence = seq;
+	vmf.pgoff = linear_page_index(vma, address);
+	vmf.gfp_mask = __get_fault_gfp_mask(vma);
+
+	/*
+	 * With interrupts disabled the page tables cannot be freed under the
+	 * walk.  Only an existing pte page table is used: allocating one, and
+	 * the huge pmds and puds, are left to the classic path.
+	 */
+	local_irq_disable();
+	pgd = pgd_offset(mm, address);
+	pgdval = READ_ONCE(*pgd);
+	if (pgd_none(pgdval) || unlikely(pgd_bad(pgdval)))
+		goto out_walk;
+
+	p4d = p4d_offset(pgd, address);
+	p4dval = READ_ONCE(*p4d);
+	if (p4d_none(p4dval) || unlikely(p4d_bad(p4dval)))
+		goto out_walk;
+
+	vmf.pud = pud_offset(p4d, address);
+	pudval = READ_ONCE(*vmf.pud);
+	if (pud_none(pudval) || pud_trans_huge(pudval) ||
+	    pud_devmap(pudval) || unlikely(pud_bad(pudval)))
+		goto out_walk;
+
+	vmf.pmd = pmd_offset(vmf.pud, address);
+	vmf.orig_pmd = READ_ONCE(*vmf.pmd);
+	if (pmd_none(vmf.orig_pmd) || is_swap_pmd(vmf.orig_pmd) ||
+	    pmd_trans_huge(vmf.orig_pmd) || pmd_devmap(vmf.orig_pmd) ||
+	    unlikely(pmd_bad(vmf.orig_pmd)))
+		goto out_walk;
+
+	vmf.pte = pte_offset_map(&vmf.orig_pmd, address);
+	vmf.orig_pte = READ_ONCE(*vmf.pte);
+	barrier(); /* See the comment in handle_pte_fault() */
+	if (pte_none(vmf.orig_pte)) {
+		pte_unmap(vmf.pte);
+		vmf.pte = NULL;
+	}
+	local_irq_enable();
+
+	ret = handle_pte_fault(&vmf);
+	if (ret & (VM_FAULT_RETRY | VM_FAULT_ERROR))
+		goto out_put;
+
+	put_vma(vma);
+	count_vm_event(PGFAULT);
+	count_memcg_event_mm(mm, PGFAULT);
+	count_vm_event(SPECULATIVE_PGFAULT);
+	return ret;
+
+out_walk:
+	local_irq_enable();
+out_put:
+	put_vma(vma);
+out_abort:
+	count_vm_event(SPECULATIVE_PGFAULT_ABORT);
+	return VM_FAULT_RETRY;
+}
+#endif /* CONFIG_SPECULATIVE_PAGE_FAULT */
+
 #ifndef __PAGETABLE_P4D_FOLDED
 /*
  * Allocate p4d page table.
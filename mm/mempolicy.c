@@ -435,7 +435,7 @@ static int queue_pages_pmd(pmd_t *pmd, spinlock_t *ptl, unsigned long addr,
 	struct queue_pages *qp = walk->private;
 	unsigned long flags;
 
-	if (unlikely(is_pmd_migration_entry(*pmd))) {
+	if (unlikely(is_swap_pmd(*pmd))) {
 		ret = 1;
 		goto unlock;
 	}
@@ -578,7 +578,8 @@ unsigned long change_prot_numa(struct vm_area_struct *vma,
 {
 	int nr_updated;
 
-	nr_updated = change_protection(vma, addr, end, PAGE_NONE, 0, 1);
+	nr_updated = change_protection(vma, addr, end, PAGE_NONE,
+				       MM_CP_PROT_NUMA);
 	if (nr_updated)
 		count_vm_numa_events(NUMA_PTE_UPDATES, nr_updated);
 
@@ -687,8 +688,10 @@ static int vma_replace_policy(struct vm_area_struct *vma,
 			goto err_out;
 	}
 
+	vm_write_begin(vma);
 	old = vma->vm_policy;
 	vma->vm_policy = new; /* protected by mmap_sem */
+	vm_write_end(vma);
 	mpol_put(old);
 
 	return 0;
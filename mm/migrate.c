@@ -46,6 +46,8 @@
 #include <linux/page_owner.h>
 #include <linux/sched/mm.h>
 #include <linux/ptrace.h>
+#include <linux/memory.h>
+#include <linux/sched/sysctl.h>
 
 #include <asm/tlbflush.h>
 
@@ -240,6 +242,8 @@ static bool remove_migration_pte(struct page *page, struct vm_area_struct *vma,
 		entry = pte_to_swp_entry(*pvmw.pte);
 		if (is_write_migration_entry(entry))
 			pte = maybe_mkwrite(pte, vma);
+		if (pte_swp_uffd_wp(*pvmw.pte))
+			pte = pte_mkuffd_wp(pte);
 
 		if (unlikely(is_zone_device_page(new))) {
 			if (is_device_private_page(new)) {
@@ -670,6 +674,8 @@ void migrate_page_states(struct page *newpage, struct page *page)
 		SetPageActive(newpage);
 	} else if (TestClearPageUnevictable(page))
 		SetPageUnevictable(newpage);
+	if (PageWorkingset(page))
+		SetPageWorkingset(newpage);
 	if (PageChecked(page))
 		SetPageChecked(newpage);
 	if (PageMappedToDisk(page))
@@ -973,8 +979,44 @@ static int move_to_new_page(struct page *newpage, struct page *page,
 	return rc;
 }
 
-static int __unmap_and_move(struct page *page, struct page *newpage,
-				int force, enum migrate_mode mode)
+/*
+ * __migrate_page_unmap() returns this when @page is unmapped and locked,
+ * ready for __migrate_page_move().
+ */
+#define MIGRATEPAGE_UNMAP		1
+
+/*
+ * Between its unmap and its move, the state of a page is kept in the
+ * ->private of its new page, which nothing else uses until the move: the
+ * anon_vma reference, and whether the page was mapped in its low bit.
+ */
+static void __migrate_page_record(struct page *newpage, int page_was_mapped,
+				  struct anon_vma *anon_vma)
+{
+	set_page_private(newpage, (unsigned long)anon_vma + page_was_mapped);
+}
+
+static void __migrate_page_extract(struct page *newpage, int *page_was_mapped,
+				   struct anon_vma **anon_vma)
+{
+	unsigned long private = page_private(newpage);
+
+	*page_was_mapped = private & 1;
+	*anon_vma = (struct anon_vma *)(private & ~1UL);
+	set_page_private(newpage, 0);
+}
+
+/*
+ * Locks @page and @newpage and replaces the ptes of @page by migration
+ * entries.  With @batch, the TLB entries are left for try_to_unmap_flush()
+ * to flush.  With @locked_others, the caller holds the locks of other
+ * pages, so sleeping on the lock of @page, or on its writeback, could
+ * deadlock: -EDEADLK is returned instead, for the caller to move its
+ * other pages first.
+ */
+static int __migrate_page_unmap(struct page *page, struct page *newpage,
+				int force, enum migrate_mode mode, bool batch,
+				bool locked_others)
 {
 	int rc = -EAGAIN;
 	int page_was_mapped = 0;
@@ -1001,6 +1043,11 @@ static int __unmap_and_move(struct page *page, struct page *newpage,
 		if (current->flags & PF_MEMALLOC)
 			goto out;
 
+		if (locked_others) {
+			rc = -EDEADLK;
+			goto out;
+		}
+
 		lock_page(page);
 	}
 
@@ -1021,6 +1068,10 @@ static int __unmap_and_move(struct page *page, struct page *newpage,
 		}
 		if (!force)
 			goto out_unlock;
+		if (locked_others) {
+			rc = -EDEADLK;
+			goto out_unlock;
+		}
 		wait_on_page_writeback(page);
 	}
 
@@ -1053,8 +1104,8 @@ static int __unmap_and_move(struct page *page, struct page *newpage,
 		goto out_unlock;
 
 	if (unlikely(!is_lru)) {
-		rc = move_to_new_page(newpage, page, mode);
-		goto out_unlock_both;
+		__migrate_page_record(newpage, 0, anon_vma);
+		return MIGRATEPAGE_UNMAP;
 	}
 
 	/*
@@ -1080,10 +1131,45 @@ static int __unmap_and_move(struct page *page, struct page *newpage,
 		VM_BUG_ON_PAGE(PageAnon(page) && !PageKsm(page) && !anon_vma,
 				page);
 		try_to_unmap(page,
-			TTU_MIGRATION|TTU_IGNORE_MLOCK|TTU_IGNORE_ACCESS);
+			TTU_MIGRATION|TTU_IGNORE_MLOCK|TTU_IGNORE_ACCESS|
+			(batch ? TTU_BATCH_FLUSH : 0));
 		page_was_mapped = 1;
 	}
 
+	__migrate_page_record(newpage, page_was_mapped, anon_vma);
+	return MIGRATEPAGE_UNMAP;
+
+out_unlock_both:
+	unlock_page(newpage);
+out_unlock:
+	/* Drop an anon_vma reference if we took one */
+	if (anon_vma)
+		put_anon_vma(anon_vma);
+	unlock_page(page);
+out:
+	return rc;
+}
+
+/*
+ * Copies @page unmapped by __migrate_page_unmap() to @newpage, and points
+ * the migration entries to @newpage, or back to @page if that failed.
+ * The TLB entries of @page must have been flushed.
+ */
+static int __migrate_page_move(struct page *page, struct page *newpage,
+			       enum migrate_mode mode)
+{
+	int rc = -EAGAIN;
+	int page_was_mapped;
+	struct anon_vma *anon_vma;
+	bool is_lru = !__PageMovable(page);
+
+	__migrate_page_extract(newpage, &page_was_mapped, &anon_vma);
+
+	if (unlikely(!is_lru)) {
+		rc = move_to_new_page(newpage, page, mode);
+		goto out_unlock_both;
+	}
+
 	if (!page_mapped(page))
 		rc = move_to_new_page(newpage, page, mode);
 
@@ -1093,12 +1179,11 @@ static int __unmap_and_move(struct page *page, struct page *newpage,
 
 out_unlock_both:
 	unlock_page(newpage);
-out_unlock:
 	/* Drop an anon_vma reference if we took one */
 	if (anon_vma)
 		put_anon_vma(anon_vma);
 	unlock_page(page);
-out:
+
 	/*
 	 * If migration is successful, decrease refcount of the newpage
 	 * which will not free the page because new page owner increased
@@ -1116,8 +1201,8 @@ static int __unmap_and_move(struct page *page, struct page *newpage,
 }
 
 /*
- * gcc 4.7 and 4.8 on arm get an ICEs when inlining unmap_and_move().  Work
- * around it.
+ * gcc 4.7 and 4.8 on arm get an ICEs when inlining migrate_page_unmap().
+ * Work around it.
  */
 #if (GCC_VERSION >= 40700 && GCC_VERSION < 40900) && defined(CONFIG_ARM)
 #define ICE_noinline noinline
@@ -1126,53 +1211,13 @@ static int __unmap_and_move(struct page *page, struct page *newpage,
 #endif
 
 /*
- * Obtain the lock on page, remove all ptes and migrate the page
- * to the newly allocated page in newpage.
+ * Releases @page and @newpage after the migration of @page ended with @rc,
+ * or restores @page, unless it is to be retried.
  */
-static ICE_noinline int unmap_and_move(new_page_t get_new_page,
-				   free_page_t put_new_page,
-				   unsigned long private, struct page *page,
-				   int force, enum migrate_mode mode,
-				   enum migrate_reason reason)
+static int migrate_page_done(free_page_t put_new_page, unsigned long private,
+			     struct page *page, struct page *newpage,
+			     int *result, int rc, enum migrate_reason reason)
 {
-	int rc = MIGRATEPAGE_SUCCESS;
-	int *result = NULL;
-	struct page *newpage;
-
-	newpage = get_new_page(page, private, &result);
-	if (!newpage)
-		return -ENOMEM;
-
-	if (page_count(page) == 1) {
-		/* page was freed from under us. So we are done. */
-		ClearPageActive(page);
-		ClearPageUnevictable(page);
-		if (unlikely(__PageMovable(page))) {
-			lock_page(page);
-			if (!PageMovable(page))
-				__ClearPageIsolated(page);
-			unlock_page(page);
-		}
-		if (put_new_page)
-			put_new_page(newpage, private);
-		else
-			put_page(newpage);
-		goto out;
-	}
-
-	if (unlikely(PageTransHuge(page) && !PageTransHuge(newpage))) {
-		lock_page(page);
-		rc = split_huge_page(page);
-		unlock_page(page);
-		if (rc)
-			goto out;
-	}
-
-	rc = __unmap_and_move(page, newpage, force, mode);
-	if (rc == MIGRATEPAGE_SUCCESS)
-		set_page_owner_migrate_reason(newpage, reason);
-
-out:
 	if (rc != -EAGAIN) {
 		/*
 		 * A page that has been migrated has all references
@@ -1239,6 +1284,88 @@ static ICE_noinline int unmap_and_move(new_page_t get_new_page,
 	return rc;
 }
 
+/*
+ * Allocates the new page of @page and unmaps @page, see
+ * __migrate_page_unmap().  Returns MIGRATEPAGE_UNMAP with the new page in
+ * @newpagep, or the result of a migration which ended here.  The unmap is
+ * batched unless the caller of migrate_pages() wants the result of the
+ * page in @resultp.
+ */
+static ICE_noinline int migrate_page_unmap(new_page_t get_new_page,
+		free_page_t put_new_page, unsigned long private,
+		struct page *page, struct page **newpagep, int **resultp,
+		int force, enum migrate_mode mode, enum migrate_reason reason,
+		bool locked_others)
+{
+	int rc = MIGRATEPAGE_SUCCESS;
+	struct page *newpage;
+
+	*resultp = NULL;
+	newpage = get_new_page(page, private, resultp);
+	if (!newpage)
+		return -ENOMEM;
+
+	if (page_count(page) == 1) {
+		/* page was freed from under us. So we are done. */
+		ClearPageActive(page);
+		ClearPageUnevictable(page);
+		if (unlikely(__PageMovable(page))) {
+			lock_page(page);
+			if (!PageMovable(page))
+				__ClearPageIsolated(page);
+			unlock_page(page);
+		}
+		if (put_new_page)
+			put_new_page(newpage, private);
+		else
+			put_page(newpage);
+		goto out;
+	}
+
+	if (unlikely(PageTransHuge(page) && !PageTransHuge(newpage))) {
+		lock_page(page);
+		rc = split_huge_page(page);
+		unlock_page(page);
+		if (rc)
+			goto out;
+	}
+
+	rc = __migrate_page_unmap(page, newpage, force, mode, !*resultp,
+				  locked_others);
+	if (rc == MIGRATEPAGE_UNMAP) {
+		*newpagep = newpage;
+		return rc;
+	}
+
+	if (rc == -EDEADLK) {
+		/* left on the list, for the caller to try again */
+		if (put_new_page)
+			put_new_page(newpage, private);
+		else
+			put_page(newpage);
+		return rc;
+	}
+
+out:
+	return migrate_page_done(put_new_page, private, page, newpage,
+				 *resultp, rc, reason);
+}
+
+static int migrate_page_move(free_page_t put_new_page, unsigned long private,
+			     struct page *page, struct page *newpage,
+			     int *result, enum migrate_mode mode,
+			     enum migrate_reason reason)
+{
+	int rc;
+
+	rc = __migrate_page_move(page, newpage, mode);
+	if (rc == MIGRATEPAGE_SUCCESS)
+		set_page_owner_migrate_reason(newpage, reason);
+
+	return migrate_page_done(put_new_page, private, page, newpage,
+				 result, rc, reason);
+}
+
 /*
  * Counterpart of unmap_and_move_page() for hugepage migration.
  *
@@ -1354,6 +1481,95 @@ static int unmap_and_move_huge_page(new_page_t get_new_page,
 	return rc;
 }
 
+/* Up to this many base pages are unmapped together, for one TLB flush */
+#define MIGRATE_BATCH_NR	512
+
+/*
+ * The pages migrate_pages() unmapped and did not move yet, in @pages, with
+ * their new pages in the same order in @newpages.  The pages to retry are
+ * put on @retry when moved.
+ */
+struct migrate_batch {
+	struct list_head pages;
+	struct list_head newpages;
+	struct list_head retry;
+	unsigned int nr_pages;
+	int nr_succeeded;
+	int nr_failed;
+	int nr_retry;
+	free_page_t *put_new_page;
+	unsigned long private;
+	enum migrate_mode mode;
+	enum migrate_reason reason;
+};
+
+static void migrate_batch_init(struct migrate_batch *batch,
+			       free_page_t put_new_page, unsigned long private,
+			       enum migrate_mode mode,
+			       enum migrate_reason reason)
+{
+	INIT_LIST_HEAD(&batch->pages);
+	INIT_LIST_HEAD(&batch->newpages);
+	INIT_LIST_HEAD(&batch->retry);
+	batch->nr_pages = 0;
+	batch->nr_succeeded = 0;
+	batch->nr_failed = 0;
+	batch->nr_retry = 0;
+	batch->put_new_page = put_new_page;
+	batch->private = private;
+	batch->mode = mode;
+	batch->reason = reason;
+}
+
+/*
+ * Flushes the TLB entries of all the pages of @batch at once, and then
+ * moves them one by one.  A page which fails to move is mapped back, as
+ * without batching.
+ */
+static void migrate_batch_move(struct migrate_batch *batch)
+{
+	struct page *page, *page2, *newpage;
+	int rc;
+
+	if (!batch->nr_pages)
+		return;
+
+	try_to_unmap_flush();
+
+	list_for_each_entry_safe(page, page2, &batch->pages, lru) {
+		newpage = list_first_entry(&batch->newpages, struct page, lru);
+		list_del(&newpage->lru);
+
+		rc = migrate_page_move(batch->put_new_page, batch->private,
+				       page, newpage, NULL, batch->mode,
+				       batch->reason);
+		switch (rc) {
+		case -EAGAIN:
+			list_move_tail(&page->lru, &batch->retry);
+			batch->nr_retry++;
+			break;
+		case MIGRATEPAGE_SUCCESS:
+			batch->nr_succeeded++;
+			break;
+		default:
+			batch->nr_failed++;
+			break;
+		}
+		cond_resched();
+	}
+	batch->nr_pages = 0;
+}
+
+static void migrate_batch_add(struct migrate_batch *batch, struct page *page,
+			      struct page *newpage)
+{
+	list_move_tail(&page->lru, &batch->pages);
+	list_add_tail(&newpage->lru, &batch->newpages);
+	batch->nr_pages += hpage_nr_pages(page);
+	if (batch->nr_pages >= MIGRATE_BATCH_NR)
+		migrate_batch_move(batch);
+}
+
 /*
  * migrate_pages - migrate the pages specified in a list, to the free pages
  *		   supplied as the target for the page migration
@@ -1374,38 +1590,64 @@ static int unmap_and_move_huge_page(new_page_t get_new_page,
  * or free list only if ret != 0.
  *
  * Returns the number of pages that were not migrated, or an error code.
+ * __migrate_pages() also returns the number of pages migrated in
+ * @nr_succeeded.
  */
-int migrate_pages(struct list_head *from, new_page_t get_new_page,
+int __migrate_pages(struct list_head *from, new_page_t get_new_page,
 		free_page_t put_new_page, unsigned long private,
-		enum migrate_mode mode, int reason)
+		enum migrate_mode mode, int reason, unsigned int *nr_succeeded)
 {
+	struct migrate_batch batch;
 	int retry = 1;
 	int nr_failed = 0;
-	int nr_succeeded = 0;
+	int nr_moved = 0;
 	int pass = 0;
 	struct page *page;
 	struct page *page2;
+	struct page *newpage;
+	int *result;
 	int swapwrite = current->flags & PF_SWAPWRITE;
 	int rc;
 
 	if (!swapwrite)
 		current->flags |= PF_SWAPWRITE;
 
+	migrate_batch_init(&batch, put_new_page, private, mode, reason);
+
 	for(pass = 0; pass < 10 && retry; pass++) {
 		retry = 0;
 
 		list_for_each_entry_safe(page, page2, from, lru) {
 			cond_resched();
 
-			if (PageHuge(page))
+			if (PageHuge(page)) {
+				/* it may sleep on the lock of the page */
+				migrate_batch_move(&batch);
 				rc = unmap_and_move_huge_page(get_new_page,
 						put_new_page, private, page,
 						pass > 2, mode, reason);
-			else
-				rc = unmap_and_move(get_new_page, put_new_page,
-						private, page, pass > 2, mode,
+				goto account;
+			}
+unmap:
+			rc = migrate_page_unmap(get_new_page, put_new_page,
+					private, page, &newpage, &result,
+					pass > 2, mode, reason,
+					batch.nr_pages > 0);
+			if (rc == -EDEADLK) {
+				migrate_batch_move(&batch);
+				goto unmap;
+			}
+			if (rc == MIGRATEPAGE_UNMAP) {
+				if (!result) {
+					migrate_batch_add(&batch, page,
+							  newpage);
+					continue;
+				}
+				rc = migrate_page_move(put_new_page, private,
+						page, newpage, result, mode,
 						reason);
-
+			}
+account:
 			switch(rc) {
 			case -ENOMEM:
 				nr_failed++;
@@ -1414,7 +1656,7 @@ int migrate_pages(struct list_head *from, new_page_t get_new_page,
 				retry++;
 				break;
 			case MIGRATEPAGE_SUCCESS:
-				nr_succeeded++;
+				nr_moved++;
 				break;
 			default:
 				/*
@@ -1427,22 +1669,44 @@ int migrate_pages(struct list_head *from, new_page_t get_new_page,
 				break;
 			}
 		}
+		migrate_batch_move(&batch);
+		list_splice_tail_init(&batch.retry, from);
+		retry += batch.nr_retry;
+		batch.nr_retry = 0;
 	}
 	nr_failed += retry;
 	rc = nr_failed;
 out:
-	if (nr_succeeded)
-		count_vm_events(PGMIGRATE_SUCCESS, nr_succeeded);
+	/* the pages unmapped before running out of memory */
+	migrate_batch_move(&batch);
+	list_splice_tail_init(&batch.retry, from);
+	nr_moved += batch.nr_succeeded;
+	nr_failed += batch.nr_failed;
+	if (rc >= 0)
+		rc = nr_failed;
+
+	if (nr_moved)
+		count_vm_events(PGMIGRATE_SUCCESS, nr_moved);
 	if (nr_failed)
 		count_vm_events(PGMIGRATE_FAIL, nr_failed);
-	trace_mm_migrate_pages(nr_succeeded, nr_failed, mode, reason);
+	trace_mm_migrate_pages(nr_moved, nr_failed, mode, reason);
 
 	if (!swapwrite)
 		current->flags &= ~PF_SWAPWRITE;
 
+	if (nr_succeeded)
+		*nr_succeeded = nr_moved;
 	return rc;
 }
 
+int migrate_pages(struct list_head *from, new_page_t get_new_page,
+		free_page_t put_new_page, unsigned long private,
+		enum migrate_mode mode, int reason)
+{
+	return __migrate_pages(from, get_new_page, put_new_page, private,
+			       mode, reason, NULL);
+}
+
 #ifdef CONFIG_NUMA
 /*
  * Move a list of individual pages
@@ -1808,6 +2072,161 @@ SYSCALL_DEFINE6(move_pages, pid_t, pid, unsigned long, nr_pages,
 	return err;
 }
 
+/*
+ * The demotion target of each node, NUMA_NO_NODE for the last tier.  The
+ * targets are chosen in passes which start from the nodes with CPUs: the
+ * nodes of a pass demote to their nearest memory-only node which is not
+ * in a previous pass, and those targets make the next pass, so that the
+ * demotion paths hold no cycles.  Reclaim reads them under RCU.
+ */
+static int node_demotion[MAX_NUMNODES] __read_mostly = {
+	[0 ... MAX_NUMNODES - 1] = NUMA_NO_NODE
+};
+static DEFINE_MUTEX(node_demotion_mutex);
+
+bool numa_demotion_enabled __read_mostly;
+
+int next_demotion_node(int node)
+{
+	int target;
+
+	rcu_read_lock();
+	target = READ_ONCE(node_demotion[node]);
+	rcu_read_unlock();
+
+	return target;
+}
+
+static void disable_all_demotion_targets(void)
+{
+	int node;
+
+	for_each_online_node(node)
+		WRITE_ONCE(node_demotion[node], NUMA_NO_NODE);
+}
+
+static void set_demotion_targets(void)
+{
+	nodemask_t this_pass, next_pass = node_states[N_CPU];
+	nodemask_t used_targets = NODE_MASK_NONE;
+	int node, target;
+
+	mutex_lock(&node_demotion_mutex);
+	/* no reclaim may follow the old paths and the new ones at once */
+	disable_all_demotion_targets();
+	synchronize_rcu();
+
+	while (!nodes_empty(next_pass)) {
+		this_pass = next_pass;
+		nodes_clear(next_pass);
+		/*
+		 * The sources of a pass cannot be targets of a later one,
+		 * but may share a target of this one.
+		 */
+		nodes_or(used_targets, used_targets, this_pass);
+		for_each_node_mask(node, this_pass) {
+			target = find_next_best_node(node, &used_targets);
+			if (target == NUMA_NO_NODE)
+				continue;
+			WRITE_ONCE(node_demotion[node], target);
+			node_set(target, next_pass);
+		}
+	}
+	mutex_unlock(&node_demotion_mutex);
+}
+
+static int demotion_memory_callback(struct notifier_block *self,
+				    unsigned long action, void *_arg)
+{
+	struct memory_notify *arg = _arg;
+
+	/* only a node gaining or losing all its memory changes the tiers */
+	if (arg->status_change_nid < 0)
+		return notifier_from_errno(0);
+
+	switch (action) {
+	case MEM_GOING_OFFLINE:
+		/* do not demote to the node while it goes away */
+		mutex_lock(&node_demotion_mutex);
+		disable_all_demotion_targets();
+		mutex_unlock(&node_demotion_mutex);
+		synchronize_rcu();
+		break;
+	case MEM_OFFLINE:
+	case MEM_ONLINE:
+	case MEM_CANCEL_OFFLINE:
+		set_demotion_targets();
+		break;
+	}
+
+	return notifier_from_errno(0);
+}
+
+#ifdef CONFIG_SYSFS
+static ssize_t demotion_enabled_show(struct kobject *kobj,
+				     struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%s\n", numa_demotion_enabled ? "true" : "false");
+}
+
+static ssize_t demotion_enabled_store(struct kobject *kobj,
+				      struct kobj_attribute *attr,
+				      const char *buf, size_t count)
+{
+	if (!strncmp(buf, "true", 4) || !strncmp(buf, "1", 1))
+		numa_demotion_enabled = true;
+	else if (!strncmp(buf, "false", 5) || !strncmp(buf, "0", 1))
+		numa_demotion_enabled = false;
+	else
+		return -EINVAL;
+
+	return count;
+}
+static struct kobj_attribute numa_demotion_enabled_attr =
+	__ATTR(demotion_enabled, 0644, demotion_enabled_show,
+	       demotion_enabled_store);
+
+static struct attribute *numa_attrs[] = {
+	&numa_demotion_enabled_attr.attr,
+	NULL,
+};
+
+static struct attribute_group numa_attr_group = {
+	.attrs = numa_attrs,
+};
+
+static int __init numa_init_sysfs(void)
+{
+	int err;
+	struct kobject *numa_kobj;
+
+	numa_kobj = kobject_create_and_add("numa", mm_kobj);
+	if (!numa_kobj) {
+		pr_err("failed to create numa kobject\n");
+		return -ENOMEM;
+	}
+	err = sysfs_create_group(numa_kobj, &numa_attr_group);
+	if (err) {
+		pr_err("failed to register numa group\n");
+		goto delete_obj;
+	}
+	return 0;
+
+delete_obj:
+	kobject_put(numa_kobj);
+	return err;
+}
+subsys_initcall(numa_init_sysfs);
+#endif
+
+static int __init demotion_init(void)
+{
+	hotplug_memory_notifier(demotion_memory_callback, 100);
+	set_demotion_targets();
+	return 0;
+}
+late_initcall(demotion_init);
+
 #ifdef CONFIG_NUMA_BALANCING
 /*
  * Returns true if this is a safe migration target node for misplaced NUMA
@@ -1898,8 +2317,25 @@ static int numamigrate_isolate_page(pg_data_t *pgdat, struct page *page)
 	VM_BUG_ON_PAGE(compound_order(page) && !PageTransHuge(page), page);
 
 	/* Avoid migrating to a node that is nearly full */
-	if (!migrate_balanced_pgdat(pgdat, 1UL << compound_order(page)))
+	if (!migrate_balanced_pgdat(pgdat, 1UL << compound_order(page))) {
+		int z;
+
+		/*
+		 * A promotion waits for kswapd to make room on the fast node,
+		 * demoting its colder pages.
+		 */
+		if (!(sysctl_numa_balancing_mode &
+		      NUMA_BALANCING_MEMORY_TIERING) ||
+		    node_is_toptier(page_to_nid(page)))
+			return 0;
+		for (z = pgdat->nr_zones - 1; z >= 0; z--)
+			if (managed_zone(pgdat->node_zones + z))
+				break;
+		if (z >= 0)
+			wakeup_kswapd(pgdat->node_zones + z,
+				      compound_order(page), ZONE_MOVABLE);
 		return 0;
+	}
 
 	if (isolate_lru_page(page))
 		return 0;
@@ -1944,6 +2380,7 @@ int migrate_misplaced_page(struct page *page, struct vm_area_struct *vma,
 			   int node)
 {
 	pg_data_t *pgdat = NODE_DATA(node);
+	int page_nid = page_to_nid(page);
 	int isolated;
 	int nr_remaining;
 	LIST_HEAD(migratepages);
@@ -1980,8 +2417,11 @@ int migrate_misplaced_page(struct page *page, struct vm_area_struct *vma,
 			putback_lru_page(page);
 		}
 		isolated = 0;
-	} else
+	} else {
 		count_vm_numa_event(NUMA_PAGE_MIGRATE);
+		if (!node_is_toptier(page_nid) && node_is_toptier(node))
+			count_vm_event(PGPROMOTE_SUCCESS);
+	}
 	BUG_ON(!list_empty(&migratepages));
 	return isolated;
 
@@ -2102,6 +2542,8 @@ int migrate_misplaced_transhuge_page(struct mm_struct *mm,
 
 	count_vm_events(PGMIGRATE_SUCCESS, HPAGE_PMD_NR);
 	count_vm_numa_events(NUMA_PAGE_MIGRATE, HPAGE_PMD_NR);
+	if (!node_is_toptier(page_to_nid(page)) && node_is_toptier(node))
+		count_vm_events(PGPROMOTE_SUCCESS, HPAGE_PMD_NR);
 
 	mod_node_page_state(page_pgdat(page),
 			NR_ISOLATED_ANON + page_lru,
@@ -2309,6 +2751,8 @@ static int migrate_vma_collect_pmd(pmd_t *pmdp,
 			swp_pte = swp_entry_to_pte(entry);
 			if (pte_soft_dirty(pte))
 				swp_pte = pte_swp_mksoft_dirty(swp_pte);
+			if (pte_uffd_wp(pte))
+				swp_pte = pte_swp_mkuffd_wp(swp_pte);
 			set_pte_at(mm, addr, ptep, swp_pte);
 
 			/*
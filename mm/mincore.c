@@ -6,7 +6,7 @@
  */
 
 /*
- * The mincore() system call.
+ * The mincore() and cachestat() system calls.
  */
 #include <linux/pagemap.h>
 #include <linux/gfp.h>
@@ -17,6 +17,8 @@
 #include <linux/swapops.h>
 #include <linux/shmem_fs.h>
 #include <linux/hugetlb.h>
+#include <linux/dax.h>
+#include <linux/file.h>
 
 #include <linux/uaccess.h>
 #include <asm/pgtable.h>
@@ -271,3 +273,140 @@ SYSCALL_DEFINE3(mincore, unsigned long, start, size_t, len,
 	free_page((unsigned long) tmp);
 	return retval;
 }
+
+/*
+ * Count the pages of @mapping between @first_index and @last_index which
+ * are cached, dirty and under writeback, and the evicted ones: those with
+ * a shadow entry, or swapped out ones for shmem, and among the shadow
+ * entries those which would be activated if they refaulted now.
+ */
+static void filemap_cachestat(struct address_space *mapping,
+			      pgoff_t first_index, pgoff_t last_index,
+			      struct cachestat *cs)
+{
+	struct radix_tree_iter iter;
+	void __rcu **slot;
+
+	rcu_read_lock();
+	radix_tree_for_each_slot(slot, &mapping->page_tree, &iter,
+				 first_index) {
+		struct page *page;
+
+		if (iter.index > last_index)
+			break;
+
+		page = radix_tree_deref_slot(slot);
+		if (unlikely(!page))
+			continue;
+
+		if (radix_tree_exception(page)) {
+			if (radix_tree_deref_retry(page)) {
+				slot = radix_tree_iter_retry(&iter);
+				continue;
+			}
+#ifdef CONFIG_SWAP
+			if (shmem_mapping(mapping)) {
+				swp_entry_t swp = radix_to_swp_entry(page);
+				struct address_space *swap_mapping;
+
+				/* still in swap cache counts as cached */
+				swap_mapping = swap_address_space(swp);
+				if (radix_tree_lookup(&swap_mapping->page_tree,
+						      swp_offset(swp)))
+					cs->nr_cache++;
+				else
+					cs->nr_evicted++;
+				goto resched;
+			}
+#endif
+			cs->nr_evicted++;
+			if (workingset_test_recent(page))
+				cs->nr_recently_evicted++;
+			goto resched;
+		}
+
+		/* racy without a reference, but these are only statistics */
+		cs->nr_cache++;
+		if (PageDirty(page))
+			cs->nr_dirty++;
+		if (PageWriteback(page))
+			cs->nr_writeback++;
+resched:
+		if (need_resched()) {
+			slot = radix_tree_iter_resume(slot, &iter);
+			cond_resched_rcu();
+		}
+	}
+	rcu_read_unlock();
+}
+
+/*
+ * The cachestat(2) system call.
+ *
+ * cachestat() returns the page cache statistics of a file in the
+ * bytes range specified by `off` and `len`: number of cached pages,
+ * number of dirty pages, number of pages marked for writeback,
+ * number of evicted pages, and number of recently evicted pages.
+ *
+ * An evicted page is a page that is previously in the page cache
+ * but has been evicted since.  A page is recently evicted if its last
+ * eviction was recent enough that its reentry to the cache would
+ * indicate that it is actively being used by the system, and that
+ * there is memory pressure on the system.
+ *
+ * `off` and `len` must be non-negative integers.  If `len` > 0,
+ * the queried range is [`off`, `off` + `len`].  If `len` == 0,
+ * we will query in the range from `off` to the end of the file.
+ *
+ * The `flags` argument is unused for now, but is included for future
+ * extensibility.  User should pass 0 (i.e no flag specified).
+ *
+ * Because the status of a page can change after cachestat() checks it
+ * but before it returns to the application, the returned values may
+ * contain stale information.
+ *
+ * return values:
+ *  zero        - success
+ *  -EFAULT     - cstat or cstat_range points to an illegal address
+ *  -EINVAL     - invalid flags
+ *  -EBADF      - invalid file descriptor
+ *  -EOPNOTSUPP - file descriptor is of a hugetlbfs or DAX file
+ */
+SYSCALL_DEFINE4(cachestat, unsigned int, fd,
+		struct cachestat_range __user *, cstat_range,
+		struct cachestat __user *, cstat, unsigned int, flags)
+{
+	struct cachestat_range csr;
+	struct cachestat cs;
+	pgoff_t first_index, last_index;
+	struct address_space *mapping;
+	struct fd f;
+
+	if (copy_from_user(&csr, cstat_range, sizeof(csr)))
+		return -EFAULT;
+
+	if (flags != 0)
+		return -EINVAL;
+
+	f = fdget(fd);
+	if (!f.file)
+		return -EBADF;
+
+	mapping = f.file->f_mapping;
+	if (is_file_hugepages(f.file) || dax_mapping(mapping)) {
+		fdput(f);
+		return -EOPNOTSUPP;
+	}
+
+	first_index = csr.off >> PAGE_SHIFT;
+	last_index = csr.len == 0 ? ULONG_MAX :
+		     (csr.off + csr.len - 1) >> PAGE_SHIFT;
+	memset(&cs, 0, sizeof(cs));
+	filemap_cachestat(mapping, first_index, last_index, &cs);
+	fdput(f);
+
+	if (copy_to_user(cstat, &cs, sizeof(cs)))
+		return -EFAULT;
+
+	return 0;
+}
@@ -160,6 +160,81 @@ void unlink_file_vma(struct vm_area_struct *vma)
 	}
 }
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+static void vma_free_rcu(struct rcu_head *head)
+{
+	struct vm_area_struct *vma = container_of(head, struct vm_area_struct,
+						  vm_rcu);
+
+	kmem_cache_free(vm_area_cachep, vma);
+}
+#endif
+
+static void __free_vma(struct vm_area_struct *vma)
+{
+	if (vma->vm_file)
+		fput(vma->vm_file);
+	mpol_put(vma_policy(vma));
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	/* get_vma() walks the rbtree under RCU only */
+	call_rcu(&vma->vm_rcu, vma_free_rcu);
+#else
+	kmem_cache_free(vm_area_cachep, vma);
+#endif
+}
+
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * Drops a reference to a vma, the last one frees it.  Speculative page
+ * faults hold a reference, which keeps the file and the mempolicy of the
+ * vma around until they are done or have seen that it went away.
+ */
+void put_vma(struct vm_area_struct *vma)
+{
+	if (atomic_dec_and_test(&vma->vm_ref_count))
+		__free_vma(vma);
+}
+
+/*
+ * Looks up the vma containing @addr without mmap_sem and takes a
+ * reference to it, NULL if there is none or it is being freed.  The
+ * rbtree may be changing under the walk, which can then miss the vma:
+ * the caller's checks of vma->vm_sequence tell whether what it found is
+ * still valid.
+ */
+struct vm_area_struct *get_vma(struct mm_struct *mm, unsigned long addr)
+{
+	struct vm_area_struct *vma = NULL;
+	struct rb_node *rb_node;
+
+	rcu_read_lock();
+	rb_node = rcu_dereference_raw(mm->mm_rb.rb_node);
+	while (rb_node) {
+		struct vm_area_struct *tmp;
+
+		tmp = rb_entry(rb_node, struct vm_area_struct, vm_rb);
+		if (tmp->vm_end > addr) {
+			if (tmp->vm_start <= addr) {
+				vma = tmp;
+				break;
+			}
+			rb_node = rcu_dereference_raw(rb_node->rb_left);
+		} else
+			rb_node = rcu_dereference_raw(rb_node->rb_right);
+	}
+	if (vma && !atomic_inc_not_zero(&vma->vm_ref_count))
+		vma = NULL;
+	rcu_read_unlock();
+
+	return vma;
+}
+#else
+static inline void put_vma(struct vm_area_struct *vma)
+{
+	__free_vma(vma);
+}
+#endif
+
 /*
  * Close a vm structure and free it, returning the next.
  */
@@ -170,10 +245,7 @@ static struct vm_area_struct *remove_vma(struct vm_area_struct *vma)
 	might_sleep();
 	if (vma->vm_ops && vma->vm_ops->close)
 		vma->vm_ops->close(vma);
-	if (vma->vm_file)
-		fput(vma->vm_file);
-	mpol_put(vma_policy(vma));
-	kmem_cache_free(vm_area_cachep, vma);
+	put_vma(vma);
 	return next;
 }
 
@@ -427,6 +499,8 @@ static void __vma_rb_erase(struct vm_area_struct *vma, struct rb_root *root)
 	 * augmented rbtree callbacks.
 	 */
 	rb_erase_augmented(&vma->vm_rb, root, &vma_gap_callbacks);
+	/* Tells the speculative page faults that the vma went away */
+	RB_CLEAR_NODE(&vma->vm_rb);
 }
 
 static __always_inline void vma_rb_erase_ignore(struct vm_area_struct *vma,
@@ -567,7 +641,13 @@ void __vma_link_rb(struct mm_struct *mm, struct vm_area_struct *vma,
 	 * immediately update the gap to the correct value. Finally we
 	 * rebalance the rbtree after all augmented values have been set.
 	 */
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	/* The reference of the mm, dropped by remove_vma() */
+	atomic_set(&vma->vm_ref_count, 1);
+	rb_link_node_rcu(&vma->vm_rb, rb_parent, rb_link);
+#else
 	rb_link_node(&vma->vm_rb, rb_parent, rb_link);
+#endif
 	vma->rb_subtree_gap = 0;
 	vma_gap_update(vma);
 	vma_rb_insert(vma, &mm->mm_rb);
@@ -777,6 +857,10 @@ int __vma_adjust(struct vm_area_struct *vma, unsigned long start,
 		}
 	}
 again:
+	vm_write_begin(vma);
+	if (next)
+		vm_write_begin(next);
+
 	vma_adjust_trans_huge(orig_vma, start, end, adjust_next);
 
 	if (file) {
@@ -893,16 +977,21 @@ int __vma_adjust(struct vm_area_struct *vma, unsigned long start,
 			uprobe_mmap(next);
 	}
 
+	/*
+	 * A removed next is off the rbtree already, which is enough for
+	 * the speculative page faults to leave it alone.
+	 */
+	if (next)
+		vm_write_end(next);
+	vm_write_end(vma);
+
 	if (remove_next) {
-		if (file) {
+		if (file)
 			uprobe_munmap(next, next->vm_start, next->vm_end);
-			fput(file);
-		}
 		if (next->anon_vma)
 			anon_vma_merge(vma, next);
 		mm->map_count--;
-		mpol_put(vma_policy(next));
-		kmem_cache_free(vm_area_cachep, next);
+		put_vma(next);
 		/*
 		 * In mprotect's case 6 (see comments on vma_merge),
 		 * we must remove another next too. It would clutter
@@ -2550,6 +2639,7 @@ int __split_vma(struct mm_struct *mm, struct vm_area_struct *vma,
 
 	/* most fields are the same, copy all, and then fixup */
 	*new = *vma;
+	vma_init_sequence(new);
 
 	INIT_LIST_HEAD(&new->anon_vma_chain);
 
@@ -3074,6 +3164,10 @@ int insert_vm_struct(struct mm_struct *mm, struct vm_area_struct *vma)
 /*
  * Copy the vma structure to a new location in the same mm,
  * prior to moving page table entries, to effect an mremap move.
+ *
+ * The vma returned is inside a vm_write_begin() section, which keeps the
+ * speculative page faults out of the new location until the caller has
+ * moved the page table entries and calls vm_write_end().
  */
 struct vm_area_struct *copy_vma(struct vm_area_struct **vmap,
 	unsigned long addr, unsigned long len, pgoff_t pgoff,
@@ -3082,7 +3176,8 @@ struct vm_area_struct *copy_vma(struct vm_area_struct **vmap,
 	struct vm_area_struct *vma = *vmap;
 	unsigned long vma_start = vma->vm_start;
 	struct mm_struct *mm = vma->vm_mm;
-	struct vm_area_struct *new_vma, *prev;
+	struct vm_area_struct *new_vma, *prev, *next;
+	unsigned long next_end = 0;
 	struct rb_node **rb_link, *rb_parent;
 	bool faulted_in_anon_vma = true;
 
@@ -3097,9 +3192,27 @@ struct vm_area_struct *copy_vma(struct vm_area_struct **vmap,
 
 	if (find_vma_links(mm, addr, addr + len, &prev, &rb_link, &rb_parent))
 		return NULL;	/* should never get here */
+
+	/*
+	 * Either neighbour may grow over the new location: begin both, and
+	 * end the ones which did not, unless vma_merge() freed next.
+	 */
+	next = prev ? prev->vm_next : mm->mmap;
+	if (prev)
+		vm_write_begin(prev);
+	if (next) {
+		vm_write_begin(next);
+		next_end = next->vm_end;
+	}
 	new_vma = vma_merge(mm, prev, addr, addr + len, vma->vm_flags,
 			    vma->anon_vma, vma->vm_file, pgoff, vma_policy(vma),
 			    vma->vm_userfaultfd_ctx);
+	if (prev && prev != new_vma)
+		vm_write_end(prev);
+	if (next && next != new_vma &&
+	    !(new_vma && new_vma == prev && new_vma->vm_end >= next_end))
+		vm_write_end(next);
+
 	if (new_vma) {
 		/*
 		 * Source vma may have been merged into new_vma
@@ -3127,6 +3240,8 @@ struct vm_area_struct *copy_vma(struct vm_area_struct **vmap,
 		if (!new_vma)
 			goto out;
 		*new_vma = *vma;
+		vma_init_sequence(new_vma);
+		vm_write_begin(new_vma);
 		new_vma->vm_start = addr;
 		new_vma->vm_end = addr + len;
 		new_vma->vm_pgoff = pgoff;
@@ -302,6 +302,8 @@ static unsigned long move_vma(struct vm_area_struct *vma,
 	if (!new_vma)
 		return -ENOMEM;
 
+	/* new_vma was returned write-begun, see copy_vma() */
+	vm_write_begin(vma);
 	moved_len = move_page_tables(vma, old_addr, new_vma, new_addr, old_len,
 				     need_rmap_locks);
 	if (moved_len < old_len) {
@@ -318,11 +320,15 @@ static unsigned long move_vma(struct vm_area_struct *vma,
 		 */
 		move_page_tables(new_vma, new_addr, vma, old_addr, moved_len,
 				 true);
+		vm_write_end(vma);
+		vm_write_end(new_vma);
 		vma = new_vma;
 		old_len = new_len;
 		old_addr = new_addr;
 		new_addr = err;
 	} else {
+		vm_write_end(vma);
+		vm_write_end(new_vma);
 		mremap_userfaultfd_prep(new_vma, uf);
 		arch_remap(mm, old_addr, old_addr + old_len,
 			   new_addr, new_addr + new_len);
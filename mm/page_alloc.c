@@ -68,6 +68,8 @@
 #include <linux/ftrace.h>
 #include <linux/lockdep.h>
 #include <linux/nmi.h>
+#include <linux/padata.h>
+#include <linux/psi.h>
 
 #include <asm/sections.h>
 #include <asm/tlbflush.h>
@@ -191,6 +193,7 @@ unsigned int pageblock_order __read_mostly;
 #endif
 
 static void __free_pages_ok(struct page *page, unsigned int order);
+static void free_the_page(struct page *page, unsigned int order);
 
 /*
  * results with 256, 32 in the lowmem_reserve sysctl:
@@ -588,7 +591,7 @@ static void bad_page(struct page *page, const char *reason,
 
 void free_compound_page(struct page *page)
 {
-	__free_pages_ok(page, compound_order(page));
+	free_the_page(page, compound_order(page));
 }
 
 void prep_compound_page(struct page *page, unsigned int order)
@@ -739,7 +742,7 @@ static inline void rmv_page_order(struct page *page)
  * For recording whether a page is in the buddy system, we set ->_mapcount
  * PAGE_BUDDY_MAPCOUNT_VALUE.
  * Setting, clearing, and testing _mapcount PAGE_BUDDY_MAPCOUNT_VALUE is
- * serialized by zone->lock.
+ * serialized by the lock of the zone shard the page belongs to.
  *
  * For recording page's order, we use page_private(page).
  */
@@ -803,6 +806,7 @@ static inline void __free_one_page(struct page *page,
 {
 	unsigned long combined_pfn;
 	unsigned long uninitialized_var(buddy_pfn);
+	struct free_area *area = zone_shard(zone, pfn)->free_area;
 	struct page *buddy;
 	unsigned int max_order;
 
@@ -835,7 +839,7 @@ static inline void __free_one_page(struct page *page,
 			clear_page_guard(zone, buddy, order, migratetype);
 		} else {
 			list_del(&buddy->lru);
-			zone->free_area[order].nr_free--;
+			area[order].nr_free--;
 			rmv_page_order(buddy);
 		}
 		combined_pfn = buddy_pfn & pfn;
@@ -888,14 +892,14 @@ static inline void __free_one_page(struct page *page,
 		if (pfn_valid_within(buddy_pfn) &&
 		    page_is_buddy(higher_page, higher_buddy, order + 1)) {
 			list_add_tail(&page->lru,
-				&zone->free_area[order].free_list[migratetype]);
+				&area[order].free_list[migratetype]);
 			goto out;
 		}
 	}
 
-	list_add(&page->lru, &zone->free_area[order].free_list[migratetype]);
+	list_add(&page->lru, &area[order].free_list[migratetype]);
 out:
-	zone->free_area[order].nr_free++;
+	area[order].nr_free++;
 }
 
 /*
@@ -1065,9 +1069,9 @@ static __always_inline bool free_pages_prepare(struct page *page,
 }
 
 #ifdef CONFIG_DEBUG_VM
-static inline bool free_pcp_prepare(struct page *page)
+static inline bool free_pcp_prepare(struct page *page, unsigned int order)
 {
-	return free_pages_prepare(page, 0, true);
+	return free_pages_prepare(page, order, true);
 }
 
 static inline bool bulkfree_pcp_prepare(struct page *page)
@@ -1075,9 +1079,9 @@ static inline bool bulkfree_pcp_prepare(struct page *page)
 	return false;
 }
 #else
-static bool free_pcp_prepare(struct page *page)
+static bool free_pcp_prepare(struct page *page, unsigned int order)
 {
-	return free_pages_prepare(page, 0, false);
+	return free_pages_prepare(page, order, false);
 }
 
 static bool bulkfree_pcp_prepare(struct page *page)
@@ -1086,10 +1090,76 @@ static bool bulkfree_pcp_prepare(struct page *page)
 }
 #endif /* CONFIG_DEBUG_VM */
 
+/*
+ * The pcp-lists are indexed by order and migratetype. THP-sized pages use
+ * the order slot right after PAGE_ALLOC_COSTLY_ORDER.
+ */
+static inline unsigned int pcp_order_idx(unsigned int order)
+{
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	if (order > PAGE_ALLOC_COSTLY_ORDER) {
+		VM_BUG_ON(order != HPAGE_PMD_ORDER);
+		return PAGE_ALLOC_COSTLY_ORDER + 1;
+	}
+#else
+	VM_BUG_ON(order > PAGE_ALLOC_COSTLY_ORDER);
+#endif
+	return order;
+}
+
+static inline unsigned int order_to_pindex(int migratetype, unsigned int order)
+{
+	return MIGRATE_PCPTYPES * pcp_order_idx(order) + migratetype;
+}
+
+static inline unsigned int pindex_to_order(unsigned int pindex)
+{
+	unsigned int order = pindex / MIGRATE_PCPTYPES;
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	if (order > PAGE_ALLOC_COSTLY_ORDER)
+		order = HPAGE_PMD_ORDER;
+#endif
+	return order;
+}
+
+/*
+ * Orders up to PAGE_ALLOC_COSTLY_ORDER always go through the pcp-lists. A
+ * THP is only cached when the high watermark has room for it, otherwise it
+ * would be drained straight back to the buddy lists by the next free.
+ */
+static inline bool pcp_allowed_order(struct zone *zone, unsigned int order)
+{
+	if (order <= PAGE_ALLOC_COSTLY_ORDER)
+		return true;
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	if (order == HPAGE_PMD_ORDER)
+		return (1 << order) <
+			READ_ONCE(raw_cpu_ptr(zone->pageset)->pcp.high);
+#endif
+	return false;
+}
+
+/*
+ * Drop the shard lock held in *locked, if any, and take the lock of
+ * @shard instead. Used by the paths moving batches of pages between the
+ * per-cpu lists and the buddy lists, whose pages may span several shards.
+ */
+static inline void zone_shard_switch(struct zone_shard **locked,
+				     struct zone_shard *shard)
+{
+	if (*locked == shard)
+		return;
+	if (*locked)
+		spin_unlock(&(*locked)->lock);
+	spin_lock(&shard->lock);
+	*locked = shard;
+}
+
 /*
  * Frees a number of pages from the PCP lists
- * Assumes all pages on list are in same zone, and of same order.
- * count is the number of pages to free.
+ * Assumes all pages on list are in same zone.
+ * count is the number of base pages to free, pcp->count is updated.
  *
  * If the zone was previously in an "all pages pinned" state then look to
  * see if this freeing clears that state.
@@ -1100,16 +1170,20 @@ static bool bulkfree_pcp_prepare(struct page *page)
 static void free_pcppages_bulk(struct zone *zone, int count,
 					struct per_cpu_pages *pcp)
 {
-	int migratetype = 0;
+	struct zone_shard *locked = NULL;
+	int pindex = 0;
 	int batch_free = 0;
-	bool isolated_pageblocks;
 
-	spin_lock(&zone->lock);
-	isolated_pageblocks = has_isolate_pageblock(zone);
+	/*
+	 * High-order pages free several base pages at once: never ask for
+	 * more than the lists hold, or the loop below would never end.
+	 */
+	count = min(pcp->count, count);
 
-	while (count) {
+	while (count > 0) {
 		struct page *page;
 		struct list_head *list;
+		unsigned int order;
 
 		/*
 		 * Remove pages from lists in a round-robin fashion. A
@@ -1120,37 +1194,46 @@ static void free_pcppages_bulk(struct zone *zone, int count,
 		 */
 		do {
 			batch_free++;
-			if (++migratetype == MIGRATE_PCPTYPES)
-				migratetype = 0;
-			list = &pcp->lists[migratetype];
+			if (++pindex == NR_PCP_LISTS)
+				pindex = 0;
+			list = &pcp->lists[pindex];
 		} while (list_empty(list));
 
 		/* This is the only non-empty list. Free them all. */
-		if (batch_free == MIGRATE_PCPTYPES)
+		if (batch_free == NR_PCP_LISTS)
 			batch_free = count;
 
+		order = pindex_to_order(pindex);
 		do {
 			int mt;	/* migratetype of the to-be-freed page */
+			unsigned long pfn;
 
 			page = list_last_entry(list, struct page, lru);
 			/* must delete as __free_one_page list manipulates */
 			list_del(&page->lru);
+			pcp->count -= 1 << order;
+			pcp->order_count[pcp_order_idx(order)]--;
+			count -= 1 << order;
 
 			mt = get_pcppage_migratetype(page);
 			/* MIGRATE_ISOLATE page should not go to pcplists */
 			VM_BUG_ON_PAGE(is_migrate_isolate(mt), page);
-			/* Pageblock could have been isolated meanwhile */
-			if (unlikely(isolated_pageblocks))
-				mt = get_pageblock_migratetype(page);
 
 			if (bulkfree_pcp_prepare(page))
 				continue;
 
-			__free_one_page(page, page_to_pfn(page), zone, 0, mt);
-			trace_mm_page_pcpu_drain(page, 0, mt);
-		} while (--count && --batch_free && !list_empty(list));
+			pfn = page_to_pfn(page);
+			zone_shard_switch(&locked, zone_shard(zone, pfn));
+			/* Pageblock could have been isolated meanwhile */
+			if (unlikely(has_isolate_pageblock(zone)))
+				mt = get_pageblock_migratetype(page);
+
+			__free_one_page(page, pfn, zone, order, mt);
+			trace_mm_page_pcpu_drain(page, order, mt);
+		} while (count > 0 && --batch_free && !list_empty(list));
 	}
-	spin_unlock(&zone->lock);
+	if (locked)
+		spin_unlock(&locked->lock);
 }
 
 static void free_one_page(struct zone *zone,
@@ -1158,13 +1241,15 @@ static void free_one_page(struct zone *zone,
 				unsigned int order,
 				int migratetype)
 {
-	spin_lock(&zone->lock);
+	struct zone_shard *shard = zone_shard(zone, pfn);
+
+	spin_lock(&shard->lock);
 	if (unlikely(has_isolate_pageblock(zone) ||
 		is_migrate_isolate(migratetype))) {
 		migratetype = get_pfnblock_migratetype(page, pfn);
 	}
 	__free_one_page(page, pfn, zone, order, migratetype);
-	spin_unlock(&zone->lock);
+	spin_unlock(&shard->lock);
 }
 
 static void __meminit __init_single_page(struct page *page, unsigned long pfn,
@@ -1271,7 +1356,6 @@ static void __init __free_pages_boot_core(struct page *page, unsigned int order)
 	__ClearPageReserved(p);
 	set_page_count(p, 0);
 
-	page_zone(page)->managed_pages += nr_pages;
 	set_page_refcounted(page);
 	__free_pages(page, order);
 }
@@ -1335,6 +1419,7 @@ void __init __free_pages_bootmem(struct page *page, unsigned long pfn,
 {
 	if (early_page_uninitialised(pfn))
 		return;
+	page_zone(page)->managed_pages += 1 << order;
 	return __free_pages_boot_core(page, order);
 }
 
@@ -1443,16 +1528,133 @@ static inline void __init pgdat_init_report_one_done(void)
 		complete(&pgdat_init_all_done_comp);
 }
 
-/* Initialise remaining memory on a node */
+/* Initialise and free the struct pages of [pfn, end_pfn) in @zone */
+static unsigned long __init
+deferred_init_range(struct zone *zone, unsigned long pfn, unsigned long end_pfn,
+		    struct mminit_pfnnid_cache *nid_init_state)
+{
+	int nid = zone_to_nid(zone), zid = zone_idx(zone);
+	struct page *page = NULL;
+	struct page *free_base_page = NULL;
+	unsigned long free_base_pfn = 0;
+	unsigned long nr_pages = 0;
+	int nr_to_free = 0;
+
+	for (; pfn < end_pfn; pfn++) {
+		if (!pfn_valid_within(pfn))
+			goto free_range;
+
+		/*
+		 * Ensure pfn_valid is checked every
+		 * pageblock_nr_pages for memory holes
+		 */
+		if ((pfn & (pageblock_nr_pages - 1)) == 0) {
+			if (!pfn_valid(pfn)) {
+				page = NULL;
+				goto free_range;
+			}
+		}
+
+		if (!meminit_pfn_in_nid(pfn, nid, nid_init_state)) {
+			page = NULL;
+			goto free_range;
+		}
+
+		/* Minimise pfn page lookups and scheduler checks */
+		if (page && (pfn & (pageblock_nr_pages - 1)) != 0) {
+			page++;
+		} else {
+			nr_pages += nr_to_free;
+			deferred_free_range(free_base_page,
+					free_base_pfn, nr_to_free);
+			free_base_page = NULL;
+			free_base_pfn = nr_to_free = 0;
+
+			page = pfn_to_page(pfn);
+			cond_resched();
+		}
+
+		if (page->flags) {
+			VM_BUG_ON(page_zone(page) != zone);
+			goto free_range;
+		}
+
+		__init_single_page(page, pfn, zid, nid);
+		if (!free_base_page) {
+			free_base_page = page;
+			free_base_pfn = pfn;
+			nr_to_free = 0;
+		}
+		nr_to_free++;
+
+		/* Where possible, batch up pages for a single free */
+		continue;
+free_range:
+		/* Free the current block of pages to allocator */
+		nr_pages += nr_to_free;
+		deferred_free_range(free_base_page, free_base_pfn,
+							nr_to_free);
+		free_base_page = NULL;
+		free_base_pfn = nr_to_free = 0;
+	}
+	/* Free the last block of pages to allocator */
+	nr_pages += nr_to_free;
+	deferred_free_range(free_base_page, free_base_pfn, nr_to_free);
+
+	return nr_pages;
+}
+
+struct deferred_init_args {
+	struct zone *zone;
+	atomic_long_t nr_pages;
+};
+
+/* One chunk of a node's deferred range, run by padata_do_multithreaded() */
+static void __init deferred_init_chunk(unsigned long start_pfn,
+				       unsigned long end_pfn, void *arg)
+{
+	struct deferred_init_args *args = arg;
+	struct zone *zone = args->zone;
+	struct mminit_pfnnid_cache nid_init_state = { };
+	unsigned long walk_start, walk_end;
+	unsigned long nr_pages = 0;
+	int i;
+
+	for_each_mem_pfn_range(i, zone_to_nid(zone), &walk_start, &walk_end,
+			       NULL) {
+		unsigned long spfn = max(walk_start, start_pfn);
+		unsigned long epfn = min(walk_end, end_pfn);
+
+		if (spfn < epfn)
+			nr_pages += deferred_init_range(zone, spfn, epfn,
+							&nid_init_state);
+	}
+
+	/*
+	 * Chunks of the same zone run concurrently, so the managed page
+	 * count deferred_free_range() leaves alone is added up here.
+	 */
+	spin_lock(&managed_page_count_lock);
+	zone->managed_pages += nr_pages;
+	spin_unlock(&managed_page_count_lock);
+
+	atomic_long_add(nr_pages, &args->nr_pages);
+}
+
+/*
+ * Initialise remaining memory on a node, spreading the work over all the
+ * cpus of the node.
+ */
 static int __init deferred_init_memmap(void *data)
 {
 	pg_data_t *pgdat = data;
 	int nid = pgdat->node_id;
-	struct mminit_pfnnid_cache nid_init_state = { };
 	unsigned long start = jiffies;
-	unsigned long nr_pages = 0;
-	unsigned long walk_start, walk_end;
-	int i, zid;
+	struct deferred_init_args args = {
+		.nr_pages = ATOMIC_LONG_INIT(0),
+	};
+	struct padata_mt_job job;
+	int zid;
 	struct zone *zone;
 	unsigned long first_init_pfn = pgdat->first_deferred_pfn;
 	const struct cpumask *cpumask = cpumask_of_node(pgdat->node_id);
@@ -1478,89 +1680,25 @@ static int __init deferred_init_memmap(void *data)
 			break;
 	}
 
-	for_each_mem_pfn_range(i, nid, &walk_start, &walk_end, NULL) {
-		unsigned long pfn, end_pfn;
-		struct page *page = NULL;
-		struct page *free_base_page = NULL;
-		unsigned long free_base_pfn = 0;
-		int nr_to_free = 0;
-
-		end_pfn = min(walk_end, zone_end_pfn(zone));
-		pfn = first_init_pfn;
-		if (pfn < walk_start)
-			pfn = walk_start;
-		if (pfn < zone->zone_start_pfn)
-			pfn = zone->zone_start_pfn;
-
-		for (; pfn < end_pfn; pfn++) {
-			if (!pfn_valid_within(pfn))
-				goto free_range;
-
-			/*
-			 * Ensure pfn_valid is checked every
-			 * pageblock_nr_pages for memory holes
-			 */
-			if ((pfn & (pageblock_nr_pages - 1)) == 0) {
-				if (!pfn_valid(pfn)) {
-					page = NULL;
-					goto free_range;
-				}
-			}
-
-			if (!meminit_pfn_in_nid(pfn, nid, &nid_init_state)) {
-				page = NULL;
-				goto free_range;
-			}
-
-			/* Minimise pfn page lookups and scheduler checks */
-			if (page && (pfn & (pageblock_nr_pages - 1)) != 0) {
-				page++;
-			} else {
-				nr_pages += nr_to_free;
-				deferred_free_range(free_base_page,
-						free_base_pfn, nr_to_free);
-				free_base_page = NULL;
-				free_base_pfn = nr_to_free = 0;
-
-				page = pfn_to_page(pfn);
-				cond_resched();
-			}
-
-			if (page->flags) {
-				VM_BUG_ON(page_zone(page) != zone);
-				goto free_range;
-			}
-
-			__init_single_page(page, pfn, zid, nid);
-			if (!free_base_page) {
-				free_base_page = page;
-				free_base_pfn = pfn;
-				nr_to_free = 0;
-			}
-			nr_to_free++;
-
-			/* Where possible, batch up pages for a single free */
-			continue;
-free_range:
-			/* Free the current block of pages to allocator */
-			nr_pages += nr_to_free;
-			deferred_free_range(free_base_page, free_base_pfn,
-								nr_to_free);
-			free_base_page = NULL;
-			free_base_pfn = nr_to_free = 0;
-		}
-		/* Free the last block of pages to allocator */
-		nr_pages += nr_to_free;
-		deferred_free_range(free_base_page, free_base_pfn, nr_to_free);
-
-		first_init_pfn = max(end_pfn, first_init_pfn);
-	}
+	first_init_pfn = max(first_init_pfn, zone->zone_start_pfn);
+	args.zone = zone;
+	job = (struct padata_mt_job) {
+		.thread_fn	= deferred_init_chunk,
+		.fn_arg		= &args,
+		.start		= first_init_pfn,
+		.size		= zone_end_pfn(zone) - first_init_pfn,
+		.align		= PAGES_PER_SECTION,
+		.min_chunk	= PAGES_PER_SECTION,
+		.max_threads	= max_t(int, cpumask_weight(cpumask), 1),
+	};
+	padata_do_multithreaded(&job);
 
 	/* Sanity check that the next zone really is unpopulated */
 	WARN_ON(++zid < MAX_NR_ZONES && populated_zone(++zone));
 
-	pr_info("node %d initialised, %lu pages in %ums\n", nid, nr_pages,
-					jiffies_to_msecs(jiffies - start));
+	pr_info("node %d initialised, %lu pages in %ums with up to %d threads\n",
+		nid, atomic_long_read(&args.nr_pages),
+		jiffies_to_msecs(jiffies - start), job.max_threads);
 
 	pgdat_init_report_one_done();
 	return 0;
@@ -1789,12 +1927,12 @@ static void prep_new_page(struct page *page, unsigned int order, gfp_t gfp_flags
 }
 
 /*
- * Go through the free lists for the given migratetype and remove
+ * Go through the free lists of @shard for the given migratetype and remove
  * the smallest available page from the freelists
  */
 static inline
-struct page *__rmqueue_smallest(struct zone *zone, unsigned int order,
-						int migratetype)
+struct page *__rmqueue_smallest(struct zone *zone, struct zone_shard *shard,
+				unsigned int order, int migratetype)
 {
 	unsigned int current_order;
 	struct free_area *area;
@@ -1802,7 +1940,7 @@ struct page *__rmqueue_smallest(struct zone *zone, unsigned int order,
 
 	/* Find a page of the appropriate size in the preferred list */
 	for (current_order = order; current_order < MAX_ORDER; ++current_order) {
-		area = &(zone->free_area[current_order]);
+		area = &shard->free_area[current_order];
 		page = list_first_entry_or_null(&area->free_list[migratetype],
 							struct page, lru);
 		if (!page)
@@ -1837,24 +1975,27 @@ static int fallbacks[MIGRATE_TYPES][4] = {
 
 #ifdef CONFIG_CMA
 static struct page *__rmqueue_cma_fallback(struct zone *zone,
-					unsigned int order)
+		struct zone_shard *shard, unsigned int order)
 {
-	return __rmqueue_smallest(zone, order, MIGRATE_CMA);
+	return __rmqueue_smallest(zone, shard, order, MIGRATE_CMA);
 }
 #else
 static inline struct page *__rmqueue_cma_fallback(struct zone *zone,
-					unsigned int order) { return NULL; }
+		struct zone_shard *shard, unsigned int order) { return NULL; }
 #endif
 
 /*
  * Move the free pages in a range to the free lists of the requested type.
  * Note that start_page and end_pages are not aligned on a pageblock
  * boundary. If alignment is required, use move_freepages_block()
+ * The range must not cross a pageblock, so it is covered by the one shard
+ * whose lock the caller holds.
  */
 static int move_freepages(struct zone *zone,
 			  struct page *start_page, struct page *end_page,
 			  int migratetype, int *num_movable)
 {
+	struct free_area *area;
 	struct page *page;
 	unsigned int order;
 	int pages_moved = 0;
@@ -1873,6 +2014,7 @@ static int move_freepages(struct zone *zone,
 	if (num_movable)
 		*num_movable = 0;
 
+	area = zone_shard(zone, page_to_pfn(start_page))->free_area;
 	for (page = start_page; page <= end_page;) {
 		if (!pfn_valid_within(page_to_pfn(page))) {
 			page++;
@@ -1897,8 +2039,7 @@ static int move_freepages(struct zone *zone,
 		}
 
 		order = page_order(page);
-		list_move(&page->lru,
-			  &zone->free_area[order].free_list[migratetype]);
+		list_move(&page->lru, &area[order].free_list[migratetype]);
 		page += 1 << order;
 		pages_moved += 1 << order;
 	}
@@ -1980,8 +2121,9 @@ static bool can_steal_fallback(unsigned int order, int start_mt)
  * of pages are free or compatible, we can change migratetype of the pageblock
  * itself, so pages freed in the future will be put on the correct free list.
  */
-static void steal_suitable_fallback(struct zone *zone, struct page *page,
-					int start_type, bool whole_block)
+static void steal_suitable_fallback(struct zone *zone,
+		struct zone_shard *shard, struct page *page,
+		int start_type, bool whole_block)
 {
 	unsigned int current_order = page_order(page);
 	struct free_area *area;
@@ -2046,7 +2188,7 @@ static void steal_suitable_fallback(struct zone *zone, struct page *page,
 	return;
 
 single_page:
-	area = &zone->free_area[current_order];
+	area = &shard->free_area[current_order];
 	list_move(&page->lru, &area->free_list[start_type]);
 }
 
@@ -2094,6 +2236,7 @@ int find_suitable_fallback(struct free_area *area, unsigned int order,
 static void reserve_highatomic_pageblock(struct page *page, struct zone *zone,
 				unsigned int alloc_order)
 {
+	struct zone_shard *shard;
 	int mt;
 	unsigned long max_managed, flags;
 
@@ -2106,6 +2249,8 @@ static void reserve_highatomic_pageblock(struct page *page, struct zone *zone,
 		return;
 
 	spin_lock_irqsave(&zone->lock, flags);
+	shard = zone_shard(zone, page_to_pfn(page));
+	spin_lock(&shard->lock);
 
 	/* Recheck the nr_reserved_highatomic limit under the lock */
 	if (zone->nr_reserved_highatomic >= max_managed)
@@ -2121,6 +2266,7 @@ static void reserve_highatomic_pageblock(struct page *page, struct zone *zone,
 	}
 
 out_unlock:
+	spin_unlock(&shard->lock);
 	spin_unlock_irqrestore(&zone->lock, flags);
 }
 
@@ -2137,6 +2283,7 @@ static bool unreserve_highatomic_pageblock(const struct alloc_context *ac,
 						bool force)
 {
 	struct zonelist *zonelist = ac->zonelist;
+	struct zone_shard *shard;
 	unsigned long flags;
 	struct zoneref *z;
 	struct zone *zone;
@@ -2155,51 +2302,61 @@ static bool unreserve_highatomic_pageblock(const struct alloc_context *ac,
 			continue;
 
 		spin_lock_irqsave(&zone->lock, flags);
-		for (order = 0; order < MAX_ORDER; order++) {
-			struct free_area *area = &(zone->free_area[order]);
+		for_each_zone_shard(zone, shard) {
+			spin_lock(&shard->lock);
+			for (order = 0; order < MAX_ORDER; order++) {
+				struct free_area *area;
 
-			page = list_first_entry_or_null(
+				area = &shard->free_area[order];
+				page = list_first_entry_or_null(
 					&area->free_list[MIGRATE_HIGHATOMIC],
 					struct page, lru);
-			if (!page)
-				continue;
+				if (!page)
+					continue;
 
-			/*
-			 * In page freeing path, migratetype change is racy so
-			 * we can counter several free pages in a pageblock
-			 * in this loop althoug we changed the pageblock type
-			 * from highatomic to ac->migratetype. So we should
-			 * adjust the count once.
-			 */
-			if (is_migrate_highatomic_page(page)) {
 				/*
-				 * It should never happen but changes to
-				 * locking could inadvertently allow a per-cpu
-				 * drain to add pages to MIGRATE_HIGHATOMIC
-				 * while unreserving so be safe and watch for
-				 * underflows.
+				 * In page freeing path, migratetype change is
+				 * racy so we can counter several free pages in
+				 * a pageblock in this loop althoug we changed
+				 * the pageblock type from highatomic to
+				 * ac->migratetype. So we should adjust the
+				 * count once.
 				 */
-				zone->nr_reserved_highatomic -= min(
+				if (is_migrate_highatomic_page(page)) {
+					/*
+					 * It should never happen but changes
+					 * to locking could inadvertently allow
+					 * a per-cpu drain to add pages to
+					 * MIGRATE_HIGHATOMIC while unreserving
+					 * so be safe and watch for underflows.
+					 */
+					zone->nr_reserved_highatomic -= min(
 						pageblock_nr_pages,
 						zone->nr_reserved_highatomic);
-			}
+				}
 
-			/*
-			 * Convert to ac->migratetype and avoid the normal
-			 * pageblock stealing heuristics. Minimally, the caller
-			 * is doing the work and needs the pages. More
-			 * importantly, if the block was always converted to
-			 * MIGRATE_UNMOVABLE or another type then the number
-			 * of pageblocks that cannot be completely freed
-			 * may increase.
-			 */
-			set_pageblock_migratetype(page, ac->migratetype);
-			ret = move_freepages_block(zone, page, ac->migratetype,
-									NULL);
-			if (ret) {
-				spin_unlock_irqrestore(&zone->lock, flags);
-				return ret;
+				/*
+				 * Convert to ac->migratetype and avoid the
+				 * normal pageblock stealing heuristics.
+				 * Minimally, the caller is doing the work and
+				 * needs the pages. More importantly, if the
+				 * block was always converted to
+				 * MIGRATE_UNMOVABLE or another type then the
+				 * number of pageblocks that cannot be
+				 * completely freed may increase.
+				 */
+				set_pageblock_migratetype(page,
+							  ac->migratetype);
+				ret = move_freepages_block(zone, page,
+						ac->migratetype, NULL);
+				if (ret) {
+					spin_unlock(&shard->lock);
+					spin_unlock_irqrestore(&zone->lock,
+							       flags);
+					return ret;
+				}
 			}
+			spin_unlock(&shard->lock);
 		}
 		spin_unlock_irqrestore(&zone->lock, flags);
 	}
@@ -2218,7 +2375,8 @@ static bool unreserve_highatomic_pageblock(const struct alloc_context *ac,
  * condition simpler.
  */
 static inline bool
-__rmqueue_fallback(struct zone *zone, int order, int start_migratetype)
+__rmqueue_fallback(struct zone *zone, struct zone_shard *shard, int order,
+		   int start_migratetype)
 {
 	struct free_area *area;
 	int current_order;
@@ -2233,7 +2391,7 @@ __rmqueue_fallback(struct zone *zone, int order, int start_migratetype)
 	 */
 	for (current_order = MAX_ORDER - 1; current_order >= order;
 				--current_order) {
-		area = &(zone->free_area[current_order]);
+		area = &shard->free_area[current_order];
 		fallback_mt = find_suitable_fallback(area, current_order,
 				start_migratetype, false, &can_steal);
 		if (fallback_mt == -1)
@@ -2259,7 +2417,7 @@ __rmqueue_fallback(struct zone *zone, int order, int start_migratetype)
 find_smallest:
 	for (current_order = order; current_order < MAX_ORDER;
 							current_order++) {
-		area = &(zone->free_area[current_order]);
+		area = &shard->free_area[current_order];
 		fallback_mt = find_suitable_fallback(area, current_order,
 				start_migratetype, false, &can_steal);
 		if (fallback_mt != -1)
@@ -2276,7 +2434,8 @@ __rmqueue_fallback(struct zone *zone, int order, int start_migratetype)
 	page = list_first_entry(&area->free_list[fallback_mt],
 							struct page, lru);
 
-	steal_suitable_fallback(zone, page, start_migratetype, can_steal);
+	steal_suitable_fallback(zone, shard, page, start_migratetype,
+				can_steal);
 
 	trace_mm_page_alloc_extfrag(page, order, current_order,
 		start_migratetype, fallback_mt);
@@ -2287,20 +2446,21 @@ __rmqueue_fallback(struct zone *zone, int order, int start_migratetype)
 
 /*
  * Do the hard work of removing an element from the buddy allocator.
- * Call me with the zone->lock already held.
+ * Call me with the shard->lock already held.
  */
-static struct page *__rmqueue(struct zone *zone, unsigned int order,
-				int migratetype)
+static struct page *__rmqueue(struct zone *zone, struct zone_shard *shard,
+				unsigned int order, int migratetype)
 {
 	struct page *page;
 
 retry:
-	page = __rmqueue_smallest(zone, order, migratetype);
+	page = __rmqueue_smallest(zone, shard, order, migratetype);
 	if (unlikely(!page)) {
 		if (migratetype == MIGRATE_MOVABLE)
-			page = __rmqueue_cma_fallback(zone, order);
+			page = __rmqueue_cma_fallback(zone, shard, order);
 
-		if (!page && __rmqueue_fallback(zone, order, migratetype))
+		if (!page &&
+		    __rmqueue_fallback(zone, shard, order, migratetype))
 			goto retry;
 	}
 
@@ -2308,20 +2468,86 @@ static struct page *__rmqueue(struct zone *zone, unsigned int order,
 	return page;
 }
 
+/* The shard a CPU allocates from first, spreading CPUs over the shards */
+static inline struct zone_shard *zone_home_shard(struct zone *zone)
+{
+	return &zone->shards[raw_smp_processor_id() & (zone->nr_shards - 1)];
+}
+
+/*
+ * Remove an element from any shard of the zone, starting with the one
+ * whose lock is held in *locked. Every shard is searched for the requested
+ * migratetype before any of them is allowed to fall back to another one,
+ * so that splitting the free lists does not defeat the anti-fragmentation
+ * heuristics. On return *locked is the shard still locked.
+ */
+static struct page *__rmqueue_sharded(struct zone *zone,
+		struct zone_shard **locked, unsigned int order,
+		int migratetype)
+{
+	unsigned int i, idx, mask = zone->nr_shards - 1;
+	struct page *page;
+
+	if (!mask)
+		return __rmqueue(zone, *locked, order, migratetype);
+
+	idx = *locked - zone->shards;
+	for (i = 0; i <= mask; i++) {
+		zone_shard_switch(locked, &zone->shards[(idx + i) & mask]);
+		page = __rmqueue_smallest(zone, *locked, order, migratetype);
+		if (page) {
+			trace_mm_page_alloc_zone_locked(page, order,
+							migratetype);
+			return page;
+		}
+	}
+
+	for (i = 0; i <= mask; i++) {
+		zone_shard_switch(locked, &zone->shards[(idx + i) & mask]);
+		page = __rmqueue(zone, *locked, order, migratetype);
+		if (page)
+			return page;
+	}
+
+	return NULL;
+}
+
+/* Look for a highatomic reserve page in every shard of the zone */
+static struct page *__rmqueue_highatomic(struct zone *zone,
+		struct zone_shard **locked, unsigned int order)
+{
+	unsigned int i, idx, mask = zone->nr_shards - 1;
+	struct page *page;
+
+	idx = *locked - zone->shards;
+	for (i = 0; i <= mask; i++) {
+		zone_shard_switch(locked, &zone->shards[(idx + i) & mask]);
+		page = __rmqueue_smallest(zone, *locked, order,
+					  MIGRATE_HIGHATOMIC);
+		if (page)
+			return page;
+	}
+
+	return NULL;
+}
+
 /*
  * Obtain a specified number of elements from the buddy allocator, all under
- * a single hold of the lock, for efficiency.  Add them to the supplied list.
+ * a single hold of the home shard lock as long as that shard has pages, for
+ * efficiency.  Add them to the supplied list.
  * Returns the number of new pages which were placed at *list.
  */
 static int rmqueue_bulk(struct zone *zone, unsigned int order,
 			unsigned long count, struct list_head *list,
 			int migratetype, bool cold)
 {
+	struct zone_shard *shard = zone_home_shard(zone);
 	int i, alloced = 0;
 
-	spin_lock(&zone->lock);
+	spin_lock(&shard->lock);
 	for (i = 0; i < count; ++i) {
-		struct page *page = __rmqueue(zone, order, migratetype);
+		struct page *page = __rmqueue_sharded(zone, &shard, order,
+						      migratetype);
 		if (unlikely(page == NULL))
 			break;
 
@@ -2355,7 +2581,7 @@ static int rmqueue_bulk(struct zone *zone, unsigned int order,
 	 * pages added to the pcp list.
 	 */
 	__mod_zone_page_state(zone, NR_FREE_PAGES, -(i << order));
-	spin_unlock(&zone->lock);
+	spin_unlock(&shard->lock);
 	return alloced;
 }
 
@@ -2376,10 +2602,8 @@ void drain_zone_pages(struct zone *zone, struct per_cpu_pages *pcp)
 	local_irq_save(flags);
 	batch = READ_ONCE(pcp->batch);
 	to_drain = min(pcp->count, batch);
-	if (to_drain > 0) {
+	if (to_drain > 0)
 		free_pcppages_bulk(zone, to_drain, pcp);
-		pcp->count -= to_drain;
-	}
 	local_irq_restore(flags);
 }
 #endif
@@ -2401,10 +2625,8 @@ static void drain_pages_zone(unsigned int cpu, struct zone *zone)
 	pset = per_cpu_ptr(zone->pageset, cpu);
 
 	pcp = &pset->pcp;
-	if (pcp->count) {
+	if (pcp->count)
 		free_pcppages_bulk(zone, pcp->count, pcp);
-		pcp->count = 0;
-	}
 	local_irq_restore(flags);
 }
 
@@ -2545,6 +2767,7 @@ void drain_all_pages(struct zone *zone)
 void mark_free_pages(struct zone *zone)
 {
 	unsigned long pfn, max_zone_pfn, page_count = WD_PAGE_COUNT;
+	struct zone_shard *shard;
 	unsigned long flags;
 	unsigned int order, t;
 	struct page *page;
@@ -2552,7 +2775,7 @@ void mark_free_pages(struct zone *zone)
 	if (zone_is_empty(zone))
 		return;
 
-	spin_lock_irqsave(&zone->lock, flags);
+	zone_lock_all_shards(zone, flags);
 
 	max_zone_pfn = zone_end_pfn(zone);
 	for (pfn = zone->zone_start_pfn; pfn < max_zone_pfn; pfn++)
@@ -2571,44 +2794,50 @@ void mark_free_pages(struct zone *zone)
 				swsusp_unset_page_free(page);
 		}
 
-	for_each_migratetype_order(order, t) {
-		list_for_each_entry(page,
-				&zone->free_area[order].free_list[t], lru) {
-			unsigned long i;
-
-			pfn = page_to_pfn(page);
-			for (i = 0; i < (1UL << order); i++) {
-				if (!--page_count) {
-					touch_nmi_watchdog();
-					page_count = WD_PAGE_COUNT;
+	for_each_zone_shard(zone, shard) {
+		for_each_migratetype_order(order, t) {
+			struct free_area *area = &shard->free_area[order];
+
+			list_for_each_entry(page, &area->free_list[t], lru) {
+				unsigned long i;
+
+				pfn = page_to_pfn(page);
+				for (i = 0; i < (1UL << order); i++) {
+					if (!--page_count) {
+						touch_nmi_watchdog();
+						page_count = WD_PAGE_COUNT;
+					}
+					swsusp_set_page_free(
+						pfn_to_page(pfn + i));
 				}
-				swsusp_set_page_free(pfn_to_page(pfn + i));
 			}
 		}
 	}
-	spin_unlock_irqrestore(&zone->lock, flags);
+	zone_unlock_all_shards(zone, flags);
 }
 #endif /* CONFIG_PM */
 
 /*
- * Free a 0-order page
+ * Free a page of an order the pcp-lists cache
  * cold == true ? free a cold page : free a hot page
  */
-void free_hot_cold_page(struct page *page, bool cold)
+static void __free_hot_cold_page(struct page *page, unsigned int order,
+				 bool cold)
 {
 	struct zone *zone = page_zone(page);
 	struct per_cpu_pages *pcp;
+	struct list_head *list;
 	unsigned long flags;
 	unsigned long pfn = page_to_pfn(page);
 	int migratetype;
 
-	if (!free_pcp_prepare(page))
+	if (!free_pcp_prepare(page, order))
 		return;
 
 	migratetype = get_pfnblock_migratetype(page, pfn);
 	set_pcppage_migratetype(page, migratetype);
 	local_irq_save(flags);
-	__count_vm_event(PGFREE);
+	__count_vm_events(PGFREE, 1 << order);
 
 	/*
 	 * We only track unmovable, reclaimable and movable on pcp lists.
@@ -2619,28 +2848,46 @@ void free_hot_cold_page(struct page *page, bool cold)
 	 */
 	if (migratetype >= MIGRATE_PCPTYPES) {
 		if (unlikely(is_migrate_isolate(migratetype))) {
-			free_one_page(zone, page, pfn, 0, migratetype);
+			free_one_page(zone, page, pfn, order, migratetype);
 			goto out;
 		}
 		migratetype = MIGRATE_MOVABLE;
 	}
 
 	pcp = &this_cpu_ptr(zone->pageset)->pcp;
+	list = &pcp->lists[order_to_pindex(migratetype, order)];
 	if (!cold)
-		list_add(&page->lru, &pcp->lists[migratetype]);
+		list_add(&page->lru, list);
 	else
-		list_add_tail(&page->lru, &pcp->lists[migratetype]);
-	pcp->count++;
+		list_add_tail(&page->lru, list);
+	pcp->count += 1 << order;
+	pcp->order_count[pcp_order_idx(order)]++;
 	if (pcp->count >= pcp->high) {
 		unsigned long batch = READ_ONCE(pcp->batch);
 		free_pcppages_bulk(zone, batch, pcp);
-		pcp->count -= batch;
 	}
 
 out:
 	local_irq_restore(flags);
 }
 
+/*
+ * Free a 0-order page
+ * cold == true ? free a cold page : free a hot page
+ */
+void free_hot_cold_page(struct page *page, bool cold)
+{
+	__free_hot_cold_page(page, 0, cold);
+}
+
+static void free_the_page(struct page *page, unsigned int order)
+{
+	if (pcp_allowed_order(page_zone(page), order))
+		__free_hot_cold_page(page, order, false);
+	else
+		__free_pages_ok(page, order);
+}
+
 /*
  * Free a list of 0-order pages
  */
@@ -2711,7 +2958,7 @@ int __isolate_free_page(struct page *page, unsigned int order)
 
 	/* Remove page from free list */
 	list_del(&page->lru);
-	zone->free_area[order].nr_free--;
+	zone_shard(zone, page_to_pfn(page))->free_area[order].nr_free--;
 	rmv_page_order(page);
 
 	/*
@@ -2757,17 +3004,31 @@ static inline void zone_statistics(struct zone *preferred_zone, struct zone *z)
 }
 
 /* Remove page from the per-cpu list, caller must protect the list */
-static struct page *__rmqueue_pcplist(struct zone *zone, int migratetype,
-			bool cold, struct per_cpu_pages *pcp,
+static struct page *__rmqueue_pcplist(struct zone *zone, unsigned int order,
+			int migratetype, bool cold,
+			struct per_cpu_pages *pcp,
 			struct list_head *list)
 {
 	struct page *page;
 
 	do {
 		if (list_empty(list)) {
-			pcp->count += rmqueue_bulk(zone, 0,
-					pcp->batch, list,
-					migratetype, cold);
+			int batch = READ_ONCE(pcp->batch);
+			int alloced;
+
+			/*
+			 * A batch is sized in base pages: refill high-order
+			 * lists with proportionally fewer pages, and THP
+			 * lists with a single one.
+			 */
+			if (order > PAGE_ALLOC_COSTLY_ORDER)
+				batch = 1;
+			else if (order)
+				batch = max(batch >> order, 2);
+			alloced = rmqueue_bulk(zone, order, batch, list,
+					       migratetype, cold);
+			pcp->count += alloced << order;
+			pcp->order_count[pcp_order_idx(order)] += alloced;
 			if (unlikely(list_empty(list)))
 				return NULL;
 		}
@@ -2778,7 +3039,8 @@ static struct page *__rmqueue_pcplist(struct zone *zone, int migratetype,
 			page = list_first_entry(list, struct page, lru);
 
 		list_del(&page->lru);
-		pcp->count--;
+		pcp->count -= 1 << order;
+		pcp->order_count[pcp_order_idx(order)]--;
 	} while (check_new_pcp(page));
 
 	return page;
@@ -2797,8 +3059,8 @@ static struct page *rmqueue_pcplist(struct zone *preferred_zone,
 
 	local_irq_save(flags);
 	pcp = &this_cpu_ptr(zone->pageset)->pcp;
-	list = &pcp->lists[migratetype];
-	page = __rmqueue_pcplist(zone,  migratetype, cold, pcp, list);
+	list = &pcp->lists[order_to_pindex(migratetype, order)];
+	page = __rmqueue_pcplist(zone, order, migratetype, cold, pcp, list);
 	if (page) {
 		__count_zid_vm_events(PGALLOC, page_zonenum(page), 1 << order);
 		zone_statistics(preferred_zone, zone);
@@ -2808,7 +3070,7 @@ static struct page *rmqueue_pcplist(struct zone *preferred_zone,
 }
 
 /*
- * Allocate a page from the given zone. Use pcplists for order-0 allocations.
+ * Allocate a page from the given zone. Use pcplists for the orders they cache.
  */
 static inline
 struct page *rmqueue(struct zone *preferred_zone,
@@ -2816,13 +3078,19 @@ struct page *rmqueue(struct zone *preferred_zone,
 			gfp_t gfp_flags, unsigned int alloc_flags,
 			int migratetype)
 {
+	struct zone_shard *shard;
 	unsigned long flags;
 	struct page *page;
 
-	if (likely(order == 0)) {
+	if (likely(pcp_allowed_order(zone, order))) {
 		page = rmqueue_pcplist(preferred_zone, zone, order,
 				gfp_flags, migratetype);
-		goto out;
+		/*
+		 * The pcp-lists never hold MIGRATE_HIGHATOMIC pages, so let
+		 * high-order atomic requests still try the reserve.
+		 */
+		if (likely(page) || !order || !(alloc_flags & ALLOC_HARDER))
+			goto out;
 	}
 
 	/*
@@ -2830,19 +3098,22 @@ struct page *rmqueue(struct zone *preferred_zone,
 	 * allocate greater than order-1 page units with __GFP_NOFAIL.
 	 */
 	WARN_ON_ONCE((gfp_flags & __GFP_NOFAIL) && (order > 1));
-	spin_lock_irqsave(&zone->lock, flags);
+	local_irq_save(flags);
+	shard = zone_home_shard(zone);
+	spin_lock(&shard->lock);
 
 	do {
 		page = NULL;
 		if (alloc_flags & ALLOC_HARDER) {
-			page = __rmqueue_smallest(zone, order, MIGRATE_HIGHATOMIC);
+			page = __rmqueue_highatomic(zone, &shard, order);
 			if (page)
 				trace_mm_page_alloc_zone_locked(page, order, migratetype);
 		}
 		if (!page)
-			page = __rmqueue(zone, order, migratetype);
+			page = __rmqueue_sharded(zone, &shard, order,
+						 migratetype);
 	} while (page && check_new_pages(page, order));
-	spin_unlock(&zone->lock);
+	spin_unlock(&shard->lock);
 	if (!page)
 		goto failed;
 	__mod_zone_freepage_state(zone, -(1 << order),
@@ -3000,26 +3271,30 @@ bool __zone_watermark_ok(struct zone *z, unsigned int order, unsigned long mark,
 
 	/* For a high-order request, check at least one suitable page is free */
 	for (o = order; o < MAX_ORDER; o++) {
-		struct free_area *area = &z->free_area[o];
-		int mt;
+		struct zone_shard *shard;
 
-		if (!area->nr_free)
-			continue;
+		for_each_zone_shard(z, shard) {
+			struct free_area *area = &shard->free_area[o];
+			int mt;
 
-		if (alloc_harder)
-			return true;
+			if (!area->nr_free)
+				continue;
 
-		for (mt = 0; mt < MIGRATE_PCPTYPES; mt++) {
-			if (!list_empty(&area->free_list[mt]))
+			if (alloc_harder)
 				return true;
-		}
+
+			for (mt = 0; mt < MIGRATE_PCPTYPES; mt++) {
+				if (!list_empty(&area->free_list[mt]))
+					return true;
+			}
 
 #ifdef CONFIG_CMA
-		if ((alloc_flags & ALLOC_CMA) &&
-		    !list_empty(&area->free_list[MIGRATE_CMA])) {
-			return true;
-		}
+			if ((alloc_flags & ALLOC_CMA) &&
+			    !list_empty(&area->free_list[MIGRATE_CMA])) {
+				return true;
+			}
 #endif
+		}
 	}
 	return false;
 }
@@ -3377,15 +3652,18 @@ __alloc_pages_direct_compact(gfp_t gfp_mask, unsigned int order,
 		enum compact_priority prio, enum compact_result *compact_result)
 {
 	struct page *page;
+	unsigned long pflags;
 	unsigned int noreclaim_flag;
 
 	if (!order)
 		return NULL;
 
+	psi_memstall_enter(&pflags);
 	noreclaim_flag = memalloc_noreclaim_save();
 	*compact_result = try_to_compact_pages(gfp_mask, order, alloc_flags, ac,
 									prio);
 	memalloc_noreclaim_restore(noreclaim_flag);
+	psi_memstall_leave(&pflags);
 
 	if (*compact_result <= COMPACT_INACTIVE)
 		return NULL;
@@ -3574,11 +3852,13 @@ __perform_reclaim(gfp_t gfp_mask, unsigned int order,
 	struct reclaim_state reclaim_state;
 	int progress;
 	unsigned int noreclaim_flag;
+	unsigned long pflags;
 
 	cond_resched();
 
 	/* We now go into synchronous reclaim */
 	cpuset_memory_pressure_bump();
+	psi_memstall_enter(&pflags);
 	noreclaim_flag = memalloc_noreclaim_save();
 	fs_reclaim_acquire(gfp_mask);
 	reclaim_state.reclaimed_slab = 0;
@@ -3590,6 +3870,7 @@ __perform_reclaim(gfp_t gfp_mask, unsigned int order,
 	current->reclaim_state = NULL;
 	fs_reclaim_release(gfp_mask);
 	memalloc_noreclaim_restore(noreclaim_flag);
+	psi_memstall_leave(&pflags);
 
 	cond_resched();
 
@@ -4260,12 +4541,8 @@ EXPORT_SYMBOL(get_zeroed_page);
 
 void __free_pages(struct page *page, unsigned int order)
 {
-	if (put_page_testzero(page)) {
-		if (order == 0)
-			free_hot_cold_page(page, false);
-		else
-			__free_pages_ok(page, order);
-	}
+	if (put_page_testzero(page))
+		free_the_page(page, order);
 }
 
 EXPORT_SYMBOL(__free_pages);
@@ -4316,14 +4593,8 @@ void __page_frag_cache_drain(struct page *page, unsigned int count)
 {
 	VM_BUG_ON_PAGE(page_ref_count(page) == 0, page);
 
-	if (page_ref_sub_and_test(page, count)) {
-		unsigned int order = compound_order(page);
-
-		if (order == 0)
-			free_hot_cold_page(page, false);
-		else
-			__free_pages_ok(page, order);
-	}
+	if (page_ref_sub_and_test(page, count))
+		free_the_page(page, compound_order(page));
 }
 EXPORT_SYMBOL(__page_frag_cache_drain);
 
@@ -4389,7 +4660,7 @@ void page_frag_free(void *addr)
 	struct page *page = virt_to_head_page(addr);
 
 	if (unlikely(put_page_testzero(page)))
-		__free_pages_ok(page, compound_order(page));
+		free_the_page(page, compound_order(page));
 }
 EXPORT_SYMBOL(page_frag_free);
 
@@ -4827,6 +5098,7 @@ void show_free_areas(unsigned int filter, nodemask_t *nodemask)
 	}
 
 	for_each_populated_zone(zone) {
+		struct zone_shard *shard;
 		unsigned int order;
 		unsigned long nr[MAX_ORDER], flags, total = 0;
 		unsigned char types[MAX_ORDER];
@@ -4836,21 +5108,25 @@ void show_free_areas(unsigned int filter, nodemask_t *nodemask)
 		show_node(zone);
 		printk(KERN_CONT "%s: ", zone->name);
 
-		spin_lock_irqsave(&zone->lock, flags);
+		zone_lock_all_shards(zone, flags);
 		for (order = 0; order < MAX_ORDER; order++) {
-			struct free_area *area = &zone->free_area[order];
 			int type;
 
-			nr[order] = area->nr_free;
-			total += nr[order] << order;
-
+			nr[order] = 0;
 			types[order] = 0;
-			for (type = 0; type < MIGRATE_TYPES; type++) {
-				if (!list_empty(&area->free_list[type]))
-					types[order] |= 1 << type;
+			for_each_zone_shard(zone, shard) {
+				struct free_area *area;
+
+				area = &shard->free_area[order];
+				nr[order] += area->nr_free;
+				for (type = 0; type < MIGRATE_TYPES; type++) {
+					if (!list_empty(&area->free_list[type]))
+						types[order] |= 1 << type;
+				}
 			}
+			total += nr[order] << order;
 		}
-		spin_unlock_irqrestore(&zone->lock, flags);
+		zone_unlock_all_shards(zone, flags);
 		for (order = 0; order < MAX_ORDER; order++) {
 			printk(KERN_CONT "%lu*%lukB ",
 			       nr[order], K(1UL) << order);
@@ -4963,7 +5239,7 @@ static int node_load[MAX_NUMNODES];
  * on them otherwise.
  * It returns -1 if no node is found.
  */
-static int find_next_best_node(int node, nodemask_t *used_node_mask)
+int find_next_best_node(int node, nodemask_t *used_node_mask)
 {
 	int n, val;
 	int min_val = INT_MAX;
@@ -5376,13 +5652,46 @@ void __meminit memmap_init_zone(unsigned long size, int nid, unsigned long zone,
 
 static void __meminit zone_init_free_lists(struct zone *zone)
 {
-	unsigned int order, t;
-	for_each_migratetype_order(order, t) {
-		INIT_LIST_HEAD(&zone->free_area[order].free_list[t]);
-		zone->free_area[order].nr_free = 0;
+	unsigned int order, t, i;
+
+	for (i = 0; i < MAX_ZONE_SHARDS; i++) {
+		struct free_area *area = zone->shards[i].free_area;
+
+		for_each_migratetype_order(order, t) {
+			INIT_LIST_HEAD(&area[order].free_list[t]);
+			area[order].nr_free = 0;
+		}
 	}
 }
 
+static unsigned int zone_shards __meminitdata = MAX_ZONE_SHARDS;
+
+/*
+ * zone_shards=N limits the number of free list shards per zone, rounded
+ * down to a power of two.
+ */
+static int __init cmdline_parse_zone_shards(char *p)
+{
+	unsigned int nr;
+
+	if (!p || kstrtouint(p, 0, &nr) || !nr)
+		return -EINVAL;
+
+	zone_shards = rounddown_pow_of_two(min_t(unsigned int, nr,
+						 MAX_ZONE_SHARDS));
+	return 0;
+}
+early_param("zone_shards", cmdline_parse_zone_shards);
+
+static void __meminit zone_init_shards(struct zone *zone)
+{
+	unsigned int i;
+
+	for (i = 0; i < MAX_ZONE_SHARDS; i++)
+		spin_lock_init(&zone->shards[i].lock);
+	zone->nr_shards = zone_shards;
+}
+
 #ifndef __HAVE_ARCH_MEMMAP_INIT
 #define memmap_init(size, nid, zone, start_pfn) \
 	memmap_init_zone((size), (nid), (zone), (start_pfn), MEMMAP_EARLY)
@@ -5474,14 +5783,14 @@ static void pageset_set_batch(struct per_cpu_pageset *p, unsigned long batch)
 static void pageset_init(struct per_cpu_pageset *p)
 {
 	struct per_cpu_pages *pcp;
-	int migratetype;
+	int pindex;
 
 	memset(p, 0, sizeof(*p));
 
 	pcp = &p->pcp;
 	pcp->count = 0;
-	for (migratetype = 0; migratetype < MIGRATE_PCPTYPES; migratetype++)
-		INIT_LIST_HEAD(&pcp->lists[migratetype]);
+	for (pindex = 0; pindex < NR_PCP_LISTS; pindex++)
+		INIT_LIST_HEAD(&pcp->lists[pindex]);
 }
 
 static void setup_pageset(struct per_cpu_pageset *p, unsigned long batch)
@@ -6051,6 +6360,7 @@ static void __paginginit free_area_init_core(struct pglist_data *pgdat)
 	pgdat->split_queue_len = 0;
 #endif
 	init_waitqueue_head(&pgdat->kswapd_wait);
+	init_waitqueue_head(&pgdat->kswapd_helper_wait);
 	init_waitqueue_head(&pgdat->pfmemalloc_wait);
 #ifdef CONFIG_COMPACTION
 	init_waitqueue_head(&pgdat->kcompactd_wait);
@@ -6113,6 +6423,7 @@ static void __paginginit free_area_init_core(struct pglist_data *pgdat)
 		zone->name = zone_names[j];
 		zone->zone_pgdat = pgdat;
 		spin_lock_init(&zone->lock);
+		zone_init_shards(zone);
 		zone_seqlock_init(zone);
 		zone_pcp_init(zone);
 
@@ -7728,7 +8039,7 @@ __offline_isolated_pages(unsigned long start_pfn, unsigned long end_pfn)
 		return;
 	offline_mem_sections(pfn, end_pfn);
 	zone = page_zone(pfn_to_page(pfn));
-	spin_lock_irqsave(&zone->lock, flags);
+	zone_lock_all_shards(zone, flags);
 	pfn = start_pfn;
 	while (pfn < end_pfn) {
 		if (!pfn_valid(pfn)) {
@@ -7755,12 +8066,12 @@ __offline_isolated_pages(unsigned long start_pfn, unsigned long end_pfn)
 #endif
 		list_del(&page->lru);
 		rmv_page_order(page);
-		zone->free_area[order].nr_free--;
+		zone_shard(zone, pfn)->free_area[order].nr_free--;
 		for (i = 0; i < (1 << order); i++)
 			SetPageReserved((page+i));
 		pfn += (1 << order);
 	}
-	spin_unlock_irqrestore(&zone->lock, flags);
+	zone_unlock_all_shards(zone, flags);
 }
 #endif
 
@@ -7768,17 +8079,18 @@ bool is_free_buddy_page(struct page *page)
 {
 	struct zone *zone = page_zone(page);
 	unsigned long pfn = page_to_pfn(page);
+	struct zone_shard *shard = zone_shard(zone, pfn);
 	unsigned long flags;
 	unsigned int order;
 
-	spin_lock_irqsave(&zone->lock, flags);
+	spin_lock_irqsave(&shard->lock, flags);
 	for (order = 0; order < MAX_ORDER; order++) {
 		struct page *page_head = page - (pfn & ((1 << order) - 1));
 
 		if (PageBuddy(page_head) && page_order(page_head) >= order)
 			break;
 	}
-	spin_unlock_irqrestore(&zone->lock, flags);
+	spin_unlock_irqrestore(&shard->lock, flags);
 
 	return order < MAX_ORDER;
 }
@@ -88,7 +88,11 @@ static bool page_idle_clear_pte_refs_one(struct page *page,
 	return true;
 }
 
-static void page_idle_clear_pte_refs(struct page *page)
+/*
+ * Clears the accessed bits of all the mappings of @page, which must be safe
+ * to rmap_walk().  An access seen there clears the idle flag of the page.
+ */
+void page_idle_clear_pte_refs(struct page *page)
 {
 	/*
 	 * Since rwc.arg is unused, rwc is effectively immutable, so we
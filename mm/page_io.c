@@ -250,7 +250,8 @@ int swap_writepage(struct page *page, struct writeback_control *wbc)
 		unlock_page(page);
 		goto out;
 	}
-	if (frontswap_store(page) == 0) {
+	/* frontswap and ->rw_page() deal in single pages only */
+	if (!PageTransHuge(page) && frontswap_store(page) == 0) {
 		set_page_writeback(page);
 		unlock_page(page);
 		end_page_writeback(page);
@@ -324,10 +325,13 @@ int __swap_writepage(struct page *page, struct writeback_control *wbc,
 		return ret;
 	}
 
-	ret = bdev_write_page(sis->bdev, swap_page_sector(page), page, wbc);
-	if (!ret) {
-		count_swpout_vm_event(page);
-		return 0;
+	if (!PageTransHuge(page)) {
+		ret = bdev_write_page(sis->bdev, swap_page_sector(page),
+				      page, wbc);
+		if (!ret) {
+			count_swpout_vm_event(page);
+			return 0;
+		}
 	}
 
 	ret = 0;
@@ -358,7 +362,7 @@ int swap_readpage(struct page *page, bool do_poll)
 	VM_BUG_ON_PAGE(!PageSwapCache(page), page);
 	VM_BUG_ON_PAGE(!PageLocked(page), page);
 	VM_BUG_ON_PAGE(PageUptodate(page), page);
-	if (frontswap_load(page) == 0) {
+	if (!PageTransHuge(page) && frontswap_load(page) == 0) {
 		SetPageUptodate(page);
 		unlock_page(page);
 		goto out;
@@ -374,15 +378,17 @@ int swap_readpage(struct page *page, bool do_poll)
 		return ret;
 	}
 
-	ret = bdev_read_page(sis->bdev, swap_page_sector(page), page);
-	if (!ret) {
-		if (trylock_page(page)) {
-			swap_slot_free_notify(page);
-			unlock_page(page);
-		}
+	if (!PageTransHuge(page)) {
+		ret = bdev_read_page(sis->bdev, swap_page_sector(page), page);
+		if (!ret) {
+			if (trylock_page(page)) {
+				swap_slot_free_notify(page);
+				unlock_page(page);
+			}
 
-		count_vm_event(PSWPIN);
-		return 0;
+			count_vm_event(PSWPIN);
+			return 0;
+		}
 	}
 
 	ret = 0;
@@ -400,7 +406,7 @@ int swap_readpage(struct page *page, bool do_poll)
 	get_task_struct(current);
 	bio->bi_private = current;
 	bio_set_op_attrs(bio, REQ_OP_READ, 0);
-	count_vm_event(PSWPIN);
+	count_vm_events(PSWPIN, hpage_nr_pages(page));
 	bio_get(bio);
 	qc = submit_bio(bio);
 	while (do_poll) {
@@ -19,16 +19,19 @@ static int set_migratetype_isolate(struct page *page,
 				bool skip_hwpoisoned_pages)
 {
 	struct zone *zone;
+	struct zone_shard *shard;
 	unsigned long flags, pfn;
 	struct memory_isolate_notify arg;
 	int notifier_ret;
 	int ret = -EBUSY;
 
 	zone = page_zone(page);
+	pfn = page_to_pfn(page);
+	shard = zone_shard(zone, pfn);
 
 	spin_lock_irqsave(&zone->lock, flags);
+	spin_lock(&shard->lock);
 
-	pfn = page_to_pfn(page);
 	arg.start_pfn = pfn;
 	arg.nr_pages = pageblock_nr_pages;
 	arg.pages_found = 0;
@@ -74,6 +77,7 @@ static int set_migratetype_isolate(struct page *page,
 		__mod_zone_freepage_state(zone, -nr_pages, migratetype);
 	}
 
+	spin_unlock(&shard->lock);
 	spin_unlock_irqrestore(&zone->lock, flags);
 	if (!ret)
 		drain_all_pages(zone);
@@ -83,6 +87,7 @@ static int set_migratetype_isolate(struct page *page,
 static void unset_migratetype_isolate(struct page *page, unsigned migratetype)
 {
 	struct zone *zone;
+	struct zone_shard *shard;
 	unsigned long flags, nr_pages;
 	bool isolated_page = false;
 	unsigned int order;
@@ -90,7 +95,9 @@ static void unset_migratetype_isolate(struct page *page, unsigned migratetype)
 	struct page *buddy;
 
 	zone = page_zone(page);
+	shard = zone_shard(zone, page_to_pfn(page));
 	spin_lock_irqsave(&zone->lock, flags);
+	spin_lock(&shard->lock);
 	if (!is_migrate_isolate_page(page))
 		goto out;
 
@@ -129,6 +136,7 @@ static void unset_migratetype_isolate(struct page *page, unsigned migratetype)
 	set_pageblock_migratetype(page, migratetype);
 	zone->nr_isolate_pageblock--;
 out:
+	spin_unlock(&shard->lock);
 	spin_unlock_irqrestore(&zone->lock, flags);
 	if (isolated_page) {
 		post_alloc_hook(page, order, __GFP_MOVABLE);
@@ -227,7 +235,7 @@ int undo_isolate_page_range(unsigned long start_pfn, unsigned long end_pfn,
 /*
  * Test all pages in the range is free(means isolated) or not.
  * all pages in [start_pfn...end_pfn) must be in the same zone.
- * zone->lock must be held before call this.
+ * zone->lock and all shard locks must be held before call this.
  *
  * Returns the last tested pfn.
  */
@@ -283,10 +291,10 @@ int test_pages_isolated(unsigned long start_pfn, unsigned long end_pfn,
 		return -EBUSY;
 	/* Check all pages are free or marked as ISOLATED */
 	zone = page_zone(page);
-	spin_lock_irqsave(&zone->lock, flags);
+	zone_lock_all_shards(zone, flags);
 	pfn = __test_page_isolated_in_pageblock(start_pfn, end_pfn,
 						skip_hwpoisoned_pages);
-	spin_unlock_irqrestore(&zone->lock, flags);
+	zone_unlock_all_shards(zone, flags);
 
 	trace_test_pages_isolated(start_pfn, end_pfn, pfn);
 
@@ -22,6 +22,9 @@
 
 #include "internal.h"
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/readahead.h>
+
 /*
  * Initialise a struct file's readahead state.  Assumes that the caller has
  * memset *ra to zero.
@@ -139,6 +142,40 @@ static int read_pages(struct address_space *mapping, struct file *filp,
 	return ret;
 }
 
+/*
+ * Allocates a huge page for the readahead at @index, if the mapping takes
+ * large pages and all of it is inside the file and not cached at all.  It
+ * is kept out of highmem, so that reads can copy from it at once, and it
+ * is not worth direct reclaim or compaction: small pages are the fallback.
+ */
+static struct page *page_cache_alloc_large(struct address_space *mapping,
+		pgoff_t index, pgoff_t end_index, gfp_t gfp)
+{
+	struct radix_tree_iter iter;
+	struct page *page;
+	bool empty = true;
+	void **slot;
+
+	if (!mapping_large_pages(mapping) || (index & (HPAGE_PMD_NR - 1)) ||
+	    index + HPAGE_PMD_NR - 1 > end_index)
+		return NULL;
+
+	rcu_read_lock();
+	radix_tree_for_each_slot(slot, &mapping->page_tree, &iter, index) {
+		empty = iter.index >= index + HPAGE_PMD_NR;
+		break;
+	}
+	rcu_read_unlock();
+	if (!empty)
+		return NULL;
+
+	gfp &= ~(__GFP_HIGHMEM | __GFP_DIRECT_RECLAIM);
+	page = alloc_pages(gfp | __GFP_COMP, HPAGE_PMD_ORDER);
+	if (page)
+		prep_transhuge_page(page);
+	return page;
+}
+
 /*
  * __do_page_cache_readahead() actually reads a chunk of disk.  It allocates all
  * the pages first, then submits them all for I/O. This avoids the very bad
@@ -156,7 +193,7 @@ int __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 	unsigned long end_index;	/* The last page we want to read */
 	LIST_HEAD(page_pool);
 	int page_idx;
-	int ret = 0;
+	int ret = 0, nr_entries = 0;
 	loff_t isize = i_size_read(inode);
 	gfp_t gfp_mask = readahead_gfp_mask(mapping);
 
@@ -180,6 +217,17 @@ int __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 		if (page && !radix_tree_exceptional_entry(page))
 			continue;
 
+		page = page_cache_alloc_large(mapping, page_offset, end_index,
+					      gfp_mask);
+		if (page) {
+			page->index = page_offset;
+			list_add(&page->lru, &page_pool);
+			nr_entries++;
+			ret += HPAGE_PMD_NR;
+			page_idx += HPAGE_PMD_NR - 1;
+			continue;
+		}
+
 		page = __page_cache_alloc(gfp_mask);
 		if (!page)
 			break;
@@ -187,6 +235,7 @@ int __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 		list_add(&page->lru, &page_pool);
 		if (page_idx == nr_to_read - lookahead_size)
 			SetPageReadahead(page);
+		nr_entries++;
 		ret++;
 	}
 
@@ -195,8 +244,8 @@ int __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 	 * uptodate then the caller will launch readpage again, and
 	 * will then handle the error.
 	 */
-	if (ret)
-		read_pages(mapping, filp, &page_pool, ret, gfp_mask);
+	if (nr_entries)
+		read_pages(mapping, filp, &page_pool, nr_entries, gfp_mask);
 	BUG_ON(!list_empty(&page_pool));
 out:
 	return ret;
@@ -317,6 +366,64 @@ static unsigned long get_next_ra_size(struct file_ra_state *ra,
  * it approaches max_readhead.
  */
 
+/*
+ * Is @offset where the readahead window @start, @size, @async_size of a
+ * sequential stream expects its next read?
+ */
+static bool ra_expects(pgoff_t start, unsigned int size,
+		       unsigned int async_size, pgoff_t offset)
+{
+	return size && (offset == start + size - async_size ||
+			offset == start + size);
+}
+
+/*
+ * Keeps the current window among the streams of @ra, when a read at @offset
+ * is about to replace it with the window of another stream.  The least
+ * recently used stream is forgotten.
+ */
+static void ra_save_stream(struct file_ra_state *ra, pgoff_t offset)
+{
+	if (!ra->size || ra->strided || ra_has_index(ra, offset))
+		return;
+
+	memmove(&ra->streams[1], &ra->streams[0],
+		sizeof(ra->streams[0]) * (RA_NR_STREAMS - 1));
+	ra->streams[0].start = ra->start;
+	ra->streams[0].size = ra->size;
+	ra->streams[0].async_size = ra->async_size;
+}
+
+/*
+ * Makes current the stream which expects a read at @offset, if any, and
+ * keeps the current one in its place.
+ */
+static bool ra_switch_stream(struct file_ra_state *ra, pgoff_t offset)
+{
+	struct file_ra_stream cur = {
+		.start = ra->start,
+		.size = ra->strided ? 0 : ra->size,
+		.async_size = ra->async_size,
+	};
+	int i;
+
+	for (i = 0; i < RA_NR_STREAMS; i++) {
+		struct file_ra_stream *s = &ra->streams[i];
+
+		if (!ra_expects(s->start, s->size, s->async_size, offset))
+			continue;
+
+		ra->start = s->start;
+		ra->size = s->size;
+		ra->async_size = s->async_size;
+		ra->strided = false;
+		memmove(&ra->streams[1], &ra->streams[0], sizeof(*s) * i);
+		ra->streams[0] = cur;
+		return true;
+	}
+	return false;
+}
+
 /*
  * Count contiguously cached pages from @offset-1 to @offset-@max,
  * this count is a conservative estimation of
@@ -362,6 +469,7 @@ static int try_context_readahead(struct address_space *mapping,
 	if (size >= offset)
 		size *= 2;
 
+	ra_save_stream(ra, offset);
 	ra->start = offset;
 	ra->size = min(size + req_size, max);
 	ra->async_size = 1;
@@ -370,7 +478,97 @@ static int try_context_readahead(struct address_space *mapping,
 }
 
 /*
- * A minimal readahead algorithm for trivial sequential/random reads.
+ * The misses of a strided read come @stride pages apart, forward or back,
+ * each of @req_size pages: read ahead the next chunks, as many as fit in
+ * the window, and mark the last one to go on when it is reached.  Reverse
+ * sequential reads, the chunks of which are contiguous, are read ahead in
+ * one go.  Returns 0 when the pattern does not fit the file.
+ */
+#define RA_STRIDE_CHUNKS	16
+
+static int ra_stride(struct address_space *mapping, struct file_ra_state *ra,
+		     struct file *filp, pgoff_t offset, unsigned long req_size,
+		     unsigned long max_pages, bool miss)
+{
+	long stride = ra->stride;
+	unsigned long nr = max(max_pages / req_size, 1UL);
+	pgoff_t start = offset;
+	int ret = 0;
+
+	if (stride == -(long)req_size) {
+		if (offset < req_size)
+			return 0;
+		nr = min(nr * req_size, offset);
+		start = offset - nr;
+		if (miss)
+			ret = __do_page_cache_readahead(mapping, filp, offset,
+							req_size, 0);
+		ret += __do_page_cache_readahead(mapping, filp, start, nr, nr);
+	} else {
+		unsigned long i;
+
+		nr = min_t(unsigned long, nr, RA_STRIDE_CHUNKS);
+		if (stride < 0 && offset < nr * -stride)
+			nr = offset / -stride;
+		if (!nr)
+			return 0;
+		if (miss)
+			ret = __do_page_cache_readahead(mapping, filp, offset,
+							req_size, 0);
+		for (i = 1; i <= nr; i++) {
+			start = offset + i * stride;
+			ret += __do_page_cache_readahead(mapping, filp, start,
+					req_size, i == nr ? req_size : 0);
+		}
+	}
+
+	ra->strided = true;
+	ra->start = start;
+	ra->size = req_size;
+	ra->async_size = req_size;
+	return ret;
+}
+
+/*
+ * Does the miss at @offset come as far from the previous one as that one
+ * from the miss before, as strided and reverse sequential reads do?  Equal
+ * gaps between random reads are unlikely.
+ */
+static bool ra_stride_detect(struct file_ra_state *ra, pgoff_t offset,
+			     unsigned long req_size, unsigned long max_pages)
+{
+	long gap = (long)(offset - ra->prev_miss);
+	bool strided;
+
+	strided = gap == ra->stride &&
+		  (gap > (long)req_size || gap == -(long)req_size) &&
+		  abs(gap) <= (long)(max_pages * RA_STRIDE_CHUNKS);
+	ra->stride = gap;
+	ra->prev_miss = offset;
+	return strided;
+}
+
+static unsigned long ra_max_pages(struct file_ra_state *ra,
+				  struct backing_dev_info *bdi,
+				  unsigned long req_size)
+{
+	/* as much as the device can read while the window is consumed */
+	unsigned long max_pages = max_t(unsigned long, ra->ra_pages,
+					READ_ONCE(bdi->ra_bw_pages));
+
+	/*
+	 * If the request exceeds the readahead window, allow the read to
+	 * be up to the optimal hardware IO size
+	 */
+	if (req_size > max_pages && bdi->io_pages > max_pages)
+		max_pages = min(req_size, bdi->io_pages);
+
+	return max_pages;
+}
+
+/*
+ * The readahead algorithm for sequential, interleaved, strided, reverse and
+ * random reads.
  */
 static unsigned long
 ondemand_readahead(struct address_space *mapping,
@@ -379,32 +577,48 @@ ondemand_readahead(struct address_space *mapping,
 		   unsigned long req_size)
 {
 	struct backing_dev_info *bdi = inode_to_bdi(mapping->host);
-	unsigned long max_pages = ra->ra_pages;
+	unsigned long max_pages = ra_max_pages(ra, bdi, req_size);
+	int pattern = RA_PATTERN_SEQUENTIAL;
+	bool strided = false;
 	pgoff_t prev_offset;
+	int ret;
+
+	if (!hit_readahead_marker)
+		strided = ra_stride_detect(ra, offset, req_size, max_pages);
 
 	/*
-	 * If the request exceeds the readahead window, allow the read to
-	 * be up to the optimal hardware IO size
+	 * The application reached the last chunk of a strided read ahead,
+	 * or missed the next chunk of one: read the next chunks.
 	 */
-	if (req_size > max_pages && bdi->io_pages > max_pages)
-		max_pages = min(req_size, bdi->io_pages);
+	if ((ra->strided && hit_readahead_marker && offset == ra->start) ||
+	    strided) {
+		pattern = ra->stride < 0 ? RA_PATTERN_REVERSE :
+					   RA_PATTERN_STRIDE;
+		ret = ra_stride(mapping, ra, filp, offset, req_size,
+				max_pages, strided);
+		if (ret || !strided)
+			goto out;
+	}
 
 	/*
 	 * start of file
 	 */
-	if (!offset)
+	if (!offset) {
+		ra_save_stream(ra, offset);
 		goto initial_readahead;
+	}
 
 	/*
-	 * It's the expected callback offset, assume sequential access.
-	 * Ramp up sizes, and push forward the readahead window.
+	 * It's the expected callback offset, assume sequential access, or
+	 * that of another stream read at the same time.  Ramp up sizes, and
+	 * push forward the readahead window.
 	 */
-	if ((offset == (ra->start + ra->size - ra->async_size) ||
-	     offset == (ra->start + ra->size))) {
-		ra->start += ra->size;
-		ra->size = get_next_ra_size(ra, max_pages);
-		ra->async_size = ra->size;
-		goto readit;
+	if (!ra->strided &&
+	    ra_expects(ra->start, ra->size, ra->async_size, offset))
+		goto next_window;
+	if (ra_switch_stream(ra, offset)) {
+		pattern = RA_PATTERN_STREAM;
+		goto next_window;
 	}
 
 	/*
@@ -423,6 +637,9 @@ ondemand_readahead(struct address_space *mapping,
 		if (!start || start - offset > max_pages)
 			return 0;
 
+		ra_save_stream(ra, offset);
+		pattern = RA_PATTERN_MARKER;
+		ra->strided = false;
 		ra->start = start;
 		ra->size = start - offset;	/* old async_size */
 		ra->size += req_size;
@@ -434,8 +651,10 @@ ondemand_readahead(struct address_space *mapping,
 	/*
 	 * oversize read
 	 */
-	if (req_size > max_pages)
+	if (req_size > max_pages) {
+		ra_save_stream(ra, offset);
 		goto initial_readahead;
+	}
 
 	/*
 	 * sequential cache miss
@@ -450,16 +669,30 @@ ondemand_readahead(struct address_space *mapping,
 	 * Query the page cache and look for the traces(cached history pages)
 	 * that a sequential stream would leave behind.
 	 */
-	if (try_context_readahead(mapping, ra, offset, req_size, max_pages))
+	if (try_context_readahead(mapping, ra, offset, req_size, max_pages)) {
+		pattern = RA_PATTERN_CONTEXT;
+		ra->strided = false;
 		goto readit;
+	}
 
 	/*
 	 * standalone, small random read
 	 * Read as is, and do not pollute the readahead state.
 	 */
-	return __do_page_cache_readahead(mapping, filp, offset, req_size, 0);
+	ret = __do_page_cache_readahead(mapping, filp, offset, req_size, 0);
+	trace_readahead(mapping, offset, req_size, hit_readahead_marker,
+			RA_PATTERN_RANDOM, ra, max_pages, ret);
+	return ret;
+
+next_window:
+	ra->start += ra->size;
+	ra->size = get_next_ra_size(ra, max_pages);
+	ra->async_size = ra->size;
+	goto readit;
 
 initial_readahead:
+	pattern = RA_PATTERN_INITIAL;
+	ra->strided = false;
 	ra->start = offset;
 	ra->size = get_init_ra_size(req_size, max_pages);
 	ra->async_size = ra->size > req_size ? ra->size - req_size : ra->size;
@@ -475,7 +708,11 @@ ondemand_readahead(struct address_space *mapping,
 		ra->size += ra->async_size;
 	}
 
-	return ra_submit(ra, mapping, filp);
+	ret = ra_submit(ra, mapping, filp);
+out:
+	trace_readahead(mapping, offset, req_size, hit_readahead_marker,
+			pattern, ra, max_pages, ret);
+	return ret;
 }
 
 /**
@@ -145,7 +145,8 @@ static inline unsigned long kmem_cache_flags(unsigned long object_size,
 			  SLAB_NOTRACK | SLAB_ACCOUNT)
 #elif defined(CONFIG_SLUB)
 #define SLAB_CACHE_FLAGS (SLAB_NOLEAKTRACE | SLAB_RECLAIM_ACCOUNT | \
-			  SLAB_TEMPORARY | SLAB_NOTRACK | SLAB_ACCOUNT)
+			  SLAB_TEMPORARY | SLAB_NOTRACK | SLAB_ACCOUNT | \
+			  SLAB_SHEAVES)
 #else
 #define SLAB_CACHE_FLAGS (0)
 #endif
@@ -165,7 +166,8 @@ static inline unsigned long kmem_cache_flags(unsigned long object_size,
 			      SLAB_RECLAIM_ACCOUNT | \
 			      SLAB_TEMPORARY | \
 			      SLAB_NOTRACK | \
-			      SLAB_ACCOUNT)
+			      SLAB_ACCOUNT | \
+			      SLAB_SHEAVES)
 
 int __kmem_cache_shutdown(struct kmem_cache *);
 void __kmem_cache_release(struct kmem_cache *);
@@ -453,6 +455,17 @@ static inline void slab_post_alloc_hook(struct kmem_cache *s, gfp_t flags,
 /*
  * The slab lists for all objects.
  */
+#ifdef CONFIG_SLUB
+/* Per node store of full and empty sheaves, see mm/slub.c */
+struct node_barn {
+	spinlock_t lock;
+	struct list_head sheaves_full;
+	struct list_head sheaves_empty;
+	unsigned int nr_full;
+	unsigned int nr_empty;
+};
+#endif
+
 struct kmem_cache_node {
 	spinlock_t list_lock;
 
@@ -479,6 +492,7 @@ struct kmem_cache_node {
 	atomic_long_t total_objects;
 	struct list_head full;
 #endif
+	struct node_barn barn;
 #endif
 
 };
@@ -2300,6 +2300,12 @@ static void put_cpu_partial(struct kmem_cache *s, struct page *page, int drain)
 #endif
 }
 
+static bool pcs_has_objects(struct kmem_cache *s, int cpu);
+static void pcs_flush_cpu(struct kmem_cache *s, int cpu);
+static void barn_shrink(struct kmem_cache *s, struct node_barn *barn);
+static void *alloc_from_pcs(struct kmem_cache *s, gfp_t gfp, int node);
+static bool free_to_pcs(struct kmem_cache *s, struct page *page, void *object);
+
 static inline void flush_slab(struct kmem_cache *s, struct kmem_cache_cpu *c)
 {
 	stat(s, CPUSLAB_FLUSH);
@@ -2317,6 +2323,8 @@ static inline void __flush_cpu_slab(struct kmem_cache *s, int cpu)
 {
 	struct kmem_cache_cpu *c = per_cpu_ptr(s->cpu_slab, cpu);
 
+	pcs_flush_cpu(s, cpu);
+
 	if (likely(c)) {
 		if (c->page)
 			flush_slab(s, c);
@@ -2337,11 +2345,19 @@ static bool has_cpu_slab(int cpu, void *info)
 	struct kmem_cache *s = info;
 	struct kmem_cache_cpu *c = per_cpu_ptr(s->cpu_slab, cpu);
 
-	return c->page || slub_percpu_partial(c);
+	return c->page || slub_percpu_partial(c) || pcs_has_objects(s, cpu);
 }
 
 static void flush_all(struct kmem_cache *s)
 {
+	struct kmem_cache_node *n;
+	int node;
+
+	/* Objects from the barns may land in the cpu slabs flushed below */
+	if (s->cpu_sheaves)
+		for_each_kmem_cache_node(s, node, n)
+			barn_shrink(s, &n->barn);
+
 	on_each_cpu_cond(has_cpu_slab, flush_cpu_slab, s, 1, GFP_ATOMIC);
 }
 
@@ -2672,6 +2688,12 @@ static __always_inline void *slab_alloc_node(struct kmem_cache *s,
 	s = slab_pre_alloc_hook(s, gfpflags);
 	if (!s)
 		return NULL;
+
+	if (s->cpu_sheaves) {
+		object = alloc_from_pcs(s, gfpflags, node);
+		if (likely(object))
+			goto out;
+	}
 redo:
 	/*
 	 * Must read kmem_cache cpu data via this cpu ptr. Preemption is
@@ -2740,6 +2762,7 @@ static __always_inline void *slab_alloc_node(struct kmem_cache *s,
 		stat(s, ALLOC_FASTPATH);
 	}
 
+out:
 	if (unlikely(gfpflags & __GFP_ZERO) && object)
 		memset(object, 0, s->object_size);
 
@@ -2993,6 +3016,8 @@ static __always_inline void slab_free(struct kmem_cache *s, struct page *page,
 	 */
 	if (s->flags & SLAB_KASAN && !(s->flags & SLAB_TYPESAFE_BY_RCU))
 		return;
+	if (s->cpu_sheaves && !tail && free_to_pcs(s, page, head))
+		return;
 	do_slab_free(s, page, head, tail, cnt, addr);
 }
 
@@ -3122,23 +3147,23 @@ void kmem_cache_free_bulk(struct kmem_cache *s, size_t size, void **p)
 }
 EXPORT_SYMBOL(kmem_cache_free_bulk);
 
-/* Note that interrupts must be enabled when calling this function. */
-int kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t flags, size_t size,
-			  void **p)
+/*
+ * Take up to size objects from the cpu slab, refilling it as needed. No
+ * memcg or debug hooks are run. Returns the number of objects taken.
+ */
+static int ___kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t flags,
+				    size_t size, void **p)
 {
 	struct kmem_cache_cpu *c;
+	unsigned long irqflags;
 	int i;
 
-	/* memcg and kmem_cache debug support */
-	s = slab_pre_alloc_hook(s, flags);
-	if (unlikely(!s))
-		return false;
 	/*
 	 * Drain objects in the per cpu slab, while disabling local
 	 * IRQs, which protects against PREEMPT and interrupts
 	 * handlers invoking normal fastpath.
 	 */
-	local_irq_disable();
+	local_irq_save(irqflags);
 	c = this_cpu_ptr(s->cpu_slab);
 
 	for (i = 0; i < size; i++) {
@@ -3152,7 +3177,7 @@ int kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t flags, size_t size,
 			p[i] = ___slab_alloc(s, flags, NUMA_NO_NODE,
 					    _RET_IP_, c);
 			if (unlikely(!p[i]))
-				goto error;
+				break;
 
 			c = this_cpu_ptr(s->cpu_slab);
 			continue; /* goto for-loop */
@@ -3161,7 +3186,25 @@ int kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t flags, size_t size,
 		p[i] = object;
 	}
 	c->tid = next_tid(c->tid);
-	local_irq_enable();
+	local_irq_restore(irqflags);
+
+	return i;
+}
+
+/* Note that interrupts must be enabled when calling this function. */
+int kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t flags, size_t size,
+			  void **p)
+{
+	int i;
+
+	/* memcg and kmem_cache debug support */
+	s = slab_pre_alloc_hook(s, flags);
+	if (unlikely(!s))
+		return false;
+
+	i = ___kmem_cache_alloc_bulk(s, flags, size, p);
+	if (unlikely(i < size))
+		goto error;
 
 	/* Clear memory outside IRQ disabled fastpath loop */
 	if (unlikely(flags & __GFP_ZERO)) {
@@ -3175,13 +3218,421 @@ int kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t flags, size_t size,
 	slab_post_alloc_hook(s, flags, size, p);
 	return i;
 error:
-	local_irq_enable();
 	slab_post_alloc_hook(s, flags, i, p);
 	__kmem_cache_free_bulk(s, i, p);
 	return 0;
 }
 EXPORT_SYMBOL(kmem_cache_alloc_bulk);
 
+/*
+ * Per cpu sheaves
+ *
+ * A sheaf is an array of objects. Caches created with SLAB_SHEAVES give
+ * each cpu a main and a spare sheaf, and allocating or freeing an object
+ * of the local node only pops or pushes the main sheaf with interrupts
+ * disabled, without touching the slab page. This keeps frees from another
+ * cpu than the allocating one off the page freelists entirely.
+ *
+ * Empty sheaves are refilled from the slabs in bulk and full ones are
+ * flushed back in bulk. In between, the per node barn keeps a few full
+ * and empty sheaves, so a cpu that mostly frees can pass its objects to
+ * one that mostly allocates.
+ *
+ * The objects in a sheaf are free as far as the debug, kasan and kmemleak
+ * hooks are concerned: the hooks run when an object enters or leaves a
+ * sheaf on behalf of a caller, never on refill or flush.
+ */
+#define MAX_FULL_SHEAVES	10
+#define MAX_EMPTY_SHEAVES	10
+
+struct slab_sheaf {
+	struct list_head barn_list;
+	unsigned int size;
+	void *objects[];
+};
+
+struct slub_percpu_sheaves {
+	struct slab_sheaf *main;	/* Never NULL */
+	struct slab_sheaf *spare;	/* Empty or full, may be NULL */
+};
+
+static inline gfp_t sheaf_gfp(gfp_t gfp)
+{
+	/* Refills never dip into the reserves or retry forever */
+	gfp &= GFP_RECLAIM_MASK & ~(__GFP_NOFAIL | __GFP_MEMALLOC);
+	return gfp | __GFP_NOWARN | __GFP_NOMEMALLOC;
+}
+
+static struct slab_sheaf *alloc_empty_sheaf(struct kmem_cache *s, gfp_t gfp)
+{
+	struct slab_sheaf *sheaf;
+
+	sheaf = kmalloc(sizeof(*sheaf) + s->sheaf_capacity * sizeof(void *),
+			gfp);
+	if (sheaf)
+		sheaf->size = 0;
+	return sheaf;
+}
+
+static struct slab_sheaf *alloc_full_sheaf(struct kmem_cache *s, gfp_t gfp)
+{
+	struct slab_sheaf *sheaf = alloc_empty_sheaf(s, gfp);
+
+	if (!sheaf)
+		return NULL;
+
+	sheaf->size = ___kmem_cache_alloc_bulk(s, gfp, s->sheaf_capacity,
+					       sheaf->objects);
+	if (!sheaf->size) {
+		kfree(sheaf);
+		return NULL;
+	}
+	stat(s, SHEAF_REFILL);
+	return sheaf;
+}
+
+/* Return the objects of a sheaf to their slabs */
+static void sheaf_flush(struct kmem_cache *s, struct slab_sheaf *sheaf)
+{
+	size_t size = sheaf->size;
+
+	if (!size)
+		return;
+
+	do {
+		struct detached_freelist df;
+
+		size = build_detached_freelist(s, size, sheaf->objects, &df);
+		if (!df.page)
+			continue;
+
+		do_slab_free(df.s, df.page, df.freelist, df.tail, df.cnt,
+			     _RET_IP_);
+	} while (likely(size));
+
+	sheaf->size = 0;
+	stat(s, SHEAF_FLUSH);
+}
+
+static struct node_barn *get_barn(struct kmem_cache *s)
+{
+	struct kmem_cache_node *n = get_node(s, numa_mem_id());
+
+	return n ? &n->barn : NULL;
+}
+
+/* Called with interrupts disabled */
+static struct slab_sheaf *barn_get_sheaf(struct node_barn *barn, bool full)
+{
+	struct slab_sheaf *sheaf = NULL;
+	struct list_head *list;
+	unsigned int *nr;
+
+	if (!barn)
+		return NULL;
+
+	list = full ? &barn->sheaves_full : &barn->sheaves_empty;
+	nr = full ? &barn->nr_full : &barn->nr_empty;
+	if (!READ_ONCE(*nr))
+		return NULL;
+
+	spin_lock(&barn->lock);
+	if (*nr) {
+		sheaf = list_first_entry(list, struct slab_sheaf, barn_list);
+		list_del(&sheaf->barn_list);
+		(*nr)--;
+	}
+	spin_unlock(&barn->lock);
+
+	return sheaf;
+}
+
+/* Called with interrupts disabled */
+static bool barn_put_sheaf(struct node_barn *barn, struct slab_sheaf *sheaf,
+			   bool full)
+{
+	unsigned int max = full ? MAX_FULL_SHEAVES : MAX_EMPTY_SHEAVES;
+	struct list_head *list;
+	unsigned int *nr;
+	bool ret = false;
+
+	if (!barn)
+		return false;
+
+	list = full ? &barn->sheaves_full : &barn->sheaves_empty;
+	nr = full ? &barn->nr_full : &barn->nr_empty;
+	if (READ_ONCE(*nr) >= max)
+		return false;
+
+	spin_lock(&barn->lock);
+	if (*nr < max) {
+		list_add(&sheaf->barn_list, list);
+		(*nr)++;
+		ret = true;
+	}
+	spin_unlock(&barn->lock);
+
+	return ret;
+}
+
+static void barn_shrink(struct kmem_cache *s, struct node_barn *barn)
+{
+	struct slab_sheaf *sheaf, *next;
+	unsigned long flags;
+	LIST_HEAD(full);
+	LIST_HEAD(empty);
+
+	spin_lock_irqsave(&barn->lock, flags);
+	list_splice_init(&barn->sheaves_full, &full);
+	barn->nr_full = 0;
+	list_splice_init(&barn->sheaves_empty, &empty);
+	barn->nr_empty = 0;
+	spin_unlock_irqrestore(&barn->lock, flags);
+
+	list_for_each_entry_safe(sheaf, next, &full, barn_list) {
+		sheaf_flush(s, sheaf);
+		kfree(sheaf);
+	}
+	list_for_each_entry_safe(sheaf, next, &empty, barn_list)
+		kfree(sheaf);
+}
+
+/* Keep an empty sheaf that was replaced, called with interrupts disabled */
+static void pcs_stash_empty(struct kmem_cache *s,
+			    struct slub_percpu_sheaves *pcs,
+			    struct slab_sheaf *empty)
+{
+	if (!pcs->spare)
+		pcs->spare = empty;
+	else if (!barn_put_sheaf(get_barn(s), empty, false))
+		kfree(empty);
+}
+
+/*
+ * Allocate an object from the main sheaf, refilling it from the spare,
+ * the barn or the slabs when it is empty. Returns NULL if the caller
+ * should use the regular paths instead.
+ */
+static void *alloc_from_pcs(struct kmem_cache *s, gfp_t gfp, int node)
+{
+	struct slub_percpu_sheaves *pcs;
+	struct slab_sheaf *full, *empty;
+	unsigned long flags;
+	void *object;
+
+	local_irq_save(flags);
+	if (IS_ENABLED(CONFIG_NUMA) && node != NUMA_NO_NODE &&
+	    node != numa_mem_id())
+		goto fail;
+
+	pcs = this_cpu_ptr(s->cpu_sheaves);
+	if (likely(pcs->main->size))
+		goto do_alloc;
+
+	if (pcs->spare && pcs->spare->size) {
+		swap(pcs->main, pcs->spare);
+		goto do_alloc;
+	}
+
+	full = barn_get_sheaf(get_barn(s), true);
+	if (full) {
+		stat(s, BARN_GET);
+		empty = pcs->main;
+		pcs->main = full;
+		pcs_stash_empty(s, pcs, empty);
+		goto do_alloc;
+	}
+	local_irq_restore(flags);
+
+	full = alloc_full_sheaf(s, sheaf_gfp(gfp));
+	if (!full)
+		return NULL;
+
+	/* We may have moved to another cpu, or been refilled meanwhile */
+	local_irq_save(flags);
+	pcs = this_cpu_ptr(s->cpu_sheaves);
+	if (!pcs->main->size) {
+		empty = pcs->main;
+		pcs->main = full;
+		pcs_stash_empty(s, pcs, empty);
+	} else if (!barn_put_sheaf(get_barn(s), full, true)) {
+		object = full->objects[--full->size];
+		local_irq_restore(flags);
+		sheaf_flush(s, full);
+		kfree(full);
+		return object;
+	}
+
+do_alloc:
+	object = pcs->main->objects[--pcs->main->size];
+	local_irq_restore(flags);
+	stat(s, ALLOC_PCS);
+	return object;
+
+fail:
+	local_irq_restore(flags);
+	return NULL;
+}
+
+/*
+ * The main sheaf is full: replace it with an empty sheaf, keeping the full
+ * one as the spare or in the barn. Called with interrupts disabled.
+ */
+static bool pcs_replace_full_main(struct kmem_cache *s,
+				  struct slub_percpu_sheaves *pcs)
+{
+	struct node_barn *barn = get_barn(s);
+	struct slab_sheaf *empty;
+
+	if (pcs->spare && (!barn ||
+			   READ_ONCE(barn->nr_full) >= MAX_FULL_SHEAVES))
+		return false;
+
+	empty = barn_get_sheaf(barn, false);
+	if (!empty)
+		empty = alloc_empty_sheaf(s, GFP_NOWAIT | __GFP_NOWARN);
+	if (!empty)
+		return false;
+
+	if (!pcs->spare) {
+		pcs->spare = pcs->main;
+	} else if (barn_put_sheaf(barn, pcs->main, true)) {
+		stat(s, BARN_PUT);
+	} else {
+		if (!barn_put_sheaf(barn, empty, false))
+			kfree(empty);
+		return false;
+	}
+	pcs->main = empty;
+	return true;
+}
+
+/*
+ * Free an object to the main sheaf. Objects of remote nodes and of
+ * pfmemalloc slabs are left to the regular paths, so that the sheaves
+ * only ever hand out local objects that any allocation may use.
+ */
+static bool free_to_pcs(struct kmem_cache *s, struct page *page, void *object)
+{
+	struct slub_percpu_sheaves *pcs;
+	unsigned long flags;
+
+	if (unlikely(PageSlabPfmemalloc(page)))
+		return false;
+
+	local_irq_save(flags);
+	if (IS_ENABLED(CONFIG_NUMA) && page_to_nid(page) != numa_mem_id()) {
+		local_irq_restore(flags);
+		return false;
+	}
+
+	pcs = this_cpu_ptr(s->cpu_sheaves);
+	if (unlikely(pcs->main->size == s->sheaf_capacity)) {
+		if (pcs->spare && !pcs->spare->size)
+			swap(pcs->main, pcs->spare);
+		else if (!pcs_replace_full_main(s, pcs))
+			sheaf_flush(s, pcs->main);
+	}
+	pcs->main->objects[pcs->main->size++] = object;
+	local_irq_restore(flags);
+	stat(s, FREE_PCS);
+	return true;
+}
+
+static bool pcs_has_objects(struct kmem_cache *s, int cpu)
+{
+	struct slub_percpu_sheaves *pcs;
+
+	if (!s->cpu_sheaves)
+		return false;
+
+	pcs = per_cpu_ptr(s->cpu_sheaves, cpu);
+	return pcs->main->size || (pcs->spare && pcs->spare->size);
+}
+
+/*
+ * Flush the sheaves of a cpu. Called with interrupts disabled, on that cpu
+ * or after it went offline.
+ */
+static void pcs_flush_cpu(struct kmem_cache *s, int cpu)
+{
+	struct slub_percpu_sheaves *pcs;
+
+	if (!s->cpu_sheaves)
+		return;
+
+	pcs = per_cpu_ptr(s->cpu_sheaves, cpu);
+	sheaf_flush(s, pcs->main);
+	if (pcs->spare)
+		sheaf_flush(s, pcs->spare);
+}
+
+static void free_percpu_sheaves(struct kmem_cache *s)
+{
+	int cpu;
+
+	if (!s->cpu_sheaves)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		struct slub_percpu_sheaves *pcs;
+
+		pcs = per_cpu_ptr(s->cpu_sheaves, cpu);
+		kfree(pcs->main);
+		kfree(pcs->spare);
+	}
+	free_percpu(s->cpu_sheaves);
+	s->cpu_sheaves = NULL;
+}
+
+static unsigned int calculate_sheaf_capacity(struct kmem_cache *s)
+{
+	if (s->size >= PAGE_SIZE)
+		return 4;
+	else if (s->size >= 1024)
+		return 8;
+	else if (s->size >= 256)
+		return 16;
+	return 32;
+}
+
+/*
+ * Sheaves are only set up once kmalloc works, and not for debug caches,
+ * whose checks need to see every allocation and free of a slab object.
+ * Failing to set them up is not fatal, the cache then works without.
+ */
+static void init_kmem_cache_sheaves(struct kmem_cache *s)
+{
+	int cpu;
+
+	s->cpu_sheaves = NULL;
+	s->sheaf_capacity = 0;
+
+	if (!(s->flags & SLAB_SHEAVES) || kmem_cache_debug(s) ||
+	    (s->flags & SLAB_KASAN) || slab_state < UP)
+		return;
+
+	s->sheaf_capacity = calculate_sheaf_capacity(s);
+	s->cpu_sheaves = alloc_percpu(struct slub_percpu_sheaves);
+	if (!s->cpu_sheaves)
+		goto fail;
+
+	for_each_possible_cpu(cpu) {
+		struct slub_percpu_sheaves *pcs;
+
+		pcs = per_cpu_ptr(s->cpu_sheaves, cpu);
+		pcs->main = alloc_empty_sheaf(s, GFP_KERNEL);
+		if (!pcs->main) {
+			free_percpu_sheaves(s);
+			goto fail;
+		}
+	}
+	return;
+
+fail:
+	s->sheaf_capacity = 0;
+}
+
 
 /*
  * Object placement in a slab is made very easy because we always start at
@@ -3316,6 +3767,11 @@ init_kmem_cache_node(struct kmem_cache_node *n)
 	atomic_long_set(&n->total_objects, 0);
 	INIT_LIST_HEAD(&n->full);
 #endif
+	spin_lock_init(&n->barn.lock);
+	INIT_LIST_HEAD(&n->barn.sheaves_full);
+	INIT_LIST_HEAD(&n->barn.sheaves_empty);
+	n->barn.nr_full = 0;
+	n->barn.nr_empty = 0;
 }
 
 static inline int alloc_kmem_cache_cpus(struct kmem_cache *s)
@@ -3392,6 +3848,7 @@ static void free_kmem_cache_nodes(struct kmem_cache *s)
 	struct kmem_cache_node *n;
 
 	for_each_kmem_cache_node(s, node, n) {
+		barn_shrink(s, &n->barn);
 		s->node[node] = NULL;
 		kmem_cache_free(kmem_cache_node, n);
 	}
@@ -3400,6 +3857,7 @@ static void free_kmem_cache_nodes(struct kmem_cache *s)
 void __kmem_cache_release(struct kmem_cache *s)
 {
 	cache_random_seq_destroy(s);
+	free_percpu_sheaves(s);
 	free_percpu(s->cpu_slab);
 	free_kmem_cache_nodes(s);
 }
@@ -3647,8 +4105,10 @@ static int kmem_cache_open(struct kmem_cache *s, unsigned long flags)
 	if (!init_kmem_cache_nodes(s))
 		goto error;
 
-	if (alloc_kmem_cache_cpus(s))
+	if (alloc_kmem_cache_cpus(s)) {
+		init_kmem_cache_sheaves(s);
 		return 0;
+	}
 
 	free_kmem_cache_nodes(s);
 error:
@@ -4068,6 +4528,7 @@ static void slab_mem_offline_callback(void *arg)
 			 * and offline_pages() function shouldn't call this
 			 * callback. So, we must fail.
 			 */
+			barn_shrink(s, &n->barn);
 			BUG_ON(slabs_node(s, offline_node));
 
 			s->node[offline_node] = NULL;
@@ -4980,6 +5441,12 @@ static ssize_t cpu_partial_store(struct kmem_cache *s, const char *buf,
 }
 SLAB_ATTR(cpu_partial);
 
+static ssize_t sheaf_capacity_show(struct kmem_cache *s, char *buf)
+{
+	return sprintf(buf, "%u\n", s->sheaf_capacity);
+}
+SLAB_ATTR_RO(sheaf_capacity);
+
 static ssize_t ctor_show(struct kmem_cache *s, char *buf)
 {
 	if (!s->ctor)
@@ -5385,6 +5852,12 @@ STAT_ATTR(CPU_PARTIAL_ALLOC, cpu_partial_alloc);
 STAT_ATTR(CPU_PARTIAL_FREE, cpu_partial_free);
 STAT_ATTR(CPU_PARTIAL_NODE, cpu_partial_node);
 STAT_ATTR(CPU_PARTIAL_DRAIN, cpu_partial_drain);
+STAT_ATTR(ALLOC_PCS, alloc_cpu_sheaf);
+STAT_ATTR(FREE_PCS, free_cpu_sheaf);
+STAT_ATTR(SHEAF_REFILL, sheaf_refill);
+STAT_ATTR(SHEAF_FLUSH, sheaf_flush);
+STAT_ATTR(BARN_GET, barn_get);
+STAT_ATTR(BARN_PUT, barn_put);
 #endif
 
 static struct attribute *slab_attrs[] = {
@@ -5394,6 +5867,7 @@ static struct attribute *slab_attrs[] = {
 	&order_attr.attr,
 	&min_partial_attr.attr,
 	&cpu_partial_attr.attr,
+	&sheaf_capacity_attr.attr,
 	&objects_attr.attr,
 	&objects_partial_attr.attr,
 	&partial_attr.attr,
@@ -5452,6 +5926,12 @@ static struct attribute *slab_attrs[] = {
 	&cpu_partial_free_attr.attr,
 	&cpu_partial_node_attr.attr,
 	&cpu_partial_drain_attr.attr,
+	&alloc_cpu_sheaf_attr.attr,
+	&free_cpu_sheaf_attr.attr,
+	&sheaf_refill_attr.attr,
+	&sheaf_flush_attr.attr,
+	&barn_get_attr.attr,
+	&barn_put_attr.attr,
 #endif
 #ifdef CONFIG_FAILSLAB
 	&failslab_attr.attr,
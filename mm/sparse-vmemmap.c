@@ -27,9 +27,11 @@
 #include <linux/spinlock.h>
 #include <linux/vmalloc.h>
 #include <linux/sched.h>
+#include <linux/memory_hotplug.h>
 #include <asm/dma.h>
 #include <asm/pgalloc.h>
 #include <asm/pgtable.h>
+#include <asm/tlbflush.h>
 
 /*
  * Allocate a block of memory to be used to back the virtual memory map
@@ -317,3 +319,186 @@ void __init sparse_mem_maps_populate_node(struct page **map_map,
 		vmemmap_buf_end = NULL;
 	}
 }
+
+#ifdef CONFIG_HUGETLB_PAGE_FREE_VMEMMAP
+/*
+ * The struct pages of a HugeTLB page past its first few tail pages are all
+ * the same.  vmemmap_remap_free() frees the vmemmap pages backing them and
+ * maps their range read-only to the vmemmap page just below it, which is
+ * kept; vmemmap_remap_alloc() gives the range its own pages back, copied
+ * from that page, before the huge page can be freed to the buddy allocator.
+ */
+static pmd_t *vmemmap_pmd(unsigned long addr)
+{
+	pgd_t *pgd = pgd_offset_k(addr);
+	p4d_t *p4d = p4d_offset(pgd, addr);
+	pud_t *pud = pud_offset(p4d, addr);
+
+	return pmd_offset(pud, addr);
+}
+
+static pte_t *vmemmap_pte(unsigned long addr)
+{
+	return pte_offset_kernel(vmemmap_pmd(addr), addr);
+}
+
+static int split_vmemmap_huge_pmd(pmd_t *pmd, unsigned long start)
+{
+	struct page *page = pmd_page(*pmd);
+	unsigned long addr = start;
+	pte_t *pgtable;
+	pmd_t __pmd;
+	int i;
+
+	pgtable = pte_alloc_one_kernel(&init_mm, start);
+	if (!pgtable)
+		return -ENOMEM;
+
+	pmd_populate_kernel(&init_mm, &__pmd, pgtable);
+	for (i = 0; i < PTRS_PER_PTE; i++, addr += PAGE_SIZE)
+		set_pte_at(&init_mm, addr, pte_offset_kernel(&__pmd, addr),
+			   mk_pte(page + i, PAGE_KERNEL));
+
+	spin_lock(&init_mm.page_table_lock);
+	if (likely(pmd_large(*pmd))) {
+		/*
+		 * The pages of a block allocated after boot are freed one
+		 * by one from now on.
+		 */
+		if (!PageReserved(page))
+			split_page(page, get_order(PMD_SIZE));
+		/* Make the ptes visible before the pmd, as __pte_alloc() */
+		smp_wmb();
+		pmd_populate_kernel(&init_mm, pmd, pgtable);
+		flush_tlb_kernel_range(start, start + PMD_SIZE);
+	} else {
+		pte_free_kernel(&init_mm, pgtable);
+	}
+	spin_unlock(&init_mm.page_table_lock);
+
+	return 0;
+}
+
+static int vmemmap_split_range(unsigned long start, unsigned long end)
+{
+	unsigned long addr;
+
+	for (addr = start & PMD_MASK; addr < end; addr += PMD_SIZE) {
+		pmd_t *pmd = vmemmap_pmd(addr);
+
+		if (pmd_large(*pmd)) {
+			int ret = split_vmemmap_huge_pmd(pmd, addr);
+
+			if (ret)
+				return ret;
+		}
+	}
+	return 0;
+}
+
+static void free_vmemmap_page(struct page *page)
+{
+	if (PageReserved(page)) {
+		/* allocated at boot, as free_pagetable() on x86 */
+#ifdef CONFIG_HAVE_BOOTMEM_INFO_NODE
+		unsigned long magic = (unsigned long)page->freelist;
+
+		__ClearPageReserved(page);
+		if (magic == SECTION_INFO || magic == MIX_SECTION_INFO) {
+			put_page_bootmem(page);
+			return;
+		}
+#endif
+		free_reserved_page(page);
+	} else {
+		__free_page(page);
+	}
+}
+
+/**
+ * vmemmap_remap_free - free the vmemmap pages of a range
+ * @start:	start address of the vmemmap range, page aligned
+ * @end:	end address of the vmemmap range, page aligned
+ * @reuse:	address of the vmemmap page the range is mapped to,
+ *		which must be @start - PAGE_SIZE
+ *
+ * Return: 0 on success, -ENOMEM if the vmemmap page tables could not be
+ * split, in which case the range is left untouched.
+ */
+int vmemmap_remap_free(unsigned long start, unsigned long end,
+		       unsigned long reuse)
+{
+	LIST_HEAD(vmemmap_pages);
+	struct page *reuse_page, *page, *next;
+	unsigned long addr;
+	int ret;
+
+	VM_BUG_ON(start - reuse != PAGE_SIZE);
+
+	ret = vmemmap_split_range(reuse, end);
+	if (ret)
+		return ret;
+
+	reuse_page = pte_page(*vmemmap_pte(reuse));
+	for (addr = start; addr < end; addr += PAGE_SIZE) {
+		pte_t *pte = vmemmap_pte(addr);
+
+		list_add_tail(&pte_page(*pte)->lru, &vmemmap_pages);
+		set_pte_at(&init_mm, addr, pte,
+			   mk_pte(reuse_page, PAGE_KERNEL_RO));
+	}
+	flush_tlb_kernel_range(start, end);
+
+	list_for_each_entry_safe(page, next, &vmemmap_pages, lru) {
+		list_del(&page->lru);
+		free_vmemmap_page(page);
+	}
+	return 0;
+}
+
+/**
+ * vmemmap_remap_alloc - give back its own vmemmap pages to a range
+ * @start:	start address of the vmemmap range, page aligned
+ * @end:	end address of the vmemmap range, page aligned
+ * @reuse:	address of the vmemmap page the range was mapped to by
+ *		vmemmap_remap_free()
+ * @gfp_mask:	GFP flag for allocating the vmemmap pages
+ *
+ * Return: 0 on success, -ENOMEM if the pages could not be allocated, in
+ * which case the range stays mapped to @reuse.
+ */
+int vmemmap_remap_alloc(unsigned long start, unsigned long end,
+			unsigned long reuse, gfp_t gfp_mask)
+{
+	LIST_HEAD(vmemmap_pages);
+	unsigned long nr_pages = (end - start) >> PAGE_SHIFT;
+	int nid = page_to_nid((struct page *)start);
+	struct page *page, *next;
+	unsigned long addr;
+
+	VM_BUG_ON(start - reuse != PAGE_SIZE);
+
+	while (nr_pages--) {
+		page = alloc_pages_node(nid, gfp_mask, 0);
+		if (!page)
+			goto out;
+		list_add_tail(&page->lru, &vmemmap_pages);
+	}
+
+	for (addr = start; addr < end; addr += PAGE_SIZE) {
+		page = list_first_entry(&vmemmap_pages, struct page, lru);
+		list_del(&page->lru);
+		copy_page(page_address(page), (void *)reuse);
+		/* Make the copy visible before the pte */
+		smp_wmb();
+		set_pte_at(&init_mm, addr, vmemmap_pte(addr),
+			   mk_pte(page, PAGE_KERNEL));
+	}
+	flush_tlb_kernel_range(start, end);
+	return 0;
+out:
+	list_for_each_entry_safe(page, next, &vmemmap_pages, lru)
+		__free_page(page);
+	return -ENOMEM;
+}
+#endif /* CONFIG_HUGETLB_PAGE_FREE_VMEMMAP */
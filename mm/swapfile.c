@@ -1255,6 +1255,82 @@ int split_swap_cluster(swp_entry_t entry)
 	unlock_cluster(ci);
 	return 0;
 }
+
+/*
+ * The helpers below deal with the swap cluster of a THP swapped out whole,
+ * which a pmd swap entry maps: @entry is the first entry of the cluster.
+ */
+int swap_duplicate_huge(swp_entry_t entry)
+{
+	swp_entry_t e = entry;
+	int i, err;
+
+	for (i = 0; i < SWAPFILE_CLUSTER; i++, e.val++) {
+		err = swap_duplicate(e);
+		if (err) {
+			while (i--) {
+				e.val--;
+				swap_free(e);
+			}
+			return err;
+		}
+	}
+	return 0;
+}
+
+void swap_free_huge(swp_entry_t entry)
+{
+	int i;
+
+	for (i = 0; i < SWAPFILE_CLUSTER; i++, entry.val++)
+		swap_free(entry);
+}
+
+void free_swap_and_cache_huge(swp_entry_t entry)
+{
+	int i;
+
+	for (i = 0; i < SWAPFILE_CLUSTER; i++, entry.val++)
+		free_swap_and_cache(entry);
+}
+
+/*
+ * Like swapcache_prepare() for the whole cluster, so that a THP can be read
+ * in its place.  Every entry must still be in use and none in the swap
+ * cache, otherwise -EBUSY tells the caller to fall back to small pages.
+ */
+int swapcache_prepare_huge(swp_entry_t entry)
+{
+	unsigned long offset = swp_offset(entry);
+	struct swap_cluster_info *ci;
+	struct swap_info_struct *si;
+	unsigned char *map;
+	int i, err = -EBUSY;
+
+	if (!IS_ALIGNED(offset, SWAPFILE_CLUSTER))
+		return -EINVAL;
+	si = _swap_info_get(entry);
+	if (!si)
+		return -EINVAL;
+
+	ci = lock_cluster(si, offset);
+	if (!ci)
+		return -EBUSY;
+	map = si->swap_map + offset;
+	for (i = 0; i < SWAPFILE_CLUSTER; i++) {
+		if (!swap_count(map[i]) || swap_count(map[i]) == SWAP_MAP_BAD ||
+		    (map[i] & SWAP_HAS_CACHE))
+			goto unlock;
+	}
+	/* the cluster lost its mark when the THP left the swap cache */
+	cluster_set_count_flag(ci, cluster_count(ci), CLUSTER_FLAG_HUGE);
+	for (i = 0; i < SWAPFILE_CLUSTER; i++)
+		map[i] |= SWAP_HAS_CACHE;
+	err = 0;
+unlock:
+	unlock_cluster(ci);
+	return err;
+}
 #else
 static inline void swapcache_free_cluster(swp_entry_t entry)
 {
@@ -1755,7 +1831,8 @@ unsigned int count_swap_pages(int type, int free)
 
 static inline int pte_same_as_swp(pte_t pte, pte_t swp_pte)
 {
-	return pte_same(pte_swp_clear_soft_dirty(pte), swp_pte);
+	pte = pte_swp_clear_soft_dirty(pte);
+	return pte_same(pte_swp_clear_uffd_wp(pte), swp_pte);
 }
 
 /*
@@ -1769,7 +1846,7 @@ static int unuse_pte(struct vm_area_struct *vma, pmd_t *pmd,
 	struct page *swapcache;
 	struct mem_cgroup *memcg;
 	spinlock_t *ptl;
-	pte_t *pte;
+	pte_t *pte, new_pte;
 	int ret = 1;
 
 	swapcache = page;
@@ -1793,8 +1870,10 @@ static int unuse_pte(struct vm_area_struct *vma, pmd_t *pmd,
 	dec_mm_counter(vma->vm_mm, MM_SWAPENTS);
 	inc_mm_counter(vma->vm_mm, MM_ANONPAGES);
 	get_page(page);
-	set_pte_at(vma->vm_mm, addr, pte,
-		   pte_mkold(mk_pte(page, vma->vm_page_prot)));
+	new_pte = pte_mkold(mk_pte(page, vma->vm_page_prot));
+	if (pte_swp_uffd_wp(*pte))
+		new_pte = pte_mkuffd_wp(new_pte);
+	set_pte_at(vma->vm_mm, addr, pte, new_pte);
 	if (page == swapcache) {
 		page_add_anon_rmap(page, vma, addr, false);
 		mem_cgroup_commit_charge(page, memcg, true, false);
@@ -1867,6 +1946,10 @@ static inline int unuse_pmd_range(struct vm_area_struct *vma, pud_t *pud,
 	do {
 		cond_resched();
 		next = pmd_addr_end(addr, end);
+		/* the ptes of a THP swapped out whole are found below */
+		if (is_pmd_swap_entry(*pmd) &&
+		    swp_type(pmd_to_swp_entry(*pmd)) == swp_type(entry))
+			split_huge_pmd(vma, pmd, addr);
 		if (pmd_none_or_trans_huge_or_clear_bad(pmd))
 			continue;
 		ret = unuse_pte_range(vma, pmd, addr, next, entry, page);
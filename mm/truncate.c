@@ -178,6 +178,22 @@ invalidate_complete_page(struct address_space *mapping, struct page *page)
 	return ret;
 }
 
+/*
+ * The lookups return the subpages of a large page one by one.  The whole
+ * page goes with the first of them: it is clean, so whatever part of it
+ * is outside of the range is just read again.  Returns the page to drop,
+ * or NULL once it is gone.
+ */
+static struct page *large_page_to_drop(struct address_space *mapping,
+				       struct page *page)
+{
+	struct page *head = compound_head(page);
+
+	if (page == head || !mapping_large_pages(mapping))
+		return page;
+	return head->mapping == mapping ? head : NULL;
+}
+
 int truncate_inode_page(struct address_space *mapping, struct page *page)
 {
 	loff_t holelen;
@@ -294,6 +310,7 @@ void truncate_inode_pages_range(struct address_space *mapping,
 			indices)) {
 		for (i = 0; i < pagevec_count(&pvec); i++) {
 			struct page *page = pvec.pages[i];
+			struct page *drop;
 
 			/* We rely upon deletion not changing page->index */
 			index = indices[i];
@@ -309,11 +326,12 @@ void truncate_inode_pages_range(struct address_space *mapping,
 			if (!trylock_page(page))
 				continue;
 			WARN_ON(page_to_index(page) != index);
-			if (PageWriteback(page)) {
+			drop = large_page_to_drop(mapping, page);
+			if (!drop || PageWriteback(page)) {
 				unlock_page(page);
 				continue;
 			}
-			truncate_inode_page(mapping, page);
+			truncate_inode_page(mapping, drop);
 			unlock_page(page);
 		}
 		pagevec_remove_exceptionals(&pvec);
@@ -381,6 +399,7 @@ void truncate_inode_pages_range(struct address_space *mapping,
 		}
 		for (i = 0; i < pagevec_count(&pvec); i++) {
 			struct page *page = pvec.pages[i];
+			struct page *drop;
 
 			/* We rely upon deletion not changing page->index */
 			index = indices[i];
@@ -399,7 +418,9 @@ void truncate_inode_pages_range(struct address_space *mapping,
 			lock_page(page);
 			WARN_ON(page_to_index(page) != index);
 			wait_on_page_writeback(page);
-			truncate_inode_page(mapping, page);
+			drop = large_page_to_drop(mapping, page);
+			if (drop)
+				truncate_inode_page(mapping, drop);
 			unlock_page(page);
 		}
 		pagevec_remove_exceptionals(&pvec);
@@ -589,7 +610,7 @@ invalidate_complete_page2(struct address_space *mapping, struct page *page)
 	if (mapping->a_ops->freepage)
 		mapping->a_ops->freepage(page);
 
-	put_page(page);	/* pagecache ref */
+	page_ref_sub(page, hpage_nr_pages(page));	/* pagecache refs */
 	return 1;
 failed:
 	spin_unlock_irqrestore(&mapping->tree_lock, flags);
@@ -652,8 +673,10 @@ int invalidate_inode_pages2_range(struct address_space *mapping,
 
 			lock_page(page);
 			WARN_ON(page_to_index(page) != index);
-			if (page->mapping != mapping) {
-				unlock_page(page);
+			/* the lock is the head's for all the subpages */
+			page = large_page_to_drop(mapping, page);
+			if (!page || page->mapping != mapping) {
+				unlock_page(pvec.pages[i]);
 				continue;
 			}
 			wait_on_page_writeback(page);
@@ -663,8 +686,8 @@ int invalidate_inode_pages2_range(struct address_space *mapping,
 					 * Zap the rest of the file in one hit.
 					 */
 					unmap_mapping_range(mapping,
-					   (loff_t)index << PAGE_SHIFT,
-					   (loff_t)(1 + end - index)
+					   (loff_t)page->index << PAGE_SHIFT,
+					   (loff_t)(1 + end - page->index)
 							 << PAGE_SHIFT,
 							 0);
 					did_range_unmap = 1;
@@ -673,8 +696,9 @@ int invalidate_inode_pages2_range(struct address_space *mapping,
 					 * Just zap this page
 					 */
 					unmap_mapping_range(mapping,
-					   (loff_t)index << PAGE_SHIFT,
-					   PAGE_SIZE, 0);
+					   (loff_t)page->index << PAGE_SHIFT,
+					   (loff_t)hpage_nr_pages(page)
+							 << PAGE_SHIFT, 0);
 				}
 			}
 			BUG_ON(page_mapped(page));
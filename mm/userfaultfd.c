@@ -574,3 +574,48 @@ ssize_t mfill_zeropage(struct mm_struct *dst_mm, unsigned long start,
 {
 	return __mcopy_atomic(dst_mm, start, 0, len, true);
 }
+
+/*
+ * Write protects, or resolves the write protection of, the pages of
+ * [start, start + len), which has to be registered for write protection.
+ * The ptes of each vma are changed in one pass with a single TLB flush.
+ */
+int mwriteprotect_range(struct mm_struct *dst_mm, unsigned long start,
+			unsigned long len, bool enable_wp)
+{
+	struct vm_area_struct *dst_vma;
+	unsigned long end = start + len;
+	unsigned long addr = start;
+	int err;
+
+	BUG_ON(start & ~PAGE_MASK);
+	BUG_ON(len & ~PAGE_MASK);
+	BUG_ON(start + len <= start);
+
+	down_read(&dst_mm->mmap_sem);
+
+	err = -ENOENT;
+	for (dst_vma = find_vma(dst_mm, start);
+	     dst_vma && addr < end; dst_vma = dst_vma->vm_next) {
+		if (dst_vma->vm_start > addr)
+			goto out_unlock;
+		if (!userfaultfd_wp(dst_vma) || !vma_is_anonymous(dst_vma))
+			goto out_unlock;
+		addr = dst_vma->vm_end;
+	}
+	if (addr < end)
+		goto out_unlock;
+
+	for (dst_vma = find_vma(dst_mm, start);
+	     dst_vma && dst_vma->vm_start < end; dst_vma = dst_vma->vm_next)
+		change_protection(dst_vma, max(start, dst_vma->vm_start),
+				  min(end, dst_vma->vm_end),
+				  dst_vma->vm_page_prot,
+				  enable_wp ? MM_CP_UFFD_WP :
+					      MM_CP_UFFD_WP_RESOLVE);
+
+	err = 0;
+out_unlock:
+	up_read(&dst_mm->mmap_sem);
+	return err;
+}
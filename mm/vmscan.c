@@ -49,12 +49,19 @@
 #include <linux/prefetch.h>
 #include <linux/printk.h>
 #include <linux/dax.h>
+#include <linux/pagevec.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/srcu.h>
+#include <linux/idr.h>
+#include <linux/migrate.h>
 
 #include <asm/tlbflush.h>
 #include <asm/div64.h>
 
 #include <linux/swapops.h>
 #include <linux/balloon_compaction.h>
+#include <linux/psi.h>
 
 #include "internal.h"
 
@@ -98,6 +105,9 @@ struct scan_control {
 	/* Can pages be swapped as part of reclaim? */
 	unsigned int may_swap:1;
 
+	/* Proactive reclaim asked for anonymous pages only */
+	unsigned int anon_only:1;
+
 	/*
 	 * Cgroups are not reclaimed below their configured memory.low,
 	 * unless we threaten to OOM. If any cgroups are skipped due to
@@ -108,6 +118,9 @@ struct scan_control {
 
 	unsigned int hibernation_mode:1;
 
+	/* The pages may not be demoted to a slower node instead */
+	unsigned int no_demotion:1;
+
 	/* One of the zones is ready for compaction */
 	unsigned int compaction_ready:1;
 
@@ -116,6 +129,9 @@ struct scan_control {
 
 	/* Number of pages freed so far during a call to shrink_zones() */
 	unsigned long nr_reclaimed;
+
+	/* Proactive reclaim may override the swappiness of the memcgs */
+	int *swappiness;
 };
 
 #ifdef ARCH_HAS_PREFETCH
@@ -150,14 +166,89 @@ struct scan_control {
  * From 0 .. 100.  Higher means more swappy.
  */
 int vm_swappiness = 60;
+/*
+ * kswapd threads per node. The ones after the first help it reclaim when it
+ * could not balance the node in a first pass.
+ */
+int kswapd_threads = 1;
 /*
  * The total number of pages which are beyond the high watermark within all
  * zones.
  */
 unsigned long vm_total_pages;
 
+/*
+ * Registration and unregistration of shrinkers serialize on shrinker_mutex,
+ * reclaim only walks the shrinkers under shrinker_srcu: a shrinker being
+ * unregistered waits for the walks in progress, but never blocks reclaim.
+ */
 static LIST_HEAD(shrinker_list);
-static DECLARE_RWSEM(shrinker_rwsem);
+static DEFINE_MUTEX(shrinker_mutex);
+DEFINE_SRCU(shrinker_srcu);
+
+#if defined(CONFIG_MEMCG) && !defined(CONFIG_SLOB)
+/*
+ * Memcg aware shrinkers get an id, the bit of the shrinker in the per
+ * memcg, per node shrinker maps that list_lru_add() sets when the memcg
+ * gets objects. The id is reserved by prealloc_shrinker() and bound to
+ * SHRINKER_REGISTERING until the shrinker is ready to be called.
+ */
+#define SHRINKER_REGISTERING ((struct shrinker *)~0UL)
+
+static DEFINE_IDR(shrinker_idr);
+static int shrinker_nr_max;
+
+static int prealloc_memcg_shrinker(struct shrinker *shrinker)
+{
+	int id, ret = -ENOMEM;
+
+	mutex_lock(&shrinker_mutex);
+	id = idr_alloc(&shrinker_idr, SHRINKER_REGISTERING, 0, 0, GFP_KERNEL);
+	if (id < 0)
+		goto unlock;
+
+	if (id >= shrinker_nr_max) {
+		if (memcg_expand_shrinker_maps(id)) {
+			idr_remove(&shrinker_idr, id);
+			goto unlock;
+		}
+		shrinker_nr_max = id + 1;
+	}
+	shrinker->id = id;
+	ret = 0;
+unlock:
+	mutex_unlock(&shrinker_mutex);
+	return ret;
+}
+
+/* Called with shrinker_mutex held */
+static void unregister_memcg_shrinker(struct shrinker *shrinker)
+{
+	BUG_ON(shrinker->id < 0);
+	idr_remove(&shrinker_idr, shrinker->id);
+}
+
+static struct shrinker *shrinker_from_id(int id)
+{
+	struct shrinker *shrinker;
+
+	/* idr nodes are freed after an rcu grace period, not an srcu one */
+	rcu_read_lock();
+	shrinker = idr_find(&shrinker_idr, id);
+	rcu_read_unlock();
+
+	return shrinker;
+}
+#else
+static int prealloc_memcg_shrinker(struct shrinker *shrinker)
+{
+	return 0;
+}
+
+static void unregister_memcg_shrinker(struct shrinker *shrinker)
+{
+}
+#endif
 
 #ifdef CONFIG_MEMCG
 static bool global_reclaim(struct scan_control *sc)
@@ -202,6 +293,36 @@ static bool sane_reclaim(struct scan_control *sc)
 }
 #endif
 
+static bool can_demote(int nid, struct scan_control *sc)
+{
+	if (!numa_demotion_enabled)
+		return false;
+	if (sc) {
+		if (sc->no_demotion)
+			return false;
+		/* demoting does not lower the usage of a memcg */
+		if (!global_reclaim(sc))
+			return false;
+	}
+
+	return next_demotion_node(nid) != NUMA_NO_NODE;
+}
+
+/* Can the anonymous pages of @memcg on node @nid be swapped or demoted? */
+static bool can_reclaim_anon_pages(struct mem_cgroup *memcg, int nid,
+				   struct scan_control *sc)
+{
+	if (memcg) {
+		if (mem_cgroup_get_nr_swap_pages(memcg) > 0)
+			return true;
+	} else {
+		if (get_nr_swap_pages() > 0)
+			return true;
+	}
+
+	return can_demote(nid, sc);
+}
+
 /*
  * This misses isolated pages which are not accounted for to save counters.
  * As the data only determines if reclaim or compaction continues, it is
@@ -213,7 +334,7 @@ unsigned long zone_reclaimable_pages(struct zone *zone)
 
 	nr = zone_page_state_snapshot(zone, NR_ZONE_INACTIVE_FILE) +
 		zone_page_state_snapshot(zone, NR_ZONE_ACTIVE_FILE);
-	if (get_nr_swap_pages() > 0)
+	if (can_reclaim_anon_pages(NULL, zone_to_nid(zone), NULL))
 		nr += zone_page_state_snapshot(zone, NR_ZONE_INACTIVE_ANON) +
 			zone_page_state_snapshot(zone, NR_ZONE_ACTIVE_ANON);
 
@@ -228,7 +349,7 @@ unsigned long pgdat_reclaimable_pages(struct pglist_data *pgdat)
 	     node_page_state_snapshot(pgdat, NR_INACTIVE_FILE) +
 	     node_page_state_snapshot(pgdat, NR_ISOLATED_FILE);
 
-	if (get_nr_swap_pages() > 0)
+	if (can_reclaim_anon_pages(NULL, pgdat->node_id, NULL))
 		nr += node_page_state_snapshot(pgdat, NR_ACTIVE_ANON) +
 		      node_page_state_snapshot(pgdat, NR_INACTIVE_ANON) +
 		      node_page_state_snapshot(pgdat, NR_ISOLATED_ANON);
@@ -272,9 +393,11 @@ unsigned long lruvec_lru_size(struct lruvec *lruvec, enum lru_list lru, int zone
 }
 
 /*
- * Add a shrinker callback to be called from the vm.
+ * Allocate what a shrinker needs before registration, including the id of
+ * a memcg aware shrinker, which its list_lrus must know before they get
+ * objects.
  */
-int register_shrinker(struct shrinker *shrinker)
+int prealloc_shrinker(struct shrinker *shrinker)
 {
 	size_t size = sizeof(*shrinker->nr_deferred);
 
@@ -285,9 +408,54 @@ int register_shrinker(struct shrinker *shrinker)
 	if (!shrinker->nr_deferred)
 		return -ENOMEM;
 
-	down_write(&shrinker_rwsem);
-	list_add_tail(&shrinker->list, &shrinker_list);
-	up_write(&shrinker_rwsem);
+#if defined(CONFIG_MEMCG) && !defined(CONFIG_SLOB)
+	shrinker->id = -1;
+#endif
+	if (shrinker->flags & SHRINKER_MEMCG_AWARE) {
+		if (prealloc_memcg_shrinker(shrinker)) {
+			kfree(shrinker->nr_deferred);
+			shrinker->nr_deferred = NULL;
+			return -ENOMEM;
+		}
+	}
+	return 0;
+}
+
+void free_prealloced_shrinker(struct shrinker *shrinker)
+{
+	if (!shrinker->nr_deferred)
+		return;
+
+	if (shrinker->flags & SHRINKER_MEMCG_AWARE) {
+		mutex_lock(&shrinker_mutex);
+		unregister_memcg_shrinker(shrinker);
+		mutex_unlock(&shrinker_mutex);
+	}
+	kfree(shrinker->nr_deferred);
+	shrinker->nr_deferred = NULL;
+}
+
+void register_shrinker_prepared(struct shrinker *shrinker)
+{
+	mutex_lock(&shrinker_mutex);
+	list_add_tail_rcu(&shrinker->list, &shrinker_list);
+#if defined(CONFIG_MEMCG) && !defined(CONFIG_SLOB)
+	if (shrinker->flags & SHRINKER_MEMCG_AWARE)
+		idr_replace(&shrinker_idr, shrinker, shrinker->id);
+#endif
+	mutex_unlock(&shrinker_mutex);
+}
+
+/*
+ * Add a shrinker callback to be called from the vm.
+ */
+int register_shrinker(struct shrinker *shrinker)
+{
+	int err = prealloc_shrinker(shrinker);
+
+	if (err)
+		return err;
+	register_shrinker_prepared(shrinker);
 	return 0;
 }
 EXPORT_SYMBOL(register_shrinker);
@@ -297,10 +465,20 @@ EXPORT_SYMBOL(register_shrinker);
  */
 void unregister_shrinker(struct shrinker *shrinker)
 {
-	down_write(&shrinker_rwsem);
-	list_del(&shrinker->list);
-	up_write(&shrinker_rwsem);
+	if (!shrinker->nr_deferred)
+		return;
+
+	mutex_lock(&shrinker_mutex);
+	list_del_rcu(&shrinker->list);
+	if (shrinker->flags & SHRINKER_MEMCG_AWARE)
+		unregister_memcg_shrinker(shrinker);
+	mutex_unlock(&shrinker_mutex);
+
+	/* Wait for the reclaimers that may still be calling it */
+	synchronize_srcu(&shrinker_srcu);
+
 	kfree(shrinker->nr_deferred);
+	shrinker->nr_deferred = NULL;
 }
 EXPORT_SYMBOL(unregister_shrinker);
 
@@ -323,8 +501,8 @@ static unsigned long do_shrink_slab(struct shrink_control *shrinkctl,
 	long scanned = 0, next_deferred;
 
 	freeable = shrinker->count_objects(shrinker, shrinkctl);
-	if (freeable == 0)
-		return 0;
+	if (freeable == 0 || freeable == SHRINK_EMPTY)
+		return freeable;
 
 	/*
 	 * copy the current shrinker scan count into a local variable
@@ -426,6 +604,78 @@ static unsigned long do_shrink_slab(struct shrink_control *shrinkctl,
 	return freed;
 }
 
+#if defined(CONFIG_MEMCG) && !defined(CONFIG_SLOB)
+/*
+ * Only calls the shrinkers that the memcg's shrinker map says have objects
+ * for it on @nid, and clears the bits of those found empty.
+ */
+static unsigned long shrink_slab_memcg(gfp_t gfp_mask, int nid,
+				       struct mem_cgroup *memcg,
+				       unsigned long nr_scanned,
+				       unsigned long nr_eligible)
+{
+	struct memcg_shrinker_map *map;
+	unsigned long freed = 0;
+	int i, idx;
+
+	idx = srcu_read_lock(&shrinker_srcu);
+	map = srcu_dereference(memcg->nodeinfo[nid]->shrinker_map,
+			       &shrinker_srcu);
+	if (unlikely(!map))
+		goto unlock;
+
+	for_each_set_bit(i, map->map, map->nr_bits) {
+		struct shrink_control sc = {
+			.gfp_mask = gfp_mask,
+			.nid = nid,
+			.memcg = memcg,
+		};
+		struct shrinker *shrinker;
+		unsigned long ret;
+
+		shrinker = shrinker_from_id(i);
+		if (unlikely(!shrinker || shrinker == SHRINKER_REGISTERING)) {
+			if (!shrinker)
+				clear_bit(i, map->map);
+			continue;
+		}
+
+		if (!(shrinker->flags & SHRINKER_NUMA_AWARE))
+			sc.nid = 0;
+
+		ret = do_shrink_slab(&sc, shrinker, nr_scanned, nr_eligible);
+		if (ret == SHRINK_EMPTY) {
+			clear_bit(i, map->map);
+			/*
+			 * An object may have been added after the shrinker
+			 * counted none and before the bit was cleared: ask
+			 * again, and set the bit back if it was. The barrier
+			 * pairs with the one in memcg_set_shrinker_bit().
+			 */
+			smp_mb__after_atomic();
+			ret = do_shrink_slab(&sc, shrinker, nr_scanned,
+					     nr_eligible);
+			if (ret == SHRINK_EMPTY)
+				ret = 0;
+			else
+				memcg_set_shrinker_bit(memcg, nid, i);
+		}
+		freed += ret;
+	}
+unlock:
+	srcu_read_unlock(&shrinker_srcu, idx);
+	return freed;
+}
+#else
+static unsigned long shrink_slab_memcg(gfp_t gfp_mask, int nid,
+				       struct mem_cgroup *memcg,
+				       unsigned long nr_scanned,
+				       unsigned long nr_eligible)
+{
+	return 0;
+}
+#endif
+
 /**
  * shrink_slab - shrink slab caches
  * @gfp_mask: allocation context
@@ -442,7 +692,8 @@ static unsigned long do_shrink_slab(struct shrink_control *shrinkctl,
  * @memcg specifies the memory cgroup to target. If it is not NULL,
  * only shrinkers with SHRINKER_MEMCG_AWARE set will be called to scan
  * objects from the memory cgroup specified. Otherwise, only unaware
- * shrinkers are called.
+ * shrinkers are called. Below the root, only the shrinkers set in the
+ * shrinker map of the memcg are called.
  *
  * @nr_scanned and @nr_eligible form a ratio that indicate how much of
  * the available objects should be scanned.  Page reclaim for example
@@ -461,6 +712,7 @@ static unsigned long shrink_slab(gfp_t gfp_mask, int nid,
 {
 	struct shrinker *shrinker;
 	unsigned long freed = 0;
+	int idx;
 
 	if (memcg && (!memcg_kmem_enabled() || !mem_cgroup_online(memcg)))
 		return 0;
@@ -468,23 +720,20 @@ static unsigned long shrink_slab(gfp_t gfp_mask, int nid,
 	if (nr_scanned == 0)
 		nr_scanned = SWAP_CLUSTER_MAX;
 
-	if (!down_read_trylock(&shrinker_rwsem)) {
-		/*
-		 * If we would return 0, our callers would understand that we
-		 * have nothing else to shrink and give up trying. By returning
-		 * 1 we keep it going and assume we'll be able to shrink next
-		 * time.
-		 */
-		freed = 1;
+	if (memcg && !mem_cgroup_is_root(memcg)) {
+		freed = shrink_slab_memcg(gfp_mask, nid, memcg, nr_scanned,
+					  nr_eligible);
 		goto out;
 	}
 
-	list_for_each_entry(shrinker, &shrinker_list, list) {
+	idx = srcu_read_lock(&shrinker_srcu);
+	list_for_each_entry_rcu(shrinker, &shrinker_list, list) {
 		struct shrink_control sc = {
 			.gfp_mask = gfp_mask,
 			.nid = nid,
 			.memcg = memcg,
 		};
+		unsigned long ret;
 
 		/*
 		 * If kernel memory accounting is disabled, we ignore
@@ -498,10 +747,12 @@ static unsigned long shrink_slab(gfp_t gfp_mask, int nid,
 		if (!(shrinker->flags & SHRINKER_NUMA_AWARE))
 			sc.nid = 0;
 
-		freed += do_shrink_slab(&sc, shrinker, nr_scanned, nr_eligible);
+		ret = do_shrink_slab(&sc, shrinker, nr_scanned, nr_eligible);
+		if (ret == SHRINK_EMPTY)
+			ret = 0;
+		freed += ret;
 	}
-
-	up_read(&shrinker_rwsem);
+	srcu_read_unlock(&shrinker_srcu, idx);
 out:
 	cond_resched();
 	return freed;
@@ -522,6 +773,28 @@ void drop_slab_node(int nid)
 	} while (freed > 10);
 }
 
+/* Drop the slab objects charged to @root and its descendants */
+void drop_slab_mem_cgroup(struct mem_cgroup *root)
+{
+	int nid;
+
+	for_each_online_node(nid) {
+		unsigned long freed;
+
+		do {
+			struct mem_cgroup *memcg;
+
+			memcg = mem_cgroup_iter(root, NULL, NULL);
+			freed = 0;
+			do {
+				freed += shrink_slab(GFP_KERNEL, nid, memcg,
+						     1000, 1000);
+			} while ((memcg = mem_cgroup_iter(root, memcg,
+							  NULL)) != NULL);
+		} while (freed > 10);
+	}
+}
+
 void drop_slab(void)
 {
 	int nid;
@@ -700,7 +973,8 @@ static int __remove_mapping(struct address_space *mapping, struct page *page,
 	 * Note that if SetPageDirty is always performed via set_page_dirty,
 	 * and thus under tree_lock, then this ordering is not required.
 	 */
-	if (unlikely(PageTransHuge(page)) && PageSwapCache(page))
+	if (unlikely(PageTransHuge(page)) &&
+	    (PageSwapCache(page) || mapping_large_pages(mapping)))
 		refcount = 1 + HPAGE_PMD_NR;
 	else
 		refcount = 2;
@@ -951,6 +1225,65 @@ struct reclaim_stat {
 	unsigned nr_unmap_fail;
 };
 
+static struct page *alloc_demote_page(struct page *page, unsigned long node,
+				      int **result)
+{
+	/* a demotion is not worth reclaiming on the slower node too */
+	gfp_t gfp_mask = (GFP_HIGHUSER_MOVABLE & ~__GFP_RECLAIM) |
+			 __GFP_THISNODE | __GFP_NOWARN |
+			 __GFP_NOMEMALLOC | GFP_NOWAIT;
+	struct page *new_page;
+
+	if (PageTransHuge(page)) {
+		new_page = alloc_pages_node(node, gfp_mask | __GFP_COMP,
+					    HPAGE_PMD_ORDER);
+		if (new_page)
+			prep_transhuge_page(new_page);
+		return new_page;
+	}
+
+	return alloc_pages_node(node, gfp_mask, 0);
+}
+
+/*
+ * Moves the pages of @demote_pages, isolated from @pgdat, to the next tier
+ * and returns how many were.  Those which could not be are left on the list.
+ */
+static unsigned int demote_page_list(struct list_head *demote_pages,
+				     struct pglist_data *pgdat)
+{
+	int target_nid = next_demotion_node(pgdat->node_id);
+	unsigned int nr_succeeded = 0;
+	struct page *page;
+
+	if (list_empty(demote_pages) || target_nid == NUMA_NO_NODE)
+		return 0;
+
+	/*
+	 * The caller accounts the pages as isolated until it puts them back,
+	 * but migration unaccounts those it is done with.
+	 */
+	list_for_each_entry(page, demote_pages, lru)
+		mod_node_page_state(pgdat, NR_ISOLATED_ANON +
+				    page_is_file_cache(page),
+				    hpage_nr_pages(page));
+
+	__migrate_pages(demote_pages, alloc_demote_page, NULL, target_nid,
+			MIGRATE_ASYNC, MR_DEMOTION, &nr_succeeded);
+
+	list_for_each_entry(page, demote_pages, lru)
+		mod_node_page_state(pgdat, NR_ISOLATED_ANON +
+				    page_is_file_cache(page),
+				    -hpage_nr_pages(page));
+
+	if (current_is_kswapd())
+		count_vm_events(PGDEMOTE_KSWAPD, nr_succeeded);
+	else
+		count_vm_events(PGDEMOTE_DIRECT, nr_succeeded);
+
+	return nr_succeeded;
+}
+
 /*
  * shrink_page_list() returns the number of reclaimed pages
  */
@@ -963,6 +1296,8 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 {
 	LIST_HEAD(ret_pages);
 	LIST_HEAD(free_pages);
+	LIST_HEAD(demote_pages);
+	bool do_demote_pass;
 	int pgactivate = 0;
 	unsigned nr_unqueued_dirty = 0;
 	unsigned nr_dirty = 0;
@@ -974,7 +1309,9 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 	unsigned nr_unmap_fail = 0;
 
 	cond_resched();
+	do_demote_pass = can_demote(pgdat->node_id, sc);
 
+retry:
 	while (!list_empty(page_list)) {
 		struct address_space *mapping;
 		struct page *page;
@@ -1125,6 +1462,17 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			; /* try to reclaim the page below */
 		}
 
+		/*
+		 * Rather than reclaiming the cold page, move it to a slower
+		 * node, as a whole when it is a THP that can be migrated.
+		 */
+		if (do_demote_pass &&
+		    (thp_migration_supported() || !PageTransHuge(page))) {
+			list_add(&page->lru, &demote_pages);
+			unlock_page(page);
+			continue;
+		}
+
 		/*
 		 * Anonymous process memory has backing store?
 		 * Try to allocate it some swap space here.
@@ -1180,7 +1528,10 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 		if (page_mapped(page)) {
 			enum ttu_flags flags = ttu_flags | TTU_BATCH_FLUSH;
 
-			if (unlikely(PageTransHuge(page)))
+			/* a THP in swap cache is mapped by a pmd swap entry */
+			if (unlikely(PageTransHuge(page)) &&
+			    !(IS_ENABLED(CONFIG_THP_SWAP) &&
+			      PageSwapCache(page)))
 				flags |= TTU_SPLIT_HUGE_PMD;
 			if (!try_to_unmap(page, flags)) {
 				nr_unmap_fail++;
@@ -1347,6 +1698,14 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 		VM_BUG_ON_PAGE(PageLRU(page) || PageUnevictable(page), page);
 	}
 
+	nr_reclaimed += demote_page_list(&demote_pages, pgdat);
+	/* the pages which could not be demoted are reclaimed instead */
+	if (!list_empty(&demote_pages)) {
+		list_splice_init(&demote_pages, page_list);
+		do_demote_pass = false;
+		goto retry;
+	}
+
 	mem_cgroup_uncharge_list(&free_pages);
 	try_to_unmap_flush();
 	free_hot_cold_page_list(&free_pages, true);
@@ -1374,6 +1733,7 @@ unsigned long reclaim_clean_pages_from_list(struct zone *zone,
 		.gfp_mask = GFP_KERNEL,
 		.priority = DEF_PRIORITY,
 		.may_unmap = 1,
+		.no_demotion = 1,
 	};
 	unsigned long ret;
 	struct page *page, *next;
@@ -1394,6 +1754,67 @@ unsigned long reclaim_clean_pages_from_list(struct zone *zone,
 	return ret;
 }
 
+static unsigned long reclaim_node_pages(struct list_head *page_list,
+					int nid, struct scan_control *sc)
+{
+	unsigned long nr_reclaimed;
+	struct page *page;
+
+	nr_reclaimed = shrink_page_list(page_list, NODE_DATA(nid), sc, 0,
+					NULL, false);
+	while (!list_empty(page_list)) {
+		page = lru_to_page(page_list);
+		list_del(&page->lru);
+		putback_lru_page(page);
+	}
+
+	return nr_reclaimed;
+}
+
+/**
+ * reclaim_pages - reclaim a list of isolated pages
+ * @page_list: pages isolated from their LRU with isolate_lru_page()
+ *
+ * Sends the pages through shrink_page_list() one node at a time, whatever
+ * their age, and puts back those which could not be reclaimed.  Returns
+ * the number of reclaimed pages.
+ */
+unsigned long reclaim_pages(struct list_head *page_list)
+{
+	struct scan_control sc = {
+		.gfp_mask = GFP_KERNEL,
+		.priority = DEF_PRIORITY,
+		.may_writepage = 1,
+		.may_unmap = 1,
+		.may_swap = 1,
+		.no_demotion = 1,
+	};
+	unsigned long nr_reclaimed = 0;
+	LIST_HEAD(node_page_list);
+	struct page *page;
+	int nid = NUMA_NO_NODE;
+
+	while (!list_empty(page_list)) {
+		page = lru_to_page(page_list);
+		if (nid == NUMA_NO_NODE)
+			nid = page_to_nid(page);
+
+		if (nid == page_to_nid(page)) {
+			ClearPageActive(page);
+			list_move(&page->lru, &node_page_list);
+			continue;
+		}
+
+		nr_reclaimed += reclaim_node_pages(&node_page_list, nid, &sc);
+		nid = NUMA_NO_NODE;
+	}
+
+	if (!list_empty(&node_page_list))
+		nr_reclaimed += reclaim_node_pages(&node_page_list, nid, &sc);
+
+	return nr_reclaimed;
+}
+
 /*
  * Attempt to remove the specified page from its LRU.  Only take this page
  * if it is of the appropriate PageActive status.  Pages which are being
@@ -2109,10 +2530,10 @@ static bool inactive_list_is_low(struct lruvec *lruvec, bool file,
 	unsigned long gb;
 
 	/*
-	 * If we don't have swap space, anonymous page deactivation
-	 * is pointless.
+	 * If we don't have swap space, nor a node to demote to, anonymous
+	 * page deactivation is pointless.
 	 */
-	if (!file && !total_swap_pages)
+	if (!file && !total_swap_pages && !can_demote(pgdat->node_id, sc))
 		return false;
 
 	inactive = lruvec_lru_size(lruvec, inactive_lru, sc->reclaim_idx);
@@ -2177,11 +2598,16 @@ enum scan_balance {
  * nr[0] = anon inactive pages to scan; nr[1] = anon active pages to scan
  * nr[2] = file inactive pages to scan; nr[3] = file active pages to scan
  */
+static int sc_swappiness(struct scan_control *sc, struct mem_cgroup *memcg)
+{
+	return sc->swappiness ? *sc->swappiness : mem_cgroup_swappiness(memcg);
+}
+
 static void get_scan_count(struct lruvec *lruvec, struct mem_cgroup *memcg,
 			   struct scan_control *sc, unsigned long *nr,
 			   unsigned long *lru_pages)
 {
-	int swappiness = mem_cgroup_swappiness(memcg);
+	int swappiness = sc_swappiness(sc, memcg);
 	struct zone_reclaim_stat *reclaim_stat = &lruvec->reclaim_stat;
 	u64 fraction[2];
 	u64 denominator = 0;	/* gcc */
@@ -2193,11 +2619,17 @@ static void get_scan_count(struct lruvec *lruvec, struct mem_cgroup *memcg,
 	enum lru_list lru;
 
 	/* If we have no swap space, do not bother scanning anon pages. */
-	if (!sc->may_swap || mem_cgroup_get_nr_swap_pages(memcg) <= 0) {
+	if (!sc->may_swap ||
+	    !can_reclaim_anon_pages(memcg, pgdat->node_id, sc)) {
 		scan_balance = SCAN_FILE;
 		goto out;
 	}
 
+	if (sc->anon_only) {
+		scan_balance = SCAN_ANON;
+		goto out;
+	}
+
 	/*
 	 * Global reclaim will swap to prevent OOM even with no
 	 * swappiness, but memcg users want to use this knob to
@@ -2375,60 +2807,819 @@ static void get_scan_count(struct lruvec *lruvec, struct mem_cgroup *memcg,
 	}
 }
 
+#ifdef CONFIG_LRU_GEN
 /*
- * This is a basic per-node page freer.  Used by both kswapd and direct reclaim.
+ * Multi-gen LRU: see struct lru_gen_struct. Instead of asking rmap about
+ * every page at the tail of the inactive list, the aging walks the page
+ * tables of the processes charged to the lruvec's memcg, harvests the
+ * accessed bits in batches and moves the pages it finds into the youngest
+ * generation. Eviction then takes the pages of the oldest generation
+ * through shrink_page_list() like the inactive list would.
  */
-static void shrink_node_memcg(struct pglist_data *pgdat, struct mem_cgroup *memcg,
-			      struct scan_control *sc, unsigned long *lru_pages)
-{
-	struct lruvec *lruvec = mem_cgroup_lruvec(pgdat, memcg);
-	unsigned long nr[NR_LRU_LISTS];
-	unsigned long targets[NR_LRU_LISTS];
-	unsigned long nr_to_scan;
-	enum lru_list lru;
-	unsigned long nr_reclaimed = 0;
-	unsigned long nr_to_reclaim = sc->nr_to_reclaim;
-	struct blk_plug plug;
-	bool scan_adjusted;
 
-	get_scan_count(lruvec, memcg, sc, nr, lru_pages);
+static bool lru_gen_state __read_mostly = IS_ENABLED(CONFIG_LRU_GEN_ENABLED);
+static DEFINE_MUTEX(lru_gen_state_mutex);
 
-	/* Record the original scan target for proportional adjustments later */
-	memcpy(targets, nr, sizeof(nr));
+/* All the mms that the aging may walk */
+static LIST_HEAD(lru_gen_mm_list);
+static DEFINE_SPINLOCK(lru_gen_mm_lock);
 
-	/*
-	 * Global reclaiming within direct reclaim at DEF_PRIORITY is a normal
-	 * event that can occur when there is little memory pressure e.g.
-	 * multiple streaming readers/writers. Hence, we do not abort scanning
-	 * when the requested number of pages are reclaimed when scanning at
-	 * DEF_PRIORITY on the assumption that the fact we are direct
-	 * reclaiming implies that kswapd is not keeping up and it is best to
-	 * do a batch of work at once. For memcg reclaim one check is made to
-	 * abort proportional reclaim if either the file or anon lru has already
-	 * dropped to zero at the first pass.
-	 */
-	scan_adjusted = (global_reclaim(sc) && !current_is_kswapd() &&
-			 sc->priority == DEF_PRIORITY);
+/* Pages moved between the classic and multi-gen lists per lru_lock hold */
+#define LRU_GEN_SWITCH_BATCH	1024
 
-	blk_start_plug(&plug);
-	while (nr[LRU_INACTIVE_ANON] || nr[LRU_ACTIVE_FILE] ||
-					nr[LRU_INACTIVE_FILE]) {
-		unsigned long nr_anon, nr_file, percentage;
-		unsigned long nr_scanned;
+struct lru_gen_walk {
+	struct lruvec *lruvec;
+	struct pglist_data *pgdat;
+	struct mem_cgroup *memcg;
+	struct pagevec pvec;
+};
 
-		for_each_evictable_lru(lru) {
-			if (nr[lru]) {
-				nr_to_scan = min(nr[lru], SWAP_CLUSTER_MAX);
-				nr[lru] -= nr_to_scan;
+void lru_gen_init_lruvec(struct lruvec *lruvec)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int gen, type, zone;
 
-				nr_reclaimed += shrink_list(lru, nr_to_scan,
-							    lruvec, memcg, sc);
-			}
-		}
+	lrugen->max_seq = MIN_NR_GENS - 1;
+	lrugen->enabled = READ_ONCE(lru_gen_state);
 
-		cond_resched();
+	for (gen = 0; gen < MAX_NR_GENS; gen++) {
+		lrugen->timestamps[gen] = jiffies;
+		for (type = 0; type < ANON_AND_FILE; type++)
+			for (zone = 0; zone < MAX_NR_ZONES; zone++)
+				INIT_LIST_HEAD(&lrugen->lists[gen][type][zone]);
+	}
+}
 
-		if (nr_reclaimed < nr_to_reclaim || scan_adjusted)
+void lru_gen_add_mm(struct mm_struct *mm)
+{
+	spin_lock(&lru_gen_mm_lock);
+	list_add_tail(&mm->lru_gen_list, &lru_gen_mm_list);
+	spin_unlock(&lru_gen_mm_lock);
+}
+
+void lru_gen_del_mm(struct mm_struct *mm)
+{
+	spin_lock(&lru_gen_mm_lock);
+	list_del(&mm->lru_gen_list);
+	spin_unlock(&lru_gen_mm_lock);
+}
+
+static bool lruvec_lru_gen(struct lruvec *lruvec)
+{
+	return READ_ONCE(lruvec->lrugen.enabled);
+}
+
+static unsigned long lru_gen_nr_gens(struct lruvec *lruvec, int type)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+
+	return lrugen->max_seq - lrugen->min_seq[type] + 1;
+}
+
+static long lru_gen_nr_pages(struct lruvec *lruvec, int type)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	long nr_pages = 0;
+	int gen, zone;
+
+	for (gen = 0; gen < MAX_NR_GENS; gen++)
+		for (zone = 0; zone < MAX_NR_ZONES; zone++)
+			nr_pages += lrugen->nr_pages[gen][type][zone];
+
+	return nr_pages;
+}
+
+/* Drops the oldest generations of @type that have no pages left */
+static void lru_gen_try_inc_min_seq(struct lruvec *lruvec, int type)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+
+	while (lru_gen_nr_gens(lruvec, type) > MIN_NR_GENS) {
+		int gen = lru_gen_from_seq(lrugen->min_seq[type]);
+		int zone;
+
+		for (zone = 0; zone < MAX_NR_ZONES; zone++)
+			if (!list_empty(&lrugen->lists[gen][type][zone]))
+				return;
+		lrugen->min_seq[type]++;
+	}
+}
+
+/* Opens a new youngest generation, called with the lru_lock held */
+static void lru_gen_inc_max_seq(struct lruvec *lruvec)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int type, zone, prev, next;
+
+	/*
+	 * A type still using all the generations, typically anon pages
+	 * without swap, has its oldest generation folded into the new
+	 * youngest one: the pages stay on their lists and count as recently
+	 * used again, since they could not be evicted anyway.
+	 */
+	for (type = 0; type < ANON_AND_FILE; type++) {
+		lru_gen_try_inc_min_seq(lruvec, type);
+		if (lru_gen_nr_gens(lruvec, type) == MAX_NR_GENS)
+			lrugen->min_seq[type]++;
+	}
+
+	/* max_seq - 1 stops being active, the reused slot becomes active */
+	prev = lru_gen_from_seq(lrugen->max_seq - 1);
+	next = lru_gen_from_seq(lrugen->max_seq + 1);
+	for (type = 0; type < ANON_AND_FILE; type++) {
+		for (zone = 0; zone < MAX_NR_ZONES; zone++) {
+			enum lru_list lru = type * LRU_FILE;
+			long delta = lrugen->nr_pages[prev][type][zone] -
+				     lrugen->nr_pages[next][type][zone];
+
+			if (!delta)
+				continue;
+			update_lru_size(lruvec, lru, zone, delta);
+			update_lru_size(lruvec, lru + LRU_ACTIVE, zone, -delta);
+		}
+	}
+
+	lrugen->max_seq++;
+	lrugen->timestamps[next] = jiffies;
+}
+
+/* Moves the pages the walk found accessed into the youngest generation */
+static void lru_gen_promote(struct lru_gen_walk *lw)
+{
+	struct lruvec *lruvec = lw->lruvec;
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int i, nr_promoted = 0;
+
+	spin_lock_irq(&lw->pgdat->lru_lock);
+	for (i = 0; i < pagevec_count(&lw->pvec); i++) {
+		struct page *page = lw->pvec.pages[i];
+		int new_gen = lru_gen_from_seq(lrugen->max_seq);
+		int old_gen = page_lru_gen(page);
+
+		/* Isolated, moved to another memcg or already young */
+		if (!PageLRU(page) || old_gen < 0 || old_gen == new_gen ||
+		    mem_cgroup_page_lruvec(page, lw->pgdat) != lruvec)
+			continue;
+
+		lru_gen_set_page_gen(lruvec, page, new_gen);
+		lru_gen_update_size(lruvec, page, old_gen, new_gen);
+		list_move(&page->lru, &lrugen->lists[new_gen]
+			  [page_is_file_cache(page)][page_zonenum(page)]);
+		nr_promoted += hpage_nr_pages(page);
+	}
+	__count_vm_events(PGACTIVATE, nr_promoted);
+	spin_unlock_irq(&lw->pgdat->lru_lock);
+
+	release_pages(lw->pvec.pages, pagevec_count(&lw->pvec), false);
+	pagevec_reinit(&lw->pvec);
+}
+
+/* Only harvest the accessed bits of the pages of the lruvec being aged */
+static void lru_gen_walk_page(struct lru_gen_walk *lw, struct page *page)
+{
+	if (!PageLRU(page) || page_pgdat(page) != lw->pgdat ||
+	    mem_cgroup_page_lruvec(page, lw->pgdat) != lw->lruvec)
+		return;
+
+	if (!get_page_unless_zero(page))
+		return;
+	if (!pagevec_add(&lw->pvec, page))
+		lru_gen_promote(lw);
+}
+
+static int lru_gen_walk_pmd(pmd_t *pmd, unsigned long addr,
+			    unsigned long end, struct mm_walk *walk)
+{
+	struct lru_gen_walk *lw = walk->private;
+	struct vm_area_struct *vma = walk->vma;
+	pte_t *pte, *orig_pte;
+	spinlock_t *ptl;
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	ptl = pmd_trans_huge_lock(pmd, vma);
+	if (ptl) {
+		if (pmd_present(*pmd) && pmd_young(*pmd) &&
+		    !is_huge_zero_pmd(*pmd)) {
+			struct page *page = pmd_page(*pmd);
+
+			if (PageLRU(page) && page_pgdat(page) == lw->pgdat &&
+			    mem_cgroup_page_lruvec(page, lw->pgdat) ==
+			    lw->lruvec &&
+			    pmdp_test_and_clear_young(vma, addr, pmd))
+				lru_gen_walk_page(lw, page);
+		}
+		spin_unlock(ptl);
+		return 0;
+	}
+#endif
+	if (pmd_trans_unstable(pmd))
+		return 0;
+
+	orig_pte = pte = pte_offset_map_lock(walk->mm, pmd, addr, &ptl);
+	for (; addr != end; pte++, addr += PAGE_SIZE) {
+		struct page *page;
+
+		if (!pte_present(*pte) || !pte_young(*pte))
+			continue;
+
+		page = vm_normal_page(vma, addr, *pte);
+		if (!page)
+			continue;
+		page = compound_head(page);
+
+		if (!PageLRU(page) || page_pgdat(page) != lw->pgdat ||
+		    mem_cgroup_page_lruvec(page, lw->pgdat) != lw->lruvec)
+			continue;
+
+		if (ptep_test_and_clear_young(vma, addr, pte))
+			lru_gen_walk_page(lw, page);
+	}
+	pte_unmap_unlock(orig_pte, ptl);
+	cond_resched();
+
+	return 0;
+}
+
+static int lru_gen_test_walk(unsigned long start, unsigned long end,
+			     struct mm_walk *walk)
+{
+	/* What page_referenced() skips, or reclaim cannot take anyway */
+	if (walk->vma->vm_flags &
+	    (VM_LOCKED | VM_IO | VM_PFNMAP | VM_SEQ_READ))
+		return 1;
+
+	return 0;
+}
+
+static void lru_gen_walk_mm(struct lru_gen_walk *lw, struct mm_struct *mm)
+{
+	struct mm_walk walk = {
+		.pmd_entry	= lru_gen_walk_pmd,
+		.test_walk	= lru_gen_test_walk,
+		.mm		= mm,
+		.private	= lw,
+	};
+
+	/* Reclaim may be entered with an mmap_sem held: never wait for one */
+	if (!down_read_trylock(&mm->mmap_sem))
+		return;
+	if (mm->highest_vm_end)
+		walk_page_range(0, mm->highest_vm_end, &walk);
+	up_read(&mm->mmap_sem);
+}
+
+static bool lru_gen_mm_in_memcg(struct mm_struct *mm, struct mem_cgroup *memcg)
+{
+#ifdef CONFIG_MEMCG
+	struct task_struct *owner;
+	bool match = false;
+
+	if (!memcg || mem_cgroup_disabled())
+		return true;
+
+	rcu_read_lock();
+	owner = rcu_dereference(mm->owner);
+	if (owner)
+		match = mem_cgroup_from_task(owner) == memcg;
+	rcu_read_unlock();
+
+	return match;
+#else
+	return true;
+#endif
+}
+
+/*
+ * Walks the mms charged to the memcg of @lruvec, then opens a new youngest
+ * generation. Returns false if another task was already doing it.
+ */
+static bool lru_gen_age(struct lruvec *lruvec, struct mem_cgroup *memcg)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	struct lru_gen_walk lw = {
+		.lruvec	= lruvec,
+		.pgdat	= lruvec_pgdat(lruvec),
+		.memcg	= memcg,
+	};
+	struct mm_struct *mm, *prev = NULL;
+
+	spin_lock_irq(&lw.pgdat->lru_lock);
+	if (lrugen->aging) {
+		spin_unlock_irq(&lw.pgdat->lru_lock);
+		return false;
+	}
+	lrugen->aging = true;
+	spin_unlock_irq(&lw.pgdat->lru_lock);
+
+	pagevec_init(&lw.pvec, 0);
+
+	/* The reference held on an mm keeps it on the list while walking it */
+	spin_lock(&lru_gen_mm_lock);
+	list_for_each_entry(mm, &lru_gen_mm_list, lru_gen_list) {
+		if (!lru_gen_mm_in_memcg(mm, memcg) || !mmget_not_zero(mm))
+			continue;
+		spin_unlock(&lru_gen_mm_lock);
+
+		if (prev)
+			mmput_async(prev);
+		prev = mm;
+		lru_gen_walk_mm(&lw, mm);
+
+		spin_lock(&lru_gen_mm_lock);
+	}
+	spin_unlock(&lru_gen_mm_lock);
+	if (prev)
+		mmput_async(prev);
+
+	if (pagevec_count(&lw.pvec))
+		lru_gen_promote(&lw);
+
+	spin_lock_irq(&lw.pgdat->lru_lock);
+	if (lrugen->enabled)
+		lru_gen_inc_max_seq(lruvec);
+	lrugen->aging = false;
+	spin_unlock_irq(&lw.pgdat->lru_lock);
+
+	return true;
+}
+
+static unsigned long lru_gen_isolate(struct lruvec *lruvec,
+				     struct scan_control *sc, int type,
+				     unsigned long nr_to_scan,
+				     struct list_head *page_list,
+				     unsigned long *nr_scanned)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int gen = lru_gen_from_seq(lrugen->min_seq[type]);
+	int next = lru_gen_from_seq(lrugen->min_seq[type] + 1);
+	isolate_mode_t mode = sc->may_unmap ? 0 : ISOLATE_UNMAPPED;
+	unsigned long nr_taken = 0, scan = 0;
+	int zone;
+
+	for (zone = MAX_NR_ZONES - 1; zone >= 0 && scan < nr_to_scan;
+	     zone--) {
+		struct list_head *head = &lrugen->lists[gen][type][zone];
+		struct list_head *younger = &lrugen->lists[next][type][zone];
+
+		while (!list_empty(head) && scan < nr_to_scan) {
+			struct page *page = lru_to_page(head);
+			int nr_pages = hpage_nr_pages(page);
+
+			VM_BUG_ON_PAGE(!PageLRU(page), page);
+			scan += nr_pages;
+
+			/* Pages of zones the caller cannot use keep aging */
+			if (zone > sc->reclaim_idx) {
+				lru_gen_set_page_gen(lruvec, page, next);
+				lru_gen_update_size(lruvec, page, gen, next);
+				list_move_tail(&page->lru, younger);
+				continue;
+			}
+
+			switch (__isolate_lru_page(page, mode)) {
+			case 0:
+				lru_gen_del_page(lruvec, page);
+				list_add(&page->lru, page_list);
+				nr_taken += nr_pages;
+				break;
+
+			case -EBUSY:
+				/* else it is being freed elsewhere */
+				list_move(&page->lru, head);
+				break;
+
+			default:
+				BUG();
+			}
+		}
+	}
+
+	*nr_scanned = scan;
+	return nr_taken;
+}
+
+/* Reclaims from the oldest generation of @type */
+static unsigned long lru_gen_evict(struct lruvec *lruvec,
+				   struct scan_control *sc, int type,
+				   unsigned long nr_to_scan,
+				   unsigned long *nr_scanned)
+{
+	struct zone_reclaim_stat *reclaim_stat = &lruvec->reclaim_stat;
+	struct pglist_data *pgdat = lruvec_pgdat(lruvec);
+	struct mem_cgroup *memcg = lruvec_memcg(lruvec);
+	struct reclaim_stat stat = {};
+	unsigned long nr_taken = 0;
+	unsigned long nr_reclaimed;
+	LIST_HEAD(page_list);
+
+	*nr_scanned = 0;
+	lru_add_drain();
+
+	spin_lock_irq(&pgdat->lru_lock);
+	/* The two youngest generations are the active ones: never evict them */
+	if (lruvec->lrugen.enabled &&
+	    lru_gen_nr_gens(lruvec, type) > MIN_NR_GENS)
+		nr_taken = lru_gen_isolate(lruvec, sc, type, nr_to_scan,
+					   &page_list, nr_scanned);
+	lru_gen_try_inc_min_seq(lruvec, type);
+
+	__mod_node_page_state(pgdat, NR_ISOLATED_ANON + type, nr_taken);
+	reclaim_stat->recent_scanned[type] += nr_taken;
+	if (current_is_kswapd()) {
+		if (global_reclaim(sc))
+			__count_vm_events(PGSCAN_KSWAPD, *nr_scanned);
+		count_memcg_events(memcg, PGSCAN_KSWAPD, *nr_scanned);
+	} else {
+		if (global_reclaim(sc))
+			__count_vm_events(PGSCAN_DIRECT, *nr_scanned);
+		count_memcg_events(memcg, PGSCAN_DIRECT, *nr_scanned);
+	}
+	spin_unlock_irq(&pgdat->lru_lock);
+
+	if (!nr_taken)
+		return 0;
+
+	nr_reclaimed = shrink_page_list(&page_list, pgdat, sc, 0, &stat, false);
+
+	spin_lock_irq(&pgdat->lru_lock);
+	if (current_is_kswapd()) {
+		if (global_reclaim(sc))
+			__count_vm_events(PGSTEAL_KSWAPD, nr_reclaimed);
+		count_memcg_events(memcg, PGSTEAL_KSWAPD, nr_reclaimed);
+	} else {
+		if (global_reclaim(sc))
+			__count_vm_events(PGSTEAL_DIRECT, nr_reclaimed);
+		count_memcg_events(memcg, PGSTEAL_DIRECT, nr_reclaimed);
+	}
+
+	/* Referenced pages come back active: into the youngest generation */
+	putback_inactive_pages(lruvec, &page_list);
+	__mod_node_page_state(pgdat, NR_ISOLATED_ANON + type, -nr_taken);
+	spin_unlock_irq(&pgdat->lru_lock);
+
+	mem_cgroup_uncharge_list(&page_list);
+	free_hot_cold_page_list(&page_list, true);
+
+	return nr_reclaimed;
+}
+
+/*
+ * Moves up to LRU_GEN_SWITCH_BATCH pages from the classic lists onto the
+ * generations (@enable) or back, oldest pages first. Returns true if there
+ * are more to move.
+ */
+static bool lru_gen_switch_batch(struct lruvec *lruvec, bool enable)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int remaining = LRU_GEN_SWITCH_BATCH;
+	enum lru_list lru;
+	int type, zone;
+
+	if (enable) {
+		for_each_evictable_lru(lru) {
+			struct list_head *head = &lruvec->lists[lru];
+
+			while (!list_empty(head)) {
+				struct page *page = lru_to_page(head);
+
+				del_page_from_lru_list(page, lruvec, lru);
+				add_page_to_lru_list(page, lruvec, lru);
+				if (!--remaining)
+					return true;
+			}
+		}
+		return false;
+	}
+
+	for (type = 0; type < ANON_AND_FILE; type++) {
+		unsigned long seq;
+
+		for (seq = lrugen->min_seq[type]; seq <= lrugen->max_seq;
+		     seq++) {
+			int gen = lru_gen_from_seq(seq);
+
+			for (zone = 0; zone < MAX_NR_ZONES; zone++) {
+				struct list_head *head =
+					&lrugen->lists[gen][type][zone];
+
+				while (!list_empty(head)) {
+					struct page *page = lru_to_page(head);
+
+					del_page_from_lru_list(page, lruvec,
+							       page_lru(page));
+					add_page_to_lru_list(page, lruvec,
+							     page_lru(page));
+					if (!--remaining)
+						return true;
+				}
+			}
+		}
+	}
+	return false;
+}
+
+static void lru_gen_switch_lruvec(struct lruvec *lruvec, bool enable)
+{
+	struct pglist_data *pgdat = lruvec_pgdat(lruvec);
+
+	spin_lock_irq(&pgdat->lru_lock);
+	WRITE_ONCE(lruvec->lrugen.enabled, enable);
+	while (lru_gen_switch_batch(lruvec, enable)) {
+		spin_unlock_irq(&pgdat->lru_lock);
+		cond_resched();
+		spin_lock_irq(&pgdat->lru_lock);
+	}
+	spin_unlock_irq(&pgdat->lru_lock);
+}
+
+static void lru_gen_change_state(bool enable)
+{
+	struct mem_cgroup *memcg;
+
+	mutex_lock(&lru_gen_state_mutex);
+	if (enable == lru_gen_state)
+		goto unlock;
+
+	WRITE_ONCE(lru_gen_state, enable);
+	memcg = mem_cgroup_iter(NULL, NULL, NULL);
+	do {
+		struct pglist_data *pgdat;
+
+		for_each_online_pgdat(pgdat) {
+			lru_gen_switch_lruvec(mem_cgroup_lruvec(pgdat, memcg),
+					      enable);
+			cond_resched();
+		}
+	} while ((memcg = mem_cgroup_iter(NULL, memcg, NULL)));
+unlock:
+	mutex_unlock(&lru_gen_state_mutex);
+}
+
+static bool lru_gen_can_swap(struct lruvec *lruvec, struct mem_cgroup *memcg,
+			     struct scan_control *sc)
+{
+	/* Same rules as get_scan_count() */
+	if (!sc->may_swap ||
+	    !can_reclaim_anon_pages(memcg, lruvec_pgdat(lruvec)->node_id, sc))
+		return false;
+	if (!global_reclaim(sc) && !sc_swappiness(sc, memcg))
+		return false;
+
+	return true;
+}
+
+/*
+ * Evicts the type with the older oldest generation, file pages on a tie
+ * or when swappiness is zero, and falls back to the other type when the
+ * first has nothing to give.
+ */
+static void lru_gen_shrink_lruvec(struct lruvec *lruvec,
+				  struct mem_cgroup *memcg,
+				  struct scan_control *sc,
+				  unsigned long *lru_pages)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	bool can_swap = lru_gen_can_swap(lruvec, memcg, sc);
+	int swappiness = sc_swappiness(sc, memcg);
+	unsigned long nr_reclaimed = 0;
+	unsigned long nr_to_scan;
+	struct blk_plug plug;
+	enum lru_list lru;
+
+	/* Pages shrink_active_list() put back while the lruvec switched */
+	if (unlikely(!list_empty(&lruvec->lists[LRU_INACTIVE_ANON]) ||
+		     !list_empty(&lruvec->lists[LRU_ACTIVE_ANON]) ||
+		     !list_empty(&lruvec->lists[LRU_INACTIVE_FILE]) ||
+		     !list_empty(&lruvec->lists[LRU_ACTIVE_FILE])))
+		lru_gen_switch_lruvec(lruvec, true);
+
+	*lru_pages = 0;
+	for_each_evictable_lru(lru)
+		*lru_pages += lruvec_lru_size(lruvec, lru, sc->reclaim_idx);
+	nr_to_scan = *lru_pages >> sc->priority;
+
+	blk_start_plug(&plug);
+	while (nr_to_scan) {
+		unsigned long batch = min(nr_to_scan, SWAP_CLUSTER_MAX);
+		unsigned long scanned = 0;
+		int type = LRU_GEN_FILE;
+		int tries;
+
+		if (can_swap && (sc->anon_only || (swappiness &&
+		    READ_ONCE(lrugen->min_seq[LRU_GEN_ANON]) <
+		    READ_ONCE(lrugen->min_seq[LRU_GEN_FILE]))))
+			type = LRU_GEN_ANON;
+
+		for (tries = 0; tries < ANON_AND_FILE; tries++) {
+			if (lru_gen_nr_pages(lruvec, type) > 0) {
+				if (lru_gen_nr_gens(lruvec, type) <=
+				    MIN_NR_GENS && !lru_gen_age(lruvec, memcg))
+					goto out;
+				nr_reclaimed += lru_gen_evict(lruvec, sc, type,
+							      batch, &scanned);
+			}
+			if (scanned || !can_swap || sc->anon_only)
+				break;
+			type = !type;
+		}
+		if (!scanned)
+			break;
+
+		nr_to_scan -= min(nr_to_scan, scanned);
+		if (nr_reclaimed >= sc->nr_to_reclaim)
+			break;
+		cond_resched();
+	}
+out:
+	blk_finish_plug(&plug);
+
+	sc->nr_reclaimed += nr_reclaimed;
+}
+
+static ssize_t lru_gen_enabled_show(struct kobject *kobj,
+				    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", READ_ONCE(lru_gen_state));
+}
+
+static ssize_t lru_gen_enabled_store(struct kobject *kobj,
+				     struct kobj_attribute *attr,
+				     const char *buf, size_t len)
+{
+	bool enable;
+
+	if (kstrtobool(buf, &enable))
+		return -EINVAL;
+
+	lru_gen_change_state(enable);
+	return len;
+}
+
+static struct kobj_attribute lru_gen_enabled_attr =
+	__ATTR(enabled, 0644, lru_gen_enabled_show, lru_gen_enabled_store);
+
+static struct attribute *lru_gen_attrs[] = {
+	&lru_gen_enabled_attr.attr,
+	NULL
+};
+
+static const struct attribute_group lru_gen_attr_group = {
+	.name	= "lru_gen",
+	.attrs	= lru_gen_attrs,
+};
+
+#ifdef CONFIG_DEBUG_FS
+/*
+ * One line per generation of each lruvec: its sequence number, its age in
+ * milliseconds and the anon and file pages in it.
+ */
+static void lru_gen_show_lruvec(struct seq_file *m, struct lruvec *lruvec)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	struct pglist_data *pgdat = lruvec_pgdat(lruvec);
+	unsigned long seq, min_seq;
+
+	spin_lock_irq(&pgdat->lru_lock);
+	seq_printf(m, " node %5d%s\n", pgdat->node_id,
+		   lrugen->enabled ? "" : " disabled");
+	min_seq = min(lrugen->min_seq[LRU_GEN_ANON],
+		      lrugen->min_seq[LRU_GEN_FILE]);
+	for (seq = min_seq; seq <= lrugen->max_seq; seq++) {
+		int gen = lru_gen_from_seq(seq);
+		long nr[ANON_AND_FILE] = {};
+		int type, zone;
+
+		for (type = 0; type < ANON_AND_FILE; type++) {
+			if (seq < lrugen->min_seq[type])
+				continue;
+			for (zone = 0; zone < MAX_NR_ZONES; zone++)
+				nr[type] += lrugen->nr_pages[gen][type][zone];
+		}
+		seq_printf(m, " %10lu %10u %10ld %10ld\n", seq,
+			   jiffies_to_msecs(jiffies - lrugen->timestamps[gen]),
+			   nr[LRU_GEN_ANON], nr[LRU_GEN_FILE]);
+	}
+	spin_unlock_irq(&pgdat->lru_lock);
+}
+
+static int lru_gen_seq_show(struct seq_file *m, void *v)
+{
+	struct mem_cgroup *memcg;
+
+	memcg = mem_cgroup_iter(NULL, NULL, NULL);
+	do {
+		struct pglist_data *pgdat;
+
+		seq_printf(m, "memcg %5hu\n", mem_cgroup_id(memcg));
+		for_each_online_pgdat(pgdat)
+			lru_gen_show_lruvec(m, mem_cgroup_lruvec(pgdat, memcg));
+	} while ((memcg = mem_cgroup_iter(NULL, memcg, NULL)));
+
+	return 0;
+}
+
+static int lru_gen_seq_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, lru_gen_seq_show, NULL);
+}
+
+static const struct file_operations lru_gen_fops = {
+	.open		= lru_gen_seq_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+#endif
+
+static int __init lru_gen_init(void)
+{
+	BUILD_BUG_ON(MAX_NR_GENS + 1 > BIT(LRU_GEN_WIDTH));
+	BUILD_BUG_ON(MIN_NR_GENS + 1 > MAX_NR_GENS);
+
+	if (sysfs_create_group(mm_kobj, &lru_gen_attr_group))
+		pr_err("lru_gen: failed to create sysfs group\n");
+#ifdef CONFIG_DEBUG_FS
+	debugfs_create_file("lru_gen", 0444, NULL, NULL, &lru_gen_fops);
+#endif
+	return 0;
+}
+late_initcall(lru_gen_init);
+
+#else /* !CONFIG_LRU_GEN */
+
+static bool lruvec_lru_gen(struct lruvec *lruvec)
+{
+	return false;
+}
+
+static void lru_gen_shrink_lruvec(struct lruvec *lruvec,
+				  struct mem_cgroup *memcg,
+				  struct scan_control *sc,
+				  unsigned long *lru_pages)
+{
+}
+
+#endif /* CONFIG_LRU_GEN */
+
+/*
+ * This is a basic per-node page freer.  Used by both kswapd and direct reclaim.
+ */
+static void shrink_node_memcg(struct pglist_data *pgdat, struct mem_cgroup *memcg,
+			      struct scan_control *sc, unsigned long *lru_pages)
+{
+	struct lruvec *lruvec = mem_cgroup_lruvec(pgdat, memcg);
+	unsigned long nr[NR_LRU_LISTS];
+	unsigned long targets[NR_LRU_LISTS];
+	unsigned long nr_to_scan;
+	enum lru_list lru;
+	unsigned long nr_reclaimed = 0;
+	unsigned long nr_to_reclaim = sc->nr_to_reclaim;
+	struct blk_plug plug;
+	bool scan_adjusted;
+
+	if (lruvec_lru_gen(lruvec)) {
+		lru_gen_shrink_lruvec(lruvec, memcg, sc, lru_pages);
+		return;
+	}
+
+	get_scan_count(lruvec, memcg, sc, nr, lru_pages);
+
+	/* Record the original scan target for proportional adjustments later */
+	memcpy(targets, nr, sizeof(nr));
+
+	/*
+	 * Global reclaiming within direct reclaim at DEF_PRIORITY is a normal
+	 * event that can occur when there is little memory pressure e.g.
+	 * multiple streaming readers/writers. Hence, we do not abort scanning
+	 * when the requested number of pages are reclaimed when scanning at
+	 * DEF_PRIORITY on the assumption that the fact we are direct
+	 * reclaiming implies that kswapd is not keeping up and it is best to
+	 * do a batch of work at once. For memcg reclaim one check is made to
+	 * abort proportional reclaim if either the file or anon lru has already
+	 * dropped to zero at the first pass.
+	 */
+	scan_adjusted = (global_reclaim(sc) && !current_is_kswapd() &&
+			 sc->priority == DEF_PRIORITY);
+
+	blk_start_plug(&plug);
+	while (nr[LRU_INACTIVE_ANON] || nr[LRU_ACTIVE_FILE] ||
+					nr[LRU_INACTIVE_FILE]) {
+		unsigned long nr_anon, nr_file, percentage;
+		unsigned long nr_scanned;
+
+		for_each_evictable_lru(lru) {
+			if (nr[lru]) {
+				nr_to_scan = min(nr[lru], SWAP_CLUSTER_MAX);
+				nr[lru] -= nr_to_scan;
+
+				nr_reclaimed += shrink_list(lru, nr_to_scan,
+							    lruvec, memcg, sc);
+			}
+		}
+
+		cond_resched();
+
+		if (nr_reclaimed < nr_to_reclaim || scan_adjusted)
 			continue;
 
 		/*
@@ -2554,7 +3745,7 @@ static inline bool should_continue_reclaim(struct pglist_data *pgdat,
 	 */
 	pages_for_compaction = compact_gap(sc->order);
 	inactive_lru_pages = node_page_state(pgdat, NR_INACTIVE_FILE);
-	if (get_nr_swap_pages() > 0)
+	if (can_reclaim_anon_pages(NULL, pgdat->node_id, sc))
 		inactive_lru_pages += node_page_state(pgdat, NR_INACTIVE_ANON);
 	if (sc->nr_reclaimed < pages_for_compaction &&
 			inactive_lru_pages > pages_for_compaction)
@@ -3110,13 +4301,17 @@ unsigned long mem_cgroup_shrink_node(struct mem_cgroup *memcg,
 	return sc.nr_reclaimed;
 }
 
-unsigned long try_to_free_mem_cgroup_pages(struct mem_cgroup *memcg,
-					   unsigned long nr_pages,
-					   gfp_t gfp_mask,
-					   bool may_swap)
+static unsigned long __try_to_free_mem_cgroup_pages(struct mem_cgroup *memcg,
+						    unsigned long nr_pages,
+						    gfp_t gfp_mask,
+						    bool may_swap,
+						    bool anon_only,
+						    int *swappiness,
+						    bool clean_only)
 {
 	struct zonelist *zonelist;
 	unsigned long nr_reclaimed;
+	unsigned long pflags;
 	int nid;
 	unsigned int noreclaim_flag;
 	struct scan_control sc = {
@@ -3126,9 +4321,11 @@ unsigned long try_to_free_mem_cgroup_pages(struct mem_cgroup *memcg,
 		.reclaim_idx = MAX_NR_ZONES - 1,
 		.target_mem_cgroup = memcg,
 		.priority = DEF_PRIORITY,
-		.may_writepage = !laptop_mode,
-		.may_unmap = 1,
+		.may_writepage = !laptop_mode && !clean_only,
+		.may_unmap = !clean_only,
 		.may_swap = may_swap,
+		.anon_only = anon_only,
+		.swappiness = swappiness,
 	};
 
 	/*
@@ -3145,14 +4342,51 @@ unsigned long try_to_free_mem_cgroup_pages(struct mem_cgroup *memcg,
 					    sc.gfp_mask,
 					    sc.reclaim_idx);
 
+	psi_memstall_enter(&pflags);
 	noreclaim_flag = memalloc_noreclaim_save();
 	nr_reclaimed = do_try_to_free_pages(zonelist, &sc);
 	memalloc_noreclaim_restore(noreclaim_flag);
+	psi_memstall_leave(&pflags);
 
 	trace_mm_vmscan_memcg_reclaim_end(nr_reclaimed);
 
 	return nr_reclaimed;
 }
+
+unsigned long try_to_free_mem_cgroup_pages(struct mem_cgroup *memcg,
+					   unsigned long nr_pages,
+					   gfp_t gfp_mask,
+					   bool may_swap)
+{
+	return __try_to_free_mem_cgroup_pages(memcg, nr_pages, gfp_mask,
+					      may_swap, false, NULL, false);
+}
+
+/*
+ * Reclaims from @memcg on behalf of userspace, see memory.reclaim: the type
+ * of pages and the swappiness may be forced, @swappiness being NULL for the
+ * own swappiness of the memcgs.
+ */
+unsigned long proactive_reclaim_mem_cgroup_pages(struct mem_cgroup *memcg,
+						 unsigned long nr_pages,
+						 bool may_swap, bool anon_only,
+						 int *swappiness)
+{
+	return __try_to_free_mem_cgroup_pages(memcg, nr_pages, GFP_KERNEL,
+					      may_swap, anon_only, swappiness,
+					      false);
+}
+
+/*
+ * Reclaims the clean and unmapped page cache of @memcg, without writeback,
+ * see memory.drop_caches.
+ */
+unsigned long drop_pagecache_mem_cgroup_pages(struct mem_cgroup *memcg,
+					      unsigned long nr_pages)
+{
+	return __try_to_free_mem_cgroup_pages(memcg, nr_pages, GFP_KERNEL,
+					      false, false, NULL, true);
+}
 #endif
 
 static void age_active_anon(struct pglist_data *pgdat,
@@ -3160,14 +4394,16 @@ static void age_active_anon(struct pglist_data *pgdat,
 {
 	struct mem_cgroup *memcg;
 
-	if (!total_swap_pages)
+	if (!total_swap_pages && !can_demote(pgdat->node_id, sc))
 		return;
 
 	memcg = mem_cgroup_iter(NULL, NULL, NULL);
 	do {
 		struct lruvec *lruvec = mem_cgroup_lruvec(pgdat, memcg);
 
-		if (inactive_list_is_low(lruvec, false, memcg, sc, true))
+		/* The aging of the multi-gen LRU does this job */
+		if (!lruvec_lru_gen(lruvec) &&
+		    inactive_list_is_low(lruvec, false, memcg, sc, true))
 			shrink_active_list(SWAP_CLUSTER_MAX, lruvec,
 					   sc, LRU_ACTIVE_ANON);
 
@@ -3307,7 +4543,25 @@ static bool kswapd_shrink_node(pg_data_t *pgdat,
  * or lower is eligible for reclaim until at least one usable zone is
  * balanced.
  */
-static int balance_pgdat(pg_data_t *pgdat, int order, int classzone_idx)
+/*
+ * Hands the request the first kswapd thread is balancing the node for to
+ * the other threads of the node, and wakes them to work on it too. They
+ * share the memcg iterator of each priority with it, so that each of them
+ * reclaims from different memcgs.
+ */
+static void kswapd_wake_helpers(pg_data_t *pgdat, int order,
+				int classzone_idx)
+{
+	pgdat->kswapd_run_order = order;
+	pgdat->kswapd_run_classzone_idx = classzone_idx;
+	/* Pairs with the smp_rmb() in kswapd_helper() */
+	smp_wmb();
+	WRITE_ONCE(pgdat->kswapd_seq, pgdat->kswapd_seq + 1);
+	wake_up_interruptible(&pgdat->kswapd_helper_wait);
+}
+
+static int balance_pgdat(pg_data_t *pgdat, struct kswapd_thread *kt,
+			 int order, int classzone_idx)
 {
 	int i;
 	unsigned long nr_soft_reclaimed;
@@ -3321,7 +4575,13 @@ static int balance_pgdat(pg_data_t *pgdat, int order, int classzone_idx)
 		.may_unmap = 1,
 		.may_swap = 1,
 	};
+	bool primary = !kt->id;
+	unsigned long pflags;
+	int pass = 0;
+
+	psi_memstall_enter(&pflags);
 	count_vm_event(PAGEOUTRUN);
+	kt->nr_wakeups++;
 
 	do {
 		unsigned long nr_reclaimed = sc.nr_reclaimed;
@@ -3358,13 +4618,19 @@ static int balance_pgdat(pg_data_t *pgdat, int order, int classzone_idx)
 		if (pgdat_balanced(pgdat, sc.order, classzone_idx))
 			goto out;
 
+		/* One pass was not enough: get the other threads to help */
+		if (primary && pass++ == 1)
+			kswapd_wake_helpers(pgdat, sc.order, classzone_idx);
+
 		/*
 		 * Do some background aging of the anon list, to give
 		 * pages a chance to be referenced before reclaiming. All
 		 * pages are rotated regardless of classzone as this is
-		 * about consistent aging.
+		 * about consistent aging. The helper threads leave that
+		 * and the soft limit reclaim to the first one.
 		 */
-		age_active_anon(pgdat, &sc);
+		if (primary)
+			age_active_anon(pgdat, &sc);
 
 		/*
 		 * If we're getting trouble reclaiming, start doing writepage
@@ -3375,10 +4641,13 @@ static int balance_pgdat(pg_data_t *pgdat, int order, int classzone_idx)
 
 		/* Call soft limit reclaim before calling shrink_node. */
 		sc.nr_scanned = 0;
-		nr_soft_scanned = 0;
-		nr_soft_reclaimed = mem_cgroup_soft_limit_reclaim(pgdat, sc.order,
-						sc.gfp_mask, &nr_soft_scanned);
-		sc.nr_reclaimed += nr_soft_reclaimed;
+		if (primary) {
+			nr_soft_scanned = 0;
+			nr_soft_reclaimed = mem_cgroup_soft_limit_reclaim(pgdat,
+						sc.order, sc.gfp_mask,
+						&nr_soft_scanned);
+			sc.nr_reclaimed += nr_soft_reclaimed;
+		}
 
 		/*
 		 * There should be no need to raise the scanning priority if
@@ -3387,6 +4656,7 @@ static int balance_pgdat(pg_data_t *pgdat, int order, int classzone_idx)
 		 */
 		if (kswapd_shrink_node(pgdat, &sc))
 			raise_priority = false;
+		kt->nr_scanned += sc.nr_scanned;
 
 		/*
 		 * If the low watermark is met there is no need for processes
@@ -3410,11 +4680,13 @@ static int balance_pgdat(pg_data_t *pgdat, int order, int classzone_idx)
 			sc.priority--;
 	} while (sc.priority >= 1);
 
-	if (!sc.nr_reclaimed)
+	if (!sc.nr_reclaimed && primary)
 		pgdat->kswapd_failures++;
 
 out:
+	kt->nr_reclaimed += sc.nr_reclaimed;
 	snapshot_refaults(NULL, pgdat);
+	psi_memstall_leave(&pflags);
 	/*
 	 * Return the order kswapd stopped reclaiming at as
 	 * prepare_kswapd_sleep() takes it into account. If another caller
@@ -3520,6 +4792,38 @@ static void kswapd_try_to_sleep(pg_data_t *pgdat, int alloc_order, int reclaim_o
 	finish_wait(&pgdat->kswapd_wait, &wait);
 }
 
+/*
+ * The threads of a node after the first only reclaim when it asks them to,
+ * for the request it is working on, and never sleep on kswapd_wait: the
+ * allocator wakes the first one alone.
+ */
+static void kswapd_helper(struct kswapd_thread *kt)
+{
+	pg_data_t *pgdat = kt->pgdat;
+	unsigned long seq = READ_ONCE(pgdat->kswapd_seq);
+
+	for ( ; ; ) {
+		int order, classzone_idx;
+
+		wait_event_freezable(pgdat->kswapd_helper_wait,
+				     READ_ONCE(pgdat->kswapd_seq) != seq ||
+				     kthread_should_stop());
+		if (kthread_should_stop())
+			break;
+		if (READ_ONCE(pgdat->kswapd_seq) == seq)
+			continue;
+
+		seq = READ_ONCE(pgdat->kswapd_seq);
+		smp_rmb();
+		order = pgdat->kswapd_run_order;
+		classzone_idx = pgdat->kswapd_run_classzone_idx;
+
+		fs_reclaim_acquire(GFP_KERNEL);
+		balance_pgdat(pgdat, kt, order, classzone_idx);
+		fs_reclaim_release(GFP_KERNEL);
+	}
+}
+
 /*
  * The background pageout daemon, started as a kernel thread
  * from the init process.
@@ -3537,7 +4841,8 @@ static int kswapd(void *p)
 {
 	unsigned int alloc_order, reclaim_order;
 	unsigned int classzone_idx = MAX_NR_ZONES - 1;
-	pg_data_t *pgdat = (pg_data_t*)p;
+	struct kswapd_thread *kt = p;
+	pg_data_t *pgdat = kt->pgdat;
 	struct task_struct *tsk = current;
 
 	struct reclaim_state reclaim_state = {
@@ -3564,6 +4869,11 @@ static int kswapd(void *p)
 	tsk->flags |= PF_MEMALLOC | PF_SWAPWRITE | PF_KSWAPD;
 	set_freezable();
 
+	if (kt->id) {
+		kswapd_helper(kt);
+		goto out;
+	}
+
 	pgdat->kswapd_order = 0;
 	pgdat->kswapd_classzone_idx = MAX_NR_ZONES;
 	for ( ; ; ) {
@@ -3604,12 +4914,14 @@ static int kswapd(void *p)
 		trace_mm_vmscan_kswapd_wake(pgdat->node_id, classzone_idx,
 						alloc_order);
 		fs_reclaim_acquire(GFP_KERNEL);
-		reclaim_order = balance_pgdat(pgdat, alloc_order, classzone_idx);
+		reclaim_order = balance_pgdat(pgdat, kt, alloc_order,
+					      classzone_idx);
 		fs_reclaim_release(GFP_KERNEL);
 		if (reclaim_order < alloc_order)
 			goto kswapd_try_sleep;
 	}
 
+out:
 	tsk->flags &= ~(PF_MEMALLOC | PF_SWAPWRITE | PF_KSWAPD);
 	current->reclaim_state = NULL;
 
@@ -3702,13 +5014,67 @@ static int kswapd_cpu_online(unsigned int cpu)
 
 		mask = cpumask_of_node(pgdat->node_id);
 
-		if (cpumask_any_and(cpu_online_mask, mask) < nr_cpu_ids)
+		if (cpumask_any_and(cpu_online_mask, mask) < nr_cpu_ids) {
+			int i;
+
 			/* One of our CPUs online: restore mask */
-			set_cpus_allowed_ptr(pgdat->kswapd, mask);
+			for (i = 0; i < MAX_KSWAPD_THREADS; i++) {
+				struct task_struct *tsk = pgdat->kswapd[i].task;
+
+				if (tsk)
+					set_cpus_allowed_ptr(tsk, mask);
+			}
+		}
 	}
 	return 0;
 }
 
+static int kswapd_start_thread(pg_data_t *pgdat, int id)
+{
+	struct kswapd_thread *kt = &pgdat->kswapd[id];
+	struct task_struct *task;
+
+	if (kt->task)
+		return 0;
+
+	kt->pgdat = pgdat;
+	kt->id = id;
+	if (id)
+		task = kthread_run(kswapd, kt, "kswapd%d:%d",
+				   pgdat->node_id, id);
+	else
+		task = kthread_run(kswapd, kt, "kswapd%d", pgdat->node_id);
+	if (IS_ERR(task))
+		return PTR_ERR(task);
+
+	kt->task = task;
+	return 0;
+}
+
+static void kswapd_stop_thread(pg_data_t *pgdat, int id)
+{
+	struct kswapd_thread *kt = &pgdat->kswapd[id];
+
+	if (kt->task) {
+		kthread_stop(kt->task);
+		kt->task = NULL;
+	}
+}
+
+/* The helper threads are not essential: failing to start them is not */
+static void kswapd_start_helpers(pg_data_t *pgdat)
+{
+	int i;
+
+	for (i = 1; i < kswapd_threads; i++) {
+		if (kswapd_start_thread(pgdat, i)) {
+			pr_warn("Failed to start kswapd thread %d on node %d\n",
+				i, pgdat->node_id);
+			break;
+		}
+	}
+}
+
 /*
  * This kswapd start function will be called by init and node-hot-add.
  * On node-hot-add, kswapd will moved to proper cpus if cpus are hot-added.
@@ -3716,20 +5082,17 @@ static int kswapd_cpu_online(unsigned int cpu)
 int kswapd_run(int nid)
 {
 	pg_data_t *pgdat = NODE_DATA(nid);
-	int ret = 0;
-
-	if (pgdat->kswapd)
-		return 0;
+	int ret;
 
-	pgdat->kswapd = kthread_run(kswapd, pgdat, "kswapd%d", nid);
-	if (IS_ERR(pgdat->kswapd)) {
+	ret = kswapd_start_thread(pgdat, 0);
+	if (ret) {
 		/* failure at boot is fatal */
 		BUG_ON(system_state < SYSTEM_RUNNING);
 		pr_err("Failed to start kswapd on node %d\n", nid);
-		ret = PTR_ERR(pgdat->kswapd);
-		pgdat->kswapd = NULL;
+		return ret;
 	}
-	return ret;
+	kswapd_start_helpers(pgdat);
+	return 0;
 }
 
 /*
@@ -3738,12 +5101,37 @@ int kswapd_run(int nid)
  */
 void kswapd_stop(int nid)
 {
-	struct task_struct *kswapd = NODE_DATA(nid)->kswapd;
+	int i;
+
+	for (i = MAX_KSWAPD_THREADS - 1; i >= 0; i--)
+		kswapd_stop_thread(NODE_DATA(nid), i);
+}
+
+static DEFINE_MUTEX(kswapd_threads_mutex);
+
+int kswapd_threads_sysctl_handler(struct ctl_table *table, int write,
+				  void __user *buffer, size_t *length,
+				  loff_t *ppos)
+{
+	int nid, i, ret;
 
-	if (kswapd) {
-		kthread_stop(kswapd);
-		NODE_DATA(nid)->kswapd = NULL;
+	mutex_lock(&kswapd_threads_mutex);
+	ret = proc_dointvec_minmax(table, write, buffer, length, ppos);
+	if (ret || !write)
+		goto unlock;
+
+	mem_hotplug_begin();
+	for_each_node_state(nid, N_MEMORY) {
+		pg_data_t *pgdat = NODE_DATA(nid);
+
+		for (i = MAX_KSWAPD_THREADS - 1; i >= kswapd_threads; i--)
+			kswapd_stop_thread(pgdat, i);
+		kswapd_start_helpers(pgdat);
 	}
+	mem_hotplug_done();
+unlock:
+	mutex_unlock(&kswapd_threads_mutex);
+	return ret;
 }
 
 static int __init kswapd_init(void)
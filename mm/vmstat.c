@@ -959,7 +959,7 @@ static void fill_contig_page_info(struct zone *zone,
 		unsigned long blocks;
 
 		/* Count number of free blocks */
-		blocks = zone->free_area[order].nr_free;
+		blocks = zone_nr_free(zone, order);
 		info->free_blocks_total += blocks;
 
 		/* Count free base pages */
@@ -1010,6 +1010,23 @@ int fragmentation_index(struct zone *zone, unsigned int order)
 	fill_contig_page_info(zone, order, &info);
 	return __fragmentation_index(order, &info);
 }
+
+/*
+ * Calculates the percentage of the free memory of @zone which is not in
+ * blocks of at least @order pages.
+ */
+unsigned int extfrag_for_order(struct zone *zone, unsigned int order)
+{
+	struct contig_page_info info;
+
+	fill_contig_page_info(zone, order, &info);
+	if (info.free_pages == 0)
+		return 0;
+
+	return div_u64((info.free_pages -
+			(info.free_blocks_suitable << order)) * 100,
+			info.free_pages);
+}
 #endif
 
 #if defined(CONFIG_PROC_FS) || defined(CONFIG_SYSFS) || defined(CONFIG_NUMA)
@@ -1084,6 +1101,8 @@ const char * const vmstat_text[] = {
 	"nr_shmem",
 	"nr_shmem_hugepages",
 	"nr_shmem_pmdmapped",
+	"nr_file_hugepages",
+	"nr_file_pmdmapped",
 	"nr_anon_transparent_hugepages",
 	"nr_unstable",
 	"nr_vmscan_write",
@@ -1113,6 +1132,10 @@ const char * const vmstat_text[] = {
 
 	"pgfault",
 	"pgmajfault",
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	"speculative_pgfault",
+	"speculative_pgfault_abort",
+#endif
 	"pglazyfreed",
 
 	"pgrefill",
@@ -1148,6 +1171,9 @@ const char * const vmstat_text[] = {
 #ifdef CONFIG_MIGRATION
 	"pgmigrate_success",
 	"pgmigrate_fail",
+	"pgdemote_kswapd",
+	"pgdemote_direct",
+	"pgpromote_success",
 #endif
 #ifdef CONFIG_COMPACTION
 	"compact_migrate_scanned",
@@ -1159,6 +1185,7 @@ const char * const vmstat_text[] = {
 	"compact_daemon_wake",
 	"compact_daemon_migrate_scanned",
 	"compact_daemon_free_scanned",
+	"compact_daemon_proactive",
 #endif
 
 #ifdef CONFIG_HUGETLB_PAGE
@@ -1191,6 +1218,8 @@ const char * const vmstat_text[] = {
 	"thp_zero_page_alloc_failed",
 	"thp_swpout",
 	"thp_swpout_fallback",
+	"thp_swpin",
+	"thp_swpin_fallback",
 #endif
 #ifdef CONFIG_MEMORY_BALLOON
 	"balloon_inflate",
@@ -1265,10 +1294,10 @@ static void walk_zones_in_node(struct seq_file *m, pg_data_t *pgdat,
 			continue;
 
 		if (!nolock)
-			spin_lock_irqsave(&zone->lock, flags);
+			zone_lock_all_shards(zone, flags);
 		print(m, pgdat, zone);
 		if (!nolock)
-			spin_unlock_irqrestore(&zone->lock, flags);
+			zone_unlock_all_shards(zone, flags);
 	}
 }
 #endif
@@ -1281,7 +1310,7 @@ static void frag_show_print(struct seq_file *m, pg_data_t *pgdat,
 
 	seq_printf(m, "Node %d, zone %8s ", pgdat->node_id, zone->name);
 	for (order = 0; order < MAX_ORDER; ++order)
-		seq_printf(m, "%6lu ", zone->free_area[order].nr_free);
+		seq_printf(m, "%6lu ", zone_nr_free(zone, order));
 	seq_putc(m, '\n');
 }
 
@@ -1307,13 +1336,16 @@ static void pagetypeinfo_showfree_print(struct seq_file *m,
 					migratetype_names[mtype]);
 		for (order = 0; order < MAX_ORDER; ++order) {
 			unsigned long freecount = 0;
-			struct free_area *area;
+			struct zone_shard *shard;
 			struct list_head *curr;
 
-			area = &(zone->free_area[order]);
+			for_each_zone_shard(zone, shard) {
+				struct free_area *area;
 
-			list_for_each(curr, &area->free_list[mtype])
-				freecount++;
+				area = &shard->free_area[order];
+				list_for_each(curr, &area->free_list[mtype])
+					freecount++;
+			}
 			seq_printf(m, "%6lu ", freecount);
 		}
 		seq_putc(m, '\n');
@@ -1502,6 +1534,18 @@ static void zoneinfo_show_print(struct seq_file *m, pg_data_t *pgdat,
 				NR_VM_NUMA_STAT_ITEMS],
 				node_page_state(pgdat, i));
 		}
+		for (i = 0; i < MAX_KSWAPD_THREADS; i++) {
+			struct kswapd_thread *kt = &pgdat->kswapd[i];
+
+			if (!READ_ONCE(kt->task) && !kt->nr_wakeups)
+				continue;
+			seq_printf(m, "\n  kswapd thread %d"
+				   "\n      wakeups      %lu"
+				   "\n      scanned      %lu"
+				   "\n      reclaimed    %lu",
+				   i, kt->nr_wakeups, kt->nr_scanned,
+				   kt->nr_reclaimed);
+		}
 	}
 	seq_printf(m,
 		   "\n  pages free     %lu"
@@ -1546,17 +1590,21 @@ static void zoneinfo_show_print(struct seq_file *m, pg_data_t *pgdat,
 	seq_printf(m, "\n  pagesets");
 	for_each_online_cpu(i) {
 		struct per_cpu_pageset *pageset;
+		int order;
 
 		pageset = per_cpu_ptr(zone->pageset, i);
 		seq_printf(m,
 			   "\n    cpu: %i"
 			   "\n              count: %i"
 			   "\n              high:  %i"
-			   "\n              batch: %i",
+			   "\n              batch: %i"
+			   "\n              orders:",
 			   i,
 			   pageset->pcp.count,
 			   pageset->pcp.high,
 			   pageset->pcp.batch);
+		for (order = 0; order < NR_PCP_ORDERS; order++)
+			seq_printf(m, " %i", pageset->pcp.order_count[order]);
 #ifdef CONFIG_SMP
 		seq_printf(m, "\n  vm stats threshold: %d",
 				pageset->stat_threshold);
@@ -219,20 +219,23 @@ void *workingset_eviction(struct address_space *mapping, struct page *page)
 	VM_BUG_ON_PAGE(!PageLocked(page), page);
 
 	lruvec = mem_cgroup_lruvec(pgdat, memcg);
+#ifdef CONFIG_LRU_GEN
+	/* The multi-gen LRU timestamps evictions with the oldest generation */
+	if (READ_ONCE(lruvec->lrugen.enabled)) {
+		eviction = READ_ONCE(lruvec->lrugen.min_seq[LRU_GEN_FILE]);
+		return pack_shadow(memcgid, pgdat, eviction << bucket_order);
+	}
+#endif
 	eviction = atomic_long_inc_return(&lruvec->inactive_age);
 	return pack_shadow(memcgid, pgdat, eviction);
 }
 
-/**
- * workingset_refault - evaluate the refault of a previously evicted page
- * @shadow: shadow entry of the evicted page
- *
- * Calculates and evaluates the refault distance of the previously
- * evicted page in the context of the node it was allocated in.
- *
- * Returns %true if the page should be activated, %false otherwise.
+/*
+ * Would the page evicted to @shadow be activated if it refaulted now?
+ * *@lruvecp is set to the lruvec it was evicted from, or to NULL if its
+ * memcg is gone.  Called under rcu_read_lock().
  */
-bool workingset_refault(void *shadow)
+static bool shadow_refault_activates(void *shadow, struct lruvec **lruvecp)
 {
 	unsigned long refault_distance;
 	unsigned long active_file;
@@ -245,7 +248,6 @@ bool workingset_refault(void *shadow)
 
 	unpack_shadow(shadow, &memcgid, &pgdat, &eviction);
 
-	rcu_read_lock();
 	/*
 	 * Look up the memcg associated with the stored ID. It might
 	 * have been deleted since the page's eviction.
@@ -264,10 +266,25 @@ bool workingset_refault(void *shadow)
 	 */
 	memcg = mem_cgroup_from_id(memcgid);
 	if (!mem_cgroup_disabled() && !memcg) {
-		rcu_read_unlock();
+		*lruvecp = NULL;
 		return false;
 	}
 	lruvec = mem_cgroup_lruvec(pgdat, memcg);
+	*lruvecp = lruvec;
+#ifdef CONFIG_LRU_GEN
+	/*
+	 * A page refaulting while the oldest generation is at most one past
+	 * the one it was evicted from was only just too cold: activate it.
+	 */
+	if (READ_ONCE(lruvec->lrugen.enabled)) {
+		unsigned long min_seq;
+
+		min_seq = READ_ONCE(lruvec->lrugen.min_seq[LRU_GEN_FILE]);
+		refault_distance = (min_seq - (eviction >> bucket_order)) &
+				   EVICTION_MASK;
+		return refault_distance <= 1;
+	}
+#endif
 	refault = atomic_long_read(&lruvec->inactive_age);
 	active_file = lruvec_lru_size(lruvec, LRU_ACTIVE_FILE, MAX_NR_ZONES);
 
@@ -289,15 +306,50 @@ bool workingset_refault(void *shadow)
 	 */
 	refault_distance = (refault - eviction) & EVICTION_MASK;
 
-	inc_lruvec_state(lruvec, WORKINGSET_REFAULT);
+	return refault_distance <= active_file;
+}
 
-	if (refault_distance <= active_file) {
-		inc_lruvec_state(lruvec, WORKINGSET_ACTIVATE);
-		rcu_read_unlock();
-		return true;
+/**
+ * workingset_refault - evaluate the refault of a previously evicted page
+ * @shadow: shadow entry of the evicted page
+ *
+ * Calculates and evaluates the refault distance of the previously
+ * evicted page in the context of the node it was allocated in.
+ *
+ * Returns %true if the page should be activated, %false otherwise.
+ */
+bool workingset_refault(void *shadow)
+{
+	struct lruvec *lruvec;
+	bool activate;
+
+	rcu_read_lock();
+	activate = shadow_refault_activates(shadow, &lruvec);
+	if (lruvec) {
+		inc_lruvec_state(lruvec, WORKINGSET_REFAULT);
+		if (activate)
+			inc_lruvec_state(lruvec, WORKINGSET_ACTIVATE);
 	}
 	rcu_read_unlock();
-	return false;
+	return activate;
+}
+
+/**
+ * workingset_test_recent - test whether an evicted page was recently used
+ * @shadow: shadow entry of the evicted page
+ *
+ * Returns %true if the page would be activated if it refaulted now, as
+ * workingset_refault() does, but without accounting a refault.
+ */
+bool workingset_test_recent(void *shadow)
+{
+	struct lruvec *lruvec;
+	bool recent;
+
+	rcu_read_lock();
+	recent = shadow_refault_activates(shadow, &lruvec);
+	rcu_read_unlock();
+	return recent;
 }
 
 /**
@@ -377,6 +429,9 @@ static unsigned long count_shadow_nodes(struct shrinker *shrinker,
 	nodes = list_lru_shrink_count(&shadow_nodes, sc);
 	local_irq_enable();
 
+	if (!nodes)
+		return SHRINK_EMPTY;
+
 	/*
 	 * Approximate a reasonable limit for the radix tree nodes
 	 * containing shadow entries. We don't need to keep more
@@ -534,15 +589,17 @@ static int __init workingset_init(void)
 	pr_info("workingset: timestamp_bits=%d max_order=%d bucket_order=%u\n",
 	       timestamp_bits, max_order, bucket_order);
 
-	ret = __list_lru_init(&shadow_nodes, true, &shadow_nodes_key);
+	ret = prealloc_shrinker(&workingset_shadow_shrinker);
 	if (ret)
 		goto err;
-	ret = register_shrinker(&workingset_shadow_shrinker);
+	ret = __list_lru_init(&shadow_nodes, true, &shadow_nodes_key,
+			      &workingset_shadow_shrinker);
 	if (ret)
 		goto err_list_lru;
+	register_shrinker_prepared(&workingset_shadow_shrinker);
 	return 0;
 err_list_lru:
-	list_lru_destroy(&shadow_nodes);
+	free_prealloced_shrinker(&workingset_shadow_shrinker);
 err:
 	return ret;
 }
@@ -35,6 +35,8 @@
 #include <linux/crypto.h>
 #include <linux/mempool.h>
 #include <linux/zpool.h>
+#include <linux/memcontrol.h>
+#include <linux/zswap.h>
 
 #include <linux/mm_types.h>
 #include <linux/page-flags.h>
@@ -49,6 +51,8 @@
 static u64 zswap_pool_total_size;
 /* The number of compressed pages currently stored in zswap */
 static atomic_t zswap_stored_pages = ATOMIC_INIT(0);
+/* The number of same-value filled pages currently stored in zswap */
+static atomic_t zswap_same_filled_pages = ATOMIC_INIT(0);
 
 /*
  * The statistics below are not protected from concurrent access for
@@ -69,6 +73,8 @@ static u64 zswap_reject_compress_poor;
 static u64 zswap_reject_alloc_fail;
 /* Store failed because the entry metadata could not be allocated (rare) */
 static u64 zswap_reject_kmemcache_fail;
+/* Store failed because the memcg stayed over its zswap limit */
+static u64 zswap_reject_memcg_limit;
 /* Duplicate store was encountered (rare) */
 static u64 zswap_duplicate_entry;
 
@@ -116,6 +122,11 @@ module_param_cb(zpool, &zswap_zpool_param_ops, &zswap_zpool_type, 0644);
 static unsigned int zswap_max_pool_percent = 20;
 module_param_named(max_pool_percent, zswap_max_pool_percent, uint, 0644);
 
+/* Enable/disable handling same-value filled pages (enabled by default) */
+static bool zswap_same_filled_pages_enabled = true;
+module_param_named(same_filled_pages_enabled, zswap_same_filled_pages_enabled,
+		   bool, 0644);
+
 /*********************************
 * data structures
 **********************************/
@@ -138,6 +149,7 @@ struct zswap_pool {
  *
  * rbnode - links the entry into red-black tree for the appropriate swap type
  * offset - the swap offset for the entry.  Index into the red-black tree.
+ * swpentry - the swap entry of the page, for writeback from the lru
  * refcount - the number of outstanding reference to the entry. This is needed
  *            to protect against premature freeing of the entry by code
  *            concurrent calls to load, invalidate, and writeback.  The lock
@@ -145,17 +157,27 @@ struct zswap_pool {
  *            be held while changing the refcount.  Since the lock must
  *            be held, there is no reason to also make refcount atomic.
  * length - the length in bytes of the compressed page data.  Needed during
- *          decompression
+ *          decompression.  Zero for a same-value filled page.
  * pool - the zswap_pool the entry's data is in
  * handle - zpool allocation handle that stores the compressed page data
+ * value - the value a same-value filled page is filled with
+ * memcg - the memcg the compressed data is charged to, if any
+ * lru - links the entry into the lru of its memcg, or the global one.  Same
+ *       value filled pages take no room and are on no lru.
  */
 struct zswap_entry {
 	struct rb_node rbnode;
 	pgoff_t offset;
+	swp_entry_t swpentry;
 	int refcount;
 	unsigned int length;
 	struct zswap_pool *pool;
-	unsigned long handle;
+	union {
+		unsigned long handle;
+		unsigned long value;
+	};
+	struct mem_cgroup *memcg;
+	struct list_head lru;
 };
 
 struct zswap_header {
@@ -181,6 +203,12 @@ static DEFINE_SPINLOCK(zswap_pools_lock);
 /* pool counter to provide unique names to zpool */
 static atomic_t zswap_pools_count = ATOMIC_INIT(0);
 
+/* The entries no memcg is charged for */
+static struct zswap_lru zswap_global_lru = {
+	.lock = __SPIN_LOCK_UNLOCKED(zswap_global_lru.lock),
+	.list = LIST_HEAD_INIT(zswap_global_lru.list),
+};
+
 /* used by param callback function */
 static bool zswap_init_started;
 
@@ -250,7 +278,9 @@ static struct zswap_entry *zswap_entry_cache_alloc(gfp_t gfp)
 	if (!entry)
 		return NULL;
 	entry->refcount = 1;
+	entry->memcg = NULL;
 	RB_CLEAR_NODE(&entry->rbnode);
+	INIT_LIST_HEAD(&entry->lru);
 	return entry;
 }
 
@@ -314,14 +344,52 @@ static void zswap_rb_erase(struct rb_root *root, struct zswap_entry *entry)
 	}
 }
 
+/*********************************
+* lru functions
+**********************************/
+static struct zswap_lru *zswap_lru_of(struct zswap_entry *entry)
+{
+	return entry->memcg ? mem_cgroup_zswap_lru(entry->memcg) :
+			      &zswap_global_lru;
+}
+
+/* the lru lock nests inside the tree lock */
+static void zswap_lru_add(struct zswap_entry *entry)
+{
+	struct zswap_lru *lru = zswap_lru_of(entry);
+
+	spin_lock(&lru->lock);
+	list_add_tail(&entry->lru, &lru->list);
+	spin_unlock(&lru->lock);
+}
+
+static void zswap_lru_del(struct zswap_entry *entry)
+{
+	struct zswap_lru *lru = zswap_lru_of(entry);
+
+	spin_lock(&lru->lock);
+	list_del_init(&entry->lru);
+	spin_unlock(&lru->lock);
+}
+
 /*
  * Carries out the common pattern of freeing and entry's zpool allocation,
  * freeing the entry itself, and decrementing the number of stored pages.
  */
 static void zswap_free_entry(struct zswap_entry *entry)
 {
-	zpool_free(entry->pool->zpool, entry->handle);
-	zswap_pool_put(entry->pool);
+	if (!entry->length) {
+		atomic_dec(&zswap_same_filled_pages);
+	} else {
+		zswap_lru_del(entry);
+		if (entry->memcg) {
+			mem_cgroup_uncharge_zswap(entry->memcg, entry->length +
+						  sizeof(struct zswap_header));
+			mem_cgroup_zswap_put(entry->memcg);
+		}
+		zpool_free(entry->pool->zpool, entry->handle);
+		zswap_pool_put(entry->pool);
+	}
 	zswap_entry_cache_free(entry);
 	atomic_dec(&zswap_stored_pages);
 	zswap_update_total_size();
@@ -819,6 +887,52 @@ static int zswap_get_swap_cache_page(swp_entry_t entry,
 	return ZSWAP_SWAPCACHE_EXIST;
 }
 
+static bool zswap_is_page_same_filled(void *ptr, unsigned long *value)
+{
+	unsigned long *page = ptr;
+	unsigned int pos;
+
+	for (pos = 1; pos < PAGE_SIZE / sizeof(*page); pos++) {
+		if (page[pos] != page[0])
+			return false;
+	}
+	*value = page[0];
+	return true;
+}
+
+static void zswap_fill_page(void *ptr, unsigned long value)
+{
+	memset_l(ptr, value, PAGE_SIZE / sizeof(unsigned long));
+}
+
+/* Fills @page with the data of @entry, decompressing it if needed */
+static void zswap_load_entry(struct zswap_entry *entry, struct page *page)
+{
+	struct crypto_comp *tfm;
+	unsigned int dlen;
+	u8 *src, *dst;
+	int ret;
+
+	if (!entry->length) {
+		dst = kmap_atomic(page);
+		zswap_fill_page(dst, entry->value);
+		kunmap_atomic(dst);
+		return;
+	}
+
+	dlen = PAGE_SIZE;
+	src = (u8 *)zpool_map_handle(entry->pool->zpool, entry->handle,
+			ZPOOL_MM_RO) + sizeof(struct zswap_header);
+	dst = kmap_atomic(page);
+	tfm = *get_cpu_ptr(entry->pool->tfm);
+	ret = crypto_comp_decompress(tfm, src, entry->length, dst, &dlen);
+	put_cpu_ptr(entry->pool->tfm);
+	kunmap_atomic(dst);
+	zpool_unmap_handle(entry->pool->zpool, entry->handle);
+	BUG_ON(ret);
+	BUG_ON(dlen != PAGE_SIZE);
+}
+
 /*
  * Attempts to free an entry by adding a page to the swap cache,
  * decompressing the entry data into the page, and issuing a
@@ -831,26 +945,17 @@ static int zswap_get_swap_cache_page(swp_entry_t entry,
  * the swap cache, the compressed version stored by zswap can be
  * freed.
  */
-static int zswap_writeback_entry(struct zpool *pool, unsigned long handle)
+static int zswap_writeback_swpentry(swp_entry_t swpentry)
 {
-	struct zswap_header *zhdr;
-	swp_entry_t swpentry;
 	struct zswap_tree *tree;
 	pgoff_t offset;
 	struct zswap_entry *entry;
 	struct page *page;
-	struct crypto_comp *tfm;
-	u8 *src, *dst;
-	unsigned int dlen;
 	int ret;
 	struct writeback_control wbc = {
 		.sync_mode = WB_SYNC_NONE,
 	};
 
-	/* extract swpentry from data */
-	zhdr = zpool_map_handle(pool, handle, ZPOOL_MM_RO);
-	swpentry = zhdr->swpentry; /* here */
-	zpool_unmap_handle(pool, handle);
 	tree = zswap_trees[swp_type(swpentry)];
 	offset = swp_offset(swpentry);
 
@@ -878,19 +983,8 @@ static int zswap_writeback_entry(struct zpool *pool, unsigned long handle)
 		goto fail;
 
 	case ZSWAP_SWAPCACHE_NEW: /* page is locked */
-		/* decompress */
-		dlen = PAGE_SIZE;
-		src = (u8 *)zpool_map_handle(entry->pool->zpool, entry->handle,
-				ZPOOL_MM_RO) + sizeof(struct zswap_header);
-		dst = kmap_atomic(page);
-		tfm = *get_cpu_ptr(entry->pool->tfm);
-		ret = crypto_comp_decompress(tfm, src, entry->length,
-					     dst, &dlen);
-		put_cpu_ptr(entry->pool->tfm);
-		kunmap_atomic(dst);
-		zpool_unmap_handle(entry->pool->zpool, entry->handle);
-		BUG_ON(ret);
-		BUG_ON(dlen != PAGE_SIZE);
+		zswap_load_entry(entry, page);
+		ret = 0;
 
 		/* page is up to date */
 		SetPageUptodate(page);
@@ -937,11 +1031,54 @@ static int zswap_writeback_entry(struct zpool *pool, unsigned long handle)
 	return ret;
 }
 
-static int zswap_shrink(void)
+/* zpool eviction, from the lru of the zpool */
+static int zswap_writeback_entry(struct zpool *pool, unsigned long handle)
+{
+	struct zswap_header *zhdr;
+	swp_entry_t swpentry;
+
+	/* extract swpentry from data */
+	zhdr = zpool_map_handle(pool, handle, ZPOOL_MM_RO);
+	swpentry = zhdr->swpentry; /* here */
+	zpool_unmap_handle(pool, handle);
+
+	return zswap_writeback_swpentry(swpentry);
+}
+
+/*
+ * Writes back the oldest entry of @lru.  The entry moves to the tail, so
+ * that the next call tries another one if this one cannot go right now.
+ */
+static int zswap_shrink_lru(struct zswap_lru *lru)
+{
+	struct zswap_entry *entry;
+	swp_entry_t swpentry;
+
+	spin_lock(&lru->lock);
+	if (list_empty(&lru->list)) {
+		spin_unlock(&lru->lock);
+		return -ENOENT;
+	}
+	entry = list_first_entry(&lru->list, struct zswap_entry, lru);
+	list_move_tail(&entry->lru, &lru->list);
+	swpentry = entry->swpentry;
+	spin_unlock(&lru->lock);
+
+	return zswap_writeback_swpentry(swpentry);
+}
+
+/*
+ * Makes room in a full pool.  The memcg which stores pays with its own
+ * oldest pages first, rather than whichever pages the zpool finds oldest.
+ */
+static int zswap_shrink(struct mem_cgroup *memcg)
 {
 	struct zswap_pool *pool;
 	int ret;
 
+	if (memcg && !zswap_shrink_lru(mem_cgroup_zswap_lru(memcg)))
+		return 0;
+
 	pool = zswap_pool_last_get();
 	if (!pool)
 		return -ENOENT;
@@ -962,10 +1099,11 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 {
 	struct zswap_tree *tree = zswap_trees[type];
 	struct zswap_entry *entry, *dupentry;
+	struct mem_cgroup *memcg;
 	struct crypto_comp *tfm;
 	int ret;
 	unsigned int dlen = PAGE_SIZE, len;
-	unsigned long handle;
+	unsigned long handle, value;
 	char *buf;
 	u8 *src, *dst;
 	struct zswap_header *zhdr;
@@ -975,16 +1113,6 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 		goto reject;
 	}
 
-	/* reclaim space if needed */
-	if (zswap_is_full()) {
-		zswap_pool_limit_hit++;
-		if (zswap_shrink()) {
-			zswap_reject_reclaim_fail++;
-			ret = -ENOMEM;
-			goto reject;
-		}
-	}
-
 	/* allocate entry */
 	entry = zswap_entry_cache_alloc(GFP_KERNEL);
 	if (!entry) {
@@ -993,11 +1121,46 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 		goto reject;
 	}
 
+	/* a page filled with one word needs neither compression nor zpool */
+	if (zswap_same_filled_pages_enabled) {
+		src = kmap_atomic(page);
+		if (zswap_is_page_same_filled(src, &value)) {
+			kunmap_atomic(src);
+			entry->offset = offset;
+			entry->swpentry = swp_entry(type, offset);
+			entry->length = 0;
+			entry->value = value;
+			atomic_inc(&zswap_same_filled_pages);
+			goto insert_entry;
+		}
+		kunmap_atomic(src);
+	}
+
+	/* the memcg over its zswap limit makes room with its own pages */
+	memcg = mem_cgroup_zswap_get(page);
+	if (!mem_cgroup_zswap_may_store(memcg) &&
+	    (zswap_shrink_lru(mem_cgroup_zswap_lru(memcg)) ||
+	     !mem_cgroup_zswap_may_store(memcg))) {
+		zswap_reject_memcg_limit++;
+		ret = -ENOMEM;
+		goto put_memcg;
+	}
+
+	/* reclaim space if needed */
+	if (zswap_is_full()) {
+		zswap_pool_limit_hit++;
+		if (zswap_shrink(memcg)) {
+			zswap_reject_reclaim_fail++;
+			ret = -ENOMEM;
+			goto put_memcg;
+		}
+	}
+
 	/* if entry is successfully added, it keeps the reference */
 	entry->pool = zswap_pool_current_get();
 	if (!entry->pool) {
 		ret = -EINVAL;
-		goto freepage;
+		goto put_memcg;
 	}
 
 	/* compress */
@@ -1034,9 +1197,14 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 
 	/* populate entry */
 	entry->offset = offset;
+	entry->swpentry = swp_entry(type, offset);
 	entry->handle = handle;
 	entry->length = dlen;
+	entry->memcg = memcg;
+	if (memcg)
+		mem_cgroup_charge_zswap(memcg, len);
 
+insert_entry:
 	/* map */
 	spin_lock(&tree->lock);
 	do {
@@ -1048,6 +1216,8 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 			zswap_entry_put(tree, dupentry);
 		}
 	} while (ret == -EEXIST);
+	if (entry->length)
+		zswap_lru_add(entry);
 	spin_unlock(&tree->lock);
 
 	/* update stats */
@@ -1059,7 +1229,8 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 put_dstmem:
 	put_cpu_var(zswap_dstmem);
 	zswap_pool_put(entry->pool);
-freepage:
+put_memcg:
+	mem_cgroup_zswap_put(memcg);
 	zswap_entry_cache_free(entry);
 reject:
 	return ret;
@@ -1074,10 +1245,6 @@ static int zswap_frontswap_load(unsigned type, pgoff_t offset,
 {
 	struct zswap_tree *tree = zswap_trees[type];
 	struct zswap_entry *entry;
-	struct crypto_comp *tfm;
-	u8 *src, *dst;
-	unsigned int dlen;
-	int ret;
 
 	/* find */
 	spin_lock(&tree->lock);
@@ -1089,17 +1256,7 @@ static int zswap_frontswap_load(unsigned type, pgoff_t offset,
 	}
 	spin_unlock(&tree->lock);
 
-	/* decompress */
-	dlen = PAGE_SIZE;
-	src = (u8 *)zpool_map_handle(entry->pool->zpool, entry->handle,
-			ZPOOL_MM_RO) + sizeof(struct zswap_header);
-	dst = kmap_atomic(page);
-	tfm = *get_cpu_ptr(entry->pool->tfm);
-	ret = crypto_comp_decompress(tfm, src, entry->length, dst, &dlen);
-	put_cpu_ptr(entry->pool->tfm);
-	kunmap_atomic(dst);
-	zpool_unmap_handle(entry->pool->zpool, entry->handle);
-	BUG_ON(ret);
+	zswap_load_entry(entry, page);
 
 	spin_lock(&tree->lock);
 	zswap_entry_put(tree, entry);
@@ -1201,6 +1358,8 @@ static int __init zswap_debugfs_init(void)
 			zswap_debugfs_root, &zswap_reject_kmemcache_fail);
 	debugfs_create_u64("reject_compress_poor", S_IRUGO,
 			zswap_debugfs_root, &zswap_reject_compress_poor);
+	debugfs_create_u64("reject_memcg_limit", S_IRUGO,
+			zswap_debugfs_root, &zswap_reject_memcg_limit);
 	debugfs_create_u64("written_back_pages", S_IRUGO,
 			zswap_debugfs_root, &zswap_written_back_pages);
 	debugfs_create_u64("duplicate_entry", S_IRUGO,
@@ -1209,6 +1368,8 @@ static int __init zswap_debugfs_init(void)
 			zswap_debugfs_root, &zswap_pool_total_size);
 	debugfs_create_atomic_t("stored_pages", S_IRUGO,
 			zswap_debugfs_root, &zswap_stored_pages);
+	debugfs_create_atomic_t("same_filled_pages", S_IRUGO,
+			zswap_debugfs_root, &zswap_same_filled_pages);
 
 	return 0;
 }
@@ -33,6 +33,7 @@
 #include <linux/mutex.h>
 #include <linux/slab.h>
 #include <linux/sched/signal.h>
+#include <linux/sched/mm.h>
 #include <linux/uaccess.h>
 #include <linux/uio.h>
 #include <net/9p/9p.h>
@@ -230,10 +231,20 @@ static int parse_opts(char *opts, struct p9_client *clnt)
 	return ret;
 }
 
-static struct p9_fcall *p9_fcall_alloc(int alloc_msize)
+static struct p9_fcall *p9_fcall_alloc(struct p9_client *c, int alloc_msize)
 {
 	struct p9_fcall *fc;
-	fc = kmalloc(sizeof(struct p9_fcall) + alloc_msize, GFP_NOFS);
+	unsigned int nofs_flags;
+
+	if (c->trans_mod->vmalloc_bufs) {
+		/* an msize of several MB is too large for kmalloc */
+		nofs_flags = memalloc_nofs_save();
+		fc = kvmalloc(sizeof(struct p9_fcall) + alloc_msize,
+			      GFP_KERNEL);
+		memalloc_nofs_restore(nofs_flags);
+	} else {
+		fc = kmalloc(sizeof(struct p9_fcall) + alloc_msize, GFP_NOFS);
+	}
 	if (!fc)
 		return NULL;
 	fc->capacity = alloc_msize;
@@ -301,9 +312,9 @@ p9_tag_alloc(struct p9_client *c, u16 tag, unsigned int max_size)
 	}
 
 	if (!req->tc)
-		req->tc = p9_fcall_alloc(alloc_msize);
+		req->tc = p9_fcall_alloc(c, alloc_msize);
 	if (!req->rc)
-		req->rc = p9_fcall_alloc(alloc_msize);
+		req->rc = p9_fcall_alloc(c, alloc_msize);
 	if (!req->tc || !req->rc)
 		goto grow_failed;
 
@@ -317,8 +328,8 @@ p9_tag_alloc(struct p9_client *c, u16 tag, unsigned int max_size)
 
 grow_failed:
 	pr_err("Couldn't grow tag array\n");
-	kfree(req->tc);
-	kfree(req->rc);
+	kvfree(req->tc);
+	kvfree(req->rc);
 	kfree(req->wq);
 	req->tc = req->rc = NULL;
 	req->wq = NULL;
@@ -410,8 +421,8 @@ static void p9_tag_cleanup(struct p9_client *c)
 	for (row = 0; row < (c->max_tag/P9_ROW_MAXTAG); row++) {
 		for (col = 0; col < P9_ROW_MAXTAG; col++) {
 			kfree(c->reqs[row][col].wq);
-			kfree(c->reqs[row][col].tc);
-			kfree(c->reqs[row][col].rc);
+			kvfree(c->reqs[row][col].tc);
+			kvfree(c->reqs[row][col].rc);
 		}
 		kfree(c->reqs[row]);
 	}
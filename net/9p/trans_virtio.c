@@ -51,22 +51,44 @@
 #include <linux/virtio_9p.h>
 #include "trans_common.h"
 
-#define VIRTQUEUE_NUM	128
+/*
+ * The sg entries a request can use: the size of the ring, or with indirect
+ * descriptors the most QEMU accepts in a chain.
+ */
+#define VIRTIO_9P_MAX_SG	1024
+/* Limit of the request queues of a channel */
+#define VIRTIO_9P_MAX_VQS	64
 
 /* a single mutex to manage channel initialization and attachment */
 static DEFINE_MUTEX(virtio_9p_lock);
 static DECLARE_WAIT_QUEUE_HEAD(vp_wq);
 static atomic_t vp_pinned = ATOMIC_INIT(0);
 
+/**
+ * struct virtio_chan_vq - a request queue of a channel
+ * @lock: protects the virtqueue and @sg
+ * @vq: the virtqueue
+ * @ring_bufs_avail: cleared when the ring is full
+ * @vc_wq: where requests wait for ring space
+ * @sg: scatter gather list which is used to pack a request
+ */
+struct virtio_chan_vq {
+	spinlock_t lock;
+	struct virtqueue *vq;
+	int ring_bufs_avail;
+	wait_queue_head_t vc_wq;
+	/* Scatterlist: can be too big for stack. */
+	struct scatterlist *sg;
+} ____cacheline_aligned_in_smp;
+
 /**
  * struct virtio_chan - per-instance transport information
- * @initialized: whether the channel is initialized
  * @inuse: whether the channel is in use
- * @lock: protects multiple elements within this structure
  * @client: client instance
  * @vdev: virtio dev associated with this channel
- * @vq: virtio queue associated with this channel
- * @sg: scatter gather list which is used to pack a request (protected?)
+ * @vqs: request queues, each request uses the one of its cpu
+ * @nr_vqs: number of @vqs
+ * @nr_sg: entries of the sg list of each queue
  *
  * We keep all per-channel information in a structure.
  * This structure is allocated within the devices dev->mem space.
@@ -77,19 +99,15 @@ static atomic_t vp_pinned = ATOMIC_INIT(0);
 struct virtio_chan {
 	bool inuse;
 
-	spinlock_t lock;
-
 	struct p9_client *client;
 	struct virtio_device *vdev;
-	struct virtqueue *vq;
-	int ring_bufs_avail;
-	wait_queue_head_t *vc_wq;
+	struct virtio_chan_vq *vqs;
+	unsigned int nr_vqs;
+	unsigned int nr_sg;
 	/* This is global limit. Since we don't have a global structure,
 	 * will be placing it in each channel.
 	 */
 	unsigned long p9_max_pages;
-	/* Scatterlist: can be too big for stack. */
-	struct scatterlist sg[VIRTQUEUE_NUM];
 
 	int tag_len;
 	/*
@@ -108,6 +126,22 @@ static unsigned int rest_of_page(void *data)
 	return PAGE_SIZE - offset_in_page(data);
 }
 
+/*
+ * The largest message a channel can carry: we leave one entry for input and
+ * one entry for response headers.  We also skip one more entry to
+ * accomodate, address that are not at page boundary, that can result in an
+ * extra page in zero copy.
+ */
+static unsigned int p9_virtio_maxsize(unsigned int nr_sg)
+{
+	return PAGE_SIZE * (nr_sg - 3);
+}
+
+static struct virtio_chan_vq *p9_virtio_cur_vq(struct virtio_chan *chan)
+{
+	return &chan->vqs[raw_smp_processor_id() % chan->nr_vqs];
+}
+
 /**
  * p9_virtio_close - reclaim resources of a channel
  * @client: client instance
@@ -143,6 +177,7 @@ static void p9_virtio_close(struct p9_client *client)
 static void req_done(struct virtqueue *vq)
 {
 	struct virtio_chan *chan = vq->vdev->priv;
+	struct virtio_chan_vq *cvq = &chan->vqs[vq->index];
 	unsigned int len;
 	struct p9_req_t *req;
 	unsigned long flags;
@@ -150,16 +185,16 @@ static void req_done(struct virtqueue *vq)
 	p9_debug(P9_DEBUG_TRANS, ": request done\n");
 
 	while (1) {
-		spin_lock_irqsave(&chan->lock, flags);
-		req = virtqueue_get_buf(chan->vq, &len);
+		spin_lock_irqsave(&cvq->lock, flags);
+		req = virtqueue_get_buf(vq, &len);
 		if (req == NULL) {
-			spin_unlock_irqrestore(&chan->lock, flags);
+			spin_unlock_irqrestore(&cvq->lock, flags);
 			break;
 		}
-		chan->ring_bufs_avail = 1;
-		spin_unlock_irqrestore(&chan->lock, flags);
+		cvq->ring_bufs_avail = 1;
+		spin_unlock_irqrestore(&cvq->lock, flags);
 		/* Wakeup if anyone waiting for VirtIO ring space. */
-		wake_up(chan->vc_wq);
+		wake_up(&cvq->vc_wq);
 		p9_client_cb(chan->client, req, REQ_STATUS_RCVD);
 	}
 }
@@ -174,7 +209,7 @@ static void req_done(struct virtqueue *vq)
  *
  * sg_lists have multiple segments of various sizes.  This will pack
  * arbitrary data into an existing scatter gather list, segmenting the
- * data as necessary within constraints.
+ * data as necessary within constraints.  The data may be vmalloc'd.
  *
  */
 
@@ -191,7 +226,11 @@ static int pack_sg_list(struct scatterlist *sg, int start,
 		BUG_ON(index > limit);
 		/* Make sure we don't terminate early. */
 		sg_unmark_end(&sg[index]);
-		sg_set_buf(&sg[index++], data, s);
+		if (is_vmalloc_addr(data))
+			sg_set_page(&sg[index++], vmalloc_to_page(data), s,
+				    offset_in_page(data));
+		else
+			sg_set_buf(&sg[index++], data, s);
 		count -= s;
 		data += s;
 	}
@@ -260,48 +299,49 @@ p9_virtio_request(struct p9_client *client, struct p9_req_t *req)
 	int in, out, out_sgs, in_sgs;
 	unsigned long flags;
 	struct virtio_chan *chan = client->trans;
+	struct virtio_chan_vq *cvq = p9_virtio_cur_vq(chan);
 	struct scatterlist *sgs[2];
 
 	p9_debug(P9_DEBUG_TRANS, "9p debug: virtio request\n");
 
 	req->status = REQ_STATUS_SENT;
 req_retry:
-	spin_lock_irqsave(&chan->lock, flags);
+	spin_lock_irqsave(&cvq->lock, flags);
 
 	out_sgs = in_sgs = 0;
 	/* Handle out VirtIO ring buffers */
-	out = pack_sg_list(chan->sg, 0,
-			   VIRTQUEUE_NUM, req->tc->sdata, req->tc->size);
+	out = pack_sg_list(cvq->sg, 0,
+			   chan->nr_sg, req->tc->sdata, req->tc->size);
 	if (out)
-		sgs[out_sgs++] = chan->sg;
+		sgs[out_sgs++] = cvq->sg;
 
-	in = pack_sg_list(chan->sg, out,
-			  VIRTQUEUE_NUM, req->rc->sdata, req->rc->capacity);
+	in = pack_sg_list(cvq->sg, out,
+			  chan->nr_sg, req->rc->sdata, req->rc->capacity);
 	if (in)
-		sgs[out_sgs + in_sgs++] = chan->sg + out;
+		sgs[out_sgs + in_sgs++] = cvq->sg + out;
 
-	err = virtqueue_add_sgs(chan->vq, sgs, out_sgs, in_sgs, req,
+	err = virtqueue_add_sgs(cvq->vq, sgs, out_sgs, in_sgs, req,
 				GFP_ATOMIC);
 	if (err < 0) {
 		if (err == -ENOSPC) {
-			chan->ring_bufs_avail = 0;
-			spin_unlock_irqrestore(&chan->lock, flags);
-			err = wait_event_interruptible(*chan->vc_wq,
-							chan->ring_bufs_avail);
+			cvq->ring_bufs_avail = 0;
+			spin_unlock_irqrestore(&cvq->lock, flags);
+			err = wait_event_interruptible(cvq->vc_wq,
+							cvq->ring_bufs_avail);
 			if (err  == -ERESTARTSYS)
 				return err;
 
 			p9_debug(P9_DEBUG_TRANS, "Retry virtio request\n");
 			goto req_retry;
 		} else {
-			spin_unlock_irqrestore(&chan->lock, flags);
+			spin_unlock_irqrestore(&cvq->lock, flags);
 			p9_debug(P9_DEBUG_TRANS,
 				 "virtio rpc add_sgs returned failure\n");
 			return -EIO;
 		}
 	}
-	virtqueue_kick(chan->vq);
-	spin_unlock_irqrestore(&chan->lock, flags);
+	virtqueue_kick(cvq->vq);
+	spin_unlock_irqrestore(&cvq->lock, flags);
 
 	p9_debug(P9_DEBUG_TRANS, "virtio request kicked\n");
 	return 0;
@@ -398,6 +438,7 @@ p9_virtio_zc_request(struct p9_client *client, struct p9_req_t *req,
 	int in_nr_pages = 0, out_nr_pages = 0;
 	struct page **in_pages = NULL, **out_pages = NULL;
 	struct virtio_chan *chan = client->trans;
+	struct virtio_chan_vq *cvq = p9_virtio_cur_vq(chan);
 	struct scatterlist *sgs[4];
 	size_t offs;
 	int need_drop = 0;
@@ -429,20 +470,20 @@ p9_virtio_zc_request(struct p9_client *client, struct p9_req_t *req,
 	}
 	req->status = REQ_STATUS_SENT;
 req_retry_pinned:
-	spin_lock_irqsave(&chan->lock, flags);
+	spin_lock_irqsave(&cvq->lock, flags);
 
 	out_sgs = in_sgs = 0;
 
 	/* out data */
-	out = pack_sg_list(chan->sg, 0,
-			   VIRTQUEUE_NUM, req->tc->sdata, req->tc->size);
+	out = pack_sg_list(cvq->sg, 0,
+			   chan->nr_sg, req->tc->sdata, req->tc->size);
 
 	if (out)
-		sgs[out_sgs++] = chan->sg;
+		sgs[out_sgs++] = cvq->sg;
 
 	if (out_pages) {
-		sgs[out_sgs++] = chan->sg + out;
-		out += pack_sg_list_p(chan->sg, out, VIRTQUEUE_NUM,
+		sgs[out_sgs++] = cvq->sg + out;
+		out += pack_sg_list_p(cvq->sg, out, chan->nr_sg,
 				      out_pages, out_nr_pages, offs, outlen);
 	}
 		
@@ -453,41 +494,41 @@ p9_virtio_zc_request(struct p9_client *client, struct p9_req_t *req,
 	 * Arrange in such a way that server places header in the
 	 * alloced memory and payload onto the user buffer.
 	 */
-	in = pack_sg_list(chan->sg, out,
-			  VIRTQUEUE_NUM, req->rc->sdata, in_hdr_len);
+	in = pack_sg_list(cvq->sg, out,
+			  chan->nr_sg, req->rc->sdata, in_hdr_len);
 	if (in)
-		sgs[out_sgs + in_sgs++] = chan->sg + out;
+		sgs[out_sgs + in_sgs++] = cvq->sg + out;
 
 	if (in_pages) {
-		sgs[out_sgs + in_sgs++] = chan->sg + out + in;
-		in += pack_sg_list_p(chan->sg, out + in, VIRTQUEUE_NUM,
+		sgs[out_sgs + in_sgs++] = cvq->sg + out + in;
+		in += pack_sg_list_p(cvq->sg, out + in, chan->nr_sg,
 				     in_pages, in_nr_pages, offs, inlen);
 	}
 
 	BUG_ON(out_sgs + in_sgs > ARRAY_SIZE(sgs));
-	err = virtqueue_add_sgs(chan->vq, sgs, out_sgs, in_sgs, req,
+	err = virtqueue_add_sgs(cvq->vq, sgs, out_sgs, in_sgs, req,
 				GFP_ATOMIC);
 	if (err < 0) {
 		if (err == -ENOSPC) {
-			chan->ring_bufs_avail = 0;
-			spin_unlock_irqrestore(&chan->lock, flags);
-			err = wait_event_interruptible(*chan->vc_wq,
-						       chan->ring_bufs_avail);
+			cvq->ring_bufs_avail = 0;
+			spin_unlock_irqrestore(&cvq->lock, flags);
+			err = wait_event_interruptible(cvq->vc_wq,
+						       cvq->ring_bufs_avail);
 			if (err  == -ERESTARTSYS)
 				goto err_out;
 
 			p9_debug(P9_DEBUG_TRANS, "Retry virtio request\n");
 			goto req_retry_pinned;
 		} else {
-			spin_unlock_irqrestore(&chan->lock, flags);
+			spin_unlock_irqrestore(&cvq->lock, flags);
 			p9_debug(P9_DEBUG_TRANS,
 				 "virtio rpc add_sgs returned failure\n");
 			err = -EIO;
 			goto err_out;
 		}
 	}
-	virtqueue_kick(chan->vq);
-	spin_unlock_irqrestore(&chan->lock, flags);
+	virtqueue_kick(cvq->vq);
+	spin_unlock_irqrestore(&cvq->lock, flags);
 	p9_debug(P9_DEBUG_TRANS, "virtio request kicked\n");
 	err = wait_event_interruptible(*req->wq,
 				       req->status >= REQ_STATUS_RCVD);
@@ -529,6 +570,84 @@ static ssize_t p9_mount_tag_show(struct device *dev,
 
 static DEVICE_ATTR(mount_tag, 0444, p9_mount_tag_show, NULL);
 
+static void p9_virtio_free_vqs(struct virtio_chan *chan)
+{
+	unsigned int i;
+
+	if (!chan->vqs)
+		return;
+	for (i = 0; i < chan->nr_vqs; i++)
+		kvfree(chan->vqs[i].sg);
+	kfree(chan->vqs);
+}
+
+/*
+ * A device offering VIRTIO_9P_F_MQ has several request queues, we use up to
+ * one per cpu.  With indirect descriptors, the chain of a request is not
+ * limited by the size of the ring and messages of several MB are possible.
+ */
+static int p9_virtio_init_vqs(struct virtio_chan *chan, u16 tag_len)
+{
+	struct virtio_device *vdev = chan->vdev;
+	struct virtqueue **vqs;
+	vq_callback_t **callbacks;
+	const char **names;
+	unsigned int nr_vqs = 1, i;
+	int err = -ENOMEM;
+
+	if (virtio_has_feature(vdev, VIRTIO_9P_F_MQ))
+		nr_vqs = virtio_cread16(vdev,
+				offsetof(struct virtio_9p_config, tag) +
+				tag_len);
+	nr_vqs = clamp_t(unsigned int, nr_vqs, 1,
+			 min_t(unsigned int, nr_cpu_ids, VIRTIO_9P_MAX_VQS));
+
+	chan->vqs = kcalloc(nr_vqs, sizeof(*chan->vqs), GFP_KERNEL);
+	vqs = kmalloc_array(nr_vqs, sizeof(*vqs), GFP_KERNEL);
+	callbacks = kmalloc_array(nr_vqs, sizeof(*callbacks), GFP_KERNEL);
+	names = kmalloc_array(nr_vqs, sizeof(*names), GFP_KERNEL);
+	if (!chan->vqs || !vqs || !callbacks || !names)
+		goto out;
+
+	for (i = 0; i < nr_vqs; i++) {
+		callbacks[i] = req_done;
+		names[i] = "requests";
+	}
+	err = virtio_find_vqs(vdev, nr_vqs, vqs, callbacks, names, NULL);
+	if (err)
+		goto out;
+	chan->nr_vqs = nr_vqs;
+
+	chan->nr_sg = VIRTIO_9P_MAX_SG;
+	if (!virtio_has_feature(vdev, VIRTIO_RING_F_INDIRECT_DESC)) {
+		for (i = 0; i < nr_vqs; i++)
+			chan->nr_sg = min(chan->nr_sg,
+					  virtqueue_get_vring_size(vqs[i]));
+	}
+
+	for (i = 0; i < nr_vqs; i++) {
+		struct virtio_chan_vq *cvq = &chan->vqs[i];
+
+		spin_lock_init(&cvq->lock);
+		cvq->vq = vqs[i];
+		cvq->ring_bufs_avail = 1;
+		init_waitqueue_head(&cvq->vc_wq);
+		cvq->sg = kvmalloc_array(chan->nr_sg, sizeof(*cvq->sg),
+					 GFP_KERNEL);
+		if (!cvq->sg) {
+			err = -ENOMEM;
+			goto out;
+		}
+		sg_init_table(cvq->sg, chan->nr_sg);
+	}
+	err = 0;
+out:
+	kfree(names);
+	kfree(callbacks);
+	kfree(vqs);
+	return err;
+}
+
 /**
  * p9_virtio_probe - probe for existence of 9P virtio channels
  * @vdev: virtio device to probe
@@ -550,7 +669,7 @@ static int p9_virtio_probe(struct virtio_device *vdev)
 		return -EINVAL;
 	}
 
-	chan = kmalloc(sizeof(struct virtio_chan), GFP_KERNEL);
+	chan = kzalloc(sizeof(struct virtio_chan), GFP_KERNEL);
 	if (!chan) {
 		pr_err("Failed to allocate virtio 9P channel\n");
 		err = -ENOMEM;
@@ -559,17 +678,6 @@ static int p9_virtio_probe(struct virtio_device *vdev)
 
 	chan->vdev = vdev;
 
-	/* We expect one virtqueue, for requests. */
-	chan->vq = virtio_find_single_vq(vdev, req_done, "requests");
-	if (IS_ERR(chan->vq)) {
-		err = PTR_ERR(chan->vq);
-		goto out_free_vq;
-	}
-	chan->vq->vdev->priv = chan;
-	spin_lock_init(&chan->lock);
-
-	sg_init_table(chan->sg, VIRTQUEUE_NUM);
-
 	chan->inuse = false;
 	if (virtio_has_feature(vdev, VIRTIO_9P_MOUNT_TAG)) {
 		virtio_cread(vdev, struct virtio_9p_config, tag_len, &tag_len);
@@ -577,6 +685,12 @@ static int p9_virtio_probe(struct virtio_device *vdev)
 		err = -EINVAL;
 		goto out_free_vq;
 	}
+
+	err = p9_virtio_init_vqs(chan, tag_len);
+	if (err)
+		goto out_free_vq;
+	vdev->priv = chan;
+
 	tag = kmalloc(tag_len, GFP_KERNEL);
 	if (!tag) {
 		err = -ENOMEM;
@@ -591,13 +705,6 @@ static int p9_virtio_probe(struct virtio_device *vdev)
 	if (err) {
 		goto out_free_tag;
 	}
-	chan->vc_wq = kmalloc(sizeof(wait_queue_head_t), GFP_KERNEL);
-	if (!chan->vc_wq) {
-		err = -ENOMEM;
-		goto out_free_tag;
-	}
-	init_waitqueue_head(chan->vc_wq);
-	chan->ring_bufs_avail = 1;
 	/* Ceiling limit to avoid denial of service attacks */
 	chan->p9_max_pages = nr_free_buffer_pages()/4;
 
@@ -616,6 +723,7 @@ static int p9_virtio_probe(struct virtio_device *vdev)
 	kfree(tag);
 out_free_vq:
 	vdev->config->del_vqs(vdev);
+	p9_virtio_free_vqs(chan);
 	kfree(chan);
 fail:
 	return err;
@@ -665,6 +773,8 @@ p9_virtio_create(struct p9_client *client, const char *devname, char *args)
 	client->trans = (void *)chan;
 	client->status = Connected;
 	chan->client = client;
+	if (client->msize > p9_virtio_maxsize(chan->nr_sg))
+		client->msize = p9_virtio_maxsize(chan->nr_sg);
 
 	return 0;
 }
@@ -706,7 +816,7 @@ static void p9_virtio_remove(struct virtio_device *vdev)
 	sysfs_remove_file(&(vdev->dev.kobj), &dev_attr_mount_tag.attr);
 	kobject_uevent(&(vdev->dev.kobj), KOBJ_CHANGE);
 	kfree(chan->tag);
-	kfree(chan->vc_wq);
+	p9_virtio_free_vqs(chan);
 	kfree(chan);
 
 }
@@ -718,6 +828,7 @@ static struct virtio_device_id id_table[] = {
 
 static unsigned int features[] = {
 	VIRTIO_9P_MOUNT_TAG,
+	VIRTIO_9P_F_MQ,
 };
 
 /* The standard "struct lguest_driver": */
@@ -738,13 +849,9 @@ static struct p9_trans_module p9_virtio_trans = {
 	.request = p9_virtio_request,
 	.zc_request = p9_virtio_zc_request,
 	.cancel = p9_virtio_cancel,
-	/*
-	 * We leave one entry for input and one entry for response
-	 * headers. We also skip one more entry to accomodate, address
-	 * that are not at page boundary, that can result in an extra
-	 * page in zero copy.
-	 */
-	.maxsize = PAGE_SIZE * (VIRTQUEUE_NUM - 3),
+	/* the limit of each channel is applied by p9_virtio_create() */
+	.maxsize = PAGE_SIZE * (VIRTIO_9P_MAX_SG - 3),
+	.vmalloc_bufs = true,
 	.def = 1,
 	.owner = THIS_MODULE,
 };
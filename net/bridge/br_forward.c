@@ -93,6 +93,7 @@ static void __br_forward(const struct net_bridge_port *to,
 		}
 		br_hook = NF_BR_FORWARD;
 		skb_forward_csum(skb);
+		skb->tstamp = 0;
 		net = dev_net(indev);
 	} else {
 		if (unlikely(netpoll_tx_running(to->br->dev))) {
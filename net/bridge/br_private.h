@@ -23,8 +23,6 @@
 #include <linux/rhashtable.h>
 #include <linux/refcount.h>
 
-#define BR_HASH_BITS 8
-#define BR_HASH_SIZE (1 << BR_HASH_BITS)
 
 #define BR_HOLD_TIME (1*HZ)
 
@@ -161,12 +159,17 @@ struct net_bridge_vlan_group {
 	u16				pvid;
 };
 
+struct net_bridge_fdb_key {
+	mac_addr addr;
+	u16 vlan_id;
+};
+
 struct net_bridge_fdb_entry {
-	struct hlist_node		hlist;
+	struct rhash_head		rhnode;
 	struct net_bridge_port		*dst;
 
-	mac_addr			addr;
-	__u16				vlan_id;
+	struct net_bridge_fdb_key	key;
+	struct hlist_node		fdb_node;
 	unsigned char			is_local:1,
 					is_static:1,
 					added_by_user:1,
@@ -307,7 +310,7 @@ struct net_bridge {
 	struct net_bridge_vlan_group	__rcu *vlgrp;
 #endif
 
-	struct hlist_head		hash[BR_HASH_SIZE];
+	struct rhashtable		fdb_hash_tbl;
 #if IS_ENABLED(CONFIG_BRIDGE_NETFILTER)
 	union {
 		struct rtable		fake_rtable;
@@ -390,6 +393,7 @@ struct net_bridge {
 	struct timer_list		tcn_timer;
 	struct timer_list		topology_change_timer;
 	struct delayed_work		gc_work;
+	struct hlist_head		fdb_list;
 	struct kobject			*ifobj;
 	u32				auto_cnt;
 
@@ -506,6 +510,8 @@ static inline void br_netpoll_disable(struct net_bridge_port *p)
 /* br_fdb.c */
 int br_fdb_init(void);
 void br_fdb_fini(void);
+int br_fdb_hash_init(struct net_bridge *br);
+void br_fdb_hash_fini(struct net_bridge *br);
 void br_fdb_flush(struct net_bridge *br);
 void br_fdb_find_delete_local(struct net_bridge *br,
 			      const struct net_bridge_port *p,
@@ -230,6 +230,7 @@ enum {
 	Opt_mount_timeout,
 	Opt_osd_idle_ttl,
 	Opt_osd_request_timeout,
+	Opt_osd_conns,
 	Opt_last_int,
 	/* int args above */
 	Opt_fsid,
@@ -257,6 +258,7 @@ static match_table_t opt_tokens = {
 	{Opt_mount_timeout, "mount_timeout=%d"},
 	{Opt_osd_idle_ttl, "osd_idle_ttl=%d"},
 	{Opt_osd_request_timeout, "osd_request_timeout=%d"},
+	{Opt_osd_conns, "osd_conns=%d"},
 	/* int args above */
 	{Opt_fsid, "fsid=%s"},
 	{Opt_name, "name=%s"},
@@ -363,6 +365,7 @@ ceph_parse_options(char *options, const char *dev_name,
 	opt->mount_timeout = CEPH_MOUNT_TIMEOUT_DEFAULT;
 	opt->osd_idle_ttl = CEPH_OSD_IDLE_TTL_DEFAULT;
 	opt->osd_request_timeout = CEPH_OSD_REQUEST_TIMEOUT_DEFAULT;
+	opt->osd_conns = CEPH_OSD_CONNS_DEFAULT;
 
 	/* get mon ip(s) */
 	/* ip1[:port1][,ip2[:port2]...] */
@@ -484,6 +487,14 @@ ceph_parse_options(char *options, const char *dev_name,
 			}
 			opt->osd_request_timeout = msecs_to_jiffies(intval * 1000);
 			break;
+		case Opt_osd_conns:
+			if (intval < 1 || intval > CEPH_OSD_MAX_CONNS) {
+				pr_err("osd_conns out of range\n");
+				err = -EINVAL;
+				goto out;
+			}
+			opt->osd_conns = intval;
+			break;
 
 		case Opt_share:
 			opt->flags &= ~CEPH_OPT_NOSHARE;
@@ -571,6 +582,8 @@ int ceph_print_client_options(struct seq_file *m, struct ceph_client *client)
 	if (opt->osd_request_timeout != CEPH_OSD_REQUEST_TIMEOUT_DEFAULT)
 		seq_printf(m, "osd_request_timeout=%d,",
 			   jiffies_to_msecs(opt->osd_request_timeout) / 1000);
+	if (opt->osd_conns != CEPH_OSD_CONNS_DEFAULT)
+		seq_printf(m, "osd_conns=%d,", opt->osd_conns);
 
 	/* drop redundant comma */
 	if (m->count != pos)
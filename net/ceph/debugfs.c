@@ -344,6 +344,7 @@ static int osdc_show(struct seq_file *s, void *pp)
 	seq_printf(s, "REQUESTS %d homeless %d\n",
 		   atomic_read(&osdc->num_requests),
 		   atomic_read(&osdc->num_homeless));
+	seq_printf(s, "CONNECTIONS %d per osd\n", osdc->num_conns);
 	for (n = rb_first(&osdc->osds); n; n = rb_next(n)) {
 		struct ceph_osd *osd = rb_entry(n, struct ceph_osd, o_node);
 
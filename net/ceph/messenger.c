@@ -754,6 +754,7 @@ void ceph_con_init(struct ceph_connection *con, void *private,
 	con->private = private;
 	con->ops = ops;
 	con->msgr = msgr;
+	con->work_cpu = WORK_CPU_UNBOUND;
 
 	con_sock_state_init(con);
 
@@ -2776,12 +2777,16 @@ static int try_read(struct ceph_connection *con)
  */
 static int queue_con_delay(struct ceph_connection *con, unsigned long delay)
 {
+	int cpu = con->work_cpu;
+
 	if (!con->ops->get(con)) {
 		dout("%s %p ref count 0\n", __func__, con);
 		return -ENOENT;
 	}
 
-	if (!queue_delayed_work(ceph_msgr_wq, &con->work, delay)) {
+	if (cpu != WORK_CPU_UNBOUND && !cpu_online(cpu))
+		cpu = WORK_CPU_UNBOUND;
+	if (!queue_delayed_work_on(cpu, ceph_msgr_wq, &con->work, delay)) {
 		dout("%s %p - already queued\n", __func__, con);
 		con->ops->put(con);
 		return -EBUSY;
@@ -3016,6 +3021,33 @@ void ceph_messenger_init(struct ceph_messenger *msgr,
 }
 EXPORT_SYMBOL(ceph_messenger_init);
 
+/*
+ * The address of sibling @idx of the messenger at @addr: the siblings of a
+ * messenger use the nonces following its own, so that all the addresses of
+ * a client can be derived from its main one, e.g. to blacklist it.
+ */
+void ceph_addr_sibling(struct ceph_entity_addr *addr, int idx)
+{
+	addr->nonce = cpu_to_le32(le32_to_cpu(addr->nonce) + idx);
+}
+EXPORT_SYMBOL(ceph_addr_sibling);
+
+/*
+ * A sibling messenger has its own address, the peers see its connections
+ * as coming from another instance of the client.  It shares the name, the
+ * options and the features of @parent.
+ */
+void ceph_messenger_init_sibling(struct ceph_messenger *msgr,
+				 struct ceph_messenger *parent, int idx)
+{
+	ceph_messenger_init(msgr, &parent->inst.addr);
+	msgr->parent = parent;
+	msgr->inst.addr.nonce = parent->inst.addr.nonce;
+	ceph_addr_sibling(&msgr->inst.addr, idx);
+	encode_my_addr(msgr);
+}
+EXPORT_SYMBOL(ceph_messenger_init_sibling);
+
 void ceph_messenger_fini(struct ceph_messenger *msgr)
 {
 	put_net(read_pnet(&msgr->net));
@@ -3049,7 +3081,7 @@ static void clear_standby(struct ceph_connection *con)
 void ceph_con_send(struct ceph_connection *con, struct ceph_msg *msg)
 {
 	/* set src+dst */
-	msg->hdr.src = con->msgr->inst.name;
+	msg->hdr.src = (con->msgr->parent ?: con->msgr)->inst.name;
 	BUG_ON(msg->front.iov_len != le32_to_cpu(msg->hdr.front_len));
 	msg->needs_out_seq = true;
 
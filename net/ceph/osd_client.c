@@ -20,6 +20,7 @@
 #include <linux/ceph/decode.h>
 #include <linux/ceph/auth.h>
 #include <linux/ceph/pagelist.h>
+#include <linux/ceph/ceph_hash.h>
 
 #define OSD_OPREPLY_FRONT_LEN	512
 
@@ -1034,18 +1035,33 @@ static void osd_cleanup(struct ceph_osd *osd)
 	WARN_ON(!list_empty(&osd->o_osd_lru));
 	WARN_ON(!list_empty(&osd->o_keepalive_item));
 
-	if (osd->o_auth.authorizer) {
+	if (osd->o_conns) {
+		int i;
+
 		WARN_ON(osd_homeless(osd));
-		ceph_auth_destroy_authorizer(osd->o_auth.authorizer);
+		for (i = 0; i < osd->o_osdc->num_conns; i++) {
+			struct ceph_auth_handshake *auth =
+						&osd->o_conns[i].auth;
+
+			if (auth->authorizer)
+				ceph_auth_destroy_authorizer(auth->authorizer);
+		}
+		kfree(osd->o_conns);
 	}
 }
 
+static struct ceph_connection *osd_con(struct ceph_osd *osd, int i)
+{
+	return &osd->o_conns[i].con;
+}
+
 /*
  * Track open sessions with osds.
  */
 static struct ceph_osd *create_osd(struct ceph_osd_client *osdc, int onum)
 {
 	struct ceph_osd *osd;
+	int i;
 
 	WARN_ON(onum == CEPH_HOMELESS_OSD);
 
@@ -1054,7 +1070,22 @@ static struct ceph_osd *create_osd(struct ceph_osd_client *osdc, int onum)
 	osd->o_osdc = osdc;
 	osd->o_osd = onum;
 
-	ceph_con_init(&osd->o_con, osd, &osd_con_ops, &osdc->client->msgr);
+	osd->o_conns = kcalloc(osdc->num_conns, sizeof(*osd->o_conns),
+			       GFP_NOIO | __GFP_NOFAIL);
+	for (i = 0; i < osdc->num_conns; i++) {
+		struct ceph_messenger *msgr = &osdc->client->msgr;
+		struct ceph_connection *con = osd_con(osd, i);
+
+		if (i)
+			msgr = &osdc->conn_msgrs[i - 1];
+		ceph_con_init(con, osd, &osd_con_ops, msgr);
+
+		/* spread the work of the connections over the cpus */
+		if (osdc->num_conns > 1)
+			con->work_cpu = cpumask_local_spread(
+				atomic_inc_return(&osdc->conn_cpu_seq),
+				NUMA_NO_NODE);
+	}
 
 	return osd;
 }
@@ -1124,11 +1155,13 @@ static void close_osd(struct ceph_osd *osd)
 {
 	struct ceph_osd_client *osdc = osd->o_osdc;
 	struct rb_node *n;
+	int i;
 
 	verify_osdc_wrlocked(osdc);
 	dout("%s osd %p osd%d\n", __func__, osd, osd->o_osd);
 
-	ceph_con_close(&osd->o_con);
+	for (i = 0; i < osdc->num_conns; i++)
+		ceph_con_close(osd_con(osd, i));
 
 	for (n = rb_first(&osd->o_requests); n; ) {
 		struct ceph_osd_request *req =
@@ -1164,6 +1197,7 @@ static void close_osd(struct ceph_osd *osd)
 static int reopen_osd(struct ceph_osd *osd)
 {
 	struct ceph_entity_addr *peer_addr;
+	int i;
 
 	dout("%s osd %p osd%d\n", __func__, osd, osd->o_osd);
 
@@ -1174,8 +1208,9 @@ static int reopen_osd(struct ceph_osd *osd)
 	}
 
 	peer_addr = &osd->o_osdc->osdmap->osd_addr[osd->o_osd];
-	if (!memcmp(peer_addr, &osd->o_con.peer_addr, sizeof (*peer_addr)) &&
-			!ceph_con_opened(&osd->o_con)) {
+	if (!memcmp(peer_addr, &osd_con(osd, 0)->peer_addr,
+		    sizeof (*peer_addr)) &&
+			!ceph_con_opened(osd_con(osd, 0))) {
 		struct rb_node *n;
 
 		dout("osd addr hasn't changed and connection never opened, "
@@ -1190,8 +1225,12 @@ static int reopen_osd(struct ceph_osd *osd)
 		return -EAGAIN;
 	}
 
-	ceph_con_close(&osd->o_con);
-	ceph_con_open(&osd->o_con, CEPH_ENTITY_TYPE_OSD, osd->o_osd, peer_addr);
+	/* the requests are resent, whichever connection they were on */
+	for (i = 0; i < osd->o_osdc->num_conns; i++) {
+		ceph_con_close(osd_con(osd, i));
+		ceph_con_open(osd_con(osd, i), CEPH_ENTITY_TYPE_OSD,
+			      osd->o_osd, peer_addr);
+	}
 	osd->o_incarnation++;
 
 	return 0;
@@ -1201,6 +1240,7 @@ static struct ceph_osd *lookup_create_osd(struct ceph_osd_client *osdc, int o,
 					  bool wrlocked)
 {
 	struct ceph_osd *osd;
+	int i;
 
 	if (wrlocked)
 		verify_osdc_wrlocked(osdc);
@@ -1217,8 +1257,10 @@ static struct ceph_osd *lookup_create_osd(struct ceph_osd_client *osdc, int o,
 
 		osd = create_osd(osdc, o);
 		insert_osd(&osdc->osds, osd);
-		ceph_con_open(&osd->o_con, CEPH_ENTITY_TYPE_OSD, osd->o_osd,
-			      &osdc->osdmap->osd_addr[osd->o_osd]);
+		for (i = 0; i < osdc->num_conns; i++)
+			ceph_con_open(osd_con(osd, i), CEPH_ENTITY_TYPE_OSD,
+				      osd->o_osd,
+				      &osdc->osdmap->osd_addr[osd->o_osd]);
 	}
 
 	dout("%s osdc %p osd%d -> osd %p\n", __func__, osdc, o, osd);
@@ -2029,6 +2071,37 @@ static void encode_request_finish(struct ceph_msg *msg)
 	     le16_to_cpu(msg->hdr.version));
 }
 
+/*
+ * The requests are striped over the connections of a session by object
+ * name, so that those to an object stay ordered.  The lingering requests
+ * and the class method calls go to the first connection: its address is
+ * the main one of the client, that the watches and locks are registered
+ * with and that rbd blacklists when breaking a lock.
+ */
+static int req_conn(struct ceph_osd_request *req)
+{
+	struct ceph_osd_client *osdc = req->r_osdc;
+	struct ceph_object_id *oid = &req->r_t.target_oid;
+	unsigned int i;
+
+	if (osdc->num_conns == 1 || req->r_linger)
+		return 0;
+
+	for (i = 0; i < req->r_num_ops; i++) {
+		switch (req->r_ops[i].op) {
+		case CEPH_OSD_OP_CALL:
+		case CEPH_OSD_OP_WATCH:
+		case CEPH_OSD_OP_NOTIFY:
+		case CEPH_OSD_OP_NOTIFY_ACK:
+		case CEPH_OSD_OP_LIST_WATCHERS:
+			return 0;
+		}
+	}
+
+	return ceph_str_hash(CEPH_STR_HASH_RJENKINS, oid->name,
+			     oid->name_len) % osdc->num_conns;
+}
+
 /*
  * @req has to be assigned a tid and registered.
  */
@@ -2070,7 +2143,8 @@ static void send_request(struct ceph_osd_request *req)
 
 	req->r_sent = osd->o_incarnation;
 	req->r_request->hdr.tid = cpu_to_le64(req->r_tid);
-	ceph_con_send(&osd->o_con, ceph_msg_get(req->r_request));
+	ceph_con_send(osd_con(osd, req_conn(req)),
+		      ceph_msg_get(req->r_request));
 }
 
 static void maybe_request_map(struct ceph_osd_client *osdc)
@@ -3069,6 +3143,7 @@ static void handle_timeout(struct work_struct *work)
 	unsigned long expiry_cutoff = jiffies - opts->osd_request_timeout;
 	LIST_HEAD(slow_osds);
 	struct rb_node *n, *p;
+	int i;
 
 	dout("%s osdc %p\n", __func__, osdc);
 	down_write(&osdc->lock);
@@ -3141,7 +3216,8 @@ static void handle_timeout(struct work_struct *work)
 							struct ceph_osd,
 							o_keepalive_item);
 		list_del_init(&osd->o_keepalive_item);
-		ceph_con_keepalive(&osd->o_con);
+		for (i = 0; i < osdc->num_conns; i++)
+			ceph_con_keepalive(osd_con(osd, i));
 	}
 
 	up_write(&osdc->lock);
@@ -3595,7 +3671,8 @@ static void scan_requests(struct ceph_osd *osd,
 		n = rb_next(n); /* unlink_request(), check_pool_dne() */
 
 		dout("%s req %p tid %llu\n", __func__, req, req->r_tid);
-		ct_res = calc_target(osdc, &req->r_t, &req->r_osd->o_con,
+		ct_res = calc_target(osdc, &req->r_t,
+				     osd->o_conns ? osd_con(osd, 0) : NULL,
 				     false);
 		switch (ct_res) {
 		case CALC_TARGET_NO_ACTION:
@@ -3680,7 +3757,7 @@ static int handle_one_map(struct ceph_osd_client *osdc,
 		scan_requests(osd, skipped_map, was_full, true, need_resend,
 			      need_resend_linger);
 		if (!ceph_osd_is_up(osdc->osdmap, osd->o_osd) ||
-		    memcmp(&osd->o_con.peer_addr,
+		    memcmp(&osd_con(osd, 0)->peer_addr,
 			   ceph_osd_addr(osdc->osdmap, osd->o_osd),
 			   sizeof(struct ceph_entity_addr)))
 			close_osd(osd);
@@ -4007,7 +4084,9 @@ static struct ceph_msg *create_backoff_message(
 	return msg;
 }
 
-static void handle_backoff_block(struct ceph_osd *osd, struct MOSDBackoff *m)
+static void handle_backoff_block(struct ceph_osd *osd,
+				 struct ceph_connection *con,
+				 struct MOSDBackoff *m)
 {
 	struct ceph_spg_mapping *spg;
 	struct ceph_osd_backoff *backoff;
@@ -4051,7 +4130,8 @@ static void handle_backoff_block(struct ceph_osd *osd, struct MOSDBackoff *m)
 		pr_err("%s failed to allocate msg\n", __func__);
 		return;
 	}
-	ceph_con_send(&osd->o_con, msg);
+	/* the backoff belongs to the connection it came on */
+	ceph_con_send(con, msg);
 }
 
 static bool target_contained_by(const struct ceph_osd_request_target *t,
@@ -4148,7 +4228,7 @@ static void handle_backoff(struct ceph_osd *osd, struct ceph_msg *msg)
 
 	switch (m.op) {
 	case CEPH_OSD_BACKOFF_OP_BLOCK:
-		handle_backoff_block(osd, &m);
+		handle_backoff_block(osd, msg->con, &m);
 		break;
 	case CEPH_OSD_BACKOFF_OP_UNBLOCK:
 		handle_backoff_unblock(osd, &m);
@@ -4895,7 +4975,7 @@ EXPORT_SYMBOL(ceph_osdc_call);
  */
 int ceph_osdc_init(struct ceph_osd_client *osdc, struct ceph_client *client)
 {
-	int err;
+	int err, i;
 
 	dout("init\n");
 	osdc->client = client;
@@ -4937,6 +5017,11 @@ int ceph_osdc_init(struct ceph_osd_client *osdc, struct ceph_client *client)
 	if (!osdc->notify_wq)
 		goto out_msgpool_reply;
 
+	osdc->num_conns = client->options->osd_conns;
+	for (i = 1; i < osdc->num_conns; i++)
+		ceph_messenger_init_sibling(&osdc->conn_msgrs[i - 1],
+					    &client->msgr, i);
+
 	schedule_delayed_work(&osdc->timeout_work,
 			      osdc->client->options->osd_keepalive_timeout);
 	schedule_delayed_work(&osdc->osds_timeout_work,
@@ -4958,6 +5043,11 @@ int ceph_osdc_init(struct ceph_osd_client *osdc, struct ceph_client *client)
 
 void ceph_osdc_stop(struct ceph_osd_client *osdc)
 {
+	int i;
+
+	for (i = 1; i < osdc->num_conns; i++)
+		atomic_set(&osdc->conn_msgrs[i - 1].stopping, 1);
+
 	flush_workqueue(osdc->notify_wq);
 	destroy_workqueue(osdc->notify_wq);
 	cancel_delayed_work_sync(&osdc->timeout_work);
@@ -4984,6 +5074,9 @@ void ceph_osdc_stop(struct ceph_osd_client *osdc)
 	mempool_destroy(osdc->req_mempool);
 	ceph_msgpool_destroy(&osdc->msgpool_op);
 	ceph_msgpool_destroy(&osdc->msgpool_op_reply);
+
+	for (i = 1; i < osdc->num_conns; i++)
+		ceph_messenger_fini(&osdc->conn_msgrs[i - 1]);
 }
 
 /*
@@ -5260,6 +5353,11 @@ static void put_osd_con(struct ceph_connection *con)
 /*
  * authentication
  */
+static struct ceph_auth_handshake *con_auth(struct ceph_connection *con)
+{
+	return &container_of(con, struct ceph_osd_conn, con)->auth;
+}
+
 /*
  * Note: returned pointer is the address of a structure that's
  * managed separately.  Caller must *not* attempt to free it.
@@ -5270,7 +5368,7 @@ static struct ceph_auth_handshake *get_authorizer(struct ceph_connection *con,
 	struct ceph_osd *o = con->private;
 	struct ceph_osd_client *osdc = o->o_osdc;
 	struct ceph_auth_client *ac = osdc->client->monc.auth;
-	struct ceph_auth_handshake *auth = &o->o_auth;
+	struct ceph_auth_handshake *auth = con_auth(con);
 
 	if (force_new && auth->authorizer) {
 		ceph_auth_destroy_authorizer(auth->authorizer);
@@ -5299,7 +5397,7 @@ static int verify_authorizer_reply(struct ceph_connection *con)
 	struct ceph_osd_client *osdc = o->o_osdc;
 	struct ceph_auth_client *ac = osdc->client->monc.auth;
 
-	return ceph_auth_verify_authorizer_reply(ac, o->o_auth.authorizer);
+	return ceph_auth_verify_authorizer_reply(ac, con_auth(con)->authorizer);
 }
 
 static int invalidate_authorizer(struct ceph_connection *con)
@@ -5322,16 +5420,14 @@ static void osd_reencode_message(struct ceph_msg *msg)
 
 static int osd_sign_message(struct ceph_msg *msg)
 {
-	struct ceph_osd *o = msg->con->private;
-	struct ceph_auth_handshake *auth = &o->o_auth;
+	struct ceph_auth_handshake *auth = con_auth(msg->con);
 
 	return ceph_auth_sign_message(auth, msg);
 }
 
 static int osd_check_message_signature(struct ceph_msg *msg)
 {
-	struct ceph_osd *o = msg->con->private;
-	struct ceph_auth_handshake *auth = &o->o_auth;
+	struct ceph_auth_handshake *auth = con_auth(msg->con);
 
 	return ceph_auth_check_message_signature(auth, msg);
 }
@@ -607,7 +607,10 @@ int __zerocopy_sg_from_iter(struct sock *sk, struct sk_buff *skb,
 		skb->data_len += copied;
 		skb->len += copied;
 		skb->truesize += truesize;
-		if (sk && sk->sk_type == SOCK_STREAM) {
+		/* TCP does its own send memory accounting, everyone else
+		 * (including AF_UNIX streams) charges sk_wmem_alloc.
+		 */
+		if (sk && sk->sk_type == SOCK_STREAM && sk_has_account(sk)) {
 			sk->sk_wmem_queued += truesize;
 			sk_mem_charge(sk, truesize);
 		} else {
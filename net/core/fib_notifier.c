@@ -163,6 +163,7 @@ static int __net_init fib_notifier_net_init(struct net *net)
 
 static struct pernet_operations fib_notifier_net_ops = {
 	.init = fib_notifier_net_init,
+	.async = true,
 };
 
 static int __init fib_notifier_init(void)
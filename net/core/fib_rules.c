@@ -1021,6 +1021,7 @@ static int __net_init fib_rules_net_init(struct net *net)
 
 static struct pernet_operations fib_rules_net_ops = {
 	.init = fib_rules_net_init,
+	.async = true,
 };
 
 static int __init fib_rules_init(void)
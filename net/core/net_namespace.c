@@ -31,6 +31,17 @@ static LIST_HEAD(pernet_list);
 static struct list_head *first_device = &pernet_list;
 DEFINE_MUTEX(net_mutex);
 
+/*
+ * net_sem protects pernet_list and first_device: namespace setup and
+ * cleanup take it for read and may run in parallel with each other,
+ * pernet_operations (un)registration takes it for write.  net_mutex is
+ * taken on top of it around each call into an operation that does not
+ * know how to run concurrently with other namespaces' init and exit, and
+ * around net_namespace_list updates while such operations exist.
+ */
+DECLARE_RWSEM(net_sem);
+static unsigned int nr_sync_pernet_ops;
+
 LIST_HEAD(net_namespace_list);
 EXPORT_SYMBOL_GPL(net_namespace_list);
 
@@ -65,11 +76,10 @@ static int net_assign_generic(struct net *net, unsigned int id, void *data)
 {
 	struct net_generic *ng, *old_ng;
 
-	BUG_ON(!mutex_is_locked(&net_mutex));
 	BUG_ON(id < MIN_PERNET_OPS_ID);
 
 	old_ng = rcu_dereference_protected(net->gen,
-					   lockdep_is_held(&net_mutex));
+					   lockdep_is_held(&net_sem));
 	if (old_ng->s.len > id) {
 		old_ng->ptr[id] = data;
 		return 0;
@@ -155,6 +165,18 @@ static void ops_free_list(const struct pernet_operations *ops,
 	}
 }
 
+static void pernet_ops_lock(const struct pernet_operations *ops)
+{
+	if (!ops->async)
+		mutex_lock(&net_mutex);
+}
+
+static void pernet_ops_unlock(const struct pernet_operations *ops)
+{
+	if (!ops->async)
+		mutex_unlock(&net_mutex);
+}
+
 /* should be called with nsid_lock held */
 static int alloc_netid(struct net *net, struct net *peer, int reqid)
 {
@@ -278,7 +300,7 @@ struct net *get_net_ns_by_id(struct net *net, int id)
  */
 static __net_init int setup_net(struct net *net, struct user_namespace *user_ns)
 {
-	/* Must be called with net_mutex held */
+	/* Must be called with net_sem held */
 	const struct pernet_operations *ops, *saved_ops;
 	int error = 0;
 	LIST_HEAD(net_exit_list);
@@ -291,7 +313,9 @@ static __net_init int setup_net(struct net *net, struct user_namespace *user_ns)
 	spin_lock_init(&net->nsid_lock);
 
 	list_for_each_entry(ops, &pernet_list, list) {
+		pernet_ops_lock(ops);
 		error = ops_init(ops, net);
+		pernet_ops_unlock(ops);
 		if (error < 0)
 			goto out_undo;
 	}
@@ -304,12 +328,18 @@ static __net_init int setup_net(struct net *net, struct user_namespace *user_ns)
 	 */
 	list_add(&net->exit_list, &net_exit_list);
 	saved_ops = ops;
-	list_for_each_entry_continue_reverse(ops, &pernet_list, list)
+	list_for_each_entry_continue_reverse(ops, &pernet_list, list) {
+		pernet_ops_lock(ops);
 		ops_exit_list(ops, &net_exit_list);
+		pernet_ops_unlock(ops);
+	}
 
 	ops = saved_ops;
-	list_for_each_entry_continue_reverse(ops, &pernet_list, list)
+	list_for_each_entry_continue_reverse(ops, &pernet_list, list) {
+		pernet_ops_lock(ops);
 		ops_free_list(ops, &net_exit_list);
+		pernet_ops_unlock(ops);
+	}
 
 	rcu_barrier();
 	goto out;
@@ -323,6 +353,7 @@ static int __net_init net_defaults_init_net(struct net *net)
 
 static struct pernet_operations net_defaults_ops = {
 	.init = net_defaults_init_net,
+	.async = true,
 };
 
 static __init int net_defaults_init(void)
@@ -406,22 +437,22 @@ struct net *copy_net_ns(unsigned long flags,
 
 	get_user_ns(user_ns);
 
-	rv = mutex_lock_killable(&net_mutex);
-	if (rv < 0) {
-		net_free(net);
-		dec_net_namespaces(ucounts);
-		put_user_ns(user_ns);
-		return ERR_PTR(rv);
-	}
-
+	down_read(&net_sem);
 	net->ucounts = ucounts;
 	rv = setup_net(net, user_ns);
 	if (rv == 0) {
+		/* Synchronous operations may walk the namespace list under
+		 * net_mutex alone, so keep publishing under it for them.
+		 */
+		if (nr_sync_pernet_ops)
+			mutex_lock(&net_mutex);
 		rtnl_lock();
 		list_add_tail_rcu(&net->list, &net_namespace_list);
 		rtnl_unlock();
+		if (nr_sync_pernet_ops)
+			mutex_unlock(&net_mutex);
 	}
-	mutex_unlock(&net_mutex);
+	up_read(&net_sem);
 	if (rv < 0) {
 		dec_net_namespaces(ucounts);
 		put_user_ns(user_ns);
@@ -446,7 +477,9 @@ static void cleanup_net(struct work_struct *work)
 	list_replace_init(&cleanup_list, &net_kill_list);
 	spin_unlock_irq(&cleanup_list_lock);
 
-	mutex_lock(&net_mutex);
+	down_read(&net_sem);
+	if (nr_sync_pernet_ops)
+		mutex_lock(&net_mutex);
 
 	/* Don't let anyone else find us. */
 	rtnl_lock();
@@ -470,6 +503,8 @@ static void cleanup_net(struct work_struct *work)
 
 	}
 	rtnl_unlock();
+	if (nr_sync_pernet_ops)
+		mutex_unlock(&net_mutex);
 
 	/*
 	 * Another CPU might be rcu-iterating the list, wait for it.
@@ -479,14 +514,19 @@ static void cleanup_net(struct work_struct *work)
 	synchronize_rcu();
 
 	/* Run all of the network namespace exit methods */
-	list_for_each_entry_reverse(ops, &pernet_list, list)
+	list_for_each_entry_reverse(ops, &pernet_list, list) {
+		pernet_ops_lock(ops);
 		ops_exit_list(ops, &net_exit_list);
+		pernet_ops_unlock(ops);
+	}
 
 	/* Free the net generic variables */
-	list_for_each_entry_reverse(ops, &pernet_list, list)
+	list_for_each_entry_reverse(ops, &pernet_list, list) {
+		pernet_ops_lock(ops);
 		ops_free_list(ops, &net_exit_list);
-
-	mutex_unlock(&net_mutex);
+		pernet_ops_unlock(ops);
+	}
+	up_read(&net_sem);
 
 	/* Ensure there are no outstanding rcu callbacks using this
 	 * network namespace.
@@ -513,8 +553,8 @@ static void cleanup_net(struct work_struct *work)
  */
 void net_ns_barrier(void)
 {
-	mutex_lock(&net_mutex);
-	mutex_unlock(&net_mutex);
+	down_write(&net_sem);
+	up_write(&net_sem);
 }
 EXPORT_SYMBOL(net_ns_barrier);
 
@@ -599,6 +639,7 @@ static __net_exit void net_ns_net_exit(struct net *net)
 static struct pernet_operations __net_initdata net_ns_ops = {
 	.init = net_ns_net_init,
 	.exit = net_ns_net_exit,
+	.async = true,
 };
 
 static const struct nla_policy rtnl_net_policy[NETNSA_MAX + 1] = {
@@ -841,7 +882,7 @@ static int __init net_ns_init(void)
 
 	rcu_assign_pointer(init_net.gen, ng);
 
-	mutex_lock(&net_mutex);
+	down_write(&net_sem);
 	if (setup_net(&init_net, &init_user_ns))
 		panic("Could not setup the initial network namespace");
 
@@ -851,7 +892,7 @@ static int __init net_ns_init(void)
 	list_add_tail_rcu(&init_net.list, &net_namespace_list);
 	rtnl_unlock();
 
-	mutex_unlock(&net_mutex);
+	up_write(&net_sem);
 
 	register_pernet_subsys(&net_ns_ops);
 
@@ -955,6 +996,8 @@ static int register_pernet_operations(struct list_head *list,
 		rcu_barrier();
 		if (ops->id)
 			ida_remove(&net_generic_ids, *ops->id);
+	} else if (!ops->async) {
+		nr_sync_pernet_ops++;
 	}
 
 	return error;
@@ -962,11 +1005,12 @@ static int register_pernet_operations(struct list_head *list,
 
 static void unregister_pernet_operations(struct pernet_operations *ops)
 {
-	
 	__unregister_pernet_operations(ops);
 	rcu_barrier();
 	if (ops->id)
 		ida_remove(&net_generic_ids, *ops->id);
+	if (!ops->async)
+		nr_sync_pernet_ops--;
 }
 
 /**
@@ -987,13 +1031,18 @@ static void unregister_pernet_operations(struct pernet_operations *ops)
  *	When a network namespace is destroyed all of the exit methods
  *	are called in the reverse of the order with which they were
  *	registered.
+ *
+ *	Operations that set @ops->async must cope with their init and
+ *	exit methods running concurrently for different namespaces;
+ *	each call into any other operation is made under net_mutex, so
+ *	those stay serialised against each other.
  */
 int register_pernet_subsys(struct pernet_operations *ops)
 {
 	int error;
-	mutex_lock(&net_mutex);
+	down_write(&net_sem);
 	error =  register_pernet_operations(first_device, ops);
-	mutex_unlock(&net_mutex);
+	up_write(&net_sem);
 	return error;
 }
 EXPORT_SYMBOL_GPL(register_pernet_subsys);
@@ -1009,9 +1058,9 @@ EXPORT_SYMBOL_GPL(register_pernet_subsys);
  */
 void unregister_pernet_subsys(struct pernet_operations *ops)
 {
-	mutex_lock(&net_mutex);
+	down_write(&net_sem);
 	unregister_pernet_operations(ops);
-	mutex_unlock(&net_mutex);
+	up_write(&net_sem);
 }
 EXPORT_SYMBOL_GPL(unregister_pernet_subsys);
 
@@ -1037,11 +1086,11 @@ EXPORT_SYMBOL_GPL(unregister_pernet_subsys);
 int register_pernet_device(struct pernet_operations *ops)
 {
 	int error;
-	mutex_lock(&net_mutex);
+	down_write(&net_sem);
 	error = register_pernet_operations(&pernet_list, ops);
 	if (!error && (first_device == &pernet_list))
 		first_device = &ops->list;
-	mutex_unlock(&net_mutex);
+	up_write(&net_sem);
 	return error;
 }
 EXPORT_SYMBOL_GPL(register_pernet_device);
@@ -1057,11 +1106,11 @@ EXPORT_SYMBOL_GPL(register_pernet_device);
  */
 void unregister_pernet_device(struct pernet_operations *ops)
 {
-	mutex_lock(&net_mutex);
+	down_write(&net_sem);
 	if (&ops->list == first_device)
 		first_device = first_device->next;
 	unregister_pernet_operations(ops);
-	mutex_unlock(&net_mutex);
+	up_write(&net_sem);
 }
 EXPORT_SYMBOL_GPL(unregister_pernet_device);
 
@@ -93,6 +93,10 @@ struct fib_table *fib_new_table(struct net *net, u32 id)
 	if (!tb)
 		return NULL;
 
+	/* without it lookups simply walk the trie */
+	if (net->ipv4.sysctl_fib_lookup_accel)
+		fib_table_accel_enable(tb);
+
 	switch (id) {
 	case RT_TABLE_MAIN:
 		rcu_assign_pointer(net->ipv4.fib_main, tb);
@@ -171,6 +175,9 @@ int fib_unmerge(struct net *net)
 	fib_replace_table(net, old, new);
 	fib_free_table(old);
 
+	if (net->ipv4.sysctl_fib_lookup_accel)
+		fib_table_accel_enable(new);
+
 	/* attempt to fetch main table if it has been allocated */
 	main_table = fib_get_table(net, RT_TABLE_MAIN);
 	if (!main_table)
@@ -200,6 +207,29 @@ static void fib_flush(struct net *net)
 		rt_cache_flush(net);
 }
 
+/* Build or drop the lookup accelerator of every table to follow
+ * net.ipv4.fib_lookup_accel.  Caller must hold RTNL.
+ */
+int fib_lookup_accel_update(struct net *net)
+{
+	unsigned int h;
+	int err = 0;
+
+	for (h = 0; h < FIB_TABLE_HASHSZ; h++) {
+		struct hlist_head *head = &net->ipv4.fib_table_hash[h];
+		struct fib_table *tb;
+
+		hlist_for_each_entry(tb, head, tb_hlist) {
+			if (!net->ipv4.sysctl_fib_lookup_accel)
+				fib_table_accel_disable(tb);
+			else if (!err)
+				err = fib_table_accel_enable(tb);
+		}
+	}
+
+	return err;
+}
+
 /*
  * Find address type as if only "dev" was present in the system. If
  * on_dev is NULL then all interfaces are taken into consideration.
@@ -1337,6 +1367,7 @@ static void __net_exit fib_net_exit(struct net *net)
 static struct pernet_operations fib_net_ops = {
 	.init = fib_net_init,
 	.exit = fib_net_exit,
+	.async = true,
 };
 
 void __init ip_fib_init(void)
@@ -73,6 +73,7 @@
 #include <linux/slab.h>
 #include <linux/export.h>
 #include <linux/vmalloc.h>
+#include <linux/workqueue.h>
 #include <linux/notifier.h>
 #include <net/net_namespace.h>
 #include <net/ip.h>
@@ -174,8 +175,31 @@ struct trie_stat {
 	unsigned int nodesizes[MAX_STAT_DEPTH];
 };
 
+/* Optional multibit lookup accelerator, indexed 16-8-8 by the key.
+ * Every slot resolves to the leaf holding the longest prefix that covers
+ * the whole block of addresses behind it, or to a chunk of 256 slots for
+ * the next 8 bits when longer prefixes live inside the block.  Chunks
+ * are tagged in bit 0 of the slot.
+ */
+#define FIB_ACCEL_L1_BITS	16
+#define FIB_ACCEL_L1_SIZE	(1U << FIB_ACCEL_L1_BITS)
+#define FIB_ACCEL_STRIDE	8
+#define FIB_ACCEL_CHUNK_SIZE	(1U << FIB_ACCEL_STRIDE)
+#define FIB_ACCEL_CHUNK		1UL
+
+struct fib_accel_chunk {
+	void __rcu *slot[FIB_ACCEL_CHUNK_SIZE];
+};
+
+struct fib_accel {
+	struct rcu_head rcu;
+	struct work_struct work;
+	void __rcu *tbl[FIB_ACCEL_L1_SIZE];
+};
+
 struct trie {
 	struct key_vector kv[1];
+	struct fib_accel __rcu *accel;
 #ifdef CONFIG_IP_FIB_TRIE_STATS
 	struct trie_use_stats __percpu *stats;
 #endif
@@ -1100,6 +1124,277 @@ static int fib_insert_alias(struct trie *t, struct key_vector *tp,
 	return 0;
 }
 
+static inline bool fib_accel_is_chunk(const void *v)
+{
+	return (unsigned long)v & FIB_ACCEL_CHUNK;
+}
+
+static inline struct fib_accel_chunk *fib_accel_chunk(const void *v)
+{
+	return (struct fib_accel_chunk *)((unsigned long)v & ~FIB_ACCEL_CHUNK);
+}
+
+/* index of the slot for key in a table whose slots cover depth bits */
+static inline unsigned int fib_accel_index(t_key key, int depth)
+{
+	if (depth == FIB_ACCEL_L1_BITS)
+		return key >> (KEYLENGTH - FIB_ACCEL_L1_BITS);
+
+	return (key >> (KEYLENGTH - depth)) & (FIB_ACCEL_CHUNK_SIZE - 1);
+}
+
+/* Length of the longest prefix in leaf l, no longer than max, that
+ * covers key, or -1 if there is none.
+ */
+static int fib_accel_cover(struct key_vector *l, t_key key, int max)
+{
+	struct fib_alias *fa;
+
+	hlist_for_each_entry(fa, &l->leaf, fa_list) {
+		if (KEYLENGTH - fa->fa_slen > max)
+			continue;
+		if (fa->fa_slen < KEYLENGTH && ((key ^ l->key) >> fa->fa_slen))
+			continue;
+		return KEYLENGTH - fa->fa_slen;
+	}
+
+	return -1;
+}
+
+static void fib_accel_free_slots(void __rcu **slots, unsigned int size)
+{
+	unsigned int i;
+
+	for (i = 0; i < size; i++) {
+		void *v = rcu_dereference_protected(slots[i], 1);
+
+		if (fib_accel_is_chunk(v)) {
+			struct fib_accel_chunk *c = fib_accel_chunk(v);
+
+			fib_accel_free_slots(c->slot, FIB_ACCEL_CHUNK_SIZE);
+			kfree(c);
+		}
+	}
+}
+
+static void fib_accel_free(struct fib_accel *acc)
+{
+	fib_accel_free_slots(acc->tbl, FIB_ACCEL_L1_SIZE);
+	kvfree(acc);
+}
+
+static void fib_accel_free_work(struct work_struct *work)
+{
+	fib_accel_free(container_of(work, struct fib_accel, work));
+}
+
+static void fib_accel_free_rcu(struct rcu_head *head)
+{
+	struct fib_accel *acc = container_of(head, struct fib_accel, rcu);
+
+	/* too much to walk and free from softirq context */
+	INIT_WORK(&acc->work, fib_accel_free_work);
+	schedule_work(&acc->work);
+}
+
+/* Caller must hold RTNL. */
+static void fib_accel_release(struct trie *t)
+{
+	struct fib_accel *acc = rtnl_dereference(t->accel);
+
+	if (!acc)
+		return;
+
+	RCU_INIT_POINTER(t->accel, NULL);
+	call_rcu(&acc->rcu, fib_accel_free_rcu);
+}
+
+/* Return the table holding the slots of a prefix of length plen and
+ * the depth it resolves, splitting slots into chunks on the way down
+ * if alloc is set.
+ */
+static void __rcu **fib_accel_slots(struct fib_accel *acc, t_key key,
+				    int plen, int *depth, bool alloc)
+{
+	void __rcu **slots = acc->tbl;
+	int d = FIB_ACCEL_L1_BITS;
+
+	while (plen > d) {
+		void __rcu **slot = &slots[fib_accel_index(key, d)];
+		void *v = rtnl_dereference(*slot);
+		struct fib_accel_chunk *c;
+
+		if (!fib_accel_is_chunk(v)) {
+			unsigned int i;
+
+			if (!alloc)
+				return NULL;
+
+			c = kmalloc(sizeof(*c), GFP_KERNEL);
+			if (!c)
+				return NULL;
+
+			/* the old slot value covers all of the new block */
+			for (i = 0; i < FIB_ACCEL_CHUNK_SIZE; i++)
+				RCU_INIT_POINTER(c->slot[i], v);
+
+			rcu_assign_pointer(*slot, (void *)((unsigned long)c |
+							   FIB_ACCEL_CHUNK));
+		} else {
+			c = fib_accel_chunk(v);
+		}
+
+		slots = c->slot;
+		d += FIB_ACCEL_STRIDE;
+	}
+
+	*depth = d;
+	return slots;
+}
+
+/* Point the slot for the block at key of the given depth, and the
+ * chunks below it, at leaf l unless they resolve to a longer prefix.
+ */
+static void fib_accel_fill(void __rcu **slot, t_key key, int depth,
+			   struct key_vector *l, int plen)
+{
+	void *v = rtnl_dereference(*slot);
+
+	if (fib_accel_is_chunk(v)) {
+		struct fib_accel_chunk *c = fib_accel_chunk(v);
+		int shift = KEYLENGTH - depth - FIB_ACCEL_STRIDE;
+		unsigned int i;
+
+		for (i = 0; i < FIB_ACCEL_CHUNK_SIZE; i++)
+			fib_accel_fill(&c->slot[i], key + ((t_key)i << shift),
+				       depth + FIB_ACCEL_STRIDE, l, plen);
+		return;
+	}
+
+	if (!v || fib_accel_cover(v, key, depth) < plen)
+		rcu_assign_pointer(*slot, l);
+}
+
+/* Hand the slots below the block at key that still resolve to leaf l
+ * over to leaf q, the holder of the next shorter prefix of length qlen,
+ * unless l keeps a longer prefix covering them.
+ */
+static void fib_accel_clear(void __rcu **slot, t_key key, int depth,
+			    struct key_vector *l, struct key_vector *q,
+			    int qlen)
+{
+	void *v = rtnl_dereference(*slot);
+
+	if (fib_accel_is_chunk(v)) {
+		struct fib_accel_chunk *c = fib_accel_chunk(v);
+		int shift = KEYLENGTH - depth - FIB_ACCEL_STRIDE;
+		unsigned int i;
+
+		for (i = 0; i < FIB_ACCEL_CHUNK_SIZE; i++)
+			fib_accel_clear(&c->slot[i], key + ((t_key)i << shift),
+					depth + FIB_ACCEL_STRIDE, l, q, qlen);
+		return;
+	}
+
+	if (v == l && fib_accel_cover(l, key, depth) <= qlen)
+		rcu_assign_pointer(*slot, q);
+}
+
+static int __fib_accel_insert(struct fib_accel *acc, struct key_vector *l,
+			      int plen)
+{
+	void __rcu **slots;
+	unsigned int i, n;
+	int depth;
+
+	slots = fib_accel_slots(acc, l->key, plen, &depth, true);
+	if (!slots)
+		return -ENOMEM;
+
+	i = fib_accel_index(l->key, depth);
+	for (n = 0; n < (1U << (depth - plen)); n++)
+		fib_accel_fill(&slots[i + n],
+			       l->key + ((t_key)n << (KEYLENGTH - depth)),
+			       depth, l, plen);
+
+	return 0;
+}
+
+/* Account for a new prefix of leaf l.  If the accelerator cannot grow
+ * it is dropped and lookups fall back to walking the trie.
+ */
+static void fib_accel_insert(struct trie *t, struct key_vector *l, int plen)
+{
+	struct fib_accel *acc = rtnl_dereference(t->accel);
+
+	if (acc && __fib_accel_insert(acc, l, plen)) {
+		pr_warn("IPv4: FIB lookup accelerator disabled, out of memory\n");
+		fib_accel_release(t);
+	}
+}
+
+/* Account for the removal of the prefix with suffix length slen from
+ * leaf l.  This must run while l is still in the trie, before it can
+ * be freed.
+ */
+static void fib_accel_remove(struct trie *t, struct key_vector *l, u8 slen)
+{
+	struct fib_accel *acc = rtnl_dereference(t->accel);
+	struct key_vector *q = NULL, *tp;
+	int plen = KEYLENGTH - slen;
+	struct fib_alias *fa;
+	void __rcu **slots;
+	unsigned int i, n;
+	int depth, qlen;
+
+	if (!acc)
+		return;
+
+	/* another alias still holds the prefix */
+	hlist_for_each_entry(fa, &l->leaf, fa_list) {
+		if (fa->fa_slen == slen)
+			return;
+	}
+
+	/* find the longest shorter prefix taking the block over */
+	for (qlen = plen - 1; qlen >= 0; qlen--) {
+		t_key qkey = 0;
+
+		if (qlen)
+			qkey = l->key & (KEY_MAX << (KEYLENGTH - qlen));
+
+		q = fib_find_node(t, &tp, qkey);
+		if (q && fib_accel_cover(q, qkey, qlen) == qlen)
+			break;
+		q = NULL;
+	}
+
+	slots = fib_accel_slots(acc, l->key, plen, &depth, false);
+	if (!slots)
+		return;
+
+	i = fib_accel_index(l->key, depth);
+	for (n = 0; n < (1U << (depth - plen)); n++)
+		fib_accel_clear(&slots[i + n],
+				l->key + ((t_key)n << (KEYLENGTH - depth)),
+				depth, l, q, qlen);
+}
+
+static inline struct key_vector *fib_accel_lookup(struct fib_accel *acc,
+						  t_key key)
+{
+	void *v = rcu_dereference(acc->tbl[fib_accel_index(key, 16)]);
+
+	if (!fib_accel_is_chunk(v))
+		return v;
+
+	v = rcu_dereference(fib_accel_chunk(v)->slot[fib_accel_index(key, 24)]);
+	if (!fib_accel_is_chunk(v))
+		return v;
+
+	return rcu_dereference(fib_accel_chunk(v)->slot[key & 0xff]);
+}
+
 static bool fib_valid_key_len(u32 key, u8 plen, struct netlink_ext_ack *extack)
 {
 	if (plen > KEYLENGTH) {
@@ -1269,6 +1564,12 @@ int fib_table_insert(struct net *net, struct fib_table *tb,
 	if (err)
 		goto out_free_new_fa;
 
+	if (rcu_access_pointer(t->accel)) {
+		if (!l)
+			l = fib_find_node(t, &tp, key);
+		fib_accel_insert(t, l, plen);
+	}
+
 	if (!plen)
 		tb->tb_num_default++;
 
@@ -1305,6 +1606,7 @@ int fib_table_lookup(struct fib_table *tb, const struct flowi4 *flp,
 #endif
 	const t_key key = ntohl(flp->daddr);
 	struct key_vector *n, *pn;
+	struct fib_accel *acc;
 	struct fib_alias *fa;
 	unsigned long index;
 	t_key cindex;
@@ -1314,6 +1616,16 @@ int fib_table_lookup(struct fib_table *tb, const struct flowi4 *flp,
 	pn = t->kv;
 	cindex = 0;
 
+	/* the accelerator resolves the longest prefix match directly */
+	acc = rcu_dereference(t->accel);
+	if (acc) {
+		n = fib_accel_lookup(acc, key);
+		if (!n)
+			return -EAGAIN;
+		goto found;
+	}
+
+walk:
 	n = get_child_rcu(pn, cindex);
 	if (!n)
 		return -EAGAIN;
@@ -1485,6 +1797,11 @@ int fib_table_lookup(struct fib_table *tb, const struct flowi4 *flp,
 #ifdef CONFIG_IP_FIB_TRIE_STATS
 	this_cpu_inc(stats->semantic_match_miss);
 #endif
+	/* let the trie find a shorter prefix that matches */
+	if (acc) {
+		acc = NULL;
+		goto walk;
+	}
 	goto backtrace;
 }
 EXPORT_SYMBOL_GPL(fib_table_lookup);
@@ -1498,6 +1815,7 @@ static void fib_remove_alias(struct trie *t, struct key_vector *tp,
 
 	/* remove the fib_alias from the list */
 	hlist_del_rcu(&old->fa_list);
+	fib_accel_remove(t, l, old->fa_slen);
 
 	/* if we emptied the list this leaf will be freed and we can sort
 	 * out parent suffix lengths as a part of trie_rebalance
@@ -1650,6 +1968,52 @@ static struct key_vector *leaf_walk_rcu(struct key_vector **tn, t_key key)
 	return n;
 }
 
+/* Caller must hold RTNL. */
+int fib_table_accel_enable(struct fib_table *tb)
+{
+	struct trie *t = (struct trie *)tb->tb_data;
+	struct key_vector *l, *tp = t->kv;
+	struct fib_accel *acc;
+	t_key key = 0;
+
+	if (rtnl_dereference(t->accel))
+		return 0;
+
+	acc = kvzalloc(sizeof(*acc), GFP_KERNEL);
+	if (!acc)
+		return -ENOMEM;
+
+	while ((l = leaf_walk_rcu(&tp, key)) != NULL) {
+		struct fib_alias *fa;
+		u8 slen = KEYLENGTH + 1;
+
+		hlist_for_each_entry(fa, &l->leaf, fa_list) {
+			if (fa->fa_slen == slen)
+				continue;
+			slen = fa->fa_slen;
+
+			if (__fib_accel_insert(acc, l, KEYLENGTH - slen)) {
+				fib_accel_free(acc);
+				return -ENOMEM;
+			}
+		}
+
+		/* stop loop if key wrapped back to 0 */
+		key = l->key + 1;
+		if (key < l->key)
+			break;
+	}
+
+	rcu_assign_pointer(t->accel, acc);
+	return 0;
+}
+
+/* Caller must hold RTNL. */
+void fib_table_accel_disable(struct fib_table *tb)
+{
+	fib_accel_release((struct trie *)tb->tb_data);
+}
+
 static void fib_trie_free(struct fib_table *tb)
 {
 	struct trie *t = (struct trie *)tb->tb_data;
@@ -1817,6 +2181,7 @@ void fib_table_flush_external(struct fib_table *tb)
 			 */
 			if (tb->tb_id != fa->tb_id) {
 				hlist_del_rcu(&fa->fa_list);
+				fib_accel_remove(t, n, fa->fa_slen);
 				alias_free_mem_rcu(fa);
 				continue;
 			}
@@ -1896,6 +2261,7 @@ int fib_table_flush(struct net *net, struct fib_table *tb)
 						 fi, fa->fa_tos, fa->fa_type,
 						 tb->tb_id);
 			hlist_del_rcu(&fa->fa_list);
+			fib_accel_remove(t, n, fa->fa_slen);
 			fib_release_info(fa->fa_info);
 			alias_free_mem_rcu(fa);
 			found++;
@@ -1981,6 +2347,10 @@ static void __trie_free_rcu(struct rcu_head *head)
 
 void fib_free_table(struct fib_table *tb)
 {
+	/* an aliased table leaves the shared trie to its owner */
+	if (tb->tb_data == tb->__data &&
+	    rcu_access_pointer(((struct trie *)tb->tb_data)->accel))
+		fib_accel_release((struct trie *)tb->tb_data);
 	call_rcu(&tb->rcu, __trie_free_rcu);
 }
 
@@ -18,6 +18,7 @@
 #include <linux/cache.h>
 #include <linux/init.h>
 #include <linux/time.h>
+#include <linux/cgroup.h>
 
 #include <net/icmp.h>
 #include <net/tcp.h>
@@ -839,6 +840,80 @@ static int inet_diag_bc_audit(const struct nlattr *attr,
 	return len == 0 ? 0 : -EINVAL;
 }
 
+/* Selectors carried as request attributes next to the bytecode.  They
+ * are cheap to test and, unlike the bytecode, cannot be expressed by
+ * userspace in terms of addresses and ports.
+ */
+struct inet_diag_dump_sel {
+	u64	changed_since;
+	u64	cgroup_id;
+};
+
+static int inet_diag_sel_audit(const struct nlmsghdr *h, int hdrlen)
+{
+	const struct nlattr *attr;
+
+	attr = nlmsg_find_attr(h, hdrlen, INET_DIAG_REQ_CHANGED_SINCE);
+	if (attr && nla_len(attr) != sizeof(u64))
+		return -EINVAL;
+
+	attr = nlmsg_find_attr(h, hdrlen, INET_DIAG_REQ_CGROUP_ID);
+	if (attr) {
+		if (nla_len(attr) != sizeof(u64))
+			return -EINVAL;
+		if (!IS_ENABLED(CONFIG_SOCK_CGROUP_DATA))
+			return -EOPNOTSUPP;
+	}
+	return 0;
+}
+
+static void inet_diag_sel_parse(const struct netlink_callback *cb,
+				struct inet_diag_dump_sel *sel)
+{
+	int hdrlen = sizeof(struct inet_diag_req_v2);
+	const struct nlattr *attr;
+
+	memset(sel, 0, sizeof(*sel));
+
+	/* Only the v2 request format carries selector attributes. */
+	if (cb->nlh->nlmsg_type != SOCK_DIAG_BY_FAMILY ||
+	    !nlmsg_attrlen(cb->nlh, hdrlen))
+		return;
+
+	attr = nlmsg_find_attr(cb->nlh, hdrlen, INET_DIAG_REQ_CHANGED_SINCE);
+	if (attr)
+		sel->changed_since = nla_get_u64(attr);
+
+	attr = nlmsg_find_attr(cb->nlh, hdrlen, INET_DIAG_REQ_CGROUP_ID);
+	if (attr)
+		sel->cgroup_id = nla_get_u64(attr);
+}
+
+static bool inet_diag_sel_match(struct sock *sk,
+				const struct inet_diag_dump_sel *sel)
+{
+	if (sel->changed_since && sk->sk_state != TCP_NEW_SYN_RECV) {
+		u64 stamp;
+
+		if (sk->sk_state == TCP_TIME_WAIT)
+			stamp = inet_twsk(sk)->tw_state_stamp;
+		else
+			stamp = sk->sk_state_stamp;
+		if (stamp < sel->changed_since)
+			return false;
+	}
+#ifdef CONFIG_SOCK_CGROUP_DATA
+	if (sel->cgroup_id) {
+		if (!sk_fullsock(sk))
+			return false;
+		if (sock_cgroup_ptr(&sk->sk_cgrp_data)->kn->id.id !=
+		    sel->cgroup_id)
+			return false;
+	}
+#endif
+	return true;
+}
+
 static int inet_csk_diag_dump(struct sock *sk,
 			      struct sk_buff *skb,
 			      struct netlink_callback *cb,
@@ -882,6 +957,100 @@ static void twsk_build_assert(void)
 #endif
 }
 
+#define SKARR_SZ 16
+
+/* A source port was requested: every listening, established and
+ * TIME_WAIT socket using it hangs off a single bind bucket, so walk that
+ * instead of the whole listening and established hash tables.
+ * Request sockets are not bound, callers fall back to the full walk
+ * when they are asked for.
+ */
+static void inet_diag_dump_bound(struct inet_hashinfo *hashinfo,
+				 struct sk_buff *skb,
+				 struct netlink_callback *cb,
+				 const struct inet_diag_req_v2 *r,
+				 struct nlattr *bc,
+				 const struct inet_diag_dump_sel *sel,
+				 u32 idiag_states, bool net_admin)
+{
+	struct net *net = sock_net(skb->sk);
+	u16 port = ntohs(r->id.idiag_sport);
+	struct inet_bind_hashbucket *head;
+	struct inet_bind_bucket *tb;
+	struct sock *sk_arr[SKARR_SZ];
+	int num_arr[SKARR_SZ];
+	int num, s_num, idx, accum, res;
+	struct sock *sk;
+
+	if (cb->args[1])
+		return;
+	s_num = cb->args[2];
+
+	head = &hashinfo->bhash[inet_bhashfn(net, port,
+					     hashinfo->bhash_size)];
+next_chunk:
+	num = 0;
+	accum = 0;
+	spin_lock_bh(&head->lock);
+	inet_bind_bucket_for_each(tb, &head->chain) {
+		if (!net_eq(ib_net(tb), net) || tb->port != port)
+			continue;
+
+		sk_for_each_bound(sk, &tb->owners) {
+			int state;
+
+			if (num < s_num)
+				goto next_bound;
+			state = (sk->sk_state == TCP_TIME_WAIT) ?
+				inet_twsk(sk)->tw_substate : sk->sk_state;
+			if (!(idiag_states & (1 << state)))
+				goto next_bound;
+			if (r->sdiag_family != AF_UNSPEC &&
+			    sk->sk_family != r->sdiag_family)
+				goto next_bound;
+			if (r->id.idiag_dport != sk->sk_dport &&
+			    r->id.idiag_dport)
+				goto next_bound;
+			if (!inet_diag_sel_match(sk, sel) ||
+			    !inet_diag_bc_sk(bc, sk))
+				goto next_bound;
+
+			sock_hold(sk);
+			num_arr[accum] = num;
+			sk_arr[accum] = sk;
+			if (++accum == SKARR_SZ)
+				goto unlock;
+next_bound:
+			++num;
+		}
+	}
+unlock:
+	spin_unlock_bh(&head->lock);
+	res = 0;
+	for (idx = 0; idx < accum; idx++) {
+		if (res >= 0) {
+			res = sk_diag_fill(sk_arr[idx], skb, r,
+					   sk_user_ns(NETLINK_CB(cb->skb).sk),
+					   NETLINK_CB(cb->skb).portid,
+					   cb->nlh->nlmsg_seq, NLM_F_MULTI,
+					   cb->nlh, net_admin);
+			if (res < 0)
+				num = num_arr[idx];
+		}
+		sock_gen_put(sk_arr[idx]);
+	}
+	if (res < 0) {
+		cb->args[2] = num;
+		return;
+	}
+	if (accum == SKARR_SZ) {
+		cond_resched();
+		s_num = num + 1;
+		goto next_chunk;
+	}
+	cb->args[1] = 1;
+}
+
 void inet_diag_dump_icsk(struct inet_hashinfo *hashinfo, struct sk_buff *skb,
 			 struct netlink_callback *cb,
 			 const struct inet_diag_req_v2 *r, struct nlattr *bc)
@@ -889,11 +1058,20 @@ void inet_diag_dump_icsk(struct inet_hashinfo *hashinfo, struct sk_buff *skb,
 	bool net_admin = netlink_net_capable(cb->skb, CAP_NET_ADMIN);
 	struct net *net = sock_net(skb->sk);
 	u32 idiag_states = r->idiag_states;
+	struct inet_diag_dump_sel sel;
 	int i, num, s_i, s_num;
 	struct sock *sk;
 
 	if (idiag_states & TCPF_SYN_RECV)
 		idiag_states |= TCPF_NEW_SYN_RECV;
+
+	inet_diag_sel_parse(cb, &sel);
+	if (r->id.idiag_sport && !(idiag_states & TCPF_NEW_SYN_RECV)) {
+		inet_diag_dump_bound(hashinfo, skb, cb, r, bc, &sel,
+				     idiag_states, net_admin);
+		return;
+	}
+
 	s_i = cb->args[1];
 	s_num = num = cb->args[2];
 
@@ -926,6 +1104,9 @@ void inet_diag_dump_icsk(struct inet_hashinfo *hashinfo, struct sk_buff *skb,
 				    r->id.idiag_sport)
 					goto next_listen;
 
+				if (!inet_diag_sel_match(sk, &sel))
+					goto next_listen;
+
 				if (inet_csk_diag_dump(sk, skb, cb, r,
 						       bc, net_admin) < 0) {
 					spin_unlock(&ilb->lock);
@@ -947,7 +1128,6 @@ void inet_diag_dump_icsk(struct inet_hashinfo *hashinfo, struct sk_buff *skb,
 	if (!(idiag_states & ~TCPF_LISTEN))
 		goto out;
 
-#define SKARR_SZ 16
 	for (i = s_i; i <= hashinfo->ehash_mask; i++) {
 		struct inet_ehash_bucket *head = &hashinfo->ehash[i];
 		spinlock_t *lock = inet_ehash_lockp(hashinfo, i);
@@ -988,7 +1168,8 @@ void inet_diag_dump_icsk(struct inet_hashinfo *hashinfo, struct sk_buff *skb,
 				goto next_normal;
 			twsk_build_assert();
 
-			if (!inet_diag_bc_sk(bc, sk))
+			if (!inet_diag_sel_match(sk, &sel) ||
+			    !inet_diag_bc_sk(bc, sk))
 				goto next_normal;
 
 			sock_hold(sk);
@@ -1152,7 +1333,12 @@ static int inet_diag_handler_cmd(struct sk_buff *skb, struct nlmsghdr *h)
 
 			attr = nlmsg_find_attr(h, hdrlen,
 					       INET_DIAG_REQ_BYTECODE);
-			err = inet_diag_bc_audit(attr, skb);
+			if (attr) {
+				err = inet_diag_bc_audit(attr, skb);
+				if (err)
+					return err;
+			}
+			err = inet_diag_sel_audit(h, hdrlen);
 			if (err)
 				return err;
 		}
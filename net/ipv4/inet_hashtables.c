@@ -231,6 +231,9 @@ struct sock *__inet_lookup_listener(struct net *net,
 						     saddr, sport);
 				result = reuseport_select_sock(sk, phash,
 							       skb, doff);
+				/* A SK_REUSEPORT program dropped it */
+				if (unlikely(IS_ERR(result)))
+					return NULL;
 				if (result)
 					return result;
 				matches = 1;
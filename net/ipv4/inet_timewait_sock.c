@@ -178,6 +178,7 @@ struct inet_timewait_sock *inet_twsk_alloc(const struct sock *sk,
 		tw->tw_num	    = inet->inet_num;
 		tw->tw_state	    = TCP_TIME_WAIT;
 		tw->tw_substate	    = state;
+		tw->tw_state_stamp  = ktime_get_ns();
 		tw->tw_sport	    = inet->inet_sport;
 		tw->tw_dport	    = inet->inet_dport;
 		tw->tw_family	    = sk->sk_family;
@@ -101,6 +101,7 @@ int ip_forward(struct sk_buff *skb)
 
 	skb_forward_csum(skb);
 	net = dev_net(skb->dev);
+	skb->tstamp = 0;
 
 	/*
 	 *	According to the RFC, we must first decrease the TTL field. If
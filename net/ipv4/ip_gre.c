@@ -1022,6 +1022,7 @@ static struct pernet_operations ipgre_net_ops = {
 	.exit = ipgre_exit_net,
 	.id   = &ipgre_net_id,
 	.size = sizeof(struct ip_tunnel_net),
+	.async = true,
 };
 
 static int ipgre_tunnel_validate(struct nlattr *tb[], struct nlattr *data[],
@@ -1553,6 +1554,7 @@ static struct pernet_operations ipgre_tap_net_ops = {
 	.exit = ipgre_tap_exit_net,
 	.id   = &gre_tap_net_id,
 	.size = sizeof(struct ip_tunnel_net),
+	.async = true,
 };
 
 static int __net_init erspan_init_net(struct net *net)
@@ -1573,6 +1575,7 @@ static struct pernet_operations erspan_net_ops = {
 	.exit = erspan_exit_net,
 	.id   = &erspan_net_id,
 	.size = sizeof(struct ip_tunnel_net),
+	.async = true,
 };
 
 static int __init ipgre_init(void)
@@ -464,6 +464,7 @@ static struct pernet_operations vti_net_ops = {
 	.exit = vti_exit_net,
 	.id   = &vti_net_id,
 	.size = sizeof(struct ip_tunnel_net),
+	.async = true,
 };
 
 static int vti_tunnel_validate(struct nlattr *tb[], struct nlattr *data[],
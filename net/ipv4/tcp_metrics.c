@@ -1027,6 +1027,7 @@ static void __net_exit tcp_net_metrics_exit(struct net *net)
 static __net_initdata struct pernet_operations tcp_net_metrics_ops = {
 	.init	=	tcp_net_metrics_init,
 	.exit	=	tcp_net_metrics_exit,
+	.async	=	true,
 };
 
 void __init tcp_metrics_init(void)
@@ -177,6 +177,14 @@ static void tcp_event_data_sent(struct tcp_sock *tp,
 /* Account for an ACK we sent. */
 static inline void tcp_event_ack_sent(struct sock *sk, unsigned int pkts)
 {
+	struct tcp_sock *tp = tcp_sk(sk);
+
+	if (unlikely(tp->compressed_ack > TCP_FASTRETRANS_THRESH)) {
+		NET_ADD_STATS(sock_net(sk), LINUX_MIB_TCPACKCOMPRESSED,
+			      tp->compressed_ack - TCP_FASTRETRANS_THRESH);
+		tp->compressed_ack = TCP_FASTRETRANS_THRESH;
+		hrtimer_try_to_cancel(&tp->compressed_ack_timer);
+	}
 	tcp_dec_quickack_mode(sk, pkts);
 	inet_csk_clear_xmit_timer(sk, ICSK_TIME_DACK);
 }
@@ -738,6 +746,11 @@ static void tcp_tsq_handler(struct sock *sk)
 	     TCPF_CLOSE_WAIT  | TCPF_LAST_ACK)) {
 		struct tcp_sock *tp = tcp_sk(sk);
 
+		/* Flush the SACK held back by tcp_compressed_ack_kick() */
+		if (tp->compressed_ack > TCP_FASTRETRANS_THRESH &&
+		    !hrtimer_is_queued(&tp->compressed_ack_timer))
+			tcp_send_ack(sk);
+
 		if (tp->lost_out > tp->retrans_out &&
 		    tp->snd_cwnd > tcp_packets_in_flight(tp)) {
 			tcp_mstamp_refresh(tp);
@@ -907,13 +920,12 @@ void tcp_wfree(struct sk_buff *skb)
 	sk_free(sk);
 }
 
-/* Note: Called under hard irq.
- * We can not call TCP stack right away.
+/* Hand the socket to the TSQ tasklet, which runs tcp_tsq_handler()
+ * from softirq, or defers it to tcp_release_cb() if the socket is owned.
  */
-enum hrtimer_restart tcp_pace_kick(struct hrtimer *timer)
+static void tcp_tsq_kick(struct sock *sk)
 {
-	struct tcp_sock *tp = container_of(timer, struct tcp_sock, pacing_timer);
-	struct sock *sk = (struct sock *)tp;
+	struct tcp_sock *tp = tcp_sk(sk);
 	unsigned long nval, oval;
 
 	for (oval = READ_ONCE(sk->sk_tsq_flags);; oval = nval) {
@@ -938,6 +950,28 @@ enum hrtimer_restart tcp_pace_kick(struct hrtimer *timer)
 			tasklet_schedule(&tsq->tasklet);
 		break;
 	}
+}
+
+/* Note: Called under hard irq.
+ * We can not call TCP stack right away.
+ */
+enum hrtimer_restart tcp_pace_kick(struct hrtimer *timer)
+{
+	struct tcp_sock *tp = container_of(timer, struct tcp_sock, pacing_timer);
+
+	tcp_tsq_kick((struct sock *)tp);
+	return HRTIMER_NORESTART;
+}
+
+/* Note: Called under hard irq.
+ * The compressed SACK is sent from tcp_tsq_handler().
+ */
+enum hrtimer_restart tcp_compressed_ack_kick(struct hrtimer *timer)
+{
+	struct tcp_sock *tp = container_of(timer, struct tcp_sock,
+					   compressed_ack_timer);
+
+	tcp_tsq_kick((struct sock *)tp);
 	return HRTIMER_NORESTART;
 }
 
@@ -952,25 +986,40 @@ static bool tcp_needs_internal_pacing(const struct sock *sk)
 	return smp_load_acquire(&sk->sk_pacing_status) == SK_PACING_NEEDED;
 }
 
-static void tcp_internal_pacing(struct sock *sk, const struct sk_buff *skb)
+/* Earliest Departure Time model: every transmitted skb carries in
+ * skb->tstamp the time it may leave the host (tp->tcp_wstamp_ns), and
+ * the departure time of the next data packet is advanced here by the
+ * time it takes to send this one at sk_pacing_rate.
+ * sch_fq (or the internal pacing timer) only has to honour the stamps.
+ */
+static void tcp_update_skb_after_send(struct sock *sk, struct sk_buff *skb,
+				      u64 prior_wstamp)
 {
-	u64 len_ns;
-	u32 rate;
+	struct tcp_sock *tp = tcp_sk(sk);
+	u32 rate = sk->sk_pacing_rate;
+	u64 len_ns, credit;
 
-	if (!tcp_needs_internal_pacing(sk))
+	if (smp_load_acquire(&sk->sk_pacing_status) == SK_PACING_NONE)
 		return;
-	rate = sk->sk_pacing_rate;
-	if (!rate || rate == ~0U)
+
+	/* Original sch_fq does not pace first 10 MSS.
+	 * Note that tp->data_segs_out overflows after 2^32 packets,
+	 * this is a minor annoyance.
+	 */
+	if (!rate || rate == ~0U || tp->data_segs_out < 10)
 		return;
 
 	/* Should account for header sizes as sch_fq does,
 	 * but lets make things simple.
 	 */
-	len_ns = (u64)skb->len * NSEC_PER_SEC;
-	do_div(len_ns, rate);
-	hrtimer_start(&tcp_sk(sk)->pacing_timer,
-		      ktime_add_ns(ktime_get(), len_ns),
-		      HRTIMER_MODE_ABS_PINNED);
+	len_ns = div_u64((u64)skb->len * NSEC_PER_SEC, rate);
+
+	/* Take into account OS jitter: if we are late compared to the
+	 * prior departure time, send the next packet a bit earlier.
+	 */
+	credit = tp->tcp_wstamp_ns - prior_wstamp;
+	len_ns -= min_t(u64, len_ns / 2, credit);
+	tp->tcp_wstamp_ns += len_ns;
 }
 
 /* This routine actually transmits TCP packets queued in by
@@ -996,10 +1045,13 @@ static int tcp_transmit_skb(struct sock *sk, struct sk_buff *skb, int clone_it,
 	struct sk_buff *oskb = NULL;
 	struct tcp_md5sig_key *md5;
 	struct tcphdr *th;
+	u64 prior_wstamp;
 	int err;
 
 	BUG_ON(!skb || !tcp_skb_pcount(skb));
 	tp = tcp_sk(sk);
+	prior_wstamp = tp->tcp_wstamp_ns;
+	tp->tcp_wstamp_ns = max(tp->tcp_wstamp_ns, tp->tcp_clock_cache);
 
 	if (clone_it) {
 		TCP_SKB_CB(skb)->tx.in_flight = TCP_SKB_CB(skb)->end_seq
@@ -1103,7 +1155,6 @@ static int tcp_transmit_skb(struct sock *sk, struct sk_buff *skb, int clone_it,
 	if (skb->len != tcp_header_size) {
 		tcp_event_data_sent(tp, sk);
 		tp->data_segs_out += tcp_skb_pcount(skb);
-		tcp_internal_pacing(sk, skb);
 	}
 
 	if (after(tcb->end_seq, tp->snd_nxt) || tcb->seq == tcb->end_seq)
@@ -1115,8 +1166,10 @@ static int tcp_transmit_skb(struct sock *sk, struct sk_buff *skb, int clone_it,
 	skb_shinfo(skb)->gso_segs = tcp_skb_pcount(skb);
 	skb_shinfo(skb)->gso_size = tcp_skb_mss(skb);
 
-	/* Our usage of tstamp should remain private */
-	skb->tstamp = 0;
+	/* skb_mstamp is private to TCP: lower layers (qdiscs, BPF, drivers)
+	 * see the earliest departure time instead.
+	 */
+	skb->tstamp = ns_to_ktime(tp->tcp_wstamp_ns);
 
 	/* Cleanup our debris for IP stacks */
 	memset(skb->cb, 0, max(sizeof(struct inet_skb_parm),
@@ -1130,6 +1183,8 @@ static int tcp_transmit_skb(struct sock *sk, struct sk_buff *skb, int clone_it,
 	}
 	if (!err && oskb) {
 		oskb->skb_mstamp = tp->tcp_mstamp;
+		if (oskb->len)
+			tcp_update_skb_after_send(sk, oskb, prior_wstamp);
 		tcp_rate_skb_sent(sk, oskb);
 	}
 	return err;
@@ -2123,10 +2178,24 @@ static int tcp_mtu_probe(struct sock *sk)
 	return -1;
 }
 
-static bool tcp_pacing_check(const struct sock *sk)
+/* When sch_fq is not handling pacing, hold back transmits until the
+ * departure time of the next packet and arm the pacing timer for it.
+ */
+static bool tcp_pacing_check(struct sock *sk)
 {
-	return tcp_needs_internal_pacing(sk) &&
-	       hrtimer_active(&tcp_sk(sk)->pacing_timer);
+	struct tcp_sock *tp = tcp_sk(sk);
+
+	if (!tcp_needs_internal_pacing(sk))
+		return false;
+
+	if (tp->tcp_wstamp_ns <= tp->tcp_clock_cache)
+		return false;
+
+	if (!hrtimer_is_queued(&tp->pacing_timer))
+		hrtimer_start(&tp->pacing_timer,
+			      ns_to_ktime(tp->tcp_wstamp_ns),
+			      HRTIMER_MODE_ABS_PINNED);
+	return true;
 }
 
 /* TCP Small Queues :
@@ -729,6 +729,28 @@ static void esp6_destroy(struct xfrm_state *x)
 	crypto_free_aead(aead);
 }
 
+/* With XFRM_SA_XFLAG_PCRYPT the packets of the state are processed on
+ * all CPUs by pcrypt, which completes them in the order they came in.
+ */
+static struct crypto_aead *esp_alloc_aead(struct xfrm_state *x,
+					  const char *name, u32 mask)
+{
+	char pcrypt_name[CRYPTO_MAX_ALG_NAME];
+
+	if (!(x->props.extra_flags & XFRM_SA_XFLAG_PCRYPT))
+		return crypto_alloc_aead(name, 0, mask);
+
+	/* pcrypt is asynchronous */
+	if (mask & CRYPTO_ALG_ASYNC)
+		return ERR_PTR(-EINVAL);
+
+	if (snprintf(pcrypt_name, CRYPTO_MAX_ALG_NAME, "pcrypt(%s)",
+		     name) >= CRYPTO_MAX_ALG_NAME)
+		return ERR_PTR(-ENAMETOOLONG);
+
+	return crypto_alloc_aead(pcrypt_name, 0, 0);
+}
+
 static int esp_init_aead(struct xfrm_state *x)
 {
 	char aead_name[CRYPTO_MAX_ALG_NAME];
@@ -744,7 +766,7 @@ static int esp_init_aead(struct xfrm_state *x)
 	if (x->xso.offload_handle)
 		mask |= CRYPTO_ALG_ASYNC;
 
-	aead = crypto_alloc_aead(aead_name, 0, mask);
+	aead = esp_alloc_aead(x, aead_name, mask);
 	err = PTR_ERR(aead);
 	if (IS_ERR(aead))
 		goto error;
@@ -803,7 +825,7 @@ static int esp_init_authenc(struct xfrm_state *x)
 	if (x->xso.offload_handle)
 		mask |= CRYPTO_ALG_ASYNC;
 
-	aead = crypto_alloc_aead(authenc_name, 0, mask);
+	aead = esp_alloc_aead(x, authenc_name, mask);
 	err = PTR_ERR(aead);
 	if (IS_ERR(aead))
 		goto error;
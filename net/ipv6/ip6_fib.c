@@ -178,16 +178,16 @@ void rt6_free_pcpu(struct rt6_info *non_pcpu_rt)
 		struct rt6_info *pcpu_rt;
 
 		ppcpu_rt = per_cpu_ptr(non_pcpu_rt->rt6i_pcpu, cpu);
-		pcpu_rt = *ppcpu_rt;
+		pcpu_rt = xchg(ppcpu_rt, NULL);
 		if (pcpu_rt) {
 			dst_dev_put(&pcpu_rt->dst);
 			dst_release(&pcpu_rt->dst);
-			*ppcpu_rt = NULL;
 		}
 	}
 
-	free_percpu(non_pcpu_rt->rt6i_pcpu);
-	non_pcpu_rt->rt6i_pcpu = NULL;
+	/* RCU lookups may still peek at the per-cpu slots, the array
+	 * itself goes away with the dst in ip6_dst_destroy().
+	 */
 }
 EXPORT_SYMBOL_GPL(rt6_free_pcpu);
 
@@ -205,7 +205,7 @@ static void fib6_link_table(struct net *net, struct fib6_table *tb)
 	 * Initialize table lock at a single place to give lockdep a key,
 	 * tables aren't visible prior to being linked to the list.
 	 */
-	rwlock_init(&tb->tb6_lock);
+	spin_lock_init(&tb->tb6_lock);
 
 	h = tb->tb6_id & (FIB6_TABLE_HASHSZ - 1);
 
@@ -323,9 +323,9 @@ unsigned int fib6_tables_seq_read(struct net *net)
 		struct fib6_table *tb;
 
 		hlist_for_each_entry_rcu(tb, head, tb6_hlist) {
-			read_lock_bh(&tb->tb6_lock);
+			spin_lock_bh(&tb->tb6_lock);
 			fib_seq += tb->fib_seq;
-			read_unlock_bh(&tb->tb6_lock);
+			spin_unlock_bh(&tb->tb6_lock);
 		}
 	}
 	rcu_read_unlock();
@@ -382,9 +382,9 @@ static void fib6_table_dump(struct net *net, struct fib6_table *tb,
 			    struct fib6_walker *w)
 {
 	w->root = &tb->tb6_root;
-	read_lock_bh(&tb->tb6_lock);
+	spin_lock_bh(&tb->tb6_lock);
 	fib6_walk(net, w);
-	read_unlock_bh(&tb->tb6_lock);
+	spin_unlock_bh(&tb->tb6_lock);
 }
 
 /* Called with rcu_read_lock() */
@@ -480,9 +480,9 @@ static int fib6_dump_table(struct fib6_table *table, struct sk_buff *skb,
 		w->count = 0;
 		w->skip = 0;
 
-		read_lock_bh(&table->tb6_lock);
+		spin_lock_bh(&table->tb6_lock);
 		res = fib6_walk(net, w);
-		read_unlock_bh(&table->tb6_lock);
+		spin_unlock_bh(&table->tb6_lock);
 		if (res > 0) {
 			cb->args[4] = 1;
 			cb->args[5] = w->root->fn_sernum;
@@ -497,9 +497,9 @@ static int fib6_dump_table(struct fib6_table *table, struct sk_buff *skb,
 		} else
 			w->skip = 0;
 
-		read_lock_bh(&table->tb6_lock);
+		spin_lock_bh(&table->tb6_lock);
 		res = fib6_walk_continue(w);
-		read_unlock_bh(&table->tb6_lock);
+		spin_unlock_bh(&table->tb6_lock);
 		if (res <= 0) {
 			fib6_walker_unlink(net, w);
 			cb->args[4] = 0;
@@ -625,8 +625,11 @@ static struct fib6_node *fib6_add_1(struct fib6_node *root,
 		if (plen == fn->fn_bit) {
 			/* clean up an intermediate node */
 			if (!(fn->fn_flags & RTN_RTINFO)) {
-				rt6_release(fn->leaf);
-				fn->leaf = NULL;
+				struct rt6_info *leaf = fn->leaf;
+
+				/* lookups skip nodes without a leaf */
+				RCU_INIT_POINTER(fn->leaf, NULL);
+				rt6_release(leaf);
 			}
 
 			fn->fn_sernum = sernum;
@@ -678,9 +681,9 @@ static struct fib6_node *fib6_add_1(struct fib6_node *root,
 	ln->fn_sernum = sernum;
 
 	if (dir)
-		pn->right = ln;
+		rcu_assign_pointer(pn->right, ln);
 	else
-		pn->left  = ln;
+		rcu_assign_pointer(pn->left, ln);
 
 	return ln;
 
@@ -737,16 +740,9 @@ static struct fib6_node *fib6_add_1(struct fib6_node *root,
 
 		in->fn_sernum = sernum;
 
-		/* update parent pointer */
-		if (dir)
-			pn->right = in;
-		else
-			pn->left  = in;
-
 		ln->fn_bit = plen;
 
 		ln->parent = in;
-		fn->parent = in;
 
 		ln->fn_sernum = sernum;
 
@@ -757,6 +753,13 @@ static struct fib6_node *fib6_add_1(struct fib6_node *root,
 			in->left  = ln;
 			in->right = fn;
 		}
+
+		/* in is complete, lookups may see it now */
+		fn->parent = in;
+		if (dir)
+			rcu_assign_pointer(pn->right, in);
+		else
+			rcu_assign_pointer(pn->left, in);
 	} else { /* plen <= bit */
 
 		/*
@@ -776,17 +779,16 @@ static struct fib6_node *fib6_add_1(struct fib6_node *root,
 
 		ln->fn_sernum = sernum;
 
-		if (dir)
-			pn->right = ln;
-		else
-			pn->left  = ln;
-
 		if (addr_bit_set(&key->addr, plen))
 			ln->right = fn;
 		else
 			ln->left  = fn;
 
 		fn->parent = ln;
+		if (dir)
+			rcu_assign_pointer(pn->right, ln);
+		else
+			rcu_assign_pointer(pn->left, ln);
 	}
 	return ln;
 }
@@ -954,8 +956,8 @@ static int fib6_add_rt2node(struct fib6_node *fn, struct rt6_info *rt,
 		while (sibling) {
 			if (sibling->rt6i_metric == rt->rt6i_metric &&
 			    rt6_qualify_for_ecmp(sibling)) {
-				list_add_tail(&rt->rt6i_siblings,
-					      &sibling->rt6i_siblings);
+				list_add_tail_rcu(&rt->rt6i_siblings,
+						  &sibling->rt6i_siblings);
 				break;
 			}
 			sibling = sibling->dst.rt6_next;
@@ -988,9 +990,9 @@ static int fib6_add_rt2node(struct fib6_node *fn, struct rt6_info *rt,
 			return err;
 
 		rt->dst.rt6_next = iter;
-		*ins = rt;
 		rcu_assign_pointer(rt->rt6i_node, fn);
 		atomic_inc(&rt->rt6i_ref);
+		rcu_assign_pointer(*ins, rt);
 		call_fib6_entry_notifiers(info->nl_net, FIB_EVENT_ENTRY_ADD,
 					  rt);
 		if (!info->skip_notify)
@@ -1016,10 +1018,10 @@ static int fib6_add_rt2node(struct fib6_node *fn, struct rt6_info *rt,
 		if (err)
 			return err;
 
-		*ins = rt;
-		rcu_assign_pointer(rt->rt6i_node, fn);
 		rt->dst.rt6_next = iter->dst.rt6_next;
+		rcu_assign_pointer(rt->rt6i_node, fn);
 		atomic_inc(&rt->rt6i_ref);
+		rcu_assign_pointer(*ins, rt);
 		call_fib6_entry_notifiers(info->nl_net, FIB_EVENT_ENTRY_REPLACE,
 					  rt);
 		if (!info->skip_notify)
@@ -1029,7 +1031,7 @@ static int fib6_add_rt2node(struct fib6_node *fn, struct rt6_info *rt,
 			fn->fn_flags |= RTN_RTINFO;
 		}
 		nsiblings = iter->rt6i_nsiblings;
-		iter->rt6i_node = NULL;
+		RCU_INIT_POINTER(iter->rt6i_node, NULL);
 		fib6_purge_rt(iter, fn, info->nl_net);
 		if (fn->rr_ptr == iter)
 			fn->rr_ptr = NULL;
@@ -1044,7 +1046,7 @@ static int fib6_add_rt2node(struct fib6_node *fn, struct rt6_info *rt,
 					break;
 				if (rt6_qualify_for_ecmp(iter)) {
 					*ins = iter->dst.rt6_next;
-					iter->rt6i_node = NULL;
+					RCU_INIT_POINTER(iter->rt6i_node, NULL);
 					fib6_purge_rt(iter, fn, info->nl_net);
 					if (fn->rr_ptr == iter)
 						fn->rr_ptr = NULL;
@@ -1163,7 +1165,7 @@ int fib6_add(struct fib6_node *root, struct rt6_info *rt,
 
 			/* Now link new subtree to main tree */
 			sfn->parent = fn;
-			fn->subtree = sfn;
+			rcu_assign_pointer(fn->subtree, sfn);
 		} else {
 			sn = fib6_add_1(fn->subtree, &rt->rt6i_src.addr,
 					rt->rt6i_src.plen,
@@ -1178,8 +1180,8 @@ int fib6_add(struct fib6_node *root, struct rt6_info *rt,
 		}
 
 		if (!fn->leaf) {
-			fn->leaf = rt;
 			atomic_inc(&rt->rt6i_ref);
+			rcu_assign_pointer(fn->leaf, rt);
 		}
 		fn = sn;
 	}
@@ -1228,9 +1230,11 @@ int fib6_add(struct fib6_node *root, struct rt6_info *rt,
 	if (fn && !(fn->fn_flags & (RTN_RTINFO|RTN_ROOT)))
 		fib6_repair_tree(info->nl_net, fn);
 	/* Always release dst as dst->__refcnt is guaranteed
-	 * to be taken before entering this function
+	 * to be taken before entering this function.  The route may
+	 * have been visible to RCU lookups as a subtree leaf, so let
+	 * the grace period pass before it goes.
 	 */
-	dst_release_immediate(&rt->dst);
+	dst_release(&rt->dst);
 	return err;
 }
 
@@ -1264,7 +1268,8 @@ static struct fib6_node *fib6_lookup_1(struct fib6_node *root,
 
 		dir = addr_bit_set(args->addr, fn->fn_bit);
 
-		next = dir ? fn->right : fn->left;
+		next = dir ? rcu_dereference(fn->right) :
+			     rcu_dereference(fn->left);
 
 		if (next) {
 			fn = next;
@@ -1274,18 +1279,23 @@ static struct fib6_node *fib6_lookup_1(struct fib6_node *root,
 	}
 
 	while (fn) {
-		if (FIB6_SUBTREE(fn) || fn->fn_flags & RTN_RTINFO) {
+		struct fib6_node *subtree = FIB6_SUBTREE(fn);
+
+		if (subtree || fn->fn_flags & RTN_RTINFO) {
+			struct rt6_info *leaf = rcu_dereference(fn->leaf);
 			struct rt6key *key;
 
-			key = (struct rt6key *) ((u8 *) fn->leaf +
-						 args->offset);
+			/* the node is being reshaped by a writer */
+			if (!leaf)
+				goto backtrack;
+
+			key = (struct rt6key *) ((u8 *) leaf + args->offset);
 
 			if (ipv6_prefix_equal(&key->addr, args->addr, key->plen)) {
 #ifdef CONFIG_IPV6_SUBTREES
-				if (fn->subtree) {
+				if (subtree) {
 					struct fib6_node *sfn;
-					sfn = fib6_lookup_1(fn->subtree,
-							    args + 1);
+					sfn = fib6_lookup_1(subtree, args + 1);
 					if (!sfn)
 						goto backtrack;
 					fn = sfn;
@@ -1295,13 +1305,11 @@ static struct fib6_node *fib6_lookup_1(struct fib6_node *root,
 					return fn;
 			}
 		}
-#ifdef CONFIG_IPV6_SUBTREES
 backtrack:
-#endif
 		if (fn->fn_flags & RTN_ROOT)
 			break;
 
-		fn = fn->parent;
+		fn = rcu_dereference(fn->parent);
 	}
 
 	return NULL;
@@ -1347,7 +1355,17 @@ static struct fib6_node *fib6_locate_1(struct fib6_node *root,
 	struct fib6_node *fn;
 
 	for (fn = root; fn ; ) {
-		struct rt6key *key = (struct rt6key *)((u8 *)fn->leaf + offset);
+		struct rt6_info *leaf = rcu_dereference(fn->leaf);
+		struct rt6key *key;
+
+		/* This node is being deleted, it holds no route */
+		if (!leaf) {
+			if (plen <= fn->fn_bit)
+				return NULL;
+			goto next;
+		}
+
+		key = (struct rt6key *)((u8 *)leaf + offset);
 
 		/*
 		 *	Prefix match
@@ -1359,13 +1377,14 @@ static struct fib6_node *fib6_locate_1(struct fib6_node *root,
 		if (plen == fn->fn_bit)
 			return fn;
 
+next:
 		/*
 		 *	We have more bits to go
 		 */
 		if (addr_bit_set(addr, fn->fn_bit))
-			fn = fn->right;
+			fn = rcu_dereference(fn->right);
 		else
-			fn = fn->left;
+			fn = rcu_dereference(fn->left);
 	}
 	return NULL;
 }
@@ -1382,8 +1401,9 @@ struct fib6_node *fib6_locate(struct fib6_node *root,
 #ifdef CONFIG_IPV6_SUBTREES
 	if (src_len) {
 		WARN_ON(saddr == NULL);
-		if (fn && fn->subtree)
-			fn = fib6_locate_1(fn->subtree, saddr, src_len,
+		if (fn && rcu_access_pointer(fn->subtree))
+			fn = fib6_locate_1(rcu_dereference(fn->subtree),
+					   saddr, src_len,
 					   offsetof(struct rt6_info, rt6i_src));
 	}
 #endif
@@ -1428,6 +1448,7 @@ static struct fib6_node *fib6_repair_tree(struct net *net,
 	int nstate;
 	struct fib6_node *child, *pn;
 	struct fib6_walker *w;
+	struct rt6_info *rt;
 	int iter = 0;
 
 	for (;;) {
@@ -1451,14 +1472,16 @@ static struct fib6_node *fib6_repair_tree(struct net *net,
 		    || (children && fn->fn_flags & RTN_ROOT)
 #endif
 		    ) {
-			fn->leaf = fib6_find_prefix(net, fn);
+			struct rt6_info *new_leaf = fib6_find_prefix(net, fn);
+
 #if RT6_DEBUG >= 2
-			if (!fn->leaf) {
-				WARN_ON(!fn->leaf);
-				fn->leaf = net->ipv6.ip6_null_entry;
+			if (!new_leaf) {
+				WARN_ON(!new_leaf);
+				new_leaf = net->ipv6.ip6_null_entry;
 			}
 #endif
-			atomic_inc(&fn->leaf->rt6i_ref);
+			atomic_inc(&new_leaf->rt6i_ref);
+			rcu_assign_pointer(fn->leaf, new_leaf);
 			return fn->parent;
 		}
 
@@ -1466,19 +1489,22 @@ static struct fib6_node *fib6_repair_tree(struct net *net,
 #ifdef CONFIG_IPV6_SUBTREES
 		if (FIB6_SUBTREE(pn) == fn) {
 			WARN_ON(!(fn->fn_flags & RTN_ROOT));
-			FIB6_SUBTREE(pn) = NULL;
+			RCU_INIT_POINTER(FIB6_SUBTREE(pn), NULL);
 			nstate = FWS_L;
 		} else {
 			WARN_ON(fn->fn_flags & RTN_ROOT);
 #endif
 			if (pn->right == fn)
-				pn->right = child;
+				rcu_assign_pointer(pn->right, child);
 			else if (pn->left == fn)
-				pn->left = child;
+				rcu_assign_pointer(pn->left, child);
 #if RT6_DEBUG >= 2
 			else
 				WARN_ON(1);
 #endif
+			/* lookups still on fn climb back up through pn, fn
+			 * itself is freed after a grace period
+			 */
 			if (child)
 				child->parent = pn;
 			nstate = FWS_R;
@@ -1520,8 +1546,9 @@ static struct fib6_node *fib6_repair_tree(struct net *net,
 		if (pn->fn_flags & RTN_RTINFO || FIB6_SUBTREE(pn))
 			return pn;
 
-		rt6_release(pn->leaf);
-		pn->leaf = NULL;
+		rt = pn->leaf;
+		RCU_INIT_POINTER(pn->leaf, NULL);
+		rt6_release(rt);
 		fn = pn;
 	}
 }
@@ -1535,9 +1562,9 @@ static void fib6_del_route(struct fib6_node *fn, struct rt6_info **rtp,
 
 	RT6_TRACE("fib6_del_route\n");
 
-	/* Unlink it */
+	/* Unlink it, leaving rt6_next alone for RCU lookups still on rt */
 	*rtp = rt->dst.rt6_next;
-	rt->rt6i_node = NULL;
+	RCU_INIT_POINTER(rt->rt6i_node, NULL);
 	net->ipv6.rt6_stats->fib_rt_entries--;
 	net->ipv6.rt6_stats->fib_discarded_routes++;
 
@@ -1553,7 +1580,7 @@ static void fib6_del_route(struct fib6_node *fn, struct rt6_info **rtp,
 					 &rt->rt6i_siblings, rt6i_siblings)
 			sibling->rt6i_nsiblings--;
 		rt->rt6i_nsiblings = 0;
-		list_del_init(&rt->rt6i_siblings);
+		list_del_rcu(&rt->rt6i_siblings);
 	}
 
 	/* Adjust walkers */
@@ -1568,8 +1595,6 @@ static void fib6_del_route(struct fib6_node *fn, struct rt6_info **rtp,
 	}
 	read_unlock(&net->ipv6.fib6_walker_lock);
 
-	rt->dst.rt6_next = NULL;
-
 	/* If it was last route, expunge its radix tree node */
 	if (!fn->leaf) {
 		fn->fn_flags &= ~RTN_RTINFO;
@@ -1834,10 +1859,10 @@ static void __fib6_clean_all(struct net *net,
 	for (h = 0; h < FIB6_TABLE_HASHSZ; h++) {
 		head = &net->ipv6.fib_table_hash[h];
 		hlist_for_each_entry_rcu(table, head, tb6_hlist) {
-			write_lock_bh(&table->tb6_lock);
+			spin_lock_bh(&table->tb6_lock);
 			fib6_clean_tree(net, &table->tb6_root,
 					func, false, sernum, arg);
-			write_unlock_bh(&table->tb6_lock);
+			spin_unlock_bh(&table->tb6_lock);
 		}
 	}
 	rcu_read_unlock();
@@ -2052,6 +2077,7 @@ static void fib6_net_exit(struct net *net)
 static struct pernet_operations fib6_net_ops = {
 	.init = fib6_net_init,
 	.exit = fib6_net_exit,
+	.async = true,
 };
 
 int __init fib6_init(void)
@@ -2207,9 +2233,9 @@ static void *ipv6_route_seq_next(struct seq_file *seq, void *v, loff_t *pos)
 
 iter_table:
 	ipv6_route_check_sernum(iter);
-	read_lock(&iter->tbl->tb6_lock);
+	spin_lock_bh(&iter->tbl->tb6_lock);
 	r = fib6_walk_continue(&iter->w);
-	read_unlock(&iter->tbl->tb6_lock);
+	spin_unlock_bh(&iter->tbl->tb6_lock);
 	if (r > 0) {
 		if (v)
 			++*pos;
@@ -1179,6 +1179,7 @@ static struct pernet_operations ip6gre_net_ops = {
 	.exit = ip6gre_exit_net,
 	.id   = &ip6gre_net_id,
 	.size = sizeof(struct ip6gre_net),
+	.async = true,
 };
 
 static int ip6gre_tunnel_validate(struct nlattr *tb[], struct nlattr *data[],
@@ -2248,6 +2248,7 @@ static struct pernet_operations ip6_tnl_net_ops = {
 	.exit = ip6_tnl_exit_net,
 	.id   = &ip6_tnl_net_id,
 	.size = sizeof(struct ip6_tnl_net),
+	.async = true,
 };
 
 /**
@@ -1863,6 +1863,7 @@ static struct pernet_operations sit_net_ops = {
 	.exit = sit_exit_net,
 	.id   = &sit_net_id,
 	.size = sizeof(struct sit_net),
+	.async = true,
 };
 
 static void __exit sit_cleanup(void)
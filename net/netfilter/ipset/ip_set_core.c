@@ -1461,25 +1461,29 @@ static const struct nla_policy ip_set_adt_policy[IPSET_ATTR_CMD_MAX + 1] = {
 	[IPSET_ATTR_LINENO]	= { .type = NLA_U32 },
 	[IPSET_ATTR_DATA]	= { .type = NLA_NESTED },
 	[IPSET_ATTR_ADT]	= { .type = NLA_NESTED },
+	[IPSET_ATTR_ADT_COUNT]	= { .type = NLA_U32 },
 };
 
+/* Elements of a multiple data container added/deleted under one lock */
+#define IPSET_ADT_BATCH		64
+
+/* Finish an add/del whose first attempt returned ret: resize the set and
+ * retry if it is full, and report errors.  Called without the set lock.
+ */
 static int
-call_ad(struct sock *ctnl, struct sk_buff *skb, struct ip_set *set,
-	struct nlattr *tb[], enum ipset_adt adt,
-	u32 flags, bool use_lineno)
+call_ad_finish(struct sock *ctnl, struct sk_buff *skb, struct ip_set *set,
+	       struct nlattr *tb[], enum ipset_adt adt,
+	       u32 flags, bool use_lineno, int ret, u32 lineno)
 {
-	int ret;
-	u32 lineno = 0;
-	bool eexist = flags & IPSET_FLAG_EXIST, retried = false;
+	bool eexist = flags & IPSET_FLAG_EXIST;
 
-	do {
+	while (ret == -EAGAIN &&
+	       set->variant->resize &&
+	       (ret = set->variant->resize(set, true)) == 0) {
 		spin_lock_bh(&set->lock);
-		ret = set->variant->uadt(set, tb, adt, &lineno, flags, retried);
+		ret = set->variant->uadt(set, tb, adt, &lineno, flags, true);
 		spin_unlock_bh(&set->lock);
-		retried = true;
-	} while (ret == -EAGAIN &&
-		 set->variant->resize &&
-		 (ret = set->variant->resize(set, retried)) == 0);
+	}
 
 	if (!ret || (ret == -IPSET_ERR_EXIST && eexist))
 		return 0;
@@ -1521,6 +1525,76 @@ call_ad(struct sock *ctnl, struct sk_buff *skb, struct ip_set *set,
 	return ret;
 }
 
+static int
+call_ad(struct sock *ctnl, struct sk_buff *skb, struct ip_set *set,
+	struct nlattr *tb[], enum ipset_adt adt,
+	u32 flags, bool use_lineno)
+{
+	u32 lineno = 0;
+	int ret;
+
+	spin_lock_bh(&set->lock);
+	ret = set->variant->uadt(set, tb, adt, &lineno, flags, false);
+	spin_unlock_bh(&set->lock);
+
+	return call_ad_finish(ctnl, skb, set, tb, adt, flags, use_lineno,
+			      ret, lineno);
+}
+
+/* Add/del the elements of a multiple data container, keeping the set
+ * locked over IPSET_ADT_BATCH of them instead of locking for each.
+ */
+static int
+call_ad_batch(struct sock *ctnl, struct sk_buff *skb, struct ip_set *set,
+	      const struct nlattr *adt_attr, enum ipset_adt adt,
+	      u32 flags, bool use_lineno)
+{
+	struct nlattr *tb[IPSET_ATTR_ADT_MAX + 1];
+	bool eexist = flags & IPSET_FLAG_EXIST;
+	const struct nlattr *nla;
+	unsigned int batched = 0;
+	int nla_rem, ret = 0;
+	u32 lineno;
+
+	nla_for_each_nested(nla, adt_attr, nla_rem) {
+		memset(tb, 0, sizeof(tb));
+		if (nla_type(nla) != IPSET_ATTR_DATA ||
+		    !flag_nested(nla) ||
+		    nla_parse_nested(tb, IPSET_ATTR_ADT_MAX, nla,
+				     set->type->adt_policy, NULL)) {
+			ret = -IPSET_ERR_PROTOCOL;
+			break;
+		}
+
+		if (!batched)
+			spin_lock_bh(&set->lock);
+		lineno = 0;
+		ret = set->variant->uadt(set, tb, adt, &lineno, flags, false);
+		if (!ret || (ret == -IPSET_ERR_EXIST && eexist)) {
+			ret = 0;
+			if (++batched < IPSET_ADT_BATCH)
+				continue;
+			spin_unlock_bh(&set->lock);
+			batched = 0;
+			cond_resched();
+			continue;
+		}
+
+		/* Resize or report the error without the lock */
+		spin_unlock_bh(&set->lock);
+		batched = 0;
+		ret = call_ad_finish(ctnl, skb, set, tb, adt, flags,
+				     use_lineno, ret, lineno);
+		if (ret < 0)
+			return ret;
+	}
+
+	if (batched)
+		spin_unlock_bh(&set->lock);
+
+	return ret;
+}
+
 static int ip_set_uadd(struct net *net, struct sock *ctnl, struct sk_buff *skb,
 		       const struct nlmsghdr *nlh,
 		       const struct nlattr * const attr[],
@@ -1529,7 +1603,6 @@ static int ip_set_uadd(struct net *net, struct sock *ctnl, struct sk_buff *skb,
 	struct ip_set_net *inst = ip_set_pernet(net);
 	struct ip_set *set;
 	struct nlattr *tb[IPSET_ATTR_ADT_MAX + 1] = {};
-	const struct nlattr *nla;
 	u32 flags = flag_exist(nlh);
 	bool use_lineno;
 	int ret = 0;
@@ -1558,20 +1631,12 @@ static int ip_set_uadd(struct net *net, struct sock *ctnl, struct sk_buff *skb,
 		ret = call_ad(ctnl, skb, set, tb, IPSET_ADD, flags,
 			      use_lineno);
 	} else {
-		int nla_rem;
-
-		nla_for_each_nested(nla, attr[IPSET_ATTR_ADT], nla_rem) {
-			memset(tb, 0, sizeof(tb));
-			if (nla_type(nla) != IPSET_ATTR_DATA ||
-			    !flag_nested(nla) ||
-			    nla_parse_nested(tb, IPSET_ATTR_ADT_MAX, nla,
-					     set->type->adt_policy, NULL))
-				return -IPSET_ERR_PROTOCOL;
-			ret = call_ad(ctnl, skb, set, tb, IPSET_ADD,
-				      flags, use_lineno);
-			if (ret < 0)
-				return ret;
-		}
+		/* Size the set for the whole batch upfront */
+		if (attr[IPSET_ATTR_ADT_COUNT] && set->variant->reserve)
+			set->variant->reserve(set,
+				nla_get_u32(attr[IPSET_ATTR_ADT_COUNT]));
+		ret = call_ad_batch(ctnl, skb, set, attr[IPSET_ATTR_ADT],
+				    IPSET_ADD, flags, use_lineno);
 	}
 	return ret;
 }
@@ -1584,7 +1649,6 @@ static int ip_set_udel(struct net *net, struct sock *ctnl, struct sk_buff *skb,
 	struct ip_set_net *inst = ip_set_pernet(net);
 	struct ip_set *set;
 	struct nlattr *tb[IPSET_ATTR_ADT_MAX + 1] = {};
-	const struct nlattr *nla;
 	u32 flags = flag_exist(nlh);
 	bool use_lineno;
 	int ret = 0;
@@ -1613,20 +1677,8 @@ static int ip_set_udel(struct net *net, struct sock *ctnl, struct sk_buff *skb,
 		ret = call_ad(ctnl, skb, set, tb, IPSET_DEL, flags,
 			      use_lineno);
 	} else {
-		int nla_rem;
-
-		nla_for_each_nested(nla, attr[IPSET_ATTR_ADT], nla_rem) {
-			memset(tb, 0, sizeof(*tb));
-			if (nla_type(nla) != IPSET_ATTR_DATA ||
-			    !flag_nested(nla) ||
-			    nla_parse_nested(tb, IPSET_ATTR_ADT_MAX, nla,
-					     set->type->adt_policy, NULL))
-				return -IPSET_ERR_PROTOCOL;
-			ret = call_ad(ctnl, skb, set, tb, IPSET_DEL,
-				      flags, use_lineno);
-			if (ret < 0)
-				return ret;
-		}
+		ret = call_ad_batch(ctnl, skb, set, attr[IPSET_ATTR_ADT],
+				    IPSET_DEL, flags, use_lineno);
 	}
 	return ret;
 }
@@ -27,9 +27,11 @@
  * Readers and resizing
  *
  * Resizing can be triggered by userspace command only, and those
- * are serialized by the nfnl mutex. During resizing the set is
- * read-locked, so the only possible concurrent operations are
- * the kernel side readers. Those must be protected by proper RCU locking.
+ * are serialized by the nfnl mutex. The elements are copied to the new
+ * table without the set lock, so the kernel side readers, adds and
+ * deletes can run in parallel: the copy is dropped and redone under the
+ * lock if they changed the set. The readers must be protected by proper
+ * RCU locking.
  */
 
 /* Number of elements to store in an initial array block */
@@ -210,7 +212,10 @@ htable_bits(u32 hashsize)
 #undef mtype_test
 #undef mtype_uref
 #undef mtype_expire
+#undef mtype_resize_copy
+#undef mtype_resize_bits
 #undef mtype_resize
+#undef mtype_reserve
 #undef mtype_head
 #undef mtype_list
 #undef mtype_gc
@@ -252,7 +257,10 @@ htable_bits(u32 hashsize)
 #define mtype_test		IPSET_TOKEN(MTYPE, _test)
 #define mtype_uref		IPSET_TOKEN(MTYPE, _uref)
 #define mtype_expire		IPSET_TOKEN(MTYPE, _expire)
+#define mtype_resize_copy	IPSET_TOKEN(MTYPE, _resize_copy)
+#define mtype_resize_bits	IPSET_TOKEN(MTYPE, _resize_bits)
 #define mtype_resize		IPSET_TOKEN(MTYPE, _resize)
+#define mtype_reserve		IPSET_TOKEN(MTYPE, _reserve)
 #define mtype_head		IPSET_TOKEN(MTYPE, _head)
 #define mtype_list		IPSET_TOKEN(MTYPE, _list)
 #define mtype_gc		IPSET_TOKEN(MTYPE, _gc)
@@ -282,6 +290,7 @@ struct htype {
 	struct timer_list gc;	/* garbage collection when timeout enabled */
 	u32 maxelem;		/* max elements in the hash */
 	u32 initval;		/* random jhash init value */
+	u32 changes;		/* bumped by changes of the elements */
 #ifdef IP_SET_HASH_WITH_MARKMASK
 	u32 markmask;		/* markmask value for mark mask to store */
 #endif
@@ -390,6 +399,7 @@ mtype_flush(struct ip_set *set)
 #endif
 	set->elements = 0;
 	set->ext_size = 0;
+	h->changes++;
 }
 
 /* Destroy the hashtable part of the set */
@@ -494,9 +504,11 @@ mtype_expire(struct ip_set *set, struct htype *h)
 #endif
 			ip_set_ext_destroy(set, data);
 			set->elements--;
+			h->changes++;
 			d++;
 		}
 		if (d >= AHASH_INIT_SIZE) {
+			h->changes++;
 			if (d >= n->size) {
 				rcu_assign_pointer(hbucket(t, i), NULL);
 				kfree_rcu(n, rcu);
@@ -540,66 +552,35 @@ mtype_gc(unsigned long ul_set)
 	add_timer(&h->gc);
 }
 
-/* Resize a hash: create a new hash table with doubling the hashsize
- * and inserting the elements to it. Repeat until we succeed or
- * fail due to memory pressures.
+/* Copy the elements of orig into the new table t.  It runs either with
+ * the set lock held (changes == NULL) or without it, bucket by bucket
+ * under RCU, in which case it gives up with -EBUSY as soon as the set is
+ * changed under it: the caller has to compare h->changes to *changes
+ * under the set lock once done, too.
  */
 static int
-mtype_resize(struct ip_set *set, bool retried)
+mtype_resize_copy(struct ip_set *set, struct htable *orig, struct htable *t,
+		  struct mtype_elem *tmp, size_t *extsize, const u32 *changes)
 {
 	struct htype *h = set->data;
-	struct htable *t, *orig;
-	u8 htable_bits;
-	size_t extsize, dsize = set->dsize;
+	u8 htable_bits = t->htable_bits;
+	size_t dsize = set->dsize;
 #ifdef IP_SET_HASH_WITH_NETS
 	u8 flags;
-	struct mtype_elem *tmp;
 #endif
 	struct mtype_elem *data;
 	struct mtype_elem *d;
 	struct hbucket *n, *m;
 	u32 i, j, key;
-	int ret;
+	int ret = 0;
 
-#ifdef IP_SET_HASH_WITH_NETS
-	tmp = kmalloc(dsize, GFP_KERNEL);
-	if (!tmp)
-		return -ENOMEM;
-#endif
-	rcu_read_lock_bh();
-	orig = rcu_dereference_bh_nfnl(h->table);
-	htable_bits = orig->htable_bits;
-	rcu_read_unlock_bh();
-
-retry:
-	ret = 0;
-	htable_bits++;
-	if (!htable_bits) {
-		/* In case we have plenty of memory :-) */
-		pr_warn("Cannot increase the hashsize of set %s further\n",
-			set->name);
-		ret = -IPSET_ERR_HASH_FULL;
-		goto out;
-	}
-	t = ip_set_alloc(htable_size(htable_bits));
-	if (!t) {
-		ret = -ENOMEM;
-		goto out;
-	}
-	t->htable_bits = htable_bits;
-
-	spin_lock_bh(&set->lock);
-	orig = __ipset_dereference_protected(h->table, 1);
-	/* There can't be another parallel resizing, but dumping is possible */
-	atomic_set(&orig->ref, 1);
-	atomic_inc(&orig->uref);
-	extsize = 0;
-	pr_debug("attempt to resize set %s from %u to %u, t %p\n",
-		 set->name, orig->htable_bits, htable_bits, orig);
+	*extsize = 0;
 	for (i = 0; i < jhash_size(orig->htable_bits); i++) {
-		n = __ipset_dereference_protected(hbucket(orig, i), 1);
+		if (changes)
+			rcu_read_lock_bh();
+		n = rcu_dereference_bh_nfnl(hbucket(orig, i));
 		if (!n)
-			continue;
+			goto next;
 		for (j = 0; j < n->pos; j++) {
 			if (!test_bit(j, n->used))
 				continue;
@@ -621,10 +602,10 @@ mtype_resize(struct ip_set *set, bool retried)
 					    GFP_ATOMIC);
 				if (!m) {
 					ret = -ENOMEM;
-					goto cleanup;
+					goto next;
 				}
 				m->size = AHASH_INIT_SIZE;
-				extsize = ext_size(AHASH_INIT_SIZE, dsize);
+				*extsize += ext_size(AHASH_INIT_SIZE, dsize);
 				RCU_INIT_POINTER(hbucket(t, key), m);
 			} else if (m->pos >= m->size) {
 				struct hbucket *ht;
@@ -640,11 +621,11 @@ mtype_resize(struct ip_set *set, bool retried)
 						ret = -ENOMEM;
 				}
 				if (ret < 0)
-					goto cleanup;
+					goto next;
 				memcpy(ht, m, sizeof(struct hbucket) +
 					      m->size * dsize);
 				ht->size = m->size + AHASH_INIT_SIZE;
-				extsize += ext_size(AHASH_INIT_SIZE, dsize);
+				*extsize += ext_size(AHASH_INIT_SIZE, dsize);
 				kfree(m);
 				m = ht;
 				RCU_INIT_POINTER(hbucket(t, key), ht);
@@ -656,7 +637,95 @@ mtype_resize(struct ip_set *set, bool retried)
 			mtype_data_reset_flags(d, &flags);
 #endif
 		}
+next:
+		if (!changes) {
+			if (ret)
+				return ret;
+			continue;
+		}
+		rcu_read_unlock_bh();
+		if (ret)
+			return ret;
+		if (READ_ONCE(h->changes) != *changes)
+			return -EBUSY;
+		cond_resched();
+	}
+
+	return 0;
+}
+
+/* Resize a hash: create a new hash table of 2^htable_bits buckets and
+ * insert the elements to it, doubling the size again until we succeed
+ * or fail due to memory pressures.
+ *
+ * The elements are copied without the set lock first, so that adds and
+ * deletes from the packet path don't wait for the copy.  If the set
+ * changes meanwhile, the copy is redone with the lock held.
+ */
+static int
+mtype_resize_bits(struct ip_set *set, u8 htable_bits)
+{
+	struct htype *h = set->data;
+	struct htable *t, *orig;
+	struct mtype_elem *tmp = NULL;
+	size_t extsize;
+	u32 changes;
+	int ret;
+
+#ifdef IP_SET_HASH_WITH_NETS
+	tmp = kmalloc(set->dsize, GFP_KERNEL);
+	if (!tmp)
+		return -ENOMEM;
+#endif
+
+retry:
+	ret = 0;
+	if (!htable_bits) {
+		/* In case we have plenty of memory :-) */
+		pr_warn("Cannot increase the hashsize of set %s further\n",
+			set->name);
+		ret = -IPSET_ERR_HASH_FULL;
+		goto out;
+	}
+	t = ip_set_alloc(htable_size(htable_bits));
+	if (!t) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	t->htable_bits = htable_bits;
+
+	spin_lock_bh(&set->lock);
+	orig = __ipset_dereference_protected(h->table, 1);
+	/* There can't be another parallel resizing, but dumping is possible */
+	atomic_set(&orig->ref, 1);
+	atomic_inc(&orig->uref);
+	changes = h->changes;
+	spin_unlock_bh(&set->lock);
+
+	pr_debug("attempt to resize set %s from %u to %u, t %p\n",
+		 set->name, orig->htable_bits, htable_bits, orig);
+	ret = mtype_resize_copy(set, orig, t, tmp, &extsize, &changes);
+
+	spin_lock_bh(&set->lock);
+	if (ret == -EBUSY || (!ret && h->changes != changes)) {
+		spin_unlock_bh(&set->lock);
+		pr_debug("set %s changed while resizing, copy locked\n",
+			 set->name);
+		mtype_ahash_destroy(set, t, false);
+		t = ip_set_alloc(htable_size(htable_bits));
+		if (!t) {
+			atomic_set(&orig->ref, 0);
+			atomic_dec(&orig->uref);
+			ret = -ENOMEM;
+			goto out;
+		}
+		t->htable_bits = htable_bits;
+		spin_lock_bh(&set->lock);
+		ret = mtype_resize_copy(set, orig, t, tmp, &extsize, NULL);
 	}
+	if (ret)
+		goto cleanup;
+
 	rcu_assign_pointer(h->table, t);
 	set->ext_size = extsize;
 
@@ -674,9 +743,7 @@ mtype_resize(struct ip_set *set, bool retried)
 	}
 
 out:
-#ifdef IP_SET_HASH_WITH_NETS
 	kfree(tmp);
-#endif
 	return ret;
 
 cleanup:
@@ -684,11 +751,48 @@ mtype_resize(struct ip_set *set, bool retried)
 	atomic_dec(&orig->uref);
 	spin_unlock_bh(&set->lock);
 	mtype_ahash_destroy(set, t, false);
-	if (ret == -EAGAIN)
+	if (ret == -EAGAIN) {
+		htable_bits++;
 		goto retry;
+	}
 	goto out;
 }
 
+static int
+mtype_resize(struct ip_set *set, bool retried)
+{
+	struct htype *h = set->data;
+	u8 htable_bits;
+
+	rcu_read_lock_bh();
+	htable_bits = rcu_dereference_bh_nfnl(h->table)->htable_bits;
+	rcu_read_unlock_bh();
+
+	return mtype_resize_bits(set, htable_bits + 1);
+}
+
+/* Grow the hash ahead of adding a batch of elements, to two elements per
+ * bucket at most, instead of doubling it repeatedly while adding them.
+ */
+static void
+mtype_reserve(struct ip_set *set, u32 elements)
+{
+	struct htype *h = set->data;
+	u8 bits, cur_bits;
+	u64 total;
+
+	total = min_t(u64, (u64)set->elements + elements, h->maxelem);
+	bits = htable_bits(max_t(u32, DIV_ROUND_UP_ULL(total, 2), 1));
+
+	rcu_read_lock_bh();
+	cur_bits = rcu_dereference_bh_nfnl(h->table)->htable_bits;
+	rcu_read_unlock_bh();
+
+	/* On failure the adds will resize as they need */
+	if (bits > cur_bits)
+		mtype_resize_bits(set, bits);
+}
+
 /* Add an element to a hash and update the internal counters when succeeded,
  * otherwise report the proper error code.
  */
@@ -823,6 +927,7 @@ mtype_add(struct ip_set *set, void *value, const struct ip_set_ext *ext,
 		if (old)
 			kfree_rcu(old, rcu);
 	}
+	h->changes++;
 
 	return 0;
 set_full:
@@ -865,6 +970,7 @@ mtype_del(struct ip_set *set, void *value, const struct ip_set_ext *ext,
 			goto out;
 
 		ret = 0;
+		h->changes++;
 		clear_bit(i, n->used);
 		smp_mb__after_atomic();
 		if (i + 1 == n->pos)
@@ -1218,6 +1324,7 @@ static const struct ip_set_type_variant mtype_variant = {
 	.list	= mtype_list,
 	.uref	= mtype_uref,
 	.resize	= mtype_resize,
+	.reserve = mtype_reserve,
 	.same_set = mtype_same_set,
 };
 
@@ -31,6 +31,7 @@
 #include <linux/net.h>
 #include <linux/kernel.h>
 #include <linux/module.h>
+#include <linux/mm.h>
 #include <linux/vmalloc.h>
 #include <linux/proc_fs.h>		/* for proc_net_* */
 #include <linux/slab.h>
@@ -47,20 +48,37 @@
 #endif
 
 /*
- * Connection hash size. Default is what was selected at compile time.
+ * Connection hash size. Each netns starts with a table of the size selected
+ * at compile time and resizes it with the number of connections, between
+ * IP_VS_CONN_TAB_MIN_BITS and conn_tab_max_bits.
 */
 static int ip_vs_conn_tab_bits = CONFIG_IP_VS_TAB_BITS;
 module_param_named(conn_tab_bits, ip_vs_conn_tab_bits, int, 0444);
-MODULE_PARM_DESC(conn_tab_bits, "Set connections' hash size");
+MODULE_PARM_DESC(conn_tab_bits, "Set connections' initial hash size");
 
-/* size and mask values */
-int ip_vs_conn_tab_size __read_mostly;
-static int ip_vs_conn_tab_mask __read_mostly;
+static int ip_vs_conn_tab_max_bits = 24;
+module_param_named(conn_tab_max_bits, ip_vs_conn_tab_max_bits, int, 0444);
+MODULE_PARM_DESC(conn_tab_max_bits, "Set connections' maximum hash size");
+
+#define IP_VS_CONN_TAB_MIN_BITS	8
+#define IP_VS_CONN_TAB_MAX_BITS	27
 
 /*
- *  Connection hash table: for input and output packets lookups of IPVS
+ *  Connection hash table: for input and output packets lookups of IPVS.
+ *
+ *  While the table is resized, new_tab points to its replacement: new
+ *  entries go there, the resize work moves the old ones over, and lookups
+ *  that miss in the old table try the new one as well.
  */
-static struct hlist_head *ip_vs_conn_tab __read_mostly;
+struct ip_vs_conn_tab {
+	struct ip_vs_conn_tab __rcu	*new_tab;
+	unsigned int			size;
+	unsigned int			mask;
+	struct hlist_head		buckets[];
+};
+
+/* Keeps the tables around for walkers that drop RCU to reschedule */
+static DEFINE_MUTEX(ip_vs_conn_tab_mutex);
 
 /*  SLAB cache for IPVS connections */
 static struct kmem_cache *ip_vs_conn_cachep __read_mostly;
@@ -72,7 +90,10 @@ static atomic_t ip_vs_conn_no_cport_cnt = ATOMIC_INIT(0);
 static unsigned int ip_vs_conn_rnd __read_mostly;
 
 /*
- *  Fine locking granularity for big connection hash table
+ *  Fine locking granularity for big connection hash table. The lock is
+ *  picked from the low bits of the full hash, so an entry keeps its lock
+ *  across table sizes (all of which have at least CT_LOCKARRAY_SIZE
+ *  buckets).
  */
 #define CT_LOCKARRAY_BITS  5
 #define CT_LOCKARRAY_SIZE  (1<<CT_LOCKARRAY_BITS)
@@ -106,22 +127,40 @@ static inline void ct_write_unlock_bh(unsigned int key)
 
 static void ip_vs_conn_expire(unsigned long data);
 
+static inline struct hlist_head *
+ip_vs_conn_bucket(struct ip_vs_conn_tab *t, unsigned int hash)
+{
+	return &t->buckets[hash & t->mask];
+}
+
+/* Next table to look in after a miss in 't', NULL unless resizing */
+static inline struct ip_vs_conn_tab *
+ip_vs_conn_tab_next(struct ip_vs_conn_tab *t)
+{
+	/* Pairs with the smp_wmb() in ip_vs_conn_move_tail() */
+	smp_rmb();
+	return rcu_dereference(t->new_tab);
+}
+
+#define ip_vs_conn_for_each_tab(t, ipvs)			\
+	for (t = rcu_dereference((ipvs)->conn_tab); t;		\
+	     t = ip_vs_conn_tab_next(t))
+
 /*
- *	Returns hash value for IPVS connection entry
+ *	Returns hash value for IPVS connection entry, before it is masked
+ *	with the table size
  */
-static unsigned int ip_vs_conn_hashkey(struct netns_ipvs *ipvs, int af, unsigned int proto,
+static unsigned int ip_vs_conn_hashkey(int af, unsigned int proto,
 				       const union nf_inet_addr *addr,
 				       __be16 port)
 {
 #ifdef CONFIG_IP_VS_IPV6
 	if (af == AF_INET6)
-		return (jhash_3words(jhash(addr, 16, ip_vs_conn_rnd),
-				    (__force u32)port, proto, ip_vs_conn_rnd) ^
-			((size_t)ipvs>>8)) & ip_vs_conn_tab_mask;
+		return jhash_3words(jhash(addr, 16, ip_vs_conn_rnd),
+				    (__force u32)port, proto, ip_vs_conn_rnd);
 #endif
-	return (jhash_3words((__force u32)addr->ip, (__force u32)port, proto,
-			    ip_vs_conn_rnd) ^
-		((size_t)ipvs>>8)) & ip_vs_conn_tab_mask;
+	return jhash_3words((__force u32)addr->ip, (__force u32)port, proto,
+			    ip_vs_conn_rnd);
 }
 
 static unsigned int ip_vs_conn_hashkey_param(const struct ip_vs_conn_param *p,
@@ -131,8 +170,7 @@ static unsigned int ip_vs_conn_hashkey_param(const struct ip_vs_conn_param *p,
 	__be16 port;
 
 	if (p->pe_data && p->pe->hashkey_raw)
-		return p->pe->hashkey_raw(p, ip_vs_conn_rnd, inverse) &
-			ip_vs_conn_tab_mask;
+		return p->pe->hashkey_raw(p, ip_vs_conn_rnd, inverse);
 
 	if (likely(!inverse)) {
 		addr = p->caddr;
@@ -142,7 +180,7 @@ static unsigned int ip_vs_conn_hashkey_param(const struct ip_vs_conn_param *p,
 		port = p->vport;
 	}
 
-	return ip_vs_conn_hashkey(p->ipvs, p->af, p->protocol, addr, port);
+	return ip_vs_conn_hashkey(p->af, p->protocol, addr, port);
 }
 
 static unsigned int ip_vs_conn_hashkey_conn(const struct ip_vs_conn *cp)
@@ -167,6 +205,7 @@ static unsigned int ip_vs_conn_hashkey_conn(const struct ip_vs_conn *cp)
  */
 static inline int ip_vs_conn_hash(struct ip_vs_conn *cp)
 {
+	struct ip_vs_conn_tab *t, *nt;
 	unsigned int hash;
 	int ret;
 
@@ -176,13 +215,19 @@ static inline int ip_vs_conn_hash(struct ip_vs_conn *cp)
 	/* Hash by protocol, client address and port */
 	hash = ip_vs_conn_hashkey_conn(cp);
 
+	rcu_read_lock();
 	ct_write_lock_bh(hash);
 	spin_lock(&cp->lock);
 
 	if (!(cp->flags & IP_VS_CONN_F_HASHED)) {
 		cp->flags |= IP_VS_CONN_F_HASHED;
 		refcount_inc(&cp->refcnt);
-		hlist_add_head_rcu(&cp->c_list, &ip_vs_conn_tab[hash]);
+		/* Once a resize started, only the new table takes entries */
+		t = rcu_dereference(cp->ipvs->conn_tab);
+		nt = rcu_dereference(t->new_tab);
+		if (nt)
+			t = nt;
+		hlist_add_head_rcu(&cp->c_list, ip_vs_conn_bucket(t, hash));
 		ret = 1;
 	} else {
 		pr_err("%s(): request for already hashed, called from %pF\n",
@@ -192,6 +237,7 @@ static inline int ip_vs_conn_hash(struct ip_vs_conn *cp)
 
 	spin_unlock(&cp->lock);
 	ct_write_unlock_bh(hash);
+	rcu_read_unlock();
 
 	return ret;
 }
@@ -266,6 +312,7 @@ static inline bool ip_vs_conn_unlink(struct ip_vs_conn *cp)
 static inline struct ip_vs_conn *
 __ip_vs_conn_in_get(const struct ip_vs_conn_param *p)
 {
+	struct ip_vs_conn_tab *t;
 	unsigned int hash;
 	struct ip_vs_conn *cp;
 
@@ -273,19 +320,22 @@ __ip_vs_conn_in_get(const struct ip_vs_conn_param *p)
 
 	rcu_read_lock();
 
-	hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[hash], c_list) {
-		if (p->cport == cp->cport && p->vport == cp->vport &&
-		    cp->af == p->af &&
-		    ip_vs_addr_equal(p->af, p->caddr, &cp->caddr) &&
-		    ip_vs_addr_equal(p->af, p->vaddr, &cp->vaddr) &&
-		    ((!p->cport) ^ (!(cp->flags & IP_VS_CONN_F_NO_CPORT))) &&
-		    p->protocol == cp->protocol &&
-		    cp->ipvs == p->ipvs) {
-			if (!__ip_vs_conn_get(cp))
-				continue;
-			/* HIT */
-			rcu_read_unlock();
-			return cp;
+	ip_vs_conn_for_each_tab(t, p->ipvs) {
+		hlist_for_each_entry_rcu(cp, ip_vs_conn_bucket(t, hash),
+					 c_list) {
+			if (p->cport == cp->cport && p->vport == cp->vport &&
+			    cp->af == p->af &&
+			    ip_vs_addr_equal(p->af, p->caddr, &cp->caddr) &&
+			    ip_vs_addr_equal(p->af, p->vaddr, &cp->vaddr) &&
+			    ((!p->cport) ^
+			     (!(cp->flags & IP_VS_CONN_F_NO_CPORT))) &&
+			    p->protocol == cp->protocol) {
+				if (!__ip_vs_conn_get(cp))
+					continue;
+				/* HIT */
+				rcu_read_unlock();
+				return cp;
+			}
 		}
 	}
 
@@ -352,6 +402,7 @@ EXPORT_SYMBOL_GPL(ip_vs_conn_in_get_proto);
 /* Get reference to connection template */
 struct ip_vs_conn *ip_vs_ct_in_get(const struct ip_vs_conn_param *p)
 {
+	struct ip_vs_conn_tab *t;
 	unsigned int hash;
 	struct ip_vs_conn *cp;
 
@@ -359,29 +410,30 @@ struct ip_vs_conn *ip_vs_ct_in_get(const struct ip_vs_conn_param *p)
 
 	rcu_read_lock();
 
-	hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[hash], c_list) {
-		if (unlikely(p->pe_data && p->pe->ct_match)) {
-			if (cp->ipvs != p->ipvs)
+	ip_vs_conn_for_each_tab(t, p->ipvs) {
+		hlist_for_each_entry_rcu(cp, ip_vs_conn_bucket(t, hash),
+					 c_list) {
+			if (unlikely(p->pe_data && p->pe->ct_match)) {
+				if (p->pe == cp->pe && p->pe->ct_match(p, cp)) {
+					if (__ip_vs_conn_get(cp))
+						goto out;
+				}
 				continue;
-			if (p->pe == cp->pe && p->pe->ct_match(p, cp)) {
+			}
+
+			if (cp->af == p->af &&
+			    ip_vs_addr_equal(p->af, p->caddr, &cp->caddr) &&
+			    /* protocol should only be IPPROTO_IP if
+			     * p->vaddr is a fwmark */
+			    ip_vs_addr_equal(p->protocol == IPPROTO_IP ?
+					     AF_UNSPEC : p->af,
+					     p->vaddr, &cp->vaddr) &&
+			    p->vport == cp->vport && p->cport == cp->cport &&
+			    cp->flags & IP_VS_CONN_F_TEMPLATE &&
+			    p->protocol == cp->protocol) {
 				if (__ip_vs_conn_get(cp))
 					goto out;
 			}
-			continue;
-		}
-
-		if (cp->af == p->af &&
-		    ip_vs_addr_equal(p->af, p->caddr, &cp->caddr) &&
-		    /* protocol should only be IPPROTO_IP if
-		     * p->vaddr is a fwmark */
-		    ip_vs_addr_equal(p->protocol == IPPROTO_IP ? AF_UNSPEC :
-				     p->af, p->vaddr, &cp->vaddr) &&
-		    p->vport == cp->vport && p->cport == cp->cport &&
-		    cp->flags & IP_VS_CONN_F_TEMPLATE &&
-		    p->protocol == cp->protocol &&
-		    cp->ipvs == p->ipvs) {
-			if (__ip_vs_conn_get(cp))
-				goto out;
 		}
 	}
 	cp = NULL;
@@ -404,6 +456,7 @@ struct ip_vs_conn *ip_vs_ct_in_get(const struct ip_vs_conn_param *p)
  *	p->vaddr, p->vport: pkt dest address (foreign host) */
 struct ip_vs_conn *ip_vs_conn_out_get(const struct ip_vs_conn_param *p)
 {
+	struct ip_vs_conn_tab *t;
 	unsigned int hash;
 	struct ip_vs_conn *cp, *ret=NULL;
 
@@ -414,21 +467,24 @@ struct ip_vs_conn *ip_vs_conn_out_get(const struct ip_vs_conn_param *p)
 
 	rcu_read_lock();
 
-	hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[hash], c_list) {
-		if (p->vport == cp->cport && p->cport == cp->dport &&
-		    cp->af == p->af &&
-		    ip_vs_addr_equal(p->af, p->vaddr, &cp->caddr) &&
-		    ip_vs_addr_equal(p->af, p->caddr, &cp->daddr) &&
-		    p->protocol == cp->protocol &&
-		    cp->ipvs == p->ipvs) {
-			if (!__ip_vs_conn_get(cp))
-				continue;
-			/* HIT */
-			ret = cp;
-			break;
+	ip_vs_conn_for_each_tab(t, p->ipvs) {
+		hlist_for_each_entry_rcu(cp, ip_vs_conn_bucket(t, hash),
+					 c_list) {
+			if (p->vport == cp->cport && p->cport == cp->dport &&
+			    cp->af == p->af &&
+			    ip_vs_addr_equal(p->af, p->vaddr, &cp->caddr) &&
+			    ip_vs_addr_equal(p->af, p->caddr, &cp->daddr) &&
+			    p->protocol == cp->protocol) {
+				if (!__ip_vs_conn_get(cp))
+					continue;
+				/* HIT */
+				ret = cp;
+				goto out;
+			}
 		}
 	}
 
+out:
 	rcu_read_unlock();
 
 	IP_VS_DBG_BUF(9, "lookup/out %s %s:%d->%s:%d %s\n",
@@ -807,6 +863,136 @@ int ip_vs_check_template(struct ip_vs_conn *ct, struct ip_vs_dest *cdest)
 	return 1;
 }
 
+static struct ip_vs_conn_tab *ip_vs_conn_tab_alloc(unsigned int size)
+{
+	struct ip_vs_conn_tab *t;
+	unsigned int idx;
+
+	t = kvmalloc(sizeof(*t) + size * sizeof(t->buckets[0]), GFP_KERNEL);
+	if (!t)
+		return NULL;
+
+	RCU_INIT_POINTER(t->new_tab, NULL);
+	t->size = size;
+	t->mask = size - 1;
+	for (idx = 0; idx < size; idx++)
+		INIT_HLIST_HEAD(&t->buckets[idx]);
+
+	return t;
+}
+
+/* Table size for the current number of connections: grow as soon as there
+ * are more connections than buckets, shrink once the table is less than
+ * 1/8 full, leaving room for the count to double again.
+ */
+static unsigned int ip_vs_conn_tab_wanted(struct netns_ipvs *ipvs,
+					  unsigned int size)
+{
+	unsigned int count = atomic_read(&ipvs->conn_count);
+
+	if (count > size)
+		size = roundup_pow_of_two(count);
+	else if (count < size / 8)
+		size = roundup_pow_of_two(max(count, 1U)) * 2;
+
+	return clamp(size, 1U << IP_VS_CONN_TAB_MIN_BITS,
+		     1U << ip_vs_conn_tab_max_bits);
+}
+
+/* Schedule a resize when the connection count left the table's range */
+static void ip_vs_conn_tab_check(struct netns_ipvs *ipvs)
+{
+	struct ip_vs_conn_tab *t;
+	unsigned int size;
+
+	rcu_read_lock();
+	t = rcu_dereference(ipvs->conn_tab);
+	size = t->size;
+	rcu_read_unlock();
+
+	if (unlikely(ip_vs_conn_tab_wanted(ipvs, size) != size))
+		schedule_work(&ipvs->conn_resize_work);
+}
+
+/* Move the last entry of 'head' to its bucket in 'nt'.  Taking the tail
+ * means that a lookup standing on the entry has nothing left to miss in
+ * the old chain: it follows the entry into the new chain and ends there,
+ * then checks the new table where everything moved so far already is.
+ * Called with the entry's bucket lock held.
+ */
+static void ip_vs_conn_move_tail(struct ip_vs_conn_tab *nt,
+				 struct hlist_head *head)
+{
+	struct hlist_node *last = head->first;
+	struct hlist_node **pprev;
+	struct ip_vs_conn *cp;
+
+	while (last->next)
+		last = last->next;
+
+	cp = hlist_entry(last, struct ip_vs_conn, c_list);
+	pprev = last->pprev;
+
+	/* Link it in the new table before it leaves the old one */
+	hlist_add_head_rcu(last,
+			   ip_vs_conn_bucket(nt, ip_vs_conn_hashkey_conn(cp)));
+	smp_wmb();
+	WRITE_ONCE(*pprev, NULL);
+}
+
+static void ip_vs_conn_resize_work(struct work_struct *work)
+{
+	struct netns_ipvs *ipvs = container_of(work, struct netns_ipvs,
+					       conn_resize_work);
+	struct ip_vs_conn_tab *t, *nt;
+	unsigned int size, idx;
+
+	mutex_lock(&ip_vs_conn_tab_mutex);
+
+	t = rcu_dereference_protected(ipvs->conn_tab,
+				      lockdep_is_held(&ip_vs_conn_tab_mutex));
+	size = ip_vs_conn_tab_wanted(ipvs, t->size);
+	if (size == t->size)
+		goto out;
+
+	nt = ip_vs_conn_tab_alloc(size);
+	if (!nt)
+		goto out;
+
+	IP_VS_DBG(2, "resizing connection table %u -> %u (%d conns)\n",
+		  t->size, size, atomic_read(&ipvs->conn_count));
+
+	rcu_assign_pointer(t->new_tab, nt);
+
+	for (idx = 0; idx < t->size; idx++) {
+		ct_write_lock_bh(idx);
+		while (!hlist_empty(&t->buckets[idx]))
+			ip_vs_conn_move_tail(nt, &t->buckets[idx]);
+		ct_write_unlock_bh(idx);
+		cond_resched();
+	}
+
+	rcu_assign_pointer(ipvs->conn_tab, nt);
+
+	/* Wait for lookups and inserts that may still use the old table */
+	synchronize_rcu();
+	kvfree(t);
+out:
+	mutex_unlock(&ip_vs_conn_tab_mutex);
+}
+
+/* Current size of the connection table, reported to user space */
+unsigned int ip_vs_conn_tab_size(struct netns_ipvs *ipvs)
+{
+	unsigned int size;
+
+	rcu_read_lock();
+	size = rcu_dereference(ipvs->conn_tab)->size;
+	rcu_read_unlock();
+
+	return size;
+}
+
 static void ip_vs_conn_rcu_free(struct rcu_head *head)
 {
 	struct ip_vs_conn *cp = container_of(head, struct ip_vs_conn,
@@ -857,6 +1043,8 @@ static void ip_vs_conn_expire(unsigned long data)
 			ip_vs_conn_rcu_free(&cp->rcu_head);
 		else
 			call_rcu(&cp->rcu_head, ip_vs_conn_rcu_free);
+		/* before the count drops: the flush waits for it to reach 0 */
+		ip_vs_conn_tab_check(ipvs);
 		atomic_dec(&ipvs->conn_count);
 		return;
 	}
@@ -990,7 +1178,8 @@ ip_vs_conn_new(const struct ip_vs_conn_param *p, int dest_af,
 		cp->flags |= IP_VS_CONN_F_NFCT;
 
 	/* Hash it in the ip_vs_conn_tab finally */
-	ip_vs_conn_hash(cp);
+	if (ip_vs_conn_hash(cp))
+		ip_vs_conn_tab_check(ipvs);
 
 	return cp;
 }
@@ -999,28 +1188,43 @@ ip_vs_conn_new(const struct ip_vs_conn_param *p, int dest_af,
  *	/proc/net/ip_vs_conn entries
  */
 #ifdef CONFIG_PROC_FS
+/* The walk holds ip_vs_conn_tab_mutex, so there is no resize under it */
 struct ip_vs_iter_state {
 	struct seq_net_private	p;
-	struct hlist_head	*l;
+	struct ip_vs_conn_tab	*t;
+	unsigned int		idx;
 };
 
-static void *ip_vs_conn_array(struct seq_file *seq, loff_t pos)
+/* First entry at or after bucket iter->idx */
+static struct ip_vs_conn *ip_vs_conn_array_next(struct ip_vs_iter_state *iter)
 {
-	int idx;
 	struct ip_vs_conn *cp;
+
+	for (; iter->idx < iter->t->size; iter->idx++) {
+		hlist_for_each_entry_rcu(cp, &iter->t->buckets[iter->idx],
+					 c_list)
+			return cp;
+		cond_resched_rcu();
+	}
+
+	return NULL;
+}
+
+static void *ip_vs_conn_array(struct seq_file *seq, loff_t pos)
+{
 	struct ip_vs_iter_state *iter = seq->private;
+	struct ip_vs_conn *cp;
 
-	for (idx = 0; idx < ip_vs_conn_tab_size; idx++) {
-		hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[idx], c_list) {
+	for (cp = ip_vs_conn_array_next(iter); cp;
+	     cp = ip_vs_conn_array_next(iter)) {
+		hlist_for_each_entry_from_rcu(cp, c_list) {
 			/* __ip_vs_conn_get() is not needed by
 			 * ip_vs_conn_seq_show and ip_vs_conn_sync_seq_show
 			 */
-			if (pos-- == 0) {
-				iter->l = &ip_vs_conn_tab[idx];
+			if (pos-- == 0)
 				return cp;
-			}
 		}
-		cond_resched_rcu();
+		iter->idx++;
 	}
 
 	return NULL;
@@ -1031,8 +1235,10 @@ static void *ip_vs_conn_seq_start(struct seq_file *seq, loff_t *pos)
 {
 	struct ip_vs_iter_state *iter = seq->private;
 
-	iter->l = NULL;
+	mutex_lock(&ip_vs_conn_tab_mutex);
 	rcu_read_lock();
+	iter->t = rcu_dereference(net_ipvs(seq_file_net(seq))->conn_tab);
+	iter->idx = 0;
 	return *pos ? ip_vs_conn_array(seq, *pos - 1) :SEQ_START_TOKEN;
 }
 
@@ -1041,8 +1247,6 @@ static void *ip_vs_conn_seq_next(struct seq_file *seq, void *v, loff_t *pos)
 	struct ip_vs_conn *cp = v;
 	struct ip_vs_iter_state *iter = seq->private;
 	struct hlist_node *e;
-	struct hlist_head *l = iter->l;
-	int idx;
 
 	++*pos;
 	if (v == SEQ_START_TOKEN)
@@ -1053,22 +1257,15 @@ static void *ip_vs_conn_seq_next(struct seq_file *seq, void *v, loff_t *pos)
 	if (e)
 		return hlist_entry(e, struct ip_vs_conn, c_list);
 
-	idx = l - ip_vs_conn_tab;
-	while (++idx < ip_vs_conn_tab_size) {
-		hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[idx], c_list) {
-			iter->l = &ip_vs_conn_tab[idx];
-			return cp;
-		}
-		cond_resched_rcu();
-	}
-	iter->l = NULL;
-	return NULL;
+	iter->idx++;
+	return ip_vs_conn_array_next(iter);
 }
 
 static void ip_vs_conn_seq_stop(struct seq_file *seq, void *v)
 	__releases(RCU)
 {
 	rcu_read_unlock();
+	mutex_unlock(&ip_vs_conn_tab_mutex);
 }
 
 static int ip_vs_conn_seq_show(struct seq_file *seq, void *v)
@@ -1277,17 +1474,18 @@ void ip_vs_random_dropentry(struct netns_ipvs *ipvs)
 {
 	int idx;
 	struct ip_vs_conn *cp, *cp_c;
+	struct ip_vs_conn_tab *t;
 
+	mutex_lock(&ip_vs_conn_tab_mutex);
 	rcu_read_lock();
+	t = rcu_dereference(ipvs->conn_tab);
 	/*
 	 * Randomly scan 1/32 of the whole table every second
 	 */
-	for (idx = 0; idx < (ip_vs_conn_tab_size>>5); idx++) {
-		unsigned int hash = prandom_u32() & ip_vs_conn_tab_mask;
+	for (idx = 0; idx < (t->size >> 5); idx++) {
+		unsigned int hash = prandom_u32() & t->mask;
 
-		hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[hash], c_list) {
-			if (cp->ipvs != ipvs)
-				continue;
+		hlist_for_each_entry_rcu(cp, &t->buckets[hash], c_list) {
 			if (cp->flags & IP_VS_CONN_F_TEMPLATE) {
 				if (atomic_read(&cp->n_control) ||
 				    !ip_vs_conn_ops_mode(cp))
@@ -1341,6 +1539,7 @@ void ip_vs_random_dropentry(struct netns_ipvs *ipvs)
 		cond_resched_rcu();
 	}
 	rcu_read_unlock();
+	mutex_unlock(&ip_vs_conn_tab_mutex);
 }
 
 
@@ -1351,14 +1550,15 @@ static void ip_vs_conn_flush(struct netns_ipvs *ipvs)
 {
 	int idx;
 	struct ip_vs_conn *cp, *cp_c;
+	struct ip_vs_conn_tab *t;
 
 flush_again:
+	mutex_lock(&ip_vs_conn_tab_mutex);
 	rcu_read_lock();
-	for (idx = 0; idx < ip_vs_conn_tab_size; idx++) {
+	t = rcu_dereference(ipvs->conn_tab);
+	for (idx = 0; idx < t->size; idx++) {
 
-		hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[idx], c_list) {
-			if (cp->ipvs != ipvs)
-				continue;
+		hlist_for_each_entry_rcu(cp, &t->buckets[idx], c_list) {
 			IP_VS_DBG(4, "del connection\n");
 			ip_vs_conn_expire_now(cp);
 			cp_c = cp->control;
@@ -1372,6 +1572,7 @@ static void ip_vs_conn_flush(struct netns_ipvs *ipvs)
 		cond_resched_rcu();
 	}
 	rcu_read_unlock();
+	mutex_unlock(&ip_vs_conn_tab_mutex);
 
 	/* the counter may be not NULL, because maybe some conn entries
 	   are run by slow timer handler or unhashed but still referred */
@@ -1385,6 +1586,14 @@ static void ip_vs_conn_flush(struct netns_ipvs *ipvs)
  */
 int __net_init ip_vs_conn_net_init(struct netns_ipvs *ipvs)
 {
+	struct ip_vs_conn_tab *t;
+
+	t = ip_vs_conn_tab_alloc(1U << ip_vs_conn_tab_bits);
+	if (!t)
+		return -ENOMEM;
+	RCU_INIT_POINTER(ipvs->conn_tab, t);
+	INIT_WORK(&ipvs->conn_resize_work, ip_vs_conn_resize_work);
+
 	atomic_set(&ipvs->conn_count, 0);
 
 	proc_create("ip_vs_conn", 0, ipvs->net->proc_net, &ip_vs_conn_fops);
@@ -1399,42 +1608,37 @@ void __net_exit ip_vs_conn_net_cleanup(struct netns_ipvs *ipvs)
 	ip_vs_conn_flush(ipvs);
 	remove_proc_entry("ip_vs_conn", ipvs->net->proc_net);
 	remove_proc_entry("ip_vs_conn_sync", ipvs->net->proc_net);
+	/* no one can queue a resize once the table is empty */
+	cancel_work_sync(&ipvs->conn_resize_work);
+	kvfree(rcu_dereference_protected(ipvs->conn_tab, 1));
 }
 
 int __init ip_vs_conn_init(void)
 {
 	int idx;
 
-	/* Compute size and mask */
-	ip_vs_conn_tab_size = 1 << ip_vs_conn_tab_bits;
-	ip_vs_conn_tab_mask = ip_vs_conn_tab_size - 1;
-
-	/*
-	 * Allocate the connection hash table and initialize its list heads
-	 */
-	ip_vs_conn_tab = vmalloc(ip_vs_conn_tab_size * sizeof(*ip_vs_conn_tab));
-	if (!ip_vs_conn_tab)
-		return -ENOMEM;
+	ip_vs_conn_tab_bits = clamp(ip_vs_conn_tab_bits,
+				    IP_VS_CONN_TAB_MIN_BITS,
+				    IP_VS_CONN_TAB_MAX_BITS);
+	ip_vs_conn_tab_max_bits = clamp(ip_vs_conn_tab_max_bits,
+					ip_vs_conn_tab_bits,
+					IP_VS_CONN_TAB_MAX_BITS);
 
 	/* Allocate ip_vs_conn slab cache */
 	ip_vs_conn_cachep = kmem_cache_create("ip_vs_conn",
 					      sizeof(struct ip_vs_conn), 0,
 					      SLAB_HWCACHE_ALIGN, NULL);
-	if (!ip_vs_conn_cachep) {
-		vfree(ip_vs_conn_tab);
+	if (!ip_vs_conn_cachep)
 		return -ENOMEM;
-	}
 
 	pr_info("Connection hash table configured "
-		"(size=%d, memory=%ldKbytes)\n",
-		ip_vs_conn_tab_size,
-		(long)(ip_vs_conn_tab_size*sizeof(struct list_head))/1024);
+		"(initial size=%d, max size=%d, memory=%ldKbytes)\n",
+		1 << ip_vs_conn_tab_bits, 1 << ip_vs_conn_tab_max_bits,
+		(long)((1 << ip_vs_conn_tab_bits) *
+		       sizeof(struct hlist_head)) / 1024);
 	IP_VS_DBG(0, "Each connection entry needs %zd bytes at least\n",
 		  sizeof(struct ip_vs_conn));
 
-	for (idx = 0; idx < ip_vs_conn_tab_size; idx++)
-		INIT_HLIST_HEAD(&ip_vs_conn_tab[idx]);
-
 	for (idx = 0; idx < CT_LOCKARRAY_SIZE; idx++)  {
 		spin_lock_init(&__ip_vs_conntbl_lock_array[idx].l);
 	}
@@ -1451,5 +1655,4 @@ void ip_vs_conn_cleanup(void)
 	rcu_barrier();
 	/* Release the empty cache */
 	kmem_cache_destroy(ip_vs_conn_cachep);
-	vfree(ip_vs_conn_tab);
 }
@@ -34,6 +34,7 @@
 #include <linux/socket.h>
 #include <linux/mm.h>
 #include <linux/nsproxy.h>
+#include <linux/log2.h>
 #include <linux/rculist_nulls.h>
 
 #include <net/netfilter/nf_conntrack.h>
@@ -71,21 +72,7 @@ EXPORT_SYMBOL_GPL(nf_conntrack_locks);
 __cacheline_aligned_in_smp DEFINE_SPINLOCK(nf_conntrack_expect_lock);
 EXPORT_SYMBOL_GPL(nf_conntrack_expect_lock);
 
-struct hlist_nulls_head *nf_conntrack_hash __read_mostly;
-EXPORT_SYMBOL_GPL(nf_conntrack_hash);
-
-struct conntrack_gc_work {
-	struct delayed_work	dwork;
-	u32			last_bucket;
-	bool			exiting;
-	bool			early_drop;
-	long			next_gc_run;
-};
-
 static __read_mostly struct kmem_cache *nf_conntrack_cachep;
-static __read_mostly spinlock_t nf_conntrack_locks_all_lock;
-static __read_mostly DEFINE_SPINLOCK(nf_conntrack_locks_all_lock);
-static __read_mostly bool nf_conntrack_locks_all;
 
 /* every gc cycle scans at most 1/GC_MAX_BUCKETS_DIV part of table */
 #define GC_MAX_BUCKETS_DIV	128u
@@ -94,48 +81,35 @@ static __read_mostly bool nf_conntrack_locks_all;
 /* desired ratio of entries found to be expired */
 #define GC_EVICT_RATIO	50u
 
-static struct conntrack_gc_work conntrack_gc_work;
+/* bounds of the per-netns table size, see nf_conntrack_bucket_lock() */
+#define NF_CT_HTABLE_MIN	CONNTRACK_LOCKS
+#define NF_CT_HTABLE_MAX	(1U << 28)
 
 void nf_conntrack_lock(spinlock_t *lock) __acquires(lock)
 {
-	/* 1) Acquire the lock */
-	spin_lock(lock);
-
-	/* 2) read nf_conntrack_locks_all, with ACQUIRE semantics
-	 * It pairs with the smp_store_release() in nf_conntrack_all_unlock()
-	 */
-	if (likely(smp_load_acquire(&nf_conntrack_locks_all) == false))
-		return;
-
-	/* fast path failed, unlock */
-	spin_unlock(lock);
-
-	/* Slow path 1) get global lock */
-	spin_lock(&nf_conntrack_locks_all_lock);
-
-	/* Slow path 2) get the lock we want */
 	spin_lock(lock);
-
-	/* Slow path 3) release the global lock */
-	spin_unlock(&nf_conntrack_locks_all_lock);
 }
 EXPORT_SYMBOL_GPL(nf_conntrack_lock);
 
+static unsigned int nf_conntrack_lock_index(u32 hash)
+{
+	return reciprocal_scale(hash, CONNTRACK_LOCKS);
+}
+
+/* h1 and h2 are raw hashes, the locks do not depend on the table size */
 static void nf_conntrack_double_unlock(unsigned int h1, unsigned int h2)
 {
-	h1 %= CONNTRACK_LOCKS;
-	h2 %= CONNTRACK_LOCKS;
+	h1 = nf_conntrack_lock_index(h1);
+	h2 = nf_conntrack_lock_index(h2);
 	spin_unlock(&nf_conntrack_locks[h1]);
 	if (h1 != h2)
 		spin_unlock(&nf_conntrack_locks[h2]);
 }
 
-/* return true if we need to recompute hashes (in case hash table was resized) */
-static bool nf_conntrack_double_lock(struct net *net, unsigned int h1,
-				     unsigned int h2, unsigned int sequence)
+static void nf_conntrack_double_lock(unsigned int h1, unsigned int h2)
 {
-	h1 %= CONNTRACK_LOCKS;
-	h2 %= CONNTRACK_LOCKS;
+	h1 = nf_conntrack_lock_index(h1);
+	h2 = nf_conntrack_lock_index(h2);
 	if (h1 <= h2) {
 		nf_conntrack_lock(&nf_conntrack_locks[h1]);
 		if (h1 != h2)
@@ -146,49 +120,12 @@ static bool nf_conntrack_double_lock(struct net *net, unsigned int h1,
 		spin_lock_nested(&nf_conntrack_locks[h1],
 				 SINGLE_DEPTH_NESTING);
 	}
-	if (read_seqcount_retry(&nf_conntrack_generation, sequence)) {
-		nf_conntrack_double_unlock(h1, h2);
-		return true;
-	}
-	return false;
-}
-
-static void nf_conntrack_all_lock(void)
-{
-	int i;
-
-	spin_lock(&nf_conntrack_locks_all_lock);
-
-	nf_conntrack_locks_all = true;
-
-	for (i = 0; i < CONNTRACK_LOCKS; i++) {
-		spin_lock(&nf_conntrack_locks[i]);
-
-		/* This spin_unlock provides the "release" to ensure that
-		 * nf_conntrack_locks_all==true is visible to everyone that
-		 * acquired spin_lock(&nf_conntrack_locks[]).
-		 */
-		spin_unlock(&nf_conntrack_locks[i]);
-	}
-}
-
-static void nf_conntrack_all_unlock(void)
-{
-	/* All prior stores must be complete before we clear
-	 * 'nf_conntrack_locks_all'. Otherwise nf_conntrack_lock()
-	 * might observe the false value but not the entire
-	 * critical section.
-	 * It pairs with the smp_load_acquire() in nf_conntrack_lock()
-	 */
-	smp_store_release(&nf_conntrack_locks_all, false);
-	spin_unlock(&nf_conntrack_locks_all_lock);
 }
 
 unsigned int nf_conntrack_htable_size __read_mostly;
 EXPORT_SYMBOL_GPL(nf_conntrack_htable_size);
 
 unsigned int nf_conntrack_max __read_mostly;
-seqcount_t nf_conntrack_generation __read_mostly;
 static unsigned int nf_conntrack_hash_rnd __read_mostly;
 
 static u32 hash_conntrack_raw(const struct nf_conntrack_tuple *tuple,
@@ -210,22 +147,26 @@ static u32 hash_conntrack_raw(const struct nf_conntrack_tuple *tuple,
 		      tuple->dst.protonum));
 }
 
-static u32 scale_hash(u32 hash)
-{
-	return reciprocal_scale(hash, nf_conntrack_htable_size);
-}
-
-static u32 __hash_conntrack(const struct net *net,
-			    const struct nf_conntrack_tuple *tuple,
-			    unsigned int size)
+/* Return the chain a new entry with raw hash @hash goes to.  Buckets of
+ * a table being resized that were already moved are looked up in the
+ * future table instead.
+ *
+ * Must be called with rcu read lock and the lock of @hash held; the
+ * resize moves a bucket under the same lock.
+ */
+static struct hlist_nulls_head *nf_ct_locked_head(struct net *net, u32 hash)
 {
-	return reciprocal_scale(hash_conntrack_raw(tuple, net), size);
-}
+	struct nf_conntrack_htable *tbl = rcu_dereference(net->ct.htable);
+	struct nf_conntrack_htable *future;
+	unsigned int bucket;
 
-static u32 hash_conntrack(const struct net *net,
-			  const struct nf_conntrack_tuple *tuple)
-{
-	return scale_hash(hash_conntrack_raw(tuple, net));
+	for (;;) {
+		bucket = reciprocal_scale(hash, tbl->size);
+		future = rcu_dereference(tbl->future);
+		if (!future || bucket >= READ_ONCE(tbl->rehashed))
+			return &tbl->hash[bucket];
+		tbl = future;
+	}
 }
 
 bool
@@ -442,18 +383,16 @@ static void nf_ct_delete_from_lists(struct nf_conn *ct)
 {
 	struct net *net = nf_ct_net(ct);
 	unsigned int hash, reply_hash;
-	unsigned int sequence;
 
 	nf_ct_helper_destroy(ct);
 
+	hash = hash_conntrack_raw(&ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple,
+				  net);
+	reply_hash = hash_conntrack_raw(&ct->tuplehash[IP_CT_DIR_REPLY].tuple,
+					net);
+
 	local_bh_disable();
-	do {
-		sequence = read_seqcount_begin(&nf_conntrack_generation);
-		hash = hash_conntrack(net,
-				      &ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple);
-		reply_hash = hash_conntrack(net,
-					   &ct->tuplehash[IP_CT_DIR_REPLY].tuple);
-	} while (nf_conntrack_double_lock(net, hash, reply_hash, sequence));
+	nf_conntrack_double_lock(hash, reply_hash);
 
 	clean_from_lists(ct);
 	nf_conntrack_double_unlock(hash, reply_hash);
@@ -530,38 +469,48 @@ ____nf_conntrack_find(struct net *net, const struct nf_conntrack_zone *zone,
 		      const struct nf_conntrack_tuple *tuple, u32 hash)
 {
 	struct nf_conntrack_tuple_hash *h;
-	struct hlist_nulls_head *ct_hash;
+	struct nf_conntrack_htable *tbl;
 	struct hlist_nulls_node *n;
-	unsigned int bucket, hsize;
+	unsigned int bucket;
 
 begin:
-	nf_conntrack_get_ht(&ct_hash, &hsize);
-	bucket = reciprocal_scale(hash, hsize);
+	tbl = rcu_dereference(net->ct.htable);
+	do {
+		bucket = reciprocal_scale(hash, tbl->size);
 
-	hlist_nulls_for_each_entry_rcu(h, n, &ct_hash[bucket], hnnode) {
-		struct nf_conn *ct;
+		hlist_nulls_for_each_entry_rcu(h, n, &tbl->hash[bucket],
+					       hnnode) {
+			struct nf_conn *ct;
 
-		ct = nf_ct_tuplehash_to_ctrack(h);
-		if (nf_ct_is_expired(ct)) {
-			nf_ct_gc_expired(ct);
-			continue;
-		}
+			ct = nf_ct_tuplehash_to_ctrack(h);
+			if (nf_ct_is_expired(ct)) {
+				nf_ct_gc_expired(ct);
+				continue;
+			}
 
-		if (nf_ct_is_dying(ct))
-			continue;
+			if (nf_ct_is_dying(ct))
+				continue;
 
-		if (nf_ct_key_equal(h, tuple, zone, net))
-			return h;
-	}
-	/*
-	 * if the nulls value we got at the end of this lookup is
-	 * not the expected one, we must restart lookup.
-	 * We probably met an item that was moved to another chain.
-	 */
-	if (get_nulls_value(n) != bucket) {
-		NF_CT_STAT_INC_ATOMIC(net, search_restart);
-		goto begin;
-	}
+			if (nf_ct_key_equal(h, tuple, zone, net))
+				return h;
+		}
+		/*
+		 * if the nulls value we got at the end of this lookup is
+		 * not the expected one, we must restart lookup.
+		 * We probably met an item that was moved to another chain.
+		 */
+		if (get_nulls_value(n) != tbl->nulls_base + bucket) {
+			NF_CT_STAT_INC_ATOMIC(net, search_restart);
+			goto begin;
+		}
+
+		/* A resize in progress may have moved the entry to the future
+		 * table.  It is published there before it is unlinked here,
+		 * pairs with the smp_wmb() in nf_ct_move_tail().
+		 */
+		smp_rmb();
+		tbl = rcu_dereference(tbl->future);
+	} while (tbl);
 
 	return NULL;
 }
@@ -604,43 +553,46 @@ nf_conntrack_find_get(struct net *net, const struct nf_conntrack_zone *zone,
 EXPORT_SYMBOL_GPL(nf_conntrack_find_get);
 
 static void __nf_conntrack_hash_insert(struct nf_conn *ct,
-				       unsigned int hash,
-				       unsigned int reply_hash)
+				       struct hlist_nulls_head *head,
+				       struct hlist_nulls_head *reply_head)
 {
 	hlist_nulls_add_head_rcu(&ct->tuplehash[IP_CT_DIR_ORIGINAL].hnnode,
-			   &nf_conntrack_hash[hash]);
+				 head);
 	hlist_nulls_add_head_rcu(&ct->tuplehash[IP_CT_DIR_REPLY].hnnode,
-			   &nf_conntrack_hash[reply_hash]);
+				 reply_head);
 }
 
 int
 nf_conntrack_hash_check_insert(struct nf_conn *ct)
 {
+	struct hlist_nulls_head *head, *reply_head;
 	const struct nf_conntrack_zone *zone;
 	struct net *net = nf_ct_net(ct);
 	unsigned int hash, reply_hash;
 	struct nf_conntrack_tuple_hash *h;
 	struct hlist_nulls_node *n;
-	unsigned int sequence;
 
 	zone = nf_ct_zone(ct);
 
+	hash = hash_conntrack_raw(&ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple,
+				  net);
+	reply_hash = hash_conntrack_raw(&ct->tuplehash[IP_CT_DIR_REPLY].tuple,
+					net);
+
+	rcu_read_lock();
 	local_bh_disable();
-	do {
-		sequence = read_seqcount_begin(&nf_conntrack_generation);
-		hash = hash_conntrack(net,
-				      &ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple);
-		reply_hash = hash_conntrack(net,
-					   &ct->tuplehash[IP_CT_DIR_REPLY].tuple);
-	} while (nf_conntrack_double_lock(net, hash, reply_hash, sequence));
+	nf_conntrack_double_lock(hash, reply_hash);
+
+	head = nf_ct_locked_head(net, hash);
+	reply_head = nf_ct_locked_head(net, reply_hash);
 
 	/* See if there's one in the list already, including reverse */
-	hlist_nulls_for_each_entry(h, n, &nf_conntrack_hash[hash], hnnode)
+	hlist_nulls_for_each_entry(h, n, head, hnnode)
 		if (nf_ct_key_equal(h, &ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple,
 				    zone, net))
 			goto out;
 
-	hlist_nulls_for_each_entry(h, n, &nf_conntrack_hash[reply_hash], hnnode)
+	hlist_nulls_for_each_entry(h, n, reply_head, hnnode)
 		if (nf_ct_key_equal(h, &ct->tuplehash[IP_CT_DIR_REPLY].tuple,
 				    zone, net))
 			goto out;
@@ -648,16 +600,18 @@ nf_conntrack_hash_check_insert(struct nf_conn *ct)
 	smp_wmb();
 	/* The caller holds a reference to this object */
 	atomic_set(&ct->ct_general.use, 2);
-	__nf_conntrack_hash_insert(ct, hash, reply_hash);
+	__nf_conntrack_hash_insert(ct, head, reply_head);
 	nf_conntrack_double_unlock(hash, reply_hash);
 	NF_CT_STAT_INC(net, insert);
 	local_bh_enable();
+	rcu_read_unlock();
 	return 0;
 
 out:
 	nf_conntrack_double_unlock(hash, reply_hash);
 	NF_CT_STAT_INC(net, insert_failed);
 	local_bh_enable();
+	rcu_read_unlock();
 	return -EEXIST;
 }
 EXPORT_SYMBOL_GPL(nf_conntrack_hash_check_insert);
@@ -723,6 +677,7 @@ static int nf_ct_resolve_clash(struct net *net, struct sk_buff *skb,
 int
 __nf_conntrack_confirm(struct sk_buff *skb)
 {
+	struct hlist_nulls_head *head, *reply_head;
 	const struct nf_conntrack_zone *zone;
 	unsigned int hash, reply_hash;
 	struct nf_conntrack_tuple_hash *h;
@@ -732,7 +687,6 @@ __nf_conntrack_confirm(struct sk_buff *skb)
 	struct hlist_nulls_node *n;
 	enum ip_conntrack_info ctinfo;
 	struct net *net;
-	unsigned int sequence;
 	int ret = NF_DROP;
 
 	ct = nf_ct_get(skb, &ctinfo);
@@ -746,17 +700,17 @@ __nf_conntrack_confirm(struct sk_buff *skb)
 		return NF_ACCEPT;
 
 	zone = nf_ct_zone(ct);
-	local_bh_disable();
 
-	do {
-		sequence = read_seqcount_begin(&nf_conntrack_generation);
-		/* reuse the hash saved before */
-		hash = *(unsigned long *)&ct->tuplehash[IP_CT_DIR_REPLY].hnnode.pprev;
-		hash = scale_hash(hash);
-		reply_hash = hash_conntrack(net,
-					   &ct->tuplehash[IP_CT_DIR_REPLY].tuple);
+	/* reuse the hash saved before */
+	hash = *(unsigned long *)&ct->tuplehash[IP_CT_DIR_REPLY].hnnode.pprev;
+	reply_hash = hash_conntrack_raw(&ct->tuplehash[IP_CT_DIR_REPLY].tuple,
+					net);
 
-	} while (nf_conntrack_double_lock(net, hash, reply_hash, sequence));
+	local_bh_disable();
+	nf_conntrack_double_lock(hash, reply_hash);
+
+	head = nf_ct_locked_head(net, hash);
+	reply_head = nf_ct_locked_head(net, reply_hash);
 
 	/* We're not in hash table, and we refuse to set up related
 	 * connections for unconfirmed conns.  But packet copies and
@@ -783,12 +737,12 @@ __nf_conntrack_confirm(struct sk_buff *skb)
 	/* See if there's one in the list already, including reverse:
 	   NAT could have grabbed it without realizing, since we're
 	   not in the hash.  If there is, we lost race. */
-	hlist_nulls_for_each_entry(h, n, &nf_conntrack_hash[hash], hnnode)
+	hlist_nulls_for_each_entry(h, n, head, hnnode)
 		if (nf_ct_key_equal(h, &ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple,
 				    zone, net))
 			goto out;
 
-	hlist_nulls_for_each_entry(h, n, &nf_conntrack_hash[reply_hash], hnnode)
+	hlist_nulls_for_each_entry(h, n, reply_head, hnnode)
 		if (nf_ct_key_equal(h, &ct->tuplehash[IP_CT_DIR_REPLY].tuple,
 				    zone, net))
 			goto out;
@@ -813,7 +767,7 @@ __nf_conntrack_confirm(struct sk_buff *skb)
 	 * guarantee that no other CPU can find the conntrack before the above
 	 * stores are visible.
 	 */
-	__nf_conntrack_hash_insert(ct, hash, reply_hash);
+	__nf_conntrack_hash_insert(ct, head, reply_head);
 	nf_conntrack_double_unlock(hash, reply_hash);
 	local_bh_enable();
 
@@ -845,40 +799,48 @@ nf_conntrack_tuple_taken(const struct nf_conntrack_tuple *tuple,
 	struct net *net = nf_ct_net(ignored_conntrack);
 	const struct nf_conntrack_zone *zone;
 	struct nf_conntrack_tuple_hash *h;
-	struct hlist_nulls_head *ct_hash;
-	unsigned int hash, hsize;
+	struct nf_conntrack_htable *tbl;
+	unsigned int hash, bucket;
 	struct hlist_nulls_node *n;
 	struct nf_conn *ct;
 
 	zone = nf_ct_zone(ignored_conntrack);
+	hash = hash_conntrack_raw(tuple, net);
 
 	rcu_read_lock();
  begin:
-	nf_conntrack_get_ht(&ct_hash, &hsize);
-	hash = __hash_conntrack(net, tuple, hsize);
+	tbl = rcu_dereference(net->ct.htable);
+	do {
+		bucket = reciprocal_scale(hash, tbl->size);
 
-	hlist_nulls_for_each_entry_rcu(h, n, &ct_hash[hash], hnnode) {
-		ct = nf_ct_tuplehash_to_ctrack(h);
+		hlist_nulls_for_each_entry_rcu(h, n, &tbl->hash[bucket],
+					       hnnode) {
+			ct = nf_ct_tuplehash_to_ctrack(h);
 
-		if (ct == ignored_conntrack)
-			continue;
+			if (ct == ignored_conntrack)
+				continue;
 
-		if (nf_ct_is_expired(ct)) {
-			nf_ct_gc_expired(ct);
-			continue;
+			if (nf_ct_is_expired(ct)) {
+				nf_ct_gc_expired(ct);
+				continue;
+			}
+
+			if (nf_ct_key_equal(h, tuple, zone, net)) {
+				NF_CT_STAT_INC_ATOMIC(net, found);
+				rcu_read_unlock();
+				return 1;
+			}
 		}
 
-		if (nf_ct_key_equal(h, tuple, zone, net)) {
-			NF_CT_STAT_INC_ATOMIC(net, found);
-			rcu_read_unlock();
-			return 1;
+		if (get_nulls_value(n) != tbl->nulls_base + bucket) {
+			NF_CT_STAT_INC_ATOMIC(net, search_restart);
+			goto begin;
 		}
-	}
 
-	if (get_nulls_value(n) != hash) {
-		NF_CT_STAT_INC_ATOMIC(net, search_restart);
-		goto begin;
-	}
+		/* see ____nf_conntrack_find() */
+		smp_rmb();
+		tbl = rcu_dereference(tbl->future);
+	} while (tbl);
 
 	rcu_read_unlock();
 
@@ -937,14 +899,14 @@ static noinline int early_drop(struct net *net, unsigned int _hash)
 	unsigned int i;
 
 	for (i = 0; i < NF_CT_EVICTION_RANGE; i++) {
-		struct hlist_nulls_head *ct_hash;
-		unsigned int hash, hsize, drops;
+		struct nf_conntrack_htable *tbl;
+		unsigned int hash, drops;
 
 		rcu_read_lock();
-		nf_conntrack_get_ht(&ct_hash, &hsize);
-		hash = reciprocal_scale(_hash++, hsize);
+		tbl = rcu_dereference(net->ct.htable);
+		hash = reciprocal_scale(_hash++, tbl->size);
 
-		drops = early_drop_list(net, &ct_hash[hash]);
+		drops = early_drop_list(net, &tbl->hash[hash]);
 		rcu_read_unlock();
 
 		if (drops) {
@@ -980,37 +942,41 @@ static void gc_worker(struct work_struct *work)
 	unsigned int min_interval = max(HZ / GC_MAX_BUCKETS_DIV, 1u);
 	unsigned int i, goal, buckets = 0, expired_count = 0;
 	unsigned int nf_conntrack_max95 = 0;
-	struct conntrack_gc_work *gc_work;
 	unsigned int ratio, scanned = 0;
+	unsigned int count, size;
 	unsigned long next_run;
+	struct net *net;
 
-	gc_work = container_of(work, struct conntrack_gc_work, dwork.work);
+	net = container_of(work, struct net, ct.gc_dwork.work);
 
-	goal = nf_conntrack_htable_size / GC_MAX_BUCKETS_DIV;
-	i = gc_work->last_bucket;
-	if (gc_work->early_drop)
+	size = nf_conntrack_hash_size(net);
+	goal = size / GC_MAX_BUCKETS_DIV;
+	i = net->ct.gc_last_bucket;
+	if (net->ct.gc_early_drop)
 		nf_conntrack_max95 = nf_conntrack_max / 100u * 95u;
 
 	do {
 		struct nf_conntrack_tuple_hash *h;
-		struct hlist_nulls_head *ct_hash;
+		struct nf_conntrack_htable *tbl;
 		struct hlist_nulls_node *n;
-		unsigned int hashsz;
 		struct nf_conn *tmp;
 
 		i++;
 		rcu_read_lock();
 
-		nf_conntrack_get_ht(&ct_hash, &hashsz);
-		if (i >= hashsz)
+		tbl = rcu_dereference(net->ct.htable);
+		if (i >= tbl->size)
 			i = 0;
 
-		hlist_nulls_for_each_entry_rcu(h, n, &ct_hash[i], hnnode) {
-			struct net *net;
-
+		hlist_nulls_for_each_entry_rcu(h, n, &tbl->hash[i], hnnode) {
 			tmp = nf_ct_tuplehash_to_ctrack(h);
 
 			scanned++;
+			if (test_bit(IPS_OFFLOAD_BIT, &tmp->status)) {
+				nf_ct_offload_timeout(tmp);
+				continue;
+			}
+
 			if (nf_ct_is_expired(tmp)) {
 				nf_ct_gc_expired(tmp);
 				expired_count++;
@@ -1020,8 +986,8 @@ static void gc_worker(struct work_struct *work)
 			if (nf_conntrack_max95 == 0 || gc_worker_skip_ct(tmp))
 				continue;
 
-			net = nf_ct_net(tmp);
-			if (atomic_read(&net->ct.count) < nf_conntrack_max95)
+			if (percpu_counter_read_positive(&net->ct.count) <
+			    nf_conntrack_max95)
 				continue;
 
 			/* need to take reference to avoid possible races */
@@ -1047,9 +1013,6 @@ static void gc_worker(struct work_struct *work)
 		cond_resched_rcu_qs();
 	} while (++buckets < goal);
 
-	if (gc_work->exiting)
-		return;
-
 	/*
 	 * Eviction will normally happen from the packet path, and not
 	 * from this gc worker.
@@ -1069,28 +1032,36 @@ static void gc_worker(struct work_struct *work)
 	 */
 	ratio = scanned ? expired_count * 100 / scanned : 0;
 	if (ratio > GC_EVICT_RATIO) {
-		gc_work->next_gc_run = min_interval;
+		net->ct.gc_next_run = min_interval;
 	} else {
 		unsigned int max = GC_MAX_SCAN_JIFFIES / GC_MAX_BUCKETS_DIV;
 
 		BUILD_BUG_ON((GC_MAX_SCAN_JIFFIES / GC_MAX_BUCKETS_DIV) == 0);
 
-		gc_work->next_gc_run += min_interval;
-		if (gc_work->next_gc_run > max)
-			gc_work->next_gc_run = max;
+		net->ct.gc_next_run += min_interval;
+		if (net->ct.gc_next_run > max)
+			net->ct.gc_next_run = max;
 	}
 
-	next_run = gc_work->next_gc_run;
-	gc_work->last_bucket = i;
-	gc_work->early_drop = false;
-	queue_delayed_work(system_long_wq, &gc_work->dwork, next_run);
-}
+	next_run = net->ct.gc_next_run;
 
-static void conntrack_gc_work_init(struct conntrack_gc_work *gc_work)
-{
-	INIT_DEFERRABLE_WORK(&gc_work->dwork, gc_worker);
-	gc_work->next_gc_run = HZ;
-	gc_work->exiting = false;
+	/* There is one worker per namespace, don't wake up idle ones at the
+	 * rate of a busy table.
+	 */
+	count = percpu_counter_read_positive(&net->ct.count);
+	if (count == 0)
+		next_run = GC_MAX_SCAN_JIFFIES;
+
+	/* Grow the tables of namespaces that were not sized by the user
+	 * once they hold more entries than buckets.
+	 */
+	if (count > size && size < nf_conntrack_htable_size &&
+	    !READ_ONCE(net->ct.htable_user))
+		queue_work(system_long_wq, &net->ct.htable_work);
+
+	net->ct.gc_last_bucket = i;
+	net->ct.gc_early_drop = false;
+	queue_delayed_work(system_long_wq, &net->ct.gc_dwork, next_run);
 }
 
 static struct nf_conn *
@@ -1102,15 +1073,18 @@ __nf_conntrack_alloc(struct net *net,
 {
 	struct nf_conn *ct;
 
-	/* We don't want any race condition at early drop stage */
-	atomic_inc(&net->ct.count);
+	/* We don't want any race condition at early drop stage. The per-CPU
+	 * counter only gets summed up when close to the limit.
+	 */
+	percpu_counter_inc(&net->ct.count);
 
 	if (nf_conntrack_max &&
-	    unlikely(atomic_read(&net->ct.count) > nf_conntrack_max)) {
+	    unlikely(percpu_counter_compare(&net->ct.count,
+					    nf_conntrack_max) > 0)) {
 		if (!early_drop(net, hash)) {
-			if (!conntrack_gc_work.early_drop)
-				conntrack_gc_work.early_drop = true;
-			atomic_dec(&net->ct.count);
+			if (!net->ct.gc_early_drop)
+				net->ct.gc_early_drop = true;
+			percpu_counter_dec(&net->ct.count);
 			net_warn_ratelimited("nf_conntrack: table full, dropping packet\n");
 			return ERR_PTR(-ENOMEM);
 		}
@@ -1144,7 +1118,7 @@ __nf_conntrack_alloc(struct net *net,
 	atomic_set(&ct->ct_general.use, 0);
 	return ct;
 out:
-	atomic_dec(&net->ct.count);
+	percpu_counter_dec(&net->ct.count);
 	return ERR_PTR(-ENOMEM);
 }
 
@@ -1170,8 +1144,7 @@ void nf_conntrack_free(struct nf_conn *ct)
 	nf_ct_ext_destroy(ct);
 	nf_ct_ext_free(ct);
 	kmem_cache_free(nf_conntrack_cachep, ct);
-	smp_mb__before_atomic();
-	atomic_dec(&net->ct.count);
+	percpu_counter_dec(&net->ct.count);
 }
 EXPORT_SYMBOL_GPL(nf_conntrack_free);
 
@@ -1590,26 +1563,29 @@ static void nf_conntrack_attach(struct sk_buff *nskb, const struct sk_buff *skb)
 
 /* Bring out ya dead! */
 static struct nf_conn *
-get_next_corpse(int (*iter)(struct nf_conn *i, void *data),
+get_next_corpse(struct net *net, int (*iter)(struct nf_conn *i, void *data),
 		void *data, unsigned int *bucket)
 {
 	struct nf_conntrack_tuple_hash *h;
+	struct nf_conntrack_htable *tbl;
 	struct nf_conn *ct;
 	struct hlist_nulls_node *n;
 	spinlock_t *lockp;
 
-	for (; *bucket < nf_conntrack_htable_size; (*bucket)++) {
-		lockp = &nf_conntrack_locks[*bucket % CONNTRACK_LOCKS];
+	/* no resize can run, see nf_ct_iterate_cleanup() */
+	tbl = rcu_dereference_protected(net->ct.htable,
+					lockdep_is_held(&net->ct.htable_mutex));
+
+	for (; *bucket < tbl->size; (*bucket)++) {
+		lockp = nf_conntrack_bucket_lock(tbl, *bucket);
 		local_bh_disable();
 		nf_conntrack_lock(lockp);
-		if (*bucket < nf_conntrack_htable_size) {
-			hlist_nulls_for_each_entry(h, n, &nf_conntrack_hash[*bucket], hnnode) {
-				if (NF_CT_DIRECTION(h) != IP_CT_DIR_ORIGINAL)
-					continue;
-				ct = nf_ct_tuplehash_to_ctrack(h);
-				if (iter(ct, data))
-					goto found;
-			}
+		hlist_nulls_for_each_entry(h, n, &tbl->hash[*bucket], hnnode) {
+			if (NF_CT_DIRECTION(h) != IP_CT_DIR_ORIGINAL)
+				continue;
+			ct = nf_ct_tuplehash_to_ctrack(h);
+			if (iter(ct, data))
+				goto found;
 		}
 		spin_unlock(lockp);
 		local_bh_enable();
@@ -1624,45 +1600,25 @@ get_next_corpse(int (*iter)(struct nf_conn *i, void *data),
 	return ct;
 }
 
-static void nf_ct_iterate_cleanup(int (*iter)(struct nf_conn *i, void *data),
+static void nf_ct_iterate_cleanup(struct net *net,
+				  int (*iter)(struct nf_conn *i, void *data),
 				  void *data, u32 portid, int report)
 {
-	unsigned int bucket = 0, sequence;
+	unsigned int bucket = 0;
 	struct nf_conn *ct;
 
 	might_sleep();
 
-	for (;;) {
-		sequence = read_seqcount_begin(&nf_conntrack_generation);
-
-		while ((ct = get_next_corpse(iter, data, &bucket)) != NULL) {
-			/* Time to push up daises... */
-
-			nf_ct_delete(ct, portid, report);
-			nf_ct_put(ct);
-			cond_resched();
-		}
+	/* keep the table from being resized under the walk */
+	mutex_lock(&net->ct.htable_mutex);
+	while ((ct = get_next_corpse(net, iter, data, &bucket)) != NULL) {
+		/* Time to push up daises... */
 
-		if (!read_seqcount_retry(&nf_conntrack_generation, sequence))
-			break;
-		bucket = 0;
+		nf_ct_delete(ct, portid, report);
+		nf_ct_put(ct);
+		cond_resched();
 	}
-}
-
-struct iter_data {
-	int (*iter)(struct nf_conn *i, void *data);
-	void *data;
-	struct net *net;
-};
-
-static int iter_net_only(struct nf_conn *i, void *data)
-{
-	struct iter_data *d = data;
-
-	if (!net_eq(d->net, nf_ct_net(i)))
-		return 0;
-
-	return d->iter(i, d->data);
+	mutex_unlock(&net->ct.htable_mutex);
 }
 
 static void
@@ -1697,7 +1653,7 @@ void nf_ct_unconfirmed_destroy(struct net *net)
 {
 	might_sleep();
 
-	if (atomic_read(&net->ct.count) > 0) {
+	if (nf_conntrack_count(net) > 0) {
 		__nf_ct_unconfirmed_destroy(net);
 		nf_queue_nf_hook_drop(net);
 		synchronize_net();
@@ -1709,18 +1665,12 @@ void nf_ct_iterate_cleanup_net(struct net *net,
 			       int (*iter)(struct nf_conn *i, void *data),
 			       void *data, u32 portid, int report)
 {
-	struct iter_data d;
-
 	might_sleep();
 
-	if (atomic_read(&net->ct.count) == 0)
+	if (nf_conntrack_count(net) == 0)
 		return;
 
-	d.iter = iter;
-	d.data = data;
-	d.net = net;
-
-	nf_ct_iterate_cleanup(iter_net_only, &d, portid, report);
+	nf_ct_iterate_cleanup(net, iter, data, portid, report);
 }
 EXPORT_SYMBOL_GPL(nf_ct_iterate_cleanup_net);
 
@@ -1742,7 +1692,7 @@ nf_ct_iterate_destroy(int (*iter)(struct nf_conn *i, void *data), void *data)
 
 	rtnl_lock();
 	for_each_net(net) {
-		if (atomic_read(&net->ct.count) == 0)
+		if (nf_conntrack_count(net) == 0)
 			continue;
 		__nf_ct_unconfirmed_destroy(net);
 		nf_queue_nf_hook_drop(net);
@@ -1762,13 +1712,19 @@ nf_ct_iterate_destroy(int (*iter)(struct nf_conn *i, void *data), void *data)
 	 */
 	synchronize_net();
 
-	nf_ct_iterate_cleanup(iter, data, 0, 0);
+	rtnl_lock();
+	for_each_net(net) {
+		if (nf_conntrack_count(net) == 0)
+			continue;
+		nf_ct_iterate_cleanup(net, iter, data, 0, 0);
+	}
+	rtnl_unlock();
 }
 EXPORT_SYMBOL_GPL(nf_ct_iterate_destroy);
 
 static int kill_all(struct nf_conn *i, void *data)
 {
-	return net_eq(nf_ct_net(i), data);
+	return 1;
 }
 
 void nf_ct_free_hashtable(void *hash, unsigned int size)
@@ -1781,9 +1737,60 @@ void nf_ct_free_hashtable(void *hash, unsigned int size)
 }
 EXPORT_SYMBOL_GPL(nf_ct_free_hashtable);
 
+static unsigned int nf_conntrack_htable_roundup(unsigned int size)
+{
+	size = clamp_t(unsigned int, size, NF_CT_HTABLE_MIN, NF_CT_HTABLE_MAX);
+	return roundup_pow_of_two(size);
+}
+
+/* Each live table needs its own nulls values, see ____nf_conntrack_find().
+ * On 32 bit there are only 30 bits for them (the values above are used by
+ * the per-cpu lists), which makes a reused value possible but unlikely.
+ */
+static unsigned long nf_conntrack_htable_nulls_base(unsigned int size)
+{
+	static atomic_t nf_conntrack_htable_id;
+	unsigned long id = (u32)atomic_inc_return(&nf_conntrack_htable_id);
+
+#if BITS_PER_LONG == 64
+	return id << 32;
+#else
+	return (id * size) & ((1UL << 30) - 1);
+#endif
+}
+
+static struct nf_conntrack_htable *nf_conntrack_htable_alloc(unsigned int size)
+{
+	struct nf_conntrack_htable *tbl;
+	unsigned int i;
+
+	tbl = kzalloc(sizeof(*tbl), GFP_KERNEL);
+	if (!tbl)
+		return NULL;
+
+	/* only ever rounded up to another power of two */
+	tbl->hash = nf_ct_alloc_hashtable(&size, 0);
+	if (!tbl->hash) {
+		kfree(tbl);
+		return NULL;
+	}
+
+	tbl->size = size;
+	tbl->nulls_base = nf_conntrack_htable_nulls_base(size);
+	for (i = 0; i < size; i++)
+		INIT_HLIST_NULLS_HEAD(&tbl->hash[i], tbl->nulls_base + i);
+
+	return tbl;
+}
+
+static void nf_conntrack_htable_free(struct nf_conntrack_htable *tbl)
+{
+	nf_ct_free_hashtable(tbl->hash, tbl->size);
+	kfree(tbl);
+}
+
 void nf_conntrack_cleanup_start(void)
 {
-	conntrack_gc_work.exiting = true;
 	RCU_INIT_POINTER(ip_ct_attach, NULL);
 }
 
@@ -1791,9 +1798,6 @@ void nf_conntrack_cleanup_end(void)
 {
 	RCU_INIT_POINTER(nf_ct_destroy, NULL);
 
-	cancel_delayed_work_sync(&conntrack_gc_work.dwork);
-	nf_ct_free_hashtable(nf_conntrack_hash, nf_conntrack_htable_size);
-
 	nf_conntrack_proto_fini();
 	nf_conntrack_seqadj_fini();
 	nf_conntrack_labels_fini();
@@ -1821,6 +1825,7 @@ void nf_conntrack_cleanup_net(struct net *net)
 
 void nf_conntrack_cleanup_net_list(struct list_head *net_exit_list)
 {
+	struct nf_conntrack_htable *tbl;
 	int busy;
 	struct net *net;
 
@@ -1833,8 +1838,8 @@ void nf_conntrack_cleanup_net_list(struct list_head *net_exit_list)
 i_see_dead_people:
 	busy = 0;
 	list_for_each_entry(net, net_exit_list, exit_list) {
-		nf_ct_iterate_cleanup(kill_all, net, 0, 0);
-		if (atomic_read(&net->ct.count) != 0)
+		nf_ct_iterate_cleanup(net, kill_all, NULL, 0, 0);
+		if (nf_conntrack_count(net) != 0)
 			busy = 1;
 	}
 	if (busy) {
@@ -1843,6 +1848,12 @@ void nf_conntrack_cleanup_net_list(struct list_head *net_exit_list)
 	}
 
 	list_for_each_entry(net, net_exit_list, exit_list) {
+		/* the gc worker queues the resize work, stop it first */
+		cancel_delayed_work_sync(&net->ct.gc_dwork);
+		cancel_work_sync(&net->ct.htable_work);
+		tbl = rcu_dereference_protected(net->ct.htable, 1);
+		nf_conntrack_htable_free(tbl);
+
 		nf_conntrack_proto_pernet_fini(net);
 		nf_conntrack_helper_pernet_fini(net);
 		nf_conntrack_ecache_pernet_fini(net);
@@ -1851,6 +1862,7 @@ void nf_conntrack_cleanup_net_list(struct list_head *net_exit_list)
 		nf_conntrack_expect_pernet_fini(net);
 		free_percpu(net->ct.stat);
 		free_percpu(net->ct.pcpu_lists);
+		percpu_counter_destroy(&net->ct.count);
 	}
 }
 
@@ -1883,63 +1895,127 @@ void *nf_ct_alloc_hashtable(unsigned int *sizep, int nulls)
 }
 EXPORT_SYMBOL_GPL(nf_ct_alloc_hashtable);
 
-int nf_conntrack_hash_resize(unsigned int hashsize)
+unsigned int nf_conntrack_hash_size(struct net *net)
 {
-	int i, bucket;
-	unsigned int old_size;
-	struct hlist_nulls_head *hash, *old_hash;
-	struct nf_conntrack_tuple_hash *h;
-	struct nf_conn *ct;
+	unsigned int size;
 
-	if (!hashsize)
-		return -EINVAL;
+	rcu_read_lock();
+	size = rcu_dereference(net->ct.htable)->size;
+	rcu_read_unlock();
 
-	hash = nf_ct_alloc_hashtable(&hashsize, 1);
-	if (!hash)
-		return -ENOMEM;
+	return size;
+}
+EXPORT_SYMBOL_GPL(nf_conntrack_hash_size);
+
+/* Move the last entry of a chain to the head of @to.  It is linked into
+ * @to before it is cut from its old chain, so a lookup that does not find
+ * it in the old table finds it in the future one.  A lookup that is on
+ * the entry meanwhile walks into @to and restarts because of its nulls.
+ */
+static void nf_ct_move_tail(struct hlist_nulls_node *last,
+			    struct hlist_nulls_head *to)
+{
+	struct hlist_nulls_node **pprev = last->pprev;
+	struct hlist_nulls_node *nulls = last->next;
+	struct hlist_nulls_node *first = to->first;
 
-	old_size = nf_conntrack_htable_size;
-	if (old_size == hashsize) {
-		nf_ct_free_hashtable(hash, hashsize);
+	WRITE_ONCE(last->next, first);
+	if (!is_a_nulls(first))
+		first->pprev = &last->next;
+	last->pprev = &to->first;
+	rcu_assign_pointer(hlist_nulls_first_rcu(to), last);
+
+	/* pairs with the smp_rmb() in ____nf_conntrack_find() */
+	smp_wmb();
+	WRITE_ONCE(*pprev, nulls);
+}
+
+/* Lookups and insertions go on while the entries are moved, only the
+ * bucket being moved is locked at any time.
+ */
+static int __nf_conntrack_hash_resize(struct net *net, unsigned int hashsize)
+{
+	struct nf_conntrack_htable *old, *new;
+	struct nf_conntrack_tuple_hash *h;
+	struct hlist_nulls_node *last;
+	unsigned int i, bucket;
+	spinlock_t *lockp;
+
+	lockdep_assert_held(&net->ct.htable_mutex);
+
+	old = rcu_dereference_protected(net->ct.htable,
+					lockdep_is_held(&net->ct.htable_mutex));
+	hashsize = nf_conntrack_htable_roundup(hashsize);
+	if (old->size == hashsize)
 		return 0;
-	}
 
-	local_bh_disable();
-	nf_conntrack_all_lock();
-	write_seqcount_begin(&nf_conntrack_generation);
+	new = nf_conntrack_htable_alloc(hashsize);
+	if (!new)
+		return -ENOMEM;
 
-	/* Lookups in the old hash might happen in parallel, which means we
-	 * might get false negatives during connection lookup. New connections
-	 * created because of a false negative won't make it into the hash
-	 * though since that required taking the locks.
-	 */
+	rcu_assign_pointer(old->future, new);
 
-	for (i = 0; i < nf_conntrack_htable_size; i++) {
-		while (!hlist_nulls_empty(&nf_conntrack_hash[i])) {
-			h = hlist_nulls_entry(nf_conntrack_hash[i].first,
-					      struct nf_conntrack_tuple_hash, hnnode);
-			ct = nf_ct_tuplehash_to_ctrack(h);
-			hlist_nulls_del_rcu(&h->hnnode);
-			bucket = __hash_conntrack(nf_ct_net(ct),
-						  &h->tuple, hashsize);
-			hlist_nulls_add_head_rcu(&h->hnnode, &hash[bucket]);
+	for (i = 0; i < old->size; i++) {
+		struct hlist_nulls_head *head = &old->hash[i];
+
+		lockp = nf_conntrack_bucket_lock(old, i);
+		local_bh_disable();
+		nf_conntrack_lock(lockp);
+		while (!hlist_nulls_empty(head)) {
+			for (last = head->first; !is_a_nulls(last->next);
+			     last = last->next)
+				;
+
+			h = hlist_nulls_entry(last,
+					      struct nf_conntrack_tuple_hash,
+					      hnnode);
+			bucket = hash_conntrack_raw(&h->tuple, net);
+			bucket = reciprocal_scale(bucket, new->size);
+			nf_ct_move_tail(last, &new->hash[bucket]);
 		}
+		/* insertions into this bucket go to the future table now */
+		WRITE_ONCE(old->rehashed, i + 1);
+		spin_unlock(lockp);
+		local_bh_enable();
+		cond_resched();
 	}
-	old_size = nf_conntrack_htable_size;
-	old_hash = nf_conntrack_hash;
-
-	nf_conntrack_hash = hash;
-	nf_conntrack_htable_size = hashsize;
-
-	write_seqcount_end(&nf_conntrack_generation);
-	nf_conntrack_all_unlock();
-	local_bh_enable();
 
+	rcu_assign_pointer(net->ct.htable, new);
 	synchronize_net();
-	nf_ct_free_hashtable(old_hash, old_size);
+	nf_conntrack_htable_free(old);
 	return 0;
 }
 
+int nf_conntrack_hash_resize(struct net *net, unsigned int hashsize)
+{
+	int ret;
+
+	if (!hashsize)
+		return -EINVAL;
+
+	mutex_lock(&net->ct.htable_mutex);
+	WRITE_ONCE(net->ct.htable_user, true);
+	ret = __nf_conntrack_hash_resize(net, hashsize);
+	mutex_unlock(&net->ct.htable_mutex);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(nf_conntrack_hash_resize);
+
+static void nf_conntrack_htable_worker(struct work_struct *work)
+{
+	struct net *net = container_of(work, struct net, ct.htable_work);
+	struct nf_conntrack_htable *tbl;
+
+	mutex_lock(&net->ct.htable_mutex);
+	tbl = rcu_dereference_protected(net->ct.htable,
+					lockdep_is_held(&net->ct.htable_mutex));
+	if (!net->ct.htable_user && tbl->size < nf_conntrack_htable_size &&
+	    percpu_counter_read_positive(&net->ct.count) > tbl->size)
+		__nf_conntrack_hash_resize(net, tbl->size * 2);
+	mutex_unlock(&net->ct.htable_mutex);
+}
+
 int nf_conntrack_set_hashsize(const char *val, struct kernel_param *kp)
 {
 	unsigned int hashsize;
@@ -1956,7 +2032,12 @@ int nf_conntrack_set_hashsize(const char *val, struct kernel_param *kp)
 	if (rc)
 		return rc;
 
-	return nf_conntrack_hash_resize(hashsize);
+	rc = nf_conntrack_hash_resize(&init_net, hashsize);
+	if (rc)
+		return rc;
+
+	nf_conntrack_htable_size = nf_conntrack_hash_size(&init_net);
+	return 0;
 }
 EXPORT_SYMBOL_GPL(nf_conntrack_set_hashsize);
 
@@ -2002,8 +2083,6 @@ int nf_conntrack_init_start(void)
 	/* struct nf_ct_ext uses u8 to store offsets/size */
 	BUILD_BUG_ON(total_extension_size() > 255u);
 
-	seqcount_init(&nf_conntrack_generation);
-
 	for (i = 0; i < CONNTRACK_LOCKS; i++)
 		spin_lock_init(&nf_conntrack_locks[i]);
 
@@ -2020,8 +2099,6 @@ int nf_conntrack_init_start(void)
 			nf_conntrack_htable_size = 65536;
 		else if (totalram_pages > (1024 * 1024 * 1024 / PAGE_SIZE))
 			nf_conntrack_htable_size = 16384;
-		if (nf_conntrack_htable_size < 32)
-			nf_conntrack_htable_size = 32;
 
 		/* Use a max. factor of four by default to get the same max as
 		 * with the old struct list_heads. When a table size is given
@@ -2030,10 +2107,8 @@ int nf_conntrack_init_start(void)
 		max_factor = 4;
 	}
 
-	nf_conntrack_hash = nf_ct_alloc_hashtable(&nf_conntrack_htable_size, 1);
-	if (!nf_conntrack_hash)
-		return -ENOMEM;
-
+	nf_conntrack_htable_size =
+		nf_conntrack_htable_roundup(nf_conntrack_htable_size);
 	nf_conntrack_max = max_factor * nf_conntrack_htable_size;
 
 	nf_conntrack_cachep = kmem_cache_create("nf_conntrack",
@@ -2041,7 +2116,7 @@ int nf_conntrack_init_start(void)
 						NFCT_INFOMASK + 1,
 						SLAB_TYPESAFE_BY_RCU | SLAB_HWCACHE_ALIGN, NULL);
 	if (!nf_conntrack_cachep)
-		goto err_cachep;
+		return -ENOMEM;
 
 	printk(KERN_INFO "nf_conntrack version %s (%u buckets, %d max)\n",
 	       NF_CONNTRACK_VERSION, nf_conntrack_htable_size,
@@ -2083,9 +2158,6 @@ int nf_conntrack_init_start(void)
 	if (ret < 0)
 		goto err_proto;
 
-	conntrack_gc_work_init(&conntrack_gc_work);
-	queue_delayed_work(system_long_wq, &conntrack_gc_work.dwork, HZ);
-
 	return 0;
 
 err_proto:
@@ -2106,8 +2178,6 @@ int nf_conntrack_init_start(void)
 	nf_conntrack_expect_fini();
 err_expect:
 	kmem_cache_destroy(nf_conntrack_cachep);
-err_cachep:
-	nf_ct_free_hashtable(nf_conntrack_hash, nf_conntrack_htable_size);
 	return ret;
 }
 
@@ -2127,12 +2197,17 @@ void nf_conntrack_init_end(void)
 
 int nf_conntrack_init_net(struct net *net)
 {
+	struct nf_conntrack_htable *tbl;
+	unsigned int size;
 	int ret = -ENOMEM;
 	int cpu;
 
 	BUILD_BUG_ON(IP_CT_UNTRACKED == IP_CT_NUMBER);
-	atomic_set(&net->ct.count, 0);
+	ret = percpu_counter_init(&net->ct.count, 0, GFP_KERNEL);
+	if (ret)
+		return ret;
 
+	ret = -ENOMEM;
 	net->ct.pcpu_lists = alloc_percpu(struct ct_pcpu);
 	if (!net->ct.pcpu_lists)
 		goto err_stat;
@@ -2149,6 +2224,19 @@ int nf_conntrack_init_net(struct net *net)
 	if (!net->ct.stat)
 		goto err_pcpu_lists;
 
+	/* Other namespaces start small and grow on demand, up to
+	 * the size of the init_net table.
+	 */
+	size = net_eq(net, &init_net) ? nf_conntrack_htable_size :
+					NF_CT_HTABLE_MIN;
+	tbl = nf_conntrack_htable_alloc(size);
+	if (!tbl)
+		goto err_htable;
+	RCU_INIT_POINTER(net->ct.htable, tbl);
+	mutex_init(&net->ct.htable_mutex);
+	INIT_WORK(&net->ct.htable_work, nf_conntrack_htable_worker);
+	net->ct.htable_user = false;
+
 	ret = nf_conntrack_expect_pernet_init(net);
 	if (ret < 0)
 		goto err_expect;
@@ -2167,6 +2255,12 @@ int nf_conntrack_init_net(struct net *net)
 	ret = nf_conntrack_proto_pernet_init(net);
 	if (ret < 0)
 		goto err_proto;
+
+	INIT_DEFERRABLE_WORK(&net->ct.gc_dwork, gc_worker);
+	net->ct.gc_last_bucket = 0;
+	net->ct.gc_next_run = HZ;
+	net->ct.gc_early_drop = false;
+	queue_delayed_work(system_long_wq, &net->ct.gc_dwork, HZ);
 	return 0;
 
 err_proto:
@@ -2180,9 +2274,12 @@ int nf_conntrack_init_net(struct net *net)
 err_acct:
 	nf_conntrack_expect_pernet_fini(net);
 err_expect:
+	nf_conntrack_htable_free(tbl);
+err_htable:
 	free_percpu(net->ct.stat);
 err_pcpu_lists:
 	free_percpu(net->ct.pcpu_lists);
 err_stat:
+	percpu_counter_destroy(&net->ct.count);
 	return ret;
 }
@@ -809,6 +809,7 @@ ctnetlink_dump_table(struct sk_buff *skb, struct netlink_callback *cb)
 	struct net *net = sock_net(skb->sk);
 	struct nf_conn *ct, *last;
 	struct nf_conntrack_tuple_hash *h;
+	struct nf_conntrack_htable *tbl;
 	struct hlist_nulls_node *n;
 	struct nfgenmsg *nfmsg = nlmsg_data(cb->nlh);
 	u_int8_t l3proto = nfmsg->nfgen_family;
@@ -820,7 +821,7 @@ ctnetlink_dump_table(struct sk_buff *skb, struct netlink_callback *cb)
 	i = 0;
 
 	local_bh_disable();
-	for (; cb->args[0] < nf_conntrack_htable_size; cb->args[0]++) {
+	for (;; cb->args[0]++) {
 restart:
 		while (i) {
 			i--;
@@ -829,13 +830,18 @@ ctnetlink_dump_table(struct sk_buff *skb, struct netlink_callback *cb)
 			nf_ct_put(nf_ct_evict[i]);
 		}
 
-		lockp = &nf_conntrack_locks[cb->args[0] % CONNTRACK_LOCKS];
-		nf_conntrack_lock(lockp);
-		if (cb->args[0] >= nf_conntrack_htable_size) {
-			spin_unlock(lockp);
+		/* A resize may move entries behind the dump, which then
+		 * misses them like the ones inserted meanwhile.
+		 */
+		rcu_read_lock();
+		tbl = rcu_dereference(net->ct.htable);
+		if (cb->args[0] >= tbl->size) {
+			rcu_read_unlock();
 			goto out;
 		}
-		hlist_nulls_for_each_entry(h, n, &nf_conntrack_hash[cb->args[0]],
+		lockp = nf_conntrack_bucket_lock(tbl, cb->args[0]);
+		nf_conntrack_lock(lockp);
+		hlist_nulls_for_each_entry(h, n, &tbl->hash[cb->args[0]],
 					   hnnode) {
 			if (NF_CT_DIRECTION(h) != IP_CT_DIR_ORIGINAL)
 				continue;
@@ -847,9 +853,6 @@ ctnetlink_dump_table(struct sk_buff *skb, struct netlink_callback *cb)
 				continue;
 			}
 
-			if (!net_eq(net, nf_ct_net(ct)))
-				continue;
-
 			/* Dump entries of a given L3 protocol number.
 			 * If it is not specified, ie. l3proto == 0,
 			 * then dump everything. */
@@ -863,21 +866,21 @@ ctnetlink_dump_table(struct sk_buff *skb, struct netlink_callback *cb)
 			if (!ctnetlink_filter_match(ct, cb->data))
 				continue;
 
-			rcu_read_lock();
 			res =
 			ctnetlink_fill_info(skb, NETLINK_CB(cb->skb).portid,
 					    cb->nlh->nlmsg_seq,
 					    NFNL_MSG_TYPE(cb->nlh->nlmsg_type),
 					    ct);
-			rcu_read_unlock();
 			if (res < 0) {
 				nf_conntrack_get(&ct->ct_general);
 				cb->args[1] = (unsigned long)ct;
 				spin_unlock(lockp);
+				rcu_read_unlock();
 				goto out;
 			}
 		}
 		spin_unlock(lockp);
+		rcu_read_unlock();
 		if (cb->args[1]) {
 			cb->args[1] = 0;
 			goto restart;
@@ -2091,7 +2094,7 @@ ctnetlink_stat_ct_fill_info(struct sk_buff *skb, u32 portid, u32 seq, u32 type,
 	struct nlmsghdr *nlh;
 	struct nfgenmsg *nfmsg;
 	unsigned int flags = portid ? NLM_F_MULTI : 0, event;
-	unsigned int nr_conntracks = atomic_read(&net->ct.count);
+	unsigned int nr_conntracks = nf_conntrack_count(net);
 
 	event = nfnl_msg_type(NFNL_SUBSYS_CTNETLINK, IPCTNL_MSG_CT_GET_STATS);
 	nlh = nlmsg_put(skb, portid, seq, event, sizeof(*nfmsg), flags);
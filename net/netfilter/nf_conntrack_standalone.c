@@ -102,8 +102,7 @@ EXPORT_SYMBOL_GPL(print_tuple);
 
 struct ct_iter_state {
 	struct seq_net_private p;
-	struct hlist_nulls_head *hash;
-	unsigned int htable_size;
+	struct nf_conntrack_htable *tbl;
 	unsigned int bucket;
 	u_int64_t time_now;
 };
@@ -114,10 +113,10 @@ static struct hlist_nulls_node *ct_get_first(struct seq_file *seq)
 	struct hlist_nulls_node *n;
 
 	for (st->bucket = 0;
-	     st->bucket < st->htable_size;
+	     st->bucket < st->tbl->size;
 	     st->bucket++) {
 		n = rcu_dereference(
-			hlist_nulls_first_rcu(&st->hash[st->bucket]));
+			hlist_nulls_first_rcu(&st->tbl->hash[st->bucket]));
 		if (!is_a_nulls(n))
 			return n;
 	}
@@ -131,12 +130,13 @@ static struct hlist_nulls_node *ct_get_next(struct seq_file *seq,
 
 	head = rcu_dereference(hlist_nulls_next_rcu(head));
 	while (is_a_nulls(head)) {
-		if (likely(get_nulls_value(head) == st->bucket)) {
-			if (++st->bucket >= st->htable_size)
+		if (likely(get_nulls_value(head) ==
+			   st->tbl->nulls_base + st->bucket)) {
+			if (++st->bucket >= st->tbl->size)
 				return NULL;
 		}
 		head = rcu_dereference(
-			hlist_nulls_first_rcu(&st->hash[st->bucket]));
+			hlist_nulls_first_rcu(&st->tbl->hash[st->bucket]));
 	}
 	return head;
 }
@@ -159,7 +159,8 @@ static void *ct_seq_start(struct seq_file *seq, loff_t *pos)
 	st->time_now = ktime_get_real_ns();
 	rcu_read_lock();
 
-	nf_conntrack_get_ht(&st->hash, &st->htable_size);
+	/* entries moved by a resize meanwhile may be missed, as is */
+	st->tbl = rcu_dereference(seq_file_net(seq)->ct.htable);
 	return ct_get_idx(seq, *pos);
 }
 
@@ -339,7 +340,9 @@ static int ct_seq_show(struct seq_file *s, void *v)
 	if (seq_print_acct(s, ct, IP_CT_DIR_REPLY))
 		goto release;
 
-	if (test_bit(IPS_ASSURED_BIT, &ct->status))
+	if (test_bit(IPS_OFFLOAD_BIT, &ct->status))
+		seq_puts(s, "[OFFLOAD] ");
+	else if (test_bit(IPS_ASSURED_BIT, &ct->status))
 		seq_puts(s, "[ASSURED] ");
 
 	if (seq_has_overflowed(s))
@@ -425,7 +428,7 @@ static void ct_cpu_seq_stop(struct seq_file *seq, void *v)
 static int ct_cpu_seq_show(struct seq_file *seq, void *v)
 {
 	struct net *net = seq_file_net(seq);
-	unsigned int nr_conntracks = atomic_read(&net->ct.count);
+	unsigned int nr_conntracks = nf_conntrack_count(net);
 	const struct ip_conntrack_stat *st = v;
 
 	if (v == SEQ_START_TOKEN) {
@@ -528,29 +531,42 @@ static void nf_conntrack_standalone_fini_proc(struct net *net)
 static int log_invalid_proto_min __read_mostly;
 static int log_invalid_proto_max __read_mostly = 255;
 
-/* size the user *wants to set */
-static unsigned int nf_conntrack_htable_size_user __read_mostly;
-
+/* Each namespace sizes its own table, extra1 is the namespace */
 static int
 nf_conntrack_hash_sysctl(struct ctl_table *table, int write,
 			 void __user *buffer, size_t *lenp, loff_t *ppos)
 {
+	struct net *net = table->extra1;
+	struct ctl_table tmp = *table;
+	unsigned int size;
 	int ret;
 
-	ret = proc_dointvec(table, write, buffer, lenp, ppos);
+	size = nf_conntrack_hash_size(net);
+	tmp.data = &size;
+
+	ret = proc_douintvec(&tmp, write, buffer, lenp, ppos);
 	if (ret < 0 || !write)
 		return ret;
 
-	/* update ret, we might not be able to satisfy request */
-	ret = nf_conntrack_hash_resize(nf_conntrack_htable_size_user);
-
-	/* update it to the actual value used by conntrack */
-	nf_conntrack_htable_size_user = nf_conntrack_htable_size;
-	return ret;
+	return nf_conntrack_hash_resize(net, size);
 }
 
 static struct ctl_table_header *nf_ct_netfilter_header;
 
+/* The count is a per-CPU counter, report its exact sum */
+static int nf_conntrack_count_sysctl(struct ctl_table *table, int write,
+				     void __user *buffer, size_t *lenp,
+				     loff_t *ppos)
+{
+	struct ctl_table tmp = *table;
+	int count;
+
+	count = percpu_counter_sum_positive(table->data);
+	tmp.data = &count;
+
+	return proc_dointvec(&tmp, write, buffer, lenp, ppos);
+}
+
 static struct ctl_table nf_ct_sysctl_table[] = {
 	{
 		.procname	= "nf_conntrack_max",
@@ -564,11 +580,10 @@ static struct ctl_table nf_ct_sysctl_table[] = {
 		.data		= &init_net.ct.count,
 		.maxlen		= sizeof(int),
 		.mode		= 0444,
-		.proc_handler	= proc_dointvec,
+		.proc_handler	= nf_conntrack_count_sysctl,
 	},
 	{
 		.procname       = "nf_conntrack_buckets",
-		.data           = &nf_conntrack_htable_size_user,
 		.maxlen         = sizeof(unsigned int),
 		.mode           = 0644,
 		.proc_handler   = nf_conntrack_hash_sysctl,
@@ -620,15 +635,15 @@ static int nf_conntrack_standalone_init_sysctl(struct net *net)
 		goto out_kmemdup;
 
 	table[1].data = &net->ct.count;
+	table[2].extra1 = net;
 	table[3].data = &net->ct.sysctl_checksum;
 	table[4].data = &net->ct.sysctl_log_invalid;
 
 	/* Don't export sysctls to unprivileged users */
-	if (net->user_ns != &init_user_ns)
+	if (net->user_ns != &init_user_ns) {
 		table[0].procname = NULL;
-
-	if (!net_eq(&init_net, net))
 		table[2].mode = 0444;
+	}
 
 	net->ct.sysctl_header = register_net_sysctl(net, "net/netfilter", table);
 	if (!net->ct.sysctl_header)
@@ -722,8 +737,6 @@ static int __init nf_conntrack_standalone_init(void)
 		ret = -ENOMEM;
 		goto out_sysctl;
 	}
-
-	nf_conntrack_htable_size_user = nf_conntrack_htable_size;
 #endif
 
 	ret = register_pernet_subsys(&nf_conntrack_net_ops);
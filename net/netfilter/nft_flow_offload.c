@@ -0,0 +1,524 @@
+/*
+ * nf_tables flow table object and "flow offload" expression: the object
+ * attaches the flow table fast path to the ingress hook of a set of
+ * devices, the expression adds established connections to it from the
+ * forward chain.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/netlink.h>
+#include <linux/netfilter.h>
+#include <linux/netdevice.h>
+#include <linux/netfilter/nfnetlink.h>
+#include <linux/netfilter/nf_tables.h>
+#include <net/ip.h>
+#include <net/route.h>
+#include <net/netfilter/nf_tables.h>
+#include <net/netfilter/nf_conntrack.h>
+#include <net/netfilter/nf_conntrack_core.h>
+#include <net/netfilter/nf_conntrack_helper.h>
+#include <net/netfilter/nf_conntrack_seqadj.h>
+#include <net/netfilter/nf_flow_table.h>
+
+#define NFT_FLOWTABLE_DEVICE_MAX	8
+
+struct nft_flowtable {
+	struct nf_flowtable		data;
+	struct list_head		list;
+	struct net			*net;
+	u32				flags;
+	int				priority;
+	int				ops_len;
+	struct nf_hook_ops		ops[NFT_FLOWTABLE_DEVICE_MAX];
+	char				devname[NFT_FLOWTABLE_DEVICE_MAX][IFNAMSIZ];
+};
+
+/* All flow table objects, protected by the nfnetlink nf_tables mutex */
+static LIST_HEAD(nft_flowtables);
+
+static int nft_flow_route(const struct nft_pktinfo *pkt,
+			  const struct nf_conn *ct,
+			  struct nf_flow_route *route,
+			  enum ip_conntrack_dir dir)
+{
+	struct dst_entry *this_dst = skb_dst(pkt->skb);
+	struct rtable *other_rt;
+	struct flowi4 fl4;
+
+	if (!this_dst)
+		return -ENOENT;
+
+	memset(&fl4, 0, sizeof(fl4));
+	fl4.daddr = ct->tuplehash[!dir].tuple.dst.u3.ip;
+
+	other_rt = ip_route_output_key(nft_net(pkt), &fl4);
+	if (IS_ERR(other_rt))
+		return -ENOENT;
+
+	route->tuple[dir].dst		= this_dst;
+	route->tuple[dir].ifindex	= nft_in(pkt)->ifindex;
+	route->tuple[!dir].dst		= &other_rt->dst;
+	route->tuple[!dir].ifindex	= nft_out(pkt)->ifindex;
+
+	return 0;
+}
+
+static bool nft_flow_offload_skip(struct sk_buff *skb)
+{
+	struct ip_options *opt  = &(IPCB(skb)->opt);
+
+	if (unlikely(opt->optlen))
+		return true;
+	if (skb_sec_path(skb))
+		return true;
+
+	return false;
+}
+
+static void nft_flowtable_offload(struct nft_flowtable *ft,
+				  struct nft_regs *regs,
+				  const struct nft_pktinfo *pkt)
+{
+	enum ip_conntrack_info ctinfo;
+	struct nf_flow_route route;
+	struct flow_offload *flow;
+	enum ip_conntrack_dir dir;
+	struct nf_conn *ct;
+
+	if (nft_pf(pkt) != ft->data.type->family ||
+	    !nft_in(pkt) || !nft_out(pkt) ||
+	    nft_flow_offload_skip(pkt->skb))
+		goto out;
+
+	ct = nf_ct_get(pkt->skb, &ctinfo);
+	if (!ct)
+		goto out;
+
+	switch (ct->tuplehash[IP_CT_DIR_ORIGINAL].tuple.dst.protonum) {
+	case IPPROTO_TCP:
+		if (ct->proto.tcp.state != TCP_CONNTRACK_ESTABLISHED)
+			goto out;
+		break;
+	case IPPROTO_UDP:
+		break;
+	default:
+		goto out;
+	}
+
+	if (!test_bit(IPS_ASSURED_BIT, &ct->status) ||
+	    test_bit(IPS_HELPER_BIT, &ct->status) ||
+	    nfct_help(ct) || nfct_seqadj(ct))
+		goto out;
+
+	if (ctinfo == IP_CT_NEW ||
+	    ctinfo == IP_CT_RELATED)
+		goto out;
+
+	if (test_and_set_bit(IPS_OFFLOAD_BIT, &ct->status))
+		goto out;
+
+	dir = CTINFO2DIR(ctinfo);
+	if (nft_flow_route(pkt, ct, &route, dir) < 0)
+		goto err_flow_route;
+
+	flow = flow_offload_alloc(ct, &route);
+	/* the flow holds its own reference on the reverse route */
+	dst_release(route.tuple[!dir].dst);
+	if (!flow)
+		goto err_flow_route;
+
+	if (flow_offload_add(&ft->data, flow) < 0) {
+		/* clears IPS_OFFLOAD_BIT */
+		flow_offload_free(flow);
+		goto out;
+	}
+
+	return;
+
+err_flow_route:
+	clear_bit(IPS_OFFLOAD_BIT, &ct->status);
+out:
+	regs->verdict.code = NFT_BREAK;
+}
+
+static void nft_flowtable_obj_eval(struct nft_object *obj,
+				   struct nft_regs *regs,
+				   const struct nft_pktinfo *pkt)
+{
+	nft_flowtable_offload(nft_obj_data(obj), regs, pkt);
+}
+
+static const struct nf_flowtable_type *nft_flowtable_type_get(u8 family)
+{
+	const struct nf_flowtable_type *type;
+
+	type = nf_flowtable_type_get(family);
+	if (type != NULL)
+		return type;
+#ifdef CONFIG_MODULES
+	nfnl_unlock(NFNL_SUBSYS_NFTABLES);
+	request_module("nf-flowtable-%u", family);
+	nfnl_lock(NFNL_SUBSYS_NFTABLES);
+	type = nf_flowtable_type_get(family);
+	if (type != NULL) {
+		module_put(type->owner);
+		return ERR_PTR(-EAGAIN);
+	}
+#endif
+	return ERR_PTR(-EAFNOSUPPORT);
+}
+
+static const struct nla_policy nft_device_policy[NFTA_DEVICE_MAX + 1] = {
+	[NFTA_DEVICE_NAME]	= { .type = NLA_STRING,
+				    .len = IFNAMSIZ - 1 },
+};
+
+static int nft_flowtable_parse_devices(struct net *net,
+				       const struct nlattr *attr,
+				       struct nft_flowtable *ft)
+{
+	struct net_device *dev;
+	const struct nlattr *tmp;
+	int rem, n = 0, err;
+
+	nla_for_each_nested(tmp, attr, rem) {
+		if (nla_type(tmp) != NFTA_DEVICE_NAME ||
+		    nla_len(tmp) > nft_device_policy[NFTA_DEVICE_NAME].len + 1) {
+			err = -EINVAL;
+			goto err;
+		}
+		if (n == NFT_FLOWTABLE_DEVICE_MAX) {
+			err = -EFBIG;
+			goto err;
+		}
+
+		nla_strlcpy(ft->devname[n], tmp, IFNAMSIZ);
+		dev = dev_get_by_name(net, ft->devname[n]);
+		if (!dev) {
+			err = -ENOENT;
+			goto err;
+		}
+		ft->ops[n++].dev = dev;
+	}
+	if (!n)
+		return -EINVAL;
+
+	ft->ops_len = n;
+	return 0;
+err:
+	while (n-- > 0)
+		dev_put(ft->ops[n].dev);
+	return err;
+}
+
+static void nft_flowtable_unregister_hooks(struct nft_flowtable *ft, int n)
+{
+	while (n-- > 0) {
+		if (!ft->ops[n].dev)
+			continue;
+		nf_unregister_net_hook(ft->net, &ft->ops[n]);
+		dev_put(ft->ops[n].dev);
+		ft->ops[n].dev = NULL;
+	}
+}
+
+static int nft_flowtable_obj_init(const struct nft_ctx *ctx,
+				  const struct nlattr * const tb[],
+				  struct nft_object *obj)
+{
+	struct nft_flowtable *ft = nft_obj_data(obj);
+	const struct nf_flowtable_type *type;
+	int err, i;
+
+	if (!tb[NFTA_FLOWTABLE_HOOK_DEVS])
+		return -EINVAL;
+
+	if (tb[NFTA_FLOWTABLE_FLAGS]) {
+		ft->flags = ntohl(nla_get_be32(tb[NFTA_FLOWTABLE_FLAGS]));
+		if (ft->flags & ~NFT_FLOWTABLE_HW_OFFLOAD)
+			return -EINVAL;
+	}
+	if (tb[NFTA_FLOWTABLE_HOOK_PRIORITY])
+		ft->priority = ntohl(nla_get_be32(tb[NFTA_FLOWTABLE_HOOK_PRIORITY]));
+
+	type = nft_flowtable_type_get(ctx->afi->family);
+	if (IS_ERR(type))
+		return PTR_ERR(type);
+
+	ft->net = ctx->net;
+	err = nft_flowtable_parse_devices(ctx->net, tb[NFTA_FLOWTABLE_HOOK_DEVS],
+					  ft);
+	if (err < 0)
+		goto err1;
+
+	ft->data.type = type;
+	if (ft->flags & NFT_FLOWTABLE_HW_OFFLOAD)
+		ft->data.flags |= NF_FLOWTABLE_F_HW;
+	err = nf_flow_table_init(&ft->data);
+	if (err < 0)
+		goto err2;
+
+	for (i = 0; i < ft->ops_len; i++) {
+		ft->ops[i].pf		= NFPROTO_NETDEV;
+		ft->ops[i].hooknum	= NF_NETDEV_INGRESS;
+		ft->ops[i].priority	= ft->priority;
+		ft->ops[i].priv		= &ft->data;
+		ft->ops[i].hook		= type->hook;
+
+		err = nf_register_net_hook(ctx->net, &ft->ops[i]);
+		if (err < 0)
+			goto err3;
+	}
+
+	list_add_tail(&ft->list, &nft_flowtables);
+
+	return 0;
+
+err3:
+	nft_flowtable_unregister_hooks(ft, i);
+	nf_flow_table_free(&ft->data);
+	for (; i < ft->ops_len; i++)
+		dev_put(ft->ops[i].dev);
+	goto err1;
+err2:
+	for (i = 0; i < ft->ops_len; i++)
+		dev_put(ft->ops[i].dev);
+err1:
+	module_put(type->owner);
+	return err;
+}
+
+static void nft_flowtable_obj_destroy(struct nft_object *obj)
+{
+	struct nft_flowtable *ft = nft_obj_data(obj);
+
+	list_del(&ft->list);
+	nft_flowtable_unregister_hooks(ft, ft->ops_len);
+	nf_flow_table_free(&ft->data);
+	module_put(ft->data.type->owner);
+}
+
+static int nft_flowtable_obj_dump(struct sk_buff *skb,
+				  struct nft_object *obj, bool reset)
+{
+	const struct nft_flowtable *ft = nft_obj_data(obj);
+	struct nlattr *nest;
+	int i;
+
+	if (nla_put_be32(skb, NFTA_FLOWTABLE_HOOK_PRIORITY, htonl(ft->priority)) ||
+	    nla_put_be32(skb, NFTA_FLOWTABLE_FLAGS, htonl(ft->flags)))
+		return -1;
+
+	nest = nla_nest_start(skb, NFTA_FLOWTABLE_HOOK_DEVS);
+	if (!nest)
+		return -1;
+	for (i = 0; i < ft->ops_len; i++) {
+		if (nla_put_string(skb, NFTA_DEVICE_NAME, ft->devname[i]))
+			return -1;
+	}
+	nla_nest_end(skb, nest);
+
+	return 0;
+}
+
+static const struct nla_policy nft_flowtable_policy[NFTA_FLOWTABLE_MAX + 1] = {
+	[NFTA_FLOWTABLE_HOOK_PRIORITY]	= { .type = NLA_U32 },
+	[NFTA_FLOWTABLE_HOOK_DEVS]	= { .type = NLA_NESTED },
+	[NFTA_FLOWTABLE_FLAGS]		= { .type = NLA_U32 },
+};
+
+static struct nft_object_type nft_flowtable_obj_type;
+static const struct nft_object_ops nft_flowtable_obj_ops = {
+	.type		= &nft_flowtable_obj_type,
+	.size		= sizeof(struct nft_flowtable),
+	.eval		= nft_flowtable_obj_eval,
+	.init		= nft_flowtable_obj_init,
+	.destroy	= nft_flowtable_obj_destroy,
+	.dump		= nft_flowtable_obj_dump,
+};
+
+static struct nft_object_type nft_flowtable_obj_type __read_mostly = {
+	.type		= NFT_OBJECT_FLOWTABLE,
+	.ops		= &nft_flowtable_obj_ops,
+	.maxattr	= NFTA_FLOWTABLE_MAX,
+	.policy		= nft_flowtable_policy,
+	.owner		= THIS_MODULE,
+};
+
+struct nft_flow_offload {
+	struct nft_object	*obj;
+};
+
+static void nft_flow_offload_eval(const struct nft_expr *expr,
+				  struct nft_regs *regs,
+				  const struct nft_pktinfo *pkt)
+{
+	struct nft_flow_offload *priv = nft_expr_priv(expr);
+
+	nft_flowtable_offload(nft_obj_data(priv->obj), regs, pkt);
+}
+
+static int nft_flow_offload_validate(const struct nft_ctx *ctx,
+				     const struct nft_expr *expr,
+				     const struct nft_data **data)
+{
+	unsigned int hook_mask = (1 << NF_INET_FORWARD);
+
+	return nft_chain_validate_hooks(ctx->chain, hook_mask);
+}
+
+static int nft_flow_offload_init(const struct nft_ctx *ctx,
+				 const struct nft_expr *expr,
+				 const struct nlattr * const tb[])
+{
+	struct nft_flow_offload *priv = nft_expr_priv(expr);
+	u8 genmask = nft_genmask_next(ctx->net);
+	struct nft_object *obj;
+	int err;
+
+	if (!tb[NFTA_FLOW_TABLE_NAME])
+		return -EINVAL;
+
+	obj = nf_tables_obj_lookup(ctx->table, tb[NFTA_FLOW_TABLE_NAME],
+				   NFT_OBJECT_FLOWTABLE, genmask);
+	if (IS_ERR(obj))
+		return -ENOENT;
+
+	err = nf_ct_netns_get(ctx->net, ctx->afi->family);
+	if (err < 0)
+		return err;
+
+	priv->obj = obj;
+	obj->use++;
+
+	return 0;
+}
+
+static void nft_flow_offload_destroy(const struct nft_ctx *ctx,
+				     const struct nft_expr *expr)
+{
+	struct nft_flow_offload *priv = nft_expr_priv(expr);
+
+	priv->obj->use--;
+	nf_ct_netns_put(ctx->net, ctx->afi->family);
+}
+
+static int nft_flow_offload_dump(struct sk_buff *skb, const struct nft_expr *r)
+{
+	struct nft_flow_offload *priv = nft_expr_priv(r);
+
+	if (nla_put_string(skb, NFTA_FLOW_TABLE_NAME, priv->obj->name))
+		goto nla_put_failure;
+
+	return 0;
+
+nla_put_failure:
+	return -1;
+}
+
+static const struct nla_policy nft_flow_offload_policy[NFTA_FLOW_MAX + 1] = {
+	[NFTA_FLOW_TABLE_NAME]	= { .type = NLA_STRING,
+				    .len = NFT_NAME_MAXLEN - 1 },
+};
+
+static struct nft_expr_type nft_flow_offload_type;
+static const struct nft_expr_ops nft_flow_offload_ops = {
+	.type		= &nft_flow_offload_type,
+	.size		= NFT_EXPR_SIZE(sizeof(struct nft_flow_offload)),
+	.eval		= nft_flow_offload_eval,
+	.init		= nft_flow_offload_init,
+	.destroy	= nft_flow_offload_destroy,
+	.validate	= nft_flow_offload_validate,
+	.dump		= nft_flow_offload_dump,
+};
+
+static struct nft_expr_type nft_flow_offload_type __read_mostly = {
+	.name		= "flow_offload",
+	.ops		= &nft_flow_offload_ops,
+	.policy		= nft_flow_offload_policy,
+	.maxattr	= NFTA_FLOW_MAX,
+	.owner		= THIS_MODULE,
+};
+
+static int nft_flowtable_netdev_event(struct notifier_block *this,
+				      unsigned long event, void *ptr)
+{
+	struct net_device *dev = netdev_notifier_info_to_dev(ptr);
+	struct nft_flowtable *ft;
+	int i;
+
+	if (event != NETDEV_DOWN &&
+	    event != NETDEV_UNREGISTER)
+		return NOTIFY_DONE;
+
+	nfnl_lock(NFNL_SUBSYS_NFTABLES);
+	list_for_each_entry(ft, &nft_flowtables, list) {
+		if (!net_eq(ft->net, dev_net(dev)))
+			continue;
+
+		nf_flow_table_cleanup(&ft->data, dev);
+
+		if (event != NETDEV_UNREGISTER)
+			continue;
+
+		for (i = 0; i < ft->ops_len; i++) {
+			if (ft->ops[i].dev != dev)
+				continue;
+			nf_unregister_net_hook(ft->net, &ft->ops[i]);
+			dev_put(dev);
+			ft->ops[i].dev = NULL;
+		}
+	}
+	nfnl_unlock(NFNL_SUBSYS_NFTABLES);
+
+	return NOTIFY_DONE;
+}
+
+static struct notifier_block nft_flowtable_netdev_notifier = {
+	.notifier_call	= nft_flowtable_netdev_event,
+};
+
+static int __init nft_flow_offload_module_init(void)
+{
+	int err;
+
+	err = register_netdevice_notifier(&nft_flowtable_netdev_notifier);
+	if (err < 0)
+		return err;
+
+	err = nft_register_obj(&nft_flowtable_obj_type);
+	if (err < 0)
+		goto err1;
+
+	err = nft_register_expr(&nft_flow_offload_type);
+	if (err < 0)
+		goto err2;
+
+	return 0;
+
+err2:
+	nft_unregister_obj(&nft_flowtable_obj_type);
+err1:
+	unregister_netdevice_notifier(&nft_flowtable_netdev_notifier);
+	return err;
+}
+
+static void __exit nft_flow_offload_module_exit(void)
+{
+	nft_unregister_expr(&nft_flow_offload_type);
+	nft_unregister_obj(&nft_flowtable_obj_type);
+	unregister_netdevice_notifier(&nft_flowtable_netdev_notifier);
+}
+
+module_init(nft_flow_offload_module_init);
+module_exit(nft_flow_offload_module_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_ALIAS_NFT_EXPR("flow_offload");
+MODULE_ALIAS_NFT_OBJ(NFT_OBJECT_FLOWTABLE);
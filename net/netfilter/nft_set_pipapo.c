@@ -0,0 +1,1173 @@
+/*
+ * nf_tables set type matching on concatenated ranges, with one range per
+ * field, e.g. source address range, destination address range and port
+ * range, in a single lookup.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Every field of the key is split in groups of four bits. For each field,
+ * a lookup table holds one bitmap of rules per group and per possible
+ * group value (bucket): a rule matches the packet field if its bit is set
+ * in the buckets selected by all group values of the packet field. Ranges
+ * are expanded to a set of netmasks, each becoming one rule, so that
+ * groups fully covered by the mask bits select all the buckets, groups
+ * that are not masked select exactly one.
+ *
+ * Rules matching in one field are then mapped to the rules of the same
+ * entry in the next field, and the result of the lookup in the next field
+ * is intersected with this map: the "pile" of bitmaps is walked field by
+ * field, and rules matching in the last field point to set elements.
+ *
+ *	key:       192.168.1.20 . 10.0.0.1 . 22
+ *	            |              |          |
+ *	field 0:  [lt: AND of 8 buckets] -> rules -> mapping --+
+ *	                                                       |
+ *	field 1:  [lt: AND of 8 buckets] & mapped rules <------+ -> mapping --+
+ *	                                                                      |
+ *	field 2:  [lt: AND of 4 buckets] & mapped rules <---------------------+
+ *	                                                  -> element
+ *
+ * Matching is a sequence of word-wide AND operations on bitmaps sized
+ * after the number of rules, with no branches depending on the packet
+ * data other than the final element selection.
+ *
+ * Updates are done on a copy of the lookup data, the clone, which is
+ * published once the transaction is committed, so that packets always see
+ * a consistent snapshot.
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/netlink.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nf_tables.h>
+#include <net/netfilter/nf_tables.h>
+#include <linux/bitmap.h>
+#include <linux/bitops.h>
+#include <linux/bottom_half.h>
+#include <linux/in6.h>
+#include <linux/mm.h>
+#include <linux/percpu.h>
+#include <linux/slab.h>
+
+#define NFT_PIPAPO_MIN_FIELDS		2
+#define NFT_PIPAPO_MAX_FIELDS		NFT_REG32_COUNT
+
+/* Largest supported field size */
+#define NFT_PIPAPO_MAX_BYTES		(sizeof(struct in6_addr))
+#define NFT_PIPAPO_MAX_BITS		(NFT_PIPAPO_MAX_BYTES * BITS_PER_BYTE)
+
+#define NFT_PIPAPO_GROUP_BITS		4
+#define NFT_PIPAPO_GROUPS_PER_BYTE	(BITS_PER_BYTE / NFT_PIPAPO_GROUP_BITS)
+#define NFT_PIPAPO_BUCKETS		BIT(NFT_PIPAPO_GROUP_BITS)
+
+/**
+ * union nft_pipapo_map_bucket - mapping of a rule to the next field
+ * @to:		first rule of the same entry in the next field
+ * @n:		number of rules of the same entry in the next field
+ * @e:		set element, for rules in the last field
+ */
+union nft_pipapo_map_bucket {
+	struct {
+		u32			to;
+		u32			n;
+	};
+	struct nft_pipapo_elem		*e;
+};
+
+/**
+ * struct nft_pipapo_field - lookup, mapping tables and data for a field
+ * @groups:	number of four-bit groups in the field
+ * @rules:	number of inserted rules
+ * @bsize:	size of each bucket in the lookup table, in longs
+ * @lt:		lookup table: groups * NFT_PIPAPO_BUCKETS buckets of bsize
+ * @mt:		mapping table: one bucket per rule
+ */
+struct nft_pipapo_field {
+	unsigned int			groups;
+	unsigned int			rules;
+	unsigned int			bsize;
+	unsigned long			*lt;
+	union nft_pipapo_map_bucket	*mt;
+};
+
+/**
+ * struct nft_pipapo_match - data used for lookups, a snapshot of the set
+ * @field_count:	number of concatenated fields
+ * @bsize_max:		largest bucket size across fields, in longs
+ * @scratch:		per-CPU maps for partial results of the lookup
+ * @rcu:		head for delayed release after publishing a new copy
+ * @f:			fields
+ */
+struct nft_pipapo_match {
+	unsigned int			field_count;
+	unsigned int			bsize_max;
+	unsigned long * __percpu	*scratch;
+	struct rcu_head			rcu;
+	struct nft_pipapo_field		f[0];
+};
+
+/**
+ * struct nft_pipapo - set private data
+ * @match:	currently in-use matching data
+ * @clone:	copy where pending changes are applied
+ * @dirty:	the clone differs from the matching data
+ */
+struct nft_pipapo {
+	struct nft_pipapo_match __rcu	*match;
+	struct nft_pipapo_match		*clone;
+	bool				dirty;
+};
+
+struct nft_pipapo_elem {
+	struct nft_set_ext		ext;
+};
+
+/* First rule and number of rules of an entry, for each field */
+struct nft_pipapo_rulemap {
+	unsigned int			to;
+	unsigned int			n;
+};
+
+/* Fields start on a register boundary in the key */
+static unsigned int pipapo_field_size(const struct nft_pipapo_field *f)
+{
+	return round_up(f->groups / NFT_PIPAPO_GROUPS_PER_BYTE, NFT_REG32_SIZE);
+}
+
+static unsigned long *pipapo_bucket(const struct nft_pipapo_field *f,
+				    unsigned int group, unsigned int v)
+{
+	return f->lt + (group * NFT_PIPAPO_BUCKETS + v) * f->bsize;
+}
+
+/* Intersect the result map with the buckets selected by the packet field,
+ * return false as soon as no rule is left.
+ */
+static bool pipapo_and_field_buckets(const struct nft_pipapo_field *f,
+				     unsigned long *dst, const u8 *data)
+{
+	unsigned int nbits = f->bsize * BITS_PER_LONG;
+	const unsigned long *lt = f->lt;
+	unsigned int group;
+
+	for (group = 0; group < f->groups;
+	     group += NFT_PIPAPO_GROUPS_PER_BYTE, data++) {
+		if (!__bitmap_and(dst, dst, lt + (*data >> 4) * f->bsize,
+				  nbits))
+			return false;
+		lt += f->bsize * NFT_PIPAPO_BUCKETS;
+
+		if (!__bitmap_and(dst, dst, lt + (*data & 0x0f) * f->bsize,
+				  nbits))
+			return false;
+		lt += f->bsize * NFT_PIPAPO_BUCKETS;
+	}
+
+	return true;
+}
+
+/**
+ * pipapo_refill() - map the rules matching in a field to the next one
+ * @map:	rules matching in the current field, cleared on return
+ * @len:	size of @map, in longs
+ * @rules:	number of rules in the current field
+ * @dst:	all-zeroes map for the next field, filled with mapped rules
+ * @mt:		mapping table of the current field
+ * @match_only:	last field: find the next matching rule, don't map it
+ *
+ * Return: index of the first matching rule with @match_only, zero if any
+ * rule matched otherwise, -1 if none did.
+ */
+static int pipapo_refill(unsigned long *map, unsigned int len,
+			 unsigned int rules, unsigned long *dst,
+			 const union nft_pipapo_map_bucket *mt, bool match_only)
+{
+	unsigned long bitset;
+	unsigned int k;
+	int ret = -1;
+
+	for (k = 0; k < len; k++) {
+		bitset = map[k];
+		while (bitset) {
+			unsigned int i = k * BITS_PER_LONG + __ffs(bitset);
+
+			if (unlikely(i >= rules)) {
+				map[k] = 0;
+				return ret;
+			}
+
+			if (match_only) {
+				__clear_bit(i, map);
+				return i;
+			}
+
+			ret = 0;
+			bitmap_set(dst, mt[i].to, mt[i].n);
+			bitset &= bitset - 1;
+		}
+		map[k] = 0;
+	}
+
+	return ret;
+}
+
+static bool pipapo_elem_equal(const struct nft_set *set,
+			      const struct nft_pipapo_elem *e,
+			      const u8 *start, const u8 *end)
+{
+	const struct nft_data *key_end;
+
+	if (nft_set_ext_exists(&e->ext, NFT_SET_EXT_KEY_END))
+		key_end = nft_set_ext_key_end(&e->ext);
+	else
+		key_end = nft_set_ext_key(&e->ext);
+
+	return !memcmp(nft_set_ext_key(&e->ext), start, set->klen) &&
+	       !memcmp(key_end, end, set->klen);
+}
+
+/**
+ * pipapo_match() - find the element matching a key
+ * @set:	nftables API set representation
+ * @m:		matching data to look up
+ * @data:	concatenated key
+ * @end:	if given, only match an element with exactly @data as start
+ *		and @end as end
+ * @genmask:	generation the element has to be active in
+ * @res_map:	scratch map for results, 2 * @m->bsize_max longs
+ *
+ * Return: matching element or NULL.
+ */
+static struct nft_pipapo_elem *pipapo_match(const struct nft_set *set,
+					    const struct nft_pipapo_match *m,
+					    const u8 *data, const u8 *end,
+					    u8 genmask, unsigned long *res_map)
+{
+	unsigned long *fill_map = res_map + m->bsize_max;
+	const struct nft_pipapo_field *f;
+	const u8 *rp = data;
+	unsigned int i;
+
+	memset(res_map, 0, m->bsize_max * 2 * sizeof(*res_map));
+	bitmap_fill(res_map, m->f[0].rules);
+
+	for (i = 0, f = m->f; i < m->field_count; i++, f++) {
+		bool last = i == m->field_count - 1;
+		int b;
+
+		if (!pipapo_and_field_buckets(f, res_map, rp))
+			return NULL;
+		rp += pipapo_field_size(f);
+
+next_match:
+		b = pipapo_refill(res_map, f->bsize, f->rules, fill_map, f->mt,
+				  last);
+		if (b < 0)
+			return NULL;
+
+		if (last) {
+			struct nft_pipapo_elem *e = f->mt[b].e;
+
+			if (!nft_set_elem_active(&e->ext, genmask) ||
+			    (end && !pipapo_elem_equal(set, e, data, end)))
+				goto next_match;
+
+			return e;
+		}
+
+		/* fill_map now holds the rules to consider in the next field,
+		 * res_map was cleared while mapping and takes its place.
+		 */
+		swap(res_map, fill_map);
+	}
+
+	return NULL;
+}
+
+static bool nft_pipapo_lookup(const struct net *net, const struct nft_set *set,
+			      const u32 *key, const struct nft_set_ext **ext)
+{
+	struct nft_pipapo *priv = nft_set_priv(set);
+	const struct nft_pipapo_match *m;
+	struct nft_pipapo_elem *e = NULL;
+	unsigned long *res_map;
+
+	/* The scratch maps are per-CPU: keep softirqs from reusing them */
+	local_bh_disable();
+
+	m = rcu_dereference(priv->match);
+	res_map = *this_cpu_ptr(m->scratch);
+	if (likely(res_map))
+		e = pipapo_match(set, m, (const u8 *)key, NULL,
+				 nft_genmask_cur(net), res_map);
+
+	local_bh_enable();
+
+	if (!e)
+		return false;
+
+	*ext = &e->ext;
+	return true;
+}
+
+/* Look up an element of the clone from the control plane */
+static struct nft_pipapo_elem *pipapo_get(const struct nft_set *set,
+					  const struct nft_pipapo_match *m,
+					  const u8 *data, const u8 *end,
+					  u8 genmask)
+{
+	struct nft_pipapo_elem *e;
+	unsigned long *res_map;
+
+	if (!m->bsize_max)
+		return NULL;
+
+	res_map = kcalloc(m->bsize_max * 2, sizeof(*res_map), GFP_KERNEL);
+	if (!res_map)
+		return ERR_PTR(-ENOMEM);
+
+	e = pipapo_match(set, m, data, end, genmask, res_map);
+	kfree(res_map);
+
+	return e;
+}
+
+/**
+ * pipapo_resize() - resize lookup and mapping tables of a field
+ * @f:		field
+ * @old_rules:	number of rules in the tables
+ * @rules:	new number of rules
+ *
+ * Buckets keep their contents up to the smaller size, rules dropped by
+ * shrinking must already be cleared.
+ *
+ * Return: 0 on success, -ENOMEM on allocation failure.
+ */
+static int pipapo_resize(struct nft_pipapo_field *f, unsigned int old_rules,
+			 unsigned int rules)
+{
+	union nft_pipapo_map_bucket *new_mt;
+	unsigned int new_bsize, copy, i;
+	unsigned long *new_lt = f->lt;
+
+	if (!rules) {
+		kvfree(f->lt);
+		kvfree(f->mt);
+		f->lt = NULL;
+		f->mt = NULL;
+		f->bsize = 0;
+		return 0;
+	}
+
+	new_bsize = BITS_TO_LONGS(rules);
+	if (new_bsize != f->bsize) {
+		new_lt = kvzalloc(f->groups * NFT_PIPAPO_BUCKETS * new_bsize *
+				  sizeof(*new_lt), GFP_KERNEL);
+		if (!new_lt)
+			return -ENOMEM;
+
+		copy = min(f->bsize, new_bsize);
+		for (i = 0; i < f->groups * NFT_PIPAPO_BUCKETS; i++)
+			memcpy(new_lt + i * new_bsize, f->lt + i * f->bsize,
+			       copy * sizeof(*new_lt));
+	}
+
+	new_mt = kvmalloc(rules * sizeof(*new_mt), GFP_KERNEL);
+	if (!new_mt) {
+		if (new_lt != f->lt)
+			kvfree(new_lt);
+		return -ENOMEM;
+	}
+
+	memcpy(new_mt, f->mt, min(old_rules, rules) * sizeof(*new_mt));
+	if (rules > old_rules)
+		memset(new_mt + old_rules, 0,
+		       (rules - old_rules) * sizeof(*new_mt));
+
+	kvfree(f->mt);
+	f->mt = new_mt;
+
+	if (new_lt != f->lt) {
+		kvfree(f->lt);
+		f->lt = new_lt;
+		f->bsize = new_bsize;
+	}
+
+	return 0;
+}
+
+/**
+ * pipapo_insert() - add a rule matching a netmask to a field
+ * @f:		field
+ * @k:		field value, network order
+ * @mask_bits:	netmask length in bits
+ *
+ * Return: number of rules added (1), or negative error code.
+ */
+static int pipapo_insert(struct nft_pipapo_field *f, const u8 *k,
+			 unsigned int mask_bits)
+{
+	unsigned int rule = f->rules, group, v, i;
+	int err;
+
+	err = pipapo_resize(f, f->rules, f->rules + 1);
+	if (err)
+		return err;
+
+	f->rules++;
+
+	for (group = 0; group < f->groups; group++) {
+		v = k[group / NFT_PIPAPO_GROUPS_PER_BYTE];
+		v = group % NFT_PIPAPO_GROUPS_PER_BYTE ? v & 0x0f : v >> 4;
+
+		if (mask_bits >= (group + 1) * NFT_PIPAPO_GROUP_BITS) {
+			/* Not masked: exactly one bucket */
+			__set_bit(rule, pipapo_bucket(f, group, v));
+		} else if (mask_bits <= group * NFT_PIPAPO_GROUP_BITS) {
+			/* Fully masked: any bucket */
+			for (i = 0; i < NFT_PIPAPO_BUCKETS; i++)
+				__set_bit(rule, pipapo_bucket(f, group, i));
+		} else {
+			/* The netmask ends within this group */
+			unsigned int mask = GENMASK(NFT_PIPAPO_GROUP_BITS - 1,
+						    NFT_PIPAPO_GROUP_BITS -
+						    mask_bits %
+						    NFT_PIPAPO_GROUP_BITS);
+
+			for (i = 0; i < NFT_PIPAPO_BUCKETS; i++) {
+				if ((i & mask) == (v & mask))
+					__set_bit(rule,
+						  pipapo_bucket(f, group, i));
+			}
+		}
+	}
+
+	return 1;
+}
+
+/* Bit @step, counted from the least significant one, of a network order
+ * value of @len bits
+ */
+static bool pipapo_test_bit(const u8 *base, unsigned int step, unsigned int len)
+{
+	return base[len / BITS_PER_BYTE - 1 - step / BITS_PER_BYTE] &
+	       BIT(step % BITS_PER_BYTE);
+}
+
+/* Would setting all bits up to @step in @base overshoot @end? */
+static bool pipapo_step_after_end(const u8 *base, const u8 *end,
+				  unsigned int step, unsigned int len)
+{
+	u8 tmp[NFT_PIPAPO_MAX_BYTES];
+	unsigned int i;
+
+	memcpy(tmp, base, len / BITS_PER_BYTE);
+	for (i = 0; i <= step; i++)
+		tmp[len / BITS_PER_BYTE - 1 - i / BITS_PER_BYTE] |=
+			BIT(i % BITS_PER_BYTE);
+
+	return memcmp(tmp, end, len / BITS_PER_BYTE) > 0;
+}
+
+/* Add 2^@step to @base, return true on overflow */
+static bool pipapo_base_sum(u8 *base, unsigned int step, unsigned int len)
+{
+	int i = len / BITS_PER_BYTE - 1 - step / BITS_PER_BYTE;
+	unsigned int sum = base[i] + BIT(step % BITS_PER_BYTE);
+
+	base[i] = sum;
+	while (sum > U8_MAX) {
+		if (--i < 0)
+			return true;
+		sum = base[i] + 1;
+		base[i] = sum;
+	}
+
+	return false;
+}
+
+/**
+ * pipapo_expand() - expand a range to netmasks and insert them as rules
+ * @f:		field
+ * @start:	range start, network order
+ * @end:	range end, network order
+ * @len:	field length in bits
+ *
+ * Return: number of rules added, or negative error code.
+ */
+static int pipapo_expand(struct nft_pipapo_field *f,
+			 const u8 *start, const u8 *end, unsigned int len)
+{
+	unsigned int step, bytes = len / BITS_PER_BYTE;
+	u8 base[NFT_PIPAPO_MAX_BYTES];
+	int masks = 0, err;
+
+	memcpy(base, start, bytes);
+	while (memcmp(base, end, bytes) <= 0) {
+		step = 0;
+		while (!pipapo_test_bit(base, step, len) &&
+		       !pipapo_step_after_end(base, end, step, len)) {
+			if (++step == len)
+				break;
+		}
+
+		err = pipapo_insert(f, base, len - step);
+		if (err < 0)
+			return err;
+		masks++;
+
+		if (step == len || pipapo_base_sum(base, step, len))
+			break;
+	}
+
+	return masks;
+}
+
+/* Point the rules of a new entry to the rules of the next field, and the
+ * rules in the last field to the element.
+ */
+static void pipapo_map(struct nft_pipapo_match *m,
+		       const struct nft_pipapo_rulemap *rulemap,
+		       struct nft_pipapo_elem *e)
+{
+	struct nft_pipapo_field *f;
+	unsigned int i, j;
+
+	for (i = 0, f = m->f; i < m->field_count - 1; i++, f++) {
+		for (j = 0; j < rulemap[i].n; j++) {
+			f->mt[rulemap[i].to + j].to = rulemap[i + 1].to;
+			f->mt[rulemap[i].to + j].n = rulemap[i + 1].n;
+		}
+	}
+
+	for (j = 0; j < rulemap[i].n; j++)
+		f->mt[rulemap[i].to + j].e = e;
+}
+
+/* Drop rules beyond @rules, tables keep their size */
+static void pipapo_truncate(struct nft_pipapo_field *f, unsigned int rules)
+{
+	unsigned int i;
+
+	if (f->rules == rules)
+		return;
+
+	for (i = 0; i < f->groups * NFT_PIPAPO_BUCKETS; i++)
+		bitmap_clear(f->lt + i * f->bsize, rules, f->rules - rules);
+
+	f->rules = rules;
+}
+
+static struct nft_pipapo_match *pipapo_clone(const struct nft_pipapo_match *old);
+
+/* Clone to apply updates to: if the last commit couldn't allocate a new
+ * one, try again now.
+ */
+static struct nft_pipapo_match *pipapo_maybe_clone(const struct nft_set *set)
+{
+	struct nft_pipapo *priv = nft_set_priv(set);
+
+	if (!priv->clone)
+		priv->clone = pipapo_clone(rcu_dereference_protected(priv->match,
+								     true));
+
+	return priv->clone;
+}
+
+static int pipapo_realloc_scratch(struct nft_pipapo_match *m,
+				  unsigned int bsize_max)
+{
+	unsigned long *scratch;
+	int i;
+
+	if (!bsize_max)
+		return 0;
+
+	for_each_possible_cpu(i) {
+		scratch = kzalloc_node(bsize_max * 2 * sizeof(*scratch),
+				       GFP_KERNEL, cpu_to_node(i));
+		if (!scratch)
+			return -ENOMEM;
+
+		kfree(*per_cpu_ptr(m->scratch, i));
+		*per_cpu_ptr(m->scratch, i) = scratch;
+	}
+
+	return 0;
+}
+
+static int nft_pipapo_insert(const struct net *net, const struct nft_set *set,
+			     const struct nft_set_elem *elem,
+			     struct nft_set_ext **ext)
+{
+	struct nft_pipapo *priv = nft_set_priv(set);
+	struct nft_pipapo_rulemap rulemap[NFT_PIPAPO_MAX_FIELDS];
+	const struct nft_set_ext *new_ext = nft_set_elem_ext(set, elem->priv);
+	struct nft_pipapo_match *m = pipapo_maybe_clone(set);
+	u8 genmask = nft_genmask_next(net);
+	const u8 *start, *end, *start_p, *end_p;
+	struct nft_pipapo_elem *e = elem->priv, *dup;
+	unsigned int i, j, bsize_max;
+	struct nft_pipapo_field *f;
+	int ret;
+
+	if (!m)
+		return -ENOMEM;
+
+	start = (const u8 *)nft_set_ext_key(new_ext)->data;
+	if (nft_set_ext_exists(new_ext, NFT_SET_EXT_KEY_END))
+		end = (const u8 *)nft_set_ext_key_end(new_ext)->data;
+	else
+		end = start;
+
+	dup = pipapo_get(set, m, start, NULL, genmask);
+	if (IS_ERR(dup))
+		return PTR_ERR(dup);
+	if (dup) {
+		if (pipapo_elem_equal(set, dup, start, end)) {
+			*ext = &dup->ext;
+			return -EEXIST;
+		}
+		return -ENOTEMPTY;
+	}
+
+	dup = pipapo_get(set, m, end, NULL, genmask);
+	if (IS_ERR(dup))
+		return PTR_ERR(dup);
+	if (dup)
+		return -ENOTEMPTY;
+
+	/* Size the scratch maps for the worst case expansion upfront, so that
+	 * no bucket can outgrow them.
+	 */
+	start_p = start;
+	end_p = end;
+	bsize_max = m->bsize_max;
+	for (i = 0, f = m->f; i < m->field_count; i++, f++) {
+		unsigned int bits = f->groups * NFT_PIPAPO_GROUP_BITS;
+
+		if (memcmp(start_p, end_p,
+			   f->groups / NFT_PIPAPO_GROUPS_PER_BYTE) > 0)
+			return -EINVAL;
+
+		bsize_max = max_t(unsigned int, bsize_max,
+				  BITS_TO_LONGS(f->rules + bits * 2));
+
+		start_p += pipapo_field_size(f);
+		end_p += pipapo_field_size(f);
+	}
+
+	if (bsize_max > m->bsize_max) {
+		ret = pipapo_realloc_scratch(m, bsize_max);
+		if (ret)
+			return ret;
+
+		m->bsize_max = bsize_max;
+	}
+
+	start_p = start;
+	end_p = end;
+	for (i = 0, f = m->f; i < m->field_count; i++, f++) {
+		rulemap[i].to = f->rules;
+
+		ret = pipapo_expand(f, start_p, end_p,
+				    f->groups * NFT_PIPAPO_GROUP_BITS);
+		if (ret < 0)
+			goto err;
+
+		rulemap[i].n = ret;
+
+		start_p += pipapo_field_size(f);
+		end_p += pipapo_field_size(f);
+	}
+
+	pipapo_map(m, rulemap, e);
+	priv->dirty = true;
+
+	return 0;
+
+err:
+	for (j = 0, f = m->f; j <= i; j++, f++)
+		pipapo_truncate(f, rulemap[j].to);
+
+	return ret;
+}
+
+/* Shift down the bits following a removed range of @cut bits */
+static void pipapo_bitmap_cut(unsigned long *map, unsigned int first,
+			      unsigned int cut, unsigned int nbits)
+{
+	unsigned int i;
+
+	for (i = first; i + cut < nbits; i++) {
+		if (test_bit(i + cut, map))
+			__set_bit(i, map);
+		else
+			__clear_bit(i, map);
+	}
+
+	bitmap_clear(map, nbits - cut, cut);
+}
+
+/* Find the rules of an element in each field, from the last one back */
+static int pipapo_rulemap(const struct nft_pipapo_match *m,
+			  const struct nft_pipapo_elem *e,
+			  struct nft_pipapo_rulemap *rulemap)
+{
+	const struct nft_pipapo_field *f;
+	int i = m->field_count - 1;
+	unsigned int r, n;
+
+	f = &m->f[i];
+	for (r = 0; r < f->rules; r++) {
+		if (f->mt[r].e == e)
+			break;
+	}
+	if (r == f->rules)
+		return -ENOENT;
+
+	for (n = 0; r + n < f->rules && f->mt[r + n].e == e; n++)
+		;
+	rulemap[i].to = r;
+	rulemap[i].n = n;
+
+	for (i--; i >= 0; i--) {
+		f = &m->f[i];
+		for (r = 0; r < f->rules; r++) {
+			if (f->mt[r].to == rulemap[i + 1].to)
+				break;
+		}
+		if (WARN_ON_ONCE(r == f->rules))
+			return -ENOENT;
+
+		for (n = 0; r + n < f->rules &&
+			    f->mt[r + n].to == rulemap[i + 1].to; n++)
+			;
+		rulemap[i].to = r;
+		rulemap[i].n = n;
+	}
+
+	return 0;
+}
+
+/* Remove the rules of an entry and fix up the mapping to following rules */
+static void pipapo_drop(struct nft_pipapo_match *m,
+			const struct nft_pipapo_rulemap *rulemap)
+{
+	struct nft_pipapo_field *f;
+	unsigned int i, j, rules;
+
+	for (i = 0, f = m->f; i < m->field_count; i++, f++) {
+		for (j = 0; j < f->groups * NFT_PIPAPO_BUCKETS; j++)
+			pipapo_bitmap_cut(f->lt + j * f->bsize, rulemap[i].to,
+					  rulemap[i].n, f->rules);
+
+		rules = f->rules - rulemap[i].n;
+		memmove(f->mt + rulemap[i].to,
+			f->mt + rulemap[i].to + rulemap[i].n,
+			(rules - rulemap[i].to) * sizeof(*f->mt));
+
+		if (i < m->field_count - 1) {
+			for (j = 0; j < rules; j++) {
+				if (f->mt[j].to > rulemap[i + 1].to)
+					f->mt[j].to -= rulemap[i + 1].n;
+			}
+		}
+
+		/* On allocation failure the larger tables are simply kept */
+		pipapo_resize(f, f->rules, rules);
+		f->rules = rules;
+	}
+}
+
+static void nft_pipapo_remove(const struct net *net, const struct nft_set *set,
+			      const struct nft_set_elem *elem)
+{
+	struct nft_pipapo *priv = nft_set_priv(set);
+	struct nft_pipapo_rulemap rulemap[NFT_PIPAPO_MAX_FIELDS];
+	struct nft_pipapo_match *m = priv->clone;
+
+	if (WARN_ON_ONCE(!m))
+		return;
+
+	if (pipapo_rulemap(m, elem->priv, rulemap))
+		return;
+
+	pipapo_drop(m, rulemap);
+	priv->dirty = true;
+}
+
+static void nft_pipapo_activate(const struct net *net,
+				const struct nft_set *set,
+				const struct nft_set_elem *elem)
+{
+	struct nft_pipapo_elem *e = elem->priv;
+
+	nft_set_elem_change_active(net, set, &e->ext);
+}
+
+static bool nft_pipapo_flush(const struct net *net, const struct nft_set *set,
+			     void *elem)
+{
+	struct nft_pipapo_elem *e = elem;
+
+	nft_set_elem_change_active(net, set, &e->ext);
+	return true;
+}
+
+static void *nft_pipapo_deactivate(const struct net *net,
+				   const struct nft_set *set,
+				   const struct nft_set_elem *elem)
+{
+	const struct nft_set_ext *ext = nft_set_elem_ext(set, elem->priv);
+	struct nft_pipapo_match *m = pipapo_maybe_clone(set);
+	const u8 *start, *end;
+	struct nft_pipapo_elem *e;
+
+	if (!m)
+		return NULL;
+
+	start = (const u8 *)nft_set_ext_key(ext)->data;
+	if (nft_set_ext_exists(ext, NFT_SET_EXT_KEY_END))
+		end = (const u8 *)nft_set_ext_key_end(ext)->data;
+	else
+		end = start;
+
+	e = pipapo_get(set, m, start, end, nft_genmask_next(net));
+	if (IS_ERR_OR_NULL(e))
+		return NULL;
+
+	nft_pipapo_flush(net, set, e);
+	return e;
+}
+
+static void nft_pipapo_walk(const struct nft_ctx *ctx, struct nft_set *set,
+			    struct nft_set_iter *iter)
+{
+	struct nft_pipapo *priv = nft_set_priv(set);
+	const struct nft_pipapo_match *m;
+	const struct nft_pipapo_field *f;
+	struct nft_pipapo_elem *e;
+	struct nft_set_elem elem;
+	unsigned int r;
+
+	/* Walks on the next generation come from updates and validation,
+	 * under the nfnetlink mutex, dumps walk the current one under RCU.
+	 */
+	if (iter->genmask == nft_genmask_next(ctx->net))
+		m = pipapo_maybe_clone(set);
+	else
+		m = rcu_dereference(priv->match);
+
+	if (!m) {
+		iter->err = -ENOMEM;
+		return;
+	}
+
+	f = &m->f[m->field_count - 1];
+	for (r = 0; r < f->rules; r++) {
+		/* Rules of the same element are adjacent */
+		if (r < f->rules - 1 && f->mt[r + 1].e == f->mt[r].e)
+			continue;
+
+		if (iter->count < iter->skip)
+			goto cont;
+
+		e = f->mt[r].e;
+		if (!nft_set_elem_active(&e->ext, iter->genmask))
+			goto cont;
+
+		elem.priv = e;
+
+		iter->err = iter->fn(ctx, set, iter, &elem);
+		if (iter->err < 0)
+			return;
+cont:
+		iter->count++;
+	}
+}
+
+static void pipapo_free_fields(struct nft_pipapo_match *m)
+{
+	unsigned int i;
+
+	for (i = 0; i < m->field_count; i++) {
+		kvfree(m->f[i].lt);
+		kvfree(m->f[i].mt);
+	}
+}
+
+static void pipapo_free_match(struct nft_pipapo_match *m)
+{
+	int i;
+
+	for_each_possible_cpu(i)
+		kfree(*per_cpu_ptr(m->scratch, i));
+
+	free_percpu(m->scratch);
+	pipapo_free_fields(m);
+	kfree(m);
+}
+
+static void pipapo_reclaim_match(struct rcu_head *rcu)
+{
+	pipapo_free_match(container_of(rcu, struct nft_pipapo_match, rcu));
+}
+
+static struct nft_pipapo_match *pipapo_alloc_match(unsigned int field_count)
+{
+	struct nft_pipapo_match *m;
+
+	m = kzalloc(sizeof(*m) + field_count * sizeof(m->f[0]), GFP_KERNEL);
+	if (!m)
+		return NULL;
+
+	m->scratch = alloc_percpu(unsigned long *);
+	if (!m->scratch) {
+		kfree(m);
+		return NULL;
+	}
+
+	m->field_count = field_count;
+	return m;
+}
+
+static struct nft_pipapo_match *pipapo_clone(const struct nft_pipapo_match *old)
+{
+	const struct nft_pipapo_field *src;
+	struct nft_pipapo_field *dst;
+	struct nft_pipapo_match *new;
+	unsigned int i;
+
+	new = pipapo_alloc_match(old->field_count);
+	if (!new)
+		return NULL;
+
+	new->bsize_max = old->bsize_max;
+	if (pipapo_realloc_scratch(new, new->bsize_max))
+		goto out;
+
+	for (i = 0; i < old->field_count; i++) {
+		src = &old->f[i];
+		dst = &new->f[i];
+
+		dst->groups = src->groups;
+		if (!src->rules)
+			continue;
+
+		dst->lt = kvmalloc(src->groups * NFT_PIPAPO_BUCKETS *
+				   src->bsize * sizeof(*dst->lt), GFP_KERNEL);
+		dst->mt = kvmalloc(src->rules * sizeof(*dst->mt), GFP_KERNEL);
+		if (!dst->lt || !dst->mt)
+			goto out;
+
+		memcpy(dst->lt, src->lt, src->groups * NFT_PIPAPO_BUCKETS *
+					 src->bsize * sizeof(*dst->lt));
+		memcpy(dst->mt, src->mt, src->rules * sizeof(*dst->mt));
+		dst->rules = src->rules;
+		dst->bsize = src->bsize;
+	}
+
+	return new;
+
+out:
+	pipapo_free_match(new);
+	return NULL;
+}
+
+/* Publish the clone and start over with a fresh copy of it. If the copy
+ * can't be allocated, the next update tries again.
+ */
+static void nft_pipapo_commit(const struct nft_set *set)
+{
+	struct nft_pipapo *priv = nft_set_priv(set);
+	struct nft_pipapo_match *old;
+
+	if (!priv->dirty)
+		return;
+
+	old = rcu_dereference_protected(priv->match, true);
+	rcu_assign_pointer(priv->match, priv->clone);
+	call_rcu(&old->rcu, pipapo_reclaim_match);
+
+	priv->clone = pipapo_clone(priv->clone);
+	priv->dirty = false;
+}
+
+/* Pending changes were already reverted on the clone by the transaction
+ * rollback, a fresh copy just gets rid of the reshuffled rules.
+ */
+static void nft_pipapo_abort(const struct nft_set *set)
+{
+	struct nft_pipapo *priv = nft_set_priv(set);
+	struct nft_pipapo_match *new;
+
+	if (!priv->dirty)
+		return;
+
+	new = pipapo_clone(rcu_dereference_protected(priv->match, true));
+	if (!new)
+		return;
+
+	if (priv->clone)
+		pipapo_free_match(priv->clone);
+	priv->clone = new;
+	priv->dirty = false;
+}
+
+static unsigned int nft_pipapo_privsize(const struct nlattr * const nla[],
+					const struct nft_set_desc *desc)
+{
+	return sizeof(struct nft_pipapo);
+}
+
+static int nft_pipapo_init(const struct nft_set *set,
+			   const struct nft_set_desc *desc,
+			   const struct nlattr * const nla[])
+{
+	struct nft_pipapo *priv = nft_set_priv(set);
+	struct nft_pipapo_match *m;
+	unsigned int i;
+
+	if (desc->field_count < NFT_PIPAPO_MIN_FIELDS ||
+	    desc->field_count > NFT_PIPAPO_MAX_FIELDS)
+		return -EINVAL;
+
+	m = pipapo_alloc_match(desc->field_count);
+	if (!m)
+		return -ENOMEM;
+
+	for (i = 0; i < desc->field_count; i++) {
+		if (desc->field_len[i] > NFT_PIPAPO_MAX_BYTES) {
+			pipapo_free_match(m);
+			return -EINVAL;
+		}
+		m->f[i].groups = desc->field_len[i] * NFT_PIPAPO_GROUPS_PER_BYTE;
+	}
+
+	priv->clone = pipapo_clone(m);
+	if (!priv->clone) {
+		pipapo_free_match(m);
+		return -ENOMEM;
+	}
+
+	rcu_assign_pointer(priv->match, m);
+	priv->dirty = false;
+
+	return 0;
+}
+
+static void nft_pipapo_destroy(const struct nft_set *set)
+{
+	struct nft_pipapo *priv = nft_set_priv(set);
+	struct nft_pipapo_match *m;
+	struct nft_pipapo_field *f;
+	unsigned int r;
+
+	/* Elements are only released from the most recent copy: the clone
+	 * if there is one, as it's never behind the matching data.
+	 */
+	m = rcu_dereference_protected(priv->match, true);
+	if (priv->clone) {
+		if (m)
+			pipapo_free_match(m);
+		m = priv->clone;
+	}
+	if (!m)
+		return;
+
+	f = &m->f[m->field_count - 1];
+	for (r = 0; r < f->rules; r++) {
+		if (r < f->rules - 1 && f->mt[r + 1].e == f->mt[r].e)
+			continue;
+
+		nft_set_elem_destroy(set, f->mt[r].e, true);
+	}
+
+	pipapo_free_match(m);
+}
+
+static bool nft_pipapo_estimate(const struct nft_set_desc *desc, u32 features,
+				struct nft_set_estimate *est)
+{
+	u64 entry_size = 0;
+	unsigned int i;
+
+	if (!(features & NFT_SET_INTERVAL) ||
+	    desc->field_count < NFT_PIPAPO_MIN_FIELDS ||
+	    desc->field_count > NFT_PIPAPO_MAX_FIELDS)
+		return false;
+
+	for (i = 0; i < desc->field_count; i++) {
+		unsigned int bits = desc->field_len[i] * BITS_PER_BYTE;
+
+		if (desc->field_len[i] > NFT_PIPAPO_MAX_BYTES)
+			return false;
+
+		/* A range of n bits expands to at most 2 * n netmasks, and
+		 * each of them takes one bit in all the buckets of the field
+		 * and one mapping bucket.
+		 */
+		entry_size += bits * 2 *
+			      (bits / NFT_PIPAPO_GROUP_BITS *
+			       NFT_PIPAPO_BUCKETS / BITS_PER_BYTE +
+			       sizeof(union nft_pipapo_map_bucket));
+	}
+
+	/* The clone doubles the footprint */
+	if (desc->size)
+		est->size = min_t(u64, sizeof(struct nft_pipapo) +
+				       desc->size * entry_size * 2, UINT_MAX);
+	else
+		est->size = ~0;
+
+	est->lookup = NFT_SET_CLASS_O_LOG_N;
+	est->space  = NFT_SET_CLASS_O_N;
+
+	return true;
+}
+
+static struct nft_set_type nft_pipapo_type;
+static struct nft_set_ops nft_pipapo_ops __read_mostly = {
+	.type		= &nft_pipapo_type,
+	.privsize	= nft_pipapo_privsize,
+	.elemsize	= offsetof(struct nft_pipapo_elem, ext),
+	.estimate	= nft_pipapo_estimate,
+	.init		= nft_pipapo_init,
+	.destroy	= nft_pipapo_destroy,
+	.insert		= nft_pipapo_insert,
+	.remove		= nft_pipapo_remove,
+	.deactivate	= nft_pipapo_deactivate,
+	.flush		= nft_pipapo_flush,
+	.activate	= nft_pipapo_activate,
+	.commit		= nft_pipapo_commit,
+	.abort		= nft_pipapo_abort,
+	.lookup		= nft_pipapo_lookup,
+	.walk		= nft_pipapo_walk,
+	.features	= NFT_SET_INTERVAL | NFT_SET_MAP | NFT_SET_OBJECT,
+};
+
+static struct nft_set_type nft_pipapo_type __read_mostly = {
+	.ops		= &nft_pipapo_ops,
+	.owner		= THIS_MODULE,
+};
+
+static int __init nft_pipapo_module_init(void)
+{
+	return nft_register_set(&nft_pipapo_type);
+}
+
+static void __exit nft_pipapo_module_exit(void)
+{
+	nft_unregister_set(&nft_pipapo_type);
+}
+
+module_init(nft_pipapo_module_init);
+module_exit(nft_pipapo_module_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_ALIAS_NFT_SET();
@@ -107,26 +107,39 @@ int __tcf_idr_release(struct tc_action *p, bool bind, bool strict)
 }
 EXPORT_SYMBOL(__tcf_idr_release);
 
+/* The totals reported by a delta dump, stored once the entry fits */
+struct tcf_action_poll {
+	struct gnet_stats_basic_packed	bstats;
+	struct gnet_stats_queue		qstats;
+};
+
+static int __tcf_action_dump_1(struct sk_buff *skb, struct tc_action *a,
+			       int bind, int ref, struct tcf_action_poll *poll);
+
+/* Actions are only freed under RTNL, which the dump holds, so walking the
+ * idr under RCU is enough and the idr lock is not held while the messages
+ * are built. cb->args[0] is the index to resume from: every part of a
+ * large dump starts where the previous one stopped instead of skipping
+ * over all the entries already dumped.
+ */
 static int tcf_dump_walker(struct tcf_idrinfo *idrinfo, struct sk_buff *skb,
 			   struct netlink_callback *cb)
 {
-	int err = 0, index = -1, s_i = 0, n_i = 0;
+	int err = 0, n_i = 0;
 	u32 act_flags = cb->args[2];
 	unsigned long jiffy_since = cb->args[3];
+	struct tcf_action_poll poll, *pollp = NULL;
 	struct nlattr *nest;
 	struct idr *idr = &idrinfo->action_idr;
 	struct tc_action *p;
-	unsigned long id = 1;
+	unsigned long id;
 
-	spin_lock_bh(&idrinfo->lock);
-
-	s_i = cb->args[0];
+	if (act_flags & TCA_FLAG_STATS_DELTA)
+		pollp = &poll;
 
-	idr_for_each_entry_ext(idr, p, id) {
-		index++;
-		if (index < s_i)
-			continue;
+	rcu_read_lock();
 
+	for (id = cb->args[0]; (p = idr_get_next_ext(idr, &id)) != NULL; id++) {
 		if (jiffy_since &&
 		    time_after(jiffy_since,
 			       (unsigned long)p->tcfa_tm.lastuse))
@@ -135,23 +148,28 @@ static int tcf_dump_walker(struct tcf_idrinfo *idrinfo, struct sk_buff *skb,
 		nest = nla_nest_start(skb, n_i);
 		if (!nest)
 			goto nla_put_failure;
-		err = tcf_action_dump_1(skb, p, 0, 0);
+		err = __tcf_action_dump_1(skb, p, 0, 0, pollp);
 		if (err < 0) {
-			index--;
 			nlmsg_trim(skb, nest);
 			goto done;
 		}
 		nla_nest_end(skb, nest);
+		/* the entry is retried in the next part if it did not fit */
+		if (pollp) {
+			p->tcfa_bstats_polled = poll.bstats;
+			p->tcfa_qstats_polled = poll.qstats;
+		}
 		n_i++;
 		if (!(act_flags & TCA_FLAG_LARGE_DUMP_ON) &&
-		    n_i >= TCA_ACT_MAX_PRIO)
+		    n_i >= TCA_ACT_MAX_PRIO) {
+			id++;
 			goto done;
+		}
 	}
 done:
-	if (index >= 0)
-		cb->args[0] = index + 1;
+	cb->args[0] = id;
 
-	spin_unlock_bh(&idrinfo->lock);
+	rcu_read_unlock();
 	if (n_i) {
 		if (act_flags & TCA_FLAG_LARGE_DUMP_ON)
 			cb->args[1] = n_i;
@@ -537,8 +555,12 @@ tcf_action_dump_old(struct sk_buff *skb, struct tc_action *a, int bind, int ref)
 	return a->ops->dump(skb, a, bind, ref);
 }
 
-int
-tcf_action_dump_1(struct sk_buff *skb, struct tc_action *a, int bind, int ref)
+static int __tcf_action_copy_stats(struct sk_buff *skb, struct tc_action *p,
+				   int compat_mode,
+				   struct tcf_action_poll *poll);
+
+static int __tcf_action_dump_1(struct sk_buff *skb, struct tc_action *a,
+			       int bind, int ref, struct tcf_action_poll *poll)
 {
 	int err = -EINVAL;
 	unsigned char *b = skb_tail_pointer(skb);
@@ -546,7 +568,7 @@ tcf_action_dump_1(struct sk_buff *skb, struct tc_action *a, int bind, int ref)
 
 	if (nla_put_string(skb, TCA_KIND, a->ops->kind))
 		goto nla_put_failure;
-	if (tcf_action_copy_stats(skb, a, 0))
+	if (__tcf_action_copy_stats(skb, a, 0, poll))
 		goto nla_put_failure;
 	if (a->act_cookie) {
 		if (nla_put(skb, TCA_ACT_COOKIE, a->act_cookie->len,
@@ -567,6 +589,12 @@ tcf_action_dump_1(struct sk_buff *skb, struct tc_action *a, int bind, int ref)
 	nlmsg_trim(skb, b);
 	return -1;
 }
+
+int
+tcf_action_dump_1(struct sk_buff *skb, struct tc_action *a, int bind, int ref)
+{
+	return __tcf_action_dump_1(skb, a, bind, ref, NULL);
+}
 EXPORT_SYMBOL(tcf_action_dump_1);
 
 int tcf_action_dump(struct sk_buff *skb, struct list_head *actions,
@@ -768,9 +796,40 @@ int tcf_action_init(struct net *net, struct tcf_proto *tp, struct nlattr *nla,
 	return err;
 }
 
-int tcf_action_copy_stats(struct sk_buff *skb, struct tc_action *p,
-			  int compat_mode)
+/* Turn the totals of p into what it did since the previous delta dump.
+ * The current totals are returned in @poll, for the caller to store in
+ * p once the entry made it into the message.
+ */
+static void tcf_action_stats_since_poll(struct tc_action *p,
+					struct gnet_stats_basic_packed *bstats,
+					struct gnet_stats_queue *qstats,
+					struct tcf_action_poll *poll)
+{
+	struct gnet_stats_basic_packed *bpoll = &p->tcfa_bstats_polled;
+	struct gnet_stats_queue *qpoll = &p->tcfa_qstats_polled;
+	struct gnet_stats_basic_packed *bnow = &poll->bstats;
+	struct gnet_stats_queue *qnow = &poll->qstats;
+
+	memset(poll, 0, sizeof(*poll));
+	__gnet_stats_copy_basic(NULL, bnow, p->cpu_bstats, &p->tcfa_bstats);
+	__gnet_stats_copy_queue(qnow, p->cpu_qstats, &p->tcfa_qstats,
+				p->tcfa_qstats.qlen);
+
+	bstats->bytes = bnow->bytes - bpoll->bytes;
+	bstats->packets = bnow->packets - bpoll->packets;
+	qstats->qlen = qnow->qlen;
+	qstats->backlog = qnow->backlog;
+	qstats->drops = qnow->drops - qpoll->drops;
+	qstats->requeues = qnow->requeues - qpoll->requeues;
+	qstats->overlimits = qnow->overlimits - qpoll->overlimits;
+}
+
+static int __tcf_action_copy_stats(struct sk_buff *skb, struct tc_action *p,
+				   int compat_mode,
+				   struct tcf_action_poll *poll)
 {
+	struct gnet_stats_basic_packed bstats;
+	struct gnet_stats_queue qstats;
 	int err = 0;
 	struct gnet_dump d;
 
@@ -796,12 +855,20 @@ int tcf_action_copy_stats(struct sk_buff *skb, struct tc_action *p,
 	if (err < 0)
 		goto errout;
 
-	if (gnet_stats_copy_basic(NULL, &d, p->cpu_bstats, &p->tcfa_bstats) < 0 ||
-	    gnet_stats_copy_rate_est(&d, &p->tcfa_rate_est) < 0 ||
-	    gnet_stats_copy_queue(&d, p->cpu_qstats,
-				  &p->tcfa_qstats,
-				  p->tcfa_qstats.qlen) < 0)
+	if (poll) {
+		tcf_action_stats_since_poll(p, &bstats, &qstats, poll);
+		if (gnet_stats_copy_basic(NULL, &d, NULL, &bstats) < 0 ||
+		    gnet_stats_copy_rate_est(&d, &p->tcfa_rate_est) < 0 ||
+		    gnet_stats_copy_queue(&d, NULL, &qstats, qstats.qlen) < 0)
+			goto errout;
+	} else if (gnet_stats_copy_basic(NULL, &d, p->cpu_bstats,
+					 &p->tcfa_bstats) < 0 ||
+		   gnet_stats_copy_rate_est(&d, &p->tcfa_rate_est) < 0 ||
+		   gnet_stats_copy_queue(&d, p->cpu_qstats,
+					 &p->tcfa_qstats,
+					 p->tcfa_qstats.qlen) < 0) {
 		goto errout;
+	}
 
 	if (gnet_stats_finish_copy(&d) < 0)
 		goto errout;
@@ -812,6 +879,12 @@ int tcf_action_copy_stats(struct sk_buff *skb, struct tc_action *p,
 	return -1;
 }
 
+int tcf_action_copy_stats(struct sk_buff *skb, struct tc_action *p,
+			  int compat_mode)
+{
+	return __tcf_action_copy_stats(skb, p, compat_mode, NULL);
+}
+
 static int tca_get_fill(struct sk_buff *skb, struct list_head *actions,
 			u32 portid, u32 seq, u16 flags, int event, int bind,
 			int ref)
@@ -1080,7 +1153,8 @@ static int tcf_action_add(struct net *net, struct nlattr *nla,
 	return tcf_add_notify(net, n, &actions, portid);
 }
 
-static u32 tcaa_root_flags_allowed = TCA_FLAG_LARGE_DUMP_ON;
+static u32 tcaa_root_flags_allowed = TCA_FLAG_LARGE_DUMP_ON |
+				      TCA_FLAG_STATS_DELTA;
 static const struct nla_policy tcaa_policy[TCA_ROOT_MAX + 1] = {
 	[TCA_ROOT_FLAGS] = { .type = NLA_BITFIELD32,
 			     .validation_data = &tcaa_root_flags_allowed },
@@ -44,7 +44,7 @@ static int tcf_connmark(struct sk_buff *skb, const struct tc_action *a,
 
 	spin_lock(&ca->tcf_lock);
 	tcf_lastuse_update(&ca->tcf_tm);
-	bstats_update(&ca->tcf_bstats, skb);
+	tcf_action_update_bstats(&ca->common, skb);
 
 	if (skb->protocol == htons(ETH_P_IP)) {
 		if (skb->len < sizeof(struct iphdr))
@@ -64,7 +64,7 @@ static int tcf_connmark(struct sk_buff *skb, const struct tc_action *a,
 	if (c) {
 		skb->mark = c->mark;
 		/* using overlimits stats to count how many packets marked */
-		ca->tcf_qstats.overlimits++;
+		tcf_action_inc_overlimit_qstats(&ca->common);
 		goto out;
 	}
 
@@ -81,7 +81,7 @@ static int tcf_connmark(struct sk_buff *skb, const struct tc_action *a,
 
 	c = nf_ct_tuplehash_to_ctrack(thash);
 	/* using overlimits stats to count how many packets marked */
-	ca->tcf_qstats.overlimits++;
+	tcf_action_inc_overlimit_qstats(&ca->common);
 	skb->mark = c->mark;
 	nf_ct_put(c);
 
@@ -119,7 +119,7 @@ static int tcf_connmark_init(struct net *net, struct nlattr *nla,
 
 	if (!tcf_idr_check(tn, parm->index, a, bind)) {
 		ret = tcf_idr_create(tn, parm->index, est, a,
-				     &act_connmark_ops, bind, false);
+				     &act_connmark_ops, bind, true);
 		if (ret)
 			return ret;
 
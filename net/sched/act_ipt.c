@@ -135,7 +135,7 @@ static int __tcf_ipt_init(struct net *net, unsigned int id, struct nlattr *nla,
 
 	if (!exists) {
 		ret = tcf_idr_create(tn, index, est, a, ops, bind,
-				     false);
+				     true);
 		if (ret)
 			return ret;
 		ret = ACT_P_CREATED;
@@ -226,7 +226,7 @@ static int tcf_ipt(struct sk_buff *skb, const struct tc_action *a,
 	spin_lock(&ipt->tcf_lock);
 
 	tcf_lastuse_update(&ipt->tcf_tm);
-	bstats_update(&ipt->tcf_bstats, skb);
+	tcf_action_update_bstats(&ipt->common, skb);
 
 	/* yes, we have to worry about both in and out dev
 	 * worry later - danger - this API seems to have changed
@@ -243,7 +243,7 @@ static int tcf_ipt(struct sk_buff *skb, const struct tc_action *a,
 		break;
 	case NF_DROP:
 		result = TC_ACT_SHOT;
-		ipt->tcf_qstats.drops++;
+		tcf_action_inc_drop_qstats(&ipt->common);
 		break;
 	case XT_CONTINUE:
 		result = TC_ACT_PIPE;
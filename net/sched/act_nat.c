@@ -58,7 +58,7 @@ static int tcf_nat_init(struct net *net, struct nlattr *nla, struct nlattr *est,
 
 	if (!tcf_idr_check(tn, parm->index, a, bind)) {
 		ret = tcf_idr_create(tn, parm->index, est, a,
-				     &act_nat_ops, bind, false);
+				     &act_nat_ops, bind, true);
 		if (ret)
 			return ret;
 		ret = ACT_P_CREATED;
@@ -109,7 +109,7 @@ static int tcf_nat(struct sk_buff *skb, const struct tc_action *a,
 	egress = p->flags & TCA_NAT_FLAG_EGRESS;
 	action = p->tcf_action;
 
-	bstats_update(&p->tcf_bstats, skb);
+	tcf_action_update_bstats(&p->common, skb);
 
 	spin_unlock(&p->tcf_lock);
 
@@ -237,9 +237,7 @@ static int tcf_nat(struct sk_buff *skb, const struct tc_action *a,
 	return action;
 
 drop:
-	spin_lock(&p->tcf_lock);
-	p->tcf_qstats.drops++;
-	spin_unlock(&p->tcf_lock);
+	tcf_action_inc_drop_qstats(&p->common);
 	return TC_ACT_SHOT;
 }
 
@@ -170,7 +170,7 @@ static int tcf_pedit_init(struct net *net, struct nlattr *nla,
 		if (!parm->nkeys)
 			return -EINVAL;
 		ret = tcf_idr_create(tn, parm->index, est, a,
-				     &act_pedit_ops, bind, false);
+				     &act_pedit_ops, bind, true);
 		if (ret)
 			return ret;
 		p = to_pedit(*a);
@@ -362,9 +362,9 @@ static int tcf_pedit(struct sk_buff *skb, const struct tc_action *a,
 		WARN(1, "pedit BUG: index %d\n", p->tcf_index);
 
 bad:
-	p->tcf_qstats.overlimits++;
+	tcf_action_inc_overlimit_qstats(&p->common);
 done:
-	bstats_update(&p->tcf_bstats, skb);
+	tcf_action_update_bstats(&p->common, skb);
 	spin_unlock(&p->tcf_lock);
 	return p->tcf_action;
 }
@@ -105,7 +105,7 @@ static int tcf_act_police_init(struct net *net, struct nlattr *nla,
 
 	if (!exists) {
 		ret = tcf_idr_create(tn, parm->index, NULL, a,
-				     &act_police_ops, bind, false);
+				     &act_police_ops, bind, true);
 		if (ret)
 			return ret;
 		ret = ACT_P_CREATED;
@@ -131,7 +131,8 @@ static int tcf_act_police_init(struct net *net, struct nlattr *nla,
 	}
 
 	if (est) {
-		err = gen_replace_estimator(&police->tcf_bstats, NULL,
+		err = gen_replace_estimator(&police->tcf_bstats,
+					    police->common.cpu_bstats,
 					    &police->tcf_rate_est,
 					    &police->tcf_lock,
 					    NULL, est);
@@ -208,7 +209,7 @@ static int tcf_act_police(struct sk_buff *skb, const struct tc_action *a,
 
 	spin_lock(&police->tcf_lock);
 
-	bstats_update(&police->tcf_bstats, skb);
+	tcf_action_update_bstats(&police->common, skb);
 	tcf_lastuse_update(&police->tcf_tm);
 
 	if (police->tcfp_ewma_rate) {
@@ -216,9 +217,9 @@ static int tcf_act_police(struct sk_buff *skb, const struct tc_action *a,
 
 		if (!gen_estimator_read(&police->tcf_rate_est, &sample) ||
 		    sample.bps >= police->tcfp_ewma_rate) {
-			police->tcf_qstats.overlimits++;
+			tcf_action_inc_overlimit_qstats(&police->common);
 			if (police->tcf_action == TC_ACT_SHOT)
-				police->tcf_qstats.drops++;
+				tcf_action_inc_drop_qstats(&police->common);
 			spin_unlock(&police->tcf_lock);
 			return police->tcf_action;
 		}
@@ -249,15 +250,15 @@ static int tcf_act_police(struct sk_buff *skb, const struct tc_action *a,
 			police->tcfp_toks = toks;
 			police->tcfp_ptoks = ptoks;
 			if (police->tcfp_result == TC_ACT_SHOT)
-				police->tcf_qstats.drops++;
+				tcf_action_inc_drop_qstats(&police->common);
 			spin_unlock(&police->tcf_lock);
 			return police->tcfp_result;
 		}
 	}
 
-	police->tcf_qstats.overlimits++;
+	tcf_action_inc_overlimit_qstats(&police->common);
 	if (police->tcf_action == TC_ACT_SHOT)
-		police->tcf_qstats.drops++;
+		tcf_action_inc_drop_qstats(&police->common);
 	spin_unlock(&police->tcf_lock);
 	return police->tcf_action;
 }
@@ -22,6 +22,10 @@
  *  bunch of packets, and this packet scheduler adds delay between
  *  packets to respect rate limitation.
  *
+ *  Transports using the Earliest Departure Time model (eg TCP) instead set
+ *  skb->tstamp (CLOCK_MONOTONIC) to the time a packet may leave the host,
+ *  and this packet scheduler holds the packet until then.
+ *
  *  enqueue() :
  *   - lookup one RB tree (out of 1024 or more) to find the flow.
  *     If non existent flow, create it, add it to the tree.
@@ -478,11 +482,16 @@ static struct sk_buff *fq_dequeue(struct Qdisc *sch)
 	}
 
 	skb = f->head;
-	if (unlikely(skb && now < f->time_next_packet &&
-		     !skb_is_tcp_pure_ack(skb))) {
-		head->first = f->next;
-		fq_flow_set_throttled(q, f);
-		goto begin;
+	if (skb && !skb_is_tcp_pure_ack(skb)) {
+		u64 time_next_packet = max_t(u64, ktime_to_ns(skb->tstamp),
+					     f->time_next_packet);
+
+		if (now < time_next_packet) {
+			head->first = f->next;
+			f->time_next_packet = time_next_packet;
+			fq_flow_set_throttled(q, f);
+			goto begin;
+		}
 	}
 
 	skb = fq_dequeue_head(sch, f);
@@ -508,16 +517,23 @@ static struct sk_buff *fq_dequeue(struct Qdisc *sch)
 		goto out;
 
 	rate = q->flow_max_rate;
-	if (skb->sk)
-		rate = min(skb->sk->sk_pacing_rate, rate);
+	plen = qdisc_pkt_len(skb);
 
-	if (rate <= q->low_rate_threshold) {
-		f->credit = 0;
-		plen = qdisc_pkt_len(skb);
-	} else {
-		plen = max(qdisc_pkt_len(skb), q->quantum);
-		if (f->credit > 0)
-			goto out;
+	/* If an earliest departure time was provided for this skb, the
+	 * sender already paced it and f->time_next_packet only needs an
+	 * update when this qdisc enforces a flow max rate.
+	 */
+	if (!skb->tstamp) {
+		if (skb->sk)
+			rate = min(skb->sk->sk_pacing_rate, rate);
+
+		if (rate <= q->low_rate_threshold) {
+			f->credit = 0;
+		} else {
+			plen = max(plen, q->quantum);
+			if (f->credit > 0)
+				goto out;
+		}
 	}
 	if (rate != ~0U) {
 		u64 len = (u64)plen * NSEC_PER_SEC;
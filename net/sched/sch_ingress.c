@@ -64,7 +64,6 @@ static int ingress_init(struct Qdisc *sch, struct nlattr *opt)
 		return err;
 
 	net_inc_ingress_queue();
-	sch->flags |= TCQ_F_CPUSTATS;
 
 	return 0;
 }
@@ -109,6 +108,7 @@ static struct Qdisc_ops ingress_qdisc_ops __read_mostly = {
 	.destroy	=	ingress_destroy,
 	.dump		=	ingress_dump,
 	.owner		=	THIS_MODULE,
+	.static_flags	=	TCQ_F_CPUSTATS,
 };
 
 struct clsact_sched_data {
@@ -164,8 +164,6 @@ static int clsact_init(struct Qdisc *sch, struct nlattr *opt)
 	net_inc_ingress_queue();
 	net_inc_egress_queue();
 
-	sch->flags |= TCQ_F_CPUSTATS;
-
 	return 0;
 }
 
@@ -197,6 +195,7 @@ static struct Qdisc_ops clsact_qdisc_ops __read_mostly = {
 	.destroy	=	clsact_destroy,
 	.dump		=	ingress_dump,
 	.owner		=	THIS_MODULE,
+	.static_flags	=	TCQ_F_CPUSTATS,
 };
 
 static int __init ingress_module_init(void)
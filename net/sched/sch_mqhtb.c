@@ -0,0 +1,936 @@
+/*
+ * net/sched/sch_mqhtb.c	Multi-queue hierarchical token bucket
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/module.h>
+#include <linux/types.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/errno.h>
+#include <linux/skbuff.h>
+#include <linux/slab.h>
+#include <linux/atomic.h>
+#include <net/netlink.h>
+#include <net/sch_generic.h>
+#include <net/pkt_sched.h>
+#include <net/pkt_cls.h>
+
+/* Like mq, the root leaves every TX queue its own qdisc and never sees a
+ * packet itself. A leaf class is pinned to a TX queue, whose qdisc is then
+ * replaced by an mqhtb_txq one: it holds the leaf's own queue and only
+ * lets packets out when the token buckets of the leaf and its ancestors
+ * allow it.
+ *
+ * Each class has a rate and a ceil bucket, both kept as the time at which
+ * the bucket would hold no tokens (GCRA). Sending a packet moves that time
+ * by its transmission time, so charging a bucket is a single cmpxchg and
+ * the buckets of inner classes are shared by all the TX queues below them
+ * without a lock. As in HTB, a class may send while it is under its rate,
+ * or borrow from the closest ancestor under its rate as long as it and
+ * every class in between are under their ceil. The rate bucket is charged
+ * from that lender up, the ceil bucket of every class on the way.
+ *
+ * With TCA_HTB_OFFLOAD the hierarchy is handed to the device through
+ * ndo_setup_tc() and the TX queue qdiscs do no shaping at all.
+ */
+
+/* max debt of a bucket */
+#define MQHTB_MBUFFER	(60ULL * NSEC_PER_SEC)
+
+struct mqhtb_params {
+	struct psched_ratecfg	rate;
+	struct psched_ratecfg	ceil;
+	s64			buffer;
+	s64			cbuffer;
+	struct rcu_head		rcu;
+};
+
+struct mqhtb_class {
+	struct Qdisc_class_common common;
+	struct mqhtb_params __rcu *params;
+	struct mqhtb_class	*parent;
+	unsigned int		children;
+	int			depth;		/* 0 at the top level */
+	int			txq;		/* -1 for inner classes */
+	struct Qdisc		*txq_sch;	/* leaf: qdisc of txq */
+	struct gnet_stats_basic_cpu __percpu *bstats;
+
+	/* written by every TX queue below the class */
+	atomic64_t		tat ____cacheline_aligned_in_smp;
+	atomic64_t		ctat;
+};
+
+struct mqhtb_sched {
+	struct Qdisc_class_hash	clhash;
+	struct Qdisc		**qdiscs;	/* until attached */
+	bool			offload;
+};
+
+struct mqhtb_txq {
+	struct Qdisc		*child;
+	struct mqhtb_class	*leaf;
+	bool			offload;
+	u32			borrows;
+	struct qdisc_watchdog	watchdog;
+};
+
+static bool mqhtb_conforms(const atomic64_t *tat, s64 burst, s64 now)
+{
+	return atomic64_read(tat) - burst <= now;
+}
+
+static void mqhtb_charge(atomic64_t *tat, s64 cost, s64 now)
+{
+	s64 old, new;
+
+	do {
+		old = atomic64_read(tat);
+		new = max(old, now) + cost;
+		new = min_t(s64, new, now + MQHTB_MBUFFER);
+	} while (atomic64_cmpxchg(tat, old, new) != old);
+}
+
+/* Closest class from the leaf up that may lend to it, NULL if it has to
+ * wait. Called under rcu_read_lock().
+ */
+static struct mqhtb_class *mqhtb_lender(struct mqhtb_class *leaf, s64 now)
+{
+	struct mqhtb_params *p;
+	struct mqhtb_class *cl;
+
+	for (cl = leaf; cl; cl = cl->parent) {
+		p = rcu_dereference(cl->params);
+		if (!mqhtb_conforms(&cl->ctat, p->cbuffer, now))
+			return NULL;
+		if (mqhtb_conforms(&cl->tat, p->buffer, now))
+			return cl;
+	}
+	return NULL;
+}
+
+/* Earliest time the leaf may send again, if nothing else sends first */
+static s64 mqhtb_next_send(struct mqhtb_class *leaf)
+{
+	s64 ceil_ready = S64_MIN, next = S64_MAX;
+	struct mqhtb_params *p;
+	struct mqhtb_class *cl;
+
+	for (cl = leaf; cl; cl = cl->parent) {
+		p = rcu_dereference(cl->params);
+		ceil_ready = max(ceil_ready,
+				 (s64)atomic64_read(&cl->ctat) - p->cbuffer);
+		next = min(next, max(ceil_ready,
+				     (s64)atomic64_read(&cl->tat) - p->buffer));
+	}
+	return next;
+}
+
+static void mqhtb_charge_class(struct mqhtb_class *leaf,
+			       struct mqhtb_class *lender,
+			       struct sk_buff *skb, s64 now)
+{
+	unsigned int len = qdisc_pkt_len(skb);
+	bool lent = false;
+	struct mqhtb_params *p;
+	struct mqhtb_class *cl;
+
+	for (cl = leaf; cl; cl = cl->parent) {
+		p = rcu_dereference(cl->params);
+		if (cl == lender)
+			lent = true;
+		if (lent)
+			mqhtb_charge(&cl->tat, psched_l2t_ns(&p->rate, len),
+				     now);
+		mqhtb_charge(&cl->ctat, psched_l2t_ns(&p->ceil, len), now);
+		bstats_cpu_update(this_cpu_ptr(cl->bstats), skb);
+	}
+}
+
+/* TX queue qdisc of a leaf class */
+
+static void mqhtb_txq_sync(struct Qdisc *sch)
+{
+	struct mqhtb_txq *q = qdisc_priv(sch);
+
+	sch->q.qlen = q->child->q.qlen;
+	sch->qstats.backlog = q->child->qstats.backlog;
+}
+
+static int mqhtb_txq_enqueue(struct sk_buff *skb, struct Qdisc *sch,
+			     struct sk_buff **to_free)
+{
+	struct mqhtb_txq *q = qdisc_priv(sch);
+	int ret;
+
+	ret = qdisc_enqueue(skb, q->child, to_free);
+	if (ret != NET_XMIT_SUCCESS) {
+		if (net_xmit_drop_count(ret))
+			qdisc_qstats_drop(sch);
+		return ret;
+	}
+
+	mqhtb_txq_sync(sch);
+	return NET_XMIT_SUCCESS;
+}
+
+static struct sk_buff *mqhtb_txq_dequeue(struct Qdisc *sch)
+{
+	struct mqhtb_txq *q = qdisc_priv(sch);
+	struct mqhtb_class *lender;
+	struct sk_buff *skb;
+	s64 now;
+
+	skb = q->child->ops->peek(q->child);
+	if (!skb)
+		return NULL;
+
+	if (q->offload) {
+		skb = qdisc_dequeue_peeked(q->child);
+		goto out;
+	}
+
+	now = ktime_get_ns();
+	rcu_read_lock();
+	lender = mqhtb_lender(q->leaf, now);
+	if (!lender) {
+		qdisc_watchdog_schedule_ns(&q->watchdog,
+					   mqhtb_next_send(q->leaf));
+		rcu_read_unlock();
+		qdisc_qstats_overlimit(sch);
+		return NULL;
+	}
+
+	skb = qdisc_dequeue_peeked(q->child);
+	if (skb) {
+		if (lender != q->leaf)
+			q->borrows++;
+		mqhtb_charge_class(q->leaf, lender, skb, now);
+	}
+	rcu_read_unlock();
+out:
+	if (skb) {
+		qdisc_bstats_update(sch, skb);
+		mqhtb_txq_sync(sch);
+	}
+	return skb;
+}
+
+static int mqhtb_txq_init(struct Qdisc *sch, struct nlattr *opt)
+{
+	struct mqhtb_txq *q = qdisc_priv(sch);
+
+	qdisc_watchdog_init(&q->watchdog, sch);
+	q->child = &noop_qdisc;
+	return 0;
+}
+
+static void mqhtb_txq_reset(struct Qdisc *sch)
+{
+	struct mqhtb_txq *q = qdisc_priv(sch);
+
+	qdisc_reset(q->child);
+	sch->q.qlen = 0;
+	sch->qstats.backlog = 0;
+	qdisc_watchdog_cancel(&q->watchdog);
+}
+
+/* The leaf may already be gone when the root is replaced, do not touch it */
+static void mqhtb_txq_destroy(struct Qdisc *sch)
+{
+	struct mqhtb_txq *q = qdisc_priv(sch);
+
+	qdisc_watchdog_cancel(&q->watchdog);
+	qdisc_destroy(q->child);
+}
+
+static struct Qdisc_ops mqhtb_txq_qdisc_ops __read_mostly = {
+	.id		=	"mqhtb_txq",
+	.priv_size	=	sizeof(struct mqhtb_txq),
+	.enqueue	=	mqhtb_txq_enqueue,
+	.dequeue	=	mqhtb_txq_dequeue,
+	.peek		=	qdisc_peek_dequeued,
+	.init		=	mqhtb_txq_init,
+	.reset		=	mqhtb_txq_reset,
+	.destroy	=	mqhtb_txq_destroy,
+	.owner		=	THIS_MODULE,
+};
+
+/* Root */
+
+static const struct nla_policy mqhtb_policy[TCA_HTB_MAX + 1] = {
+	[TCA_HTB_PARMS]	= { .len = sizeof(struct tc_htb_opt) },
+	[TCA_HTB_INIT]	= { .len = sizeof(struct tc_htb_glob) },
+	[TCA_HTB_CTAB]	= { .type = NLA_BINARY, .len = TC_RTAB_SIZE },
+	[TCA_HTB_RTAB]	= { .type = NLA_BINARY, .len = TC_RTAB_SIZE },
+	[TCA_HTB_RATE64] = { .type = NLA_U64 },
+	[TCA_HTB_CEIL64] = { .type = NLA_U64 },
+	[TCA_HTB_OFFLOAD] = { .type = NLA_FLAG },
+	[TCA_HTB_TXQ]	= { .type = NLA_U32 },
+};
+
+static struct mqhtb_class *mqhtb_find(u32 handle, struct Qdisc *sch)
+{
+	struct mqhtb_sched *q = qdisc_priv(sch);
+	struct Qdisc_class_common *clc;
+
+	clc = qdisc_class_find(&q->clhash, handle);
+	if (clc == NULL)
+		return NULL;
+	return container_of(clc, struct mqhtb_class, common);
+}
+
+static int mqhtb_offload(struct Qdisc *sch, enum tc_htb_command command,
+			 struct mqhtb_class *cl)
+{
+	struct net_device *dev = qdisc_dev(sch);
+	struct tc_htb_qopt_offload opt = {
+		.command	= command,
+		.handle		= sch->handle,
+		.qid		= -1,
+	};
+	struct mqhtb_params *p;
+
+	if (cl) {
+		p = rtnl_dereference(cl->params);
+		opt.classid = cl->common.classid;
+		opt.parent_classid = cl->parent ? cl->parent->common.classid :
+						  TC_H_ROOT;
+		opt.qid = cl->txq;
+		opt.rate = p->rate.rate_bytes_ps;
+		opt.ceil = p->ceil.rate_bytes_ps;
+	}
+
+	return dev->netdev_ops->ndo_setup_tc(dev, TC_SETUP_QDISC_HTB, &opt);
+}
+
+/* Put qdisc on TX queue ntx and destroy the one it replaces */
+static void mqhtb_graft_txq(struct Qdisc *sch, unsigned int ntx,
+			    struct Qdisc *qdisc)
+{
+	struct net_device *dev = qdisc_dev(sch);
+	struct Qdisc *old;
+
+	if (dev->flags & IFF_UP)
+		dev_deactivate(dev);
+
+	old = dev_graft_qdisc(netdev_get_tx_queue(dev, ntx), qdisc);
+	qdisc->flags |= TCQ_F_ONETXQUEUE | TCQ_F_NOPARENT;
+
+	if (dev->flags & IFF_UP)
+		dev_activate(dev);
+
+	if (old)
+		qdisc_destroy(old);
+}
+
+static struct Qdisc *mqhtb_create_dflt(struct Qdisc *sch, unsigned int ntx)
+{
+	struct net_device *dev = qdisc_dev(sch);
+
+	return qdisc_create_dflt(netdev_get_tx_queue(dev, ntx),
+				 get_default_qdisc_ops(dev, ntx),
+				 TC_H_MAKE(TC_H_MAJ(sch->handle),
+					   TC_H_MIN(ntx + 1)));
+}
+
+static int mqhtb_init(struct Qdisc *sch, struct nlattr *opt)
+{
+	struct net_device *dev = qdisc_dev(sch);
+	struct mqhtb_sched *q = qdisc_priv(sch);
+	struct nlattr *tb[TCA_HTB_MAX + 1];
+	struct Qdisc *qdisc;
+	unsigned int ntx;
+	int err;
+
+	if (sch->parent != TC_H_ROOT)
+		return -EOPNOTSUPP;
+
+	if (!netif_is_multiqueue(dev))
+		return -EOPNOTSUPP;
+
+	if (opt) {
+		err = nla_parse_nested(tb, TCA_HTB_MAX, opt, mqhtb_policy,
+				       NULL);
+		if (err < 0)
+			return err;
+		q->offload = nla_get_flag(tb[TCA_HTB_OFFLOAD]);
+	}
+
+	err = qdisc_class_hash_init(&q->clhash);
+	if (err < 0)
+		return err;
+
+	/* pre-allocate qdiscs, attachment can't fail */
+	q->qdiscs = kcalloc(dev->num_tx_queues, sizeof(q->qdiscs[0]),
+			    GFP_KERNEL);
+	if (!q->qdiscs)
+		return -ENOMEM;
+
+	for (ntx = 0; ntx < dev->num_tx_queues; ntx++) {
+		qdisc = mqhtb_create_dflt(sch, ntx);
+		if (!qdisc)
+			return -ENOMEM;
+		q->qdiscs[ntx] = qdisc;
+		qdisc->flags |= TCQ_F_ONETXQUEUE | TCQ_F_NOPARENT;
+	}
+
+	if (q->offload) {
+		if (!dev->netdev_ops->ndo_setup_tc)
+			return -EOPNOTSUPP;
+		err = mqhtb_offload(sch, TC_HTB_CREATE, NULL);
+		if (err) {
+			q->offload = false;
+			return err;
+		}
+	}
+
+	sch->flags |= TCQ_F_MQROOT;
+	return 0;
+}
+
+static void mqhtb_attach(struct Qdisc *sch)
+{
+	struct net_device *dev = qdisc_dev(sch);
+	struct mqhtb_sched *q = qdisc_priv(sch);
+	struct Qdisc *old;
+	unsigned int ntx;
+
+	for (ntx = 0; ntx < dev->num_tx_queues; ntx++) {
+		old = dev_graft_qdisc(q->qdiscs[ntx]->dev_queue,
+				      q->qdiscs[ntx]);
+		if (old)
+			qdisc_destroy(old);
+	}
+	kfree(q->qdiscs);
+	q->qdiscs = NULL;
+}
+
+static void mqhtb_destroy_class(struct mqhtb_class *cl)
+{
+	kfree(rcu_dereference_protected(cl->params, 1));
+	free_percpu(cl->bstats);
+	kfree(cl);
+}
+
+/* The TX queue qdiscs of the leaves are either gone already or go away
+ * with the root that replaces us.
+ */
+static void mqhtb_destroy(struct Qdisc *sch)
+{
+	struct net_device *dev = qdisc_dev(sch);
+	struct mqhtb_sched *q = qdisc_priv(sch);
+	struct hlist_node *next;
+	struct mqhtb_class *cl;
+	unsigned int ntx, i;
+
+	if (q->qdiscs) {
+		for (ntx = 0;
+		     ntx < dev->num_tx_queues && q->qdiscs[ntx]; ntx++)
+			qdisc_destroy(q->qdiscs[ntx]);
+		kfree(q->qdiscs);
+	}
+
+	for (i = 0; i < q->clhash.hashsize; i++) {
+		hlist_for_each_entry_safe(cl, next, &q->clhash.hash[i],
+					  common.hnode)
+			mqhtb_destroy_class(cl);
+	}
+	qdisc_class_hash_destroy(&q->clhash);
+
+	if (q->offload)
+		mqhtb_offload(sch, TC_HTB_DESTROY, NULL);
+}
+
+static int mqhtb_dump(struct Qdisc *sch, struct sk_buff *skb)
+{
+	struct net_device *dev = qdisc_dev(sch);
+	struct mqhtb_sched *q = qdisc_priv(sch);
+	struct tc_htb_glob gopt = {
+		.version	= TC_HTB_PROTOVER,
+		.rate2quantum	= 1,
+	};
+	struct nlattr *nest;
+	struct Qdisc *qdisc;
+	unsigned int ntx;
+	__u32 qlen;
+
+	sch->q.qlen = 0;
+	memset(&sch->bstats, 0, sizeof(sch->bstats));
+	memset(&sch->qstats, 0, sizeof(sch->qstats));
+
+	for (ntx = 0; ntx < dev->num_tx_queues; ntx++) {
+		qdisc = netdev_get_tx_queue(dev, ntx)->qdisc_sleeping;
+		spin_lock_bh(qdisc_lock(qdisc));
+
+		if (qdisc_is_percpu_stats(qdisc)) {
+			qlen = qdisc_qlen_sum(qdisc);
+			__gnet_stats_copy_basic(NULL, &sch->bstats,
+						qdisc->cpu_bstats,
+						&qdisc->bstats);
+			__gnet_stats_copy_queue(&sch->qstats,
+						qdisc->cpu_qstats,
+						&qdisc->qstats, qlen);
+			sch->q.qlen		+= qlen;
+		} else {
+			sch->q.qlen		+= qdisc->q.qlen;
+			sch->bstats.bytes	+= qdisc->bstats.bytes;
+			sch->bstats.packets	+= qdisc->bstats.packets;
+			sch->qstats.backlog	+= qdisc->qstats.backlog;
+			sch->qstats.drops	+= qdisc->qstats.drops;
+			sch->qstats.requeues	+= qdisc->qstats.requeues;
+			sch->qstats.overlimits	+= qdisc->qstats.overlimits;
+		}
+
+		spin_unlock_bh(qdisc_lock(qdisc));
+	}
+
+	nest = nla_nest_start(skb, TCA_OPTIONS);
+	if (nest == NULL)
+		goto nla_put_failure;
+	if (nla_put(skb, TCA_HTB_INIT, sizeof(gopt), &gopt))
+		goto nla_put_failure;
+	if (q->offload && nla_put_flag(skb, TCA_HTB_OFFLOAD))
+		goto nla_put_failure;
+
+	return nla_nest_end(skb, nest);
+
+nla_put_failure:
+	nla_nest_cancel(skb, nest);
+	return -1;
+}
+
+/* Classes */
+
+static unsigned long mqhtb_search(struct Qdisc *sch, u32 handle)
+{
+	return (unsigned long)mqhtb_find(handle, sch);
+}
+
+static struct netdev_queue *mqhtb_select_queue(struct Qdisc *sch,
+					       struct tcmsg *tcm)
+{
+	struct mqhtb_class *cl = mqhtb_find(tcm->tcm_parent, sch);
+	struct net_device *dev = qdisc_dev(sch);
+
+	if (!cl || cl->txq < 0)
+		return netdev_get_tx_queue(dev, 0);
+	return netdev_get_tx_queue(dev, cl->txq);
+}
+
+static int mqhtb_graft(struct Qdisc *sch, unsigned long arg,
+		       struct Qdisc *new, struct Qdisc **old)
+{
+	struct mqhtb_class *cl = (struct mqhtb_class *)arg;
+	struct mqhtb_txq *tq;
+
+	if (cl->txq < 0)
+		return -EINVAL;
+	if (new == NULL &&
+	    (new = qdisc_create_dflt(cl->txq_sch->dev_queue,
+				     &pfifo_qdisc_ops,
+				     cl->common.classid)) == NULL)
+		return -ENOBUFS;
+
+	tq = qdisc_priv(cl->txq_sch);
+	sch_tree_lock(cl->txq_sch);
+	*old = tq->child;
+	tq->child = new;
+	qdisc_reset(*old);
+	mqhtb_txq_sync(cl->txq_sch);
+	sch_tree_unlock(cl->txq_sch);
+	return 0;
+}
+
+static struct Qdisc *mqhtb_leaf(struct Qdisc *sch, unsigned long arg)
+{
+	struct mqhtb_class *cl = (struct mqhtb_class *)arg;
+	struct mqhtb_txq *tq;
+
+	if (cl->txq < 0)
+		return NULL;
+	tq = qdisc_priv(cl->txq_sch);
+	return tq->child;
+}
+
+static struct mqhtb_params *mqhtb_parse_params(struct nlattr **tb)
+{
+	struct mqhtb_params *p;
+	struct tc_htb_opt *hopt;
+	u64 rate64, ceil64;
+
+	hopt = nla_data(tb[TCA_HTB_PARMS]);
+	if (!hopt->rate.rate || !hopt->ceil.rate)
+		return ERR_PTR(-EINVAL);
+
+	/* Keeping backward compatible with rate_table based iproute2 tc */
+	if (hopt->rate.linklayer == TC_LINKLAYER_UNAWARE)
+		qdisc_put_rtab(qdisc_get_rtab(&hopt->rate, tb[TCA_HTB_RTAB]));
+
+	if (hopt->ceil.linklayer == TC_LINKLAYER_UNAWARE)
+		qdisc_put_rtab(qdisc_get_rtab(&hopt->ceil, tb[TCA_HTB_CTAB]));
+
+	p = kzalloc(sizeof(*p), GFP_KERNEL);
+	if (!p)
+		return ERR_PTR(-ENOBUFS);
+
+	rate64 = tb[TCA_HTB_RATE64] ? nla_get_u64(tb[TCA_HTB_RATE64]) : 0;
+	ceil64 = tb[TCA_HTB_CEIL64] ? nla_get_u64(tb[TCA_HTB_CEIL64]) : 0;
+
+	psched_ratecfg_precompute(&p->rate, &hopt->rate, rate64);
+	psched_ratecfg_precompute(&p->ceil, &hopt->ceil, ceil64);
+	p->buffer = PSCHED_TICKS2NS(hopt->buffer);
+	p->cbuffer = PSCHED_TICKS2NS(hopt->cbuffer);
+
+	return p;
+}
+
+/* Pin the new leaf cl to its TX queue */
+static int mqhtb_create_leaf(struct Qdisc *sch, struct mqhtb_class *cl)
+{
+	struct mqhtb_sched *q = qdisc_priv(sch);
+	struct netdev_queue *dev_queue;
+	struct mqhtb_txq *tq;
+	struct Qdisc *child;
+
+	dev_queue = netdev_get_tx_queue(qdisc_dev(sch), cl->txq);
+	cl->txq_sch = qdisc_create_dflt(dev_queue, &mqhtb_txq_qdisc_ops,
+					cl->common.classid);
+	if (!cl->txq_sch)
+		return -ENOBUFS;
+
+	child = qdisc_create_dflt(dev_queue, &pfifo_qdisc_ops,
+				  cl->common.classid);
+	if (!child) {
+		qdisc_destroy(cl->txq_sch);
+		return -ENOBUFS;
+	}
+
+	tq = qdisc_priv(cl->txq_sch);
+	tq->child = child;
+	tq->leaf = cl;
+	tq->offload = q->offload;
+
+	mqhtb_graft_txq(sch, cl->txq, cl->txq_sch);
+	qdisc_hash_add(child, true);
+	return 0;
+}
+
+static bool mqhtb_txq_busy(struct Qdisc *sch, unsigned int ntx)
+{
+	struct mqhtb_sched *q = qdisc_priv(sch);
+	struct mqhtb_class *cl;
+	unsigned int i;
+
+	for (i = 0; i < q->clhash.hashsize; i++) {
+		hlist_for_each_entry(cl, &q->clhash.hash[i], common.hnode) {
+			if (cl->txq == ntx)
+				return true;
+		}
+	}
+	return false;
+}
+
+static int mqhtb_change_class(struct Qdisc *sch, u32 classid,
+			      u32 parentid, struct nlattr **tca,
+			      unsigned long *arg)
+{
+	struct mqhtb_class *cl = (struct mqhtb_class *)*arg, *parent;
+	struct mqhtb_sched *q = qdisc_priv(sch);
+	struct nlattr *opt = tca[TCA_OPTIONS];
+	struct nlattr *tb[TCA_HTB_MAX + 1];
+	struct mqhtb_params *p, *old;
+	int txq = -1;
+	s64 now;
+	int err;
+
+	if (!opt)
+		return -EINVAL;
+	if (tca[TCA_RATE])
+		return -EOPNOTSUPP;
+
+	err = nla_parse_nested(tb, TCA_HTB_MAX, opt, mqhtb_policy, NULL);
+	if (err < 0)
+		return err;
+
+	if (tb[TCA_HTB_PARMS] == NULL)
+		return -EINVAL;
+
+	if (tb[TCA_HTB_TXQ]) {
+		if (nla_get_u32(tb[TCA_HTB_TXQ]) >=
+		    qdisc_dev(sch)->real_num_tx_queues)
+			return -EINVAL;
+		txq = nla_get_u32(tb[TCA_HTB_TXQ]);
+	}
+
+	if (cl) {
+		if (tb[TCA_HTB_TXQ] && txq != cl->txq)
+			return -EINVAL;
+
+		p = mqhtb_parse_params(tb);
+		if (IS_ERR(p))
+			return PTR_ERR(p);
+
+		old = rtnl_dereference(cl->params);
+		rcu_assign_pointer(cl->params, p);
+		if (q->offload) {
+			err = mqhtb_offload(sch, TC_HTB_NODE_MODIFY, cl);
+			if (err) {
+				rcu_assign_pointer(cl->params, old);
+				kfree_rcu(p, rcu);
+				return err;
+			}
+		}
+		kfree_rcu(old, rcu);
+		return 0;
+	}
+
+	/* new class */
+	parent = parentid == TC_H_ROOT ? NULL : mqhtb_find(parentid, sch);
+	if (parentid != TC_H_ROOT && !parent)
+		return -EINVAL;
+	if (parent && (parent->txq >= 0 ||
+		       parent->depth >= TC_HTB_MAXDEPTH - 1))
+		return -EINVAL;
+
+	/* check for valid classid */
+	if (!classid || TC_H_MAJ(classid ^ sch->handle) ||
+	    mqhtb_find(classid, sch))
+		return -EINVAL;
+
+	if (txq >= 0 && mqhtb_txq_busy(sch, txq))
+		return -EBUSY;
+
+	p = mqhtb_parse_params(tb);
+	if (IS_ERR(p))
+		return PTR_ERR(p);
+
+	err = -ENOBUFS;
+	cl = kzalloc(sizeof(*cl), GFP_KERNEL);
+	if (!cl)
+		goto err_params;
+
+	cl->bstats = netdev_alloc_pcpu_stats(struct gnet_stats_basic_cpu);
+	if (!cl->bstats)
+		goto err_class;
+
+	RCU_INIT_POINTER(cl->params, p);
+	cl->common.classid = classid;
+	cl->parent = parent;
+	cl->depth = parent ? parent->depth + 1 : 0;
+	cl->txq = txq;
+
+	/* start with full buckets */
+	now = ktime_get_ns();
+	atomic64_set(&cl->tat, now);
+	atomic64_set(&cl->ctat, now);
+
+	if (q->offload) {
+		err = mqhtb_offload(sch, TC_HTB_NODE_ADD, cl);
+		if (err)
+			goto err_stats;
+	}
+
+	if (txq >= 0) {
+		err = mqhtb_create_leaf(sch, cl);
+		if (err)
+			goto err_offload;
+	}
+
+	qdisc_class_hash_insert(&q->clhash, &cl->common);
+	if (parent)
+		parent->children++;
+	qdisc_class_hash_grow(sch, &q->clhash);
+
+	*arg = (unsigned long)cl;
+	return 0;
+
+err_offload:
+	if (q->offload)
+		mqhtb_offload(sch, TC_HTB_NODE_DEL, cl);
+err_stats:
+	free_percpu(cl->bstats);
+err_class:
+	kfree(cl);
+err_params:
+	kfree(p);
+	return err;
+}
+
+static int mqhtb_delete(struct Qdisc *sch, unsigned long arg)
+{
+	struct mqhtb_class *cl = (struct mqhtb_class *)arg;
+	struct mqhtb_sched *q = qdisc_priv(sch);
+	struct Qdisc *qdisc;
+
+	if (cl->children)
+		return -EBUSY;
+
+	/* give the TX queue back its default qdisc */
+	if (cl->txq >= 0) {
+		qdisc = mqhtb_create_dflt(sch, cl->txq);
+		if (!qdisc)
+			return -ENOBUFS;
+		mqhtb_graft_txq(sch, cl->txq, qdisc);
+	}
+
+	if (q->offload)
+		mqhtb_offload(sch, TC_HTB_NODE_DEL, cl);
+
+	qdisc_class_hash_remove(&q->clhash, &cl->common);
+	if (cl->parent)
+		cl->parent->children--;
+
+	/* No TX queue walks up through cl any more: it has no children and
+	 * the grafting of its own TX queue waited for the queue to be idle.
+	 */
+	mqhtb_destroy_class(cl);
+	return 0;
+}
+
+static int mqhtb_dump_class(struct Qdisc *sch, unsigned long arg,
+			    struct sk_buff *skb, struct tcmsg *tcm)
+{
+	struct mqhtb_class *cl = (struct mqhtb_class *)arg;
+	struct mqhtb_params *p = rtnl_dereference(cl->params);
+	struct nlattr *nest;
+	struct tc_htb_opt opt;
+
+	tcm->tcm_parent = cl->parent ? cl->parent->common.classid : TC_H_ROOT;
+	tcm->tcm_handle = cl->common.classid;
+	if (cl->txq >= 0)
+		tcm->tcm_info = mqhtb_leaf(sch, arg)->handle;
+
+	nest = nla_nest_start(skb, TCA_OPTIONS);
+	if (nest == NULL)
+		goto nla_put_failure;
+
+	memset(&opt, 0, sizeof(opt));
+
+	psched_ratecfg_getrate(&opt.rate, &p->rate);
+	opt.buffer = PSCHED_NS2TICKS(p->buffer);
+	psched_ratecfg_getrate(&opt.ceil, &p->ceil);
+	opt.cbuffer = PSCHED_NS2TICKS(p->cbuffer);
+	opt.level = cl->txq >= 0 ? 0 : TC_HTB_MAXDEPTH - 1 - cl->depth;
+	if (nla_put(skb, TCA_HTB_PARMS, sizeof(opt), &opt))
+		goto nla_put_failure;
+	if ((p->rate.rate_bytes_ps >= (1ULL << 32)) &&
+	    nla_put_u64_64bit(skb, TCA_HTB_RATE64, p->rate.rate_bytes_ps,
+			      TCA_HTB_PAD))
+		goto nla_put_failure;
+	if ((p->ceil.rate_bytes_ps >= (1ULL << 32)) &&
+	    nla_put_u64_64bit(skb, TCA_HTB_CEIL64, p->ceil.rate_bytes_ps,
+			      TCA_HTB_PAD))
+		goto nla_put_failure;
+	if (cl->txq >= 0 && nla_put_u32(skb, TCA_HTB_TXQ, cl->txq))
+		goto nla_put_failure;
+
+	return nla_nest_end(skb, nest);
+
+nla_put_failure:
+	nla_nest_cancel(skb, nest);
+	return -1;
+}
+
+static int mqhtb_dump_class_stats(struct Qdisc *sch, unsigned long arg,
+				  struct gnet_dump *d)
+{
+	struct mqhtb_class *cl = (struct mqhtb_class *)arg;
+	struct mqhtb_params *p = rtnl_dereference(cl->params);
+	struct gnet_stats_queue qs = {};
+	struct tc_htb_xstats xstats = {};
+	s64 now = ktime_get_ns();
+	struct Qdisc *child;
+	__u32 qlen = 0;
+
+	if (cl->txq >= 0) {
+		child = mqhtb_leaf(sch, arg);
+		qlen = child->q.qlen;
+		qs.backlog = child->qstats.backlog;
+		qs.drops = cl->txq_sch->qstats.drops;
+		qs.overlimits = cl->txq_sch->qstats.overlimits;
+		xstats.borrows = ((struct mqhtb_txq *)
+				  qdisc_priv(cl->txq_sch))->borrows;
+	}
+	xstats.tokens = clamp_t(s64, PSCHED_NS2TICKS(
+				min_t(s64, p->buffer,
+				      p->buffer + now -
+				      atomic64_read(&cl->tat))),
+				INT_MIN, INT_MAX);
+	xstats.ctokens = clamp_t(s64, PSCHED_NS2TICKS(
+				 min_t(s64, p->cbuffer,
+				       p->cbuffer + now -
+				       atomic64_read(&cl->ctat))),
+				 INT_MIN, INT_MAX);
+
+	if (gnet_stats_copy_basic(NULL, d, cl->bstats, NULL) < 0 ||
+	    gnet_stats_copy_queue(d, NULL, &qs, qlen) < 0)
+		return -1;
+
+	return gnet_stats_copy_app(d, &xstats, sizeof(xstats));
+}
+
+static void mqhtb_walk(struct Qdisc *sch, struct qdisc_walker *arg)
+{
+	struct mqhtb_sched *q = qdisc_priv(sch);
+	struct mqhtb_class *cl;
+	unsigned int i;
+
+	if (arg->stop)
+		return;
+
+	for (i = 0; i < q->clhash.hashsize; i++) {
+		hlist_for_each_entry(cl, &q->clhash.hash[i], common.hnode) {
+			if (arg->count < arg->skip) {
+				arg->count++;
+				continue;
+			}
+			if (arg->fn(sch, (unsigned long)cl, arg) < 0) {
+				arg->stop = 1;
+				return;
+			}
+			arg->count++;
+		}
+	}
+}
+
+static const struct Qdisc_class_ops mqhtb_class_ops = {
+	.select_queue	=	mqhtb_select_queue,
+	.graft		=	mqhtb_graft,
+	.leaf		=	mqhtb_leaf,
+	.find		=	mqhtb_search,
+	.change		=	mqhtb_change_class,
+	.delete		=	mqhtb_delete,
+	.walk		=	mqhtb_walk,
+	.dump		=	mqhtb_dump_class,
+	.dump_stats	=	mqhtb_dump_class_stats,
+};
+
+static struct Qdisc_ops mqhtb_qdisc_ops __read_mostly = {
+	.cl_ops		=	&mqhtb_class_ops,
+	.id		=	"mqhtb",
+	.priv_size	=	sizeof(struct mqhtb_sched),
+	.init		=	mqhtb_init,
+	.destroy	=	mqhtb_destroy,
+	.attach		=	mqhtb_attach,
+	.dump		=	mqhtb_dump,
+	.owner		=	THIS_MODULE,
+};
+
+static int __init mqhtb_module_init(void)
+{
+	return register_qdisc(&mqhtb_qdisc_ops);
+}
+
+static void __exit mqhtb_module_exit(void)
+{
+	unregister_qdisc(&mqhtb_qdisc_ops);
+}
+
+module_init(mqhtb_module_init)
+module_exit(mqhtb_module_exit)
+MODULE_LICENSE("GPL");
@@ -508,9 +508,13 @@ static struct rpc_clnt *rpc_create_xprt(struct rpc_create_args *args,
  * It can ping the server in order to determine if it is up, and to see if
  * it supports this program and version.  RPC_CLNT_CREATE_NOPING disables
  * this behavior so asynchronous tasks can also use rpc_create.
+ *
+ * With args->nconnect > 1, that many transports to the same server address
+ * are created and the tasks of the client are spread over them round robin.
  */
 struct rpc_clnt *rpc_create(struct rpc_create_args *args)
 {
+	struct rpc_clnt *clnt;
 	struct rpc_xprt *xprt;
 	struct xprt_create xprtargs = {
 		.net = args->net,
@@ -522,6 +526,7 @@ struct rpc_clnt *rpc_create(struct rpc_create_args *args)
 		.bc_xprt = args->bc_xprt,
 	};
 	char servername[48];
+	unsigned int i;
 
 	if (args->bc_xprt) {
 		WARN_ON_ONCE(!(args->protocol & XPRT_TRANSPORT_BC));
@@ -584,7 +589,19 @@ struct rpc_clnt *rpc_create(struct rpc_create_args *args)
 	if (args->flags & RPC_CLNT_CREATE_NONPRIVPORT)
 		xprt->resvport = 0;
 
-	return rpc_create_xprt(args, xprt);
+	clnt = rpc_create_xprt(args, xprt);
+	if (IS_ERR(clnt))
+		return clnt;
+
+	/*
+	 * The additional transports are best effort: the client is usable
+	 * with fewer of them, the tasks are spread over the ones there are.
+	 */
+	for (i = 1; i < args->nconnect; i++) {
+		if (rpc_clnt_add_xprt(clnt, &xprtargs, NULL, NULL) < 0)
+			break;
+	}
+	return clnt;
 }
 EXPORT_SYMBOL_GPL(rpc_create);
 
@@ -416,6 +416,26 @@ __svc_init_bc(struct svc_serv *serv)
 }
 #endif
 
+/*
+ * Add a thread to the auto-sized pools whose xprts waited too long for one,
+ * see svc_xprt_do_enqueue().
+ */
+static void svc_grow_work(struct work_struct *work)
+{
+	struct svc_serv *serv = container_of(work, struct svc_serv,
+					     sv_grow_work);
+	unsigned int i;
+
+	for (i = 0; i < serv->sv_nrpools; i++) {
+		struct svc_pool *pool = &serv->sv_pools[i];
+
+		if (!test_bit(SP_GROW_PENDING, &pool->sp_flags))
+			continue;
+		serv->sv_ops->svo_grow_pool(serv, pool);
+		clear_bit(SP_GROW_PENDING, &pool->sp_flags);
+	}
+}
+
 /*
  * Create an RPC service
  */
@@ -480,6 +500,7 @@ __svc_create(struct svc_program *prog, unsigned int bufsize, int npools,
 		INIT_LIST_HEAD(&pool->sp_all_threads);
 		spin_lock_init(&pool->sp_lock);
 	}
+	INIT_WORK(&serv->sv_grow_work, svc_grow_work);
 
 	return serv;
 }
@@ -538,6 +559,7 @@ svc_destroy(struct svc_serv *serv)
 		printk("svc_destroy: no threads for serv=%p!\n", serv);
 
 	del_timer_sync(&serv->sv_temptimer);
+	cancel_work_sync(&serv->sv_grow_work);
 
 	/*
 	 * The last user is gone and thus all sockets have to be destroyed to
@@ -736,6 +758,7 @@ svc_start_kthreads(struct svc_serv *serv, struct svc_pool *pool, int nrservs)
 
 		svc_sock_update_bufs(serv);
 		wake_up_process(task);
+		atomic_long_inc(&chosen_pool->sp_stats.threads_started);
 	} while (nrservs > 0);
 
 	return 0;
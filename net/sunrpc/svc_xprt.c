@@ -375,6 +375,22 @@ static bool svc_xprt_has_something_to_do(struct svc_xprt *xprt)
 	return false;
 }
 
+/*
+ * Ask for one more thread in an auto-sized pool once @xprt has been queued
+ * for longer than sv_grow_delay.  Called with the sp_lock held.
+ */
+static void svc_pool_check_delay(struct svc_pool *pool, struct svc_xprt *xprt)
+{
+	struct svc_serv *serv = xprt->xpt_server;
+
+	if (!pool->sp_max_threads || pool->sp_nrthreads >= pool->sp_max_threads)
+		return;
+	if (time_before(jiffies, xprt->xpt_qtime + serv->sv_grow_delay))
+		return;
+	if (!test_and_set_bit(SP_GROW_PENDING, &pool->sp_flags))
+		queue_work(system_unbound_wq, &serv->sv_grow_work);
+}
+
 void svc_xprt_do_enqueue(struct svc_xprt *xprt)
 {
 	struct svc_pool *pool;
@@ -447,8 +463,11 @@ void svc_xprt_do_enqueue(struct svc_xprt *xprt)
 		queued = true;
 		dprintk("svc: transport %p put into queue\n", xprt);
 		spin_lock_bh(&pool->sp_lock);
+		xprt->xpt_qtime = jiffies;
 		list_add_tail(&xprt->xpt_ready, &pool->sp_sockets);
 		pool->sp_stats.sockets_queued++;
+		svc_pool_check_delay(pool, list_first_entry(&pool->sp_sockets,
+				struct svc_xprt, xpt_ready));
 		spin_unlock_bh(&pool->sp_lock);
 		goto redo_search;
 	}
@@ -488,6 +507,7 @@ static struct svc_xprt *svc_xprt_dequeue(struct svc_pool *pool)
 					struct svc_xprt, xpt_ready);
 		list_del_init(&xprt->xpt_ready);
 		svc_xprt_get(xprt);
+		svc_pool_check_delay(pool, xprt);
 
 		dprintk("svc: transport %p dequeued, inuse=%d\n",
 			xprt, kref_read(&xprt->xpt_ref));
@@ -1434,16 +1454,19 @@ static int svc_pool_stats_show(struct seq_file *m, void *p)
 	struct svc_pool *pool = p;
 
 	if (p == SEQ_START_TOKEN) {
-		seq_puts(m, "# pool packets-arrived sockets-enqueued threads-woken threads-timedout\n");
+		seq_puts(m, "# pool packets-arrived sockets-enqueued threads-woken threads-timedout threads threads-started threads-retired\n");
 		return 0;
 	}
 
-	seq_printf(m, "%u %lu %lu %lu %lu\n",
+	seq_printf(m, "%u %lu %lu %lu %lu %u %lu %lu\n",
 		pool->sp_id,
 		(unsigned long)atomic_long_read(&pool->sp_stats.packets),
 		pool->sp_stats.sockets_queued,
 		(unsigned long)atomic_long_read(&pool->sp_stats.threads_woken),
-		(unsigned long)atomic_long_read(&pool->sp_stats.threads_timedout));
+		(unsigned long)atomic_long_read(&pool->sp_stats.threads_timedout),
+		pool->sp_nrthreads,
+		(unsigned long)atomic_long_read(&pool->sp_stats.threads_started),
+		(unsigned long)atomic_long_read(&pool->sp_stats.threads_retired));
 
 	return 0;
 }
@@ -45,8 +45,45 @@ MODULE_AUTHOR("Mellanox Technologies");
 MODULE_DESCRIPTION("Transport Layer Security Support");
 MODULE_LICENSE("Dual BSD/GPL");
 
-static struct proto tls_base_prot;
-static struct proto tls_sw_prot;
+static struct proto tls_prots[TLS_NUM_CONFIG][TLS_NUM_CONFIG];
+
+/*
+ * The socket ops of the sockets with RX keys, built on first use from the
+ * inet or inet6 stream ops, for splice() to read the decrypted records.
+ */
+enum {
+	TLSV4,
+	TLSV6,
+	TLS_NUM_PROTS,
+};
+
+static struct proto_ops tls_sw_proto_ops[TLS_NUM_PROTS];
+static const struct proto_ops *saved_tcp_ops[TLS_NUM_PROTS];
+static DEFINE_MUTEX(tls_ops_mutex);
+
+static inline void update_sk_prot(struct sock *sk, struct tls_context *ctx)
+{
+	sk->sk_prot = &tls_prots[ctx->tx_conf][ctx->rx_conf];
+}
+
+static void update_sk_proto_ops(struct sock *sk)
+{
+	int ip_ver = sk->sk_family == AF_INET6 ? TLSV6 : TLSV4;
+	const struct proto_ops *ops = sk->sk_socket->ops;
+
+	if (unlikely(ops != smp_load_acquire(&saved_tcp_ops[ip_ver]))) {
+		mutex_lock(&tls_ops_mutex);
+		if (ops != saved_tcp_ops[ip_ver]) {
+			tls_sw_proto_ops[ip_ver] = *ops;
+			tls_sw_proto_ops[ip_ver].splice_read =
+				tls_sw_splice_read;
+			smp_store_release(&saved_tcp_ops[ip_ver], ops);
+		}
+		mutex_unlock(&tls_ops_mutex);
+	}
+
+	sk->sk_socket->ops = &tls_sw_proto_ops[ip_ver];
+}
 
 int wait_on_pending_writer(struct sock *sk, long *timeo)
 {
@@ -232,9 +269,12 @@ static void tls_sk_proto_close(struct sock *sk, long timeout)
 			sg++;
 		}
 	}
-	ctx->free_resources(sk);
-	kfree(ctx->rec_seq);
-	kfree(ctx->iv);
+	if (ctx->free_resources)
+		ctx->free_resources(sk);
+	kfree(ctx->tx.rec_seq);
+	kfree(ctx->tx.iv);
+	kfree(ctx->rx.rec_seq);
+	kfree(ctx->rx.iv);
 
 	sk_proto_close = ctx->sk_proto_close;
 	kfree(ctx);
@@ -243,8 +283,8 @@ static void tls_sk_proto_close(struct sock *sk, long timeout)
 	sk_proto_close(sk, timeout);
 }
 
-static int do_tls_getsockopt_tx(struct sock *sk, char __user *optval,
-				int __user *optlen)
+static int do_tls_getsockopt_conf(struct sock *sk, char __user *optval,
+				  int __user *optlen, int tx)
 {
 	int rc = 0;
 	struct tls_context *ctx = tls_get_ctx(sk);
@@ -265,7 +305,10 @@ static int do_tls_getsockopt_tx(struct sock *sk, char __user *optval,
 	}
 
 	/* get user crypto info */
-	crypto_info = &ctx->crypto_send;
+	if (tx)
+		crypto_info = &ctx->crypto_send;
+	else
+		crypto_info = &ctx->crypto_recv;
 
 	if (!TLS_CRYPTO_INFO_READY(crypto_info)) {
 		rc = -EBUSY;
@@ -291,7 +334,8 @@ static int do_tls_getsockopt_tx(struct sock *sk, char __user *optval,
 			goto out;
 		}
 		lock_sock(sk);
-		memcpy(crypto_info_aes_gcm_128->iv, ctx->iv,
+		memcpy(crypto_info_aes_gcm_128->iv,
+		       tx ? ctx->tx.iv : ctx->rx.iv,
 		       TLS_CIPHER_AES_GCM_128_IV_SIZE);
 		release_sock(sk);
 		if (copy_to_user(optval,
@@ -315,7 +359,9 @@ static int do_tls_getsockopt(struct sock *sk, int optname,
 
 	switch (optname) {
 	case TLS_TX:
-		rc = do_tls_getsockopt_tx(sk, optval, optlen);
+	case TLS_RX:
+		rc = do_tls_getsockopt_conf(sk, optval, optlen,
+					    optname == TLS_TX);
 		break;
 	default:
 		rc = -ENOPROTOOPT;
@@ -335,12 +381,11 @@ static int tls_getsockopt(struct sock *sk, int level, int optname,
 	return do_tls_getsockopt(sk, optname, optval, optlen);
 }
 
-static int do_tls_setsockopt_tx(struct sock *sk, char __user *optval,
-				unsigned int optlen)
+static int do_tls_setsockopt_conf(struct sock *sk, char __user *optval,
+				  unsigned int optlen, int tx)
 {
 	struct tls_crypto_info *crypto_info, tmp_crypto_info;
 	struct tls_context *ctx = tls_get_ctx(sk);
-	struct proto *prot = NULL;
 	int rc = 0;
 
 	if (!optval || (optlen < sizeof(*crypto_info))) {
@@ -361,7 +406,10 @@ static int do_tls_setsockopt_tx(struct sock *sk, char __user *optval,
 	}
 
 	/* get user crypto info */
-	crypto_info = &ctx->crypto_send;
+	if (tx)
+		crypto_info = &ctx->crypto_send;
+	else
+		crypto_info = &ctx->crypto_recv;
 
 	/* Currently we don't support set crypto info more than one time */
 	if (TLS_CRYPTO_INFO_READY(crypto_info))
@@ -389,18 +437,21 @@ static int do_tls_setsockopt_tx(struct sock *sk, char __user *optval,
 		goto out;
 	}
 
-	ctx->sk_write_space = sk->sk_write_space;
-	sk->sk_write_space = tls_write_space;
-
-	ctx->sk_proto_close = sk->sk_prot->close;
-
 	/* currently SW is default, we will have ethtool in future */
-	rc = tls_set_sw_offload(sk, ctx);
-	prot = &tls_sw_prot;
+	rc = tls_set_sw_offload(sk, ctx, tx);
 	if (rc)
 		goto err_crypto_info;
 
-	sk->sk_prot = prot;
+	if (tx) {
+		ctx->sk_write_space = sk->sk_write_space;
+		sk->sk_write_space = tls_write_space;
+		ctx->tx_conf = TLS_SW;
+	} else {
+		ctx->rx_conf = TLS_SW;
+		update_sk_proto_ops(sk);
+	}
+
+	update_sk_prot(sk, ctx);
 	goto out;
 
 err_crypto_info:
@@ -416,8 +467,10 @@ static int do_tls_setsockopt(struct sock *sk, int optname,
 
 	switch (optname) {
 	case TLS_TX:
+	case TLS_RX:
 		lock_sock(sk);
-		rc = do_tls_setsockopt_tx(sk, optval, optlen);
+		rc = do_tls_setsockopt_conf(sk, optval, optlen,
+					    optname == TLS_TX);
 		release_sock(sk);
 		break;
 	default:
@@ -453,7 +506,11 @@ static int tls_init(struct sock *sk)
 	icsk->icsk_ulp_data = ctx;
 	ctx->setsockopt = sk->sk_prot->setsockopt;
 	ctx->getsockopt = sk->sk_prot->getsockopt;
-	sk->sk_prot = &tls_base_prot;
+	ctx->sk_proto_close = sk->sk_prot->close;
+
+	ctx->tx_conf = TLS_BASE;
+	ctx->rx_conf = TLS_BASE;
+	update_sk_prot(sk, ctx);
 out:
 	return rc;
 }
@@ -466,14 +523,22 @@ static struct tcp_ulp_ops tcp_tls_ulp_ops __read_mostly = {
 
 static int __init tls_register(void)
 {
-	tls_base_prot			= tcp_prot;
-	tls_base_prot.setsockopt	= tls_setsockopt;
-	tls_base_prot.getsockopt	= tls_getsockopt;
-
-	tls_sw_prot			= tls_base_prot;
-	tls_sw_prot.sendmsg		= tls_sw_sendmsg;
-	tls_sw_prot.sendpage            = tls_sw_sendpage;
-	tls_sw_prot.close               = tls_sk_proto_close;
+	tls_prots[TLS_BASE][TLS_BASE]			= tcp_prot;
+	tls_prots[TLS_BASE][TLS_BASE].setsockopt	= tls_setsockopt;
+	tls_prots[TLS_BASE][TLS_BASE].getsockopt	= tls_getsockopt;
+	tls_prots[TLS_BASE][TLS_BASE].close		= tls_sk_proto_close;
+
+	tls_prots[TLS_SW][TLS_BASE] = tls_prots[TLS_BASE][TLS_BASE];
+	tls_prots[TLS_SW][TLS_BASE].sendmsg		= tls_sw_sendmsg;
+	tls_prots[TLS_SW][TLS_BASE].sendpage		= tls_sw_sendpage;
+
+	tls_prots[TLS_BASE][TLS_SW] = tls_prots[TLS_BASE][TLS_BASE];
+	tls_prots[TLS_BASE][TLS_SW].recvmsg		= tls_sw_recvmsg;
+	tls_prots[TLS_BASE][TLS_SW].stream_memory_read	= tls_sw_stream_read;
+
+	tls_prots[TLS_SW][TLS_SW] = tls_prots[TLS_SW][TLS_BASE];
+	tls_prots[TLS_SW][TLS_SW].recvmsg		= tls_sw_recvmsg;
+	tls_prots[TLS_SW][TLS_SW].stream_memory_read	= tls_sw_stream_read;
 
 	tcp_register_ulp(&tcp_tls_ulp_ops);
 
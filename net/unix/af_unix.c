@@ -118,6 +118,7 @@
 #include <linux/security.h>
 #include <linux/freezer.h>
 #include <linux/file.h>
+#include <linux/in.h>
 
 struct hlist_head unix_socket_table[2 * UNIX_HASH_SIZE];
 EXPORT_SYMBOL_GPL(unix_socket_table);
@@ -486,6 +487,7 @@ static void unix_sock_destructor(struct sock *sk)
 	struct unix_sock *u = unix_sk(sk);
 
 	skb_queue_purge(&sk->sk_receive_queue);
+	skb_queue_purge(&sk->sk_error_queue);
 
 	WARN_ON(refcount_read(&sk->sk_wmem_alloc));
 	WARN_ON(!sk_unhashed(sk));
@@ -1837,6 +1839,7 @@ static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 	struct sk_buff *skb;
 	int sent = 0;
 	struct scm_cookie scm;
+	struct ubuf_info *uarg = NULL;
 	bool fds_sent = false;
 	int data_len;
 
@@ -1862,22 +1865,42 @@ static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 	if (sk->sk_shutdown & SEND_SHUTDOWN)
 		goto pipe_err;
 
+	if (msg->msg_flags & MSG_ZEROCOPY && len &&
+	    sock_flag(sk, SOCK_ZEROCOPY)) {
+		uarg = sock_zerocopy_alloc(sk, len);
+		if (!uarg) {
+			err = -ENOBUFS;
+			goto out_err;
+		}
+	}
+
 	while (sent < len) {
 		size = len - sent;
 
 		/* Keep two messages in the pipe so it schedules better */
 		size = min_t(int, size, (sk->sk_sndbuf >> 1) - 64);
 
-		/* allow fallback to order-0 allocations */
-		size = min_t(int, size, SKB_MAX_HEAD(0) + UNIX_SKB_FRAGS_SZ);
+		if (uarg) {
+			/* the payload stays in the pinned user pages */
+			data_len = 0;
+			skb = sock_alloc_send_pskb(sk, 0, 0,
+						   msg->msg_flags & MSG_DONTWAIT,
+						   &err, 0);
+		} else {
+			/* allow fallback to order-0 allocations */
+			size = min_t(int, size,
+				     SKB_MAX_HEAD(0) + UNIX_SKB_FRAGS_SZ);
 
-		data_len = max_t(int, 0, size - SKB_MAX_HEAD(0));
+			data_len = max_t(int, 0, size - SKB_MAX_HEAD(0));
 
-		data_len = min_t(size_t, size, PAGE_ALIGN(data_len));
+			data_len = min_t(size_t, size, PAGE_ALIGN(data_len));
 
-		skb = sock_alloc_send_pskb(sk, size - data_len, data_len,
-					   msg->msg_flags & MSG_DONTWAIT, &err,
-					   get_order(UNIX_SKB_FRAGS_SZ));
+			skb = sock_alloc_send_pskb(sk, size - data_len,
+						   data_len,
+						   msg->msg_flags & MSG_DONTWAIT,
+						   &err,
+						   get_order(UNIX_SKB_FRAGS_SZ));
+		}
 		if (!skb)
 			goto out_err;
 
@@ -1889,13 +1912,24 @@ static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 		}
 		fds_sent = true;
 
-		skb_put(skb, size - data_len);
-		skb->data_len = data_len;
-		skb->len = size;
-		err = skb_copy_datagram_from_iter(skb, 0, &msg->msg_iter, size);
-		if (err) {
-			kfree_skb(skb);
-			goto out_err;
+		if (uarg) {
+			/* Returns how much fit in MAX_SKB_FRAGS pages */
+			err = skb_zerocopy_iter_stream(sk, skb, msg, size, uarg);
+			if (err < 0) {
+				kfree_skb(skb);
+				goto out_err;
+			}
+			size = err;
+		} else {
+			skb_put(skb, size - data_len);
+			skb->data_len = data_len;
+			skb->len = size;
+			err = skb_copy_datagram_from_iter(skb, 0, &msg->msg_iter,
+							  size);
+			if (err) {
+				kfree_skb(skb);
+				goto out_err;
+			}
 		}
 
 		unix_state_lock(other);
@@ -1911,6 +1945,7 @@ static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 		sent += size;
 	}
 
+	sock_zerocopy_put(uarg);
 	scm_destroy(&scm);
 
 	return sent;
@@ -1923,6 +1958,10 @@ static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 		send_sig(SIGPIPE, current, 0);
 	err = -EPIPE;
 out_err:
+	if (sent)
+		sock_zerocopy_put(uarg);
+	else
+		sock_zerocopy_put_abort(uarg);
 	scm_destroy(&scm);
 	return sent ? : err;
 }
@@ -2464,6 +2503,11 @@ static int unix_stream_recvmsg(struct socket *sock, struct msghdr *msg,
 		.flags = flags
 	};
 
+	/* MSG_ZEROCOPY completions, in the same format as for TCP */
+	if (unlikely(flags & MSG_ERRQUEUE))
+		return sock_recv_errqueue(sock->sk, msg, size,
+					  SOL_IP, IP_RECVERR);
+
 	return unix_stream_read_generic(&state, true);
 }
 
@@ -2471,6 +2515,12 @@ static int unix_stream_splice_actor(struct sk_buff *skb,
 				    int skip, int chunk,
 				    struct unix_stream_read_state *state)
 {
+	/* Pipe buffers outlive the skb, so they must not keep referencing
+	 * MSG_ZEROCOPY pages the sender is told it can reuse.
+	 */
+	if (skb_orphan_frags_rx(skb, GFP_KERNEL))
+		return -ENOMEM;
+
 	return skb_splice_bits(skb, state->socket->sk,
 			       UNIXCB(skb).consumed + skip,
 			       state->pipe, chunk, state->splice_flags);
@@ -2648,8 +2698,9 @@ static unsigned int unix_poll(struct file *file, struct socket *sock, poll_table
 	mask = 0;
 
 	/* exceptional events? */
-	if (sk->sk_err)
-		mask |= POLLERR;
+	if (sk->sk_err || !skb_queue_empty(&sk->sk_error_queue))
+		mask |= POLLERR |
+			(sock_flag(sk, SOCK_SELECT_ERR_QUEUE) ? POLLPRI : 0);
 	if (sk->sk_shutdown == SHUTDOWN_MASK)
 		mask |= POLLHUP;
 	if (sk->sk_shutdown & RCV_SHUTDOWN)
@@ -2912,6 +2963,7 @@ static void __net_exit unix_net_exit(struct net *net)
 static struct pernet_operations unix_net_ops = {
 	.init = unix_net_init,
 	.exit = unix_net_exit,
+	.async = true,
 };
 
 static int __init af_unix_init(void)
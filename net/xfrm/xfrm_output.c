@@ -50,6 +50,42 @@ static struct dst_entry *skb_dst_pop(struct sk_buff *skb)
 	return child;
 }
 
+/* Number the packet from this CPU's batch, without taking x->lock */
+static bool xfrm_output_pcpu(struct xfrm_state *x, struct sk_buff *skb)
+{
+	struct xfrm_state_pcpu *pc;
+	bool ret = false;
+
+	local_bh_disable();
+	pc = this_cpu_ptr(x->pcpu);
+	if (pc->left && READ_ONCE(x->km.state) == XFRM_STATE_VALID) {
+		XFRM_SKB_CB(skb)->seq.output.low = lower_32_bits(pc->seq);
+		XFRM_SKB_CB(skb)->seq.output.hi = upper_32_bits(pc->seq);
+		pc->seq++;
+		pc->left--;
+		pc->bytes += skb->len;
+		pc->packets++;
+		ret = true;
+	}
+	local_bh_enable();
+
+	return ret;
+}
+
+/* Charge this CPU's use to the state and reserve its next batch.
+ * Called with x->lock held.
+ */
+static void xfrm_output_pcpu_refill(struct xfrm_state *x)
+{
+	struct xfrm_state_pcpu *pc = this_cpu_ptr(x->pcpu);
+
+	x->curlft.bytes += pc->bytes;
+	x->curlft.packets += pc->packets;
+	pc->bytes = 0;
+	pc->packets = 0;
+	pc->left = xfrm_replay_reserve(x, x->seq_batch - 1, &pc->seq);
+}
+
 static int xfrm_output_one(struct sk_buff *skb, int err)
 {
 	struct dst_entry *dst = skb_dst(skb);
@@ -75,6 +111,9 @@ static int xfrm_output_one(struct sk_buff *skb, int err)
 			goto error_nolock;
 		}
 
+		if (x->pcpu && xfrm_output_pcpu(x, skb))
+			goto unlocked;
+
 		spin_lock_bh(&x->lock);
 
 		if (unlikely(x->km.state != XFRM_STATE_VALID)) {
@@ -98,8 +137,12 @@ static int xfrm_output_one(struct sk_buff *skb, int err)
 		x->curlft.bytes += skb->len;
 		x->curlft.packets++;
 
+		if (x->pcpu)
+			xfrm_output_pcpu_refill(x);
+
 		spin_unlock_bh(&x->lock);
 
+unlocked:
 		skb_dst_force(skb);
 
 		if (xfrm_offload(skb)) {
@@ -46,6 +46,45 @@ u32 xfrm_replay_seqhi(struct xfrm_state *x, __be32 net_seq)
 	return seq_hi;
 }
 EXPORT_SYMBOL(xfrm_replay_seqhi);
+
+/* Reserve up to n output sequence numbers following the last one handed
+ * out, for a CPU to use without the state lock.  Returns how many were
+ * reserved and stores the first one in *seq.  The reservation stops
+ * short of wrapping, so the overflow checks of x->repl->overflow() still
+ * catch the end of the sequence number space.
+ *
+ * The state structure must be locked!
+ */
+u32 xfrm_replay_reserve(struct xfrm_state *x, u32 n, u64 *seq)
+{
+	struct xfrm_replay_state_esn *replay_esn = x->replay_esn;
+	u64 oseq, limit = U32_MAX;
+
+	if (!(x->type->flags & XFRM_TYPE_REPLAY_PROT))
+		return 0;
+
+	if (!replay_esn) {
+		oseq = x->replay.oseq;
+	} else if (x->props.flags & XFRM_STATE_ESN) {
+		oseq = (u64)replay_esn->oseq_hi << 32 | replay_esn->oseq;
+		limit = U64_MAX;
+	} else {
+		oseq = replay_esn->oseq;
+	}
+
+	n = min_t(u64, n, limit - oseq);
+	*seq = oseq + 1;
+	oseq += n;
+
+	if (!replay_esn) {
+		x->replay.oseq = oseq;
+	} else {
+		replay_esn->oseq = lower_32_bits(oseq);
+		replay_esn->oseq_hi = upper_32_bits(oseq);
+	}
+
+	return n;
+}
 ;
 static void xfrm_replay_notify(struct xfrm_state *x, int event)
 {
@@ -450,6 +450,7 @@ static void xfrm_state_gc_destroy(struct xfrm_state *x)
 	}
 	xfrm_dev_state_free(x);
 	security_xfrm_state_free(x);
+	free_percpu(x->pcpu);
 	kfree(x);
 }
 
@@ -1335,6 +1336,9 @@ static struct xfrm_state *xfrm_state_clone(struct xfrm_state *orig,
 	x->props.family = orig->props.family;
 	x->props.saddr = orig->props.saddr;
 
+	if (xfrm_state_seq_batch_init(x, orig->seq_batch))
+		goto error;
+
 	if (orig->aalg) {
 		x->aalg = xfrm_algo_auth_clone(orig->aalg);
 		if (!x->aalg)
@@ -1582,6 +1586,30 @@ int xfrm_state_check_expire(struct xfrm_state *x)
 }
 EXPORT_SYMBOL(xfrm_state_check_expire);
 
+/* Let each CPU reserve batch output sequence numbers at a time, so that
+ * xfrm_output() takes the state lock once per batch instead of once per
+ * packet.  The CPUs send their numbers out of order, which the replay
+ * window of the receiver has to absorb, and the lifetime use of a CPU is
+ * only charged to the state when it takes its next batch.
+ */
+int xfrm_state_seq_batch_init(struct xfrm_state *x, u32 batch)
+{
+	if (!batch)
+		return 0;
+
+	if (batch > XFRM_SEQ_BATCH_MAX || x->id.proto != IPPROTO_ESP ||
+	    x->xso.dev)
+		return -EINVAL;
+
+	x->pcpu = alloc_percpu(struct xfrm_state_pcpu);
+	if (!x->pcpu)
+		return -ENOMEM;
+
+	x->seq_batch = batch;
+	return 0;
+}
+EXPORT_SYMBOL(xfrm_state_seq_batch_init);
+
 struct xfrm_state *
 xfrm_state_lookup(struct net *net, u32 mark, const xfrm_address_t *daddr, __be32 spi,
 		  u8 proto, unsigned short family)
@@ -609,6 +609,13 @@ static struct xfrm_state *xfrm_state_construct(struct net *net,
 					       attrs[XFRMA_REPLAY_ESN_VAL])))
 		goto error;
 
+	if (attrs[XFRMA_SEQ_BATCH]) {
+		err = xfrm_state_seq_batch_init(x,
+				nla_get_u32(attrs[XFRMA_SEQ_BATCH]));
+		if (err)
+			goto error;
+	}
+
 	x->km.seq = p->seq;
 	x->replay_maxdiff = net->xfrm.sysctl_aevent_rseqth;
 	/* sysctl_xfrm_aevent_etime is in 100ms units */
@@ -906,6 +913,11 @@ static int copy_to_user_state_extra(struct xfrm_state *x,
 		if (ret)
 			goto out;
 	}
+	if (x->seq_batch) {
+		ret = nla_put_u32(skb, XFRMA_SEQ_BATCH, x->seq_batch);
+		if (ret)
+			goto out;
+	}
 	if (x->security)
 		ret = copy_sec_ctx(x->security, skb);
 out:
@@ -2467,6 +2479,7 @@ static const struct nla_policy xfrma_policy[XFRMA_MAX+1] = {
 	[XFRMA_ADDRESS_FILTER]	= { .len = sizeof(struct xfrm_address_filter) },
 	[XFRMA_OFFLOAD_DEV]	= { .len = sizeof(struct xfrm_user_offload) },
 	[XFRMA_OUTPUT_MARK]	= { .len = NLA_U32 },
+	[XFRMA_SEQ_BATCH]	= { .type = NLA_U32 },
 };
 
 static const struct nla_policy xfrma_spd_policy[XFRMA_SPD_MAX+1] = {
@@ -2693,6 +2706,8 @@ static inline size_t xfrm_sa_len(struct xfrm_state *x)
 		 l += nla_total_size(sizeof(x->xso));
 	if (x->props.output_mark)
 		l += nla_total_size(sizeof(x->props.output_mark));
+	if (x->seq_batch)
+		l += nla_total_size(sizeof(x->seq_batch));
 
 	/* Must count x->lastused as it may become non-zero behind our back. */
 	l += nla_total_size_64bit(sizeof(u64));
@@ -3219,6 +3234,7 @@ static void __net_exit xfrm_user_net_exit(struct list_head *net_exit_list)
 static struct pernet_operations xfrm_user_net_ops = {
 	.init	    = xfrm_user_net_init,
 	.exit_batch = xfrm_user_net_exit,
+	.async = true,
 };
 
 static int __init xfrm_user_init(void)
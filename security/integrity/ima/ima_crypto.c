@@ -33,7 +33,7 @@ struct ahash_completion {
 };
 
 /* minimum file size for ahash use */
-static unsigned long ima_ahash_minsize;
+static unsigned long ima_ahash_minsize = CONFIG_IMA_AHASH_MINSIZE;
 module_param_named(ahash_minsize, ima_ahash_minsize, ulong, 0644);
 MODULE_PARM_DESC(ahash_minsize, "Minimum file size for ahash use");
 
@@ -62,7 +62,7 @@ static const struct kernel_param_ops param_ops_bufsize = {
 #define param_check_bufsize(name, p) __param_check(name, p, unsigned int)
 
 module_param_named(ahash_bufsize, ima_bufsize, bufsize, 0644);
-MODULE_PARM_DESC(ahash_bufsize, "Maximum ahash buffer size");
+MODULE_PARM_DESC(ahash_bufsize, "Maximum file hashing buffer size");
 
 static struct crypto_shash *ima_shash_tfm;
 static struct crypto_ahash *ima_ahash_tfm;
@@ -357,6 +357,7 @@ static int ima_calc_file_hash_tfm(struct file *file,
 	loff_t i_size, offset = 0;
 	char *rbuf;
 	int rc, read = 0;
+	size_t rbuf_size;
 	SHASH_DESC_ON_STACK(shash, tfm);
 
 	shash->tfm = tfm;
@@ -373,7 +374,8 @@ static int ima_calc_file_hash_tfm(struct file *file,
 	if (i_size == 0)
 		goto out;
 
-	rbuf = kzalloc(PAGE_SIZE, GFP_KERNEL);
+	/* read in chunks of up to ima.ahash_bufsize, as the ahash path */
+	rbuf = ima_alloc_pages(i_size, &rbuf_size, 1);
 	if (!rbuf)
 		return -ENOMEM;
 
@@ -385,7 +387,7 @@ static int ima_calc_file_hash_tfm(struct file *file,
 	while (offset < i_size) {
 		int rbuf_len;
 
-		rbuf_len = integrity_kernel_read(file, offset, rbuf, PAGE_SIZE);
+		rbuf_len = integrity_kernel_read(file, offset, rbuf, rbuf_size);
 		if (rbuf_len < 0) {
 			rc = rbuf_len;
 			break;
@@ -400,7 +402,7 @@ static int ima_calc_file_hash_tfm(struct file *file,
 	}
 	if (read)
 		file->f_mode &= ~FMODE_READ;
-	kfree(rbuf);
+	ima_free_pages(rbuf, rbuf_size);
 out:
 	if (!rc)
 		rc = crypto_shash_final(shash, hash->digest);
@@ -432,9 +434,9 @@ static int ima_calc_file_shash(struct file *file, struct ima_digest_data *hash)
  * The 'ima.ahash_minsize' module parameter allows specifying the best
  * minimum file size for using ahash on the system.
  *
- * If the ima.ahash_minsize parameter is not specified, this function uses
- * shash for the hash calculation.  If ahash fails, it falls back to using
- * shash.
+ * If neither the ima.ahash_minsize parameter nor CONFIG_IMA_AHASH_MINSIZE
+ * is set, this function uses shash for the hash calculation.  If ahash
+ * fails, it falls back to using shash.
  */
 int ima_calc_file_hash(struct file *file, struct ima_digest_data *hash)
 {
@@ -23,6 +23,9 @@
 #include <linux/skbuff.h>
 #include <linux/percpu.h>
 #include <linux/list.h>
+#include <linux/jhash.h>
+#include <linux/log2.h>
+#include <linux/mm.h>
 #include <net/sock.h>
 #include <linux/un.h>
 #include <net/af_unix.h>
@@ -34,9 +37,12 @@
 #include "avc_ss.h"
 #include "classmap.h"
 
-#define AVC_CACHE_SLOTS			512
+#define AVC_DEF_CACHE_SLOTS		512
+#define AVC_MIN_CACHE_SLOTS		64
+#define AVC_MAX_CACHE_SLOTS		(1 << 20)
 #define AVC_DEF_CACHE_THRESHOLD		512
 #define AVC_CACHE_RECLAIM		16
+#define AVC_PCPU_SLOTS			64
 
 #ifdef CONFIG_SECURITY_SELINUX_AVC_STATS
 #define avc_cache_stats_incr(field)	this_cpu_inc(avc_cache_stats.field)
@@ -69,13 +75,33 @@ struct avc_xperms_node {
 };
 
 struct avc_cache {
-	struct hlist_head	slots[AVC_CACHE_SLOTS]; /* head for avc_node->list */
-	spinlock_t		slots_lock[AVC_CACHE_SLOTS]; /* lock for writes */
+	struct hlist_head	*slots; /* head for avc_node->list */
+	spinlock_t		*slots_lock; /* lock for writes */
 	atomic_t		lru_hint;	/* LRU hint for reclaim scan */
 	atomic_t		active_nodes;
 	u32			latest_notif;	/* latest revocation notification */
 };
 
+/*
+ * Per-cpu front cache of the recent decisions, direct mapped.  An entry
+ * is valid while its generation is avc_pcpu_gen, which is bumped after
+ * any change to the decisions cached in the AVC.  The entries are only
+ * accessed from their cpu, with preemption disabled, the sequence count
+ * keeping apart the readers and writers interrupting each other.
+ */
+struct avc_pcpu_entry {
+	u32			seq;
+	u32			gen;
+	u32			ssid;
+	u32			tsid;
+	u16			tclass;
+	struct av_decision	avd;
+};
+
+struct avc_pcpu_cache {
+	struct avc_pcpu_entry	entries[AVC_PCPU_SLOTS];
+};
+
 struct avc_callback_node {
 	int (*callback) (u32 event);
 	u32 events;
@@ -85,11 +111,28 @@ struct avc_callback_node {
 /* Exported via selinufs */
 unsigned int avc_cache_threshold = AVC_DEF_CACHE_THRESHOLD;
 
+static unsigned int avc_cache_slots __ro_after_init = AVC_DEF_CACHE_SLOTS;
+
+static int __init avc_cache_slots_setup(char *str)
+{
+	unsigned long slots;
+
+	if (!kstrtoul(str, 0, &slots)) {
+		slots = clamp_t(unsigned long, slots, AVC_MIN_CACHE_SLOTS,
+				AVC_MAX_CACHE_SLOTS);
+		avc_cache_slots = roundup_pow_of_two(slots);
+	}
+	return 1;
+}
+__setup("avc_cache_slots=", avc_cache_slots_setup);
+
 #ifdef CONFIG_SECURITY_SELINUX_AVC_STATS
 DEFINE_PER_CPU(struct avc_cache_stats, avc_cache_stats) = { 0 };
 #endif
 
 static struct avc_cache avc_cache;
+static DEFINE_PER_CPU(struct avc_pcpu_cache, avc_pcpu_cache);
+static atomic_t avc_pcpu_gen __read_mostly = ATOMIC_INIT(1);
 static struct avc_callback_node *avc_callbacks;
 static struct kmem_cache *avc_node_cachep;
 static struct kmem_cache *avc_xperms_data_cachep;
@@ -98,7 +141,74 @@ static struct kmem_cache *avc_xperms_cachep;
 
 static inline int avc_hash(u32 ssid, u32 tsid, u16 tclass)
 {
-	return (ssid ^ (tsid<<2) ^ (tclass<<4)) & (AVC_CACHE_SLOTS - 1);
+	return jhash_3words(ssid, tsid, tclass, 0) & (avc_cache_slots - 1);
+}
+
+static inline int avc_pcpu_hash(u32 ssid, u32 tsid, u16 tclass)
+{
+	return (ssid ^ (tsid<<2) ^ (tclass<<4)) & (AVC_PCPU_SLOTS - 1);
+}
+
+static inline u32 avc_pcpu_gen_read(void)
+{
+	u32 gen = atomic_read(&avc_pcpu_gen);
+
+	/* see the AVC as of this generation, pairs with avc_pcpu_flush() */
+	smp_rmb();
+	return gen;
+}
+
+/* Invalidates the per-cpu caches, after a change to the AVC */
+static void avc_pcpu_flush(void)
+{
+	smp_wmb();
+	atomic_inc(&avc_pcpu_gen);
+}
+
+static bool avc_pcpu_lookup(u32 ssid, u32 tsid, u16 tclass, u32 gen,
+			    struct av_decision *avd)
+{
+	struct avc_pcpu_entry *e;
+	bool hit = false;
+	u32 seq;
+
+	e = &get_cpu_ptr(&avc_pcpu_cache)->entries[avc_pcpu_hash(ssid, tsid,
+								  tclass)];
+	seq = READ_ONCE(e->seq);
+	barrier();
+	if (!(seq & 1) && e->gen == gen && e->ssid == ssid &&
+	    e->tsid == tsid && e->tclass == tclass) {
+		memcpy(avd, &e->avd, sizeof(*avd));
+		barrier();
+		hit = READ_ONCE(e->seq) == seq;
+	}
+	put_cpu_ptr(&avc_pcpu_cache);
+
+	return hit;
+}
+
+static void avc_pcpu_insert(u32 ssid, u32 tsid, u16 tclass, u32 gen,
+			    struct av_decision *avd)
+{
+	struct avc_pcpu_entry *e;
+	u32 seq;
+
+	e = &get_cpu_ptr(&avc_pcpu_cache)->entries[avc_pcpu_hash(ssid, tsid,
+								  tclass)];
+	seq = READ_ONCE(e->seq);
+	/* leave the entry to the update this one interrupted */
+	if (!(seq & 1)) {
+		WRITE_ONCE(e->seq, seq + 1);
+		barrier();
+		e->gen = gen;
+		e->ssid = ssid;
+		e->tsid = tsid;
+		e->tclass = tclass;
+		memcpy(&e->avd, avd, sizeof(e->avd));
+		barrier();
+		WRITE_ONCE(e->seq, seq + 2);
+	}
+	put_cpu_ptr(&avc_pcpu_cache);
 }
 
 /**
@@ -178,7 +288,19 @@ void __init avc_init(void)
 {
 	int i;
 
-	for (i = 0; i < AVC_CACHE_SLOTS; i++) {
+	avc_cache.slots = kvmalloc_array(avc_cache_slots,
+					 sizeof(*avc_cache.slots), GFP_KERNEL);
+	avc_cache.slots_lock = kvmalloc_array(avc_cache_slots,
+					      sizeof(*avc_cache.slots_lock),
+					      GFP_KERNEL);
+	if (!avc_cache.slots || !avc_cache.slots_lock)
+		panic("SELinux: unable to allocate %u AVC slots\n",
+		      avc_cache_slots);
+	/* keep the default threshold in proportion with avc_cache_slots= */
+	if (avc_cache_slots != AVC_DEF_CACHE_SLOTS)
+		avc_cache_threshold = avc_cache_slots;
+
+	for (i = 0; i < avc_cache_slots; i++) {
 		INIT_HLIST_HEAD(&avc_cache.slots[i]);
 		spin_lock_init(&avc_cache.slots_lock[i]);
 	}
@@ -209,7 +331,7 @@ int avc_get_hash_stats(char *page)
 
 	slots_used = 0;
 	max_chain_len = 0;
-	for (i = 0; i < AVC_CACHE_SLOTS; i++) {
+	for (i = 0; i < avc_cache_slots; i++) {
 		head = &avc_cache.slots[i];
 		if (!hlist_empty(head)) {
 			slots_used++;
@@ -226,7 +348,7 @@ int avc_get_hash_stats(char *page)
 	return scnprintf(page, PAGE_SIZE, "entries: %d\nbuckets used: %d/%d\n"
 			 "longest chain: %d\n",
 			 atomic_read(&avc_cache.active_nodes),
-			 slots_used, AVC_CACHE_SLOTS, max_chain_len);
+			 slots_used, avc_cache_slots, max_chain_len);
 }
 
 /*
@@ -501,9 +623,11 @@ static void avc_node_kill(struct avc_node *node)
 	atomic_dec(&avc_cache.active_nodes);
 }
 
+/* Replacing a node changes its decision, drop the per-cpu copies */
 static void avc_node_replace(struct avc_node *new, struct avc_node *old)
 {
 	hlist_replace_rcu(&old->list, &new->list);
+	avc_pcpu_flush();
 	call_rcu(&old->rhead, avc_node_free);
 	atomic_dec(&avc_cache.active_nodes);
 }
@@ -516,8 +640,9 @@ static inline int avc_reclaim_node(void)
 	struct hlist_head *head;
 	spinlock_t *lock;
 
-	for (try = 0, ecx = 0; try < AVC_CACHE_SLOTS; try++) {
-		hvalue = atomic_inc_return(&avc_cache.lru_hint) & (AVC_CACHE_SLOTS - 1);
+	for (try = 0, ecx = 0; try < avc_cache_slots; try++) {
+		hvalue = atomic_inc_return(&avc_cache.lru_hint) &
+			 (avc_cache_slots - 1);
 		head = &avc_cache.slots[hvalue];
 		lock = &avc_cache.slots_lock[hvalue];
 
@@ -898,6 +1023,12 @@ static int avc_update_node(u32 event, u32 perms, u8 driver, u8 xperm, u32 ssid,
 out_unlock:
 	spin_unlock_irqrestore(lock, flag);
 out:
+	/*
+	 * Without the node, the per-cpu caches may still hold the decision
+	 * this update was meant to change.
+	 */
+	if (rc)
+		avc_pcpu_flush();
 	return rc;
 }
 
@@ -912,7 +1043,7 @@ static void avc_flush(void)
 	unsigned long flag;
 	int i;
 
-	for (i = 0; i < AVC_CACHE_SLOTS; i++) {
+	for (i = 0; i < avc_cache_slots; i++) {
 		head = &avc_cache.slots[i];
 		lock = &avc_cache.slots_lock[i];
 
@@ -927,6 +1058,7 @@ static void avc_flush(void)
 		rcu_read_unlock();
 		spin_unlock_irqrestore(lock, flag);
 	}
+	avc_pcpu_flush();
 }
 
 /**
@@ -1100,16 +1232,24 @@ inline int avc_has_perm_noaudit(u32 ssid, u32 tsid,
 	struct avc_xperms_node xp_node;
 	int rc = 0;
 	u32 denied;
+	u32 gen;
 
 	BUG_ON(!requested);
 
 	rcu_read_lock();
 
-	node = avc_lookup(ssid, tsid, tclass);
-	if (unlikely(!node))
-		node = avc_compute_av(ssid, tsid, tclass, avd, &xp_node);
-	else
-		memcpy(avd, &node->ae.avd, sizeof(*avd));
+	gen = avc_pcpu_gen_read();
+	if (avc_pcpu_lookup(ssid, tsid, tclass, gen, avd)) {
+		avc_cache_stats_incr(lookups);
+	} else {
+		node = avc_lookup(ssid, tsid, tclass);
+		if (unlikely(!node))
+			node = avc_compute_av(ssid, tsid, tclass, avd,
+					      &xp_node);
+		else
+			memcpy(avd, &node->ae.avd, sizeof(*avd));
+		avc_pcpu_insert(ssid, tsid, tclass, gen, avd);
+	}
 
 	denied = requested & ~(avd->allowed);
 	if (unlikely(denied))
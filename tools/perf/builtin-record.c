@@ -46,6 +46,7 @@
 #include <errno.h>
 #include <inttypes.h>
 #include <poll.h>
+#include <pthread.h>
 #include <unistd.h>
 #include <sched.h>
 #include <signal.h>
@@ -63,6 +64,27 @@ struct switch_output {
 	bool		 set;
 };
 
+struct record;
+
+/*
+ * With --threads, each record_thread drains the ring buffers of its
+ * CPUs into its own file of the perf.data directory.
+ */
+struct record_thread {
+	pthread_t		tid;
+	struct record		*rec;
+	struct cpu_map		*cpus;
+	struct perf_data_dir_file *file;
+	int			nr_mmaps;
+	struct perf_mmap	**mmaps;
+	int			nr_pollfd;
+	struct pollfd		*pollfd;
+	u64			bytes_written;
+	unsigned long long	samples;
+	unsigned long		waking;
+	int			err;
+};
+
 struct record {
 	struct perf_tool	tool;
 	struct record_opts	opts;
@@ -81,6 +103,11 @@ struct record {
 	bool			timestamp_filename;
 	struct switch_output	switch_output;
 	unsigned long long	samples;
+	const char		*threads_spec;
+	int			nr_threads;
+	struct record_thread	*threads;
+	int			thread_stop_pipe[2];
+	int			thread_exit_pipe[2];
 };
 
 static volatile int auxtrace_record__snapshot_started;
@@ -177,9 +204,30 @@ rb_find_range(void *data, int mask, u64 head, u64 old,
 	return backward_rb_find_range(data, mask, head, start, end);
 }
 
+static int record_thread__write(struct record_thread *thread,
+				void *bf, size_t size)
+{
+	if (perf_data_dir_file__write(thread->file, bf, size) < 0) {
+		pr_err("failed to write perf data, error: %m\n");
+		return -1;
+	}
+
+	thread->bytes_written += size;
+	return 0;
+}
+
+static int record__mmap_write(struct record *rec,
+			      struct record_thread *thread,
+			      void *bf, size_t size)
+{
+	if (thread)
+		return record_thread__write(thread, bf, size);
+	return record__write(rec, bf, size);
+}
+
 static int
-record__mmap_read(struct record *rec, struct perf_mmap *md,
-		  bool overwrite, bool backward)
+record__mmap_read(struct record *rec, struct record_thread *thread,
+		  struct perf_mmap *md, bool overwrite, bool backward)
 {
 	u64 head = perf_mmap__read_head(md);
 	u64 old = md->prev;
@@ -196,7 +244,10 @@ record__mmap_read(struct record *rec, struct perf_mmap *md,
 	if (start == end)
 		return 0;
 
-	rec->samples++;
+	if (thread)
+		thread->samples++;
+	else
+		rec->samples++;
 
 	size = end - start;
 	if (size > (unsigned long)(md->mask) + 1) {
@@ -212,7 +263,7 @@ record__mmap_read(struct record *rec, struct perf_mmap *md,
 		size = md->mask + 1 - (start & md->mask);
 		start += size;
 
-		if (record__write(rec, buf, size) < 0) {
+		if (record__mmap_write(rec, thread, buf, size) < 0) {
 			rc = -1;
 			goto out;
 		}
@@ -222,7 +273,7 @@ record__mmap_read(struct record *rec, struct perf_mmap *md,
 	size = end - start;
 	start += size;
 
-	if (record__write(rec, buf, size) < 0) {
+	if (record__mmap_write(rec, thread, buf, size) < 0) {
 		rc = -1;
 		goto out;
 	}
@@ -577,7 +628,7 @@ static int record__mmap_read_evlist(struct record *rec, struct perf_evlist *evli
 		struct auxtrace_mmap *mm = &maps[i].auxtrace_mmap;
 
 		if (maps[i].base) {
-			if (record__mmap_read(rec, &maps[i],
+			if (record__mmap_read(rec, NULL, &maps[i],
 					      evlist->overwrite, backward) != 0) {
 				rc = -1;
 				goto out;
@@ -615,6 +666,215 @@ static int record__mmap_read_all(struct record *rec)
 	return record__mmap_read_evlist(rec, rec->evlist, true);
 }
 
+static int record_thread__mmap_read(struct record_thread *thread)
+{
+	int i;
+
+	for (i = 0; i < thread->nr_mmaps; i++) {
+		struct perf_mmap *md = thread->mmaps[i];
+
+		if (md->base &&
+		    record__mmap_read(thread->rec, thread, md, false, false))
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * No PERF_RECORD_FINISHED_ROUND is written to the files of the
+ * threads: a round only orders the events of one file, the files are
+ * sorted together when they are read.
+ */
+static void *record_thread__run(void *arg)
+{
+	struct record_thread *thread = arg;
+	struct record *rec = thread->rec;
+	bool draining = false;
+	int i, hup;
+	char c;
+
+	for (;;) {
+		unsigned long long samples = thread->samples;
+
+		if (record_thread__mmap_read(thread) < 0) {
+			thread->err = -1;
+			break;
+		}
+
+		if (samples != thread->samples)
+			continue;
+		if (draining)
+			break;
+
+		if (poll(thread->pollfd, thread->nr_pollfd + 1, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			thread->err = -errno;
+			break;
+		}
+		thread->waking++;
+
+		/* Stopped by the main thread, or all the events are gone */
+		if (thread->pollfd[thread->nr_pollfd].revents)
+			draining = true;
+
+		for (i = 0, hup = 0; i < thread->nr_pollfd; i++)
+			if (thread->pollfd[i].revents & (POLLERR | POLLHUP))
+				hup++;
+		if (hup == thread->nr_pollfd)
+			draining = true;
+	}
+
+	/* Tells the main thread to stop recording on errors */
+	c = !!thread->err;
+	if (write(rec->thread_exit_pipe[1], &c, 1) < 0)
+		pr_debug("failed to notify the exit of a thread\n");
+	return NULL;
+}
+
+/* The first thread with the CPU of the ring buffer drains it */
+static int record__thread_idx(struct record *rec, int mmap_idx)
+{
+	int i, cpu = rec->evlist->cpus->map[mmap_idx];
+
+	for (i = 0; i < rec->nr_threads; i++)
+		if (cpu_map__has(rec->threads[i].cpus, cpu))
+			return i;
+	return -1;
+}
+
+static int record_thread__init(struct record_thread *thread)
+{
+	struct record *rec = thread->rec;
+	struct perf_evlist *evlist = rec->evlist;
+	struct fdarray *fda = &evlist->pollfd;
+	int i, idx = thread - rec->threads;
+
+	thread->mmaps = calloc(evlist->nr_mmaps, sizeof(*thread->mmaps));
+	thread->pollfd = calloc(fda->nr + 1, sizeof(*thread->pollfd));
+	if (!thread->mmaps || !thread->pollfd)
+		return -ENOMEM;
+
+	thread->file = &rec->file.dir_files[idx];
+
+	for (i = 0; i < evlist->nr_mmaps; i++)
+		if (record__thread_idx(rec, i) == idx)
+			thread->mmaps[thread->nr_mmaps++] = &evlist->mmap[i];
+
+	for (i = 0; i < fda->nr; i++) {
+		struct perf_mmap *md = fda->priv[i].ptr;
+		struct pollfd *pfd;
+
+		if (!md || md < evlist->mmap ||
+		    md >= evlist->mmap + evlist->nr_mmaps ||
+		    record__thread_idx(rec, md - evlist->mmap) != idx)
+			continue;
+
+		pfd = &thread->pollfd[thread->nr_pollfd++];
+		pfd->fd = fda->entries[i].fd;
+		pfd->events = fda->entries[i].events;
+	}
+
+	/* The last entry is for the stop pipe */
+	thread->pollfd[thread->nr_pollfd].fd = rec->thread_stop_pipe[0];
+	thread->pollfd[thread->nr_pollfd].events = POLLIN;
+	return 0;
+}
+
+static int record_thread__start(struct record_thread *thread)
+{
+	sigset_t full, old;
+	pthread_attr_t attr;
+	cpu_set_t mask;
+	int i, err;
+
+	err = record_thread__init(thread);
+	if (err)
+		return err;
+
+	CPU_ZERO(&mask);
+	for (i = 0; i < cpu_map__nr(thread->cpus); i++)
+		CPU_SET(thread->cpus->map[i], &mask);
+
+	pthread_attr_init(&attr);
+	pthread_attr_setaffinity_np(&attr, sizeof(mask), &mask);
+
+	/* The signals are handled by the main thread only */
+	sigfillset(&full);
+	pthread_sigmask(SIG_SETMASK, &full, &old);
+	err = pthread_create(&thread->tid, &attr, record_thread__run, thread);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	pthread_attr_destroy(&attr);
+
+	if (err) {
+		pr_err("failed to start a record thread: %s\n", strerror(err));
+		return -err;
+	}
+	return 0;
+}
+
+/*
+ * Runs the threads until recording is done, or until the events of all
+ * the threads are gone, then has them drain their ring buffers.
+ */
+static int record__run_threads(struct record *rec, unsigned long *waking)
+{
+	int i, err = 0, nr_running = 0, nr_exited = 0;
+	struct pollfd pfd;
+	char c = 0;
+
+	if (pipe(rec->thread_stop_pipe) < 0)
+		return -errno;
+	if (pipe(rec->thread_exit_pipe) < 0) {
+		err = -errno;
+		goto out_close_stop;
+	}
+
+	for (i = 0; i < rec->nr_threads; i++) {
+		err = record_thread__start(&rec->threads[i]);
+		if (err)
+			goto out_stop;
+		nr_running++;
+	}
+
+	pfd.fd = rec->thread_exit_pipe[0];
+	pfd.events = POLLIN;
+	while (!done && nr_exited < nr_running) {
+		if (poll(&pfd, 1, -1) > 0 && read(pfd.fd, &c, 1) == 1) {
+			if (c)
+				break;
+			nr_exited++;
+		}
+	}
+	c = 0;
+
+	/* As in the loop of __cmd_record(), a forked workload just ends */
+	if (!target__none(&rec->opts.target))
+		perf_evlist__disable(rec->evlist);
+
+out_stop:
+	if (write(rec->thread_stop_pipe[1], &c, 1) < 0 && !err)
+		err = -errno;
+
+	for (i = 0; i < nr_running; i++) {
+		struct record_thread *thread = &rec->threads[i];
+
+		pthread_join(thread->tid, NULL);
+		if (thread->err && !err)
+			err = thread->err;
+		*waking += thread->waking;
+		rec->samples += thread->samples;
+	}
+
+	close(rec->thread_exit_pipe[0]);
+	close(rec->thread_exit_pipe[1]);
+out_close_stop:
+	close(rec->thread_stop_pipe[0]);
+	close(rec->thread_stop_pipe[1]);
+	return err;
+}
+
 static void record__init_features(struct record *rec)
 {
 	struct perf_session *session = rec->session;
@@ -643,6 +903,7 @@ record__finish_output(struct record *rec)
 {
 	struct perf_data_file *file = &rec->file;
 	int fd = perf_data_file__fd(file);
+	int i;
 
 	if (file->is_pipe)
 		return;
@@ -650,6 +911,9 @@ record__finish_output(struct record *rec)
 	rec->session->header.data_size += rec->bytes_written;
 	file->size = lseek(perf_data_file__fd(file), 0, SEEK_CUR);
 
+	for (i = 0; i < file->nr_dir_files; i++)
+		file->dir_files[i].size = rec->threads[i].bytes_written;
+
 	if (!rec->no_buildid) {
 		process_buildids(rec);
 
@@ -1052,6 +1316,14 @@ static int __cmd_record(struct record *rec, int argc, const char **argv)
 	trigger_ready(&auxtrace_snapshot_trigger);
 	trigger_ready(&switch_output_trigger);
 	perf_hooks__invoke_record_start();
+
+	if (rec->nr_threads) {
+		err = record__run_threads(rec, &waking);
+		if (err)
+			goto out_child;
+		goto out_drained;
+	}
+
 	for (;;) {
 		unsigned long long hits = rec->samples;
 
@@ -1149,6 +1421,7 @@ static int __cmd_record(struct record *rec, int argc, const char **argv)
 			disabled = true;
 		}
 	}
+out_drained:
 	trigger_off(&auxtrace_snapshot_trigger);
 	trigger_off(&switch_output_trigger);
 
@@ -1203,9 +1476,14 @@ static int __cmd_record(struct record *rec, int argc, const char **argv)
 	perf_hooks__invoke_record_end();
 
 	if (!err && !quiet) {
+		unsigned long size = perf_data_file__size(file);
 		char samples[128];
 		const char *postfix = rec->timestamp_filename ?
 					".<timestamp>" : "";
+		int i;
+
+		for (i = 0; i < file->nr_dir_files; i++)
+			size += file->dir_files[i].size;
 
 		if (rec->samples && !rec->opts.full_auxtrace)
 			scnprintf(samples, sizeof(samples),
@@ -1214,7 +1492,7 @@ static int __cmd_record(struct record *rec, int argc, const char **argv)
 			samples[0] = '\0';
 
 		fprintf(stderr,	"[ perf record: Captured and wrote %.3f MB %s%s%s ]\n",
-			perf_data_file__size(file) / 1024.0 / 1024.0,
+			size / 1024.0 / 1024.0,
 			file->path, postfix, samples);
 	}
 
@@ -1446,6 +1724,129 @@ static void switch_output_size_warn(struct record *rec)
 	}
 }
 
+static void record__free_threads(struct record *rec)
+{
+	int i;
+
+	for (i = 0; i < rec->nr_threads; i++) {
+		cpu_map__put(rec->threads[i].cpus);
+		free(rec->threads[i].mmaps);
+		free(rec->threads[i].pollfd);
+	}
+	zfree(&rec->threads);
+	rec->nr_threads = 0;
+}
+
+static int record__add_thread(struct record *rec, struct cpu_map *cpus)
+{
+	struct record_thread *threads;
+
+	threads = realloc(rec->threads,
+			  (rec->nr_threads + 1) * sizeof(*threads));
+	if (!threads) {
+		cpu_map__put(cpus);
+		return -ENOMEM;
+	}
+
+	rec->threads = threads;
+	memset(&threads[rec->nr_threads], 0, sizeof(*threads));
+	threads[rec->nr_threads].rec = rec;
+	threads[rec->nr_threads].cpus = cpus;
+	rec->nr_threads++;
+	return 0;
+}
+
+/*
+ * --threads takes either 'cpu', for a thread per CPU, or a list of CPU
+ * lists separated by colons, e.g. 0-7:8-15, for a thread per list
+ * draining the ring buffers of these CPUs.  Each thread is pinned to
+ * its CPUs.
+ */
+static int record__init_threads(struct record *rec)
+{
+	struct cpu_map *cpus = rec->evlist->cpus;
+	char buf[16], *spec, *tok, *saveptr = NULL;
+	int i, t, err = 0;
+
+	if (!rec->threads_spec)
+		return 0;
+
+	if (rec->switch_output.enabled || rec->timestamp_filename) {
+		pr_err("--threads can't switch the output\n");
+		return -EINVAL;
+	}
+	if (rec->opts.overwrite) {
+		pr_err("--threads can't read overwritable ring buffers\n");
+		return -EINVAL;
+	}
+	if (rec->opts.full_auxtrace || rec->opts.auxtrace_snapshot_mode) {
+		pr_err("--threads doesn't support AUX area tracing yet\n");
+		return -EINVAL;
+	}
+	if (cpu_map__empty(cpus)) {
+		pr_err("--threads needs per-cpu ring buffers\n");
+		return -EINVAL;
+	}
+
+	if (!strcmp(rec->threads_spec, "cpu")) {
+		for (i = 0; !err && i < cpu_map__nr(cpus); i++) {
+			scnprintf(buf, sizeof(buf), "%d", cpus->map[i]);
+			err = record__add_thread(rec, cpu_map__new(buf));
+		}
+	} else {
+		spec = strdup(rec->threads_spec);
+		if (!spec)
+			return -ENOMEM;
+
+		for (tok = strtok_r(spec, ":", &saveptr); tok && !err;
+		     tok = strtok_r(NULL, ":", &saveptr)) {
+			struct cpu_map *map = cpu_map__new(tok);
+
+			if (!map) {
+				pr_err("invalid CPU list %s for --threads\n",
+				       tok);
+				err = -EINVAL;
+				break;
+			}
+			err = record__add_thread(rec, map);
+		}
+		free(spec);
+	}
+	if (err)
+		goto out_free;
+
+	for (i = 0; i < cpu_map__nr(cpus); i++) {
+		if (record__thread_idx(rec, i) < 0) {
+			pr_err("no --threads thread for CPU %d\n",
+			       cpus->map[i]);
+			err = -EINVAL;
+			goto out_free;
+		}
+	}
+
+	for (t = 0; t < rec->nr_threads; t++) {
+		for (i = 0; i < cpu_map__nr(cpus); i++)
+			if (record__thread_idx(rec, i) == t)
+				break;
+		if (i == cpu_map__nr(cpus)) {
+			pr_err("--threads thread %d has no recorded CPU\n", t);
+			err = -EINVAL;
+			goto out_free;
+		}
+	}
+
+	/* The files of the threads are sorted together by time */
+	rec->opts.sample_time = true;
+
+	rec->file.is_dir = true;
+	rec->file.nr_dir_files = rec->nr_threads;
+	return 0;
+
+out_free:
+	record__free_threads(rec);
+	return err;
+}
+
 static int switch_output_setup(struct record *rec)
 {
 	struct switch_output *s = &rec->switch_output;
@@ -1677,6 +2078,9 @@ static struct option __record_options[] = {
 			  &record.switch_output.set, "signal,size,time",
 			  "Switch output when receive SIGUSR2 or cross size,time threshold",
 			  "signal"),
+	OPT_STRING_OPTARG(0, "threads", &record.threads_spec, "cpu|cpu lists",
+			  "drain the ring buffers with a thread per CPU, or per CPU list (e.g. 0-7:8-15), into a perf.data directory",
+			  "cpu"),
 	OPT_BOOLEAN(0, "dry-run", &dry_run,
 		    "Parse options then exit"),
 	OPT_END()
@@ -1875,6 +2279,10 @@ int cmd_record(int argc, const char **argv)
 	if (rec->opts.full_auxtrace)
 		rec->buildid_all = true;
 
+	err = record__init_threads(rec);
+	if (err)
+		goto out;
+
 	if (record_opts__config(&rec->opts)) {
 		err = -EINVAL;
 		goto out;
@@ -1882,6 +2290,7 @@ int cmd_record(int argc, const char **argv)
 
 	err = __cmd_record(&record, argc, argv);
 out:
+	record__free_threads(rec);
 	perf_evlist__delete(rec->evlist);
 	symbol__exit();
 	auxtrace_record__free(rec->itr);
@@ -44,7 +44,9 @@
 #include <dlfcn.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <pthread.h>
 #include <regex.h>
+#include <sched.h>
 #include <signal.h>
 #include <linux/bitmap.h>
 #include <linux/stringify.h>
@@ -52,6 +54,8 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+struct report_decoder;
+
 struct report {
 	struct perf_tool	tool;
 	struct perf_session	*session;
@@ -76,6 +80,11 @@ struct report {
 	int			socket_filter;
 	DECLARE_BITMAP(cpu_bitmap, MAX_NR_CPUS);
 	struct branch_type_stat	brtype_stat;
+	struct report_decoder	*decoders;
+	unsigned int		nr_decoders;
+	bool			decoders_pending;
+	/* serializes the annotation and branch type updates of decoders */
+	pthread_mutex_t		callback_lock;
 };
 
 static int report__config(const char *var, const char *value, void *cb)
@@ -123,6 +132,9 @@ static int hist_iter__report_callback(struct hist_entry_iter *iter,
 	if (!ui__has_annotation())
 		return 0;
 
+	if (rep->nr_decoders)
+		pthread_mutex_lock(&rep->callback_lock);
+
 	hist__account_cycles(sample->branch_stack, al, sample,
 			     rep->nonany_branch_mode);
 
@@ -151,6 +163,8 @@ static int hist_iter__report_callback(struct hist_entry_iter *iter,
 	}
 
 out:
+	if (rep->nr_decoders)
+		pthread_mutex_unlock(&rep->callback_lock);
 	return err;
 }
 
@@ -164,34 +178,38 @@ static int hist_iter__branch_callback(struct hist_entry_iter *iter,
 	struct branch_info *bi;
 
 	bi = he->branch_info;
+
+	if (rep->nr_decoders)
+		pthread_mutex_lock(&rep->callback_lock);
 	branch_type_count(&rep->brtype_stat, &bi->flags,
 			  bi->from.addr, bi->to.addr);
+	if (rep->nr_decoders)
+		pthread_mutex_unlock(&rep->callback_lock);
 
 	return 0;
 }
 
-static int process_sample_event(struct perf_tool *tool,
-				union perf_event *event,
-				struct perf_sample *sample,
-				struct perf_evsel *evsel,
-				struct machine *machine)
+/*
+ * Resolve @sample and add it to @hists, or to the hists of @evsel when
+ * @hists is NULL.
+ */
+static int report__add_sample(struct report *rep, struct perf_evsel *evsel,
+			      struct perf_sample *sample,
+			      struct machine *machine, struct hists *hists)
 {
-	struct report *rep = container_of(tool, struct report, tool);
 	struct addr_location al;
 	struct hist_entry_iter iter = {
 		.evsel 			= evsel,
+		.hists			= hists,
 		.sample 		= sample,
 		.hide_unresolved 	= symbol_conf.hide_unresolved,
 		.add_entry_cb 		= hist_iter__report_callback,
 	};
 	int ret = 0;
 
-	if (perf_time__skip_sample(&rep->ptime, sample->time))
-		return 0;
-
 	if (machine__resolve(machine, &al, sample) < 0) {
 		pr_debug("problem processing %d event, skipping it.\n",
-			 event->header.type);
+			 PERF_RECORD_SAMPLE);
 		return -1;
 	}
 
@@ -219,8 +237,12 @@ static int process_sample_event(struct perf_tool *tool,
 		iter.ops = &hist_iter_normal;
 	}
 
-	if (al.map != NULL)
+	if (al.map != NULL && !al.map->dso->hit) {
+		/* 'hit' shares its byte with flags set by dso__load() */
+		pthread_mutex_lock(&al.map->dso->lock);
 		al.map->dso->hit = 1;
+		pthread_mutex_unlock(&al.map->dso->lock);
+	}
 
 	ret = hist_entry_iter__add(&iter, &al, rep->max_stack, rep);
 	if (ret < 0)
@@ -230,6 +252,20 @@ static int process_sample_event(struct perf_tool *tool,
 	return ret;
 }
 
+static int process_sample_event(struct perf_tool *tool,
+				union perf_event *event __maybe_unused,
+				struct perf_sample *sample,
+				struct perf_evsel *evsel,
+				struct machine *machine)
+{
+	struct report *rep = container_of(tool, struct report, tool);
+
+	if (perf_time__skip_sample(&rep->ptime, sample->time))
+		return 0;
+
+	return report__add_sample(rep, evsel, sample, machine, NULL);
+}
+
 static int process_read_event(struct perf_tool *tool,
 			      union perf_event *event,
 			      struct perf_sample *sample __maybe_unused,
@@ -517,6 +553,441 @@ static int report__browse_hists(struct report *rep)
 	return ret;
 }
 
+/*
+ * With --decode-threads the samples are resolved and added to the hists by
+ * a pool of decoders, each one taking the samples of a subset of the CPUs
+ * and adding them to private hists, merged into the evsel ones at the end.
+ * Symbols are loaded on demand by whichever decoder first needs them, the
+ * DSOs, maps and threads being shared by all of them.
+ *
+ * The events that change the machine and thread state (COMM, MMAP, FORK
+ * and so on) are still processed in order by the session thread, but only
+ * once the samples queued before them have been added, so every sample is
+ * resolved against the same state as in the serial case.
+ */
+#define DECODER_BATCH		64
+#define DECODER_MAX_QUEUED	(64 * DECODER_BATCH)
+
+struct decoder_sample {
+	struct list_head	node;
+	struct perf_evsel	*evsel;
+	struct machine		*machine;
+	struct perf_sample	sample;
+	u64			data[];
+};
+
+struct report_decoder {
+	struct report		*rep;
+	pthread_t		thread;
+	pthread_mutex_t		lock;
+	pthread_cond_t		work_cond;
+	pthread_cond_t		idle_cond;
+	struct list_head	queue;
+	unsigned int		nr_queued;
+	bool			busy;
+	bool			stop;
+	int			err;
+	/* filled by the session thread and queued a batch at a time */
+	struct list_head	batch;
+	unsigned int		nr_batch;
+	struct hists		*hists;		/* indexed by evsel->idx */
+};
+
+/*
+ * The sample points into the event, which doesn't outlive the delivery, so
+ * copy what the hists may look at.  The registers and the user stack are
+ * only used by the DWARF unwinder, with which the decoders are not used.
+ */
+static struct decoder_sample *decoder_sample__new(struct perf_evsel *evsel,
+						  struct machine *machine,
+						  struct perf_sample *sample)
+{
+	size_t callchain_size = 0, branch_size = 0, raw_size = 0;
+	struct decoder_sample *ds;
+	void *data;
+
+	if (sample->callchain)
+		callchain_size = (sample->callchain->nr + 1) * sizeof(u64);
+	if (sample->branch_stack)
+		branch_size = sizeof(struct branch_stack) +
+			      sample->branch_stack->nr *
+			      sizeof(struct branch_entry);
+	if (sample->raw_data)
+		raw_size = PERF_ALIGN(sample->raw_size, sizeof(u64));
+
+	ds = malloc(sizeof(*ds) + callchain_size + branch_size + raw_size);
+	if (ds == NULL)
+		return NULL;
+
+	ds->evsel = evsel;
+	ds->machine = machine;
+	ds->sample = *sample;
+	data = ds->data;
+
+	if (callchain_size) {
+		ds->sample.callchain = memcpy(data, sample->callchain,
+					      callchain_size);
+		data += callchain_size;
+	}
+	if (branch_size) {
+		ds->sample.branch_stack = memcpy(data, sample->branch_stack,
+						 branch_size);
+		data += branch_size;
+	}
+	if (raw_size)
+		ds->sample.raw_data = memcpy(data, sample->raw_data,
+					     sample->raw_size);
+
+	ds->sample.user_regs.regs = NULL;
+	ds->sample.intr_regs.regs = NULL;
+	ds->sample.user_stack.data = NULL;
+	ds->sample.user_stack.size = 0;
+	return ds;
+}
+
+static void report_decoder__process(struct report_decoder *dec,
+				    struct list_head *list)
+{
+	struct decoder_sample *ds, *tmp;
+	int err;
+
+	list_for_each_entry_safe(ds, tmp, list, node) {
+		list_del(&ds->node);
+
+		if (!dec->err) {
+			err = report__add_sample(dec->rep, ds->evsel,
+						 &ds->sample, ds->machine,
+						 &dec->hists[ds->evsel->idx]);
+			if (err) {
+				pthread_mutex_lock(&dec->lock);
+				dec->err = err;
+				pthread_mutex_unlock(&dec->lock);
+			}
+		}
+		free(ds);
+	}
+}
+
+static void *report_decoder__thread(void *arg)
+{
+	struct report_decoder *dec = arg;
+	LIST_HEAD(list);
+
+	/*
+	 * Loading the symbols of a DSO may have to setns() into the mount
+	 * namespace of its process, which is refused to a thread that shares
+	 * its filesystem information with others.
+	 */
+	unshare(CLONE_FS);
+
+	pthread_mutex_lock(&dec->lock);
+	while (true) {
+		while (list_empty(&dec->queue) && !dec->stop)
+			pthread_cond_wait(&dec->work_cond, &dec->lock);
+
+		if (list_empty(&dec->queue))
+			break;
+
+		list_splice_init(&dec->queue, &list);
+		dec->nr_queued = 0;
+		dec->busy = true;
+		pthread_cond_signal(&dec->idle_cond);
+		pthread_mutex_unlock(&dec->lock);
+
+		report_decoder__process(dec, &list);
+
+		pthread_mutex_lock(&dec->lock);
+		dec->busy = false;
+		pthread_cond_signal(&dec->idle_cond);
+	}
+	pthread_mutex_unlock(&dec->lock);
+
+	return NULL;
+}
+
+static int report_decoder__flush(struct report_decoder *dec)
+{
+	int err;
+
+	pthread_mutex_lock(&dec->lock);
+	if (dec->nr_batch) {
+		while (dec->nr_queued >= DECODER_MAX_QUEUED)
+			pthread_cond_wait(&dec->idle_cond, &dec->lock);
+
+		list_splice_tail_init(&dec->batch, &dec->queue);
+		dec->nr_queued += dec->nr_batch;
+		dec->nr_batch = 0;
+		pthread_cond_signal(&dec->work_cond);
+	}
+	err = dec->err;
+	pthread_mutex_unlock(&dec->lock);
+
+	return err;
+}
+
+static int report__drain_decoders(struct report *rep)
+{
+	struct report_decoder *dec;
+	unsigned int i;
+	int err = 0;
+
+	if (!rep->decoders_pending)
+		return 0;
+
+	for (i = 0; i < rep->nr_decoders; i++) {
+		dec = &rep->decoders[i];
+		if (!err)
+			err = report_decoder__flush(dec);
+	}
+
+	for (i = 0; i < rep->nr_decoders; i++) {
+		dec = &rep->decoders[i];
+
+		pthread_mutex_lock(&dec->lock);
+		while (!list_empty(&dec->queue) || dec->busy)
+			pthread_cond_wait(&dec->idle_cond, &dec->lock);
+		if (!err)
+			err = dec->err;
+		pthread_mutex_unlock(&dec->lock);
+	}
+
+	rep->decoders_pending = false;
+	return err;
+}
+
+static int process_sample_event_decoders(struct perf_tool *tool,
+					 union perf_event *event __maybe_unused,
+					 struct perf_sample *sample,
+					 struct perf_evsel *evsel,
+					 struct machine *machine)
+{
+	struct report *rep = container_of(tool, struct report, tool);
+	struct report_decoder *dec;
+	struct decoder_sample *ds;
+	u32 shard = sample->tid;
+	int err;
+
+	if (perf_time__skip_sample(&rep->ptime, sample->time))
+		return 0;
+
+	/*
+	 * Older perf.data files have no kernel MMAP events, in which case
+	 * machine__resolve() creates the kernel maps of the first kernel
+	 * sample: do it here, where it can't race with another decoder.
+	 */
+	if (sample->cpumode == PERF_RECORD_MISC_KERNEL &&
+	    machine__kernel_map(machine) == NULL) {
+		err = report__drain_decoders(rep);
+		if (err)
+			return err;
+		machine__create_kernel_maps(machine);
+	}
+
+	ds = decoder_sample__new(evsel, machine, sample);
+	if (ds == NULL)
+		return -ENOMEM;
+
+	if (evsel->attr.sample_type & PERF_SAMPLE_CPU)
+		shard = sample->cpu;
+
+	dec = &rep->decoders[shard % rep->nr_decoders];
+	list_add_tail(&ds->node, &dec->batch);
+	rep->decoders_pending = true;
+
+	if (++dec->nr_batch < DECODER_BATCH)
+		return 0;
+
+	return report_decoder__flush(dec);
+}
+
+static int process_sideband_event(struct perf_tool *tool,
+				  union perf_event *event,
+				  struct perf_sample *sample,
+				  struct machine *machine)
+{
+	struct report *rep = container_of(tool, struct report, tool);
+	int err;
+
+	err = report__drain_decoders(rep);
+	if (err)
+		return err;
+
+	return perf_event__process(tool, event, sample, machine);
+}
+
+/*
+ * Cases in which adding the samples concurrently is not safe: the DWARF
+ * unwinder, the source line lookups, the trace and dynamic sort keys
+ * (which find their evsel through the hists), the hierarchy mode and the
+ * instruction trace decoders, which look up the maps themselves.  Pipe
+ * mode may add events while the samples are being processed.
+ */
+static bool report__can_use_decoders(struct report *rep)
+{
+	struct perf_session *session = rep->session;
+	struct perf_evlist *evlist = session->evlist;
+	struct perf_evsel *pos;
+	struct perf_hpp_fmt *fmt;
+
+	if (perf_data_file__is_pipe(session->file) ||
+	    perf_header__has_feat(&session->header, HEADER_AUXTRACE) ||
+	    symbol_conf.report_hierarchy ||
+	    callchain_param.key == CCKEY_SRCLINE)
+		return false;
+
+	if (perf_evlist__combined_sample_type(evlist) & PERF_SAMPLE_STACK_USER)
+		return false;
+
+	evlist__for_each_entry(evlist, pos) {
+		if (pos->attr.type == PERF_TYPE_TRACEPOINT)
+			return false;
+	}
+
+	perf_hpp_list__for_each_sort_list(&perf_hpp_list, fmt) {
+		if (perf_hpp__is_srcline_entry(fmt) ||
+		    perf_hpp__is_srcfile_entry(fmt) ||
+		    perf_hpp__is_srcline_from_entry(fmt) ||
+		    perf_hpp__is_srcline_to_entry(fmt))
+			return false;
+	}
+
+	return true;
+}
+
+static void report_decoder__exit(struct report_decoder *dec,
+				 struct perf_evlist *evlist)
+{
+	struct perf_evsel *pos;
+
+	if (dec->hists) {
+		evlist__for_each_entry(evlist, pos)
+			pthread_mutex_destroy(&dec->hists[pos->idx].lock);
+		zfree(&dec->hists);
+	}
+	pthread_cond_destroy(&dec->idle_cond);
+	pthread_cond_destroy(&dec->work_cond);
+	pthread_mutex_destroy(&dec->lock);
+}
+
+static int report_decoder__init(struct report_decoder *dec,
+				struct report *rep)
+{
+	struct perf_evlist *evlist = rep->session->evlist;
+	struct perf_evsel *pos;
+
+	dec->rep = rep;
+	pthread_mutex_init(&dec->lock, NULL);
+	pthread_cond_init(&dec->work_cond, NULL);
+	pthread_cond_init(&dec->idle_cond, NULL);
+	INIT_LIST_HEAD(&dec->queue);
+	INIT_LIST_HEAD(&dec->batch);
+
+	dec->hists = calloc(evlist->nr_entries, sizeof(*dec->hists));
+	if (dec->hists == NULL)
+		return -ENOMEM;
+
+	evlist__for_each_entry(evlist, pos) {
+		__hists__init(&dec->hists[pos->idx],
+			      evsel__hists(pos)->hpp_list);
+	}
+
+	return 0;
+}
+
+static void report__start_decoders(struct report *rep)
+{
+	unsigned int i, nr = symbol_conf.nr_decode_threads;
+	struct report_decoder *dec;
+
+	if (nr > 1 && !report__can_use_decoders(rep)) {
+		pr_debug("The samples can't be decoded by several threads\n");
+		nr = 0;
+	}
+
+	if (nr > 1)
+		rep->decoders = calloc(nr, sizeof(*rep->decoders));
+
+	if (rep->decoders == NULL) {
+		symbol_conf.nr_decode_threads = 0;
+		return;
+	}
+
+	for (i = 0; i < nr; i++) {
+		dec = &rep->decoders[i];
+
+		if (report_decoder__init(dec, rep) ||
+		    pthread_create(&dec->thread, NULL,
+				   report_decoder__thread, dec)) {
+			report_decoder__exit(dec, rep->session->evlist);
+			break;
+		}
+	}
+
+	rep->nr_decoders = i;
+	if (rep->nr_decoders == 0) {
+		zfree(&rep->decoders);
+		symbol_conf.nr_decode_threads = 0;
+		return;
+	}
+
+	pthread_mutex_init(&rep->callback_lock, NULL);
+
+	rep->tool.sample     = process_sample_event_decoders;
+	rep->tool.mmap	     = process_sideband_event;
+	rep->tool.mmap2	     = process_sideband_event;
+	rep->tool.comm	     = process_sideband_event;
+	rep->tool.namespaces = process_sideband_event;
+	rep->tool.exit	     = process_sideband_event;
+	rep->tool.fork	     = process_sideband_event;
+}
+
+/*
+ * Wait for the decoders to add the samples still queued and merge their
+ * hists into the ones of the evsels, which then hold exactly what the
+ * serial processing would have added.
+ */
+static int report__stop_decoders(struct report *rep)
+{
+	struct perf_evlist *evlist = rep->session->evlist;
+	struct report_decoder *dec;
+	struct perf_evsel *pos;
+	unsigned int i;
+	int err, ret;
+
+	if (rep->nr_decoders == 0)
+		return 0;
+
+	ret = report__drain_decoders(rep);
+
+	for (i = 0; i < rep->nr_decoders; i++) {
+		dec = &rep->decoders[i];
+
+		pthread_mutex_lock(&dec->lock);
+		dec->stop = true;
+		pthread_cond_signal(&dec->work_cond);
+		pthread_mutex_unlock(&dec->lock);
+	}
+
+	for (i = 0; i < rep->nr_decoders; i++) {
+		dec = &rep->decoders[i];
+
+		pthread_join(dec->thread, NULL);
+
+		evlist__for_each_entry(evlist, pos) {
+			err = hists__merge(evsel__hists(pos),
+					   &dec->hists[pos->idx]);
+			if (err && !ret)
+				ret = err;
+		}
+		report_decoder__exit(dec, evlist);
+	}
+
+	pthread_mutex_destroy(&rep->callback_lock);
+	zfree(&rep->decoders);
+	rep->nr_decoders = 0;
+	return ret;
+}
+
 static int report__collapse_hists(struct report *rep)
 {
 	struct ui_progress prog;
@@ -566,7 +1037,7 @@ static void report__output_resort(struct report *rep)
 
 static int __cmd_report(struct report *rep)
 {
-	int ret;
+	int ret, err;
 	struct perf_session *session = rep->session;
 	struct perf_evsel *pos;
 	struct perf_data_file *file = session->file;
@@ -595,7 +1066,12 @@ static int __cmd_report(struct report *rep)
 		return ret;
 	}
 
+	report__start_decoders(rep);
+
 	ret = perf_session__process_events(session);
+	err = report__stop_decoders(rep);
+	if (!ret)
+		ret = err;
 	if (ret) {
 		ui__error("failed to process sample\n");
 		return ret;
@@ -871,6 +1347,10 @@ int cmd_report(int argc, const char **argv)
 		    "Show raw trace event output (do not use print fmt or plugins)"),
 	OPT_BOOLEAN(0, "hierarchy", &symbol_conf.report_hierarchy,
 		    "Show entries in a hierarchy"),
+	OPT_UINTEGER(0, "decode-threads", &symbol_conf.nr_decode_threads,
+		     "Number of threads adding the samples to the histograms"),
+	OPT_UINTEGER(0, "sort-threads", &symbol_conf.nr_sort_threads,
+		     "Number of threads sorting the callchains of the entries"),
 	OPT_CALLBACK_DEFAULT(0, "stdio-color", NULL, "mode",
 			     "'always' (default), 'never' or 'auto' only applicable to --stdio mode",
 			     stdio__config_color, "always"),
@@ -6,6 +6,8 @@
 #include <errno.h>
 #include <unistd.h>
 #include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
 
 #include "data.h"
 #include "util.h"
@@ -51,26 +53,29 @@ static int check_backup(struct perf_data_file *file)
 		char oldname[PATH_MAX];
 		snprintf(oldname, sizeof(oldname), "%s.old",
 			 file->path);
-		unlink(oldname);
+		if (!stat(oldname, &st) && S_ISDIR(st.st_mode))
+			rm_rf(oldname);
+		else
+			unlink(oldname);
 		rename(file->path, oldname);
 	}
 
 	return 0;
 }
 
-static int open_file_read(struct perf_data_file *file)
+static int __open_file_read(struct perf_data_file *file, const char *path)
 {
 	struct stat st;
 	int fd;
 	char sbuf[STRERR_BUFSIZE];
 
-	fd = open(file->path, O_RDONLY);
+	fd = open(path, O_RDONLY);
 	if (fd < 0) {
 		int err = errno;
 
-		pr_err("failed to open %s: %s", file->path,
+		pr_err("failed to open %s: %s", path,
 			str_error_r(err, sbuf, sizeof(sbuf)));
-		if (err == ENOENT && !strcmp(file->path, "perf.data"))
+		if (err == ENOENT && !strcmp(path, "perf.data"))
 			pr_err("  (try 'perf record' first)");
 		pr_err("\n");
 		return -err;
@@ -81,13 +86,13 @@ static int open_file_read(struct perf_data_file *file)
 
 	if (!file->force && st.st_uid && (st.st_uid != geteuid())) {
 		pr_err("File %s not owned by current user or root (use -f to override)\n",
-		       file->path);
+		       path);
 		goto out_close;
 	}
 
 	if (!st.st_size) {
 		pr_info("zero-sized file (%s), nothing to do!\n",
-			file->path);
+			path);
 		goto out_close;
 	}
 
@@ -99,6 +104,11 @@ static int open_file_read(struct perf_data_file *file)
 	return -1;
 }
 
+static int open_file_read(struct perf_data_file *file)
+{
+	return __open_file_read(file, file->path);
+}
+
 static int open_file_write(struct perf_data_file *file)
 {
 	int fd;
@@ -117,10 +127,165 @@ static int open_file_write(struct perf_data_file *file)
 	return fd;
 }
 
+static void close_dir_files(struct perf_data_file *file)
+{
+	int i;
+
+	for (i = 0; i < file->nr_dir_files; i++) {
+		if (file->dir_files[i].fd >= 0)
+			close(file->dir_files[i].fd);
+		free(file->dir_files[i].path);
+	}
+
+	zfree(&file->dir_files);
+	file->nr_dir_files = 0;
+}
+
+static int open_dir_file(struct perf_data_file *file,
+			 struct perf_data_dir_file *dir_file, int idx)
+{
+	char sbuf[STRERR_BUFSIZE];
+	struct stat st;
+
+	if (asprintf(&dir_file->path, "%s/data.%d", file->path, idx) < 0) {
+		dir_file->path = NULL;
+		return -ENOMEM;
+	}
+
+	if (perf_data_file__is_read(file))
+		dir_file->fd = open(dir_file->path, O_RDONLY);
+	else
+		dir_file->fd = open(dir_file->path,
+				    O_CREAT|O_RDWR|O_TRUNC|O_CLOEXEC,
+				    S_IRUSR|S_IWUSR);
+	if (dir_file->fd < 0) {
+		int err = errno;
+
+		if (err != ENOENT || !perf_data_file__is_read(file))
+			pr_err("failed to open %s: %s\n", dir_file->path,
+			       str_error_r(err, sbuf, sizeof(sbuf)));
+		return -err;
+	}
+
+	if (fstat(dir_file->fd, &st) < 0)
+		return -errno;
+
+	dir_file->size = st.st_size;
+	return 0;
+}
+
+/*
+ * A perf.data directory holds the header and the events not read from
+ * the ring buffers in its 'data' file, and the events each 'perf record'
+ * thread read from its ring buffers in 'data.<thread index>'.
+ */
+static int open_dir_read(struct perf_data_file *file)
+{
+	struct perf_data_dir_file *dir_files, *dir_file;
+	char *path;
+	int fd, err;
+
+	if (asprintf(&path, "%s/data", file->path) < 0)
+		return -ENOMEM;
+
+	fd = __open_file_read(file, path);
+	free(path);
+	if (fd < 0)
+		return fd;
+
+	for (;;) {
+		dir_files = realloc(file->dir_files, (file->nr_dir_files + 1) *
+				    sizeof(*dir_files));
+		if (!dir_files) {
+			err = -ENOMEM;
+			goto out_err;
+		}
+		file->dir_files = dir_files;
+
+		dir_file = &file->dir_files[file->nr_dir_files++];
+		dir_file->path = NULL;
+		dir_file->fd = -1;
+
+		err = open_dir_file(file, dir_file, file->nr_dir_files - 1);
+		if (err == -ENOENT) {
+			free(dir_file->path);
+			file->nr_dir_files--;
+			return fd;
+		}
+		if (err)
+			goto out_err;
+	}
+
+out_err:
+	close_dir_files(file);
+	close(fd);
+	return err;
+}
+
+static int open_dir_write(struct perf_data_file *file)
+{
+	char sbuf[STRERR_BUFSIZE];
+	int fd, err, i, nr = file->nr_dir_files;
+	char *path;
+
+	if (check_backup(file))
+		return -1;
+
+	if (mkdir(file->path, S_IRWXU) < 0) {
+		pr_err("failed to create %s : %s\n", file->path,
+			str_error_r(errno, sbuf, sizeof(sbuf)));
+		return -errno;
+	}
+
+	if (asprintf(&path, "%s/data", file->path) < 0)
+		return -ENOMEM;
+
+	fd = open(path, O_CREAT|O_RDWR|O_TRUNC|O_CLOEXEC, S_IRUSR|S_IWUSR);
+	if (fd < 0) {
+		err = -errno;
+		pr_err("failed to open %s : %s\n", path,
+			str_error_r(errno, sbuf, sizeof(sbuf)));
+		free(path);
+		return err;
+	}
+	free(path);
+
+	file->nr_dir_files = 0;
+	file->dir_files = calloc(nr, sizeof(*file->dir_files));
+	if (!file->dir_files) {
+		err = -ENOMEM;
+		goto out_err;
+	}
+
+	for (i = 0; i < nr; i++) {
+		file->dir_files[i].fd = -1;
+		file->nr_dir_files++;
+
+		err = open_dir_file(file, &file->dir_files[i], i);
+		if (err)
+			goto out_err;
+	}
+
+	return fd;
+
+out_err:
+	close_dir_files(file);
+	close(fd);
+	return err;
+}
+
 static int open_file(struct perf_data_file *file)
 {
 	int fd;
 
+	if (perf_data_file__is_dir(file)) {
+		fd = perf_data_file__is_read(file) ?
+		     open_dir_read(file) : open_dir_write(file);
+
+		file->fd = fd;
+		return fd < 0 ? -1 : 0;
+	}
+
 	fd = perf_data_file__is_read(file) ?
 	     open_file_read(file) : open_file_write(file);
 
@@ -130,17 +295,24 @@ static int open_file(struct perf_data_file *file)
 
 int perf_data_file__open(struct perf_data_file *file)
 {
+	struct stat st;
+
 	if (check_pipe(file))
-		return 0;
+		return perf_data_file__is_dir(file) ? -EINVAL : 0;
 
 	if (!file->path)
 		file->path = "perf.data";
 
+	if (perf_data_file__is_read(file) &&
+	    !stat(file->path, &st) && S_ISDIR(st.st_mode))
+		file->is_dir = true;
+
 	return open_file(file);
 }
 
 void perf_data_file__close(struct perf_data_file *file)
 {
+	close_dir_files(file);
 	close(file->fd);
 }
 
@@ -150,6 +322,12 @@ ssize_t perf_data_file__write(struct perf_data_file *file,
 	return writen(file->fd, buf, size);
 }
 
+ssize_t perf_data_dir_file__write(struct perf_data_dir_file *dir_file,
+				  void *buf, size_t size)
+{
+	return writen(dir_file->fd, buf, size);
+}
+
 int perf_data_file__switch(struct perf_data_file *file,
 			   const char *postfix,
 			   size_t pos, bool at_exit)
@@ -159,7 +337,7 @@ int perf_data_file__switch(struct perf_data_file *file,
 
 	if (check_pipe(file))
 		return -EINVAL;
-	if (perf_data_file__is_read(file))
+	if (perf_data_file__is_read(file) || perf_data_file__is_dir(file))
 		return -EINVAL;
 
 	if (asprintf(&new_filepath, "%s.%s", file->path, postfix) < 0)
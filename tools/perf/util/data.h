@@ -9,13 +9,27 @@ enum perf_data_mode {
 	PERF_DATA_MODE_READ,
 };
 
+/*
+ * One of the streams of events of a perf.data directory, written by a
+ * 'perf record --threads' thread next to the 'data' file holding the
+ * header.
+ */
+struct perf_data_dir_file {
+	char			*path;
+	int			 fd;
+	unsigned long		 size;
+};
+
 struct perf_data_file {
 	const char		*path;
 	int			 fd;
 	bool			 is_pipe;
+	bool			 is_dir;
 	bool			 force;
 	unsigned long		 size;
 	enum perf_data_mode	 mode;
+	int			 nr_dir_files;
+	struct perf_data_dir_file *dir_files;
 };
 
 static inline bool perf_data_file__is_read(struct perf_data_file *file)
@@ -33,6 +47,11 @@ static inline int perf_data_file__is_pipe(struct perf_data_file *file)
 	return file->is_pipe;
 }
 
+static inline bool perf_data_file__is_dir(struct perf_data_file *file)
+{
+	return file->is_dir;
+}
+
 static inline int perf_data_file__fd(struct perf_data_file *file)
 {
 	return file->fd;
@@ -47,6 +66,8 @@ int perf_data_file__open(struct perf_data_file *file);
 void perf_data_file__close(struct perf_data_file *file);
 ssize_t perf_data_file__write(struct perf_data_file *file,
 			      void *buf, size_t size);
+ssize_t perf_data_dir_file__write(struct perf_data_dir_file *dir_file,
+				  void *buf, size_t size);
 /*
  * If at_exit is set, only rename current perf.data to
  * perf.data.<postfix>, continue write on original file.
@@ -679,7 +679,7 @@ iter_add_single_mem_entry(struct hist_entry_iter *iter, struct addr_location *al
 {
 	u64 cost;
 	struct mem_info *mi = iter->priv;
-	struct hists *hists = evsel__hists(iter->evsel);
+	struct hists *hists = iter->hists;
 	struct perf_sample *sample = iter->sample;
 	struct hist_entry *he;
 
@@ -712,8 +712,7 @@ static int
 iter_finish_mem_entry(struct hist_entry_iter *iter,
 		      struct addr_location *al __maybe_unused)
 {
-	struct perf_evsel *evsel = iter->evsel;
-	struct hists *hists = evsel__hists(evsel);
+	struct hists *hists = iter->hists;
 	struct hist_entry *he = iter->he;
 	int err = -EINVAL;
 
@@ -782,8 +781,7 @@ static int
 iter_add_next_branch_entry(struct hist_entry_iter *iter, struct addr_location *al)
 {
 	struct branch_info *bi;
-	struct perf_evsel *evsel = iter->evsel;
-	struct hists *hists = evsel__hists(evsel);
+	struct hists *hists = iter->hists;
 	struct perf_sample *sample = iter->sample;
 	struct hist_entry *he = NULL;
 	int i = iter->curr;
@@ -834,11 +832,10 @@ iter_prepare_normal_entry(struct hist_entry_iter *iter __maybe_unused,
 static int
 iter_add_single_normal_entry(struct hist_entry_iter *iter, struct addr_location *al)
 {
-	struct perf_evsel *evsel = iter->evsel;
 	struct perf_sample *sample = iter->sample;
 	struct hist_entry *he;
 
-	he = hists__add_entry(evsel__hists(evsel), al, iter->parent, NULL, NULL,
+	he = hists__add_entry(iter->hists, al, iter->parent, NULL, NULL,
 			      sample, true);
 	if (he == NULL)
 		return -ENOMEM;
@@ -852,7 +849,6 @@ iter_finish_normal_entry(struct hist_entry_iter *iter,
 			 struct addr_location *al __maybe_unused)
 {
 	struct hist_entry *he = iter->he;
-	struct perf_evsel *evsel = iter->evsel;
 	struct perf_sample *sample = iter->sample;
 
 	if (he == NULL)
@@ -860,7 +856,7 @@ iter_finish_normal_entry(struct hist_entry_iter *iter,
 
 	iter->he = NULL;
 
-	hists__inc_nr_samples(evsel__hists(evsel), he->filtered);
+	hists__inc_nr_samples(iter->hists, he->filtered);
 
 	return hist_entry__append_callchain(he, sample);
 }
@@ -892,8 +888,7 @@ static int
 iter_add_single_cumulative_entry(struct hist_entry_iter *iter,
 				 struct addr_location *al)
 {
-	struct perf_evsel *evsel = iter->evsel;
-	struct hists *hists = evsel__hists(evsel);
+	struct hists *hists = iter->hists;
 	struct perf_sample *sample = iter->sample;
 	struct hist_entry **he_cache = iter->priv;
 	struct hist_entry *he;
@@ -937,12 +932,11 @@ static int
 iter_add_next_cumulative_entry(struct hist_entry_iter *iter,
 			       struct addr_location *al)
 {
-	struct perf_evsel *evsel = iter->evsel;
 	struct perf_sample *sample = iter->sample;
 	struct hist_entry **he_cache = iter->priv;
 	struct hist_entry *he;
 	struct hist_entry he_tmp = {
-		.hists = evsel__hists(evsel),
+		.hists = iter->hists,
 		.cpu = al->cpu,
 		.thread = al->thread,
 		.comm = thread__comm(al->thread),
@@ -974,7 +968,7 @@ iter_add_next_cumulative_entry(struct hist_entry_iter *iter,
 		}
 	}
 
-	he = hists__add_entry(evsel__hists(evsel), al, iter->parent, NULL, NULL,
+	he = hists__add_entry(iter->hists, al, iter->parent, NULL, NULL,
 			      sample, false);
 	if (he == NULL)
 		return -ENOMEM;
@@ -1038,6 +1032,9 @@ int hist_entry_iter__add(struct hist_entry_iter *iter, struct addr_location *al,
 	if (al && al->map)
 		alm = map__get(al->map);
 
+	if (iter->hists == NULL)
+		iter->hists = evsel__hists(iter->evsel);
+
 	err = sample__resolve_callchain(iter->sample, &callchain_cursor, &iter->parent,
 					iter->evsel, al, max_stack_depth);
 	if (err)
@@ -1504,6 +1501,81 @@ int hists__collapse_resort(struct hists *hists, struct ui_progress *prog)
 	return 0;
 }
 
+/*
+ * Move the entries added to @from, which must share its sort keys with
+ * @hists, into the input tree of @hists, folding each of them into the
+ * entry @hists already has for the same keys, if any.  This is how the
+ * hists filled by the decoding threads of perf report end up in the
+ * ones of their evsel, before the collapse.
+ */
+int hists__merge(struct hists *hists, struct hists *from)
+{
+	struct rb_root *root = from->entries_in;
+	struct rb_node **p, *parent, *next;
+	struct hist_entry *iter, *he;
+	int64_t cmp;
+	int ret = 0;
+
+	while ((next = rb_first(root)) != NULL) {
+		he = rb_entry(next, struct hist_entry, rb_node_in);
+		rb_erase(next, root);
+
+		p = &hists->entries_in->rb_node;
+		parent = NULL;
+		iter = NULL;
+
+		while (*p != NULL) {
+			parent = *p;
+			iter = rb_entry(parent, struct hist_entry, rb_node_in);
+
+			cmp = hist_entry__cmp(iter, he);
+			if (!cmp)
+				break;
+
+			if (cmp < 0)
+				p = &(*p)->rb_left;
+			else
+				p = &(*p)->rb_right;
+			iter = NULL;
+		}
+
+		if (iter) {
+			he_stat__add_stat(&iter->stat, &he->stat);
+			if (symbol_conf.cumulate_callchain)
+				he_stat__add_stat(iter->stat_acc, he->stat_acc);
+
+			if (symbol_conf.use_callchain) {
+				callchain_cursor_reset(&callchain_cursor);
+				if (callchain_merge(&callchain_cursor,
+						    iter->callchain,
+						    he->callchain) < 0)
+					ret = -1;
+			}
+			hist_entry__delete(he);
+			continue;
+		}
+
+		he->hists = hists;
+		hists->nr_entries++;
+
+		rb_link_node(&he->rb_node_in, parent, p);
+		rb_insert_color(&he->rb_node_in, hists->entries_in);
+	}
+
+	hists->callchain_period += from->callchain_period;
+	hists->callchain_non_filtered_period +=
+		from->callchain_non_filtered_period;
+	hists->stats.nr_events[PERF_RECORD_SAMPLE] +=
+		from->stats.nr_events[PERF_RECORD_SAMPLE];
+	/* nr_events[0] counts the events of all types */
+	hists->stats.nr_events[0] += from->stats.nr_events[0];
+	hists->stats.nr_non_filtered_samples +=
+		from->stats.nr_non_filtered_samples;
+
+	from->nr_entries = 0;
+	return ret;
+}
+
 static int hist_entry__sort(struct hist_entry *a, struct hist_entry *b)
 {
 	struct hists *hists = a->hists;
@@ -1604,6 +1676,22 @@ static void hierarchy_insert_output_entry(struct rb_root *root,
 	}
 }
 
+static void hist_entry__sort_callchain(struct hist_entry *he,
+				       u64 min_callchain_hits)
+{
+	if (callchain_param.mode == CHAIN_GRAPH_REL) {
+		u64 total = he->stat.period;
+
+		if (symbol_conf.cumulate_callchain)
+			total = he->stat_acc->period;
+
+		min_callchain_hits = total * (callchain_param.min_percent / 100);
+	}
+
+	callchain_param.sort(&he->sorted_chain, he->callchain,
+			     min_callchain_hits, &callchain_param);
+}
+
 static void hists__hierarchy_output_resort(struct hists *hists,
 					   struct ui_progress *prog,
 					   struct rb_root *root_in,
@@ -1644,17 +1732,7 @@ static void hists__hierarchy_output_resort(struct hists *hists,
 		if (!use_callchain)
 			continue;
 
-		if (callchain_param.mode == CHAIN_GRAPH_REL) {
-			u64 total = he->stat.period;
-
-			if (symbol_conf.cumulate_callchain)
-				total = he->stat_acc->period;
-
-			min_callchain_hits = total * (callchain_param.min_percent / 100);
-		}
-
-		callchain_param.sort(&he->sorted_chain, he->callchain,
-				     min_callchain_hits, &callchain_param);
+		hist_entry__sort_callchain(he, min_callchain_hits);
 	}
 }
 
@@ -1668,18 +1746,8 @@ static void __hists__insert_output_entry(struct rb_root *entries,
 	struct hist_entry *iter;
 	struct perf_hpp_fmt *fmt;
 
-	if (use_callchain) {
-		if (callchain_param.mode == CHAIN_GRAPH_REL) {
-			u64 total = he->stat.period;
-
-			if (symbol_conf.cumulate_callchain)
-				total = he->stat_acc->period;
-
-			min_callchain_hits = total * (callchain_param.min_percent / 100);
-		}
-		callchain_param.sort(&he->sorted_chain, he->callchain,
-				      min_callchain_hits, &callchain_param);
-	}
+	if (use_callchain)
+		hist_entry__sort_callchain(he, min_callchain_hits);
 
 	while (*p != NULL) {
 		parent = *p;
@@ -1701,6 +1769,132 @@ static void __hists__insert_output_entry(struct rb_root *entries,
 	}
 }
 
+struct callchain_sort_arg {
+	struct hist_entry	**entries;
+	unsigned long		nr_entries;
+	unsigned int		idx;
+	unsigned int		nr_threads;
+	u64			min_callchain_hits;
+};
+
+static void *callchain_sort_thread(void *arg)
+{
+	struct callchain_sort_arg *sa = arg;
+	unsigned long i;
+
+	for (i = sa->idx; i < sa->nr_entries; i += sa->nr_threads)
+		hist_entry__sort_callchain(sa->entries[i],
+					   sa->min_callchain_hits);
+	return NULL;
+}
+
+/*
+ * Sorting the callchain of an entry only touches that entry, so with
+ * symbol_conf.nr_sort_threads the callchains are sorted by several threads
+ * before the entries are inserted in the output tree, in their usual order.
+ * The share of the threads that couldn't be started is done by the caller.
+ */
+static void hists__sort_callchains(struct hist_entry **entries,
+				   unsigned long nr_entries,
+				   u64 min_callchain_hits)
+{
+	unsigned int i, nr_started, nr_threads;
+	struct callchain_sort_arg *args;
+	pthread_t *threads;
+
+	nr_threads = symbol_conf.nr_sort_threads;
+	if (nr_threads > nr_entries)
+		nr_threads = nr_entries;
+
+	args = calloc(nr_threads, sizeof(*args));
+	threads = calloc(nr_threads, sizeof(*threads));
+	if (args == NULL || threads == NULL)
+		nr_threads = 1;
+
+	if (nr_threads < 2) {
+		struct callchain_sort_arg sa = {
+			.entries		= entries,
+			.nr_entries		= nr_entries,
+			.nr_threads		= 1,
+			.min_callchain_hits	= min_callchain_hits,
+		};
+
+		callchain_sort_thread(&sa);
+		goto out_free;
+	}
+
+	for (i = 0; i < nr_threads; i++) {
+		args[i].entries		   = entries;
+		args[i].nr_entries	   = nr_entries;
+		args[i].idx		   = i;
+		args[i].nr_threads	   = nr_threads;
+		args[i].min_callchain_hits = min_callchain_hits;
+	}
+
+	for (nr_started = 0; nr_started < nr_threads; nr_started++) {
+		if (pthread_create(&threads[nr_started], NULL,
+				   callchain_sort_thread, &args[nr_started]))
+			break;
+	}
+
+	for (i = nr_started; i < nr_threads; i++)
+		callchain_sort_thread(&args[i]);
+
+	for (i = 0; i < nr_started; i++)
+		pthread_join(threads[i], NULL);
+out_free:
+	free(threads);
+	free(args);
+}
+
+static int output_resort_threaded(struct hists *hists,
+				  struct ui_progress *prog,
+				  struct rb_root *root,
+				  u64 min_callchain_hits,
+				  hists__resort_cb_t cb)
+{
+	struct hist_entry **entries, *n;
+	unsigned long nr_entries = 0, i;
+	struct rb_node *next;
+
+	for (next = rb_first(root); next; next = rb_next(next))
+		nr_entries++;
+
+	entries = malloc(nr_entries * sizeof(*entries));
+	if (entries == NULL)
+		return -ENOMEM;
+
+	nr_entries = 0;
+	for (next = rb_first(root); next; next = rb_next(next)) {
+		n = rb_entry(next, struct hist_entry, rb_node_in);
+
+		if (cb && cb(n))
+			continue;
+
+		entries[nr_entries++] = n;
+	}
+
+	hists__sort_callchains(entries, nr_entries, min_callchain_hits);
+
+	hists->entries = RB_ROOT;
+
+	for (i = 0; i < nr_entries; i++) {
+		n = entries[i];
+
+		__hists__insert_output_entry(&hists->entries, n, 0, false);
+		hists__inc_stats(hists, n);
+
+		if (!n->filtered)
+			hists__calc_col_len(hists, n);
+
+		if (prog)
+			ui_progress__update(prog, 1);
+	}
+
+	free(entries);
+	return 0;
+}
+
 static void output_resort(struct hists *hists, struct ui_progress *prog,
 			  bool use_callchain, hists__resort_cb_t cb)
 {
@@ -1734,6 +1928,10 @@ static void output_resort(struct hists *hists, struct ui_progress *prog,
 	else
 		root = hists->entries_in;
 
+	if (use_callchain && symbol_conf.nr_sort_threads > 1 &&
+	    !output_resort_threaded(hists, prog, root, min_callchain_hits, cb))
+		return;
+
 	next = rb_first(root);
 	hists->entries = RB_ROOT;
 
@@ -110,6 +110,7 @@ struct hist_entry_iter {
 	int max_stack;
 
 	struct perf_evsel *evsel;
+	struct hists *hists;	/* evsel__hists(evsel) if not set */
 	struct perf_sample *sample;
 	struct hist_entry *he;
 	struct symbol *parent;
@@ -165,6 +166,7 @@ void hists__output_resort(struct hists *hists, struct ui_progress *prog);
 void hists__output_resort_cb(struct hists *hists, struct ui_progress *prog,
 			     hists__resort_cb_t cb);
 int hists__collapse_resort(struct hists *hists, struct ui_progress *prog);
+int hists__merge(struct hists *hists, struct hists *from);
 
 void hists__decay_entries(struct hists *hists, bool zap_user, bool zap_kernel);
 void hists__delete_entries(struct hists *hists);
@@ -355,6 +357,8 @@ bool perf_hpp__defined_dynamic_entry(struct perf_hpp_fmt *fmt, struct hists *his
 bool perf_hpp__is_trace_entry(struct perf_hpp_fmt *fmt);
 bool perf_hpp__is_srcline_entry(struct perf_hpp_fmt *fmt);
 bool perf_hpp__is_srcfile_entry(struct perf_hpp_fmt *fmt);
+bool perf_hpp__is_srcline_from_entry(struct perf_hpp_fmt *fmt);
+bool perf_hpp__is_srcline_to_entry(struct perf_hpp_fmt *fmt);
 bool perf_hpp__is_thread_entry(struct perf_hpp_fmt *fmt);
 bool perf_hpp__is_comm_entry(struct perf_hpp_fmt *fmt);
 bool perf_hpp__is_dso_entry(struct perf_hpp_fmt *fmt);
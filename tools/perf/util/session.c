@@ -1823,13 +1823,10 @@ fetch_mmaped_event(struct perf_session *session,
 #define NUM_MMAPS 128
 #endif
 
-static int __perf_session__process_events(struct perf_session *session,
-					  u64 data_offset, u64 data_size,
-					  u64 file_size)
+static int __perf_session__read_events(struct perf_session *session, int fd,
+				       u64 data_offset, u64 data_size,
+				       u64 file_size, bool dir_file)
 {
-	struct ordered_events *oe = &session->ordered_events;
-	struct perf_tool *tool = session->tool;
-	int fd = perf_data_file__fd(session->file);
 	u64 head, page_offset, file_offset, file_pos, size;
 	int err, mmap_prot, mmap_flags, map_idx = 0;
 	size_t	mmap_size;
@@ -1838,24 +1835,27 @@ static int __perf_session__process_events(struct perf_session *session,
 	struct ui_progress prog;
 	s64 skip;
 
-	perf_tool__fill_defaults(tool);
-
 	page_offset = page_size * (data_offset / page_size);
 	file_offset = page_offset;
 	head = data_offset - page_offset;
 
 	if (data_size == 0)
-		goto out;
+		return 0;
 
 	if (data_offset + data_size < file_size)
 		file_size = data_offset + data_size;
 
 	ui_progress__init(&prog, file_size, "Processing events...");
 
+	/*
+	 * The one mmap of the file is looked up by the offsets of the
+	 * events, which are only unique within the 'data' file.
+	 */
+	session->one_mmap = false;
 	mmap_size = MMAP_SIZE;
 	if (mmap_size > file_size) {
 		mmap_size = file_size;
-		session->one_mmap = true;
+		session->one_mmap = !dir_file;
 	}
 
 	memset(mmaps, 0, sizeof(mmaps));
@@ -1923,6 +1923,46 @@ static int __perf_session__process_events(struct perf_session *session,
 		goto more;
 
 out:
+	err = 0;
+out_err:
+	ui_progress__finish();
+	return err;
+}
+
+static int __perf_session__process_events(struct perf_session *session,
+					  u64 data_offset, u64 data_size,
+					  u64 file_size)
+{
+	struct ordered_events *oe = &session->ordered_events;
+	struct perf_data_file *file = session->file;
+	struct perf_tool *tool = session->tool;
+	int i, err;
+
+	perf_tool__fill_defaults(tool);
+
+#if BITS_PER_LONG != 64
+	/*
+	 * The events of the files of a directory are only sorted together
+	 * by the final flush, after their mmaps were recycled.
+	 */
+	if (perf_data_file__is_dir(file))
+		ordered_events__set_copy_on_queue(oe, true);
+#endif
+
+	err = __perf_session__read_events(session, perf_data_file__fd(file),
+					  data_offset, data_size, file_size,
+					  false);
+
+	for (i = 0; !err && i < file->nr_dir_files && !session_done(); i++) {
+		struct perf_data_dir_file *dir_file = &file->dir_files[i];
+
+		err = __perf_session__read_events(session, dir_file->fd, 0,
+						  dir_file->size,
+						  dir_file->size, true);
+	}
+	if (err)
+		goto out_err;
+
 	/* do the final flush for ordered samples */
 	err = ordered_events__flush(oe, OE_FLUSH__FINAL);
 	if (err)
@@ -1932,7 +1972,6 @@ static int __perf_session__process_events(struct perf_session *session,
 		goto out_err;
 	err = perf_session__flush_thread_stacks(session);
 out_err:
-	ui_progress__finish();
 	perf_session__warn_about_errors(session);
 	/*
 	 * We may switching perf.data output, make ordered_events
@@ -1726,6 +1726,8 @@ bool perf_hpp__is_ ## key ## _entry(struct perf_hpp_fmt *fmt)	\
 MK_SORT_ENTRY_CHK(trace)
 MK_SORT_ENTRY_CHK(srcline)
 MK_SORT_ENTRY_CHK(srcfile)
+MK_SORT_ENTRY_CHK(srcline_from)
+MK_SORT_ENTRY_CHK(srcline_to)
 MK_SORT_ENTRY_CHK(thread)
 MK_SORT_ENTRY_CHK(comm)
 MK_SORT_ENTRY_CHK(dso)
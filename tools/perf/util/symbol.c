@@ -501,6 +501,13 @@ void dso__insert_symbol(struct dso *dso, enum map_type type, struct symbol *sym)
 struct symbol *dso__find_symbol(struct dso *dso,
 				enum map_type type, u64 addr)
 {
+	/*
+	 * The symbols may be looked up by several perf report decoding
+	 * threads at once, and the cache can't be updated atomically.
+	 */
+	if (symbol_conf.nr_decode_threads > 1)
+		return symbols__find(&dso->symbols[type], addr);
+
 	if (dso->last_find_result[type].addr != addr || dso->last_find_result[type].symbol == NULL) {
 		dso->last_find_result[type].addr   = addr;
 		dso->last_find_result[type].symbol = symbols__find(&dso->symbols[type], addr);
@@ -89,6 +89,8 @@ struct intlist;
 struct symbol_conf {
 	unsigned short	priv_size;
 	unsigned short	nr_events;
+	unsigned int	nr_sort_threads;
+	unsigned int	nr_decode_threads;
 	bool		try_vmlinux_path,
 			init_annotation,
 			force,
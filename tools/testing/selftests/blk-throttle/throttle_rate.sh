@@ -0,0 +1,157 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Measure what blk-throttle costs to bios that are within their budget
+#
+# Load null_blk with one queue per CPU and read it with one job per CPU
+# from a cgroup v2 group, first without any limit, then with an io.max
+# limit far above what the device can do, and report the IOPS of both and
+# the overhead of the limit.  Then set a low limit and check that it is
+# still enforced.  fio is used when available, dd otherwise.  Pass the
+# runtime of each pass in seconds as the first argument, default is 10.
+
+readonly RUNTIME="${1:-10}"
+readonly LOW_IOPS=2000
+readonly RAND="$(mktemp -u XXXXXX)"
+readonly DEV=/dev/nullb0
+
+cgroot=""
+cgmounted=0
+cg=""
+ret=0
+
+cleanup()
+{
+	[ -n "${cg}" ] && rmdir "${cg}" 2>/dev/null
+	if [ "${cgmounted}" -eq 1 ]; then
+		umount "${cgroot}"
+		rmdir "${cgroot}"
+	fi
+	[ -e /sys/module/null_blk ] && rmmod null_blk
+}
+
+cpus()
+{
+	local cpu
+
+	for cpu in /sys/devices/system/cpu/cpu[0-9]*; do
+		[ "$(cat "${cpu}/online" 2>/dev/null)" = 0 ] && continue
+		echo "${cpu##*cpu}"
+	done
+}
+
+# Print the read IOPS of one pass, run from the test group
+run_fio()
+{
+	sh -c "echo \$\$ > ${cg}/cgroup.procs &&
+	       exec fio --name=throttle --filename=${DEV} --direct=1 \
+			--rw=randread --bs=4k --ioengine=libaio --iodepth=32 \
+			--numjobs=$(cpus | wc -l) --cpus_allowed_policy=split \
+			--cpus_allowed=$(cpus | paste -sd,) \
+			--time_based --runtime=${RUNTIME} --group_reporting \
+			--minimal" | awk -F';' '{ print $8 }'
+}
+
+run_dd()
+{
+	local out="$(mktemp -d)"
+	local cpu bytes=0 b
+
+	for cpu in $(cpus); do
+		sh -c "echo \$\$ > ${cg}/cgroup.procs &&
+		       exec taskset -c ${cpu} timeout -s INT ${RUNTIME} \
+			    dd if=${DEV} of=/dev/null bs=4k iflag=direct" \
+			2> "${out}/${cpu}" &
+	done
+	wait
+
+	for cpu in $(cpus); do
+		b="$(awk '/bytes/ { print $1 }' "${out}/${cpu}" | tail -n 1)"
+		bytes=$(( bytes + ${b:-0} ))
+	done
+	rm -rf "${out}"
+
+	echo $(( bytes / 4096 / RUNTIME ))
+}
+
+run()
+{
+	if command -v fio > /dev/null; then
+		run_fio
+	else
+		run_dd
+	fi
+}
+
+trap cleanup EXIT
+
+if [ "$(id -u)" -ne 0 ]; then
+	echo "SKIP: need root privileges"
+	exit 0
+fi
+
+if [ -e /sys/module/null_blk ]; then
+	echo "SKIP: null_blk is already loaded"
+	exit 0
+fi
+
+if ! modprobe null_blk queue_mode=2 nr_devices=1 irqmode=0 \
+     submit_queues="$(cpus | wc -l)" hw_queue_depth=256 2>/dev/null; then
+	echo "SKIP: could not load null_blk"
+	exit 0
+fi
+readonly MAJMIN="$(cat /sys/block/nullb0/dev)"
+
+cgroot="$(awk '$3 == "cgroup2" { print $2; exit }' /proc/mounts)"
+if [ -z "${cgroot}" ]; then
+	cgroot="$(mktemp -d)"
+	if ! mount -t cgroup2 none "${cgroot}"; then
+		rmdir "${cgroot}"
+		cgroot=""
+		echo "SKIP: could not mount cgroup2"
+		exit 0
+	fi
+	cgmounted=1
+fi
+
+if ! echo "+io" > "${cgroot}/cgroup.subtree_control"; then
+	echo "SKIP: could not enable the io controller"
+	exit 0
+fi
+
+cg="${cgroot}/throttle-${RAND}"
+mkdir "${cg}"
+
+base="$(run)"
+echo "no limit: ${base} IOPS"
+
+echo "${MAJMIN} riops=1000000000 rbps=1099511627776" > "${cg}/io.max"
+limited="$(run)"
+echo "high limit: ${limited} IOPS"
+
+if [ "${base:-0}" -gt 0 ]; then
+	echo "overhead: $(( (base - ${limited:-0}) * 100 / base ))%"
+else
+	echo "no I/O done without a limit"
+	ret=1
+fi
+
+echo "${MAJMIN} riops=${LOW_IOPS} rbps=max" > "${cg}/io.max"
+low="$(run)"
+echo "low limit: ${low} IOPS (limit ${LOW_IOPS})"
+
+# Allow for the first slice and the per-cpu batches charged in advance
+if [ "${low:-0}" -gt $(( LOW_IOPS * 11 / 10 )) ]; then
+	echo "low limit exceeded"
+	ret=1
+fi
+
+echo "${MAJMIN} riops=max rbps=max" > "${cg}/io.max"
+
+if [ "${ret}" -ne 0 ]; then
+	echo "FAIL"
+	exit 1
+fi
+
+echo "OK"
+exit 0
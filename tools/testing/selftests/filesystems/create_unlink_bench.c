@@ -0,0 +1,231 @@
+/* Measure multi-threaded create and unlink throughput in one directory
+ *
+ * A set of threads keeps creating and unlinking files of their own in a
+ * single directory, each one keeping a backlog of its files in place so
+ * that the directory stays large.  The directory is first filled with a
+ * number of files that are left alone, to get it past a single block and
+ * into an indexed (htree) directory on ext4.  This is the pattern of an
+ * object store ingesting into flat directories, where every operation
+ * goes through the directory inode lock and starts a journal handle.
+ *
+ * Reports the number of creates and unlinks per second.
+ */
+
+#define _GNU_SOURCE
+
+#include <error.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+static const char *cfg_dir = ".";
+static int cfg_num_threads	= 16;
+static int cfg_num_prefill	= 10000;
+static int cfg_backlog		= 64;
+static int cfg_runtime_ms	= 5000;
+
+static char *dir;
+static volatile bool stop;
+
+struct thread_stats {
+	pthread_t thread;
+	int id;
+	unsigned long creates;
+	unsigned long unlinks;
+} __attribute__((aligned(64)));
+
+static unsigned long gettimeofday_ms(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (tv.tv_sec * 1000) + (tv.tv_usec / 1000);
+}
+
+static void file_name(char *buf, size_t len, const char *prefix,
+		      int id, unsigned long n)
+{
+	snprintf(buf, len, "%s/%s-%d-%lu", dir, prefix, id, n);
+}
+
+static void do_create(const char *name)
+{
+	int fd;
+
+	fd = open(name, O_CREAT | O_EXCL | O_WRONLY, 0600);
+	if (fd == -1)
+		error(1, errno, "open %s", name);
+	if (close(fd))
+		error(1, errno, "close %s", name);
+}
+
+static void do_unlink(const char *name)
+{
+	if (unlink(name))
+		error(1, errno, "unlink %s", name);
+}
+
+static void *do_worker(void *arg)
+{
+	struct thread_stats *stats = arg;
+	char name[PATH_MAX];
+
+	while (!stop) {
+		file_name(name, sizeof(name), "w", stats->id, stats->creates);
+		do_create(name);
+		stats->creates++;
+
+		if (stats->creates <= cfg_backlog)
+			continue;
+
+		file_name(name, sizeof(name), "w", stats->id, stats->unlinks);
+		do_unlink(name);
+		stats->unlinks++;
+	}
+
+	return NULL;
+}
+
+static void start_threads(struct thread_stats *stats, int num)
+{
+	int i;
+
+	for (i = 0; i < num; i++) {
+		stats[i].id = i;
+		errno = pthread_create(&stats[i].thread, NULL, do_worker,
+				       &stats[i]);
+		if (errno)
+			error(1, errno, "pthread_create");
+	}
+}
+
+static void join_threads(struct thread_stats *stats, int num,
+			 unsigned long *creates, unsigned long *unlinks)
+{
+	int i;
+
+	for (i = 0; i < num; i++) {
+		errno = pthread_join(stats[i].thread, NULL);
+		if (errno)
+			error(1, errno, "pthread_join");
+		*creates += stats[i].creates;
+		*unlinks += stats[i].unlinks;
+	}
+}
+
+static void setup(void)
+{
+	char name[PATH_MAX];
+	int i;
+
+	if (asprintf(&dir, "%s/create_unlink_bench.XXXXXX", cfg_dir) == -1)
+		error(1, ENOMEM, "asprintf");
+	if (!mkdtemp(dir))
+		error(1, errno, "mkdtemp %s", dir);
+
+	for (i = 0; i < cfg_num_prefill; i++) {
+		file_name(name, sizeof(name), "p", 0, i);
+		do_create(name);
+	}
+}
+
+static void cleanup(struct thread_stats *stats, int num)
+{
+	char name[PATH_MAX];
+	unsigned long n;
+	int i;
+
+	for (i = 0; i < num; i++) {
+		for (n = stats[i].unlinks; n < stats[i].creates; n++) {
+			file_name(name, sizeof(name), "w", stats[i].id, n);
+			do_unlink(name);
+		}
+	}
+
+	for (i = 0; i < cfg_num_prefill; i++) {
+		file_name(name, sizeof(name), "p", 0, i);
+		do_unlink(name);
+	}
+
+	if (rmdir(dir))
+		error(1, errno, "rmdir %s", dir);
+	free(dir);
+}
+
+static void usage(const char *filepath)
+{
+	error(1, 0, "Usage: %s [-d dir] [-n threads] [-p prefill] [-b backlog] [-t ms]",
+	      filepath);
+}
+
+static void parse_opts(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "b:d:n:p:t:")) != -1) {
+		switch (c) {
+		case 'b':
+			cfg_backlog = strtol(optarg, NULL, 0);
+			break;
+		case 'd':
+			cfg_dir = optarg;
+			break;
+		case 'n':
+			cfg_num_threads = strtol(optarg, NULL, 0);
+			break;
+		case 'p':
+			cfg_num_prefill = strtol(optarg, NULL, 0);
+			break;
+		case 't':
+			cfg_runtime_ms = strtol(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (cfg_num_threads <= 0 || cfg_num_prefill < 0 ||
+	    cfg_backlog < 0 || cfg_runtime_ms <= 0)
+		usage(argv[0]);
+}
+
+int main(int argc, char **argv)
+{
+	struct thread_stats *workers;
+	unsigned long tstart, tstop, creates = 0, unlinks = 0;
+
+	parse_opts(argc, argv);
+	setup();
+
+	workers = calloc(cfg_num_threads, sizeof(*workers));
+	if (!workers)
+		error(1, ENOMEM, "calloc");
+
+	tstart = gettimeofday_ms();
+	start_threads(workers, cfg_num_threads);
+
+	usleep(cfg_runtime_ms * 1000);
+	stop = true;
+
+	join_threads(workers, cfg_num_threads, &creates, &unlinks);
+	tstop = gettimeofday_ms();
+
+	fprintf(stderr, "threads=%d prefill=%d backlog=%d dir=%s\n",
+		cfg_num_threads, cfg_num_prefill, cfg_backlog, cfg_dir);
+	fprintf(stderr, "%lu creates (%lu/s), %lu unlinks (%lu/s), %lu ops/s\n",
+		creates, creates * 1000 / (tstop - tstart),
+		unlinks, unlinks * 1000 / (tstop - tstart),
+		(creates + unlinks) * 1000 / (tstop - tstart));
+
+	cleanup(workers, cfg_num_threads);
+	free(workers);
+	return 0;
+}
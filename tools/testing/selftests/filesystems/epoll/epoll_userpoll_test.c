@@ -0,0 +1,228 @@
+/* Test the EPOLL_USERPOLL event ring
+ *
+ * Register eventfds with an epoll instance that publishes ready events
+ * in a ring mmap()ed from the epoll fd, and check that signalling them
+ * queues exactly one ring entry per transition to ready, with the
+ * registered data, plus the EPOLLONESHOT and epoll_wait() behaviour.
+ */
+
+#define _GNU_SOURCE
+
+#include <error.h>
+#include <errno.h>
+#include <linux/eventpoll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define NUM_FDS		8
+
+static struct epoll_uheader *header;
+static uint32_t *ring;
+static uint32_t ring_mask;
+static int epfd;
+static int efds[NUM_FDS];
+
+static int sys_epoll_ctl(int op, int fd, uint32_t events, uint64_t data)
+{
+	struct epoll_event ev = { .events = events, .data = data };
+
+	return syscall(__NR_epoll_ctl, epfd, op, fd, &ev);
+}
+
+static int sys_epoll_wait(int timeout)
+{
+	struct epoll_event ev;
+
+	return syscall(__NR_epoll_wait, epfd, &ev, 1, timeout);
+}
+
+static void signal_fd(int i)
+{
+	uint64_t val = 1;
+
+	if (write(efds[i], &val, sizeof(val)) != sizeof(val))
+		error(1, errno, "write");
+}
+
+static void drain_fd(int i)
+{
+	uint64_t val;
+
+	if (read(efds[i], &val, sizeof(val)) == -1 && errno != EAGAIN)
+		error(1, errno, "read");
+}
+
+/* Returns the number of consumed entries, fills data of the last one */
+static int consume(uint64_t *data, uint32_t *events)
+{
+	uint32_t head = header->head;
+	int count = 0;
+
+	while (head != __atomic_load_n(&header->tail, __ATOMIC_ACQUIRE)) {
+		uint32_t *idx = &ring[head & ring_mask];
+		uint32_t nr, ready;
+
+		while (!(nr = __atomic_load_n(idx, __ATOMIC_ACQUIRE)))
+			;
+		*idx = 0;
+		__atomic_store_n(&header->head, ++head, __ATOMIC_RELEASE);
+
+		ready = __atomic_exchange_n(&header->items[nr - 1].ready_events,
+					    0, __ATOMIC_ACQ_REL);
+		if (!ready)
+			continue;
+
+		*data = header->items[nr - 1].data;
+		*events = ready;
+		count++;
+	}
+
+	return count;
+}
+
+static void expect_entries(int expected, uint64_t expected_data)
+{
+	uint32_t events = 0;
+	uint64_t data = 0;
+	int ret;
+
+	ret = consume(&data, &events);
+	if (ret != expected)
+		error(1, 0, "ring: %d entries, expected %d", ret, expected);
+	if (expected && data != expected_data)
+		error(1, 0, "ring: data %lu, expected %lu",
+		      (unsigned long)data, (unsigned long)expected_data);
+	if (expected && !(events & EPOLLIN))
+		error(1, 0, "ring: events 0x%x without EPOLLIN", events);
+}
+
+static void setup(void)
+{
+	size_t len;
+	int i;
+
+	epfd = syscall(__NR_epoll_create1, EPOLL_USERPOLL);
+	if (epfd == -1)
+		error(1, errno, "epoll_create1 userpoll");
+
+	header = mmap(NULL, 4096, PROT_READ, MAP_SHARED, epfd, 0);
+	if (header == MAP_FAILED)
+		error(1, errno, "mmap header");
+	if (header->magic != EPOLL_USERPOLL_HEADER_MAGIC)
+		error(1, 0, "bad magic 0x%x", header->magic);
+
+	len = header->header_length + header->index_length;
+	ring_mask = header->index_length / sizeof(uint32_t) - 1;
+	munmap(header, 4096);
+
+	header = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, epfd, 0);
+	if (header == MAP_FAILED)
+		error(1, errno, "mmap");
+	ring = (void *)header + header->header_length;
+
+	for (i = 0; i < NUM_FDS; i++) {
+		efds[i] = eventfd(0, EFD_NONBLOCK);
+		if (efds[i] == -1)
+			error(1, errno, "eventfd");
+	}
+}
+
+int main(int argc, char **argv)
+{
+	int i, ret;
+
+	setup();
+
+	/* level triggered registrations are refused */
+	if (!sys_epoll_ctl(EPOLL_CTL_ADD, efds[0], EPOLLIN, 0) ||
+	    errno != EINVAL)
+		error(1, errno, "level triggered add");
+
+	for (i = 0; i < NUM_FDS; i++)
+		if (sys_epoll_ctl(EPOLL_CTL_ADD, efds[i], EPOLLIN | EPOLLET,
+				  100 + i))
+			error(1, errno, "epoll_ctl add");
+
+	/* nothing is ready */
+	if (sys_epoll_wait(0) != 0)
+		error(1, 0, "epoll_wait: events on an idle ring");
+	expect_entries(0, 0);
+
+	/* one entry per transition, repeated wakeups do not add entries */
+	signal_fd(3);
+	signal_fd(3);
+	if (sys_epoll_wait(1000) != 1)
+		error(1, 0, "epoll_wait: expected one queued entry");
+	expect_entries(1, 103);
+	drain_fd(3);
+
+	for (i = 0; i < NUM_FDS; i++)
+		signal_fd(i);
+	ret = sys_epoll_wait(1000);
+	if (ret != NUM_FDS)
+		error(1, 0, "epoll_wait: %d queued entries", ret);
+	expect_entries(NUM_FDS, 100 + NUM_FDS - 1);
+	for (i = 0; i < NUM_FDS; i++)
+		drain_fd(i);
+
+	/* oneshot: reported once, then only after rearming */
+	if (sys_epoll_ctl(EPOLL_CTL_MOD, efds[5],
+			  EPOLLIN | EPOLLET | EPOLLONESHOT, 205))
+		error(1, errno, "epoll_ctl mod");
+	signal_fd(5);
+	expect_entries(1, 205);
+	drain_fd(5);
+	signal_fd(5);
+	expect_entries(0, 0);
+	if (sys_epoll_ctl(EPOLL_CTL_MOD, efds[5],
+			  EPOLLIN | EPOLLET | EPOLLONESHOT, 305))
+		error(1, errno, "epoll_ctl rearm");
+	expect_entries(1, 305);
+	drain_fd(5);
+
+	/* a removed item that was still queued is skipped */
+	signal_fd(6);
+	if (sys_epoll_ctl(EPOLL_CTL_DEL, efds[6], 0, 0))
+		error(1, errno, "epoll_ctl del");
+	expect_entries(0, 0);
+
+	/*
+	 * Re-adding a ready file queues an entry each time: the items of the
+	 * removed registrations stay reserved until they are consumed, so the
+	 * ring never holds more entries than it has slots.
+	 */
+	for (i = 0; i <= 2 * (int)(ring_mask + 1); i++) {
+		if (sys_epoll_ctl(EPOLL_CTL_ADD, efds[6], EPOLLIN | EPOLLET,
+				  400 + i)) {
+			if (errno != ENOSPC)
+				error(1, errno, "epoll_ctl add churn");
+			break;
+		}
+		if (header->tail - header->head > ring_mask + 1)
+			error(1, 0, "ring overrun: %u entries",
+			      header->tail - header->head);
+		if (sys_epoll_ctl(EPOLL_CTL_DEL, efds[6], 0, 0))
+			error(1, errno, "epoll_ctl del churn");
+	}
+	if (i > (int)(ring_mask + 1))
+		error(1, 0, "churn was not bounded by the ring size");
+	expect_entries(0, 0);
+	if (sys_epoll_ctl(EPOLL_CTL_ADD, efds[6], EPOLLIN | EPOLLET, 106))
+		error(1, errno, "epoll_ctl add after churn");
+	expect_entries(1, 106);
+	drain_fd(6);
+
+	for (i = 0; i < NUM_FDS; i++)
+		close(efds[i]);
+	close(epfd);
+
+	fprintf(stderr, "OK\n");
+	return 0;
+}
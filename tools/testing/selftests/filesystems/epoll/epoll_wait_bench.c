@@ -0,0 +1,240 @@
+/* Measure multi-threaded epoll_wait() throughput
+ *
+ * A set of writer threads keeps signalling a large number of eventfds
+ * that are all registered with a single epoll instance, while a set of
+ * reader threads harvest them with epoll_wait() and reset them with
+ * read().  This is the pattern of a server with many worker threads
+ * sharing one epoll fd over thousands of hot sockets, where wakeups
+ * (ep_poll_callback) and harvesting (ep_scan_ready_list) contend on the
+ * epoll internal locks.
+ *
+ * Reports the number of events harvested per second.
+ */
+
+#define _GNU_SOURCE
+
+#include <error.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define MAX_EVENTS	64
+
+static int cfg_num_fds		= 4096;
+static int cfg_num_readers	= 32;
+static int cfg_num_writers	= 8;
+static int cfg_runtime_ms	= 5000;
+static bool cfg_edge;
+
+static int epfd;
+static int *efds;
+static volatile bool stop;
+
+struct thread_stats {
+	pthread_t thread;
+	unsigned int seed;
+	unsigned long events;
+	unsigned long wakeups;
+} __attribute__((aligned(64)));
+
+static unsigned long gettimeofday_ms(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (tv.tv_sec * 1000) + (tv.tv_usec / 1000);
+}
+
+static void *do_reader(void *arg)
+{
+	struct thread_stats *stats = arg;
+	struct epoll_event events[MAX_EVENTS];
+	uint64_t val;
+	int i, ret;
+
+	while (!stop) {
+		ret = epoll_wait(epfd, events, MAX_EVENTS, 100);
+		if (ret == -1) {
+			if (errno == EINTR)
+				continue;
+			error(1, errno, "epoll_wait");
+		}
+
+		stats->wakeups++;
+		for (i = 0; i < ret; i++) {
+			/* Several readers may race on the same fd */
+			if (read(efds[events[i].data.u32], &val,
+				 sizeof(val)) == -1 && errno != EAGAIN)
+				error(1, errno, "read");
+		}
+		stats->events += ret;
+	}
+
+	return NULL;
+}
+
+static void *do_writer(void *arg)
+{
+	struct thread_stats *stats = arg;
+	uint64_t val = 1;
+
+	while (!stop) {
+		int fd = efds[rand_r(&stats->seed) % cfg_num_fds];
+
+		if (write(fd, &val, sizeof(val)) == -1)
+			error(1, errno, "write");
+		stats->events++;
+	}
+
+	return NULL;
+}
+
+static void start_threads(struct thread_stats *stats, int num,
+			  void *(*fn)(void *))
+{
+	int i;
+
+	for (i = 0; i < num; i++) {
+		stats[i].seed = i + 1;
+		errno = pthread_create(&stats[i].thread, NULL, fn, &stats[i]);
+		if (errno)
+			error(1, errno, "pthread_create");
+	}
+}
+
+static unsigned long join_threads(struct thread_stats *stats, int num,
+				  unsigned long *wakeups)
+{
+	unsigned long total = 0;
+	int i;
+
+	for (i = 0; i < num; i++) {
+		errno = pthread_join(stats[i].thread, NULL);
+		if (errno)
+			error(1, errno, "pthread_join");
+		total += stats[i].events;
+		if (wakeups)
+			*wakeups += stats[i].wakeups;
+	}
+
+	return total;
+}
+
+static void setup(void)
+{
+	struct epoll_event ev = {0};
+	int i;
+
+	epfd = epoll_create1(0);
+	if (epfd == -1)
+		error(1, errno, "epoll_create1");
+
+	efds = calloc(cfg_num_fds, sizeof(*efds));
+	if (!efds)
+		error(1, ENOMEM, "calloc");
+
+	for (i = 0; i < cfg_num_fds; i++) {
+		efds[i] = eventfd(0, EFD_NONBLOCK);
+		if (efds[i] == -1)
+			error(1, errno, "eventfd");
+
+		ev.events = EPOLLIN | (cfg_edge ? EPOLLET : 0);
+		ev.data.u32 = i;
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, efds[i], &ev))
+			error(1, errno, "epoll_ctl");
+	}
+}
+
+static void cleanup(void)
+{
+	int i;
+
+	for (i = 0; i < cfg_num_fds; i++)
+		if (close(efds[i]))
+			error(1, errno, "close");
+	free(efds);
+	if (close(epfd))
+		error(1, errno, "close epoll");
+}
+
+static void usage(const char *filepath)
+{
+	error(1, 0, "Usage: %s [-e] [-f num_fds] [-r readers] [-w writers] [-t ms]",
+	      filepath);
+}
+
+static void parse_opts(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "ef:r:t:w:")) != -1) {
+		switch (c) {
+		case 'e':
+			cfg_edge = true;
+			break;
+		case 'f':
+			cfg_num_fds = strtol(optarg, NULL, 0);
+			break;
+		case 'r':
+			cfg_num_readers = strtol(optarg, NULL, 0);
+			break;
+		case 't':
+			cfg_runtime_ms = strtol(optarg, NULL, 0);
+			break;
+		case 'w':
+			cfg_num_writers = strtol(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (cfg_num_fds <= 0 || cfg_num_readers <= 0 ||
+	    cfg_num_writers <= 0 || cfg_runtime_ms <= 0)
+		usage(argv[0]);
+}
+
+int main(int argc, char **argv)
+{
+	struct thread_stats *readers, *writers;
+	unsigned long tstart, tstop, harvested, signalled, wakeups = 0;
+
+	parse_opts(argc, argv);
+	setup();
+
+	readers = calloc(cfg_num_readers, sizeof(*readers));
+	writers = calloc(cfg_num_writers, sizeof(*writers));
+	if (!readers || !writers)
+		error(1, ENOMEM, "calloc");
+
+	tstart = gettimeofday_ms();
+	start_threads(readers, cfg_num_readers, do_reader);
+	start_threads(writers, cfg_num_writers, do_writer);
+
+	usleep(cfg_runtime_ms * 1000);
+	stop = true;
+
+	signalled = join_threads(writers, cfg_num_writers, NULL);
+	harvested = join_threads(readers, cfg_num_readers, &wakeups);
+	tstop = gettimeofday_ms();
+
+	fprintf(stderr, "fds=%d readers=%d writers=%d %s-triggered\n",
+		cfg_num_fds, cfg_num_readers, cfg_num_writers,
+		cfg_edge ? "edge" : "level");
+	fprintf(stderr, "signalled %lu, harvested %lu events (%lu/s) in %lu wakeups\n",
+		signalled, harvested, harvested * 1000 / (tstop - tstart),
+		wakeups);
+
+	free(writers);
+	free(readers);
+	cleanup();
+	return 0;
+}
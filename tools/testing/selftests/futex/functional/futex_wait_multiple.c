@@ -0,0 +1,197 @@
+// SPDX-License-Identifier: GPL-2.0
+/******************************************************************************
+ *
+ * DESCRIPTION
+ *      Test FUTEX_WAIT_MULTIPLE: it must return -EWOULDBLOCK if one of the
+ *      futex values differs from the expected one, time out on its absolute
+ *      timeout, and return the index of the futex that was woken.
+ *
+ *      The wakeup test doubles as a benchmark: a thread wakes each of the
+ *      futexes in turn and the average wake to wakeup round trip is
+ *      reported.
+ *
+ *****************************************************************************/
+
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "atomic.h"
+#include "futextest.h"
+#include "logging.h"
+
+#define TEST_NAME "futex-wait-multiple"
+#define timeout_ns 100000
+
+static int nr_futexes = 32;
+static int iterations = 10000;
+
+static futex_t futexes[FUTEX_WAIT_MULTIPLE_MAX];
+static struct futex_wait_block wb[FUTEX_WAIT_MULTIPLE_MAX];
+static futex_t ack = FUTEX_INITIALIZER;
+
+void usage(char *prog)
+{
+	printf("Usage: %s\n", prog);
+	printf("  -c	Use color\n");
+	printf("  -h	Display this help message\n");
+	printf("  -i N	Number of wakeup round trips (default: %d)\n",
+	       iterations);
+	printf("  -n N	Number of futexes to wait on (default: %d, max: %d)\n",
+	       nr_futexes, FUTEX_WAIT_MULTIPLE_MAX);
+	printf("  -v L	Verbosity level: %d=QUIET %d=CRITICAL %d=INFO\n",
+	       VQUIET, VCRITICAL, VINFO);
+}
+
+static void timespec_add_ns(struct timespec *ts, long ns)
+{
+	ts->tv_nsec += ns;
+	while (ts->tv_nsec >= 1000000000L) {
+		ts->tv_nsec -= 1000000000L;
+		ts->tv_sec++;
+	}
+}
+
+static void *waker_fn(void *arg)
+{
+	futex_t seen;
+	int i;
+
+	for (i = 0; i < iterations; i++) {
+		seen = ack;
+		futexes[i % nr_futexes] = 1;
+		futex_wake(&futexes[i % nr_futexes], 1, FUTEX_PRIVATE_FLAG);
+		while (ack == seen)
+			futex_wait(&ack, seen, NULL, FUTEX_PRIVATE_FLAG);
+	}
+
+	return NULL;
+}
+
+static int test_wakeups(void)
+{
+	struct timespec start, end;
+	pthread_t waker;
+	int i, j, res;
+	double ns;
+
+	if (pthread_create(&waker, NULL, waker_fn, NULL)) {
+		error("pthread_create failed\n", errno);
+		return RET_ERROR;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < iterations; i++) {
+		res = futex_wait_multiple(wb, nr_futexes, NULL,
+					  FUTEX_PRIVATE_FLAG);
+		if (res < 0 && errno != EWOULDBLOCK && errno != EINTR) {
+			fail("futex_wait_multiple returned: %d %s\n",
+			     errno, strerror(errno));
+			return RET_FAIL;
+		}
+		if (res >= 0 && res != i % nr_futexes) {
+			fail("futex_wait_multiple woke on %d, expected %d\n",
+			     res, i % nr_futexes);
+			return RET_FAIL;
+		}
+		if (res < 0) {
+			/* the wakeup came before we queued, or a signal */
+			for (j = 0; j < nr_futexes && !futexes[j]; j++)
+				;
+			if (j == nr_futexes) {
+				i--;
+				continue;
+			}
+		}
+
+		futexes[i % nr_futexes] = 0;
+		atomic_inc((atomic_t *)&ack);
+		futex_wake(&ack, 1, FUTEX_PRIVATE_FLAG);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	pthread_join(waker, NULL);
+
+	ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+	ksft_print_msg("\t%d round trips on %d futexes: %.0f ns each\n",
+		       iterations, nr_futexes, ns / iterations);
+
+	return RET_PASS;
+}
+
+int main(int argc, char *argv[])
+{
+	struct timespec to;
+	int res, ret = RET_PASS;
+	int c, i;
+
+	while ((c = getopt(argc, argv, "chi:n:v:")) != -1) {
+		switch (c) {
+		case 'c':
+			log_color(1);
+			break;
+		case 'h':
+			usage(basename(argv[0]));
+			exit(0);
+		case 'i':
+			iterations = atoi(optarg);
+			break;
+		case 'n':
+			nr_futexes = atoi(optarg);
+			break;
+		case 'v':
+			log_verbosity(atoi(optarg));
+			break;
+		default:
+			usage(basename(argv[0]));
+			exit(1);
+		}
+	}
+
+	if (nr_futexes < 1 || nr_futexes > FUTEX_WAIT_MULTIPLE_MAX) {
+		usage(basename(argv[0]));
+		exit(1);
+	}
+
+	ksft_print_header();
+	ksft_print_msg("%s: Block on several futexes at once\n",
+	       basename(argv[0]));
+	ksft_print_msg("\tArguments: futexes=%d iterations=%d\n",
+		       nr_futexes, iterations);
+
+	for (i = 0; i < nr_futexes; i++) {
+		wb[i].uaddr = (unsigned long)&futexes[i];
+		wb[i].val = 0;
+		wb[i].bitset = FUTEX_BITSET_MATCH_ANY;
+	}
+
+	info("Calling futex_wait_multiple with a wrong value\n");
+	wb[nr_futexes - 1].val = 1;
+	res = futex_wait_multiple(wb, nr_futexes, NULL, FUTEX_PRIVATE_FLAG);
+	if (res != -1 || errno != EWOULDBLOCK) {
+		fail("futex_wait_multiple returned: %d %s\n",
+		     res < 0 ? errno : res, res < 0 ? strerror(errno) : "");
+		ret = RET_FAIL;
+	}
+	wb[nr_futexes - 1].val = 0;
+
+	info("Calling futex_wait_multiple with a %dns timeout\n", timeout_ns);
+	clock_gettime(CLOCK_MONOTONIC, &to);
+	timespec_add_ns(&to, timeout_ns);
+	res = futex_wait_multiple(wb, nr_futexes, &to, FUTEX_PRIVATE_FLAG);
+	if (res != -1 || errno != ETIMEDOUT) {
+		fail("futex_wait_multiple returned: %d %s\n",
+		     res < 0 ? errno : res, res < 0 ? strerror(errno) : "");
+		ret = RET_FAIL;
+	}
+
+	if (ret == RET_PASS) {
+		info("Waking each of the futexes in turn\n");
+		ret = test_wakeups();
+	}
+
+	print_result(TEST_NAME, ret);
+	return ret;
+}
@@ -0,0 +1,155 @@
+#!/bin/bash
+#
+# Measure the IPv6 forwarding rate of a router namespace
+#
+# Three namespaces are chained with veth pairs, a sender, a router and
+# a receiver.  pktgen in the sender blasts UDP over IPv6 at the receiver
+# from one kernel thread per CPU, so that the router does a fib6 lookup
+# and takes a route reference for every packet on all CPUs at once.
+# Report the rate the receiver sees.  Pass a different runtime in
+# seconds as the first argument, default is 10, and a different number
+# of sender threads as the second one, default is one per CPU.
+
+readonly DURATION="${1:-10}"
+readonly THREADS="${2:-$(nproc)}"
+readonly RAND="$(mktemp -u XXXXXX)"
+readonly NS_SRC="fwd-src-${RAND}"
+readonly NS_RTR="fwd-rtr-${RAND}"
+readonly NS_DST="fwd-dst-${RAND}"
+readonly PKT_SIZE=64
+
+ret=0
+
+cleanup()
+{
+	ip netns del "${NS_SRC}" 2>/dev/null
+	ip netns del "${NS_RTR}" 2>/dev/null
+	ip netns del "${NS_DST}" 2>/dev/null
+}
+
+trap cleanup EXIT
+
+pgset()
+{
+	local ns="$1"
+	local file="$2"
+	local cmd="$3"
+
+	ip netns exec "${ns}" sh -c "echo '${cmd}' > /proc/net/pktgen/${file}"
+	[ "${file}" = "pgctrl" ] && return
+
+	if ! ip netns exec "${ns}" grep -q "Result: OK" \
+	     "/proc/net/pktgen/${file}"; then
+		echo "pktgen: '${cmd}' to ${file} failed"
+		ret=1
+	fi
+}
+
+link_stat()
+{
+	ip netns exec "$1" cat "/sys/class/net/$2/statistics/$3"
+}
+
+if [ "$(id -u)" -ne 0 ]; then
+	echo "SKIP: need root privileges"
+	exit 0
+fi
+
+if [ ! -d /proc/net/pktgen ] && ! modprobe pktgen 2>/dev/null; then
+	echo "SKIP: pktgen is not available"
+	exit 0
+fi
+
+ip netns add "${NS_SRC}" || exit 1
+ip netns add "${NS_RTR}" || exit 1
+ip netns add "${NS_DST}" || exit 1
+
+if ! ip -n "${NS_SRC}" link add veth0 type veth \
+     peer name veth0 netns "${NS_RTR}" 2>/dev/null; then
+	echo "SKIP: could not create a veth pair"
+	exit 0
+fi
+ip -n "${NS_DST}" link add veth0 type veth peer name veth1 netns "${NS_RTR}"
+
+ip -n "${NS_SRC}" -6 addr add fd00:1::2/64 dev veth0 nodad
+ip -n "${NS_RTR}" -6 addr add fd00:1::1/64 dev veth0 nodad
+ip -n "${NS_RTR}" -6 addr add fd00:2::1/64 dev veth1 nodad
+ip -n "${NS_DST}" -6 addr add fd00:2::2/64 dev veth0 nodad
+
+for ns in "${NS_SRC}" "${NS_RTR}" "${NS_DST}"; do
+	ip -n "${ns}" link set lo up
+	ip -n "${ns}" link set veth0 up
+done
+ip -n "${NS_RTR}" link set veth1 up
+
+ip -n "${NS_SRC}" -6 route add fd00:2::/64 via fd00:1::1
+ip -n "${NS_DST}" -6 route add fd00:1::/64 via fd00:2::1
+ip netns exec "${NS_RTR}" sysctl -qw net.ipv6.conf.all.forwarding=1
+
+# Resolve the next hops up front, neighbour discovery under load would
+# only drop the first packets and skew the rate.
+dst_mac="$(ip -n "${NS_DST}" -o link show veth0 | \
+	   sed -n 's|.*link/ether \([0-9a-f:]*\).*|\1|p')"
+rtr_mac="$(ip -n "${NS_RTR}" -o link show veth0 | \
+	   sed -n 's|.*link/ether \([0-9a-f:]*\).*|\1|p')"
+ip -n "${NS_RTR}" -6 neigh add fd00:2::2 lladdr "${dst_mac}" \
+	dev veth1 nud permanent
+
+# veth does not allow shared skbs, so no clone_skb and no burst.  Each
+# thread drives its own copy of the device and gets its own range of
+# UDP ports, which keeps the threads on separate flows.
+pgset "${NS_SRC}" pgctrl "reset"
+for i in $(seq 0 $(( THREADS - 1 ))); do
+	dev="veth0@${i}"
+
+	if ! ip netns exec "${NS_SRC}" \
+	     test -e "/proc/net/pktgen/kpktgend_${i}"; then
+		echo "SKIP: no pktgen thread for CPU ${i}"
+		exit 0
+	fi
+
+	pgset "${NS_SRC}" "kpktgend_${i}" "rem_device_all"
+	pgset "${NS_SRC}" "kpktgend_${i}" "add_device ${dev}"
+	pgset "${NS_SRC}" "${dev}" "count 0"
+	pgset "${NS_SRC}" "${dev}" "clone_skb 0"
+	pgset "${NS_SRC}" "${dev}" "pkt_size ${PKT_SIZE}"
+	pgset "${NS_SRC}" "${dev}" "delay 0"
+	pgset "${NS_SRC}" "${dev}" "src6 fd00:1::2"
+	pgset "${NS_SRC}" "${dev}" "dst6 fd00:2::2"
+	pgset "${NS_SRC}" "${dev}" "dst_mac ${rtr_mac}"
+	pgset "${NS_SRC}" "${dev}" "udp_dst_min $(( 9000 + i * 16 ))"
+	pgset "${NS_SRC}" "${dev}" "udp_dst_max $(( 9000 + i * 16 + 15 ))"
+done
+
+if [ "${ret}" -ne 0 ]; then
+	echo "FAIL"
+	exit 1
+fi
+
+tx_start="$(link_stat "${NS_SRC}" veth0 tx_packets)"
+rx_start="$(link_stat "${NS_DST}" veth0 rx_packets)"
+
+ip netns exec "${NS_SRC}" sh -c "echo start > /proc/net/pktgen/pgctrl" &
+pid=$!
+sleep "${DURATION}"
+ip netns exec "${NS_SRC}" sh -c "echo stop > /proc/net/pktgen/pgctrl"
+wait "${pid}"
+
+tx=$(( $(link_stat "${NS_SRC}" veth0 tx_packets) - tx_start ))
+rx=$(( $(link_stat "${NS_DST}" veth0 rx_packets) - rx_start ))
+
+echo "threads ${THREADS}: sent ${tx}, forwarded ${rx} in ${DURATION} s" \
+     "($(( rx / DURATION )) pps)"
+
+if [ "${rx}" -eq 0 ]; then
+	echo "router forwarded nothing"
+	ret=1
+fi
+
+if [ "${ret}" -ne 0 ]; then
+	echo "FAIL"
+	exit 1
+fi
+
+echo "OK"
+exit 0
@@ -0,0 +1,89 @@
+#!/bin/bash
+#
+# Measure how fast network namespaces can be set up and torn down
+#
+# Create NUM namespaces, each with one end of a veth pair moved into it
+# and the other left in the current namespace, the way container
+# runtimes plumb a new pod.  Report the setup and the teardown rate.
+# Pass a different count as the first argument, default is 10000.
+
+readonly NUM="${1:-10000}"
+readonly RAND="$(mktemp -u XXXXXX)"
+readonly NSPREFIX="ns-${RAND}-"
+readonly DEVPREFIX="vr${RAND}"
+readonly BATCH="$(mktemp)"
+
+ret=0
+
+now_ms()
+{
+	echo $(( $(date +%s%N) / 1000000 ))
+}
+
+report()
+{
+	local what="$1"
+	local start="$2"
+	local end="$3"
+	local ms=$(( end - start ))
+
+	[ "${ms}" -eq 0 ] && ms=1
+	echo "${what}: ${NUM} netns+veth in ${ms} ms ($(( NUM * 1000 / ms ))/s)"
+}
+
+cleanup()
+{
+	rm -f "${BATCH}"
+}
+
+trap cleanup EXIT
+
+if [ "$(id -u)" -ne 0 ]; then
+	echo "SKIP: need root privileges"
+	exit 0
+fi
+
+if ! ip link add "${DEVPREFIX}" type veth peer name "${DEVPREFIX}p" \
+     2>/dev/null; then
+	echo "SKIP: could not create a veth pair"
+	exit 0
+fi
+ip link del "${DEVPREFIX}"
+
+for i in $(seq 1 "${NUM}"); do
+	echo "netns add ${NSPREFIX}${i}"
+done > "${BATCH}"
+
+start="$(now_ms)"
+ip -batch "${BATCH}" || ret=1
+
+for i in $(seq 1 "${NUM}"); do
+	echo "link add ${DEVPREFIX}${i} type veth peer name eth0 netns ${NSPREFIX}${i}"
+	echo "link set ${DEVPREFIX}${i} up"
+done > "${BATCH}"
+ip -batch "${BATCH}" || ret=1
+end="$(now_ms)"
+report "setup" "${start}" "${end}"
+
+for i in $(seq 1 "${NUM}"); do
+	echo "netns del ${NSPREFIX}${i}"
+done > "${BATCH}"
+
+start="$(now_ms)"
+ip -batch "${BATCH}" || ret=1
+
+# Namespaces are destroyed from a workqueue, wait for the host-side
+# veth ends to go away with them.
+while ip -o link show | grep -q "${DEVPREFIX}"; do
+	sleep 0.1
+done
+end="$(now_ms)"
+report "cleanup" "${start}" "${end}"
+
+if [ "${ret}" -ne 0 ]; then
+	echo "FAIL"
+	exit 1
+fi
+
+echo "OK"
+exit 0
@@ -0,0 +1,288 @@
+/* Evaluate TCP_ZEROCOPY_RECEIVE
+ *
+ * Start this program on two connected hosts, one in server mode ('-s')
+ * and the other as a client ('-H <server address>').  The client sends
+ * -t bytes (default 1 GB) over one TCP connection, the server receives
+ * them and reports how much was mapped into its address space and how
+ * much had to be copied.
+ *
+ * In zerocopy mode ('-z') the server mmap()s a window on the socket and
+ * pulls data with getsockopt(TCP_ZEROCOPY_RECEIVE), which maps whole
+ * page frags and copies the remainder into a bounce buffer.  Otherwise
+ * it uses plain read().
+ *
+ * Mapping only succeeds for payload that lands page aligned in the
+ * receive queue, which needs a NIC doing header split or an MSS that is
+ * a multiple of the page size ('-M').
+ */
+
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <error.h>
+#include <errno.h>
+#include <linux/tcp.h>
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#ifndef TCP_ZEROCOPY_RECEIVE
+#define TCP_ZEROCOPY_RECEIVE	35
+#endif
+
+#define CHUNK_SIZE	(512 * 1024)
+
+static bool cfg_server;
+static bool cfg_zerocopy;
+static const char *cfg_host;
+static int  cfg_port		= 8787;
+static int  cfg_mss;
+static int  cfg_family		= AF_INET6;
+static long long cfg_total	= 1LL << 30;
+
+static unsigned long gettimeofday_ms(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (tv.tv_sec * 1000) + (tv.tv_usec / 1000);
+}
+
+static void do_setsockopt(int fd, int level, int optname, int val)
+{
+	if (setsockopt(fd, level, optname, &val, sizeof(val)))
+		error(1, errno, "setsockopt %d.%d: %d", level, optname, val);
+}
+
+static void setup_sockaddr(struct sockaddr_storage *ss, socklen_t *alen,
+			   const char *host)
+{
+	struct sockaddr_in6 *addr6 = (void *)ss;
+	struct sockaddr_in *addr4 = (void *)ss;
+
+	memset(ss, 0, sizeof(*ss));
+
+	if (cfg_family == AF_INET) {
+		addr4->sin_family = AF_INET;
+		addr4->sin_port = htons(cfg_port);
+		if (host && inet_pton(AF_INET, host, &addr4->sin_addr) != 1)
+			error(1, 0, "ipv4 parse error: %s", host);
+		if (!host)
+			addr4->sin_addr.s_addr = htonl(INADDR_ANY);
+		*alen = sizeof(*addr4);
+	} else {
+		addr6->sin6_family = AF_INET6;
+		addr6->sin6_port = htons(cfg_port);
+		if (host && inet_pton(AF_INET6, host, &addr6->sin6_addr) != 1)
+			error(1, 0, "ipv6 parse error: %s", host);
+		if (!host)
+			addr6->sin6_addr = in6addr_any;
+		*alen = sizeof(*addr6);
+	}
+}
+
+static void do_rx(int fd)
+{
+	long long total = 0, total_mmap = 0, total_copy = 0;
+	unsigned long tstart = gettimeofday_ms();
+	void *addr = NULL;
+	char *buffer;
+	ssize_t ret;
+
+	buffer = malloc(CHUNK_SIZE);
+	if (!buffer)
+		error(1, ENOMEM, "malloc");
+
+	if (cfg_zerocopy) {
+		addr = mmap(NULL, CHUNK_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+		if (addr == MAP_FAILED)
+			error(1, errno, "mmap");
+	}
+
+	while (1) {
+		if (cfg_zerocopy) {
+			struct tcp_zerocopy_receive zc = {};
+			socklen_t zc_len = sizeof(zc);
+
+			zc.address = (__u64)(unsigned long)addr;
+			zc.length = CHUNK_SIZE;
+			zc.copybuf_address = (__u64)(unsigned long)buffer;
+			zc.copybuf_len = CHUNK_SIZE;
+
+			if (getsockopt(fd, IPPROTO_TCP, TCP_ZEROCOPY_RECEIVE,
+				       &zc, &zc_len) == -1) {
+				if (errno == EIO)
+					break;
+				error(1, errno, "getsockopt zerocopy");
+			}
+
+			total_mmap += zc.length;
+			total_copy += zc.copybuf_len;
+			total += zc.length + zc.copybuf_len;
+			if (zc.length || zc.copybuf_len)
+				continue;
+		}
+
+		/* Nothing queued (or plain mode): block in read, which
+		 * also notices the end of the stream.
+		 */
+		ret = read(fd, buffer, CHUNK_SIZE);
+		if (ret < 0)
+			error(1, errno, "read");
+		if (ret == 0)
+			break;
+		total_copy += ret;
+		total += ret;
+	}
+
+	fprintf(stderr, "received %lld MB (%.2f %% mmap'ed) in %lu ms\n",
+		total >> 20, total ? 100.0 * total_mmap / total : 0.0,
+		gettimeofday_ms() - tstart);
+
+	if (total != total_mmap + total_copy)
+		error(1, 0, "accounting error");
+
+	if (cfg_zerocopy)
+		munmap(addr, CHUNK_SIZE);
+	free(buffer);
+}
+
+static void do_server(void)
+{
+	struct sockaddr_storage addr;
+	socklen_t alen;
+	int fd, conn;
+
+	fd = socket(cfg_family, SOCK_STREAM, 0);
+	if (fd == -1)
+		error(1, errno, "socket");
+
+	do_setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, 1);
+	if (cfg_mss)
+		do_setsockopt(fd, IPPROTO_TCP, TCP_MAXSEG, cfg_mss);
+
+	setup_sockaddr(&addr, &alen, NULL);
+	if (bind(fd, (void *)&addr, alen))
+		error(1, errno, "bind");
+	if (listen(fd, 1))
+		error(1, errno, "listen");
+
+	conn = accept(fd, NULL, NULL);
+	if (conn == -1)
+		error(1, errno, "accept");
+
+	do_rx(conn);
+
+	if (close(conn))
+		error(1, errno, "close conn");
+	if (close(fd))
+		error(1, errno, "close");
+}
+
+static void do_client(void)
+{
+	struct sockaddr_storage addr;
+	long long total = 0;
+	socklen_t alen;
+	char *buffer;
+	int fd;
+
+	buffer = mmap(NULL, CHUNK_SIZE, PROT_READ | PROT_WRITE,
+		      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buffer == MAP_FAILED)
+		error(1, errno, "mmap");
+	memset(buffer, 'a', CHUNK_SIZE);
+
+	fd = socket(cfg_family, SOCK_STREAM, 0);
+	if (fd == -1)
+		error(1, errno, "socket");
+
+	if (cfg_mss)
+		do_setsockopt(fd, IPPROTO_TCP, TCP_MAXSEG, cfg_mss);
+
+	setup_sockaddr(&addr, &alen, cfg_host);
+	if (connect(fd, (void *)&addr, alen))
+		error(1, errno, "connect");
+
+	while (total < cfg_total) {
+		size_t len = cfg_total - total;
+		ssize_t wr;
+
+		if (len > CHUNK_SIZE)
+			len = CHUNK_SIZE;
+
+		wr = send(fd, buffer, len, 0);
+		if (wr <= 0)
+			error(1, errno, "send");
+		total += wr;
+	}
+
+	if (close(fd))
+		error(1, errno, "close");
+	munmap(buffer, CHUNK_SIZE);
+}
+
+static void usage(const char *filepath)
+{
+	error(1, 0, "Usage: %s [-4|-6] [-s [-z] | -H host] [-p port] [-M mss] [-t bytes]",
+	      filepath);
+}
+
+static void parse_opts(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "46H:M:p:st:z")) != -1) {
+		switch (c) {
+		case '4':
+			cfg_family = AF_INET;
+			break;
+		case '6':
+			cfg_family = AF_INET6;
+			break;
+		case 'H':
+			cfg_host = optarg;
+			break;
+		case 'M':
+			cfg_mss = strtol(optarg, NULL, 0);
+			break;
+		case 'p':
+			cfg_port = strtol(optarg, NULL, 0);
+			break;
+		case 's':
+			cfg_server = true;
+			break;
+		case 't':
+			cfg_total = strtoll(optarg, NULL, 0);
+			break;
+		case 'z':
+			cfg_zerocopy = true;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (cfg_server == !!cfg_host)
+		usage(argv[0]);
+}
+
+int main(int argc, char **argv)
+{
+	parse_opts(argc, argv);
+
+	if (cfg_server)
+		do_server();
+	else
+		do_client();
+
+	return 0;
+}
@@ -0,0 +1,289 @@
+/* Test the kernel TLS receive path over loopback
+ *
+ * Install the same AES-GCM-128 key as TLS_TX on one end of a TCP
+ * connection and as TLS_RX on the other, then check that the receiver
+ * gets the plaintext back, that every read reports the record type
+ * through a TLS_GET_RECORD_TYPE cmsg, that records of different types
+ * are never merged into one read and that a non-data record is refused
+ * to a reader that passes no room for the cmsg.
+ */
+
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <error.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#ifndef TCP_ULP
+#define TCP_ULP		31
+#endif
+
+#ifndef SOL_TLS
+#define SOL_TLS		282
+#endif
+
+/* linux/tls.h pulls in kernel-only headers, so carry what we need */
+#define TLS_TX			1
+#define TLS_RX			2
+#define TLS_SET_RECORD_TYPE	1
+#define TLS_GET_RECORD_TYPE	2
+
+#define TLS_1_2_VERSION		0x0303
+#define TLS_CIPHER_AES_GCM_128	51
+
+struct tls12_crypto_info_aes_gcm_128 {
+	struct {
+		uint16_t version;
+		uint16_t cipher_type;
+	} info;
+	unsigned char iv[8];
+	unsigned char key[16];
+	unsigned char salt[4];
+	unsigned char rec_seq[8];
+};
+
+#define RECORD_TYPE_DATA	0x17
+#define RECORD_TYPE_HANDSHAKE	0x16
+
+#define BUF_SIZE		(1 << 16)
+
+static int cfg_port = 8000;
+static char sbuf[BUF_SIZE];
+static char rbuf[BUF_SIZE];
+
+static void set_key(int fd, int optname)
+{
+	struct tls12_crypto_info_aes_gcm_128 info;
+
+	memset(&info, 0, sizeof(info));
+	info.info.version = TLS_1_2_VERSION;
+	info.info.cipher_type = TLS_CIPHER_AES_GCM_128;
+	memset(info.key, 0x11, sizeof(info.key));
+	memset(info.salt, 0x22, sizeof(info.salt));
+	memset(info.iv, 0x33, sizeof(info.iv));
+
+	if (setsockopt(fd, SOL_TLS, optname, &info, sizeof(info)))
+		error(1, errno, "setsockopt tls %s",
+		      optname == TLS_TX ? "tx" : "rx");
+}
+
+static void setup_pair(int *fdt, int *fdr)
+{
+	struct sockaddr_in addr = {0};
+	socklen_t alen = sizeof(addr);
+	int fdl, one = 1;
+
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(cfg_port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	fdl = socket(AF_INET, SOCK_STREAM, 0);
+	if (fdl == -1)
+		error(1, errno, "socket l");
+	if (setsockopt(fdl, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)))
+		error(1, errno, "setsockopt reuseaddr");
+	if (bind(fdl, (void *)&addr, alen))
+		error(1, errno, "bind");
+	if (listen(fdl, 1))
+		error(1, errno, "listen");
+
+	*fdt = socket(AF_INET, SOCK_STREAM, 0);
+	if (*fdt == -1)
+		error(1, errno, "socket t");
+	if (connect(*fdt, (void *)&addr, alen))
+		error(1, errno, "connect");
+
+	*fdr = accept(fdl, NULL, NULL);
+	if (*fdr == -1)
+		error(1, errno, "accept");
+	if (close(fdl))
+		error(1, errno, "close l");
+
+	if (setsockopt(*fdt, IPPROTO_TCP, TCP_ULP, "tls", sizeof("tls")))
+		error(1, errno, "setsockopt ulp t");
+	if (setsockopt(*fdr, IPPROTO_TCP, TCP_ULP, "tls", sizeof("tls")))
+		error(1, errno, "setsockopt ulp r");
+
+	set_key(*fdt, TLS_TX);
+	set_key(*fdr, TLS_RX);
+}
+
+static void send_record(int fd, int len, unsigned char type)
+{
+	char control[CMSG_SPACE(sizeof(type))] = {0};
+	struct msghdr msg = {0};
+	struct iovec iov;
+	struct cmsghdr *cm;
+	int ret;
+
+	iov.iov_base = sbuf;
+	iov.iov_len = len;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+
+	if (type != RECORD_TYPE_DATA) {
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+
+		cm = CMSG_FIRSTHDR(&msg);
+		cm->cmsg_level = SOL_TLS;
+		cm->cmsg_type = TLS_SET_RECORD_TYPE;
+		cm->cmsg_len = CMSG_LEN(sizeof(type));
+		*CMSG_DATA(cm) = type;
+	}
+
+	ret = sendmsg(fd, &msg, 0);
+	if (ret == -1)
+		error(1, errno, "sendmsg");
+	if (ret != len)
+		error(1, 0, "sendmsg: %d != %d", ret, len);
+}
+
+/* Read up to len bytes, return the count and the reported record type */
+static int recv_record(int fd, int len, int flags, unsigned char *type)
+{
+	char control[CMSG_SPACE(sizeof(*type))] = {0};
+	struct msghdr msg = {0};
+	struct iovec iov;
+	struct cmsghdr *cm;
+	int ret;
+
+	iov.iov_base = rbuf;
+	iov.iov_len = len;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	ret = recvmsg(fd, &msg, flags);
+	if (ret == -1)
+		error(1, errno, "recvmsg");
+
+	cm = CMSG_FIRSTHDR(&msg);
+	if (!cm || cm->cmsg_level != SOL_TLS ||
+	    cm->cmsg_type != TLS_GET_RECORD_TYPE)
+		error(1, 0, "recvmsg: no record type cmsg");
+	*type = *CMSG_DATA(cm);
+
+	return ret;
+}
+
+static void recv_expect(int fd, int len, unsigned char type)
+{
+	unsigned char rtype;
+	int ret, off = 0;
+
+	while (off < len) {
+		ret = recv_record(fd, len - off, 0, &rtype);
+		if (rtype != type)
+			error(1, 0, "recv: type %u != %u", rtype, type);
+		if (memcmp(rbuf, sbuf + off, ret))
+			error(1, 0, "recv: data mismatch at %d", off);
+		off += ret;
+	}
+}
+
+static void test_data(int fdt, int fdr, int len)
+{
+	int i;
+
+	fprintf(stderr, "data: len=%d\n", len);
+
+	for (i = 0; i < len; i++)
+		sbuf[i] = rand();
+
+	send_record(fdt, len, RECORD_TYPE_DATA);
+	recv_expect(fdr, len, RECORD_TYPE_DATA);
+}
+
+static void test_peek(int fdt, int fdr)
+{
+	unsigned char type;
+	int ret;
+
+	fprintf(stderr, "peek\n");
+
+	memset(sbuf, 'p', 1000);
+	send_record(fdt, 1000, RECORD_TYPE_DATA);
+
+	ret = recv_record(fdr, 1000, MSG_PEEK, &type);
+	if (ret != 1000 || memcmp(rbuf, sbuf, ret))
+		error(1, 0, "peek: bad data (%d)", ret);
+	recv_expect(fdr, 1000, RECORD_TYPE_DATA);
+}
+
+static void test_types(int fdt, int fdr)
+{
+	unsigned char type;
+	int ret;
+
+	fprintf(stderr, "record types\n");
+
+	memset(sbuf, 'd', 100);
+	send_record(fdt, 100, RECORD_TYPE_DATA);
+	send_record(fdt, 100, RECORD_TYPE_HANDSHAKE);
+
+	/* a large read must stop at the record type boundary */
+	ret = recv_record(fdr, sizeof(rbuf), 0, &type);
+	if (ret != 100 || type != RECORD_TYPE_DATA)
+		error(1, 0, "types: first read %d type %u", ret, type);
+
+	/* no room for the cmsg: the handshake record is refused */
+	ret = recv(fdr, rbuf, sizeof(rbuf), 0);
+	if (ret != -1 || errno != EIO)
+		error(1, 0, "types: control read without cmsg: %d", ret);
+
+	ret = recv_record(fdr, sizeof(rbuf), 0, &type);
+	if (ret != 100 || type != RECORD_TYPE_HANDSHAKE)
+		error(1, 0, "types: second read %d type %u", ret, type);
+}
+
+static void parse_opts(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "p:")) != -1) {
+		switch (c) {
+		case 'p':
+			cfg_port = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			error(1, 0, "%s: parse error", argv[0]);
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	int fdt, fdr;
+
+	parse_opts(argc, argv);
+
+	setup_pair(&fdt, &fdr);
+
+	test_data(fdt, fdr, 1);
+	test_data(fdt, fdr, 1000);
+	test_data(fdt, fdr, 1 << 14);
+	test_data(fdt, fdr, (1 << 14) + 1);
+	test_data(fdt, fdr, BUF_SIZE);
+	test_peek(fdt, fdr);
+	test_types(fdt, fdr);
+
+	if (close(fdt))
+		error(1, errno, "close t");
+	if (close(fdr))
+		error(1, errno, "close r");
+
+	fprintf(stderr, "OK\n");
+	return 0;
+}
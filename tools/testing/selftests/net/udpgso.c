@@ -0,0 +1,259 @@
+/* Test UDP_SEGMENT over loopback
+ *
+ * Send a buffer with a segment size set through setsockopt or cmsg and
+ * verify that the receiver sees datagrams of exactly that size, plus a
+ * shorter last one if the buffer is not a multiple of it.  Loopback does
+ * not advertise NETIF_F_GSO_UDP_L4, so this exercises the software
+ * segmentation path.  Also check that invalid combinations are refused.
+ */
+
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <error.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#ifndef SOL_UDP
+#define SOL_UDP		17
+#endif
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT	103
+#endif
+
+#define UDP_MAX_SEGMENTS	(1 << 6)
+#define BUF_SIZE		(1 << 16)
+
+struct testcase {
+	int tlen;		/* send() buffer size, must be > 0 */
+	int gso_len;		/* segment size */
+	int r_num_mss;		/* recv(): number of segments of gso_len */
+	int r_len_last;		/* recv(): size of last non-mss dgram, if any */
+	bool tfail;		/* send() is expected to fail */
+};
+
+static struct testcase testcases[] = {
+	{ .tlen = 1000, .gso_len = 1000, .r_num_mss = 1 },
+	{ .tlen = 1001, .gso_len = 1000, .r_num_mss = 1, .r_len_last = 1 },
+	{ .tlen = 4000, .gso_len = 1000, .r_num_mss = 4 },
+	{ .tlen = 4321, .gso_len = 1000, .r_num_mss = 4, .r_len_last = 321 },
+	{ .tlen = 1400 * 20, .gso_len = 1400, .r_num_mss = 20 },
+	{ .tlen = 100 * UDP_MAX_SEGMENTS, .gso_len = 100,
+	  .r_num_mss = UDP_MAX_SEGMENTS },
+	{ .tlen = 100 * UDP_MAX_SEGMENTS + 1, .gso_len = 100, .tfail = true },
+	{ .tlen = 1, .gso_len = 1, .r_num_mss = 1 },
+	{ .tlen = 2, .gso_len = 1, .r_num_mss = 2 },
+};
+
+static bool cfg_do_ipv4 = true;
+static bool cfg_do_ipv6 = true;
+static int cfg_port = 8000;
+static char buf[BUF_SIZE];
+
+static void set_gso(int fd, unsigned short gso_len)
+{
+	int val = gso_len;
+
+	if (setsockopt(fd, SOL_UDP, UDP_SEGMENT, &val, sizeof(val)))
+		error(1, errno, "setsockopt udp segment");
+}
+
+static bool __send_one(int fd, struct msghdr *msg, int flags)
+{
+	int ret;
+
+	ret = sendmsg(fd, msg, flags);
+	if (ret == -1 && (errno == EMSGSIZE || errno == ENOMEM ||
+			  errno == EINVAL))
+		return false;
+	if (ret == -1)
+		error(1, errno, "sendmsg");
+	if (ret != msg->msg_iov->iov_len)
+		error(1, 0, "sendmsg: %u != %zu", ret, msg->msg_iov->iov_len);
+	if (msg->msg_flags)
+		error(1, 0, "sendmsg: return flags 0x%x", msg->msg_flags);
+
+	return true;
+}
+
+static bool send_one(int fd, int len, int gso_len, bool use_cmsg)
+{
+	char control[CMSG_SPACE(sizeof(uint16_t))] = {0};
+	struct msghdr msg = {0};
+	struct iovec iov = {0};
+	struct cmsghdr *cm;
+
+	iov.iov_base = buf;
+	iov.iov_len = len;
+
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+
+	if (use_cmsg) {
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+
+		cm = CMSG_FIRSTHDR(&msg);
+		cm->cmsg_level = SOL_UDP;
+		cm->cmsg_type = UDP_SEGMENT;
+		cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+		*((uint16_t *) CMSG_DATA(cm)) = gso_len;
+	}
+
+	return __send_one(fd, &msg, 0);
+}
+
+static int recv_one(int fd, int flags)
+{
+	int ret;
+
+	ret = recv(fd, buf, sizeof(buf), flags);
+	if (ret == -1 && errno == EAGAIN && (flags & MSG_DONTWAIT))
+		return 0;
+	if (ret == -1)
+		error(1, errno, "recv");
+
+	return ret;
+}
+
+static void run_one(struct testcase *test, int fdt, int fdr, bool use_cmsg)
+{
+	int i, ret, len, mss;
+
+	fprintf(stderr, "%s: len=%u gso=%u%s\n", use_cmsg ? "cmsg" : "sockopt",
+		test->tlen, test->gso_len, test->tfail ? " (fail)" : "");
+
+	mss = test->gso_len;
+	if (!use_cmsg)
+		set_gso(fdt, mss);
+
+	if (!send_one(fdt, test->tlen, mss, use_cmsg)) {
+		if (!test->tfail)
+			error(1, 0, "send failed unexpectedly");
+		return;
+	}
+	if (test->tfail)
+		error(1, 0, "send succeeded unexpectedly");
+
+	/* first the full size segments, then a shorter remainder if any */
+	for (i = 0; i < test->r_num_mss; i++) {
+		ret = recv_one(fdr, 0);
+		if (ret != mss)
+			error(1, 0, "recv.%d: %d != %d", i, ret, mss);
+	}
+	if (test->r_len_last) {
+		ret = recv_one(fdr, 0);
+		if (ret != test->r_len_last)
+			error(1, 0, "recv.%d: %d != %d (last)",
+			      i, ret, test->r_len_last);
+	}
+
+	/* and nothing else */
+	len = recv_one(fdr, MSG_DONTWAIT);
+	if (len)
+		error(1, 0, "recv: unexpected datagram of %d bytes", len);
+
+	if (!use_cmsg)
+		set_gso(fdt, 0);
+}
+
+static void run_test(struct sockaddr *addr, socklen_t alen)
+{
+	struct timeval tv = { .tv_usec = 100 * 1000 };
+	int fdr, fdt, i;
+
+	fdr = socket(addr->sa_family, SOCK_DGRAM, 0);
+	if (fdr == -1)
+		error(1, errno, "socket r");
+
+	if (bind(fdr, addr, alen))
+		error(1, errno, "bind");
+
+	/* Have tests fail quickly instead of hang */
+	if (setsockopt(fdr, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)))
+		error(1, errno, "setsockopt rcv timeout");
+
+	fdt = socket(addr->sa_family, SOCK_DGRAM, 0);
+	if (fdt == -1)
+		error(1, errno, "socket t");
+
+	if (connect(fdt, addr, alen))
+		error(1, errno, "connect");
+
+	for (i = 0; i < sizeof(testcases) / sizeof(testcases[0]); i++) {
+		run_one(&testcases[i], fdt, fdr, false);
+		run_one(&testcases[i], fdt, fdr, true);
+	}
+
+	if (close(fdt))
+		error(1, errno, "close t");
+	if (close(fdr))
+		error(1, errno, "close r");
+}
+
+static void run_test_v4(void)
+{
+	struct sockaddr_in addr = {0};
+
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(cfg_port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	run_test((void *)&addr, sizeof(addr));
+}
+
+static void run_test_v6(void)
+{
+	struct sockaddr_in6 addr = {0};
+
+	addr.sin6_family = AF_INET6;
+	addr.sin6_port = htons(cfg_port);
+	addr.sin6_addr = in6addr_loopback;
+
+	run_test((void *)&addr, sizeof(addr));
+}
+
+static void parse_opts(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "46p:")) != -1) {
+		switch (c) {
+		case '4':
+			cfg_do_ipv4 = true;
+			cfg_do_ipv6 = false;
+			break;
+		case '6':
+			cfg_do_ipv4 = false;
+			cfg_do_ipv6 = true;
+			break;
+		case 'p':
+			cfg_port = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			error(1, 0, "%s: parse error", argv[0]);
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	parse_opts(argc, argv);
+
+	if (cfg_do_ipv4)
+		run_test_v4();
+	if (cfg_do_ipv6)
+		run_test_v6();
+
+	fprintf(stderr, "OK\n");
+	return 0;
+}
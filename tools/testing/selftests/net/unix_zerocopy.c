@@ -0,0 +1,192 @@
+/* Test MSG_ZEROCOPY over AF_UNIX stream sockets
+ *
+ * Send buffers with MSG_ZEROCOPY over a socketpair, read them back on
+ * the peer and verify the data and the completion notifications that
+ * the sender gets on its error queue once the peer consumed the data.
+ * Also check that SO_ZEROCOPY is refused for datagram sockets.
+ */
+
+#define _GNU_SOURCE
+
+#include <error.h>
+#include <errno.h>
+#include <time.h>
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY		5
+#endif
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY	60
+#endif
+
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+#define SO_EE_CODE_ZEROCOPY_COPIED	1
+#endif
+
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY	0x4000000
+#endif
+
+#define BUF_SIZE	(1 << 16)
+
+static int cfg_num_sends = 100;
+static char sbuf[BUF_SIZE];
+static char rbuf[BUF_SIZE];
+
+static void do_setsockopt(int fd, int level, int optname, int val)
+{
+	if (setsockopt(fd, level, optname, &val, sizeof(val)))
+		error(1, errno, "setsockopt %d.%d: %d", level, optname, val);
+}
+
+static void recv_all(int fd, int len)
+{
+	int ret, off = 0;
+
+	while (off < len) {
+		ret = recv(fd, rbuf + off, len - off, 0);
+		if (ret == -1)
+			error(1, errno, "recv");
+		if (ret == 0)
+			error(1, 0, "recv: unexpected eof");
+		off += ret;
+	}
+
+	if (memcmp(rbuf, sbuf, len))
+		error(1, 0, "recv: data mismatch");
+}
+
+/* Return the number of sends the notification covers */
+static uint32_t recv_completion(int fd, uint32_t expected_lo)
+{
+	char control[100];
+	struct sock_extended_err *serr;
+	struct msghdr msg = {0};
+	struct pollfd pfd;
+	struct cmsghdr *cm;
+	int ret;
+
+	pfd.fd = fd;
+	pfd.events = 0;
+	ret = poll(&pfd, 1, 1000);
+	if (ret != 1 || !(pfd.revents & POLLERR))
+		error(1, errno, "poll: no completion");
+
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	ret = recvmsg(fd, &msg, MSG_ERRQUEUE);
+	if (ret == -1)
+		error(1, errno, "recvmsg notification");
+	if (msg.msg_flags & MSG_CTRUNC)
+		error(1, 0, "recvmsg notification: truncated");
+
+	cm = CMSG_FIRSTHDR(&msg);
+	if (!cm)
+		error(1, 0, "cmsg: no cmsg");
+	if (cm->cmsg_level != SOL_IP || cm->cmsg_type != IP_RECVERR)
+		error(1, 0, "cmsg: wrong type: %d.%d",
+		      cm->cmsg_level, cm->cmsg_type);
+
+	serr = (void *)CMSG_DATA(cm);
+	if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+		error(1, 0, "serr: wrong origin: %u", serr->ee_origin);
+	if (serr->ee_errno != 0)
+		error(1, 0, "serr: wrong error code: %u", serr->ee_errno);
+	if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+		error(1, 0, "serr: data was copied");
+	if (serr->ee_info != expected_lo)
+		error(1, 0, "serr: lo %u != %u", serr->ee_info, expected_lo);
+	if (serr->ee_data < serr->ee_info)
+		error(1, 0, "serr: hi %u < lo %u", serr->ee_data, serr->ee_info);
+
+	return serr->ee_data - serr->ee_info + 1;
+}
+
+static void test_stream(void)
+{
+	uint32_t completed = 0;
+	int fds[2], i, len, ret;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
+		error(1, errno, "socketpair");
+
+	do_setsockopt(fds[0], SOL_SOCKET, SO_ZEROCOPY, 1);
+
+	for (i = 0; i < BUF_SIZE; i++)
+		sbuf[i] = rand();
+
+	for (i = 0; i < cfg_num_sends; i++) {
+		len = 1 + (i * 4099) % BUF_SIZE;
+
+		ret = send(fds[0], sbuf, len, MSG_ZEROCOPY);
+		if (ret == -1)
+			error(1, errno, "send");
+		if (ret != len)
+			error(1, 0, "send: %d != %d", ret, len);
+
+		recv_all(fds[1], len);
+
+		/* the peer consumed everything, so this send completed */
+		while (completed < i + 1)
+			completed += recv_completion(fds[0], completed);
+	}
+
+	if (close(fds[0]) || close(fds[1]))
+		error(1, errno, "close");
+
+	fprintf(stderr, "stream: %u sends completed\n", completed);
+}
+
+static void test_dgram_refused(void)
+{
+	int fd, val = 1;
+
+	fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+	if (fd == -1)
+		error(1, errno, "socket dgram");
+
+	if (!setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &val, sizeof(val)))
+		error(1, 0, "setsockopt zerocopy on dgram: unexpected success");
+
+	if (close(fd))
+		error(1, errno, "close dgram");
+}
+
+static void parse_opts(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "n:")) != -1) {
+		switch (c) {
+		case 'n':
+			cfg_num_sends = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			error(1, 0, "%s: parse error", argv[0]);
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	parse_opts(argc, argv);
+
+	test_stream();
+	test_dgram_refused();
+
+	fprintf(stderr, "OK\n");
+	return 0;
+}
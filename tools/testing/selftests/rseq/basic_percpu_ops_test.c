@@ -0,0 +1,148 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Per-CPU counters updated with rseq, checked against the number of
+ * increments and timed against a shared atomic counter.
+ *
+ * Usage: basic_percpu_ops_test [nr_threads [nr_reps]]
+ */
+#define _GNU_SOURCE
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rseq.h"
+
+#define CPU_CACHELINE	64
+
+struct percpu_counter_entry {
+	intptr_t count;
+} __attribute__((aligned(CPU_CACHELINE)));
+
+struct percpu_counter {
+	struct percpu_counter_entry c[CPU_SETSIZE];
+};
+
+static struct percpu_counter counter;
+static intptr_t atomic_counter __attribute__((aligned(CPU_CACHELINE)));
+static long nr_reps = 5000000;
+static long nr_aborts;
+
+#if RSEQ_ARCH_SUPPORTED
+static void *test_percpu_counter_thread(void *arg)
+{
+	long i, aborts = 0;
+
+	if (rseq_register_current_thread())
+		abort();
+
+	for (i = 0; i < nr_reps; i++) {
+		for (;;) {
+			int cpu = rseq_cpu_start();
+
+			if (!rseq_addv(&counter.c[cpu].count, 1, cpu))
+				break;
+			aborts++;
+		}
+	}
+
+	__atomic_add_fetch(&nr_aborts, aborts, __ATOMIC_RELAXED);
+	if (rseq_unregister_current_thread())
+		abort();
+
+	return NULL;
+}
+#endif
+
+static void *test_atomic_counter_thread(void *arg)
+{
+	long i;
+
+	for (i = 0; i < nr_reps; i++)
+		__atomic_add_fetch(&atomic_counter, 1, __ATOMIC_RELAXED);
+
+	return NULL;
+}
+
+static double run_threads(void *(*fn)(void *), int nr_threads)
+{
+	pthread_t *threads;
+	struct timespec start, end;
+	int i;
+
+	threads = calloc(nr_threads, sizeof(*threads));
+	assert(threads);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < nr_threads; i++)
+		assert(!pthread_create(&threads[i], NULL, fn, NULL));
+	for (i = 0; i < nr_threads; i++)
+		assert(!pthread_join(threads[i], NULL));
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	free(threads);
+
+	return (end.tv_sec - start.tv_sec) * 1e9 +
+	       (end.tv_nsec - start.tv_nsec);
+}
+
+int main(int argc, char **argv)
+{
+	int nr_threads = 2 * sysconf(_SC_NPROCESSORS_ONLN);
+	double ns_rseq, ns_atomic;
+	intptr_t sum = 0;
+	int i;
+
+	if (argc > 1)
+		nr_threads = atoi(argv[1]);
+	if (argc > 2)
+		nr_reps = atol(argv[2]);
+
+#if RSEQ_ARCH_SUPPORTED
+	if (rseq_register_current_thread()) {
+		if (errno == ENOSYS) {
+			printf("rseq not supported, skipping\n");
+			return 4;	/* KSFT_SKIP */
+		}
+		fprintf(stderr, "Error: rseq_register_current_thread(...) failed(%d): %s\n",
+			errno, strerror(errno));
+		return -1;
+	}
+
+	ns_rseq = run_threads(test_percpu_counter_thread, nr_threads);
+	for (i = 0; i < CPU_SETSIZE; i++)
+		sum += counter.c[i].count;
+	if (sum != (intptr_t)nr_threads * nr_reps) {
+		fprintf(stderr, "Error: counted %ld increments, expected %ld\n",
+			(long)sum, (long)nr_threads * nr_reps);
+		return -1;
+	}
+
+	ns_atomic = run_threads(test_atomic_counter_thread, nr_threads);
+	assert(atomic_counter == (intptr_t)nr_threads * nr_reps);
+
+	printf("%d threads, %ld increments each, %ld rseq aborts\n",
+	       nr_threads, nr_reps, nr_aborts);
+	printf("rseq per-cpu counter: %.2f ns/increment\n",
+	       ns_rseq / ((double)nr_threads * nr_reps));
+	printf("shared atomic counter: %.2f ns/increment\n",
+	       ns_atomic / ((double)nr_threads * nr_reps));
+
+	if (rseq_unregister_current_thread()) {
+		fprintf(stderr, "Error: rseq_unregister_current_thread(...) failed(%d): %s\n",
+			errno, strerror(errno));
+		return -1;
+	}
+
+	return 0;
+#else
+	printf("rseq critical sections not implemented for this architecture, skipping\n");
+	return 4;	/* KSFT_SKIP */
+#endif
+}
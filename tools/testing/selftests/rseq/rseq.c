@@ -0,0 +1,59 @@
+// SPDX-License-Identifier: GPL-2.0
+#define _GNU_SOURCE
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <syscall.h>
+
+#include "rseq.h"
+
+__thread volatile struct rseq __rseq_abi = {
+	.cpu_id = RSEQ_CPU_ID_UNINITIALIZED,
+};
+
+static int sys_rseq(volatile struct rseq *rseq_abi, uint32_t rseq_len,
+		    int flags, uint32_t sig)
+{
+#ifdef __NR_rseq
+	return syscall(__NR_rseq, rseq_abi, rseq_len, flags, sig);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+int rseq_register_current_thread(void)
+{
+	int rc;
+
+	rc = sys_rseq(&__rseq_abi, sizeof(struct rseq), 0, RSEQ_SIG);
+	if (rc) {
+		/* EBUSY: already registered, leave cpu_id alone */
+		if (errno != ENOSYS && errno != EBUSY)
+			__rseq_abi.cpu_id = RSEQ_CPU_ID_REGISTRATION_FAILED;
+		return -1;
+	}
+
+	return 0;
+}
+
+int rseq_unregister_current_thread(void)
+{
+	return sys_rseq(&__rseq_abi, sizeof(struct rseq),
+			RSEQ_FLAG_UNREGISTER, RSEQ_SIG);
+}
+
+int32_t rseq_fallback_current_cpu(void)
+{
+	int32_t cpu;
+
+	cpu = sched_getcpu();
+	if (cpu < 0) {
+		perror("sched_getcpu()");
+		abort();
+	}
+
+	return cpu;
+}
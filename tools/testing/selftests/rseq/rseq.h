@@ -0,0 +1,110 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Restartable sequences helpers for the selftests
+ *
+ * Each thread registers its struct rseq with rseq_register_current_thread().
+ * rseq_addv() adds to a per-CPU value inside a critical section, and fails
+ * if the thread is not running on @cpu, or was preempted, migrated or
+ * signalled before the final add, which then did not happen.
+ */
+#ifndef RSEQ_H
+#define RSEQ_H
+
+#include <stdint.h>
+#include <linux/rseq.h>
+
+#define RSEQ_SIG	0x53053053
+
+#define RSEQ_ACCESS_ONCE(x)	(*(__volatile__ __typeof__(x) *)&(x))
+#define RSEQ_READ_ONCE(x)	RSEQ_ACCESS_ONCE(x)
+
+extern __thread volatile struct rseq __rseq_abi;
+
+int rseq_register_current_thread(void);
+int rseq_unregister_current_thread(void);
+int32_t rseq_fallback_current_cpu(void);
+
+static inline int32_t rseq_current_cpu_raw(void)
+{
+	return RSEQ_READ_ONCE(__rseq_abi.cpu_id);
+}
+
+static inline uint32_t rseq_cpu_start(void)
+{
+	return __rseq_abi.cpu_id_start;
+}
+
+#if defined(__x86_64__)
+
+#define RSEQ_ARCH_SUPPORTED	1
+
+#define __rseq_str_1(x)	#x
+#define __rseq_str(x)	__rseq_str_1(x)
+
+/* Offsets in struct rseq */
+#define RSEQ_CPU_ID_OFFSET	4
+#define RSEQ_CS_OFFSET		8
+
+/*
+ * The struct rseq_cs of a critical section: it starts at start_ip, ends
+ * right after its commit at post_commit_ip, and aborts to abort_ip.
+ */
+#define RSEQ_ASM_DEFINE_TABLE(label, start_ip, post_commit_ip, abort_ip) \
+		".pushsection __rseq_table, \"aw\"\n\t"			\
+		".balign 32\n\t"					\
+		__rseq_str(label) ":\n\t"				\
+		".long 0x0, 0x0\n\t"					\
+		".quad " __rseq_str(start_ip) ", ("			\
+		__rseq_str(post_commit_ip) " - "			\
+		__rseq_str(start_ip) "), " __rseq_str(abort_ip) "\n\t"	\
+		".popsection\n\t"
+
+#define RSEQ_ASM_STORE_RSEQ_CS(label, cs_label, rseq_cs)		\
+		"leaq " __rseq_str(cs_label) "(%%rip), %%rax\n\t"	\
+		"movq %%rax, " __rseq_str(rseq_cs) "\n\t"		\
+		__rseq_str(label) ":\n\t"
+
+#define RSEQ_ASM_CMP_CPU_ID(cpu_id, current_cpu_id, label)		\
+		"cmpl %[" __rseq_str(cpu_id) "], "			\
+		__rseq_str(current_cpu_id) "\n\t"			\
+		"jnz " __rseq_str(label) "\n\t"
+
+/* The signature is encoded as nopl <sig>(%rip) right before the handler */
+#define RSEQ_ASM_DEFINE_ABORT(label, abort_label)			\
+		".pushsection __rseq_failure, \"ax\"\n\t"		\
+		".byte 0x0f, 0x1f, 0x05\n\t"				\
+		".long " __rseq_str(RSEQ_SIG) "\n\t"			\
+		__rseq_str(label) ":\n\t"				\
+		"jmp %l[" __rseq_str(abort_label) "]\n\t"		\
+		".popsection\n\t"
+
+static inline __attribute__((always_inline))
+int rseq_addv(intptr_t *v, intptr_t count, int cpu)
+{
+	__asm__ __volatile__ goto (
+		RSEQ_ASM_DEFINE_TABLE(3, 1f, 2f, 4f)
+		/* Start rseq by storing table entry pointer into rseq_cs. */
+		RSEQ_ASM_STORE_RSEQ_CS(1, 3b, RSEQ_CS_OFFSET(%[rseq_abi]))
+		RSEQ_ASM_CMP_CPU_ID(cpu_id, RSEQ_CPU_ID_OFFSET(%[rseq_abi]), 4f)
+		/* final store */
+		"addq %[count], %[v]\n\t"
+		"2:\n\t"
+		RSEQ_ASM_DEFINE_ABORT(4, abort)
+		: /* gcc asm goto does not allow outputs */
+		: [cpu_id]	"r" (cpu),
+		  [rseq_abi]	"r" (&__rseq_abi),
+		  [v]		"m" (*v),
+		  [count]	"er" (count)
+		: "memory", "cc", "rax"
+		: abort
+	);
+	return 0;
+abort:
+	return -1;
+}
+
+#else
+#define RSEQ_ARCH_SUPPORTED	0
+#endif
+
+#endif /* RSEQ_H */
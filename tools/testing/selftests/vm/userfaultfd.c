@@ -437,6 +437,17 @@ static int copy_page(int ufd, unsigned long offset)
 	return __copy_page(ufd, offset, false);
 }
 
+static void wp_range(int ufd, __u64 start, __u64 len, bool wp)
+{
+	struct uffdio_writeprotect prms = { 0 };
+
+	prms.range.start = start;
+	prms.range.len = len;
+	prms.mode = wp ? UFFDIO_WRITEPROTECT_MODE_WP : 0;
+	if (ioctl(ufd, UFFDIO_WRITEPROTECT, &prms))
+		fprintf(stderr, "UFFDIO_WRITEPROTECT failure\n"), exit(1);
+}
+
 static void *uffd_poll_thread(void *arg)
 {
 	unsigned long cpu = (unsigned long) arg;
@@ -480,11 +491,17 @@ static void *uffd_poll_thread(void *arg)
 				msg.event), exit(1);
 			break;
 		case UFFD_EVENT_PAGEFAULT:
-			if (msg.arg.pagefault.flags & UFFD_PAGEFAULT_FLAG_WRITE)
-				fprintf(stderr, "unexpected write fault\n"), exit(1);
 			offset = (char *)(unsigned long)msg.arg.pagefault.address -
 				area_dst;
 			offset &= ~(page_size-1);
+			if (msg.arg.pagefault.flags & UFFD_PAGEFAULT_FLAG_WP) {
+				wp_range(uffd, (unsigned long)area_dst + offset,
+					 page_size, false);
+				userfaults++;
+				break;
+			}
+			if (msg.arg.pagefault.flags & UFFD_PAGEFAULT_FLAG_WRITE)
+				fprintf(stderr, "unexpected write fault\n"), exit(1);
 			if (copy_page(uffd, offset))
 				userfaults++;
 			break;
@@ -1008,6 +1025,66 @@ static int userfaultfd_sig_test(void)
 	close(uffd);
 	return userfaults != 0;
 }
+
+/* exercise UFFDIO_WRITEPROTECT, on anonymous memory only */
+static int userfaultfd_wp_test(void)
+{
+	struct uffdio_register uffdio_register;
+	unsigned long userfaults;
+	pthread_t uffd_mon;
+	unsigned long nr;
+	char c;
+
+	if (test_type != TEST_ANON)
+		return 0;
+
+	printf("testing UFFDIO_WRITEPROTECT: ");
+	fflush(stdout);
+
+	if (uffd_test_ops->release_pages(area_dst))
+		return 1;
+	memset(area_dst, 1, nr_pages * page_size);
+
+	if (userfaultfd_open(UFFD_FEATURE_PAGEFAULT_FLAG_WP) < 0)
+		return 1;
+	uffdio_register.range.start = (unsigned long) area_dst;
+	uffdio_register.range.len = nr_pages * page_size;
+	uffdio_register.mode = UFFDIO_REGISTER_MODE_WP;
+	if (ioctl(uffd, UFFDIO_REGISTER, &uffdio_register))
+		fprintf(stderr, "register failure\n"), exit(1);
+
+	if (!(uffdio_register.ioctls & (1 << _UFFDIO_WRITEPROTECT)))
+		fprintf(stderr,
+			"unexpected missing ioctl for anon memory\n"),
+			exit(1);
+
+	wp_range(uffd, (unsigned long) area_dst, nr_pages * page_size, true);
+
+	if (pthread_create(&uffd_mon, &attr, uffd_poll_thread, NULL))
+		perror("uffd_poll_thread create"), exit(1);
+
+	/* every first write to a page has to wait for the monitor */
+	for (nr = 0; nr < nr_pages; nr++) {
+		area_dst[nr * page_size] = 2;
+		area_dst[nr * page_size + 1] = 2;
+	}
+
+	if (write(pipefd[1], &c, sizeof(c)) != sizeof(c))
+		perror("pipe write"), exit(1);
+	if (pthread_join(uffd_mon, (void **)&userfaults))
+		return 1;
+
+	for (nr = 0; nr < nr_pages; nr++)
+		if (area_dst[nr * page_size] != 2 ||
+		    area_dst[nr * page_size + 2] != 1)
+			fprintf(stderr, "page %lu corrupted\n", nr), exit(1);
+
+	close(uffd);
+	printf("userfaults: %ld\n", userfaults);
+
+	return userfaults != nr_pages;
+}
+
 static int userfaultfd_stress(void)
 {
 	void *area;
@@ -1198,7 +1275,7 @@ static int userfaultfd_stress(void)
 
 	close(uffd);
 	return userfaultfd_zeropage_test() || userfaultfd_sig_test()
-		|| userfaultfd_events_test();
+		|| userfaultfd_events_test() || userfaultfd_wp_test();
 }
 
 /*
@@ -0,0 +1,152 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * KVM dirty ring
+ *
+ * Each vcpu pushes the gfns it dirties in a ring that userspace maps at
+ * KVM_DIRTY_LOG_PAGE_OFFSET of the vcpu fd.  Userspace collects the entries
+ * with KVM_DIRTY_GFN_F_DIRTY set, in order, then flags them with
+ * KVM_DIRTY_GFN_F_RESET.  KVM_RESET_DIRTY_RINGS write protects those gfns
+ * again and gives the entries back to the vcpus.
+ */
+
+#include <linux/kvm_host.h>
+#include <linux/kvm.h>
+#include <linux/vmalloc.h>
+#include <linux/kvm_dirty_ring.h>
+
+static u32 kvm_dirty_ring_used(struct kvm_dirty_ring *ring)
+{
+	return READ_ONCE(ring->dirty_index) - READ_ONCE(ring->reset_index);
+}
+
+bool kvm_dirty_ring_soft_full(struct kvm_dirty_ring *ring)
+{
+	return kvm_dirty_ring_used(ring) >= ring->soft_limit;
+}
+
+static bool kvm_dirty_ring_full(struct kvm_dirty_ring *ring)
+{
+	return kvm_dirty_ring_used(ring) >= ring->size;
+}
+
+static void kvm_reset_dirty_gfn(struct kvm *kvm, u32 slot, u64 offset,
+				u64 mask)
+{
+	struct kvm_memory_slot *memslot;
+	int as_id, id;
+
+	if (!mask)
+		return;
+
+	as_id = slot >> 16;
+	id = (u16)slot;
+	if (as_id >= KVM_ADDRESS_SPACE_NUM || id >= KVM_USER_MEM_SLOTS)
+		return;
+
+	/* the slot may have changed since the gfn was pushed */
+	memslot = id_to_memslot(__kvm_memslots(kvm, as_id), id);
+	if (!memslot->dirty_bitmap || offset + __fls(mask) >= memslot->npages)
+		return;
+
+	KVM_MMU_LOCK(kvm);
+	kvm_arch_mmu_enable_log_dirty_pt_masked(kvm, memslot, offset, mask);
+	KVM_MMU_UNLOCK(kvm);
+}
+
+int kvm_dirty_ring_alloc(struct kvm_dirty_ring *ring, u32 size)
+{
+	ring->dirty_gfns = vzalloc(size);
+	if (!ring->dirty_gfns)
+		return -ENOMEM;
+
+	ring->size = size / sizeof(struct kvm_dirty_gfn);
+	ring->soft_limit = ring->size - kvm_dirty_ring_get_rsvd_entries();
+	ring->dirty_index = 0;
+	ring->reset_index = 0;
+	return 0;
+}
+
+/*
+ * Called with kvm->slots_lock held: returns the number of entries reset.
+ * The write protection of consecutive gfns of a slot is enabled again in
+ * batches of BITS_PER_LONG.
+ */
+int kvm_dirty_ring_reset(struct kvm *kvm, struct kvm_dirty_ring *ring)
+{
+	struct kvm_dirty_gfn *entry;
+	u32 cur_slot = 0, next_slot;
+	u64 cur_offset = 0, next_offset;
+	unsigned long mask = 0;
+	int count = 0;
+
+	while (ring->reset_index != READ_ONCE(ring->dirty_index)) {
+		entry = &ring->dirty_gfns[ring->reset_index & (ring->size - 1)];
+
+		/* pairs with the writes of userspace */
+		if (!(smp_load_acquire(&entry->flags) & KVM_DIRTY_GFN_F_RESET))
+			break;
+
+		next_slot = READ_ONCE(entry->slot);
+		next_offset = READ_ONCE(entry->offset);
+
+		/* the entry can be pushed again once reset_index moves */
+		WRITE_ONCE(entry->flags, 0);
+		smp_store_release(&ring->reset_index, ring->reset_index + 1);
+		count++;
+
+		if (mask && next_slot == cur_slot) {
+			s64 delta = next_offset - cur_offset;
+
+			if (delta >= 0 && delta < BITS_PER_LONG) {
+				mask |= 1UL << delta;
+				continue;
+			}
+
+			/* backwards, if the mask does not overflow */
+			if (delta < 0 && delta > -BITS_PER_LONG &&
+			    (mask << -delta >> -delta) == mask) {
+				cur_offset = next_offset;
+				mask = (mask << -delta) | 1;
+				continue;
+			}
+		}
+		kvm_reset_dirty_gfn(kvm, cur_slot, cur_offset, mask);
+		cur_slot = next_slot;
+		cur_offset = next_offset;
+		mask = 1;
+	}
+	kvm_reset_dirty_gfn(kvm, cur_slot, cur_offset, mask);
+
+	return count;
+}
+
+/*
+ * Called by the vcpu owning @ring: false if it is full, the caller then
+ * records the gfn in the dirty bitmap of the slot.
+ */
+bool kvm_dirty_ring_push(struct kvm_dirty_ring *ring, u32 slot, u64 offset)
+{
+	struct kvm_dirty_gfn *entry;
+
+	if (kvm_dirty_ring_full(ring))
+		return false;
+
+	entry = &ring->dirty_gfns[ring->dirty_index & (ring->size - 1)];
+	entry->slot = slot;
+	entry->offset = offset;
+	/* userspace must see the gfn before the flag */
+	smp_store_release(&entry->flags, KVM_DIRTY_GFN_F_DIRTY);
+	WRITE_ONCE(ring->dirty_index, ring->dirty_index + 1);
+	return true;
+}
+
+struct page *kvm_dirty_ring_get_page(struct kvm_dirty_ring *ring, u32 offset)
+{
+	return vmalloc_to_page((void *)ring->dirty_gfns + offset * PAGE_SIZE);
+}
+
+void kvm_dirty_ring_free(struct kvm_dirty_ring *ring)
+{
+	vfree(ring->dirty_gfns);
+	ring->dirty_gfns = NULL;
+}